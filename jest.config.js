@@ -160,9 +160,11 @@ const config = {
   // ],
 
   // An array of regexp pattern strings that are matched against all test paths, matched tests are skipped
-  // testPathIgnorePatterns: [
-  //   "/node_modules/"
-  // ],
+  // The performance tier is run on its own, with test/perf/jest.config.js.
+  testPathIgnorePatterns: [
+    "/node_modules/",
+    "/test/perf/"
+  ],
 
   // The regexp pattern or array of patterns that Jest uses to detect test files
   // testRegex: [],
@@ -195,4 +197,4 @@ const config = {
   // watchman: true,
 };
 
-module.exports = config;
+export default config;
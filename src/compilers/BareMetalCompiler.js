@@ -0,0 +1,373 @@
+/* eslint-disable curly */
+/* eslint-disable eqeqeq */
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import { execSync } from 'child_process';
+import fs from 'fs';
+import path from "path";
+import { Compiler, IECLanguage, OutputType, CommunicationProtocol } from './Compiler.js';
+import * as iec from "./iec-parser/parser.js";
+import { parseStructuredText } from './st-parser/parser.js';
+import { transpile } from './st-parser/gcctranspiler.js';
+import { optimize } from './st-parser/ir.js';
+import { parseAddress } from './st-parser/expressionConverter.js';
+import { CPPCompiler, parseTaskInterval, sizeProcessImage, locatedAddressExpression } from './CPPCompiler.js';
+import { fileURLToPath } from 'node:url';
+import { dirname } from 'node:path';
+
+const __filename = fileURLToPath(import.meta.url);
+const __dirname = dirname(__filename);
+
+/**
+ * The toolchain of the cortex-m target. A board adds its startup code and HAL to cortex-m-sources, and its linker
+ * script as cortex-m-ldscript, in the toolchain.json of the source directory.
+ */
+const DEFAULT_TOOLCHAIN = {
+    "cortex-m": "arm-none-eabi-g++",
+    "cortex-m-cpu": "cortex-m4",
+    "cortex-m-flags": "",
+    "cortex-m-ldscript": "",
+    "cortex-m-sources": []
+};
+
+/**
+ * The runtime sources of the cortex-m target, in support/baremetal.
+ */
+const RUNTIME_SOURCES = ['scheduler.cpp', 'modbusrtu.cpp'];
+
+/**
+ * The smallest size of each space of the image. The image of a microcontroller is sized to the addresses the program
+ * uses, rather than to the defaults of the generic runtime, which would take most of the RAM of a small part.
+ */
+const PROCESS_IMAGE_MINIMUM = { I: 8, Q: 8, M: 8 };
+
+/**
+ * The function blocks and constructs of the generic runtime that the bare-metal runtime leaves out, by the C++ the
+ * transpiler emits for them.
+ */
+const UNSUPPORTED_CONSTRUCTS = [
+    [/\b\w+_BANK</, "function block banks"],
+    [/\bPID(?:_LREAL)?\s+\w+\s*;/, "PID"],
+    [/\bMOVING_AVG\b/, "MOVING_AVG"],
+    [/\bLOWPASS\b/, "LOWPASS"],
+    [/\bRAMP\b/, "RAMP"],
+    [/\bLIN_TABLE\b/, "LIN_TABLE"],
+    [/\b(?:PULSE_OUT|SET_OUT_AT)\b/, "timed outputs"],
+    [/\bSfcChart\b/, "SFC charts"]
+];
+
+const WORD_ORDERS = { ABCD: 0, CDAB: 1, BADC: 2, DCBA: 3 };
+
+/**
+ * Compiles programs for Cortex-M microcontrollers without an operating system. The program is built with the
+ * freestanding runtime of support/baremetal, without a heap, exceptions or RTTI, and its cyclic tasks are released
+ * by SysTick. Its IO is GPIO pins and Modbus RTU slaves on the board's UARTs, which are compiled into static tables.
+ */
+export class BareMetalCompiler extends Compiler {
+    constructor(options) {
+        super(options);
+        this.name = 'BareMetalCompiler';
+    }
+
+    get supportedLanguages() {
+        return [IECLanguage.STRUCTURED_TEXT, IECLanguage.LADDER_DIAGRAM];
+    }
+
+    get supportedOutputTypes() {
+        return [OutputType.EXECUTABLE, OutputType.SOURCE_CODE];
+    }
+
+    get supportedTargetDevices() {
+        return ['cortex-m'];
+    }
+
+    get supportedProtocols() {
+        return [CommunicationProtocol.MODBUS];
+    }
+
+    get compilerVersion() {
+        return '1.0.0';
+    }
+
+    async compile() {
+        const { sourcePath, outputPath, outputType, resourceName, boundsChecks, cpu } = this.options;
+
+        this.toolchain = { ...DEFAULT_TOOLCHAIN };
+        const sourceDir = fs.lstatSync(sourcePath).isDirectory() ? sourcePath : path.dirname(sourcePath);
+        const toolchainConfigPath = path.join(sourceDir, "toolchain.json");
+        if (fs.existsSync(toolchainConfigPath)) {
+            try {
+                const customToolchain = JSON.parse(fs.readFileSync(toolchainConfigPath, "utf-8"));
+                if (typeof customToolchain !== "object" || customToolchain === null) {
+                    throw new Error("The toolchain configuration must be a JSON object.");
+                }
+                this.toolchain = { ...this.toolchain, ...customToolchain };
+            } catch (err) {
+                throw new Error(`Failed to load toolchain configuration from ${toolchainConfigPath}: ${err.message}`);
+            }
+        }
+        else {
+            fs.writeFileSync(toolchainConfigPath, JSON.stringify(this.toolchain, null, 4));
+        }
+
+        var sourceCode = fs.readFileSync(sourcePath, 'utf-8');
+        const filename = path.basename(sourcePath, path.extname(sourcePath));
+        const cppFile = path.join(outputPath, `${filename}.cpp`);
+        if(sourcePath.toLowerCase().endsWith(".iec") || sourcePath.toLowerCase().endsWith(".xml")){
+            if(typeof resourceName === "undefined" || resourceName === null || resourceName.length === 0){
+                throw new Error("You must provide the resourceName option for an IEC project file.");
+            }
+            const iecProj = iec.Project.fromXML(sourceCode, resourceName);
+            let stcode = "";
+            iecProj.Instances.Configurations.forEach((c) => {
+                if(stcode.length > 0) return;
+                const res = c.Resources.find(r => r.Name === resourceName);
+                if(res){
+                    stcode = res.toST();
+                }
+            });
+            if(stcode.length === 0){
+                throw new Error("No resource was found by the name " + resourceName + " or the resource could not be parsed.");
+            }
+            sourceCode = stcode;
+        }
+
+        const parsed = parseStructuredText(sourceCode);
+        const imageSizes = sizeProcessImage(sourceCode, PROCESS_IMAGE_MINIMUM);
+        const optimized = optimize(parsed, { addressReads: true });
+
+        const tasks = [];
+        const programs = [];
+        const maps = [];
+        const mapCompiler = new CPPCompiler({});
+        sourceCode.split("\n").forEach((line) => {
+            if(line.trim().startsWith("//Task=")){
+                const task = JSON.parse(line.substring(line.indexOf("=") + 1).trim());
+                if(String(task.Single ?? "").trim() !== ""){
+                    throw new Error(`Task ${task.Name} is an event task, which the cortex-m target doesn't run. Its tasks must be cyclic.`);
+                }
+                task.Instances = [];
+                tasks.push(task);
+            }
+            else if(line.trim().startsWith("//Instance=")){
+                const instance = JSON.parse(line.substring(line.indexOf("=") + 1).trim());
+                tasks.find((t) => t.Name === instance.AssociatedTaskName)?.Instances.push(instance);
+            }
+            else if(line.trim().startsWith("//Map=")){
+                const map = mapCompiler.compileMap(line.substring(line.indexOf("=") + 1).trim());
+                if(!map.row){
+                    throw new Error(`The mapping ${line.substring(line.indexOf("=") + 1).trim()} could not be read.`);
+                }
+                maps.push(map.row);
+            }
+            else if(line.trim().startsWith("PROGRAM")){
+                let pname = line.trim().substring(line.trim().indexOf(" ") + 1).trim();
+                pname = pname.split(/\s|\/\/|\(\*/)[0];
+                programs.push(pname);
+            }
+        });
+
+        const transpiled = transpile(optimized, {});
+        UNSUPPORTED_CONSTRUCTS.forEach(([pattern, name]) => {
+            if(pattern.test(transpiled)){
+                throw new Error(`The program uses ${name}, which the cortex-m target doesn't support.`);
+            }
+        });
+
+        // The tasks are a static table the scheduler keeps its statistics in. Without tasks, every program runs in a
+        // task of 1 ms, as on the other targets.
+        const taskList = tasks.length > 0 ?
+            tasks.map((t) => {
+                const priority = parseInt(t.Priority);
+                return { name: t.Name, interval: parseTaskInterval(t.Interval), priority: isNaN(priority) ? 0 : priority,
+                    programs: t.Instances.map((i) => i.TypeName) };
+            }) :
+            [{ name: "MainTask", interval: 1, priority: 0, programs }];
+        const taskFunctions = taskList.map((t, x) =>
+            `static void runTask${x}() {\n${t.programs.map((p) => `  ${p}();\n`).join("")}}\n`).join("");
+        const taskRows = taskList.map((t, x) =>
+            `  { ${JSON.stringify(t.name)}, ${t.interval}, ${Math.min(Math.max(t.priority, 0), 255)}, runTask${x}, 0, 0, 0, 0, 0, 0 }`);
+
+        const gpio = maps.filter((r) => r.protocol === "GPIO").map((r) => this.gpioRow(r));
+        const lines = this.modbusRtuLines(maps.filter((r) => r.protocol === "MODBUS-RTU"));
+        const unsupported = maps.find((r) => r.protocol !== "GPIO" && r.protocol !== "MODBUS-RTU");
+        if(unsupported){
+            throw new Error(`The cortex-m target maps GPIO and MODBUS-RTU, not ${unsupported.protocol} (${unsupported.localAddress}).`);
+        }
+        const rtuMaps = lines.flatMap((l) => l.maps);
+
+        let code = `#include "nodalis.h"\n\n${transpiled}\n`;
+        code += `alignas(8) uint8_t PROCESS_IMAGE[PROCESS_IMAGE_BYTES];\n\n`;
+        code += taskFunctions;
+        code += `\nstatic NodalisTask TASKS[] = {\n${taskRows.join(",\n")}\n};\n`;
+        if(gpio.length > 0){
+            code += `static const GpioMapDefinition GPIO_MAPS[] = {\n${gpio.join(",\n")}\n};\n`;
+        }
+        if(lines.length > 0){
+            code += `static const ModbusRtuLineDefinition RTU_LINES[] = {\n${lines.map((l) => l.row).join(",\n")}\n};\n` +
+                `static ModbusRtuLineState RTU_STATES[${lines.length}];\n` +
+                `static const ModbusRtuMapDefinition RTU_MAPS[] = {\n${rtuMaps.join(",\n")}\n};\n` +
+                `static uint32_t RTU_DUE[${rtuMaps.length}];\n`;
+        }
+        code += `
+static const NodalisTarget TARGET = {
+  TASKS, ${taskList.length},
+  ${gpio.length > 0 ? "GPIO_MAPS" : "nullptr"}, ${gpio.length},
+  ${lines.length > 0 ? "RTU_LINES, RTU_STATES" : "nullptr, nullptr"}, ${lines.length},
+  ${lines.length > 0 ? "RTU_MAPS, RTU_DUE" : "nullptr, nullptr"}
+};
+
+int main() {
+  nodalisRun(TARGET);
+}
+`;
+
+        if (!fs.existsSync(outputPath)) {
+            fs.mkdirSync(outputPath, { recursive: true });
+        }
+        const coreDir = path.resolve(__dirname + '/support/baremetal');
+        fs.readdirSync(coreDir).forEach((file) => fs.copyFileSync(path.join(coreDir, file), path.join(outputPath, file)));
+        // The standard functions are shared with the generic runtime.
+        fs.copyFileSync(path.resolve(__dirname + '/support/generic/iecfunctions.h'), path.join(outputPath, 'iecfunctions.h'));
+        fs.writeFileSync(path.join(outputPath, "runtimeconfig.h"),
+`#pragma once
+#define NODALIS_INPUT_BYTES ${imageSizes.I}
+#define NODALIS_OUTPUT_BYTES ${imageSizes.Q}
+#define NODALIS_MEMORY_BYTES ${imageSizes.M}
+${boundsChecks === true ? "#define NODALIS_ARRAY_BOUNDS_CHECK 1\n" : ""}`);
+        fs.writeFileSync(cppFile, code);
+
+        if (outputType === 'executable') {
+            const ldscript = this.toolchain["cortex-m-ldscript"];
+            if (!ldscript) {
+                throw new Error(`The cortex-m target is linked with the board's linker script, which must be given as cortex-m-ldscript in ${toolchainConfigPath}, along with its startup code in cortex-m-sources. Use --outputType code to build the sources with the board's own project instead.`);
+            }
+            const resolve = (file) => path.isAbsolute(file) ? file : path.resolve(sourceDir, file);
+            const boardSources = [].concat(this.toolchain["cortex-m-sources"] ?? []).map(resolve);
+            const sources = [cppFile, ...RUNTIME_SOURCES.map((s) => path.join(outputPath, s)), ...boardSources];
+            const flags = `-mcpu=${cpu ?? this.toolchain["cortex-m-cpu"]} -mthumb -std=c++17 -Os -ffreestanding -fno-exceptions -fno-rtti ` +
+                `-fno-threadsafe-statics -fno-use-cxa-atexit -ffunction-sections -fdata-sections ${this.toolchain["cortex-m-flags"] ?? ""}`.trim();
+            const elfFile = path.join(outputPath, `${filename}.elf`);
+            execSync(`${this.toolchain["cortex-m"]} ${flags} -I"${outputPath}" ${sources.map((s) => `"${s}"`).join(" ")} ` +
+                `-Wl,--gc-sections --specs=nano.specs --specs=nosys.specs -T "${resolve(ldscript)}" -o "${elfFile}"`, { stdio: 'inherit' });
+        }
+    }
+
+    /**
+     * Parses the ProtocolProperties of a mapping.
+     * @param {object} row The row of the mapping, from compileMap().
+     * @returns {object} Returns the properties, or an empty object if there are none.
+     */
+    mapProperties(row) {
+        if(!row.properties){
+            return {};
+        }
+        try {
+            const props = JSON.parse(row.properties);
+            return props && typeof props === "object" ? props : {};
+        }
+        catch(e) {
+            throw new Error(`The ProtocolProperties of ${row.localAddress} are not valid JSON.`);
+        }
+    }
+
+    /**
+     * Compiles a GPIO mapping into a row of the pin table. The port is a number, or a letter from A, and the pin is the
+     * RemoteAddress.
+     * @param {object} row The row of the mapping.
+     * @returns {string} Returns the row.
+     */
+    gpioRow(row) {
+        const local = parseAddress(row.localAddress);
+        if(local.bit < 0 || local.space === "M"){
+            throw new Error(`GPIO mapping ${row.localAddress} must be a bit of %I or %Q.`);
+        }
+        const port = /^[A-Za-z]$/.test(row.moduleID.trim()) ? row.moduleID.trim().toUpperCase().charCodeAt(0) - 65 : parseInt(row.moduleID, 10);
+        const pin = parseInt(row.remoteAddress, 10);
+        if(isNaN(port) || isNaN(pin) || port < 0 || port > 255 || pin < 0 || pin > 255){
+            throw new Error(`GPIO mapping ${row.localAddress} must give its port as ModuleID and its pin as RemoteAddress.`);
+        }
+        const activeLow = this.mapProperties(row).ActiveLow === true;
+        return `  { ${port}, ${pin}, ${local.space === "Q"}, ${activeLow}, ${locatedAddressExpression(row.localAddress)} }`;
+    }
+
+    /**
+     * Compiles the MODBUS-RTU mappings into a table of lines, one for each UART, with the rows of their mappings.
+     * The settings of a line are taken from its first mapping.
+     * @param {object[]} rows The rows of the mappings.
+     * @returns {{row: string, maps: string[]}[]} Returns the lines.
+     */
+    modbusRtuLines(rows) {
+        const lines = new Map();
+        rows.forEach((row) => {
+            const uart = parseInt((row.modulePort.match(/(\d+)$/) ?? [])[1], 10);
+            if(isNaN(uart) || uart > 255){
+                throw new Error(`MODBUS-RTU mapping ${row.localAddress} must give the number of its UART as ModulePort.`);
+            }
+            if(!lines.has(uart)){
+                lines.set(uart, []);
+            }
+            lines.get(uart).push(row);
+        });
+        let first = 0;
+        return [...lines.entries()].map(([uart, members]) => {
+            const props = this.mapProperties(members[0]);
+            const number = (value, fallback) => {
+                const n = parseInt(value, 10);
+                return isNaN(n) ? fallback : n;
+            };
+            const parity = String(props.Parity ?? "E").toUpperCase().charAt(0);
+            const line = `  { ${uart}, ${number(props.BaudRate, 9600)}, '${"EON".includes(parity) ? parity : "E"}', ${number(props.StopBits, 1)}, ` +
+                `${number(props.ResponseTimeout, 1000)}, ${number(props.TurnaroundDelay, 100)}, ${first}, ${members.length} }`;
+            first += members.length;
+            return { row: line, maps: members.map((row) => this.modbusRtuRow(row, this.mapProperties(row), number)) };
+        });
+    }
+
+    /**
+     * Compiles a MODBUS-RTU mapping into a row of the map table.
+     * @param {object} row The row of the mapping.
+     * @param {object} props The ProtocolProperties of the mapping.
+     * @param {function} number Parses an integer property, with a fallback.
+     * @returns {string} Returns the row.
+     */
+    modbusRtuRow(row, props, number) {
+        const local = parseAddress(row.localAddress);
+        const output = local.space === "Q";
+        const isBit = row.width === 1;
+        if(row.remoteAddress.includes(".")){
+            throw new Error(`The cortex-m target maps Modbus registers whole, not the bit ${row.remoteAddress} for ${row.localAddress}.`);
+        }
+        if(isBit !== (local.bit > -1) || (!isBit && row.width !== local.width) || ![1, 8, 16, 32, 64].includes(row.width)){
+            throw new Error(`MODBUS-RTU mapping ${row.localAddress} must have the width of its address, not ${row.width}.`);
+        }
+        const dataType = String(props.DataType ?? "").toUpperCase();
+        if((dataType === "REAL" && row.width !== 32) || (dataType === "LREAL" && row.width !== 64)){
+            throw new Error(`MODBUS-RTU mapping ${row.localAddress} is ${dataType}, which the cortex-m target only maps to an address of its own width.`);
+        }
+        let fn = output ? (isBit ? 15 : 16) : (isBit ? 2 : 3);
+        const requested = number(props.Function, 0);
+        if(!output && ((isBit && (requested === 1 || requested === 2)) || (!isBit && (requested === 3 || requested === 4)))){
+            fn = requested;
+        }
+        const address = parseInt(row.remoteAddress, 10);
+        if(isNaN(address) || address < 0 || address > 65535){
+            throw new Error(`MODBUS-RTU mapping ${row.localAddress} has an invalid RemoteAddress: ${row.remoteAddress}`);
+        }
+        const unit = number(props.UnitID, number(row.moduleID, 1));
+        const order = WORD_ORDERS[String(props.WordOrder ?? "ABCD").toUpperCase()] ?? 0;
+        return `  { ${unit}, ${fn}, ${address}, ${row.width}, ${order}, ${Math.max(row.interval, 1)}, ${locatedAddressExpression(row.localAddress)} }`;
+    }
+}
@@ -14,14 +14,19 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-import { execSync } from 'child_process';
+import { execSync, execFileSync, spawn } from 'child_process';
 import os from 'os';
 import fs from 'fs';
+import crypto from 'crypto';
 import path from "path";
 import { Compiler, IECLanguage, OutputType, CommunicationProtocol } from './Compiler.js';
 import * as iec from "./iec-parser/parser.js";
 import { parseStructuredText } from './st-parser/parser.js';
-import { transpile } from './st-parser/gcctranspiler.js';
+import { listPOUs, programAccesses, parallelStages, exchangedGlobals, addressBytes } from './st-parser/gcctranspiler.js';
+import { transpileParallel } from './st-parser/paralleltranspiler.js';
+import { optimize } from './st-parser/ir.js';
+import { estimateCosts, costWeights } from './st-parser/costmodel.js';
+import { parseAddress, AddressError, getCppReadAddressExpression } from './st-parser/expressionConverter.js';
 import { fileURLToPath } from 'node:url';
 import { dirname } from 'node:path';
 
@@ -30,6 +35,7 @@ const __dirname = dirname(__filename);
 
 const DEFAULT_TOOLCHAIN = {
     "linux-arm": "arm-linux-gnueabi-g++",
+    "linux-armhf": "arm-linux-gnueabihf-g++",
     "linux-arm64": "aarch64-linux-gnu-g++",
     "linux-x64": "x86_64-linux-gnu-g++",
     "macos-arm64": "clang++",
@@ -38,7 +44,854 @@ const DEFAULT_TOOLCHAIN = {
     "windows-arm64": "/opt/llvm-mingw/bin/aarch64-w64-mingw32-g++"
 };
 
-let ToolChain = { ...DEFAULT_TOOLCHAIN };
+/**
+ * The CPU each target is tuned for when a build doesn't name one, for the C++ compiler's -mtune. Tuning schedules
+ * the code for that CPU without using instructions that other CPUs of the target lack.
+ */
+const DEFAULT_CPU_TUNING = {
+    "linux-arm64": "cortex-a53",
+    "linux-armhf": "cortex-a7"
+};
+
+/**
+ * The runtime sources that are built into the runtime library every program of a target links against.
+ */
+const RUNTIME_SOURCES = ['nodalis.cpp', 'modbus.cpp', 'opcua.cpp', 'bacnet.cpp', 'ioreactor.cpp', 'metrics.cpp', 'redundancy.cpp', 'netvar.cpp', 'recorder.cpp', 'simulation.cpp', 'historian.cpp', 'watch.cpp', 'alarms.cpp', 'sparkplug.cpp', 'localio.cpp', 'enip.cpp', 'iocapture.cpp', 'iodriver.cpp', 'clocksync.cpp', 'timedio.cpp', 'ioscheduler.cpp'];
+
+/**
+ * The protocols a runtime can be built without, by name, with the macro of runtimeconfig.h that leaves each out, its
+ * runtime source, and the Protocols of the IO maps that use it. Those built on a prebuilt library also have the
+ * library and headers a target needs under support/generic, and the script that builds them.
+ */
+const RUNTIME_PROTOCOLS = {
+    modbus: { macro: "NODALIS_MODBUS", source: "modbus.cpp", protocols: ["MODBUS-TCP", "MODBUS-RTU"] },
+    opcua: { macro: "NODALIS_OPCUA", source: "opcua.cpp", protocols: ["OPCUA"], title: "OPC UA", script: "open62541/opc-build.sh",
+        prebuilt: (target, windows) => [path.join("open62541", "lib", target, windows ? "open62541.lib" : "open62541.o")] },
+    bacnet: { macro: "NODALIS_BACNET", source: "bacnet.cpp", protocols: ["BACNET", "BACNET-IP"], title: "BACnet", script: "bacnet-stack/bacnet-build.sh",
+        prebuilt: (target) => [path.join("bacnet-stack", target, "libbacnet.a"), path.join("bacnet-stack", target, "include")] }
+};
+
+/**
+ * Bounds how many toolchain processes the builds of this process run at once. Builds queue for a slot, so a batch of
+ * targets keeps every core busy without starting all of its compilers together.
+ */
+const toolchainSlots = { limit: Math.max(1, os.availableParallelism?.() ?? os.cpus().length), active: 0, waiting: [] };
+
+/**
+ * The builds of cached files that are under way, by the file they produce, so that builds in the same process that
+ * need the same object or library wait for one build of it.
+ */
+const pendingBuilds = new Map();
+
+/**
+ * Sets how many toolchain processes may run at once.
+ * @param {number} jobs The number of processes, at least 1.
+ */
+export function setToolchainJobs(jobs){
+    toolchainSlots.limit = Math.max(1, Math.trunc(jobs) || 1);
+    while(toolchainSlots.waiting.length > 0 && toolchainSlots.active < toolchainSlots.limit){
+        toolchainSlots.active++;
+        toolchainSlots.waiting.shift()();
+    }
+}
+
+/**
+ * Runs a toolchain command once a slot is free, without blocking the event loop.
+ * @param {string} command The command line.
+ * @returns {Promise<void>} Resolves when the command succeeds, and rejects if it fails.
+ */
+async function runToolchain(command){
+    if(toolchainSlots.active < toolchainSlots.limit){
+        toolchainSlots.active++;
+    }
+    else{
+        await new Promise((resolve) => toolchainSlots.waiting.push(resolve));
+    }
+    try {
+        await new Promise((resolve, reject) => {
+            const child = spawn(command, { shell: true, stdio: 'inherit' });
+            child.on('error', reject);
+            child.on('close', (code) => code === 0 ? resolve() : reject(new Error(`Command failed: ${command}`)));
+        });
+    } finally {
+        const next = toolchainSlots.waiting.shift();
+        if(next){
+            next();
+        }
+        else{
+            toolchainSlots.active--;
+        }
+    }
+}
+
+/**
+ * Builds a cached file unless it exists, sharing one build between the callers that need it at the same time.
+ * @param {string} file The file the build produces.
+ * @param {function(): Promise<void>} build Builds the file.
+ * @returns {Promise<string>} Returns the file.
+ */
+function buildOnce(file, build){
+    if(fs.existsSync(file)){
+        return Promise.resolve(file);
+    }
+    if(!pendingBuilds.has(file)){
+        pendingBuilds.set(file, build().then(() => file).finally(() => pendingBuilds.delete(file)));
+    }
+    return pendingBuilds.get(file);
+}
+
+/**
+ * The `--version` output of each compiler that has been asked, so a process building many resources asks once.
+ */
+const compilerVersions = new Map();
+
+/**
+ * Gets the build cache directory, NODALIS_CACHE or ~/.nodalis/cache.
+ * @returns {string} Returns the path to the cache.
+ */
+function cacheRoot(){
+    return process.env.NODALIS_CACHE || path.join(os.homedir(), '.nodalis', 'cache');
+}
+
+/**
+ * Gets the version of a compiler, as part of the key of everything it builds.
+ * @param {string} compiler The C++ compiler.
+ * @returns {string} Returns the output of `--version`, or an empty string for cl.exe or a compiler that doesn't say.
+ */
+function compilerVersion(compiler){
+    if(!compilerVersions.has(compiler)){
+        let version = "";
+        if(compiler !== 'cl.exe'){
+            try {
+                version = execSync(`${compiler} --version`, { stdio: ['ignore', 'pipe', 'ignore'] }).toString();
+            } catch {
+                // detectCompiler has already checked that the compiler runs.
+            }
+        }
+        compilerVersions.set(compiler, version);
+    }
+    return compilerVersions.get(compiler);
+}
+
+/**
+ * Hashes the headers in a directory, and the named sources, by name and content.
+ * @param {crypto.Hash} hash The hash to update.
+ * @param {string} dir The directory.
+ * @param {string[]} sources The .cpp files to include.
+ * @param {string[]} excluded The headers to leave out.
+ */
+function hashHeaders(hash, dir, sources = [], excluded = []){
+    fs.readdirSync(dir).filter((file) => /\.(h|hpp|cpp)$/.test(file) && !excluded.includes(file) && !fs.statSync(path.join(dir, file)).isDirectory())
+        .filter((file) => sources.includes(file) || !file.endsWith('.cpp')).sort().forEach((file) => {
+            hash.update(`${file}\n`).update(fs.readFileSync(path.join(dir, file)));
+        });
+}
+
+/**
+ * Hashes a file by content, or by its absence.
+ * @param {crypto.Hash} hash The hash to update.
+ * @param {string} file The file.
+ */
+function hashFile(hash, file){
+    hash.update(`${file}\n`);
+    if(fs.existsSync(file)){
+        hash.update(fs.readFileSync(file));
+    }
+}
+
+/**
+ * The relocations in code that make it position dependent: absolute addresses, and addresses relative to the code of
+ * a symbol that another module could define, which position independent code reaches through its global offset table.
+ * A shared library can't be linked from code with either.
+ */
+const ABSOLUTE_RELOCATION = /^R_(X86_64_32S?|ARM_ABS32|ARM_MOV[WT]_ABS(_NC)?|AARCH64_ABS(16|32)|AARCH64_MOVW_UABS_G\d(_NC)?)$/;
+const RELATIVE_RELOCATION = /^R_(X86_64_PC32|AARCH64_ADR_PREL_PG_HI21(_NC)?|AARCH64_ADD_ABS_LO12_NC|AARCH64_LDST\d+_ABS_LO12_NC)$/;
+
+/**
+ * Finds code that isn't position independent in a prebuilt object or archive, from the relocations of its code
+ * sections, which readelf lists for objects of any architecture.
+ * @param {string} file The object or archive.
+ * @returns {string|null|undefined} Returns the first relocation that isn't position independent, such as
+ * "R_X86_64_32S against .rodata.CSWTCH.1 in abort.o", null if there is none, or undefined if readelf wasn't found.
+ */
+function positionDependentCode(file){
+    let listing;
+    for(const readelf of ["readelf", "llvm-readelf"]){
+        try {
+            listing = execFileSync(readelf, ["-rsW", file], { encoding: 'utf-8', maxBuffer: 1 << 30, stdio: ['ignore', 'pipe', 'pipe'] });
+            break;
+        }
+        catch(e) {
+            if(e.code !== 'ENOENT') throw e;
+        }
+    }
+    if(listing === undefined) return undefined;
+    // An archive is listed member by member, each with its relocations and then its symbols.
+    let member = path.basename(file), section = "", relocations = [], preemptible = new Set();
+    const check = () => {
+        const found = relocations.find(({ type, symbol }) => ABSOLUTE_RELOCATION.test(type) || (RELATIVE_RELOCATION.test(type) && preemptible.has(symbol)));
+        return found ? `${found.type} against ${found.symbol} in ${member}` : null;
+    };
+    for(const line of listing.split("\n")){
+        let match;
+        if((match = /^File: .*\((.+)\)$/.exec(line))){
+            const found = check();
+            if(found) return found;
+            member = match[1];
+            relocations = [];
+            preemptible = new Set();
+        }
+        else if((match = /^Relocation section '([^']+)'/.exec(line))){
+            section = match[1];
+        }
+        else if((match = /^[0-9a-f]+\s+[0-9a-f]+\s+(R_\w+)\s+[0-9a-f]+\s+(\S+)/.exec(line))){
+            if(/^\.rela?\.text/.test(section)){
+                relocations.push({ type: match[1], symbol: match[2] });
+            }
+        }
+        else if((match = /^\s*\d+:\s+[0-9a-f]+\s+\S+\s+\S+\s+(?:GLOBAL|WEAK)\s+DEFAULT\s+\S+\s+([^@\s]+)/.exec(line))){
+            preemptible.add(match[1]);
+        }
+    }
+    return check();
+}
+
+/**
+ * Checks that a target has the prebuilt libraries of the protocols its runtime is built with, so that a target they
+ * haven't been built for yet fails before the build rather than in the compiler or linker.
+ * @param {string} target The target, such as linux-armhf.
+ * @param {boolean} windows True for a Windows target, whose open62541 is a .lib.
+ * @param {Set<string>} built The names of the protocols the runtime is built with.
+ * @throws {Error} Throws if a prebuilt library or its headers are missing.
+ */
+function checkPrebuilts(target, windows, built){
+    const generic = path.resolve(__dirname, "support", "generic");
+    Object.entries(RUNTIME_PROTOCOLS).filter(([name, p]) => built.has(name) && p.prebuilt).forEach(([, p]) => {
+        const missing = p.prebuilt(target, windows).find((file) => !fs.existsSync(path.join(generic, file)));
+        if(missing !== undefined){
+            throw new Error(`${p.title} isn't available for ${target} yet: there is no prebuilt ${missing}, which ${p.script} builds. ` +
+                `Build the program without ${p.title} mappings, or build the prebuilts for ${target} first.`);
+        }
+    });
+}
+
+/**
+ * Finds the protocols a program's runtime is built with: those of its IO maps, OPC UA when it has located globals or
+ * browsed variables for the OPC UA server to serve, and those it names. A map that couldn't be read at compile time could use any of them,
+ * so its program is built with them all.
+ * @param {object[]} maps The compiled //Map= lines.
+ * @param {boolean} serves True if the program has located globals, or browses its variables.
+ * @param {string[]} named The protocols to build in whether or not they are used, as names of RUNTIME_PROTOCOLS, or "all".
+ * @returns {Set<string>} Returns the names of the protocols.
+ */
+function runtimeProtocols(maps, serves, named){
+    const unknown = named.find((name) => name !== "all" && !RUNTIME_PROTOCOLS[name]);
+    if(unknown !== undefined){
+        throw new Error(`Unknown protocol ${unknown}. Use ${Object.keys(RUNTIME_PROTOCOLS).join(", ")} or all.`);
+    }
+    if(named.includes("all") || maps.some((m) => !m.row)){
+        return new Set(Object.keys(RUNTIME_PROTOCOLS));
+    }
+    const used = new Set(named);
+    maps.forEach((m) => {
+        Object.entries(RUNTIME_PROTOCOLS).filter(([, p]) => p.protocols.includes(m.row.protocol)).forEach(([name]) => used.add(name));
+    });
+    if(serves){
+        used.add("opcua");
+    }
+    return used;
+}
+
+/**
+ * Writes a file only if its content differs, so that an unchanged file keeps its time stamp.
+ * @param {string} file The file.
+ * @param {string} content The content.
+ * @returns {boolean} Returns true if the file was written.
+ */
+function writeIfChanged(file, content){
+    if(fs.existsSync(file) && (Buffer.isBuffer(content) ? fs.readFileSync(file).equals(content) : fs.readFileSync(file, 'utf-8') === content)){
+        return false;
+    }
+    fs.writeFileSync(file, content);
+    return true;
+}
+
+/**
+ * Copies a directory tree, skipping every file whose copy already has the same size and time stamp. Copies are
+ * given the time stamp of their source, so a tree that was copied before costs only a stat of each file.
+ * @param {string} source The directory to copy.
+ * @param {string} destination The directory to copy it to.
+ */
+function syncTree(source, destination){
+    fs.mkdirSync(destination, { recursive: true });
+    fs.readdirSync(source, { withFileTypes: true }).forEach((entry) => {
+        const from = path.join(source, entry.name);
+        const to = path.join(destination, entry.name);
+        if(entry.isDirectory()){
+            syncTree(from, to);
+            return;
+        }
+        const stat = fs.statSync(from);
+        const copy = fs.existsSync(to) ? fs.statSync(to) : null;
+        if(copy && copy.size === stat.size && Math.trunc(copy.mtimeMs) === Math.trunc(stat.mtimeMs)){
+            return;
+        }
+        fs.copyFileSync(from, to);
+        fs.utimesSync(to, stat.atime, stat.mtime);
+    });
+}
+
+/**
+ * Converts a task interval to milliseconds. Intervals can be a plain number of milliseconds, or an IEC duration like T#100ms or T#1s.
+ * @param {string} interval The interval from the task metadata.
+ * @returns {number} Returns the interval in milliseconds, or 1000 if it could not be parsed.
+ */
+export function parseTaskInterval(interval){
+    const text = String(interval ?? "").trim().toLowerCase().replace(/^(t|time)#/, "").replace(/_/g, "");
+    if(/^\d+(\.\d+)?$/.test(text)){
+        return Math.round(parseFloat(text));
+    }
+    const units = { d: 86400000, h: 3600000, m: 60000, s: 1000, ms: 1, us: 0.001, ns: 0.000001 };
+    const parts = [...text.matchAll(/(\d+(?:\.\d+)?)(ms|us|ns|d|h|m|s)/g)];
+    if(parts.length === 0 || parts.map(p => p[0]).join("") !== text){
+        return 1000;
+    }
+    return Math.max(1, Math.round(parts.reduce((total, p) => total + parseFloat(p[1]) * units[p[2]], 0)));
+}
+
+/**
+ * Gets the C++ expression an event task reads its trigger with. The Single of the task is a located BOOL, a global, or
+ * a variable of a program instance, like Main.Start.
+ * @param {{Name: string, Single?: string}} task The task metadata.
+ * @param {Map<string, string>} globalAddresses The addresses of the globals, by upper case name.
+ * @returns {string|null} Returns the expression, or null if the task is cyclic.
+ * @throws {AddressError} if the trigger is not a BOOL address or a variable.
+ */
+export function taskTrigger(task, globalAddresses){
+    const single = String(task.Single ?? "").trim();
+    if(single === ""){
+        return null;
+    }
+    const address = single.startsWith("%") ? single : globalAddresses.get(single.toUpperCase());
+    if(address !== undefined){
+        const parsed = parseAddress(address);
+        if(parsed.bit < 0){
+            throw new AddressError(`Task ${task.Name} must be triggered by a BOOL, not ${single}`);
+        }
+        return getCppReadAddressExpression(address);
+    }
+    if(!/^[A-Za-z_]\w*(\.[A-Za-z_]\w*)+$/.test(single)){
+        throw new AddressError(`Task ${task.Name} has an invalid trigger: ${single}`);
+    }
+    return single;
+}
+
+/**
+ * The ProtocolProperties of a BACnet mapping that describe its point, and are compiled into the point table.
+ * Properties of the client, like MaxAPDU, are left in the mapping.
+ */
+const BACNET_POINT_PROPERTIES = ["objectType", "ObjectType", "objectInstance", "ObjectInstance", "propertyId", "PropertyId",
+    "valueType", "ValueType", "arrayIndex", "ArrayIndex", "COV", "COVConfirmed", "COVLifetime", "Priority"];
+
+/**
+ * The fields of a mapping that the runtime requires, as strings, to map it.
+ */
+const MAP_FIELDS = ["Protocol", "ModuleID", "ModulePort", "RemoteAddress", "InternalAddress", "RemoteSize", "PollTime"];
+
+/**
+ * Writes a string as a C++ string literal.
+ * @param {string} text The string.
+ * @returns {string} Returns the quoted and escaped literal.
+ */
+function cppString(text){
+    return `"${text.replace(/[\\"]/g, "\\$&").replace(/[\x00-\x1f\x7f]/g, (c) => "\\" + c.charCodeAt(0).toString(8).padStart(3, "0"))}"`;
+}
+
+/**
+ * The application tags of the BACnet value types, by their ValueType letter. Anything else is enumerated.
+ */
+const BACNET_VALUE_TYPES = { i: 3, u: 2, d: 5, b: 1, f: 4 };
+
+/**
+ * Parses the point of a BACnet mapping at compile time, the way the runtime would parse its ProtocolProperties.
+ * @param {object} props The ProtocolProperties of the mapping.
+ * @returns {object|null} Returns the point, or null if the runtime should parse it instead.
+ */
+export function parseBACnetPoint(props){
+    const first = (...keys) => keys.map((k) => props[k]).find((v) => v !== undefined);
+    const number = (value, fallback) => {
+        if(value === undefined) return fallback;
+        const parsed = typeof value === "number" ? Math.trunc(value) : parseInt(String(value), 10);
+        return isNaN(parsed) ? null : parsed;
+    };
+    const flag = (value) => {
+        if(typeof value === "string") return value.trim().toLowerCase() === "true" || value === "1";
+        return value === undefined ? false : Boolean(value);
+    };
+    const point = {
+        objectType: number(first("objectType", "ObjectType"), 0),
+        objectInstance: number(first("objectInstance", "ObjectInstance"), 0),
+        propertyId: number(first("propertyId", "PropertyId"), 85),
+        arrayIndex: number(first("arrayIndex", "ArrayIndex"), -1),
+        valueType: BACNET_VALUE_TYPES[String(first("valueType", "ValueType") ?? "")] ?? 9,
+        priority: number(props.Priority, 16),
+        cov: flag(props.COV),
+        covConfirmed: flag(props.COVConfirmed),
+        covLifetime: number(props.COVLifetime, 300)
+    };
+    if(Object.values(point).some((v) => v === null)){
+        return null;
+    }
+    if(point.priority < 0 || point.priority > 16){
+        point.priority = 16;
+    }
+    return point;
+}
+
+/**
+ * The default sizes of the %I, %Q and %M spaces of the process image, in bytes.
+ */
+const PROCESS_IMAGE_DEFAULTS = { I: 512, Q: 512, M: 7168 };
+
+/**
+ * Counts the elements of an array from the dimensions of its declaration.
+ * @param {string} dimensions The dimensions, as in "0..9, 1..4".
+ * @returns {number} Returns the number of elements.
+ */
+function arrayElements(dimensions){
+    return dimensions.split(",").reduce((count, range) => {
+        const [low, high] = range.split("..").map((bound) => parseInt(bound, 10));
+        return isNaN(low) || isNaN(high) ? count : count * Math.max(high - low + 1, 0);
+    }, 1);
+}
+
+/**
+ * Sizes the process image so that every located address in a program is in it, with all of the elements of a located
+ * array. The sizes can be raised with a //ProcessImage={"I":1024,"Q":1024,"M":65536} line in the source.
+ * @param {string} sourceCode The source of the program.
+ * @param {object} [minimum] The smallest size of each space, in bytes. A target without room for the default image
+ * sizes it to the addresses the program uses instead.
+ * @returns {object} Returns the size of each space in bytes.
+ */
+export function sizeProcessImage(sourceCode, minimum = PROCESS_IMAGE_DEFAULTS){
+    const sizes = { ...minimum };
+    const widths = { X: 1, B: 1, W: 2, D: 4, L: 8 };
+    for(const match of sourceCode.matchAll(/%([IQM])([XBWDL])(\d+)(?:\.(\d+))?(?:\s*:\s*ARRAY\s*\[([^\]]*)\])?/gi)){
+        const width = widths[match[2].toUpperCase()];
+        const start = parseInt(match[3], 10) * width;
+        const end = match[4] !== undefined ? start + Math.floor(parseInt(match[4], 10) / 8) + 1
+            : start + width * (match[5] !== undefined ? arrayElements(match[5]) : 1);
+        const space = match[1].toUpperCase();
+        sizes[space] = Math.max(sizes[space], end);
+    }
+    sourceCode.split("\n").filter((line) => line.trim().startsWith("//ProcessImage=")).forEach((line) => {
+        const requested = JSON.parse(line.substring(line.indexOf("=") + 1).trim());
+        Object.keys(sizes).forEach((space) => {
+            const bytes = parseInt(requested[space], 10);
+            if(!isNaN(bytes)){
+                sizes[space] = Math.max(sizes[space], bytes);
+            }
+        });
+    });
+    return sizes;
+}
+
+/**
+ * Moves the located addresses of a program into its window of a host's process image, by adding the offset of the
+ * window in each space to them. The offsets are multiples of 8 bytes, so an address keeps its width.
+ * @param {string} sourceCode The source of the program.
+ * @param {object} base The offset of the window in each space, in bytes.
+ * @returns {string} Returns the source with its addresses moved.
+ */
+export function relocateAddresses(sourceCode, base){
+    const widths = { X: 1, B: 1, W: 2, D: 4, L: 8 };
+    return sourceCode.replace(/%([IQM])([XBWDL])(\d+)/gi, (match, space, width, index) =>
+        `%${space}${width}${parseInt(index, 10) + base[space.toUpperCase()] / widths[width.toUpperCase()]}`);
+}
+
+/**
+ * Lays out the process image of a host that runs several resources, giving each a window of %I, %Q and %M of its own
+ * that no other resource's addresses reach. Every resource is built with the sizes of the whole image, and with a
+ * retained range that spans the RETAIN globals of all of them.
+ * @param {string[]} sources The source of each resource.
+ * @returns {{base: object, sizes: object, retain: {start: number, bytes: number}}[]} Returns the window of each
+ * resource, for its imageWindow option.
+ */
+export function layoutHostImage(sources){
+    const round = (bytes) => Math.ceil(bytes / 8) * 8;
+    const sizes = { I: 0, Q: 0, M: 0 };
+    let start = Infinity;
+    let end = 0;
+    const bases = sources.map((sourceCode) => {
+        const own = sizeProcessImage(sourceCode);
+        const base = { ...sizes };
+        const retained = findRetainRegion(parseStructuredText(sourceCode));
+        if(retained.bytes > 0){
+            start = Math.min(start, base.M + retained.start);
+            end = Math.max(end, base.M + retained.start + retained.bytes);
+        }
+        Object.keys(sizes).forEach((space) => {
+            sizes[space] += round(own[space]);
+        });
+        return base;
+    });
+    const retain = end > 0 ? { start, bytes: end - start } : { start: 0, bytes: 0 };
+    return bases.map((base) => ({ base, sizes, retain }));
+}
+
+/**
+ * Finds the part of %M that holds the RETAIN globals of a program, which the runtime keeps in its retain file.
+ * @param {object} parsed The parsed program.
+ * @returns {{start: number, bytes: number}} Returns the byte range within %M, with no bytes if nothing is retained.
+ */
+export function findRetainRegion(parsed){
+    let start = Infinity;
+    let end = 0;
+    parsed.body.filter((block) => block.type === "GlobalVars").forEach((block) => {
+        block.variables.filter((v) => v.retain).forEach((v) => {
+            const addr = v.address ? (v.address.startsWith("%") ? v.address : "%" + v.address) : "";
+            const located = addr ? parseAddress(addr) : null;
+            if(!located || located.space !== "M"){
+                throw new AddressError(`RETAIN variable ${v.name} must be located in %M memory`);
+            }
+            const first = located.index * located.width / 8 + (located.bit > -1 ? Math.floor(located.bit / 8) : 0);
+            start = Math.min(start, first);
+            end = Math.max(end, located.bit > -1 ? first + 1 : first + located.width / 8);
+        });
+    });
+    return end > 0 ? { start, bytes: end - start } : { start: 0, bytes: 0 };
+}
+
+/**
+ * Gets the C++ expression of a located address resolved at compile time, which fails to compile if the address is
+ * outside of the image.
+ * @param {string} address The address.
+ * @returns {string} Returns the expression.
+ */
+export function locatedAddressExpression(address){
+    const { space, width, index, bit } = parseAddress(address);
+    return bit > -1 ? `locatedAddress<MEMORY_SPACE::${space}, ${width}, ${index}, ${bit}>()`
+        : `locatedAddress<MEMORY_SPACE::${space}, ${width}, ${index}>()`;
+}
+
+/**
+ * Builds the cost report of a program: the estimated worst case of each POU and of each cyclic task, which runs its
+ * program instances one after another. A task whose worst case is longer than its interval, and a POU with a loop
+ * without a known bound, are reported as warnings, since the estimate can't be relied on for either.
+ * @param {object} parsed The parsed program.
+ * @param {{name: string, interval: number, programs: string[]}[]} tasks The cyclic tasks, with their interval in
+ * milliseconds and the types of their program instances.
+ * @param {string} target The target the weights are for.
+ * @returns {{report: object, warnings: string[]}} Returns the report, to be written as JSON, and the warnings.
+ */
+export function costReport(parsed, tasks, target){
+    const costs = estimateCosts(parsed, target);
+    const warnings = [];
+    costs.forEach((cost) => {
+        if(cost.loops.some((loop) => loop.iterations === null)){
+            warnings.push(`${cost.name} has a loop without a known bound, so its estimated cost is only a lower bound`);
+        }
+    });
+    const round = (us) => Math.round(us * 1000) / 1000;
+    const taskCosts = tasks.map((task) => {
+        const instances = task.programs.map((p) => costs.get(p.toUpperCase())).filter((cost) => cost);
+        const cycles = instances.reduce((sum, cost) => sum + cost.cycles, 0);
+        const microseconds = instances.reduce((sum, cost) => sum + cost.microseconds, 0);
+        const exceeds = microseconds > task.interval * 1000;
+        if(exceeds){
+            warnings.push(`Task ${task.name} is estimated to take ${round(microseconds)} us in the worst case, ` +
+                `longer than its interval of ${task.interval} ms`);
+        }
+        return { name: task.name, interval: task.interval, programs: task.programs, cycles, microseconds: round(microseconds),
+            unbounded: instances.some((cost) => cost.unbounded), exceeds };
+    });
+    const report = {
+        target,
+        weights: costWeights(target),
+        pous: [...costs.values()].map((cost) => ({ ...cost, microseconds: round(cost.microseconds) })),
+        tasks: taskCosts
+    };
+    return { report, warnings };
+}
+
+/**
+ * Lays out the located globals and IO mappings of a program in its process image, so that the addresses the
+ * generated code and the runtime resolve without checks are known to be valid. An address outside of its space, a
+ * bit beyond the width of its address, or a mapping whose RemoteSize isn't the width of its address is an error.
+ * Located globals of which one aliases part of another, two names for one location, and input mappings that more
+ * than one device writes are reported as warnings, since they may be meant. Bits of a located word, and globals
+ * located in a mapped range, are not.
+ * @param {object} parsed The parsed program.
+ * @param {object[]} maps The compiled IO mappings, from compileMap().
+ * @param {Map<string, string>} globalAddresses The address of each //Global= line, by upper case name.
+ * @param {object} imageSizes The size of each space, from sizeProcessImage().
+ * @returns {{entries: object[], warnings: string[]}} Returns the byte range of each global and mapping in its space,
+ * with its bit or -1, and the warnings.
+ * @throws {AddressError} if an address is invalid or outside of the image.
+ */
+export function layoutMemoryMap(parsed, maps, globalAddresses, imageSizes){
+    const entries = [];
+    const place = (name, address, elements, kind) => {
+        const located = parseAddress(address);
+        const bytes = located.width / 8;
+        if(located.bit >= located.width){
+            throw new AddressError(`${name} selects bit ${located.bit} of a ${located.width} bit address: ${address}`);
+        }
+        const start = located.index * bytes + (located.bit > -1 ? located.bit >> 3 : 0);
+        const end = located.bit > -1 ? start + 1 : start + bytes * elements;
+        if(end > imageSizes[located.space]){
+            throw new AddressError(`${name} at ${address} ends at byte ${end} of %${located.space}, ` +
+                `which has ${imageSizes[located.space]} bytes`);
+        }
+        entries.push({ name, address, kind, space: located.space, start, end, bit: located.bit > -1 ? located.bit & 7 : -1 });
+    };
+    const names = new Set();
+    parsed.body.filter((block) => block.type === "GlobalVars").forEach((block) => {
+        block.variables.filter((v) => v.address).forEach((v) => {
+            names.add(v.name.toUpperCase());
+            place(v.name, v.address.startsWith("%") ? v.address : "%" + v.address,
+                v.array ? v.array.dimensions.reduce((count, { low, high }) => count * (high - low + 1), 1) : 1, "variable");
+        });
+    });
+    globalAddresses.forEach((address, name) => {
+        if(!names.has(name)){
+            place(name, address, 1, "variable");
+        }
+    });
+    maps.filter((m) => m.row).forEach(({ row }) => {
+        const name = `${row.protocol} mapping ${row.moduleID} ${row.remoteAddress}`;
+        const located = parseAddress(row.localAddress);
+        if(located.bit > -1 ? row.width !== 1 : row.width !== located.width){
+            throw new AddressError(`${name} has a RemoteSize of ${row.width}, which doesn't fit ${row.localAddress}`);
+        }
+        place(name, row.localAddress, 1, located.space === "Q" ? "output" : "input");
+    });
+
+    // The entries of each space are swept in order of their start, so that each is only compared with those it overlaps.
+    const warnings = [];
+    const sorted = [...entries].sort((a, b) => a.space.localeCompare(b.space) || a.start - b.start);
+    sorted.forEach((a, x) => {
+        for(let y = x + 1; y < sorted.length && sorted[y].space === a.space && sorted[y].start < a.end; y++){
+            const b = sorted[y];
+            const bits = a.bit > -1 && b.bit > -1;
+            if(bits && a.bit !== b.bit){
+                continue;
+            }
+            if(a.kind === "variable" && b.kind === "variable" && (bits || (a.bit < 0 && b.bit < 0))){
+                warnings.push(a.start === b.start && a.end === b.end
+                    ? `${a.name} (${a.address}) and ${b.name} (${b.address}) are the same location`
+                    : `${a.name} (${a.address}) and ${b.name} (${b.address}) overlap`);
+            }
+            else if(a.kind !== "variable" && b.kind !== "variable" && a.address.toUpperCase() === b.address.toUpperCase()){
+                warnings.push(`${b.name} is left out, since ${a.name} already maps ${a.address}`);
+            }
+            else if(a.kind === "input" && b.kind === "input"){
+                warnings.push(`${a.name} and ${b.name} both write ${a.address} and ${b.address}`);
+            }
+        }
+    });
+    return { entries, warnings };
+}
+
+/**
+ * Hashes a name for the symbol index, as symbolHash() of symbolindex.h does: FNV-1a over its bytes in upper case,
+ * seeded, and a final mix.
+ * @param {number} seed The seed, 0 for the bucket of a name and the displacement of its bucket for its slot.
+ * @param {Buffer} name The bytes of the name.
+ * @returns {number} Returns the hash.
+ */
+function symbolHash(seed, name){
+    let h = (2166136261 ^ Math.imul(seed, 0x9E3779B1)) >>> 0;
+    for(const byte of name){
+        h = Math.imul(h ^ (byte >= 0x61 && byte <= 0x7a ? byte - 0x20 : byte), 16777619) >>> 0;
+    }
+    h = (h ^ (h >>> 16)) >>> 0;
+    h = Math.imul(h, 0x85EBCA6B) >>> 0;
+    h = (h ^ (h >>> 13)) >>> 0;
+    h = Math.imul(h, 0xC2B2AE35) >>> 0;
+    return (h ^ (h >>> 16)) >>> 0;
+}
+
+/**
+ * Builds the symbol index of a program, laid out as in symbolindex.h: a minimal perfect hash table of its located
+ * globals, built by hash and displace, with the type, POU, address and location in the image of each. The names of a
+ * bucket are placed together, the largest buckets first, with the first displacement that puts each in a free slot.
+ * @param {object} parsed The parsed program.
+ * @param {object} imageSizes The size of each space, from sizeProcessImage().
+ * @returns {Buffer} Returns the index.
+ */
+export function buildSymbolIndex(parsed, imageSizes){
+    const round = (bytes) => Math.ceil(bytes / 64) * 64;
+    const spaces = { I: [0, round(imageSizes.I)], Q: [round(imageSizes.I), round(imageSizes.Q)],
+        M: [round(imageSizes.I) + round(imageSizes.Q), round(imageSizes.M)] };
+    const symbols = [];
+    const names = new Set();
+    parsed.body.filter((block) => block.type === "GlobalVars").forEach((block) => {
+        block.variables.filter((v) => v.address && !names.has(v.name.toUpperCase())).forEach((v) => {
+            const address = v.address.startsWith("%") ? v.address : "%" + v.address;
+            const located = parseAddress(address);
+            const bytes = located.width / 8;
+            const elements = v.array ? v.array.dimensions.reduce((count, { low, high }) => count * (high - low + 1), 1) : 1;
+            const type = v.array ? `ARRAY[${v.array.dimensions.map(({ low, high }) => `${low}..${high}`).join(",")}] OF ${v.array.of}` : v.type;
+            names.add(v.name.toUpperCase());
+            symbols.push({ name: Buffer.from(v.name), type, pou: "", address, space: located.space,
+                offset: spaces[located.space][0] + located.index * bytes + (located.bit > -1 ? located.bit >> 3 : 0),
+                width: located.bit > -1 ? 1 : located.width, bit: located.bit > -1 ? located.bit & 7 : -1,
+                size: located.bit > -1 ? 1 : bytes * elements });
+        });
+    });
+
+    const count = symbols.length;
+    const buckets = Math.max(1, Math.ceil(count / 2));
+    const displacements = new Array(buckets).fill(0);
+    const slots = new Array(count).fill(null);
+    const groups = Array.from({ length: buckets }, () => []);
+    symbols.forEach((symbol) => {
+        symbol.hash = symbolHash(0, symbol.name);
+        groups[symbol.hash % buckets].push(symbol);
+    });
+    groups.map((group, bucket) => ({ group, bucket })).sort((a, b) => b.group.length - a.group.length).forEach(({ group, bucket }) => {
+        if(group.length === 0){
+            return;
+        }
+        for(let d = 1; ; d++){
+            if(d > 0xFFFFFF){
+                throw new Error("The symbol index of the program couldn't be built.");
+            }
+            const placed = group.map((symbol) => symbolHash(d, symbol.name) % count);
+            if(placed.every((slot, x) => slots[slot] === null && placed.indexOf(slot) === x)){
+                placed.forEach((slot, x) => slots[slot] = group[x]);
+                displacements[bucket] = d;
+                return;
+            }
+        }
+    });
+
+    // The strings start with the empty string, so an offset of 0 is empty.
+    const strings = [Buffer.alloc(1)];
+    const offsets = new Map([["", 0]]);
+    let stringsBytes = 1;
+    const intern = (text) => {
+        const key = text.toString();
+        if(!offsets.has(key)){
+            const bytes = Buffer.concat([Buffer.from(key), Buffer.alloc(1)]);
+            offsets.set(key, stringsBytes);
+            strings.push(bytes);
+            stringsBytes += bytes.length;
+        }
+        return offsets.get(key);
+    };
+    const entriesOffset = 48 + buckets * 4;
+    const stringsOffset = entriesOffset + count * 32;
+    const header = Buffer.alloc(entriesOffset);
+    header.write("NDLSSYM1", 0, "latin1");
+    header.writeUInt32LE(1, 8);
+    header.writeUInt32LE(count, 12);
+    header.writeUInt32LE(buckets, 16);
+    header.writeUInt32LE(entriesOffset, 20);
+    header.writeUInt32LE(stringsOffset, 24);
+    header.writeUInt32LE(spaces.I[1], 32);
+    header.writeUInt32LE(spaces.Q[1], 36);
+    header.writeUInt32LE(spaces.M[1], 40);
+    displacements.forEach((d, bucket) => header.writeUInt32LE(d, 48 + bucket * 4));
+    const entries = Buffer.alloc(count * 32);
+    slots.forEach((symbol, slot) => {
+        const at = slot * 32;
+        entries.writeUInt32LE(symbol.hash, at);
+        entries.writeUInt32LE(intern(symbol.name), at + 4);
+        entries.writeUInt32LE(intern(symbol.type), at + 8);
+        entries.writeUInt32LE(intern(symbol.pou), at + 12);
+        entries.writeUInt32LE(intern(symbol.address), at + 16);
+        entries.writeUInt32LE(symbol.offset, at + 20);
+        entries.writeUInt16LE(symbol.width, at + 24);
+        entries.writeInt8(symbol.bit, at + 26);
+        entries.write(symbol.space, at + 27, "latin1");
+        entries.writeUInt32LE(symbol.size, at + 28);
+    });
+    header.writeUInt32LE(stringsBytes, 28);
+    return Buffer.concat([header, entries, ...strings]);
+}
+
+/**
+ * Groups the IO mappings that were read by the endpoint of their client, as the runtime would. As the runtime would,
+ * the first mapping of a local address wins, and the slaves of a Modbus RTU line share the client of its serial port.
+ * @param {object[]} maps The compiled IO mappings, from compileMap().
+ * @returns {Map<string, object[]>} Returns the mappings of each endpoint, in the order they were first mapped.
+ */
+export function groupMappings(maps){
+    const clients = new Map();
+    const mapped = new Set();
+    maps.filter((m) => m.row && !mapped.has(m.row.localAddress)).forEach((m) => {
+        mapped.add(m.row.localAddress);
+        const endpoint = m.row.protocol === "MODBUS-RTU" ? `${m.row.protocol}\n${m.row.modulePort}`
+            : `${m.row.moduleID}\n${m.row.modulePort}`;
+        if(!clients.has(endpoint)){
+            clients.set(endpoint, []);
+        }
+        clients.get(endpoint).push(m);
+    });
+    return clients;
+}
+
+/**
+ * Builds a binary IO configuration, laid out as in ioconfig.h: a header, a 64 byte record for each mapping, the
+ * mappings of each client, and a pool of the strings the records refer to, with a checksum of all but the header.
+ * A BACnet mapping keeps the point in its properties, since the runtime has no point table for it.
+ * @param {Map<string, object[]>} clients The mappings of each endpoint, from groupMappings().
+ * @param {function(object): ?string} taskOf Gets the task of a row, or null.
+ * @returns {Buffer} Returns the configuration.
+ */
+export function buildIOConfig(clients, taskOf = (row) => row.task){
+    const members = [...clients.values()];
+    const count = members.reduce((sum, group) => sum + group.length, 0);
+    const strings = [Buffer.alloc(1)];
+    const offsets = new Map([["", 0]]);
+    let stringsBytes = 1;
+    const intern = (text) => {
+        const key = text ?? "";
+        if(!offsets.has(key)){
+            const bytes = Buffer.concat([Buffer.from(key), Buffer.alloc(1)]);
+            offsets.set(key, stringsBytes);
+            strings.push(bytes);
+            stringsBytes += bytes.length;
+        }
+        return offsets.get(key);
+    };
+    const mapsOffset = 48;
+    const clientsOffset = mapsOffset + count * 64;
+    const stringsOffset = clientsOffset + members.length * 8;
+    const records = Buffer.alloc(stringsOffset - mapsOffset);
+    let at = 0;
+    members.forEach((group, c) => {
+        records.writeUInt32LE(at / 64, count * 64 + c * 8);
+        records.writeUInt32LE(group.length, count * 64 + c * 8 + 4);
+        group.forEach(({ row, properties }) => {
+            [row.protocol, row.moduleID, row.modulePort, row.remoteAddress, row.localAddress, properties ?? row.properties,
+                taskOf(row)].forEach((text, x) => records.writeUInt32LE(intern(text), at + x * 4));
+            [row.width, row.interval, row.refreshTime, row.minInterval, row.maxInterval]
+                .forEach((value, x) => records.writeInt32LE(value, at + 28 + x * 4));
+            records.writeBigUInt64LE(BigInt.asUintN(64, BigInt(row.deadband)), at + 48);
+            at += 64;
+        });
+    });
+    const body = Buffer.concat([records, ...strings]);
+    let checksum = 2166136261;
+    for(const byte of body){
+        checksum = Math.imul(checksum ^ byte, 16777619) >>> 0;
+    }
+    const header = Buffer.alloc(48);
+    header.write("NDLSIOC1", 0, "latin1");
+    header.writeUInt32LE(1, 8);
+    header.writeUInt32LE(48 + body.length, 12);
+    header.writeUInt32LE(count, 16);
+    header.writeUInt32LE(members.length, 20);
+    header.writeUInt32LE(mapsOffset, 24);
+    header.writeUInt32LE(clientsOffset, 28);
+    header.writeUInt32LE(stringsOffset, 32);
+    header.writeUInt32LE(stringsBytes, 36);
+    header.writeUInt32LE(checksum, 40);
+    return Buffer.concat([header, body]);
+}
 
 export class CPPCompiler extends Compiler {
     constructor(options) {
@@ -55,21 +908,42 @@ export class CPPCompiler extends Compiler {
     }
 
     get supportedTargetDevices() {
-        return ['linux-arm', "linux-arm64", "linux-x64", 'macos-x64', "macos-arm64", 'windows-x64', "windows-arm64"];
+        return ['linux-arm', 'linux-armhf', "linux-arm64", "linux-x64", 'macos-x64', "macos-arm64", 'windows-x64', "windows-arm64"];
     }
 
     get supportedProtocols() {
-        return [CommunicationProtocol.MODBUS];
+        return [CommunicationProtocol.MODBUS, CommunicationProtocol.CUSTOM];
     }
 
     get compilerVersion() {
         return '1.0.0';
     }
 
+    /**
+     * Records the end of a stage of compile() in buildStages, with the milliseconds since the last one ended and the
+     * memory of the process when it ended.
+     * @param {string} name The stage.
+     */
+    endStage(name) {
+        const now = performance.now();
+        const memory = process.memoryUsage();
+        this.buildStages.push({ name, millis: now - this.stageStart, heapBytes: memory.heapUsed, rssBytes: memory.rss });
+        this.stageStart = now;
+    }
+
     async compile() {
-        const { sourcePath, outputPath, target, outputType, resourceName } = this.options;
+        // The time and memory of each stage of the build, in the order they ran, which the compile benchmark reports.
+        this.buildStages = [];
+        this.stageStart = performance.now();
+        const { sourcePath, outputPath, target, outputType, resourceName, scanExceptions, packBools, boundsChecks, trace, pouProfile, allocTrack, atomicImage, arenaBytes, project, splitUnits, profile, cpu, lto, pgoTraining, onlineChange, warmRestart, loopGuard, fixedReal, protocols, browseVariables, incremental, imageWindow } = this.options;
+        // fixedReal is true for the default Q15.16 format, or the number of fractional bits.
+        const fixedBits = fixedReal === true ? 16 : fixedReal > 0 ? fixedReal : 0;
+        if (fixedBits !== 0 && !(Number.isInteger(fixedBits) && fixedBits <= 30)) {
+            throw new Error(`fixedReal must be true or a number of fractional bits from 1 to 30, not ${fixedReal}.`);
+        }
 
-        ToolChain = { ...DEFAULT_TOOLCHAIN };
+        // Each build keeps its own toolchain, so builds from different source directories can run at the same time.
+        this.toolchain = { ...DEFAULT_TOOLCHAIN };
         const sourceDir = fs.lstatSync(sourcePath).isDirectory() ? sourcePath : path.dirname(sourcePath);
         const toolchainConfigPath = path.join(sourceDir, "toolchain.json");
         if (fs.existsSync(toolchainConfigPath)) {
@@ -78,13 +952,13 @@ export class CPPCompiler extends Compiler {
                 if (typeof customToolchain !== "object" || customToolchain === null) {
                     throw new Error("The toolchain configuration must be a JSON object.");
                 }
-                ToolChain = { ...ToolChain, ...customToolchain };
+                this.toolchain = { ...this.toolchain, ...customToolchain };
             } catch (err) {
                 throw new Error(`Failed to load toolchain configuration from ${toolchainConfigPath}: ${err.message}`);
             }
         }
         else {
-            fs.writeFileSync(toolchainConfigPath, JSON.stringify(ToolChain, null, 4));
+            fs.writeFileSync(toolchainConfigPath, JSON.stringify(this.toolchain, null, 4));
         }
 
         var sourceCode = fs.readFileSync(sourcePath, 'utf-8');
@@ -96,7 +970,10 @@ export class CPPCompiler extends Compiler {
                 throw new Error("You must provide the resourceName option for an IEC project file.");
             }
             var stcode = "";
-            const iecProj = iec.Project.fromXML(sourceCode);
+            // A batch build parses the project once and passes it to each of its builds, and a watch keeps the POUs it
+            // has read in unitCache, so only those that changed are read again.
+            const iecProj = project ?? iec.Project.fromXML(sourceCode, resourceName, this.options.unitCache);
+            this.endStage("xmlParse");
             iecProj.Instances.Configurations.forEach(
                 /**
                  * @param {iec.Configuration} c
@@ -112,6 +989,7 @@ export class CPPCompiler extends Compiler {
                     }
                 }
             );
+            this.endStage("toST");
             if(stcode.length > 0){
                 sourceCode = stcode;
             }
@@ -119,14 +997,28 @@ export class CPPCompiler extends Compiler {
                 throw new Error("No resource was found by the name " + resourceName + " or the resource could not be parsed.");
             }
         }
+        // A resource of a host is moved into its window of the host's image, which it is built with the layout of.
+        if(imageWindow){
+            sourceCode = relocateAddresses(sourceCode, imageWindow.base);
+        }
         const parsed = parseStructuredText(sourceCode);
-        const transpiledCode = transpile(parsed);
+        this.endStage("stParse");
+        const retainRegion = imageWindow?.retain ?? findRetainRegion(parsed);
+        const imageSizes = imageWindow?.sizes ?? sizeProcessImage(sourceCode);
+        const optimized = optimize(parsed, { addressReads: true });
+        // With pouProfile, the POU bodies sample into a table indexed by POU ID, which the diagnostics read back.
+        const pous = pouProfile === true ? listPOUs(optimized) : [];
+        const pouTable = pous.length > 0 ?
+            `POUProfile POU_PROFILES[${pous.length}] = {\n${pous.map((p) => `  { "${p.name}", "${p.kind}" }`).join(",\n")}\n};\n` : "";
 
         let tasks = [];
         let programs = [];
         let globals = [];
         let taskCode = "";
         let mapCode = "";
+        let maps = [];
+        let symbols = [];
+        const globalAddresses = new Map();
         let plcname = "NodalisPLC";
         if(typeof resourceName !== "undefined" && resourceName !== null){
             plcname = resourceName;
@@ -146,12 +1038,21 @@ export class CPPCompiler extends Compiler {
                 }
             }
             else if(line.trim().startsWith("//Map=")){
-                mapCode += `mapIO("${line.substring(line.indexOf("=") + 1).trim()}");\n`;
-
+                maps.push(this.compileMap(line.substring(line.indexOf("=") + 1).trim()));
             }
             else if(line.indexOf("//Global=") > -1){
                 let global = JSON.parse(line.substring(line.indexOf("=") + 1).trim());
-                globals.push(`opcServer.mapVariable("${global.Name}", "${global.Address}");`)
+                try{
+                    parseAddress(global.Address);
+                }
+                catch(e){
+                    throw new AddressError(`Global ${global.Name} has an invalid address: ${global.Address}`);
+                }
+                symbols.push(`  { "${global.Name}", "${global.Address}" }`);
+                globalAddresses.set(global.Name.toUpperCase(), global.Address);
+                if(/^%M/i.test(global.Address)){
+                    globals.push(`publishBACnetObject("${global.Name}", "${global.Address}");`);
+                }
 
             }
             else if(line.trim().startsWith("PROGRAM")){
@@ -168,72 +1069,371 @@ export class CPPCompiler extends Compiler {
                 programs.push(pname);
             }
         });
+        // Every located global and mapping is laid out in the image before any code is emitted, so that the addresses
+        // the program and the mapping table resolve at compile time are known to be in it.
+        layoutMemoryMap(parsed, maps, globalAddresses, imageSizes).warnings.forEach((warning) => console.warn(`Warning: ${warning}`));
+        // BACnet points are parsed here into a table sorted by device and object, which the runtime indexes
+        // instead of parsing each mapping's ProtocolProperties when it starts.
+        const points = maps.filter((m) => m.point).sort((a, b) =>
+            a.module.localeCompare(b.module) || a.point.objectType - b.point.objectType ||
+            a.point.objectInstance - b.point.objectInstance || a.point.propertyId - b.point.propertyId);
+        points.forEach((m, index) => m.definition = index);
+        // The mappings read here are emitted as a table grouped by the endpoint of their client, which the runtime
+        // maps in one pass when it starts.
+        maps.filter((m) => !m.row).forEach((m) => {
+            mapCode += `mapIO("${m.text}");\n`;
+        });
+        const clients = groupMappings(maps);
+        // Each mapping is tied to the fastest cyclic task whose programs read the input, or write the output, which the
+        // runtime polls it in step with under --io-phase. A map may name its task instead (Task).
+        const accesses = programAccesses(optimized);
+        const cyclicTasks = tasks.length > 0 ?
+            tasks.filter((t) => String(t.Single ?? "").trim() === "")
+                .map((t) => ({ name: t.Name, interval: parseTaskInterval(t.Interval), programs: t.Instances.map((i) => i.TypeName) })) :
+            [{ name: "MainTask", interval: 1, programs }];
+        // The worst case cost of each POU is estimated for the target, and each cyclic task sums the programs it runs,
+        // which is reported beside the executable and checked against the interval of the task.
+        const costs = costReport(optimized, cyclicTasks, target);
+        costs.warnings.forEach((warning) => console.warn(`Warning: ${warning}`));
+        const mappingTask = (row) => {
+            if(row.task){
+                return row.task;
+            }
+            let bytes;
+            try {
+                bytes = addressBytes(row.localAddress);
+            }
+            catch(e) {
+                return null;
+            }
+            const output = row.localAddress.toUpperCase().includes("%Q");
+            const tied = cyclicTasks.filter((t) => t.programs.some((p) => {
+                const access = accesses.get(p.toUpperCase());
+                return access !== undefined && bytes.some((b) => (output ? access.writes : access.reads).has(b));
+            }));
+            return tied.sort((a, b) => a.interval - b.interval)[0]?.name ?? null;
+        };
+        let pointTable = "";
+        if(clients.size > 0){
+            const rows = [];
+            const groups = [];
+            clients.forEach((members) => {
+                groups.push(`  { ${rows.length}, ${members.length} }`);
+                members.forEach(({ row: r, definition }) => {
+                    const task = mappingTask(r);
+                    rows.push(
+                        `  { ${[r.protocol, r.moduleID, r.modulePort, r.remoteAddress, r.localAddress, r.properties].map(cppString).join(", ")}, ` +
+                        `${r.width}, ${r.interval}, ${r.deadband}ull, ${r.refreshTime}, ${definition ?? -1}, ${r.minInterval}, ${r.maxInterval}, ` +
+                        `${task ? cppString(task) : "nullptr"}, ${locatedAddressExpression(r.localAddress)} }`);
+                });
+            });
+            pointTable += `static constexpr IOMapDefinition IO_MAPS[] = {\n${rows.join(",\n")}\n};\n` +
+                `static constexpr IOClientDefinition IO_CLIENTS[] = {\n${groups.join(",\n")}\n};\n`;
+            mapCode = `mapIOTable(IO_MAPS, IO_CLIENTS, ${groups.length});\n` + mapCode;
+        }
+        // The same mappings are written as a binary IO configuration, which a runtime started with --io-config maps
+        // in place of the table, so a copy of it can be edited with `nodalis iomap` without building the program.
+        const ioConfig = buildIOConfig(clients, mappingTask);
+        if(points.length > 0){
+            const rows = points.map(({ point: p }) =>
+                `  { ${p.objectType}, ${p.objectInstance}, ${p.propertyId}, ${p.arrayIndex < 0 ? "UINT32_MAX" : p.arrayIndex}, ${p.valueType}, ${p.priority}, ${p.cov}, ${p.covConfirmed}, ${p.covLifetime} }`);
+            pointTable = `static const BACnetPointDefinition BACNET_POINTS[] = {\n${rows.join(",\n")}\n};\n` + pointTable;
+            mapCode = `registerBACnetPoints(BACNET_POINTS, ${points.length});\n` + mapCode;
+        }
+        // The located globals are emitted as a symbol table that the OPC UA server builds its address space from in one pass,
+        // and that the shared image publishes as its layout descriptor.
+        let symbolTable = "";
+        if(symbols.length > 0){
+            symbolTable = `static const ImageSymbol IMAGE_SYMBOLS[] = {\n${symbols.join(",\n")}\n};\n`;
+            globals.unshift(`registerImageSymbols(IMAGE_SYMBOLS, ${symbols.length});`,
+                `mapOPCUAVariables(IMAGE_SYMBOLS, ${symbols.length});`);
+        }
+        // The runtime is built with only the protocols the program uses, or names, and the OPC UA server only runs when
+        // there are located globals to serve, variables to browse or OPC UA is named. The host of an online change is
+        // built with them all, since the versions of the program it loads may use others.
+        const named = (typeof protocols === "string" ? protocols.split(",") : protocols ?? [])
+            .map((name) => String(name).trim().toLowerCase()).filter((name) => name !== "");
+        const browse = browseVariables === true;
+        if(browse && onlineChange === true){
+            throw new Error("The variables of a program can't be browsed from OPC UA with online change, since they move with each version.");
+        }
+        const built = runtimeProtocols(maps, symbols.length > 0 || browse, onlineChange === true ? ["all"] : named);
+        if(outputType === 'executable'){
+            const builtTarget = target ?? `${this.getHostOS()}-${this.getHostArch()}`;
+            checkPrebuilts(builtTarget, this.resolveTarget(builtTarget).os === 'windows', built);
+        }
+        const serveOPCUA = symbols.length > 0 || browse || named.includes("opcua") || named.includes("all");
+        const runtimeSources = RUNTIME_SOURCES.filter((source) =>
+            !Object.entries(RUNTIME_PROTOCOLS).some(([name, p]) => p.source === source && !built.has(name)));
+
+        // The symbol index of the located globals is written beside the executable for tools, and embedded in it so
+        // the runtime looks names up through the same perfect hash.
+        const symbolIndex = buildSymbolIndex(parsed, imageSizes);
+        const indexCount = symbolIndex.readUInt32LE(12);
+        if(indexCount > 0){
+            const rows = [];
+            for(let x = 0; x < symbolIndex.length; x += 24){
+                rows.push(`  ${[...symbolIndex.subarray(x, x + 24)].map((b) => `0x${b.toString(16).padStart(2, "0")}`).join(", ")}`);
+            }
+            symbolTable += `alignas(8) static const uint8_t SYMBOL_INDEX[] = {\n${rows.join(",\n")}\n};\n`;
+            globals.unshift(`registerSymbolIndex(SYMBOL_INDEX, sizeof(SYMBOL_INDEX));`);
+        }
+
+        // The globals that more than one task uses are exchanged between the tasks through channels sized here, one
+        // for each, which a task worker loads its copy from when it is released and publishes what it wrote to.
+        const exchanged = exchangedGlobals(optimized, tasks.map((t) => t.Instances.map((i) => i.TypeName)));
+        this.endStage("analysis");
+        // The POUs are generated on as many workers as the toolchain may run processes, and those that haven't changed
+        // since an earlier build are taken from the cache.
+        const transpiled = await transpileParallel(optimized, { packBools: packBools === true, units: splitUnits === true, pouProfile: pouProfile === true,
+            stateTable: onlineChange === true || warmRestart === true, exchanged, loopGuard: loopGuard === true, browseTable: browse,
+            fixedReal: fixedBits > 0, incremental: incremental === true }, { jobs: toolchainSlots.limit, cacheDir: path.join(cacheRoot(), 'pous') });
+        this.endStage("transpile");
+        // Split into units, the main translation unit includes the header of the POUs and defines the globals, and
+        // each POU is written to <filename>.<POU>.cpp.
+        const headerFile = `${filename}.h`;
+        let transpiledCode = splitUnits === true ? `#include "${headerFile}"\n\n${transpiled.definitions.join("\n")}\n` : transpiled;
+        const channels = [...exchanged];
+        if(channels.length > 0){
+            const names = new Map(optimized.body.filter((block) => block.type === "GlobalVars")
+                .flatMap((block) => block.variables.map((v) => [v.name.toUpperCase(), v.name])));
+            transpiledCode += `\nstatic const GlobalChannel GLOBAL_CHANNELS[] = {\n${channels.map((c) =>
+                `  globalChannel(GLOBAL_BUFFERS[0], GLOBAL_BUFFERS[0].${names.get(c)})`).join(",\n")}\n};\n` +
+                `static GlobalExchange GLOBAL_EXCHANGE(GLOBAL_BUFFERS, sizeof(EXCHANGED_GLOBALS), GLOBAL_CHANNELS, ${channels.length});\n`;
+        }
+        // A task loads the channels of the globals it uses and publishes those it writes.
+        const exchangeTask = (instances) => {
+            if(channels.length === 0){
+                return { load: "", store: "" };
+            }
+            const used = new Set();
+            const written = new Set();
+            instances.forEach((i) => {
+                const access = accesses.get(i.TypeName.toUpperCase());
+                access?.reads.forEach((r) => used.add(r));
+                access?.writes.forEach((w) => { used.add(w); written.add(w); });
+            });
+            const indices = (set) => channels.map((c, x) => set.has(`G:${c}`) ? x : -1).filter((x) => x > -1).join(", ");
+            return { load: indices(used) === "" ? "" : `GLOBAL_EXCHANGE.load(TASK_GLOBALS, { ${indices(used)} });\n        `,
+                store: indices(written) === "" ? "" : `        GLOBAL_EXCHANGE.store(TASK_GLOBALS, { ${indices(written)} });\n` };
+        };
+
+        // Each program instance has a profile, which the runtime's benchmark mode (--bench) times its calls into.
+        const profiles = [];
+        const callProgram = (typeName, name) => {
+            profiles.push(`  { ${cppString(name)} }`);
+            return `runProgram(PROGRAM_PROFILES[${profiles.length - 1}], ${typeName});\n`;
+        };
+        // The instances of a task that touch nothing the others write run in parallel stages, on the pool of
+        // --parallel-programs, and the stages keep the order of the instances that depend on each other.
+        const callPrograms = (instances) => parallelStages(instances.map((i) => accesses.get(i.TypeName.toUpperCase())))
+            .map((stage) => stage.length === 1 ? callProgram(instances[stage[0]].TypeName, instances[stage[0]].Name) :
+                `runParallel({\n${stage.map((x) => `          [](){ ${callProgram(instances[x].TypeName, instances[x].Name).trim()} }`).join(",\n")}\n        });\n`)
+            .join("");
+        const taskList = [];
         if(tasks.length > 0){
             tasks.forEach((t) => {
-                var progCode = "";
-                t.Instances.forEach((i) => {
-                    progCode += i.TypeName + "();\n";
-                });
-                taskCode += 
-`
-    if(PROGRAM_COUNT % ${t.Interval} == 0){
-        ${progCode}
-    }
-`;
+                const instances = t.Instances.map((i) => ({ TypeName: i.TypeName, Name: i.Name || i.TypeName }));
+                const exchange = exchangeTask(instances);
+                var progCode = exchange.load + callPrograms(instances) + exchange.store;
+                var priority = parseInt(t.Priority);
+                taskList.push({ name: t.Name, interval: parseTaskInterval(t.Interval), priority: isNaN(priority) ? 0 : priority, code: progCode,
+                    trigger: taskTrigger(t, globalAddresses), watchdog: t.Watchdog ? parseTaskInterval(t.Watchdog) : 0 });
             });
         }
         else{
-            programs.forEach((p) => {
-                taskCode += p + "();\n";
-            });
+            var progCode = callPrograms(programs.map((p) => ({ TypeName: p, Name: p })));
+            taskList.push({ name: "MainTask", interval: 1, priority: 0, code: progCode, watchdog: 0 });
         }
+        taskList.forEach((t) => {
+            taskCode += t.trigger ?
+`
+  scheduler.addEventTask("${t.name}", ${t.priority}, [](){ return static_cast<bool>(${t.trigger}); }, [](){
+        ${t.code}
+  }${t.watchdog > 0 ? `, ${t.watchdog}` : ""});
+` :
+`
+  scheduler.addTask("${t.name}", ${t.interval}, ${t.priority}, [](){
+        ${t.code}
+  }${t.watchdog > 0 ? `, ${t.watchdog}` : ""});
+`;
+        });
         
-        const cppCode = 
+        // The profiles are registered again by each version of a program loaded for an online change.
+        const attachments = [];
+        let profileTable = "";
+        if(profiles.length > 0){
+            profileTable = `static ProgramProfile PROGRAM_PROFILES[] = {\n${profiles.join(",\n")}\n};\n`;
+            attachments.push(`registerProgramProfiles(PROGRAM_PROFILES, ${profiles.length});`);
+        }
+        if(pous.length > 0){
+            attachments.push(`registerPOUProfiles(POU_PROFILES, ${pous.length});`);
+        }
+
+        // The variables of the programs and the globals, which an online change carries over to the next version,
+        // and a warm restart snapshot holds along with the process image.
+        const programNames = optimized.body.filter((block) => block.type === 'ProgramDeclaration').map((block) => block.name);
+        const stateFunction = onlineChange !== true && warmRestart !== true ? "" : `static const StateVariable* programState(size_t* count) {
+  static std::vector<StateVariable> state;
+  if(state.empty()){
+    ${["GLOBAL_STATE", ...programNames.map((name) => `${name}_STATE`)].map((table) => `appendState(state, ${table});`).join("\n    ")}
+  }
+  *count = state.size();
+  return state.data();
+}
+`;
+        const registerState = warmRestart === true ? ["registerStateTable(programState);"] : [];
+
+        const cppCode = onlineChange === true ? programModule() :
 `#include "nodalis.h"
 #include <chrono>
-#include <thread>
 #include <cstdint>
-#include <limits>
-#include "opcua.h"
 
-OPCUAServer opcServer;
+${pointTable}
+${symbolTable}
+${pouTable}
 ${transpiledCode}
-
-int main() {
-  ${globals.join("\n")}
-  opcServer.start();
-  ${mapCode}
-  std::cout << "${plcname} is running!\\n";
-  while (true) {
-    try{
-        superviseIO();
-        ${taskCode}
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        PROGRAM_COUNT++;
-        if(PROGRAM_COUNT >= std::numeric_limits<uint64_t>::max()){
-            PROGRAM_COUNT = 0;
-        }
-    }
-    catch(const std::exception& e){
-        std::cout << "Caught exception: " << e.what() << "\\n";
-    }
+${profileTable}
+${stateFunction}
+int main(int argc, char* argv[]) {
+  RuntimeOptions options = parseRuntimeOptions(argc, argv);
+  applyRuntimeProfile(options);
+  ${serveOPCUA ? "configureOPCUAServer(options);" : ""}
+  ${[...globals, ...registerState, ...attachments].join("\n")}
+  TaskScheduler scheduler(options);
+  ${taskCode}
+  if(options.ioConfig.empty()){
+    ${mapCode}
+  }
+  else if(!mapIOConfig(options.ioConfig)){
+    return 1;
   }
+  ${browse ? ["GLOBAL_BROWSE();", ...programNames.map((name) => `${name}_BROWSE();`)].join("\n  ") : ""}
+  ${serveOPCUA ? "startOPCUAServer();" : ""}
+  nodalisLog() << "${plcname} is running!\\n";
+  scheduler.run();
   return 0;
 }`;
 
+        /**
+         * With onlineChange, the program is compiled into a library for the host in programhost.h instead of an
+         * executable. It exports its tasks, the parts of main that configure the runtime, and a table of the
+         * variables of its programs and globals. The tasks, IO maps and symbols are hashed, since they are set up
+         * once, when the host starts, and a change to them needs a restart.
+         * @returns {string} Returns the code of the library.
+         */
+        function programModule() {
+            const configuration = crypto.createHash('sha256').update(JSON.stringify({ pointTable, symbolTable, globals, mapCode,
+                tasks: taskList.map((t) => [t.name, t.interval, t.priority, t.trigger ?? "", t.watchdog]) })).digest('hex').slice(0, 16);
+            return `#include "nodalis.h"
+#include "programhost.h"
+#include <chrono>
+#include <cstdint>
+
+${pointTable}
+${symbolTable}
+${pouTable}
+${transpiledCode}
+${profileTable}
+
+static void configureProgram() {
+  ${[...globals, ...registerState].join("\n  ")}
+}
+
+static void mapProgram() {
+  ${mapCode}
+}
+
+static void attachProgram() {
+  ${attachments.join("\n  ")}
+}
+
+${stateFunction}
+static const ProgramTask PROGRAM_TASKS[] = {
+${taskList.map((t) => `  { ${cppString(t.name)}, ${t.interval}, ${t.priority}, [](){
+        ${t.code}
+  }, ${t.trigger ? `[](){ return static_cast<bool>(${t.trigger}); }` : "nullptr"}, ${t.watchdog} }`).join(",\n")}
+};
+
+NODALIS_PROGRAM_EXPORT const ProgramModule* nodalis_program() {
+  static const ProgramModule module = { NODALIS_PROGRAM_ABI_VERSION, NODALIS_RUNTIME_ID, "${configuration}", ${cppString(plcname)},
+    PROGRAM_TASKS, ${taskList.length}, configureProgram, mapProgram, attachProgram, programState };
+  return &module;
+}`;
+        }
+
+        // Generated files are only written when they change, so an unchanged program keeps its cached objects.
         fs.mkdirSync(outputPath, { recursive: true });
-        fs.writeFileSync(cppFile, cppCode);
+        writeIfChanged(cppFile, cppCode);
+        writeIfChanged(path.join(outputPath, `${filename}.symbols`), symbolIndex);
+        writeIfChanged(path.join(outputPath, `${filename}.iomap`), ioConfig);
+        writeIfChanged(path.join(outputPath, `${filename}.cost.json`), JSON.stringify(costs.report, null, 2) + "\n");
+        const unitFiles = [];
+        if(splitUnits === true){
+            writeIfChanged(path.join(outputPath, headerFile), `#pragma once\n#include "${onlineChange === true ? 'programhost.h' : 'nodalis.h'}"\n\n${transpiled.header.join("\n")}\n`);
+            transpiled.units.forEach((unit) => {
+                const unitFile = path.join(outputPath, `${filename}.${unit.name}.cpp`);
+                writeIfChanged(unitFile, `#include "${headerFile}"\n\n${unit.code.join("\n")}\n`);
+                unitFiles.push(unitFile);
+            });
+        }
+        // The units of POUs that were removed from the source are removed with them.
+        fs.readdirSync(outputPath).filter((file) => file.startsWith(`${filename}.`) && file.endsWith(".cpp") &&
+            file !== path.basename(cppFile) && !unitFiles.includes(path.join(outputPath, file))).forEach((file) => {
+            fs.rmSync(path.join(outputPath, file));
+        });
         if(sourcePath.toLowerCase().endsWith(".iec") || sourcePath.toLowerCase().endsWith(".xml")){
-            fs.writeFileSync(stFile, sourceCode);
+            writeIfChanged(stFile, sourceCode);
         }
+        this.endStage("write");
         // Copy core headers and cpp support files
         const coreFiles = [
             'nodalis.h',
             'nodalis.cpp',
+            'nodalislog.h',
+            'iecfunctions.h',
             'modbus.h',
             'modbus.cpp',
             'bacnet.h',
             'bacnet.cpp',
+            'ioreactor.h',
+            'ioreactor.cpp',
+            'metrics.h',
+            'metrics.cpp',
+            'redundancy.h',
+            'redundancy.cpp',
+            'netvar.h',
+            'netvar.cpp',
+            'recorder.h',
+            'recorder.cpp',
+            'simulation.h',
+            'simulation.cpp',
+            'historian.h',
+            'historian.cpp',
+            'watch.h',
+            'watch.cpp',
+            'alarms.h',
+            'alarms.cpp',
+            'sparkplug.h',
+            'sparkplug.cpp',
+            'localio.h',
+            'localio.cpp',
+            'enip.h',
+            'enip.cpp',
+            'iocapture.h',
+            'iocapture.cpp',
+            'iodriver.h',
+            'iodriver.cpp',
+            'nodalisdriver.h',
+            'clocksync.h',
+            'clocksync.cpp',
+            'timedio.h',
+            'timedio.cpp',
+            'ioscheduler.h',
+            'ioscheduler.cpp',
+            'sharedimage.h',
+            'symbolindex.h',
+            'ioconfig.h',
             "json.hpp"
         ];
 
@@ -248,12 +1448,27 @@ int main() {
         // }
 
         const coreDir = path.resolve(__dirname + '/support/generic');
-        fs.cpSync(coreDir, outputPath, {force: true, recursive: true});
+        syncTree(coreDir, outputPath);
+        // Every translation unit includes the same sizes, so the layout of the image agrees across them.
+        writeIfChanged(path.join(outputPath, "processimage.h"),
+`#pragma once
+#define NODALIS_INPUT_BYTES ${imageSizes.I}
+#define NODALIS_OUTPUT_BYTES ${imageSizes.Q}
+#define NODALIS_MEMORY_BYTES ${imageSizes.M}
+#define NODALIS_RETAIN_OFFSET ${retainRegion.start}
+#define NODALIS_RETAIN_BYTES ${retainRegion.bytes}
+`);
+        // The protocols left out of the runtime are turned off for every translation unit, which also all agree on
+        // the format of a fixed point REAL.
+        writeIfChanged(path.join(outputPath, "runtimeconfig.h"), `#pragma once\n${Object.entries(RUNTIME_PROTOCOLS)
+            .filter(([name]) => !built.has(name)).map(([, p]) => `#define ${p.macro} 0\n`).join("")}${
+            fixedBits > 0 ? `#define NODALIS_FIXED_REAL_BITS ${fixedBits}\n` : ""}`);
         // for (const file of coreFiles) {
             
         //     fs.copyFileSync(path.join(target.includes("windows") && file.includes("opc") ? coreDir + "/windows/" : coreDir, file), path.join(outputPath, file));
         // }
 
+        this.endStage("copy");
        const pathTo = name => path.join(outputPath, name);
         const targetInfo = this.resolveTarget(target);
 
@@ -276,6 +1491,7 @@ int main() {
             const open62541o = pathTo(path.join("open62541", "lib", target, isWindowsTarget ? "open62541.lib" : 'open62541.o'));
             const bacneta = pathTo(path.join("bacnet-stack", target, "libbacnet.a"));
             const bacneti = pathTo(path.join("bacnet-stack", target, "include"));
+            const prebuilt = [...(built.has("opcua") ? [open62541o] : []), ...(built.has("bacnet") ? [bacneta] : [])];
             //let cCompileCmd = "";
             // if (compiler === 'cl.exe') {
             //     // Compile C file with cl
@@ -297,29 +1513,485 @@ int main() {
                 exeFile += '.exe';
             }
 
-            let cppCompileCmd;
-            const inputs = [
-                `"${cppFile}"`,
-                `"${pathTo('nodalis.cpp')}"`,
-                `"${pathTo('modbus.cpp')}"`,
-                `"${pathTo('opcua.cpp')}"`,
-                `"${pathTo('bacnet.cpp')}"`
-            ];
+            // Without scan exceptions, task releases run without a try/catch around them.
+            const define = (name) => compiler === 'cl.exe' ? `/D${name} ` : `-D${name} `;
+            const scanDefine = (scanExceptions === false ? define("NODALIS_SCAN_EXCEPTIONS=0") : "") +
+                (boundsChecks === true ? define("NODALIS_ARRAY_BOUNDS_CHECK=1") : "") +
+                (trace === true ? define("NODALIS_TRACE=1") : "") +
+                (allocTrack === true ? define("NODALIS_ALLOC_TRACK=1") : "") +
+                (atomicImage === true ? define("NODALIS_ATOMIC_IMAGE=1") : "") +
+                (arenaBytes > 0 ? define(`NODALIS_ARENA_BYTES=${Math.floor(arenaBytes)}`) : "");
+            const includes = compiler === 'cl.exe'
+                ? `/I${bacneti} /I${bacneti}/ports/${isWindowsTarget ? "win32" : "linux"} `
+                : `-I${bacneti} -I${bacneti}/ports/${isWindowsTarget ? "win32" : "linux"} `;
+            const cppFlagSegment = formatFlags(archFlags.cpp);
+            // The host of an online change exports the runtime to its program libraries, which link time
+            // optimization would leave out, so it is built without it.
+            const buildFlags = this.getProfileFlags(profile ?? 'release', compiler, target, cpu, lto !== false && onlineChange !== true);
+            const profileSegment = formatFlags(buildFlags.compile);
+            const linkSegment = formatFlags(buildFlags.link);
+            const compileFlags = compiler === 'cl.exe' ? `${includes}${cppFlagSegment}${profileSegment}${scanDefine}/EHsc /std:c++17` : `${cppFlagSegment}${profileSegment}${scanDefine}-std=c++17 ${includes}`;
+            const link = (objects, libraries, flags = "") => compiler === 'cl.exe'
+                ? `cl.exe ${cppFlagSegment}/Fe:"${exeFile}" ${[...objects, ...libraries].map((input) => `"${input}"`).join(' ')} ${linkSegment}`
+                : `${compiler} ${cppFlagSegment}${linkSegment}${flags}-o "${exeFile}" ${[...objects, ...libraries].map((input) => `"${input}"`).join(' ')} ${archFlags.linker}`;
+
+            if (onlineChange === true) {
+                if (isWindowsTarget || compiler === 'cl.exe') {
+                    throw new Error(`Online change loads the program as a shared library into a host that exports the runtime, which isn't supported for ${requestedTarget}.`);
+                }
+                if (pgoTraining) {
+                    throw new Error("Online change can't be combined with profile guided optimization.");
+                }
+                await this.onlineChangeBuild(outputPath, exeFile, target, compiler, compileFlags, [cppFile, ...unitFiles],
+                    prebuilt, { cpp: cppFlagSegment, link: linkSegment, linker: archFlags.linker ?? "", macos: targetInfo.os === 'macos' },
+                    splitUnits === true ? [headerFile] : []);
+                this.endStage("toolchain");
+                return;
+            }
+
+            if (pgoTraining) {
+                if (targetInfo.os !== hostOs || targetInfo.arch !== hostArch) {
+                    throw new Error(`Profile guided optimization trains on a run of the program, so ${requestedTarget} can only be built with it on a ${requestedTarget} host.`);
+                }
+                await this.profileGuidedBuild(outputPath, exeFile, target, compiler, compileFlags, [cppFile, ...unitFiles], runtimeSources, prebuilt, link, pgoTraining);
+                fs.rmSync(`${exeFile}.hash`, { force: true });
+                this.endStage("toolchain");
+                return;
+            }
+
+            // The runtime is built once per target, toolchain, flags and process image layout, and only the program
+            // is compiled for each build. The runtime and the program's units compile side by side, and a unit that
+            // hasn't changed is found in the cache.
+            const [runtimeLib, ...programObjects] = await Promise.all([
+                this.runtimeLibrary(outputPath, target, compiler, compileFlags, splitUnits === true ? [headerFile] : [], buildFlags.lto, runtimeSources),
+                ...[cppFile, ...unitFiles].map((file) => this.programObject(outputPath, file, target, compiler, compileFlags))
+            ]);
+            const libraries = compiler === 'cl.exe' ? [runtimeLib] : [runtimeLib, ...prebuilt];
+
+            // The executable is linked again only when one of its inputs, or the way it is linked, has changed.
+            // The program objects and the runtime library are named by their hashes, and the prebuilt libraries are
+            // hashed by content.
+            const linkHash = crypto.createHash('sha256').update(`${compiler}\n${cppFlagSegment}\n${linkSegment}\n${archFlags.linker ?? ""}\n${programObjects.join("\n")}\n${runtimeLib}\n`);
+            libraries.filter((library) => library !== runtimeLib).forEach((library) => hashFile(linkHash, library));
+            const linkKey = linkHash.digest('hex');
+            const stampFile = `${exeFile}.hash`;
+            if (fs.existsSync(exeFile) && fs.existsSync(stampFile) && fs.readFileSync(stampFile, 'utf-8') === linkKey) {
+                this.endStage("toolchain");
+                return;
+            }
+            fs.rmSync(stampFile, { force: true });
+            await runToolchain(link(programObjects, libraries));
+            fs.writeFileSync(stampFile, linkKey);
+            this.endStage("toolchain");
+        }
+    }
+
+    /**
+     * Builds a program for online change: a host executable of the runtime (nodalishost.cpp and programhost.cpp),
+     * which exports the runtime's symbols, and the program as a library beside it, <executable>.program.so or
+     * .program.dylib, that the host loads. Both are compiled with the ID of the runtime library, which the host checks
+     * a library against. The host only depends on the runtime, so it is linked again only when the runtime changes,
+     * and the library is written under a temporary name and renamed, so that a running host never reads half of it.
+     * @param {string} outputPath The output directory.
+     * @param {string} exeFile The host executable.
+     * @param {string} target The target, such as linux-x64.
+     * @param {string} compiler The C++ compiler.
+     * @param {string} compileFlags The flags to compile with.
+     * @param {string[]} programFiles The program's translation units.
+     * @param {string[]} prebuilt The prebuilt open62541 and BACnet libraries the runtime is linked with.
+     * @param {{cpp: string, link: string, linker: string, macos: boolean}} linking The architecture and profile flags
+     * to link with, and whether the target is macOS.
+     * @param {string[]} programHeaders The program's headers, which the runtime doesn't depend on.
+     */
+    async onlineChangeBuild(outputPath, exeFile, target, compiler, compileFlags, programFiles, prebuilt, linking, programHeaders) {
+        const runtimeLib = await this.runtimeLibrary(outputPath, target, compiler, compileFlags, programHeaders, false);
+        const runtimeFlags = `${compileFlags}'-DNODALIS_RUNTIME_ID="${path.basename(path.dirname(runtimeLib))}"' `;
+        const [hostObjects, programObjects] = await Promise.all([
+            Promise.all(['nodalishost.cpp', 'programhost.cpp'].map((file) => this.programObject(outputPath, path.join(outputPath, file), target, compiler, runtimeFlags))),
+            Promise.all(programFiles.map((file) => this.programObject(outputPath, file, target, compiler, `${runtimeFlags}-fPIC `)))
+        ]);
+
+        const quoted = (files) => files.map((file) => `"${file}"`).join(' ');
+        const wholeRuntime = linking.macos ? `-Wl,-force_load,"${runtimeLib}"` : `-Wl,--whole-archive "${runtimeLib}" -Wl,--no-whole-archive`;
+        const hostHash = crypto.createHash('sha256').update(`${compiler}\n${linking.cpp}\n${linking.link}\n${linking.linker}\n${hostObjects.join('\n')}\n${runtimeLib}\n`);
+        prebuilt.forEach((library) => hashFile(hostHash, library));
+        const hostKey = hostHash.digest('hex');
+        const stampFile = `${exeFile}.hash`;
+        if (!fs.existsSync(exeFile) || !fs.existsSync(stampFile) || fs.readFileSync(stampFile, 'utf-8') !== hostKey) {
+            fs.rmSync(stampFile, { force: true });
+            await runToolchain(`${compiler} ${linking.cpp}${linking.link}${linking.macos ? '-Wl,-export_dynamic' : '-rdynamic'} -o "${exeFile}" ` +
+                `${quoted(hostObjects)} ${wholeRuntime} ${quoted(prebuilt)} ${linking.linker} -ldl`);
+            fs.writeFileSync(stampFile, hostKey);
+        }
+
+        const programFile = `${exeFile}.program.${linking.macos ? 'dylib' : 'so'}`;
+        const programHash = crypto.createHash('sha256').update(`${compiler}\n${linking.cpp}\n${programObjects.join('\n')}\n`).digest('hex');
+        const programStamp = `${programFile}.hash`;
+        if (fs.existsSync(programFile) && fs.existsSync(programStamp) && fs.readFileSync(programStamp, 'utf-8') === programHash) {
+            return;
+        }
+        const partial = `${programFile}.${process.pid}`;
+        await runToolchain(`${compiler} ${linking.cpp}-shared -fPIC ${linking.macos ? '-undefined dynamic_lookup ' : ''}-o "${partial}" ${quoted(programObjects)}`);
+        fs.renameSync(partial, programFile);
+        fs.writeFileSync(programStamp, programHash);
+    }
+
+    /**
+     * Checks that the IO library can be built for a target. On Linux it links the prebuilt open62541 and BACnet
+     * libraries into a shared library, which needs them to be position independent, and the prebuilt libraries that
+     * weren't built with -fPIC are found from their relocations rather than by the linker at the end of the build.
+     * Without readelf on the host, they are left to the linker.
+     * @param {string} target The target, such as linux-x64. Defaults to the host.
+     * @throws {Error} Throws if a prebuilt library of a Linux target is missing or isn't position independent.
+     */
+    checkIOLibrary(target) {
+        target = target ?? `${this.getHostOS()}-${this.getHostArch()}`;
+        if (this.resolveTarget(target).os !== 'linux') {
+            return;
+        }
+        const generic = path.resolve(__dirname + '/support/generic');
+        [
+            { file: path.join("open62541", "lib", target, "open62541.o"), script: "open62541/opc-build.sh" },
+            { file: path.join("bacnet-stack", target, "libbacnet.a"), script: "bacnet-stack/bacnet-build.sh" }
+        ].forEach(({ file, script }) => {
+            if (!fs.existsSync(path.join(generic, file))) {
+                throw new Error(`The IO library can't be built for ${target} yet: there is no prebuilt ${file}. It has to be built with ${script}.`);
+            }
+            const found = positionDependentCode(path.join(generic, file));
+            if (found) {
+                throw new Error(`The IO library can't be built for ${target} yet: the prebuilt ${file} isn't position independent (${found}). It has to be rebuilt with ${script}, which compiles it with -fPIC.`);
+            }
+        });
+    }
+
+    /**
+     * Builds the runtime's IO clients into a shared library with the C interface of nodalisio.h, for hosts that keep
+     * their own process image, like the jint PLC, to run their IO on. The library is built with the default image
+     * layout, which the host's image must share, and with position independent code, so the prebuilt open62541 and
+     * BACnet libraries of the target must be built with it as well, which checkIOLibrary() checks before anything is
+     * built.
+     * @param {string} outputPath The directory to copy the runtime to and write the library in.
+     * @param {string} target The target, such as linux-x64. Defaults to the host.
+     * @returns {Promise<string>} Returns the path to the library: nodalisio.dll, libnodalisio.dylib or libnodalisio.so.
+     * @throws {Error} Throws if a prebuilt library of a Linux target is missing or isn't position independent.
+     */
+    async buildIOLibrary(outputPath, target) {
+        target = target ?? `${this.getHostOS()}-${this.getHostArch()}`;
+        const targetInfo = this.resolveTarget(target);
+        this.checkIOLibrary(target);
+        syncTree(path.resolve(__dirname + '/support/generic'), outputPath);
+        writeIfChanged(path.join(outputPath, "processimage.h"), "#pragma once\n");
+        writeIfChanged(path.join(outputPath, "runtimeconfig.h"), "#pragma once\n");
+
+        const compiler = this.detectCompiler(this.getHostOS(), this.getHostArch(), targetInfo.os, targetInfo.arch);
+        const msvc = compiler === 'cl.exe';
+        const archFlags = this.getArchFlags(targetInfo.os, targetInfo.arch, compiler);
+        const cppFlagSegment = archFlags.cpp.length ? `${archFlags.cpp.join(' ')} ` : '';
+        const buildFlags = this.getProfileFlags('release', compiler, target, undefined, false);
+        const profileSegment = buildFlags.compile.length ? `${buildFlags.compile.join(' ')} ` : '';
+        const bacneti = path.join(outputPath, "bacnet-stack", target, "include");
+        const port = targetInfo.os === 'windows' ? "win32" : "linux";
+        const compileFlags = msvc
+            ? `/I${bacneti} /I${bacneti}/ports/${port} ${cppFlagSegment}${profileSegment}/EHsc /std:c++17`
+            : `${cppFlagSegment}${profileSegment}-fPIC -fvisibility=hidden -std=c++17 -I${bacneti} -I${bacneti}/ports/${port} `;
+
+        const open62541o = path.join(outputPath, "open62541", "lib", target, targetInfo.os === 'windows' ? "open62541.lib" : 'open62541.o');
+        const bacneta = path.join(outputPath, "bacnet-stack", target, "libbacnet.a");
+
+        const [runtimeLib, ioObject] = await Promise.all([
+            this.runtimeLibrary(outputPath, target, compiler, compileFlags),
+            this.programObject(outputPath, path.join(outputPath, "nodalisio.cpp"), target, compiler, compileFlags)
+        ]);
+        const libFile = path.join(outputPath, targetInfo.os === 'windows' ? "nodalisio.dll" : targetInfo.os === 'macos' ? "libnodalisio.dylib" : "libnodalisio.so");
+        await runToolchain(msvc
+            ? `cl.exe ${cppFlagSegment}/LD /Fe:"${libFile}" "${ioObject}" "${runtimeLib}"`
+            : `${compiler} ${cppFlagSegment}-shared -o "${libFile}" "${ioObject}" "${runtimeLib}" "${open62541o}" "${bacneta}" ${archFlags.linker}`);
+        return libFile;
+    }
+
+    /**
+     * Gets the optimization flags of a build profile, with link time optimization and the tuning for the CPU of the
+     * target. A named CPU, from the cpu option or a "<target>-cpu" entry of toolchain.json, is built for with -march
+     * on x64 and -mcpu elsewhere, or /arch with cl.exe, so the executable may not run on other CPUs of the target.
+     * @param {string} profile The profile: debug (-O0 -g), release (-O2, link time optimized), size (-Os, link time
+     * optimized) or embedded (size, without exceptions or RTTI, with unused sections removed and symbols stripped).
+     * Only GCC and Clang build the embedded profile.
+     * @param {string} compiler The C++ compiler.
+     * @param {string} target The target, such as linux-x64.
+     * @param {string} cpu The CPU to build for, or undefined for the target's default tuning.
+     * @param {boolean} lto False to build release and size profiles without link time optimization.
+     * @returns {{compile: string[], link: string[], lto: boolean}} Returns the flags to compile and link with.
+     */
+    getProfileFlags(profile, compiler, target, cpu, lto = true) {
+        const msvc = compiler === 'cl.exe';
+        const gcc = !msvc && !compiler.includes('clang');
+        const optimized = profile !== 'debug' && lto;
+        let flags;
+        if (msvc) {
+            flags = {
+                debug: { compile: ['/Od', '/Zi'], link: [] },
+                release: { compile: ['/O2', '/DNDEBUG'], link: [] },
+                size: { compile: ['/O1', '/DNDEBUG'], link: [] }
+            }[profile];
+            if (profile === 'embedded') {
+                throw new Error("The embedded profile builds without exceptions and RTTI with GCC or Clang, and can't be built with cl.exe.");
+            }
+            if (flags && optimized) {
+                flags = { compile: [...flags.compile, '/GL'], link: ['/link', '/LTCG'] };
+            }
+        }
+        else {
+            flags = {
+                debug: { compile: ['-O0', '-g'], link: ['-g'] },
+                release: { compile: ['-O2', '-DNDEBUG'], link: ['-O2'] },
+                size: { compile: ['-Os', '-DNDEBUG'], link: ['-Os'] },
+                // The runtime reports what it would have thrown and aborts, and its messages are written with stdio.
+                embedded: {
+                    compile: ['-Os', '-DNDEBUG', '-fno-exceptions', '-fno-rtti', '-ffunction-sections', '-fdata-sections'],
+                    link: ['-Os', ...(target.startsWith('macos') ? ['-Wl,-dead_strip'] : ['-Wl,--gc-sections', '-s'])]
+                }
+            }[profile];
+            if (flags && optimized) {
+                // GCC spreads the link time optimization over the cores, and Clang's needs a linker that loads
+                // LLVM bitcode, which is lld except on macOS.
+                const thin = !gcc && !target.startsWith('macos') ? ['-fuse-ld=lld'] : [];
+                flags = {
+                    compile: [...flags.compile, gcc ? '-flto' : '-flto=thin'],
+                    link: [...flags.link, gcc ? '-flto=auto' : '-flto=thin', ...thin]
+                };
+            }
+        }
+        if (!flags) {
+            throw new Error(`Unknown build profile ${profile}. Use debug, release, size or embedded.`);
+        }
+        const named = cpu ?? this.toolchain?.[`${target}-cpu`];
+        if (named) {
+            flags.compile.push(msvc ? `/arch:${named}` : target.endsWith('x64') ? `-march=${named}` : `-mcpu=${named}`);
+        }
+        else if (!msvc && profile !== 'debug' && DEFAULT_CPU_TUNING[target]) {
+            flags.compile.push(`-mtune=${DEFAULT_CPU_TUNING[target]}`);
+        }
+        return { ...flags, lto: optimized };
+    }
+
+    /**
+     * Builds an executable with profile guided optimization, from the program and the runtime sources. A first
+     * build is instrumented and run for a while to record where the program spends its time, then everything is
+     * built again with that profile. The objects of both builds are kept in <outputPath>/pgo rather than the object
+     * cache, since the profile is one of their inputs, and with GCC it is found by the path of each object.
+     * @param {string} outputPath The output directory.
+     * @param {string} exeFile The executable.
+     * @param {string} target The target, such as linux-x64.
+     * @param {string} compiler The C++ compiler.
+     * @param {string} compileFlags The flags to compile with.
+     * @param {string[]} programFiles The translation units of the program.
+     * @param {string[]} runtimeSources The runtime sources the program is built with.
+     * @param {string[]} libraries The prebuilt libraries to link.
+     * @param {function(string[], string[], string): string} link Makes the link command for objects, libraries and flags.
+     * @param {number} trainingTime How long the training run runs for, in milliseconds.
+     */
+    async profileGuidedBuild(outputPath, exeFile, target, compiler, compileFlags, programFiles, runtimeSources, libraries, link, trainingTime) {
+        if (compiler === 'cl.exe') {
+            throw new Error("Profile guided optimization is only supported with GCC and Clang toolchains.");
+        }
+        const clang = compiler.includes('clang');
+        const pgoDir = path.join(outputPath, 'pgo');
+        const objectDir = path.join(pgoDir, 'obj');
+        const profileDir = path.join(pgoDir, 'profile');
+        fs.rmSync(pgoDir, { recursive: true, force: true });
+        fs.mkdirSync(objectDir, { recursive: true });
+        fs.mkdirSync(profileDir, { recursive: true });
+        const sources = [...programFiles, ...runtimeSources.map((source) => path.join(outputPath, source))];
+        const build = async (flags) => {
+            const objects = await Promise.all(sources.map(async (source) => {
+                const object = path.join(objectDir, path.basename(source).replace(/\.cpp$/, '.o'));
+                await runToolchain(`${compiler} ${compileFlags}${flags}-c "${source}" -o "${object}"`);
+                return object;
+            }));
+            await runToolchain(link(objects, libraries, flags));
+        };
+
+        const generate = `-fprofile-generate="${profileDir}" `;
+        await build(`${generate}-DNODALIS_PGO_TRAINING `);
+        await runToolchain(`"${exeFile}" --run-for ${Math.max(1, Math.trunc(trainingTime))}`);
+        // endRun() only writes the profile in the training build, so its profile never matches and is left out.
+        let use = `-fprofile-use="${profileDir}" -fprofile-correction -Wno-missing-profile -Wno-coverage-mismatch `;
+        if (clang) {
+            const raw = fs.readdirSync(profileDir).filter((file) => file.endsWith('.profraw')).map((file) => `"${path.join(profileDir, file)}"`);
+            const merged = path.join(profileDir, 'default.profdata');
+            const profdata = this.toolchain?.[`${target}-profdata`] ?? (target.startsWith('macos') ? 'xcrun llvm-profdata' : 'llvm-profdata');
+            await runToolchain(`${profdata} merge -output="${merged}" ${raw.join(' ')}`);
+            use = `-fprofile-use="${merged}" -Wno-profile-instr-unprofiled `;
+        }
+        await build(use);
+    }
+
+    /**
+     * Gets the object file of a translation unit of a generated program, compiling it on first use. Objects are cached under
+     * NODALIS_CACHE, or ~/.nodalis/cache, keyed on the target, the compiler and its version, the flags, the program
+     * and every header it could include, so the same program built again, in any output directory, is not recompiled.
+     * @param {string} outputPath The directory the program and the runtime headers were written to.
+     * @param {string} cppFile The generated translation unit.
+     * @param {string} target The target, such as linux-x64.
+     * @param {string} compiler The C++ compiler.
+     * @param {string} flags The flags the program is compiled with.
+     * @returns {Promise<string>} Returns the path to the object file.
+     */
+    async programObject(outputPath, cppFile, target, compiler, flags) {
+        const msvc = compiler === 'cl.exe';
+        const hash = crypto.createHash('sha256').update(`${target}\n${compiler}\n${compilerVersion(compiler)}\n${flags.split(outputPath).join('<output>')}\n`);
+        hash.update(fs.readFileSync(cppFile));
+        hashHeaders(hash, outputPath);
+        const objectDir = path.join(cacheRoot(), 'objects', target);
+        const objectFile = path.join(objectDir, `${hash.digest('hex').slice(0, 32)}${msvc ? '.obj' : '.o'}`);
+        return buildOnce(objectFile, async () => {
+            fs.mkdirSync(objectDir, { recursive: true });
+            // Like the runtime library, the object is only moved into the cache once it is complete.
+            const partial = `${objectFile}.${process.pid}`;
+            try {
+                await runToolchain(msvc ? `cl.exe ${flags} /c "${cppFile}" /Fo"${partial}"` : `${compiler} ${flags}-c "${cppFile}" -o "${partial}"`);
+                fs.renameSync(partial, objectFile);
+            } finally {
+                fs.rmSync(partial, { force: true });
+            }
+        });
+    }
 
-            inputs.push(`"${open62541o}"`);
-            inputs.push(`"${bacneta}"`);
+    /**
+     * Gets the static library of the runtime sources (nodalis, modbus, opcua, bacnet, ioreactor, metrics,
+     * redundancy, netvar, recorder, simulation, historian, watch, alarms, sparkplug, localio and enip) for a build, building it
+     * on first use.
+     * Libraries are cached under NODALIS_CACHE, or ~/.nodalis/cache, keyed on the target, the compiler and its version,
+     * the flags and the contents of every runtime header and source, processimage.h and runtimeconfig.h included, so a
+     * program is linked against a library built with the same image layout and protocols.
+     * @param {string} outputPath The directory the runtime sources were copied to.
+     * @param {string} target The target, such as linux-x64.
+     * @param {string} compiler The C++ compiler.
+     * @param {string} flags The flags the runtime is compiled with.
+     * @param {string[]} programHeaders The headers of the program in the output directory, which the runtime doesn't include.
+     * @param {boolean} lto True if the flags compile for link time optimization, which needs an archiver that indexes it.
+     * @param {string[]} sources The runtime sources to build, which leave out those of the protocols the program doesn't use.
+     * @returns {Promise<string>} Returns the path to the library.
+     */
+    async runtimeLibrary(outputPath, target, compiler, flags, programHeaders = [], lto = false, sources = RUNTIME_SOURCES) {
+        const msvc = compiler === 'cl.exe';
+        // The include paths lead into the output directory, which doesn't change what is compiled.
+        const hash = crypto.createHash('sha256').update(`${target}\n${compiler}\n${compilerVersion(compiler)}\n${flags.split(outputPath).join('<output>')}\n`);
+        hashHeaders(hash, outputPath, sources, programHeaders);
+        const libDir = path.join(cacheRoot(), 'runtime', target, hash.digest('hex').slice(0, 16));
+        const libFile = path.join(libDir, msvc ? 'nodalis.lib' : 'libnodalis.a');
+        return buildOnce(libFile, async () => {
+            // The library is built beside its final place and moved there whole, so a build that stops half way, or
+            // another build of the same library at the same time, never leaves a partial library in the cache.
+            // Its sources compile in parallel.
+            const buildDir = `${libDir}.${process.pid}`;
+            fs.mkdirSync(buildDir, { recursive: true });
+            try {
+                const objects = await Promise.all(sources.map(async (source) => {
+                    const object = path.join(buildDir, source.replace(/\.cpp$/, msvc ? '.obj' : '.o'));
+                    const input = path.join(outputPath, source);
+                    await runToolchain(msvc ? `cl.exe ${flags} /c "${input}" /Fo"${object}"` : `${compiler} ${flags}-c "${input}" -o "${object}"`);
+                    return `"${object}"`;
+                }));
+                const library = path.join(buildDir, path.basename(libFile));
+                await runToolchain(msvc ? `lib.exe ${lto ? '/LTCG ' : ''}/OUT:"${library}" ${objects.join(' ')}` : `${this.getArchiverBinary(target, compiler, lto)} rcs "${library}" ${objects.join(' ')}`);
+                objects.forEach((object) => fs.rmSync(object.slice(1, -1)));
+                try {
+                    fs.renameSync(buildDir, libDir);
+                } catch {
+                    // Another build finished the same library first.
+                }
+            } finally {
+                fs.rmSync(buildDir, { recursive: true, force: true });
+            }
+        });
+    }
 
-            if (compiler === 'cl.exe') {
-                const cppFlagSegment = formatFlags(archFlags.cpp);
-                cppCompileCmd = `cl.exe /I${bacneti} /I${bacneti}/ports/${isWindowsTarget ? "win32" : "linux"} ${cppFlagSegment}/EHsc /std:c++17 /Fe:"${exeFile}" ` +
-                    `"${cppFile}" "${pathTo('nodalis.cpp')}" "${pathTo('modbus.cpp')}" "${pathTo('opcua.cpp')}" "${pathTo('bacnet.cpp')}"`; //"${pathTo('open62541.obj')}"`;
-            } else {
-                const cppFlagSegment = formatFlags(archFlags.cpp);
-                cppCompileCmd = `${compiler} ${cppFlagSegment}-std=c++17 -I${bacneti} -I${bacneti}/ports/${isWindowsTarget ? "win32" : "linux"} -o "${exeFile}" ${inputs.join(' ')} ${archFlags.linker}`;
+    /**
+     * Gets the archiver that goes with a C++ compiler, such as x86_64-linux-gnu-ar for x86_64-linux-gnu-g++. A
+     * toolchain.json can name it as "<target>-ar".
+     * @param {string} target The target, such as linux-x64.
+     * @param {string} compiler The C++ compiler.
+     * @param {boolean} lto True if the objects are built for link time optimization, which takes gcc-ar with GCC,
+     * or llvm-ar with Clang outside of macOS.
+     * @returns {string} Returns the archiver.
+     */
+    getArchiverBinary(target, compiler, lto = false) {
+        if (this.toolchain?.[`${target}-ar`]) {
+            return this.toolchain[`${target}-ar`];
+        }
+        // Objects built for link time optimization hold GCC's or LLVM's IR, which only their own archivers index.
+        if (lto && compiler.includes('clang')) {
+            if (!target.startsWith('macos')) {
+                return /clang\+\+(-[\w.]+)?$/.test(compiler) ? compiler.replace(/clang\+\+(-[\w.]+)?$/, 'llvm-ar$1') : 'llvm-ar';
             }
+        }
+        else if (lto && /g\+\+(-[\w.]+)?$/.test(compiler)) {
+            return compiler.replace(/g\+\+(-[\w.]+)?$/, 'gcc-ar$1');
+        }
+        const archiver = compiler.replace(/(g\+\+|clang\+\+|c\+\+)(-[\w.]+)?$/, 'ar');
+        return archiver === compiler ? 'ar' : archiver;
+    }
 
-            execSync(cppCompileCmd, { stdio: 'inherit' });
+    /**
+     * Compiles a //Map= line into a row of the IO map table. The point of a BACnet mapping is parsed into the point
+     * table, and only the properties of its client are left in the mapping. A map that can't be read here is left for
+     * the runtime to parse, and to report, when it starts.
+     * @param {string} text The map, as JSON escaped for a C++ string literal.
+     * @returns {object} Returns the escaped map, its row when it was read, and the module and point of a BACnet mapping.
+     */
+    compileMap(text) {
+        let map;
+        try {
+            map = JSON.parse(JSON.parse(`"${text}"`));
         }
+        catch(e) {
+            return { text };
+        }
+        if(!map || typeof map !== "object" ||
+            MAP_FIELDS.some((key) => typeof map[key] !== "string") ||
+            [map.Deadband, map.RefreshTime, map.MinPollTime, map.MaxPollTime].some((v) => v !== undefined && typeof v !== "string" && typeof v !== "number")){
+            return { text };
+        }
+        let props = map.ProtocolProperties;
+        let point = null;
+        let pointProperties = null;
+        if(map.Protocol === "BACNET" || map.Protocol === "BACNET-IP"){
+            try {
+                props = typeof props === "string" ? JSON.parse(props) : props;
+                point = props && typeof props === "object" ? parseBACnetPoint(props) : null;
+            }
+            catch(e) {
+                point = null;
+            }
+            if(point){
+                pointProperties = props;
+                map.ProtocolProperties = Object.fromEntries(Object.entries(props).filter(([key]) => !BACNET_POINT_PROPERTIES.includes(key)));
+            }
+        }
+        props = map.ProtocolProperties;
+        const integer = (value) => {
+            const n = typeof value === "number" ? Math.trunc(value) : parseInt(value, 10);
+            return isNaN(n) ? 0 : n;
+        };
+        const row = {
+            protocol: map.Protocol,
+            moduleID: map.ModuleID,
+            modulePort: map.ModulePort,
+            remoteAddress: map.RemoteAddress,
+            localAddress: map.InternalAddress,
+            properties: typeof props === "string" ? props : props === undefined || props === null ? "" : JSON.stringify(props),
+            width: integer(map.RemoteSize),
+            interval: integer(map.PollTime),
+            deadband: map.Deadband === undefined ? 0n : BigInt.asUintN(64, BigInt(integer(map.Deadband))),
+            refreshTime: map.RefreshTime === undefined ? 10000 : integer(map.RefreshTime),
+            minInterval: map.MinPollTime === undefined ? 0 : integer(map.MinPollTime),
+            maxInterval: map.MaxPollTime === undefined ? 0 : integer(map.MaxPollTime),
+            task: typeof map.Task === "string" && map.Task !== "" ? map.Task : null
+        };
+        const escaped = point ? JSON.stringify(map).replace(/\\/g, "\\\\").replace(/"/g, '\\"') : text;
+        return point ? { text: escaped, row, module: `${map.ModuleID}:${map.ModulePort}`, point, properties: JSON.stringify(pointProperties) }
+            : { text, row };
     }
 
     resolveTarget(target) {
@@ -356,7 +2028,8 @@ int main() {
             amd64: 'x64',
             arm64: 'arm64',
             aarch64: 'arm64',
-            arm: 'arm'
+            arm: 'arm',
+            armhf: 'armhf'
         };
         return map[archPart.toLowerCase()];
     }
@@ -408,7 +2081,7 @@ int main() {
             return defaultCompiler;
         }
 
-        const configuredCompiler = ToolChain[targetKey];
+        const configuredCompiler = (this.toolchain ?? DEFAULT_TOOLCHAIN)[targetKey];
         if (!configuredCompiler) {
             throw new Error(`No cross-compiler is configured for target ${targetKey}. Add it to toolchain.json or update the ToolChain defaults.`);
         }
@@ -443,6 +2116,7 @@ int main() {
             'linux-x64': [],
             'linux-arm64': [],
             'linux-arm': [],
+            'linux-armhf': ['-mfloat-abi=hard', '-mfpu=neon'],
             'macos-x64': ['-arch', 'x86_64'],
             'macos-arm64': ['-arch', 'arm64'],
             'windows-x64': [],
@@ -452,9 +2126,10 @@ int main() {
         let linker = {
             "windows-x64": " -lws2_32 -lcrypt32 -lwsock32 -lole32 -liphlpapi",
             "windows-arm64": " -lws2_32 -lcrypt32 -lwsock32 -lole32 -liphlpapi",
-            "linux-x64": "",
-            "linux-arm64": "",
-            "linux-arm": "",
+            "linux-x64": " -ldl",
+            "linux-arm64": " -ldl",
+            "linux-arm": " -ldl",
+            "linux-armhf": " -ldl",
             "macos-x64": "",
             "macos-arm64": "",
         }
@@ -464,6 +2139,8 @@ int main() {
                 'linux-x64': ["-D_POSIX_C_SOURCE=200809L -D_GNU_SOURCE -pthread"],
                 'linux-arm64': ["-D_POSIX_C_SOURCE=200809L -D_GNU_SOURCE -pthread"],
                 'linux-arm': ["-D_POSIX_C_SOURCE=200809L -D_GNU_SOURCE -pthread"],
+                // The hard-float ABI passes floats in VFP registers, and NEON runs the line kernels of the image.
+                'linux-armhf': ["-D_POSIX_C_SOURCE=200809L -D_GNU_SOURCE -pthread -mfloat-abi=hard -mfpu=neon"],
                 'windows-x64': ["-DUA_ARCHITECTURE_WIN32 -D_POSIX_C_SOURCE=200809L -D_GNU_SOURCE"],
                 'windows-arm64': ["-DUA_ARCHITECTURE_WIN32 -D_POSIX_C_SOURCE=200809L -D_GNU_SOURCE"]
             };
@@ -25,7 +25,8 @@ export const IECLanguage = Object.freeze({
 export const OutputType = Object.freeze({
   EXECUTABLE: 'executable',
   NODE_APP: 'node',
-  SOURCE_CODE: 'code'
+  SOURCE_CODE: 'code',
+  WASM: 'wasm'
 });
 
 export const CommunicationProtocol = Object.freeze({
@@ -21,6 +21,9 @@ import { Compiler, IECLanguage, OutputType, CommunicationProtocol } from './Comp
 import * as iec from "./iec-parser/parser.js";
 import { parseStructuredText } from './st-parser/parser.js';
 import { transpile } from './st-parser/jstranspiler.js';
+import { optimize } from './st-parser/ir.js';
+import { transpileWasm } from './st-parser/wasmtranspiler.js';
+import { CPPCompiler, parseTaskInterval } from './CPPCompiler.js';
 import which from "which";
 import { fileURLToPath } from "url";
 
@@ -39,7 +42,7 @@ export class JSCompiler extends Compiler {
     }
 
     get supportedOutputTypes() {
-        return [OutputType.SOURCE_CODE, OutputType.EXECUTABLE];
+        return [OutputType.SOURCE_CODE, OutputType.EXECUTABLE, OutputType.WASM];
     }
 
     get supportedTargetDevices() {
@@ -55,17 +58,23 @@ export class JSCompiler extends Compiler {
     }
 
     async compile() {
-        const { sourcePath, outputPath, target, outputType, resourceName } = this.options;
+        const { sourcePath, outputPath, target, outputType, resourceName, project } = this.options;
         var sourceCode = fs.readFileSync(sourcePath, 'utf-8');
         const filename = path.basename(sourcePath, path.extname(sourcePath));
         const jsFile = path.join(outputPath, `${filename}.js`);
         const stFile = path.join(outputPath, `${filename}.st`);
+        // The IO library is built last, so a host it can't be built for is rejected before the rest of the build.
+        if(target === "jint" && outputType === "executable" && this.options.nativeIO === true){
+            new CPPCompiler({}).checkIOLibrary();
+        }
         if(sourcePath.toLowerCase().endsWith(".iec") || sourcePath.toLowerCase().endsWith(".xml")){
             if(typeof resourceName === "undefined" || resourceName === null || resourceName.length === 0){
                 throw new Error("You must provide the resourceName option for an IEC project file.");
             }
             var stcode = "";
-            const iecProj = iec.Project.fromXML(sourceCode);
+            // A batch build parses the project once and passes it to each of its builds, and a watch keeps the POUs it
+            // has read in unitCache, so only those that changed are read again.
+            const iecProj = project ?? iec.Project.fromXML(sourceCode, resourceName, this.options.unitCache);
             iecProj.Instances.Configurations.forEach(
                 /**
                  * @param {iec.Configuration} c
@@ -89,7 +98,21 @@ export class JSCompiler extends Compiler {
             }
         }
         const parsed = parseStructuredText(sourceCode);
-        const transpiledCode = transpile(parsed);
+        // With the wasm output type, the programs that fit the WebAssembly transpiler are compiled into a module
+        // beside the script, and the script calls them through it; the rest are transpiled to Javascript as usual.
+        let wasm = null;
+        if(outputType === OutputType.WASM){
+            if(target !== "nodejs"){
+                throw new Error("The wasm output type is only supported for the nodejs target.");
+            }
+            wasm = transpileWasm(optimize(parsed, { addressReads: true }));
+            wasm.skipped.forEach((s) => console.warn(`${s.name} is transpiled to Javascript, since WebAssembly doesn't support ${s.reason}.`));
+        }
+        const jsPrograms = wasm === null ? parsed : { ...parsed, body: parsed.body.filter((b) => b.type !== 'ProgramDeclaration' || !wasm.programs.includes(b.name)) };
+        let transpiledCode = transpile(optimize(jsPrograms), { image: target === "nodejs" });
+        if(wasm !== null){
+            transpiledCode += wasm.programs.map((p) => `\nexport function ${p}() { // PROGRAM:${p}\n    WASM.${p}();\n}`).join("");
+        }
 
         let tasks = [];
         let programs = [];
@@ -137,45 +160,65 @@ export class JSCompiler extends Compiler {
                 programs.push(pname);
             }
         });
+        // The Node.js target releases its tasks from one scheduler, with the intervals and priorities the C++ target
+        // uses. The jint host calls run() itself, once per scan.
+        const nodeTasks = [];
         if(tasks.length > 0){
             tasks.forEach((t) => {
                 var progCode = "";
                 t.Instances.forEach((i) => {
                     progCode += i.TypeName + "();\n";
                 });
-                taskCode += 
-`
-    ${target === "nodejs" ? `setInterval(() => {` : ""}
-        ${progCode}
-    ${target === "nodejs" ? `}, ${t.Interval});` : ""}
-`;
+                var priority = parseInt(t.Priority);
+                nodeTasks.push({ name: t.Name, interval: parseTaskInterval(t.Interval), priority: isNaN(priority) ? 0 : priority, code: progCode });
+                if(target !== "nodejs") taskCode += progCode;
             });
         }
         else{
-            if(target === "nodejs") taskCode = "setInterval(() => {\n";
+            var progCode = "";
             programs.forEach((p) => {
-                taskCode += p + "();\n";
+                progCode += p + "();\n";
             });
-            if(target === "nodejs") taskCode += "}, 100);"
+            nodeTasks.push({ name: "MainTask", interval: 100, priority: 0, code: progCode });
+            if(target !== "nodejs") taskCode += progCode;
+        }
+        if(target === "nodejs" && (tasks.length > 0 || programs.length > 0)){
+            taskCode = `startScheduler([\n${nodeTasks.map((t) =>
+`        { name: ${JSON.stringify(t.name)}, interval: ${t.interval}, priority: ${t.priority}, run: () => {
+            ${t.code}
+        } }`).join(",\n")}\n    ]);`;
         }
         let includes = 
         `import {
         readBit, writeBit, readByte, writeByte, readWord, writeWord, readDWord, writeDWord, readAddress, writeAddress,
-        getBit, setBit, resolve, newStatic, RefVar, superviseIO, mapIO, createReference,
-        TON, TOF, TP, R_TRIG, F_TRIG, CTU, CTD, CTUD,
+        getBit, setBit, resolve, newStatic, RefVar, superviseIO, mapIO, createReference, startScheduler, startIOWorker,
+        IMAGE_BYTES, IMAGE_WORDS, IMAGE_DWORDS, setImageBit,
+        TON, TOF, TP, TON_LTIME, TOF_LTIME, TP_LTIME, R_TRIG, F_TRIG, CTU, CTD, CTUD,
         AND, OR, XOR, NOR, NAND, NOT, ASSIGNMENT,
         EQ, NE, LT, GT, GE, LE,
-        MOVE, SEL, MUX, MIN, MAX, LIMIT
+        MOVE, SEL, MUX, MIN, MAX, LIMIT,
+        SQRT, LN, LOG, EXP, SIN, COS, TAN, ASIN, ACOS, ATAN, EXPT, ABS, SHL, SHR, ROL, ROR,
+        TO_BOOL, TO_BYTE, TO_WORD, TO_DWORD, TO_LWORD, TO_SINT, TO_INT, TO_DINT, TO_LINT, TO_USINT, TO_UINT, TO_UDINT,
+        TO_ULINT, TO_REAL, TO_LREAL, TO_TIME, TO_LTIME, TO_LDATE, TO_LTOD, TO_LDT, TIME_TO_LTIME, LTIME_TO_TIME,
+        LDT_TO_LDATE, LDT_TO_LTOD, TRUNC, TRUNC_SINT, TRUNC_INT, TRUNC_DINT, TRUNC_LINT, TRUNC_USINT, TRUNC_UINT,
+        TRUNC_UDINT, TRUNC_ULINT
 } from "./nodalis.js";
  import {OPCServer} from "./opcua.js";`;
         if(target === "jint"){
             includes = "";
         }
+        if(wasm !== null){
+            includes += `
+import { readFileSync } from "fs";
+import { loadWasmProgram } from "./nodalis.js";
+const WASM = loadWasmProgram(readFileSync(new URL("./${filename}.wasm", import.meta.url)), ${wasm.pages});`;
+        }
         let jsCode = 
 `${includes}
 ${transpiledCode}
 ${target === "nodejs" ? `let opcServer = new OPCServer();`: ""}
 ${taskCode !== "" ? `export async function setup(){
+    ${target === "nodejs" ? `if(!process.argv.includes("--sync-io")) startIOWorker();` : ""}
     ${mapCode}
 
     ${target === "nodejs" ? "opcServer.setReadWriteHandlers(readAddress, writeAddress);\n" + `await opcServer.start();\n` + globals.join("\n") : ""}
@@ -183,7 +226,6 @@ ${taskCode !== "" ? `export async function setup(){
 }
 
 export function run(){
-    ${target === "nodejs" ? "setInterval(superviseIO, 1);" : ""} 
     ${taskCode}
     
 }
@@ -196,6 +238,9 @@ export function run(){
         }
         fs.mkdirSync(outputPath, { recursive: true });
         fs.writeFileSync(jsFile, jsCode);
+        if(wasm !== null){
+            fs.writeFileSync(path.join(outputPath, `${filename}.wasm`), wasm.bytes);
+        }
         if(sourcePath.toLowerCase().endsWith(".iec") || sourcePath.toLowerCase().endsWith(".xml")){
             fs.writeFileSync(stFile, sourceCode);
         }
@@ -205,6 +250,7 @@ export function run(){
                 'nodalis.js',
                 'modbus.js',
                 "IOClient.js",
+                "ioworker.js",
                 "opcua.js"
             ];
 
@@ -260,6 +306,19 @@ export function run(){
                     content = content.replace("{script}", scriptName);
                     fs.writeFileSync(batFile, content, "utf-8");
                 }
+            }
+
+            // 4. With nativeIO, the runtime's IO clients are built for the host into a library beside the host's
+            //    executable, which the PLC loads when it is started with --native-io.
+            if (this.options.nativeIO === true) {
+                const cpp = new CPPCompiler({});
+                const hostOs = cpp.getHostOS();
+                const rid = `${{ linux: "linux", macos: "osx", windows: "win" }[hostOs]}-${cpp.getHostArch()}`;
+                const library = await cpp.buildIOLibrary(path.join(outputPath, "nativeio"));
+                const platformDir = path.join(publishRoot, rid);
+                if (fs.existsSync(platformDir)) {
+                    fs.copyFileSync(library, path.join(platformDir, path.basename(library)));
+                }
 
             }
         }
@@ -22,7 +22,7 @@
  * @copyright Apache 2.0
  */
 
-import {DOMParser} from "xmldom";
+import {parseXML} from "./xmlreader.js";
 
 /**
  * Tests whether an object value is null or undefined.
@@ -114,6 +114,37 @@ function generateGUID() {
     }
 
     
+/**
+ * The standard blocks without state, which an FBD network compiles to an expression of their inputs rather than to a
+ * call of an instance, by type name. Each is given the ST expressions of its connected inputs, in order.
+ */
+const FBD_EXPRESSIONS = {
+    AND: (ins) => ins.join(" AND "),
+    OR: (ins) => ins.join(" OR "),
+    XOR: (ins) => ins.join(" XOR "),
+    NAND: (ins) => `NOT (${ins.join(" AND ")})`,
+    NOR: (ins) => `NOT (${ins.join(" OR ")})`,
+    NOT: (ins) => `NOT ${ins[0]}`,
+    ASSIGNMENT: (ins) => ins[0],
+    MOVE: (ins) => ins[0],
+    ADD: (ins) => ins.join(" + "),
+    MUL: (ins) => ins.join(" * "),
+    SUB: (ins) => ins.join(" - "),
+    DIV: (ins) => ins.join(" / "),
+    MOD: (ins) => ins.join(" MOD "),
+    EQ: (ins) => ins.join(" = "),
+    NE: (ins) => ins.join(" <> "),
+    LT: (ins) => ins.join(" < "),
+    GT: (ins) => ins.join(" > "),
+    GE: (ins) => ins.join(" >= "),
+    LE: (ins) => ins.join(" <= ")
+};
+
+/**
+ * The blocks of FBD_EXPRESSIONS whose result is a BOOL whatever their inputs are.
+ */
+const FBD_BOOL_RESULTS = new Set(["AND", "OR", "XOR", "NAND", "NOR", "NOT", "ASSIGNMENT", "EQ", "NE", "LT", "GT", "GE", "LE"]);
+
 /**
  * An abstract class which will provide definition for serializing any inheriting class
  * into json or from json. The inheriting class must extend the "TypeMap" property defined
@@ -232,12 +263,25 @@ export class Project extends Serializable {
 
     /**
      * Parses a string of xml representing the complete project file and sets the properties of a new Project object based on it.
+     * When resources are named, only those resources and the programs and function blocks they use are read, and the
+     * rest of the project is passed over without being built.
      * @param {String} xml A string containing the xml to parse.
+     * @param {string|string[]?} resourceNames The resources to read, or null or undefined to read the whole project.
+     * @param {Map<string, Element>?} unitCache Kept between reads of the same project, the programs and function blocks
+     * read before, by their xml. Those that haven't changed since are not read again.
      * @returns A new Project object.
      */
-    static fromXML(xml) {
-        const parser = new DOMParser();
-        const xmlDoc = parser.parseFromString(xml, "text/xml");
+    static fromXML(xml, resourceNames, unitCache) {
+        const scoped = isValid(resourceNames);
+        const wanted = new Set(Array.isArray(resourceNames) ? resourceNames : [resourceNames]);
+        const xmlDoc = parseXML(xml, scoped ? {
+            visit: (tagName, attributes, parent) => {
+                if(tagName === "Resource") return wanted.has(attributes.name) ? "keep" : "skip";
+                if((tagName === "Program" || tagName === "FunctionBlock") && parent.tagName === "NamespaceDecl") return "defer";
+                return "keep";
+            }
+        } : undefined);
+        if(scoped) Project.readUsedUnits(xmlDoc, unitCache);
         
         const proj = new Project(
             FileHeader.fromXML(xmlDoc.getElementsByTagName("FileHeader")[0]),
@@ -254,6 +298,46 @@ export class Project extends Serializable {
         return proj;
     }
 
+    /**
+     * Reads the deferred programs and function blocks that the resources of a document use, starting from the types of
+     * their program instances and following every name in the source of each unit read, and drops the others.
+     * IEC names are not case sensitive, and a name that only looks like a reference costs an extra unit, never a missing one.
+     * @param {ReturnType<typeof parseXML>} xmlDoc The document read with the programs and function blocks deferred.
+     * @param {Map<string, Element>?} unitCache The units read before. Units that are no longer used are dropped from it.
+     */
+    static readUsedUnits(xmlDoc, unitCache) {
+        const units = Object.create(null);
+        forEachElem(xmlDoc.deferred, (d) => {
+            const key = d.getAttribute("name").toUpperCase();
+            if(!isValid(units[key])) units[key] = [];
+            units[key].push(d);
+        });
+        const pending = [];
+        const used = [];
+        const use = (name) => {
+            const key = name.toUpperCase();
+            const found = units[key];
+            if(isValid(found)){
+                delete units[key];
+                pending.push(...found);
+            }
+        };
+        forEachElem(xmlDoc.getElementsByTagName("ProgramInstance"), (p) => use(p.getAttribute("typeName")));
+        while(pending.length > 0){
+            const unit = pending.pop();
+            for(const name of unit.xml.matchAll(/[A-Za-z_][A-Za-z0-9_]*/g)){
+                use(name[0]);
+            }
+            unit.expand(unitCache);
+            used.push(unit.xml);
+        }
+        if(isValid(unitCache)){
+            const keep = new Set(used);
+            [...unitCache.keys()].filter(xml => !keep.has(xml)).forEach(xml => unitCache.delete(xml));
+        }
+        Object.values(units).forEach(found => forEachElem(found, d => d.remove()));
+    }
+
     /**
      * Formats the object as an XML string.
      * @returns A string representation of the Project object.
@@ -799,7 +883,7 @@ export class Instances extends Serializable {
         if(isValid(parent)) obj.Parent = parent;
         var configs = xml.getElementsByTagName("Configuration");
         forEachElem(configs, (c) => {
-            obj.Configurations.push(Configuration.fromXML(xml, obj));
+            obj.Configurations.push(Configuration.fromXML(c, obj));
         });
         return obj;
     }
@@ -1068,25 +1152,29 @@ export class Task extends Serializable{
      * @param {string?} interval The interval at which the task runs.
      * @param {string?} priority The priority of the task.
      * @param {Configuration?} parent The parent that owns the task.
+     * @param {string?} single The BOOL whose rising edge triggers an event task, or empty for a cyclic task.
      */
-    constructor(type, name, interval, priority, parent){
+    constructor(type, name, interval, priority, parent, single){
         super();
         this.TypeMap = {
             "Type": "",
             "Name": "",
             "Interval": "",
-            "Priority": ""
+            "Priority": "",
+            "Single": ""
         };
         this.Type = "";
         this.Name = "";
         this.Interval = "1000";
         this.Priority = "1";
+        this.Single = "";
         this.Parent = null;
         if(isValid(type)) this.Type = type;
         if(isValid(name)) this.Name = name;
         if(isValid(interval)) this.Interval = interval;
         if(isValid(priority)) this.Priority = priority;
         if(isValid(parent)) this.Parent = parent;
+        if(isValid(single)) this.Single = single;
     }
 
     /**
@@ -1097,7 +1185,8 @@ export class Task extends Serializable{
      */
     static fromXML(xml, parent){
         if(!isValid(xml)) return null;
-        return new Task(xml.getAttribute("xsi:type"), xml.getAttribute("name"), xml.getAttribute("interval"), xml.getAttribute("priority"), parent);
+        return new Task(xml.getAttribute("xsi:type"), xml.getAttribute("name"), xml.getAttribute("interval"), xml.getAttribute("priority"), parent,
+            xml.getAttribute("single"));
     }
 
     /**
@@ -1105,7 +1194,8 @@ export class Task extends Serializable{
      * @returns {string} Returns an xml string of the object.
      */
     toXML(){
-        return `<Task xsi:type="${this.Type}" name="${this.Name}" interval="${this.Interval}" priority="${this.Priority}"/>`;
+        const single = this.Single ? ` single="${this.Single}"` : "";
+        return `<Task xsi:type="${this.Type}" name="${this.Name}" interval="${this.Interval}" priority="${this.Priority}"${single}/>`;
     }
 
     /**
@@ -1114,7 +1204,8 @@ export class Task extends Serializable{
      * @returns {string} A string representing the task as structured text.
      */
     toST(){
-        return `//Task={"Name":"${this.Name}", "Interval":"${this.Interval}", "Priority":"${this.Priority}"}\n`;
+        const single = this.Single ? `, "Single":"${this.Single}"` : "";
+        return `//Task={"Name":"${this.Name}", "Interval":"${this.Interval}", "Priority":"${this.Priority}"${single}}\n`;
     }
 }
 
@@ -1255,12 +1346,13 @@ export class Program extends Serializable {
                     decl += `${v.Name} ${isValid(v.Address) ? "AT %" + v.Address.Location + v.Address.Size + (v.Address.Address.length > 0 ? "." + v.Address.Address : "") : ""} : ${v.Type.TypeName};\n`;
                 }
             );
+            const body = this.MainBody.toST();
             st = 
 `PROGRAM ${this.Name}
     VAR
         ${decl}
     END_VAR
-    ${this.MainBody.toST()}
+    ${this.MainBody.BodyContent?.temporariesST() ?? ""}${body}
 END_PROGRAM`;
         }
         catch(e){
@@ -1347,6 +1439,7 @@ export class BodyContent extends Serializable {
         this.ST = null;
         this.Rungs = [];
         this.Networks = [];
+        this.Temporaries = [];
         this.Parent = null;
         if(type == "ST"){
             this.ST = new ST();
@@ -1458,6 +1551,16 @@ export class BodyContent extends Serializable {
                     st += r.toST();
                 });
             }
+            else if(this.Type === "FBD"){
+                this.Temporaries = [];
+                const networks = [...this.Networks].sort((n1, n2) => parseInt(n1.EvaluationOrder) - parseInt(n2.EvaluationOrder));
+                const types = this.variableTypes();
+                networks.forEach((n, i) => {
+                    const compiled = n.toST(types, `FBD${i + 1}`);
+                    this.Temporaries.push(...compiled.temporaries);
+                    st += compiled.st;
+                });
+            }
             else if(this.ST !== null){
                 st = this.ST.Content.trim();
             }
@@ -1468,6 +1571,30 @@ export class BodyContent extends Serializable {
         return st;
         
     }
+
+    /**
+     * Gets the types of the variables of the POU this content is the body of, to type the temporaries of FBD networks.
+     * @returns {Object<string, string>} Returns the ST type names, by upper case variable name.
+     */
+    variableTypes(){
+        const types = {};
+        const pou = this.Parent?.Parent;
+        const add = (vars) => forEachElem(vars?.Variables ?? [], (v) => types[v.Name.toUpperCase()] = v.Type?.TypeName);
+        add(pou?.Vars);
+        add(pou?.ExternalVars);
+        add(pou?.Parameters?.InputVars);
+        add(pou?.Parameters?.OutputVars);
+        return types;
+    }
+
+    /**
+     * Declares the temporaries the last toST() of an FBD body assigns.
+     * @returns {string} Returns a VAR_TEMP section, indented to go before the body, or an empty string if there are none.
+     */
+    temporariesST(){
+        if(!isValid(this.Temporaries) || this.Temporaries.length === 0) return "";
+        return `VAR_TEMP\n${this.Temporaries.map((t) => `        ${t.name} : ${t.type};\n`).join("")}    END_VAR\n    `;
+    }
 }
 
 /**
@@ -1605,6 +1732,7 @@ export class FunctionBlock extends Serializable{
                     decl += `${v.Name} ${isValid(v.Address) ? "%" + v.Address.Location + v.Address.Size + (v.Address.Address.length > 0 ? "." + v.Address.Address : "") : ""} : ${v.Type.TypeName};\n`;
                 }
             );
+            const body = this.MainBody.toST();
             st =
 `FUNCTION_BLOCK ${this.Name}
     VAR_INPUT
@@ -1616,7 +1744,7 @@ export class FunctionBlock extends Serializable{
     VAR
         ${decl}
     END_VAR
-    ${this.MainBody.toST()}
+    ${this.MainBody.BodyContent?.temporariesST() ?? ""}${body}
 END_FUNCTION_BLOCK`;
         }
         catch(e){
@@ -2143,15 +2271,13 @@ export class Network extends Serializable{
     static fromXML(xml, parent) {
         if(!isValid(xml)) return null;
         var net = new Network(xml.getAttribute("evaluationOrder"), parent);
-        var onodes = xml.getElementsByTagName("CommonObject,FbdObject");
-        forEachElem(onodes, (elem) => {
-            if(elem.tagName == "CommonObject"){
-                net.Objects.push(CommonObject.fromXML(elem, net));
-            }
-            else if(elem.tagName == "FbdObject"){
-                net.Objects.push(FbdObject.fromXML(elem, net));
-            }
+        forEachElem(xml.getElementsByTagName("FbdObject"), (elem) => {
+            net.Objects.push(FbdObject.fromXML(elem, net));
+        });
+        forEachElem(xml.getElementsByTagName("CommonObject"), (elem) => {
+            net.Objects.push(CommonObject.fromXML(elem, net));
         });
+        return net;
     }
 
     /**
@@ -2167,6 +2293,105 @@ export class Network extends Serializable{
                     ${objxml}
                 </Network>`;
     }
+
+    /**
+     * Compiles the network to structured text, in the order its blocks depend on each other rather than through
+     * instance variables for every block. The blocks without state (FBD_EXPRESSIONS) become expressions that are
+     * written into the inputs that read them, so their values stay in registers. A value such a block gives more than
+     * one input is computed once into a temporary, when its type is known. Every other block keeps its instance, and
+     * is called with formal parameters once the blocks it reads from have been, so that a data sink or another block
+     * reads its outputs from this scan. A connection back to a block that is still being compiled, a feedback path,
+     * reads the outputs the block had at the end of the last scan.
+     * @param {Object<string, string>} types The ST types of the variables of the POU, by upper case name, to type the
+     * temporaries.
+     * @param {string} prefix The prefix of the names of the network's temporaries.
+     * @returns {{st: string, temporaries: {name: string, type: string}[]}} Returns the structured text and the
+     * temporaries it assigns, which the POU declares as VAR_TEMP.
+     */
+    toST(types = {}, prefix = "FBD"){
+        const objects = this.Objects.filter((o) => o instanceof FbdObject);
+        // The object and output variable of each output point, and the number of inputs connected to it, by ID.
+        const sources = {};
+        const uses = {};
+        forEachElem(objects, (o) => {
+            forEachElem(o.Outputs, (point) => sources[point.ID] = { object: o, parameter: "" });
+            forEachElem(o.OutputVariables.Variables, (v) => sources[v.OutputPoint.ID] = { object: o, parameter: v.ParameterName });
+            forEachElem(o.getInputIDs(), (id) => uses[id] = (uses[id] ?? 0) + 1);
+        });
+        const lines = [];
+        const temporaries = [];
+        const values = {};
+        const called = new Set();
+        const visiting = new Set();
+        const name = (o) => o.InstanceName || o.Identifier;
+        const stateless = (o) => o.Type === "Block" && isValid(FBD_EXPRESSIONS[o.TypeName.toUpperCase()]);
+        // The ST type of the value of an output, if it is known without the types of the blocks' instances.
+        const typeOf = (id) => {
+            const source = sources[id];
+            if(!isValid(source)) return null;
+            const o = source.object;
+            if(o.Type === "DataSource"){
+                if(/^(TRUE|FALSE)$/i.test(o.Identifier)) return "BOOL";
+                return types[o.Identifier.toUpperCase()] ?? null;
+            }
+            if(!stateless(o)) return null;
+            if(FBD_BOOL_RESULTS.has(o.TypeName.toUpperCase())) return "BOOL";
+            return o.InputVariables.Variables.map((v) => v.InputPoint?.Connections[0]?.RefID)
+                .filter(isValid).map(typeOf).find(isValid) ?? null;
+        };
+        const inputs = (o) => o.InputVariables.Variables.map((v) => {
+            const id = v.InputPoint?.Connections[0]?.RefID;
+            const value = isValid(id) ? valueOf(id) : null;
+            if(!isValid(value)) return null;
+            return { name: v.ParameterName, value: v.Negated === "true" ? `(NOT ${value})` : value };
+        }).filter(isValid);
+        const call = (o) => {
+            if(called.has(o) || visiting.has(o)) return;
+            visiting.add(o);
+            const args = inputs(o).map((input) => `${input.name} := ${input.value}`);
+            visiting.delete(o);
+            called.add(o);
+            lines.push(`${name(o)}(${args.join(", ")});`);
+        };
+        // The ST expression that reads an output.
+        const valueOf = (id) => {
+            const source = sources[id];
+            if(!isValid(source)) return null;
+            const o = source.object;
+            if(o.Type === "DataSource") return o.Identifier;
+            if(!stateless(o)){
+                call(o);
+                return `${name(o)}.${source.parameter}`;
+            }
+            if(isValid(values[id])) return values[id];
+            if(visiting.has(o)){
+                throw new Error(`The FBD network ${this.EvaluationOrder} has a loop through ${name(o)} without a function block to hold its value.`);
+            }
+            visiting.add(o);
+            let value = `(${FBD_EXPRESSIONS[o.TypeName.toUpperCase()](inputs(o).map((input) => input.value))})`;
+            visiting.delete(o);
+            const type = typeOf(id);
+            if((uses[id] ?? 0) > 1 && isValid(type)){
+                const temporary = `${prefix}_${temporaries.length + 1}`;
+                temporaries.push({ name: temporary, type: type });
+                lines.push(`${temporary} := ${value};`);
+                value = temporary;
+            }
+            values[id] = value;
+            return value;
+        };
+        forEachElem(objects, (o) => {
+            if(o.Type === "DataSink"){
+                const id = o.Inputs[0]?.Connections[0]?.RefID;
+                const value = isValid(id) ? valueOf(id) : null;
+                if(isValid(value)) lines.push(`${o.Identifier} := ${value};`);
+            }
+            else if(o.Type === "Block" && !stateless(o)){
+                call(o);
+            }
+        });
+        return { st: lines.join("\n") + (lines.length > 0 ? "\n" : ""), temporaries: temporaries };
+    }
 }
 
 /**
@@ -2535,12 +2760,12 @@ export class LdObject extends Serializable{
                     }
                     else if(this.Latch === "set"){
                         st = `IF (${expression}) THEN
-                            ${this.Operand} := 1;"
+                            ${this.Operand} := 1;
                         END_IF;`;
                     }
                     else if(this.Latch === "reset"){
                         st = `IF (${expression}) THEN
-                            ${this.Operand} := 0;"
+                            ${this.Operand} := 0;
                         END_IF;`;
                     }
                     
@@ -4175,6 +4400,10 @@ export const ModuleProtocols = Object.freeze([
     "MODBUS-RTU",
     "OPCUA",
     "BACNET-IP",
+    "NETVAR",
+    "ETHERNET-IP",
+    "GPIO",
+    "MMIO",
     "MTI"
 ]);
 
@@ -0,0 +1,341 @@
+/* eslint-disable curly */
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/**
+ * @description Single pass XML reader for IEC project files
+ * @author Nathan Skipper, MTI
+ * @version 1.0.0
+ * @copyright Apache 2.0
+ */
+
+const NAME = /[A-Za-z_:][\w:.-]*/y;
+const ATTRIBUTE = /\s*([A-Za-z_:][\w:.-]*)\s*=\s*(?:"([^"]*)"|'([^']*)')/y;
+const TAG_END = /\s*(\/?)>/y;
+const TAG_REST = /[^>"']*(?:(?:"[^"]*"|'[^']*')[^>"']*)*>/y;
+const ENTITY = /&(#x[0-9a-fA-F]+|#[0-9]+|lt|gt|amp|quot|apos);/g;
+const ENTITIES = { lt: "<", gt: ">", amp: "&", quot: "\"", apos: "'" };
+
+/**
+ * Replaces the character and predefined entity references of a string.
+ * @param {string} text The raw text of an attribute or text node.
+ * @returns {string} Returns the decoded text.
+ */
+function decode(text){
+    if(text.indexOf("&") < 0) return text;
+    return text.replace(ENTITY, (_, ref) => {
+        if(ref.startsWith("#x")) return String.fromCodePoint(parseInt(ref.substring(2), 16));
+        if(ref.startsWith("#")) return String.fromCodePoint(parseInt(ref.substring(1), 10));
+        return ENTITIES[ref];
+    });
+}
+
+/**
+ * A list of nodes, which is an array that also offers the item() of a DOM NodeList.
+ */
+export class XmlNodeList extends Array {
+    /**
+     * @param {number} index The index of the node.
+     * @returns {XmlElement|XmlText|null} Returns the node, or null when the index is out of range.
+     */
+    item(index){
+        return index < this.length ? this[index] : null;
+    }
+}
+
+/**
+ * A text or CDATA node of a document.
+ */
+export class XmlText {
+    /**
+     * @param {string} data The decoded text.
+     * @param {XmlElement} parentNode The element containing the text.
+     */
+    constructor(data, parentNode){
+        this.nodeType = 3;
+        this.nodeName = "#text";
+        this.data = data;
+        this.parentNode = parentNode;
+    }
+
+    get textContent(){
+        return this.data;
+    }
+}
+
+/**
+ * An element of a document, offering the part of the DOM Element interface the IEC parser uses.
+ */
+export class XmlElement {
+    /**
+     * @param {string} tagName The qualified name of the element.
+     * @param {Object<string, string>} attributes The decoded attributes by their qualified name.
+     * @param {XmlElement?} parentNode The containing element.
+     */
+    constructor(tagName, attributes, parentNode){
+        this.nodeType = 1;
+        this.tagName = tagName;
+        this.nodeName = tagName;
+        this.attributes = attributes;
+        /** @type {XmlNodeList} */
+        this.childNodes = new XmlNodeList();
+        this.parentNode = parentNode ?? null;
+    }
+
+    get firstChild(){
+        return this.childNodes.length > 0 ? this.childNodes[0] : null;
+    }
+
+    get children(){
+        return this.childNodes.filter(n => n.nodeType === 1);
+    }
+
+    get textContent(){
+        var text = "";
+        for(const node of this.childNodes){
+            text += node.textContent;
+        }
+        return text;
+    }
+
+    /**
+     * Gets the value of an attribute.
+     * @param {string} name The qualified name of the attribute.
+     * @returns {string} Returns the value, or an empty string when the element does not have the attribute.
+     */
+    getAttribute(name){
+        return Object.prototype.hasOwnProperty.call(this.attributes, name) ? this.attributes[name] : "";
+    }
+
+    /**
+     * Determines whether the element has an attribute.
+     * @param {string} name The qualified name of the attribute.
+     * @returns {boolean} Returns true if the attribute is present.
+     */
+    hasAttribute(name){
+        return Object.prototype.hasOwnProperty.call(this.attributes, name);
+    }
+
+    /**
+     * Finds the descendants of the element with a name, in document order.
+     * @param {string} names The name to find, "*" for every element, or a comma separated list of names.
+     * @returns {XmlNodeList} Returns the matching elements.
+     */
+    getElementsByTagName(names){
+        const found = new XmlNodeList();
+        const any = names === "*";
+        const wanted = names.indexOf(",") < 0 ? null : new Set(names.split(",").map(n => n.trim()));
+        const search = (elem) => {
+            for(const node of elem.childNodes){
+                if(node.nodeType !== 1) continue;
+                if(any || (wanted ? wanted.has(node.tagName) : node.tagName === names)) found.push(node);
+                search(node);
+            }
+        };
+        search(this);
+        return found;
+    }
+}
+
+/**
+ * An element left unparsed when reading a document, which keeps the range of its source so it can be read later.
+ */
+export class DeferredElement extends XmlElement {
+    /**
+     * @param {string} tagName The qualified name of the element.
+     * @param {Object<string, string>} attributes The decoded attributes of the element.
+     * @param {XmlElement} parentNode The containing element.
+     * @param {string} source The document the element was found in.
+     * @param {number} start The offset of the start tag in the document.
+     */
+    constructor(tagName, attributes, parentNode, source, start){
+        super(tagName, attributes, parentNode);
+        this.source = source;
+        this.start = start;
+        this.end = start;
+    }
+
+    /**
+     * Gets the source of the element, from its start tag through its end tag.
+     * @returns {string} Returns the xml of the element.
+     */
+    get xml(){
+        return this.source.substring(this.start, this.end);
+    }
+
+    /**
+     * Reads the element and puts it in place of this one in the containing element.
+     * @param {{get: function(string): XmlElement, set: function(string, XmlElement)}?} cache Elements read before, by
+     * their source. An element whose source is in the cache is taken from it instead of being read again.
+     * @returns {XmlElement} Returns the element that was read.
+     */
+    expand(cache){
+        const xml = this.xml;
+        let elem = cache?.get(xml);
+        if(!elem){
+            elem = parseXML(xml).documentElement;
+            cache?.set(xml, elem);
+        }
+        elem.parentNode = this.parentNode;
+        const siblings = this.parentNode.childNodes;
+        siblings[siblings.indexOf(this)] = elem;
+        return elem;
+    }
+
+    /**
+     * Removes the element from the containing element without reading it.
+     */
+    remove(){
+        const siblings = this.parentNode.childNodes;
+        siblings.splice(siblings.indexOf(this), 1);
+    }
+}
+
+/**
+ * Reads a document in a single pass over its text. Comments, processing instructions and the doctype are dropped, and
+ * CDATA sections become text nodes. The reader is lenient toward end tags that do not match, as IEC editors are.
+ * @param {string} xml The text of the document.
+ * @param {{visit?: (tagName: string, attributes: Object<string, string>, parent: XmlElement) => ("keep"|"skip"|"defer")}} options
+ * The visit function is called with each start tag. An element that is skipped is passed over without building any of
+ * it, and an element that is deferred is passed over and kept as a DeferredElement, to be read only when it is needed.
+ * @returns {XmlElement & {documentElement: XmlElement, deferred: DeferredElement[]}} Returns the document node.
+ */
+export function parseXML(xml, options = {}){
+    const visit = options.visit;
+    const doc = new XmlElement("#document", {}, null);
+    doc.deferred = [];
+    var current = doc;
+    // While passing over an element, the names of its open elements, and the deferred element being passed over.
+    var passing = null;
+    var deferred = null;
+    var pos = 0;
+    const length = xml.length;
+
+    const text = (raw) => {
+        if(passing === null && raw.length > 0 && current !== doc) current.childNodes.push(new XmlText(raw, current));
+    };
+    const passed = (end) => {
+        if(deferred !== null){
+            deferred.end = end;
+            deferred = null;
+        }
+        passing = null;
+    };
+
+    while(pos < length){
+        const lt = xml.indexOf("<", pos);
+        if(lt < 0){
+            if(passing === null) text(decode(xml.substring(pos)));
+            break;
+        }
+        if(lt > pos && passing === null) text(decode(xml.substring(pos, lt)));
+        const next = xml.charCodeAt(lt + 1);
+        if(next === 33 /* ! */){
+            if(xml.startsWith("<!--", lt)){
+                const close = xml.indexOf("-->", lt + 4);
+                pos = close < 0 ? length : close + 3;
+            }
+            else if(xml.startsWith("<![CDATA[", lt)){
+                const close = xml.indexOf("]]>", lt + 9);
+                text(xml.substring(lt + 9, close < 0 ? length : close));
+                pos = close < 0 ? length : close + 3;
+            }
+            else{
+                const close = xml.indexOf(">", lt + 2);
+                pos = close < 0 ? length : close + 1;
+            }
+            continue;
+        }
+        if(next === 63 /* ? */){
+            const close = xml.indexOf("?>", lt + 2);
+            pos = close < 0 ? length : close + 2;
+            continue;
+        }
+        if(next === 47 /* / */){
+            NAME.lastIndex = lt + 2;
+            const name = NAME.exec(xml)?.[0] ?? "";
+            const close = xml.indexOf(">", lt + 2);
+            pos = close < 0 ? length : close + 1;
+            if(passing !== null){
+                const open = passing.lastIndexOf(name);
+                if(open >= 0) passing.length = open;
+                if(passing.length === 0) passed(pos);
+                continue;
+            }
+            for(var elem = current; elem !== doc; elem = elem.parentNode){
+                if(elem.tagName === name){
+                    current = elem.parentNode;
+                    break;
+                }
+            }
+            continue;
+        }
+        NAME.lastIndex = lt + 1;
+        const nameMatch = NAME.exec(xml);
+        if(nameMatch === null){
+            // A stray "<" is kept as text.
+            text("<");
+            pos = lt + 1;
+            continue;
+        }
+        const tagName = nameMatch[0];
+        if(passing !== null){
+            // Passing over, the rest of the tag only needs to be found.
+            TAG_REST.lastIndex = NAME.lastIndex;
+            const rest = TAG_REST.exec(xml);
+            pos = rest === null ? length : TAG_REST.lastIndex;
+            if(rest === null || xml.charCodeAt(pos - 2) !== 47) passing.push(tagName);
+            continue;
+        }
+        const attributes = {};
+        var at = NAME.lastIndex;
+        for(;;){
+            ATTRIBUTE.lastIndex = at;
+            const attr = ATTRIBUTE.exec(xml);
+            if(attr === null) break;
+            attributes[attr[1]] = decode(attr[2] ?? attr[3]);
+            at = ATTRIBUTE.lastIndex;
+        }
+        TAG_END.lastIndex = at;
+        const tagEnd = TAG_END.exec(xml);
+        var selfClosing = false;
+        if(tagEnd === null){
+            const close = xml.indexOf(">", at);
+            pos = close < 0 ? length : close + 1;
+            selfClosing = close > 0 && xml.charCodeAt(close - 1) === 47;
+        }
+        else{
+            pos = TAG_END.lastIndex;
+            selfClosing = tagEnd[1] === "/";
+        }
+        const action = visit ? visit(tagName, attributes, current) : "keep";
+        if(action === "skip" || action === "defer"){
+            if(action === "defer"){
+                deferred = new DeferredElement(tagName, attributes, current, xml, lt);
+                current.childNodes.push(deferred);
+                doc.deferred.push(deferred);
+            }
+            if(selfClosing) passed(pos);
+            else passing = [tagName];
+            continue;
+        }
+        const element = new XmlElement(tagName, attributes, current);
+        current.childNodes.push(element);
+        if(current === doc && !doc.documentElement) doc.documentElement = element;
+        if(!selfClosing) current = element;
+    }
+    if(deferred !== null) deferred.end = length;
+    return doc;
+}
@@ -0,0 +1,265 @@
+/* eslint-disable curly */
+/* eslint-disable eqeqeq */
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/**
+ * @description Packed BOOL Planner for the ANSI CPP Transpiler
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * Packs the internal BOOL variables of a POU into 64-bit words and lays them out so that runs of independent rungs
+ * of the same shape, such as the coils a Ladder Diagram resource turns into, evaluate as one bitwise expression on
+ * whole words: rung j of a run reads and writes bit j of each word, like a compiled bit-slice PLC.
+ */
+
+/**
+ * The C++ array the packed BOOLs of a POU are stored in.
+ */
+export const PACKED_STORAGE = 'PACKED_BOOLS';
+
+/**
+ * The most rungs a run can hold, one per bit of a word.
+ */
+const WORD_BITS = 64;
+
+/**
+ * Parses the right side of an assignment as a BOOL expression of variables, constants, NOT, AND, OR and XOR.
+ * @param {string[]} tokens The tokens of the expression.
+ * @returns {{op: string, args: [], name: string, value: boolean}|null} Returns the expression tree, or null if the
+ * expression is anything else.
+ */
+function parseBoolExpression(tokens) {
+  let pos = 0;
+  const peek = () => tokens[pos]?.toUpperCase();
+  const binary = (next, ops) => () => {
+    let left = next();
+    while (left && ops.includes(peek())) {
+      const op = peek() === '&' ? 'AND' : peek();
+      pos++;
+      const right = next();
+      left = right ? { op, args: [left, right] } : null;
+    }
+    return left;
+  };
+  const unary = () => {
+    const token = tokens[pos];
+    const upper = peek();
+    if (upper === undefined) return null;
+    pos++;
+    if (upper === 'NOT') {
+      const arg = unary();
+      return arg ? { op: 'NOT', args: [arg] } : null;
+    }
+    if (upper === '(') {
+      const inner = or();
+      if (peek() !== ')') return null;
+      pos++;
+      return inner;
+    }
+    if (upper === 'TRUE' || upper === 'FALSE') return { value: upper === 'TRUE' };
+    return /^[A-Za-z_]\w*$/.test(token) && !['AND', 'OR', 'XOR'].includes(upper) ? { name: token } : null;
+  };
+  const and = binary(unary, ['AND', '&']);
+  const xor = binary(and, ['XOR']);
+  const or = binary(xor, ['OR']);
+  const tree = or();
+  return tree && pos === tokens.length ? tree : null;
+}
+
+/**
+ * Describes the shape of an expression without its variables, so that rungs of the same shape can share one.
+ * @param {{op: string, args: [], name: string, value: boolean}} tree The expression.
+ * @returns {string} Returns the shape.
+ */
+function shapeOf(tree) {
+  if (tree.name !== undefined) return '$';
+  if (tree.value !== undefined) return tree.value ? '1' : '0';
+  return `${tree.op}(${tree.args.map(shapeOf).join(',')})`;
+}
+
+/**
+ * Lists the variables of an expression in the order they are read.
+ * @param {{op: string, args: [], name: string, value: boolean}} tree The expression.
+ * @returns {string[]} Returns the variable names, once for each time they are read.
+ */
+function operandsOf(tree) {
+  if (tree.name !== undefined) return [tree.name];
+  return tree.args ? tree.args.flatMap(operandsOf) : [];
+}
+
+/**
+ * Converts an expression to a C++ expression on the words its variables are packed in.
+ * @param {{op: string, args: [], name: string, value: boolean}} tree The expression.
+ * @param {number[]} words The word each variable of the expression is read from, in the order they are read.
+ * @returns {string} Returns the C++ expression.
+ */
+function wordExpression(tree, words) {
+  let slot = 0;
+  const convert = (node) => {
+    if (node.name !== undefined) return `${PACKED_STORAGE}[${words[slot++]}]`;
+    if (node.value !== undefined) return node.value ? '~0ull' : '0ull';
+    if (node.op === 'NOT') return `~${convert(node.args[0])}`;
+    const op = { AND: '&', OR: '|', XOR: '^' }[node.op];
+    return `(${node.args.map(convert).join(` ${op} `)})`;
+  };
+  return convert(tree);
+}
+
+/**
+ * Determines the initial value of a BOOL variable that is packed.
+ * @param {string|undefined} value The initial value the variable was declared with.
+ * @returns {boolean|null} Returns the value, or null if it isn't a BOOL literal.
+ */
+function boolLiteral(value) {
+  if (value === undefined || value === null) return false;
+  const upper = String(value).trim().toUpperCase();
+  if (upper === 'TRUE' || upper === '1') return true;
+  if (upper === 'FALSE' || upper === '0') return false;
+  return null;
+}
+
+/**
+ * Plans how the internal BOOL variables of a program or function block are packed, and which of its top level rungs,
+ * assignments of a BOOL expression of packed variables to a packed variable, are evaluated together. A run is a
+ * sequence of consecutive rungs of the same shape where no rung reads or writes a variable an earlier rung of the run
+ * writes, so evaluating them at once reads the same values evaluating them one after another would. Each rung of a
+ * run must find every variable it uses unplaced or already at its own bit, in the word the run keeps for that operand.
+ * @param {{name: string, type: string, address: string, array: {}, initialValue: string, sectionType: string}[]} variables The variables of the POU.
+ * @param {{type: string, left: string, right: string[]}[]} statements The statements of the POU.
+ * @returns {{words: number, layout: Map<string, {word: number, bit: number}>, initial: bigint[], runs: Map<number, {count: number, code: string}>}|null}
+ * Returns the plan, or null if the POU has no BOOL variables to pack.
+ */
+export function planPackedBools(variables, statements) {
+  const packable = new Set(variables.filter((v) => v.sectionType === 'VAR' && !v.address && !v.array &&
+    v.type.trim().toUpperCase() === 'BOOL' && boolLiteral(v.initialValue) !== null).map((v) => v.name));
+  if (packable.size === 0) return null;
+
+  const layout = new Map();
+  const occupied = new Set();
+  let words = 0;
+  const runs = new Map();
+
+  const rungOf = (stmt) => {
+    if (stmt?.type !== 'ASSIGN' || !packable.has(stmt.left)) return null;
+    const tree = parseBoolExpression(Array.isArray(stmt.right) ? stmt.right : [stmt.right]);
+    if (!tree) return null;
+    const operands = operandsOf(tree);
+    return operands.every((name) => packable.has(name)) ? { target: stmt.left, tree, operands, shape: shapeOf(tree) } : null;
+  };
+
+  // Works out where rung j of a run would put its variables, given the words the run already keeps for each slot.
+  // Slot 0 is the target and the rest are the operands.
+  const place = (run, rung, j) => {
+    const names = [rung.target, ...rung.operands];
+    const slotWords = [...run.words];
+    const pending = new Map();
+    let next = run.next;
+    for (let s = 0; s < names.length; s++) {
+      const at = layout.get(names[s]) ?? run.placed.get(names[s]) ?? pending.get(names[s]);
+      if (at) {
+        if (at.bit !== j || (slotWords[s] !== undefined && slotWords[s] !== at.word)) return null;
+        slotWords[s] = at.word;
+        continue;
+      }
+      if (slotWords[s] === undefined) slotWords[s] = next++;
+      const key = `${slotWords[s]}:${j}`;
+      if (occupied.has(key) || run.occupied.has(key) || [...pending.values()].some((p) => `${p.word}:${p.bit}` === key)) return null;
+      pending.set(names[s], { word: slotWords[s], bit: j });
+    }
+    return { slotWords, pending, next };
+  };
+
+  for (let i = 0; i < statements.length; i++) {
+    const first = rungOf(statements[i]);
+    if (!first) continue;
+    const run = { words: [], placed: new Map(), occupied: new Set(), next: words, rungs: [] };
+    const written = new Set();
+    for (let j = 0; j < WORD_BITS && i + j < statements.length; j++) {
+      const rung = j === 0 ? first : rungOf(statements[i + j]);
+      if (!rung || rung.shape !== first.shape || written.has(rung.target) ||
+          rung.operands.some((name) => written.has(name))) break;
+      const placed = place(run, rung, j);
+      if (!placed) break;
+      run.words = placed.slotWords;
+      run.next = placed.next;
+      placed.pending.forEach((at, name) => {
+        run.placed.set(name, at);
+        run.occupied.add(`${at.word}:${at.bit}`);
+      });
+      run.rungs.push(rung);
+      written.add(rung.target);
+    }
+    if (run.rungs.length < 2) continue;
+
+    run.placed.forEach((at, name) => layout.set(name, at));
+    run.occupied.forEach((key) => occupied.add(key));
+    words = run.next;
+    const count = run.rungs.length;
+    const mask = count === WORD_BITS ? '~0ull' : `0x${((1n << BigInt(count)) - 1n).toString(16)}ull`;
+    const target = `${PACKED_STORAGE}[${run.words[0]}]`;
+    runs.set(i, {
+      count,
+      code: `${target} = (${target} & ~${mask}) | (${wordExpression(first.tree, run.words.slice(1))} & ${mask}); // ${run.rungs.map((r) => r.target).join(', ')}`
+    });
+    i += count - 1;
+  }
+
+  // The variables no run placed fill the free bits left in order.
+  let word = 0;
+  let bit = 0;
+  packable.forEach((name) => {
+    if (layout.has(name)) return;
+    while (occupied.has(`${word}:${bit}`)) {
+      bit++;
+      if (bit === WORD_BITS) {
+        bit = 0;
+        word++;
+      }
+    }
+    layout.set(name, { word, bit });
+    occupied.add(`${word}:${bit}`);
+    words = Math.max(words, word + 1);
+  });
+
+  const initial = new Array(words).fill(0n);
+  variables.filter((v) => packable.has(v.name) && boolLiteral(v.initialValue)).forEach((v) => {
+    const at = layout.get(v.name);
+    initial[at.word] |= 1n << BigInt(at.bit);
+  });
+  return { words, layout, initial, runs };
+}
+
+/**
+ * Declares the words the BOOLs of a POU are packed in.
+ * @param {{words: number, initial: bigint[]}} plan The plan from planPackedBools.
+ * @param {boolean} member True to declare them as members of a function block class, rather than in a program.
+ * @returns {string[]} Returns the declaration.
+ */
+export function declarePackedBools(plan, member) {
+  const initial = plan.initial.map((w) => `0x${w.toString(16)}ull`).join(', ');
+  return [`${member ? '' : 'static '}uint64_t ${PACKED_STORAGE}[${plan.words}] = { ${initial} };`];
+}
+
+/**
+ * Declares the packed BOOLs of a POU under their own names, so that the statements that aren't part of a run read and
+ * assign them like any BOOL.
+ * @param {{layout: Map<string, {word: number, bit: number}>}} plan The plan from planPackedBools.
+ * @returns {string[]} Returns the declarations.
+ */
+export function packedAccessors(plan) {
+  return [...plan.layout].map(([name, at]) => `BankBit ${name}(${PACKED_STORAGE}[${at.word}], 1ull << ${at.bit});`);
+}
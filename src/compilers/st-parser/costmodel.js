@@ -0,0 +1,167 @@
+/* eslint-disable curly */
+/* eslint-disable eqeqeq */
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/**
+ * @description Static Cost Model for Structured Text
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * Estimates the worst case execution time of each POU of a program from its statements, without running it. Each
+ * construct is weighted in cycles of the target, and a branch costs its most expensive arm, a FOR loop with constant
+ * bounds its body times its iterations, and a call the cost of the POU it calls. Loops without a known bound are
+ * counted once and reported, since the estimate of a POU that has one is only a lower bound.
+ */
+import { parseExpression, foldExpression } from './ir.js';
+
+/**
+ * The weights of each target architecture, in cycles of its CPU, and the clock they are converted to time at. They
+ * are nominal figures for a typical core of each architecture (the default tuning of the compiler, like Cortex-A53
+ * for arm64), to be calibrated against benchmarks of the devices a program is deployed to.
+ */
+export const COST_WEIGHTS = {
+  x64: { clockMHz: 2000, statement: 2, operator: 1, divide: 24, located: 2, call: 12, branch: 2, iteration: 2 },
+  arm64: { clockMHz: 1200, statement: 3, operator: 1, divide: 12, located: 3, call: 16, branch: 3, iteration: 3 },
+  arm: { clockMHz: 800, statement: 4, operator: 2, divide: 40, located: 6, call: 24, branch: 4, iteration: 4 }
+};
+
+const POU_KINDS = { ProgramDeclaration: 'PROGRAM', FunctionDeclaration: 'FUNCTION', FunctionBlockDeclaration: 'FUNCTION_BLOCK' };
+
+const OPERATORS = new Set(['+', '-', '*', '**', 'AND', '&', 'OR', 'XOR', 'NOT', '=', '<>', '<', '>', '<=', '>=']);
+
+/**
+ * Gets the weights of a target.
+ * @param {string} target The target, like linux-arm64.
+ * @returns {object} Returns the weights of its architecture, or those of x64 if it is unknown.
+ */
+export function costWeights(target) {
+  return COST_WEIGHTS[String(target ?? '').split('-').pop()] ?? COST_WEIGHTS.x64;
+}
+
+/**
+ * Evaluates a bound of a FOR loop.
+ * @param {string[]} tokens The tokens of the bound.
+ * @returns {number|null} Returns the value, or null if it isn't constant.
+ */
+function constantBound(tokens) {
+  const tree = parseExpression(tokens);
+  if (!tree) return null;
+  const folded = foldExpression(tree, {});
+  return folded.kind === 'literal' && typeof folded.value === 'number' ? folded.value : null;
+}
+
+/**
+ * Estimates the cost of each POU of a program.
+ * @param {{body: {type: string, name: string, varSections: [], statements: []}}[]} ast The tokenized code.
+ * @param {string} target The target, which selects the weights with costWeights().
+ * @returns {Map<string, {name: string, kind: string, statements: number, calls: number, locatedAccesses: number,
+ * loops: {variable: string, iterations: number|null}[], unbounded: boolean, cycles: number, microseconds: number}>}
+ * Returns the cost of each POU, by upper case name. The counts are of the POU's own code, and the cycles are the
+ * worst case of a run of it, including the POUs it calls. A POU is unbounded if it or a POU it calls has a loop
+ * without a known bound.
+ */
+export function estimateCosts(ast, target) {
+  const weights = costWeights(target);
+  const located = new Set();
+  ast.body.filter((block) => block.type === 'GlobalVars').forEach((block) =>
+    block.variables.filter((v) => v.address).forEach((v) => located.add(v.name.toUpperCase())));
+  const pous = new Map(ast.body.filter((block) => POU_KINDS[block.type]).map((block) => [block.name.toUpperCase(), block]));
+  const costs = new Map();
+  const costOf = (block) => {
+    const name = block.name.toUpperCase();
+    if (costs.has(name)) return costs.get(name);
+    const cost = { name: block.name, kind: POU_KINDS[block.type], statements: 0, calls: 0, locatedAccesses: 0, loops: [], unbounded: false, cycles: 0, microseconds: 0 };
+    // Set before the body is walked, so that a recursive call adds what is known so far instead of looping.
+    costs.set(name, cost);
+    const locals = new Map((block.varSections ?? []).map((v) => [v.name.toUpperCase(), v]));
+    const call = (callee) => {
+      cost.calls++;
+      if (!callee) return weights.call;
+      const inner = costOf(callee);
+      cost.unbounded ||= inner.unbounded;
+      return weights.call + inner.cycles;
+    };
+    const expression = (tokens) => {
+      const list = Array.isArray(tokens) ? tokens : [tokens];
+      return list.reduce((cycles, token, i) => {
+        if (typeof token !== 'string') return cycles;
+        const upper = token.toUpperCase();
+        if (upper === '/' || upper === 'MOD') return cycles + weights.divide;
+        if (OPERATORS.has(upper)) return cycles + weights.operator;
+        if (/^%[IQM]/i.test(token) || (!locals.has(upper.split(/[.[]/)[0]) && located.has(upper.split(/[.[]/)[0]))) {
+          cost.locatedAccesses++;
+          return cycles + weights.located;
+        }
+        if (list[i + 1] === '(' && /^[A-Za-z_]\w*$/.test(token)) return cycles + call(pous.get(upper));
+        return cycles;
+      }, 0);
+    };
+    const store = (name) => expression((name.match(/%?[A-Za-z_][\w.]*/g) ?? []).slice(0, 1)) +
+      expression((name.match(/%?[A-Za-z_][\w.]*/g) ?? []).slice(1));
+    const longest = (blocks) => Math.max(0, ...blocks.map(visit));
+    const visit = (statements) => (statements ?? []).reduce((cycles, stmt) => {
+      cost.statements++;
+      cycles += weights.statement;
+      switch (stmt.type) {
+        case 'ASSIGN':
+        case 'TEMP':
+          return cycles + store(stmt.left ?? '') + expression(stmt.right ?? []);
+        case 'CALL': {
+          const base = stmt.name.split(/[.[]/)[0].toUpperCase();
+          const type = locals.has(base) ? locals.get(base).type?.toUpperCase() : base;
+          cycles += call(pous.get(type)) + expression(stmt.args ?? []);
+          (stmt.inputs ?? []).forEach((input) => cycles += expression(input.value));
+          (stmt.outputs ?? []).forEach((output) => cycles += store(output.target));
+          return cycles;
+        }
+        case 'IF': {
+          // The conditions of every arm are evaluated before the last one is taken.
+          const conditions = [stmt.condition, ...(stmt.elseIfBlocks ?? []).map((branch) => branch.condition)];
+          cycles += conditions.reduce((sum, condition) => sum + expression(condition ?? []) + weights.branch, 0);
+          return cycles + longest([stmt.thenBlock, ...(stmt.elseIfBlocks ?? []).map((branch) => branch.block), stmt.elseBlock]);
+        }
+        case 'CASE':
+          return cycles + expression(stmt.expression ?? []) + weights.branch +
+            longest([...(stmt.branches ?? []).map((branch) => branch.body), stmt.elseBlock]);
+        case 'FOR': {
+          const [from, to, step] = [stmt.from, stmt.to, stmt.step?.length ? stmt.step : ['1']].map(constantBound);
+          const iterations = from !== null && to !== null && step ? Math.max(0, Math.floor((to - from) / step) + 1) : null;
+          cost.loops.push({ variable: stmt.variable, iterations });
+          if (iterations === null) cost.unbounded = true;
+          cycles += expression(stmt.from ?? []) + expression(stmt.to ?? []) + expression(stmt.step ?? []);
+          return cycles + (iterations ?? 1) * (visit(stmt.body) + weights.iteration);
+        }
+        case 'WHILE':
+        case 'REPEAT':
+          cost.loops.push({ variable: null, iterations: null });
+          cost.unbounded = true;
+          return cycles + expression(stmt.condition ?? []) + visit(stmt.body) + weights.iteration;
+        case 'SFC':
+          // A scan of a chart evaluates every transition, and at worst runs every action.
+          return cycles + (stmt.transitions ?? []).reduce((sum, transition) => sum + expression(transition.condition ?? []) + weights.branch, 0) +
+            (stmt.actions ?? []).reduce((sum, action) => sum + visit(action.body), 0);
+        default:
+          return cycles;
+      }
+    }, 0);
+    cost.cycles = visit(block.statements);
+    cost.microseconds = cost.cycles / weights.clockMHz;
+    return cost;
+  };
+  pous.forEach((block) => costOf(block));
+  return costs;
+}
@@ -28,9 +28,20 @@
  * @param {Array | string} expr An array of tokens or a string representing the expression.
  * @param {boolean} isjsfb Expresses whether this expression is within a JS function block.
  * @param {string[]} jsfbVars An array of variable names defined in the JS function block.
+ * @param {boolean} isjs True to convert the expression to Javascript, false for C++.
+ * @param {Map<string, string>?} jsRefs The located variables in scope, by name, with their addresses. Only these are
+ * references in Javascript, and read through resolve(). If it isn't given, every variable is read through resolve().
+ * @param {boolean} jsImage True to read located addresses straight from the process image of the Node.js runtime.
  * @returns {string} Returns a converted expression.
  */
-export function convertExpression(expr, isjsfb = false, jsfbVars = [], isjs=false) {
+export function convertExpression(expr, isjsfb = false, jsfbVars = [], isjs=false, jsRefs = null, jsImage = false) {
+  // String literals are set aside so that nothing in them is converted, and put back as literals of the target.
+  const strings = [];
+  const setAside = (text) => text.replace(STRING_LITERAL, (literal) => {
+    strings.push(literal);
+    return `__STRING_${strings.length - 1}__`;
+  });
+  expr = Array.isArray(expr) ? expr.map((e) => setAside(String(e))) : setAside(String(expr));
   if (Array.isArray(expr)) {
     if (!isjsfb) {
       expr = expr.join(" ");
@@ -47,8 +58,20 @@ export function convertExpression(expr, isjsfb = false, jsfbVars = [], isjs=fals
     }
   }
 
+  // IO_QUALITY(%IW0) and IO_UPDATED(%IW0) read the quality plane of the input rather than its value, through a
+  // function of the runtime that takes the address as template arguments.
+  if (!isjs) {
+    expr = expr.replace(/\b(IO_QUALITY|IO_UPDATED)\s*\(\s*(%[IQM][XBWDL]\d+(?:\.\d+)?)\s*\)/gi, (_, name, addr) => {
+      const { space, width, index, bit } = parseAddress(addr);
+      return `${name.toUpperCase()}<MEMORY_SPACE::${space},${width},${index}${bit > -1 ? `,${bit}` : ""}>()`;
+    });
+  }
+
+  expr = expr.replace(STANDARD_CALL, (name) => standardFunction(name));
+
   let results = expr
     .replace(/\bAND\b/gi, '&')
+    .replace(/\bXOR\b/gi, '^')
     .replace(/\bOR\b/gi, '|')
     .replace(/\bNOT\b/gi, '!')
     .replace(/\bMOD\b/gi, '%')
@@ -75,32 +98,208 @@ export function convertExpression(expr, isjsfb = false, jsfbVars = [], isjs=fals
   const parts = results.split(/\s+/);
   results = parts.map((e, index, tks) => {
     // Don't touch raw address reads
-    if (/^%[IQM][XBWDL]?\d+(\.\d+)?$/i.test(e)) return getReadAddressExpression(e);
+    if (/^%[IQM][XBWDL]?\d+(\.\d+)?$/i.test(e)) {
+      if (!isjs) return getCppReadAddressExpression(e);
+      return jsImage ? getImageReadExpression(e) : getReadAddressExpression(e);
+    }
 
     // Don't wrap literals or operators
-    if (/^(true|false|null|\d+|!|&&|\|\||==|!=|[<>=+\-*/(),&|])$/i.test(e)) return e;
+    if (/^(true|false|null|\d+(?:\.\d+(?:[eE][+\-]?\d+)?)?|!|&&|\|\||==|!=|[<>=+\-*/(),&|])$/i.test(e)) return e;
 
     // Don't wrap known function expressions (e.g., getBit)
-    if (/^getBit\(/.test(e)) return e;
+    if (/^getBit(<\d+>)?\(/.test(e)) return e;
 
     // Don't wrap dot-bit references already processed
     if (/^&?[A-Za-z_]\w*\.\d+$/.test(e)) return e;
     // token is a function call
     if (tks.length > index && tks[index + 1] === "(") return e;
-    // Otherwise, wrap in resolve()
-    if(isjs)
-      return `resolve(${e})`;
+    // Otherwise, a reference to a located variable is read through resolve(), or from the process image, and any
+    // other variable is read as it is, so that the read is a plain property or local access.
+    if(isjs){
+      if(jsRefs === null) return `resolve(${e})`;
+      const name = e.replace(/^this\./, '');
+      if(!jsRefs.has(name.split(/[.[]/)[0])) return e;
+      return jsImage && jsRefs.has(name) ? getImageReadExpression(jsRefs.get(name)) : `resolve(${e})`;
+    }
     else return e;
   }).join(' ');
   //if (results.indexOf("read") === -1) {
   results = results.replace(/\b(?<!%)(([A-Za-z_]\w*)\.(\d+))\b/g, (_, full, base, bit) => {
-    return `getBit(${isjs ? "" : "&"}${base}, ${bit})`;
+    // C++ takes the bit number as a template argument, so the test compiles to a single instruction.
+    return isjs ? `getBit(${base}, ${bit})` : `getBit<${bit}>(&${base})`;
     });
   //}
   
-  return results;
+  results = convertIndices(results);
+  return results.replace(/__STRING_(\d+)__/g, (_, index) => isjs ? jsStringLiteral(strings[index]) : cppStringLiteral(strings[index]));
+}
+
+/**
+ * Converts the indices of multi-dimensional array elements, A[i, j], to the arrays of arrays they are stored as,
+ * A[i][j]. Commas between the arguments of a call inside an index are kept.
+ * @param {string} expr The expression to convert.
+ * @returns {string} Returns the converted expression.
+ */
+export function convertIndices(expr) {
+  if (!expr.includes('[') || !expr.includes(',')) return expr;
+  const open = [];
+  return [...expr].map((c) => {
+    if (c === '[' || c === '(') open.push(c);
+    else if (c === ']' || c === ')') open.pop();
+    else if (c === ',' && open[open.length - 1] === '[') return '][';
+    return c;
+  }).join('');
+}
+
+/**
+ * The elementary type names of the conversions, with the long names of the time types mapped to the short ones the
+ * runtimes name their functions with.
+ */
+const CONVERSION_TYPES = {
+  BOOL: 'BOOL', BYTE: 'BYTE', WORD: 'WORD', DWORD: 'DWORD', LWORD: 'LWORD', SINT: 'SINT', INT: 'INT', DINT: 'DINT',
+  LINT: 'LINT', USINT: 'USINT', UINT: 'UINT', UDINT: 'UDINT', ULINT: 'ULINT', REAL: 'REAL', LREAL: 'LREAL',
+  TIME: 'TIME', LTIME: 'LTIME', DATE: 'DATE', LDATE: 'LDATE', TIME_OF_DAY: 'TOD', TOD: 'TOD', LTIME_OF_DAY: 'LTOD',
+  LTOD: 'LTOD', DATE_AND_TIME: 'DT', DT: 'DT', LDATE_AND_TIME: 'LDT', LDT: 'LDT'
+};
+
+/**
+ * The conversions between time types that change the unit of the value, which the runtimes have functions of their
+ * own for, rather than a TO_ function of the target type.
+ */
+const UNIT_CONVERSIONS = new Set(['TIME_TO_LTIME', 'LTIME_TO_TIME', 'DATE_TO_LDATE', 'LDATE_TO_DATE', 'TOD_TO_LTOD',
+  'LTOD_TO_TOD', 'DT_TO_LDT', 'LDT_TO_DT', 'DT_TO_DATE', 'DT_TO_TOD', 'LDT_TO_LDATE', 'LDT_TO_LTOD']);
+
+/**
+ * The standard functions the runtimes provide under their upper case names.
+ */
+const STANDARD_FUNCTIONS = ['SQRT', 'LN', 'LOG', 'EXP', 'SIN', 'COS', 'TAN', 'ASIN', 'ACOS', 'ATAN', 'EXPT', 'ABS',
+  'TRUNC', 'SHL', 'SHR', 'ROL', 'ROR', 'SQRT_ARRAY', 'LN_ARRAY', 'LOG_ARRAY', 'EXP_ARRAY', 'SIN_ARRAY', 'COS_ARRAY',
+  'TAN_ARRAY', 'ABS_ARRAY', 'TRUNC_ARRAY', 'CONVERT_ARRAY', 'SCALE_ARRAY', 'LIMIT_ARRAY'];
+
+const TYPE_NAMES = Object.keys(CONVERSION_TYPES).sort((a, b) => b.length - a.length).join('|');
+
+/**
+ * Matches the name of a standard function or conversion that is called, like SQRT, INT_TO_REAL or REAL_TRUNC_INT.
+ */
+const STANDARD_CALL = new RegExp(`\\b(?:(?:(?:${TYPE_NAMES})_)?(?:TO|TRUNC)_(?:${TYPE_NAMES})|${STANDARD_FUNCTIONS.join('|')})(?=\\s*\\()`, 'gi');
+
+/**
+ * Gets the name the runtimes give a standard function or conversion of ST, in any case: INT_TO_REAL and TO_REAL are
+ * TO_REAL, REAL_TRUNC_INT is TRUNC_INT, the conversions that change the unit of a time type keep their name with
+ * the short type names, as TIME_OF_DAY_TO_LTIME_OF_DAY is TOD_TO_LTOD, and the numeric functions are upper cased.
+ * @param {string} name The name of the called function.
+ * @returns {string} Returns the name of the runtime's function, or the name as it is if it isn't a standard one.
+ */
+export function standardFunction(name) {
+  const upper = name.toUpperCase();
+  if (STANDARD_FUNCTIONS.includes(upper)) return upper;
+  const match = new RegExp(`^(?:(${TYPE_NAMES})_)?(TO|TRUNC)_(${TYPE_NAMES})$`).exec(upper);
+  if (!match) return name;
+  const from = match[1] ? CONVERSION_TYPES[match[1]] : null;
+  const to = CONVERSION_TYPES[match[3]];
+  if (match[2] === 'TRUNC') return `TRUNC_${to}`;
+  return from && UNIT_CONVERSIONS.has(`${from}_TO_${to}`) ? `${from}_TO_${to}` : `TO_${to}`;
+}
+
+/**
+ * Matches an ST string literal, single quoted for STRING or double quoted for WSTRING, with its $ escapes.
+ */
+const STRING_LITERAL = /'(?:\$.|[^'$])*'|"(?:\$.|[^"$])*"/g;
+
+/**
+ * Decodes the characters of an ST string literal, resolving its $ escapes.
+ * @param {string} literal The literal, with its quotes.
+ * @returns {string} Returns the characters.
+ */
+export function decodeStringLiteral(literal) {
+  const escapes = { $: '$', "'": "'", '"': '"', L: '\n', N: '\n', P: '\f', R: '\r', T: '\t' };
+  // A STRING escapes a character with two hex digits and a WSTRING with four.
+  const hex = literal.startsWith('"') ? /\$([0-9A-Fa-f]{4}|.)/g : /\$([0-9A-Fa-f]{2}|.)/g;
+  return literal.slice(1, -1).replace(hex, (_, code) =>
+    code.length > 1 ? String.fromCharCode(parseInt(code, 16)) : escapes[code.toUpperCase()] ?? code);
+}
+
+/**
+ * Converts an ST string literal to a C++ one: a narrow literal for STRING, a char16_t one for WSTRING.
+ * @param {string} literal The literal, with its quotes.
+ * @returns {string} Returns the C++ literal.
+ */
+export function cppStringLiteral(literal) {
+  const text = [...decodeStringLiteral(literal)].map((c) => {
+    const code = c.charCodeAt(0);
+    if (c === '"' || c === '\\') return '\\' + c;
+    if (code >= 0x20 && code < 0x7f) return c;
+    return code < 0x100 ? '\\' + code.toString(8).padStart(3, '0') : '\\u' + code.toString(16).padStart(4, '0');
+  }).join('');
+  return literal.startsWith('"') ? `u"${text}"` : `"${text}"`;
+}
+
+/**
+ * Converts an ST string literal to a Javascript one.
+ * @param {string} literal The literal, with its quotes.
+ * @returns {string} Returns the Javascript literal.
+ */
+function jsStringLiteral(literal) {
+  return JSON.stringify(decodeStringLiteral(literal));
+}
+
+
+/**
+ * Indicates that a located address reference could not be resolved at compile time.
+ */
+export class AddressError extends Error {
+  constructor(message) {
+    super(message);
+    this.name = "AddressError";
+  }
+}
+
+/**
+ * Parses a located address reference (e.g. %IX0.1, %MW10) into its parts.
+ * @param {string} addr The address to parse.
+ * @returns {{space: string, width: number, index: number, bit: number}} The memory space (I, Q or M), the width in bits, the index and the bit (-1 if no bit is selected).
+ * @throws {AddressError} if the address is malformed.
+ */
+export function parseAddress(addr) {
+  const match = /^%([IQM])([XBWDL])(\d+)(?:\.(\d+))?$/i.exec(addr?.trim() ?? "");
+  if (!match) {
+    throw new AddressError(`Invalid address format: ${addr}`);
+  }
+  const widths = { X: 8, B: 8, W: 16, D: 32, L: 64 };
+  return {
+    space: match[1].toUpperCase(),
+    width: widths[match[2].toUpperCase()],
+    index: parseInt(match[3], 10),
+    bit: match[4] !== undefined ? parseInt(match[4], 10) : -1
+  };
+}
+
+/**
+ * Gets the C++ expression that reads a located address resolved at compile time.
+ * @param {string} addr The address to read.
+ * @returns {string} Returns the C++ expression.
+ */
+export function getCppReadAddressExpression(addr) {
+  const { space, width, index, bit } = parseAddress(addr);
+  if (bit > -1) {
+    return `readMemoryBit<MEMORY_SPACE::${space}, ${width}, ${index}, ${bit}>()`;
+  }
+  return `readMemory<MEMORY_SPACE::${space}, ${width}, ${index}>()`;
 }
 
+/**
+ * Gets the C++ statement that writes a value to a located address resolved at compile time.
+ * @param {string} addr The address to write.
+ * @param {string} value The expression of the value to write.
+ * @returns {string} Returns the C++ statement, without a terminating semicolon.
+ */
+export function getCppWriteAddressExpression(addr, value) {
+  const { space, width, index, bit } = parseAddress(addr);
+  if (bit > -1) {
+    return `writeMemoryBit<MEMORY_SPACE::${space}, ${width}, ${index}, ${bit}>(${value})`;
+  }
+  return `writeMemory<MEMORY_SPACE::${space}, ${width}, ${index}>(${value})`;
+}
 
 /**
  * 
@@ -110,17 +309,18 @@ export function convertExpression(expr, isjsfb = false, jsfbVars = [], isjs=fals
 export function getReadAddressExpression(addr){
   var result = `readDWord("${addr}")`;
   try{
-    if(addr.indexOf(".")){
+    if(addr.indexOf(".") > -1){
       result = `readBit("${addr}")`;
     }
     else{
       var width = addr.substring(2, 3).toUpperCase();
       switch(width){
         case "X":
+        case "B":
           result = `readByte("${addr}")`;
         break;
         case "W":
-          `readWord("${addr}")`;
+          result = `readWord("${addr}")`;
         break;
       }
     }
@@ -141,10 +341,11 @@ export function getWriteAddressExpression(addr, value){
       var width = addr.substring(2, 3).toUpperCase();
       switch(width){
         case "X":
+        case "B":
           result = `writeByte("${addr}", ${value})`;
         break;
         case "W":
-          `writeWord("${addr}", ${value})`;
+          result = `writeWord("${addr}", ${value})`;
         break;
       }
     }
@@ -155,3 +356,61 @@ export function getWriteAddressExpression(addr, value){
   return result;
 }
 
+/**
+ * The offset and size in bytes of the %I, %Q and %M spaces in the process image of the Node.js runtime (nodalis.js).
+ */
+const JS_IMAGE_SPACES = { I: [0, 512], Q: [512, 512], M: [1024, 7168] };
+
+/**
+ * Finds a located address in the process image of the Node.js runtime.
+ * @param {string} addr The address.
+ * @returns {{width: number, bit: number, byte: number, mask: number}?} Returns the width of the value, its bit (-1 for
+ * a whole value), the offset of its first byte and the mask of its bit, or null if it isn't in the image.
+ */
+export function locateInImage(addr) {
+  let parsed;
+  try {
+    parsed = parseAddress(addr);
+  } catch (e) {
+    return null;
+  }
+  const { space, width, index, bit } = parsed;
+  const [offset, bytes] = JS_IMAGE_SPACES[space];
+  const position = index * width + Math.max(bit, 0);
+  if ((width > 32 && bit === -1) || bit >= width || position + (bit > -1 ? 1 : width) > bytes * 8) return null;
+  return { width, bit, byte: offset + (position >> 3), mask: 1 << (position & 7) };
+}
+
+/**
+ * Gets the Javascript expression that reads a located address straight from the typed arrays of the Node.js
+ * runtime's process image. An address outside of the image is read with the runtime's functions, which report it.
+ * @param {string} addr The address to read.
+ * @returns {string} Returns the Javascript expression.
+ */
+export function getImageReadExpression(addr) {
+  const a = locateInImage(addr);
+  if (!a) return getReadAddressExpression(addr);
+  if (a.bit > -1) return `((IMAGE_BYTES[${a.byte}] & ${a.mask}) !== 0)`;
+  switch (a.width) {
+    case 8: return `IMAGE_BYTES[${a.byte}]`;
+    case 16: return `IMAGE_WORDS[${a.byte >> 1}]`;
+    default: return `IMAGE_DWORDS[${a.byte >> 2}]`;
+  }
+}
+
+/**
+ * Gets the Javascript statement that writes a value to a located address in the Node.js runtime's process image.
+ * @param {string} addr The address to write.
+ * @param {string} value The expression of the value to write.
+ * @returns {string} Returns the Javascript statement, without a terminating semicolon.
+ */
+export function getImageWriteExpression(addr, value) {
+  const a = locateInImage(addr);
+  if (!a) return getWriteAddressExpression(addr, value);
+  if (a.bit > -1) return `setImageBit(${a.byte}, ${a.mask}, ${value})`;
+  switch (a.width) {
+    case 8: return `IMAGE_BYTES[${a.byte}] = ${value}`;
+    case 16: return `IMAGE_WORDS[${a.byte >> 1}] = ${value}`;
+    default: return `IMAGE_DWORDS[${a.byte >> 2}] = ${value}`;
+  }
+}
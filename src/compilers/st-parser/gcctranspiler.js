@@ -22,62 +22,716 @@
  * @copyright Apache 2.0
  */
 
-import { convertExpression } from './expressionConverter.js';
-import { getWriteAddressExpression } from './expressionConverter.js';
+import { convertExpression, convertIndices, parseAddress, getCppWriteAddressExpression, AddressError, standardFunction } from './expressionConverter.js';
+import { planPackedBools, declarePackedBools, packedAccessors, PACKED_STORAGE } from './bitslice.js';
+import { planIncrementalRungs, guardRung } from './incremental.js';
+
+/**
+ * The C++ type of REAL in the code being transpiled, float or, with the fixedReal option, FixedReal.
+ */
+let realType = 'float';
 
 /**
  * Converts the tokenized ST code to ANSCII C++.
  * @param {{body: {type: string, name: string, varSections: [], statements: []}}[]} ast The tokenized code.
- * @returns {string} The transpiled code.
+ * @param {{packBools: boolean, units: boolean, pouProfile: boolean, stateTable: boolean, exchanged: Set<string>, loopGuard: boolean, browseTable: boolean, fixedReal: boolean, incremental: boolean, only: Set<string>, generated: Map<string, object>}} options With packBools, the
+ * internal BOOL variables of programs and function blocks are packed into 64-bit words, and runs of independent rungs
+ * are evaluated a word at a time. With units, the code is split into translation units, as described by the return
+ * value. With pouProfile, the body of each POU samples the cycle counter into POU_PROFILES[id], where id is the POU's
+ * index in listPOUs(); the table itself is defined by the caller. With stateTable, each program gets a function
+ * PROGRAM_NAME_STATE(size_t* count), and the globals a function GLOBAL_STATE(size_t* count), that return a table of
+ * their variables for an online change to carry over, or a warm restart snapshot to hold (see stateTable()). The
+ * globals named in exchanged, by upper case name, from exchangedGlobals(), are members of EXCHANGED_GLOBALS instead,
+ * and the POUs reach them through TASK_GLOBALS, which a task worker points at a copy of its own. With loopGuard, each
+ * WHILE, REPEAT and FOR loop ends once the task release running it has run past its watchdog budget. With browseTable,
+ * each program, function block and STRUCT type gets a BrowseTraits specialization that describes its members, each
+ * program a function PROGRAM_NAME_BROWSE() and the globals a function GLOBAL_BROWSE() that publish their variables
+ * from the OPC UA server (see browseOPCUAProgram()). With fixedReal, REAL is the runtime's fixed point FixedReal
+ * instead of float. With incremental, the top level statements of each program are grouped into rungs that the runtime
+ * skips when nothing they use changed (see planIncrementalRungs()). With only, a set of POU names, just the code of those POUs is generated, and returned as an object
+ * of their parts by name, which a later call takes back as the Map generated instead of generating them again (see
+ * transpileParallel()).
+ * @returns {string|{header: string[], definitions: string[], units: {name: string, code: string[]}[]}} The
+ * transpiled code. With units, it is split into a header that declares the types, globals, functions, function
+ * blocks and programs in the order they were written, the definitions of the globals, and a unit for each POU that
+ * defines its body. A program has one instance that is private to its unit, and is called through a function
+ * named after it, so the tasks still call it as PROGRAM_NAME(). A small function block's body stays in the header,
+ * so that it is still inlined into its calls.
  */
-export function transpile(ast) {
+export function transpile(ast, options = {}) {
+  realType = options.fixedReal ? 'FixedReal' : 'float';
   const lines = [];
+  const header = [];
+  const definitions = [];
+  const units = [];
+  const globalTypes = {};
+  ast.body.filter((block) => block.type === 'GlobalVars').forEach((block) => {
+    block.variables.forEach((v) => globalTypes[v.name] = v.type);
+  });
+  // The generic standard blocks are instantiated on the types of the variables wired to them in each POU.
+  const symbolTypes = (block) => {
+    const types = { ...globalTypes };
+    block.varSections?.forEach((v) => types[v.name] = v.type);
+    return types;
+  };
+  const operandTypes = (block) => inferOperandTypes(block.statements, symbolTypes(block));
+  const functions = new Map(ast.body.filter((block) => block.type === 'FunctionDeclaration')
+    .map((block) => [block.name.toUpperCase(), functionParameters(block)]));
+  const pure = pureFunctions(ast.body, options);
+  const statementsOf = (block) => {
+    const chart = chartOf(block);
+    let statements = positionalCalls(typeCounters(block.statements, symbolTypes(block)), functions);
+    if (chart) statements = chartFlags(statements, chart);
+    return options.loopGuard ? guardLoops(statements) : statements;
+  };
+  // The BOOLs of a POU with a chart aren't packed, since its actions and transitions are compiled apart from the rungs.
+  const packedPlan = (block) => options.packBools && !chartOf(block) ? planPackedBools(block.varSections, block.statements) : null;
+  // The rungs of a program are planned against what its statements can name: its variables, and the globals.
+  const globalVariables = ast.body.filter((block) => block.type === 'GlobalVars').flatMap((block) => block.variables);
+  const memberTypes = new Map();
+  ast.body.forEach((block) => {
+    if (block.type === 'TypeDeclaration') block.types.filter((t) => t.members).forEach((t) => memberTypes.set(t.name.toUpperCase(), t.members));
+    if (block.type === 'FunctionBlockDeclaration') memberTypes.set(block.name.toUpperCase(), block.varSections);
+  });
+  const incrementalRungs = (block, statements, plan) => options.incremental && block.type === 'ProgramDeclaration' && !chartOf(block) ?
+    planIncrementalRungs(statements, { variables: new Map([...globalVariables, ...block.varSections].map((v) => [v.name, v])),
+      members: memberTypes, pure, mapType, packed: plan }) : null;
+  const pouIds = new Map(listPOUs(ast).map((pou, id) => [pou.name, id]));
+  const sample = (block) => options.pouProfile ? [`POUSample POU_SAMPLE(POU_PROFILES[${pouIds.get(block.name)}]);`] : [];
+  const unpacked = (block, plan) => plan ? block.varSections.filter((v) => !plan.layout.has(v.name)) : block.varSections;
+  // The exchanged globals are declared together, before the first POU, and a POU that doesn't declare a variable of
+  // the same name reaches them through TASK_GLOBALS.
+  const exchanged = ast.body.filter((block) => block.type === 'GlobalVars')
+    .flatMap((block) => block.variables.filter((v) => options.exchanged?.has(v.name.toUpperCase())));
+  const exchangedNames = new Set(exchanged.map((v) => v.name));
+  const exchangeDeclaration = () => exchanged.length === 0 ? [] : [
+    '// The globals the tasks exchange. A task worker runs against a copy of them of its own (see GlobalExchange).',
+    'struct EXCHANGED_GLOBALS {', ...declareVars(exchanged, {}, true).map((line) => `  ${line}`), '};',
+    'inline EXCHANGED_GLOBALS GLOBAL_BUFFERS[2];',
+    'inline thread_local EXCHANGED_GLOBALS* TASK_GLOBALS = GLOBAL_BUFFERS;', ''];
+  const qualify = (block, lines) => {
+    const locals = new Set((block.varSections ?? []).map((v) => v.name));
+    const names = [...exchangedNames].filter((name) => !locals.has(name));
+    if (names.length === 0) return lines;
+    const pattern = new RegExp(`(?<![\\w.]|->)\\b(${names.join('|')})\\b`, 'g');
+    // String literals are left alone.
+    return lines.map((line) => line.split(/("(?:[^"\\]|\\.)*")/)
+      .map((part, i) => i % 2 === 1 ? part : part.replace(pattern, 'TASK_GLOBALS->$1')).join(''));
+  };
+  // The members and call operator of the class of a program or function block. VAR_TEMP variables are locals of the
+  // call, everything else is instance state. With a qualified name, the call operator is only declared in the class,
+  // and is returned as a definition outside of it, under that name.
+  const instanceBody = (block, inline = false, qualified = null) => {
+    const plan = packedPlan(block);
+    const variables = unpacked(block, plan);
+    const members = [];
+    members.push(...declareVars(variables.filter((v) => v.sectionType !== 'VAR_TEMP'), operandTypes(block), true));
+    if (plan) {
+      members.push(...declarePackedBools(plan, true));
+    }
+    if (chartOf(block)) {
+      members.push(...declareChart(chartOf(block)));
+    }
+    const body = [...sample(block)];
+    body.push(...declareVars(variables.filter((v) => v.sectionType === 'VAR_TEMP'), operandTypes(block)));
+    if (plan) {
+      body.push(...packedAccessors(plan));
+    }
+    const statements = statementsOf(block);
+    body.push(...qualify(block, transpileStatements(statements, plan, incrementalRungs(block, statements, plan))));
+    if (qualified) {
+      return { members: [...members, '  void operator()();'], call: [`void ${qualified}::operator()() {`, ...body.map(line => `  ${line}`), '}'] };
+    }
+    return [...members, inline ? '  NODALIS_ALWAYS_INLINE void operator()() {' : '  void operator()() {', ...body.map(line => `    ${line}`), '  }'];
+  };
+  const programClass = (block) => [`class ${block.name}_PROGRAM {//PROGRAM:${block.name}`, 'public:', ...instanceBody(block), '};'];
+  // The layout of a user type names its members and their layouts, so that a type whose members changed doesn't match
+  // the one it replaces in an online change.
+  const userTypes = new Map();
+  ast.body.forEach((block) => {
+    if (block.type === 'TypeDeclaration') block.types.forEach((t) => userTypes.set(t.name.toUpperCase(), { type: t }));
+    if (block.type === 'FunctionBlockDeclaration') userTypes.set(block.name.toUpperCase(), { block });
+  });
+  const typeLayout = (name) => {
+    const user = userTypes.get(name.trim().toUpperCase());
+    if (!user) return name.trim();
+    if (user.layout === undefined) {
+      user.layout = name.trim();
+      let members;
+      if (user.type?.alias) {
+        members = variableLayout({ name: user.type.name, type: user.type.alias.type, array: user.type.alias.array }, {}, typeLayout);
+      }
+      else if (user.type) {
+        members = user.type.members.map((v) => memberLayout(v, {}, typeLayout)).join(';');
+      }
+      else {
+        const plan = packedPlan(user.block);
+        members = unpacked(user.block, plan).filter((v) => v.sectionType !== 'VAR_TEMP')
+          .map((v) => memberLayout(v, operandTypes(user.block), typeLayout)).join(';') +
+          (plan ? `;${PACKED_STORAGE}:${[...plan.layout].map(([n, at]) => `${n}@${at.word}.${at.bit}`).join(',')}` : '');
+      }
+      user.layout = `${name.trim()}#${layoutHash(members)}`;
+    }
+    return user.layout;
+  };
+  const programState = (block, instance) => {
+    const plan = packedPlan(block);
+    const types = operandTypes(block);
+    const rows = unpacked(block, plan).filter((v) => v.sectionType !== 'VAR_TEMP' && !v.address)
+      .map((v) => stateRow(`${block.name}.${v.name}`, variableLayout(v, types, typeLayout), `${instance}.${v.name}`));
+    if (plan) {
+      rows.push(...[...plan.layout].map(([name, at]) =>
+        `  { "${block.name}.${name}", "bool", &${instance}.${PACKED_STORAGE}[${at.word}], sizeof(uint64_t), 1ull << ${at.bit}, nullptr }`));
+    }
+    return stateTable(`${block.name}_STATE`, rows);
+  };
+  // The members the OPC UA server browses in place: everything but VAR_TEMP and located variables.
+  const browseMembers = (block) => {
+    const plan = packedPlan(block);
+    const rows = unpacked(block, plan).filter((v) => v.sectionType !== 'VAR_TEMP' && !v.address)
+      .map((v) => [v.name, `NODALIS_BROWSE_MEMBER(Owner, ${v.name})`]);
+    if (plan) {
+      rows.push(...[...plan.layout].map(([name, at]) => [name, `NODALIS_BROWSE_BIT(Owner, ${name}, ${PACKED_STORAGE}[${at.word}], ${at.bit})`]));
+    }
+    return rows;
+  };
+  const typesBrowse = (types) => types.filter((t) => t.members)
+    .flatMap((t) => browseTraits(t.name, t.members.filter((v) => !v.address).map((v) => [v.name, `NODALIS_BROWSE_MEMBER(Owner, ${v.name})`])));
+  const programBrowse = (block, instance) => [...browseTraits(`${block.name}_PROGRAM`, browseMembers(block)), '',
+    `void ${block.name}_BROWSE() {`, `  browseOPCUAProgram("${block.name}", &${instance}, BrowseTraits<${block.name}_PROGRAM>::type());`, '}'];
+  const globalBrowseRows = [];
+  const globalBrowse = (block) => {
+    globalBrowseRows.push(...block.variables.filter((v) => !v.address && !exchangedNames.has(v.name))
+      .map((v) => [v.name, `NODALIS_BROWSE_GLOBAL(${v.name})`]));
+  };
+  const globalRows = [];
+  const globalState = (block) => {
+    globalRows.push(...block.variables.filter((v) => !v.address)
+      .map((v) => stateRow(v.name, variableLayout(v, {}, typeLayout), exchangedNames.has(v.name) ? `TASK_GLOBALS->${v.name}` : v.name)));
+  };
+  // A function takes its inputs by value and its in-outs by reference, and an input with an initial value that only
+  // inputs with initial values follow is a default argument. A pure function is constexpr, and a small one is
+  // inlined into its calls.
+  const functionQualifier = (block) => pure.has(block.name.toUpperCase()) ? 'constexpr ' :
+    isSmallBlock(block.statements) ? 'NODALIS_ALWAYS_INLINE ' : '';
+  const functionSignature = (block, defaults) => {
+    const parameters = functionParameters(block);
+    let optional = parameters.length;
+    while (optional > 0 && parameters[optional - 1].sectionType === 'VAR_INPUT' && parameters[optional - 1].initialValue != null) {
+      optional--;
+    }
+    const list = parameters.map((v, i) => {
+      const type = mapType(v.type) === 'auto' ? v.type.trim() : mapType(v.type);
+      if (v.sectionType === 'VAR_IN_OUT') return `${type}& ${v.name}`;
+      return `${type} ${v.name}${defaults && i >= optional ? ` = ${convertExpression(String(v.initialValue))}` : ''}`;
+    });
+    return `${returnType(block)} ${block.name}(${list.join(', ')})`;
+  };
+  // The result is a local named after the function, which assignments to the function's name write, and which is
+  // returned once at the end. Locals of elementary types start at 0 on every call.
+  const functionBody = (block) => {
+    const body = [`${functionQualifier(block)}${functionSignature(block, true)} { //FUNCTION:${block.name}`, ...sample(block)];
+    const locals = block.varSections.filter((v) => v.sectionType !== 'VAR_INPUT' && v.sectionType !== 'VAR_IN_OUT')
+      .map((v) => v.initialValue == null && !v.array && !v.address && CONSTEXPR_TYPES.has(mapType(v.type)) ?
+        { ...v, initialValue: mapType(v.type) === 'bool' ? 'FALSE' : '0' } : v);
+    body.push(`${returnType(block)} ${block.name}{};`);
+    body.push(...declareVars(locals, operandTypes(block)));
+    body.push(...qualify(block, transpileStatements(statementsOf(block))));
+    body.push(`return ${block.name};`, '}');
+    return body;
+  };
+
+  // The code of a POU depends only on the POU and on the declarations it is transpiled with, so it can be generated
+  // apart from the others, and code generated before is passed back in generated, by POU name.
+  const pouPart = (block) => {
+    if (options.generated?.has(block.name)) return options.generated.get(block.name);
+    if (!options.units) {
+      switch (block.type) {
+        case 'ProgramDeclaration':
+          // A program is a class with one instance named after it, so its variables keep their values from one scan
+          // to the next, lie together in memory and the tasks still call it as PROGRAM_NAME().
+          return { lines: [...programClass(block), `${block.name}_PROGRAM ${block.name};`,
+            ...(options.stateTable ? programState(block, block.name) : []),
+            ...(options.browseTable ? programBrowse(block, block.name) : [])] };
+        case 'FunctionDeclaration':
+          return { lines: functionBody(block) };
+        default:
+          return { lines: [`class ${block.name} {//FUNCTION_BLOCK:${block.name}`, 'public:',
+            ...instanceBody(block, isSmallBlock(block.statements)), '};',
+            ...(options.browseTable ? browseTraits(block.name, browseMembers(block)) : [])] };
+      }
+    }
+    switch (block.type) {
+      case 'ProgramDeclaration':
+        return {
+          header: [`void ${block.name}();`, '',
+            ...(options.stateTable ? [`const StateVariable* ${block.name}_STATE(size_t* count);`, ''] : []),
+            ...(options.browseTable ? [`void ${block.name}_BROWSE();`, ''] : [])],
+          unit: [...programClass(block), `static ${block.name}_PROGRAM ${block.name}_INSTANCE;`, '',
+            `void ${block.name}() {`, `  ${block.name}_INSTANCE();`, '}',
+            ...(options.stateTable ? ['', ...programState(block, `${block.name}_INSTANCE`)] : []),
+            ...(options.browseTable ? ['', ...programBrowse(block, `${block.name}_INSTANCE`)] : [])]
+        };
+      case 'FunctionDeclaration':
+        // A constexpr or inlined function is defined in the header, so that its calls in every unit can be.
+        if (functionQualifier(block)) {
+          return { header: [...functionBody(block), ''] };
+        }
+        return { header: [`${functionSignature(block, true)};`, ''],
+          unit: [`${functionSignature(block, false)} { //FUNCTION:${block.name}`, ...functionBody(block).slice(1)] };
+      default: {
+        const part = { header: [`class ${block.name} {//FUNCTION_BLOCK:${block.name}`, 'public:'] };
+        if (isSmallBlock(block.statements)) {
+          part.header.push(...instanceBody(block, true));
+        }
+        else {
+          const { members, call } = instanceBody(block, false, block.name);
+          part.header.push(...members);
+          part.unit = call;
+        }
+        part.header.push('};', '');
+        if (options.browseTable) part.header.push(...browseTraits(block.name, browseMembers(block)), '');
+        return part;
+      }
+    }
+  };
+  if (options.only) {
+    return Object.fromEntries(ast.body.filter((block) => POU_KINDS[block.type] && options.only.has(block.name))
+      .map((block) => [block.name, pouPart(block)]));
+  }
+
+  if (options.units) {
+    if (options.pouProfile && pouIds.size > 0) {
+      header.push(`extern POUProfile POU_PROFILES[${pouIds.size}];`, '');
+    }
+    let declared = false;
+    for (const block of ast.body) {
+      if (POU_KINDS[block.type] && !declared) {
+        header.push(...exchangeDeclaration());
+        declared = true;
+      }
+      switch (block.type) {
+        case 'TypeDeclaration':
+          header.push(...declareTypes(block.types), '');
+          if (options.browseTable) header.push(...typesBrowse(block.types), '');
+          break;
+        case 'GlobalVars': {
+          const variables = block.variables.filter((v) => !exchangedNames.has(v.name));
+          const declarations = declareVars(variables);
+          header.push('// Global variable declarations', ...variables.map((v, i) => externDeclaration(v, declarations[i])), '');
+          definitions.push(...declarations);
+          if (options.stateTable) globalState(block);
+          if (options.browseTable) globalBrowse(block);
+          break;
+        }
+        case 'ProgramDeclaration':
+        case 'FunctionDeclaration':
+        case 'FunctionBlockDeclaration': {
+          const part = pouPart(block);
+          header.push(...part.header);
+          if (part.unit) units.push({ name: block.name, code: part.unit });
+          break;
+        }
+      }
+    }
+    if (!declared) header.push(...exchangeDeclaration());
+    if (options.stateTable) {
+      header.push('const StateVariable* GLOBAL_STATE(size_t* count);', '');
+      definitions.push('', ...stateTable('GLOBAL_STATE', globalRows));
+    }
+    if (options.browseTable) {
+      header.push('void GLOBAL_BROWSE();', '');
+      definitions.push('', ...globalBrowseTable(globalBrowseRows));
+    }
+    return { header, definitions, units };
+  }
 
+  let declared = false;
   for (const block of ast.body) {
+    if (POU_KINDS[block.type] && !declared) {
+      lines.push(...exchangeDeclaration());
+      declared = true;
+    }
     switch (block.type) {
+      case 'TypeDeclaration':
+        lines.push(...declareTypes(block.types));
+        if (options.browseTable) lines.push(...typesBrowse(block.types));
+        break;
       case 'GlobalVars':
         lines.push('// Global variable declarations');
-        lines.push(...declareVars(block.variables));
+        lines.push(...declareVars(block.variables.filter((v) => !exchangedNames.has(v.name))));
+        if (options.stateTable) globalState(block);
+        if (options.browseTable) globalBrowse(block);
         break;
       case 'ProgramDeclaration':
-        lines.push(`void ${block.name}() { //PROGRAM:${block.name}`);
-        lines.push(...declareVars(block.varSections));
-        lines.push(...transpileStatements(block.statements));
-        lines.push('}');
-        break;
-
       case 'FunctionDeclaration':
-        lines.push(`${mapType(block.returnType)} ${block.name}() { //FUNCTION:${block.name}`);
-        lines.push(...declareVars(block.varSections));
-        lines.push(...transpileStatements(block.statements));
-        lines.push('}');
-
-        for(var x = 0; x < lines.length; x++){
-            var l = lines[x];
-            if(l.indexOf(`${block.name} =`) > -1){
-                lines[x] = l.replace(`${block.name} =`, "return");
-            }
-        }
-
-        break;
-
       case 'FunctionBlockDeclaration':
-        lines.push(`class ${block.name} {//FUNCTION_BLOCK:${block.name}`);
-        lines.push('public:');
-        //for (const v of block.varSections) {
-          lines.push(...declareVars(block.varSections));
-        //}
-        lines.push('  void operator()() {');
-        lines.push(...transpileStatements(block.statements).map(line => `    ${line}`));
-        lines.push('  }');
-        lines.push('};');
+        lines.push(...pouPart(block).lines);
         break;
     }
     lines.push('');
   }
+  if (!declared) lines.push(...exchangeDeclaration());
+  if (options.stateTable) {
+    lines.push(...stateTable('GLOBAL_STATE', globalRows), '');
+  }
+  if (options.browseTable) {
+    lines.push(...globalBrowseTable(globalBrowseRows), '');
+  }
 
   return lines.join('\n');
 }
+
+/**
+ * Describes what the code of every POU depends on besides the POU itself: the options, the declarations of all the
+ * blocks, the types and globals, the pure functions and the order of the POUs, which gives their profile IDs. The
+ * code of a POU is the same for the same POU and context, so it may be reused from an earlier build.
+ * @param {{body: {type: string, name: string}[]}} ast The tokenized code.
+ * @param {object} options The options of transpile().
+ * @returns {string} Returns the context as text.
+ */
+export function transpileContext(ast, options = {}) {
+  const { only, generated, exchanged, ...settings } = options;
+  // The layout of a function block's packed BOOLs follows from its statements, and is part of the state tables of the
+  // POUs that have an instance of it.
+  const declarations = ast.body.map((block) => !POU_KINDS[block.type] ? block :
+    { type: block.type, name: block.name, returnType: block.returnType, varSections: block.varSections,
+      statements: options.packBools && block.type === 'FunctionBlockDeclaration' ? block.statements : undefined });
+  return JSON.stringify({ settings, exchanged: [...(exchanged ?? [])].sort(), declarations,
+    pure: [...pureFunctions(ast.body, options)].sort() }, (key, value) => typeof value === 'bigint' ? `${value}n` : value);
+}
+
+/**
+ * The kinds of POU, by the type of their declaration.
+ */
+const POU_KINDS = { ProgramDeclaration: 'PROGRAM', FunctionDeclaration: 'FUNCTION', FunctionBlockDeclaration: 'FUNCTION_BLOCK' };
+
+/**
+ * Lists the POUs of a program in the order they were declared, which is the order of their IDs in POU_PROFILES.
+ * @param {{body: {type: string, name: string}[]}} ast The parsed code.
+ * @returns {{name: string, kind: string}[]} Returns the name and kind of each POU.
+ */
+export function listPOUs(ast) {
+  return ast.body.filter((block) => POU_KINDS[block.type]).map((block) => ({ name: block.name, kind: POU_KINDS[block.type] }));
+}
+
+/**
+ * Gets the bytes of the process image an address covers, as accesses of programAccesses().
+ * @param {string} address The located address.
+ * @returns {string[]} Returns an access for each byte, like "Q:12".
+ */
+export function addressBytes(address) {
+  const { space, width, index, bit } = parseAddress(address);
+  const first = index * (width / 8);
+  if (bit > -1) return [`${space}:${first + (bit >> 3)}`];
+  return Array.from({ length: width / 8 }, (_, b) => `${space}:${first + b}`);
+}
+
+/**
+ * Finds what each program reads and writes that another program could also touch: the bytes of located addresses,
+ * the globals, and the variables of program instances, including through the function blocks and functions it calls.
+ * Bits are counted as their whole byte, since setting one rewrites the byte. A program that takes an address with
+ * ADR or REF, or dereferences one, can reach anything and is marked opaque.
+ * @param {{body: {type: string, name: string, varSections: [], statements: []}}[]} ast The tokenized code.
+ * @returns {Map<string, {reads: Set<string>, writes: Set<string>, opaque: boolean}>} Returns the accesses of each
+ * program, by upper case name. Every program writes its own instance, as "P:NAME".
+ */
+export function programAccesses(ast) {
+  const globals = new Map();
+  ast.body.filter((block) => block.type === 'GlobalVars').forEach((block) =>
+    block.variables.forEach((v) => globals.set(v.name.toUpperCase(), v.address ?? null)));
+  const pous = new Map(ast.body.filter((block) => POU_KINDS[block.type]).map((block) => [block.name.toUpperCase(), block]));
+  const accesses = new Map();
+  const accessesOf = (block) => {
+    const name = block.name.toUpperCase();
+    if (accesses.has(name)) return accesses.get(name);
+    const access = { reads: new Set(), writes: new Set(), opaque: false };
+    // Set before the body is walked, so that a recursive call sees what is known so far instead of looping.
+    accesses.set(name, access);
+    if (block.type === 'ProgramDeclaration') access.writes.add(`P:${name}`);
+    const locals = new Map((block.varSections ?? []).map((v) => [v.name.toUpperCase(), v]));
+    const shared = (target) => {
+      if (/^%[IQM]/i.test(target)) return addressBytes(target);
+      const base = target.split(/[.[]/)[0].toUpperCase();
+      if (locals.has(base)) return [];
+      if (globals.has(base)) return globals.get(base) ? addressBytes(globals.get(base)) : [`G:${base}`];
+      if (pous.get(base)?.type === 'ProgramDeclaration') return [`P:${base}`];
+      return [];
+    };
+    const include = (callee) => {
+      const inner = accessesOf(callee);
+      inner.reads.forEach((r) => access.reads.add(r));
+      inner.writes.forEach((w) => access.writes.add(w));
+      access.opaque ||= inner.opaque;
+    };
+    const read = (tokens) => {
+      const list = Array.isArray(tokens) ? tokens : [tokens];
+      list.forEach((token, i) => {
+        if (typeof token !== 'string') return;
+        const upper = token.toUpperCase();
+        if (upper === 'ADR' || upper === 'REF' || token.includes('^')) access.opaque = true;
+        if (list[i + 1] === '(' && pous.has(upper)) include(pous.get(upper));
+        shared(token).forEach((r) => access.reads.add(r));
+      });
+    };
+    const write = (target) => {
+      shared(target).forEach((w) => access.writes.add(w));
+      // The indices of an element are read.
+      read((target.match(/%?[A-Za-z_][\w.]*/g) ?? []).slice(1));
+    };
+    const visit = (statements) => statements?.forEach((stmt) => {
+      switch (stmt.type) {
+        case 'ASSIGN':
+          write(stmt.left);
+          read(stmt.right);
+          break;
+        case 'TEMP':
+          read(stmt.right);
+          break;
+        case 'CALL': {
+          const base = stmt.name.split(/[.[]/)[0].toUpperCase();
+          const type = locals.has(base) ? locals.get(base).type?.toUpperCase() : globals.has(base) ? null : base;
+          const callee = type ? pous.get(type) : null;
+          if (callee) include(callee);
+          // A function block instance outside of the POU is changed by the call.
+          if (!locals.has(base)) write(stmt.name);
+          read(stmt.args ?? []);
+          (stmt.inputs ?? []).forEach((input) => read(input.value));
+          (stmt.outputs ?? []).forEach((output) => write(output.target));
+          break;
+        }
+        default:
+          read(stmt.condition ?? []);
+          read(stmt.expression ?? []);
+          [stmt.from, stmt.to, stmt.step].forEach((bound) => read(bound ?? []));
+          if (stmt.variable) write(stmt.variable);
+          visit(stmt.thenBlock);
+          (stmt.elseIfBlocks ?? []).forEach((branch) => {
+            read(branch.condition ?? []);
+            visit(branch.block);
+          });
+          visit(stmt.elseBlock);
+          visit(stmt.body);
+          (stmt.branches ?? []).forEach((branch) => visit(branch.body));
+          if (stmt.type === 'SFC') {
+            stmt.transitions.forEach((transition) => read(transition.condition));
+            stmt.actions.forEach((action) => visit(action.body));
+            chartIndices(stmt).variables.forEach(write);
+          }
+      }
+    });
+    visit(block.statements);
+    return access;
+  };
+  pous.forEach((block) => accessesOf(block));
+  return new Map([...accesses].filter(([name]) => pous.get(name).type === 'ProgramDeclaration'));
+}
+
+/**
+ * Splits the program instances of a task into stages that run one after another. The instances of a stage don't
+ * write anything another of them reads or writes, so they can run in parallel, and an instance that conflicts with
+ * an earlier one is in a later stage than it, so the task ends the same as if its instances ran in order.
+ * @param {({reads: Set<string>, writes: Set<string>, opaque: boolean}|undefined)[]} accesses The accesses of each
+ * instance, in the order of the task, from programAccesses(). An instance without them is treated as opaque.
+ * @returns {number[][]} Returns the stages, as the indices of their instances, each in the order of the task.
+ */
+export function parallelStages(accesses) {
+  const conflicts = (a, b) => !a || !b || a.opaque || b.opaque ||
+    [...a.writes].some((w) => b.reads.has(w) || b.writes.has(w)) || [...b.writes].some((w) => a.reads.has(w));
+  const levels = [];
+  const stages = [];
+  accesses.forEach((access, j) => {
+    let level = 0;
+    for (let i = 0; i < j; i++) {
+      if (levels[i] >= level && conflicts(accesses[i], access)) level = levels[i] + 1;
+    }
+    levels.push(level);
+    (stages[level] ??= []).push(j);
+  });
+  return stages;
+}
+
+/**
+ * Finds the globals the tasks exchange: those that more than one task uses and at least one of them writes. A task
+ * worker runs against a copy of them of its own, loaded when it is released and published when it completes, so
+ * that no task sees a value another is halfway through writing. Only globals declared before the first POU, of the
+ * elementary, string and STRUCT types and arrays of them, can be copied; instances of function blocks stay shared.
+ * @param {{body: {type: string, name: string, varSections: [], statements: []}}[]} ast The tokenized code.
+ * @param {string[][]} tasks The types of the program instances of each task.
+ * @returns {Set<string>} Returns the upper case names of the globals, in the order they were declared.
+ */
+export function exchangedGlobals(ast, tasks) {
+  const exchanged = new Set();
+  if (tasks.length < 2) return exchanged;
+  const types = new Map();
+  ast.body.filter((block) => block.type === 'TypeDeclaration').forEach((block) =>
+    block.types.forEach((t) => types.set(t.name.toUpperCase(), t)));
+  const copyable = (type, seen = new Set()) => {
+    const upper = type.trim().toUpperCase();
+    if (mapType(upper) !== 'auto') return true;
+    const t = types.get(upper);
+    if (!t || seen.has(upper)) return false;
+    seen.add(upper);
+    if (t.members) {
+      return t.members.every((m) => !m.address && (m.array ? copyable(m.array.of, seen) : copyable(m.type, seen)));
+    }
+    return copyable(t.alias.array ? t.alias.array.of : t.alias.type, seen);
+  };
+  const accesses = programAccesses(ast);
+  const taskAccesses = tasks.map((instances) => {
+    const reads = new Set();
+    const writes = new Set();
+    instances.forEach((type) => {
+      const access = accesses.get(type.toUpperCase());
+      access?.reads.forEach((r) => reads.add(r));
+      access?.writes.forEach((w) => writes.add(w));
+    });
+    return { reads, writes };
+  });
+  const first = ast.body.findIndex((block) => POU_KINDS[block.type]);
+  ast.body.slice(0, first < 0 ? ast.body.length : first).filter((block) => block.type === 'GlobalVars').forEach((block) =>
+    block.variables.forEach((v) => {
+      if (v.address || (v.array ? BANK_BLOCKS[v.array.of.trim().toUpperCase()] || !copyable(v.array.of) : !copyable(v.type))) return;
+      const key = `G:${v.name.toUpperCase()}`;
+      const users = taskAccesses.filter((t) => t.reads.has(key) || t.writes.has(key)).length;
+      if (users > 1 && taskAccesses.some((t) => t.writes.has(key))) exchanged.add(v.name.toUpperCase());
+    }));
+  return exchanged;
+}
+
+/**
+ * Gets the layout of a variable for an online change: the C++ type it is declared with, with the layout of each user
+ * type in it in place of its name. Two variables of the same name and layout can be assigned one from the other.
+ * @param {{name: string, type: string, array?: {}}} v The variable.
+ * @param {Object<string, string>} operandTypes The operand types of the generic block instances, by name.
+ * @param {function(string): string} typeLayout Gets the layout of a type by name.
+ * @returns {string} Returns the layout.
+ */
+function variableLayout(v, operandTypes, typeLayout) {
+  if (v.array) {
+    const bank = BANK_BLOCKS[v.array.of.trim().toUpperCase()];
+    if (bank && v.array.dimensions.length === 1) {
+      return `${bank}<${v.array.high - v.array.low + 1}, ${v.array.low}>`;
+    }
+    return arrayType({ name: v.name, array: { ...v.array, of: typeLayout(v.array.of) } });
+  }
+  const upper = v.type.trim().toUpperCase();
+  if (GENERIC_BLOCKS[upper]) {
+    return `${upper}<${operandTypes[v.name] ?? ''}>`;
+  }
+  const mapped = mapType(v.type);
+  return mapped !== 'auto' ? mapped : typeLayout(v.type);
+}
+
+/**
+ * Gets the layout of a member of a user type, which includes the address of a located member.
+ * @param {{name: string, type: string, address?: string}} v The member.
+ * @param {Object<string, string>} operandTypes The operand types of the generic block instances, by name.
+ * @param {function(string): string} typeLayout Gets the layout of a type by name.
+ * @returns {string} Returns the name and layout of the member.
+ */
+function memberLayout(v, operandTypes, typeLayout) {
+  return `${v.name}:${v.address ? `${mapType(v.type)}@${v.address}` : variableLayout(v, operandTypes, typeLayout)}`;
+}
+
+/**
+ * Hashes the text of a layout with 32-bit FNV-1a.
+ * @param {string} text The layout.
+ * @returns {string} Returns the hash in hex.
+ */
+function layoutHash(text) {
+  let hash = 0x811c9dc5;
+  for (let i = 0; i < text.length; i++) {
+    hash = Math.imul(hash ^ text.charCodeAt(i), 0x01000193) >>> 0;
+  }
+  return hash.toString(16).padStart(8, '0');
+}
+
+/**
+ * Writes a row of a state table.
+ * @param {string} name The name the variable is matched by.
+ * @param {string} layout The layout of the variable.
+ * @param {string} variable The C++ expression of the variable.
+ * @returns {string} Returns the row.
+ */
+function stateRow(name, layout, variable) {
+  return `  { "${name}", "${layout}", &${variable}, sizeof(${variable}), 0, &copyState<decltype(${variable})> }`;
+}
+
+/**
+ * Defines a function that returns a table of variables, as StateVariable rows, for the runtime host of an online
+ * change to carry the variables over from one version of the program to the next.
+ * @param {string} name The name of the function.
+ * @param {string[]} rows The rows.
+ * @returns {string[]} Returns the definition.
+ */
+function stateTable(name, rows) {
+  if (rows.length === 0) {
+    return [`const StateVariable* ${name}(size_t* count) {`, '  *count = 0;', '  return nullptr;', '}'];
+  }
+  return [`const StateVariable* ${name}(size_t* count) {`, '  static const StateVariable state[] = {',
+    ...rows.map((row, i) => `  ${row}${i < rows.length - 1 ? ',' : ''}`), '  };',
+    '  *count = sizeof(state) / sizeof(state[0]);', '  return state;', '}'];
+}
+
+/**
+ * Specializes BrowseTraits for a program, function block or STRUCT type, for the OPC UA server to browse its members
+ * in place. The members are sorted by name, in the strcmp() order the server searches them in.
+ * @param {string} type The C++ type.
+ * @param {[string, string][]} rows The name and BrowseMember row of each member.
+ * @returns {string[]} Returns the specialization.
+ */
+function browseTraits(type, rows) {
+  const sorted = [...rows].sort(([a], [b]) => a < b ? -1 : a > b ? 1 : 0).map(([, row]) => row);
+  if (sorted.length === 0) {
+    return [`template<> struct BrowseTraits<${type}> {`, '  static const BrowseType* type() {',
+      '    static const BrowseType browse{ BrowseKind::Object };', '    return &browse;', '  }', '};'];
+  }
+  return [`template<> struct BrowseTraits<${type}> {`, `  NODALIS_BROWSE_OBJECT(${type},`,
+    ...sorted.map((row, i) => `    ${row}${i < sorted.length - 1 ? ',' : ')'}`), '};'];
+}
+
+/**
+ * Defines GLOBAL_BROWSE(), which publishes the globals from the OPC UA server as GLOBALS.
+ * @param {[string, string][]} rows The name and BrowseMember row of each global.
+ * @returns {string[]} Returns the definition.
+ */
+function globalBrowseTable(rows) {
+  const sorted = [...rows].sort(([a], [b]) => a < b ? -1 : a > b ? 1 : 0).map(([, row]) => row);
+  if (sorted.length === 0) {
+    return ['void GLOBAL_BROWSE() {', '  static const BrowseType browse{ BrowseKind::Object };',
+      '  browseOPCUAProgram("GLOBALS", nullptr, &browse);', '}'];
+  }
+  return ['void GLOBAL_BROWSE() {', '  static const BrowseMember members[] = {',
+    ...sorted.map((row, i) => `    ${row}${i < sorted.length - 1 ? ',' : ''}`), '  };',
+    '  static const BrowseType browse{ BrowseKind::Object, members, sizeof(members) / sizeof(members[0]) };',
+    '  browseOPCUAProgram("GLOBALS", nullptr, &browse);', '}'];
+}
+
+/**
+ * Gets the C++ return type of a function: its mapped type, or the name of the STRUCT type it returns.
+ * @param {{name: string, returnType: string}} block The function.
+ * @returns {string} Returns the C++ type.
+ */
+function returnType(block) {
+  const mapped = mapType(block.returnType);
+  return !mapped || mapped === 'auto' ? block.returnType.trim() : mapped;
+}
+
+/**
+ * Declares a global that is defined in another translation unit.
+ * @param {{name: string}} v The global.
+ * @param {string} declaration The definition of the global, from declareVars.
+ * @returns {string} Returns the extern declaration, without the initial value.
+ */
+function externDeclaration(v, declaration) {
+  const match = new RegExp(`^(?:static )?(.*?) ${v.name}(?=[ ;=({])`).exec(declaration);
+  if (!match) {
+    throw new Error(`Global ${v.name} can't be declared in a separate translation unit`);
+  }
+  return `extern ${match[1]} ${v.name};`;
+}
+
 /**
  * Converts a single statement to C++
  * @param {{type: string, left: string, right: string, condition:string[], elseIfBlocks: [], elseBlock: [], body: []}} stmt The tokenized statement to convert.
@@ -87,17 +741,20 @@ function mapStatement(stmt){
   try{
     switch (stmt.type) {
         case 'ASSIGN': {
-          const left = stmt.left;
+          const left = convertIndices(stmt.left);
           const rightExpr = convertExpression(stmt.right);
           if (isIOAddress(left)) {
-            return getWriteAddressExpression(left, rightExpr) + ";";
+            return getCppWriteAddressExpression(left, rightExpr) + ";";
           } else if (isBitSelector(left)) {
             const [varName, bitIndex] = left.split('.');
-            return `setBit(&${varName}, ${bitIndex}, ${rightExpr});`;
+            return `setBit<${bitIndex}>(&${varName}, ${rightExpr});`;
           }
           return `${left} = ${rightExpr};`;
         }
 
+        case 'TEMP':
+          return [`const auto ${stmt.name} = ${convertExpression(stmt.right)};`];
+
         case 'IF': {
           const cond = convertExpression(Array.isArray(stmt.condition) ? stmt.condition.join(' ') : stmt.condition);
           const lines = [];
@@ -133,63 +790,707 @@ function mapStatement(stmt){
           ];
 
         case 'FOR':
+          return mapFor(stmt);
+        case 'REPEAT': {
+          const rcond = convertExpression(Array.isArray(stmt.condition) ? stmt.condition.join(' ') : stmt.condition);
           return [
-            `for (int ${stmt.variable} = ${stmt.start}; ${stmt.variable} <= ${stmt.end}; ${stmt.variable} += ${stmt.step}) {`,
+            `do {`,
             ...transpileStatements(stmt.body)?.map(s => `  ${s}`),
-            `}`
+            `} while (!(${rcond}));`
           ];
+        }
+
+        case 'CASE':
+          return mapCase(stmt);
+        case 'LOOP_GUARD':
+          return ['if (releaseExpired()) break;'];
+        case 'SFC':
+          return mapChart(stmt);
       case "CALL": {
+        // A call with formal parameters sets the inputs of the instance, evaluates it, then copies out its outputs.
+        if (stmt.inputs || stmt.outputs) {
+          const instance = convertIndices(stmt.name);
+          return [
+            ...(stmt.inputs ?? []).flatMap((input) => mapStatement({ type: 'ASSIGN', left: `${instance}.${input.name}`, right: input.value })),
+            `${instance}();`,
+            ...(stmt.outputs ?? []).flatMap((output) => mapStatement({ type: 'ASSIGN', left: output.target, right: [`${instance}.${output.name}`] }))
+          ];
+        }
         // If args exist, it's a normal function call: Foo(a, b);
         if (stmt.args && stmt.args.length) {
-          const argsExpr = convertExpression(stmt.args, infb, fbVars, true);
-          return [`${stmt.name}(${argsExpr});`];
+          return [`${standardFunction(stmt.name)}(${convertExpression(stmt.args)});`];
         }
 
         // Otherwise treat as FB instance call: FB1();
-        return [stmt.name + "();"];
+        return [convertIndices(stmt.name) + "();"];
       }
         default:
           return [`// unsupported: ${stmt.type}`];
       }
   }
   catch(e){
+    if(e instanceof AddressError) throw e;
     console.error(e + "\n" + JSON.stringify(stmt));
   }
   return "// uncompilable statement " + JSON.stringify(stmt);
 }
 
+/**
+ * The most statements a function block can have, counting those nested in others, to be inlined into its callers.
+ */
+const INLINE_BLOCK_STATEMENTS = 8;
+
+/**
+ * Determines whether the body of a function block is small enough to be inlined into every call of it: no more than
+ * INLINE_BLOCK_STATEMENTS statements and no loops.
+ * @param {{type: string}[]} statements The statements of the function block.
+ * @returns {boolean} Returns true for a small body.
+ */
+function isSmallBlock(statements) {
+  let count = 0;
+  const visit = (stmts) => (stmts ?? []).every((stmt) => {
+    count++;
+    if (['FOR', 'WHILE', 'REPEAT', 'SFC'].includes(stmt.type)) return false;
+    return visit(stmt.thenBlock) && (stmt.elseIfBlocks ?? []).every((b) => visit(b.block)) && visit(stmt.elseBlock) &&
+      (stmt.branches ?? []).every((b) => visit(b.body));
+  });
+  return visit(statements) && count <= INLINE_BLOCK_STATEMENTS;
+}
+
+/**
+ * The C++ types of the variables a constexpr function may have.
+ */
+const CONSTEXPR_TYPES = new Set(['bool', 'uint8_t', 'uint16_t', 'uint32_t', 'uint64_t', 'int8_t', 'int16_t', 'int32_t',
+  'int64_t', 'float', 'double', 'FixedReal', 'IEC_LTIME', 'IEC_LDATE', 'IEC_LTIME_OF_DAY', 'IEC_LDATE_AND_TIME']);
+
+/**
+ * Gets the parameters of a function, its VAR_INPUT variables, passed by value, and its VAR_IN_OUT variables, passed by
+ * reference, in the order they are declared.
+ * @param {{varSections: {name: string, sectionType: string}[]}} block The function.
+ * @returns {{name: string, type: string, initialValue: string, sectionType: string}[]} Returns the parameters.
+ */
+function functionParameters(block) {
+  return block.varSections.filter((v) => v.sectionType === 'VAR_INPUT' || v.sectionType === 'VAR_IN_OUT');
+}
+
+/**
+ * Finds the functions whose bodies are pure, to be compiled as constexpr: their result and variables are elementary
+ * numbers or BOOLs, and their statements only read and write their own variables and call other pure functions. A
+ * call of one with constant arguments is folded by the C++ compiler. The cycle counter sample of a profiled POU, and
+ * the watchdog test of a guarded loop, aren't constant, so with pouProfile no function is pure, and with loopGuard
+ * no function with a loop is.
+ * @param {{type: string, name: string, returnType: string, varSections: [], statements: []}[]} blocks The POUs.
+ * @param {{pouProfile: boolean, loopGuard: boolean}} options The options of the transpiler.
+ * @returns {Set<string>} Returns the upper case names of the pure functions.
+ */
+function pureFunctions(blocks, options = {}) {
+  const functions = new Map(blocks.filter((block) => block.type === 'FunctionDeclaration')
+    .map((block) => [block.name.toUpperCase(), block]));
+  if (options.pouProfile) return new Set();
+  const statementTypes = ['ASSIGN', 'TEMP', 'IF', 'CASE', ...(options.loopGuard ? [] : ['FOR', 'WHILE', 'REPEAT'])];
+  const operators = new Set(['AND', 'OR', 'XOR', 'NOT', 'MOD', 'TRUE', 'FALSE']);
+  const calls = new Map();
+  for (const [name, block] of functions) {
+    const locals = new Set([block.name, ...block.varSections.map((v) => v.name)]);
+    const called = new Set();
+    let pure = CONSTEXPR_TYPES.has(mapType(block.returnType)) && block.varSections.every((v) => !v.array && !v.address &&
+      v.sectionType !== 'VAR_IN_OUT' && v.sectionType !== 'VAR_EXTERNAL' && CONSTEXPR_TYPES.has(mapType(v.type)));
+    const visit = (value, key) => {
+      if (!pure || key === 'type') return;
+      if (Array.isArray(value)) return value.forEach((item) => visit(item));
+      if (value && typeof value === 'object') {
+        if (value.type && !statementTypes.includes(value.type)) pure = false;
+        if (value.type === 'TEMP') locals.add(value.name);
+        return Object.entries(value).forEach(([k, v]) => visit(v, k));
+      }
+      if (typeof value !== 'string') return;
+      // Anything but names, numbers and the arithmetic, comparison and logic operators, such as a located address,
+      // an array index, a bit of a variable or a typed literal, isn't known to be constant.
+      if (/[^\w\s.+\-*/()<>=:,;]/.test(value)) pure = false;
+      for (const match of value.matchAll(/(?<![\w.])[A-Za-z_]\w*/g)) {
+        const word = match[0];
+        const at = match.index;
+        if (value[at - 1] === '.' || value[at + word.length] === '.') pure = false;
+        else if (functions.has(word.toUpperCase()) && !locals.has(word)) called.add(word.toUpperCase());
+        else if (!locals.has(word) && !operators.has(word.toUpperCase())) pure = false;
+      }
+    };
+    visit(block.statements);
+    if (pure) calls.set(name, called);
+  }
+  // A function that calls one that isn't pure isn't either.
+  let changed = true;
+  while (changed) {
+    changed = false;
+    for (const [name, called] of calls) {
+      if ([...called].some((f) => f === name || !calls.has(f))) {
+        calls.delete(name);
+        changed = true;
+      }
+    }
+  }
+  return new Set(calls.keys());
+}
+
+/**
+ * Puts the arguments of the calls of user functions with formal arguments, Name(B := 1, A := X), in the order of the
+ * function's parameters, after any leading positional ones. An input that a call doesn't give is passed its initial
+ * value, or a value initialized with {}.
+ * @param {{type: string}[]} statements The statements of a POU.
+ * @param {Map<string, {name: string, initialValue: string}[]>} functions The parameters of the functions, by upper case name.
+ * @returns {{type: string}[]} Returns the statements, with the calls rewritten.
+ */
+function positionalCalls(statements, functions) {
+  const tokens = (list) => {
+    const out = [];
+    for (let i = 0; i < list.length; i++) {
+      const parameters = typeof list[i] === 'string' ? functions.get(list[i].toUpperCase()) : undefined;
+      if (!parameters || list[i + 1] !== '(') {
+        out.push(list[i]);
+        continue;
+      }
+      const args = [[]];
+      let depth = 0;
+      let j = i + 2;
+      for (; j < list.length && !(depth === 0 && list[j] === ')'); j++) {
+        if (list[j] === '(' || list[j] === '[') depth++;
+        if (list[j] === ')' || list[j] === ']') depth--;
+        if (depth === 0 && list[j] === ',') args.push([]);
+        else args[args.length - 1].push(list[j]);
+      }
+      let positional = args.length === 1 && args[0].length === 0 ? [] : args;
+      if (positional.some((arg) => arg[1] === ':=')) {
+        const named = new Map(positional.filter((arg) => arg[1] === ':=').map((arg) => [String(arg[0]).toUpperCase(), arg.slice(2)]));
+        const leading = positional.filter((arg) => arg[1] !== ':=');
+        positional = parameters.map((v, k) => named.get(v.name.toUpperCase()) ?? leading[k] ?? [v.initialValue ?? '{}']);
+      }
+      out.push(list[i], '(', ...positional.flatMap((arg, k) => [...(k > 0 ? [','] : []), ...tokens(arg)]), ')');
+      i = j;
+    }
+    return out;
+  };
+  const rewrite = (value) => {
+    if (Array.isArray(value)) return value.every((item) => typeof item === 'string') ? tokens(value) : value.map(rewrite);
+    if (value && typeof value === 'object') return Object.fromEntries(Object.entries(value).map(([k, v]) => [k, rewrite(v)]));
+    return value;
+  };
+  return functions.size === 0 ? statements : rewrite(statements);
+}
+
+/**
+ * Converts a FOR statement to a counted C++ for loop. The start, end and step are evaluated once and give the number
+ * of iterations, counted in 64 bits so that a loop up to the largest value of its type ends. The counter steps in a
+ * local of its declared type, which the C++ compiler can keep in a register, and is copied back to the variable after
+ * the loop. A literal step picks the direction when the program is compiled, any other step when the loop starts; a
+ * step of 0 runs no iterations.
+ * @param {{variable: string, from: string[], to: string[], step: string[], counterType: string, body: []}} stmt The FOR statement.
+ * @returns {string[]} Returns the loop, in a block of its own.
+ */
+function mapFor(stmt) {
+  const v = stmt.variable;
+  const type = stmt.counterType ?? 'int32_t';
+  const step = convertExpression(stmt.step);
+  const stepValue = /^-?\d+$/.test(step.replace(/\s+/g, '')) ? Number(step.replace(/\s+/g, '')) : null;
+  const [start, end, stepName, count] = ['START', 'END', 'STEP', 'COUNT'].map((name) => `FOR_${v}_${name}`);
+  const up = (by) => `${start} <= ${end} ? (uint64_t(${end}) - uint64_t(${start}))${by === '1' ? '' : ` / ${by}`} + 1 : 0`;
+  const down = (by) => `${start} >= ${end} ? (uint64_t(${start}) - uint64_t(${end}))${by === '1' ? '' : ` / ${by}`} + 1 : 0`;
+  const lines = ['{', `  auto& FOR_${v} = ${v};`];
+  // The bounds are evaluated before the counter is declared, since they may read the variable it shadows.
+  lines.push(`  const ${type} ${start} = ${convertExpression(stmt.from)};`);
+  lines.push(`  const ${type} ${end} = ${convertExpression(stmt.to)};`);
+  if (stepValue === null) {
+    lines.push(`  const ${type} ${stepName} = ${step};`);
+    lines.push(`  const uint64_t ${count} = ${stepName} > 0 ? (${up(`uint64_t(${stepName})`)}) :`);
+    lines.push(`    ${stepName} < 0 ? (${down(`(0 - uint64_t(${stepName}))`)}) : 0;`);
+  }
+  else {
+    lines.push(`  const uint64_t ${count} = ${stepValue > 0 ? up(String(stepValue)) : stepValue < 0 ? down(String(-stepValue)) : '0'};`);
+  }
+  lines.push(`  ForCounter<${type}> ${v} = ${start};`);
+  if (isIndependentLoop(stmt)) lines.push('  NODALIS_IVDEP');
+  lines.push(`  for (uint64_t FOR_${v}_N = 0; FOR_${v}_N < ${count}; FOR_${v}_N++, ${v} += ${stepValue ?? stepName}) {`);
+  lines.push(...(transpileStatements(stmt.body) ?? []).map(s => `    ${s}`));
+  lines.push('  }', `  FOR_${v} = ${v};`, '}');
+  return lines;
+}
+
+/**
+ * Determines whether the iterations of a FOR loop are independent of each other, so that it can be marked for the
+ * C++ compiler to vectorize without proving that itself: the body only assigns elements of arrays at the counter,
+ * reads the arrays it assigns only at the counter and calls nothing.
+ * @param {{variable: string, body: {type: string, left: string, right: string[]}[]}} stmt The FOR statement.
+ * @returns {boolean} Returns true if the iterations are independent.
+ */
+function isIndependentLoop(stmt) {
+  const body = stmt.body ?? [];
+  const written = new Set();
+  for (const s of body) {
+    if (s.type === 'TEMP') continue;
+    const element = s.type === 'ASSIGN' ? /^([A-Za-z_]\w*)\[([A-Za-z_]\w*)\]$/.exec(s.left) : null;
+    if (!element || element[2] !== stmt.variable) return false;
+    written.add(element[1]);
+  }
+  const operators = ['AND', 'OR', 'XOR', 'NOT', 'MOD'];
+  return written.size > 0 && body.every((s) => {
+    const tokens = Array.isArray(s.right) ? s.right : [s.right];
+    return tokens.every((t, i) => {
+      if (tokens[i + 1] === '(' && /^[A-Za-z_]/.test(t) && !operators.includes(t.toUpperCase())) return false;
+      return !written.has(t) || (tokens[i + 1] === '[' && tokens[i + 2] === stmt.variable && tokens[i + 3] === ']');
+    });
+  });
+}
+
+/**
+ * Gives each FOR statement the C++ type of its counter, as declared in the POU or globally.
+ * @param {{type: string}[]} statements The statements of a POU.
+ * @param {Object<string, string>} types The ST types of the variables in scope, by name.
+ * @returns {{type: string}[]} Returns the statements, with counterType set on the FOR statements.
+ */
+function typeCounters(statements, types) {
+  const nested = (list) => typeCounters(list, types);
+  return statements?.map((stmt) => {
+    switch (stmt.type) {
+      case 'FOR': {
+        const type = types[stmt.variable] ? mapType(types[stmt.variable]) : 'auto';
+        return { ...stmt, counterType: type === 'auto' ? 'int32_t' : type, body: nested(stmt.body) };
+      }
+      case 'IF':
+        return {
+          ...stmt,
+          thenBlock: nested(stmt.thenBlock),
+          elseIfBlocks: stmt.elseIfBlocks?.map((branch) => ({ ...branch, block: nested(branch.block) })),
+          elseBlock: nested(stmt.elseBlock)
+        };
+      case 'WHILE':
+      case 'REPEAT':
+        return { ...stmt, body: nested(stmt.body) };
+      case 'CASE':
+        return {
+          ...stmt,
+          branches: stmt.branches.map((branch) => ({ ...branch, body: nested(branch.body) })),
+          elseBlock: nested(stmt.elseBlock)
+        };
+      case 'SFC':
+        return { ...stmt, actions: stmt.actions.map((action) => ({ ...action, body: nested(action.body) })) };
+      default:
+        return stmt;
+    }
+  });
+}
+
+/**
+ * Starts the body of each loop with a LOOP_GUARD, which ends the loop once the watchdog finds that the task release
+ * running it has overrun its budget, so that a loop that never ends can't hang the runtime.
+ * @param {{type: string}[]} statements The statements of a POU.
+ * @returns {{type: string}[]} Returns the statements, with their loops guarded.
+ */
+function guardLoops(statements) {
+  return statements?.map((stmt) => {
+    switch (stmt.type) {
+      case 'FOR':
+      case 'WHILE':
+      case 'REPEAT':
+        return { ...stmt, body: [{ type: 'LOOP_GUARD' }, ...(guardLoops(stmt.body) ?? [])] };
+      case 'IF':
+        return {
+          ...stmt,
+          thenBlock: guardLoops(stmt.thenBlock),
+          elseIfBlocks: stmt.elseIfBlocks?.map((branch) => ({ ...branch, block: guardLoops(branch.block) })),
+          elseBlock: guardLoops(stmt.elseBlock)
+        };
+      case 'CASE':
+        return {
+          ...stmt,
+          branches: stmt.branches.map((branch) => ({ ...branch, body: guardLoops(branch.body) })),
+          elseBlock: guardLoops(stmt.elseBlock)
+        };
+      case 'SFC':
+        return { ...stmt, actions: stmt.actions.map((action) => ({ ...action, body: guardLoops(action.body) })) };
+      default:
+        return stmt;
+    }
+  });
+}
+
+/**
+ * The widest range of CASE labels, such as 1..5, that is expanded into a case label for each value. Wider ranges are
+ * tested in the default branch instead.
+ */
+const CASE_RANGE_LABELS = 256;
+
+/**
+ * Converts a CASE statement to a switch, which the C++ compiler can make a jump table of when the labels are dense.
+ * Ranges of labels become a case label for each of their values.
+ * @param {{expression: string[], branches: {labels: {low: string, high: string}[], body: []}[], elseBlock: []}} stmt The CASE statement.
+ * @returns {string[]} Returns the switch statement.
+ */
+function mapCase(stmt) {
+  const selector = convertExpression(stmt.expression);
+  const body = (statements) => ['  {', ...(transpileStatements(statements) ?? []).map(s => `    ${s}`), '    break;', '  }'];
+  const lines = [];
+  const wide = [];
+  for (const branch of stmt.branches) {
+    const labels = [];
+    const ranges = [];
+    for (const { low, high } of branch.labels) {
+      const from = Number(low);
+      const to = Number(high);
+      if (low === high) {
+        labels.push(low);
+      }
+      else if (Number.isInteger(from) && Number.isInteger(to) && to >= from && to - from < CASE_RANGE_LABELS) {
+        for (let value = from; value <= to; value++) labels.push(String(value));
+      }
+      else {
+        ranges.push(`(CASE_SELECTOR >= ${low} && CASE_SELECTOR <= ${high})`);
+      }
+    }
+    if (labels.length > 0) {
+      lines.push(...labels.map(label => `  case ${label}:`), ...body(branch.body));
+    }
+    if (ranges.length > 0) {
+      wide.push({ condition: ranges.join(' || '), statements: branch.body });
+    }
+  }
+  if (wide.length > 0) {
+    lines.push('  default:', '  {');
+    wide.forEach(({ condition, statements }, x) => {
+      lines.push(`    ${x > 0 ? 'else if' : 'if'} (${condition}) {`, ...(transpileStatements(statements) ?? []).map(s => `      ${s}`), '    }');
+    });
+    if (stmt.elseBlock?.length) {
+      lines.push('    else {', ...transpileStatements(stmt.elseBlock).map(s => `      ${s}`), '    }');
+    }
+    lines.push('    break;', '  }');
+  }
+  else if (stmt.elseBlock?.length) {
+    lines.push('  default:', ...body(stmt.elseBlock));
+  }
+  const head = wide.length > 0 ? `switch (const auto CASE_SELECTOR = ${selector}; CASE_SELECTOR) {` : `switch (${selector}) {`;
+  return [head, ...lines, '}'];
+}
+
+/**
+ * Finds the sequential function chart of a POU, which the parser puts among its top level statements.
+ * @param {{statements: {type: string}[]}} block The POU.
+ * @returns {{steps: [], transitions: [], actions: []}|undefined} Returns the SFC statement, if the POU has a chart.
+ */
+function chartOf(block) {
+  return block.statements?.find((stmt) => stmt.type === 'SFC');
+}
+
+/**
+ * Numbers the steps and actions of a chart. The actions written as ACTION blocks come first, then the variables
+ * that steps name as actions, which are set while the action is active.
+ * @param {{steps: {name: string, associations: {action: string}[]}[], actions: {name: string}[]}} chart The chart.
+ * @returns {{steps: Map<string, number>, actions: Map<string, number>, variables: string[]}} Returns the index of
+ * each step and action by upper case name, and the names of the variable actions in their order.
+ */
+function chartIndices(chart) {
+  const steps = new Map(chart.steps.map((step, i) => [step.name.toUpperCase(), i]));
+  const actions = new Map(chart.actions.map((action, i) => [action.name.toUpperCase(), i]));
+  const variables = [];
+  chart.steps.forEach((step) => step.associations.forEach(({ action }) => {
+    if (!actions.has(action.toUpperCase())) {
+      actions.set(action.toUpperCase(), actions.size);
+      variables.push(action);
+    }
+  }));
+  return { steps, actions, variables };
+}
+
+/**
+ * Replaces the flags of the steps of a chart, as Fill.X and Fill.T, in the tokens of a POU's statements with the
+ * flags the chart keeps for them.
+ * @param {{type: string}[]} statements The statements of the POU.
+ * @param {{steps: []}} chart The chart.
+ * @returns {{type: string}[]} Returns the statements.
+ */
+function chartFlags(statements, chart) {
+  const { steps } = chartIndices(chart);
+  const rename = (value) => {
+    if (Array.isArray(value)) return value.map(rename);
+    if (value && typeof value === 'object') return Object.fromEntries(Object.entries(value).map(([k, v]) => [k, rename(v)]));
+    const flag = typeof value === 'string' ? /^([A-Za-z_]\w*)\.([XT])$/i.exec(value) : null;
+    const index = flag ? steps.get(flag[1].toUpperCase()) : undefined;
+    return index === undefined ? value : `SFC_CHART.steps[${index}].${flag[2].toUpperCase()}`;
+  };
+  return rename(statements);
+}
+
+/**
+ * Declares the static tables of a chart and its state, as members of the class of its POU. The transitions of each
+ * step are listed with it, so that a scan only reaches the transitions of the active steps.
+ * @param {{steps: [], transitions: {from: string[], to: string[]}[]}} chart The chart.
+ * @returns {string[]} Returns the member declarations.
+ */
+function declareChart(chart) {
+  const { steps, actions } = chartIndices(chart);
+  const leaving = chart.steps.map(() => []);
+  const links = [];
+  const transitions = chart.transitions.map((transition, t) => {
+    transition.from.forEach((step) => leaving[steps.get(step.toUpperCase())].push(t));
+    const first = links.length;
+    links.push(...[...transition.from, ...transition.to].map((step) => steps.get(step.toUpperCase())));
+    return `{ ${first}, ${transition.from.length}, ${transition.to.length} }`;
+  });
+  const stepTransitions = [];
+  const associations = [];
+  const rows = chart.steps.map((step, i) => {
+    const row = `{ ${stepTransitions.length}, ${leaving[i].length}, ${associations.length}, ${step.associations.length} }`;
+    stepTransitions.push(...leaving[i]);
+    associations.push(...step.associations.map((a) => `{ ${actions.get(a.action.toUpperCase())}, SFC_${a.qualifier}, ${a.duration} }`));
+    return row;
+  });
+  // A table can't be empty, so one without entries holds a single unused one.
+  const list = (items, empty) => ` ${(items.length ? items : [empty]).join(', ')} `;
+  const initial = chart.steps.map((step, i) => step.initial ? i : -1).filter((i) => i >= 0);
+  return [
+    `static constexpr SfcStep SFC_STEPS[] = {${list(rows, '{}')}};`,
+    `static constexpr uint16_t SFC_STEP_TRANSITIONS[] = {${list(stepTransitions, 0)}};`,
+    `static constexpr SfcTransition SFC_TRANSITIONS[] = {${list(transitions, '{}')}};`,
+    `static constexpr uint16_t SFC_LINKS[] = {${list(links, 0)}};`,
+    `static constexpr SfcAssociation SFC_ASSOCIATIONS[] = {${list(associations, '{}')}};`,
+    `static constexpr uint16_t SFC_INITIAL[] = {${list(initial, 0)}};`,
+    `SfcChart<${chart.steps.length}, ${actions.size}> SFC_CHART;`
+  ];
+}
+
+/**
+ * Converts a chart to a scan of its SfcChart, with a switch over the conditions of its transitions and one over its
+ * actions. An ACTION block runs while its action is active and once more in the scan after it ends; a variable
+ * action is set to whether it is active.
+ * @param {{steps: [], transitions: {condition: string[]}[], actions: {name: string, body: []}[]}} chart The chart.
+ * @returns {string[]} Returns the statements.
+ */
+function mapChart(chart) {
+  const { variables } = chartIndices(chart);
+  const lines = [
+    `SFC_CHART(SfcTable{ SFC_STEPS, SFC_STEP_TRANSITIONS, SFC_TRANSITIONS, SFC_LINKS, SFC_ASSOCIATIONS, SFC_INITIAL, ${chart.steps.filter((step) => step.initial).length} },`,
+    '  [&](size_t transition) -> bool {',
+    '    switch (transition) {',
+    ...chart.transitions.map((transition, t) => `      case ${t}: return ${convertExpression(transition.condition)};`),
+    '    }',
+    '    return false;',
+    '  },',
+    '  [&](size_t action, bool active) {',
+    ...(variables.length ? [] : ['    (void)active;']),
+    '    switch (action) {'
+  ];
+  chart.actions.forEach((action, a) => {
+    lines.push(`      case ${a}: {`, ...(transpileStatements(action.body) ?? []).map((s) => `        ${s}`), '        break;', '      }');
+  });
+  variables.forEach((name, v) => {
+    lines.push(`      case ${chart.actions.length + v}:`, `        ${name} = active;`, '        break;');
+  });
+  lines.push('    }', '  });');
+  return lines;
+}
+
 /**
  * Transpiles an array of statements.
  * @param {{type: string, left: string, right: string, condition:string[], elseIfBlocks: [], elseBlock: [], body: []}[]} statements The statements to transpile.
+ * @param {{runs: Map<number, {count: number, code: string}>}} plan The packed BOOL plan of the POU, if the statements
+ * are its top level ones, so that each run of rungs it found is replaced by its word expression.
+ * @param {Map<number, {count: number, lines: string[], values: string[]}>} rungs The incremental rungs of the program,
+ * if the statements are its top level ones, from planIncrementalRungs(), which are wrapped in their guards.
  * @returns {string[]} Returns an array of transpiled statements.
  */
-function transpileStatements(statements) {
-  return statements?.flatMap(mapStatement);
+function transpileStatements(statements, plan = null, rungs = null) {
+  if ((!plan && !rungs) || !statements) {
+    return statements?.flatMap(mapStatement);
+  }
+  const lines = [];
+  for (let x = 0; x < statements.length; x++) {
+    const run = plan?.runs.get(x);
+    const rung = rungs?.get(x);
+    if (run) {
+      lines.push(run.code);
+      x += run.count - 1;
+    }
+    else if (rung) {
+      lines.push(...guardRung(rung, x, statements.slice(x, x + rung.count).flatMap(mapStatement)));
+      x += rung.count - 1;
+    }
+    else {
+      lines.push(...[mapStatement(statements[x])].flat());
+    }
+  }
+  return lines;
+}
+
+/**
+ * The standard function blocks that are C++ templates on the type of their operands, and the pins that carry it.
+ */
+const GENERIC_BLOCKS = {
+  EQ: ['IN1', 'IN2'], NE: ['IN1', 'IN2'], LT: ['IN1', 'IN2'], GT: ['IN1', 'IN2'], GE: ['IN1', 'IN2'], LE: ['IN1', 'IN2'],
+  MOVE: ['IN', 'OUT'], SEL: ['IN0', 'IN1', 'OUT'], MUX: ['IN0', 'IN1', 'OUT'],
+  MIN: ['IN1', 'IN2', 'OUT'], MAX: ['IN1', 'IN2', 'OUT'], LIMIT: ['MN', 'IN', 'MX', 'OUT'],
+  CTU: ['PV', 'CV'], CTD: ['PV', 'CV'], CTUD: ['PV', 'CV'],
+  MOVING_AVG: ['IN', 'OUT'], LOWPASS: ['IN', 'OUT'], RAMP: ['IN', 'OUT'], LIN_TABLE: ['IN', 'OUT']
+};
+
+/**
+ * Infers the operand type of the generic standard blocks of a POU from the variables assigned to or from their pins,
+ * such as `L1.IN := Temp` or `Big := M1.OUT`. A real literal wired to a pin makes it LREAL if no variable decides it.
+ * @param {{type: string, left: string, right: string[]}[]} statements The statements of the POU.
+ * @param {Object<string, string>} types The declared ST types of the variables the POU can see, by name.
+ * @returns {Object<string, string>} Returns the C++ operand type of each generic block instance, by name.
+ */
+function inferOperandTypes(statements, types) {
+  const inferred = {};
+  const literals = {};
+  const pinOf = (ref) => {
+    const [instance, pin] = typeof ref === 'string' ? ref.split('.') : [];
+    const block = GENERIC_BLOCKS[types[instance]?.trim().toUpperCase()];
+    return block && block.includes(pin?.toUpperCase()) ? instance : null;
+  };
+  // The parameters of a formal call are read as the assignments they are compiled to.
+  const assignments = (stmt) => stmt.type === 'CALL' && (stmt.inputs || stmt.outputs) ? [
+    ...(stmt.inputs ?? []).map((input) => ({ type: 'ASSIGN', left: `${stmt.name}.${input.name}`, right: input.value })),
+    ...(stmt.outputs ?? []).map((output) => ({ type: 'ASSIGN', left: output.target, right: [`${stmt.name}.${output.name}`] }))
+  ] : [stmt];
+  const walk = (stmts) => stmts?.flatMap(assignments).forEach((stmt) => {
+    if (stmt.type === 'ASSIGN') {
+      const right = Array.isArray(stmt.right) ? stmt.right : [stmt.right];
+      const value = right.length === 1 ? right[0] : null;
+      let instance = pinOf(stmt.left);
+      let operand = value;
+      if (!instance) {
+        instance = pinOf(value);
+        operand = stmt.left;
+      }
+      if (instance && !inferred[instance]) {
+        // A located global the optimizer reads by address is of the plain image type of its width.
+        const located = isIOAddress(operand) ? parseAddress(operand) : null;
+        const type = located ? (located.bit > -1 ? 'bool' : `uint${located.width}_t`) : types[operand] ? mapType(types[operand]) : 'auto';
+        if (type !== 'auto' && type !== 'bool' && !type.startsWith('IECString')) {
+          inferred[instance] = type;
+        }
+        else if (/^\d+\.\d+/.test(operand ?? '')) {
+          literals[instance] = 'double';
+        }
+      }
+    }
+    walk(stmt.thenBlock);
+    stmt.elseIfBlocks?.forEach((elif) => walk(elif.block));
+    walk(stmt.elseBlock);
+    walk(stmt.body);
+    stmt.actions?.forEach((action) => walk(action.body));
+  });
+  walk(statements);
+  return { ...literals, ...inferred };
+}
+
+/**
+ * The function blocks that arrays of are declared as banks, which evaluate every instance in one call.
+ */
+const BANK_BLOCKS = {
+  TON: 'TON_BANK', R_TRIG: 'R_TRIG_BANK', F_TRIG: 'F_TRIG_BANK', PID: 'PID_BANK',
+  MOVING_AVG: 'MOVING_AVG_BANK', LOWPASS: 'LOWPASS_BANK', RAMP: 'RAMP_BANK'
+};
+
+/**
+ * Declares an array of function blocks as a bank. Each element is addressed with the array's own bounds.
+ * @param {{name: string, array: {low: number, high: number, of: string}, sectionType: string}} v The array variable.
+ * @param {boolean} member True if the bank is a member of a program or function block class.
+ * @returns {string} Returns the declaration.
+ */
+function declareBank(v, member = false) {
+  const bank = BANK_BLOCKS[v.array.of.trim().toUpperCase()];
+  const declaration = `${bank}<${v.array.high - v.array.low + 1}, ${v.array.low}> ${v.name};`;
+  return v.sectionType === 'VAR' && !member ? `static ${declaration}` : declaration;
+}
+
+/**
+ * Gets the C++ type of an array: an IECArray for each dimension, of the mapped element type or of the function
+ * block or STRUCT type it names.
+ * @param {{name: string, array: {of: string, dimensions: {low: number, high: number}[]}}} v The array variable.
+ * @returns {string} Returns the C++ type.
+ */
+function arrayType(v) {
+  const upper = v.array.of.trim().toUpperCase();
+  if (GENERIC_BLOCKS[upper]) {
+    throw new Error(`Variable ${v.name}: ARRAY OF ${v.array.of} is not supported, the operand type of its elements can't be inferred`);
+  }
+  const mapped = mapType(v.array.of);
+  const element = mapped === 'auto' ? v.array.of.trim() : mapped;
+  return v.array.dimensions.reduceRight((inner, { low, high }) => `IECArray<${inner}, ${low}, ${high}>`, element);
+}
+
+/**
+ * Declares the types of a TYPE section: a STRUCT as a C++ struct of its members in order, and an alias as a typedef.
+ * @param {{name: string, members?: [], alias?: {type: string, array?: {}}}[]} types The declared types.
+ * @returns {string[]} Returns the declarations.
+ */
+function declareTypes(types) {
+  return types.flatMap((t) => {
+    if (t.members) {
+      return [`struct ${t.name} {//TYPE:${t.name}`, ...declareVars(t.members, {}, true).map(line => `  ${line}`), '};'];
+    }
+    const mapped = mapType(t.alias.type);
+    return [`typedef ${t.alias.array ? arrayType({ name: t.name, array: t.alias.array }) : mapped === 'auto' ? t.alias.type : mapped} ${t.name};`];
+  });
 }
 
 /**
  * Creates a transpiled section of declared variables.
  * @param {{type: string, address: string, initialValue: string, sectionType: string}[]} varSections An array of variable tokens.
+ * @param {Object<string, string>} operandTypes The C++ operand types inferred for the generic block instances, by name.
+ * @param {boolean} member True to declare the variables as members of a program or function block class, which
+ * every instance has its own of, rather than as globals or locals.
  * @returns {string[]} An array of declaration statements.
  */
-function declareVars(varSections) {
+function declareVars(varSections, operandTypes = {}, member = false) {
   return varSections.map(v => {
+    if (v.array) {
+      // Single dimensional arrays of the timers, edge detectors, PID controllers and signal blocks are evaluated as
+      // banks, other arrays are stored as plain C++ arrays.
+      if (BANK_BLOCKS[v.array.of.trim().toUpperCase()] && v.array.dimensions.length === 1) {
+        return declareBank(v, member);
+      }
+      const declaration = `${arrayType(v)} ${v.name};`;
+      return v.sectionType === 'VAR' && !member ? `static ${declaration}` : declaration;
+    }
     var cleanedType = v.type.trim().toUpperCase();
     var gv = "";
     const isFunctionBlockType = !mapType(cleanedType) || mapType(cleanedType) === 'auto';
     let init = "";
     cleanedType = mapType(cleanedType);
     if(v.address){
-      cleanedType = "RefVar<" + cleanedType + ">";
       var addr = v.address;
       if(!addr.startsWith("%")) addr = "%" + addr;
-      init = `("${addr}")`
+      const { space, width, index, bit } = parseAddress(addr);
+      // The address is resolved here, so that the runtime has nothing left to validate. Signed and floating point
+      // variables are views of the unsigned value of the same width.
+      const widths = { bool: -1, uint8_t: 8, uint16_t: 16, uint32_t: 32, uint64_t: 64,
+        int8_t: 8, int16_t: 16, int32_t: 32, int64_t: 64, float: 32, double: 64, FixedReal: 32 };
+      const expected = widths[cleanedType];
+      if(expected !== undefined){
+        if(expected === -1 ? bit < 0 : (bit > -1 || width !== expected)){
+          throw new AddressError(`Variable ${v.name} of type ${v.type} can't be located at ${addr}`);
+        }
+        init = bit > -1 ? `(locatedAddress<MEMORY_SPACE::${space}, ${width}, ${index}, ${bit}>())`
+                        : `(locatedAddress<MEMORY_SPACE::${space}, ${width}, ${index}>())`;
+      }
+      else{
+        init = `("${addr}")`;
+      }
+      if(member){
+        init = `{${init.slice(1, -1)}}`;
+      }
+      cleanedType = "RefVar<" + cleanedType + ">";
     }
     else if (v.initialValue !== undefined && v.initialValue !== null) {
-      init = ` = ${v.initialValue}`;
+      init = ` = ${convertExpression(String(v.initialValue))}`;
     }
-    if (v.sectionType==='VAR' && isFunctionBlockType) {
-      return `static ${v.type} ${v.name};`; // assume Function Block type
+    if (isFunctionBlockType && !v.address) {
+      // Instances of function blocks and variables of STRUCT types are declared with their own type name.
+      const upper = v.type.trim().toUpperCase();
+      const storage = v.sectionType === 'VAR' && !member ? 'static ' : '';
+      if (GENERIC_BLOCKS[upper]) {
+        return `${storage}${upper}<${operandTypes[v.name] ?? ''}> ${v.name};`;
+      }
+      return `${storage}${v.type.trim()} ${v.name}${init};`; // a function block or STRUCT type
     }
     return `${cleanedType} ${v.name}${init};${gv}`;
   });
@@ -201,6 +1502,13 @@ function declareVars(varSections) {
  * @returns {string} Returns a string representing the C++ equivalent for the structured text type.
  */
 export function mapType(type) {
+  if (realType !== 'float' && type.trim().toUpperCase() === 'REAL') {
+    return realType;
+  }
+  const sized = /^(W?STRING)\s*\[\s*(\d+)\s*\]$/i.exec(type.trim());
+  if (sized) {
+    return sized[1].toUpperCase() === 'WSTRING' ? `IECString<${sized[2]}, char16_t>` : `IECString<${sized[2]}>`;
+  }
   const types = {
     'BOOL': 'bool',
     'BYTE': 'uint8_t',
@@ -218,11 +1526,19 @@ export function mapType(type) {
     'REAL': 'float',
     'LREAL': 'double',
     'TIME': 'uint32_t',
-    'DATE': 'std::string',
-    'TIME_OF_DAY': 'std::string',
-    'DATE_AND_TIME': 'std::string',
-    'STRING': 'std::string',
-    'WSTRING': 'std::wstring'
+    'DATE': 'IEC_DATE',
+    'TIME_OF_DAY': 'IEC_TIME_OF_DAY',
+    'TOD': 'IEC_TIME_OF_DAY',
+    'DATE_AND_TIME': 'IEC_DATE_AND_TIME',
+    'DT': 'IEC_DATE_AND_TIME',
+    'LTIME': 'IEC_LTIME',
+    'LDATE': 'IEC_LDATE',
+    'LTIME_OF_DAY': 'IEC_LTIME_OF_DAY',
+    'LTOD': 'IEC_LTIME_OF_DAY',
+    'LDATE_AND_TIME': 'IEC_LDATE_AND_TIME',
+    'LDT': 'IEC_LDATE_AND_TIME',
+    'STRING': 'IECString<IEC_STRING_DEFAULT_LENGTH>',
+    'WSTRING': 'IECString<IEC_STRING_DEFAULT_LENGTH, char16_t>'
   };
   return types[type.trim().toUpperCase()] || 'auto';
 }
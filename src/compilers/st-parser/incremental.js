@@ -0,0 +1,216 @@
+/* eslint-disable curly */
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/**
+ * @description Incremental Rung Planner for the ANSI CPP Transpiler
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * Groups the top level statements of a program into rungs that the runtime skips when nothing they use changed
+ * (--incremental). A Ladder Diagram resource reaches the transpiler as ST, one or a few consecutive statements per
+ * rung, so a rung here is a run of consecutive statements that can be guarded: assignments and IF statements that
+ * only read variables and located addresses and call pure functions. The located addresses of a rung are checked
+ * by the lines of the process image they lie in, which the runtime tracks as they change, and its other operands
+ * by their values (see IncrementalRung in nodalis.h). A statement that calls a function block, such as a timer,
+ * whose outputs change with time, or that indexes an array or takes an address, is always evaluated.
+ */
+import { convertExpression, parseAddress, standardFunction } from './expressionConverter.js';
+
+/**
+ * The most statements, and the most operands compared by value, a rung can have. A longer run of statements is
+ * split into several rungs, which are more likely to be skipped than one.
+ */
+const RUNG_STATEMENTS = 8;
+const RUNG_VALUES = 16;
+
+/**
+ * The least work a rung must do to be guarded, in operators, calls and statements, and the work its guard does to
+ * check each of its lines and values. A rung that does less than its guard is always evaluated.
+ */
+const RUNG_MIN_WORK = 6;
+const GUARD_WORK = 2;
+
+const KEYWORDS = new Set(['AND', 'OR', 'XOR', 'NOT', 'MOD', 'TRUE', 'FALSE']);
+const OPERATORS = new Set(['+', '-', '*', '/', '**', '&', '=', '<>', '<', '>', '<=', '>=', 'AND', 'OR', 'XOR', 'NOT', 'MOD']);
+
+/**
+ * The C++ types whose values a rung compares: the elementary types and strings.
+ */
+const COMPARABLE = /^(bool|u?int(8|16|32|64)_t|float|double|FixedReal|IEC_\w+|IECString<.*>)$/;
+
+/**
+ * The bytes of a line of the process image. Each memory space starts on a line, so addresses of a space that are in
+ * the same line here are in the same line of the image.
+ */
+const LINE_BYTES = 64;
+
+/**
+ * Adds the line of the process image a located address lies in to a rung.
+ * @param {string} address The address.
+ * @param {Map<string, string>} lines The lines of the rung, as C++ expressions by space and line.
+ */
+function addLine(address, lines) {
+  const { space, width, index, bit } = parseAddress(address);
+  const key = `${space}:${Math.floor((index * (width / 8) + (bit > -1 ? bit >> 3 : 0)) / LINE_BYTES)}`;
+  if (!lines.has(key)) lines.set(key, `imageLine<MEMORY_SPACE::${space}, ${width}, ${index}${bit > -1 ? `, ${bit}` : ''}>()`);
+}
+
+/**
+ * Plans the rungs of a program that are guarded.
+ * @param {{type: string}[]} statements The top level statements of the program, as they are transpiled.
+ * @param {object} scope What the statements can name.
+ * @param {Map<string, {type: string, address: string, array: {}}>} scope.variables The variables of the program and
+ * the globals, by name.
+ * @param {Map<string, {name: string, type: string}[]>} scope.members The members of the STRUCT types and the
+ * variables of the function blocks, by upper case type name.
+ * @param {Set<string>} scope.pure The upper case names of the pure functions.
+ * @param {(type: string) => string} scope.mapType Maps an ST type to its C++ type.
+ * @param {{layout: Map<string, {}>, runs: Map<number, {count: number}>}|null} scope.packed The packed BOOL plan of
+ * the program, whose runs and packed variables are left alone.
+ * @returns {Map<number, {count: number, lines: string[], values: string[]}>} Returns the rungs by the index of their
+ * first statement, with the number of statements, the lines of their located addresses and the C++ expressions of
+ * their other operands.
+ */
+export function planIncrementalRungs(statements, scope) {
+  const { variables, members, pure, mapType, packed } = scope;
+  const comparable = (type) => COMPARABLE.test(mapType(type));
+
+  // Adds the operand a name refers to, or returns false if the rung can't compare it.
+  const operand = (name, rung) => {
+    if (/^%[IQM]/i.test(name)) {
+      addLine(name, rung.lines);
+      return true;
+    }
+    const parts = name.split('.');
+    const variable = variables.get(parts[0]);
+    if (!variable || variable.array || packed?.layout.has(parts[0])) return false;
+    if (variable.address) {
+      addLine(variable.address, rung.lines);
+      return true;
+    }
+    // A bit of a variable is compared as the variable.
+    if (parts.length === 1 || (parts.length === 2 && /^\d+$/.test(parts[1]))) {
+      if (!comparable(variable.type)) return false;
+      rung.values.add(parts[0]);
+      return true;
+    }
+    if (parts.length !== 2) return false;
+    // A member of a STRUCT or of a user function block must be of an elementary type, while the pins of the standard
+    // function blocks all are.
+    const declared = members.get(variable.type.trim().toUpperCase());
+    const member = declared?.find((m) => m.name.toUpperCase() === parts[1].toUpperCase());
+    if (declared && (!member || member.array || member.address || !comparable(member.type))) return false;
+    if (!declared && comparable(variable.type)) return false;
+    rung.values.add(convertExpression([name]));
+    return true;
+  };
+
+  // Adds the operands of an expression, or returns false if the rung can't be guarded.
+  const expression = (tokens, rung) => {
+    const list = Array.isArray(tokens) ? tokens : [tokens];
+    for (let i = 0; i < list.length; i++) {
+      const token = list[i];
+      if (typeof token !== 'string') return false;
+      const upper = token.toUpperCase();
+      if (token === '[' || token === '=>' || token.includes('^') || upper === 'ADR' || upper === 'REF') return false;
+      if (OPERATORS.has(upper)) rung.work++;
+      if (KEYWORDS.has(upper) || /^[\d'"]/.test(token) || token.includes('#')) continue;
+      if (/^%[IQM]/i.test(token)) {
+        if (!operand(token, rung)) return false;
+        continue;
+      }
+      if (!/^[A-Za-z_][\w.]*$/.test(token)) continue;
+      if (list[i + 1] === '(') {
+        // The standard functions and conversions are pure, and are the names standardFunction() renames.
+        if (!pure.has(upper) && standardFunction(token.toLowerCase()) === token.toLowerCase()) return false;
+        rung.work += 2;
+        continue;
+      }
+      // The name of a formal argument.
+      if (list[i + 1] === ':=') continue;
+      if (!operand(token, rung)) return false;
+    }
+    return true;
+  };
+
+  const statement = (stmt, rung) => {
+    rung.work++;
+    switch (stmt.type) {
+      case 'ASSIGN':
+        return typeof stmt.left === 'string' && !stmt.left.includes('[') && operand(stmt.left, rung) && expression(stmt.right, rung);
+      case 'IF':
+        return expression(stmt.condition, rung) && block(stmt.thenBlock, rung) &&
+          (stmt.elseIfBlocks ?? []).every((branch) => expression(branch.condition, rung) && block(branch.block, rung)) &&
+          block(stmt.elseBlock, rung);
+      default:
+        return false;
+    }
+  };
+  const block = (stmts, rung) => (stmts ?? []).every((stmt) => statement(stmt, rung));
+
+  const packedRuns = new Set();
+  packed?.runs.forEach((run, first) => {
+    for (let x = first; x < first + run.count; x++) packedRuns.add(x);
+  });
+  const rungs = new Map();
+  let current = null;
+  const close = () => {
+    if (current && current.work >= Math.max(RUNG_MIN_WORK, GUARD_WORK * (current.lines.size + current.values.size))) {
+      rungs.set(current.first, { count: current.count, lines: [...current.lines.values()], values: [...current.values] });
+    }
+    current = null;
+  };
+  statements.forEach((stmt, x) => {
+    const rung = { first: x, count: 1, work: 0, lines: new Map(), values: new Set() };
+    if (packedRuns.has(x) || !statement(stmt, rung)) {
+      close();
+      return;
+    }
+    const values = current ? new Set([...current.values, ...rung.values]) : rung.values;
+    if (current && current.count < RUNG_STATEMENTS && values.size <= RUNG_VALUES) {
+      current.count++;
+      current.work += rung.work;
+      rung.lines.forEach((line, key) => current.lines.set(key, line));
+      current.values = values;
+      return;
+    }
+    close();
+    if (rung.values.size <= RUNG_VALUES) current = rung;
+  });
+  close();
+  return rungs;
+}
+
+/**
+ * Wraps the code of a rung in its guard.
+ * @param {{lines: string[], values: string[]}} rung The rung, from planIncrementalRungs().
+ * @param {number} first The index of the first statement of the rung, which names its guard.
+ * @param {string[]} code The code of the statements of the rung.
+ * @returns {string[]} Returns the guarded code.
+ */
+export function guardRung(rung, first, code) {
+  const guard = `RUNG_${first}`;
+  const types = rung.values.map((value) => `std::decay_t<decltype(${value})>`).join(', ');
+  const values = rung.values.map((value) => `, ${value}`).join('');
+  return [
+    `static IncrementalRung<${types}> ${guard};`,
+    `if (${guard}.due({ ${rung.lines.join(', ')} }${values})) {`,
+    ...code.map((line) => `  ${line}`),
+    `  ${guard}.done(${rung.values.join(', ')});`,
+    '}'
+  ];
+}
@@ -0,0 +1,514 @@
+/* eslint-disable curly */
+/* eslint-disable eqeqeq */
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/**
+ * @description Structured Text Expression IR and Optimizer
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * Sits between parseStructuredText and the transpilers. Expressions are parsed into typed trees with their names
+ * resolved against the variables of the POU and the globals, optimized, and written back to the statements as tokens,
+ * so that the C++ and Javascript transpilers both emit the optimized program. The optimizer folds constants, removes
+ * branches whose condition is constant, hoists common subexpressions into TEMP statements and, when the backend
+ * asks for it, reads and writes located globals straight from their address.
+ */
+
+import { parseAddress } from './expressionConverter.js';
+
+/**
+ * The binary operators by precedence, lowest first.
+ */
+const BINARY_LEVELS = [['OR'], ['XOR'], ['AND', '&'], ['=', '<>'], ['<', '>', '<=', '>='], ['+', '-'], ['*', '/', 'MOD']];
+
+/**
+ * The ST types of the images of each address width, which a located variable must be declared as to be read
+ * straight from its address.
+ */
+const ADDRESS_TYPES = {
+  8: ['BYTE', 'USINT'], 16: ['WORD', 'UINT'], 32: ['DWORD', 'UDINT', 'TIME'],
+  64: ['LWORD', 'ULINT', 'LTIME', 'LDATE', 'LTIME_OF_DAY', 'LDATE_AND_TIME']
+};
+
+const REAL_TYPES = new Set(['REAL', 'LREAL', 'ANY_REAL']);
+
+/**
+ * Parses the tokens of an expression into a tree.
+ * @param {string[]} tokens The tokens of the expression.
+ * @returns {{kind: string}|null} Returns the tree, or null if the expression uses anything the IR doesn't model, such
+ * as named call arguments, in which case it is left as it was written.
+ */
+export function parseExpression(tokens) {
+  if (!Array.isArray(tokens) || tokens.length === 0) return null;
+  let pos = 0;
+  const peek = () => tokens[pos];
+  const upper = () => tokens[pos]?.toUpperCase();
+
+  const binary = (level) => {
+    if (level === BINARY_LEVELS.length) return unary();
+    let left = binary(level + 1);
+    while (left && BINARY_LEVELS[level].includes(upper())) {
+      const op = upper() === '&' ? 'AND' : upper();
+      pos++;
+      const right = binary(level + 1);
+      left = right ? { kind: 'binary', op, left, right } : null;
+    }
+    return left;
+  };
+  const unary = () => {
+    if (upper() === 'NOT' || peek() === '-') {
+      const op = upper() === 'NOT' ? 'NOT' : '-';
+      pos++;
+      const operand = unary();
+      return operand ? { kind: 'unary', op, operand } : null;
+    }
+    return primary();
+  };
+  const primary = () => {
+    const token = peek();
+    if (token === undefined) return null;
+    pos++;
+    if (token === '(') {
+      const inner = binary(0);
+      if (peek() !== ')') return null;
+      pos++;
+      return inner;
+    }
+    if (/^['"]/.test(token)) return { kind: 'string', text: token };
+    if (/^(TRUE|FALSE)$/i.test(token)) return { kind: 'literal', value: token.toUpperCase() === 'TRUE', type: 'BOOL' };
+    if (/^\d+$/.test(token)) return { kind: 'literal', value: Number(token), type: 'ANY_INT' };
+    if (/^\d+\.\d+(?:[eE][+\-]?\d+)?$/.test(token)) return { kind: 'literal', value: Number(token), type: 'ANY_REAL' };
+    if (/^%[IQM]/i.test(token)) return { kind: 'address', address: token };
+    if (!/^[A-Za-z_][\w.]*$/.test(token) || BINARY_LEVELS.flat().includes(token.toUpperCase())) return null;
+    if (peek() === '(') {
+      pos++;
+      const args = [];
+      while (peek() !== ')') {
+        const arg = binary(0);
+        if (!arg) return null;
+        args.push(arg);
+        if (peek() === ',') pos++;
+        else if (peek() !== ')') return null;
+      }
+      pos++;
+      return { kind: 'call', name: token, args };
+    }
+    if (peek() === '[') {
+      pos++;
+      const index = binary(0);
+      if (!index || peek() !== ']') return null;
+      pos++;
+      const member = peek()?.startsWith('.') ? tokens[pos++] : '';
+      return { kind: 'index', name: token, index, member };
+    }
+    return { kind: 'name', name: token };
+  };
+
+  const tree = binary(0);
+  return tree && pos === tokens.length ? tree : null;
+}
+
+/**
+ * Writes an expression tree back out as tokens, with every compound operand in parentheses.
+ * @param {{kind: string}} node The expression.
+ * @returns {string[]} Returns the tokens.
+ */
+export function expressionTokens(node) {
+  const operand = (child) => child.kind === 'binary' || child.kind === 'unary' || (child.kind === 'literal' && child.value < 0)
+    ? ['(', ...expressionTokens(child), ')'] : expressionTokens(child);
+  switch (node.kind) {
+    case 'literal':
+      if (typeof node.value === 'boolean') return [node.value ? 'TRUE' : 'FALSE'];
+      if (node.value < 0) return ['-', ...expressionTokens({ ...node, value: -node.value })];
+      return [REAL_TYPES.has(node.type) && Number.isInteger(node.value) ? node.value.toFixed(1) : String(node.value)];
+    case 'name':
+      return [node.name];
+    case 'address':
+      return [node.address];
+    case 'string':
+      return [node.text];
+    case 'unary':
+      return [node.op, ...operand(node.operand)];
+    case 'binary':
+      return [...operand(node.left), node.op, ...operand(node.right)];
+    case 'call':
+      return [node.name, '(', ...node.args.flatMap((arg, x) => x > 0 ? [',', ...expressionTokens(arg)] : expressionTokens(arg)), ')'];
+    case 'index':
+      return [node.name, '[', ...expressionTokens(node.index), ']', ...(node.member ? [node.member] : [])];
+  }
+  return [];
+}
+
+/**
+ * Works out the ST type of an expression, or undefined if it can't be known here, such as for a pin of a block.
+ * @param {{kind: string}} node The expression.
+ * @param {Object<string, string>} symbols The declared types of the variables in scope, by name.
+ * @returns {string|undefined} Returns the type. Untyped literals are ANY_INT or ANY_REAL.
+ */
+export function typeOf(node, symbols) {
+  switch (node.kind) {
+    case 'literal':
+      return node.type;
+    case 'name':
+      return symbols[node.name]?.trim().toUpperCase();
+    case 'address': {
+      const { width, bit } = parseAddress(node.address);
+      return bit > -1 ? 'BOOL' : ADDRESS_TYPES[width][0];
+    }
+    case 'string':
+      return node.text.startsWith('"') ? 'WSTRING' : 'STRING';
+    case 'unary':
+      return typeOf(node.operand, symbols);
+    case 'binary': {
+      if (['=', '<>', '<', '>', '<=', '>='].includes(node.op)) return 'BOOL';
+      const left = typeOf(node.left, symbols);
+      const right = typeOf(node.right, symbols);
+      if (left?.startsWith('ANY_')) return right ?? left;
+      return left ?? right;
+    }
+  }
+  return undefined;
+}
+
+/**
+ * Determines whether evaluating an expression has no effects and can be repeated or skipped, so it holds no calls.
+ * @param {{kind: string}} node The expression.
+ * @returns {boolean} Returns true if the expression is pure.
+ */
+function isPure(node) {
+  switch (node.kind) {
+    case 'call':
+      return false;
+    case 'unary':
+      return isPure(node.operand);
+    case 'binary':
+      return isPure(node.left) && isPure(node.right);
+    case 'index':
+      return isPure(node.index);
+  }
+  return true;
+}
+
+/**
+ * Folds an operator applied to literals into a literal.
+ * @param {string} op The operator.
+ * @param {{value: number|boolean, type: string}[]} args The literal operands.
+ * @returns {{kind: string, value: number|boolean, type: string}|null} Returns the literal, or null if the operation
+ * isn't folded, such as a division by zero or a result that the integer types of the target wouldn't hold.
+ */
+function foldLiterals(op, args) {
+  const [a, b] = args.map((arg) => arg.value);
+  const real = args.some((arg) => REAL_TYPES.has(arg.type));
+  const bools = args.every((arg) => typeof arg.value === 'boolean');
+  let value;
+  switch (op) {
+    case 'NOT': value = bools ? !a : null; break;
+    case '-': value = args.length === 1 ? -a : a - b; break;
+    case 'AND': value = bools ? a && b : null; break;
+    case 'OR': value = bools ? a || b : null; break;
+    case 'XOR': value = bools ? a !== b : null; break;
+    case '=': value = a === b; break;
+    case '<>': value = a !== b; break;
+    case '<': value = a < b; break;
+    case '>': value = a > b; break;
+    case '<=': value = a <= b; break;
+    case '>=': value = a >= b; break;
+    case '+': value = a + b; break;
+    case '*': value = a * b; break;
+    case '/': value = b === 0 ? null : real ? a / b : Math.trunc(a / b); break;
+    case 'MOD': value = b === 0 || real ? null : a % b; break;
+  }
+  if (value === null || value === undefined) return null;
+  if (typeof value === 'boolean') return { kind: 'literal', value, type: 'BOOL' };
+  if (bools || !Number.isFinite(value) || /e/i.test(String(value))) return null;
+  if (!real && (!Number.isInteger(value) || Math.abs(value) > 0x7fffffff)) return null;
+  return { kind: 'literal', value, type: real ? 'ANY_REAL' : 'ANY_INT' };
+}
+
+/**
+ * Folds the constant parts of an expression, and the BOOL identities such as X AND TRUE and NOT NOT X.
+ * @param {{kind: string}} node The expression.
+ * @param {Object<string, string>} symbols The declared types of the variables in scope, by name.
+ * @returns {{kind: string}} Returns the folded expression.
+ */
+export function foldExpression(node, symbols) {
+  const isBool = (n) => typeOf(n, symbols) === 'BOOL';
+  const isLiteral = (n, value) => n.kind === 'literal' && (value === undefined || n.value === value);
+  switch (node.kind) {
+    case 'unary': {
+      const operand = foldExpression(node.operand, symbols);
+      if (isLiteral(operand)) return foldLiterals(node.op, [operand]) ?? { ...node, operand };
+      if (node.op === 'NOT' && operand.kind === 'unary' && operand.op === 'NOT' && isBool(operand.operand)) return operand.operand;
+      return { ...node, operand };
+    }
+    case 'binary': {
+      const left = foldExpression(node.left, symbols);
+      const right = foldExpression(node.right, symbols);
+      if (isLiteral(left) && isLiteral(right)) {
+        const folded = foldLiterals(node.op, [left, right]);
+        if (folded) return folded;
+      }
+      for (const [constant, other] of [[left, right], [right, left]]) {
+        if (typeof constant.value !== 'boolean' || !isLiteral(constant) || !isBool(other)) continue;
+        if (node.op === 'AND') return constant.value ? other : (isPure(other) ? constant : { ...node, left, right });
+        if (node.op === 'OR') return constant.value ? (isPure(other) ? constant : { ...node, left, right }) : other;
+        if (node.op === 'XOR' && !constant.value) return other;
+      }
+      return { ...node, left, right };
+    }
+    case 'call':
+      return { ...node, args: node.args.map((arg) => foldExpression(arg, symbols)) };
+    case 'index':
+      return { ...node, index: foldExpression(node.index, symbols) };
+  }
+  return node;
+}
+
+/**
+ * Replaces the reads of located globals declared as the plain image type of their address with the address itself,
+ * so the backend reads the image directly instead of through a reference.
+ * @param {{kind: string}} node The expression.
+ * @param {Object<string, string>} located The addresses of the located globals that can be read directly, by name.
+ * @returns {{kind: string}} Returns the expression.
+ */
+function propagateAddresses(node, located) {
+  switch (node.kind) {
+    case 'name':
+      return located[node.name] ? { kind: 'address', address: located[node.name] } : node;
+    case 'unary':
+      return { ...node, operand: propagateAddresses(node.operand, located) };
+    case 'binary':
+      return { ...node, left: propagateAddresses(node.left, located), right: propagateAddresses(node.right, located) };
+    case 'call':
+      return { ...node, args: node.args.map((arg) => propagateAddresses(arg, located)) };
+    case 'index':
+      return { ...node, index: propagateAddresses(node.index, located) };
+  }
+  return node;
+}
+
+/**
+ * Hoists the compound subexpressions an expression computes more than once into temporaries, largest first.
+ * @param {{kind: string}} node The expression.
+ * @param {() => string} nextTemp Makes the name of a new temporary.
+ * @returns {{tree: {kind: string}, temps: {name: string, tree: {kind: string}}[]}} Returns the expression reading
+ * the temporaries, and the temporaries in the order they must be computed.
+ */
+function eliminateCommonSubexpressions(node, nextTemp) {
+  const temps = [];
+  const keyOf = (n) => expressionTokens(n).join(' ');
+  let tree = node;
+  for (;;) {
+    const counts = new Map();
+    const visit = (n) => {
+      if ((n.kind === 'binary' || n.kind === 'unary') && isPure(n)) {
+        const key = keyOf(n);
+        const entry = counts.get(key) ?? { node: n, count: 0, size: expressionTokens(n).length };
+        entry.count++;
+        counts.set(key, entry);
+      }
+      if (n.kind === 'unary') visit(n.operand);
+      if (n.kind === 'binary') { visit(n.left); visit(n.right); }
+      if (n.kind === 'call') n.args.forEach(visit);
+      if (n.kind === 'index') visit(n.index);
+    };
+    visit(tree);
+    const repeated = [...counts.values()].filter((entry) => entry.count > 1).sort((a, b) => b.size - a.size)[0];
+    if (!repeated) break;
+    const name = nextTemp();
+    const key = keyOf(repeated.node);
+    const replace = (n) => {
+      if (keyOf(n) === key) return { kind: 'name', name };
+      switch (n.kind) {
+        case 'unary': return { ...n, operand: replace(n.operand) };
+        case 'binary': return { ...n, left: replace(n.left), right: replace(n.right) };
+        case 'call': return { ...n, args: n.args.map(replace) };
+        case 'index': return { ...n, index: replace(n.index) };
+      }
+      return n;
+    };
+    // A temporary computed from an earlier one is hoisted after it, and one an earlier one is computed from before.
+    temps.forEach((temp) => temp.tree = replace(temp.tree));
+    temps.unshift({ name, tree: repeated.node });
+    tree = replace(tree);
+  }
+  return { tree, temps };
+}
+
+/**
+ * Optimizes the statements of a POU.
+ * @param {{type: string}[]} statements The statements.
+ * @param {{symbols: Object<string, string>, located: Object<string, string>, nextTemp: () => string}} scope The
+ * types of the variables in scope, the located globals to access by address and the namer of temporaries.
+ * @returns {{type: string}[]} Returns the optimized statements.
+ */
+function optimizeStatements(statements, scope) {
+  if (!statements) return statements;
+  const { symbols, located } = scope;
+  const optimizeTree = (tokens) => {
+    const tree = parseExpression(tokens);
+    return tree ? foldExpression(propagateAddresses(tree, located), symbols) : null;
+  };
+  const optimizeTokens = (tokens) => {
+    const tree = optimizeTree(tokens);
+    return tree ? expressionTokens(tree) : tokens;
+  };
+  // Hoists the common subexpressions of an expression evaluated once into TEMP statements ahead of the statement.
+  const hoist = (tokens, out) => {
+    const tree = optimizeTree(tokens);
+    if (!tree) return tokens;
+    const { tree: reduced, temps } = eliminateCommonSubexpressions(tree, scope.nextTemp);
+    temps.forEach((temp) => out.push({ type: 'TEMP', name: temp.name, right: expressionTokens(temp.tree) }));
+    return expressionTokens(reduced);
+  };
+  const constantOf = (tokens) => {
+    const tree = optimizeTree(tokens);
+    return tree?.kind === 'literal' && typeof tree.value === 'boolean' ? tree.value : undefined;
+  };
+
+  const out = [];
+  for (const stmt of statements) {
+    switch (stmt.type) {
+      case 'ASSIGN': {
+        const right = hoist(stmt.right, out);
+        out.push({ ...stmt, left: located[stmt.left] ?? stmt.left, right });
+        break;
+      }
+      case 'IF': {
+        // The branches are walked in order, dropping those that can never run and stopping at one that always does.
+        const branches = [{ condition: stmt.condition, block: stmt.thenBlock }, ...(stmt.elseIfBlocks ?? [])];
+        const kept = [];
+        let elseBlock = stmt.elseBlock;
+        for (const branch of branches) {
+          const constant = constantOf(branch.condition);
+          if (constant === false) continue;
+          if (constant === true) {
+            elseBlock = branch.block;
+            break;
+          }
+          kept.push(branch);
+        }
+        if (kept.length === 0) {
+          out.push(...(optimizeStatements(elseBlock, scope) ?? []));
+          break;
+        }
+        const [first, ...rest] = kept;
+        out.push({
+          ...stmt,
+          condition: hoist(first.condition, out),
+          thenBlock: optimizeStatements(first.block, scope),
+          elseIfBlocks: rest.map((branch) => ({ condition: optimizeTokens(branch.condition), block: optimizeStatements(branch.block, scope) })),
+          elseBlock: optimizeStatements(elseBlock, scope)
+        });
+        break;
+      }
+      case 'WHILE':
+        if (constantOf(stmt.condition) === false) break;
+        out.push({ ...stmt, condition: optimizeTokens(stmt.condition), body: optimizeStatements(stmt.body, scope) });
+        break;
+      case 'FOR': {
+        // The counter is read as a variable in the body even if it is located, since the loop counts in a copy of it.
+        const bodyLocated = { ...located };
+        delete bodyLocated[stmt.variable];
+        out.push({
+          ...stmt,
+          from: optimizeTokens(stmt.from),
+          to: optimizeTokens(stmt.to),
+          step: optimizeTokens(stmt.step),
+          body: optimizeStatements(stmt.body, { ...scope, located: bodyLocated })
+        });
+        break;
+      }
+      case 'REPEAT':
+        out.push({ ...stmt, ...(stmt.condition ? { condition: optimizeTokens(stmt.condition) } : {}), body: optimizeStatements(stmt.body, scope) });
+        break;
+      case 'CASE':
+        out.push({
+          ...stmt,
+          expression: hoist(stmt.expression, out),
+          branches: stmt.branches.map((branch) => ({ ...branch, body: optimizeStatements(branch.body, scope) })),
+          elseBlock: optimizeStatements(stmt.elseBlock, scope)
+        });
+        break;
+      case 'CALL':
+        if (stmt.inputs || stmt.outputs) {
+          out.push({
+            ...stmt,
+            inputs: stmt.inputs?.map((input) => ({ ...input, value: optimizeTokens(input.value) })),
+            outputs: stmt.outputs?.map((output) => ({ ...output, target: located[output.target] ?? output.target }))
+          });
+          break;
+        }
+        out.push(stmt.args?.length ? { ...stmt, args: optimizeTokens(stmt.args) } : stmt);
+        break;
+      case 'SFC':
+        out.push({
+          ...stmt,
+          transitions: stmt.transitions.map((transition) => ({ ...transition, condition: optimizeTokens(transition.condition) })),
+          actions: stmt.actions.map((action) => ({ ...action, body: optimizeStatements(action.body, scope) }))
+        });
+        break;
+      default:
+        out.push(stmt);
+    }
+  }
+  return out;
+}
+
+/**
+ * Optimizes a parsed program. The tree returned has the same shape as the one from parseStructuredText, and may hold
+ * TEMP statements, `{type: 'TEMP', name, right}`, which declare a temporary of the POU set to an expression.
+ * @param {{body: {type: string, name: string, variables: [], varSections: [], statements: []}[]}} ast The parsed program.
+ * @param {{addressReads: boolean}} options With addressReads, located globals of the plain image type of their address
+ * are read and written by address, for backends that resolve addresses at compile time.
+ * @returns {{body: []}} Returns the optimized program.
+ */
+export function optimize(ast, options = {}) {
+  const globals = ast.body.filter((block) => block.type === 'GlobalVars').flatMap((block) => block.variables);
+  const globalTypes = Object.fromEntries(globals.map((v) => [v.name, v.type]));
+  const globalLocated = {};
+  if (options.addressReads) {
+    globals.filter((v) => v.address && !v.array).forEach((v) => {
+      const address = v.address.startsWith('%') ? v.address : '%' + v.address;
+      const type = v.type.trim().toUpperCase();
+      try {
+        const { width, bit } = parseAddress(address);
+        if (bit > -1 ? type === 'BOOL' : ADDRESS_TYPES[width]?.includes(type)) {
+          globalLocated[v.name] = address;
+        }
+      } catch (e) {
+        // Left to the transpiler, which reports the address.
+      }
+    });
+  }
+
+  return {
+    ...ast,
+    body: ast.body.map((block) => {
+      if (!block.statements) return block;
+      const symbols = { ...globalTypes };
+      const located = { ...globalLocated };
+      block.varSections?.forEach((v) => {
+        symbols[v.name] = v.type;
+        delete located[v.name];
+      });
+      let temps = 0;
+      const nextTemp = () => `CSE_${temps++}`;
+      return { ...block, statements: optimizeStatements(block.statements, { symbols, located, nextTemp }) };
+    })
+  };
+}
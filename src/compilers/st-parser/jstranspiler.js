@@ -22,22 +22,39 @@
  * @copyright Apache 2.0
  */
 
-import { convertExpression, getWriteAddressExpression } from './expressionConverter.js';
+import { convertExpression, getWriteAddressExpression, getImageWriteExpression, standardFunction } from './expressionConverter.js';
 let fbVars = [];
-let refVars = [];
+/**
+ * The located variables in scope, by name, with their addresses, and those declared globally. They are the only
+ * variables that are references, so the only ones read through resolve().
+ */
+let located = new Map();
+let globalLocated = new Map();
+/**
+ * True to access located addresses straight through the process image of the Node.js runtime.
+ */
+let image = false;
 /**
  * Converts the tokenized ST code to Javascript.
  * @param {{body: {type: string, name: string, varSections: [], statements: []}}[]} ast The tokenized code.
+ * @param {{image?: boolean}} options image is true to read and write located addresses as elements of the typed arrays
+ * of the Node.js runtime's process image, rather than through its functions.
  * @returns {string} The transpiled code.
  */
-export function transpile(ast) {
+export function transpile(ast, options = {}) {
   const lines = [];
+  image = options.image === true;
+  located = new Map();
+  globalLocated = new Map();
 
   for (const block of ast.body) {
+    if (block.statements?.some((stmt) => stmt.type === 'SFC')) {
+      throw new Error(`${block.name}: sequential function charts are only supported by the C++ compiler`);
+    }
     switch (block.type) {
       case 'GlobalVars':
         lines.push('// Global variable declarations');
-        lines.push(...declareVars(block.variables));
+        lines.push(...declareVars(block.variables, false, "", true));
         break;
 
       case 'ProgramDeclaration':
@@ -47,19 +64,20 @@ export function transpile(ast) {
         lines.push('}');
         break;
 
-      case 'FunctionDeclaration':
+      case 'FunctionDeclaration': {
+        const start = lines.length;
+        const result = new RegExp(`^(\\s*)${block.name} =`);
         lines.push(`export function ${block.name}() { // FUNCTION:${block.name}`);
         lines.push(...declareVars(block.varSections, false, block.name));
         lines.push(...transpileStatements(block.statements));
 
-        for (let i = 0; i < lines.length; i++) {
-          if (lines[i].includes(`${block.name} =`)) {
-            lines[i] = lines[i].replace(`${block.name} =`, 'return');
-          }
+        for (let i = start; i < lines.length; i++) {
+          lines[i] = lines[i].replace(result, '$1return');
         }
 
         lines.push('}');
         break;
+      }
 
       case 'FunctionBlockDeclaration':
         lines.push(`export class ${block.name} { // FUNCTION_BLOCK:${block.name}`);
@@ -76,6 +94,16 @@ export function transpile(ast) {
   return lines.join('\n');
 }
 
+/**
+ * Converts an expression to Javascript in the current scope.
+ * @param {Array | string} expr The expression.
+ * @param {boolean} infb True if the expression is in a function block.
+ * @returns {string} Returns the converted expression.
+ */
+function jsExpression(expr, infb) {
+  return convertExpression(expr, infb, fbVars, true, located, image);
+}
+
 /**
  * Converts a single statement to Javascript
  * @param {{type: string, left: string, right: string, condition:string[], elseIfBlocks: [], elseBlock: [], body: []}} stmt The tokenized statement to convert.
@@ -91,10 +119,14 @@ function mapStatement(stmt, infb = false) {
             left = "this." + left;
         }
             
-        const rightExpr = convertExpression(stmt.right, infb, fbVars, true);
+        const rightExpr = jsExpression(stmt.right, infb);
+        const writeAddress = image ? getImageWriteExpression : getWriteAddressExpression;
 
         if (isIOAddress(left)) {
-          return getWriteAddressExpression(left, rightExpr) + ";";
+          return writeAddress(left, rightExpr) + ";";
+        } else if (located.has(stmt.left)) {
+          // A located variable is written through to its address, rather than replacing its reference.
+          return writeAddress(located.get(stmt.left), rightExpr) + ";";
         } else if (isBitSelector(left)) {
           const [varName, bitIndex] = left.split('.');
           return `setBit(${varName}, ${bitIndex}, ${rightExpr});`;
@@ -103,8 +135,11 @@ function mapStatement(stmt, infb = false) {
         return `${left} = ${rightExpr};`;
       }
 
+      case 'TEMP':
+        return [`const ${stmt.name} = ${jsExpression(stmt.right, infb)};`];
+
       case 'IF': {
-        const cond = convertExpression(stmt.condition, infb, fbVars,true);
+        const cond = jsExpression(stmt.condition, infb);
         const lines = [];
 
         lines.push(`if (${cond}) {`);
@@ -113,7 +148,7 @@ function mapStatement(stmt, infb = false) {
 
         if (stmt.elseIfBlocks?.length) {
           for (const elif of stmt.elseIfBlocks) {
-            const elifCond = convertExpression(elif.condition, infb, fbVars,true);
+            const elifCond = jsExpression(elif.condition, infb);
             lines.push(`else if (${elifCond}) {`);
             lines.push(...transpileStatements(elif.block, infb).map(s => `  ${s}`));
             lines.push('}');
@@ -130,7 +165,7 @@ function mapStatement(stmt, infb = false) {
       }
 
       case 'WHILE': {
-        const cond = convertExpression(stmt.condition, infb, fbVars,true);
+        const cond = jsExpression(stmt.condition, infb);
         return [
           `while (${cond}) {`,
           ...transpileStatements(stmt.body, infb).map(s => `  ${s}`),
@@ -138,15 +173,21 @@ function mapStatement(stmt, infb = false) {
         ];
       }
 
-      case 'FOR':
+      case 'FOR': {
+        // The end and step are evaluated once, and the sign of the step gives the direction of the test.
+        const v = stmt.variable;
+        const from = jsExpression(stmt.from, infb);
+        const to = jsExpression(stmt.to, infb);
+        const step = jsExpression(stmt.step, infb);
         return [
-          `for (let ${stmt.variable} = ${stmt.from}; ${stmt.variable} <= ${stmt.to}; ${stmt.variable} += ${stmt.step}) {`,
+          `for (let ${v} = ${from}, FOR_${v}_END = ${to}, FOR_${v}_STEP = ${step}; FOR_${v}_STEP >= 0 ? ${v} <= FOR_${v}_END : ${v} >= FOR_${v}_END; ${v} += FOR_${v}_STEP) {`,
           ...transpileStatements(stmt.body, infb).map(s => `  ${s}`),
           `}`
         ];
+      }
 
       case 'REPEAT': {
-        const cond = convertExpression(stmt.condition, infb, fbVars,true);
+        const cond = jsExpression(stmt.condition, infb);
         return [
           `do {`,
           ...transpileStatements(stmt.body, infb).map(s => `  ${s}`),
@@ -155,10 +196,19 @@ function mapStatement(stmt, infb = false) {
       }
 
       case 'CALL': {
+        // A call with formal parameters sets the inputs of the instance, calls it, then copies out its outputs.
+        if (stmt.inputs || stmt.outputs) {
+          const ext = infb && fbVars.includes(stmt.name.split('[')[0]) ? "this." : "";
+          return [
+            ...(stmt.inputs ?? []).flatMap((input) => mapStatement({ type: 'ASSIGN', left: `${stmt.name}.${input.name}`, right: input.value }, infb)),
+            `${ext}${stmt.name}.call();`,
+            ...(stmt.outputs ?? []).flatMap((output) => mapStatement({ type: 'ASSIGN', left: output.target, right: [`${stmt.name}.${output.name}`] }, infb))
+          ];
+        }
         // If args exist, it's a normal function call: Foo(a, b);
         if (stmt.args && stmt.args.length) {
-          const argsExpr = convertExpression(stmt.args, infb, fbVars, true);
-          return [`${stmt.name}(${argsExpr});`];
+          const argsExpr = jsExpression(stmt.args, infb);
+          return [`${standardFunction(stmt.name)}(${argsExpr});`];
         }
 
       // Otherwise treat as FB instance call: FB1();
@@ -189,25 +239,32 @@ function transpileStatements(statements, infb=false) {
  * @param {{type: string, address: string, initialValue: string, sectionType: string}[]} varSections An array of variable tokens.
  * @returns {string[]} An array of declaration statements.
  */
-function declareVars(varSections, infb = false, blockName = "") {
+function declareVars(varSections, infb = false, blockName = "", global = false) {
   if(infb){
     fbVars = [];
   }
+  if(!global){
+    located = new Map(globalLocated);
+  }
   return varSections.map(v => {
     const isFunctionBlock = !mapType(v.type) || mapType(v.type) === 'any';
     const decl = infb ? "this." : "let ";
     if(infb) fbVars.push(v.name);
     if (v.address) {
       const addr = v.address.startsWith('%') ? v.address : '%' + v.address;
-      refVars.push(v.name);
+      located.set(v.name, addr);
+      if(global) globalLocated.set(v.name, addr);
       return `${decl}${v.name} = createReference("${addr}");`;
     }
+    located.delete(v.name);
 
     const fullVarName = blockName ? `${blockName}.${v.name}` : v.name;
 
+    // A variable starts with a value of its type, so each local and field keeps one type, and each function block
+    // one shape, for V8 to optimize its accesses for.
     const initValue = (v.initialValue !== undefined && v.initialValue !== null)
       ? ` = ${v.initialValue}`
-      : isFunctionBlock ? ` = newStatic("${fullVarName}", ${v.type})` : infb ? " = null" : "";
+      : isFunctionBlock ? ` = newStatic("${fullVarName}", ${v.type})` : ` = ${defaultValue(v.type)}`;
 
     return `${decl}${v.name}${initValue};`;
   });
@@ -231,6 +288,19 @@ function isBitSelector(expr) {
   return typeof expr === 'string' && /^[A-Za-z_]\w*\.\d+$/.test(expr);
 }
 
+/**
+ * Gets the initial value of a variable of an elementary type that doesn't declare one.
+ * @param {string} type The type of the variable.
+ * @returns {string} Returns the Javascript literal of the value.
+ */
+function defaultValue(type) {
+  switch (mapType(type)) {
+    case 'boolean': return 'false';
+    case 'string': return '""';
+    default: return '0';
+  }
+}
+
 function mapType(type) {
   const jsTypes = {
     'BOOL': 'boolean',
@@ -252,6 +322,12 @@ function mapType(type) {
     'DATE': 'string',
     'TIME_OF_DAY': 'string',
     'DATE_AND_TIME': 'string',
+    'LTIME': 'number',
+    'LDATE': 'number',
+    'LTIME_OF_DAY': 'number',
+    'LTOD': 'number',
+    'LDATE_AND_TIME': 'number',
+    'LDT': 'number',
     'STRING': 'string',
     'WSTRING': 'string'
   };
@@ -0,0 +1,148 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Parallel ANSI CPP Transpiler
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+
+import fs from 'fs';
+import os from 'os';
+import path from 'path';
+import crypto from 'crypto';
+import { Worker, isMainThread, parentPort, workerData } from 'worker_threads';
+import { transpile, transpileContext } from './gcctranspiler.js';
+
+/**
+ * The POUs each worker should have to generate before it is worth starting one, since a worker costs tens of
+ * milliseconds to start and to be sent the code.
+ */
+const POUS_PER_WORKER = 32;
+
+/**
+ * The kinds of declaration that are POUs, whose code is generated apart from the rest.
+ */
+const POU_TYPES = new Set(['ProgramDeclaration', 'FunctionDeclaration', 'FunctionBlockDeclaration']);
+
+/**
+ * The sources of the transpiler, which are part of the key of the code it cached, so that code generated by another
+ * version isn't reused.
+ */
+const TRANSPILER_SOURCES = ['gcctranspiler.js', 'expressionConverter.js', 'bitslice.js', 'incremental.js'];
+let transpilerVersion = null;
+
+// A worker generates the POUs it was given and sends their parts back.
+if (!isMainThread && workerData?.transpileOnly) {
+  parentPort.postMessage(transpile(workerData.ast, { ...workerData.options, only: new Set(workerData.transpileOnly) }));
+}
+
+function digest(...parts) {
+  const hash = crypto.createHash('sha256');
+  parts.forEach((part) => hash.update(part));
+  return hash.digest('hex');
+}
+
+function stringify(value) {
+  return JSON.stringify(value, (key, item) => typeof item === 'bigint' ? `${item}n` : item);
+}
+
+function readCached(cacheDir, key) {
+  if (!cacheDir) return null;
+  try {
+    return JSON.parse(fs.readFileSync(path.join(cacheDir, `${key}.json`), 'utf-8'));
+  }
+  catch {
+    return null;
+  }
+}
+
+function writeCached(cacheDir, key, part) {
+  if (!cacheDir) return;
+  // The part is written under a name of its own and moved into place, so a build reading it never sees half of it.
+  const file = path.join(cacheDir, `${key}.json`);
+  const partial = `${file}.${process.pid}.${crypto.randomBytes(4).toString('hex')}`;
+  try {
+    fs.mkdirSync(cacheDir, { recursive: true });
+    fs.writeFileSync(partial, JSON.stringify(part));
+    fs.renameSync(partial, file);
+  }
+  catch {
+    fs.rmSync(partial, { force: true });
+  }
+}
+
+/**
+ * Generates POUs on worker threads, sharing them out by size so that the workers finish together.
+ * @returns {Promise<object>} Resolves to the parts of the POUs by name.
+ */
+async function generateInWorkers(ast, options, pous, sizes, jobs) {
+  const shares = Array.from({ length: jobs }, () => ({ names: [], size: 0 }));
+  [...pous].sort((a, b) => sizes.get(b.name) - sizes.get(a.name)).forEach((block) => {
+    const share = shares.reduce((least, s) => s.size < least.size ? s : least);
+    share.names.push(block.name);
+    share.size += sizes.get(block.name);
+  });
+  const results = await Promise.all(shares.filter((share) => share.names.length > 0).map((share) => new Promise((resolve, reject) => {
+    const worker = new Worker(new URL(import.meta.url), { workerData: { ast, options, transpileOnly: share.names } });
+    worker.once('message', resolve);
+    worker.once('error', reject);
+    worker.once('exit', (code) => code !== 0 && reject(new Error(`A transpiler worker stopped with exit code ${code}.`)));
+  })));
+  return Object.assign({}, ...results);
+}
+
+/**
+ * Transpiles like transpile(), generating the POUs on worker threads and reusing the code of the POUs that haven't
+ * changed. The code of a POU is cached by a hash of the POU, of everything else it depends on (see
+ * transpileContext()) and of the transpiler's sources. The POUs that aren't cached are shared out between up to jobs
+ * workers, when there are enough of them to be worth it, and the code is assembled in the order the POUs were
+ * written, so the output is the same however it was generated.
+ * @param {{body: {type: string, name: string}[]}} ast The tokenized code.
+ * @param {object} options The options of transpile().
+ * @param {{jobs: number, cacheDir: string}} build The most workers to start, which defaults to the number of cores, and
+ * the directory the code of the POUs is cached in, if any.
+ * @returns {Promise<string|{header: string[], definitions: string[], units: {name: string, code: string[]}[]}>}
+ * Resolves to the transpiled code, as transpile() returns it.
+ */
+export async function transpileParallel(ast, options = {}, build = {}) {
+  if (transpilerVersion === null) {
+    transpilerVersion = digest(...TRANSPILER_SOURCES.map((file) => fs.readFileSync(new URL(file, import.meta.url))));
+  }
+  const pous = ast.body.filter((block) => POU_TYPES.has(block.type));
+  const context = digest(transpilerVersion, transpileContext(ast, options));
+  const keys = new Map();
+  const sizes = new Map();
+  const generated = new Map();
+  pous.forEach((block) => {
+    const text = stringify(block);
+    keys.set(block.name, digest(context, text));
+    sizes.set(block.name, text.length);
+    const cached = readCached(build.cacheDir, keys.get(block.name));
+    if (cached) generated.set(block.name, cached);
+  });
+  const missing = pous.filter((block) => !generated.has(block.name));
+  if (missing.length > 0) {
+    const cores = os.availableParallelism?.() ?? os.cpus().length;
+    const jobs = Math.min(build.jobs ?? cores, Math.floor(missing.length / POUS_PER_WORKER));
+    const parts = jobs > 1 ? await generateInWorkers(ast, options, missing, sizes, jobs) :
+      transpile(ast, { ...options, only: new Set(missing.map((block) => block.name)) });
+    Object.entries(parts).forEach(([name, part]) => {
+      generated.set(name, part);
+      writeCached(build.cacheDir, keys.get(name), part);
+    });
+  }
+  return transpile(ast, { ...options, generated });
+}
@@ -22,9 +22,35 @@
  * @copyright Apache 2.0
  */
 
-import { tokenize } from './tokenizer.js';
+import { tokenize, Keyword, isVarSection } from './tokenizer.js';
 import {mapType} from "./gcctranspiler.js";
 
+/**
+ * The qualifiers of the actions of a chart step. P1 is read as P.
+ */
+const SFC_QUALIFIERS = ['N', 'S', 'R', 'P', 'P1', 'P0', 'L', 'D'];
+
+/**
+ * Converts the duration of an action association to milliseconds. The tokenizer folds a literal like T#1m30s to its
+ * milliseconds, and an LTIME one to its nanoseconds, which the association converts; a duration written without the #,
+ * as T1m30s, is read from its joined tokens. A plain number is a number of milliseconds.
+ * @param {string} text The joined tokens of the duration, or an empty string for none.
+ * @returns {number} Returns the milliseconds.
+ */
+function parseDuration(text) {
+  if (text === '') return 0;
+  if (/^\d+$/.test(text)) return Number(text);
+  const units = { d: 86400000, h: 3600000, m: 60000, s: 1000, ms: 1 };
+  const body = text.replace(/^(TIME|T)(?=\d)/i, '');
+  let ms = 0;
+  const rest = body.replace(/(\d+(?:\.\d+)?)(ms|d|h|m|s)/gi, (_, value, unit) => {
+    ms += Number(value) * units[unit.toLowerCase()];
+    return '';
+  });
+  if (rest !== '' || body === '') throw new Error(`Invalid duration '${text}'`);
+  return Math.round(ms);
+}
+
 /**
  * Parses a block of structured text code and divides it into statement objects that can then be transpiled.
  * @param {string} code A block of Structured Text Code
@@ -33,6 +59,8 @@ import {mapType} from "./gcctranspiler.js";
 export function parseStructuredText(code) {
   const tokens = tokenize(code);
   let position = 0;
+  // The STRUCT types and aliases declared in TYPE sections, which are data rather than function blocks.
+  const dataTypes = new Set();
 
   function peek(offset = 0) {
     return tokens[position + offset];
@@ -42,10 +70,35 @@ export function parseStructuredText(code) {
     return tokens[position++];
   }
 
+  /**
+   * Determines whether a token ahead is a keyword, by its interned ID.
+   * @param {number} id The ID of the keyword, from Keyword.
+   * @param {number} offset How far ahead the token is.
+   * @returns {boolean} Returns true if the token is the keyword.
+   */
+  function is(id, offset = 0) {
+    return tokens[position + offset]?.id === id;
+  }
+
+  /**
+   * Describes where a token is, for error messages.
+   * @param {{line: number, column: number}?} token The token, or undefined at the end of the code.
+   * @returns {string} Returns the line and column of the token.
+   */
+  function where(token) {
+    return token ? ` at line ${token.line}, column ${token.column}` : ' at the end of the code';
+  }
+
+  /**
+   * Consumes a keyword or symbol that must come next.
+   * @param {string} value The keyword, in upper case, or the symbol.
+   * @returns {{type: string, value: string}} Returns the token.
+   */
   function expect(value) {
     const token = consume();
-    if (!token || token.value.toUpperCase() !== value.toUpperCase()) {
-      throw new Error(`Expected '${value}', but got '${token?.value}'`);
+    const id = Keyword[value];
+    if (!token || (id ? token.id !== id : token.value !== value)) {
+      throw new Error(`Expected '${value}', but got '${token?.value}'${where(token)}`);
     }
     return token;
   }
@@ -54,15 +107,17 @@ export function parseStructuredText(code) {
     const token = peek();
     if (!token) return null;
 
-    switch (token.value.toUpperCase()) {
-      case 'PROGRAM':
+    switch (token.id) {
+      case Keyword.PROGRAM:
         return parseProgram();
-      case 'FUNCTION':
+      case Keyword.FUNCTION:
         return parseFunction();
-      case 'FUNCTION_BLOCK':
+      case Keyword.FUNCTION_BLOCK:
         return parseFunctionBlock();
-      case 'VAR_GLOBAL':
+      case Keyword.VAR_GLOBAL:
         return parseGlobalVarSection();
+      case Keyword.TYPE:
+        return parseTypeDeclarations();
       default:
         consume();
         return null;
@@ -72,29 +127,34 @@ export function parseStructuredText(code) {
   function parseGlobalVarSection() {
     expect('VAR_GLOBAL');
     const variables = [];
+    let retain = false;
+    if (is(Keyword.RETAIN) || is(Keyword.PERSISTENT)) {
+      consume();
+      retain = true;
+    }
 
-    while (peek() && peek().value.toUpperCase() !== 'END_VAR') {
+    while (peek() && !is(Keyword.END_VAR)) {
       const name = consume().value;
       let address = null;
       let token = peek();
-      if (peek()?.value.toUpperCase?.() === 'AT') {
+      if (is(Keyword.AT)) {
         consume(); // skip 'AT'
         const addrToken = consume();
         if (addrToken?.type === 'ADDRESS' || addrToken?.type === 'IDENTIFIER') {
           address = addrToken.value;
         } else {
-          throw new Error(`Expected address after AT, got '${addrToken?.value}'`);
+          throw new Error(`Expected address after AT, got '${addrToken?.value}'${where(addrToken)}`);
         }
       }
       expect(':');
-      const type = consume().value;
+      const { type, array } = parseType();
       let initialValue = null;
 
       if (peek()?.value === ':=') {
         consume(); // consume ':='
         initialValue = consume().value;
       }
-      variables.push({ name, type, address, initialValue, sectionType: 'VAR_GLOBAL' });
+      variables.push({ name, type, address, initialValue, sectionType: 'VAR_GLOBAL', retain, ...(array ? { array } : {}) });
       if (peek()?.value === ';') consume();
     }
 
@@ -103,30 +163,302 @@ export function parseStructuredText(code) {
   }
 
 
+  /**
+   * Parses the type of a declaration, which is a type name, a string with its length or an ARRAY of one or more
+   * dimensions of a type. An array of arrays is flattened into one array of all of their dimensions.
+   * @returns {{type: string, array?: {low: number, high: number, of: string, dimensions: {low: number, high: number}[]}}}
+   * The type, with the bounds of the first dimension, every dimension and the element type of an array.
+   */
+  function parseType() {
+    const token = consume();
+    const type = token.value;
+    // A string's length is part of its type, as STRING[20] or STRING(20).
+    if (/^W?STRING$/i.test(type) && (peek()?.value === '[' || peek()?.value === '(')) {
+      consume();
+      const length = consume().value;
+      consume();
+      return { type: `${type}[${length}]` };
+    }
+    if (token.id !== Keyword.ARRAY) {
+      return { type };
+    }
+    const bound = () => {
+      const sign = peek()?.value === '-' ? (consume(), -1) : 1;
+      return sign * parseInt(consume().value, 10);
+    };
+    const dimensions = [];
+    expect('[');
+    do {
+      const low = bound();
+      expect('..');
+      const high = bound();
+      dimensions.push({ low, high });
+    } while (peek()?.value === ',' && consume());
+    expect(']');
+    expect('OF');
+    const element = parseType();
+    const of = element.array ? element.array.of : element.type;
+    if (dimensions.some(({ low, high }) => isNaN(low) || isNaN(high) || high < low)) {
+      throw new Error(`Invalid array bounds for ARRAY OF ${of}${where(token)}`);
+    }
+    if (element.array) dimensions.push(...element.array.dimensions);
+    return { type: 'ARRAY', array: { low: dimensions[0].low, high: dimensions[0].high, of, dimensions } };
+  }
+
+  /**
+   * Parses a TYPE section of STRUCT types and aliases of other types. Enumerations aren't supported.
+   * @returns {{type: string, types: {name: string, members?: [], alias?: {type: string, array?: {}}}[]}} The declared types.
+   */
+  function parseTypeDeclarations() {
+    expect('TYPE');
+    const types = [];
+    while (peek() && !is(Keyword.END_TYPE)) {
+      const nameToken = consume();
+      const name = nameToken.value;
+      expect(':');
+      if (peek()?.value === '(') {
+        throw new Error(`Type ${name}: enumerated types are not supported${where(nameToken)}`);
+      }
+      if (is(Keyword.STRUCT)) {
+        consume();
+        const members = [];
+        while (peek() && !is(Keyword.END_STRUCT)) {
+          const member = consume().value;
+          expect(':');
+          const { type, array } = parseType();
+          let initialValue = null;
+          if (peek()?.value === ':=') {
+            consume();
+            initialValue = consume().value;
+          }
+          members.push({ name: member, type, initialValue, sectionType: 'VAR', ...(array ? { array } : {}) });
+          if (peek()?.value === ';') consume();
+        }
+        expect('END_STRUCT');
+        types.push({ name, members });
+      }
+      else {
+        types.push({ name, alias: parseType() });
+      }
+      dataTypes.add(name.toUpperCase());
+      if (peek()?.value === ';') consume();
+    }
+    expect('END_TYPE');
+    return { type: 'TypeDeclaration', types };
+  }
+
+  /**
+   * Determines whether a variable is an instance of a function block, or an array of them, which its POU calls after
+   * its own statements.
+   * @param {{type: string, array?: {of: string}}} v The variable.
+   * @returns {boolean} Returns true for a function block instance.
+   */
+  function isFunctionBlockInstance(v) {
+    const type = v.array ? v.array.of : v.type;
+    return mapType(type) === "auto" && !dataTypes.has(type.trim().toUpperCase());
+  }
+
+  /**
+   * Lists the function block instances a POU calls itself, anywhere in its statements, which aren't called again after
+   * them. An array of instances is called by the POU if any of its elements is.
+   * @param {{type: string, name: string}[]} statements The statements of the POU.
+   * @param {Set<string>} called The names found so far.
+   * @returns {Set<string>} Returns the names of the called instances.
+   */
+  function calledInstances(statements, called = new Set()) {
+    statements?.forEach((stmt) => {
+      if (stmt.type === 'CALL') called.add(stmt.name.split('[')[0]);
+      [stmt.thenBlock, stmt.elseBlock, stmt.body, ...(stmt.elseIfBlocks ?? []).map((b) => b.block),
+        ...(stmt.branches ?? []).map((b) => b.body), ...(stmt.actions ?? []).map((a) => a.body)]
+        .forEach((block) => calledInstances(block, called));
+    });
+    return called;
+  }
+
   function parseVarSection() {
     const variables = [];
     const sectionType = consume().value.toUpperCase();
 
-    while (peek() && peek().value.toUpperCase() !== 'END_VAR') {
+    while (peek() && !is(Keyword.END_VAR)) {
       const name = consume().value;
       expect(':');
-      const type = consume().value;
+      const { type, array } = parseType();
       let initialValue = null;
 
       if (peek()?.value === ':=') {
         consume(); // consume ':='
         initialValue = consume().value;
       }
-      variables.push({ name, type, initialValue, sectionType });
+      variables.push({ name, type, initialValue, sectionType, ...(array ? { array } : {}) });
       if (peek()?.value === ';') consume();
     }
     expect('END_VAR');
     return variables;
   }
 
+  /**
+   * Reads the body of a program or function block. Besides statements, the body can hold a sequential function
+   * chart, written as its steps, transitions and actions, which is collected into one SFC statement after the other
+   * statements. The chart's keywords are read by their spelling, so STEP, ACTION and the others can still name
+   * variables.
+   * @param {number} until The keyword ID that ends the body.
+   * @returns {{type: string}[]} Returns the statements.
+   */
+  function parseBody(until) {
+    const statements = [];
+    const chart = { type: 'SFC', steps: [], transitions: [], actions: [] };
+    while (peek() && !is(until)) {
+      const element = chartElement();
+      if (element === 'INITIAL_STEP' || element === 'STEP') chart.steps.push(parseStep());
+      else if (element === 'TRANSITION') chart.transitions.push(parseTransition());
+      else if (element === 'ACTION') chart.actions.push(parseAction());
+      else {
+        const stmt = parseStatement();
+        if (stmt) statements.push(stmt);
+      }
+    }
+    if (chart.steps.length || chart.transitions.length || chart.actions.length) {
+      statements.push(checkChart(chart));
+    }
+    return statements;
+  }
+
+  /**
+   * Gets the chart element that starts at the next token.
+   * @returns {string|null} Returns INITIAL_STEP, STEP, TRANSITION or ACTION, or null if a statement is ahead.
+   */
+  function chartElement() {
+    const word = peek()?.value.toUpperCase();
+    if (word === 'INITIAL_STEP') return word;
+    if ((word === 'STEP' || word === 'ACTION') && peek(1)?.type === 'IDENTIFIER' && peek(2)?.value === ':') return word;
+    if (word === 'TRANSITION' && (peek(1)?.value.toUpperCase() === 'FROM' || peek(2)?.value.toUpperCase() === 'FROM')) return word;
+    return null;
+  }
+
+  /**
+   * Consumes a word of a chart, which isn't a keyword of the tokenizer, in any case.
+   * @param {string} word The word, in upper case.
+   */
+  function expectWord(word) {
+    const token = consume();
+    if (token?.value.toUpperCase() !== word) {
+      throw new Error(`Expected '${word}', but got '${token?.value}'${where(token)}`);
+    }
+    if (peek()?.value === ';' && word.startsWith('END_')) consume();
+  }
+
+  /**
+   * Reads a step, `STEP Fill: Valve(N); Alarm(D, T#5s); END_STEP`, with the actions associated with it.
+   * @returns {{name: string, initial: boolean, associations: {action: string, qualifier: string, duration: number}[]}}
+   * Returns the step.
+   */
+  function parseStep() {
+    const initial = consume().value.toUpperCase() === 'INITIAL_STEP';
+    const name = consume().value;
+    expect(':');
+    const associations = [];
+    while (peek() && peek().value.toUpperCase() !== 'END_STEP') {
+      const action = consume();
+      expect('(');
+      const qualifier = consume()?.value.toUpperCase();
+      const duration = [];
+      if (peek()?.value === ',') {
+        consume();
+        while (peek() && peek().value !== ')') {
+          const token = consume();
+          duration.push(token.literal === 'LTIME' ? String(BigInt(token.value) / 1000000n) : token.value);
+        }
+      }
+      expect(')');
+      if (peek()?.value === ';') consume();
+      if (!SFC_QUALIFIERS.includes(qualifier)) {
+        throw new Error(`Step ${name}: unknown qualifier '${qualifier}' of action ${action.value}${where(action)}`);
+      }
+      if ((qualifier === 'L' || qualifier === 'D') && duration.length === 0) {
+        throw new Error(`Step ${name}: the ${qualifier} qualifier of action ${action.value} needs a duration${where(action)}`);
+      }
+      associations.push({ action: action.value, qualifier: qualifier === 'P1' ? 'P' : qualifier, duration: parseDuration(duration.join('')) });
+    }
+    expectWord('END_STEP');
+    return { name, initial, associations };
+  }
+
+  /**
+   * Reads a transition, `TRANSITION FROM Fill TO (Heat, Mix) := Level > 80; END_TRANSITION`, which may be named.
+   * @returns {{name: string|null, from: string[], to: string[], condition: string[]}} Returns the transition.
+   */
+  function parseTransition() {
+    consume(); // TRANSITION
+    const name = peek()?.value.toUpperCase() === 'FROM' ? null : consume().value;
+    expectWord('FROM');
+    const from = parseStepList();
+    expect('TO');
+    const to = parseStepList();
+    expect(':=');
+    const condition = [];
+    while (peek() && peek().value !== ';') condition.push(consume().value);
+    if (peek()?.value === ';') consume();
+    expectWord('END_TRANSITION');
+    return { name, from, to, condition };
+  }
+
+  /**
+   * Reads the steps a transition leaves or leads to: one step, or several in parentheses.
+   * @returns {string[]} Returns the names of the steps.
+   */
+  function parseStepList() {
+    if (peek()?.value !== '(') return [consume().value];
+    consume();
+    const steps = [];
+    while (peek() && peek().value !== ')') {
+      const token = consume();
+      if (token.value !== ',') steps.push(token.value);
+    }
+    expect(')');
+    return steps;
+  }
+
+  /**
+   * Reads an action, `ACTION Fill: ... END_ACTION`, with the statements it runs.
+   * @returns {{name: string, body: {type: string}[]}} Returns the action.
+   */
+  function parseAction() {
+    consume(); // ACTION
+    const name = consume().value;
+    expect(':');
+    const body = [];
+    while (peek() && peek().value.toUpperCase() !== 'END_ACTION') {
+      const stmt = parseStatement();
+      if (stmt) body.push(stmt);
+    }
+    expectWord('END_ACTION');
+    return { name, body };
+  }
+
+  /**
+   * Checks that a chart has one initial step, that its names are unique and that its transitions link its steps.
+   * @param {{steps: [], transitions: [], actions: []}} chart The chart.
+   * @returns {{type: string}} Returns the chart.
+   */
+  function checkChart(chart) {
+    const steps = new Set();
+    chart.steps.forEach((step) => {
+      if (steps.has(step.name.toUpperCase())) throw new Error(`Step ${step.name} is declared more than once`);
+      steps.add(step.name.toUpperCase());
+    });
+    const initial = chart.steps.filter((step) => step.initial);
+    if (initial.length !== 1) {
+      throw new Error(`A chart must have one INITIAL_STEP, but has ${initial.length}`);
+    }
+    chart.transitions.forEach((transition) => [...transition.from, ...transition.to].forEach((step) => {
+      if (!steps.has(step.toUpperCase())) throw new Error(`Transition ${transition.name ?? `from ${transition.from.join(', ')}`}: unknown step ${step}`);
+    }));
+    return chart;
+  }
+
   function parseStatements(until) {
     const statements = [];
-    while (peek() && peek().value.toUpperCase() !== until) {
+    while (peek() && !is(until)) {
       const stmt = parseStatement();
       if (stmt) statements.push(stmt);
     }
@@ -137,16 +469,16 @@ function parseStatement() {
   const token = peek();
   if (!token) return null;
 
-  if (token.value.toUpperCase() === 'IF') return parseIf();
-  if (token.value.toUpperCase() === 'WHILE') return parseWhile();
-  if (token.value.toUpperCase() === 'FOR') return parseFor();
-  if (token.value.toUpperCase() === 'REPEAT') return parseRepeat();
-  if (token.value.toUpperCase() === 'CASE') return parseCase();
+  if (token.id === Keyword.IF) return parseIf();
+  if (token.id === Keyword.WHILE) return parseWhile();
+  if (token.id === Keyword.FOR) return parseFor();
+  if (token.id === Keyword.REPEAT) return parseRepeat();
+  if (token.id === Keyword.CASE) return parseCase();
 
   // Assignment: x := y;
   const lhsTokens = [];
 let i = 0;
-while (peek(i) && peek(i).value !== ':=' && peek(i).value !== ';') {
+while (peek(i) && peek(i).value !== ':=' && peek(i).value !== ';' && peek(i).value !== '(') {
   lhsTokens.push(peek(i));
   i++;
 }
@@ -162,10 +494,10 @@ if (peek(i)?.value === ':=') {
   return { type: 'ASSIGN', left: lhs, right };
 }
 
-  // Call statement like: Foo(...);
-  if (token.type === 'IDENTIFIER' && peek(1)?.value === '(') {
-    const name = consume().value; // IDENTIFIER
-    consume(); // '('
+  // Call statement like: Foo(...); or an element of an array of function blocks, like Fans[2](...);
+  if (token.type === 'IDENTIFIER' && peek(i)?.value === '(') {
+    const name = lhsTokens.map(t => t.value).join('');
+    for (let j = 0; j < i + 1; j++) consume(); // consume the name and '('
 
     const args = [];
     let depth = 1;
@@ -182,7 +514,7 @@ if (peek(i)?.value === ':=') {
   // optional semicolon
     if (peek()?.value === ';') consume();
 
-    return { type: 'CALL', name, args };
+    return parseCallArguments(name, args);
   }
 
   consume(); // Skip unknown
@@ -190,37 +522,72 @@ if (peek(i)?.value === ':=') {
 }
 
 
+/**
+ * Reads the arguments of a call statement. A call of a function block with formal parameters, such as
+ * T1(IN := x, PT := 500, Q => done), lists the inputs it sets before the call and the outputs it reads after it;
+ * any other call keeps its arguments as they are.
+ * @param {string} name The function or function block instance called.
+ * @param {string[]} args The tokens between the parentheses.
+ * @returns {{type: string, name: string, args: string[], inputs?: {name: string, value: string[]}[], outputs?: {name: string, target: string}[]}}
+ * Returns the call statement.
+ */
+function parseCallArguments(name, args) {
+  const parameters = [];
+  let current = [];
+  let depth = 0;
+  for (const t of args) {
+    if (t === '(' || t === '[') depth++;
+    else if (t === ')' || t === ']') depth--;
+    if (t === ',' && depth === 0) {
+      parameters.push(current);
+      current = [];
+    }
+    else current.push(t);
+  }
+  if (current.length) parameters.push(current);
+  const formal = parameters.length > 0 && parameters.every((p) => p.length > 2 && (p[1] === ':=' || p[1] === '=>'));
+  if (!formal) return { type: 'CALL', name, args };
+  return {
+    type: 'CALL',
+    name,
+    args: [],
+    inputs: parameters.filter((p) => p[1] === ':=').map((p) => ({ name: p[0], value: p.slice(2) })),
+    outputs: parameters.filter((p) => p[1] === '=>').map((p) => ({ name: p[0], target: p.slice(2).join('') }))
+  };
+}
+
+
 function parseIf() {
   consume(); // IF
 
   // Collect condition tokens until THEN
   const conditionTokens = [];
-  while (peek() && peek().value.toUpperCase() !== 'THEN') {
+  while (peek() && !is(Keyword.THEN)) {
     conditionTokens.push(consume().value);
   }
   consume(); // THEN
 
-  const thenBlock = parseStatementsUntil(['ELSIF', 'ELSE', 'END_IF']);
+  const thenBlock = parseStatementsUntil([Keyword.ELSIF, Keyword.ELSE, Keyword.END_IF]);
   const elseIfBlocks = [];
   let elseBlock = null;
 
-  while (peek()?.value.toUpperCase() === 'ELSIF') {
+  while (is(Keyword.ELSIF)) {
     consume(); // ELSIF
     const elifCondTokens = [];
-    while (peek() && peek().value.toUpperCase() !== 'THEN') {
+    while (peek() && !is(Keyword.THEN)) {
       elifCondTokens.push(consume().value);
     }
     consume(); // THEN
-    const elifBlock = parseStatementsUntil(['ELSIF', 'ELSE', 'END_IF']);
+    const elifBlock = parseStatementsUntil([Keyword.ELSIF, Keyword.ELSE, Keyword.END_IF]);
     elseIfBlocks.push({ condition: elifCondTokens, block: elifBlock });
   }
 
-  if (peek()?.value.toUpperCase() === 'ELSE') {
+  if (is(Keyword.ELSE)) {
     consume(); // ELSE
-    elseBlock = parseStatementsUntil(['END_IF']);
+    elseBlock = parseStatementsUntil([Keyword.END_IF]);
   }
 
-  if (peek()?.value.toUpperCase() === 'END_IF') {
+  if (is(Keyword.END_IF)) {
     consume(); // END_IF
   }
 
@@ -236,7 +603,7 @@ function parseIf() {
 
 function parseStatementsUntil(endTokens) {
   const statements = [];
-  while (peek() && !endTokens.includes(peek().value.toUpperCase())) {
+  while (peek() && !endTokens.includes(peek().id)) {
     const stmt = parseStatement();
     if (stmt) {
       statements.push(stmt);
@@ -252,11 +619,11 @@ function parseStatementsUntil(endTokens) {
   function parseWhile() {
     consume(); // WHILE
     const condition = [];
-    while (peek() && peek().value.toUpperCase() !== 'DO') {
+    while (peek() && !is(Keyword.DO)) {
       condition.push(consume().value);
     }
     expect('DO');
-    const body = parseStatements('END_WHILE');
+    const body = parseStatements(Keyword.END_WHILE);
     expect('END_WHILE');
     return { type: 'WHILE', condition, body };
   }
@@ -265,28 +632,37 @@ function parseStatementsUntil(endTokens) {
     consume(); // FOR
     const variable = consume().value;
     expect(':=');
-    const from = consume().value;
+    // The start, end and step are expressions, evaluated once when the loop starts.
+    const until = (...ends) => {
+      const tokens = [];
+      while (peek() && !ends.includes(peek().id)) {
+        tokens.push(consume().value);
+      }
+      return tokens;
+    };
+    const from = until(Keyword.TO);
     expect('TO');
-    const to = consume().value;
-    let step = '1';
-    if (peek()?.value.toUpperCase() === 'BY') {
+    const to = until(Keyword.BY, Keyword.DO);
+    let step = ['1'];
+    if (is(Keyword.BY)) {
       consume();
-      step = consume().value;
+      step = until(Keyword.DO);
     }
     expect('DO');
-    const body = parseStatements('END_FOR');
+    const body = parseStatements(Keyword.END_FOR);
     expect('END_FOR');
     return { type: 'FOR', variable, from, to, step, body };
   }
 
   function parseRepeat() {
     consume(); // REPEAT
-    const body = parseStatements('UNTIL');
+    const body = parseStatements(Keyword.UNTIL);
     expect('UNTIL');
     const condition = [];
-    while (peek() && peek().value !== ';') {
+    while (peek() && peek().value !== ';' && !is(Keyword.END_REPEAT)) {
       condition.push(consume().value);
     }
+    if (is(Keyword.END_REPEAT)) consume();
     if (peek()?.value === ';') consume();
     return { type: 'REPEAT', condition, body };
   }
@@ -294,19 +670,70 @@ function parseStatementsUntil(endTokens) {
   function parseCase() {
     consume(); // CASE
     const expression = [];
-    while (peek() && peek().value.toUpperCase() !== 'OF') {
+    while (peek() && !is(Keyword.OF)) {
       expression.push(consume().value);
     }
     expect('OF');
     const branches = [];
-    while (peek() && peek().value.toUpperCase() !== 'END_CASE') {
-      const label = consume().value;
-      expect(':');
-      const body = parseStatements('ELSE');
-      branches.push({ label, body });
+    let elseBlock = null;
+    while (peek() && !is(Keyword.END_CASE)) {
+      if (is(Keyword.ELSE)) {
+        consume();
+        elseBlock = parseStatements(Keyword.END_CASE);
+        break;
+      }
+      const labels = parseCaseLabels(true);
+      if (!labels) {
+        throw new Error(`Expected a CASE label, but got '${peek()?.value}'${where(peek())}`);
+      }
+      const body = [];
+      while (peek() && !is(Keyword.ELSE) && !is(Keyword.END_CASE) && !parseCaseLabels(false)) {
+        const stmt = parseStatement();
+        if (stmt) body.push(stmt);
+      }
+      branches.push({ labels, body });
     }
     expect('END_CASE');
-    return { type: 'CASE', expression, branches };
+    return { type: 'CASE', expression, branches, elseBlock };
+  }
+
+  /**
+   * Reads the labels of a CASE branch, such as `1, 3..5, -2:`, where each label is a value or a range of them.
+   * @param {boolean} take True to consume the labels and the colon, false to only look ahead.
+   * @returns {{low: string, high: string}[]|null} Returns the labels, or null if the tokens ahead aren't labels.
+   */
+  function parseCaseLabels(take) {
+    let i = 0;
+    const value = () => {
+      let sign = '';
+      if (peek(i)?.value === '-') {
+        sign = '-';
+        i++;
+      }
+      const token = peek(i);
+      if (!token || (token.type !== 'NUMBER' && token.type !== 'IDENTIFIER')) return null;
+      i++;
+      return sign + token.value;
+    };
+    const labels = [];
+    for (;;) {
+      const low = value();
+      if (low === null) return null;
+      let high = low;
+      if (peek(i)?.value === '..') {
+        i++;
+        high = value();
+        if (high === null) return null;
+      }
+      labels.push({ low, high });
+      if (peek(i)?.value !== ',') break;
+      i++;
+    }
+    if (peek(i)?.value !== ':') return null;
+    if (take) {
+      for (let j = 0; j <= i; j++) consume();
+    }
+    return labels;
   }
 
   function parseProgram() {
@@ -315,13 +742,14 @@ function parseStatementsUntil(endTokens) {
     const vars = [];
     const stmts = [];
 
-    while (peek() && peek().value.toUpperCase().startsWith('VAR')) {
+    while (peek() && isVarSection(peek().id)) {
       vars.push(...parseVarSection());
     }
 
-    stmts.push(...parseStatements('END_PROGRAM'));
+    stmts.push(...parseBody(Keyword.END_PROGRAM));
+    const called = calledInstances(stmts);
     vars.forEach((v) => {
-      if (mapType(v.type) === "auto") {
+      if (isFunctionBlockInstance(v) && !called.has(v.name)) {
         stmts.push({ type: "CALL", name: v.name });
       }
     });
@@ -338,13 +766,14 @@ function parseStatementsUntil(endTokens) {
     const vars = [];
     const stmts = [];
 
-    while (peek() && peek().value.toUpperCase().startsWith('VAR')) {
+    while (peek() && isVarSection(peek().id)) {
       vars.push(...parseVarSection());
     }
 
-    stmts.push(...parseStatements('END_FUNCTION'));
+    stmts.push(...parseStatements(Keyword.END_FUNCTION));
+    const called = calledInstances(stmts);
     vars.forEach((v) => {
-      if (mapType(v.type) === "auto") {
+      if (isFunctionBlockInstance(v) && !called.has(v.name)) {
         stmts.push({ type: "CALL", name: v.name });
       }
     });
@@ -359,13 +788,14 @@ function parseStatementsUntil(endTokens) {
     const vars = [];
     const stmts = [];
 
-    while (peek() && peek().value.toUpperCase().startsWith('VAR')) {
+    while (peek() && isVarSection(peek().id)) {
       vars.push(...parseVarSection());
     }
 
-    stmts.push(...parseStatements('END_FUNCTION_BLOCK'));
+    stmts.push(...parseBody(Keyword.END_FUNCTION_BLOCK));
+    const called = calledInstances(stmts);
     vars.forEach((v) => {
-      if (mapType(v.type) === "auto") {
+      if (isFunctionBlockInstance(v) && !called.has(v.name)) {
         stmts.push({ type: "CALL", name: v.name });
       }
     });
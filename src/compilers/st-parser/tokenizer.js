@@ -22,40 +22,292 @@
  */
 
 /**
- * Tokenizes a block of structured text into their types and values.
- * @param {string} code A block of structured text code.
- * @returns {{type: string, value: string}[]} An array of tokens.
+ * The interned IDs of the keywords, which the scanner stores on each keyword token as its `id`, so the parser compares
+ * numbers rather than upper cased strings. Every other token has an `id` of 0.
  */
-export function tokenize(code) {
-  const tokens = [];
-  let match;
-  // Remove single-line comments (//...)
-  code = code.replace(/\/\/.*$/gm, '');
+export const Keyword = Object.freeze(Object.fromEntries([
+  'PROGRAM', 'END_PROGRAM', 'FUNCTION', 'END_FUNCTION', 'FUNCTION_BLOCK', 'END_FUNCTION_BLOCK',
+  'VAR', 'VAR_INPUT', 'VAR_OUTPUT', 'VAR_IN_OUT', 'VAR_TEMP', 'VAR_EXTERNAL', 'VAR_GLOBAL', 'VAR_CONFIG', 'VAR_ACCESS',
+  'END_VAR', 'RETAIN', 'PERSISTENT', 'CONSTANT', 'AT', 'TYPE', 'END_TYPE', 'STRUCT', 'END_STRUCT', 'ARRAY', 'OF',
+  'IF', 'THEN', 'ELSIF', 'ELSE', 'END_IF', 'WHILE', 'DO', 'END_WHILE', 'FOR', 'TO', 'BY', 'END_FOR',
+  'REPEAT', 'UNTIL', 'END_REPEAT', 'CASE', 'END_CASE'
+].map((k, i) => [k, i + 1])));
+
+/**
+ * Determines whether a keyword opens a variable section, as VAR and the VAR_ keywords do.
+ * @param {number} id The keyword ID of a token.
+ * @returns {boolean} Returns true for VAR, VAR_INPUT, VAR_GLOBAL and the other section keywords.
+ */
+export function isVarSection(id) {
+  return id >= Keyword.VAR && id <= Keyword.VAR_ACCESS;
+}
+
+// The character codes of the symbols, and for each first character of a compound symbol, the second characters it takes.
+const SINGLE_SYMBOLS = new Set([...'<>+-*/=;():,[]'].map((c) => c.charCodeAt(0)));
+const COMPOUND_SYMBOLS = new Map([[':', '='], ['=', '>'], ['>', '='], ['<', '=>'], ['!', '='], ['.', '.']]
+  .map(([first, seconds]) => [first.charCodeAt(0), new Set([...seconds].map((c) => c.charCodeAt(0)))]));
+const LONGEST_KEYWORD = Math.max(...Object.keys(Keyword).map((k) => k.length));
+
+const isDigit = (c) => c >= 48 && c <= 57;
+const isUpper = (c) => c >= 65 && c <= 90;
+const isIdentifierStart = (c) => isUpper(c) || (c >= 97 && c <= 122) || c === 95;
+const isWord = (c) => isIdentifierStart(c) || isDigit(c);
+const isLineBreak = (c) => c === 10 || c === 13 || c === 0x2028 || c === 0x2029;
 
-  // Remove multi-line comments ((*...*))
-  code = code.replace(/\(\*[\s\S]*?\*\)/g, '');
+// The type of a typed time literal, by its prefix, and the characters its body takes after the #.
+const TIME_PREFIXES = new Map([
+  ['T', 'TIME'], ['TIME', 'TIME'], ['LT', 'LTIME'], ['LTIME', 'LTIME'],
+  ['D', 'DATE'], ['DATE', 'DATE'], ['LD', 'LDATE'], ['LDATE', 'LDATE'],
+  ['TOD', 'TIME_OF_DAY'], ['TIME_OF_DAY', 'TIME_OF_DAY'], ['LTOD', 'LTIME_OF_DAY'], ['LTIME_OF_DAY', 'LTIME_OF_DAY'],
+  ['DT', 'DATE_AND_TIME'], ['DATE_AND_TIME', 'DATE_AND_TIME'], ['LDT', 'LDATE_AND_TIME'], ['LDATE_AND_TIME', 'LDATE_AND_TIME']
+]);
+const TIME_BODIES = {
+  TIME: /^[+-]?[0-9A-Za-z_.]+/, LTIME: /^[+-]?[0-9A-Za-z_.]+/, DATE: /^[0-9-]+/, LDATE: /^[0-9-]+/,
+  TIME_OF_DAY: /^[0-9:.]+/, LTIME_OF_DAY: /^[0-9:.]+/, DATE_AND_TIME: /^[0-9:.-]+/, LDATE_AND_TIME: /^[0-9:.-]+/
+};
+const NANOS = { d: 86400000000000n, h: 3600000000000n, m: 60000000000n, s: 1000000000n, ms: 1000000n, us: 1000n, ns: 1n };
 
-  //const regex = /(%[IQM][A-Z]?[0-9]+(?:\.[0-9]+)?)|(:=)|([A-Za-z_]\w*\.\d+)|([A-Za-z_]\w*\.\w+)|([A-Za-z_]\w*)|(\d+)|([:;()<>+\-*/=])/g;
-  const regex = /(%[IQM][A-Z]*\d+(?:\.\d+)?)|(:=|>=|<=|<>|!=)|([A-Za-z_]\w*\.\d+)|([A-Za-z_]\w*\.\w+)|([A-Za-z_]\w*)|(\d+)|([<>+\-*/=;():,])/g;
+/**
+ * Folds the body of a typed time literal, what follows its #, to the integer the runtimes store it as: TIME in
+ * milliseconds, DATE and DATE_AND_TIME in seconds since 1970, TIME_OF_DAY in milliseconds since midnight, and the
+ * L types, LTIME, LDATE, LTIME_OF_DAY and LDATE_AND_TIME, in nanoseconds. A fraction finer than the unit is rounded.
+ * @param {string} type The type of the literal, like TIME or LDATE_AND_TIME.
+ * @param {string} body The body of the literal, like 1h30m or 2025-06-01-12:00:00.
+ * @returns {bigint|null} Returns the value, or null if the body isn't valid for the type.
+ */
+export function foldTimeLiteral(type, body) {
+  // The nanoseconds of a decimal number of a unit, rounded.
+  const scale = (text, unit) => {
+    const [whole, fraction = ''] = text.split('.');
+    const digits = fraction.slice(0, 9);
+    return BigInt(whole) * unit + (BigInt(digits || '0') * unit) / 10n ** BigInt(digits.length);
+  };
+  const daySeconds = (text) => {
+    const match = /^(\d+):(\d+):(\d+(?:\.\d+)?)$/.exec(text) ?? /^(\d+):(\d+)()$/.exec(text);
+    if (!match || Number(match[1]) > 23 || Number(match[2]) > 59 || Number(match[3] || 0) >= 60) return null;
+    return BigInt(match[1]) * NANOS.h + BigInt(match[2]) * NANOS.m + scale(match[3] || '0', NANOS.s);
+  };
+  const dateNanos = (text) => {
+    const match = /^(\d{4})-(\d{1,2})-(\d{1,2})$/.exec(text);
+    if (!match) return null;
+    const millis = Date.UTC(Number(match[1]), Number(match[2]) - 1, Number(match[3]));
+    // Date.UTC carries a day or month past the end into the next, so a date that moved wasn't a real one.
+    if (new Date(millis).getUTCDate() !== Number(match[3])) return null;
+    return BigInt(millis) * NANOS.ms;
+  };
+  const round = (nanos, unit) => (nanos >= 0n ? nanos + unit / 2n : nanos - unit / 2n) / unit;
+  let nanos;
+  switch (type) {
+    case 'TIME':
+    case 'LTIME': {
+      const negative = body.startsWith('-');
+      const text = body.replace(/^[+-]/, '').replace(/_/g, '').toLowerCase();
+      nanos = 0n;
+      let rest = text.replace(/(\d+(?:\.\d+)?)(ms|us|ns|d|h|m|s)/g, (_, value, unit) => {
+        nanos += scale(value, NANOS[unit]);
+        return '';
+      });
+      // A plain number, like T#500, is a number of milliseconds.
+      if (/^\d+$/.test(text)) {
+        nanos = BigInt(text) * NANOS.ms;
+        rest = '';
+      }
+      if (rest !== '' || text === '') return null;
+      if (negative) nanos = -nanos;
+      return type === 'TIME' ? round(nanos, NANOS.ms) : nanos;
+    }
+    case 'DATE':
+    case 'LDATE':
+      nanos = dateNanos(body);
+      if (nanos === null) return null;
+      return type === 'DATE' ? nanos / NANOS.s : nanos;
+    case 'TIME_OF_DAY':
+    case 'LTIME_OF_DAY':
+      nanos = daySeconds(body);
+      if (nanos === null) return null;
+      return type === 'TIME_OF_DAY' ? round(nanos, NANOS.ms) : nanos;
+    default: {
+      // DATE_AND_TIME and LDATE_AND_TIME join the date and the time of day with a -, as 2025-06-01-12:00:00.
+      const match = /^(\d{4}-\d{1,2}-\d{1,2})-(.+)$/.exec(body);
+      const date = match && dateNanos(match[1]);
+      const time = match && daySeconds(match[2]);
+      if (date === null || time === null) return null;
+      nanos = date + time;
+      return type === 'DATE_AND_TIME' ? round(nanos, NANOS.s) : nanos;
+    }
+  }
+}
 
-while ((match = regex.exec(code)) !== null) {
-  const [_, address, compoundSymbol, bitIdentifier, propIdentifier, identifier, number, symbol] = match;
+/**
+ * Tokenizes a block of structured text into their types and values, in one pass over the code. Comments are skipped
+ * as they are met, so a // or (* inside a string literal stays part of the string.
+ * @param {string} code A block of structured text code.
+ * @returns {{type: string, value: string, id: number, line: number, column: number, literal?: string}[]} An array of
+ * tokens, each with its keyword ID and the line and column, from 1, where it starts. A folded time literal is a NUMBER
+ * with the type it was written as in its `literal`.
+ */
+export function tokenize(code) {
+  const tokens = [];
+  const length = code.length;
+  let pos = 0;
+  let line = 1;
+  let lineStart = 0;
 
-  if (address) 
-    tokens.push({ type: 'ADDRESS', value: address });
-  else if (compoundSymbol)
-    tokens.push({ type: 'SYMBOL', value: compoundSymbol });
-  else if (bitIdentifier)
-    tokens.push({ type: 'IDENTIFIER', value: bitIdentifier });
-  else if (propIdentifier)
-    tokens.push({ type: 'IDENTIFIER', value: propIdentifier });
-  else if (identifier)
-    tokens.push({ type: 'IDENTIFIER', value: identifier });
-  else if (number)
-    tokens.push({ type: 'NUMBER', value: number });
-  else if (symbol)
-    tokens.push({ type: 'SYMBOL', value: symbol });
+  // The keyword ID of each identifier spelling seen so far, 0 for those that aren't keywords.
+  const spellings = new Map();
+  const push = (type, start, end) => {
+    tokens.push({ type, value: code.substring(start, end), id: 0, line, column: start - lineStart + 1 });
+  };
+  // Moves past a range that may hold line breaks, keeping the line count.
+  const skipTo = (end) => {
+    for (let i = code.indexOf('\n', pos); i >= 0 && i < end; i = code.indexOf('\n', i + 1)) {
+      line++;
+      lineStart = i + 1;
+    }
+    pos = end;
+  };
+  // The end of a string literal starting at pos, with its quotes and $ escapes, or -1 if it isn't closed.
+  const stringEnd = (quote) => {
+    for (let i = pos + 1; i < length; i++) {
+      const c = code.charCodeAt(i);
+      if (c === quote) return i + 1;
+      if (c === 36 /* $ */) {
+        if (i + 1 >= length || isLineBreak(code.charCodeAt(i + 1))) return -1;
+        i++;
+      }
+    }
+    return -1;
+  };
+  const digitsEnd = (i) => {
+    while (i < length && isDigit(code.charCodeAt(i))) i++;
+    return i;
+  };
 
+  while (pos < length) {
+    const c = code.charCodeAt(pos);
+    if (c === 10) {
+      line++;
+      lineStart = ++pos;
+      continue;
+    }
+    if (c === 32 || c === 9 || c === 13) {
+      pos++;
+      continue;
+    }
+    const next = code.charCodeAt(pos + 1);
+    // Single-line comments (//...)
+    if (c === 47 && next === 47) {
+      let end = pos + 2;
+      while (end < length && !isLineBreak(code.charCodeAt(end))) end++;
+      pos = end;
+      continue;
+    }
+    // Multi-line comments ((*...*))
+    if (c === 40 && next === 42) {
+      const end = code.indexOf('*)', pos + 2);
+      skipTo(end < 0 ? length : end + 2);
+      continue;
+    }
+    // String literals are kept whole, quotes and $ escapes included, so the transpilers can convert them for their target.
+    if (c === 39 || c === 34) {
+      const end = stringEnd(c);
+      if (end < 0) {
+        pos++;
+        continue;
+      }
+      push('STRING', pos, end);
+      skipTo(end);
+      continue;
+    }
+    if (c === 37 /* % */ && (next === 73 || next === 81 || next === 77)) {
+      let end = pos + 2;
+      while (end < length && isUpper(code.charCodeAt(end))) end++;
+      const digits = digitsEnd(end);
+      if (digits > end) {
+        end = digits;
+        if (code.charCodeAt(end) === 46 && isDigit(code.charCodeAt(end + 1))) end = digitsEnd(end + 1);
+        push('ADDRESS', pos, end);
+        pos = end;
+        continue;
+      }
+    }
+    if (COMPOUND_SYMBOLS.get(c)?.has(next)) {
+      push('SYMBOL', pos, pos + 2);
+      pos += 2;
+      continue;
+    }
+    if (isIdentifierStart(c)) {
+      let end = pos + 1;
+      while (end < length && isWord(code.charCodeAt(end))) end++;
+      let word = false;
+      // A bit of a variable, like X.0, or one member of it, like T1.Q, is part of the identifier. A member after an
+      // index or after another member, like the .IN of Zones[3].IN, is read as its own token.
+      if (code.charCodeAt(end) === 46 && isDigit(code.charCodeAt(end + 1))) {
+        end = digitsEnd(end + 1);
+      }
+      else if (code.charCodeAt(end) === 46 && isWord(code.charCodeAt(end + 1))) {
+        end += 2;
+        while (end < length && isWord(code.charCodeAt(end))) end++;
+      }
+      else {
+        word = end - pos <= LONGEST_KEYWORD;
+      }
+      // A typed time literal, like T#1m30s or DT#2025-06-01-12:00:00, is folded to the number the runtimes store it
+      // as, so a timer's preset costs nothing at run time. A negative duration is read as a - and the number.
+      const literal = word && code.charCodeAt(end) === 35 /* # */ && TIME_PREFIXES.get(code.substring(pos, end).toUpperCase());
+      if (literal) {
+        const body = TIME_BODIES[literal].exec(code.substring(end + 1, end + 65))?.[0] ?? '';
+        const value = foldTimeLiteral(literal, body);
+        if (value === null) {
+          throw new Error(`Invalid ${literal} literal '${code.substring(pos, end + 1 + body.length)}' at line ${line}, column ${pos - lineStart + 1}`);
+        }
+        const column = pos - lineStart + 1;
+        if (value < 0n) tokens.push({ type: 'SYMBOL', value: '-', id: 0, line, column });
+        tokens.push({ type: 'NUMBER', value: String(value < 0n ? -value : value), id: 0, line, column, literal });
+        pos = end + 1 + body.length;
+        continue;
+      }
+      if (word) {
+        const value = code.substring(pos, end);
+        let id = spellings.get(value);
+        if (id === undefined) {
+          id = Keyword[value.toUpperCase()] ?? 0;
+          spellings.set(value, id);
+        }
+        tokens.push({ type: 'IDENTIFIER', value, id, line, column: pos - lineStart + 1 });
+      }
+      else {
+        push('IDENTIFIER', pos, end);
+      }
+      pos = end;
+      continue;
+    }
+    if (c === 46 /* . */ && isIdentifierStart(next)) {
+      let end = pos + 2;
+      while (end < length && isWord(code.charCodeAt(end))) end++;
+      push('IDENTIFIER', pos, end);
+      pos = end;
+      continue;
+    }
+    if (isDigit(c)) {
+      let end = digitsEnd(pos);
+      if (code.charCodeAt(end) === 46 && isDigit(code.charCodeAt(end + 1))) {
+        end = digitsEnd(end + 1);
+        const e = code.charCodeAt(end);
+        if (e === 69 || e === 101) {
+          const sign = code.charCodeAt(end + 1) === 43 || code.charCodeAt(end + 1) === 45 ? 1 : 0;
+          if (isDigit(code.charCodeAt(end + 1 + sign))) end = digitsEnd(end + 1 + sign);
+        }
+      }
+      push('NUMBER', pos, end);
+      pos = end;
+      continue;
+    }
+    if (SINGLE_SYMBOLS.has(c)) {
+      push('SYMBOL', pos, pos + 1);
+    }
+    // Anything else is skipped.
+    pos++;
   }
   return tokens;
 }
@@ -0,0 +1,620 @@
+/* eslint-disable curly */
+/* eslint-disable eqeqeq */
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/**
+ * @description WebAssembly Transpiler
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * Compiles the programs of an optimized tree (see ir.js) into a WebAssembly module for the Node.js runtime. The
+ * module imports one shared memory, env.memory, which holds the process image at the offsets of the Javascript
+ * runtime's image, followed by the state of the programs, so the programs read and write their IO in place and keep
+ * their variables between scans like the programs of the C++ target. Each program is exported as a function of its
+ * name, and __init sets the variables to their initial values.
+ *
+ * A program is compiled if it only uses the elementary integer, BOOL, TIME and REAL types, located addresses, and
+ * the statements and operators of the IR; the others, and the functions and function blocks, are left to the
+ * Javascript transpiler, so a module may hold some of the programs of a source or none of them. Integers are 32 bit
+ * and wrap to the width of the variable they are stored to, REALs are 64 bit, and a division by zero is 0.
+ */
+
+import { parseExpression, typeOf } from './ir.js';
+import { locateInImage } from './expressionConverter.js';
+
+/**
+ * The bytes of the process image, which the state of the programs follows.
+ */
+const IMAGE_BYTES = 512 + 512 + 7168;
+
+const PAGE_BYTES = 65536;
+
+/**
+ * The elementary types a compiled program may use, with their bits and whether they are signed. REALs are 0 bits.
+ */
+const TYPES = {
+  BOOL: { bits: 1, signed: false },
+  SINT: { bits: 8, signed: true },
+  INT: { bits: 16, signed: true },
+  DINT: { bits: 32, signed: true },
+  USINT: { bits: 8, signed: false },
+  UINT: { bits: 16, signed: false },
+  UDINT: { bits: 32, signed: false },
+  BYTE: { bits: 8, signed: false },
+  WORD: { bits: 16, signed: false },
+  DWORD: { bits: 32, signed: false },
+  TIME: { bits: 32, signed: true },
+  REAL: { bits: 0, signed: true },
+  LREAL: { bits: 0, signed: true }
+};
+
+const I32 = 0x7f;
+const F64 = 0x7c;
+const VOID = 0x40;
+
+const OP = {
+  block: 0x02, loop: 0x03, if: 0x04, else: 0x05, end: 0x0b, br: 0x0c, brIf: 0x0d, drop: 0x1a,
+  localGet: 0x20, localSet: 0x21, localTee: 0x22,
+  i32Load: 0x28, f64Load: 0x2b, i32Load8u: 0x2d, i32Load16u: 0x2f,
+  i32Store: 0x36, f64Store: 0x39, i32Store8: 0x3a, i32Store16: 0x3b,
+  i32Const: 0x41, f64Const: 0x44,
+  i32Eqz: 0x45, i32Eq: 0x46, i32Ne: 0x47, i32LtS: 0x48, i32LtU: 0x49, i32GtS: 0x4a, i32GtU: 0x4b,
+  i32LeS: 0x4c, i32LeU: 0x4d, i32GeS: 0x4e, i32GeU: 0x4f,
+  f64Eq: 0x61, f64Ne: 0x62, f64Lt: 0x63, f64Gt: 0x64, f64Le: 0x65, f64Ge: 0x66,
+  i32Add: 0x6a, i32Sub: 0x6b, i32Mul: 0x6c, i32DivS: 0x6d, i32DivU: 0x6e, i32RemS: 0x6f, i32RemU: 0x70,
+  i32And: 0x71, i32Or: 0x72, i32Xor: 0x73,
+  f64Abs: 0x99, f64Neg: 0x9a, f64Add: 0xa0, f64Sub: 0xa1, f64Mul: 0xa2, f64Div: 0xa3, f64Min: 0xa4, f64Max: 0xa5,
+  f64ConvertI32S: 0xb7, f64ConvertI32U: 0xb8, i32Extend8S: 0xc0, i32Extend16S: 0xc1
+};
+
+/**
+ * Thrown for what a program uses that can't be compiled, so that the program is left to Javascript.
+ */
+class Unsupported extends Error {}
+
+function unsigned(value) {
+  const bytes = [];
+  do {
+    let byte = value & 0x7f;
+    value >>>= 7;
+    if (value !== 0) byte |= 0x80;
+    bytes.push(byte);
+  } while (value !== 0);
+  return bytes;
+}
+
+function signed(value) {
+  const bytes = [];
+  value |= 0;
+  for (;;) {
+    const byte = value & 0x7f;
+    value >>= 7;
+    if ((value === 0 && (byte & 0x40) === 0) || (value === -1 && (byte & 0x40) !== 0)) {
+      bytes.push(byte);
+      return bytes;
+    }
+    bytes.push(byte | 0x80);
+  }
+}
+
+function float64(value) {
+  return [...new Uint8Array(new Float64Array([value]).buffer)];
+}
+
+function vector(items) {
+  return [...unsigned(items.length), ...items.flat()];
+}
+
+function section(id, content) {
+  return [id, ...unsigned(content.length), ...content];
+}
+
+function name(text) {
+  return vector([...Buffer.from(text, 'utf-8')]);
+}
+
+/**
+ * The class of a value on the WebAssembly stack, from its ST type: an i32 integer or BOOL, or an f64 REAL.
+ */
+function valueType(type) {
+  return TYPES[type]?.bits === 0 || type === 'ANY_REAL' ? F64 : I32;
+}
+
+function isUnsigned(type) {
+  return TYPES[type] ? !TYPES[type].signed : false;
+}
+
+/**
+ * Compiles one program into the body of a function.
+ */
+class ProgramCompiler {
+  /**
+   * @param {{name: string, varSections: [], statements: []}} block The program.
+   * @param {Map<string, {offset: number, type: string}>} state The variables of the program in the module's memory.
+   * @param {number[]} prologue The code that sets the VAR_TEMP variables to their initial values on each call.
+   */
+  constructor(block, state, prologue) {
+    this.block = block;
+    this.state = state;
+    this.prologue = prologue;
+    this.symbols = Object.fromEntries([...state].map(([n, v]) => [n, v.type]));
+    this.locals = [];
+    this.temps = new Map();
+    this.code = [];
+  }
+
+  compile() {
+    this.emit(this.prologue);
+    this.statements(this.block.statements);
+    this.code.push(OP.end);
+    const groups = this.locals.map((type) => [1, type]);
+    const body = [...vector(groups), ...this.code];
+    return [...unsigned(body.length), ...body];
+  }
+
+  local(type) {
+    this.locals.push(type);
+    return this.locals.length - 1;
+  }
+
+  emit(...bytes) {
+    this.code.push(...bytes.flat());
+  }
+
+  memory(op, align, offset) {
+    this.emit(OP.i32Const, 0, op, align, unsigned(offset));
+  }
+
+  typeOf(node) {
+    if (node.kind === 'name' && this.temps.has(node.name)) return this.temps.get(node.name).type;
+    const type = typeOf(node, this.symbols);
+    if (type === 'ANY_INT' || type === 'ANY_REAL' || TYPES[type]) return type;
+    if (node.kind === 'call') return this.callType(node);
+    throw new Unsupported(`values of type ${type ?? 'unknown'}`);
+  }
+
+  callType(node) {
+    const types = node.args.map((arg) => this.typeOf(arg));
+    switch (node.name.toUpperCase()) {
+      case 'ABS': return types[0];
+      case 'MIN': case 'MAX': return types.some((t) => valueType(t) === F64) ? 'LREAL' : types.find((t) => t !== 'ANY_INT') ?? 'DINT';
+      case 'LIMIT': return this.callType({ name: 'MAX', args: node.args });
+      case 'SEL': return this.callType({ name: 'MAX', args: node.args.slice(1) });
+    }
+    throw new Unsupported(`calls of ${node.name}`);
+  }
+
+  /**
+   * Emits an expression, leaving its value on the stack as the value type of a type.
+   * @param {{kind: string}} node The expression.
+   * @param {string} type The type the value is converted to, or undefined to leave it as it is.
+   * @returns {string} Returns the type of the value left.
+   */
+  expression(node, type) {
+    const own = this.typeOf(node);
+    this.value(node, own);
+    if (type !== undefined) this.convert(own, type);
+    return type ?? own;
+  }
+
+  convert(from, to) {
+    const source = valueType(from);
+    const target = valueType(to);
+    if (to === 'BOOL' && from !== 'BOOL') {
+      if (source === F64) this.emit(OP.f64Const, float64(0), OP.f64Ne);
+      else this.emit(OP.i32Const, 0, OP.i32Ne);
+      return;
+    }
+    if (source === target) return;
+    if (target === F64) this.emit(isUnsigned(from) ? OP.f64ConvertI32U : OP.f64ConvertI32S);
+    else this.emit(0xfc, isUnsigned(to) ? 0x03 : 0x02);
+  }
+
+  /**
+   * Narrows an i32 to the width of the type it is stored to, as the C++ target does.
+   */
+  wrap(type) {
+    const bits = TYPES[type]?.bits;
+    if (bits === 8) this.emit(TYPES[type].signed ? [OP.i32Extend8S] : [OP.i32Const, signed(0xff), OP.i32And]);
+    else if (bits === 16) this.emit(TYPES[type].signed ? [OP.i32Extend16S] : [OP.i32Const, signed(0xffff), OP.i32And]);
+  }
+
+  value(node, type) {
+    switch (node.kind) {
+      case 'literal':
+        if (typeof node.value === 'boolean') this.emit(OP.i32Const, node.value ? 1 : 0);
+        else if (valueType(type) === F64) this.emit(OP.f64Const, float64(node.value));
+        else this.emit(OP.i32Const, signed(node.value));
+        return;
+      case 'name': {
+        const temp = this.temps.get(node.name);
+        if (temp) {
+          this.emit(OP.localGet, unsigned(temp.index));
+          return;
+        }
+        const variable = this.state.get(node.name);
+        if (!variable) throw new Unsupported(`the variable ${node.name}`);
+        if (valueType(variable.type) === F64) this.memory(OP.f64Load, 3, variable.offset);
+        else this.memory(OP.i32Load, 2, variable.offset);
+        return;
+      }
+      case 'address': {
+        const a = locateInImage(node.address);
+        if (!a) throw new Unsupported(`the address ${node.address}`);
+        if (a.bit > -1) {
+          this.memory(OP.i32Load8u, 0, a.byte);
+          this.emit(OP.i32Const, signed(a.mask), OP.i32And, OP.i32Const, 0, OP.i32Ne);
+        }
+        else if (a.width === 8) this.memory(OP.i32Load8u, 0, a.byte);
+        else if (a.width === 16) this.memory(OP.i32Load16u, 1, a.byte);
+        else this.memory(OP.i32Load, 2, a.byte);
+        return;
+      }
+      case 'unary':
+        if (node.op === 'NOT') {
+          this.expression(node.operand, type);
+          if (type === 'BOOL') this.emit(OP.i32Eqz);
+          else this.emit(OP.i32Const, signed(-1), OP.i32Xor);
+        }
+        else if (valueType(type) === F64) {
+          this.expression(node.operand, type);
+          this.emit(OP.f64Neg);
+        }
+        else {
+          this.emit(OP.i32Const, 0);
+          this.expression(node.operand, type);
+          this.emit(OP.i32Sub);
+        }
+        return;
+      case 'binary':
+        this.binary(node);
+        return;
+      case 'call':
+        this.call(node, type);
+        return;
+    }
+    throw new Unsupported(`${node.kind} expressions`);
+  }
+
+  binary(node) {
+    const left = this.typeOf(node.left);
+    const right = this.typeOf(node.right);
+    const real = valueType(left) === F64 || valueType(right) === F64;
+    const logical = left === 'BOOL' && right === 'BOOL';
+    const operand = real ? 'LREAL' : logical ? 'BOOL' : [left, right].find((t) => isUnsigned(t)) ?? 'DINT';
+    const comparisons = { '=': ['f64Eq', 'i32Eq', 'i32Eq'], '<>': ['f64Ne', 'i32Ne', 'i32Ne'],
+      '<': ['f64Lt', 'i32LtS', 'i32LtU'], '>': ['f64Gt', 'i32GtS', 'i32GtU'],
+      '<=': ['f64Le', 'i32LeS', 'i32LeU'], '>=': ['f64Ge', 'i32GeS', 'i32GeU'] };
+    const pick = (ops) => OP[ops[real ? 0 : isUnsigned(operand) ? 2 : 1]];
+    if (['AND', 'OR', 'XOR'].includes(node.op)) {
+      if (real) throw new Unsupported(`${node.op} of REALs`);
+      this.expression(node.left, operand);
+      this.expression(node.right, operand);
+      this.emit({ AND: OP.i32And, OR: OP.i32Or, XOR: OP.i32Xor }[node.op]);
+      return;
+    }
+    if (comparisons[node.op]) {
+      this.expression(node.left, operand);
+      this.expression(node.right, operand);
+      this.emit(pick(comparisons[node.op]));
+      return;
+    }
+    if (node.op === '/' || node.op === 'MOD') {
+      if (real && node.op === 'MOD') throw new Unsupported('MOD of REALs');
+      if (real) {
+        this.expression(node.left, operand);
+        this.expression(node.right, operand);
+        this.emit(OP.f64Div);
+        return;
+      }
+      // A division by zero is 0, rather than a trap that would stop the task.
+      const dividend = this.local(I32);
+      const divisor = this.local(I32);
+      this.expression(node.left, operand);
+      this.emit(OP.localSet, unsigned(dividend));
+      this.expression(node.right, operand);
+      this.emit(OP.localTee, unsigned(divisor), OP.i32Eqz, OP.if, I32, OP.i32Const, 0, OP.else,
+        OP.localGet, unsigned(dividend), OP.localGet, unsigned(divisor),
+        pick(node.op === '/' ? ['', 'i32DivS', 'i32DivU'] : ['', 'i32RemS', 'i32RemU']), OP.end);
+      return;
+    }
+    const arithmetic = { '+': ['f64Add', 'i32Add'], '-': ['f64Sub', 'i32Sub'], '*': ['f64Mul', 'i32Mul'] }[node.op];
+    if (!arithmetic) throw new Unsupported(`the operator ${node.op}`);
+    this.expression(node.left, operand);
+    this.expression(node.right, operand);
+    this.emit(OP[arithmetic[real ? 0 : 1]]);
+  }
+
+  call(node, type) {
+    const real = valueType(type) === F64;
+    const args = node.args;
+    const choose = (test) => {
+      // Keeps the two values in locals, and leaves the one the comparison picks.
+      const a = this.local(real ? F64 : I32);
+      const b = this.local(real ? F64 : I32);
+      this.expression(args[test.left], type);
+      this.emit(OP.localSet, unsigned(a));
+      this.expression(args[test.right], type);
+      this.emit(OP.localSet, unsigned(b));
+      this.emit(OP.localGet, unsigned(a), OP.localGet, unsigned(b), OP.localGet, unsigned(a), OP.localGet, unsigned(b));
+      this.emit(real ? OP[test.real] : isUnsigned(type) ? OP[test.unsigned] : OP[test.signed], 0x1b);
+    };
+    switch (node.name.toUpperCase()) {
+      case 'ABS':
+        if (args.length !== 1) break;
+        if (real) {
+          this.expression(args[0], type);
+          this.emit(OP.f64Abs);
+          return;
+        }
+        {
+          const x = this.local(I32);
+          this.expression(args[0], type);
+          this.emit(OP.localTee, unsigned(x), OP.i32Const, 0, OP.localGet, unsigned(x), OP.i32Sub,
+            OP.localGet, unsigned(x), OP.i32Const, 0, OP.i32GeS, 0x1b);
+        }
+        return;
+      case 'MIN':
+        if (args.length !== 2) break;
+        choose({ left: 0, right: 1, real: 'f64Le', signed: 'i32LeS', unsigned: 'i32LeU' });
+        return;
+      case 'MAX':
+        if (args.length !== 2) break;
+        choose({ left: 0, right: 1, real: 'f64Ge', signed: 'i32GeS', unsigned: 'i32GeU' });
+        return;
+      case 'LIMIT':
+        if (args.length !== 3) break;
+        // LIMIT(MN, IN, MX) is MIN(MAX(IN, MN), MX).
+        this.call({ name: 'MIN', args: [{ kind: 'call', name: 'MAX', args: [args[1], args[0]] }, args[2]] }, type);
+        return;
+      case 'SEL': {
+        if (args.length !== 3) break;
+        this.expression(args[2], type);
+        this.expression(args[1], type);
+        this.expression(args[0], 'BOOL');
+        this.emit(0x1b);
+        return;
+      }
+    }
+    throw new Unsupported(`calls of ${node.name}`);
+  }
+
+  condition(tokens) {
+    const tree = parseExpression(tokens);
+    if (!tree) throw new Unsupported('an expression the IR does not model');
+    this.expression(tree, 'BOOL');
+  }
+
+  /**
+   * Emits the value of an expression converted to a type, and stores it to a variable, a temporary or an address.
+   */
+  assign(target, tokens) {
+    const tree = parseExpression(tokens);
+    if (!tree) throw new Unsupported('an expression the IR does not model');
+    this.store(target, () => tree);
+  }
+
+  store(target, source) {
+    // Located globals were replaced by their address by the optimizer.
+    const address = /^%[IQM]/i.test(target) ? target : null;
+    if (address) {
+      const a = locateInImage(address);
+      if (!a) throw new Unsupported(`the address ${address}`);
+      if (a.bit > -1) {
+        // Bits are set with atomic operations, so that one can't undo a bit the IO worker wrote to the same byte.
+        this.expression(source(), 'BOOL');
+        this.emit(OP.if, VOID, OP.i32Const, 0, OP.i32Const, signed(a.mask), 0xfe, 0x35, 0, unsigned(a.byte), OP.drop,
+          OP.else, OP.i32Const, 0, OP.i32Const, signed(~a.mask & 0xff), 0xfe, 0x2e, 0, unsigned(a.byte), OP.drop, OP.end);
+        return;
+      }
+      const type = { 8: 'BYTE', 16: 'WORD', 32: 'DWORD' }[a.width];
+      this.emit(OP.i32Const, 0);
+      this.expression(source(), type);
+      this.emit({ 8: OP.i32Store8, 16: OP.i32Store16, 32: OP.i32Store }[a.width], { 8: 0, 16: 1, 32: 2 }[a.width], unsigned(a.byte));
+      return;
+    }
+    const variable = this.state.get(target);
+    if (!variable) throw new Unsupported(`assignments to ${target}`);
+    this.emit(OP.i32Const, 0);
+    this.expression(source(), variable.type);
+    if (valueType(variable.type) === F64) {
+      this.emit(OP.f64Store, 3, unsigned(variable.offset));
+    }
+    else {
+      this.wrap(variable.type);
+      this.emit(OP.i32Store, 2, unsigned(variable.offset));
+    }
+  }
+
+  statements(statements) {
+    (statements ?? []).forEach((stmt) => this.statement(stmt));
+  }
+
+  statement(stmt) {
+    switch (stmt.type) {
+      case 'ASSIGN':
+        this.assign(stmt.left, stmt.right);
+        return;
+      case 'TEMP': {
+        const tree = parseExpression(stmt.right);
+        if (!tree) throw new Unsupported('an expression the IR does not model');
+        const type = this.typeOf(tree);
+        const resolved = type === 'ANY_INT' ? 'DINT' : type === 'ANY_REAL' ? 'LREAL' : type;
+        const index = this.local(valueType(resolved));
+        this.expression(tree, resolved);
+        this.emit(OP.localSet, unsigned(index));
+        this.temps.set(stmt.name, { index, type: resolved });
+        this.symbols[stmt.name] = resolved;
+        return;
+      }
+      case 'IF': {
+        const branches = [{ condition: stmt.condition, block: stmt.thenBlock }, ...(stmt.elseIfBlocks ?? [])];
+        branches.forEach((branch, x) => {
+          this.condition(branch.condition);
+          this.emit(OP.if, VOID);
+          this.statements(branch.block);
+          if (x < branches.length - 1 || stmt.elseBlock?.length) this.emit(OP.else);
+        });
+        this.statements(stmt.elseBlock);
+        branches.forEach(() => this.emit(OP.end));
+        return;
+      }
+      case 'WHILE':
+        this.emit(OP.block, VOID, OP.loop, VOID);
+        this.condition(stmt.condition);
+        this.emit(OP.i32Eqz, OP.brIf, 1);
+        this.statements(stmt.body);
+        this.emit(OP.br, 0, OP.end, OP.end);
+        return;
+      case 'REPEAT':
+        this.emit(OP.loop, VOID);
+        this.statements(stmt.body);
+        this.condition(stmt.condition);
+        this.emit(OP.i32Eqz, OP.brIf, 0, OP.end);
+        return;
+      case 'FOR': {
+        // The end and step are evaluated once, and the sign of the step gives the direction of the test.
+        const variable = this.state.get(stmt.variable);
+        if (!variable || valueType(variable.type) !== I32 || variable.type === 'BOOL') {
+          throw new Unsupported(`FOR loops over ${stmt.variable}`);
+        }
+        const type = variable.type;
+        const end = this.local(I32);
+        const step = this.local(I32);
+        const read = () => this.memory(OP.i32Load, 2, variable.offset);
+        const compare = (s, u) => isUnsigned(type) ? u : s;
+        this.assign(stmt.variable, stmt.from);
+        this.expressionTokens(stmt.to, type);
+        this.emit(OP.localSet, unsigned(end));
+        this.expressionTokens(stmt.step, type);
+        this.emit(OP.localSet, unsigned(step));
+        this.emit(OP.block, VOID, OP.loop, VOID);
+        read();
+        this.emit(OP.localGet, unsigned(end));
+        this.emit(compare(OP.i32LeS, OP.i32LeU));
+        read();
+        this.emit(OP.localGet, unsigned(end));
+        this.emit(compare(OP.i32GeS, OP.i32GeU));
+        this.emit(OP.localGet, unsigned(step), OP.i32Const, 0, OP.i32GeS, 0x1b, OP.i32Eqz, OP.brIf, 1);
+        this.statements(stmt.body);
+        this.temps.set(`FOR_STEP_${step}`, { index: step, type });
+        this.symbols[`FOR_STEP_${step}`] = type;
+        this.store(stmt.variable, () => ({ kind: 'binary', op: '+', left: { kind: 'name', name: stmt.variable }, right: { kind: 'name', name: `FOR_STEP_${step}` } }));
+        this.emit(OP.br, 0, OP.end, OP.end);
+        return;
+      }
+      case 'CASE': {
+        const tree = parseExpression(stmt.expression);
+        if (!tree) throw new Unsupported('an expression the IR does not model');
+        const type = this.typeOf(tree);
+        if (valueType(type) !== I32) throw new Unsupported('CASE of REALs');
+        const selector = this.local(I32);
+        this.expression(tree, type);
+        this.emit(OP.localSet, unsigned(selector));
+        const label = (text) => {
+          if (!/^-?\d+$/.test(text)) throw new Unsupported(`the CASE label ${text}`);
+          return Number(text);
+        };
+        stmt.branches.forEach((branch, x) => {
+          branch.labels.forEach((l, y) => {
+            const low = label(l.low);
+            const high = label(l.high);
+            this.emit(OP.localGet, unsigned(selector), OP.i32Const, signed(low), isUnsigned(type) ? OP.i32GeU : OP.i32GeS);
+            this.emit(OP.localGet, unsigned(selector), OP.i32Const, signed(high), isUnsigned(type) ? OP.i32LeU : OP.i32LeS);
+            this.emit(OP.i32And);
+            if (y > 0) this.emit(OP.i32Or);
+          });
+          this.emit(OP.if, VOID);
+          this.statements(branch.body);
+          if (x < stmt.branches.length - 1 || stmt.elseBlock?.length) this.emit(OP.else);
+        });
+        this.statements(stmt.elseBlock);
+        stmt.branches.forEach(() => this.emit(OP.end));
+        return;
+      }
+    }
+    throw new Unsupported(`${stmt.type} statements`);
+  }
+
+  expressionTokens(tokens, type) {
+    const tree = parseExpression(tokens);
+    if (!tree) throw new Unsupported('an expression the IR does not model');
+    this.expression(tree, type);
+  }
+}
+
+/**
+ * Compiles the programs of an optimized tree into a WebAssembly module.
+ * @param {{body: {type: string, name: string, variables: [], varSections: [], statements: []}[]}} ast The program,
+ * optimized with addressReads so that located globals are read and written by address.
+ * @returns {{bytes: Uint8Array, pages: number, programs: string[], skipped: {name: string, reason: string}[]}} Returns
+ * the module, the pages of memory it imports, the programs it exports, and those left to Javascript with the reason.
+ */
+export function transpileWasm(ast) {
+  let offset = IMAGE_BYTES;
+  const bodies = [];
+  const programs = [];
+  const skipped = [];
+  const init = [];
+  const store = (v) => valueType(v.type) === F64
+    ? [OP.i32Const, 0, OP.f64Const, ...float64(v.value), OP.f64Store, 3, ...unsigned(v.offset)]
+    : [OP.i32Const, 0, OP.i32Const, ...signed(v.value), OP.i32Store, 2, ...unsigned(v.offset)];
+  for (const block of ast.body.filter((b) => b.type === 'ProgramDeclaration')) {
+    const state = new Map();
+    const inits = [];
+    try {
+      let next = offset;
+      for (const v of block.varSections ?? []) {
+        const type = v.type?.trim().toUpperCase();
+        if (v.array || !TYPES[type]) throw new Unsupported(`the variable ${v.name} of type ${v.type}`);
+        if (['VAR_EXTERNAL', 'VAR_IN_OUT'].includes(v.sectionType)) throw new Unsupported(`${v.sectionType} variables`);
+        state.set(v.name, { offset: next, type });
+        const text = String(v.initialValue ?? '0').toUpperCase();
+        const value = text === 'TRUE' ? 1 : text === 'FALSE' ? 0 : Number(text);
+        if (!Number.isFinite(value)) throw new Unsupported(`the initial value ${v.initialValue}`);
+        inits.push({ offset: next, type, value, temp: v.sectionType === 'VAR_TEMP' });
+        next += 8;
+      }
+      const prologue = inits.filter((v) => v.temp).flatMap(store);
+      const body = new ProgramCompiler(block, state, prologue).compile();
+      bodies.push(body);
+      programs.push(block.name);
+      init.push(...inits.filter((v) => !v.temp));
+      offset = next;
+    } catch (e) {
+      if (!(e instanceof Unsupported)) throw e;
+      skipped.push({ name: block.name, reason: e.message });
+    }
+  }
+
+  // __init stores the initial values, since a shared memory is only written by the code that uses it.
+  const initBody = [0, ...init.flatMap(store), OP.end];
+  bodies.push([...unsigned(initBody.length), ...initBody]);
+
+  const pages = Math.ceil(offset / PAGE_BYTES);
+  const exports = [...programs, '__init'].map((n, x) => [...name(n), 0x00, ...unsigned(x)]);
+  const bytes = [
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    ...section(1, vector([[0x60, 0, 0]])),
+    // A shared memory of a fixed size, so that its buffer is the SharedArrayBuffer the IO worker attaches to.
+    ...section(2, vector([[...name('env'), ...name('memory'), 0x02, 0x03, ...unsigned(pages), ...unsigned(pages)]])),
+    ...section(3, vector(bodies.map(() => [0]))),
+    ...section(7, vector(exports)),
+    ...section(10, vector(bodies))
+  ];
+  return { bytes: Uint8Array.from(bytes), pages, programs, skipped };
+}
@@ -0,0 +1,247 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "modbusrtu.h"
+#include "nodalishal.h"
+
+// Each line has one transaction at a time, whose request and response share the line's frame buffer. A line is idle
+// until a mapping is due, sends its request, and then waits for the response, or for the turnaround delay after a
+// broadcast. Frames are separated by at least 3.5 characters of silence.
+
+enum ModbusRtuPhase : uint8_t {
+    RTU_IDLE,
+    RTU_SENDING,
+    RTU_WAITING,
+    RTU_TURNAROUND
+};
+
+/**
+ * Computes the CRC of a frame.
+ * @param data The bytes of the frame.
+ * @param length The number of bytes.
+ * @returns Returns the CRC, which is sent low byte first.
+ */
+static uint16_t crc16(const uint8_t* data, uint16_t length) {
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 1) ? static_cast<uint16_t>((crc >> 1) ^ 0xA001) : static_cast<uint16_t>(crc >> 1);
+        }
+    }
+    return crc;
+}
+
+/**
+ * Gets the silence between frames on a line: 3.5 characters of 11 bits, or a fixed 1750 us above 19200 baud.
+ * @param line The line.
+ * @returns Returns the silence, in microseconds.
+ */
+static uint32_t frameSilence(const ModbusRtuLineDefinition& line) {
+    return line.baudRate > 19200 || line.baudRate == 0 ? 1750u : 38500000u / line.baudRate;
+}
+
+static inline uint16_t registerCount(const ModbusRtuMapDefinition& map) {
+    return map.width <= 16 ? 1 : static_cast<uint16_t>(map.width / 16);
+}
+
+static inline uint16_t swapBytes(uint16_t value) {
+    return static_cast<uint16_t>((value << 8) | (value >> 8));
+}
+
+/**
+ * Assembles a value from the registers of a frame.
+ * @param data The registers, 2 big endian bytes each.
+ * @param count The number of registers.
+ * @param order The ModbusRtuOrder flags of the registers.
+ * @returns Returns the value.
+ */
+static uint64_t joinRegisters(const uint8_t* data, uint16_t count, uint8_t order) {
+    uint64_t value = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        const uint8_t* word = data + ((order & MODBUS_RTU_WORD_SWAP) ? count - 1 - i : i) * 2;
+        uint16_t reg = static_cast<uint16_t>((word[0] << 8) | word[1]);
+        value = (value << 16) | ((order & MODBUS_RTU_BYTE_SWAP) ? swapBytes(reg) : reg);
+    }
+    return value;
+}
+
+/**
+ * Splits a value into the registers of a frame. This is the inverse of joinRegisters().
+ * @param value The value.
+ * @param count The number of registers.
+ * @param order The ModbusRtuOrder flags of the registers.
+ * @param out Receives the registers, 2 bytes each.
+ */
+static void splitRegisters(uint64_t value, uint16_t count, uint8_t order, uint8_t* out) {
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t reg = static_cast<uint16_t>(value >> ((count - 1 - i) * 16));
+        reg = (order & MODBUS_RTU_BYTE_SWAP) ? swapBytes(reg) : reg;
+        uint8_t* word = out + ((order & MODBUS_RTU_WORD_SWAP) ? count - 1 - i : i) * 2;
+        word[0] = static_cast<uint8_t>(reg >> 8);
+        word[1] = static_cast<uint8_t>(reg);
+    }
+}
+
+static uint64_t loadLocal(const ModbusRtuMapDefinition& map) {
+    switch (map.width) {
+        case 1: return map.local.getBit() ? 1 : 0;
+        case 8: return loadImageValue<uint8_t>(map.local.data());
+        case 16: return loadImageValue<uint16_t>(map.local.data());
+        case 32: return loadImageValue<uint32_t>(map.local.data());
+    }
+    return loadImageValue<uint64_t>(map.local.data());
+}
+
+static void storeLocal(const ModbusRtuMapDefinition& map, uint64_t value) {
+    switch (map.width) {
+        case 1: map.local.setBit(value != 0); return;
+        case 8: storeImageValue<uint8_t>(map.local.data(), static_cast<uint8_t>(value)); return;
+        case 16: storeImageValue<uint16_t>(map.local.data(), static_cast<uint16_t>(value)); return;
+        case 32: storeImageValue<uint32_t>(map.local.data(), static_cast<uint32_t>(value)); return;
+    }
+    storeImageValue<uint64_t>(map.local.data(), value);
+}
+
+/**
+ * Builds the request of a mapping in a line's frame, and the length of the response it expects.
+ * @param map The mapping.
+ * @param state The line.
+ */
+static void buildRequest(const ModbusRtuMapDefinition& map, ModbusRtuLineState& state) {
+    uint8_t* frame = state.frame;
+    uint16_t count = map.function == 15 || map.function == 1 || map.function == 2 ? 1 : registerCount(map);
+    frame[0] = map.unit;
+    frame[1] = map.function;
+    frame[2] = static_cast<uint8_t>(map.address >> 8);
+    frame[3] = static_cast<uint8_t>(map.address);
+    frame[4] = static_cast<uint8_t>(count >> 8);
+    frame[5] = static_cast<uint8_t>(count);
+    uint16_t length = 6;
+    if (map.function == 15) {
+        frame[6] = 1;
+        frame[7] = loadLocal(map) ? 1 : 0;
+        length = 8;
+        state.expected = 8;
+    }
+    else if (map.function == 16) {
+        uint64_t value = loadLocal(map);
+        frame[6] = static_cast<uint8_t>(count * 2);
+        splitRegisters(map.width == 8 ? value & 0xFF : value, count, map.order, frame + 7);
+        length = static_cast<uint16_t>(7 + count * 2);
+        state.expected = 8;
+    }
+    else {
+        state.expected = map.function <= 2 ? 6 : static_cast<uint16_t>(5 + count * 2);
+    }
+    uint16_t crc = crc16(frame, length);
+    frame[length] = static_cast<uint8_t>(crc);
+    frame[length + 1] = static_cast<uint8_t>(crc >> 8);
+    state.length = static_cast<uint16_t>(length + 2);
+}
+
+/**
+ * Takes a complete response into the image.
+ * @param map The mapping the request was for.
+ * @param state The line, with the response in its frame.
+ * @returns Returns false if the response was not a valid answer to the request.
+ */
+static bool applyResponse(const ModbusRtuMapDefinition& map, ModbusRtuLineState& state) {
+    const uint8_t* frame = state.frame;
+    uint16_t crc = crc16(frame, static_cast<uint16_t>(state.length - 2));
+    if (frame[state.length - 2] != static_cast<uint8_t>(crc) || frame[state.length - 1] != static_cast<uint8_t>(crc >> 8)) {
+        return false;
+    }
+    if (frame[0] != map.unit || frame[1] != map.function) {
+        return false;
+    }
+    if (map.function == 1 || map.function == 2) {
+        storeLocal(map, frame[3] & 1);
+    }
+    else if (map.function == 3 || map.function == 4) {
+        uint64_t value = joinRegisters(frame + 3, registerCount(map), map.order);
+        storeLocal(map, map.width == 8 ? value & 0xFF : value);
+    }
+    return true;
+}
+
+void modbusRtuOpen(const NodalisTarget& target) {
+    for (size_t i = 0; i < target.lineCount; i++) {
+        const ModbusRtuLineDefinition& line = target.lines[i];
+        nodalis_uart_open(line.uart, line.baudRate, line.parity, line.stopBits);
+        target.lineStates[i] = ModbusRtuLineState{};
+        target.lineStates[i].since = nodalisMicros();
+        target.lineStates[i].current = line.first;
+    }
+}
+
+void modbusRtuService(const NodalisTarget& target, uint32_t tick) {
+    uint64_t now = nodalisMicros();
+    for (size_t i = 0; i < target.lineCount; i++) {
+        const ModbusRtuLineDefinition& line = target.lines[i];
+        ModbusRtuLineState& state = target.lineStates[i];
+        const ModbusRtuMapDefinition& map = target.maps[state.current];
+        switch (state.phase) {
+            case RTU_IDLE: {
+                if (now - state.since < frameSilence(line)) break;
+                // The mappings of a line take turns, from the one after the last sent, so that one with a short
+                // interval can't keep the others from being sent.
+                for (uint16_t n = 0; n < line.count; n++) {
+                    uint16_t index = static_cast<uint16_t>(line.first + (state.current - line.first + 1 + n) % line.count);
+                    if (static_cast<int32_t>(tick - target.mapDue[index]) < 0) continue;
+                    target.mapDue[index] = tick + target.maps[index].interval;
+                    state.current = index;
+                    buildRequest(target.maps[index], state);
+                    nodalis_uart_send(line.uart, state.frame, state.length);
+                    state.requests++;
+                    state.phase = RTU_SENDING;
+                    break;
+                }
+                break;
+            }
+            case RTU_SENDING:
+                if (nodalis_uart_sending(line.uart)) break;
+                state.length = 0;
+                state.since = now;
+                state.phase = map.unit == 0 ? RTU_TURNAROUND : RTU_WAITING;
+                break;
+            case RTU_WAITING: {
+                int byte;
+                while (state.length < sizeof(state.frame) && (byte = nodalis_uart_receive(line.uart)) >= 0) {
+                    state.frame[state.length++] = static_cast<uint8_t>(byte);
+                    state.since = now;
+                }
+                // An exception response is 5 bytes, whatever the request.
+                bool exception = state.length >= 2 && (state.frame[1] & 0x80) != 0;
+                if (state.length >= (exception ? 5 : state.expected)) {
+                    if (exception || !applyResponse(map, state)) state.failures++;
+                    state.since = now;
+                    state.phase = RTU_IDLE;
+                }
+                else if (now - state.since >= static_cast<uint64_t>(line.responseTimeout) * 1000u) {
+                    state.failures++;
+                    state.since = now;
+                    state.phase = RTU_IDLE;
+                }
+                break;
+            }
+            case RTU_TURNAROUND:
+                if (now - state.since >= static_cast<uint64_t>(line.turnaroundDelay) * 1000u) {
+                    state.since = now;
+                    state.phase = RTU_IDLE;
+                }
+                break;
+        }
+    }
+}
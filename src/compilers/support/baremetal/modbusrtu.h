@@ -0,0 +1,42 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis Bare-Metal Modbus RTU Master
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+#pragma once
+#ifndef NODALIS_MODBUS_RTU_H
+#define NODALIS_MODBUS_RTU_H
+
+#include "nodalis.h"
+
+/**
+ * Opens the UART of each Modbus RTU line of a program.
+ * @param target The program's tasks and IO.
+ */
+void modbusRtuOpen(const NodalisTarget& target);
+
+/**
+ * Advances the transaction of each Modbus RTU line of a program, without waiting: a request is started when a mapping
+ * of an idle line is due, and a response is taken into the image once all of it has arrived. Called from the
+ * scheduler's loop, between tasks.
+ * @param target The program's tasks and IO.
+ * @param tick The current tick of SysTick.
+ */
+void modbusRtuService(const NodalisTarget& target, uint32_t tick);
+
+#endif // NODALIS_MODBUS_RTU_H
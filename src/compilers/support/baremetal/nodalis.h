@@ -0,0 +1,1416 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Bare-Metal Runtime
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * The runtime of the cortex-m target, which runs a program on a microcontroller without an operating system. It has
+ * the interface the transpiled POUs use from the generic runtime's nodalis.h: the located accessors of the process
+ * image, RefVar, the bit accessors, the standard function blocks, strings and arrays. It is freestanding C++: nothing
+ * is allocated from a heap, nothing throws, and nothing needs RTTI, threads or a file system. The process image is a
+ * static array sized to the addresses the program uses, which the compiler writes to runtimeconfig.h.
+ *
+ * The program's tasks are released by SysTick and its IO is exchanged through the board's drivers (nodalishal.h),
+ * both by scheduler.cpp. The banks of function blocks, the PID and signal blocks and SFC charts of the generic
+ * runtime aren't part of it, and a program that uses them is refused by the compiler.
+ */
+#pragma once
+#ifndef NODALIS_H
+#define NODALIS_H
+
+#include "runtimeconfig.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define NODALIS_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define NODALIS_ALWAYS_INLINE inline
+#endif
+
+#if defined(__clang__)
+#define NODALIS_IVDEP _Pragma("clang loop vectorize(assume_safety)")
+#elif defined(__GNUC__)
+#define NODALIS_IVDEP _Pragma("GCC ivdep")
+#else
+#define NODALIS_IVDEP
+#endif
+
+/**
+ * Stops the controller on an error the program can't continue from, such as an array index out of bounds. The
+ * runtime's definition turns every GPIO output off and waits in a loop; a board may define its own, which must not
+ * return, to report the fault or reset.
+ * @param message What went wrong.
+ */
+extern "C" [[noreturn]] void nodalisFault(const char* message);
+
+#pragma region "Time"
+/**
+ * The time the running task was released, in milliseconds since the scheduler started. It is latched once per
+ * release, so every timer of a task sees the same time.
+ */
+extern uint64_t SCAN_MILLIS;
+/**
+ * Provides the time the current task was released, for timers.
+ * @returns Returns the milliseconds since the scheduler started, as of the release.
+ */
+inline uint64_t scanTime(){
+    return SCAN_MILLIS;
+}
+/**
+ * The nanoseconds in a millisecond. TIME counts milliseconds and LTIME nanoseconds, as in the generic runtime.
+ */
+constexpr int64_t NANOS_PER_MS = 1000000;
+/**
+ * An LTIME, a duration in nanoseconds.
+ */
+typedef int64_t IEC_LTIME;
+/**
+ * Provides the number of milliseconds since the scheduler started.
+ * @returns Returns the elapsed time, in milliseconds.
+ */
+uint64_t elapsed();
+/**
+ * Provides the time since the scheduler started with the resolution of the core clock, from the count of SysTick.
+ * @returns Returns the elapsed time, in microseconds.
+ */
+uint64_t nodalisMicros();
+#pragma endregion
+
+#pragma region "Process Image"
+#ifndef NODALIS_INPUT_BYTES
+#define NODALIS_INPUT_BYTES 64
+#endif
+#ifndef NODALIS_OUTPUT_BYTES
+#define NODALIS_OUTPUT_BYTES 64
+#endif
+#ifndef NODALIS_MEMORY_BYTES
+#define NODALIS_MEMORY_BYTES 256
+#endif
+
+/**
+ * Rounds the size of a space up to 8 bytes, so that each space starts aligned for the widest value.
+ */
+constexpr size_t imageSpaceBytes(size_t bytes){
+    return (bytes + 7) / 8 * 8;
+}
+constexpr size_t INPUT_IMAGE_BYTES = imageSpaceBytes(NODALIS_INPUT_BYTES);
+constexpr size_t OUTPUT_IMAGE_BYTES = imageSpaceBytes(NODALIS_OUTPUT_BYTES);
+constexpr size_t MEMORY_IMAGE_BYTES = imageSpaceBytes(NODALIS_MEMORY_BYTES);
+constexpr size_t PROCESS_IMAGE_BYTES = INPUT_IMAGE_BYTES + OUTPUT_IMAGE_BYTES + MEMORY_IMAGE_BYTES;
+
+/**
+ * The process image: the %I, %Q and %M spaces, one after another, laid out as in the generic runtime. It is defined
+ * by the program, and only the main loop touches it, so it is read and written without atomics or locks.
+ */
+extern uint8_t PROCESS_IMAGE[PROCESS_IMAGE_BYTES];
+
+/**
+ * Defines the memory space designations for use in getting memory addresses.
+ */
+enum MEMORY_SPACE : int {
+    I, //input memory space
+    Q, //output memory space
+    M, //Virtual memory space
+};
+
+template<int Width>
+using MemoryType = std::conditional_t<Width == 8, uint8_t,
+                   std::conditional_t<Width == 16, uint16_t,
+                   std::conditional_t<Width == 32, uint32_t, uint64_t>>>;
+
+template<typename T>
+constexpr bool isImageType = std::is_same_v<T, bool> ||
+    ((std::is_integral_v<T> || std::is_same_v<T, float> || std::is_same_v<T, double>) &&
+     (sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8));
+
+/**
+ * Reinterprets the bits of a value as another type of the same size, which compiles to nothing or a register move.
+ * @param value The value to reinterpret.
+ * @returns Returns the value with the same bits.
+ */
+template<typename To, typename From>
+inline To imageCast(From value){
+    static_assert(sizeof(To) == sizeof(From), "imageCast requires types of the same size");
+    if constexpr (std::is_same_v<To, From>) {
+        return value;
+    } else {
+        To ret;
+        memcpy(&ret, &value, sizeof(To));
+        return ret;
+    }
+}
+
+/**
+ * Reads a value of a type from the image.
+ * @param data The first byte of the value.
+ * @returns Returns the value.
+ */
+template<typename T>
+inline T loadImageValue(const uint8_t* data){
+    static_assert(isImageType<T> && !std::is_same_v<T, bool>, "Unsupported type for the process image");
+    T value;
+    memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+/**
+ * Writes a value of a type to the image.
+ * @param data The first byte of the value.
+ * @param value The value to write.
+ */
+template<typename T>
+inline void storeImageValue(uint8_t* data, T value){
+    static_assert(isImageType<T> && !std::is_same_v<T, bool>, "Unsupported type for the process image");
+    memcpy(data, &value, sizeof(T));
+}
+
+/**
+ * An address that was resolved when the program was compiled, with its offset into the process image.
+ */
+struct ResolvedAddress {
+    /**
+     * The memory space of the address.
+     */
+    int space = -1;
+    /**
+     * The width of the address in bits.
+     */
+    int width = -1;
+    /**
+     * The index of the address, in units of its width.
+     */
+    int index = -1;
+    /**
+     * The bit selected by the address, or -1 if the address does not select a bit.
+     */
+    int bit = -1;
+    /**
+     * The offset of the first byte of the addressed value from the start of the image.
+     */
+    size_t offset = 0;
+    /**
+     * The offset of the byte containing the selected bit from the start of the image.
+     */
+    size_t bitOffset = 0;
+    /**
+     * The mask of the selected bit within its byte.
+     */
+    uint8_t bitMask = 0;
+
+    /**
+     * Gets a pointer to the first byte of the addressed value.
+     */
+    uint8_t* data() const { return PROCESS_IMAGE + offset; }
+    /**
+     * Reads the selected bit.
+     */
+    bool getBit() const { return (PROCESS_IMAGE[bitOffset] & bitMask) != 0; }
+    /**
+     * Writes the selected bit.
+     * @param value The state to set the bit to.
+     */
+    void setBit(bool value) const {
+        if (value) PROCESS_IMAGE[bitOffset] |= bitMask;
+        else PROCESS_IMAGE[bitOffset] &= static_cast<uint8_t>(~bitMask);
+    }
+};
+
+/**
+ * Gets the offset and size of a memory space within the image.
+ * @param space The memory space.
+ * @param size Receives the size of the space in bytes, or 0 if there is no such space.
+ * @returns Returns the offset of the first byte of the space.
+ */
+constexpr size_t memorySpace(int space, size_t& size){
+    switch(space){
+        case MEMORY_SPACE::I: size = INPUT_IMAGE_BYTES; return 0;
+        case MEMORY_SPACE::Q: size = OUTPUT_IMAGE_BYTES; return INPUT_IMAGE_BYTES;
+        case MEMORY_SPACE::M: size = MEMORY_IMAGE_BYTES; return INPUT_IMAGE_BYTES + OUTPUT_IMAGE_BYTES;
+    }
+    size = 0;
+    return 0;
+}
+
+/**
+ * Gets the log2 of the size in bytes of an address width, which converts an index to a byte index.
+ * @param width The width of the address in bits.
+ * @returns Returns the shift, or -1 if the width is invalid.
+ */
+constexpr int widthShift(int width){
+    switch(width){
+        case 8: return 0;
+        case 16: return 1;
+        case 32: return 2;
+        case 64: return 3;
+    }
+    return -1;
+}
+
+/**
+ * Computes the byte offset of a range of bytes within the image. This can be evaluated at compile time.
+ * @param space The memory space of the address.
+ * @param addr The byte index within the memory space.
+ * @param count The number of bytes that must be in the space, starting at addr.
+ * @returns Returns the offset of the byte from the start of the image, or -1 if the bytes are not all in the space.
+ */
+constexpr int memoryOffset(int space, long long addr, long long count = 1){
+    size_t size = 0;
+    size_t base = memorySpace(space, size);
+    if(addr < 0 || count < 1 || static_cast<unsigned long long>(addr + count) > size){
+        return -1;
+    }
+    return static_cast<int>(base + static_cast<size_t>(addr));
+}
+
+/**
+ * Computes the byte offset of an address within the image. This can be evaluated at compile time.
+ * @param space The memory space of the address.
+ * @param width The width of the address in bits.
+ * @param index The index of the address, in units of its width.
+ * @returns Returns the offset of the first byte of the value, or -1 if the value is not entirely in the space.
+ */
+constexpr int addressOffset(int space, int width, long long index){
+    int shift = widthShift(width);
+    if(shift < 0 || index < 0 || index > 0x7fffffff){
+        return -1;
+    }
+    return memoryOffset(space, index << shift, 1ll << shift);
+}
+
+/**
+ * Computes the byte offset of the byte holding a bit of an address within the image. This can be evaluated at
+ * compile time.
+ * @param space The memory space of the address.
+ * @param width The width of the address in bits.
+ * @param index The index of the address, in units of its width.
+ * @param bit The bit, counted from the first byte of the value.
+ * @returns Returns the offset of the byte holding the bit, or -1 if that byte is not in the space.
+ */
+constexpr int bitOffset(int space, int width, long long index, int bit){
+    int shift = widthShift(width);
+    if(shift < 0 || bit < 0 || index < 0 || index > 0x7fffffff){
+        return -1;
+    }
+    return memoryOffset(space, (index << shift) + (bit >> 3));
+}
+
+/**
+ * Reads a located address that was resolved when the program was compiled. An address outside of its memory space
+ * fails to compile.
+ * @tparam Space The memory space of the address.
+ * @tparam Width The width of the address in bits.
+ * @tparam Index The index of the address, in units of its width.
+ * @returns Returns the value in memory.
+ */
+template<int Space, int Width, int Index>
+inline MemoryType<Width> readMemory(){
+    constexpr int offset = addressOffset(Space, Width, Index);
+    static_assert(offset >= 0, "Address is outside of memory");
+    return loadImageValue<MemoryType<Width>>(PROCESS_IMAGE + offset);
+}
+
+/**
+ * Reads a bit from a located address that was resolved when the program was compiled.
+ * @tparam Space The memory space of the address.
+ * @tparam Width The width of the address in bits.
+ * @tparam Index The index of the address, in units of its width.
+ * @tparam Bit The bit to read.
+ * @returns Returns the state of the bit.
+ */
+template<int Space, int Width, int Index, int Bit>
+inline bool readMemoryBit(){
+    static_assert(Bit >= 0, "Invalid address bit");
+    constexpr int offset = bitOffset(Space, Width, Index, Bit);
+    static_assert(offset >= 0, "Address is outside of memory");
+    return (PROCESS_IMAGE[offset] & (1u << (Bit % 8))) != 0;
+}
+
+/**
+ * Writes a bit to a located address that was resolved when the program was compiled.
+ * @tparam Space The memory space of the address.
+ * @tparam Width The width of the address in bits.
+ * @tparam Index The index of the address, in units of its width.
+ * @tparam Bit The bit to write.
+ * @param value The state to set the bit to.
+ */
+template<int Space, int Width, int Index, int Bit>
+inline void writeMemoryBit(bool value){
+    static_assert(Bit >= 0, "Invalid address bit");
+    constexpr int offset = bitOffset(Space, Width, Index, Bit);
+    static_assert(offset >= 0, "Address is outside of memory");
+    if(value) PROCESS_IMAGE[offset] |= static_cast<uint8_t>(1u << (Bit % 8));
+    else PROCESS_IMAGE[offset] &= static_cast<uint8_t>(~(1u << (Bit % 8)));
+}
+
+/**
+ * Writes a located address that was resolved when the program was compiled.
+ * @tparam Space The memory space of the address.
+ * @tparam Width The width of the address in bits.
+ * @tparam Index The index of the address, in units of its width.
+ * @param value The value to write.
+ */
+template<int Space, int Width, int Index>
+inline void writeMemory(MemoryType<Width> value){
+    constexpr int offset = addressOffset(Space, Width, Index);
+    static_assert(offset >= 0, "Address is outside of memory");
+    storeImageValue<MemoryType<Width>>(PROCESS_IMAGE + offset, value);
+}
+
+/**
+ * Reads a located address that was resolved when the program was compiled as a value of a type, such as a REAL
+ * from %MD4 or an INT from %IW2.
+ * @tparam T The type of the value.
+ * @tparam Space The memory space of the address.
+ * @tparam Index The index of the address, in units of the size of the type.
+ * @returns Returns the value.
+ */
+template<typename T, int Space, int Index>
+inline T readMemoryAs(){
+    return imageCast<T>(readMemory<Space, sizeof(T) * 8, Index>());
+}
+
+/**
+ * Writes a value of a type to a located address that was resolved when the program was compiled.
+ * @tparam T The type of the value.
+ * @tparam Space The memory space of the address.
+ * @tparam Index The index of the address, in units of the size of the type.
+ * @param value The value to write.
+ */
+template<typename T, int Space, int Index>
+inline void writeMemoryAs(T value){
+    writeMemory<Space, sizeof(T) * 8, Index>(imageCast<MemoryType<sizeof(T) * 8>>(value));
+}
+
+/**
+ * Resolves a located address that was parsed when the program was compiled. An address outside of its memory
+ * space fails to compile.
+ * @tparam Space The memory space of the address.
+ * @tparam Width The width of the address in bits.
+ * @tparam Index The index of the address, in units of its width.
+ * @tparam Bit The bit selected by the address, or -1 if the address does not select a bit.
+ * @returns Returns the resolved address.
+ */
+template<int Space, int Width, int Index, int Bit = -1>
+constexpr ResolvedAddress locatedAddress(){
+    static_assert(widthShift(Width) >= 0, "Invalid address width");
+    constexpr int offset = Bit < 0 ? addressOffset(Space, Width, Index) : memoryOffset(Space, static_cast<long long>(Index) << widthShift(Width));
+    constexpr int bitByte = Bit < 0 ? offset : bitOffset(Space, Width, Index, Bit);
+    static_assert(offset >= 0 && bitByte >= 0, "Address is outside of memory");
+    ResolvedAddress ret;
+    ret.space = Space;
+    ret.width = Width;
+    ret.index = Index;
+    ret.bit = Bit;
+    ret.offset = static_cast<size_t>(offset);
+    if(Bit >= 0){
+        ret.bitOffset = static_cast<size_t>(bitByte);
+        ret.bitMask = static_cast<uint8_t>(1u << (Bit % 8));
+    }
+    return ret;
+}
+#pragma endregion
+
+#pragma region "Bit Access"
+template<typename T>
+struct BitWord { using type = std::make_unsigned_t<T>; };
+template<>
+struct BitWord<bool> { using type = uint8_t; };
+
+/**
+ * Extracts a field of bits from a word.
+ * @tparam Low The number of the lowest bit of the field.
+ * @tparam Width The number of bits in the field.
+ * @param word The word.
+ * @returns Returns the field, in the low bits.
+ */
+template<int Low, int Width, typename T>
+constexpr T extractBits(T word) {
+    using U = typename BitWord<T>::type;
+    static_assert(Low >= 0 && Width > 0 && Low + Width <= static_cast<int>(sizeof(T) * 8), "Bit field is out of range");
+    constexpr U mask = Width == static_cast<int>(sizeof(U) * 8) ? static_cast<U>(~U(0)) : static_cast<U>((U(1) << Width) - 1);
+    return static_cast<T>(static_cast<U>(static_cast<U>(word) >> Low) & mask);
+}
+/**
+ * Inserts a field of bits into a word.
+ * @tparam Low The number of the lowest bit of the field.
+ * @tparam Width The number of bits in the field.
+ * @param word The word.
+ * @param field The field, in the low bits. Bits above the width are ignored.
+ * @returns Returns the word with the field replaced.
+ */
+template<int Low, int Width, typename T>
+constexpr T insertBits(T word, T field) {
+    using U = typename BitWord<T>::type;
+    static_assert(Low >= 0 && Width > 0 && Low + Width <= static_cast<int>(sizeof(T) * 8), "Bit field is out of range");
+    constexpr U mask = static_cast<U>((Width == static_cast<int>(sizeof(U) * 8) ? static_cast<U>(~U(0))
+        : static_cast<U>((U(1) << Width) - 1)) << Low);
+    return static_cast<T>(static_cast<U>((static_cast<U>(word) & ~mask) | (static_cast<U>(static_cast<U>(field) << Low) & mask)));
+}
+
+/**
+ * Gets a bit of a variable.
+ * @tparam Bit The number of the bit to get.
+ * @param var A pointer to the variable from which to get the bit.
+ * @returns Returns the state of the bit.
+ */
+template<int Bit, typename T>
+constexpr bool getBit(const T* var) {
+    static_assert(Bit >= 0 && Bit < static_cast<int>(sizeof(T) * 8), "Bit number is out of range of the variable");
+    if constexpr (std::is_integral_v<T>) {
+        return (static_cast<typename BitWord<T>::type>(*var) >> Bit) & 1;
+    } else {
+        return (reinterpret_cast<const uint8_t*>(var)[Bit / 8] >> (Bit % 8)) & 1;
+    }
+}
+/**
+ * Sets a bit of a variable.
+ * @tparam Bit The number of the bit to set.
+ * @param var A pointer to the variable to which to set the bit.
+ * @param value The state to set the bit to.
+ */
+template<int Bit, typename T>
+constexpr void setBit(T* var, bool value) {
+    static_assert(Bit >= 0 && Bit < static_cast<int>(sizeof(T) * 8), "Bit number is out of range of the variable");
+    if constexpr (std::is_integral_v<T>) {
+        using U = typename BitWord<T>::type;
+        constexpr U mask = static_cast<U>(U(1) << Bit);
+        U word = static_cast<U>(*var);
+        *var = static_cast<T>(value ? static_cast<U>(word | mask) : static_cast<U>(word & ~mask));
+    } else {
+        uint8_t& byte = reinterpret_cast<uint8_t*>(var)[Bit / 8];
+        byte = value ? static_cast<uint8_t>(byte | (1 << (Bit % 8))) : static_cast<uint8_t>(byte & ~(1 << (Bit % 8)));
+    }
+}
+/**
+ * Gets a bit of a variable, for a bit number that is only known at run time.
+ * @param var A pointer to the variable from which to get the bit.
+ * @param bit The number of the bit to get.
+ * @returns Returns the state of the bit, or false if the variable has no such bit.
+ */
+template<typename T>
+constexpr bool getBit(const T* var, int bit) {
+    if (bit < 0 || bit >= static_cast<int>(sizeof(T) * 8)) {
+        return false;
+    }
+    if constexpr (std::is_integral_v<T>) {
+        return (static_cast<typename BitWord<T>::type>(*var) >> bit) & 1;
+    } else {
+        return (reinterpret_cast<const uint8_t*>(var)[bit / 8] >> (bit % 8)) & 1;
+    }
+}
+/**
+ * Sets a bit of a variable, for a bit number that is only known at run time.
+ * @param var A pointer to the variable to which to set the bit.
+ * @param bit The number of the bit to set. Nothing is written if the variable has no such bit.
+ * @param value The state to set the bit to.
+ */
+template<typename T>
+constexpr void setBit(T* var, int bit, bool value) {
+    if (bit < 0 || bit >= static_cast<int>(sizeof(T) * 8)) {
+        return;
+    }
+    if constexpr (std::is_integral_v<T>) {
+        using U = typename BitWord<T>::type;
+        U mask = static_cast<U>(U(1) << bit);
+        U word = static_cast<U>(*var);
+        *var = static_cast<T>(value ? static_cast<U>(word | mask) : static_cast<U>(word & ~mask));
+    } else {
+        uint8_t& byte = reinterpret_cast<uint8_t*>(var)[bit / 8];
+        byte = value ? static_cast<uint8_t>(byte | (1 << (bit % 8))) : static_cast<uint8_t>(byte & ~(1 << (bit % 8)));
+    }
+}
+#pragma endregion
+
+#pragma region "Reference Handling"
+/**
+ * A variable located in the process image. BOOL references a bit, and the other types a value the width of the type.
+ * Only the addresses resolved when the program was compiled are taken, since there is no address parser.
+ */
+template<typename T>
+class RefVar {
+    static_assert(isImageType<T>, "Unsupported type for RefVar");
+public:
+    /**
+     * Constructs a reference to an address from locatedAddress().
+     * @param resolved The resolved address to reference.
+     */
+    constexpr RefVar(const ResolvedAddress& resolved) noexcept : handle(resolved) {}
+
+    RefVar<T>& operator=(T value) {
+        if constexpr (std::is_same_v<T, bool>) {
+            handle.setBit(value);
+        } else {
+            storeImageValue<T>(handle.data(), value);
+        }
+        return *this;
+    }
+
+    RefVar<T>& operator&(){
+        return *this;
+    }
+
+    operator T() const {
+        if constexpr (std::is_same_v<T, bool>) {
+            return handle.getBit();
+        } else {
+            return loadImageValue<T>(handle.data());
+        }
+    }
+
+private:
+    ResolvedAddress handle;
+};
+
+template<typename T>
+bool getBit(RefVar<T>& var, int bit){
+    T ref = var;
+    return getBit(&ref, bit);
+}
+template<int Bit, typename T>
+bool getBit(RefVar<T>& var){
+    T ref = var;
+    return getBit<Bit>(&ref);
+}
+template<typename T>
+void setBit(RefVar<T>& var, int bit, bool value){
+    T ref = var;
+    setBit(&ref, bit, value);
+    var = ref;
+}
+template<int Bit, typename T>
+void setBit(RefVar<T>& var, bool value){
+    T ref = var;
+    setBit<Bit>(&ref, value);
+    var = ref;
+}
+#pragma endregion
+
+#pragma region "Standard Function Blocks"
+// The timers compare the release time of their task with the time they started, rather than scheduling themselves on
+// a timer wheel as the generic runtime's do, since a small controller has few of them. TP, TON and TOF take TIME in
+// milliseconds, and TP_LTIME, TON_LTIME and TOF_LTIME take LTIME in nanoseconds, measured in whole milliseconds.
+
+/**
+ * Gets the release time of the running task in the unit of a timer.
+ * @tparam Unit The nanoseconds in a unit of the timer.
+ */
+template<int64_t Unit>
+NODALIS_ALWAYS_INLINE uint64_t timerNow() {
+    return scanTime() * static_cast<uint64_t>(NANOS_PER_MS / Unit);
+}
+
+template<typename T, int64_t Unit>
+class TPBlock {
+public:
+    bool Q = false;
+    bool IN = false;
+    T PT = 0;
+    T ET = 0;
+
+    NODALIS_ALWAYS_INLINE void operator()() {
+        uint64_t now = timerNow<Unit>();
+        if (!pulsing && IN && !lastIN) {
+            pulsing = true;
+            startTime = now;
+        }
+        if (pulsing) {
+            ET = static_cast<T>(now - startTime);
+            if (ET >= PT) {
+                ET = PT;
+                pulsing = false;
+            }
+        }
+        else if (!IN) {
+            ET = 0;
+        }
+        Q = pulsing;
+        lastIN = IN;
+    }
+
+private:
+    bool lastIN = false;
+    bool pulsing = false;
+    uint64_t startTime = 0;
+};
+
+// TON: On-delay timer
+template<typename T, int64_t Unit>
+class TONBlock {
+public:
+    bool IN = false;
+    T PT = 0;
+    bool Q = false;
+    T ET = 0;
+
+    NODALIS_ALWAYS_INLINE void operator()() {
+        if (IN) {
+            uint64_t now = timerNow<Unit>();
+            if (!timing) {
+                startTime = now;
+                timing = true;
+            }
+            ET = static_cast<T>(now - startTime);
+            Q = ET >= PT;
+            if (Q) ET = PT;
+        } else {
+            timing = false;
+            ET = 0;
+            Q = false;
+        }
+    }
+
+private:
+    bool timing = false;
+    uint64_t startTime = 0;
+};
+
+// TOF: Off-delay timer
+template<typename T, int64_t Unit>
+class TOFBlock {
+public:
+    bool IN = false;
+    T PT = 0;
+    bool Q = false;
+    T ET = 0;
+
+    NODALIS_ALWAYS_INLINE void operator()() {
+        if (IN) {
+            Q = true;
+            timing = false;
+            ET = 0;
+        } else if (Q) {
+            uint64_t now = timerNow<Unit>();
+            if (!timing) {
+                startTime = now;
+                timing = true;
+            }
+            ET = static_cast<T>(now - startTime);
+            if (ET >= PT) {
+                ET = PT;
+                Q = false;
+            }
+        }
+    }
+
+private:
+    bool timing = false;
+    uint64_t startTime = 0;
+};
+
+using TP = TPBlock<uint64_t, NANOS_PER_MS>;
+using TON = TONBlock<uint64_t, NANOS_PER_MS>;
+using TOF = TOFBlock<uint64_t, NANOS_PER_MS>;
+using TP_LTIME = TPBlock<IEC_LTIME, 1>;
+using TON_LTIME = TONBlock<IEC_LTIME, 1>;
+using TOF_LTIME = TOFBlock<IEC_LTIME, 1>;
+
+// Boolean Logic Gates
+#define BOOL_GATE(NAME, EXPR) \
+class NAME { \
+public: \
+    bool IN1 = false; \
+    bool IN2 = false; \
+    bool OUT = false; \
+    NODALIS_ALWAYS_INLINE void operator()() { OUT = (EXPR); } \
+};
+
+BOOL_GATE(AND, IN1 && IN2)
+BOOL_GATE(OR, IN1 || IN2)
+BOOL_GATE(XOR, IN1 != IN2)
+BOOL_GATE(NOR, !(IN1 || IN2))
+BOOL_GATE(NAND, !(IN1 && IN2))
+#undef BOOL_GATE
+
+class NOT {
+public:
+    bool IN = false;
+    bool OUT = false;
+    NODALIS_ALWAYS_INLINE void operator()() { OUT = !IN; }
+};
+
+class ASSIGNMENT {
+public:
+    bool IN = false;
+    bool OUT = false;
+    NODALIS_ALWAYS_INLINE void operator()() { OUT = IN; }
+};
+
+// Set/Reset flip-flops
+class SR {
+public:
+    bool S1 = false;
+    bool R = false;
+    bool Q1 = false;
+
+    NODALIS_ALWAYS_INLINE void operator()() {
+        if (R) Q1 = false;
+        if (S1) Q1 = true;
+    }
+};
+
+class RS {
+public:
+    bool S = false;
+    bool R1 = false;
+    bool Q1 = false;
+
+    NODALIS_ALWAYS_INLINE void operator()() {
+        if (S) Q1 = true;
+        if (R1) Q1 = false;
+    }
+};
+
+// Rising-edge Trigger
+class R_TRIG {
+public:
+    bool CLK = false;
+    bool OUT = false;
+
+    NODALIS_ALWAYS_INLINE void operator()() {
+        OUT = CLK && !lastCLK;
+        lastCLK = CLK;
+    }
+
+private:
+    bool lastCLK = false;
+};
+
+// Falling-edge Trigger
+class F_TRIG {
+public:
+    bool CLK = false;
+    bool OUT = false;
+
+    NODALIS_ALWAYS_INLINE void operator()() {
+        OUT = !CLK && lastCLK;
+        lastCLK = CLK;
+    }
+
+private:
+    bool lastCLK = false;
+};
+
+// Up Counter
+template<typename T = uint16_t>
+class CTU {
+public:
+    bool CU = false;
+    bool R = false;
+    T PV = 0;
+    T CV = 0;
+    bool Q = false;
+
+    NODALIS_ALWAYS_INLINE void operator()() {
+        if (R) {
+            CV = 0;
+        } else if (CU && !lastCU && CV < (std::numeric_limits<T>::max)()) {
+            CV++;
+        }
+        Q = CV >= PV;
+        lastCU = CU;
+    }
+
+private:
+    bool lastCU = false;
+};
+
+// Down Counter
+template<typename T = uint16_t>
+class CTD {
+public:
+    bool CD = false;
+    bool LD = false;
+    T PV = 0;
+    T CV = 0;
+    bool Q = false;
+
+    NODALIS_ALWAYS_INLINE void operator()() {
+        if (LD) {
+            CV = PV;
+        } else if (CD && !lastCD && CV > 0) {
+            CV--;
+        }
+        Q = CV == 0;
+        lastCD = CD;
+    }
+
+private:
+    bool lastCD = false;
+};
+
+// Up/Down Counter
+template<typename T = uint16_t>
+class CTUD {
+public:
+    bool CU = false;
+    bool CD = false;
+    bool R = false;
+    bool LD = false;
+    T PV = 0;
+    T CV = 0;
+    bool QU = false;
+    bool QD = false;
+
+    NODALIS_ALWAYS_INLINE void operator()() {
+        if (R) {
+            CV = 0;
+        } else if (LD) {
+            CV = PV;
+        } else {
+            if (CU && !lastCU && CV < (std::numeric_limits<T>::max)()) CV++;
+            if (CD && !lastCD && CV > 0) CV--;
+        }
+
+        QU = CV >= PV;
+        QD = CV == 0;
+
+        lastCU = CU;
+        lastCD = CD;
+    }
+
+private:
+    bool lastCU = false;
+    bool lastCD = false;
+};
+
+#define TYPED_COUNTERS(SUFFIX, TYPE) \
+using CTU_##SUFFIX = CTU<TYPE>; \
+using CTD_##SUFFIX = CTD<TYPE>; \
+using CTUD_##SUFFIX = CTUD<TYPE>;
+
+TYPED_COUNTERS(INT, int16_t)
+TYPED_COUNTERS(DINT, int32_t)
+TYPED_COUNTERS(LINT, int64_t)
+TYPED_COUNTERS(UDINT, uint32_t)
+TYPED_COUNTERS(ULINT, uint64_t)
+#undef TYPED_COUNTERS
+
+// Comparison blocks
+#define COMP_BLOCK(NAME, EXPR) \
+template<typename T = uint32_t> \
+class NAME { \
+public: \
+    T IN1 = 0, IN2 = 0; \
+    bool OUT = false; \
+    NODALIS_ALWAYS_INLINE void operator()() { OUT = (EXPR); } \
+};
+
+COMP_BLOCK(EQ, IN1 == IN2)
+COMP_BLOCK(NE, IN1 != IN2)
+COMP_BLOCK(LT, IN1 < IN2)
+COMP_BLOCK(GT, IN1 > IN2)
+COMP_BLOCK(GE, IN1 >= IN2)
+COMP_BLOCK(LE, IN1 <= IN2)
+#undef COMP_BLOCK
+
+template<typename T = uint32_t>
+class MOVE {
+public:
+    T IN = 0;
+    T OUT = 0;
+    NODALIS_ALWAYS_INLINE void operator()() { OUT = IN; }
+};
+
+template<typename T = uint32_t>
+class SEL {
+public:
+    bool G = false;
+    T IN0 = 0, IN1 = 0;
+    T OUT = 0;
+    NODALIS_ALWAYS_INLINE void operator()() { OUT = G ? IN1 : IN0; }
+};
+
+template<typename T = uint32_t>
+class MUX {
+public:
+    bool K = false;
+    T IN0 = 0, IN1 = 0;
+    T OUT = 0;
+    NODALIS_ALWAYS_INLINE void operator()() { OUT = K ? IN1 : IN0; }
+};
+
+template<typename T = uint32_t>
+class MIN {
+public:
+    T IN1 = 0, IN2 = 0;
+    T OUT = 0;
+    NODALIS_ALWAYS_INLINE void operator()() { OUT = IN2 < IN1 ? IN2 : IN1; }
+};
+
+template<typename T = uint32_t>
+class MAX {
+public:
+    T IN1 = 0, IN2 = 0;
+    T OUT = 0;
+    NODALIS_ALWAYS_INLINE void operator()() { OUT = IN1 < IN2 ? IN2 : IN1; }
+};
+
+template<typename T = uint32_t>
+class LIMIT {
+public:
+    T MN = 0, IN = 0, MX = 0;
+    T OUT = 0;
+    NODALIS_ALWAYS_INLINE void operator()() {
+        if (IN < MN) OUT = MN;
+        else if (IN > MX) OUT = MX;
+        else OUT = IN;
+    }
+};
+#pragma endregion
+
+#pragma region "Strings"
+// STRING and WSTRING variables hold their characters inline up to the declared length, as in the generic runtime, so
+// they never allocate. Characters past the capacity of a string are dropped. Positions are 1 based, as in ST.
+
+constexpr size_t IEC_STRING_DEFAULT_LENGTH = 80;
+constexpr size_t IEC_STRING_RESULT_LENGTH = 254;
+
+template<typename CharT>
+struct IECStringView {
+    using value_type = CharT;
+    const CharT* data;
+    size_t size;
+};
+
+template<typename CharT>
+inline size_t stringLength(const CharT* text) {
+    size_t length = 0;
+    while (text != nullptr && text[length] != 0) length++;
+    return length;
+}
+
+template<size_t N, typename CharT = char>
+class IECString {
+public:
+    static constexpr size_t CAPACITY = N;
+
+    IECString() = default;
+    IECString(const CharT* text) { assign(text, stringLength(text)); }
+    IECString(IECStringView<CharT> text) { assign(text.data, text.size); }
+    template<size_t M>
+    IECString(const IECString<M, CharT>& other) { assign(other.data(), other.size()); }
+
+    IECString& operator=(const CharT* text) {
+        assign(text, stringLength(text));
+        return *this;
+    }
+    IECString& operator=(IECStringView<CharT> text) {
+        assign(text.data, text.size);
+        return *this;
+    }
+    template<size_t M>
+    IECString& operator=(const IECString<M, CharT>& other) {
+        assign(other.data(), other.size());
+        return *this;
+    }
+
+    void assign(const CharT* text, size_t count) {
+        used = count < N ? count : N;
+        if (used > 0) memmove(chars, text, used * sizeof(CharT));
+        chars[used] = 0;
+    }
+
+    void append(const CharT* text, size_t count) {
+        size_t room = N - used;
+        count = count < room ? count : room;
+        if (count > 0) memmove(chars + used, text, count * sizeof(CharT));
+        used += count;
+        chars[used] = 0;
+    }
+
+    const CharT* data() const { return chars; }
+    const CharT* c_str() const { return chars; }
+    size_t size() const { return used; }
+    operator IECStringView<CharT>() const { return { chars, used }; }
+
+private:
+    CharT chars[N + 1] = {};
+    size_t used = 0;
+};
+
+template<size_t N, typename CharT>
+inline IECStringView<CharT> stringView(const IECString<N, CharT>& text) { return text; }
+inline IECStringView<char> stringView(const char* text) { return { text, stringLength(text) }; }
+inline IECStringView<char16_t> stringView(const char16_t* text) { return { text, stringLength(text) }; }
+template<typename CharT>
+inline IECStringView<CharT> stringView(IECStringView<CharT> text) { return text; }
+
+template<typename S>
+using StringChar = typename decltype(stringView(std::declval<const S&>()))::value_type;
+
+template<typename S>
+using StringResult = IECString<IEC_STRING_RESULT_LENGTH, StringChar<S>>;
+
+template<typename T>
+inline size_t stringClamp(T value, size_t limit) {
+    if (value <= 0) return 0;
+    return static_cast<uint64_t>(value) < limit ? static_cast<size_t>(value) : limit;
+}
+
+template<typename CharT>
+inline int compareStrings(IECStringView<CharT> a, IECStringView<CharT> b) {
+    size_t count = a.size < b.size ? a.size : b.size;
+    for (size_t x = 0; x < count; x++) {
+        if (a.data[x] != b.data[x]) return a.data[x] < b.data[x] ? -1 : 1;
+    }
+    return a.size == b.size ? 0 : (a.size < b.size ? -1 : 1);
+}
+
+#define IEC_STRING_COMPARISON(OP) \
+template<size_t N, size_t M, typename CharT> \
+inline bool operator OP(const IECString<N, CharT>& a, const IECString<M, CharT>& b) { return compareStrings(stringView(a), stringView(b)) OP 0; } \
+template<size_t N, typename CharT> \
+inline bool operator OP(const IECString<N, CharT>& a, const CharT* b) { return compareStrings(stringView(a), stringView(b)) OP 0; } \
+template<size_t N, typename CharT> \
+inline bool operator OP(const CharT* a, const IECString<N, CharT>& b) { return compareStrings(stringView(a), stringView(b)) OP 0; }
+IEC_STRING_COMPARISON(==)
+IEC_STRING_COMPARISON(!=)
+IEC_STRING_COMPARISON(<)
+IEC_STRING_COMPARISON(>)
+IEC_STRING_COMPARISON(<=)
+IEC_STRING_COMPARISON(>=)
+#undef IEC_STRING_COMPARISON
+
+template<typename S>
+inline int16_t LEN(const S& in) { return static_cast<int16_t>(stringView(in).size); }
+
+template<typename S, typename L>
+inline StringResult<S> LEFT(const S& in, L l) {
+    auto text = stringView(in);
+    return IECStringView<StringChar<S>>{ text.data, stringClamp(l, text.size) };
+}
+
+template<typename S, typename L>
+inline StringResult<S> RIGHT(const S& in, L l) {
+    auto text = stringView(in);
+    size_t count = stringClamp(l, text.size);
+    return IECStringView<StringChar<S>>{ text.data + text.size - count, count };
+}
+
+template<typename S, typename L, typename P>
+inline StringResult<S> MID(const S& in, L l, P p) {
+    auto text = stringView(in);
+    size_t start = stringClamp(p, text.size + 1);
+    if (start == 0) return {};
+    size_t count = stringClamp(l, text.size - (start - 1));
+    return IECStringView<StringChar<S>>{ text.data + start - 1, count };
+}
+
+template<typename S, typename... Rest>
+inline StringResult<S> CONCAT(const S& first, const Rest&... rest) {
+    StringResult<S> result = stringView(first);
+    (result.append(stringView(rest).data, stringView(rest).size), ...);
+    return result;
+}
+
+template<typename S1, typename S2, typename P>
+inline StringResult<S1> INSERT(const S1& in1, const S2& in2, P p) {
+    auto text = stringView(in1);
+    size_t at = stringClamp(p, text.size);
+    StringResult<S1> result = IECStringView<StringChar<S1>>{ text.data, at };
+    result.append(stringView(in2).data, stringView(in2).size);
+    result.append(text.data + at, text.size - at);
+    return result;
+}
+
+template<typename S, typename L, typename P>
+inline StringResult<S> DELETE(const S& in, L l, P p) {
+    auto text = stringView(in);
+    size_t start = stringClamp(p, text.size + 1);
+    if (start == 0) return text;
+    size_t count = stringClamp(l, text.size - (start - 1));
+    StringResult<S> result = IECStringView<StringChar<S>>{ text.data, start - 1 };
+    result.append(text.data + start - 1 + count, text.size - (start - 1) - count);
+    return result;
+}
+
+template<typename S1, typename S2, typename L, typename P>
+inline StringResult<S1> REPLACE(const S1& in1, const S2& in2, L l, P p) {
+    auto text = stringView(in1);
+    size_t start = stringClamp(p, text.size + 1);
+    start = start == 0 ? 1 : start;
+    size_t count = stringClamp(l, text.size - (start - 1));
+    StringResult<S1> result = IECStringView<StringChar<S1>>{ text.data, start - 1 };
+    result.append(stringView(in2).data, stringView(in2).size);
+    result.append(text.data + start - 1 + count, text.size - (start - 1) - count);
+    return result;
+}
+
+template<typename S1, typename S2>
+inline int16_t FIND(const S1& in1, const S2& in2) {
+    auto text = stringView(in1);
+    auto pattern = stringView(in2);
+    if (pattern.size == 0 || pattern.size > text.size) return 0;
+    for (size_t x = 0; x + pattern.size <= text.size; x++) {
+        if (memcmp(text.data + x, pattern.data, pattern.size * sizeof(StringChar<S1>)) == 0) {
+            return static_cast<int16_t>(x + 1);
+        }
+    }
+    return 0;
+}
+
+typedef uint32_t IEC_DATE;
+typedef uint32_t IEC_TIME_OF_DAY;
+typedef uint32_t IEC_DATE_AND_TIME;
+typedef int64_t IEC_LDATE;
+typedef int64_t IEC_LTIME_OF_DAY;
+typedef int64_t IEC_LDATE_AND_TIME;
+#pragma endregion
+
+#pragma region "Arrays"
+/**
+ * With NODALIS_ARRAY_BOUNDS_CHECK 1, indexing an ST array outside of its bounds stops the controller with
+ * nodalisFault(). By default the index is not checked.
+ */
+#ifndef NODALIS_ARRAY_BOUNDS_CHECK
+#define NODALIS_ARRAY_BOUNDS_CHECK 0
+#endif
+
+template<typename T>
+using ForCounter = decltype(+T());
+
+/**
+ * An ST ARRAY [Low..High] OF T, stored inline and indexed with the bounds of the ST declaration.
+ * @tparam T The type of the elements.
+ * @tparam Low The lower bound.
+ * @tparam High The upper bound.
+ */
+template<typename T, int64_t Low, int64_t High>
+class IECArray {
+    static_assert(High >= Low, "The upper bound of an array can't be below its lower bound");
+public:
+    static constexpr size_t N = static_cast<size_t>(High - Low + 1);
+
+    template<typename I>
+    T& operator[](I index) { return items[offset(index)]; }
+    template<typename I>
+    const T& operator[](I index) const { return items[offset(index)]; }
+
+    void operator()() {
+        for (auto& item : items) item();
+    }
+
+    T* begin() { return items; }
+    T* end() { return items + N; }
+    const T* begin() const { return items; }
+    const T* end() const { return items + N; }
+    static constexpr size_t size() { return N; }
+
+private:
+    template<typename I>
+    static size_t offset(I index) {
+#if NODALIS_ARRAY_BOUNDS_CHECK
+        if (static_cast<int64_t>(index) < Low || static_cast<int64_t>(index) > High) {
+            nodalisFault("Array index is out of bounds");
+        }
+#endif
+        return static_cast<size_t>(static_cast<int64_t>(index) - Low);
+    }
+
+    T items[N] = {};
+};
+#pragma endregion
+
+// The standard numeric, bit shift and conversion functions, shared with the generic runtime, which the compiler copies
+// beside this header.
+#include "iecfunctions.h"
+
+#pragma region "Tasks and IO"
+/**
+ * A cyclic task of the program. The scheduler keeps its statistics in it, which a debugger can read.
+ */
+struct NodalisTask {
+    /**
+     * The name of the task.
+     */
+    const char* name;
+    /**
+     * The interval of the task, in milliseconds (SysTick periods).
+     */
+    uint32_t interval;
+    /**
+     * The IEC priority of the task. 0 is the highest priority.
+     */
+    uint8_t priority;
+    /**
+     * Runs the program instances of the task.
+     */
+    void (*run)();
+    /**
+     * The tick of the next release.
+     */
+    uint32_t next;
+    /**
+     * The number of times the task ran.
+     */
+    uint32_t runs;
+    /**
+     * The number of releases that were skipped because the task was still behind.
+     */
+    uint32_t overruns;
+    /**
+     * The execution time of the last run, and the longest, in microseconds.
+     */
+    uint32_t lastMicros;
+    uint32_t maxMicros;
+    /**
+     * The longest time from a release to the start of its run, in microseconds.
+     */
+    uint32_t maxLatenessMicros;
+};
+
+/**
+ * A GPIO pin mapped to a bit of the image (GPIO). Inputs are sampled right before a task runs, and outputs driven
+ * right after it.
+ */
+struct GpioMapDefinition {
+    /**
+     * The port of the pin, as the board numbers them (ModuleID).
+     */
+    uint8_t port;
+    /**
+     * The pin within the port (RemoteAddress).
+     */
+    uint8_t pin;
+    /**
+     * Whether the pin drives a %Q bit, rather than sampling into a %I bit.
+     */
+    bool output;
+    /**
+     * Whether the pin is low when the bit is set (ActiveLow).
+     */
+    bool activeLow;
+    /**
+     * The bit of the image.
+     */
+    ResolvedAddress local;
+};
+
+/**
+ * A serial line of Modbus RTU slaves (MODBUS-RTU), whose mappings are rows first to first + count - 1 of the map table.
+ */
+struct ModbusRtuLineDefinition {
+    /**
+     * The UART of the line, as the board numbers them (ModulePort).
+     */
+    uint8_t uart;
+    uint32_t baudRate;
+    /**
+     * 'E', 'O' or 'N'.
+     */
+    char parity;
+    uint8_t stopBits;
+    /**
+     * The time a slave has to answer, in milliseconds (ResponseTimeout).
+     */
+    uint32_t responseTimeout;
+    /**
+     * The silence after a broadcast, in milliseconds (TurnaroundDelay).
+     */
+    uint32_t turnaroundDelay;
+    uint16_t first;
+    uint16_t count;
+};
+
+/**
+ * The word order of a register value of more than one register (WordOrder): ABCD, CDAB, BADC or DCBA.
+ */
+enum ModbusRtuOrder : uint8_t {
+    MODBUS_RTU_WORD_SWAP = 1,
+    MODBUS_RTU_BYTE_SWAP = 2
+};
+
+/**
+ * A value of a Modbus RTU slave mapped to the image.
+ */
+struct ModbusRtuMapDefinition {
+    /**
+     * The address of the slave (ModuleID). Outputs to slave 0 are broadcast.
+     */
+    uint8_t unit;
+    /**
+     * The function read or written with: 1 to 4 for an input, 15 or 16 for an output.
+     */
+    uint8_t function;
+    /**
+     * The first coil, input or register (RemoteAddress).
+     */
+    uint16_t address;
+    /**
+     * The width of the value in bits (RemoteSize): 1 for a bit, otherwise 8, 16, 32 or 64.
+     */
+    uint8_t width;
+    /**
+     * The ModbusRtuOrder flags of the value's registers.
+     */
+    uint8_t order;
+    /**
+     * The interval the value is read or written at, in milliseconds (PollTime).
+     */
+    uint32_t interval;
+    /**
+     * The location of the value in the image.
+     */
+    ResolvedAddress local;
+};
+
+/**
+ * The state of a Modbus RTU line, which the program allocates statically for each line.
+ */
+struct ModbusRtuLineState {
+    uint8_t frame[256];
+    uint16_t length;
+    uint16_t expected;
+    uint16_t current;
+    uint8_t phase;
+    uint64_t since;
+    uint32_t requests;
+    uint32_t failures;
+};
+
+/**
+ * The program's tasks and IO, which it hands to the scheduler.
+ */
+struct NodalisTarget {
+    NodalisTask* tasks;
+    size_t taskCount;
+    const GpioMapDefinition* gpio;
+    size_t gpioCount;
+    const ModbusRtuLineDefinition* lines;
+    ModbusRtuLineState* lineStates;
+    size_t lineCount;
+    const ModbusRtuMapDefinition* maps;
+    /**
+     * The tick each mapping is next due at, one for each row of maps.
+     */
+    uint32_t* mapDue;
+};
+
+/**
+ * Starts SysTick and runs the tasks of a program, forever. Called by the program's main().
+ * @param target The program's tasks and IO.
+ */
+[[noreturn]] void nodalisRun(const NodalisTarget& target);
+#pragma endregion
+
+#endif // NODALIS_H
@@ -0,0 +1,108 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis Bare-Metal Board Interface
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * The functions the bare-metal runtime calls to reach the pins and serial ports of a board. Each is defined weakly by
+ * the runtime, to do nothing, so a board only defines the ones it has; they have C linkage, so they may be written
+ * in C on top of a vendor's HAL. None of them may block, since they are called from the scheduler's loop.
+ */
+#pragma once
+#ifndef NODALIS_HAL_H
+#define NODALIS_HAL_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Sets up the clocks and peripherals of the board, before the scheduler starts.
+ */
+void nodalis_hal_init(void);
+
+/**
+ * Provides the frequency SysTick counts at, which sets its reload for a 1 ms tick.
+ * @returns Returns the frequency of the core clock, in Hz. The runtime's definition returns SystemCoreClock if the
+ * board's CMSIS defines it, otherwise 16 MHz.
+ */
+uint32_t nodalis_hal_core_clock(void);
+
+/**
+ * Configures a pin as an input or a push-pull output.
+ * @param port The port of the pin, as the board numbers them.
+ * @param pin The pin within the port.
+ * @param output Nonzero to make the pin an output.
+ */
+void nodalis_gpio_configure(uint8_t port, uint8_t pin, int output);
+
+/**
+ * Reads the level of a pin.
+ * @param port The port of the pin.
+ * @param pin The pin within the port.
+ * @returns Returns nonzero if the pin is high.
+ */
+int nodalis_gpio_read(uint8_t port, uint8_t pin);
+
+/**
+ * Drives a pin.
+ * @param port The port of the pin.
+ * @param pin The pin within the port.
+ * @param high Nonzero to drive the pin high.
+ */
+void nodalis_gpio_write(uint8_t port, uint8_t pin, int high);
+
+/**
+ * Opens a UART, with 8 data bits, and with its RS-485 driver turned on while it sends if it has one.
+ * @param uart The UART, as the board numbers them.
+ * @param baudRate The baud rate.
+ * @param parity 'E', 'O' or 'N'.
+ * @param stopBits 1 or 2.
+ * @returns Returns nonzero if the UART was opened.
+ */
+int nodalis_uart_open(uint8_t uart, uint32_t baudRate, char parity, uint8_t stopBits);
+
+/**
+ * Starts sending bytes from a UART, typically by DMA or from its interrupt. The bytes stay valid until
+ * nodalis_uart_sending() returns zero.
+ * @param uart The UART.
+ * @param data The bytes to send.
+ * @param length The number of bytes.
+ */
+void nodalis_uart_send(uint8_t uart, const uint8_t* data, uint16_t length);
+
+/**
+ * Tells whether a UART is still sending, including its last stop bit.
+ * @param uart The UART.
+ * @returns Returns nonzero while the UART is sending.
+ */
+int nodalis_uart_sending(uint8_t uart);
+
+/**
+ * Takes the next byte a UART received, from the board's receive buffer.
+ * @param uart The UART.
+ * @returns Returns the byte, or -1 if no byte is waiting.
+ */
+int nodalis_uart_receive(uint8_t uart);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NODALIS_HAL_H
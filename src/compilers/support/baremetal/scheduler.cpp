@@ -0,0 +1,180 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nodalis.h"
+#include "nodalishal.h"
+#include "modbusrtu.h"
+
+// SysTick counts down from its reload at the core clock and interrupts every millisecond. Its registers are
+// architectural, so they are the same on every Cortex-M and need no vendor header.
+#define SYST_CSR (*reinterpret_cast<volatile uint32_t*>(0xE000E010u))
+#define SYST_RVR (*reinterpret_cast<volatile uint32_t*>(0xE000E014u))
+#define SYST_CVR (*reinterpret_cast<volatile uint32_t*>(0xE000E018u))
+
+uint64_t SCAN_MILLIS = 0;
+static volatile uint64_t TICKS = 0;
+static uint32_t RELOAD = 0;
+static const NodalisTarget* ACTIVE_TARGET = nullptr;
+
+extern "C" uint32_t SystemCoreClock __attribute__((weak));
+
+extern "C" void SysTick_Handler(void) {
+    TICKS = TICKS + 1;
+}
+
+#pragma region "Board Defaults"
+extern "C" {
+__attribute__((weak)) void nodalis_hal_init(void) {}
+__attribute__((weak)) uint32_t nodalis_hal_core_clock(void) {
+    return &SystemCoreClock != nullptr && SystemCoreClock != 0 ? SystemCoreClock : 16000000u;
+}
+__attribute__((weak)) void nodalis_gpio_configure(uint8_t, uint8_t, int) {}
+__attribute__((weak)) int nodalis_gpio_read(uint8_t, uint8_t) { return 0; }
+__attribute__((weak)) void nodalis_gpio_write(uint8_t, uint8_t, int) {}
+__attribute__((weak)) int nodalis_uart_open(uint8_t, uint32_t, char, uint8_t) { return 0; }
+__attribute__((weak)) void nodalis_uart_send(uint8_t, const uint8_t*, uint16_t) {}
+__attribute__((weak)) int nodalis_uart_sending(uint8_t) { return 0; }
+__attribute__((weak)) int nodalis_uart_receive(uint8_t) { return -1; }
+
+__attribute__((weak)) void nodalisFault(const char*) {
+    if (ACTIVE_TARGET != nullptr) {
+        for (size_t i = 0; i < ACTIVE_TARGET->gpioCount; i++) {
+            const GpioMapDefinition& pin = ACTIVE_TARGET->gpio[i];
+            if (pin.output) nodalis_gpio_write(pin.port, pin.pin, pin.activeLow);
+        }
+    }
+    for (;;) {}
+}
+}
+#pragma endregion
+
+#pragma region "Time"
+/**
+ * Reads the tick count, which the SysTick interrupt may change between the reads of its two halves.
+ */
+static uint64_t ticks() {
+    uint64_t value;
+    do {
+        value = TICKS;
+    } while (value != TICKS);
+    return value;
+}
+
+uint64_t elapsed() {
+    return ticks();
+}
+
+uint64_t nodalisMicros() {
+    uint64_t tick;
+    uint32_t count;
+    do {
+        tick = TICKS;
+        count = SYST_CVR;
+    } while (tick != TICKS);
+    return tick * 1000u + static_cast<uint64_t>(RELOAD - count) * 1000u / (static_cast<uint64_t>(RELOAD) + 1);
+}
+#pragma endregion
+
+#pragma region "Scheduler"
+/**
+ * Samples the GPIO inputs into the image.
+ */
+static void sampleInputs(const NodalisTarget& target) {
+    for (size_t i = 0; i < target.gpioCount; i++) {
+        const GpioMapDefinition& pin = target.gpio[i];
+        if (!pin.output) pin.local.setBit((nodalis_gpio_read(pin.port, pin.pin) != 0) != pin.activeLow);
+    }
+}
+
+/**
+ * Drives the GPIO outputs from the image.
+ */
+static void driveOutputs(const NodalisTarget& target) {
+    for (size_t i = 0; i < target.gpioCount; i++) {
+        const GpioMapDefinition& pin = target.gpio[i];
+        if (pin.output) nodalis_gpio_write(pin.port, pin.pin, pin.local.getBit() != pin.activeLow);
+    }
+}
+
+static inline void waitForInterrupt() {
+#if defined(__arm__) || defined(__thumb__)
+    __asm volatile ("wfi");
+#endif
+}
+
+// Tasks don't preempt each other. At each pass, the highest priority task that is due runs to completion, and the
+// Modbus lines are serviced between tasks; when nothing is due, the core sleeps until the next interrupt. A task
+// that is behind by a whole interval skips the releases it missed, which count as overruns, rather than running
+// several times in a row.
+void nodalisRun(const NodalisTarget& target) {
+    ACTIVE_TARGET = &target;
+    nodalis_hal_init();
+    for (size_t i = 0; i < target.gpioCount; i++) {
+        const GpioMapDefinition& pin = target.gpio[i];
+        nodalis_gpio_configure(pin.port, pin.pin, pin.output);
+        if (pin.output) nodalis_gpio_write(pin.port, pin.pin, pin.activeLow);
+    }
+
+    RELOAD = nodalis_hal_core_clock() / 1000u - 1;
+    SYST_RVR = RELOAD;
+    SYST_CVR = 0;
+    SYST_CSR = 7;
+    modbusRtuOpen(target);
+
+    uint32_t start = static_cast<uint32_t>(ticks());
+    for (size_t i = 0; i < target.taskCount; i++) {
+        target.tasks[i].next = start;
+    }
+    for (size_t i = 0; i < target.lineCount; i++) {
+        for (uint16_t m = 0; m < target.lines[i].count; m++) {
+            target.mapDue[target.lines[i].first + m] = start;
+        }
+    }
+
+    for (;;) {
+        uint32_t now = static_cast<uint32_t>(ticks());
+        NodalisTask* due = nullptr;
+        for (size_t i = 0; i < target.taskCount; i++) {
+            NodalisTask& task = target.tasks[i];
+            if (static_cast<int32_t>(now - task.next) >= 0 && (due == nullptr || task.priority < due->priority)) {
+                due = &task;
+            }
+        }
+        if (due != nullptr) {
+            uint64_t begin = nodalisMicros();
+            uint32_t lateness = static_cast<uint32_t>(begin) - due->next * 1000u;
+            if (lateness > due->maxLatenessMicros) due->maxLatenessMicros = lateness;
+            SCAN_MILLIS = begin / 1000u;
+            sampleInputs(target);
+            due->run();
+            driveOutputs(target);
+            due->lastMicros = static_cast<uint32_t>(nodalisMicros() - begin);
+            if (due->lastMicros > due->maxMicros) due->maxMicros = due->lastMicros;
+            due->runs++;
+
+            uint32_t interval = due->interval == 0 ? 1 : due->interval;
+            due->next += interval;
+            uint32_t after = static_cast<uint32_t>(ticks());
+            if (static_cast<int32_t>(after - due->next) >= 0) {
+                uint32_t missed = (after - due->next) / interval + 1;
+                due->overruns += missed;
+                due->next += missed * interval;
+            }
+        }
+        uint32_t tick = static_cast<uint32_t>(ticks());
+        modbusRtuService(target, tick);
+        if (due == nullptr && tick == now) waitForInterrupt();
+    }
+}
+#pragma endregion
@@ -0,0 +1,379 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Alarms
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+#include "alarms.h"
+#include "nodalis.h"
+#include <algorithm>
+#include <array>
+#include <ctime>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+
+/**
+ * How long the alarm thread sleeps between drains of the ring, in milliseconds.
+ */
+static constexpr int ALARM_DRAIN_WAIT = 20;
+
+/**
+ * A declared alarm.
+ */
+struct Alarm {
+    std::string name;
+    std::string address;
+    size_t word;            // The index of its word in the alarm engine.
+    uint64_t mask;          // Its bit in the word.
+};
+
+/**
+ * A 64 bit word of the image that holds alarms. The scan thread is the only one that writes active and
+ * unacknowledged, which other threads read; any thread sets bits of acknowledge, which the scan thread takes.
+ */
+struct AlarmWord {
+    size_t index = 0;                           // The index of the word in MEMORY.
+    uint64_t mask = 0;                          // The bits of the word that are alarms.
+    std::array<uint32_t, 64> alarms{};          // The alarm of each bit of mask.
+    std::atomic<uint64_t> active{0};            // The alarms that were set in the last scan.
+    std::atomic<uint64_t> unacknowledged{0};    // The alarms that were raised and not acknowledged.
+    std::atomic<uint64_t> acknowledge{0};       // The acknowledgements to take with the next scan.
+};
+
+/**
+ * An entry of the ring between the scan thread and the alarm thread.
+ */
+struct AlarmRecord {
+    uint64_t micros;
+    uint32_t alarm;
+    AlarmEventKind kind;
+};
+
+class AlarmEngine {
+public:
+    bool open(const RuntimeOptions& options);
+    void evaluate(uint64_t micros) {
+        for (size_t k = 0; k < wordCount; k++) {
+            AlarmWord& word = words[k];
+            uint64_t cur = MEMORY[word.index] & word.mask;
+            uint64_t prev = word.active.load(std::memory_order_relaxed);
+            uint64_t acknowledged = word.acknowledge.load(std::memory_order_relaxed);
+            if (cur == prev && acknowledged == 0) {
+                continue;
+            }
+            uint64_t unacknowledged = word.unacknowledged.load(std::memory_order_relaxed);
+            if (acknowledged != 0) {
+                acknowledged = word.acknowledge.exchange(0, std::memory_order_acq_rel) & unacknowledged;
+            }
+            uint64_t raised = cur & ~prev;
+            uint64_t cleared = prev & ~cur;
+            // An acknowledgement is of the alarm as it was, so an alarm raised again in the same scan is unacknowledged.
+            word.unacknowledged.store((unacknowledged & ~acknowledged) | raised, std::memory_order_relaxed);
+            word.active.store(cur, std::memory_order_relaxed);
+            forEachBankBit(acknowledged, 0, [&](size_t bit) { push(micros, word.alarms[bit], AlarmEventKind::Acknowledged); });
+            forEachBankBit(cleared, 0, [&](size_t bit) { push(micros, word.alarms[bit], AlarmEventKind::Cleared); });
+            forEachBankBit(raised, 0, [&](size_t bit) { push(micros, word.alarms[bit], AlarmEventKind::Raised); });
+        }
+    }
+    bool acknowledge(const std::string& name);
+    void acknowledgeAll();
+    std::vector<AlarmState> list();
+    size_t count(bool active);
+    void setListener(std::function<void(const AlarmEvent&)> callback);
+    void drain();
+
+    std::atomic<bool> running{false};
+
+private:
+    std::vector<Alarm> alarms;      // In the order of their addresses.
+    std::unordered_map<std::string, uint32_t> byName;   // The alarms by lower case name and by address.
+    std::unique_ptr<AlarmWord[]> words;
+    size_t wordCount = 0;
+    /**
+     * The wall clock time the runtime started at, in microseconds since the Unix epoch, which scan times are added to.
+     */
+    int64_t epoch = 0;
+    std::vector<AlarmRecord> ring;
+    uint64_t capacity = 0;
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    alignas(64) std::atomic<uint64_t> dropped{0};
+    uint64_t reported = 0;          // The dropped events the alarm thread has written about.
+    FILE* log = stdout;         // The alarm log, which stays open until the runtime exits.
+    /**
+     * Guards the drain, which the alarm thread and closeAlarms() both do, and the listener.
+     */
+    std::mutex drainMutex;
+    std::function<void(const AlarmEvent&)> listener;
+
+    void push(uint64_t micros, uint32_t alarm, AlarmEventKind kind) {
+        uint64_t slot = head.load(std::memory_order_relaxed);
+        if (slot - tail.load(std::memory_order_acquire) >= capacity) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        ring[slot & (capacity - 1)] = AlarmRecord{ micros, alarm, kind };
+        head.store(slot + 1, std::memory_order_release);
+    }
+};
+
+static AlarmEngine ALARMS;
+
+/**
+ * Formats a time as an ISO 8601 date and time in UTC, to the microsecond.
+ */
+static std::string formatTime(int64_t micros) {
+    std::time_t seconds = static_cast<std::time_t>(micros / 1000000);
+    std::tm utc{};
+#ifdef _WIN32
+    gmtime_s(&utc, &seconds);
+#else
+    gmtime_r(&seconds, &utc);
+#endif
+    char text[40];
+    std::snprintf(text, sizeof(text), "%04d-%02d-%02dT%02d:%02d:%02d.%06dZ", utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday,
+        utc.tm_hour, utc.tm_min, utc.tm_sec, static_cast<int>(micros % 1000000));
+    return text;
+}
+
+static const char* kindText(AlarmEventKind kind) {
+    switch (kind) {
+        case AlarmEventKind::Raised: return "RAISED";
+        case AlarmEventKind::Cleared: return "CLEARED";
+        default: return "ACKNOWLEDGED";
+    }
+}
+
+bool AlarmEngine::open(const RuntimeOptions& options) {
+    size_t symbolCount = 0;
+    const ImageSymbol* symbols = registeredImageSymbols(symbolCount);
+    struct Declared {
+        Alarm alarm;
+        size_t bit;         // The bit of the image, counted from its start.
+    };
+    std::vector<Declared> declared;
+    std::string list = options.alarms;
+    size_t from = 0;
+    while (from <= list.size()) {
+        size_t comma = list.find(',', from);
+        std::string name = list.substr(from, comma == std::string::npos ? std::string::npos : comma - from);
+        from = comma == std::string::npos ? list.size() + 1 : comma + 1;
+        name.erase(0, name.find_first_not_of(' '));
+        name.erase(name.find_last_not_of(' ') + 1);
+        if (name.empty()) {
+            continue;
+        }
+        // An alarm is a located global by name, or a bit address, which takes the name of the global located at it.
+        std::string address = name;
+        if (const char* located = findSymbolAddress(name)) {
+            address = located;
+        }
+        else {
+            for (size_t s = 0; s < symbolCount; s++) {
+                if (name == symbols[s].address) {
+                    name = symbols[s].name;
+                }
+            }
+        }
+        ResolvedAddress resolved;
+        AddressStatus status = tryResolveAddress(address, -1, true, resolved);
+        if (status == AddressStatus::OK && resolved.bit < 0) {
+            nodalisLog() << "Can't raise " << name << " as an alarm: " << address << " is not a bit\n";
+            continue;
+        }
+        if (status != AddressStatus::OK) {
+            nodalisLog() << "Can't raise " << name << " as an alarm: " << addressStatusText(status) << "\n";
+            continue;
+        }
+        size_t bit = resolved.bitOffset * 8 + static_cast<size_t>(countTrailingZeros(resolved.bitMask));
+        auto same = std::find_if(declared.begin(), declared.end(), [bit](const Declared& d) { return d.bit == bit; });
+        if (same != declared.end()) {
+            nodalisLog() << "Can't raise " << name << " as an alarm: " << address << " is already the alarm " << same->alarm.name << "\n";
+            continue;
+        }
+        declared.push_back(Declared{ Alarm{ name, address, 0, 0 }, bit });
+    }
+    if (declared.empty()) {
+        return false;
+    }
+
+    // The alarms are grouped by the 64 bit word of the image they are in. The image is little endian, so the bit of
+    // a byte b of a word is at 8 * b in the word.
+    std::sort(declared.begin(), declared.end(), [](const Declared& a, const Declared& b) { return a.bit < b.bit; });
+    wordCount = 0;
+    for (size_t d = 0; d < declared.size(); d++) {
+        if (d == 0 || declared[d].bit / 64 != declared[d - 1].bit / 64) {
+            wordCount++;
+        }
+    }
+    words = std::make_unique<AlarmWord[]>(wordCount);
+    size_t k = 0;
+    for (size_t d = 0; d < declared.size(); d++) {
+        if (d > 0 && declared[d].bit / 64 != declared[d - 1].bit / 64) {
+            k++;
+        }
+        Alarm alarm = declared[d].alarm;
+        alarm.word = k;
+        alarm.mask = uint64_t(1) << (declared[d].bit % 64);
+        words[k].index = declared[d].bit / 64;
+        words[k].mask |= alarm.mask;
+        words[k].alarms[declared[d].bit % 64] = static_cast<uint32_t>(alarms.size());
+        byName[toLowerCase(alarm.name)] = static_cast<uint32_t>(alarms.size());
+        byName[toLowerCase(alarm.address)] = static_cast<uint32_t>(alarms.size());
+        alarms.push_back(std::move(alarm));
+    }
+
+    if (!options.alarmLog.empty()) {
+        log = std::fopen(options.alarmLog.c_str(), "a");
+        if (log == nullptr) {
+            log = stdout;
+            nodalisLog() << "Can't write the alarm log to " << options.alarmLog << "\n";
+            return false;
+        }
+    }
+    epoch = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count()
+        - std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - PROGRAM_START).count();
+    capacity = 1;
+    while (capacity < options.alarmBuffer) {
+        capacity <<= 1;
+    }
+    ring.resize(capacity);
+    nodalisLog() << "Watching " << alarms.size() << " alarms in " << wordCount << " words of the image\n";
+    running = true;
+    std::thread([this]() {
+        moveToBackground();
+        NODALIS_TRACE_THREAD("Alarms");
+        while (running) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(ALARM_DRAIN_WAIT));
+            drain();
+        }
+    }).detach();
+    return true;
+}
+
+bool AlarmEngine::acknowledge(const std::string& name) {
+    auto found = byName.find(toLowerCase(name));
+    if (found == byName.end()) {
+        return false;
+    }
+    const Alarm& alarm = alarms[found->second];
+    words[alarm.word].acknowledge.fetch_or(alarm.mask, std::memory_order_acq_rel);
+    return true;
+}
+
+void AlarmEngine::acknowledgeAll() {
+    for (size_t k = 0; k < wordCount; k++) {
+        words[k].acknowledge.fetch_or(words[k].mask, std::memory_order_acq_rel);
+    }
+}
+
+std::vector<AlarmState> AlarmEngine::list() {
+    std::vector<AlarmState> states;
+    for (const auto& alarm : alarms) {
+        const AlarmWord& word = words[alarm.word];
+        bool active = (word.active.load(std::memory_order_relaxed) & alarm.mask) != 0;
+        bool acknowledged = (word.unacknowledged.load(std::memory_order_relaxed) & alarm.mask) == 0;
+        if (active || !acknowledged) {
+            states.push_back(AlarmState{ alarm.name, alarm.address, active, acknowledged });
+        }
+    }
+    return states;
+}
+
+size_t AlarmEngine::count(bool active) {
+    size_t total = 0;
+    for (size_t k = 0; k < wordCount; k++) {
+        forEachBankBit((active ? words[k].active : words[k].unacknowledged).load(std::memory_order_relaxed), 0, [&](size_t) { total++; });
+    }
+    return total;
+}
+
+void AlarmEngine::setListener(std::function<void(const AlarmEvent&)> callback) {
+    std::lock_guard<std::mutex> lock(drainMutex);
+    listener = std::move(callback);
+}
+
+void AlarmEngine::drain() {
+    std::lock_guard<std::mutex> lock(drainMutex);
+    uint64_t from = tail.load(std::memory_order_relaxed);
+    uint64_t to = head.load(std::memory_order_acquire);
+    for (uint64_t slot = from; slot < to; slot++) {
+        const AlarmRecord& record = ring[slot & (capacity - 1)];
+        const Alarm& alarm = alarms[record.alarm];
+        AlarmEvent event{ epoch + static_cast<int64_t>(record.micros), record.kind, record.alarm, alarm.name, alarm.address };
+        LogLine(log) << formatTime(event.time) << " " << kindText(event.kind) << " " << alarm.name << " (" << alarm.address << ")\n";
+        if (listener) {
+            listener(event);
+        }
+    }
+    tail.store(to, std::memory_order_release);
+    uint64_t lost = dropped.load(std::memory_order_relaxed);
+    if (lost != reported) {
+        LogLine(log) << lost - reported << " alarm events were dropped, since the ring of " << capacity << " was full\n";
+        reported = lost;
+    }
+    if (to != from) {
+        std::fflush(log);
+    }
+}
+
+bool openAlarms(const RuntimeOptions& options) {
+    if (options.alarms.empty() || options.benchScans > 0) {
+        return false;
+    }
+    return ALARMS.open(options);
+}
+
+void evaluateAlarms(uint64_t micros) {
+    if (ALARMS.running.load(std::memory_order_relaxed)) {
+        ALARMS.evaluate(micros);
+    }
+}
+
+bool acknowledgeAlarm(const std::string& name) {
+    return ALARMS.running && ALARMS.acknowledge(name);
+}
+
+void acknowledgeAllAlarms() {
+    if (ALARMS.running) {
+        ALARMS.acknowledgeAll();
+    }
+}
+
+std::vector<AlarmState> listAlarms() {
+    return ALARMS.running ? ALARMS.list() : std::vector<AlarmState>();
+}
+
+size_t activeAlarmCount() {
+    return ALARMS.running ? ALARMS.count(true) : 0;
+}
+
+size_t unacknowledgedAlarmCount() {
+    return ALARMS.running ? ALARMS.count(false) : 0;
+}
+
+void setAlarmListener(std::function<void(const AlarmEvent&)> listener) {
+    ALARMS.setListener(std::move(listener));
+}
+
+void closeAlarms() {
+    if (ALARMS.running) {
+        ALARMS.drain();
+    }
+}
@@ -0,0 +1,120 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Alarms
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * Detects and latches alarms in the runtime, so a program doesn't need an R_TRIG and a latch for each of them
+ * (--alarms). An alarm is a bit of the image, as a located BOOL by name or a bit address, which is set while its
+ * condition holds. The bits are grouped by the 64 bit word of the image they are in, and after each scan the scan
+ * thread loads each word once, masks it, and finds the alarms that were raised and cleared as cur & ~prev and
+ * prev & ~cur. A raised alarm is unacknowledged until it is acknowledged, which is also a bit in a word, so a scan
+ * with no change costs a load, an AND and a compare for each word, whatever the number of alarms.
+ *
+ * Each change, and each acknowledgement, is an event with the time of the scan, which the scan thread appends to a
+ * ring that was allocated when the alarms were opened, without a lock, a system call or an allocation. The alarm
+ * thread drains the ring, writes the events to --alarm-log or the standard output, and hands them to the listener,
+ * which the OPC UA server sets to raise them as events of the Server object.
+ */
+#pragma once
+#ifndef ALARMS_H
+#define ALARMS_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct RuntimeOptions;
+
+/**
+ * The kinds of alarm events.
+ */
+enum class AlarmEventKind : uint8_t {
+    Raised = 1,         // The condition of the alarm started to hold.
+    Cleared = 2,        // The condition of the alarm stopped holding.
+    Acknowledged = 3,   // The alarm was acknowledged.
+};
+
+/**
+ * An alarm event, as the listener receives it.
+ */
+struct AlarmEvent {
+    int64_t time;           // Microseconds since the Unix epoch.
+    AlarmEventKind kind;
+    uint32_t alarm;         // The index of the alarm.
+    std::string name;       // The name the alarm was declared with.
+    std::string address;    // The bit address of the alarm.
+};
+
+/**
+ * The state of an alarm.
+ */
+struct AlarmState {
+    std::string name;
+    std::string address;
+    bool active;            // Whether the condition holds.
+    bool acknowledged;      // Whether the alarm was acknowledged since it was last raised.
+};
+
+/**
+ * Resolves the alarms of options.alarms and starts the alarm thread. Called by the TaskScheduler constructor, once
+ * the symbols are registered.
+ * @param options The runtime options.
+ * @returns Returns false, having written why, if there are no alarms or they can't be kept.
+ */
+bool openAlarms(const RuntimeOptions& options);
+/**
+ * Finds the alarms that were raised, cleared or acknowledged in the scan that was just committed. Called by the scan
+ * thread after each scan, and does nothing if there are no alarms.
+ * @param micros The time of the scan, in microseconds since the runtime started.
+ */
+void evaluateAlarms(uint64_t micros);
+/**
+ * Acknowledges an alarm, which takes effect with the next scan. This is safe to call from any thread.
+ * @param name The name or the address of the alarm.
+ * @returns Returns false if there is no such alarm.
+ */
+bool acknowledgeAlarm(const std::string& name);
+/**
+ * Acknowledges every alarm, which takes effect with the next scan. This is safe to call from any thread.
+ */
+void acknowledgeAllAlarms();
+/**
+ * Lists the alarms that are active or unacknowledged, as of the last scan.
+ * @returns Returns the alarms, in the order of their addresses.
+ */
+std::vector<AlarmState> listAlarms();
+/**
+ * @returns Returns the number of alarms whose condition holds, as of the last scan.
+ */
+size_t activeAlarmCount();
+/**
+ * @returns Returns the number of alarms that were raised and not yet acknowledged, as of the last scan.
+ */
+size_t unacknowledgedAlarmCount();
+/**
+ * Sets the function the alarm thread hands each event to, after it was logged.
+ * @param listener The listener, or nullptr for none.
+ */
+void setAlarmListener(std::function<void(const AlarmEvent&)> listener);
+/**
+ * Logs the events that are still in the ring. Called when the runtime stops.
+ */
+void closeAlarms();
+
+#endif // ALARMS_H
@@ -13,7 +13,7 @@ make library \
     BACDL=bip \
     BACNET_PORT=linux \
     BACNET_LIB_DIR=$DEST \
-    CC=arm-linux-gnueabi-gcc \
+    CC="arm-linux-gnueabi-gcc -fPIC" \
     AR=arm-linux-gnueabi-ar \
     RANLIB=arm-linux-gnueabi-ranlib
 
@@ -34,6 +34,37 @@ rsync -a --delete \
       ports/linux/ "$DEST/include/ports/linux/"
 
 
+#Make for Linux-arm hard-float
+DEST=$SCRIPT_DIR/dist/linux-armhf
+echo "Making Linux-Arm hard-float To $DEST"
+rm -rf $DEST
+mkdir -p $DEST
+make clean
+make library \
+    BACDL=bip \
+    BACNET_PORT=linux \
+    BACNET_LIB_DIR=$DEST \
+    CC="arm-linux-gnueabihf-gcc -fPIC -mfpu=neon" \
+    AR=arm-linux-gnueabihf-ar \
+    RANLIB=arm-linux-gnueabihf-ranlib
+
+mkdir -p "$DEST/include/bacnet"
+rsync -a --delete \
+      --prune-empty-dirs \
+      --include '*/' \
+      --include '*.h' --include '*.hpp' \
+      --exclude '*' \
+      src/bacnet/ "$DEST/include/bacnet/"
+
+mkdir -p "$DEST/include/ports/linux"
+rsync -a --delete \
+      --prune-empty-dirs \
+      --include '*/' \
+      --include '*.h' --include '*.hpp' \
+      --exclude '*' \
+      ports/linux/ "$DEST/include/ports/linux/"
+
+
 #Make for Linux-arm64
 DEST=$(printf %s "$SCRIPT_DIR/dist/macos-arm64")
 echo "Making Linux-Arm64 To $DEST"
@@ -44,7 +75,7 @@ make library \
     BACDL=bip \
     BACNET_PORT=linux \
     BACNET_LIB_DIR=$DEST \
-    CC=aarch64-linux-gnu-gcc \
+    CC="aarch64-linux-gnu-gcc -fPIC" \
     AR=aarch64-linux-gnu-ar \
     RANLIB=aarch64-linux-gnu-ranlib 
 
@@ -74,7 +105,7 @@ make library \
     BACDL=bip \
     BACNET_PORT=linux \
     BACNET_LIB_DIR=$DEST \
-    CC=x86_64-linux-gnu-gcc \
+    CC="x86_64-linux-gnu-gcc -fPIC" \
     AR=x86_64-linux-gnu-ar \
     RANLIB=x86_64-linux-gnu-ranlib 
 
@@ -104,7 +135,7 @@ make library \
     BACDL=bip \
     BACNET_PORT=bsd \
     BACNET_LIB_DIR=$DEST \
-    CC="clang -arch arm64" \
+    CC="clang -arch arm64 -fPIC" \
     AR=llvm-ar \
     RANLIB=llvm-ranlib 
 
@@ -134,7 +165,7 @@ make library \
     BACDL=bip \
     BACNET_PORT=bsd \
     BACNET_LIB_DIR=$DEST \
-    CC="clang -arch x86_64" \
+    CC="clang -arch x86_64 -fPIC" \
     AR=llvm-ar \
     RANLIB=llvm-ranlib 
 
@@ -3,12 +3,15 @@
 #include <array>
 #include <cctype>
 #include <cstring>
-#include <iostream>
+#include <cstdio>
 #include <stdexcept>
 #include <cstdlib>
 #include <chrono>
 #include <optional>
 #include <vector>
+#include <mutex>
+#include <map>
+#include <atomic>
 
 #ifdef _WIN32
     #include <winsock2.h>
@@ -26,6 +29,23 @@
 
 namespace {
     constexpr size_t PDU_BUFFER_SIZE = MAX_APDU + 64;
+    // The smallest max APDU a BACnet device may have.
+    constexpr size_t MIN_APDU = 50;
+    // The most property values decoded from one COV notification.
+    constexpr size_t MAX_COV_VALUES = 8;
+
+    // The longest a thread reads the datalink before it checks its own transactions again, in milliseconds.
+    constexpr unsigned RECEIVE_SLICE_MS = 10;
+
+    // An address off the local networks, whose route picks the interface of the default route. Nothing is sent to it.
+    const char* const DEFAULT_ROUTE_PROBE = "192.0.2.1";
+    // How often the server checks for a newly published image while no PDU arrives, in milliseconds.
+    constexpr unsigned SERVER_CHECK_MS = 10;
+    // The most COV subscriptions the server keeps at once.
+    constexpr size_t MAX_SERVER_SUBSCRIPTIONS = 256;
+
+    // The subscriber process identifier of the next client's COV subscriptions.
+    std::atomic<uint32_t> NEXT_PROCESS_ID{1};
 
     std::string normalizeKey(const std::string& input) {
         std::string normalized;
@@ -59,6 +79,26 @@ namespace {
         return false;
     }
 
+    bool extractBool(const json& data, const std::string& key, bool& value) {
+        if (!data.contains(key)) {
+            return false;
+        }
+        const json& token = data.at(key);
+        if (token.is_boolean()) {
+            value = token.get<bool>();
+            return true;
+        }
+        if (token.is_number()) {
+            value = token.get<int64_t>() != 0;
+            return true;
+        }
+        if (token.is_string()) {
+            value = normalizeKey(token.get<std::string>()) == "true" || token.get<std::string>() == "1";
+            return true;
+        }
+        return false;
+    }
+
     std::optional<std::string> extractString(const json& data, const std::string& key) {
         if (!data.contains(key)) {
             return std::nullopt;
@@ -145,24 +185,17 @@ static bool decode_error_class_code(
     return true;
 }
 
-// Small hex dump helper for debugging
-static void dump_hex(const uint8_t *b, int n)
-{
-    for (int i = 0; i < n; i++)
-        std::printf("%02X ", b[i]);
-    std::printf("\n");
-}
-
 BACNETClient::BACNETClient(const std::string& ip, uint16_t port)
-    : IOClient("BACNET"), remoteIp(ip), remotePort(port == 0 ? 0xBAC0 : port) {
+    : ScalarIOClient("BACNET"), remoteIp(ip), remotePort(port) {
+    processId = NEXT_PROCESS_ID++;
 }
 
 BACNETClient::~BACNETClient() {
+    stop();
     if (datalinkReady) {
-        datalink_cleanup();
-#ifdef _WIN32
-        WSACleanup();
-#endif
+        BACnetDatalink& datalink = BACnetDatalink::instance();
+        datalink.detach(device, this);
+        datalink.release();
     }
 }
 
@@ -184,20 +217,20 @@ void BACNETClient::connect() {
     if (remoteIp.empty()) {
         return;
     }
-    std::cout << "BACNET-IP attempting to connect to " << remoteIp.c_str() << ":" << remotePort << "\n";
+    nodalisLog() << "BACNET-IP attempting to connect to " << remoteIp.c_str() << ":" << remotePort << "\n";
 
     connected = ensureDatalink();
     if (connected)
     {
-        std::cout << "BACNET-IP successfully connected to " << remoteIp.c_str() << ":" << remotePort << "\n";
+        nodalisLog() << "BACNET-IP successfully connected to " << remoteIp.c_str() << ":" << remotePort << "\n";
     }
     else
     {
-        std::cout << "BACNET-IP failed to connect to " << remoteIp.c_str() << ":" << remotePort << "\n";
+        nodalisLog() << "BACNET-IP failed to connect to " << remoteIp.c_str() << ":" << remotePort << "\n";
     }
 }
 
-void BACNETClient::onMappingAdded(const IOMap& map) {
+void BACNETClient::onMappingAdded(IOMap& map) {
     if (!map.modulePort.empty() && remotePort == 0) {
         remotePort = static_cast<uint16_t>(std::strtoul(map.modulePort.c_str(), nullptr, 10));
     }
@@ -206,19 +239,58 @@ void BACNETClient::onMappingAdded(const IOMap& map) {
     }
 
     BACnetRemotePoint point;
-    if (parseRemoteDefinition(map, point)) {
-        remoteCache[map.remoteAddress] = point;
-        std::cout << "BACNET-IP added map for Instance = " << point.objectInstance << ", Object Type = " << point.objectType << " Property ID = " << point.propertyId << " Value Type = " << point.valueType << "\n";
+    if (definePoint(map, point) || parseRemoteDefinition(map, point)) {
+        point.mapping = static_cast<size_t>(&map - mappings.data());
+        map.remoteHandle = static_cast<int>(points.size());
+        points.push_back(point);
+        remoteIndex[map.remoteAddress] = points.size() - 1;
+        nodalisLog() << "BACNET-IP added map for Instance = " << point.objectInstance << ", Object Type = " << point.objectType << " Property ID = " << point.propertyId << " Value Type = " << point.valueType << "\n";
+    }
+
+    // ProtocolProperties may give the device's max APDU with {"MaxAPDU": 480}.
+    json config = protocolProperties(map);
+    size_t apdu = 0;
+    if (config.is_object() && extractNumber(config, "MaxAPDU", apdu) && apdu >= MIN_APDU) {
+        maxApdu = apdu < MAX_APDU ? apdu : MAX_APDU;
+    }
+    if (config.is_object()) {
+        // An invoke ID can only be outstanding once, so no more than half of them are used at a time.
+        size_t inFlight = 0;
+        if (extractNumber(config, "MaxInFlight", inFlight) && inFlight > 0) {
+            maxInFlight = inFlight < 128 ? inFlight : 128;
+        }
+        extractNumber(config, "ResponseTimeout", responseTimeout);
+        extractNumber(config, "Retries", retries);
+        extractNumber(config, "DeviceInstance", deviceInstance);
+        // More than 64 segments can't be asked for by number, and the reassembly buffer grows with them.
+        if (extractNumber(config, "MaxSegments", maxSegments) && maxSegments > 64) {
+            maxSegments = 64;
+        }
+        unsigned window = 0;
+        if (extractNumber(config, "SegmentWindow", window) && window > 0) {
+            segmentWindow = static_cast<uint8_t>(window < 127 ? window : 127);
+        }
     }
 }
 
+/**
+ * Reports why the interface to reach a device on couldn't be found.
+ * @param what Why.
+ * @returns Returns an empty string, for the lookup to return.
+ */
+static std::string failedLookup(const std::string& what)
+{
+    nodalisError() << "BACnet: " << what << "\n";
+    return std::string();
+}
+
 #ifndef _WIN32
 static std::string iface_name_for_local_ip(const std::string &localIp)
 {
     struct ifaddrs *ifaddr = nullptr;
     if (getifaddrs(&ifaddr) != 0)
     {
-        throw std::runtime_error("getifaddrs() failed");
+        return failedLookup("getifaddrs() failed");
     }
 
     std::string found;
@@ -245,7 +317,7 @@ static std::string iface_name_for_local_ip(const std::string &localIp)
 
     if (found.empty())
     {
-        throw std::runtime_error("No interface found with IP: " + localIp);
+        return failedLookup("No interface found with IP: " + localIp);
     }
     return found;
 }
@@ -262,7 +334,7 @@ static std::string get_local_ip_for_remote(const std::string &remoteIp, uint16_t
         WSADATA wsaData;
         int r = WSAStartup(MAKEWORD(2, 2), &wsaData);
         if (r != 0)
-            throw std::runtime_error("WSAStartup failed");
+            return failedLookup("WSAStartup failed");
         wsaInit = true;
     }
 #endif
@@ -275,7 +347,7 @@ static std::string get_local_ip_for_remote(const std::string &remoteIp, uint16_t
         socket(AF_INET, SOCK_DGRAM, 0);
 #endif
     if (sock < 0)
-        throw std::runtime_error("socket() failed");
+        return failedLookup("socket() failed");
 
     // Build remote address
     sockaddr_in remote{};
@@ -288,7 +360,7 @@ static std::string get_local_ip_for_remote(const std::string &remoteIp, uint16_t
 #else
         close(sock);
 #endif
-        throw std::runtime_error("inet_pton() failed for remoteIp: " + remoteIp);
+        return failedLookup("inet_pton() failed for remoteIp: " + remoteIp);
     }
 
     // "Connect" UDP socket (doesn't send packets; just sets default route/interface)
@@ -305,7 +377,7 @@ static std::string get_local_ip_for_remote(const std::string &remoteIp, uint16_t
 #else
         close(sock);
 #endif
-        throw std::runtime_error("connect() failed");
+        return failedLookup("connect() failed");
     }
 
     // Query local address chosen by OS routing
@@ -328,7 +400,7 @@ static std::string get_local_ip_for_remote(const std::string &remoteIp, uint16_t
 #else
         close(sock);
 #endif
-        throw std::runtime_error("getsockname() failed");
+        return failedLookup("getsockname() failed");
     }
 
     // Convert local IP to string
@@ -340,7 +412,7 @@ static std::string get_local_ip_for_remote(const std::string &remoteIp, uint16_t
 #else
         close(sock);
 #endif
-        throw std::runtime_error("inet_ntop() failed");
+        return failedLookup("inet_ntop() failed");
     }
 
 #ifdef _WIN32
@@ -352,788 +424,2716 @@ static std::string get_local_ip_for_remote(const std::string &remoteIp, uint16_t
     return std::string(buf);
 }
 
-bool BACNETClient::ensureDatalink() {
-    if (datalinkReady) {
+BACnetDatalink& BACnetDatalink::instance()
+{
+    static BACnetDatalink datalink;
+    return datalink;
+}
+
+bool BACnetDatalink::acquire(const std::string& remoteIp)
+{
+    std::lock_guard<std::mutex> lock(linkMutex);
+    if (users > 0)
+    {
+        users++;
         return true;
     }
 #ifdef _WIN32
     WSADATA wsa;
     if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
-        std::cerr << "BACnet: Failed to initialize WinSock\n";
+        nodalisError() << "BACnet: Failed to initialize WinSock\n";
         return false;
     }
 #endif
     std::string localIp = get_local_ip_for_remote(remoteIp, 47808);
+    if (localIp.empty())
+    {
+        return false;
+    }
 
+    auto known = interfaces.find(localIp);
+    if (known == interfaces.end())
+    {
 #ifdef _WIN32
-    // Windows bacnet-stack ports commonly accept dotted IP for BACNET_IFACE
-    std::string ifaceParam = localIp;
+        // Windows bacnet-stack ports commonly accept dotted IP for BACNET_IFACE
+        std::string ifaceParam = localIp;
 #else
-    // BSD/Linux ports commonly expect the interface name (en0/eth0)
-    std::string ifaceParam = iface_name_for_local_ip(localIp);
+        // BSD/Linux ports commonly expect the interface name (en0/eth0)
+        std::string ifaceParam = iface_name_for_local_ip(localIp);
+        if (ifaceParam.empty())
+        {
+            return false;
+        }
 #endif
+        known = interfaces.emplace(localIp, ifaceParam).first;
+    }
 
     char ifname[64];
-    std::snprintf(ifname, sizeof(ifname), "%s", ifaceParam.c_str());
+    std::snprintf(ifname, sizeof(ifname), "%s", known->second.c_str());
+    if (localPort != 0)
+    {
+        bip_set_port(localPort);
+    }
     datalink_init(ifname);
     address_init();
+    // The clients match their own replies, so the bacnet-stack TSM isn't used.
     // tsm_init();
-    datalinkReady = true;
+    nodalisLog() << "BACNET-IP datalink started on " << known->second << "\n";
+    users = 1;
     return true;
 }
 
-BACNET_ADDRESS BACNETClient::buildAddress() const {
-    BACNET_ADDRESS dest{};
-    dest.net = 0;
-    dest.len = 0;
-    dest.mac_len = 6;
-    dest.mac[4] = static_cast<uint8_t>((remotePort >> 8) & 0xFF);
-    dest.mac[5] = static_cast<uint8_t>(remotePort & 0xFF);
-
-    in_addr addr{};
-    if (inet_pton(AF_INET, remoteIp.c_str(), &addr) != 1) {
-        throw std::runtime_error("Invalid BACnet IP address: " + remoteIp);
+void BACnetDatalink::release()
+{
+    std::lock_guard<std::mutex> receiving(receiveMutex);
+    std::lock_guard<std::mutex> lock(linkMutex);
+    if (users == 0 || --users > 0)
+    {
+        return;
     }
-    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&addr.s_addr);
-    std::copy(bytes, bytes + 4, dest.mac);
-    return dest;
+    datalink_cleanup();
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    nodalisLog() << "BACNET-IP datalink stopped\n";
 }
 
-uint8_t BACNETClient::nextInvokeId() {
-    uint8_t current = invokeId++;
-    if (invokeId == 0) {
-        invokeId = 1;
-    }
-    return current;
+void BACnetDatalink::attach(const BACNET_ADDRESS& device, BACNETClient* client)
+{
+    std::lock_guard<std::mutex> lock(routeGuard);
+    routes[addressKey(device)] = client;
 }
 
-bool BACNETClient::resolveRemote(const std::string& remote, BACnetRemotePoint& point) {
-    auto cached = remoteCache.find(remote);
-    if (cached != remoteCache.end()) {
-        point = cached->second;
-        return true;
+void BACnetDatalink::detach(const BACNET_ADDRESS& device, BACNETClient* client)
+{
+    std::lock_guard<std::mutex> lock(routeGuard);
+    auto route = routes.find(addressKey(device));
+    if (route != routes.end() && route->second == client)
+    {
+        routes.erase(route);
     }
+}
 
-    for (const auto& map : mappings) {
-        if (map.remoteAddress == remote) {
-            if (parseRemoteDefinition(map, point)) {
-                remoteCache[remote] = point;
-                return true;
-            }
-        }
-    }
-    return false;
+bool BACnetDatalink::send(BACNET_ADDRESS& dest, BACNET_NPDU_DATA& npdu, uint8_t* pdu, int pduLen)
+{
+    std::lock_guard<std::mutex> lock(linkMutex);
+    return users > 0 && datalink_send_pdu(&dest, &npdu, pdu, static_cast<unsigned>(pduLen)) > 0;
 }
 
-bool BACNETClient::parseRemoteDefinition(const IOMap &map, BACnetRemotePoint &point)
+std::mutex& BACnetDatalink::routeMutex()
+{
+    return routeGuard;
+}
+
+void BACnetDatalink::pump(std::unique_lock<std::mutex>& lock, Clock::time_point until)
 {
-    json config = nullptr;
-    if (map.additionalProperties.is_string())
+    if (receiveMutex.try_lock())
     {
-        std::cout << "BACNET-IP Additional Properties is a string.\n";
-        config = json::parse(map.additionalProperties.get<std::string>());
+        // This thread reads the datalink for everyone until the deadline, then hands it to the next waiter.
+        lock.unlock();
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(until - Clock::now()).count();
+        receiveOne(left > 0 ? static_cast<unsigned>(left) : 0);
+        receiveMutex.unlock();
+        lock.lock();
+        routeChanged.notify_all();
     }
     else
     {
-        config = map.additionalProperties;
-        std::cout << "BACNET-IP Additional Properties is an object.\n";
-    }
-    if (parseJsonRemote(config, point))
-    {
-        return true;
+        counters.waits.fetch_add(1, std::memory_order_relaxed);
+        routeChanged.wait_until(lock, until);
     }
-
-    return false;
 }
 
-bool BACNETClient::parseJsonRemote(const json& config, BACnetRemotePoint& point) {
-    auto objectTypeToken = extractString(config, "objectType");
-    if (!objectTypeToken) {
-        objectTypeToken = extractString(config, "ObjectType");
-    }
-    if (objectTypeToken) {
-        point.objectType = parseObjectType(*objectTypeToken);
-    }
-    else
+void BACnetDatalink::poll()
+{
+    // If another thread is reading the datalink, it routes whatever arrives.
+    std::unique_lock<std::mutex> receiving(receiveMutex, std::try_to_lock);
+    if (!receiving.owns_lock())
     {
-        std::cout << "BACNET-IP no object type\n";
-        std::cout << config.dump() << "\n";
-    }
-
-    uint32_t instance = 0;
-    if (extractNumber(config, "objectInstance", instance) ||
-        extractNumber(config, "ObjectInstance", instance)) {
-        point.objectInstance = instance;
+        return;
     }
-    else
+    while (receiveOne(0))
     {
-        std::cout << "BACNET-IP no object instance\n";
     }
+    receiving.unlock();
+    routeChanged.notify_all();
+}
 
-    auto propertyToken = extractString(config, "propertyId");
-    if (!propertyToken) {
-        propertyToken = extractString(config, "PropertyId");
-    }
-    if (propertyToken) {
-        point.propertyId = parsePropertyId(*propertyToken);
-    }
-    else
+void BACnetDatalink::notify()
+{
+    routeChanged.notify_all();
+}
+
+void BACnetDatalink::setLocalPort(uint16_t port)
+{
+    std::lock_guard<std::mutex> lock(linkMutex);
+    localPort = port;
+}
+
+const BACnetDatalinkCounters& BACnetDatalink::getCounters() const
+{
+    return counters;
+}
+
+void BACnetDatalink::countResend()
+{
+    counters.resends.fetch_add(1, std::memory_order_relaxed);
+}
+
+void BACnetDatalink::countTimeout()
+{
+    counters.timeouts.fetch_add(1, std::memory_order_relaxed);
+}
+
+void BACnetDatalink::serve(BACnetServer* handler)
+{
+    std::lock_guard<std::mutex> receiving(receiveMutex);
+    server = handler;
+}
+
+uint64_t BACnetDatalink::addressKey(const BACNET_ADDRESS& address)
+{
+    uint64_t key = 0;
+    if (address.net != 0 && address.net != BACNET_BROADCAST_NETWORK)
     {
-        std::cout << "BACNET-IP no property id\n";
+        // A device behind a router is keyed by its network and its MAC address on it, which is at most 5 bytes
+        // for the networks BACnet routers connect to in practice (MS/TP, ARCNET, or a VMAC).
+        key = (1ull << 63) | (static_cast<uint64_t>(address.net) << 40);
+        for (int i = 0; i < address.len && i < 5; i++)
+        {
+            key |= static_cast<uint64_t>(address.adr[i]) << (8 * (address.len - 1 - i));
+        }
+        return key;
     }
-
-    auto valueTypeToken = extractString(config, "valueType");
-    if (!valueTypeToken)
+    for (int i = 0; i < 6; i++)
     {
-        valueTypeToken = extractString(config, "ValueType");
+        key = (key << 8) | address.mac[i];
     }
-    if (valueTypeToken)
+    return key;
+}
+
+void BACnetDatalink::setBindingsFile(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(routeGuard);
+    bindingsFile = path;
+    if (path.empty())
     {
-        point.valueType = parseValueType(*valueTypeToken);
+        return;
     }
-    else
+    std::ifstream in(path);
+    if (!in)
     {
-        std::cout << "BACNET-IP no value type\n";
+        return;
     }
-
-    int32_t arrayIndex = point.arrayIndex;
-    if (extractNumber(config, "arrayIndex", arrayIndex) ||
-        extractNumber(config, "ArrayIndex", arrayIndex))
+    json saved = json::parse(in, nullptr, false);
+    if (!saved.is_object())
     {
-        point.arrayIndex = arrayIndex;
+        nodalisLog() << "BACNET-IP ignoring unreadable bindings file " << path << "\n";
+        return;
     }
-
-    return true;
-}
-
-bool BACNETClient::parseStringRemote(const std::string &definition, BACnetRemotePoint &point) const
-{
-    std::vector<std::string> tokens;
-    std::string current;
-    for (char ch : definition)
+    for (auto& entry : saved.items())
     {
-        if (ch == ':' || ch == '|')
+        const json& config = entry.value();
+        uint32_t instance = 0;
+        if (!config.is_object() || !config.contains("mac") || !config["mac"].is_array() ||
+            std::sscanf(entry.key().c_str(), "%u", &instance) != 1)
         {
-            if (!current.empty())
-            {
-                tokens.push_back(current);
-                current.clear();
-            }
+            continue;
         }
-        else
+        BACnetDeviceBinding binding;
+        const json& mac = config["mac"];
+        binding.address.mac_len = static_cast<uint8_t>(mac.size() < MAX_MAC_LEN ? mac.size() : MAX_MAC_LEN);
+        for (size_t i = 0; i < binding.address.mac_len; i++)
         {
-            current.push_back(ch);
+            binding.address.mac[i] = mac[i].get<uint8_t>();
+        }
+        extractNumber(config, "net", binding.address.net);
+        if (config.contains("adr") && config["adr"].is_array())
+        {
+            const json& adr = config["adr"];
+            binding.address.len = static_cast<uint8_t>(adr.size() < MAX_MAC_LEN ? adr.size() : MAX_MAC_LEN);
+            for (size_t i = 0; i < binding.address.len; i++)
+            {
+                binding.address.adr[i] = adr[i].get<uint8_t>();
+            }
         }
+        extractNumber(config, "maxApdu", binding.maxApdu);
+        extractNumber(config, "segmentation", binding.segmentation);
+        extractNumber(config, "vendorId", binding.vendorId);
+        bindings[instance] = binding;
     }
-    if (!current.empty())
+    nodalisLog() << "BACNET-IP loaded " << bindings.size() << " device bindings from " << path << "\n";
+}
+
+bool BACnetDatalink::discover(uint32_t instance, BACNET_ADDRESS configured, Clock::duration timeout, BACnetDeviceBinding& binding)
+{
+    bool known;
     {
-        tokens.push_back(current);
+        std::lock_guard<std::mutex> lock(routeGuard);
+        known = findBinding(instance, configured, binding);
     }
 
-    if (tokens.size() < 3)
+    // The device is asked at its configured address, and a device with a known instance is also asked for on
+    // every network, so that it is found behind a router or after it moved.
+    sendWhoIs(configured, instance);
+    if (instance != NO_DEVICE_INSTANCE)
     {
-        return false;
+        BACNET_ADDRESS everywhere{};
+        datalink_get_broadcast_address(&everywhere);
+        everywhere.net = BACNET_BROADCAST_NETWORK;
+        sendWhoIs(everywhere, instance);
+    }
+    if (known)
+    {
+        return true;
     }
 
-    point.objectType = parseObjectType(tokens[0]);
-    point.objectInstance = static_cast<uint32_t>(std::stoul(tokens[1]));
-    point.propertyId = parsePropertyId(tokens[2]);
-    if (tokens.size() > 3)
+    std::unique_lock<std::mutex> lock(routeGuard);
+    Clock::time_point until = Clock::now() + timeout;
+    while (!findBinding(instance, configured, binding))
     {
-        point.arrayIndex = static_cast<int32_t>(std::stol(tokens[3]));
+        if (Clock::now() >= until)
+        {
+            return false;
+        }
+        pump(lock, until);
     }
     return true;
 }
 
-BACNET_OBJECT_TYPE BACNETClient::parseObjectType(const std::string &raw) const
+void BACnetDatalink::sendWhoIs(BACNET_ADDRESS& dest, uint32_t instance)
 {
-    std::cout << "BACNET-IP parsing object type " << raw.c_str() << "\n";
-    return static_cast<BACNET_OBJECT_TYPE>(std::stoi(raw));
+    uint8_t pdu[64];
+    BACNET_NPDU_DATA npdu{};
+    npdu_encode_npdu_data(&npdu, false, MESSAGE_PRIORITY_NORMAL);
+    int len = npdu_encode_pdu(pdu, &dest, nullptr, &npdu);
+    int32_t limit = instance != NO_DEVICE_INSTANCE ? static_cast<int32_t>(instance) : -1;
+    len += whois_encode_apdu(pdu + len, limit, limit);
+    send(dest, npdu, pdu, len);
 }
 
-BACNET_PROPERTY_ID BACNETClient::parsePropertyId(const std::string &raw) const
+void BACnetDatalink::learn(const BACNET_ADDRESS& source, const uint8_t* apdu, int apduLen)
 {
-    std::cout << "BACNET-IP parsing property id " << raw.c_str() << "\n";
-    return static_cast<BACNET_PROPERTY_ID>(std::stoi(raw));
-}
+    uint32_t instance = 0;
+    unsigned maxApdu = 0;
+    int segmentation = SEGMENTATION_NONE;
+    uint16_t vendorId = 0;
+    if (bacnet_iam_request_decode(apdu + 2, static_cast<unsigned>(apduLen - 2), &instance, &maxApdu, &segmentation, &vendorId) <= 0)
+    {
+        return;
+    }
 
-uint8_t BACNETClient::parseValueType(const std::string &raw) const
-{
-    std::cout << "BACNET-IP parsing value type " << raw.c_str() << "\n";
-    BACNET_APPLICATION_TAG result = BACNET_APPLICATION_TAG_ENUMERATED;
-    if (raw == "i")
+    json saved;
     {
-        result = BACNET_APPLICATION_TAG_SIGNED_INT;
+        std::lock_guard<std::mutex> lock(routeGuard);
+        BACnetDeviceBinding& binding = bindings[instance];
+        bool changed = !bacnet_address_same(&binding.address, &source) || binding.maxApdu != maxApdu ||
+            binding.segmentation != segmentation || binding.vendorId != vendorId;
+        binding.address = source;
+        binding.maxApdu = maxApdu;
+        binding.segmentation = segmentation;
+        binding.vendorId = vendorId;
+        if (!changed || bindingsFile.empty())
+        {
+            return;
+        }
+        saved = json::object();
+        for (auto& known : bindings)
+        {
+            const BACNET_ADDRESS& address = known.second.address;
+            saved[std::to_string(known.first)] = {
+                {"mac", std::vector<uint8_t>(address.mac, address.mac + address.mac_len)},
+                {"net", address.net},
+                {"adr", std::vector<uint8_t>(address.adr, address.adr + address.len)},
+                {"maxApdu", known.second.maxApdu},
+                {"segmentation", known.second.segmentation},
+                {"vendorId", known.second.vendorId}
+            };
+        }
     }
-    else if (raw == "u")
+    saveBindings(saved);
+}
+
+bool BACnetDatalink::findBinding(uint32_t instance, const BACNET_ADDRESS& configured, BACnetDeviceBinding& binding) const
+{
+    if (instance != NO_DEVICE_INSTANCE)
     {
-        result = BACNET_APPLICATION_TAG_UNSIGNED_INT;
+        auto known = bindings.find(instance);
+        if (known == bindings.end())
+        {
+            return false;
+        }
+        binding = known->second;
+        return true;
     }
-    else if (raw == "d")
+    uint64_t key = addressKey(configured);
+    for (auto& known : bindings)
     {
-        result = BACNET_APPLICATION_TAG_DOUBLE;
+        if (addressKey(known.second.address) == key)
+        {
+            binding = known.second;
+            return true;
+        }
     }
-    else if (raw == "b")
+    return false;
+}
+
+void BACnetDatalink::saveBindings(const json& saved) const
+{
+    // The file is replaced in one rename, so that a restart never finds it half written.
+    std::string temporary = bindingsFile + ".tmp";
     {
-        result = BACNET_APPLICATION_TAG_BOOLEAN;
+        std::ofstream out(temporary, std::ios::trunc);
+        if (!out || !(out << saved.dump(2) << "\n"))
+        {
+            DIAGNOSTIC("BACNET-IP could not write the bindings file " << temporary);
+            return;
+        }
     }
-    else if (raw == "f")
+    if (std::rename(temporary.c_str(), bindingsFile.c_str()) != 0)
     {
-        result = BACNET_APPLICATION_TAG_REAL;
+        DIAGNOSTIC("BACNET-IP could not replace the bindings file " << bindingsFile);
     }
-    return static_cast<uint8_t>(result);
 }
 
-bool BACNETClient::performRead(const BACnetRemotePoint &point, BACNET_APPLICATION_DATA_VALUE &value)
+bool BACnetDatalink::receiveOne(unsigned timeoutMs)
 {
-    if (!ensureDatalink())
     {
-        return false;
+        std::lock_guard<std::mutex> lock(linkMutex);
+        if (users == 0)
+        {
+            return false;
+        }
     }
-
-    BACNET_ADDRESS dest = buildAddress();
-    BACNET_NPDU_DATA npdu;
-    npdu_encode_npdu_data(&npdu, true, MESSAGE_PRIORITY_NORMAL);
-
-    BACNET_READ_PROPERTY_DATA request{};
-    request.object_type = point.objectType;
-    request.object_instance = point.objectInstance;
-    request.object_property = point.propertyId;
-    request.array_index = point.arrayIndex;
-
-    std::array<uint8_t, PDU_BUFFER_SIZE> buffer{};
-    int pduLen = npdu_encode_pdu(buffer.data(), &dest, nullptr, &npdu);
-    if (pduLen < 0)
+    BACNET_ADDRESS source{};
+    int received = datalink_receive(&source, receiveBuffer, sizeof(receiveBuffer), timeoutMs);
+    counters.receives.fetch_add(1, std::memory_order_relaxed);
+    if (received <= 0)
     {
+        counters.emptyReceives.fetch_add(1, std::memory_order_relaxed);
         return false;
     }
 
-    uint8_t invoke = nextInvokeId();
-    pduLen += rp_encode_apdu(buffer.data() + pduLen, invoke, &request);
+    // ---- NPDU decode (with BVLC fallback) ----
+    BACNET_NPDU_DATA rxNpdu{};
+    int offset = npdu_decode(receiveBuffer, nullptr, &source, &rxNpdu);
 
-    if (datalink_send_pdu(&dest, &npdu, buffer.data(), pduLen) <= 0)
+    // If decode failed and packet looks like BVLC (BACnet/IP), retry after 4-byte BVLC header.
+    if (offset < 0 && received >= 4 && receiveBuffer[0] == 0x81)
     {
-        return false;
+        offset = npdu_decode(receiveBuffer + 4, nullptr, &source, &rxNpdu);
+        if (offset >= 0)
+        {
+            offset += 4; // adjust back to original rx buffer offset
+        }
+    }
+    if (offset < 0 || received - offset < 2)
+    {
+        return true;
+    }
+    const uint8_t* apdu = receiveBuffer + offset;
+    if (apdu[0] == PDU_TYPE_UNCONFIRMED_SERVICE_REQUEST && apdu[1] == SERVICE_UNCONFIRMED_I_AM)
+    {
+        learn(source, apdu, received - offset);
+        return true;
+    }
+    if (server != nullptr && server->handle(source, apdu, received - offset))
+    {
+        return true;
+    }
+
+    // PDUs from devices that no client talks to are dropped.
+    std::lock_guard<std::mutex> lock(routeGuard);
+    auto route = routes.find(addressKey(source));
+    if (route != routes.end())
+    {
+        route->second->deliver(source, receiveBuffer + offset, received - offset);
+    }
+    else
+    {
+        counters.unrouted.fetch_add(1, std::memory_order_relaxed);
     }
+    return true;
+}
 
-    const auto deadline = std::chrono::steady_clock::now() + REQUEST_TIMEOUT;
+bool BACNETClient::ensureDatalink() {
+    if (datalinkReady) {
+        return true;
+    }
+    BACnetDatalink& datalink = BACnetDatalink::instance();
+    if (!datalink.acquire(remoteIp)) {
+        return false;
+    }
 
-    while (std::chrono::steady_clock::now() < deadline)
+    BACNET_ADDRESS configured = buildAddress();
+    BACnetDeviceBinding binding;
+    auto timeout = std::chrono::milliseconds(responseTimeout * static_cast<uint64_t>(retries + 1));
+    if (datalink.discover(deviceInstance, configured, timeout, binding))
     {
-        BACNET_ADDRESS source{};
-        std::array<uint8_t, PDU_BUFFER_SIZE> rx{};
-        int received = datalink_receive(&source, rx.data(), rx.size(), 10);
-        if (received <= 0)
+        device = binding.address;
+        if (binding.maxApdu >= MIN_APDU && binding.maxApdu < maxApdu)
         {
-            continue;
+            maxApdu = binding.maxApdu;
         }
+        segmentation = binding.segmentation;
+    }
+    else
+    {
+        DIAGNOSTIC("BACNET-IP " << remoteIp << ":" << remotePort << " didn't answer Who-Is; using its configured address");
+        device = configured;
+    }
+    datalink.attach(device, this);
+    datalinkReady = true;
+    return true;
+}
 
-        // ---- NPDU decode (with BVLC fallback) ----
-        BACNET_NPDU_DATA rxNpdu{};
-        int offset = npdu_decode(rx.data(), nullptr, &source, &rxNpdu);
+BACNET_ADDRESS BACNETClient::buildAddress() const {
+    BACNET_ADDRESS dest{};
+    dest.net = 0;
+    dest.len = 0;
+    dest.mac_len = 6;
+    dest.mac[4] = static_cast<uint8_t>((remotePort >> 8) & 0xFF);
+    dest.mac[5] = static_cast<uint8_t>(remotePort & 0xFF);
 
-        // If decode failed and packet looks like BVLC (BACnet/IP), retry after 4-byte BVLC header.
-        if (offset < 0 && received >= 4 && rx[0] == 0x81)
-        {
-            offset = npdu_decode(rx.data() + 4, nullptr, &source, &rxNpdu);
-            if (offset >= 0)
-            {
-                offset += 4; // adjust back to original rx buffer offset
-            }
-        }
+    in_addr addr{};
+    if (inet_pton(AF_INET, remoteIp.c_str(), &addr) != 1) {
+        NODALIS_THROW(std::runtime_error("Invalid BACnet IP address: " + remoteIp));
+    }
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&addr.s_addr);
+    std::copy(bytes, bytes + 4, dest.mac);
+    return dest;
+}
 
-        if (offset < 0)
-        {
-            continue;
-        }
+uint8_t BACNETClient::nextInvokeId() {
+    uint8_t current = invokeId++;
+    if (invokeId == 0) {
+        invokeId = 1;
+    }
+    return current;
+}
 
-        int apdu_len = received - offset;
-        if (apdu_len < 2)
-        {
-            continue;
-        }
+bool BACNETClient::resolveRemote(const std::string& remote, BACnetRemotePoint& point) {
+    // Every mapping's point is parsed when it is added, so an address that isn't known is invalid.
+    auto known = remoteIndex.find(remote);
+    if (known == remoteIndex.end()) {
+        return false;
+    }
+    point = points[known->second];
+    return true;
+}
 
-        uint8_t *apdu = rx.data() + offset;
+static const BACnetPointDefinition* POINT_TABLE = nullptr;
+static size_t POINT_TABLE_SIZE = 0;
 
-        // IMPORTANT: your stack's PDU_TYPE_* constants appear to already be 0x10/0x20/0x30...
-        // So compare using (apdu[0] & 0xF0) directly to PDU_TYPE_* (no shifts).
-        uint8_t pduType = (apdu[0] & 0xF0);
+void registerBACnetPoints(const BACnetPointDefinition* points, size_t count) {
+    POINT_TABLE = points;
+    POINT_TABLE_SIZE = count;
+}
 
-        // Only these contain invoke id at apdu[1]
-        bool hasInvoke = (pduType == PDU_TYPE_SIMPLE_ACK ||
-                          pduType == PDU_TYPE_COMPLEX_ACK ||
-                          pduType == PDU_TYPE_ERROR ||
-                          pduType == PDU_TYPE_REJECT ||
-                          pduType == PDU_TYPE_ABORT);
+bool BACNETClient::definePoint(const IOMap& map, BACnetRemotePoint& point) const {
+    if (map.definition < 0 || static_cast<size_t>(map.definition) >= POINT_TABLE_SIZE) {
+        return false;
+    }
+    const BACnetPointDefinition& definition = POINT_TABLE[map.definition];
+    point.objectType = static_cast<BACNET_OBJECT_TYPE>(definition.objectType);
+    point.objectInstance = definition.objectInstance;
+    point.propertyId = static_cast<BACNET_PROPERTY_ID>(definition.propertyId);
+    point.arrayIndex = definition.arrayIndex;
+    point.valueType = definition.valueType;
+    point.priority = definition.priority;
+    point.cov = definition.cov;
+    point.covConfirmed = definition.covConfirmed;
+    point.covLifetime = definition.covLifetime;
+    return true;
+}
 
-        if (!hasInvoke)
-        {
-            continue;
-        }
+bool BACNETClient::parseRemoteDefinition(const IOMap &map, BACnetRemotePoint &point)
+{
+    return parseJsonRemote(protocolProperties(map), point);
+}
 
-        // Must match our invoke id
-        if (apdu[1] != invoke)
-        {
-            continue;
-        }
+bool BACNETClient::parseJsonRemote(const json& config, BACnetRemotePoint& point) {
+    auto objectTypeToken = extractString(config, "objectType");
+    if (!objectTypeToken) {
+        objectTypeToken = extractString(config, "ObjectType");
+    }
+    if (objectTypeToken) {
+        point.objectType = parseObjectType(*objectTypeToken);
+    }
+    else
+    {
+        nodalisLog() << "BACNET-IP no object type\n";
+        nodalisLog() << config.dump() << "\n";
+    }
 
-        // ---- Success case: ComplexACK for ReadProperty ----
-        if (pduType == PDU_TYPE_COMPLEX_ACK)
-        {
-            if (apdu_len < 3)
-            {
-                continue;
-            }
-            if (apdu[2] != SERVICE_CONFIRMED_READ_PROPERTY)
-            {
-                continue;
-            }
+    uint32_t instance = 0;
+    if (extractNumber(config, "objectInstance", instance) ||
+        extractNumber(config, "ObjectInstance", instance)) {
+        point.objectInstance = instance;
+    }
+    else
+    {
+        nodalisLog() << "BACNET-IP no object instance\n";
+    }
 
-            BACNET_READ_PROPERTY_DATA ack{};
-            if (rp_ack_decode_service_request(apdu + 3, apdu_len - 3, &ack) < 0)
-            {
-                continue;
-            }
-            if (!ack.application_data || ack.application_data_len <= 0)
-            {
-                return false;
-            }
-            if (bacapp_decode_application_data(ack.application_data, ack.application_data_len, &value) < 0)
-            {
-                return false;
-            }
-            return true;
-        }
+    auto propertyToken = extractString(config, "propertyId");
+    if (!propertyToken) {
+        propertyToken = extractString(config, "PropertyId");
+    }
+    if (propertyToken) {
+        point.propertyId = parsePropertyId(*propertyToken);
+    }
+    else
+    {
+        nodalisLog() << "BACNET-IP no property id\n";
+    }
 
-        // ---- ERROR / REJECT / ABORT handling (robust) ----
+    auto valueTypeToken = extractString(config, "valueType");
+    if (!valueTypeToken)
+    {
+        valueTypeToken = extractString(config, "ValueType");
+    }
+    if (valueTypeToken)
+    {
+        point.valueType = parseValueType(*valueTypeToken);
+    }
+    else
+    {
+        nodalisLog() << "BACNET-IP no value type\n";
+    }
 
-        if (pduType == PDU_TYPE_ERROR)
-        {
-            uint8_t service = (apdu_len >= 3) ? apdu[2] : 0xFF;
-            uint32_t errClass = 0, errCode = 0;
-            bool decoded = (apdu_len > 3) && decode_error_class_code(apdu, apdu_len, 3, errClass, errCode);
+    int32_t arrayIndex = point.arrayIndex;
+    if (extractNumber(config, "arrayIndex", arrayIndex) ||
+        extractNumber(config, "ArrayIndex", arrayIndex))
+    {
+        point.arrayIndex = arrayIndex;
+    }
 
-            std::cout << "BACNET-IP performRead got ERROR for invoke=" << int(invoke)
-                      << " service=" << int(service);
+    // ProtocolProperties may subscribe to the point's changes with {"COV": true}, rather than polling it.
+    extractBool(config, "COV", point.cov);
+    extractBool(config, "COVConfirmed", point.covConfirmed);
+    extractNumber(config, "COVLifetime", point.covLifetime);
 
-            if (decoded)
-            {
-                std::cout << " errClass=" << errClass << " errCode=" << errCode;
-            }
-            else
-            {
-                std::cout << " (could not decode error class/code)";
-            }
-            std::cout << "\n";
+    // ProtocolProperties may set the command priority outputs are written at with {"Priority": 8}.
+    int priority = point.priority;
+    if (extractNumber(config, "Priority", priority) && priority >= 0 && priority <= BACNET_MAX_PRIORITY)
+    {
+        point.priority = static_cast<uint8_t>(priority);
+    }
 
-            return false;
-        }
+    return true;
+}
 
-        if (pduType == PDU_TYPE_REJECT)
+bool BACNETClient::parseStringRemote(const std::string &definition, BACnetRemotePoint &point) const
+{
+    std::vector<std::string> tokens;
+    std::string current;
+    for (char ch : definition)
+    {
+        if (ch == ':' || ch == '|')
         {
-            uint8_t reason = (apdu_len >= 3) ? apdu[2] : 0xFF;
-            std::cout << "BACNET-IP performRead got REJECT for invoke=" << int(invoke)
-                      << " reason=" << int(reason) << "\n";
-            return false;
+            if (!current.empty())
+            {
+                tokens.push_back(current);
+                current.clear();
+            }
         }
-
-        if (pduType == PDU_TYPE_ABORT)
+        else
         {
-            uint8_t reason = (apdu_len >= 3) ? apdu[2] : 0xFF;
-            bool server = (apdu[0] & 0x01) != 0;
-            std::cout << "BACNET-IP performRead got ABORT for invoke=" << int(invoke)
-                      << " reason=" << int(reason)
-                      << " server=" << (server ? "true" : "false") << "\n";
-            return false;
+            current.push_back(ch);
         }
+    }
+    if (!current.empty())
+    {
+        tokens.push_back(current);
+    }
 
-        // SimpleACK is not expected for ReadProperty; ignore.
+    if (tokens.size() < 3)
+    {
+        return false;
     }
 
-    return false;
+    point.objectType = parseObjectType(tokens[0]);
+    point.objectInstance = static_cast<uint32_t>(std::stoul(tokens[1]));
+    point.propertyId = parsePropertyId(tokens[2]);
+    if (tokens.size() > 3)
+    {
+        point.arrayIndex = static_cast<int32_t>(std::stol(tokens[3]));
+    }
+    return true;
 }
 
-bool BACNETClient::performWrite(const BACnetRemotePoint &point, const BACNET_APPLICATION_DATA_VALUE &value)
+BACNET_OBJECT_TYPE BACNETClient::parseObjectType(const std::string &raw) const
 {
-    if (!ensureDatalink())
+    nodalisLog() << "BACNET-IP parsing object type " << raw.c_str() << "\n";
+    return static_cast<BACNET_OBJECT_TYPE>(std::stoi(raw));
+}
+
+BACNET_PROPERTY_ID BACNETClient::parsePropertyId(const std::string &raw) const
+{
+    nodalisLog() << "BACNET-IP parsing property id " << raw.c_str() << "\n";
+    return static_cast<BACNET_PROPERTY_ID>(std::stoi(raw));
+}
+
+uint8_t BACNETClient::parseValueType(const std::string &raw) const
+{
+    nodalisLog() << "BACNET-IP parsing value type " << raw.c_str() << "\n";
+    BACNET_APPLICATION_TAG result = BACNET_APPLICATION_TAG_ENUMERATED;
+    if (raw == "i")
     {
-        return false;
+        result = BACNET_APPLICATION_TAG_SIGNED_INT;
+    }
+    else if (raw == "u")
+    {
+        result = BACNET_APPLICATION_TAG_UNSIGNED_INT;
+    }
+    else if (raw == "d")
+    {
+        result = BACNET_APPLICATION_TAG_DOUBLE;
+    }
+    else if (raw == "b")
+    {
+        result = BACNET_APPLICATION_TAG_BOOLEAN;
     }
+    else if (raw == "f")
+    {
+        result = BACNET_APPLICATION_TAG_REAL;
+    }
+    return static_cast<uint8_t>(result);
+}
 
-    BACNET_ADDRESS dest = buildAddress();
-    BACNET_NPDU_DATA npdu;
-    npdu_encode_npdu_data(&npdu, false, MESSAGE_PRIORITY_NORMAL);
+/**
+ * Logs a reply that failed a request: an Error, Reject or Abort PDU.
+ * @param operation The name of the operation, for logging.
+ * @param invoke The invoke ID of the request.
+ * @param apdu The APDU of the reply.
+ * @param apduLen The length of the APDU.
+ */
+static void logFailure(const char* operation, uint8_t invoke, const uint8_t* apdu, int apduLen)
+{
+    uint8_t pduType = (apdu[0] & 0xF0);
+    if (pduType == PDU_TYPE_ERROR)
+    {
+        uint8_t service = (apduLen >= 3) ? apdu[2] : 0xFF;
+        uint32_t errClass = 0, errCode = 0;
+        bool decoded = (apduLen > 3) && decode_error_class_code(apdu, apduLen, 3, errClass, errCode);
+
+        if (decoded)
+        {
+            DIAGNOSTIC("BACNET-IP " << operation << " got ERROR for invoke=" << int(invoke) << " service=" << int(service)
+                       << " errClass=" << errClass << " errCode=" << errCode);
+        }
+        else
+        {
+            DIAGNOSTIC("BACNET-IP " << operation << " got ERROR for invoke=" << int(invoke) << " service=" << int(service)
+                       << " (could not decode error class/code)");
+        }
+    }
+    else if (pduType == PDU_TYPE_REJECT)
+    {
+        uint8_t reason = (apduLen >= 3) ? apdu[2] : 0xFF;
+        DIAGNOSTIC("BACNET-IP " << operation << " got REJECT for invoke=" << int(invoke) << " reason=" << int(reason));
+    }
+    else if (pduType == PDU_TYPE_ABORT)
+    {
+        uint8_t reason = (apduLen >= 3) ? apdu[2] : 0xFF;
+        bool server = (apdu[0] & 0x01) != 0; // BACnet: bit0 indicates server abort
+        DIAGNOSTIC("BACNET-IP " << operation << " got ABORT for invoke=" << int(invoke) << " reason=" << int(reason)
+                   << " server=" << (server ? "true" : "false"));
+    }
+    else
+    {
+        uint8_t service = (apduLen >= 3) ? apdu[2] : 0xFF;
+        DIAGNOSTIC("BACNET-IP " << operation << " got " << pdu_type_name(pduType) << " for invoke=" << int(invoke)
+                   << " service=" << int(service) << " (unexpected)");
+    }
+}
 
-    std::array<uint8_t, PDU_BUFFER_SIZE> buffer{};
-    int pduLen = npdu_encode_pdu(buffer.data(), &dest, nullptr, &npdu);
+bool BACNETClient::performRead(const BACnetRemotePoint &point, BACNET_APPLICATION_DATA_VALUE &value)
+{
+    BACnetTransaction transaction;
+    int pduLen = beginRequest(transaction);
     if (pduLen < 0)
     {
         return false;
     }
 
-    BACNET_WRITE_PROPERTY_DATA request{};
+    BACNET_READ_PROPERTY_DATA request{};
     request.object_type = point.objectType;
     request.object_instance = point.objectInstance;
     request.object_property = point.propertyId;
     request.array_index = point.arrayIndex;
-    request.priority = 16;
+    transaction.pduLen = pduLen + rp_encode_apdu(transaction.pdu + pduLen, transaction.invokeId, &request);
+    acceptSegments(transaction, pduLen);
 
-    std::array<uint8_t, MAX_APDU> app{};
-    BACNET_APPLICATION_DATA_VALUE copy = value;
-    int appLen = bacapp_encode_application_data(app.data(), &copy);
-    if (appLen <= 0)
+    if (!transact(transaction))
     {
         return false;
     }
-    request.application_data_len = appLen;
-    std::memcpy(request.application_data, app.data(),
-                static_cast<size_t>(appLen));
 
-    uint8_t invoke = nextInvokeId();
-    pduLen += wp_encode_apdu(buffer.data() + pduLen, invoke, &request);
+    const uint8_t *apdu = transaction.replyApdu();
+    int apdu_len = transaction.replyLen;
+    uint8_t pduType = (apdu[0] & 0xF0);
 
-    if (datalink_send_pdu(&dest, &npdu, buffer.data(), pduLen) <= 0)
+    // ---- Success case: ComplexACK for ReadProperty ----
+    if (pduType == PDU_TYPE_COMPLEX_ACK && apdu_len >= 3 && apdu[2] == SERVICE_CONFIRMED_READ_PROPERTY)
     {
-        return false;
-    }
+        BACNET_READ_PROPERTY_DATA ack{};
+        if (rp_ack_decode_service_request(const_cast<uint8_t*>(apdu) + 3, apdu_len - 3, &ack) < 0)
+        {
+            return false;
+        }
+        if (!ack.application_data || ack.application_data_len <= 0)
+        {
+            return false;
+        }
+        if (bacapp_decode_application_data(ack.application_data, ack.application_data_len, &value) < 0)
+        {
+            return false;
+        }
+        return true;
+    }
+
+    logFailure("performRead", transaction.invokeId, apdu, apdu_len);
+    return false;
+}
+
+bool BACNETClient::performWrite(const BACnetRemotePoint &point, const BACNET_APPLICATION_DATA_VALUE &value)
+{
+    BACnetTransaction transaction;
+    int pduLen = beginRequest(transaction);
+    if (pduLen < 0)
+    {
+        return false;
+    }
+
+    BACNET_WRITE_PROPERTY_DATA request;
+    request.object_type = point.objectType;
+    request.object_instance = point.objectInstance;
+    request.object_property = point.propertyId;
+    request.array_index = point.arrayIndex;
+    request.priority = point.priority;
+
+    // Encoded straight into the request, which is left uninitialized rather than zeroing its 1476 byte buffer.
+    BACNET_APPLICATION_DATA_VALUE copy = value;
+    int appLen = bacapp_encode_application_data(request.application_data, &copy);
+    if (appLen <= 0)
+    {
+        return false;
+    }
+    request.application_data_len = appLen;
+
+    transaction.pduLen = pduLen + wp_encode_apdu(transaction.pdu + pduLen, transaction.invokeId, &request);
+
+    if (!transact(transaction))
+    {
+        DIAGNOSTIC("BACNET-IP performWrite Did not receive ACK");
+        return false;
+    }
+
+    // SUCCESS: SimpleACK for WriteProperty
+    const uint8_t *apdu = transaction.replyApdu();
+    if ((apdu[0] & 0xF0) == PDU_TYPE_SIMPLE_ACK && transaction.replyLen >= 3 && apdu[2] == SERVICE_CONFIRMED_WRITE_PROPERTY)
+    {
+        return true;
+    }
+
+    logFailure("performWrite", transaction.invokeId, apdu, transaction.replyLen);
+    return false;
+}
+
+int BACNETClient::beginRequest(BACnetTransaction& transaction)
+{
+    if (!ensureDatalink())
+    {
+        return -1;
+    }
+    transaction.dest = device;
+    npdu_encode_npdu_data(&transaction.npdu, true, MESSAGE_PRIORITY_NORMAL);
+    transaction.invokeId = nextInvokeId();
+    transaction.pending = false;
+    transaction.replyLen = 0;
+    transaction.pduLen = 0;
+    return npdu_encode_pdu(transaction.pdu, &transaction.dest, nullptr, &transaction.npdu);
+}
 
-    const auto deadline = std::chrono::steady_clock::now() + REQUEST_TIMEOUT;
+bool BACNETClient::submit(BACnetTransaction& transaction)
+{
+    BACnetDatalink& datalink = BACnetDatalink::instance();
+    std::lock_guard<std::mutex> lock(datalink.routeMutex());
+    // The transaction is registered before it is sent, so that a fast reply finds it.
+    pending[transaction.invokeId] = &transaction;
+    transaction.pending = true;
+    transaction.replyLen = 0;
+    transaction.assembled.clear();
+    transaction.retriesLeft = retries;
+    transaction.sentAt = std::chrono::steady_clock::now();
+    transaction.deadline = transaction.sentAt + std::chrono::milliseconds(responseTimeout);
+    if (datalink.send(transaction.dest, transaction.npdu, transaction.pdu, transaction.pduLen))
+    {
+        return true;
+    }
+    pending[transaction.invokeId] = nullptr;
+    transaction.pending = false;
+    requestCompleted(false, 0);
+    return false;
+}
 
-    while (std::chrono::steady_clock::now() < deadline)
+void BACNETClient::await(BACnetTransaction* const* transactions, size_t count)
+{
+    BACnetDatalink& datalink = BACnetDatalink::instance();
+    std::unique_lock<std::mutex> lock(datalink.routeMutex());
+    while (true)
     {
-        BACNET_ADDRESS source{};
-        std::array<uint8_t, PDU_BUFFER_SIZE> rx{};
-        int received = datalink_receive(&source, rx.data(), rx.size(), 10);
-        if (received <= 0)
+        auto now = std::chrono::steady_clock::now();
+        auto wake = now + std::chrono::milliseconds(RECEIVE_SLICE_MS);
+        bool waiting = false;
+        for (size_t i = 0; i < count; i++)
         {
-            continue;
+            BACnetTransaction& transaction = *transactions[i];
+            if (!transaction.pending)
+            {
+                continue;
+            }
+            if (now >= transaction.deadline)
+            {
+                if (transaction.retriesLeft <= 0)
+                {
+                    // Out of retries. A reply that arrives later finds no transaction and is dropped.
+                    if (pending[transaction.invokeId] == &transaction)
+                    {
+                        pending[transaction.invokeId] = nullptr;
+                    }
+                    transaction.pending = false;
+                    datalink.countTimeout();
+                    requestCompleted(false, 0);
+                    continue;
+                }
+                // The request is sent again with the same invoke ID, so that a late reply to either copy completes it.
+                transaction.retriesLeft--;
+                transaction.deadline = now + std::chrono::milliseconds(responseTimeout);
+                // A segmented reply that stalled is started over by the new copy.
+                transaction.assembled.clear();
+                datalink.countResend();
+                datalink.send(transaction.dest, transaction.npdu, transaction.pdu, transaction.pduLen);
+            }
+            waiting = true;
+            if (transaction.deadline < wake)
+            {
+                wake = transaction.deadline;
+            }
+        }
+        if (!waiting)
+        {
+            return;
         }
+        datalink.pump(lock, wake);
+    }
+}
+
+bool BACNETClient::transact(BACnetTransaction& transaction)
+{
+    if (!submit(transaction))
+    {
+        return false;
+    }
+    BACnetTransaction* list[1] = { &transaction };
+    await(list, 1);
+    return transaction.replyLen > 0;
+}
+
+void BACNETClient::deliver(BACNET_ADDRESS& source, const uint8_t* apdu, int apduLen)
+{
+    // IMPORTANT: your stack's PDU_TYPE_* constants appear to already be 0x10/0x20/0x30...
+    // So compare using (apdu[0] & 0xF0) directly to PDU_TYPE_* (no shifts).
+    uint8_t pduType = (apdu[0] & 0xF0);
+
+    // Only these contain invoke id at apdu[1]
+    bool hasInvoke = (pduType == PDU_TYPE_SIMPLE_ACK ||
+                      pduType == PDU_TYPE_COMPLEX_ACK ||
+                      pduType == PDU_TYPE_ERROR ||
+                      pduType == PDU_TYPE_REJECT ||
+                      pduType == PDU_TYPE_ABORT);
+
+    if (!hasInvoke)
+    {
+        handleUnsolicited(source, apdu, apduLen);
+        return;
+    }
+    BACnetTransaction* transaction = pending[apdu[1]];
+    if (!transaction)
+    {
+        return;
+    }
+    if (pduType == PDU_TYPE_COMPLEX_ACK && (apdu[0] & 0x08) != 0)
+    {
+        receiveSegment(*transaction, apdu, apduLen);
+        return;
+    }
+    int replyLen = apduLen < MAX_APDU ? apduLen : MAX_APDU;
+    std::memcpy(transaction->reply, apdu, static_cast<size_t>(replyLen));
+    transaction->assembled.clear();
+    complete(*transaction, replyLen);
+}
+
+void BACNETClient::complete(BACnetTransaction& transaction, int replyLen)
+{
+    transaction.replyLen = replyLen;
+    transaction.pending = false;
+    pending[transaction.invokeId] = nullptr;
+    // This can run on whichever client's thread is pumping the datalink, which the counters allow.
+    uint8_t pduType = replyLen > 0 ? (transaction.replyApdu()[0] & 0xF0) : 0;
+    requestCompleted(pduType == PDU_TYPE_SIMPLE_ACK || pduType == PDU_TYPE_COMPLEX_ACK,
+        microsBetween(transaction.sentAt, std::chrono::steady_clock::now()));
+    BACnetDatalink::instance().notify();
+}
+
+/**
+ * Sends an APDU that doesn't expect a reply, such as a SegmentACK, an Abort or the server's answer to a request.
+ * @param dest The address to send it to.
+ * @param apdu The APDU.
+ * @param apduLen The length of the APDU.
+ */
+static void sendApdu(BACNET_ADDRESS& dest, const uint8_t* apdu, int apduLen)
+{
+    uint8_t pdu[MAX_PDU];
+    BACNET_NPDU_DATA npdu{};
+    npdu_encode_npdu_data(&npdu, false, MESSAGE_PRIORITY_NORMAL);
+    int len = npdu_encode_pdu(pdu, &dest, nullptr, &npdu);
+    std::memcpy(pdu + len, apdu, static_cast<size_t>(apduLen));
+    BACnetDatalink::instance().send(dest, npdu, pdu, len + apduLen);
+}
+
+void BACNETClient::acceptSegments(BACnetTransaction& transaction, int npduLen) const
+{
+    if (maxSegments > 1)
+    {
+        // The segmented-response-accepted bit, and the most segments and largest APDU this client accepts.
+        transaction.pdu[npduLen] |= 0x02;
+        transaction.pdu[npduLen + 1] = encode_max_segs_max_apdu(static_cast<int>(maxSegments), MAX_APDU);
+    }
+}
+
+size_t BACNETClient::replyBudget() const
+{
+    bool segments = maxSegments > 1 && (segmentation == SEGMENTATION_BOTH || segmentation == SEGMENTATION_TRANSMIT);
+    // Each segment starts with the 5 byte header of a segmented ComplexACK, where an unsegmented one has 3.
+    return segments ? (maxApdu - 5) * maxSegments + 3 : maxApdu;
+}
+
+void BACNETClient::receiveSegment(BACnetTransaction& transaction, const uint8_t* apdu, int apduLen)
+{
+    // A segment has its sequence number and the window size the device proposes before the service choice.
+    if (apduLen < 5)
+    {
+        return;
+    }
+    uint8_t sequence = apdu[2];
+    bool more = (apdu[0] & 0x04) != 0;
+    if (sequence == 0)
+    {
+        uint8_t proposed = apdu[3] > 0 ? apdu[3] : 1;
+        transaction.windowSize = proposed < segmentWindow ? proposed : segmentWindow;
+        transaction.assembled.assign({ PDU_TYPE_COMPLEX_ACK, transaction.invokeId, apdu[4] });
+        transaction.nextSegment = 0;
+        transaction.windowStart = 0;
+    }
+    if (transaction.assembled.empty())
+    {
+        // The first segment was missed, so the device sends it again when it gets no SegmentACK.
+        return;
+    }
+    if (sequence != transaction.nextSegment)
+    {
+        sendSegmentAck(transaction, static_cast<uint8_t>(transaction.nextSegment - 1), true);
+        return;
+    }
+    size_t dataLen = static_cast<size_t>(apduLen - 5);
+    if (transaction.assembled.size() + dataLen > maxSegments * MAX_APDU)
+    {
+        // The device sent more than the request accepted, so the transaction is aborted as a buffer overflow.
+        uint8_t abort[3] = { PDU_TYPE_ABORT, transaction.invokeId, ABORT_REASON_BUFFER_OVERFLOW };
+        sendApdu(transaction.dest, abort, 3);
+        std::memcpy(transaction.reply, abort, 3);
+        transaction.assembled.clear();
+        complete(transaction, 3);
+        return;
+    }
+    transaction.assembled.insert(transaction.assembled.end(), apdu + 5, apdu + apduLen);
+    transaction.nextSegment++;
+    // The reply is still arriving, so the wait for the rest of it starts over with each segment.
+    transaction.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(responseTimeout);
+    if (!more)
+    {
+        sendSegmentAck(transaction, sequence, false);
+        complete(transaction, static_cast<int>(transaction.assembled.size()));
+        return;
+    }
+    // The first segment is acknowledged on its own, and then each window once all of its segments are in.
+    if (sequence == 0 || static_cast<uint8_t>(transaction.nextSegment - transaction.windowStart) >= transaction.windowSize)
+    {
+        sendSegmentAck(transaction, sequence, false);
+        transaction.windowStart = transaction.nextSegment;
+    }
+}
+
+void BACNETClient::sendSegmentAck(BACnetTransaction& transaction, uint8_t sequence, bool negative)
+{
+    uint8_t ack[4] = {
+        static_cast<uint8_t>(PDU_TYPE_SEGMENT_ACK | (negative ? 0x02 : 0x00)),
+        transaction.invokeId,
+        sequence,
+        transaction.windowSize
+    };
+    sendApdu(transaction.dest, ack, 4);
+}
+
+/**
+ * Estimates the size of a point's result in a ReadPropertyMultiple acknowledgement.
+ * @param point The point.
+ * @param newObject Whether the point starts a new object in the request.
+ * @returns Returns the largest size the result can have, for the numeric values that points are read as.
+ */
+static size_t resultSize(const BACnetRemotePoint& point, bool newObject)
+{
+    // The property identifier, the tags around the value, and the largest numeric value (a double).
+    size_t size = 4 + 2 + 10;
+    if (point.arrayIndex != BACNET_ARRAY_ALL)
+    {
+        size += 5;
+    }
+    if (newObject)
+    {
+        // The object identifier and the tags around its results.
+        size += 5 + 2;
+    }
+    return size;
+}
+
+/**
+ * Estimates the size of a point's entry in a ReadPropertyMultiple request.
+ * @param point The point.
+ * @param newObject Whether the point starts a new object in the request.
+ * @returns Returns the largest size the entry can have.
+ */
+static size_t requestSize(const BACnetRemotePoint& point, bool newObject)
+{
+    // The property identifier, and the array index if there is one.
+    size_t size = 5;
+    if (point.arrayIndex != BACNET_ARRAY_ALL)
+    {
+        size += 5;
+    }
+    if (newObject)
+    {
+        // The object identifier and the tags around its properties.
+        size += 5 + 2;
+    }
+    return size;
+}
 
-        // std::cout << "RX " << received << " bytes\n";
-        // int n = received < 16 ? received : 16;
-        // for (int i = 0; i < n; i++)
-        // {
-        //     printf("%02X ", rx[i]);
-        // }
-        // printf("\n");
+static bool sameObject(const BACnetRemotePoint& a, const BACnetRemotePoint& b)
+{
+    return a.objectType == b.objectType && a.objectInstance == b.objectInstance;
+}
 
-        // ---- NPDU decode (with BVLC fallback) ----
-        BACNET_NPDU_DATA rxNpdu{};
-        int offset = npdu_decode(rx.data(), nullptr, &source, &rxNpdu);
+/**
+ * Estimates the size of a point's entry in a WritePropertyMultiple request.
+ * @param point The point.
+ * @param newObject Whether the point starts a new object in the request.
+ * @returns Returns the largest size the entry can have, for the numeric values that points are written as.
+ */
+static size_t writeSize(const BACnetRemotePoint& point, bool newObject)
+{
+    // The property identifier, the tags around the value, the largest numeric value (a double) and the priority.
+    size_t size = 4 + 2 + 10 + 2;
+    if (point.arrayIndex != BACNET_ARRAY_ALL)
+    {
+        size += 5;
+    }
+    if (newObject)
+    {
+        // The object identifier and the tags around its values.
+        size += 5 + 2;
+    }
+    return size;
+}
 
-        // If decode failed and packet looks like BVLC (BACnet/IP), retry after 4-byte BVLC header.
-        if (offset < 0 && received >= 4 && rx[0] == 0x81)
+void BACNETClient::submitBatch(IOBatch& batch)
+{
+    BACnetDatalink::instance().poll();
+    readBatch.clear();
+    writeBatch.clear();
+    pointRequests.resize(points.size());
+    for (auto& request : batch.requests)
+    {
+        if (request.remoteHandle >= 0)
         {
-            offset = npdu_decode(rx.data() + 4, nullptr, &source, &rxNpdu);
-            if (offset >= 0)
+            BACnetRemotePoint& point = points[request.remoteHandle];
+            pointRequests[request.remoteHandle] = &request;
+            if (request.direction == IOType::Output && wpmSupported && !point.writeSingly)
+            {
+                writeBatch.push_back(&point);
+                continue;
+            }
+            if (request.direction == IOType::Input)
             {
-                offset += 4; // adjust back to original rx buffer offset
+                if (point.cov && covCurrent(point))
+                {
+                    continue;
+                }
+                if (rpmSupported)
+                {
+                    readBatch.push_back(&point);
+                    continue;
+                }
             }
         }
+        NODALIS_TRY
+        {
+            exchange(request);
+        }
+        NODALIS_CATCH(e)
+        {
+            complete(request, IOStatus::Failed);
+        }
+    }
+    transferMultiple(writeBatch, true);
+    shareReads();
+    transferMultiple(readBatch, false);
+}
 
-        if (offset < 0)
+void BACNETClient::shareReads()
+{
+    // Inputs of the same property, such as the bits of one bitstring or several mappings of one value, are read once.
+    sharedReads.clear();
+    std::sort(readBatch.begin(), readBatch.end(), [](const BACnetRemotePoint* a, const BACnetRemotePoint* b) {
+        if (a->objectType != b->objectType) return a->objectType < b->objectType;
+        if (a->objectInstance != b->objectInstance) return a->objectInstance < b->objectInstance;
+        if (a->propertyId != b->propertyId) return a->propertyId < b->propertyId;
+        if (a->arrayIndex != b->arrayIndex) return a->arrayIndex < b->arrayIndex;
+        return a < b;
+    });
+    size_t kept = 0;
+    for (size_t i = 0; i < readBatch.size(); i++)
+    {
+        const BACnetRemotePoint* point = readBatch[i];
+        const BACnetRemotePoint* reader = kept > 0 ? readBatch[kept - 1] : nullptr;
+        if (reader != nullptr && sameObject(*reader, *point) && reader->propertyId == point->propertyId
+            && reader->arrayIndex == point->arrayIndex)
         {
+            sharedReads.emplace_back(reader, point);
             continue;
         }
-
-        int apdu_len = received - offset;
-        if (apdu_len < 1)
+        readBatch[kept++] = point;
+    }
+    readBatch.resize(kept);
+    std::sort(sharedReads.begin(), sharedReads.end());
+}
+
+/**
+ * Fits a decoded value to the width of its mapping.
+ * @param width The width of the mapping.
+ * @param decoded The value, as returned by decodeNumeric().
+ * @returns Returns the value to write to the process image.
+ */
+static uint64_t fitDecoded(int width, uint64_t decoded)
+{
+    switch (width)
+    {
+    case 1:
+        return decoded != 0 ? 1 : 0;
+    case 8:
+        return decoded & 0xFF;
+    case 16:
+        return decoded & 0xFFFF;
+    case 32:
+        return decoded & 0xFFFFFFFF;
+    default:
+        return decoded;
+    }
+}
+
+bool BACNETClient::storeRead(const BACnetRemotePoint& point, const BACNET_APPLICATION_DATA_VALUE* value)
+{
+    uint64_t decoded = 0;
+    bool stored = value != nullptr && decodeNumeric(*value, decoded);
+    // A value that isn't numeric was answered, but can't be mapped.
+    IOStatus status = stored ? IOStatus::Good : value != nullptr ? IOStatus::Refused : IOStatus::Failed;
+    IORequest& request = requestOf(point);
+    complete(request, status, fitDecoded(request.width, decoded));
+    auto shared = std::lower_bound(sharedReads.begin(), sharedReads.end(), std::make_pair(&point, static_cast<const BACnetRemotePoint*>(nullptr)));
+    for (; shared != sharedReads.end() && shared->first == &point; ++shared)
+    {
+        IORequest& sharing = requestOf(*shared->second);
+        complete(sharing, status, fitDecoded(sharing.width, decoded));
+    }
+    return stored;
+}
+
+void BACNETClient::transferMultiple(std::vector<const BACnetRemotePoint*>& batch, bool write)
+{
+    // The points of one object share its entry in the request.
+    std::stable_sort(batch.begin(), batch.end(), [](const BACnetRemotePoint* a, const BACnetRemotePoint* b) {
+        return a->objectType != b->objectType ? a->objectType < b->objectType : a->objectInstance < b->objectInstance;
+    });
+
+    size_t windowSize = maxInFlight < 1 ? 1 : maxInFlight;
+    if (window.size() < windowSize)
+    {
+        window.resize(windowSize);
+    }
+    size_t first = 0;
+    while (first < batch.size())
+    {
+        // Up to maxInFlight requests are sent together, and completed in order once all of them are answered.
+        size_t requestApdu = maxApdu;
+        chunks.clear();
+        outstanding.clear();
+        while (chunks.size() < windowSize && first < batch.size())
+        {
+            // A read takes as many points as the acknowledgement has room for, after its 3 byte header, in as many
+            // segments as the device can send. A write, and the request of a read, take as many as the request has
+            // room for after its 4 byte header, since requests aren't segmented.
+            size_t budget = write ? requestApdu - 4 : replyBudget() - 3;
+            size_t used = 0;
+            size_t requested = 0;
+            size_t count = 0;
+            while (first + count < batch.size())
+            {
+                const BACnetRemotePoint& point = *batch[first + count];
+                bool newObject = count == 0 || !sameObject(*batch[first + count - 1], point);
+                size_t size = write ? writeSize(point, newObject) : resultSize(point, newObject);
+                size_t entry = write ? 0 : requestSize(point, newObject);
+                if (count > 0 && (used + size > budget || requested + entry > requestApdu - 4))
+                {
+                    break;
+                }
+                used += size;
+                requested += entry;
+                count++;
+            }
+            BACnetTransaction& transaction = window[chunks.size()];
+            bool encoded = write ? encodeWriteMultiple(&batch[first], count, transaction)
+                                 : encodeReadMultiple(&batch[first], count, transaction);
+            if (encoded && submit(transaction))
+            {
+                outstanding.push_back(&transaction);
+            }
+            chunks.emplace_back(first, count);
+            first += count;
+        }
+        await(outstanding.data(), outstanding.size());
+        for (size_t i = 0; i < chunks.size(); i++)
+        {
+            const BACnetRemotePoint* const* chunk = &batch[chunks[i].first];
+            if (write)
+            {
+                completeWriteMultiple(chunk, chunks[i].second, window[i]);
+            }
+            else if (!completeReadMultiple(chunk, chunks[i].second, window[i], requestApdu))
+            {
+                for (size_t x = 0; x < chunks[i].second; x++)
+                {
+                    storeRead(*chunk[x], nullptr);
+                }
+            }
+        }
+        if (!(write ? wpmSupported : rpmSupported))
+        {
+            // The device doesn't support the service, so the rest are exchanged one at a time.
+            for (size_t i = chunks[0].first; i < batch.size(); i++)
+            {
+                NODALIS_TRY
+                {
+                    exchange(requestOf(*batch[i]));
+                }
+                NODALIS_CATCH(e)
+                {
+                    complete(requestOf(*batch[i]), IOStatus::Failed);
+                }
+            }
+            if (!write)
+            {
+                for (const auto& shared : sharedReads)
+                {
+                    NODALIS_TRY
+                    {
+                        exchange(requestOf(*shared.second));
+                    }
+                    NODALIS_CATCH(e)
+                    {
+                        complete(requestOf(*shared.second), IOStatus::Failed);
+                    }
+                }
+            }
+            return;
+        }
+    }
+}
+
+bool BACNETClient::encodeWriteMultiple(const BACnetRemotePoint* const* batch, size_t count, BACnetTransaction& transaction)
+{
+    int pduLen = beginRequest(transaction);
+    if (pduLen < 0)
+    {
+        return false;
+    }
+
+    uint8_t* buffer = transaction.pdu;
+    pduLen += wpm_encode_apdu_init(buffer + pduLen, transaction.invokeId);
+    BACNET_WRITE_PROPERTY_DATA property{};
+    for (size_t i = 0; i < count; i++)
+    {
+        const BACnetRemotePoint& point = *batch[i];
+        if (i == 0 || !sameObject(*batch[i - 1], point))
+        {
+            pduLen += wpm_encode_apdu_object_begin(buffer + pduLen, point.objectType, point.objectInstance);
+        }
+        BACNET_APPLICATION_DATA_VALUE value{};
+        if (!encodeValue(requestOf(point).value, point, value))
+        {
+            return false;
+        }
+        property.object_property = point.propertyId;
+        property.array_index = point.arrayIndex;
+        property.priority = point.priority;
+        property.application_data_len = bacapp_encode_application_data(property.application_data, &value);
+        if (property.application_data_len <= 0)
+        {
+            return false;
+        }
+        pduLen += wpm_encode_apdu_object_property(buffer + pduLen, &property);
+        if (i + 1 == count || !sameObject(*batch[i + 1], point))
+        {
+            pduLen += wpm_encode_apdu_object_end(buffer + pduLen);
+        }
+    }
+    transaction.pduLen = pduLen;
+    return true;
+}
+
+bool BACNETClient::completeWriteMultiple(const BACnetRemotePoint* const* batch, size_t count, const BACnetTransaction& transaction)
+{
+    const uint8_t* apdu = transaction.replyApdu();
+    int apduLen = transaction.replyLen;
+    uint8_t pduType = apduLen >= 3 ? (apdu[0] & 0xF0) : 0;
+    if (pduType == PDU_TYPE_SIMPLE_ACK && apdu[2] == SERVICE_CONFIRMED_WRITE_PROP_MULTIPLE)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            complete(requestOf(*batch[i]), IOStatus::Good);
+        }
+        return true;
+    }
+
+    // The device writes the properties in order and stops at the first that fails, so that one and the rest are
+    // written again. If the reply doesn't say which one failed, all of them are. The one that failed is written on
+    // its own from then on, so that it can't keep the points after it from being written.
+    size_t failed = 0;
+    IOStatus status = IOStatus::Failed;
+    if (apduLen == 0)
+    {
+        DIAGNOSTIC("BACNET-IP WritePropertyMultiple of " << count << " points on " << remoteIp << " timed out");
+    }
+    else if (pduType == PDU_TYPE_REJECT && apdu[2] == REJECT_REASON_UNRECOGNIZED_SERVICE)
+    {
+        if (wpmSupported)
+        {
+            DIAGNOSTIC("BACNET-IP " << remoteIp << " doesn't support WritePropertyMultiple; writing points one at a time");
+        }
+        // The points are written one at a time right away, so they aren't marked as failed.
+        wpmSupported = false;
+        return false;
+    }
+    else if (pduType == PDU_TYPE_ERROR && apdu[2] == SERVICE_CONFIRMED_WRITE_PROP_MULTIPLE)
+    {
+        status = IOStatus::Refused;
+        BACNET_WRITE_PROPERTY_DATA error{};
+        if (wpm_error_ack_decode_apdu(apdu + 3, static_cast<uint16_t>(apduLen - 3), &error) > 0)
+        {
+            DIAGNOSTIC("BACNET-IP write of object " << error.object_type << ":" << error.object_instance << " property "
+                       << error.object_property << " got ERROR errClass=" << error.error_class << " errCode=" << error.error_code);
+            for (size_t i = 0; i < count; i++)
+            {
+                if (batch[i]->objectType == error.object_type && batch[i]->objectInstance == error.object_instance
+                    && batch[i]->propertyId == error.object_property)
+                {
+                    failed = i;
+                    points[mappings[batch[i]->mapping].remoteHandle].writeSingly = true;
+                    break;
+                }
+            }
+        }
+    }
+    else
+    {
+        logFailure("WritePropertyMultiple", transaction.invokeId, apdu, apduLen);
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        complete(requestOf(*batch[i]), i < failed ? IOStatus::Good : status);
+    }
+    return false;
+}
+
+bool BACNETClient::encodeReadMultiple(const BACnetRemotePoint* const* batch, size_t count, BACnetTransaction& transaction)
+{
+    int pduLen = beginRequest(transaction);
+    if (pduLen < 0)
+    {
+        return false;
+    }
+
+    uint8_t* buffer = transaction.pdu;
+    int npduLen = pduLen;
+    pduLen += rpm_encode_apdu_init(buffer + pduLen, transaction.invokeId);
+    acceptSegments(transaction, npduLen);
+    for (size_t i = 0; i < count; i++)
+    {
+        const BACnetRemotePoint& point = *batch[i];
+        if (i == 0 || !sameObject(*batch[i - 1], point))
+        {
+            pduLen += rpm_encode_apdu_object_begin(buffer + pduLen, point.objectType, point.objectInstance);
+        }
+        pduLen += rpm_encode_apdu_object_property(buffer + pduLen, point.propertyId, point.arrayIndex);
+        if (i + 1 == count || !sameObject(*batch[i + 1], point))
+        {
+            pduLen += rpm_encode_apdu_object_end(buffer + pduLen);
+        }
+    }
+    transaction.pduLen = pduLen;
+    return true;
+}
+
+bool BACNETClient::completeReadMultiple(const BACnetRemotePoint* const* batch, size_t count, const BACnetTransaction& transaction, size_t requestApdu)
+{
+    if (transaction.replyLen == 0)
+    {
+        DIAGNOSTIC("BACNET-IP ReadPropertyMultiple of " << count << " points on " << remoteIp << " timed out");
+        return false;
+    }
+    const uint8_t* apdu = transaction.replyApdu();
+    int apduLen = transaction.replyLen;
+    if (apduLen < 3)
+    {
+        return false;
+    }
+
+    uint8_t pduType = (apdu[0] & 0xF0);
+    if (pduType == PDU_TYPE_REJECT && apdu[2] == REJECT_REASON_UNRECOGNIZED_SERVICE)
+    {
+        if (rpmSupported)
+        {
+            DIAGNOSTIC("BACNET-IP " << remoteIp << " doesn't support ReadPropertyMultiple; reading points one at a time");
+        }
+        rpmSupported = false;
+        return false;
+    }
+    if (pduType == PDU_TYPE_ABORT && apdu[2] == ABORT_REASON_SEGMENTATION_NOT_SUPPORTED && replyBudget() > maxApdu)
+    {
+        // The device announced that it can segment, but won't, so later requests fit in one APDU.
+        segmentation = SEGMENTATION_NONE;
+        DIAGNOSTIC("BACNET-IP " << remoteIp << " doesn't segment ReadPropertyMultiple replies; reading fewer points at a time");
+        return false;
+    }
+    if ((pduType == PDU_TYPE_ABORT && (apdu[2] == ABORT_REASON_SEGMENTATION_NOT_SUPPORTED || apdu[2] == ABORT_REASON_BUFFER_OVERFLOW))
+        || (pduType == PDU_TYPE_REJECT && apdu[2] == REJECT_REASON_BUFFER_OVERFLOW))
+    {
+        // The acknowledgement didn't fit in one APDU, so later requests are made smaller. Every request that was
+        // outstanding with this one was sized the same, so the limit is only halved once for all of them.
+        size_t reduced = requestApdu / 2 > MIN_APDU ? requestApdu / 2 : MIN_APDU;
+        if (reduced < maxApdu)
+        {
+            maxApdu = reduced;
+            DIAGNOSTIC("BACNET-IP ReadPropertyMultiple on " << remoteIp << " was too large; using a max APDU of " << maxApdu);
+        }
+        return false;
+    }
+    if (pduType != PDU_TYPE_COMPLEX_ACK || apdu[2] != SERVICE_CONFIRMED_READ_PROP_MULTIPLE || (apdu[0] & 0x08) != 0)
+    {
+        DIAGNOSTIC("BACNET-IP ReadPropertyMultiple on " << remoteIp << " got " << pdu_type_name(pduType));
+        return false;
+    }
+
+    // The results follow the order of the request: each object, then each of its properties with a value or an error.
+    const uint8_t* p = apdu + 3;
+    int remaining = apduLen - 3;
+    size_t index = 0;
+    while (remaining > 0 && index < count)
+    {
+        BACNET_OBJECT_TYPE objectType = OBJECT_NONE;
+        uint32_t objectInstance = 0;
+        int len = rpm_ack_decode_object_id(p, static_cast<unsigned>(remaining), &objectType, &objectInstance);
+        if (len <= 0)
+        {
+            break;
+        }
+        p += len;
+        remaining -= len;
+        int endLength = 0;
+        while (remaining > 0 && !bacnet_is_closing_tag_number(p, static_cast<uint32_t>(remaining), 1, &endLength))
+        {
+            BACNET_PROPERTY_ID property = PROP_PRESENT_VALUE;
+            BACNET_ARRAY_INDEX arrayIndex = BACNET_ARRAY_ALL;
+            len = rpm_ack_decode_object_property(p, static_cast<unsigned>(remaining), &property, &arrayIndex);
+            if (len <= 0)
+            {
+                return false;
+            }
+            p += len;
+            remaining -= len;
+
+            const BACnetRemotePoint* point = index < count ? batch[index] : nullptr;
+            if (!point || point->objectType != objectType || point->objectInstance != objectInstance || point->propertyId != property)
+            {
+                DIAGNOSTIC("BACNET-IP ReadPropertyMultiple on " << remoteIp << " returned an unexpected property");
+                return false;
+            }
+            index++;
+
+            int tagLength = 0;
+            bool isValue = bacnet_is_opening_tag_number(p, static_cast<uint32_t>(remaining), 4, &tagLength);
+            if (!isValue && !bacnet_is_opening_tag_number(p, static_cast<uint32_t>(remaining), 5, &tagLength))
+            {
+                return false;
+            }
+            int dataLength = bacnet_enclosed_data_length(p, static_cast<size_t>(remaining));
+            if (dataLength < 0 || tagLength + dataLength + 1 > remaining)
+            {
+                return false;
+            }
+            const uint8_t* data = p + tagLength;
+            if (isValue)
+            {
+                BACNET_APPLICATION_DATA_VALUE value{};
+                bool decoded = bacapp_decode_application_data(data, static_cast<uint32_t>(dataLength), &value) > 0;
+                if (!storeRead(*point, decoded ? &value : nullptr))
+                {
+                    DIAGNOSTIC("BACNET-IP could not decode object " << objectType << ":" << objectInstance << " property " << property);
+                }
+            }
+            else
+            {
+                uint32_t errClass = 0, errCode = 0;
+                int used = bacnet_enumerated_application_decode(data, static_cast<uint32_t>(dataLength), &errClass);
+                if (used > 0)
+                {
+                    bacnet_enumerated_application_decode(data + used, static_cast<uint32_t>(dataLength - used), &errCode);
+                }
+                DIAGNOSTIC("BACNET-IP read of object " << objectType << ":" << objectInstance << " property " << property
+                           << " got ERROR errClass=" << errClass << " errCode=" << errCode);
+                storeRead(*point, nullptr);
+            }
+            // The opening tag, the data and the one byte closing tag.
+            p += tagLength + dataLength + 1;
+            remaining -= tagLength + dataLength + 1;
+        }
+        // The closing tag of the object's results.
+        p += endLength;
+        remaining -= endLength;
+    }
+    return index == count;
+}
+
+bool BACNETClient::covCurrent(BACnetRemotePoint& point)
+{
+    uint64_t now = elapsed();
+    if (point.covRenewAt > now)
+    {
+        return true;
+    }
+    switch (performSubscribe(point))
+    {
+    case SubscribeResult::Subscribed:
+        // Renew at half the lifetime, so that a lost renewal can be retried before the subscription expires.
+        point.covRenewAt = point.covLifetime == 0 ? UINT64_MAX : now + point.covLifetime * 500ULL;
+        break;
+    case SubscribeResult::Refused:
+        DIAGNOSTIC("BACNET-IP " << remoteIp << " refused a COV subscription to object " << point.objectType << ":"
+                   << point.objectInstance << "; polling it instead");
+        point.cov = false;
+        break;
+    case SubscribeResult::Failed:
+        break;
+    }
+    // The point is read once whenever it is (re)subscribed, so that its value doesn't wait for a change.
+    return false;
+}
+
+BACNETClient::SubscribeResult BACNETClient::performSubscribe(const BACnetRemotePoint& point)
+{
+    BACnetTransaction transaction;
+    int pduLen = beginRequest(transaction);
+    if (pduLen < 0)
+    {
+        return SubscribeResult::Failed;
+    }
+
+    // The target is registered before the request, because the device may notify before its acknowledgement arrives.
+    const IOMap& map = mappings[point.mapping];
+    auto matches = [&](const CovTarget& t) {
+        return t.objectType == point.objectType && t.objectInstance == point.objectInstance
+            && t.propertyId == point.propertyId && t.local.offset == map.local.offset && t.local.bit == map.local.bit;
+    };
+    {
+        std::lock_guard<std::mutex> lock(BACnetDatalink::instance().routeMutex());
+        if (std::find_if(covTargets.begin(), covTargets.end(), matches) == covTargets.end())
+        {
+            covTargets.push_back({ point.objectType, point.objectInstance, point.propertyId, map.local, map.width, map.quality });
+        }
+    }
+
+    BACNET_SUBSCRIBE_COV_DATA request{};
+    request.subscriberProcessIdentifier = processId;
+    request.monitoredObjectIdentifier.type = point.objectType;
+    request.monitoredObjectIdentifier.instance = point.objectInstance;
+    request.cancellationRequest = false;
+    request.issueConfirmedNotifications = point.covConfirmed;
+    request.lifetime = point.covLifetime;
+    uint8_t service = SERVICE_CONFIRMED_SUBSCRIBE_COV;
+    unsigned room = static_cast<unsigned>(sizeof(transaction.pdu) - static_cast<size_t>(pduLen));
+    if (point.propertyId == PROP_PRESENT_VALUE && point.arrayIndex == BACNET_ARRAY_ALL)
+    {
+        pduLen += cov_subscribe_encode_apdu(transaction.pdu + pduLen, room, transaction.invokeId, &request);
+    }
+    else
+    {
+        service = SERVICE_CONFIRMED_SUBSCRIBE_COV_PROPERTY;
+        request.covSubscribeToProperty = true;
+        request.monitoredProperty.property_identifier = point.propertyId;
+        request.monitoredProperty.property_array_index = point.arrayIndex;
+        pduLen += cov_subscribe_property_encode_apdu(transaction.pdu + pduLen, room, transaction.invokeId, &request);
+    }
+    transaction.pduLen = pduLen;
+
+    if (!transact(transaction))
+    {
+        return SubscribeResult::Failed;
+    }
+    const uint8_t* apdu = transaction.replyApdu();
+    uint8_t pduType = (apdu[0] & 0xF0);
+    if (pduType == PDU_TYPE_SIMPLE_ACK && transaction.replyLen >= 3 && apdu[2] == service)
+    {
+        return SubscribeResult::Subscribed;
+    }
+    if (pduType == PDU_TYPE_ERROR)
+    {
+        uint32_t errClass = 0, errCode = 0;
+        if (decode_error_class_code(apdu, transaction.replyLen, 3, errClass, errCode))
+        {
+            DIAGNOSTIC("BACNET-IP SubscribeCOV got ERROR errClass=" << errClass << " errCode=" << errCode);
+        }
+    }
+    std::lock_guard<std::mutex> lock(BACnetDatalink::instance().routeMutex());
+    covTargets.erase(std::remove_if(covTargets.begin(), covTargets.end(), matches), covTargets.end());
+    return SubscribeResult::Refused;
+}
+
+void BACNETClient::handleUnsolicited(BACNET_ADDRESS& source, const uint8_t* apdu, int apduLen)
+{
+    uint8_t pduType = (apdu[0] & 0xF0);
+    const uint8_t* request = nullptr;
+    int requestLen = 0;
+    bool confirmed = false;
+    if (pduType == PDU_TYPE_UNCONFIRMED_SERVICE_REQUEST && apduLen >= 2 && apdu[1] == SERVICE_UNCONFIRMED_COV_NOTIFICATION)
+    {
+        request = apdu + 2;
+        requestLen = apduLen - 2;
+    }
+    else if (pduType == PDU_TYPE_CONFIRMED_SERVICE_REQUEST && apduLen >= 4 && (apdu[0] & 0x08) == 0
+             && apdu[3] == SERVICE_CONFIRMED_COV_NOTIFICATION)
+    {
+        confirmed = true;
+        request = apdu + 4;
+        requestLen = apduLen - 4;
+    }
+    else
+    {
+        return;
+    }
+
+    BACNET_COV_DATA data{};
+    BACNET_PROPERTY_VALUE values[MAX_COV_VALUES];
+    cov_data_value_list_link(&data, values, MAX_COV_VALUES);
+    if (cov_notify_decode_service_request(request, static_cast<unsigned>(requestLen), &data) < 0)
+    {
+        return;
+    }
+
+    if (data.subscriberProcessIdentifier == processId)
+    {
+        for (BACNET_PROPERTY_VALUE* value = data.listOfValues; value != nullptr; value = value->next)
+        {
+            for (const CovTarget& target : covTargets)
+            {
+                if (target.objectType == data.monitoredObjectIdentifier.type
+                    && target.objectInstance == data.monitoredObjectIdentifier.instance
+                    && target.propertyId == value->propertyIdentifier)
+                {
+                    uint64_t decoded = 0;
+                    if (decodeNumeric(value->value, decoded))
+                    {
+                        writeImage(target.local, fitDecoded(target.width, decoded));
+                        setInputQuality(target.quality, IOQuality::Good);
+                    }
+                }
+            }
+        }
+    }
+
+    if (confirmed)
+    {
+        // A confirmed notification is acknowledged with a SimpleACK carrying its invoke ID.
+        BACNET_NPDU_DATA npdu;
+        npdu_encode_npdu_data(&npdu, false, MESSAGE_PRIORITY_NORMAL);
+        std::array<uint8_t, 32> ack{};
+        int len = npdu_encode_pdu(ack.data(), &source, nullptr, &npdu);
+        if (len < 0)
+        {
+            return;
+        }
+        ack[len++] = PDU_TYPE_SIMPLE_ACK;
+        ack[len++] = apdu[2];
+        ack[len++] = SERVICE_CONFIRMED_COV_NOTIFICATION;
+        BACnetDatalink::instance().send(source, npdu, ack.data(), len);
+    }
+}
+
+bool BACNETClient::readBit(const std::string& remote, int& result) {
+    BACnetRemotePoint point;
+    if (!resolveRemote(remote, point)) {
+        return false;
+    }
+    BACNET_APPLICATION_DATA_VALUE value{};
+    if (!performRead(point, value)) {
+        return false;
+    }
+    bool decoded = false;
+    if (!decodeNumeric(value, decoded)) {
+        return false;
+    }
+    result = decoded ? 1 : 0;
+    return true;
+}
+
+bool BACNETClient::writeBit(const std::string& remote, int value) {
+    BACnetRemotePoint point;
+    if (!resolveRemote(remote, point)) {
+        DIAGNOSTIC("BACNET-IP writeBit Could not resolve remote " << remote.c_str());
+        return false;
+    }
+    BACNET_APPLICATION_DATA_VALUE app{};
+    if (!encodeValue(value, point, app))
+    {
+        DIAGNOSTIC("BACNET-IP writeBit Could not encode value " << value);
+        return false;
+    }
+    return performWrite(point, app);
+}
+
+bool BACNETClient::readByte(const std::string& remote, uint8_t& result) {
+    BACnetRemotePoint point;
+    if (!resolveRemote(remote, point)) {
+        return false;
+    }
+    BACNET_APPLICATION_DATA_VALUE value{};
+    if (!performRead(point, value)) {
+        return false;
+    }
+    uint32_t decoded = 0;
+    if (!decodeNumeric(value, decoded)) {
+        return false;
+    }
+    result = static_cast<uint8_t>(decoded & 0xFF);
+    return true;
+}
+
+bool BACNETClient::writeByte(const std::string& remote, uint8_t value) {
+    BACnetRemotePoint point;
+    if (!resolveRemote(remote, point)) {
+        return false;
+    }
+    BACNET_APPLICATION_DATA_VALUE app{};
+    if (!encodeValue(value, point, app))
+    {
+        return false;
+    }
+    return performWrite(point, app);
+}
+
+bool BACNETClient::readWord(const std::string& remote, uint16_t& result) {
+    BACnetRemotePoint point;
+    if (!resolveRemote(remote, point)) {
+        return false;
+    }
+    BACNET_APPLICATION_DATA_VALUE value{};
+    if (!performRead(point, value)) {
+        return false;
+    }
+    uint32_t decoded = 0;
+    if (!decodeNumeric(value, decoded)) {
+        return false;
+    }
+    result = static_cast<uint16_t>(decoded & 0xFFFF);
+    return true;
+}
+
+bool BACNETClient::writeWord(const std::string& remote, uint16_t value) {
+    BACnetRemotePoint point;
+    if (!resolveRemote(remote, point)) {
+        return false;
+    }
+    BACNET_APPLICATION_DATA_VALUE app{};
+    if (!encodeValue(value, point, app))
+    {
+        return false;
+    }
+    return performWrite(point, app);
+}
+
+bool BACNETClient::readDWord(const std::string& remote, uint32_t& result) {
+    BACnetRemotePoint point;
+    if (!resolveRemote(remote, point)) {
+        return false;
+    }
+    BACNET_APPLICATION_DATA_VALUE value{};
+    if (!performRead(point, value)) {
+        return false;
+    }
+    uint32_t decoded = 0;
+    if (!decodeNumeric(value, decoded)) {
+        return false;
+    }
+    result = decoded;
+    return true;
+}
+
+bool BACNETClient::writeDWord(const std::string& remote, uint32_t value) {
+    BACnetRemotePoint point;
+    if (!resolveRemote(remote, point)) {
+        return false;
+    }
+    BACNET_APPLICATION_DATA_VALUE app{};
+    if (!encodeValue(value, point, app))
+    {
+        return false;
+    }
+    return performWrite(point, app);
+}
+
+bool BACNETClient::readLWord(const std::string& remote, uint64_t& result) {
+    BACnetRemotePoint point;
+    if (!resolveRemote(remote, point)) {
+        return false;
+    }
+    BACNET_APPLICATION_DATA_VALUE value{};
+    if (!performRead(point, value)) {
+        return false;
+    }
+    uint64_t decoded = 0;
+    if (!decodeNumeric(value, decoded)) {
+        return false;
+    }
+    result = decoded;
+    return true;
+}
+
+bool BACNETClient::writeLWord(const std::string& remote, uint64_t value) {
+    BACnetRemotePoint point;
+    if (!resolveRemote(remote, point)) {
+        return false;
+    }
+    BACNET_APPLICATION_DATA_VALUE app{};
+    if (!encodeValue(value, point, app))
+    {
+        return false;
+    }
+    return performWrite(point, app);
+}
+
+bool BACNETClient::encodeValue(uint64_t raw, BACnetRemotePoint point, BACNET_APPLICATION_DATA_VALUE &value)
+{
+    value.tag = point.valueType;
+    switch (point.valueType)
+    {
+    case BACNET_APPLICATION_TAG_ENUMERATED:
+        value.type.Enumerated = static_cast<uint32_t>(raw & 0xFFFFFFFF);
+        return true;
+    case BACNET_APPLICATION_TAG_REAL:
+        value.type.Real = static_cast<float>(uint64_to_double(raw));
+        return true;
+    case BACNET_APPLICATION_TAG_UNSIGNED_INT:
+        value.type.Unsigned_Int = static_cast<uint32_t>(raw & 0xFFFFFFFF);
+        return true;
+    case BACNET_APPLICATION_TAG_SIGNED_INT:
+        value.type.Signed_Int = static_cast<int32_t>(raw & 0xFFFFFFFF);
+        return true;
+    case BACNET_APPLICATION_TAG_DOUBLE:
+        value.type.Double = static_cast<double>(uint64_to_double(raw));
+        return true;
+    case BACNET_APPLICATION_TAG_BOOLEAN:
+        value.type.Boolean = raw > 0;
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * Gets the BACnet object identifier of an object, which the server indexes its objects by.
+ * @param type The object type.
+ * @param instance The object instance.
+ * @returns Returns the object identifier.
+ */
+static uint32_t objectIdentifier(BACNET_OBJECT_TYPE type, uint32_t instance)
+{
+    return (static_cast<uint32_t>(type) << 22) | (instance & BACNET_MAX_INSTANCE);
+}
+
+BACnetServer::BACnetServer(uint32_t deviceInstance, const std::string& deviceName)
+    : deviceInstance(deviceInstance),
+      deviceName(deviceName.empty() ? "Nodalis " + std::to_string(deviceInstance) : deviceName)
+{
+    BACnetServerObject device;
+    device.type = OBJECT_DEVICE;
+    device.instance = deviceInstance;
+    device.name = this->deviceName;
+    objects.push_back(device);
+    index[objectIdentifier(OBJECT_DEVICE, deviceInstance)] = 0;
+}
+
+BACnetServer::~BACnetServer()
+{
+    stop();
+}
+
+bool BACnetServer::publish(const std::string& name, const std::string& address)
+{
+    if (address.size() < 3 || address[0] != '%' || (address[1] != 'M' && address[1] != 'm'))
+    {
+        return false;
+    }
+    BACnetServerObject object;
+    NODALIS_TRY
+    {
+        bool bit = address.find('.') != std::string::npos;
+        object.address = resolveAddress(address, -1, bit);
+    }
+    NODALIS_CATCH(e)
+    {
+        return false;
+    }
+    object.name = name;
+    if (object.address.bit > -1)
+    {
+        object.type = OBJECT_BINARY_VALUE;
+        object.instance = binaryValues++;
+    }
+    else
+    {
+        object.type = OBJECT_ANALOG_VALUE;
+        object.instance = analogValues++;
+    }
+    index[objectIdentifier(object.type, object.instance)] = objects.size();
+    objects.push_back(object);
+    return true;
+}
+
+bool BACnetServer::start()
+{
+    if (running)
+    {
+        return true;
+    }
+    BACnetDatalink& datalink = BACnetDatalink::instance();
+    NODALIS_TRY
+    {
+        datalinkReady = datalink.acquire(DEFAULT_ROUTE_PROBE);
+    }
+    NODALIS_CATCH(e)
+    {
+        nodalisLog() << "BACnet server: " << e.what() << "\n";
+    }
+    if (!datalinkReady)
+    {
+        nodalisLog() << "BACnet server: the datalink could not be initialized\n";
+        return false;
+    }
+    datalink.serve(this);
+    running = true;
+    worker = std::thread(&BACnetServer::run, this);
+    sendIAm();
+    nodalisLog() << "BACnet server started as device " << deviceInstance << " with " << (objects.size() - 1)
+              << " objects\n";
+    return true;
+}
+
+void BACnetServer::stop()
+{
+    if (!running)
+    {
+        return;
+    }
+    running = false;
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+    BACnetDatalink& datalink = BACnetDatalink::instance();
+    datalink.serve(nullptr);
+    if (datalinkReady)
+    {
+        datalink.release();
+        datalinkReady = false;
+    }
+}
+
+void BACnetServer::run()
+{
+    moveToBackground();
+    BACnetDatalink& datalink = BACnetDatalink::instance();
+    while (running)
+    {
+        {
+            std::unique_lock<std::mutex> lock(datalink.routeMutex());
+            datalink.pump(lock, Clock::now() + std::chrono::milliseconds(SERVER_CHECK_MS));
+        }
+        std::lock_guard<std::mutex> lock(serverMutex);
+        auto now = Clock::now();
+        for (size_t i = 0; i < subscriptions.size();)
+        {
+            if (subscriptions[i].expires && subscriptions[i].expiresAt <= now)
+            {
+                objects[subscriptions[i].object].subscribers--;
+                subscriptions[i] = subscriptions.back();
+                subscriptions.pop_back();
+                continue;
+            }
+            i++;
+        }
+        // The image only changes once per scan, so it is only compared when a new one has been published.
+        uint64_t published = imageGeneration();
+        if (published != generation)
+        {
+            generation = published;
+            if (!subscriptions.empty())
+            {
+                notifyChanges();
+            }
+        }
+    }
+}
+
+bool BACnetServer::handle(BACNET_ADDRESS& source, const uint8_t* apdu, int apduLen)
+{
+    uint8_t type = apdu[0] & 0xF0;
+    if (type == PDU_TYPE_UNCONFIRMED_SERVICE_REQUEST)
+    {
+        if (apdu[1] != SERVICE_UNCONFIRMED_WHO_IS)
+        {
+            return false;
+        }
+        answerWhoIs(apdu, apduLen);
+        return true;
+    }
+    if (type != PDU_TYPE_CONFIRMED_SERVICE_REQUEST || apduLen < 4)
+    {
+        return false;
+    }
+    uint8_t invoke = apdu[2];
+    uint8_t reply[8];
+    if (apdu[0] & 0x08)
+    {
+        // The server doesn't reassemble segmented requests, which none of the services it offers need.
+        sendApdu(source, reply, abort_encode_apdu(reply, invoke, ABORT_REASON_SEGMENTATION_NOT_SUPPORTED, true));
+        return true;
+    }
+    size_t maxReply = static_cast<size_t>(decode_max_apdu(apdu[1]));
+    if (maxReply < MIN_APDU || maxReply > MAX_APDU)
+    {
+        maxReply = MAX_APDU;
+    }
+    switch (apdu[3])
+    {
+    case SERVICE_CONFIRMED_COV_NOTIFICATION:
+        // Notifications are for the client subscribed to the device that sent them.
+        return false;
+    case SERVICE_CONFIRMED_READ_PROPERTY:
+        readProperty(source, apdu, apduLen, maxReply);
+        return true;
+    case SERVICE_CONFIRMED_READ_PROP_MULTIPLE:
+        readPropertyMultiple(source, apdu, apduLen, maxReply);
+        return true;
+    case SERVICE_CONFIRMED_SUBSCRIBE_COV:
+        subscribeCov(source, apdu, apduLen);
+        return true;
+    default:
+        sendApdu(source, reply, reject_encode_apdu(reply, invoke, REJECT_REASON_UNRECOGNIZED_SERVICE));
+        return true;
+    }
+}
+
+void BACnetServer::answerWhoIs(const uint8_t* apdu, int apduLen)
+{
+    int32_t low = -1;
+    int32_t high = -1;
+    if (apduLen > 2 && whois_decode_service_request(apdu + 2, static_cast<unsigned>(apduLen - 2), &low, &high) <= 0)
+    {
+        return;
+    }
+    if (low < 0 || (static_cast<int64_t>(deviceInstance) >= low && static_cast<int64_t>(deviceInstance) <= high))
+    {
+        sendIAm();
+    }
+}
+
+void BACnetServer::sendIAm()
+{
+    BACNET_ADDRESS dest{};
+    datalink_get_broadcast_address(&dest);
+    uint8_t apdu[32];
+    int len = iam_encode_apdu(apdu, deviceInstance, MAX_APDU, SEGMENTATION_NONE, BACNET_VENDOR_ID);
+    sendApdu(dest, apdu, len);
+}
+
+long BACnetServer::findObject(BACNET_OBJECT_TYPE type, uint32_t instance) const
+{
+    // The wildcard instance of a Device refers to the device that receives the request.
+    if (type == OBJECT_DEVICE && instance == BACNET_MAX_INSTANCE)
+    {
+        return 0;
+    }
+    auto found = index.find(objectIdentifier(type, instance));
+    return found != index.end() ? static_cast<long>(found->second) : -1;
+}
+
+void BACnetServer::sendError(BACNET_ADDRESS& dest, uint8_t invoke, BACNET_CONFIRMED_SERVICE service,
+                             BACNET_ERROR_CLASS errorClass, BACNET_ERROR_CODE errorCode)
+{
+    uint8_t apdu[16];
+    sendApdu(dest, apdu, bacerror_encode_apdu(apdu, invoke, service, errorClass, errorCode));
+}
+
+void BACnetServer::readProperty(BACNET_ADDRESS& source, const uint8_t* apdu, int apduLen, size_t maxReply)
+{
+    uint8_t invoke = apdu[2];
+    uint8_t reply[MAX_APDU + 64];
+    BACNET_READ_PROPERTY_DATA request{};
+    if (rp_decode_service_request(apdu + 4, static_cast<unsigned>(apduLen - 4), &request) <= 0)
+    {
+        sendApdu(source, reply, reject_encode_apdu(reply, invoke, REJECT_REASON_MISSING_REQUIRED_PARAMETER));
+        return;
+    }
+    long found = findObject(request.object_type, request.object_instance);
+    if (found < 0)
+    {
+        sendError(source, invoke, SERVICE_CONFIRMED_READ_PROPERTY, ERROR_CLASS_OBJECT, ERROR_CODE_UNKNOWN_OBJECT);
+        return;
+    }
+    const BACnetServerObject& object = objects[static_cast<size_t>(found)];
+    request.object_instance = object.instance;
+    uint8_t value[MAX_APDU];
+    BACNET_ERROR_CLASS errorClass = ERROR_CLASS_PROPERTY;
+    BACNET_ERROR_CODE errorCode = ERROR_CODE_UNKNOWN_PROPERTY;
+    int len = encodeProperty(object, request.object_property, request.array_index, value, sizeof(value), errorClass, errorCode);
+    if (len == BACNET_STATUS_ERROR)
+    {
+        sendError(source, invoke, SERVICE_CONFIRMED_READ_PROPERTY, errorClass, errorCode);
+        return;
+    }
+    int replyLen = 0;
+    if (len >= 0)
+    {
+        request.application_data = value;
+        request.application_data_len = len;
+        replyLen = rp_ack_encode_apdu(reply, invoke, &request);
+    }
+    if (len < 0 || static_cast<size_t>(replyLen) > maxReply)
+    {
+        replyLen = abort_encode_apdu(reply, invoke, ABORT_REASON_SEGMENTATION_NOT_SUPPORTED, true);
+    }
+    sendApdu(source, reply, replyLen);
+}
+
+void BACnetServer::readPropertyMultiple(BACNET_ADDRESS& source, const uint8_t* apdu, int apduLen, size_t maxReply)
+{
+    uint8_t invoke = apdu[2];
+    uint8_t reply[MAX_APDU + 64];
+    uint8_t value[MAX_APDU];
+    int len = rpm_ack_encode_apdu_init(reply, invoke);
+    bool overflow = false;
+    // Each property adds at most 12 bytes of tags around its value, or an error of at most 10 bytes after them.
+    auto append = [&](const BACnetServerObject* object, BACNET_PROPERTY_ID property, BACNET_ARRAY_INDEX arrayIndex)
+    {
+        BACNET_ERROR_CLASS errorClass = ERROR_CLASS_OBJECT;
+        BACNET_ERROR_CODE errorCode = ERROR_CODE_UNKNOWN_OBJECT;
+        int valueLen = BACNET_STATUS_ERROR;
+        if (object != nullptr)
+        {
+            errorClass = ERROR_CLASS_PROPERTY;
+            errorCode = ERROR_CODE_UNKNOWN_PROPERTY;
+            valueLen = encodeProperty(*object, property, arrayIndex, value, sizeof(value), errorClass, errorCode);
+        }
+        size_t needed = 12 + (valueLen > 0 ? static_cast<size_t>(valueLen) : 10);
+        if (valueLen == BACNET_STATUS_ABORT || static_cast<size_t>(len) + needed + 1 > maxReply)
+        {
+            overflow = true;
+            return;
+        }
+        len += rpm_ack_encode_apdu_object_property(reply + len, property, arrayIndex);
+        if (valueLen >= 0)
+        {
+            len += rpm_ack_encode_apdu_object_property_value(reply + len, value, static_cast<unsigned>(valueLen));
+        }
+        else
         {
-            continue;
+            len += rpm_ack_encode_apdu_object_property_error(reply + len, errorClass, errorCode);
         }
+    };
 
-        uint8_t *apdu = rx.data() + offset;
-        uint8_t pduType = (apdu[0] & 0xF0);
-
-        // std::cout << "offset=" << offset << " apdu_len=" << apdu_len << "\n";
-        // if (apdu_len >= 1)
-        // {
-        //     printf("pduType=0x%02X (%s)\n", pduType, pdu_type_name(pduType));
-        // }
-        // if (apdu_len >= 2)
-        // {
-        //     std::cout << "invoke=" << int(apdu[1]) << " (expect " << int(invoke) << ")\n";
-        // }
-        // if (apdu_len >= 3)
-        // {
-        //     std::cout << "service=" << int(apdu[2]) << "\n";
-        // }
-
-        // Only these response types contain an invoke id at apdu[1]
-        bool hasInvoke = (pduType == PDU_TYPE_SIMPLE_ACK ||
-                          pduType == PDU_TYPE_COMPLEX_ACK ||
-                          pduType == PDU_TYPE_ERROR ||
-                          pduType == PDU_TYPE_REJECT ||
-                          pduType == PDU_TYPE_ABORT);
-
-        if (!hasInvoke)
-        {
-            // Not a confirmed-service reply; ignore
-            continue;
+    int offset = 4;
+    while (offset < apduLen && !overflow)
+    {
+        BACNET_RPM_DATA request{};
+        int decoded = rpm_decode_object_id(apdu + offset, static_cast<unsigned>(apduLen - offset), &request);
+        if (decoded <= 0)
+        {
+            break;
         }
-
-        if (apdu_len < 2)
+        offset += decoded;
+        long found = findObject(request.object_type, request.object_instance);
+        const BACnetServerObject* object = found >= 0 ? &objects[static_cast<size_t>(found)] : nullptr;
+        if (object != nullptr)
         {
-            // Should not happen for these types, but be safe
-            continue;
+            request.object_instance = object->instance;
         }
-
-        // Must match our invoke id
-        if (apdu[1] != invoke)
+        if (static_cast<size_t>(len) + 8 > maxReply)
         {
-            continue;
+            overflow = true;
+            break;
         }
-
-        // ---- Robust response handling ----
-
-        // SUCCESS: SimpleACK for WriteProperty
-        if (pduType == PDU_TYPE_SIMPLE_ACK)
+        len += rpm_ack_encode_apdu_object_begin(reply + len, &request);
+        while (offset < apduLen && !overflow)
         {
-            if (apdu_len >= 3 && apdu[2] == SERVICE_CONFIRMED_WRITE_PROPERTY)
+            if (rpm_decode_object_end(apdu + offset, static_cast<unsigned>(apduLen - offset)) == 1)
             {
-                return true;
+                break;
             }
-            // SimpleACK but not for WriteProperty; ignore
-            continue;
-        }
-
-        // ERROR: device understood but rejected with error class/code
-        if (pduType == PDU_TYPE_ERROR)
-        {
-            uint8_t service = (apdu_len >= 3) ? apdu[2] : 0xFF;
-            uint32_t errClass = 0, errCode = 0;
-            bool decoded = (apdu_len > 3) && decode_error_class_code(apdu, apdu_len, 3, errClass, errCode);
-
-            std::cout << "BACNET-IP performWrite got ERROR for invoke=" << int(invoke)
-                      << " service=" << int(service);
-
-            if (decoded)
+            decoded = rpm_decode_object_property(apdu + offset, static_cast<unsigned>(apduLen - offset), &request);
+            if (decoded <= 0)
             {
-                std::cout << " errClass=" << errClass << " errCode=" << errCode;
+                offset = apduLen + 1;
+                break;
+            }
+            offset += decoded;
+            BACNET_PROPERTY_ID property = request.object_property;
+            if (object != nullptr && (property == PROP_ALL || property == PROP_REQUIRED || property == PROP_OPTIONAL))
+            {
+                for (BACNET_PROPERTY_ID listed : properties(object->type))
+                {
+                    bool optional = listed == PROP_COV_INCREMENT;
+                    if (property == PROP_ALL || (property == PROP_OPTIONAL) == optional)
+                    {
+                        append(object, listed, BACNET_ARRAY_ALL);
+                    }
+                }
             }
             else
             {
-                std::cout << " (could not decode error class/code)";
+                append(object, property, request.array_index);
             }
-            std::cout << "\n";
-
-            return false;
-        }
-
-        // REJECT: device rejected request (invalid params, unsupported service, etc.)
-        if (pduType == PDU_TYPE_REJECT)
-        {
-            uint8_t reason = (apdu_len >= 3) ? apdu[2] : 0xFF;
-            std::cout << "BACNET-IP performWrite got REJECT for invoke=" << int(invoke)
-                      << " reason=" << int(reason) << "\n";
-            return false;
-        }
-
-        // ABORT: device aborted processing
-        if (pduType == PDU_TYPE_ABORT)
-        {
-            uint8_t reason = (apdu_len >= 3) ? apdu[2] : 0xFF;
-            bool server = (apdu[0] & 0x01) != 0; // BACnet: bit0 indicates server abort
-            std::cout << "BACNET-IP performWrite got ABORT for invoke=" << int(invoke)
-                      << " reason=" << int(reason)
-                      << " server=" << (server ? "true" : "false") << "\n";
-            return false;
         }
-
-        // COMPLEX_ACK: not expected for WriteProperty; log and keep waiting
-        if (pduType == PDU_TYPE_COMPLEX_ACK)
+        if (offset >= apduLen)
         {
-            uint8_t service = (apdu_len >= 3) ? apdu[2] : 0xFF;
-            std::cout << "BACNET-IP performWrite got COMPLEX_ACK for invoke=" << int(invoke)
-                      << " service=" << int(service) << " (unexpected for WriteProperty)\n";
-            continue;
+            // The list of properties of the object wasn't closed.
+            offset = apduLen + 1;
+            break;
         }
-
-        // Anything else with invoke id: log and keep listening
-        std::cout << "BACNET-IP performWrite got " << pdu_type_name(pduType)
-                  << " for invoke=" << int(invoke) << " (unhandled)\n";
-    }
-
-    std::cout << "BACNET-IP performWrite Did not receive ACK\n";
-    return false;
-}
-
-bool BACNETClient::readBit(const std::string& remote, int& result) {
-    BACnetRemotePoint point;
-    if (!resolveRemote(remote, point)) {
-        return false;
+        offset++;
+        len += rpm_ack_encode_apdu_object_end(reply + len);
     }
-    BACNET_APPLICATION_DATA_VALUE value{};
-    if (!performRead(point, value)) {
-        return false;
+    if (overflow)
+    {
+        len = abort_encode_apdu(reply, invoke, ABORT_REASON_SEGMENTATION_NOT_SUPPORTED, true);
     }
-    bool decoded = false;
-    if (!decodeNumeric(value, decoded)) {
-        return false;
+    else if (offset != apduLen)
+    {
+        len = reject_encode_apdu(reply, invoke, REJECT_REASON_INVALID_TAG);
     }
-    result = decoded ? 1 : 0;
-    return true;
+    sendApdu(source, reply, len);
 }
 
-bool BACNETClient::writeBit(const std::string& remote, int value) {
-    BACnetRemotePoint point;
-    if (!resolveRemote(remote, point)) {
-        std::cout << "BACNET-IP writeBit Could not resolve remote " << remote.c_str() << "\n";
-        return false;
-    }
-    BACNET_APPLICATION_DATA_VALUE app{};
-    if (!encodeValue(value, point, app))
+const std::vector<BACNET_PROPERTY_ID>& BACnetServer::properties(BACNET_OBJECT_TYPE type)
+{
+    static const std::vector<BACNET_PROPERTY_ID> device = {
+        PROP_OBJECT_IDENTIFIER, PROP_OBJECT_NAME, PROP_OBJECT_TYPE, PROP_SYSTEM_STATUS, PROP_VENDOR_NAME,
+        PROP_VENDOR_IDENTIFIER, PROP_MODEL_NAME, PROP_FIRMWARE_REVISION, PROP_APPLICATION_SOFTWARE_VERSION,
+        PROP_PROTOCOL_VERSION, PROP_PROTOCOL_REVISION, PROP_PROTOCOL_SERVICES_SUPPORTED,
+        PROP_PROTOCOL_OBJECT_TYPES_SUPPORTED, PROP_OBJECT_LIST, PROP_MAX_APDU_LENGTH_ACCEPTED,
+        PROP_SEGMENTATION_SUPPORTED, PROP_APDU_TIMEOUT, PROP_NUMBER_OF_APDU_RETRIES, PROP_DEVICE_ADDRESS_BINDING,
+        PROP_DATABASE_REVISION, PROP_PROPERTY_LIST};
+    static const std::vector<BACNET_PROPERTY_ID> analogValue = {
+        PROP_OBJECT_IDENTIFIER, PROP_OBJECT_NAME, PROP_OBJECT_TYPE, PROP_PRESENT_VALUE, PROP_STATUS_FLAGS,
+        PROP_EVENT_STATE, PROP_OUT_OF_SERVICE, PROP_UNITS, PROP_COV_INCREMENT, PROP_PROPERTY_LIST};
+    static const std::vector<BACNET_PROPERTY_ID> binaryValue = {
+        PROP_OBJECT_IDENTIFIER, PROP_OBJECT_NAME, PROP_OBJECT_TYPE, PROP_PRESENT_VALUE, PROP_STATUS_FLAGS,
+        PROP_EVENT_STATE, PROP_OUT_OF_SERVICE, PROP_PROPERTY_LIST};
+    switch (type)
     {
-        std::cout << "BACNET-IP writeBit Could not encode value " << value << "\n";
-        return false;
+    case OBJECT_DEVICE:
+        return device;
+    case OBJECT_ANALOG_VALUE:
+        return analogValue;
+    default:
+        return binaryValue;
     }
-    return performWrite(point, app);
 }
 
-bool BACNETClient::readByte(const std::string& remote, uint8_t& result) {
-    BACnetRemotePoint point;
-    if (!resolveRemote(remote, point)) {
-        return false;
-    }
-    BACNET_APPLICATION_DATA_VALUE value{};
-    if (!performRead(point, value)) {
-        return false;
+double BACnetServer::presentValue(const BACnetServerObject& object, const uint8_t* image)
+{
+    const ResolvedAddress& address = object.address;
+    if (address.bit > -1)
+    {
+        return (image[address.bitOffset] & address.bitMask) != 0 ? 1 : 0;
     }
-    uint32_t decoded = 0;
-    if (!decodeNumeric(value, decoded)) {
-        return false;
+    const uint8_t* data = image + address.offset;
+    uint16_t word;
+    uint32_t dword;
+    uint64_t lword;
+    switch (address.width)
+    {
+    case 8:
+        return data[0];
+    case 16:
+        std::memcpy(&word, data, sizeof(word));
+        return word;
+    case 32:
+        std::memcpy(&dword, data, sizeof(dword));
+        return dword;
+    default:
+        // 64 bit values hold REALs as 32.32 fixed point, as the BACnet client writes them.
+        std::memcpy(&lword, data, sizeof(lword));
+        return uint64_to_double(lword);
     }
-    result = static_cast<uint8_t>(decoded & 0xFF);
-    return true;
 }
 
-bool BACNETClient::writeByte(const std::string& remote, uint8_t value) {
-    BACnetRemotePoint point;
-    if (!resolveRemote(remote, point)) {
-        return false;
-    }
-    BACNET_APPLICATION_DATA_VALUE app{};
-    if (!encodeValue(value, point, app))
-    {
-        return false;
-    }
-    return performWrite(point, app);
+double BACnetServer::presentValue(const BACnetServerObject& object) const
+{
+    double value = 0;
+    readImage([&](const uint8_t* image) { value = presentValue(object, image); });
+    return value;
 }
 
-bool BACNETClient::readWord(const std::string& remote, uint16_t& result) {
-    BACnetRemotePoint point;
-    if (!resolveRemote(remote, point)) {
-        return false;
+int BACnetServer::encodeProperty(const BACnetServerObject& object, BACNET_PROPERTY_ID property,
+                                 BACNET_ARRAY_INDEX arrayIndex, uint8_t* apdu, size_t size,
+                                 BACNET_ERROR_CLASS& errorClass, BACNET_ERROR_CODE& errorCode) const
+{
+    const std::vector<BACNET_PROPERTY_ID>& listed = properties(object.type);
+    bool known = false;
+    for (BACNET_PROPERTY_ID candidate : listed)
+    {
+        known = known || candidate == property;
     }
-    BACNET_APPLICATION_DATA_VALUE value{};
-    if (!performRead(point, value)) {
-        return false;
+    errorClass = ERROR_CLASS_PROPERTY;
+    if (!known)
+    {
+        errorCode = ERROR_CODE_UNKNOWN_PROPERTY;
+        return BACNET_STATUS_ERROR;
     }
-    uint32_t decoded = 0;
-    if (!decodeNumeric(value, decoded)) {
-        return false;
+    if (arrayIndex != BACNET_ARRAY_ALL && property != PROP_OBJECT_LIST && property != PROP_PROPERTY_LIST)
+    {
+        errorCode = ERROR_CODE_PROPERTY_IS_NOT_AN_ARRAY;
+        return BACNET_STATUS_ERROR;
+    }
+    // Every value other than the names and the lists fits in 16 bytes.
+    if (size < 16)
+    {
+        return BACNET_STATUS_ABORT;
     }
-    result = static_cast<uint16_t>(decoded & 0xFFFF);
-    return true;
-}
 
-bool BACNETClient::writeWord(const std::string& remote, uint16_t value) {
-    BACnetRemotePoint point;
-    if (!resolveRemote(remote, point)) {
-        return false;
+    BACNET_CHARACTER_STRING text;
+    BACNET_BIT_STRING bits;
+    const char* string = nullptr;
+    switch (property)
+    {
+    case PROP_OBJECT_IDENTIFIER:
+        return encode_application_object_id(apdu, object.type, object.instance);
+    case PROP_OBJECT_TYPE:
+        return encode_application_enumerated(apdu, object.type);
+    case PROP_OBJECT_NAME:
+        string = object.name.c_str();
+        break;
+    case PROP_VENDOR_NAME:
+        string = BACNET_VENDOR_NAME;
+        break;
+    case PROP_MODEL_NAME:
+        string = "Nodalis PLC";
+        break;
+    case PROP_FIRMWARE_REVISION:
+        string = BACNET_VERSION_TEXT;
+        break;
+    case PROP_APPLICATION_SOFTWARE_VERSION:
+        string = "1.0";
+        break;
+    case PROP_SYSTEM_STATUS:
+        return encode_application_enumerated(apdu, STATUS_OPERATIONAL);
+    case PROP_VENDOR_IDENTIFIER:
+        return encode_application_unsigned(apdu, BACNET_VENDOR_ID);
+    case PROP_PROTOCOL_VERSION:
+        return encode_application_unsigned(apdu, BACNET_PROTOCOL_VERSION);
+    case PROP_PROTOCOL_REVISION:
+        return encode_application_unsigned(apdu, BACNET_PROTOCOL_REVISION);
+    case PROP_PROTOCOL_SERVICES_SUPPORTED:
+        bitstring_init(&bits);
+        for (uint8_t service = 0; service < MAX_BACNET_SERVICES_SUPPORTED; service++)
+        {
+            bitstring_set_bit(&bits, service, service == SERVICE_SUPPORTED_READ_PROPERTY ||
+                service == SERVICE_SUPPORTED_READ_PROP_MULTIPLE || service == SERVICE_SUPPORTED_SUBSCRIBE_COV ||
+                service == SERVICE_SUPPORTED_WHO_IS);
+        }
+        return encode_application_bitstring(apdu, &bits);
+    case PROP_PROTOCOL_OBJECT_TYPES_SUPPORTED:
+        bitstring_init(&bits);
+        for (uint8_t type = 0; type < MAX_ASHRAE_OBJECT_TYPE; type++)
+        {
+            bitstring_set_bit(&bits, type, type == OBJECT_DEVICE || type == OBJECT_ANALOG_VALUE ||
+                type == OBJECT_BINARY_VALUE);
+        }
+        return encode_application_bitstring(apdu, &bits);
+    case PROP_MAX_APDU_LENGTH_ACCEPTED:
+        return encode_application_unsigned(apdu, MAX_APDU);
+    case PROP_SEGMENTATION_SUPPORTED:
+        return encode_application_enumerated(apdu, SEGMENTATION_NONE);
+    case PROP_APDU_TIMEOUT:
+        return encode_application_unsigned(apdu, 3000);
+    case PROP_NUMBER_OF_APDU_RETRIES:
+        return encode_application_unsigned(apdu, 0);
+    case PROP_DEVICE_ADDRESS_BINDING:
+        // The server never initiates confirmed requests to other devices, so it binds none.
+        return 0;
+    case PROP_DATABASE_REVISION:
+        return encode_application_unsigned(apdu, 1);
+    case PROP_PRESENT_VALUE:
+        if (object.type == OBJECT_BINARY_VALUE)
+        {
+            return encode_application_enumerated(apdu, presentValue(object) != 0 ? BINARY_ACTIVE : BINARY_INACTIVE);
+        }
+        return encode_application_real(apdu, static_cast<float>(presentValue(object)));
+    case PROP_STATUS_FLAGS:
+        bitstring_init(&bits);
+        for (uint8_t flag = 0; flag < 4; flag++)
+        {
+            bitstring_set_bit(&bits, flag, false);
+        }
+        return encode_application_bitstring(apdu, &bits);
+    case PROP_EVENT_STATE:
+        return encode_application_enumerated(apdu, EVENT_STATE_NORMAL);
+    case PROP_OUT_OF_SERVICE:
+        return encode_application_boolean(apdu, false);
+    case PROP_UNITS:
+        return encode_application_enumerated(apdu, UNITS_NO_UNITS);
+    case PROP_COV_INCREMENT:
+        // Any change is notified.
+        return encode_application_real(apdu, 0.0f);
+    default:
+        break;
     }
-    BACNET_APPLICATION_DATA_VALUE app{};
-    if (!encodeValue(value, point, app))
+
+    if (string != nullptr)
     {
-        return false;
+        if (std::strlen(string) + 8 > size || !characterstring_init_ansi(&text, string))
+        {
+            return BACNET_STATUS_ABORT;
+        }
+        return encode_application_character_string(apdu, &text);
     }
-    return performWrite(point, app);
-}
 
-bool BACNETClient::readDWord(const std::string& remote, uint32_t& result) {
-    BACnetRemotePoint point;
-    if (!resolveRemote(remote, point)) {
-        return false;
+    // The Object_List and Property_List arrays. Property_List leaves out the four properties every object has.
+    size_t count = object.type == OBJECT_DEVICE && property == PROP_OBJECT_LIST ? objects.size() : listed.size() - 4;
+    auto element = [&](size_t i, uint8_t* out)
+    {
+        if (property == PROP_OBJECT_LIST)
+        {
+            return encode_application_object_id(out, objects[i].type, objects[i].instance);
+        }
+        return encode_application_enumerated(out, listed[i + 3]);
+    };
+    if (arrayIndex == 0)
+    {
+        return encode_application_unsigned(apdu, count);
     }
-    BACNET_APPLICATION_DATA_VALUE value{};
-    if (!performRead(point, value)) {
-        return false;
+    if (arrayIndex != BACNET_ARRAY_ALL)
+    {
+        if (arrayIndex > count)
+        {
+            errorCode = ERROR_CODE_INVALID_ARRAY_INDEX;
+            return BACNET_STATUS_ERROR;
+        }
+        return element(arrayIndex - 1, apdu);
     }
-    uint32_t decoded = 0;
-    if (!decodeNumeric(value, decoded)) {
-        return false;
+    size_t len = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        // An object identifier or an enumeration takes at most 5 bytes.
+        if (len + 5 > size)
+        {
+            return BACNET_STATUS_ABORT;
+        }
+        len += static_cast<size_t>(element(i, apdu + len));
     }
-    result = decoded;
-    return true;
+    return static_cast<int>(len);
 }
 
-bool BACNETClient::writeDWord(const std::string& remote, uint32_t value) {
-    BACnetRemotePoint point;
-    if (!resolveRemote(remote, point)) {
-        return false;
+void BACnetServer::subscribeCov(BACNET_ADDRESS& source, const uint8_t* apdu, int apduLen)
+{
+    uint8_t invoke = apdu[2];
+    uint8_t reply[8];
+    BACNET_SUBSCRIBE_COV_DATA request{};
+    if (cov_subscribe_decode_service_request(apdu + 4, static_cast<unsigned>(apduLen - 4), &request) <= 0)
+    {
+        sendApdu(source, reply, reject_encode_apdu(reply, invoke, REJECT_REASON_MISSING_REQUIRED_PARAMETER));
+        return;
     }
-    BACNET_APPLICATION_DATA_VALUE app{};
-    if (!encodeValue(value, point, app))
+    long found = findObject(static_cast<BACNET_OBJECT_TYPE>(request.monitoredObjectIdentifier.type),
+                            request.monitoredObjectIdentifier.instance);
+    if (found < 0)
     {
-        return false;
+        sendError(source, invoke, SERVICE_CONFIRMED_SUBSCRIBE_COV, ERROR_CLASS_OBJECT, ERROR_CODE_UNKNOWN_OBJECT);
+        return;
+    }
+    size_t object = static_cast<size_t>(found);
+    if (objects[object].type == OBJECT_DEVICE)
+    {
+        sendError(source, invoke, SERVICE_CONFIRMED_SUBSCRIBE_COV, ERROR_CLASS_OBJECT,
+                  ERROR_CODE_OPTIONAL_FUNCTIONALITY_NOT_SUPPORTED);
+        return;
     }
-    return performWrite(point, app);
-}
 
-bool BACNETClient::readLWord(const std::string& remote, uint64_t& result) {
-    BACnetRemotePoint point;
-    if (!resolveRemote(remote, point)) {
-        return false;
+    std::lock_guard<std::mutex> lock(serverMutex);
+    uint64_t subscriber = BACnetDatalink::addressKey(source);
+    BACnetCovSubscription* subscription = nullptr;
+    for (size_t i = 0; i < subscriptions.size(); i++)
+    {
+        BACnetCovSubscription& candidate = subscriptions[i];
+        if (candidate.object == object && candidate.processId == request.subscriberProcessIdentifier &&
+            BACnetDatalink::addressKey(candidate.subscriber) == subscriber)
+        {
+            if (request.cancellationRequest)
+            {
+                objects[object].subscribers--;
+                subscriptions[i] = subscriptions.back();
+                subscriptions.pop_back();
+            }
+            else
+            {
+                subscription = &candidate;
+            }
+            break;
+        }
     }
-    BACNET_APPLICATION_DATA_VALUE value{};
-    if (!performRead(point, value)) {
-        return false;
+    if (request.cancellationRequest)
+    {
+        // Cancelling a subscription that doesn't exist succeeds too.
+        sendApdu(source, reply, encode_simple_ack(reply, invoke, SERVICE_CONFIRMED_SUBSCRIBE_COV));
+        return;
     }
-    uint64_t decoded = 0;
-    if (!decodeNumeric(value, decoded)) {
-        return false;
+    if (subscription == nullptr)
+    {
+        if (subscriptions.size() >= MAX_SERVER_SUBSCRIPTIONS)
+        {
+            sendError(source, invoke, SERVICE_CONFIRMED_SUBSCRIBE_COV, ERROR_CLASS_RESOURCES,
+                      ERROR_CODE_NO_SPACE_TO_ADD_LIST_ELEMENT);
+            return;
+        }
+        subscriptions.emplace_back();
+        subscription = &subscriptions.back();
+        subscription->subscriber = source;
+        subscription->processId = request.subscriberProcessIdentifier;
+        subscription->object = object;
+        if (objects[object].subscribers++ == 0)
+        {
+            // The object wasn't being watched, so changes are counted from the value the subscriber is sent now.
+            objects[object].reported = presentValue(objects[object]);
+        }
     }
-    result = decoded;
-    return true;
+    subscription->confirmed = request.issueConfirmedNotifications;
+    subscription->expires = request.lifetime > 0;
+    subscription->expiresAt = Clock::now() + std::chrono::seconds(request.lifetime);
+    sendApdu(source, reply, encode_simple_ack(reply, invoke, SERVICE_CONFIRMED_SUBSCRIBE_COV));
+    notify(*subscription, objects[object].reported);
 }
 
-bool BACNETClient::writeLWord(const std::string& remote, uint64_t value) {
-    BACnetRemotePoint point;
-    if (!resolveRemote(remote, point)) {
-        return false;
-    }
-    BACNET_APPLICATION_DATA_VALUE app{};
-    if (!encodeValue(value, point, app))
+void BACnetServer::notifyChanges()
+{
+    watched.clear();
+    readImage([&](const uint8_t* image)
     {
-        return false;
+        for (size_t i = 1; i < objects.size(); i++)
+        {
+            if (objects[i].subscribers > 0)
+            {
+                watched.emplace_back(i, presentValue(objects[i], image));
+            }
+        }
+    });
+    for (const auto& read : watched)
+    {
+        BACnetServerObject& object = objects[read.first];
+        if (read.second == object.reported)
+        {
+            continue;
+        }
+        object.reported = read.second;
+        for (BACnetCovSubscription& subscription : subscriptions)
+        {
+            if (subscription.object == read.first)
+            {
+                notify(subscription, read.second);
+            }
+        }
     }
-    return performWrite(point, app);
 }
 
-bool BACNETClient::encodeValue(uint64_t raw, BACnetRemotePoint point, BACNET_APPLICATION_DATA_VALUE &value)
+void BACnetServer::notify(BACnetCovSubscription& subscription, double value)
 {
-    value.tag = point.valueType;
-    switch (point.valueType)
+    const BACnetServerObject& object = objects[subscription.object];
+    BACNET_PROPERTY_VALUE values[2];
+    BACNET_COV_DATA data{};
+    cov_data_value_list_link(&data, values, 2);
+    data.subscriberProcessIdentifier = subscription.processId;
+    data.initiatingDeviceIdentifier = deviceInstance;
+    data.monitoredObjectIdentifier.type = object.type;
+    data.monitoredObjectIdentifier.instance = object.instance;
+    data.timeRemaining = 0;
+    if (subscription.expires)
     {
-    case BACNET_APPLICATION_TAG_ENUMERATED:
-        value.type.Enumerated = static_cast<uint32_t>(raw & 0xFFFFFFFF);
-        return true;
-    case BACNET_APPLICATION_TAG_REAL:
-        value.type.Real = static_cast<float>(uint64_to_double(raw));
-        return true;
-    case BACNET_APPLICATION_TAG_UNSIGNED_INT:
-        value.type.Unsigned_Int = static_cast<uint32_t>(raw & 0xFFFFFFFF);
-        return true;
-    case BACNET_APPLICATION_TAG_SIGNED_INT:
-        value.type.Signed_Int = static_cast<int32_t>(raw & 0xFFFFFFFF);
-        return true;
-    case BACNET_APPLICATION_TAG_DOUBLE:
-        value.type.Double = static_cast<double>(uint64_to_double(raw));
-        return true;
-    case BACNET_APPLICATION_TAG_BOOLEAN:
-        value.type.Boolean = raw > 0;
-        return true;
-    default:
-        return false;
+        auto left = std::chrono::duration_cast<std::chrono::seconds>(subscription.expiresAt - Clock::now()).count();
+        data.timeRemaining = left > 0 ? static_cast<uint32_t>(left) : 0;
+    }
+    if (object.type == OBJECT_BINARY_VALUE)
+    {
+        cov_value_list_encode_enumerated(values, value != 0 ? BINARY_ACTIVE : BINARY_INACTIVE, false, false, false, false);
+    }
+    else
+    {
+        cov_value_list_encode_real(values, static_cast<float>(value), false, false, false, false);
+    }
+
+    uint8_t pdu[MAX_PDU];
+    BACNET_NPDU_DATA npdu{};
+    npdu_encode_npdu_data(&npdu, subscription.confirmed, MESSAGE_PRIORITY_NORMAL);
+    int len = npdu_encode_pdu(pdu, &subscription.subscriber, nullptr, &npdu);
+    unsigned room = static_cast<unsigned>(sizeof(pdu) - static_cast<size_t>(len));
+    // Confirmed notifications aren't sent again if their acknowledgement doesn't arrive; the next change is.
+    int apduLen = subscription.confirmed ? ccov_notify_encode_apdu(pdu + len, room, invokeId++, &data)
+                                         : ucov_notify_encode_apdu(pdu + len, room, &data);
+    if (apduLen <= 0)
+    {
+        return;
+    }
+    if (!BACnetDatalink::instance().send(subscription.subscriber, npdu, pdu, len + apduLen))
+    {
+        DIAGNOSTIC("BACnet server: failed to send a COV notification for " << object.name);
     }
 }
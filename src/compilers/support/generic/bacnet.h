@@ -21,9 +21,15 @@
 #pragma once
 
 #include "nodalis.h"
+#include "nodalisjson.h"
 #include <array>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -33,12 +39,21 @@ extern "C"
 #include "bacnet/config.h"
 #include "bacnet/apdu.h"
 #include "bacnet/bacapp.h"
+#include "bacnet/cov.h"
 #include "bacnet/bacdef.h"
 #include "bacnet/bacenum.h"
 #include "bacnet/bacdcode.h"
 #include "bacnet/npdu.h"
 #include "bacnet/rp.h"
+#include "bacnet/rpm.h"
 #include "bacnet/wp.h"
+#include "bacnet/wpm.h"
+#include "bacnet/iam.h"
+#include "bacnet/whois.h"
+#include "bacnet/abort.h"
+#include "bacnet/bacerror.h"
+#include "bacnet/reject.h"
+#include "bacnet/version.h"
 #include "bacnet/datalink/bip.h"
 #include "bacnet/datalink/datalink.h"
 #include "bacnet/bacaddr.h"
@@ -115,11 +130,269 @@ struct BACnetRemotePoint
     BACNET_ARRAY_INDEX arrayIndex = BACNET_ARRAY_ALL;
     uint8_t valueType = BACNET_APPLICATION_TAG_ENUMERATED;
     uint8_t direction = 0;
+    uint8_t priority = 16;  // The command priority the point is written at, from the Priority property. 0 writes without one.
+    bool writeSingly = false;   // Whether the point is left out of WritePropertyMultiple, after it failed in one.
+    size_t mapping = 0;     // The index of the mapping in mappings.
+    bool cov = false;       // Whether the point is subscribed to with COV rather than polled, from the COV property.
+    bool covConfirmed = false;  // Whether the device should confirm its notifications, from COVConfirmed.
+    uint32_t covLifetime = 300; // The lifetime of the subscription in seconds, from COVLifetime. 0 never expires.
+    uint64_t covRenewAt = 0;    // When the subscription is due to be renewed, in milliseconds since start.
 };
 
-class BACNETClient : public IOClient {
+/**
+ * A confirmed request to a device, from when it is sent until its reply arrives or its retries run out.
+ */
+struct BACnetTransaction
+{
+    BACNET_ADDRESS dest{};
+    BACNET_NPDU_DATA npdu{};
+    uint8_t invokeId = 0;
+    uint8_t pdu[MAX_PDU];       // The encoded request, kept so that it can be sent again.
+    int pduLen = 0;
+    std::chrono::steady_clock::time_point deadline;
+    std::chrono::steady_clock::time_point sentAt;   // When the request was first sent, to count its round trip.
+    int retriesLeft = 0;
+    bool pending = false;       // Whether the request is waiting for its reply.
+    uint8_t reply[MAX_APDU];    // The APDU of an unsegmented reply.
+    int replyLen = 0;           // The length of the reply, or 0 if none arrived.
+    std::vector<uint8_t> assembled; // A segmented reply, reassembled into one APDU. Its storage is reused.
+    uint8_t nextSegment = 0;    // The sequence number of the next segment of a segmented reply.
+    uint8_t windowStart = 0;    // The sequence number of the first segment of the current window.
+    uint8_t windowSize = 1;     // The window size agreed with the device for a segmented reply.
+
+    /**
+     * Gets the APDU of the reply, once it has arrived.
+     * @returns Returns the reply, which is replyLen bytes long.
+     */
+    const uint8_t* replyApdu() const
+    {
+        return assembled.empty() ? reply : assembled.data();
+    }
+};
+
+/**
+ * What a device announced about itself in its I-Am: the address it answers at and the largest requests it accepts.
+ */
+struct BACnetDeviceBinding
+{
+    BACNET_ADDRESS address{};
+    unsigned maxApdu = MAX_APDU;
+    int segmentation = SEGMENTATION_NONE;
+    uint16_t vendorId = 0;
+};
+
+/**
+ * Counters of the shared datalink, which show how much of the clients' waiting for replies goes into reading it. All
+ * of them are atomic, so they can be read from any thread.
+ */
+struct BACnetDatalinkCounters
+{
+    std::atomic<uint64_t> receives{0};      // The reads of the datalink.
+    std::atomic<uint64_t> emptyReceives{0}; // The reads that timed out without a PDU.
+    std::atomic<uint64_t> waits{0};         // The waits of a thread in pump() while another thread read the datalink.
+    std::atomic<uint64_t> unrouted{0};      // The PDUs that no client or server took.
+    std::atomic<uint64_t> resends{0};       // The requests that were sent again after no reply arrived.
+    std::atomic<uint64_t> timeouts{0};      // The requests that ran out of retries.
+};
+
+class BACNETClient;
+class BACnetServer;
+
+/**
+ * The BACnet/IP datalink of the process. bacnet-stack keeps a single datalink for the whole process, so it is owned
+ * here on behalf of every BACNETClient: it is initialized by the first client that needs it, shut down when the last
+ * one releases it, and read by one waiting thread at a time. Each PDU that arrives is routed to the client of the
+ * device it came from.
+ */
+class BACnetDatalink {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * Gets the datalink of the process.
+     * @returns Returns the datalink.
+     */
+    static BACnetDatalink& instance();
+
+    /**
+     * Starts using the datalink, initializing it if no other client is using it. The interface is found from the
+     * route to the device, once per interface.
+     * @param remoteIp The address of a device the datalink must reach.
+     * @returns Returns false if the datalink could not be initialized.
+     */
+    bool acquire(const std::string& remoteIp);
+    /**
+     * Stops using the datalink. The last client to release it shuts it down.
+     */
+    void release();
+    /**
+     * Routes the PDUs that arrive from a device to a client.
+     * @param device The address of the device.
+     * @param client The client.
+     */
+    void attach(const BACNET_ADDRESS& device, BACNETClient* client);
+    /**
+     * Stops routing the PDUs of a device to a client. Once this returns, the client receives no more PDUs.
+     * @param device The address of the device.
+     * @param client The client.
+     */
+    void detach(const BACNET_ADDRESS& device, BACNETClient* client);
+    /**
+     * Sends a PDU. This can be called from any thread, with or without the route lock.
+     * @param dest The address to send to.
+     * @param npdu The NPDU data of the PDU.
+     * @param pdu The encoded PDU.
+     * @param pduLen The length of the PDU.
+     * @returns Returns false if the PDU could not be sent.
+     */
+    bool send(BACNET_ADDRESS& dest, BACNET_NPDU_DATA& npdu, uint8_t* pdu, int pduLen);
+    /**
+     * Gets the mutex that guards the routes, and the transactions and COV targets of every client. PDUs are handed
+     * to clients while it is held.
+     * @returns Returns the route mutex.
+     */
+    std::mutex& routeMutex();
+    /**
+     * Waits until a deadline or until a PDU is routed. If no other thread is reading the datalink, this thread reads
+     * it for everyone in the meantime. The route lock is released while waiting.
+     * @param lock The held route lock.
+     * @param until The deadline.
+     */
+    void pump(std::unique_lock<std::mutex>& lock, Clock::time_point until);
+    /**
+     * Routes the PDUs that have arrived, unless another thread is reading the datalink.
+     */
+    void poll();
+    /**
+     * Wakes the threads waiting in pump(). The route lock must be held.
+     */
+    void notify();
+
+    /**
+     * Sets the file that device bindings are kept in, and loads the bindings it holds, so that a restarted runtime
+     * can talk to its devices without waiting for them to answer Who-Is. It must be set before any client connects.
+     * @param path The path of the file, or empty to not keep the bindings.
+     */
+    void setBindingsFile(const std::string& path);
+    /**
+     * Finds the address and limits of a device. A binding that is already known, or was loaded from the bindings
+     * file, is returned right away. Otherwise this waits for the device to answer a Who-Is. A Who-Is is sent
+     * either way, so that the bindings follow devices that move.
+     * @param instance The device instance, or NO_DEVICE_INSTANCE for the device at the configured address.
+     * @param configured The configured address of the device.
+     * @param timeout The longest time to wait for the I-Am.
+     * @param binding Set to the binding.
+     * @returns Returns false if the device didn't answer.
+     */
+    bool discover(uint32_t instance, BACNET_ADDRESS configured, Clock::duration timeout, BACnetDeviceBinding& binding);
+    /**
+     * Hands the requests that are meant for this runtime's own device to a server: Who-Is, and every confirmed
+     * request other than a COV notification, which still goes to the client of the device that sent it.
+     * @param handler The server, or nullptr to stop serving.
+     */
+    void serve(BACnetServer* handler);
+    /**
+     * Sets the UDP port the datalink binds to when it is initialized, so that other devices can reach this runtime
+     * at a known port. By default the OS picks the port, which is enough for clients. It must be set before any
+     * client connects.
+     * @param port The port, or 0 to let the OS pick one.
+     */
+    void setLocalPort(uint16_t port);
+    /**
+     * Gets the counters of the datalink.
+     * @returns Returns the counters.
+     */
+    const BACnetDatalinkCounters& getCounters() const;
+    /**
+     * Counts a request that is sent again.
+     */
+    void countResend();
+    /**
+     * Counts a request that ran out of retries.
+     */
+    void countTimeout();
+
+    /**
+     * Gets the key that PDUs are routed by: the IP address and port of a BACnet/IP MAC address, or the network
+     * and MAC address of a device behind a router.
+     * @param address The address.
+     * @returns Returns the key.
+     */
+    static uint64_t addressKey(const BACNET_ADDRESS& address);
+
+    /**
+     * The instance of a device that isn't configured with one.
+     */
+    static constexpr uint32_t NO_DEVICE_INSTANCE = UINT32_MAX;
+
+private:
+    BACnetDatalink() = default;
+
+    /**
+     * Sends a Who-Is.
+     * @param dest The address to send it to.
+     * @param instance The device instance to ask for, or NO_DEVICE_INSTANCE to ask every device.
+     */
+    void sendWhoIs(BACNET_ADDRESS& dest, uint32_t instance);
+    /**
+     * Records the binding announced by an I-Am, and saves the bindings if it changed. The receive mutex must be
+     * held.
+     * @param source The address the I-Am came from.
+     * @param apdu The APDU of the I-Am.
+     * @param apduLen The length of the APDU.
+     */
+    void learn(const BACNET_ADDRESS& source, const uint8_t* apdu, int apduLen);
+    /**
+     * Finds a known binding. The route mutex must be held.
+     * @param instance The device instance, or NO_DEVICE_INSTANCE to find the device at an address.
+     * @param configured The configured address of the device.
+     * @param binding Set to the binding.
+     * @returns Returns false if the device isn't known.
+     */
+    bool findBinding(uint32_t instance, const BACNET_ADDRESS& configured, BACnetDeviceBinding& binding) const;
+    /**
+     * Writes the bindings to the bindings file. Only the thread that holds the receive mutex calls this.
+     * @param saved The bindings, as JSON.
+     */
+    void saveBindings(const json& saved) const;
+
+    /**
+     * Reads one PDU from the datalink and routes it. The receive mutex must be held.
+     * @param timeoutMs The longest time to wait for a PDU, in milliseconds.
+     * @returns Returns false if no PDU arrived.
+     */
+    bool receiveOne(unsigned timeoutMs);
+
+    // Guards initialization, cleanup and sends.
+    std::mutex linkMutex;
+    int users = 0;
+    uint16_t localPort = 0;
+    // The interface names by local address, so that each interface is only looked up once.
+    std::map<std::string, std::string> interfaces;
+    // Held by the thread that is reading the datalink, which owns receiveBuffer meanwhile.
+    std::mutex receiveMutex;
+    uint8_t receiveBuffer[MAX_PDU + 64];
+    // The route mutex, which is taken before linkMutex when both are held.
+    std::mutex routeGuard;
+    std::condition_variable routeChanged;
+    // The clients by the addressKey() of their device.
+    std::map<uint64_t, BACNETClient*> routes;
+    // The bindings of the devices that have announced themselves, by device instance, guarded by the route mutex.
+    std::map<uint32_t, BACnetDeviceBinding> bindings;
+    std::string bindingsFile;
+    // The server that requests to this runtime's device are handed to, guarded by the receive mutex.
+    BACnetServer* server = nullptr;
+    BACnetDatalinkCounters counters;
+};
+
+class BACNETClient : public ScalarIOClient {
 public:
-    BACNETClient(const std::string& ip = "", uint16_t port = 0xBAC0);
+    /**
+     * Constructs a BACnet/IP client.
+     * @param ip The address of the device, or empty to use the ModuleID of the first mapping.
+     * @param port The UDP port of the device, or 0 to use the ModulePort of the first mapping, or 47808.
+     */
+    BACNETClient(const std::string& ip = "", uint16_t port = 0);
     ~BACNETClient() override;
 
 protected:
@@ -134,15 +407,31 @@ protected:
     bool readLWord(const std::string &remote, uint64_t &result) override;
     bool writeLWord(const std::string &remote, uint64_t value) override;
     void connect() override;
-    void onMappingAdded(const IOMap& map) override;
+    void onMappingAdded(IOMap& map) override;
+    /**
+     * Writes the due outputs with WritePropertyMultiple and reads the due inputs with ReadPropertyMultiple, in as
+     * few requests as the device's max APDU allows, keeping up to maxInFlight of them outstanding at once. Points
+     * the device can't transfer that way are exchanged one at a time.
+     * @param batch The requests of the mappings that are due.
+     */
+    void submitBatch(IOBatch& batch) override;
 
 private:
-    static constexpr std::chrono::milliseconds REQUEST_TIMEOUT{1000};
-
     uint8_t nextInvokeId();
+    /**
+     * Acquires the shared datalink and routes the device's PDUs to this client, unless that is already done.
+     * @returns Returns false if the datalink could not be initialized.
+     */
     bool ensureDatalink();
     BACNET_ADDRESS buildAddress() const;
     bool resolveRemote(const std::string& remote, BACnetRemotePoint& point);
+    /**
+     * Gets the point of a mapping from the table the compiler generated.
+     * @param map The mapping.
+     * @param point Set to the point.
+     * @returns Returns false if the mapping has no definition in the table.
+     */
+    bool definePoint(const IOMap& map, BACnetRemotePoint& point) const;
     bool parseRemoteDefinition(const IOMap& map, BACnetRemotePoint& point);
     bool parseJsonRemote(const json& config, BACnetRemotePoint& point);
     bool parseStringRemote(const std::string& definition, BACnetRemotePoint& point) const;
@@ -152,18 +441,464 @@ private:
 
     bool performRead(const BACnetRemotePoint &point, BACNET_APPLICATION_DATA_VALUE &value);
     bool performWrite(const BACnetRemotePoint& point, const BACNET_APPLICATION_DATA_VALUE& value);
+    /**
+     * Encodes a ReadPropertyMultiple request for a batch of points.
+     * @param batch The points, with the points of one object next to each other.
+     * @param count The number of points.
+     * @param transaction The transaction to encode the request into.
+     * @returns Returns false if the request could not be encoded.
+     */
+    bool encodeReadMultiple(const BACnetRemotePoint* const* batch, size_t count, BACnetTransaction& transaction);
+    /**
+     * Writes the values of a ReadPropertyMultiple acknowledgement to the process image. A property that the device
+     * returns an error for is reported on its own, and doesn't fail the others.
+     * @param batch The points that were requested.
+     * @param count The number of points.
+     * @param transaction The completed transaction.
+     * @param requestApdu The max APDU the request was sized for.
+     * @returns Returns false if the request failed as a whole.
+     */
+    bool completeReadMultiple(const BACnetRemotePoint* const* batch, size_t count, const BACnetTransaction& transaction, size_t requestApdu);
+    /**
+     * Encodes a WritePropertyMultiple request that writes the current values of a batch of output points.
+     * @param batch The points, with the points of one object next to each other.
+     * @param count The number of points.
+     * @param transaction The transaction to encode the request into.
+     * @returns Returns false if the request could not be encoded.
+     */
+    bool encodeWriteMultiple(const BACnetRemotePoint* const* batch, size_t count, BACnetTransaction& transaction);
+    /**
+     * Checks the reply to a WritePropertyMultiple request. The outputs that weren't written are written again on
+     * their next poll.
+     * @param batch The points that were written.
+     * @param count The number of points.
+     * @param transaction The completed transaction.
+     * @returns Returns false if any point wasn't written.
+     */
+    bool completeWriteMultiple(const BACnetRemotePoint* const* batch, size_t count, const BACnetTransaction& transaction);
+    /**
+     * Reads or writes a batch of points with as few ReadPropertyMultiple or WritePropertyMultiple requests as the
+     * device's max APDU allows, keeping up to maxInFlight of them outstanding at once. If the device doesn't
+     * support the service, the points are exchanged one at a time instead.
+     * @param batch The points. They are sorted by object.
+     * @param write Whether the points are outputs to write.
+     */
+    void transferMultiple(std::vector<const BACnetRemotePoint*>& batch, bool write);
+    /**
+     * Starts a confirmed request to the device, encoding its NPDU and assigning its invoke ID.
+     * @param transaction The transaction.
+     * @returns Returns the length of the NPDU, where the APDU is to be encoded, or -1 on error.
+     */
+    int beginRequest(BACnetTransaction& transaction);
+    /**
+     * Marks an encoded request as accepting a segmented reply of up to maxSegments segments.
+     * @param transaction The transaction.
+     * @param npduLen The length of the NPDU, where the APDU starts.
+     */
+    void acceptSegments(BACnetTransaction& transaction, int npduLen) const;
+    /**
+     * Gets the largest reply the device can send, in one APDU or, if it can segment it, in maxSegments segments.
+     * @returns Returns the size in bytes.
+     */
+    size_t replyBudget() const;
+    /**
+     * Adds a segment of a segmented ComplexACK to its transaction, and acknowledges it when it completes a window.
+     * Segments that arrive out of order are dropped and acknowledged negatively, so that the device resends them.
+     * The route mutex must be held.
+     * @param transaction The transaction.
+     * @param apdu The APDU of the segment.
+     * @param apduLen The length of the APDU.
+     */
+    void receiveSegment(BACnetTransaction& transaction, const uint8_t* apdu, int apduLen);
+    /**
+     * Sends a SegmentACK. The route mutex must be held.
+     * @param transaction The transaction being reassembled.
+     * @param sequence The sequence number of the last segment received in order.
+     * @param negative Whether a segment was missed, so that the device resends those after the sequence number.
+     */
+    void sendSegmentAck(BACnetTransaction& transaction, uint8_t sequence, bool negative);
+    /**
+     * Completes a transaction with its reply. The route mutex must be held.
+     * @param transaction The transaction.
+     * @param replyLen The length of the reply.
+     */
+    void complete(BACnetTransaction& transaction, int replyLen);
+    // The requests of a batch are completed as for every client.
+    using IOClient::complete;
+    /**
+     * Sends a request and registers it to receive its reply.
+     * @param transaction The transaction, whose request has been encoded.
+     * @returns Returns false if the request could not be sent.
+     */
+    bool submit(BACnetTransaction& transaction);
+    /**
+     * Waits until each of a set of submitted transactions has its reply or has run out of retries. The waiting
+     * threads take turns reading the datalink, and each reply is handed to the transaction it belongs to, whichever
+     * thread is reading.
+     * @param transactions The transactions.
+     * @param count The number of transactions.
+     */
+    void await(BACnetTransaction* const* transactions, size_t count);
+    /**
+     * Sends one request and waits for its reply.
+     * @param transaction The transaction, whose request has been encoded.
+     * @returns Returns true if a reply arrived, in transaction.reply.
+     */
+    bool transact(BACnetTransaction& transaction);
+    /**
+     * Gets the request of a point in the batch being polled.
+     * @param point The point.
+     * @returns Returns the request.
+     */
+    IORequest& requestOf(const BACnetRemotePoint& point) { return *pointRequests[&point - points.data()]; }
+    /**
+     * Completes the request of a point that was read, and those of the inputs that share the point's read.
+     * @param point The point that was read.
+     * @param value The value, or nullptr if the read failed.
+     * @returns Returns true if the value was written for the point itself.
+     */
+    bool storeRead(const BACnetRemotePoint& point, const BACNET_APPLICATION_DATA_VALUE* value);
+    /**
+     * Leaves out of readBatch the inputs of a property that another input of the batch reads, and records them in
+     * sharedReads.
+     */
+    void shareReads();
+
+    /**
+     * The result of a COV subscription request.
+     */
+    enum class SubscribeResult {
+        Subscribed,
+        Refused,    // The device returned an error or rejected the request, so the point is polled instead.
+        Failed      // The request timed out, so it is tried again on the next poll.
+    };
+    /**
+     * Subscribes to, or renews the subscription to, the changes of a point. Present_Value is subscribed to with
+     * SubscribeCOV, and other properties with SubscribeCOVProperty.
+     * @param point The point.
+     * @returns Returns the result of the request.
+     */
+    SubscribeResult performSubscribe(const BACnetRemotePoint& point);
+    /**
+     * Keeps the COV subscription of a point current, subscribing when it is due to be renewed. If the device
+     * refuses, the point falls back to polling. The mapping mutex must be held.
+     * @param point The point, which must use COV.
+     * @returns Returns true if the point's value will arrive by notification, so it doesn't need to be read.
+     */
+    bool covCurrent(BACnetRemotePoint& point);
+    friend class BACnetDatalink;
+    /**
+     * Handles a PDU from the device. A reply completes the outstanding transaction with its invoke ID, and is
+     * dropped if there is none. The route mutex must be held.
+     * @param source The address the PDU came from.
+     * @param apdu The APDU.
+     * @param apduLen The length of the APDU.
+     */
+    void deliver(BACNET_ADDRESS& source, const uint8_t* apdu, int apduLen);
+    /**
+     * Handles a PDU from the device that isn't a reply. COV notifications of this client's subscriptions are
+     * written straight to the process image, and confirmed ones are acknowledged. Anything else is dropped. The
+     * route mutex must be held.
+     * @param source The address the PDU came from.
+     * @param apdu The APDU.
+     * @param apduLen The length of the APDU.
+     */
+    void handleUnsolicited(BACNET_ADDRESS& source, const uint8_t* apdu, int apduLen);
+
+    /**
+     * A point whose value arrives by COV notification.
+     */
+    struct CovTarget {
+        BACNET_OBJECT_TYPE objectType;
+        uint32_t objectInstance;
+        BACNET_PROPERTY_ID propertyId;
+        ResolvedAddress local;
+        int width;
+        uint32_t quality;
+    };
+    /**
+     * The points that are subscribed to. It is guarded by the route mutex rather than the mapping mutex, so that
+     * notifications received by another client's thread can be stored for this one.
+     */
+    std::vector<CovTarget> covTargets;
+    /**
+     * The subscriber process identifier of this client's subscriptions, which notifications for them carry.
+     */
+    uint32_t processId = 0;
 
     template<typename T>
     bool decodeNumeric(const BACNET_APPLICATION_DATA_VALUE& value, T& result);
     bool encodeValue(uint64_t raw, BACnetRemotePoint point, BACNET_APPLICATION_DATA_VALUE &value);
 
-    std::unordered_map<std::string, BACnetRemotePoint> remoteCache;
+    /**
+     * The index in points of each remote address, for the exchanges that are made by address.
+     */
+    std::unordered_map<std::string, size_t> remoteIndex;
+    /**
+     * The points of the mappings, indexed by their remoteHandle.
+     */
+    std::vector<BACnetRemotePoint> points;
+    /**
+     * The input points being read, kept between polls so that its storage is reused.
+     */
+    std::vector<const BACnetRemotePoint*> readBatch;
+    /**
+     * The inputs left out of readBatch, after the point of readBatch whose read they share, sorted by that point.
+     */
+    std::vector<std::pair<const BACnetRemotePoint*, const BACnetRemotePoint*>> sharedReads;
+    /**
+     * The output points being written, kept between polls so that its storage is reused.
+     */
+    std::vector<const BACnetRemotePoint*> writeBatch;
+    /**
+     * The request of each point in the batch being polled, indexed like points.
+     */
+    std::vector<IORequest*> pointRequests;
+    /**
+     * The first point and the number of points of each request that is outstanding together.
+     */
+    std::vector<std::pair<size_t, size_t>> chunks;
+    /**
+     * The number of requests that may be outstanding to the device at once. It is set with the MaxInFlight protocol
+     * property.
+     */
+    size_t maxInFlight = 1;
+    /**
+     * The longest time to wait for a reply before the request is sent again, in milliseconds. Set with the
+     * ResponseTimeout protocol property.
+     */
+    uint64_t responseTimeout = 1000;
+    /**
+     * The number of times a request is sent again before it fails. Set with the Retries protocol property.
+     */
+    int retries = 1;
+    /**
+     * The transactions of the requests that are outstanding together, kept between polls.
+     */
+    std::vector<BACnetTransaction> window;
+    std::vector<BACnetTransaction*> outstanding;
+    /**
+     * The outstanding transactions by invoke ID, guarded by the route mutex.
+     */
+    std::array<BACnetTransaction*, 256> pending{};
+    /**
+     * The largest APDU the device sends, from the MaxAPDU protocol property, or the max APDU of its I-Am if that is
+     * smaller. ReadPropertyMultiple requests are sized so that their acknowledgement fits in it, and it is halved
+     * if the device aborts one as too large.
+     */
+    size_t maxApdu = MAX_APDU;
+    /**
+     * The instance of the device, from the DeviceInstance protocol property, or NO_DEVICE_INSTANCE if it isn't
+     * configured. A configured device is found wherever it answers Who-Is, including behind a router.
+     */
+    uint32_t deviceInstance = BACnetDatalink::NO_DEVICE_INSTANCE;
+    /**
+     * The address requests are sent to, bound from the device's I-Am when it answers one.
+     */
+    BACNET_ADDRESS device{};
+    /**
+     * The segmentation the device supports, from its I-Am.
+     */
+    int segmentation = SEGMENTATION_NONE;
+    /**
+     * The most segments a reply may have, from the MaxSegments protocol property. Above 1, requests for values
+     * accept segmented replies, and ReadPropertyMultiple requests are sized for the segments if the device can
+     * send them.
+     */
+    size_t maxSegments = 16;
+    /**
+     * The largest window of segments the device may send before it waits for a SegmentACK, from the SegmentWindow
+     * protocol property. The window of a reply is the smaller of this and the window the device proposes.
+     */
+    uint8_t segmentWindow = 16;
+    /**
+     * Whether the device supports ReadPropertyMultiple. Once it rejects the service, points are read one at a time.
+     */
+    bool rpmSupported = true;
+    /**
+     * Whether the device supports WritePropertyMultiple. Once it rejects the service, points are written one at a time.
+     */
+    bool wpmSupported = true;
     std::string remoteIp;
     uint16_t remotePort;
     uint8_t invokeId = 1;
     bool datalinkReady = false;
 };
 
+/**
+ * An object the BACnet server publishes. Value objects are backed by an address in %M memory and read straight
+ * from the published process image.
+ */
+struct BACnetServerObject
+{
+    BACNET_OBJECT_TYPE type = OBJECT_DEVICE;
+    uint32_t instance = 0;
+    std::string name;
+    ResolvedAddress address;
+    size_t subscribers = 0;     // The COV subscriptions to the object, which is only checked for changes while it has some.
+    double reported = 0;        // The value the subscribers were last notified of.
+};
+
+/**
+ * A COV subscription of a BACnet client to one of the server's objects.
+ */
+struct BACnetCovSubscription
+{
+    BACNET_ADDRESS subscriber{};
+    uint32_t processId = 0;
+    size_t object = 0;          // The index of the object in the server's objects.
+    bool confirmed = false;
+    bool expires = true;        // Whether the subscription has a lifetime. A lifetime of 0 never expires.
+    std::chrono::steady_clock::time_point expiresAt;
+};
+
+/**
+ * A BACnet/IP server that publishes the process image as a device with Analog Value and Binary Value objects, so
+ * that a BMS can read them directly. It answers Who-Is, ReadProperty, ReadPropertyMultiple and SubscribeCOV on the
+ * shared datalink. Objects are looked up in an index built when the server starts, and the values of subscribed
+ * objects are compared once per published image so that their subscribers are notified of changes.
+ */
+class BACnetServer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * Constructs a server.
+     * @param deviceInstance The instance of the server's device object.
+     * @param deviceName The name of the server's device object.
+     */
+    BACnetServer(uint32_t deviceInstance, const std::string& deviceName);
+    ~BACnetServer();
+    /**
+     * Publishes an address in %M memory as an object. A bit address becomes a Binary Value, and any other address an
+     * Analog Value. Objects are numbered from 0 per type, in the order they are published. This must be called
+     * before start().
+     * @param name The object name.
+     * @param address The address, like %MX0.1 or %MW10.
+     * @returns Returns false if the address isn't a valid %M address.
+     */
+    bool publish(const std::string& name, const std::string& address);
+    /**
+     * Starts serving on the shared datalink and announces the device with an I-Am.
+     * @returns Returns false if the datalink could not be initialized.
+     */
+    bool start();
+    /**
+     * Stops serving and releases the datalink.
+     */
+    void stop();
+
+private:
+    friend class BACnetDatalink;
+    /**
+     * Handles a PDU addressed to the server's device. The datalink's receive mutex is held.
+     * @param source The address the PDU came from.
+     * @param apdu The APDU.
+     * @param apduLen The length of the APDU.
+     * @returns Returns false if the PDU isn't a request for the server.
+     */
+    bool handle(BACNET_ADDRESS& source, const uint8_t* apdu, int apduLen);
+    void answerWhoIs(const uint8_t* apdu, int apduLen);
+    void sendIAm();
+    /**
+     * Answers a ReadProperty request.
+     * @param source The address of the requester.
+     * @param apdu The APDU of the request.
+     * @param apduLen The length of the APDU.
+     * @param maxReply The largest APDU the requester accepts.
+     */
+    void readProperty(BACNET_ADDRESS& source, const uint8_t* apdu, int apduLen, size_t maxReply);
+    /**
+     * Answers a ReadPropertyMultiple request. The properties ALL, REQUIRED and OPTIONAL read every property of an
+     * object. A property that can't be read returns its own error, and a reply that doesn't fit in maxReply is
+     * aborted, since the server doesn't segment.
+     * @param source The address of the requester.
+     * @param apdu The APDU of the request.
+     * @param apduLen The length of the APDU.
+     * @param maxReply The largest APDU the requester accepts.
+     */
+    void readPropertyMultiple(BACNET_ADDRESS& source, const uint8_t* apdu, int apduLen, size_t maxReply);
+    /**
+     * Adds, renews or cancels a COV subscription. A new or renewed subscription is notified of the current value
+     * right away.
+     * @param source The address of the subscriber.
+     * @param apdu The APDU of the request.
+     * @param apduLen The length of the APDU.
+     */
+    void subscribeCov(BACNET_ADDRESS& source, const uint8_t* apdu, int apduLen);
+    /**
+     * Encodes the value of a property.
+     * @param object The object.
+     * @param property The property.
+     * @param arrayIndex The array index, or BACNET_ARRAY_ALL.
+     * @param apdu The buffer to encode into.
+     * @param size The size of the buffer.
+     * @param errorClass Set to the error class if the property can't be read.
+     * @param errorCode Set to the error code if the property can't be read.
+     * @returns Returns the length of the value, BACNET_STATUS_ERROR if the property can't be read, or
+     * BACNET_STATUS_ABORT if the value doesn't fit in the buffer.
+     */
+    int encodeProperty(const BACnetServerObject& object, BACNET_PROPERTY_ID property, BACNET_ARRAY_INDEX arrayIndex,
+                       uint8_t* apdu, size_t size, BACNET_ERROR_CLASS& errorClass, BACNET_ERROR_CODE& errorCode) const;
+    /**
+     * Gets the properties of an object type.
+     * @param type The object type.
+     * @returns Returns the properties, in the order they are read for ALL.
+     */
+    static const std::vector<BACNET_PROPERTY_ID>& properties(BACNET_OBJECT_TYPE type);
+    /**
+     * Gets the present value of a value object from the published image.
+     * @param object The object.
+     * @param image The published image.
+     * @returns Returns the value. Binary Values are 0 or 1.
+     */
+    static double presentValue(const BACnetServerObject& object, const uint8_t* image);
+    double presentValue(const BACnetServerObject& object) const;
+    /**
+     * Finds an object by its type and instance.
+     * @returns Returns the index of the object, or -1 if there is none.
+     */
+    long findObject(BACNET_OBJECT_TYPE type, uint32_t instance) const;
+    /**
+     * Reads the subscribed objects from the published image, and notifies the subscribers of those whose value
+     * changed since they were last notified. The server mutex must be held.
+     */
+    void notifyChanges();
+    /**
+     * Sends a COV notification. The server mutex must be held.
+     * @param subscription The subscription.
+     * @param value The value to notify.
+     */
+    void notify(BACnetCovSubscription& subscription, double value);
+    void sendError(BACNET_ADDRESS& dest, uint8_t invokeId, BACNET_CONFIRMED_SERVICE service,
+                   BACNET_ERROR_CLASS errorClass, BACNET_ERROR_CODE errorCode);
+    /**
+     * Reads the datalink when no client is, drops expired subscriptions, and checks each newly published image for
+     * changes to notify.
+     */
+    void run();
+
+    uint32_t deviceInstance;
+    std::string deviceName;
+    // The device object, then the published objects in order.
+    std::vector<BACnetServerObject> objects;
+    // The indexes of the objects by their BACnet object identifier.
+    std::unordered_map<uint32_t, size_t> index;
+    uint32_t analogValues = 0;
+    uint32_t binaryValues = 0;
+    // Guards the subscriptions, and the reported values and subscriber counts of the objects.
+    std::mutex serverMutex;
+    std::vector<BACnetCovSubscription> subscriptions;
+    // The values read by notifyChanges(), by object index. Its storage is reused.
+    std::vector<std::pair<size_t, double>> watched;
+    uint8_t invokeId = 0;
+    uint64_t generation = 0;
+    std::atomic<bool> running{false};
+    std::thread worker;
+    bool datalinkReady = false;
+};
+
 template<typename T>
 bool BACNETClient::decodeNumeric(const BACNET_APPLICATION_DATA_VALUE& value, T& result) {
     double rf;
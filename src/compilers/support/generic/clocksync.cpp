@@ -0,0 +1,156 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Clock Synchronized Scheduling
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+#include "clocksync.h"
+#include <atomic>
+#include <cstring>
+#include <cerrno>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/timex.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    std::atomic<bool> ACTIVE{false};
+    /**
+     * The synchronized time less the steady time, in nanoseconds.
+     */
+    std::atomic<int64_t> OFFSET{0};
+    int64_t PHASE = 0;
+    std::chrono::steady_clock::time_point LAST_MEASURED;
+    ExecutionStats* CORRECTIONS = nullptr;
+#ifdef __linux__
+    /**
+     * The clock of the PTP device, or CLOCK_REALTIME.
+     */
+    clockid_t CLOCK = CLOCK_REALTIME;
+#endif
+
+    int64_t steadyNanos(std::chrono::steady_clock::time_point time) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    }
+
+    int64_t syncedNanos() {
+#ifdef __linux__
+        struct timespec now;
+        clock_gettime(CLOCK, &now);
+        return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    /**
+     * Measures the offset of the synchronized clock from the steady clock. The synchronized clock is read between two
+     * reads of the steady clock, and the closest of a few tries is taken, so that a preemption doesn't skew it.
+     */
+    int64_t measureOffset() {
+        int64_t best = 0;
+        int64_t window = INT64_MAX;
+        for (int x = 0; x < 5; x++) {
+            int64_t before = steadyNanos(std::chrono::steady_clock::now());
+            int64_t synced = syncedNanos();
+            int64_t after = steadyNanos(std::chrono::steady_clock::now());
+            if (after - before < window) {
+                window = after - before;
+                best = synced - (before + (after - before) / 2);
+            }
+        }
+        return best;
+    }
+
+    std::chrono::steady_clock::time_point steadyAt(int64_t synced) {
+        return std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::nanoseconds(synced - OFFSET.load(std::memory_order_acquire))));
+    }
+}
+
+bool openClockSync(const std::string& clock, uint64_t phase) {
+#ifdef __linux__
+    if (clock != "realtime") {
+        int fd = open(clock.c_str(), O_RDONLY);
+        if (fd < 0) {
+            nodalisLog() << "Could not open the clock " << clock << ": " << std::strerror(errno) << "\n";
+            return false;
+        }
+        // A PTP device is read through its dynamic POSIX clock, whose ID is made from the descriptor.
+        CLOCK = static_cast<clockid_t>((~static_cast<unsigned int>(fd) << 3) | 3);
+        struct timespec now;
+        if (clock_gettime(CLOCK, &now) != 0) {
+            nodalisLog() << clock << " is not a PTP clock: " << std::strerror(errno) << "\n";
+            close(fd);
+            CLOCK = CLOCK_REALTIME;
+            return false;
+        }
+    }
+    else {
+        struct timex status;
+        std::memset(&status, 0, sizeof(status));
+        if (adjtimex(&status) == TIME_ERROR || (status.status & STA_UNSYNC) != 0) {
+            DIAGNOSTIC("The system clock is not synchronized, so the task releases are only aligned to its own time");
+        }
+    }
+#else
+    if (clock != "realtime") {
+        nodalisLog() << "Only the realtime clock can be synchronized to on this platform\n";
+        return false;
+    }
+#endif
+    PHASE = static_cast<int64_t>(phase) * 1000;
+    OFFSET.store(measureOffset(), std::memory_order_release);
+    LAST_MEASURED = std::chrono::steady_clock::now();
+    CORRECTIONS = &registerStats("Clock.Correction");
+    ACTIVE.store(true, std::memory_order_release);
+    nodalisLog() << "Task releases are aligned to " << clock << "\n";
+    return true;
+}
+
+bool clockSyncActive() {
+    return ACTIVE.load(std::memory_order_acquire);
+}
+
+void trackClockSync() {
+    if (!clockSyncActive()) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (now - LAST_MEASURED < std::chrono::seconds(1)) {
+        return;
+    }
+    LAST_MEASURED = now;
+    int64_t offset = measureOffset();
+    int64_t correction = offset - OFFSET.exchange(offset, std::memory_order_acq_rel);
+    CORRECTIONS->record(static_cast<uint64_t>(correction < 0 ? -correction : correction) / 1000);
+}
+
+std::chrono::steady_clock::time_point firstSyncedRelease(std::chrono::steady_clock::time_point now, std::chrono::milliseconds interval) {
+    int64_t period = std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count();
+    int64_t synced = steadyNanos(now) + OFFSET.load(std::memory_order_acquire) - PHASE;
+    int64_t cycles = synced / period + (synced % period > 0 ? 1 : 0);
+    return steadyAt(cycles * period + PHASE);
+}
+
+std::chrono::steady_clock::time_point alignSyncedRelease(std::chrono::steady_clock::time_point release, std::chrono::milliseconds interval) {
+    int64_t period = std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count();
+    int64_t synced = steadyNanos(release) + OFFSET.load(std::memory_order_acquire) - PHASE;
+    return steadyAt((synced + period / 2) / period * period + PHASE);
+}
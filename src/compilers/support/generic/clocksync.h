@@ -0,0 +1,72 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Clock Synchronized Scheduling
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * Aligns the releases of the cyclic tasks to a clock that is disciplined across the controllers of a machine
+ * (--clock-sync <clock>): a PTP hardware clock on Linux (/dev/ptp0), or the system clock ("realtime") when NTP or
+ * phc2sys keeps it synchronized. A task of interval I is then released when the synchronized time is a multiple of I,
+ * plus --clock-phase <us>, so the cycles of every controller running with the same clock start together, and a value
+ * that crosses from one to another, as a network variable or through phase-aligned IO, arrives a known time before
+ * the next release rather than up to a cycle later.
+ *
+ * The scheduler still sleeps on the steady clock, which the synchronized clock is measured against once a second.
+ * Each release is put back on the grid of the synchronized clock as it is scheduled, so the controllers stay in phase
+ * as their oscillators drift, and a step of the synchronized clock moves the releases to the nearest point of the
+ * new grid rather than releasing a task twice or skipping it.
+ */
+#pragma once
+#ifndef CLOCKSYNC_H
+#define CLOCKSYNC_H
+
+#include "nodalis.h"
+#include <chrono>
+#include <string>
+
+/**
+ * Opens the clock the task releases are aligned to. Called by the scheduler before the tasks are first released.
+ * @param clock The clock, from options.clockSync: "realtime", or a PTP clock device such as /dev/ptp0.
+ * @param phase The offset of the releases from the grid, in microseconds, from options.clockPhase.
+ * @returns Returns false, having written why, if the clock can't be read. The releases are then not aligned.
+ */
+bool openClockSync(const std::string& clock, uint64_t phase);
+/**
+ * @returns Returns true if the task releases are aligned to a synchronized clock.
+ */
+bool clockSyncActive();
+/**
+ * Measures the synchronized clock against the steady clock again, if that was last done over a second ago. Called by
+ * the scheduler between scans.
+ */
+void trackClockSync();
+/**
+ * Gets the first release of a task at or after a time.
+ * @param now The time.
+ * @param interval The interval of the task.
+ * @returns Returns the time, on the steady clock, when the synchronized clock next reaches the task's grid.
+ */
+std::chrono::steady_clock::time_point firstSyncedRelease(std::chrono::steady_clock::time_point now, std::chrono::milliseconds interval);
+/**
+ * Puts a release back on the grid of its task.
+ * @param release The release, as the scheduler moved it forward from the last.
+ * @param interval The interval of the task.
+ * @returns Returns the time, on the steady clock, of the point of the grid nearest to the release.
+ */
+std::chrono::steady_clock::time_point alignSyncedRelease(std::chrono::steady_clock::time_point release, std::chrono::milliseconds interval);
+
+#endif // CLOCKSYNC_H
@@ -0,0 +1,780 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC EtherNet/IP Scanner
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+#include "enip.h"
+#include "nodalisjson.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #pragma comment(lib, "ws2_32.lib")
+#else
+    #include <arpa/inet.h>
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <sys/select.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+#endif
+#ifdef MSG_NOSIGNAL
+    static constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+    static constexpr int SEND_FLAGS = 0;
+#endif
+
+// Encapsulation commands.
+static constexpr uint16_t ENCAP_REGISTER_SESSION = 0x0065;
+static constexpr uint16_t ENCAP_UNREGISTER_SESSION = 0x0066;
+static constexpr uint16_t ENCAP_SEND_RR_DATA = 0x006f;
+static constexpr size_t ENCAP_HEADER_SIZE = 24;
+// Common packet format item types.
+static constexpr uint16_t CPF_NULL_ADDRESS = 0x0000;
+static constexpr uint16_t CPF_UNCONNECTED_DATA = 0x00b2;
+static constexpr uint16_t CPF_CONNECTED_DATA = 0x00b1;
+static constexpr uint16_t CPF_SEQUENCED_ADDRESS = 0x8002;
+// Connection Manager services.
+static constexpr uint8_t SERVICE_FORWARD_OPEN = 0x54;
+static constexpr uint8_t SERVICE_FORWARD_CLOSE = 0x4e;
+/**
+ * The vendor ID the scanner opens connections with, which no vendor is assigned.
+ */
+static constexpr uint16_t ORIGINATOR_VENDOR = 0xffff;
+/**
+ * Network connection parameters of a fixed size, point to point connection of scheduled priority.
+ */
+static constexpr uint16_t POINT_TO_POINT = 0x4800;
+/**
+ * The size of the header of an IO datagram: the item count, the sequenced address item, the header of the connected
+ * data item and the sequence count.
+ */
+static constexpr size_t IO_HEADER_SIZE = 20;
+
+static void append16(std::vector<uint8_t>& out, uint16_t value) {
+    out.push_back(static_cast<uint8_t>(value));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+static void append32(std::vector<uint8_t>& out, uint32_t value) {
+    append16(out, static_cast<uint16_t>(value));
+    append16(out, static_cast<uint16_t>(value >> 16));
+}
+
+static void store16(uint8_t* out, uint16_t value) {
+    out[0] = static_cast<uint8_t>(value);
+    out[1] = static_cast<uint8_t>(value >> 8);
+}
+
+static void store32(uint8_t* out, uint32_t value) {
+    store16(out, static_cast<uint16_t>(value));
+    store16(out + 2, static_cast<uint16_t>(value >> 16));
+}
+
+static uint16_t load16(const uint8_t* in) {
+    return static_cast<uint16_t>(in[0] | (in[1] << 8));
+}
+
+static uint32_t load32(const uint8_t* in) {
+    return static_cast<uint32_t>(load16(in)) | (static_cast<uint32_t>(load16(in + 2)) << 16);
+}
+
+/**
+ * Appends a logical segment to a path, in its 8 bit form if the value fits and its 16 bit form otherwise.
+ * @param path The path.
+ * @param type The 8 bit form of the segment: 0x20 for a class, 0x24 for an instance, 0x2c for a connection point.
+ * @param value The class, instance or connection point.
+ */
+static void appendSegment(std::vector<uint8_t>& path, uint8_t type, uint32_t value) {
+    if (value <= 0xff) {
+        path.push_back(type);
+        path.push_back(static_cast<uint8_t>(value));
+    }
+    else {
+        path.push_back(static_cast<uint8_t>(type | 1));
+        path.push_back(0);
+        append16(path, static_cast<uint16_t>(value));
+    }
+}
+
+/**
+ * Reads a value of an assembly, which is little endian.
+ * @param assembly The assembly.
+ * @param offset The byte offset of the value.
+ * @param bit The bit of a BOOL, or -1.
+ * @param width The width of the value.
+ * @returns Returns the value.
+ */
+static uint64_t loadValue(const uint8_t* assembly, size_t offset, int bit, int width) {
+    if (bit >= 0) {
+        return (assembly[offset] >> bit) & 1;
+    }
+    uint64_t value = 0;
+    for (int i = width / 8 - 1; i >= 0; i--) {
+        value = (value << 8) | assembly[offset + static_cast<size_t>(i)];
+    }
+    return value;
+}
+
+/**
+ * Writes a value to an assembly, which is little endian.
+ * @param assembly The assembly.
+ * @param offset The byte offset of the value.
+ * @param bit The bit of a BOOL, or -1.
+ * @param width The width of the value.
+ * @param value The value.
+ */
+static void storeValue(uint8_t* assembly, size_t offset, int bit, int width, uint64_t value) {
+    if (bit >= 0) {
+        uint8_t mask = static_cast<uint8_t>(1u << bit);
+        assembly[offset] = value != 0 ? static_cast<uint8_t>(assembly[offset] | mask) : static_cast<uint8_t>(assembly[offset] & ~mask);
+        return;
+    }
+    for (int i = 0; i < width / 8; i++) {
+        assembly[offset + static_cast<size_t>(i)] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+static void closeSocket(int fd) {
+#ifdef _WIN32
+    closesocket(fd);
+#else
+    close(fd);
+#endif
+}
+
+static bool setNonBlocking(int fd, bool nonBlocking) {
+#ifdef _WIN32
+    u_long mode = nonBlocking ? 1 : 0;
+    return ioctlsocket(fd, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return false;
+    flags = nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    return fcntl(fd, F_SETFL, flags) == 0;
+#endif
+}
+
+/**
+ * Waits until a socket is readable or writable.
+ * @param fd The socket.
+ * @param forWrite True to wait for the socket to become writable, false to wait for data to read.
+ * @param timeoutMicros The longest time to wait, in microseconds.
+ * @returns Returns 1 if the socket is ready, 0 on timeout and -1 on error.
+ */
+static int waitSocket(int fd, bool forWrite, int64_t timeoutMicros) {
+    fd_set set;
+    FD_ZERO(&set);
+    FD_SET(fd, &set);
+    timeval tv;
+    tv.tv_sec = static_cast<long>(timeoutMicros / 1000000);
+    tv.tv_usec = static_cast<long>(timeoutMicros % 1000000);
+    return select(fd + 1, forWrite ? nullptr : &set, forWrite ? &set : nullptr, nullptr, &tv);
+}
+
+static bool receiveAll(int fd, uint8_t* data, size_t bytes) {
+    while (bytes > 0) {
+        int received = static_cast<int>(recv(fd, reinterpret_cast<char*>(data), static_cast<int>(bytes), 0));
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        bytes -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+static int64_t numberProperty(const json& config, const char* name, int64_t fallback) {
+    if (!config.is_object() || !config.contains(name)) return fallback;
+    const json& value = config[name];
+    if (value.is_string()) return std::strtoll(value.get<std::string>().c_str(), nullptr, 0);
+    if (value.is_number()) return value.get<int64_t>();
+    return fallback;
+}
+
+static bool boolProperty(const json& config, const char* name, bool fallback) {
+    if (!config.is_object() || !config.contains(name) || !config[name].is_boolean()) return fallback;
+    return config[name].get<bool>();
+}
+
+// ========== IO Thread ==========
+
+/**
+ * Guards the open connections, which are added and removed by the worker threads of the clients and served by the IO
+ * thread.
+ */
+static std::mutex ENIP_MUTEX;
+static std::vector<EnipClient*> ENIP_CONNECTIONS;
+/**
+ * Serializes starting and stopping the IO thread.
+ */
+static std::mutex ENIP_THREAD_MUTEX;
+static std::thread ENIP_THREAD;
+static std::atomic<bool> ENIP_RUNNING{false};
+static int ENIP_SOCKET = -1;
+
+/**
+ * Hands a datagram received on the UDP port to the connection it was produced for.
+ * @param data The datagram.
+ * @param bytes The size of the datagram.
+ * @param now When it was received.
+ */
+static void dispatchDatagram(const uint8_t* data, size_t bytes, EnipClient::Clock::time_point now) {
+    // Two items: the sequenced address, with the connection ID and the sequence, and the connected data, which starts
+    // with the sequence count.
+    if (bytes < IO_HEADER_SIZE || load16(data) < 2 || load16(data + 2) != CPF_SEQUENCED_ADDRESS || load16(data + 4) != 8 ||
+        load16(data + 14) != CPF_CONNECTED_DATA) {
+        return;
+    }
+    uint32_t id = load32(data + 6);
+    uint32_t sequence = load32(data + 10);
+    size_t length = load16(data + 16);
+    if (length < 2 || 18 + length > bytes) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(ENIP_MUTEX);
+    for (EnipClient* client : ENIP_CONNECTIONS) {
+        if (client->consumedConnection() == id) {
+            client->consume(sequence, data + IO_HEADER_SIZE, length - 2, now);
+            return;
+        }
+    }
+}
+
+/**
+ * Sends the outputs of the connections when they are due, and receives their inputs, until the last connection is
+ * closed.
+ */
+static void runEnipIO() {
+    std::vector<uint8_t> buffer(2048);
+    while (ENIP_RUNNING) {
+        auto now = EnipClient::Clock::now();
+        auto wake = now + std::chrono::milliseconds(100);
+        {
+            std::lock_guard<std::mutex> lock(ENIP_MUTEX);
+            bool due = false;
+            for (EnipClient* client : ENIP_CONNECTIONS) {
+                due = due || client->nextProduction() <= now;
+            }
+            if (due) {
+                readImage([&](const uint8_t* image) {
+                    for (EnipClient* client : ENIP_CONNECTIONS) {
+                        if (client->nextProduction() <= now) {
+                            client->takeOutputs(image);
+                        }
+                    }
+                });
+                for (EnipClient* client : ENIP_CONNECTIONS) {
+                    if (client->nextProduction() <= now) {
+                        client->produce(ENIP_SOCKET, now);
+                    }
+                }
+            }
+            for (EnipClient* client : ENIP_CONNECTIONS) {
+                client->checkTimeout(now);
+                wake = std::min(wake, client->nextProduction());
+            }
+        }
+        auto wait = std::chrono::duration_cast<std::chrono::microseconds>(wake - EnipClient::Clock::now()).count();
+        if (waitSocket(ENIP_SOCKET, false, std::max<int64_t>(0, wait)) <= 0) {
+            continue;
+        }
+        while (true) {
+            int bytes = static_cast<int>(recv(ENIP_SOCKET, reinterpret_cast<char*>(buffer.data()), static_cast<int>(buffer.size()), 0));
+            if (bytes <= 0) {
+                break;
+            }
+            dispatchDatagram(buffer.data(), static_cast<size_t>(bytes), EnipClient::Clock::now());
+        }
+    }
+}
+
+/**
+ * Adds an open connection to the IO thread, opening the UDP port and starting the thread for the first one.
+ * @param client The client of the connection.
+ * @returns Returns false, having written why, if the UDP port can't be opened.
+ */
+static bool attachConnection(EnipClient* client) {
+    std::lock_guard<std::mutex> threadLock(ENIP_THREAD_MUTEX);
+    if (ENIP_SOCKET < 0) {
+        int fd = static_cast<int>(socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+        if (fd < 0) {
+            return false;
+        }
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&on), sizeof(on));
+        sockaddr_in local{};
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_ANY);
+        local.sin_port = htons(ENIP_UDP_PORT);
+        if (bind(fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0 || !setNonBlocking(fd, true)) {
+            nodalisLog() << "EtherNet/IP can't open UDP port " << ENIP_UDP_PORT << "\n";
+            closeSocket(fd);
+            return false;
+        }
+        ENIP_SOCKET = fd;
+    }
+    {
+        std::lock_guard<std::mutex> lock(ENIP_MUTEX);
+        ENIP_CONNECTIONS.push_back(client);
+    }
+    if (!ENIP_RUNNING) {
+        ENIP_RUNNING = true;
+        ENIP_THREAD = std::thread(runEnipIO);
+    }
+    return true;
+}
+
+/**
+ * Removes a connection from the IO thread, stopping the thread and closing the UDP port with the last one. When it
+ * returns, the IO thread no longer uses the client.
+ * @param client The client of the connection.
+ */
+static void detachConnection(EnipClient* client) {
+    std::lock_guard<std::mutex> threadLock(ENIP_THREAD_MUTEX);
+    bool last;
+    {
+        std::lock_guard<std::mutex> lock(ENIP_MUTEX);
+        ENIP_CONNECTIONS.erase(std::remove(ENIP_CONNECTIONS.begin(), ENIP_CONNECTIONS.end(), client), ENIP_CONNECTIONS.end());
+        last = ENIP_CONNECTIONS.empty();
+    }
+    if (last && ENIP_RUNNING) {
+        ENIP_RUNNING = false;
+        if (ENIP_THREAD.joinable()) {
+            ENIP_THREAD.join();
+        }
+        closeSocket(ENIP_SOCKET);
+        ENIP_SOCKET = -1;
+    }
+}
+
+// ========== Client ==========
+
+EnipClient::EnipClient() : IOClient("ETHERNET-IP") {
+#ifdef _WIN32
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2,2), &wsa);
+#endif
+    reconnectDelay = minReconnectDelay = 1000;
+    maxReconnectDelay = 30000;
+    std::random_device random;
+    originatorSerial = random();
+    connectionSerial = static_cast<uint16_t>(random());
+}
+
+EnipClient::~EnipClient() {
+    stop();
+    disconnect();
+}
+
+void EnipClient::onMappingAdded(IOMap& map) {
+    json config = protocolProperties(map);
+    // Any mapping may set the connection, and a later one overrides an earlier one.
+    inputAssembly = static_cast<uint32_t>(numberProperty(config, "InputAssembly", inputAssembly));
+    outputAssembly = static_cast<uint32_t>(numberProperty(config, "OutputAssembly", outputAssembly));
+    configAssembly = static_cast<uint32_t>(numberProperty(config, "ConfigAssembly", configAssembly));
+    inputSize = static_cast<size_t>(numberProperty(config, "InputSize", static_cast<int64_t>(inputSize)));
+    outputSize = static_cast<size_t>(numberProperty(config, "OutputSize", static_cast<int64_t>(outputSize)));
+    inputRunIdle = boolProperty(config, "InputRunIdle", inputRunIdle);
+    outputRunIdle = boolProperty(config, "OutputRunIdle", outputRunIdle);
+    responseTimeout = static_cast<int>(numberProperty(config, "ResponseTimeout", responseTimeout));
+    if (config.is_object() && config.contains("RPI")) {
+        const json& value = config["RPI"];
+        double millis = value.is_number() ? value.get<double>() : value.is_string() ? std::atof(value.get<std::string>().c_str()) : 0;
+        if (millis > 0) {
+            rpi = static_cast<uint32_t>(millis * 1000);
+        }
+    }
+    int64_t multiplier = numberProperty(config, "TimeoutMultiplier", 4 << timeoutMultiplier);
+    for (timeoutMultiplier = 0; timeoutMultiplier < 7 && (4 << timeoutMultiplier) < multiplier; timeoutMultiplier++) {}
+    if (config.is_object() && config.contains("Path") && config["Path"].is_string()) {
+        // The route through bridges to the adapter, as pairs of a port and a link address: "1,0" is slot 0 of the
+        // backplane.
+        route.clear();
+        std::string path = config["Path"].get<std::string>();
+        for (size_t at = 0; at < path.size();) {
+            size_t comma = path.find(',', at);
+            route.push_back(static_cast<uint8_t>(std::atoi(path.substr(at, comma - at).c_str())));
+            at = comma == std::string::npos ? path.size() : comma + 1;
+        }
+        if (route.size() % 2 != 0) {
+            route.push_back(0);
+        }
+    }
+    uint32_t interval = static_cast<uint32_t>(map.interval > 0 ? map.interval : 1) * 1000;
+    pollRpi = pollRpi == 0 ? interval : std::min(pollRpi, interval);
+
+    std::string address = map.remoteAddress;
+    size_t dot = address.find('.');
+    char* end = nullptr;
+    unsigned long offset = std::strtoul(address.substr(0, dot).c_str(), &end, 0);
+    int bit = dot == std::string::npos ? (map.width == 1 ? 0 : -1) : std::atoi(address.c_str() + dot + 1);
+    size_t bytes = map.width == 1 ? 1 : static_cast<size_t>(map.width / 8);
+    if (address.empty() || end == nullptr || *end != '\0' || bit > 7 || (bit >= 0 && map.width != 1) ||
+        offset + bytes > ENIP_MAX_CONNECTION_SIZE) {
+        nodalisLog() << "Invalid EtherNet/IP address " << map.remoteAddress << " for " << map.localAddress << "\n";
+        return;
+    }
+    // The assemblies are sized when the connection is opened, so a mapping added to an open connection opens it again.
+    if (open) {
+        disconnect();
+    }
+    Point point{ map.local, static_cast<size_t>(offset), bit, map.width };
+    if (map.direction == IOType::Output) {
+        outputs.push_back(point);
+        outputExtent = std::max(outputExtent, point.offset + bytes);
+    }
+    else {
+        inputs.push_back(point);
+        inputExtent = std::max(inputExtent, point.offset + bytes);
+    }
+}
+
+bool EnipClient::sendRequest(uint16_t command, const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> frame;
+    frame.reserve(ENCAP_HEADER_SIZE + data.size());
+    append16(frame, command);
+    append16(frame, static_cast<uint16_t>(data.size()));
+    append32(frame, session);
+    append32(frame, 0);             // Status.
+    frame.resize(frame.size() + 8); // Sender context.
+    append32(frame, 0);             // Options.
+    frame.insert(frame.end(), data.begin(), data.end());
+    return send(sockfd, reinterpret_cast<const char*>(frame.data()), static_cast<int>(frame.size()), SEND_FLAGS) ==
+        static_cast<int>(frame.size());
+}
+
+bool EnipClient::request(uint16_t command, const std::vector<uint8_t>& data, std::vector<uint8_t>& reply) {
+    uint8_t header[ENCAP_HEADER_SIZE];
+    if (!sendRequest(command, data) || !receiveAll(sockfd, header, sizeof(header))) {
+        nodalisLog() << "EtherNet/IP " << moduleID << " didn't reply\n";
+        return false;
+    }
+    reply.resize(load16(header + 2));
+    if (!receiveAll(sockfd, reply.data(), reply.size())) {
+        nodalisLog() << "EtherNet/IP " << moduleID << " didn't reply\n";
+        return false;
+    }
+    uint32_t status = load32(header + 8);
+    if (load16(header) != command || status != 0) {
+        nodalisLog() << "EtherNet/IP " << moduleID << " refused command 0x" << logHex(command) << " with status 0x" << logHex(status) << "\n";
+        return false;
+    }
+    if (command == ENCAP_REGISTER_SESSION) {
+        session = load32(header + 4);
+    }
+    return true;
+}
+
+bool EnipClient::sendUnconnected(const std::vector<uint8_t>& message, std::vector<uint8_t>& reply) {
+    std::vector<uint8_t> data;
+    append32(data, 0);              // Interface handle.
+    append16(data, 10);             // Timeout.
+    append16(data, 2);              // Item count.
+    append16(data, CPF_NULL_ADDRESS);
+    append16(data, 0);
+    append16(data, CPF_UNCONNECTED_DATA);
+    append16(data, static_cast<uint16_t>(message.size()));
+    data.insert(data.end(), message.begin(), message.end());
+    std::vector<uint8_t> response;
+    if (!request(ENCAP_SEND_RR_DATA, data, response)) {
+        return false;
+    }
+    reply.clear();
+    size_t at = 8;
+    for (uint16_t item = 0; response.size() >= 8 && item < load16(response.data() + 6) && at + 4 <= response.size(); item++) {
+        uint16_t type = load16(response.data() + at);
+        size_t length = load16(response.data() + at + 2);
+        if (at + 4 + length > response.size()) {
+            break;
+        }
+        if (type == CPF_UNCONNECTED_DATA) {
+            reply.assign(response.begin() + static_cast<std::ptrdiff_t>(at + 4), response.begin() + static_cast<std::ptrdiff_t>(at + 4 + length));
+        }
+        at += 4 + length;
+    }
+    if (reply.size() < 4 || reply[0] != (message[0] | 0x80)) {
+        nodalisLog() << "EtherNet/IP " << moduleID << " sent an invalid reply to service 0x" << logHex(message[0]) << "\n";
+        return false;
+    }
+    if (reply[2] != 0) {
+        // The extended status says why a connection was refused, as 0x0100 for a connection in use.
+        uint16_t extended = reply[3] > 0 && reply.size() >= 6 ? load16(reply.data() + 4) : 0;
+        nodalisLog() << "EtherNet/IP " << moduleID << " refused service 0x" << logHex(message[0]) << " with status 0x"
+            << logHex(reply[2]) << ", extended status 0x" << logHex(extended) << "\n";
+        return false;
+    }
+    reply.erase(reply.begin(), reply.begin() + 4 + 2 * reply[3]);
+    return true;
+}
+
+bool EnipClient::forwardOpen() {
+    size_t inputHeader = inputRunIdle ? 4 : 0;
+    size_t outputHeader = outputRunIdle ? 4 : 0;
+    size_t consumedSize = 2 + inputHeader + inputBytes;
+    size_t producedSize = 2 + outputHeader + outputBytes;
+    uint32_t interval = rpi != 0 ? rpi : pollRpi;
+    connectionPath = route;
+    appendSegment(connectionPath, 0x20, 0x04);  // The Assembly class.
+    appendSegment(connectionPath, 0x24, configAssembly);
+    appendSegment(connectionPath, 0x2c, outputAssembly);
+    appendSegment(connectionPath, 0x2c, inputAssembly);
+    std::random_device random;
+    connectionSerial++;
+
+    std::vector<uint8_t> message = { SERVICE_FORWARD_OPEN, 0x02, 0x20, 0x06, 0x24, 0x01 };
+    message.push_back(0x0a);        // Priority and time tick.
+    message.push_back(0x0e);        // Timeout ticks.
+    append32(message, 0);           // O->T connection ID, chosen by the adapter.
+    append32(message, random());    // T->O connection ID.
+    append16(message, connectionSerial);
+    append16(message, ORIGINATOR_VENDOR);
+    append32(message, originatorSerial);
+    message.push_back(timeoutMultiplier);
+    message.insert(message.end(), 3, 0);
+    append32(message, interval);
+    append16(message, static_cast<uint16_t>(POINT_TO_POINT | producedSize));
+    append32(message, interval);
+    append16(message, static_cast<uint16_t>(POINT_TO_POINT | consumedSize));
+    message.push_back(0x01);        // Class 1, cyclic, client.
+    message.push_back(static_cast<uint8_t>(connectionPath.size() / 2));
+    message.insert(message.end(), connectionPath.begin(), connectionPath.end());
+    std::vector<uint8_t> reply;
+    if (!sendUnconnected(message, reply)) {
+        return false;
+    }
+    if (reply.size() < 26) {
+        nodalisLog() << "EtherNet/IP " << moduleID << " sent an invalid Forward Open reply\n";
+        return false;
+    }
+    producedId = load32(reply.data());
+    consumedId = load32(reply.data() + 4);
+    // The adapter may grant different intervals than were requested.
+    uint32_t producedInterval = load32(reply.data() + 16);
+    uint32_t consumedInterval = load32(reply.data() + 20);
+    productionInterval = std::chrono::microseconds(producedInterval != 0 ? producedInterval : interval);
+    timeout = std::chrono::microseconds(static_cast<uint64_t>(consumedInterval != 0 ? consumedInterval : interval) * (4u << timeoutMultiplier));
+    return true;
+}
+
+void EnipClient::forwardClose() {
+    std::vector<uint8_t> message = { SERVICE_FORWARD_CLOSE, 0x02, 0x20, 0x06, 0x24, 0x01, 0x0a, 0x0e };
+    append16(message, connectionSerial);
+    append16(message, ORIGINATOR_VENDOR);
+    append32(message, originatorSerial);
+    message.push_back(static_cast<uint8_t>(connectionPath.size() / 2));
+    message.push_back(0);
+    message.insert(message.end(), connectionPath.begin(), connectionPath.end());
+    std::vector<uint8_t> reply;
+    sendUnconnected(message, reply);
+}
+
+void EnipClient::connect() {
+    if (open || sockfd >= 0) {
+        disconnect();
+    }
+    in_addr address{};
+    int port = modulePort.empty() ? ENIP_TCP_PORT : std::atoi(modulePort.c_str());
+    if (inet_pton(AF_INET, moduleID.c_str(), &address) != 1 || port <= 0 || port > 65535) {
+        nodalisLog() << "EtherNet/IP adapter " << moduleID << ":" << modulePort << " isn't an IPv4 address and port\n";
+        return;
+    }
+    inputBytes = inputSize != 0 ? inputSize : inputExtent;
+    outputBytes = outputSize != 0 ? outputSize : outputExtent;
+    if (inputExtent > inputBytes || outputExtent > outputBytes ||
+        2 + 4 + inputBytes > ENIP_MAX_CONNECTION_SIZE || 2 + 4 + outputBytes > ENIP_MAX_CONNECTION_SIZE) {
+        nodalisLog() << "EtherNet/IP mappings of " << moduleID << " don't fit the InputSize and OutputSize of its assemblies\n";
+        return;
+    }
+    int fd = static_cast<int>(socket(AF_INET, SOCK_STREAM, 0));
+    if (fd < 0) {
+        return;
+    }
+    sockaddr_in remote{};
+    remote.sin_family = AF_INET;
+    remote.sin_addr = address;
+    remote.sin_port = htons(static_cast<uint16_t>(port));
+    // Connect without blocking, so that an unreachable adapter costs at most the response timeout.
+    setNonBlocking(fd, true);
+    bool pending = ::connect(fd, reinterpret_cast<sockaddr*>(&remote), sizeof(remote)) != 0;
+    int soError = 0;
+    socklen_t length = sizeof(soError);
+    if (pending && (waitSocket(fd, true, static_cast<int64_t>(responseTimeout) * 1000) <= 0 ||
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&soError), &length) != 0 || soError != 0)) {
+        nodalisLog() << "EtherNet/IP can't connect to " << moduleID << ":" << port << "\n";
+        closeSocket(fd);
+        return;
+    }
+    setNonBlocking(fd, false);
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&on), sizeof(on));
+#ifdef _WIN32
+    DWORD wait = static_cast<DWORD>(responseTimeout);
+#else
+    timeval wait;
+    wait.tv_sec = responseTimeout / 1000;
+    wait.tv_usec = (responseTimeout % 1000) * 1000;
+#endif
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&wait), sizeof(wait));
+    sockfd = fd;
+
+    std::vector<uint8_t> reply;
+    auto start = std::chrono::steady_clock::now();
+    if (!request(ENCAP_REGISTER_SESSION, { 1, 0, 0, 0 }, reply) || !forwardOpen()) {
+        requestCompleted(false, 0);
+        disconnect();
+        return;
+    }
+    requestCompleted(true, microsBetween(start, std::chrono::steady_clock::now()));
+    targetAddress = address.s_addr;
+    size_t outputHeader = outputRunIdle ? 4 : 0;
+    datagram.assign(IO_HEADER_SIZE + outputHeader + outputBytes, 0);
+    store16(datagram.data(), 2);
+    store16(datagram.data() + 2, CPF_SEQUENCED_ADDRESS);
+    store16(datagram.data() + 4, 8);
+    store32(datagram.data() + 6, producedId);
+    store16(datagram.data() + 14, CPF_CONNECTED_DATA);
+    store16(datagram.data() + 16, static_cast<uint16_t>(2 + outputHeader + outputBytes));
+    if (outputRunIdle) {
+        store32(datagram.data() + IO_HEADER_SIZE, 1);   // Run.
+    }
+    outputStart = IO_HEADER_SIZE + outputHeader;
+    lastInputs.assign(inputBytes, 0);
+    consumedAny = false;
+    producedSequence = 0;
+    producedCount = 0;
+    timedOut = false;
+    productionDue = lastConsumed = Clock::now();
+    if (!attachConnection(this)) {
+        disconnect();
+        return;
+    }
+    open = true;
+    connected = true;
+    nodalisLog() << "EtherNet/IP opened a connection to " << moduleID << " with " << inputBytes << " bytes of inputs and "
+        << outputBytes << " bytes of outputs every " << std::chrono::duration_cast<std::chrono::microseconds>(productionInterval).count()
+        << " us\n";
+}
+
+void EnipClient::disconnect() {
+    if (open) {
+        detachConnection(this);
+        open = false;
+        forwardClose();
+    }
+    if (sockfd >= 0) {
+        sendRequest(ENCAP_UNREGISTER_SESSION, {});
+        closeSocket(sockfd);
+        sockfd = -1;
+        session = 0;
+    }
+    connected = false;
+}
+
+void EnipClient::submitBatch(IOBatch& batch) {
+    (void)batch;
+    if (timedOut) {
+        nodalisLog() << "EtherNet/IP connection to " << moduleID << " timed out\n";
+        for (const auto& point : inputs) {
+            markInputPending(point.local);
+        }
+        markInputs(IOQuality::Stale);
+        disconnect();
+    }
+}
+
+void EnipClient::takeOutputs(const uint8_t* image) {
+    uint8_t* assembly = datagram.data() + outputStart;
+    for (const auto& point : outputs) {
+        storeValue(assembly, point.offset, point.bit, point.width, point.local.load(image));
+    }
+}
+
+void EnipClient::produce(int udp, Clock::time_point now) {
+    store32(datagram.data() + 10, ++producedSequence);
+    store16(datagram.data() + 18, ++producedCount);
+    sockaddr_in to{};
+    to.sin_family = AF_INET;
+    to.sin_addr.s_addr = targetAddress;
+    to.sin_port = htons(ENIP_UDP_PORT);
+    if (sendto(udp, reinterpret_cast<const char*>(datagram.data()), static_cast<int>(datagram.size()), 0,
+        reinterpret_cast<sockaddr*>(&to), sizeof(to)) != static_cast<int>(datagram.size())) {
+        requestCompleted(false, 0);
+    }
+    productionDue += productionInterval;
+    if (productionDue <= now) {
+        // A late thread skips the datagrams it missed rather than sending them in a burst.
+        productionDue = now + productionInterval;
+    }
+}
+
+void EnipClient::consume(uint32_t sequence, const uint8_t* data, size_t bytes, Clock::time_point now) {
+    size_t header = inputRunIdle ? 4 : 0;
+    if (bytes != header + inputBytes) {
+        requestCompleted(false, 0);
+        return;
+    }
+    if (consumedAny) {
+        int32_t ahead = static_cast<int32_t>(sequence - consumedSequence);
+        if (ahead <= 0) {
+            // Late or repeated.
+            return;
+        }
+        // The datagrams that were lost count as failed requests, and each one received as a request that took the
+        // time since the last.
+        for (int32_t lost = 1; lost < ahead && lost <= 64; lost++) {
+            requestCompleted(false, 0);
+        }
+        requestCompleted(true, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - lastConsumed).count()));
+    }
+    consumedSequence = sequence;
+    lastConsumed = now;
+    const uint8_t* assembly = data + header;
+    bool first = !consumedAny;
+    consumedAny = true;
+    markInputs(IOQuality::Good);
+    if (!first && (inputBytes == 0 || std::memcmp(assembly, lastInputs.data(), inputBytes) == 0)) {
+        return;
+    }
+    stagedAddresses.clear();
+    stagedValues.clear();
+    for (const auto& point : inputs) {
+        uint64_t value = loadValue(assembly, point.offset, point.bit, point.width);
+        if (first || value != loadValue(lastInputs.data(), point.offset, point.bit, point.width)) {
+            stagedAddresses.push_back(point.local);
+            stagedValues.push_back(value);
+        }
+    }
+    std::memcpy(lastInputs.data(), assembly, inputBytes);
+    if (!stagedAddresses.empty()) {
+        writeImage(stagedAddresses.data(), stagedValues.data(), stagedAddresses.size());
+    }
+}
+
+void EnipClient::checkTimeout(Clock::time_point now) {
+    if (!timedOut && now - lastConsumed > timeout) {
+        timedOut = true;
+    }
+}
@@ -0,0 +1,203 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC EtherNet/IP Scanner
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * Exchanges the IO assemblies of EtherNet/IP adapters, such as drives and remote IO racks, over implicit (Class 1)
+ * connections. They are mapped like any other IO, with the protocol ETHERNET-IP: the ModuleID is the IP address of
+ * the adapter, the ModulePort its TCP port (44818), and the RemoteAddress the byte offset of the value in the
+ * assembly, followed by .bit for a bit. A %I mapping reads the input assembly, which the adapter produces, and a %Q
+ * mapping writes the output assembly, which the scanner produces.
+ *
+ * The client registers a session with the adapter over TCP and opens one connection with a Forward Open to the
+ * Connection Manager, for the configuration, output and input assembly instances given in the protocol properties,
+ * point to point in both directions, at the requested packet interval (RPI). The data then flows as UDP datagrams
+ * on port 2222, without requests: the adapter sends the inputs every RPI, and the scanner sends the outputs every
+ * RPI, with the run/idle header set to run.
+ *
+ * The datagrams of every connection are received and sent by one IO thread, which sleeps until the next datagram is
+ * due or one arrives. The inputs are decoded straight from the datagram that was received: one that is the same as
+ * the last costs a compare, and otherwise the values that changed are staged in one batch, to be latched by the next
+ * scan. The outputs of the connections that are due are taken from the image under one lock. A connection that
+ * receives nothing for its timeout, the RPI times the timeout multiplier, is closed and opened again, and its inputs
+ * are reported as bad until they are received again.
+ */
+#pragma once
+#ifndef ENIP_H
+#define ENIP_H
+
+#include "nodalis.h"
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+constexpr uint16_t ENIP_TCP_PORT = 44818;
+constexpr uint16_t ENIP_UDP_PORT = 2222;
+/**
+ * The largest connection a Forward Open can open, in bytes of the connected data item.
+ */
+constexpr size_t ENIP_MAX_CONNECTION_SIZE = 511;
+
+/**
+ * Scans one EtherNet/IP adapter over an implicit connection.
+ */
+class EnipClient : public IOClient {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    EnipClient();
+    ~EnipClient();
+
+    // Called on the IO thread, with the connections locked.
+
+    /**
+     * @returns Returns the ID of the connection the adapter produces on.
+     */
+    uint32_t consumedConnection() const { return consumedId; }
+    /**
+     * @returns Returns when the outputs are next due.
+     */
+    Clock::time_point nextProduction() const { return productionDue; }
+    /**
+     * Takes the outputs from the image into the datagram that is sent next.
+     * @param image The image.
+     */
+    void takeOutputs(const uint8_t* image);
+    /**
+     * Sends the outputs, and schedules the next datagram.
+     * @param udp The socket of the IO thread.
+     * @param now The time.
+     */
+    void produce(int udp, Clock::time_point now);
+    /**
+     * Stages the inputs of a datagram the adapter produced.
+     * @param sequence The encapsulation sequence of the datagram.
+     * @param data The connected data, after the sequence count.
+     * @param bytes The size of the connected data.
+     * @param now The time.
+     */
+    void consume(uint32_t sequence, const uint8_t* data, size_t bytes, Clock::time_point now);
+    /**
+     * Marks the connection as timed out if nothing was received for its timeout.
+     * @param now The time.
+     */
+    void checkTimeout(Clock::time_point now);
+
+protected:
+    /**
+     * Registers a session with the adapter and opens the connection.
+     */
+    void connect() override;
+    /**
+     * Adds a mapping to the inputs or the outputs, which takes effect when the connection is opened again.
+     * @param map The mapping.
+     */
+    void onMappingAdded(IOMap& map) override;
+    /**
+     * Closes the connection if it timed out, so the next poll opens it again. The data is exchanged by the IO thread.
+     * @param batch The requests of the mappings that are due.
+     */
+    void submitBatch(IOBatch& batch) override;
+
+private:
+    /**
+     * A value in an assembly.
+     */
+    struct Point {
+        ResolvedAddress local;
+        size_t offset;          // The byte offset in the assembly.
+        int bit;                // The bit of a BOOL, or -1.
+        int width;
+    };
+    std::vector<Point> inputs;
+    std::vector<Point> outputs;
+    size_t inputExtent = 0;     // The bytes of the input assembly that the inputs cover.
+    size_t outputExtent = 0;
+
+    // The connection, as set by the protocol properties.
+    uint32_t inputAssembly = 100;
+    uint32_t outputAssembly = 150;
+    uint32_t configAssembly = 1;
+    size_t inputSize = 0;       // The size of the input assembly in bytes, or 0 for inputExtent.
+    size_t outputSize = 0;
+    uint32_t rpi = 0;           // Microseconds, or 0 for the shortest PollTime.
+    uint32_t pollRpi = 0;       // The shortest PollTime, in microseconds.
+    uint8_t timeoutMultiplier = 0;  // The connection times out after 4 << timeoutMultiplier RPIs.
+    bool inputRunIdle = false;  // Whether the inputs start with a run/idle header.
+    bool outputRunIdle = true;
+    std::vector<uint8_t> route; // The port segments of the path to the adapter, from Path.
+    int responseTimeout = 2000;
+
+    // The session and the connection, while it is open.
+    int sockfd = -1;
+    uint32_t session = 0;
+    bool open = false;
+    uint32_t producedId = 0;
+    uint32_t consumedId = 0;
+    uint16_t connectionSerial = 0;
+    uint32_t originatorSerial;
+    uint32_t targetAddress = 0; // The IPv4 address of the adapter, in network byte order.
+    std::vector<uint8_t> connectionPath;    // The path of the Forward Open, for the Forward Close.
+    size_t inputBytes = 0;      // The size of the input assembly of the open connection.
+    size_t outputBytes = 0;
+    Clock::duration productionInterval{};
+    Clock::duration timeout{};
+    Clock::time_point productionDue{};
+    Clock::time_point lastConsumed{};
+    uint32_t producedSequence = 0;
+    uint16_t producedCount = 0;
+    std::vector<uint8_t> datagram;  // The outputs datagram, whose header is written when the connection opens.
+    size_t outputStart = 0;         // The offset of the output assembly in the datagram.
+    uint32_t consumedSequence = 0;
+    bool consumedAny = false;
+    std::vector<uint8_t> lastInputs;
+    std::vector<ResolvedAddress> stagedAddresses;
+    std::vector<uint64_t> stagedValues;
+    std::atomic<bool> timedOut{false};
+
+    /**
+     * Sends an encapsulation request over the session and receives its reply.
+     * @param command The encapsulation command.
+     * @param data The command specific data.
+     * @param reply Receives the command specific data of the reply.
+     * @returns Returns false, having written why, if there was no reply or it reported an error.
+     */
+    bool request(uint16_t command, const std::vector<uint8_t>& data, std::vector<uint8_t>& reply);
+    /**
+     * Sends an encapsulation request over the session.
+     * @param command The encapsulation command.
+     * @param data The command specific data.
+     * @returns Returns false if it couldn't be sent.
+     */
+    bool sendRequest(uint16_t command, const std::vector<uint8_t>& data);
+    /**
+     * Sends an unconnected message to the Connection Manager and receives its reply.
+     * @param message The message router request.
+     * @param reply Receives the message router reply.
+     * @returns Returns false, having written why, if there was no reply or the service failed.
+     */
+    bool sendUnconnected(const std::vector<uint8_t>& message, std::vector<uint8_t>& reply);
+    bool forwardOpen();
+    void forwardClose();
+    /**
+     * Closes the connection and the session.
+     */
+    void disconnect();
+};
+
+#endif // ENIP_H
@@ -0,0 +1,553 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Historian
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+#include "historian.h"
+#include "nodalis.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <thread>
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+/**
+ * How long the historian thread sleeps between drains of the ring, in milliseconds.
+ */
+static constexpr int HISTORIAN_DRAIN_WAIT = 50;
+
+/**
+ * The most bits a sample takes: the longest time (4 + 64) and the longest value (2 + 6 + 6 + 64).
+ */
+static constexpr uint64_t HISTORY_SAMPLE_BITS = 146;
+
+#pragma region "Compression"
+/**
+ * Appends bits to a bit stream, most significant bit first.
+ */
+class BitWriter {
+public:
+    BitWriter(uint8_t* data, uint64_t bits) : data(data), bits(bits) {}
+    void write(uint64_t value, int count) {
+        for (int n = count - 1; n >= 0; n--) {
+            uint8_t& byte = data[bits >> 3];
+            uint8_t mask = static_cast<uint8_t>(0x80 >> (bits & 7));
+            if ((value >> n) & 1) byte |= mask;
+            else byte &= static_cast<uint8_t>(~mask);
+            bits++;
+        }
+    }
+    uint64_t position() const { return bits; }
+private:
+    uint8_t* data;
+    uint64_t bits;
+};
+
+/**
+ * Reads the bits a BitWriter wrote.
+ */
+class BitReader {
+public:
+    BitReader(const uint8_t* data, uint64_t bits) : data(data), end(bits) {}
+    uint64_t read(int count) {
+        uint64_t value = 0;
+        for (int n = 0; n < count && bits < end; n++, bits++) {
+            value = (value << 1) | ((data[bits >> 3] >> (7 - (bits & 7))) & 1);
+        }
+        return value;
+    }
+    bool bit() { return read(1) != 0; }
+private:
+    const uint8_t* data;
+    uint64_t end;
+    uint64_t bits = 0;
+};
+
+static int64_t signExtend(uint64_t value, int bits) {
+    int shift = 64 - bits;
+    return static_cast<int64_t>(value << shift) >> shift;
+}
+
+static bool fits(int64_t value, int bits) {
+    int64_t limit = int64_t(1) << (bits - 1);
+    return value >= -limit && value < limit;
+}
+
+static int leadingZeros(uint64_t value) {
+    int count = 0;
+    while (count < 64 && !(value & (uint64_t(1) << (63 - count)))) count++;
+    return count;
+}
+
+static int trailingZeros(uint64_t value) {
+    int count = 0;
+    while (count < 64 && !(value & (uint64_t(1) << count))) count++;
+    return count;
+}
+
+/**
+ * The state that encodes or decodes a sample from the one before it. Both sides start from the same state at the
+ * start of a segment.
+ */
+struct HistoryCodec {
+    int64_t time = 0;
+    int64_t delta = 0;
+    uint64_t value = 0;
+    int leading = -1;       // The leading zero bits of the last XOR window, or -1 before the first.
+    int trailing = 0;
+    bool first = true;
+
+    void encode(BitWriter& out, int64_t sampleTime, uint64_t sampleValue) {
+        if (first) {
+            out.write(static_cast<uint64_t>(sampleTime), 64);
+            out.write(sampleValue, 64);
+            time = sampleTime;
+            value = sampleValue;
+            first = false;
+            return;
+        }
+        int64_t nextDelta = sampleTime - time;
+        int64_t dod = nextDelta - delta;
+        if (dod == 0) out.write(0, 1);
+        else if (fits(dod, 7)) { out.write(0b10, 2); out.write(static_cast<uint64_t>(dod), 7); }
+        else if (fits(dod, 12)) { out.write(0b110, 3); out.write(static_cast<uint64_t>(dod), 12); }
+        else if (fits(dod, 20)) { out.write(0b1110, 4); out.write(static_cast<uint64_t>(dod), 20); }
+        else { out.write(0b1111, 4); out.write(static_cast<uint64_t>(dod), 64); }
+        delta = nextDelta;
+        time = sampleTime;
+
+        uint64_t x = sampleValue ^ value;
+        value = sampleValue;
+        if (x == 0) {
+            out.write(0, 1);
+            return;
+        }
+        int lead = leadingZeros(x);
+        int trail = trailingZeros(x);
+        if (leading >= 0 && lead >= leading && trail >= trailing) {
+            // The changed bits fit in the window of the last XOR.
+            out.write(0b10, 2);
+            out.write(x >> trailing, 64 - leading - trailing);
+            return;
+        }
+        int meaningful = 64 - lead - trail;
+        out.write(0b11, 2);
+        out.write(static_cast<uint64_t>(lead), 6);
+        out.write(static_cast<uint64_t>(meaningful - 1), 6);
+        out.write(x >> trail, meaningful);
+        leading = lead;
+        trailing = trail;
+    }
+
+    void decode(BitReader& in, int64_t& sampleTime, uint64_t& sampleValue) {
+        if (first) {
+            time = static_cast<int64_t>(in.read(64));
+            value = in.read(64);
+            first = false;
+        }
+        else {
+            int64_t dod = 0;
+            if (!in.bit()) dod = 0;
+            else if (!in.bit()) dod = signExtend(in.read(7), 7);
+            else if (!in.bit()) dod = signExtend(in.read(12), 12);
+            else if (!in.bit()) dod = signExtend(in.read(20), 20);
+            else dod = static_cast<int64_t>(in.read(64));
+            delta += dod;
+            time += delta;
+            if (in.bit()) {
+                if (!in.bit()) {
+                    value ^= in.read(64 - leading - trailing) << trailing;
+                }
+                else {
+                    leading = static_cast<int>(in.read(6));
+                    int meaningful = static_cast<int>(in.read(6)) + 1;
+                    trailing = 64 - leading - meaningful;
+                    value ^= in.read(meaningful) << trailing;
+                }
+            }
+        }
+        sampleTime = time;
+        sampleValue = value;
+    }
+};
+#pragma endregion
+
+#pragma region "Segments"
+/**
+ * A memory mapped segment file of a tag.
+ */
+class HistorySegment {
+public:
+    ~HistorySegment() { unmap(); }
+    /**
+     * Creates a segment, or maps one that exists.
+     * @param create Whether to create the file, at the size given, rather than map it for reading.
+     */
+    bool open(const std::string& file, uint64_t size, bool create) {
+        path = file;
+#ifdef _WIN32
+        HANDLE handle = CreateFileA(file.c_str(), create ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ, nullptr,
+            create ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (handle == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER length;
+        if (!create) {
+            GetFileSizeEx(handle, &length);
+            size = static_cast<uint64_t>(length.QuadPart);
+        }
+        HANDLE mapping = size >= sizeof(HistorySegmentHeader) ? CreateFileMappingA(handle, nullptr, create ? PAGE_READWRITE : PAGE_READONLY,
+            static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), nullptr) : nullptr;
+        CloseHandle(handle);
+        if (mapping == nullptr) return false;
+        data = static_cast<uint8_t*>(MapViewOfFile(mapping, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, size));
+        CloseHandle(mapping);
+#else
+        int fd = ::open(file.c_str(), create ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+        if (fd < 0) return false;
+        struct stat info;
+        if (!create) {
+            size = fstat(fd, &info) == 0 ? static_cast<uint64_t>(info.st_size) : 0;
+        }
+        else if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            size = 0;
+        }
+        void* view = size >= sizeof(HistorySegmentHeader)
+            ? mmap(nullptr, size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        data = view == MAP_FAILED ? nullptr : static_cast<uint8_t*>(view);
+#endif
+        if (data == nullptr) return false;
+        bytes = size;
+        HistorySegmentHeader* head = header();
+        if (create) {
+            head->magic = HISTORY_SEGMENT_MAGIC;
+            head->version = HISTORY_SEGMENT_VERSION;
+            return true;
+        }
+        return head->magic == HISTORY_SEGMENT_MAGIC && head->version == HISTORY_SEGMENT_VERSION &&
+            head->bits <= (bytes - sizeof(HistorySegmentHeader)) * 8;
+    }
+    void unmap() {
+        if (data == nullptr) return;
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+#else
+        munmap(data, bytes);
+#endif
+        data = nullptr;
+    }
+    HistorySegmentHeader* header() const { return reinterpret_cast<HistorySegmentHeader*>(data); }
+    uint8_t* stream() const { return data + sizeof(HistorySegmentHeader); }
+    uint64_t capacityBits() const { return (bytes - sizeof(HistorySegmentHeader)) * 8; }
+
+    std::string path;
+    HistoryCodec codec;     // The state of the encoder, for the segment being written.
+private:
+    uint8_t* data = nullptr;
+    uint64_t bytes = 0;
+};
+
+/**
+ * A tag whose history is kept.
+ */
+struct HistoryTag {
+    std::string name;               // The name of the located global, or the address.
+    std::string address;
+    ResolvedAddress resolved;
+    int width;
+    std::string directory;
+    uint64_t next = 0;              // The number of the next segment file.
+    std::vector<std::unique_ptr<HistorySegment>> segments;  // Oldest first; the last is written to.
+    uint64_t last = 0;              // The value last appended by the scan thread.
+    bool recorded = false;          // Whether the scan thread has appended a value yet.
+};
+
+/**
+ * An entry of the ring between the scan thread and the historian thread.
+ */
+struct HistoryEntry {
+    uint64_t micros;
+    uint64_t value;
+    uint32_t tag;
+};
+#pragma endregion
+
+class Historian {
+public:
+    bool open(const RuntimeOptions& options);
+    void record(uint64_t micros) {
+        const uint8_t* image = reinterpret_cast<const uint8_t*>(MEMORY);
+        for (size_t t = 0; t < tags.size(); t++) {
+            HistoryTag& tag = tags[t];
+            uint64_t value = tag.resolved.load(image);
+            if (onChange && tag.recorded && value == tag.last) {
+                continue;
+            }
+            uint64_t slot = head.load(std::memory_order_relaxed);
+            if (slot - tail.load(std::memory_order_acquire) >= capacity) {
+                // The value is appended again with the next scan, since it still differs from the last.
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            ring[slot & (capacity - 1)] = HistoryEntry{ micros, value, static_cast<uint32_t>(t) };
+            head.store(slot + 1, std::memory_order_release);
+            tag.last = value;
+            tag.recorded = true;
+        }
+    }
+    bool read(const std::string& name, int64_t from, int64_t to, size_t max, std::vector<HistorySample>& samples, int& width);
+    void drain();
+
+    std::atomic<bool> running{false};
+
+private:
+    std::vector<HistoryTag> tags;
+    bool onChange = true;
+    uint64_t segmentBytes = 0;
+    uint64_t keep = 0;
+    /**
+     * The wall clock time the runtime started at, in microseconds since the Unix epoch, which scan times are added to.
+     */
+    int64_t epoch = 0;
+    std::vector<HistoryEntry> ring;
+    uint64_t capacity = 0;
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    alignas(64) std::atomic<uint64_t> dropped{0};
+    /**
+     * Guards the segments, which the historian thread appends to and readers read.
+     */
+    std::mutex segmentMutex;
+
+    bool startSegment(HistoryTag& tag);
+    void append(HistoryTag& tag, int64_t time, uint64_t value);
+};
+
+static Historian HISTORIAN;
+
+/**
+ * Makes a name usable as a file name.
+ */
+static std::string fileName(const std::string& name) {
+    std::string file = name;
+    for (char& c : file) {
+        if (c == '/' || c == '\\' || c == ':' || c == '*' || c == '?' || c == '"' || c == '<' || c == '>' || c == '|') {
+            c = '_';
+        }
+    }
+    return file;
+}
+
+bool Historian::open(const RuntimeOptions& options) {
+    size_t symbolCount = 0;
+    const ImageSymbol* symbols = registeredImageSymbols(symbolCount);
+    std::string list = options.history;
+    size_t from = 0;
+    while (from <= list.size()) {
+        size_t comma = list.find(',', from);
+        std::string name = list.substr(from, comma == std::string::npos ? std::string::npos : comma - from);
+        from = comma == std::string::npos ? list.size() + 1 : comma + 1;
+        name.erase(0, name.find_first_not_of(' '));
+        name.erase(name.find_last_not_of(' ') + 1);
+        if (name.empty()) {
+            continue;
+        }
+        // A tag is a located global by name, or an address, which takes the name of the global located at it.
+        std::string address = name;
+        if (const char* located = findSymbolAddress(name)) {
+            address = located;
+        }
+        else {
+            for (size_t s = 0; s < symbolCount; s++) {
+                if (name == symbols[s].address) {
+                    name = symbols[s].name;
+                }
+            }
+        }
+        HistoryTag tag;
+        AddressStatus status = tryResolveAddress(address, -1, address.find('.') != std::string::npos, tag.resolved);
+        if (status != AddressStatus::OK) {
+            nodalisLog() << "Can't keep the history of " << name << ": " << addressStatusText(status) << "\n";
+            continue;
+        }
+        tag.name = name;
+        tag.address = address;
+        tag.width = tag.resolved.bit > -1 ? 1 : tag.resolved.width;
+        tags.push_back(std::move(tag));
+    }
+    if (tags.empty()) {
+        return false;
+    }
+    onChange = options.historyMode != "scan";
+    segmentBytes = std::max<uint64_t>(options.historySegmentBytes, sizeof(HistorySegmentHeader) + 64);
+    keep = std::max<uint64_t>(options.historySegments, 1);
+    epoch = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count()
+        - std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - PROGRAM_START).count();
+
+    std::error_code error;
+    for (auto& tag : tags) {
+        tag.directory = (std::filesystem::path(options.historyDir) / fileName(tag.name)).string();
+        std::filesystem::create_directories(tag.directory, error);
+        // The segments of earlier runs are read as they are, and the numbers of their files continue.
+        std::vector<std::pair<uint64_t, std::string>> files;
+        for (const auto& entry : std::filesystem::directory_iterator(tag.directory, error)) {
+            if (entry.path().extension() == ".seg") {
+                files.push_back({ std::strtoull(entry.path().stem().string().c_str(), nullptr, 10), entry.path().string() });
+            }
+        }
+        std::sort(files.begin(), files.end());
+        for (const auto& file : files) {
+            auto segment = std::make_unique<HistorySegment>();
+            if (segment->open(file.second, 0, false) && segment->header()->width == tag.width) {
+                tag.segments.push_back(std::move(segment));
+            }
+            tag.next = file.first + 1;
+        }
+        if (!startSegment(tag)) {
+            nodalisLog() << "Can't write the history of " << tag.name << " to " << tag.directory << "\n";
+            return false;
+        }
+    }
+    capacity = 1;
+    while (capacity < options.historyBuffer) {
+        capacity <<= 1;
+    }
+    ring.resize(capacity);
+    nodalisLog() << "Keeping the history of " << tags.size() << " tags in " << options.historyDir << "\n";
+    running = true;
+    std::thread([this]() {
+        moveToBackground();
+        NODALIS_TRACE_THREAD("Historian");
+        while (running) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(HISTORIAN_DRAIN_WAIT));
+            drain();
+        }
+    }).detach();
+    return true;
+}
+
+bool Historian::startSegment(HistoryTag& tag) {
+    char file[32];
+    std::snprintf(file, sizeof(file), "%08llu.seg", static_cast<unsigned long long>(tag.next++));
+    auto segment = std::make_unique<HistorySegment>();
+    if (!segment->open((std::filesystem::path(tag.directory) / file).string(), segmentBytes, true)) {
+        return false;
+    }
+    segment->header()->width = static_cast<uint16_t>(tag.width);
+    tag.segments.push_back(std::move(segment));
+    while (tag.segments.size() > keep) {
+        std::string path = tag.segments.front()->path;
+        tag.segments.erase(tag.segments.begin());
+        std::remove(path.c_str());
+    }
+    return true;
+}
+
+void Historian::append(HistoryTag& tag, int64_t time, uint64_t value) {
+    HistorySegment* segment = tag.segments.back().get();
+    HistorySegmentHeader* header = segment->header();
+    if (header->bits + HISTORY_SAMPLE_BITS > segment->capacityBits()) {
+        if (!startSegment(tag)) {
+            return;
+        }
+        segment = tag.segments.back().get();
+        header = segment->header();
+    }
+    BitWriter out(segment->stream(), header->bits);
+    segment->codec.encode(out, time, value);
+    // The header is updated after the bits, so a segment that is cut short by a crash reads up to its last sample.
+    if (header->count == 0) {
+        header->first = time;
+    }
+    header->last = time;
+    header->bits = out.position();
+    header->count++;
+}
+
+void Historian::drain() {
+    std::lock_guard<std::mutex> lock(segmentMutex);
+    uint64_t from = tail.load(std::memory_order_relaxed);
+    uint64_t to = head.load(std::memory_order_acquire);
+    for (uint64_t slot = from; slot < to; slot++) {
+        const HistoryEntry& entry = ring[slot & (capacity - 1)];
+        append(tags[entry.tag], epoch + static_cast<int64_t>(entry.micros), entry.value);
+    }
+    tail.store(to, std::memory_order_release);
+}
+
+bool Historian::read(const std::string& name, int64_t from, int64_t to, size_t max, std::vector<HistorySample>& samples, int& width) {
+    auto tag = std::find_if(tags.begin(), tags.end(), [&](const HistoryTag& t) { return t.name == name || t.address == name; });
+    if (tag == tags.end()) {
+        return false;
+    }
+    width = tag->width;
+    std::lock_guard<std::mutex> lock(segmentMutex);
+    for (const auto& segment : tag->segments) {
+        const HistorySegmentHeader* header = segment->header();
+        if (header->count == 0 || header->last < from || header->first > to) {
+            continue;
+        }
+        BitReader in(segment->stream(), header->bits);
+        HistoryCodec codec;
+        for (uint64_t n = 0; n < header->count; n++) {
+            HistorySample sample;
+            codec.decode(in, sample.time, sample.value);
+            if (sample.time > to) {
+                break;
+            }
+            if (sample.time >= from) {
+                samples.push_back(sample);
+                if (max > 0 && samples.size() >= max) {
+                    return true;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool openHistorian(const RuntimeOptions& options) {
+    if (options.history.empty() || options.benchScans > 0) {
+        return false;
+    }
+    return HISTORIAN.open(options);
+}
+
+void recordHistory(uint64_t micros) {
+    if (HISTORIAN.running.load(std::memory_order_relaxed)) {
+        HISTORIAN.record(micros);
+    }
+}
+
+bool readHistory(const std::string& tag, int64_t from, int64_t to, size_t max, std::vector<HistorySample>& samples, int& width) {
+    return HISTORIAN.read(tag, from, to, max, samples, width);
+}
+
+void closeHistorian() {
+    if (HISTORIAN.running) {
+        HISTORIAN.drain();
+    }
+}
@@ -0,0 +1,103 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Historian
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * Keeps the history of a set of tags on the controller (--history). A tag is a located global, by name, or an
+ * address. After each scan, the scan thread appends the value of each tag that changed, or of every tag with
+ * --history-mode scan, to a ring that was allocated when the historian opened, without a lock, a system call or an
+ * allocation. The historian thread drains the ring into the tags' segments.
+ *
+ * Storage is by column: each tag has a directory of its own under --history-dir, of segment files that are
+ * --history-segment-bytes long and memory mapped. A segment is a HistorySegmentHeader followed by a bit stream of
+ * samples, which is only ever appended to. A sample's time is stored as the change in the difference from the
+ * sample before it (delta of delta), which is a single bit for samples taken at a steady rate, and its value as its
+ * XOR with the value before it, by the leading and trailing zero bits of the XOR (as in Facebook's Gorilla), which is
+ * a single bit for an unchanged value and a few for a float that changed a little. When a segment is full the next
+ * one is started, and only the newest --history-segments of a tag are kept. The segments of earlier runs are kept and
+ * read like those of this one.
+ *
+ * Times are in microseconds since the Unix epoch. The history is read with readHistory(), and served to OPC UA
+ * clients through HistoryRead (raw) on the variables of the tags.
+ */
+#pragma once
+#ifndef HISTORIAN_H
+#define HISTORIAN_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct RuntimeOptions;
+
+/**
+ * The header of a segment file.
+ */
+struct HistorySegmentHeader {
+    uint32_t magic;         // HISTORY_SEGMENT_MAGIC.
+    uint16_t version;       // HISTORY_SEGMENT_VERSION.
+    uint16_t width;         // The width of the tag, in bits, with 1 for a bit.
+    uint64_t count;         // The number of samples in the segment.
+    uint64_t bits;          // The length of the bit stream.
+    int64_t first;          // The time of the first sample.
+    int64_t last;           // The time of the last sample.
+    uint64_t reserved[3];
+};
+
+constexpr uint32_t HISTORY_SEGMENT_MAGIC = 0x5348444e;     // "NDHS"
+constexpr uint16_t HISTORY_SEGMENT_VERSION = 1;
+
+/**
+ * A value of a tag at a time.
+ */
+struct HistorySample {
+    int64_t time;           // Microseconds since the Unix epoch.
+    uint64_t value;         // The bits of the value, zero extended.
+};
+
+/**
+ * Resolves the tags of options.history, loads their segments and starts the historian thread. Called by the
+ * TaskScheduler constructor, once the symbols are registered.
+ * @param options The runtime options.
+ * @returns Returns false, having written why, if there is no history to keep or it can't be kept.
+ */
+bool openHistorian(const RuntimeOptions& options);
+/**
+ * Appends the tags of the scan that was just committed to the historian's ring. Called by the scan thread after each
+ * scan, and does nothing if there is no historian.
+ * @param micros The time of the scan, in microseconds since the runtime started.
+ */
+void recordHistory(uint64_t micros);
+/**
+ * Reads the history of a tag. This is safe to call from any thread, and waits for the historian thread to finish
+ * writing the samples it is on.
+ * @param tag The name or the address of the tag.
+ * @param from The time of the first sample to read.
+ * @param to The time after which no sample is read.
+ * @param max The most samples to read, or 0 for no limit.
+ * @param samples Receives the samples, oldest first.
+ * @param width Receives the width of the tag.
+ * @returns Returns false if the tag isn't kept.
+ */
+bool readHistory(const std::string& tag, int64_t from, int64_t to, size_t max, std::vector<HistorySample>& samples, int& width);
+/**
+ * Writes the samples that are still in the ring to the segments. Called when the runtime stops.
+ */
+void closeHistorian();
+
+#endif // HISTORIAN_H
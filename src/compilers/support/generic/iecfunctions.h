@@ -0,0 +1,389 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Standard Functions
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ *
+ * The numeric, bit shift and type conversion functions of IEC 61131-3, as templates on the type of their argument, so
+ * the calls the compiler emits inline into the scan and are folded when their arguments are constants. A conversion
+ * to an integer saturates to the range of the target rather than wrapping, and one from a REAL rounds to the nearest
+ * integer, halves away from zero, with NaN converted to 0. A REAL_TO_INT of 1e9 is 32767, not a wrapped value.
+ *
+ * The compiler maps the ST names of the conversions onto these: INT_TO_REAL(x) and TO_REAL(x) are both TO_REAL(x),
+ * since the source type is the type of the argument, and the conversions between the time types that change their
+ * unit, like TIME_TO_LTIME or DT_TO_TOD, are functions of their own. The _ARRAY functions apply a function to every
+ * element of an array into another, in a loop the compiler vectorizes, with SQRT_ARRAY of REALs written with SSE or
+ * NEON, for the batches of analog values of a scan.
+ *
+ * This header is shared by the generic and the bare-metal runtimes, which include it after their IECArray, so it only
+ * depends on the C++ standard library and on the NODALIS_IVDEP macro of the runtime.
+ */
+#pragma once
+#ifndef IECFUNCTIONS_H
+#define IECFUNCTIONS_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define IEC_SIMD_SSE 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define IEC_SIMD_NEON 1
+#endif
+
+#ifndef NODALIS_IVDEP
+#define NODALIS_IVDEP
+#endif
+
+#pragma region "Numeric Functions"
+/**
+ * The type a math function of a T returns and the type it computes in: REAL for REAL, LREAL for LREAL and the
+ * integers, and, for a fixed point REAL, the fixed point type computed in float.
+ */
+template<typename T, typename = void>
+struct IecMath {
+    using Result = double;
+    using Compute = double;
+};
+template<>
+struct IecMath<float> {
+    using Result = float;
+    using Compute = float;
+};
+template<typename T>
+struct IecMath<T, std::enable_if_t<!std::is_arithmetic<T>::value>> {
+    using Result = T;
+    using Compute = float;
+};
+
+#define IEC_MATH_FUNCTION(NAME, EXPRESSION) \
+template<typename T> \
+inline typename IecMath<T>::Result NAME(T in) { \
+    using Compute = typename IecMath<T>::Compute; \
+    Compute x = static_cast<Compute>(in); \
+    return static_cast<typename IecMath<T>::Result>(EXPRESSION); \
+}
+IEC_MATH_FUNCTION(SQRT, std::sqrt(x))
+IEC_MATH_FUNCTION(LN, std::log(x))
+IEC_MATH_FUNCTION(LOG, std::log10(x))
+IEC_MATH_FUNCTION(EXP, std::exp(x))
+IEC_MATH_FUNCTION(SIN, std::sin(x))
+IEC_MATH_FUNCTION(COS, std::cos(x))
+IEC_MATH_FUNCTION(TAN, std::tan(x))
+IEC_MATH_FUNCTION(ASIN, std::asin(x))
+IEC_MATH_FUNCTION(ACOS, std::acos(x))
+IEC_MATH_FUNCTION(ATAN, std::atan(x))
+#undef IEC_MATH_FUNCTION
+
+/**
+ * IN1 raised to the power IN2, in the type of IN1.
+ */
+template<typename T, typename E>
+inline typename IecMath<T>::Result EXPT(T in1, E in2) {
+    using Compute = typename IecMath<T>::Compute;
+    return static_cast<typename IecMath<T>::Result>(std::pow(static_cast<Compute>(in1), static_cast<Compute>(in2)));
+}
+
+/**
+ * The absolute value, in the type of IN. The lowest value of a signed integer saturates to its highest.
+ */
+template<typename T>
+constexpr T ABS(T in) {
+    if constexpr (std::is_integral<T>::value && std::is_signed<T>::value) {
+        return in >= 0 ? in : (in == std::numeric_limits<T>::lowest() ? std::numeric_limits<T>::max() : static_cast<T>(-in));
+    }
+    else if constexpr (std::is_unsigned<T>::value) {
+        return in;
+    }
+    else {
+        return in < T(0) ? -in : in;
+    }
+}
+#pragma endregion
+
+#pragma region "Type Conversions"
+/**
+ * Converts a value to the type To as the *_TO_* functions do: to BOOL, whether it isn't 0; from a REAL to an integer,
+ * rounded to the nearest, halves away from zero, with NaN as 0; and to an integer, saturated to its range.
+ * @tparam To The type to convert to.
+ * @param value The value.
+ * @returns Returns the converted value.
+ */
+template<typename To, typename From>
+constexpr To iecConvert(From value) {
+    if constexpr (!std::is_arithmetic<From>::value) {
+        // A fixed point REAL converts as the float it stands for.
+        return iecConvert<To>(static_cast<float>(value));
+    }
+    else if constexpr (std::is_same<To, bool>::value) {
+        return value != From(0);
+    }
+    else if constexpr (std::is_same<From, bool>::value || !std::is_arithmetic<To>::value) {
+        return static_cast<To>(value);
+    }
+    else if constexpr (std::is_integral<To>::value && std::is_floating_point<From>::value) {
+        if (!(value == value)) return To(0);
+        if (value <= static_cast<From>(std::numeric_limits<To>::lowest())) return std::numeric_limits<To>::lowest();
+        if (value >= static_cast<From>(std::numeric_limits<To>::max())) return std::numeric_limits<To>::max();
+        // Rounded in double, since a float just under a half, like 0.49999997, rounds up when 0.5 is added in float.
+        double wide = static_cast<double>(value);
+        return static_cast<To>(wide < 0 ? wide - 0.5 : wide + 0.5);
+    }
+    else if constexpr (std::is_integral<To>::value) {
+        if constexpr (std::is_signed<From>::value) {
+            if (value < 0) {
+                if constexpr (std::is_unsigned<To>::value) return To(0);
+                else if (static_cast<int64_t>(value) < static_cast<int64_t>(std::numeric_limits<To>::lowest())) {
+                    return std::numeric_limits<To>::lowest();
+                }
+                return static_cast<To>(value);
+            }
+        }
+        return static_cast<uint64_t>(value) > static_cast<uint64_t>(std::numeric_limits<To>::max()) ?
+            std::numeric_limits<To>::max() : static_cast<To>(value);
+    }
+    else {
+        return static_cast<To>(value);
+    }
+}
+
+/**
+ * Truncates a REAL toward zero to the integer type To, saturated to its range.
+ */
+template<typename To, typename From>
+constexpr To iecTruncate(From value) {
+    if constexpr (std::is_floating_point<From>::value) {
+        if (!(value == value)) return To(0);
+        if (value <= static_cast<From>(std::numeric_limits<To>::lowest())) return std::numeric_limits<To>::lowest();
+        if (value >= static_cast<From>(std::numeric_limits<To>::max())) return std::numeric_limits<To>::max();
+        return static_cast<To>(value);
+    }
+    else if constexpr (!std::is_arithmetic<From>::value) {
+        return iecTruncate<To>(static_cast<float>(value));
+    }
+    else {
+        return iecConvert<To>(value);
+    }
+}
+
+// TO_INT(x) converts x, of any elementary type, to INT, and so on for each type. REAL is float here, and a program
+// built with fixedReal converts the result to its FixedReal where it is stored.
+#define IEC_CONVERSION(NAME, TYPE) \
+template<typename T> \
+constexpr TYPE TO_##NAME(T value) { return iecConvert<TYPE>(value); }
+IEC_CONVERSION(BOOL, bool)
+IEC_CONVERSION(BYTE, uint8_t)
+IEC_CONVERSION(WORD, uint16_t)
+IEC_CONVERSION(DWORD, uint32_t)
+IEC_CONVERSION(LWORD, uint64_t)
+IEC_CONVERSION(SINT, int8_t)
+IEC_CONVERSION(INT, int16_t)
+IEC_CONVERSION(DINT, int32_t)
+IEC_CONVERSION(LINT, int64_t)
+IEC_CONVERSION(USINT, uint8_t)
+IEC_CONVERSION(UINT, uint16_t)
+IEC_CONVERSION(UDINT, uint32_t)
+IEC_CONVERSION(ULINT, uint64_t)
+IEC_CONVERSION(REAL, float)
+IEC_CONVERSION(LREAL, double)
+IEC_CONVERSION(TIME, uint32_t)
+IEC_CONVERSION(LTIME, IEC_LTIME)
+IEC_CONVERSION(DATE, IEC_DATE)
+IEC_CONVERSION(LDATE, IEC_LDATE)
+IEC_CONVERSION(TOD, IEC_TIME_OF_DAY)
+IEC_CONVERSION(LTOD, IEC_LTIME_OF_DAY)
+IEC_CONVERSION(DT, IEC_DATE_AND_TIME)
+IEC_CONVERSION(LDT, IEC_LDATE_AND_TIME)
+#undef IEC_CONVERSION
+
+#define IEC_TRUNCATION(NAME, TYPE) \
+template<typename T> \
+constexpr TYPE TRUNC_##NAME(T value) { return iecTruncate<TYPE>(value); }
+IEC_TRUNCATION(SINT, int8_t)
+IEC_TRUNCATION(INT, int16_t)
+IEC_TRUNCATION(DINT, int32_t)
+IEC_TRUNCATION(LINT, int64_t)
+IEC_TRUNCATION(USINT, uint8_t)
+IEC_TRUNCATION(UINT, uint16_t)
+IEC_TRUNCATION(UDINT, uint32_t)
+IEC_TRUNCATION(ULINT, uint64_t)
+#undef IEC_TRUNCATION
+
+/**
+ * Truncates a REAL toward zero to a DINT.
+ */
+template<typename T>
+constexpr int32_t TRUNC(T value) { return iecTruncate<int32_t>(value); }
+
+// The conversions between the time types that change their unit: TIME, TOD and the time of a DT are milliseconds or
+// seconds, and their L forms nanoseconds. A DT converts to the DATE of its day and the TOD of its time.
+constexpr IEC_LTIME TIME_TO_LTIME(uint32_t value) { return static_cast<IEC_LTIME>(value) * 1000000; }
+constexpr uint32_t LTIME_TO_TIME(IEC_LTIME value) { return iecConvert<uint32_t>(value / 1000000); }
+constexpr IEC_LDATE DATE_TO_LDATE(IEC_DATE value) { return static_cast<IEC_LDATE>(value) * 1000000000; }
+constexpr IEC_DATE LDATE_TO_DATE(IEC_LDATE value) { return iecConvert<IEC_DATE>(value / 1000000000); }
+constexpr IEC_LTIME_OF_DAY TOD_TO_LTOD(IEC_TIME_OF_DAY value) { return static_cast<IEC_LTIME_OF_DAY>(value) * 1000000; }
+constexpr IEC_TIME_OF_DAY LTOD_TO_TOD(IEC_LTIME_OF_DAY value) { return iecConvert<IEC_TIME_OF_DAY>(value / 1000000); }
+constexpr IEC_LDATE_AND_TIME DT_TO_LDT(IEC_DATE_AND_TIME value) { return static_cast<IEC_LDATE_AND_TIME>(value) * 1000000000; }
+constexpr IEC_DATE_AND_TIME LDT_TO_DT(IEC_LDATE_AND_TIME value) { return iecConvert<IEC_DATE_AND_TIME>(value / 1000000000); }
+constexpr IEC_DATE DT_TO_DATE(IEC_DATE_AND_TIME value) { return value - value % 86400; }
+constexpr IEC_TIME_OF_DAY DT_TO_TOD(IEC_DATE_AND_TIME value) { return (value % 86400) * 1000; }
+constexpr IEC_LDATE LDT_TO_LDATE(IEC_LDATE_AND_TIME value) {
+    return value - ((value % 86400000000000) + 86400000000000) % 86400000000000;
+}
+constexpr IEC_LTIME_OF_DAY LDT_TO_LTOD(IEC_LDATE_AND_TIME value) {
+    return ((value % 86400000000000) + 86400000000000) % 86400000000000;
+}
+#pragma endregion
+
+#pragma region "Bit Shifts"
+// The shifts and rotations of ANY_BIT. N counts bits, and a shift by the width of IN or more gives 0. A rotation
+// is within the width of the type of IN, so ROL of a WORD rotates 16 bits.
+
+template<typename T>
+constexpr T SHL(T in, int64_t n) {
+    using Bits = std::make_unsigned_t<T>;
+    return n <= 0 ? in : n >= static_cast<int64_t>(sizeof(T) * 8) ? T(0) : static_cast<T>(static_cast<Bits>(static_cast<Bits>(in) << n));
+}
+
+template<typename T>
+constexpr T SHR(T in, int64_t n) {
+    using Bits = std::make_unsigned_t<T>;
+    return n <= 0 ? in : n >= static_cast<int64_t>(sizeof(T) * 8) ? T(0) : static_cast<T>(static_cast<Bits>(in) >> n);
+}
+
+template<typename T>
+constexpr T ROL(T in, int64_t n) {
+    using Bits = std::make_unsigned_t<T>;
+    constexpr int64_t width = sizeof(T) * 8;
+    int64_t by = ((n % width) + width) % width;
+    Bits bits = static_cast<Bits>(in);
+    return by == 0 ? in : static_cast<T>(static_cast<Bits>((bits << by) | (bits >> (width - by))));
+}
+
+template<typename T>
+constexpr T ROR(T in, int64_t n) {
+    constexpr int64_t width = sizeof(T) * 8;
+    return ROL(in, width - ((n % width) + width) % width);
+}
+#pragma endregion
+
+#pragma region "Array Functions"
+// The array forms of the functions, SQRT_ARRAY(Raw, Scaled) and so on, apply the function to each element of IN and
+// store it to the element of OUT at the same position, for the elements both arrays have. IN and OUT may be the same
+// array. The loops have no dependencies between their iterations, so the compiler vectorizes them where it can.
+
+#define IEC_ARRAY_FUNCTION(NAME) \
+template<typename In, typename Out> \
+inline void NAME##_ARRAY(const In& in, Out& out) { \
+    using Element = std::remove_reference_t<decltype(*out.begin())>; \
+    const auto* source = in.begin(); \
+    Element* target = out.begin(); \
+    size_t n = in.size() < out.size() ? in.size() : out.size(); \
+    NODALIS_IVDEP \
+    for (size_t i = 0; i < n; i++) target[i] = static_cast<Element>(NAME(source[i])); \
+}
+IEC_ARRAY_FUNCTION(ABS)
+IEC_ARRAY_FUNCTION(LN)
+IEC_ARRAY_FUNCTION(LOG)
+IEC_ARRAY_FUNCTION(EXP)
+IEC_ARRAY_FUNCTION(SIN)
+IEC_ARRAY_FUNCTION(COS)
+IEC_ARRAY_FUNCTION(TAN)
+IEC_ARRAY_FUNCTION(TRUNC)
+#undef IEC_ARRAY_FUNCTION
+
+/**
+ * Stores the square root of each element of IN to OUT. Between arrays of REALs it takes four elements at a time with
+ * SSE or NEON, since std::sqrt keeps the compiler from vectorizing a loop where it sets errno.
+ */
+template<typename In, typename Out>
+inline void SQRT_ARRAY(const In& in, Out& out) {
+    using Element = std::remove_reference_t<decltype(*out.begin())>;
+    const auto* source = in.begin();
+    Element* target = out.begin();
+    size_t n = in.size() < out.size() ? in.size() : out.size();
+    size_t i = 0;
+#if defined(IEC_SIMD_SSE) || defined(IEC_SIMD_NEON)
+    if constexpr (std::is_same<std::remove_cv_t<std::remove_reference_t<decltype(*in.begin())>>, float>::value &&
+        std::is_same<Element, float>::value) {
+        for (; i + 4 <= n; i += 4) {
+#if defined(IEC_SIMD_SSE)
+            _mm_storeu_ps(target + i, _mm_sqrt_ps(_mm_loadu_ps(source + i)));
+#else
+            vst1q_f32(target + i, vsqrtq_f32(vld1q_f32(source + i)));
+#endif
+        }
+    }
+#endif
+    for (; i < n; i++) target[i] = static_cast<Element>(SQRT(source[i]));
+}
+
+/**
+ * Converts each element of IN to the type of the elements of OUT, as the *_TO_* functions do, so RawCounts of INTs
+ * convert to an array of REALs with CONVERT_ARRAY(RawCounts, Volts).
+ */
+template<typename In, typename Out>
+inline void CONVERT_ARRAY(const In& in, Out& out) {
+    using Element = std::remove_reference_t<decltype(*out.begin())>;
+    const auto* source = in.begin();
+    Element* target = out.begin();
+    size_t n = in.size() < out.size() ? in.size() : out.size();
+    NODALIS_IVDEP
+    for (size_t i = 0; i < n; i++) target[i] = iecConvert<Element>(source[i]);
+}
+
+/**
+ * Stores IN * GAIN + OFFSET of each element of IN to OUT, in the type of OUT, which scales raw analog counts to
+ * engineering units.
+ */
+template<typename In, typename Out, typename G, typename O>
+inline void SCALE_ARRAY(const In& in, Out& out, G gain, O offset) {
+    using Element = std::remove_reference_t<decltype(*out.begin())>;
+    const auto* source = in.begin();
+    Element* target = out.begin();
+    size_t n = in.size() < out.size() ? in.size() : out.size();
+    Element k = static_cast<Element>(gain);
+    Element d = static_cast<Element>(offset);
+    NODALIS_IVDEP
+    for (size_t i = 0; i < n; i++) target[i] = static_cast<Element>(source[i]) * k + d;
+}
+
+/**
+ * Stores each element of IN, limited to MN and MX, to OUT.
+ */
+template<typename In, typename Out, typename L, typename H>
+inline void LIMIT_ARRAY(L mn, const In& in, H mx, Out& out) {
+    using Element = std::remove_reference_t<decltype(*out.begin())>;
+    const auto* source = in.begin();
+    Element* target = out.begin();
+    size_t n = in.size() < out.size() ? in.size() : out.size();
+    Element low = static_cast<Element>(mn);
+    Element high = static_cast<Element>(mx);
+    NODALIS_IVDEP
+    for (size_t i = 0; i < n; i++) {
+        Element value = static_cast<Element>(source[i]);
+        target[i] = value < low ? low : (value > high ? high : value);
+    }
+}
+#pragma endregion
+
+#endif // IECFUNCTIONS_H
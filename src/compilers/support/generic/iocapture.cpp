@@ -0,0 +1,378 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC IO Capture and Replay
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+#include "iocapture.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+
+/**
+ * How long the capture thread waits between writes of the records captured since the last, in milliseconds.
+ */
+static constexpr int CAPTURE_WRITE_WAIT = 100;
+
+std::atomic<bool> IO_CAPTURING{false};
+
+/**
+ * Gets an address in upper case, so that a replay matches the mappings of a capture however their addresses were
+ * written.
+ * @param address The address.
+ */
+static std::string addressKey(std::string address) {
+    std::transform(address.begin(), address.end(), address.begin(), [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+    return address;
+}
+
+class IOCapture {
+public:
+    bool start(const RuntimeOptions& options);
+    void stop();
+    /**
+     * Adds a record, stamped with the current time. This may be called from any thread.
+     */
+    void add(uint16_t client, uint32_t mapping, IOCaptureKind kind, uint8_t status, uint64_t value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back({ microsBetween(origin, std::chrono::steady_clock::now()), value, mapping, client, kind, status });
+    }
+
+    /**
+     * The index of each captured client, and the client and mapping of each captured input, by its quality slot.
+     * They are filled when the capture starts and only read afterwards.
+     */
+    std::unordered_map<const IOClient*, uint16_t> clients;
+    std::unordered_map<uint32_t, std::pair<uint16_t, uint32_t>> inputs;
+
+private:
+    void run();
+    void write();
+
+    std::mutex mutex;
+    std::condition_variable signal;
+    bool stopping = false;
+    /**
+     * The records captured since the last write, and those being written, which swap so that a write doesn't hold
+     * up the clients.
+     */
+    std::vector<IOCaptureRecord> pending;
+    std::vector<IOCaptureRecord> writing;
+    std::chrono::steady_clock::time_point origin;
+    std::mutex writeMutex;
+    std::thread writer;
+    std::string path;
+    FILE* file = nullptr;
+    uint64_t written = 0;
+};
+
+static IOCapture CAPTURE;
+
+bool IOCapture::start(const RuntimeOptions& options) {
+    if (Clients.size() > 0xffff) {
+        nodalisLog() << "Can't capture the IO of more than 65535 clients\n";
+        return false;
+    }
+    path = options.ioCapture;
+    file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        nodalisLog() << "Can't capture the IO to " << path << "\n";
+        return false;
+    }
+    IOCaptureHeader header{ IO_CAPTURE_MAGIC, IO_CAPTURE_VERSION, static_cast<uint16_t>(Clients.size()),
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count() };
+    std::vector<uint8_t> table(reinterpret_cast<const uint8_t*>(&header), reinterpret_cast<const uint8_t*>(&header) + sizeof(header));
+    auto text = [&](const std::string& value, size_t lengthBytes) {
+        size_t length = std::min(value.size(), lengthBytes == 1 ? size_t(0xff) : size_t(0xffff));
+        table.push_back(static_cast<uint8_t>(length));
+        if (lengthBytes == 2) {
+            table.push_back(static_cast<uint8_t>(length >> 8));
+        }
+        table.insert(table.end(), value.begin(), value.begin() + length);
+    };
+    for (size_t c = 0; c < Clients.size(); c++) {
+        const IOClient& client = *Clients[c];
+        clients.emplace(&client, static_cast<uint16_t>(c));
+        const std::vector<IOMap>& mappings = client.getMappings();
+        text(client.getProtocol(), 1);
+        text(client.getEndpoint(), 2);
+        uint32_t count = static_cast<uint32_t>(mappings.size());
+        table.insert(table.end(), reinterpret_cast<const uint8_t*>(&count), reinterpret_cast<const uint8_t*>(&count) + sizeof(count));
+        for (uint32_t m = 0; m < count; m++) {
+            const IOMap& map = mappings[m];
+            table.push_back(static_cast<uint8_t>(map.direction));
+            text(map.localAddress, 1);
+            text(map.remoteAddress, 2);
+            if (map.direction == IOType::Input && map.quality != NO_QUALITY_SLOT) {
+                inputs.emplace(map.quality, std::make_pair(static_cast<uint16_t>(c), m));
+            }
+        }
+    }
+    if (std::fwrite(table.data(), 1, table.size(), file) != table.size()) {
+        nodalisLog() << "Can't capture the IO to " << path << "\n";
+        std::fclose(file);
+        file = nullptr;
+        return false;
+    }
+    origin = std::chrono::steady_clock::now();
+    writer = std::thread(&IOCapture::run, this);
+    IO_CAPTURING.store(true, std::memory_order_release);
+    nodalisLog() << "Capturing the IO of " << Clients.size() << " clients to " << path << "\n";
+    return true;
+}
+
+void IOCapture::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        signal.wait_for(lock, std::chrono::milliseconds(CAPTURE_WRITE_WAIT), [this] { return stopping; });
+        lock.unlock();
+        write();
+        lock.lock();
+    }
+}
+
+void IOCapture::write() {
+    std::lock_guard<std::mutex> writeLock(writeMutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        writing.swap(pending);
+    }
+    if (!writing.empty() && file != nullptr) {
+        written += std::fwrite(writing.data(), sizeof(IOCaptureRecord), writing.size(), file);
+        std::fflush(file);
+    }
+    writing.clear();
+}
+
+void IOCapture::stop() {
+    if (!IO_CAPTURING.exchange(false)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    signal.notify_all();
+    if (writer.joinable()) {
+        writer.join();
+    }
+    write();
+    std::fclose(file);
+    file = nullptr;
+    nodalisLog() << "Captured " << written << " IO records to " << path << "\n";
+}
+
+bool startIOCapture(const RuntimeOptions& options) {
+    if (options.ioCapture.empty() || IO_CAPTURING.load()) {
+        return false;
+    }
+    return CAPTURE.start(options);
+}
+
+void stopIOCapture() {
+    CAPTURE.stop();
+}
+
+void captureRequest(const IOClient* client, bool succeeded, uint64_t micros) {
+    auto found = CAPTURE.clients.find(client);
+    if (found != CAPTURE.clients.end()) {
+        CAPTURE.add(found->second, UINT32_MAX, IOCaptureKind::Request, succeeded ? 1 : 0, micros);
+    }
+}
+
+void captureInput(const ResolvedAddress& address, uint64_t value) {
+    auto found = CAPTURE.inputs.find(findQualitySlot(address));
+    if (found != CAPTURE.inputs.end()) {
+        CAPTURE.add(found->second.first, found->second.second, IOCaptureKind::Input, static_cast<uint8_t>(IOQuality::Good), value);
+    }
+}
+
+void captureQuality(uint32_t slot, IOQuality quality) {
+    auto found = CAPTURE.inputs.find(slot);
+    if (found != CAPTURE.inputs.end()) {
+        CAPTURE.add(found->second.first, found->second.second, IOCaptureKind::Quality, static_cast<uint8_t>(quality), 0);
+    }
+}
+
+/**
+ * A client of the capture a replay serves.
+ */
+struct ReplayedClient {
+    std::string endpoint;
+    /**
+     * The local address of each mapping, by its index in the capture, from addressKey().
+     */
+    std::vector<std::string> locals;
+    std::vector<IOCaptureRecord> records;
+};
+
+static bool REPLAYING = false;
+static std::vector<ReplayedClient> REPLAYED_CLIENTS;
+/**
+ * The time the records of a replay are served from, which is when its first client connected.
+ */
+static std::once_flag REPLAY_STARTED;
+static std::chrono::steady_clock::time_point REPLAY_ORIGIN;
+
+bool openIOReplay(const std::string& path) {
+    REPLAYING = true;
+    std::ifstream in(path, std::ios::binary);
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    size_t at = 0;
+    bool valid = true;
+    auto take = [&](void* into, size_t count) {
+        if (!valid || bytes.size() - at < count) {
+            valid = false;
+            return;
+        }
+        std::memcpy(into, bytes.data() + at, count);
+        at += count;
+    };
+    auto text = [&](size_t lengthBytes) {
+        uint16_t length = 0;
+        uint8_t low = 0;
+        take(&low, 1);
+        length = low;
+        if (lengthBytes == 2) {
+            uint8_t high = 0;
+            take(&high, 1);
+            length |= static_cast<uint16_t>(high << 8);
+        }
+        if (!valid || bytes.size() - at < length) {
+            valid = false;
+            return std::string();
+        }
+        std::string value(reinterpret_cast<const char*>(bytes.data() + at), length);
+        at += length;
+        return value;
+    };
+    IOCaptureHeader header{};
+    take(&header, sizeof(header));
+    if (!valid || header.magic != IO_CAPTURE_MAGIC || header.version != IO_CAPTURE_VERSION) {
+        nodalisLog() << "Can't replay the IO of " << path << ": it isn't an IO capture this runtime can read\n";
+        return false;
+    }
+    REPLAYED_CLIENTS.resize(header.clients);
+    for (ReplayedClient& client : REPLAYED_CLIENTS) {
+        text(1);
+        client.endpoint = text(2);
+        uint32_t count = 0;
+        take(&count, sizeof(count));
+        for (uint32_t m = 0; valid && m < count; m++) {
+            uint8_t direction = 0;
+            take(&direction, 1);
+            client.locals.push_back(addressKey(text(1)));
+            text(2);
+        }
+    }
+    if (!valid) {
+        nodalisLog() << "Can't replay the IO of " << path << ": its clients are cut short\n";
+        REPLAYED_CLIENTS.clear();
+        return false;
+    }
+    size_t records = 0;
+    for (; bytes.size() - at >= sizeof(IOCaptureRecord); at += sizeof(IOCaptureRecord)) {
+        IOCaptureRecord record;
+        std::memcpy(&record, bytes.data() + at, sizeof(record));
+        if (record.client < REPLAYED_CLIENTS.size()) {
+            REPLAYED_CLIENTS[record.client].records.push_back(record);
+            records++;
+        }
+    }
+    nodalisLog() << "Replaying " << records << " IO records of " << REPLAYED_CLIENTS.size() << " clients from " << path << "\n";
+    return true;
+}
+
+bool ioReplayActive() {
+    return REPLAYING;
+}
+
+IOReplayClient::IOReplayClient(const std::string& protocol) : IOClient(protocol) {}
+
+IOReplayClient::~IOReplayClient() {
+    {
+        std::lock_guard<std::mutex> lock(replayMutex);
+        stopping = true;
+    }
+    replaySignal.notify_all();
+    if (replay.joinable()) {
+        replay.join();
+    }
+    stop();
+}
+
+void IOReplayClient::connect() {
+    std::call_once(REPLAY_STARTED, [] { REPLAY_ORIGIN = std::chrono::steady_clock::now(); });
+    connected = true;
+    if (records != nullptr) {
+        return;
+    }
+    auto found = std::find_if(REPLAYED_CLIENTS.begin(), REPLAYED_CLIENTS.end(),
+        [this](const ReplayedClient& client) { return client.endpoint == getEndpoint(); });
+    if (found == REPLAYED_CLIENTS.end()) {
+        nodalisLog() << "IO replay: " << getEndpoint() << " wasn't captured, so its inputs aren't read\n";
+        static const std::vector<IOCaptureRecord> none;
+        records = &none;
+        return;
+    }
+    targets.assign(found->locals.size(), { ResolvedAddress(), NO_QUALITY_SLOT });
+    matched.assign(found->locals.size(), false);
+    for (size_t m = 0; m < found->locals.size(); m++) {
+        for (const IOMap& map : mappings) {
+            if (map.direction == IOType::Input && addressKey(map.localAddress) == found->locals[m]) {
+                targets[m] = { map.local, map.quality };
+                matched[m] = true;
+                break;
+            }
+        }
+    }
+    records = &found->records;
+    replay = std::thread(&IOReplayClient::serve, this);
+}
+
+void IOReplayClient::serve() {
+    for (const IOCaptureRecord& record : *records) {
+        {
+            std::unique_lock<std::mutex> lock(replayMutex);
+            if (replaySignal.wait_until(lock, REPLAY_ORIGIN + std::chrono::microseconds(record.time), [this] { return stopping; })) {
+                return;
+            }
+        }
+        bool mapped = record.mapping < targets.size() && matched[record.mapping];
+        switch (record.kind) {
+            case IOCaptureKind::Request:
+                requestCompleted(record.status != 0, record.value);
+                break;
+            case IOCaptureKind::Input:
+                if (mapped) {
+                    writeImage(targets[record.mapping].first, record.value);
+                    setInputQuality(targets[record.mapping].second, IOQuality::Good);
+                }
+                break;
+            case IOCaptureKind::Quality:
+                if (mapped) {
+                    setInputQuality(targets[record.mapping].second, static_cast<IOQuality>(record.status));
+                }
+                break;
+        }
+    }
+    nodalisLog() << "IO replay of " << getEndpoint() << " ended after " << records->size() << " records\n";
+}
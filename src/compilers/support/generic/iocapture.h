@@ -0,0 +1,174 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC IO Capture and Replay
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * Captures the IO traffic of a runtime in the field (--io-capture <file>), so that it can be replayed in the lab
+ * against another build of the runtime (--io-replay <file>) with the same timing. The capture is taken where every
+ * client meets the runtime, whatever its protocol: each request a client completes, with its result and round trip
+ * time, each input value it stages into the image, and each input it marks stale or failed. A replay creates an
+ * IOReplayClient in place of the client of each endpoint, which serves what the client of that endpoint captured at
+ * the time it was captured, counting the requests with their captured round trip times, so the diagnostics,
+ * adaptive polling and programs of the runtime see the traffic of the field without a device on the network.
+ *
+ * The capture is an IOCaptureHeader, then each client, as its protocol (the length as uint8_t and the text), its
+ * endpoint key (uint16_t and the text) and the number of its mappings (uint32_t), and each mapping as its direction
+ * (uint8_t), local address (uint8_t and the text) and remote address (uint16_t and the text). The records follow,
+ * in the order they were captured. A replay matches clients by their endpoint and mappings by their local address,
+ * so the program it runs may map the same IO in another order. Numbers are in the byte order of the controller.
+ */
+#pragma once
+#ifndef IOCAPTURE_H
+#define IOCAPTURE_H
+
+#include "nodalis.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * The header of an IO capture.
+ */
+struct IOCaptureHeader {
+    uint32_t magic;         // IO_CAPTURE_MAGIC.
+    uint16_t version;       // IO_CAPTURE_VERSION.
+    uint16_t clients;       // The number of clients.
+    int64_t started;        // The time the capture started, in microseconds since the Unix epoch.
+};
+
+constexpr uint32_t IO_CAPTURE_MAGIC = 0x4349444e;    // "NDIC"
+constexpr uint16_t IO_CAPTURE_VERSION = 1;
+
+/**
+ * The kinds of record of an IO capture.
+ */
+enum class IOCaptureKind : uint8_t {
+    Request = 0,    // A request completed. The value is its round trip time, and the status 1 if it succeeded.
+    Input = 1,      // An input was read. The value is what was staged into the image.
+    Quality = 2     // An input was marked with a quality other than Good, which is the status.
+};
+
+/**
+ * A record of an IO capture.
+ */
+struct IOCaptureRecord {
+    uint64_t time;          // The time of the record, in microseconds since the capture started.
+    uint64_t value;
+    uint32_t mapping;       // The index of the mapping in its client, or UINT32_MAX for a request.
+    uint16_t client;        // The index of the client.
+    IOCaptureKind kind;
+    uint8_t status;
+};
+
+static_assert(sizeof(IOCaptureRecord) == 24, "IO capture records are 24 bytes.");
+
+/**
+ * Set while IO is being captured, so that the runtime only calls the capture functions then.
+ */
+extern std::atomic<bool> IO_CAPTURING;
+
+/**
+ * Starts capturing the IO of the clients that are mapped, if options.ioCapture names a file. Called by
+ * TaskScheduler::run() before the IO starts.
+ * @param options The runtime options.
+ * @returns Returns false, having written why, if nothing is captured or the file can't be written.
+ */
+bool startIOCapture(const RuntimeOptions& options);
+/**
+ * Writes the records that haven't been written yet and closes the capture. Called when the runtime stops.
+ */
+void stopIOCapture();
+/**
+ * Captures a request a client completed. Called by IOClient::requestCompleted().
+ * @param client The client.
+ * @param succeeded Whether the device answered the request without an error.
+ * @param micros The round trip time of the request, in microseconds.
+ */
+void captureRequest(const IOClient* client, bool succeeded, uint64_t micros);
+/**
+ * Captures a value staged into the image, if it is the input of a captured mapping. Called by writeImage().
+ * @param address The address written.
+ * @param value The value.
+ */
+void captureInput(const ResolvedAddress& address, uint64_t value);
+/**
+ * Captures a quality other than Good of an input. Called by setInputQuality().
+ * @param slot The quality slot of the input.
+ * @param quality The quality.
+ */
+void captureQuality(uint32_t slot, IOQuality quality);
+
+/**
+ * Reads the capture that a replay serves, and makes newClient() create an IOReplayClient for every endpoint, so that
+ * no device is reached even if the capture can't be read. Called by applyRuntimeProfile() before the IO is mapped.
+ * @param path The capture, from options.ioReplay.
+ * @returns Returns false, having written why, if the capture can't be read.
+ */
+bool openIOReplay(const std::string& path);
+/**
+ * @returns Returns true if the IO is replayed rather than exchanged with the devices.
+ */
+bool ioReplayActive();
+
+/**
+ * Stands in for the client of an endpoint in a replay, serving the records its client captured at the times they
+ * were captured, measured from when the first client of the replay connected.
+ */
+class IOReplayClient : public IOClient {
+public:
+    /**
+     * @param protocol The protocol of the client it stands in for.
+     */
+    explicit IOReplayClient(const std::string& protocol);
+    ~IOReplayClient();
+
+protected:
+    /**
+     * Finds the client of the endpoint in the capture, matches its mappings and starts serving its records.
+     */
+    void connect() override;
+    /**
+     * Does nothing, since the records are served at their own times, and outputs are answered by the captured
+     * requests of the client.
+     * @param batch The requests of the mappings that are due.
+     */
+    void submitBatch(IOBatch& batch) override { (void)batch; }
+
+private:
+    /**
+     * Serves the records on the replay thread, until they run out or the client is destroyed.
+     */
+    void serve();
+
+    /**
+     * The records of the client, and the local address and quality slot of each captured mapping, which are
+     * copied when it connects so that the replay thread doesn't touch the mappings.
+     */
+    const std::vector<IOCaptureRecord>* records = nullptr;
+    std::vector<std::pair<ResolvedAddress, uint32_t>> targets;
+    std::vector<bool> matched;
+    std::thread replay;
+    std::mutex replayMutex;
+    std::condition_variable replaySignal;
+    bool stopping = false;
+};
+
+#endif // IOCAPTURE_H
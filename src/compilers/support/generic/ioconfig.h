@@ -0,0 +1,255 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC IO Configuration
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * The layout of a binary IO configuration, which a runtime started with --io-config <file> maps in place of the IO
+ * maps it was compiled with, and a reader for it. The compiler writes the maps of a program beside it as
+ * <executable>.iomap, and `nodalis iomap` converts a list of maps into one, so the maps of a device can be changed
+ * without building the program again. The file is a table of fixed size records, one for each mapping, grouped by
+ * the client they share, and a pool of the strings they refer to, so it is read where it is mapped without parsing.
+ * This header only depends on the standard library and the OS, so engineering tools can include it on its own.
+ */
+#pragma once
+#ifndef IOCONFIG_H
+#define IOCONFIG_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Identifies an IO configuration.
+ */
+static constexpr char IO_CONFIG_MAGIC[8] = { 'N', 'D', 'L', 'S', 'I', 'O', 'C', '1' };
+
+/**
+ * The version of the configuration layout. Readers should refuse a configuration with a version they don't know.
+ */
+static constexpr uint32_t IO_CONFIG_VERSION = 1;
+
+/**
+ * The header at the start of an IO configuration. It is followed by the mappings, the clients and the strings. All
+ * numbers are little endian.
+ */
+struct IOConfigHeader {
+    char magic[8];              // IO_CONFIG_MAGIC.
+    uint32_t version;           // IO_CONFIG_VERSION.
+    uint32_t bytes;             // The size of the configuration.
+    uint32_t mapCount;          // The number of mappings.
+    uint32_t clientCount;       // The number of clients.
+    uint32_t mapsOffset;        // The offset of the mappings from the start of the configuration.
+    uint32_t clientsOffset;     // The offset of the clients from the start of the configuration.
+    uint32_t stringsOffset;     // The offset of the strings from the start of the configuration.
+    uint32_t stringsBytes;      // The size of the strings.
+    uint32_t checksum;          // ioConfigChecksum() of everything after the header.
+    uint32_t reserved;
+};
+
+static_assert(sizeof(IOConfigHeader) == 48, "The IO configuration header is 48 bytes.");
+
+/**
+ * A mapping of an IO configuration, with the fields of a //Map= line. Strings are offsets into the strings, which
+ * are null terminated. The offset 0 is the empty string.
+ */
+struct IOConfigMap {
+    uint32_t protocol;          // Protocol.
+    uint32_t moduleID;          // ModuleID.
+    uint32_t modulePort;        // ModulePort.
+    uint32_t remoteAddress;     // RemoteAddress.
+    uint32_t localAddress;      // InternalAddress.
+    uint32_t properties;        // ProtocolProperties, as the text of a JSON object.
+    uint32_t task;              // Task, or the empty string for none.
+    int32_t width;              // RemoteSize.
+    int32_t interval;           // PollTime.
+    int32_t refreshTime;        // RefreshTime.
+    int32_t minInterval;        // MinPollTime, or 0.
+    int32_t maxInterval;        // MaxPollTime, or 0.
+    uint64_t deadband;          // Deadband.
+    uint32_t reserved[2];
+};
+
+static_assert(sizeof(IOConfigMap) == 64, "IO configuration mappings are 64 bytes.");
+
+/**
+ * A client of an IO configuration: the mappings that share its endpoint, which follow each other.
+ */
+struct IOConfigClient {
+    uint32_t first;             // The index of the first mapping of the client.
+    uint32_t count;             // The number of mappings of the client.
+};
+
+static_assert(sizeof(IOConfigClient) == 8, "IO configuration clients are 8 bytes.");
+
+/**
+ * Computes the checksum of an IO configuration, FNV-1a over the bytes after its header. The compiler writes it with
+ * the same function.
+ * @param bytes The bytes after the header.
+ * @param count The number of bytes.
+ * @returns Returns the checksum.
+ */
+inline uint32_t ioConfigChecksum(const uint8_t* bytes, size_t count){
+    uint32_t h = 2166136261u;
+    for(size_t x = 0; x < count; x++){
+        h = (h ^ bytes[x]) * 16777619u;
+    }
+    return h;
+}
+
+/**
+ * Reads an IO configuration in place, from the file it is mapped from.
+ */
+class IOConfigReader {
+public:
+    IOConfigReader() = default;
+    IOConfigReader(const IOConfigReader&) = delete;
+    IOConfigReader& operator=(const IOConfigReader&) = delete;
+    ~IOConfigReader(){ close(); }
+
+    /**
+     * Maps an IO configuration file read only.
+     * @param path The path of the file.
+     * @returns Returns true if the file was mapped, its layout is one this reader knows and its checksum matches.
+     */
+    bool open(const std::string& path){
+        close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(file == INVALID_HANDLE_VALUE){
+            return false;
+        }
+        LARGE_INTEGER length;
+        size_t bytes = GetFileSizeEx(file, &length) ? static_cast<size_t>(length.QuadPart) : 0;
+        mapping = bytes > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+        CloseHandle(file);
+        const uint8_t* view = mapping != nullptr ? static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0){
+            return false;
+        }
+        struct stat info;
+        size_t bytes = fstat(fd, &info) == 0 ? static_cast<size_t>(info.st_size) : 0;
+        void* region = bytes > 0 ? mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        const uint8_t* view = region == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(region);
+#endif
+        map = view;
+        size = bytes;
+        if(!validate()){
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Unmaps the file.
+     */
+    void close(){
+        if(map != nullptr){
+#ifdef _WIN32
+            UnmapViewOfFile(map);
+#else
+            munmap(const_cast<uint8_t*>(map), size);
+#endif
+        }
+#ifdef _WIN32
+        if(mapping != nullptr) CloseHandle(mapping);
+        mapping = nullptr;
+#endif
+        map = nullptr;
+        size = 0;
+    }
+
+    /**
+     * @returns Returns the header of the configuration, or nullptr if it isn't open.
+     */
+    const IOConfigHeader* header() const { return reinterpret_cast<const IOConfigHeader*>(map); }
+
+    /**
+     * @returns Returns the mappings, in the order of their clients.
+     */
+    const IOConfigMap* maps() const { return reinterpret_cast<const IOConfigMap*>(map + header()->mapsOffset); }
+
+    /**
+     * @returns Returns the clients.
+     */
+    const IOConfigClient* clients() const { return reinterpret_cast<const IOConfigClient*>(map + header()->clientsOffset); }
+
+    /**
+     * Gets a string of the configuration.
+     * @param offset The offset of the string, from a mapping.
+     * @returns Returns the null terminated string, which stays valid while the configuration is open.
+     */
+    const char* string(uint32_t offset) const {
+        return reinterpret_cast<const char*>(map + header()->stringsOffset + offset);
+    }
+
+private:
+    /**
+     * Checks the header, the checksum and that every client and string of the mappings is inside the configuration,
+     * so that nothing read from it afterwards needs a check.
+     */
+    bool validate() const {
+        if(map == nullptr || size < sizeof(IOConfigHeader)){
+            return false;
+        }
+        const IOConfigHeader* h = header();
+        if(std::memcmp(h->magic, IO_CONFIG_MAGIC, sizeof(IO_CONFIG_MAGIC)) != 0 || h->version != IO_CONFIG_VERSION ||
+           h->bytes != size || h->mapsOffset % 8 != 0 || h->clientsOffset % 8 != 0 ||
+           h->mapsOffset + static_cast<uint64_t>(h->mapCount) * sizeof(IOConfigMap) > size ||
+           h->clientsOffset + static_cast<uint64_t>(h->clientCount) * sizeof(IOConfigClient) > size ||
+           h->stringsBytes == 0 || h->stringsOffset + static_cast<uint64_t>(h->stringsBytes) > size ||
+           map[h->stringsOffset] != '\0' || map[h->stringsOffset + h->stringsBytes - 1] != '\0' ||
+           h->checksum != ioConfigChecksum(map + sizeof(IOConfigHeader), size - sizeof(IOConfigHeader))){
+            return false;
+        }
+        for(uint32_t c = 0; c < h->clientCount; c++){
+            const IOConfigClient& client = clients()[c];
+            if(client.count == 0 || static_cast<uint64_t>(client.first) + client.count > h->mapCount){
+                return false;
+            }
+        }
+        for(uint32_t m = 0; m < h->mapCount; m++){
+            const IOConfigMap& row = maps()[m];
+            for(uint32_t offset : { row.protocol, row.moduleID, row.modulePort, row.remoteAddress, row.localAddress, row.properties, row.task }){
+                if(offset >= h->stringsBytes){
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    const uint8_t* map = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE mapping = nullptr;
+#endif
+};
+
+#endif
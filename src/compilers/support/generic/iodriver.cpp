@@ -0,0 +1,434 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC IO Driver Loader
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+#include "iodriver.h"
+#include "nodalisjson.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <thread>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    std::mutex DRIVER_MUTEX;
+    std::string DRIVER_DIRECTORY = "drivers";
+    /**
+     * The driver of each protocol that was looked for, or null for a protocol that has none.
+     */
+    std::map<std::string, const NodalisDriver*> DRIVERS;
+
+    /**
+     * Reads a millisecond protocol property, given as a number or a string.
+     */
+    uint64_t millisProperty(const json& config, const char* name, uint64_t fallback) {
+        if (!config.is_object() || !config.contains(name)) {
+            return fallback;
+        }
+        const json& token = config.at(name);
+        if (token.is_number_unsigned()) {
+            return token.get<uint64_t>();
+        }
+        if (token.is_string()) {
+            return std::strtoull(token.get<std::string>().c_str(), nullptr, 10);
+        }
+        return fallback;
+    }
+
+    /**
+     * Loads the driver of a protocol from the driver directory.
+     * @param protocol The protocol, in upper case.
+     * @returns Returns the driver, or null, having written why if a library was found, if it can't be loaded.
+     */
+    const NodalisDriver* loadDriver(const std::string& protocol) {
+        std::string name = protocol;
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+#if defined(_WIN32)
+        std::string path = DRIVER_DIRECTORY + "\\nodalis-" + name + ".dll";
+        HMODULE library = LoadLibraryA(path.c_str());
+        if (library == nullptr) {
+            return nullptr;
+        }
+        auto entry = reinterpret_cast<NodalisDriverEntry>(GetProcAddress(library, "nodalis_driver"));
+#else
+#if defined(__APPLE__)
+        std::string path = DRIVER_DIRECTORY + "/libnodalis-" + name + ".dylib";
+#else
+        std::string path = DRIVER_DIRECTORY + "/libnodalis-" + name + ".so";
+#endif
+        // Drivers are only loaded for the protocols the IO maps name, so a missing one is not an error yet.
+        void* library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (library == nullptr) {
+            if (access(path.c_str(), F_OK) == 0) {
+                const char* reason = dlerror();
+                nodalisLog() << "Could not load the driver " << path << ": " << (reason != nullptr ? reason : "unknown error") << "\n";
+            }
+            return nullptr;
+        }
+        auto entry = reinterpret_cast<NodalisDriverEntry>(dlsym(library, "nodalis_driver"));
+#endif
+        const NodalisDriver* driver = entry != nullptr ? entry() : nullptr;
+        if (driver == nullptr || driver->abiVersion != NODALIS_DRIVER_ABI_VERSION || driver->create == nullptr ||
+            driver->destroy == nullptr || driver->map == nullptr || driver->connect == nullptr || driver->submit == nullptr) {
+            nodalisLog() << path << " is not a driver library of this version of the runtime\n";
+            // The library is left loaded, since it may have started threads of its own.
+            return nullptr;
+        }
+        nodalisLog() << "Loaded the " << protocol << " driver from " << path << "\n";
+        return driver;
+    }
+}
+
+void setIODriverDirectory(const std::string& directory) {
+    std::lock_guard<std::mutex> lock(DRIVER_MUTEX);
+    DRIVER_DIRECTORY = directory;
+}
+
+std::unique_ptr<IOClient> newDriverClient(const std::string& protocol) {
+    const NodalisDriver* driver;
+    {
+        std::lock_guard<std::mutex> lock(DRIVER_MUTEX);
+        auto found = DRIVERS.find(protocol);
+        if (found == DRIVERS.end()) {
+            found = DRIVERS.emplace(protocol, loadDriver(protocol)).first;
+        }
+        driver = found->second;
+    }
+    if (driver == nullptr) {
+        return nullptr;
+    }
+    return std::make_unique<PluginIOClient>(protocol, *driver);
+}
+
+PluginIOClient::PluginIOClient(const std::string& protocol, const NodalisDriver& driver)
+    : IOClient(protocol), driver(driver) {
+    host.client = this;
+    host.complete = &PluginIOClient::hostComplete;
+    host.counted = &PluginIOClient::hostCounted;
+    host.log = &PluginIOClient::hostLog;
+    host.wake = &PluginIOClient::hostWake;
+    instance = driver.create(&host);
+    if (instance == nullptr) {
+        nodalisLog() << "The " << protocol << " driver could not create a client\n";
+    }
+    reconnectDelay = minReconnectDelay = 1000;
+    maxReconnectDelay = 30000;
+}
+
+PluginIOClient::~PluginIOClient() {
+    stop();
+    if (reactor != nullptr) {
+        reactor->runSync([this]() { detach(); });
+    }
+    else if (instance != nullptr) {
+        driver.destroy(instance);
+    }
+}
+
+void PluginIOClient::onMappingAdded(IOMap& map) {
+    json config = protocolProperties(map);
+    responseTimeout = millisProperty(config, "ResponseTimeout", responseTimeout);
+    minReconnectDelay = millisProperty(config, "ReconnectDelay", minReconnectDelay);
+    maxReconnectDelay = millisProperty(config, "MaxReconnectDelay", maxReconnectDelay);
+    if (maxReconnectDelay < minReconnectDelay) {
+        maxReconnectDelay = minReconnectDelay;
+    }
+    if (lastAttempt == 0) {
+        reconnectDelay = minReconnectDelay;
+    }
+    if (instance == nullptr) {
+        return;
+    }
+    NodalisIOMapping mapping;
+    mapping.moduleID = map.moduleID.c_str();
+    mapping.modulePort = map.modulePort.c_str();
+    mapping.remoteAddress = map.remoteAddress.c_str();
+    mapping.properties = map.additionalProperties.c_str();
+    mapping.output = map.direction == IOType::Output ? 1 : 0;
+    mapping.width = static_cast<uint8_t>(map.width);
+    mapping.interval = map.interval;
+    map.remoteHandle = driver.map(instance, &mapping);
+    if (map.remoteHandle < 0) {
+        map.remoteHandle = -1;
+        nodalisLog() << "The " << protocol << " driver can't map " << map.remoteAddress << " for " << map.localAddress << "\n";
+    }
+}
+
+void PluginIOClient::connect() {
+    if (connected || instance == nullptr) {
+        return;
+    }
+    connected = driver.connect(instance) != 0;
+    descriptor = connected && driver.descriptor != nullptr ? driver.descriptor(instance) : -1;
+}
+
+bool PluginIOClient::startBatch(IOBatch& batch) {
+    active = &batch;
+    batchId++;
+    remaining = batch.requests.size();
+    submitted.clear();
+    for (size_t x = 0; x < batch.requests.size(); x++) {
+        IORequest& request = batch.requests[x];
+        if (request.remoteHandle < 0) {
+            complete(request, IOStatus::Invalid);
+            remaining--;
+            continue;
+        }
+        NodalisIORequest entry;
+        entry.value = request.value;
+        entry.handle = request.remoteHandle;
+        entry.output = request.direction == IOType::Output ? 1 : 0;
+        entry.width = static_cast<uint8_t>(request.width);
+        entry.reserved = 0;
+        entry.batch = batchId;
+        entry.index = static_cast<uint32_t>(x);
+        submitted.push_back(entry);
+    }
+    if (submitted.empty()) {
+        active = nullptr;
+        return true;
+    }
+    woken = false;
+    if (driver.submit(instance, submitted.data(), submitted.size()) == 0) {
+        connectionLost();
+        return false;
+    }
+    return true;
+}
+
+bool PluginIOClient::service() {
+    woken = false;
+    if (driver.service == nullptr) {
+        return true;
+    }
+    if (driver.service(instance) == 0) {
+        connectionLost();
+        return false;
+    }
+    return true;
+}
+
+void PluginIOClient::completed(const NodalisIORequest& request, int status, uint64_t value) {
+    if (active == nullptr || request.batch != batchId || request.index >= active->requests.size()) {
+        return;
+    }
+    IORequest& target = active->requests[request.index];
+    if (target.status != IOStatus::Pending) {
+        return;
+    }
+    if (status < NODALIS_IO_GOOD || status > NODALIS_IO_INVALID) {
+        status = NODALIS_IO_FAILED;
+    }
+    complete(target, static_cast<IOStatus>(status), value);
+    if (--remaining == 0) {
+        active = nullptr;
+    }
+}
+
+void PluginIOClient::abandonBatch() {
+    if (active != nullptr) {
+        for (auto& request : active->requests) {
+            if (request.status == IOStatus::Pending) {
+                complete(request, IOStatus::Failed);
+            }
+        }
+    }
+    active = nullptr;
+    remaining = 0;
+    // A completion that arrives for the abandoned batch no longer matches.
+    batchId++;
+}
+
+void PluginIOClient::connectionLost() {
+    abandonBatch();
+    if (connected) {
+        DIAGNOSTIC("The " << protocol << " connection to " << moduleID << " was lost");
+    }
+    connected = false;
+    if (reactor != nullptr && descriptor >= 0) {
+        reactor->unwatch(descriptor);
+    }
+    descriptor = -1;
+    lastAttempt = elapsed();
+}
+
+void PluginIOClient::submitBatch(IOBatch& batch) {
+    if (instance == nullptr || !startBatch(batch)) {
+        return;
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(responseTimeout);
+    while (active != nullptr) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            DIAGNOSTIC("The " << protocol << " requests to " << moduleID << " timed out");
+            abandonBatch();
+            return;
+        }
+        bool ready = woken.load(std::memory_order_acquire);
+#ifndef _WIN32
+        if (!ready && descriptor >= 0) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count();
+            struct pollfd entry = { descriptor, POLLIN, 0 };
+            ready = ::poll(&entry, 1, static_cast<int>(left < 10 ? left + 1 : 10)) > 0;
+        }
+        else
+#endif
+        if (!ready) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (ready && !service()) {
+            return;
+        }
+    }
+}
+
+void PluginIOClient::hostComplete(void* client, const NodalisIORequest* request, int status, uint64_t value) {
+    if (request != nullptr) {
+        static_cast<PluginIOClient*>(client)->completed(*request, status, value);
+    }
+}
+
+void PluginIOClient::hostCounted(void* client, int succeeded, uint64_t micros) {
+    static_cast<PluginIOClient*>(client)->requestCompleted(succeeded != 0, micros);
+}
+
+void PluginIOClient::hostLog(void* client, const char* message) {
+    auto* self = static_cast<PluginIOClient*>(client);
+    nodalisLog() << self->protocol << " " << self->moduleID << ": " << (message != nullptr ? message : "") << "\n";
+}
+
+void PluginIOClient::hostWake(void* client) {
+    auto* self = static_cast<PluginIOClient*>(client);
+    self->woken.store(true, std::memory_order_release);
+    if (self->reactor != nullptr) {
+        self->reactor->post([self]() { self->serviceTick(); });
+    }
+}
+
+// ========== Reactor Mode ==========
+
+bool PluginIOClient::attach(IOReactor& target) {
+    reactor = &target;
+    ioStats = &registerStats("IO." + protocol + "." + moduleID);
+    reactor->post([this]() { tick(); });
+    return true;
+}
+
+void PluginIOClient::detach() {
+    reactor->cancel(tickTimer);
+    tickTimer = 0;
+    if (descriptor >= 0) {
+        reactor->unwatch(descriptor);
+        descriptor = -1;
+    }
+    if (instance != nullptr) {
+        driver.destroy(instance);
+        instance = nullptr;
+    }
+}
+
+void PluginIOClient::tick() {
+    tickTimer = 0;
+    {
+        std::lock_guard<std::mutex> lock(mappingMutex);
+        if (instance != nullptr && active != nullptr && microsBetween(batchStart, IOReactor::Clock::now()) >= responseTimeout * 1000) {
+            DIAGNOSTIC("The " << protocol << " requests to " << moduleID << " timed out");
+            abandonBatch();
+        }
+        uint64_t now = elapsed();
+        if (instance != nullptr && !connected && (lastAttempt == 0 || now - lastAttempt >= reconnectDelay)) {
+            lastAttempt = now;
+            connect();
+            connectAttempted(connected);
+            if (connected && descriptor >= 0) {
+                reactor->watch(descriptor, EVENT_READABLE, [this](uint32_t events) {
+                    (void)events;
+                    serviceTick();
+                });
+            }
+        }
+        // Like the other reactor clients, a poll starts once the previous one is finished.
+        if (connected && active == nullptr) {
+            collectDue(reactorDue);
+            if (!reactorDue.empty()) {
+                buildBatch(reactorDue, reactorBatch);
+                batchStart = IOReactor::Clock::now();
+                startBatch(reactorBatch);
+                publishCompleted();
+                if (active == nullptr && ioStats != nullptr) {
+                    ioStats->record(microsBetween(batchStart, IOReactor::Clock::now()));
+                }
+            }
+        }
+    }
+    scheduleTick();
+}
+
+void PluginIOClient::serviceTick() {
+    if (instance == nullptr || !connected) {
+        return;
+    }
+    bool finished;
+    {
+        std::lock_guard<std::mutex> lock(mappingMutex);
+        bool pending = active != nullptr;
+        service();
+        publishCompleted();
+        finished = pending && active == nullptr;
+        if (finished && connected && ioStats != nullptr) {
+            ioStats->record(microsBetween(batchStart, IOReactor::Clock::now()));
+        }
+    }
+    if (finished) {
+        scheduleTick();
+    }
+}
+
+void PluginIOClient::wake() {
+    if (reactor == nullptr) {
+        IOClient::wake();
+        return;
+    }
+    reactor->post([this]() { scheduleTick(); });
+}
+
+void PluginIOClient::scheduleTick() {
+    reactor->cancel(tickTimer);
+    auto now = IOReactor::Clock::now();
+    IOReactor::Clock::time_point when;
+    if (active != nullptr) {
+        when = batchStart + std::chrono::milliseconds(responseTimeout);
+    }
+    else {
+        when = PROGRAM_START + std::chrono::milliseconds(nextPollDue());
+    }
+    // Wake at least every 100ms so that newly added mappings are noticed.
+    if (when > now + std::chrono::milliseconds(100)) {
+        when = now + std::chrono::milliseconds(100);
+    }
+    tickTimer = reactor->schedule(when, [this]() { tick(); });
+}
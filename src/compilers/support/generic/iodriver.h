@@ -0,0 +1,171 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC IO Driver Loader
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * Loads the protocol drivers that are built as shared libraries (see nodalisdriver.h), and runs an instance of one
+ * for each endpoint as a PluginIOClient, which gives it the batches, scheduling, reconnects and diagnostics of the
+ * built in clients.
+ */
+#pragma once
+#ifndef IODRIVER_H
+#define IODRIVER_H
+
+#include "nodalis.h"
+#include "nodalisdriver.h"
+#include "ioreactor.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+class PluginIOClient : public IOClient {
+public:
+    /**
+     * @param protocol The protocol of the client's mappings.
+     * @param driver The driver, which stays loaded while the runtime runs.
+     */
+    PluginIOClient(const std::string& protocol, const NodalisDriver& driver);
+    ~PluginIOClient();
+    /**
+     * Runs the client on an IO reactor, which connects the instance, submits its batches, and services it when its
+     * descriptor is readable or it wakes the host.
+     * @param reactor The reactor.
+     * @returns Returns true.
+     */
+    bool attach(IOReactor& reactor) override;
+
+protected:
+    void connect() override;
+    /**
+     * Passes a mapping to the driver's map(), whose handle becomes the mapping's remoteHandle. The ResponseTimeout
+     * protocol property sets how long the client waits for a batch to complete.
+     * @param map The mapping.
+     */
+    void onMappingAdded(IOMap& map) override;
+    /**
+     * Submits a batch to the instance and, since this is only used without a reactor, services the instance until
+     * every request has completed or the response timeout has passed.
+     * @param batch The requests of the mappings that are due.
+     */
+    void submitBatch(IOBatch& batch) override;
+    /**
+     * Reschedules the next tick on the reactor, so that outputs made due by requestFlush() are written at once.
+     */
+    void wake() override;
+
+private:
+    const NodalisDriver& driver;
+    NodalisDriverHost host;
+    void* instance = nullptr;
+    /**
+     * The descriptor the instance gave after it connected, or -1.
+     */
+    int descriptor = -1;
+    /**
+     * The longest the client waits for the requests of a batch to complete, in milliseconds (ResponseTimeout).
+     */
+    uint64_t responseTimeout = 5000;
+    /**
+     * The batch in progress, which completions are matched against by its ID, and the number of its requests that
+     * haven't completed. The ID changes with each batch, so that a late completion of an abandoned one is ignored.
+     */
+    IOBatch* active = nullptr;
+    uint32_t batchId = 0;
+    size_t remaining = 0;
+    /**
+     * The requests of the batch as the driver sees them, kept between batches so that they are reused.
+     */
+    std::vector<NodalisIORequest> submitted;
+    /**
+     * Whether the instance woke the host since it was last serviced.
+     */
+    std::atomic<bool> woken{false};
+
+    // ----- Reactor mode -----
+
+    IOReactor* reactor = nullptr;
+    ExecutionStats* ioStats = nullptr;
+    uint64_t tickTimer = 0;
+    std::vector<IOMap*> reactorDue;
+    IOBatch reactorBatch;
+    std::chrono::steady_clock::time_point batchStart;
+
+    /**
+     * Starts a batch: the requests without a valid handle are completed as invalid, and the others submitted.
+     * @param batch The batch.
+     * @returns Returns false if the connection was lost.
+     */
+    bool startBatch(IOBatch& batch);
+    /**
+     * Calls the instance's service(), if it has one.
+     * @returns Returns false if the connection was lost.
+     */
+    bool service();
+    /**
+     * Handles the loss of the connection: the requests left in the batch are failed, and the instance is connected
+     * again after the reconnect delay.
+     */
+    void connectionLost();
+    /**
+     * Completes the requests left in the batch as failed, and ends the batch.
+     */
+    void abandonBatch();
+    /**
+     * Handles a completion from the instance.
+     */
+    void completed(const NodalisIORequest& request, int status, uint64_t value);
+    /**
+     * Cancels the timer, stops watching the descriptor and destroys the instance. This runs on the reactor thread
+     * when the client is destroyed.
+     */
+    void detach();
+    /**
+     * Connects the instance when it is due, times out a batch that took too long, and submits the next batch once
+     * the last one has completed.
+     */
+    void tick();
+    /**
+     * Services the instance, publishes what it completed and, if that finished the batch, schedules the next tick.
+     */
+    void serviceTick();
+    /**
+     * Schedules the next tick, for when the batch in progress times out or the next poll is due.
+     */
+    void scheduleTick();
+
+    static void hostComplete(void* client, const NodalisIORequest* request, int status, uint64_t value);
+    static void hostCounted(void* client, int succeeded, uint64_t micros);
+    static void hostLog(void* client, const char* message);
+    static void hostWake(void* client);
+};
+
+/**
+ * Sets the directory that drivers are loaded from. Called by applyRuntimeProfile() before the IO is mapped.
+ * @param directory The directory, from options.ioDrivers.
+ */
+void setIODriverDirectory(const std::string& directory);
+/**
+ * Creates a client for a protocol that isn't built into the runtime, from the driver of the protocol in the driver
+ * directory. The driver is loaded the first time, and a protocol without one is only looked for once.
+ * @param protocol The protocol, in upper case.
+ * @returns Returns the client, or null if there is no driver for the protocol.
+ */
+std::unique_ptr<IOClient> newDriverClient(const std::string& protocol);
+
+#endif // IODRIVER_H
@@ -0,0 +1,1109 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC IO Reactor
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+#include "ioreactor.h"
+#include "nodalis.h"
+#include <future>
+#include <cstring>
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #include <windows.h>
+#else
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+    #if defined(__linux__)
+        #include <sys/epoll.h>
+        #if defined(__has_include)
+            #if __has_include(<linux/io_uring.h>)
+                #include <linux/io_uring.h>
+                #include <sys/mman.h>
+                #include <sys/syscall.h>
+                #include <sys/uio.h>
+                #define NODALIS_IO_URING 1
+            #endif
+        #endif
+    #elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+        #include <sys/event.h>
+        #define NODALIS_KQUEUE 1
+    #endif
+#endif
+
+// ========== Backends ==========
+
+#if defined(__linux__)
+/**
+ * Waits for readiness with epoll.
+ */
+class EpollBackend : public ReactorBackend {
+public:
+    EpollBackend() : epfd(epoll_create1(EPOLL_CLOEXEC)) {}
+    ~EpollBackend() override {
+        if (epfd >= 0) close(epfd);
+    }
+    bool add(int fd, uint32_t events) override {
+        epoll_event ev = toEpoll(fd, events);
+        return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == 0;
+    }
+    bool modify(int fd, uint32_t events) override {
+        epoll_event ev = toEpoll(fd, events);
+        return epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) == 0;
+    }
+    void remove(int fd) override {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+    int wait(std::vector<std::pair<int, uint32_t>>& ready, std::vector<ReactorCompletion>& completions, int timeoutMs) override {
+        (void)completions;
+        epoll_event events[64];
+        int count = epoll_wait(epfd, events, 64, timeoutMs);
+        if (count < 0) return errno == EINTR ? 0 : -1;
+        for (int i = 0; i < count; i++) {
+            uint32_t flags = 0;
+            if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) flags |= EVENT_READABLE;
+            if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) flags |= EVENT_WRITABLE;
+            int fd = events[i].data.fd;
+            ready.push_back({ fd, flags });
+        }
+        return count;
+    }
+    const char* name() const override { return "epoll"; }
+
+private:
+    int epfd;
+
+    static epoll_event toEpoll(int fd, uint32_t events) {
+        epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.data.fd = fd;
+        if (events & EVENT_READABLE) ev.events |= EPOLLIN;
+        if (events & EVENT_WRITABLE) ev.events |= EPOLLOUT;
+        return ev;
+    }
+};
+#endif
+
+#if defined(NODALIS_KQUEUE)
+/**
+ * Waits for readiness with kqueue.
+ */
+class KqueueBackend : public ReactorBackend {
+public:
+    KqueueBackend() : kq(kqueue()) {}
+    ~KqueueBackend() override {
+        if (kq >= 0) close(kq);
+    }
+    bool add(int fd, uint32_t events) override {
+        interest[fd] = 0;
+        return modify(fd, events);
+    }
+    bool modify(int fd, uint32_t events) override {
+        uint32_t current = interest[fd];
+        struct kevent changes[2];
+        int count = 0;
+        if ((events ^ current) & EVENT_READABLE) {
+            EV_SET(&changes[count++], fd, EVFILT_READ, (events & EVENT_READABLE) ? EV_ADD : EV_DELETE, 0, 0, nullptr);
+        }
+        if ((events ^ current) & EVENT_WRITABLE) {
+            EV_SET(&changes[count++], fd, EVFILT_WRITE, (events & EVENT_WRITABLE) ? EV_ADD : EV_DELETE, 0, 0, nullptr);
+        }
+        interest[fd] = events;
+        return count == 0 || kevent(kq, changes, count, nullptr, 0, nullptr) == 0;
+    }
+    void remove(int fd) override {
+        modify(fd, 0);
+        interest.erase(fd);
+    }
+    int wait(std::vector<std::pair<int, uint32_t>>& ready, std::vector<ReactorCompletion>& completions, int timeoutMs) override {
+        (void)completions;
+        struct kevent events[64];
+        timespec ts;
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+        int count = kevent(kq, nullptr, 0, events, 64, &ts);
+        if (count < 0) return errno == EINTR ? 0 : -1;
+        for (int i = 0; i < count; i++) {
+            uint32_t flags = events[i].filter == EVFILT_READ ? EVENT_READABLE : EVENT_WRITABLE;
+            ready.push_back({ static_cast<int>(events[i].ident), flags });
+        }
+        return count;
+    }
+    const char* name() const override { return "kqueue"; }
+
+private:
+    int kq;
+    std::map<int, uint32_t> interest;
+};
+#endif
+
+#if defined(NODALIS_IO_URING)
+/**
+ * Waits for readiness, and performs sends and receives, with io_uring. Everything queued during a loop of the
+ * reactor is submitted together with the wait for completions in a single io_uring_enter call, and the buffers
+ * of the reactor's pool are registered so that sends and receives use them without mapping them each time.
+ * The rings are driven with raw system calls, so liburing is not needed.
+ */
+class UringBackend : public ReactorBackend {
+public:
+    ~UringBackend() override {
+        if (sqes != nullptr) munmap(sqes, sqeBytes);
+        if (ring != nullptr) munmap(ring, ringBytes);
+        if (ringFd >= 0) close(ringFd);
+    }
+    /**
+     * Creates the rings.
+     * @param entries The size of the submission queue.
+     * @returns Returns false if io_uring is not available, or lacks the features this backend needs.
+     */
+    bool setup(unsigned entries) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ringFd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (ringFd < 0) return false;
+        if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG)) {
+            return false;
+        }
+        size_t sqBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        size_t cqBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        ringBytes = sqBytes > cqBytes ? sqBytes : cqBytes;
+        void* mapped = mmap(nullptr, ringBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        if (mapped == MAP_FAILED) return false;
+        ring = static_cast<uint8_t*>(mapped);
+        sqeBytes = params.sq_entries * sizeof(io_uring_sqe);
+        mapped = mmap(nullptr, sqeBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+        if (mapped == MAP_FAILED) return false;
+        sqes = static_cast<io_uring_sqe*>(mapped);
+
+        sqHead = reinterpret_cast<unsigned*>(ring + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(ring + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(ring + params.sq_off.ring_mask);
+        sqEntries = params.sq_entries;
+        sqArray = reinterpret_cast<unsigned*>(ring + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned*>(ring + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(ring + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(ring + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(ring + params.cq_off.cqes);
+        localTail = *sqTail;
+        return true;
+    }
+    bool add(int fd, uint32_t events) override {
+        Poll& poll = polls[fd];
+        poll.events = events;
+        return arm(fd, poll);
+    }
+    bool modify(int fd, uint32_t events) override {
+        auto it = polls.find(fd);
+        if (it == polls.end()) return add(fd, events);
+        if (it->second.events == events) return true;
+        disarm(fd, it->second);
+        it->second.events = events;
+        return arm(fd, it->second);
+    }
+    void remove(int fd) override {
+        auto it = polls.find(fd);
+        if (it == polls.end()) return;
+        disarm(fd, it->second);
+        polls.erase(it);
+    }
+    int wait(std::vector<std::pair<int, uint32_t>>& ready, std::vector<ReactorCompletion>& completions, int timeoutMs) override {
+        __atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+        __kernel_timespec ts;
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+        io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+        unsigned toSubmit = unsubmitted;
+        unsubmitted = 0;
+        long ret = syscall(__NR_io_uring_enter, ringFd, toSubmit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+        if (ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY) {
+            return -1;
+        }
+        return reap(ready, completions);
+    }
+    bool performsIO() const override { return true; }
+    bool registerBuffers(uint8_t* base, size_t size, size_t count) override {
+        std::vector<iovec> iovecs(count);
+        for (size_t i = 0; i < count; i++) {
+            iovecs[i].iov_base = base + i * size;
+            iovecs[i].iov_len = size;
+        }
+        return syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, iovecs.data(), static_cast<unsigned>(count)) == 0;
+    }
+    bool queueReceive(int fd, int index, uint8_t* buffer, size_t length, uint64_t token) override {
+        return queueFixed(IORING_OP_READ_FIXED, fd, index, buffer, length, token);
+    }
+    bool queueSend(int fd, int index, const uint8_t* buffer, size_t length, uint64_t token) override {
+        return queueFixed(IORING_OP_WRITE_FIXED, fd, index, const_cast<uint8_t*>(buffer), length, token);
+    }
+    void cancelOperation(uint64_t token) override {
+        io_uring_sqe* sqe = nextSqe();
+        if (sqe == nullptr) return;
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = token;
+        sqe->user_data = IGNORED_TAG;
+    }
+    const char* name() const override { return "io_uring"; }
+
+private:
+    // user_data tags. Operation tokens are small counters, so the top bits mark the backend's own entries.
+    static constexpr uint64_t POLL_TAG = 1ULL << 63;
+    static constexpr uint64_t IGNORED_TAG = 1ULL << 62;
+
+    /**
+     * A watched socket. The poll is one-shot and re-armed after it fires, and each arming gets a new generation
+     * so that completions of earlier, removed polls are recognised and dropped.
+     */
+    struct Poll {
+        uint32_t events = 0;
+        uint32_t generation = 0;
+        bool armed = false;
+    };
+
+    int ringFd = -1;
+    uint8_t* ring = nullptr;
+    size_t ringBytes = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqeBytes = 0;
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned sqEntries = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+    unsigned localTail = 0;
+    unsigned unsubmitted = 0;
+    std::map<int, Poll> polls;
+
+    static uint64_t pollData(int fd, uint32_t generation) {
+        return POLL_TAG | (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd);
+    }
+
+    /**
+     * Gets the next free submission queue entry, submitting what is queued if the queue is full.
+     * @returns Returns the entry, or null if the queue can't be drained.
+     */
+    io_uring_sqe* nextSqe() {
+        unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        if (localTail - head >= sqEntries) {
+            __atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+            syscall(__NR_io_uring_enter, ringFd, unsubmitted, 0, 0, nullptr, 0);
+            unsubmitted = 0;
+            head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+            if (localTail - head >= sqEntries) return nullptr;
+        }
+        unsigned index = localTail & sqMask;
+        io_uring_sqe* sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqArray[index] = index;
+        localTail++;
+        unsubmitted++;
+        return sqe;
+    }
+
+    bool queueFixed(uint8_t opcode, int fd, int index, uint8_t* buffer, size_t length, uint64_t token) {
+        io_uring_sqe* sqe = nextSqe();
+        if (sqe == nullptr) return false;
+        sqe->opcode = opcode;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(buffer);
+        sqe->len = static_cast<uint32_t>(length);
+        sqe->buf_index = static_cast<uint16_t>(index);
+        sqe->user_data = token;
+        return true;
+    }
+
+    bool arm(int fd, Poll& poll) {
+        if (poll.events == 0) return true;
+        io_uring_sqe* sqe = nextSqe();
+        if (sqe == nullptr) return false;
+        // The generation sits below the tag bits of user_data.
+        poll.generation = (poll.generation + 1) & 0x3FFFFFFF;
+        poll.armed = true;
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->poll32_events = ((poll.events & EVENT_READABLE) ? POLLIN : 0) | ((poll.events & EVENT_WRITABLE) ? POLLOUT : 0);
+        sqe->user_data = pollData(fd, poll.generation);
+        return true;
+    }
+
+    void disarm(int fd, Poll& poll) {
+        if (!poll.armed) return;
+        poll.armed = false;
+        io_uring_sqe* sqe = nextSqe();
+        if (sqe == nullptr) return;
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = pollData(fd, poll.generation);
+        sqe->user_data = IGNORED_TAG;
+    }
+
+    int reap(std::vector<std::pair<int, uint32_t>>& ready, std::vector<ReactorCompletion>& completions) {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        int count = 0;
+        for (; head != tail; head++) {
+            const io_uring_cqe& cqe = cqes[head & cqMask];
+            if (cqe.user_data == IGNORED_TAG) continue;
+            if (cqe.user_data & POLL_TAG) {
+                int fd = static_cast<int>(cqe.user_data & 0xFFFFFFFF);
+                uint32_t generation = static_cast<uint32_t>((cqe.user_data >> 32) & 0x3FFFFFFF);
+                auto it = polls.find(fd);
+                if (it == polls.end() || !it->second.armed || it->second.generation != generation || cqe.res < 0) {
+                    continue;
+                }
+                it->second.armed = false;
+                uint32_t flags = 0;
+                if (cqe.res & (POLLIN | POLLERR | POLLHUP)) flags |= EVENT_READABLE;
+                if (cqe.res & (POLLOUT | POLLERR | POLLHUP)) flags |= EVENT_WRITABLE;
+                ready.push_back({ fd, flags });
+                arm(fd, it->second);
+            }
+            else {
+                completions.push_back({ cqe.user_data, cqe.res });
+            }
+            count++;
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        return count;
+    }
+};
+#endif
+
+#ifdef _WIN32
+/**
+ * Performs sends and receives with an IO completion port, so that they are handed to the kernel and completed
+ * without a readiness wait and a second call. Sockets are watched for readiness with WSAEventSelect, and a wait
+ * registered on each socket's event posts the network events to the same port, so that the reactor still sleeps
+ * in one call.
+ */
+class IocpBackend : public ReactorBackend {
+public:
+    ~IocpBackend() override {
+        while (!watches.empty()) {
+            remove(watches.begin()->first);
+        }
+        for (auto& entry : operations) {
+            CancelIoEx(reinterpret_cast<HANDLE>(entry.second->socket), &entry.second->overlapped);
+        }
+        // The kernel owns each OVERLAPPED until its completion is dequeued, so the cancelled operations are drained.
+        OVERLAPPED_ENTRY entries[64];
+        ULONG removed = 0;
+        while (!operations.empty() && GetQueuedCompletionStatusEx(port, entries, 64, &removed, 100, FALSE)) {
+            for (ULONG i = 0; i < removed; i++) {
+                if (entries[i].lpOverlapped != nullptr) {
+                    operations.erase(reinterpret_cast<Operation*>(entries[i].lpOverlapped)->token);
+                }
+            }
+        }
+        if (port != nullptr) CloseHandle(port);
+    }
+    /**
+     * Creates the completion port.
+     * @returns Returns false if the port can't be created.
+     */
+    bool setup() {
+        port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1);
+        return port != nullptr;
+    }
+    bool add(int fd, uint32_t events) override {
+        auto it = watches.find(fd);
+        if (it != watches.end()) return modify(fd, events);
+        std::unique_ptr<Watch> watch(new Watch());
+        watch->port = port;
+        watch->socket = static_cast<SOCKET>(fd);
+        watch->event = WSACreateEvent();
+        if (watch->event == WSA_INVALID_EVENT) return false;
+        if (!selectEvents(*watch, events) ||
+            !RegisterWaitForSingleObject(&watch->wait, watch->event, signalled, watch.get(), INFINITE, WT_EXECUTEINWAITTHREAD)) {
+            WSAEventSelect(watch->socket, nullptr, 0);
+            WSACloseEvent(watch->event);
+            return false;
+        }
+        watches[fd] = std::move(watch);
+        return true;
+    }
+    bool modify(int fd, uint32_t events) override {
+        auto it = watches.find(fd);
+        if (it == watches.end()) return add(fd, events);
+        return selectEvents(*it->second, events);
+    }
+    void remove(int fd) override {
+        auto it = watches.find(fd);
+        if (it == watches.end()) return;
+        Watch& watch = *it->second;
+        // Waits for a running callback, so the watch is not used after it is freed. Events it already posted
+        // are dropped by wait(), as the socket is no longer watched.
+        UnregisterWaitEx(watch.wait, INVALID_HANDLE_VALUE);
+        WSAEventSelect(watch.socket, nullptr, 0);
+        WSACloseEvent(watch.event);
+        watches.erase(it);
+    }
+    int wait(std::vector<std::pair<int, uint32_t>>& ready, std::vector<ReactorCompletion>& completions, int timeoutMs) override {
+        int count = static_cast<int>(failed.size());
+        completions.insert(completions.end(), failed.begin(), failed.end());
+        failed.clear();
+        OVERLAPPED_ENTRY entries[64];
+        ULONG removed = 0;
+        if (!GetQueuedCompletionStatusEx(port, entries, 64, &removed, count > 0 ? 0 : static_cast<DWORD>(timeoutMs), FALSE)) {
+            DWORD error = GetLastError();
+            return error == WAIT_TIMEOUT || error == WAIT_IO_COMPLETION ? count : -1;
+        }
+        for (ULONG i = 0; i < removed; i++) {
+            const OVERLAPPED_ENTRY& entry = entries[i];
+            if (entry.lpOverlapped == nullptr) {
+                // Network events posted by a watch; the key is the socket and the byte count the ReactorEvent flags.
+                int fd = static_cast<int>(entry.lpCompletionKey);
+                auto it = watches.find(fd);
+                if (it == watches.end() || entry.dwNumberOfBytesTransferred == 0) continue;
+                ready.push_back({ fd, entry.dwNumberOfBytesTransferred & it->second->events });
+            }
+            else {
+                Operation* operation = reinterpret_cast<Operation*>(entry.lpOverlapped);
+                DWORD transferred = 0;
+                DWORD flags = 0;
+                int result = static_cast<int>(entry.dwNumberOfBytesTransferred);
+                if (!WSAGetOverlappedResult(operation->socket, &operation->overlapped, &transferred, FALSE, &flags)) {
+                    result = -WSAGetLastError();
+                }
+                completions.push_back({ operation->token, result });
+                operations.erase(operation->token);
+            }
+            count++;
+        }
+        return count;
+    }
+    bool performsIO() const override { return true; }
+    bool queueReceive(int fd, int index, uint8_t* buffer, size_t length, uint64_t token) override {
+        (void)index;
+        Operation* operation = begin(fd, buffer, length, token);
+        if (operation == nullptr) return false;
+        DWORD flags = 0;
+        if (WSARecv(operation->socket, &operation->buffer, 1, nullptr, &flags, &operation->overlapped, nullptr) != 0) {
+            queued(*operation, WSAGetLastError());
+        }
+        return true;
+    }
+    bool queueSend(int fd, int index, const uint8_t* buffer, size_t length, uint64_t token) override {
+        (void)index;
+        Operation* operation = begin(fd, const_cast<uint8_t*>(buffer), length, token);
+        if (operation == nullptr) return false;
+        if (WSASend(operation->socket, &operation->buffer, 1, nullptr, 0, &operation->overlapped, nullptr) != 0) {
+            queued(*operation, WSAGetLastError());
+        }
+        return true;
+    }
+    void cancelOperation(uint64_t token) override {
+        auto it = operations.find(token);
+        if (it == operations.end()) return;
+        // The operation still completes through the port, with WSA_OPERATION_ABORTED, and is freed then.
+        CancelIoEx(reinterpret_cast<HANDLE>(it->second->socket), &it->second->overlapped);
+    }
+    const char* name() const override { return "iocp"; }
+
+private:
+    /**
+     * A watched socket. The event is signalled by WSAEventSelect, and the wait registered on it runs signalled()
+     * on a thread of the system pool.
+     */
+    struct Watch {
+        HANDLE port = nullptr;
+        SOCKET socket = INVALID_SOCKET;
+        WSAEVENT event = WSA_INVALID_EVENT;
+        HANDLE wait = nullptr;
+        uint32_t events = 0;
+    };
+
+    /**
+     * A send or receive handed to the kernel. The OVERLAPPED comes first, so that the pointer the port returns is
+     * the operation.
+     */
+    struct Operation {
+        OVERLAPPED overlapped;
+        SOCKET socket;
+        WSABUF buffer;
+        uint64_t token;
+    };
+
+    HANDLE port = nullptr;
+    std::map<int, std::unique_ptr<Watch>> watches;
+    std::map<uint64_t, std::unique_ptr<Operation>> operations;
+    std::vector<ReactorCompletion> failed;
+
+    /**
+     * Reads and resets the network events of a watch, and posts them to the port as ReactorEvent flags.
+     */
+    static VOID CALLBACK signalled(PVOID context, BOOLEAN timedOut) {
+        (void)timedOut;
+        Watch* watch = static_cast<Watch*>(context);
+        WSANETWORKEVENTS network;
+        if (WSAEnumNetworkEvents(watch->socket, watch->event, &network) != 0) {
+            WSAResetEvent(watch->event);
+            return;
+        }
+        uint32_t flags = 0;
+        if (network.lNetworkEvents & (FD_READ | FD_ACCEPT | FD_CLOSE)) flags |= EVENT_READABLE;
+        if (network.lNetworkEvents & (FD_WRITE | FD_CONNECT | FD_CLOSE)) flags |= EVENT_WRITABLE;
+        if (flags != 0) {
+            PostQueuedCompletionStatus(watch->port, flags, static_cast<ULONG_PTR>(watch->socket), nullptr);
+        }
+    }
+
+    static bool selectEvents(Watch& watch, uint32_t events) {
+        long network = 0;
+        if (events & EVENT_READABLE) network |= FD_READ | FD_ACCEPT | FD_CLOSE;
+        if (events & EVENT_WRITABLE) network |= FD_WRITE | FD_CONNECT | FD_CLOSE;
+        watch.events = events;
+        return WSAEventSelect(watch.socket, watch.event, network) == 0;
+    }
+
+    /**
+     * Associates a socket with the port and creates an operation for it.
+     * @returns Returns the operation, or null if the socket can't be used with the port.
+     */
+    Operation* begin(int fd, uint8_t* buffer, size_t length, uint64_t token) {
+        SOCKET socket = static_cast<SOCKET>(fd);
+        // Socket numbers are reused once closed, so the association is made on every operation, and the error for a
+        // socket that is already associated is accepted.
+        if (CreateIoCompletionPort(reinterpret_cast<HANDLE>(socket), port, 0, 0) == nullptr) {
+            if (GetLastError() != ERROR_INVALID_PARAMETER) return nullptr;
+        }
+        else if (watches.find(fd) == watches.end()) {
+            // Accepted sockets inherit the WSAEventSelect of their listener, which would signal it on every receive.
+            WSAEventSelect(socket, nullptr, 0);
+        }
+        std::unique_ptr<Operation> operation(new Operation());
+        memset(&operation->overlapped, 0, sizeof(operation->overlapped));
+        operation->socket = socket;
+        operation->buffer.buf = reinterpret_cast<char*>(buffer);
+        operation->buffer.len = static_cast<ULONG>(length);
+        operation->token = token;
+        Operation* queued = operation.get();
+        operations[token] = std::move(operation);
+        return queued;
+    }
+
+    /**
+     * Handles the result of WSARecv or WSASend that did not succeed right away. A pending operation completes through
+     * the port; one that failed never does, so its failure is reported by the next wait().
+     */
+    void queued(Operation& operation, int error) {
+        if (error == WSA_IO_PENDING) return;
+        failed.push_back({ operation.token, -error });
+        operations.erase(operation.token);
+    }
+};
+#endif
+
+/**
+ * Waits for readiness with poll, or WSAPoll on Windows.
+ */
+class PollBackend : public ReactorBackend {
+public:
+    bool add(int fd, uint32_t events) override {
+        interest[fd] = events;
+        return true;
+    }
+    bool modify(int fd, uint32_t events) override {
+        interest[fd] = events;
+        return true;
+    }
+    void remove(int fd) override {
+        interest.erase(fd);
+    }
+    int wait(std::vector<std::pair<int, uint32_t>>& ready, std::vector<ReactorCompletion>& completions, int timeoutMs) override {
+        (void)completions;
+        fds.clear();
+        for (const auto& entry : interest) {
+            pollfd pfd;
+            pfd.fd = entry.first;
+            pfd.events = 0;
+            pfd.revents = 0;
+            if (entry.second & EVENT_READABLE) pfd.events |= POLLIN;
+            if (entry.second & EVENT_WRITABLE) pfd.events |= POLLOUT;
+            fds.push_back(pfd);
+        }
+#ifdef _WIN32
+        int count = WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), timeoutMs);
+#else
+        int count = poll(fds.data(), fds.size(), timeoutMs);
+        if (count < 0 && errno == EINTR) return 0;
+#endif
+        if (count < 0) return -1;
+        for (const auto& pfd : fds) {
+            if (pfd.revents == 0) continue;
+            uint32_t flags = 0;
+            if (pfd.revents & (POLLIN | POLLERR | POLLHUP)) flags |= EVENT_READABLE;
+            if (pfd.revents & (POLLOUT | POLLERR | POLLHUP)) flags |= EVENT_WRITABLE;
+            ready.push_back({ static_cast<int>(pfd.fd), flags });
+        }
+        return count;
+    }
+    const char* name() const override { return "poll"; }
+
+private:
+    std::map<int, uint32_t> interest;
+    std::vector<pollfd> fds;
+};
+
+std::unique_ptr<ReactorBackend> createReactorBackend(const std::string& preferred) {
+    if (preferred == "poll") {
+        return std::make_unique<PollBackend>();
+    }
+#if defined(NODALIS_IO_URING)
+    if (preferred == "uring" || preferred == "io_uring") {
+        auto uring = std::make_unique<UringBackend>();
+        if (uring->setup(256)) {
+            return uring;
+        }
+        nodalisError() << "io_uring is not available, using epoll\n";
+    }
+#endif
+#if defined(_WIN32)
+    auto iocp = std::make_unique<IocpBackend>();
+    if (iocp->setup()) {
+        return iocp;
+    }
+    nodalisError() << "The IO completion port could not be created, using WSAPoll\n";
+    return std::make_unique<PollBackend>();
+#elif defined(__linux__)
+    return std::make_unique<EpollBackend>();
+#elif defined(NODALIS_KQUEUE)
+    return std::make_unique<KqueueBackend>();
+#else
+    return std::make_unique<PollBackend>();
+#endif
+}
+
+// ========== Reactor ==========
+
+IOReactor::IOReactor(const std::string& name, const std::string& backendName)
+    : name(name), backend(createReactorBackend(backendName)) {
+    bufferPool.resize(BUFFER_SIZE * BUFFER_COUNT);
+    for (int i = static_cast<int>(BUFFER_COUNT) - 1; i >= 0; i--) {
+        freeBuffers.push_back(i);
+    }
+    if (backend->performsIO() && !backend->registerBuffers(bufferPool.data(), BUFFER_SIZE, BUFFER_COUNT)) {
+        nodalisError() << "IO reactor " << name << " could not register its buffers, using epoll\n";
+        backend = createReactorBackend();
+    }
+#ifdef _WIN32
+    // Windows has no pipes that can be polled, so the reactor wakes itself with a datagram to a loopback socket.
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2,2), &wsa);
+    SOCKET sock = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int len = sizeof(addr);
+    bind(sock, (sockaddr*)&addr, sizeof(addr));
+    getsockname(sock, (sockaddr*)&addr, &len);
+    ::connect(sock, (sockaddr*)&addr, sizeof(addr));
+    u_long mode = 1;
+    ioctlsocket(sock, FIONBIO, &mode);
+    wakeRead = wakeWrite = static_cast<int>(sock);
+#else
+    int fds[2];
+    if (pipe(fds) == 0) {
+        fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK);
+        fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL, 0) | O_NONBLOCK);
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        wakeRead = fds[0];
+        wakeWrite = fds[1];
+    }
+#endif
+    backend->add(wakeRead, EVENT_READABLE);
+}
+
+IOReactor::~IOReactor() {
+    stop();
+    backend->remove(wakeRead);
+#ifdef _WIN32
+    closesocket(wakeRead);
+#else
+    close(wakeRead);
+    close(wakeWrite);
+#endif
+}
+
+void IOReactor::start() {
+    if (!running) {
+        running = true;
+        thread = std::thread(&IOReactor::run, this);
+    }
+}
+
+void IOReactor::stop() {
+    if (running) {
+        running = false;
+        wake();
+        if (thread.joinable() && !inLoop()) {
+            thread.join();
+        }
+    }
+}
+
+bool IOReactor::inLoop() const {
+    return std::this_thread::get_id() == loopThread;
+}
+
+const std::string& IOReactor::getName() const {
+    return name;
+}
+
+const char* IOReactor::getBackendName() const {
+    return backend->name();
+}
+
+bool IOReactor::watch(int fd, uint32_t events, Handler handler) {
+    auto it = handlers.find(fd);
+    if (it != handlers.end()) {
+        it->second = { events, std::move(handler) };
+        return backend->modify(fd, events);
+    }
+    if (!backend->add(fd, events)) {
+        return false;
+    }
+    handlers[fd] = { events, std::move(handler) };
+    return true;
+}
+
+void IOReactor::modify(int fd, uint32_t events) {
+    auto it = handlers.find(fd);
+    if (it != handlers.end() && it->second.first != events) {
+        it->second.first = events;
+        backend->modify(fd, events);
+    }
+}
+
+void IOReactor::unwatch(int fd) {
+    if (handlers.erase(fd) > 0) {
+        backend->remove(fd);
+    }
+}
+
+uint64_t IOReactor::schedule(Clock::time_point when, Task task) {
+    uint64_t id = nextTimer++;
+    timers[id] = std::move(task);
+    timerQueue.insert({ when, id });
+    return id;
+}
+
+void IOReactor::cancel(uint64_t timer) {
+    // The queue entry is left in place and skipped when it comes due.
+    timers.erase(timer);
+}
+
+void IOReactor::post(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(postMutex);
+        posted.push_back(std::move(task));
+    }
+    wake();
+}
+
+void IOReactor::runSync(Task task) {
+    if (!running || inLoop()) {
+        task();
+        return;
+    }
+    std::promise<void> done;
+    auto finished = done.get_future();
+    post([&]() {
+        task();
+        done.set_value();
+    });
+    finished.wait();
+}
+
+/**
+ * Gets the error of the last failed socket call as a negative number.
+ * @returns Returns the negated error code.
+ */
+static int lastSocketError() {
+#ifdef _WIN32
+    return -WSAGetLastError();
+#else
+    return -errno;
+#endif
+}
+
+/**
+ * Checks whether a socket error means the call would have blocked.
+ * @param error The negated error code.
+ * @returns Returns true if the call would have blocked.
+ */
+static bool wouldBlock(int error) {
+#ifdef _WIN32
+    return error == -WSAEWOULDBLOCK;
+#else
+    return error == -EAGAIN || error == -EWOULDBLOCK;
+#endif
+}
+
+/**
+ * Sends on a non-blocking socket.
+ * @param fd The socket.
+ * @param data The data to send.
+ * @param length The number of bytes to send.
+ * @returns Returns the number of bytes sent, or the negated error code.
+ */
+static int sendNow(int fd, const uint8_t* data, size_t length) {
+#ifdef MSG_NOSIGNAL
+    int flags = MSG_NOSIGNAL;
+#else
+    int flags = 0;
+#endif
+    int sent = static_cast<int>(::send(fd, reinterpret_cast<const char*>(data), static_cast<int>(length), flags));
+    return sent >= 0 ? sent : lastSocketError();
+}
+
+int IOReactor::takeBuffer() {
+    if (freeBuffers.empty()) return -1;
+    int index = freeBuffers.back();
+    freeBuffers.pop_back();
+    return index;
+}
+
+uint8_t* IOReactor::bufferAt(int index) {
+    return bufferPool.data() + static_cast<size_t>(index) * BUFFER_SIZE;
+}
+
+bool IOReactor::submitReceive(int fd, Completion done) {
+    int buffer = takeBuffer();
+    if (buffer < 0) return false;
+    uint64_t token = nextOperation++;
+    operations[token] = { fd, false, buffer, BUFFER_SIZE, std::move(done) };
+    if (backend->performsIO()) {
+        if (!backend->queueReceive(fd, buffer, bufferAt(buffer), BUFFER_SIZE, token)) {
+            operations.erase(token);
+            freeBuffers.push_back(buffer);
+            return false;
+        }
+        return true;
+    }
+    socketOperations[fd].first = token;
+    updateIOInterest(fd);
+    return true;
+}
+
+size_t IOReactor::submitSend(int fd, const uint8_t* data, size_t length, Completion done) {
+    int buffer = takeBuffer();
+    if (buffer < 0) return 0;
+    size_t taken = length < BUFFER_SIZE ? length : BUFFER_SIZE;
+    memcpy(bufferAt(buffer), data, taken);
+    uint64_t token = nextOperation++;
+    operations[token] = { fd, true, buffer, taken, std::move(done) };
+    if (backend->performsIO()) {
+        if (!backend->queueSend(fd, buffer, bufferAt(buffer), taken, token)) {
+            operations.erase(token);
+            freeBuffers.push_back(buffer);
+            return 0;
+        }
+        return taken;
+    }
+    // Most sends fit in the socket buffer, so try right away and only wait for writability if it is full. The
+    // completion is deferred to the loop so that it never runs inside the caller.
+    int result = sendNow(fd, bufferAt(buffer), taken);
+    if (wouldBlock(result)) {
+        socketOperations[fd].second = token;
+        updateIOInterest(fd);
+    }
+    else {
+        completions.push_back({ token, result });
+    }
+    return taken;
+}
+
+void IOReactor::cancelIO(int fd) {
+    for (auto& entry : operations) {
+        if (entry.second.fd != fd || !entry.second.done) continue;
+        entry.second.done = nullptr;
+        if (backend->performsIO()) {
+            // The kernel may still be using the buffer, so the operation is kept until its completion arrives.
+            backend->cancelOperation(entry.first);
+        }
+    }
+    if (!backend->performsIO()) {
+        auto it = socketOperations.find(fd);
+        if (it != socketOperations.end()) {
+            if (it->second.first != 0) complete(it->second.first, 0);
+            if (it->second.second != 0) complete(it->second.second, 0);
+            socketOperations.erase(it);
+        }
+        unwatch(fd);
+    }
+}
+
+void IOReactor::complete(uint64_t token, int result) {
+    auto it = operations.find(token);
+    if (it == operations.end()) return;
+    Operation operation = std::move(it->second);
+    operations.erase(it);
+    if (operation.done) {
+        operation.done(operation.isSend ? nullptr : bufferAt(operation.buffer), result);
+    }
+    freeBuffers.push_back(operation.buffer);
+}
+
+void IOReactor::performIO(int fd, uint32_t events) {
+    auto it = socketOperations.find(fd);
+    if (it == socketOperations.end()) return;
+    uint64_t receive = it->second.first;
+    uint64_t sendToken = it->second.second;
+    // Completions may submit new operations on the socket, so the tokens are cleared before they run.
+    if ((events & EVENT_WRITABLE) && sendToken != 0) {
+        Operation& operation = operations[sendToken];
+        int result = sendNow(fd, bufferAt(operation.buffer), operation.length);
+        if (!wouldBlock(result)) {
+            socketOperations[fd].second = 0;
+            complete(sendToken, result);
+        }
+    }
+    if ((events & EVENT_READABLE) && receive != 0) {
+        Operation& operation = operations[receive];
+        int received = static_cast<int>(::recv(fd, reinterpret_cast<char*>(bufferAt(operation.buffer)), static_cast<int>(operation.length), 0));
+        int result = received >= 0 ? received : lastSocketError();
+        if (!wouldBlock(result)) {
+            socketOperations[fd].first = 0;
+            complete(receive, result);
+        }
+    }
+    updateIOInterest(fd);
+}
+
+void IOReactor::updateIOInterest(int fd) {
+    auto it = socketOperations.find(fd);
+    if (it == socketOperations.end()) return;
+    uint32_t events = (it->second.first != 0 ? static_cast<uint32_t>(EVENT_READABLE) : 0u) |
+        (it->second.second != 0 ? static_cast<uint32_t>(EVENT_WRITABLE) : 0u);
+    if (events == 0) {
+        // Keep the registration while a receive is likely to be submitted again; it is only dropped by cancelIO().
+        modify(fd, 0);
+        return;
+    }
+    if (handlers.find(fd) == handlers.end()) {
+        watch(fd, events, [this, fd](uint32_t ready) { performIO(fd, ready); });
+    }
+    else {
+        modify(fd, events);
+    }
+}
+
+void IOReactor::wake() {
+    uint8_t byte = 1;
+#ifdef _WIN32
+    send(wakeWrite, reinterpret_cast<const char*>(&byte), 1, 0);
+#else
+    ssize_t ret = write(wakeWrite, &byte, 1);
+    (void)ret; // A full pipe already has a wake up pending.
+#endif
+}
+
+void IOReactor::runPosted() {
+    std::vector<Task> tasks;
+    {
+        std::lock_guard<std::mutex> lock(postMutex);
+        tasks.swap(posted);
+    }
+    for (auto& task : tasks) {
+        task();
+    }
+}
+
+void IOReactor::runTimers() {
+    auto now = Clock::now();
+    while (!timerQueue.empty() && timerQueue.begin()->first <= now) {
+        uint64_t id = timerQueue.begin()->second;
+        timerQueue.erase(timerQueue.begin());
+        auto it = timers.find(id);
+        if (it == timers.end()) {
+            continue; // cancelled
+        }
+        Task task = std::move(it->second);
+        timers.erase(it);
+        task();
+    }
+}
+
+void IOReactor::run() {
+    loopThread = std::this_thread::get_id();
+    moveToBackground();
+    NODALIS_TRACE_THREAD("IO reactor " + name);
+    nodalisLog() << "IO reactor " << name << " running with " << backend->name() << "\n";
+    std::vector<std::pair<int, uint32_t>> ready;
+    while (running) {
+        runPosted();
+        runTimers();
+
+        // Sleep until the next timer, rounding up so that a timer is never polled for early.
+        int timeout = 1000;
+        if (!timerQueue.empty()) {
+            auto wait = std::chrono::duration_cast<std::chrono::microseconds>(timerQueue.begin()->first - Clock::now()).count();
+            timeout = wait <= 0 ? 0 : static_cast<int>(wait < 1000000 ? (wait + 999) / 1000 : 1000);
+        }
+        if (!completions.empty()) {
+            timeout = 0;
+        }
+        ready.clear();
+        if (backend->wait(ready, completions, timeout) < 0) {
+            nodalisError() << "IO reactor " << name << " wait failed\n";
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+        for (const auto& entry : ready) {
+            if (entry.first == wakeRead) {
+                uint8_t buf[64];
+#ifdef _WIN32
+                while (recv(wakeRead, reinterpret_cast<char*>(buf), sizeof(buf), 0) > 0) {}
+#else
+                while (read(wakeRead, buf, sizeof(buf)) > 0) {}
+#endif
+                continue;
+            }
+            // A handler may unwatch other sockets, or its own, so each one is looked up when its turn comes.
+            auto it = handlers.find(entry.first);
+            if (it == handlers.end()) {
+                continue;
+            }
+            uint32_t events = entry.second & it->second.first;
+            if (events != 0) {
+                Handler handler = it->second.second;
+                handler(events);
+            }
+        }
+        // Completions can queue more deferred completions, which run in the same pass.
+        for (size_t i = 0; i < completions.size(); i++) {
+            ReactorCompletion completion = completions[i];
+            complete(completion.token, completion.result);
+        }
+        completions.clear();
+    }
+    // Run anything that was posted while stopping, so callers of runSync() are never left waiting.
+    runPosted();
+}
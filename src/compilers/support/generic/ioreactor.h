@@ -0,0 +1,354 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC IO Reactor
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+#pragma once
+#ifndef IOREACTOR_H
+#define IOREACTOR_H
+
+#include <cstdint>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <vector>
+
+/**
+ * The readiness events a socket can be watched for.
+ */
+enum ReactorEvent : uint32_t {
+    EVENT_READABLE = 0x01,
+    EVENT_WRITABLE = 0x02
+};
+
+/**
+ * The result of a send or receive that a backend performed itself.
+ */
+struct ReactorCompletion {
+    uint64_t token;     // The token the operation was queued with.
+    int result;         // The number of bytes transferred, or a negative error code.
+};
+
+/**
+ * Waits for readiness on a set of sockets. This is implemented with epoll on Linux, kqueue on macOS and the BSDs,
+ * and poll (WSAPoll on Windows) everywhere else. The io_uring backend also performs sends and receives itself, so
+ * that everything queued during a loop is submitted with the wait in one system call, and so does the IO completion
+ * port backend on Windows.
+ */
+class ReactorBackend {
+public:
+    virtual ~ReactorBackend() = default;
+    /**
+     * Starts watching a socket.
+     * @param fd The socket.
+     * @param events The ReactorEvent flags to watch for.
+     * @returns Returns false if the socket can't be watched.
+     */
+    virtual bool add(int fd, uint32_t events) = 0;
+    /**
+     * Changes the events a watched socket is watched for.
+     * @param fd The socket.
+     * @param events The ReactorEvent flags to watch for.
+     * @returns Returns false if the change failed.
+     */
+    virtual bool modify(int fd, uint32_t events) = 0;
+    /**
+     * Stops watching a socket.
+     * @param fd The socket.
+     */
+    virtual void remove(int fd) = 0;
+    /**
+     * Waits for at least one watched socket to become ready or one queued operation to complete. Errors and hang
+     * ups are reported as readiness for the watched events, so that the next read or write on the socket reports them.
+     * @param ready Receives the ready sockets and their events.
+     * @param completions Receives the operations that completed.
+     * @param timeoutMs The longest time to wait, in milliseconds.
+     * @returns Returns the number of events, or -1 on error.
+     */
+    virtual int wait(std::vector<std::pair<int, uint32_t>>& ready, std::vector<ReactorCompletion>& completions, int timeoutMs) = 0;
+    /**
+     * Checks whether the backend performs sends and receives itself. Otherwise the reactor performs them when the
+     * socket is ready.
+     * @returns Returns true if queueSend() and queueReceive() are supported.
+     */
+    virtual bool performsIO() const { return false; }
+    /**
+     * Registers the reactor's buffer pool with the backend.
+     * @param base The first buffer.
+     * @param size The size of each buffer.
+     * @param count The number of buffers.
+     * @returns Returns false if the buffers can't be registered.
+     */
+    virtual bool registerBuffers(uint8_t* base, size_t size, size_t count) { (void)base; (void)size; (void)count; return true; }
+    /**
+     * Queues a receive into a registered buffer.
+     * @param fd The socket.
+     * @param index The index of the buffer.
+     * @param buffer The buffer.
+     * @param length The size of the buffer.
+     * @param token The token to complete the operation with.
+     * @returns Returns false if the operation can't be queued.
+     */
+    virtual bool queueReceive(int fd, int index, uint8_t* buffer, size_t length, uint64_t token) {
+        (void)fd; (void)index; (void)buffer; (void)length; (void)token; return false;
+    }
+    /**
+     * Queues a send from a registered buffer.
+     * @param fd The socket.
+     * @param index The index of the buffer.
+     * @param buffer The buffer.
+     * @param length The number of bytes to send.
+     * @param token The token to complete the operation with.
+     * @returns Returns false if the operation can't be queued.
+     */
+    virtual bool queueSend(int fd, int index, const uint8_t* buffer, size_t length, uint64_t token) {
+        (void)fd; (void)index; (void)buffer; (void)length; (void)token; return false;
+    }
+    /**
+     * Cancels a queued operation. Its completion is still reported, usually with an error.
+     * @param token The token of the operation.
+     */
+    virtual void cancelOperation(uint64_t token) { (void)token; }
+    /**
+     * Gets the name of the backend, for logging.
+     * @returns Returns the name.
+     */
+    virtual const char* name() const = 0;
+};
+
+/**
+ * Creates a reactor backend.
+ * @param preferred The name of the backend to use: "epoll", "kqueue", "poll", "uring" or "iocp". If it is empty or
+ * not available, the best backend for the platform is used, which is "iocp" on Windows.
+ * @returns Returns the backend.
+ */
+std::unique_ptr<ReactorBackend> createReactorBackend(const std::string& preferred = "");
+
+/**
+ * An event loop that multiplexes the sockets of many IO clients on one thread. Clients register readiness handlers
+ * for their sockets and timers for their polls, and the reactor calls them from its thread, so one thread can serve
+ * many devices without blocking on any of them.
+ *
+ * watch(), unwatch(), schedule() and cancel() must be called from the reactor thread, which is where all handlers
+ * and timers run. Other threads hand work to the reactor with post() or runSync().
+ */
+class IOReactor {
+public:
+    using Clock = std::chrono::steady_clock;
+    /**
+     * A readiness handler, called with the ReactorEvent flags that are ready.
+     */
+    using Handler = std::function<void(uint32_t events)>;
+    using Task = std::function<void()>;
+    /**
+     * The completion of a send or receive, called with the received data (null for sends) and the number of bytes
+     * transferred, 0 if the peer closed the connection, or a negative error code.
+     */
+    using Completion = std::function<void(const uint8_t* data, int result)>;
+
+    /**
+     * The size of each buffer in the reactor's pool. It holds any Modbus/TCP ADU or BACnet/IP datagram.
+     */
+    static constexpr size_t BUFFER_SIZE = 2048;
+    /**
+     * The number of buffers in the reactor's pool, which bounds the operations that can be outstanding at once.
+     */
+    static constexpr size_t BUFFER_COUNT = 256;
+
+    /**
+     * Constructs a new reactor.
+     * @param name The name of the reactor, for logging.
+     * @param backendName The backend to use, as accepted by createReactorBackend().
+     */
+    IOReactor(const std::string& name, const std::string& backendName = "");
+    ~IOReactor();
+
+    /**
+     * Starts the reactor thread.
+     */
+    void start();
+    /**
+     * Stops the reactor thread, waiting for the current handler to finish.
+     */
+    void stop();
+
+    /**
+     * Watches a socket, or changes the events of a socket that is already watched.
+     * @param fd The socket.
+     * @param events The ReactorEvent flags to watch for.
+     * @param handler The handler to call when the socket is ready.
+     * @returns Returns false if the socket can't be watched.
+     */
+    bool watch(int fd, uint32_t events, Handler handler);
+    /**
+     * Changes the events of a watched socket, keeping its handler.
+     * @param fd The socket.
+     * @param events The ReactorEvent flags to watch for.
+     */
+    void modify(int fd, uint32_t events);
+    /**
+     * Stops watching a socket. This must be called before the socket is closed.
+     * @param fd The socket.
+     */
+    void unwatch(int fd);
+    /**
+     * Schedules a task to run on the reactor thread at a given time.
+     * @param when The time at which to run the task.
+     * @param task The task.
+     * @returns Returns an ID that can be passed to cancel().
+     */
+    uint64_t schedule(Clock::time_point when, Task task);
+    /**
+     * Cancels a scheduled task that hasn't run yet.
+     * @param timer The ID returned by schedule().
+     */
+    void cancel(uint64_t timer);
+    /**
+     * Queues a task to run on the reactor thread. This can be called from any thread.
+     * @param task The task.
+     */
+    void post(Task task);
+    /**
+     * Runs a task on the reactor thread and waits for it to finish. If the reactor isn't running, or this is the
+     * reactor thread, the task runs right away.
+     * @param task The task.
+     */
+    void runSync(Task task);
+    /**
+     * Receives from a connected socket into a pool buffer. The data passed to the completion is only valid during
+     * the call. Only one receive may be outstanding per socket, and a socket with outstanding operations must not
+     * be watched by the caller.
+     * @param fd The socket.
+     * @param done The completion.
+     * @returns Returns false if no buffer is free.
+     */
+    bool submitReceive(int fd, Completion done);
+    /**
+     * Sends from a connected socket. The data is copied into a pool buffer, so it doesn't need to outlive the call.
+     * At most BUFFER_SIZE bytes are taken. Only one send should be outstanding per socket, so that the stream stays
+     * in order.
+     * @param fd The socket.
+     * @param data The data to send.
+     * @param length The number of bytes to send.
+     * @param done The completion, called with the number of bytes sent, which may be fewer than were taken.
+     * @returns Returns the number of bytes taken, or 0 if no buffer is free.
+     */
+    size_t submitSend(int fd, const uint8_t* data, size_t length, Completion done);
+    /**
+     * Cancels the outstanding sends and receives on a socket. Their completions are not called. This must be
+     * called before the socket is closed.
+     * @param fd The socket.
+     */
+    void cancelIO(int fd);
+    /**
+     * Gets the name of the backend in use.
+     * @returns Returns the name.
+     */
+    const char* getBackendName() const;
+
+    /**
+     * Checks whether the calling thread is the reactor thread.
+     * @returns Returns true if this is the reactor thread.
+     */
+    bool inLoop() const;
+
+    const std::string& getName() const;
+
+private:
+    std::string name;
+    std::unique_ptr<ReactorBackend> backend;
+    std::map<int, std::pair<uint32_t, Handler>> handlers;
+    std::multimap<Clock::time_point, uint64_t> timerQueue;
+    std::map<uint64_t, Task> timers;
+    uint64_t nextTimer = 1;
+
+    /**
+     * A send or receive that is outstanding.
+     */
+    struct Operation {
+        int fd;
+        bool isSend;
+        int buffer;         // The index of the pool buffer.
+        size_t length;      // The number of bytes to send, or the size of the receive buffer.
+        Completion done;    // Null once the operation is cancelled.
+    };
+    std::map<uint64_t, Operation> operations;
+    uint64_t nextOperation = 1;
+    // The outstanding receive and send tokens of each socket, for backends that don't perform IO themselves.
+    std::map<int, std::pair<uint64_t, uint64_t>> socketOperations;
+    std::vector<ReactorCompletion> completions;
+    std::vector<uint8_t> bufferPool;
+    std::vector<int> freeBuffers;
+
+    std::mutex postMutex;
+    std::vector<Task> posted;
+    // The socket pair used to wake the reactor thread when work is posted.
+    int wakeRead = -1;
+    int wakeWrite = -1;
+
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::thread::id loopThread;
+
+    /**
+     * The loop of the reactor thread.
+     */
+    void run();
+    /**
+     * Wakes the reactor thread from its wait.
+     */
+    void wake();
+    /**
+     * Runs the tasks that were posted since the last call.
+     */
+    void runPosted();
+    /**
+     * Runs the timers that are due.
+     */
+    void runTimers();
+    /**
+     * Gets a buffer from the pool.
+     * @returns Returns the index of the buffer, or -1 if none is free.
+     */
+    int takeBuffer();
+    uint8_t* bufferAt(int index);
+    /**
+     * Performs the outstanding operations of a ready socket, for backends that don't perform IO themselves.
+     * @param fd The socket.
+     * @param events The ReactorEvent flags that are ready.
+     */
+    void performIO(int fd, uint32_t events);
+    /**
+     * Watches a socket for the outstanding operations on it, for backends that don't perform IO themselves.
+     * @param fd The socket.
+     */
+    void updateIOInterest(int fd);
+    /**
+     * Completes an operation, calling its completion unless it was cancelled, and returns its buffer to the pool.
+     * @param token The token of the operation.
+     * @param result The result of the operation.
+     */
+    void complete(uint64_t token, int result);
+};
+
+#endif // IOREACTOR_H
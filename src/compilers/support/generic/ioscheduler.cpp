@@ -0,0 +1,202 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC IO Request Scheduling
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+#include "ioscheduler.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+
+/**
+ * The milliseconds of its rate a token bucket holds, which is the burst a device takes after a quiet spell.
+ */
+static constexpr double BUCKET_BURST_MILLIS = 100;
+
+/**
+ * The mappings each priority class of a device takes in its turn, by IOPriority. Critical mappings aren't queued.
+ */
+static constexpr int CLASS_QUANTUM[4] = { 0, 4, 2, 1 };
+
+bool parseIOPriority(const std::string& text, IOPriority& priority) {
+    std::string name;
+    for (char c : text) {
+        name += static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+    if (name == "CRITICAL") priority = IOPriority::Critical;
+    else if (name == "HIGH") priority = IOPriority::High;
+    else if (name == "NORMAL") priority = IOPriority::Normal;
+    else if (name == "LOW") priority = IOPriority::Low;
+    else return false;
+    return true;
+}
+
+void TokenBucket::configure(double tokensPerSecond, uint64_t now) {
+    rate = tokensPerSecond > 0 ? tokensPerSecond : 0;
+    capacity = std::max(1.0, rate * BUCKET_BURST_MILLIS / 1000);
+    tokens = capacity;
+    refilled = now;
+}
+
+void TokenBucket::refill(uint64_t now) {
+    if (rate > 0 && now > refilled) {
+        tokens = std::min(capacity, tokens + rate * static_cast<double>(now - refilled) / 1000);
+    }
+    refilled = now;
+}
+
+uint64_t TokenBucket::readyAt(uint64_t now) const {
+    if (rate <= 0) {
+        return now;
+    }
+    double current = tokens + (now > refilled ? rate * static_cast<double>(now - refilled) / 1000 : 0);
+    if (current > 0) {
+        return now;
+    }
+    // The first whole millisecond at which the debt has been paid off.
+    return now + static_cast<uint64_t>(std::floor(-current * 1000 / rate)) + 1;
+}
+
+IORequestScheduler::IORequestScheduler(double requestRate, double byteRate, size_t batchLimit) :
+    requestRate(requestRate), byteRate(byteRate), batchLimit(batchLimit) {
+}
+
+void IORequestScheduler::add(size_t index, const IOMap& map, IOPriority priority, const std::string& device,
+    double deviceRequestRate, double deviceByteRate, double weight) {
+    uint64_t now = elapsed();
+    auto it = deviceIndex.find(device);
+    if (it == deviceIndex.end()) {
+        it = deviceIndex.emplace(device, static_cast<uint32_t>(devices.size())).first;
+        devices.emplace_back();
+        devices.back().requests.configure(requestRate, now);
+        devices.back().bytes.configure(byteRate, now);
+    }
+    Device& state = devices[it->second];
+    if (!state.configured && (deviceRequestRate >= 0 || deviceByteRate >= 0 || weight > 0)) {
+        state.configured = true;
+        if (deviceRequestRate >= 0) {
+            state.requests.configure(deviceRequestRate, now);
+        }
+        if (deviceByteRate >= 0) {
+            state.bytes.configure(deviceByteRate, now);
+        }
+        if (weight > 0) {
+            state.weight = weight;
+        }
+    }
+    if (members.size() <= index) {
+        members.resize(index + 1);
+    }
+    Member& member = members[index];
+    member.device = it->second;
+    member.priority = priority;
+    member.bytes = map.width > 8 ? (map.width + 7) / 8 : 1;
+}
+
+size_t IORequestScheduler::admit(std::vector<IOMap*>& due, IOMap* mappings, uint64_t now) {
+    admitted.clear();
+    for (IOMap* map : due) {
+        size_t index = static_cast<size_t>(map - mappings);
+        Member& member = members[index];
+        Device& device = devices[member.device];
+        if (member.priority == IOPriority::Critical) {
+            device.requests.refill(now);
+            device.bytes.refill(now);
+            device.requests.charge(1);
+            device.bytes.charge(member.bytes);
+            admitted.push_back(map);
+            continue;
+        }
+        // A mapping that is still queued when it is due again is sent once, with the value it has when it is sent.
+        if (member.queued) {
+            continue;
+        }
+        member.queued = true;
+        // A device that had no work rejoins at the current virtual time, rather than with credit for its quiet spell.
+        if (device.queued == 0) {
+            device.virtualTime = std::max(device.virtualTime, virtualTime);
+        }
+        device.queues[static_cast<size_t>(member.priority)].push_back(index);
+        device.queued++;
+        backlog++;
+    }
+    for (Device& device : devices) {
+        if (device.queued > 0) {
+            device.requests.refill(now);
+            device.bytes.refill(now);
+        }
+    }
+    size_t sent = 0;
+    while (backlog > 0 && (batchLimit == 0 || sent < batchLimit)) {
+        Device* next = nullptr;
+        for (Device& device : devices) {
+            if (device.queued > 0 && device.requests.available() && device.bytes.available()
+                && (next == nullptr || device.virtualTime < next->virtualTime)) {
+                next = &device;
+            }
+        }
+        if (next == nullptr) {
+            break;
+        }
+        size_t index = take(*next);
+        Member& member = members[index];
+        member.queued = false;
+        next->queued--;
+        backlog--;
+        next->requests.charge(1);
+        next->bytes.charge(member.bytes);
+        virtualTime = next->virtualTime;
+        next->virtualTime += 1 / next->weight;
+        admitted.push_back(&mappings[index]);
+        sent++;
+    }
+    due.swap(admitted);
+    // Clients expect the mappings in the order they were added, to coalesce neighbours into block requests.
+    std::sort(due.begin(), due.end());
+    return backlog;
+}
+
+uint64_t IORequestScheduler::nextReady(uint64_t now) const {
+    if (backlog == 0) {
+        return UINT64_MAX;
+    }
+    uint64_t ready = UINT64_MAX;
+    for (const Device& device : devices) {
+        if (device.queued > 0) {
+            ready = std::min(ready, std::max(device.requests.readyAt(now), device.bytes.readyAt(now)));
+        }
+    }
+    return ready;
+}
+
+size_t IORequestScheduler::take(Device& device) {
+    for (;;) {
+        for (size_t c = 1; c < 4; c++) {
+            if (!device.queues[c].empty() && device.credits[c] > 0) {
+                device.credits[c]--;
+                size_t index = device.queues[c].front();
+                device.queues[c].pop_front();
+                return index;
+            }
+        }
+        // Every class with work has used its turn, so they all start another.
+        for (size_t c = 1; c < 4; c++) {
+            device.credits[c] = device.queues[c].empty() ? 0 : CLASS_QUANTUM[c];
+        }
+    }
+}
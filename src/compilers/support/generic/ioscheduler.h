@@ -0,0 +1,173 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC IO Request Scheduling
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * Shares the requests of an IO client fairly between the devices it serves, so that a slow gateway or a Modbus RTU
+ * slave with many points doesn't starve the others, and keeps each device under the request and byte rates it can
+ * take. A device is the ModuleID of a mapping, with its UnitID if it sets one, so the slaves of a serial line and the
+ * units behind a gateway are each a device.
+ *
+ * Each device has a token bucket of requests per second and one of bytes per second, which hold about 100 ms of their
+ * rate. The mappings that are due are queued by device and by priority, and taken from the devices whose buckets have
+ * tokens, lowest virtual time first: a device's virtual time advances by 1 / Weight with each request, so devices
+ * are served in proportion to their Weight while they all have work. Within a device the High, Normal and Low
+ * mappings are taken 4, 2 and 1 at a time. Critical mappings are never queued: they are sent when they are due and
+ * charged to their device's buckets, which may go into debt for them.
+ *
+ * A mapping exchange counts as one request, and its width, rounded up to bytes, as its bytes. Clients that coalesce
+ * mappings into block requests make fewer requests than that, so the budget is conservative for them.
+ */
+#pragma once
+#ifndef IOSCHEDULER_H
+#define IOSCHEDULER_H
+
+#include "nodalis.h"
+#include <deque>
+#include <unordered_map>
+
+/**
+ * The priority class of a mapping (Priority).
+ */
+enum class IOPriority : uint8_t {
+    Critical = 0,
+    High = 1,
+    Normal = 2,
+    Low = 3
+};
+
+/**
+ * Parses a priority class, ignoring case.
+ * @param text The name of the class.
+ * @param priority Receives the class.
+ * @returns Returns false if the text doesn't name a class.
+ */
+bool parseIOPriority(const std::string& text, IOPriority& priority);
+
+/**
+ * A token bucket, refilled at a rate per second up to a capacity.
+ */
+class TokenBucket {
+public:
+    /**
+     * Sets the rate of the bucket, and fills it.
+     * @param rate The tokens per second, or 0 for no limit.
+     * @param now The current time, in milliseconds since the program started.
+     */
+    void configure(double rate, uint64_t now);
+    /**
+     * Refills the bucket for the time since it was last refilled.
+     * @param now The current time, in milliseconds since the program started.
+     */
+    void refill(uint64_t now);
+    /**
+     * Checks whether the bucket has tokens. A bucket without a limit always has.
+     */
+    bool available() const { return rate <= 0 || tokens > 0; }
+    /**
+     * Takes tokens from the bucket, which may go into debt.
+     * @param cost The tokens.
+     */
+    void charge(double cost) { if (rate > 0) tokens -= cost; }
+    /**
+     * Gets the time at which the bucket next has tokens.
+     * @param now The current time, in milliseconds since the program started.
+     * @returns Returns now if it has tokens already.
+     */
+    uint64_t readyAt(uint64_t now) const;
+private:
+    double rate = 0;
+    double capacity = 0;
+    double tokens = 0;
+    uint64_t refilled = 0;
+};
+
+/**
+ * Chooses which of the due mappings of an IO client are sent in a poll, and queues the rest for later polls. Used by
+ * IOClient::collectDue() with the mapping mutex held.
+ */
+class IORequestScheduler {
+public:
+    /**
+     * Sets the limits used for devices whose mappings set none.
+     * @param requestRate The requests per second of each device, or 0 for no limit (--io-request-rate).
+     * @param byteRate The bytes per second of each device, or 0 for no limit (--io-byte-rate).
+     * @param batchLimit The queued mappings sent in one poll, or 0 for no limit (--io-batch-limit).
+     */
+    IORequestScheduler(double requestRate, double byteRate, size_t batchLimit);
+    /**
+     * Adds a mapping. The first mapping of a device that sets RequestRate, ByteRate or Weight sets them for the device.
+     * @param index The index of the mapping in the client's mappings.
+     * @param map The mapping.
+     * @param priority The priority class of the mapping.
+     * @param device The device the mapping belongs to.
+     * @param requestRate The requests per second of the device, or a negative number if the mapping sets none.
+     * @param byteRate The bytes per second of the device, or a negative number if the mapping sets none.
+     * @param weight The share of the device, or a negative number if the mapping sets none.
+     */
+    void add(size_t index, const IOMap& map, IOPriority priority, const std::string& device, double requestRate,
+        double byteRate, double weight);
+    /**
+     * Replaces the due mappings with the ones to send now: the Critical ones, then the queued ones the budgets allow,
+     * in fair order. The others stay queued for a later call.
+     * @param due The due mappings, which point into mappings. They are replaced by the mappings to send.
+     * @param mappings The first of the client's mappings.
+     * @param now The current time, in milliseconds since the program started.
+     * @returns Returns the number of mappings that stay queued.
+     */
+    size_t admit(std::vector<IOMap*>& due, IOMap* mappings, uint64_t now);
+    /**
+     * Gets the time at which a queued mapping can next be sent.
+     * @param now The current time, in milliseconds since the program started.
+     * @returns Returns UINT64_MAX if no mapping is queued.
+     */
+    uint64_t nextReady(uint64_t now) const;
+private:
+    struct Device {
+        TokenBucket requests;
+        TokenBucket bytes;
+        double weight = 1;
+        double virtualTime = 0;
+        bool configured = false;
+        std::deque<size_t> queues[4];   // The queued mappings of each priority class, but Critical's is unused.
+        int credits[4] = {};            // The mappings each class may still take before the others have their turn.
+        size_t queued = 0;
+    };
+    struct Member {
+        uint32_t device = 0;
+        IOPriority priority = IOPriority::Normal;
+        double bytes = 0;
+        bool queued = false;
+    };
+    double requestRate;
+    double byteRate;
+    size_t batchLimit;
+    std::vector<Device> devices;
+    std::unordered_map<std::string, uint32_t> deviceIndex;
+    std::vector<Member> members;
+    double virtualTime = 0;
+    size_t backlog = 0;
+    std::vector<IOMap*> admitted;
+
+    /**
+     * Takes the next mapping of a device, by the weights of its classes.
+     */
+    size_t take(Device& device);
+};
+
+#endif // IOSCHEDULER_H
@@ -0,0 +1,638 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Local IO
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+#include "localio.h"
+#include "nodalisjson.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <tuple>
+#ifdef __linux__
+    #include <fcntl.h>
+    #include <sys/ioctl.h>
+    #include <sys/mman.h>
+    #include <unistd.h>
+    #if __has_include(<linux/gpio.h>)
+        #include <linux/gpio.h>
+    #endif
+#endif
+
+#if defined(__linux__) && defined(GPIO_V2_GET_LINE_IOCTL)
+    #define NODALIS_GPIO 1
+#endif
+
+/**
+ * The local IO clients, which the scan thread samples and drives.
+ */
+static std::mutex LOCALIO_CLIENTS_MUTEX;
+static std::vector<LocalIOClient*> LOCALIO_CLIENTS;
+
+/**
+ * Parses a number in decimal, or in hexadecimal with 0x.
+ * @param text The number.
+ * @param value Receives the number.
+ * @returns Returns false if the text isn't a number.
+ */
+static bool parseNumber(const std::string& text, uint64_t& value) {
+    if (text.empty()) return false;
+    char* end = nullptr;
+    errno = 0;
+    value = std::strtoull(text.c_str(), &end, 0);
+    return errno == 0 && end != nullptr && *end == '\0';
+}
+
+/**
+ * Reads a numeric protocol property, given as a number or as the text of one.
+ * @param config The protocol properties.
+ * @param name The name of the property.
+ * @param fallback The value if the property isn't present or isn't a number.
+ * @returns Returns the value of the property.
+ */
+static int64_t numberProperty(const json& config, const char* name, int64_t fallback) {
+    if (!config.is_object() || !config.contains(name)) return fallback;
+    const json& value = config[name];
+    uint64_t number = 0;
+    if (value.is_string() && parseNumber(value.get<std::string>(), number)) return static_cast<int64_t>(number);
+    if (value.is_number()) return value.get<int64_t>();
+    return fallback;
+}
+
+/**
+ * Reads a text protocol property, in lower case.
+ * @param config The protocol properties.
+ * @param name The name of the property.
+ * @returns Returns the value of the property, or an empty string if it is not present.
+ */
+static std::string textProperty(const json& config, const char* name) {
+    if (!config.is_object() || !config.contains(name) || !config[name].is_string()) return "";
+    std::string value = config[name].get<std::string>();
+    std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return value;
+}
+
+// ========== Local IO Client ==========
+
+LocalIOClient::LocalIOClient(const std::string& protocol) : IOClient(protocol) {
+    reconnectDelay = minReconnectDelay = 1000;
+    maxReconnectDelay = 30000;
+    std::lock_guard<std::mutex> lock(LOCALIO_CLIENTS_MUTEX);
+    LOCALIO_CLIENTS.push_back(this);
+}
+
+LocalIOClient::~LocalIOClient() {
+    unregister();
+}
+
+void LocalIOClient::unregister() {
+    std::lock_guard<std::mutex> lock(LOCALIO_CLIENTS_MUTEX);
+    LOCALIO_CLIENTS.erase(std::remove(LOCALIO_CLIENTS.begin(), LOCALIO_CLIENTS.end(), this), LOCALIO_CLIENTS.end());
+}
+
+void LocalIOClient::connect() {
+    std::lock_guard<std::mutex> lock(deviceMutex);
+    closeDevice();
+    connected = openDevice();
+}
+
+void LocalIOClient::onMappingAdded(IOMap& map) {
+    std::lock_guard<std::mutex> lock(deviceMutex);
+    if (!addPoint(map)) {
+        return;
+    }
+    // The lines and registers are requested when the device is opened, so a mapping added to an open device opens
+    // it again.
+    if (connected) {
+        closeDevice();
+        connected = false;
+    }
+}
+
+void LocalIOClient::stage(const ResolvedAddress& local, uint64_t value) {
+    stagedAddresses.push_back(local);
+    stagedValues.push_back(value);
+}
+
+void LocalIOClient::sampleInputs() {
+    std::lock_guard<std::mutex> lock(deviceMutex);
+    if (!connected) {
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    stagedAddresses.clear();
+    stagedValues.clear();
+    bool ok = readInputs();
+    if (!stagedAddresses.empty()) {
+        writeImage(stagedAddresses.data(), stagedValues.data(), stagedAddresses.size());
+    }
+    markInputs(ok ? IOQuality::Good : IOQuality::Stale);
+    finish(ok, start);
+}
+
+void LocalIOClient::driveOutputs() {
+    std::lock_guard<std::mutex> lock(deviceMutex);
+    if (!holds.empty()) {
+        uint64_t generation = imageGeneration();
+        holds.erase(std::remove_if(holds.begin(), holds.end(), [&](const Hold& hold) {
+            return generation >= hold.generation;
+        }), holds.end());
+    }
+    if (!connected) {
+        return;
+    }
+    finish(writeOutputs(), std::chrono::steady_clock::now());
+}
+
+void LocalIOClient::writeOutputNow(size_t mapping, const ResolvedAddress& local, uint64_t value) {
+    (void)mapping;
+    std::lock_guard<std::mutex> lock(deviceMutex);
+    // Two publishes: the scan running now may commit without the staged value, and the next one latches it.
+    Hold hold{ local, value, imageGeneration() + 2 };
+    auto held = std::find_if(holds.begin(), holds.end(), [&](const Hold& other) { return other.local == local; });
+    if (held == holds.end()) {
+        holds.push_back(hold);
+    }
+    else {
+        *held = hold;
+    }
+    if (connected) {
+        auto start = std::chrono::steady_clock::now();
+        finish(writePoint(local, value), start);
+    }
+}
+
+uint64_t LocalIOClient::outputValue(const ResolvedAddress& local, const uint8_t* image) const {
+    for (const auto& hold : holds) {
+        if (hold.local == local) {
+            return hold.value;
+        }
+    }
+    return local.load(image);
+}
+
+void LocalIOClient::finish(bool ok, std::chrono::steady_clock::time_point start) {
+    requestCompleted(ok, microsBetween(start, std::chrono::steady_clock::now()));
+    if (!ok) {
+        nodalisLog() << protocol << " " << moduleID << " failed: " << strerror(errno) << "\n";
+        closeDevice();
+        connected = false;
+    }
+}
+
+void sampleLocalInputs() {
+    std::lock_guard<std::mutex> lock(LOCALIO_CLIENTS_MUTEX);
+    for (LocalIOClient* client : LOCALIO_CLIENTS) {
+        client->sampleInputs();
+    }
+}
+
+void driveLocalOutputs() {
+    std::lock_guard<std::mutex> lock(LOCALIO_CLIENTS_MUTEX);
+    for (LocalIOClient* client : LOCALIO_CLIENTS) {
+        client->driveOutputs();
+    }
+}
+
+// ========== GPIO Client ==========
+
+GpioClient::GpioClient() : LocalIOClient("GPIO") {}
+
+GpioClient::~GpioClient() {
+    stop();
+    unregister();
+    closeDevice();
+    connected = false;
+}
+
+bool GpioClient::addPoint(IOMap& map) {
+    if (map.width != 1) {
+        nodalisLog() << "GPIO mapping " << map.localAddress << " must be a bit\n";
+        return false;
+    }
+    Line line{ map.local, map.direction, map.remoteAddress, 0, 0 };
+#ifdef NODALIS_GPIO
+    json config = protocolProperties(map);
+    line.flags = map.direction == IOType::Output ? GPIO_V2_LINE_FLAG_OUTPUT : GPIO_V2_LINE_FLAG_INPUT;
+    if (config.is_object() && config.contains("ActiveLow") && config["ActiveLow"].is_boolean() && config["ActiveLow"].get<bool>()) {
+        line.flags |= GPIO_V2_LINE_FLAG_ACTIVE_LOW;
+    }
+    std::string bias = textProperty(config, "Bias");
+    if (bias == "pull-up") line.flags |= GPIO_V2_LINE_FLAG_BIAS_PULL_UP;
+    else if (bias == "pull-down") line.flags |= GPIO_V2_LINE_FLAG_BIAS_PULL_DOWN;
+    else if (bias == "disabled") line.flags |= GPIO_V2_LINE_FLAG_BIAS_DISABLED;
+    if (map.direction == IOType::Output) {
+        std::string drive = textProperty(config, "Drive");
+        if (drive == "open-drain") line.flags |= GPIO_V2_LINE_FLAG_OPEN_DRAIN;
+        else if (drive == "open-source") line.flags |= GPIO_V2_LINE_FLAG_OPEN_SOURCE;
+    }
+    else {
+        line.debounce = static_cast<uint32_t>(std::max<int64_t>(0, numberProperty(config, "Debounce", 0)));
+    }
+#endif
+    lines.push_back(line);
+    return true;
+}
+
+#ifdef NODALIS_GPIO
+
+bool GpioClient::findLine(const std::string& name, uint32_t& offset) {
+    uint64_t number = 0;
+    if (parseNumber(name, number)) {
+        offset = static_cast<uint32_t>(number);
+        return true;
+    }
+    gpiochip_info chip{};
+    if (ioctl(chipfd, GPIO_GET_CHIPINFO_IOCTL, &chip) < 0) {
+        return false;
+    }
+    for (uint32_t candidate = 0; candidate < chip.lines; candidate++) {
+        gpio_v2_line_info info{};
+        info.offset = candidate;
+        if (ioctl(chipfd, GPIO_V2_GET_LINEINFO_IOCTL, &info) == 0 && name == info.name) {
+            offset = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GpioClient::openDevice() {
+    std::string path = moduleID.find('/') == std::string::npos ? "/dev/" + moduleID : moduleID;
+    chipfd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (chipfd < 0) {
+        nodalisLog() << "GPIO can't open " << path << ": " << strerror(errno) << "\n";
+        return false;
+    }
+    std::vector<uint32_t> offsets(lines.size());
+    for (size_t i = 0; i < lines.size(); i++) {
+        if (!findLine(lines[i].name, offsets[i])) {
+            nodalisLog() << "GPIO " << moduleID << " has no line " << lines[i].name << "\n";
+            closeDevice();
+            return false;
+        }
+    }
+    // The lines that share their direction and settings are requested together, up to GPIO_V2_LINES_MAX at a time.
+    std::vector<size_t> order(lines.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return std::tie(lines[a].flags, lines[a].debounce) < std::tie(lines[b].flags, lines[b].debounce);
+    });
+    for (size_t i = 0; i < order.size(); i++) {
+        const Line& line = lines[order[i]];
+        if (requests.empty() || requests.back().lines.size() == GPIO_V2_LINES_MAX ||
+            lines[requests.back().lines[0]].flags != line.flags || lines[requests.back().lines[0]].debounce != line.debounce) {
+            requests.emplace_back();
+            requests.back().direction = line.direction;
+        }
+        Request& request = requests.back();
+        request.mask |= 1ull << request.lines.size();
+        request.lines.push_back(order[i]);
+    }
+    // Outputs start with the values the image has, so that a line doesn't change when it is opened again.
+    readImage([&](const uint8_t* image) {
+        for (auto& request : requests) {
+            if (request.direction != IOType::Output) continue;
+            for (size_t bit = 0; bit < request.lines.size(); bit++) {
+                if (outputValue(lines[request.lines[bit]].local, image) != 0) {
+                    request.value |= 1ull << bit;
+                }
+            }
+            request.valid = true;
+        }
+    });
+    for (auto& request : requests) {
+        const Line& first = lines[request.lines[0]];
+        gpio_v2_line_request config{};
+        for (size_t bit = 0; bit < request.lines.size(); bit++) {
+            config.offsets[bit] = offsets[request.lines[bit]];
+        }
+        config.num_lines = static_cast<uint32_t>(request.lines.size());
+        std::strncpy(config.consumer, "nodalis", sizeof(config.consumer) - 1);
+        config.config.flags = first.flags;
+        if (request.direction == IOType::Output) {
+            auto& attribute = config.config.attrs[config.config.num_attrs++];
+            attribute.attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+            attribute.attr.values = request.value;
+            attribute.mask = request.mask;
+        }
+        else if (first.debounce > 0) {
+            auto& attribute = config.config.attrs[config.config.num_attrs++];
+            attribute.attr.id = GPIO_V2_LINE_ATTR_ID_DEBOUNCE;
+            attribute.attr.debounce_period_us = first.debounce;
+            attribute.mask = request.mask;
+        }
+        if (ioctl(chipfd, GPIO_V2_GET_LINE_IOCTL, &config) < 0) {
+            nodalisLog() << "GPIO can't request " << request.lines.size() << " lines of " << moduleID << ": " << strerror(errno) << "\n";
+            closeDevice();
+            return false;
+        }
+        request.fd = config.fd;
+    }
+    nodalisLog() << "GPIO opened " << path << " with " << lines.size() << " lines in " << requests.size() << " requests\n";
+    return true;
+}
+
+void GpioClient::closeDevice() {
+    for (auto& request : requests) {
+        if (request.fd >= 0) {
+            ::close(request.fd);
+        }
+    }
+    requests.clear();
+    if (chipfd >= 0) {
+        ::close(chipfd);
+        chipfd = -1;
+    }
+}
+
+bool GpioClient::readInputs() {
+    for (auto& request : requests) {
+        if (request.direction != IOType::Input) continue;
+        gpio_v2_line_values values{};
+        values.mask = request.mask;
+        if (ioctl(request.fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0) {
+            return false;
+        }
+        uint64_t bits = values.bits & request.mask;
+        uint64_t changed = request.valid ? bits ^ request.value : request.mask;
+        request.value = bits;
+        request.valid = true;
+        forEachBankBit(changed, 0, [&](size_t bit) {
+            stage(lines[request.lines[bit]].local, (bits >> bit) & 1);
+        });
+    }
+    return true;
+}
+
+bool GpioClient::writeOutputs() {
+    // The values are taken under the image lock, and written to the chip after it is released.
+    readImage([&](const uint8_t* image) {
+        for (auto& request : requests) {
+            if (request.direction != IOType::Output) continue;
+            request.next = 0;
+            for (size_t bit = 0; bit < request.lines.size(); bit++) {
+                if (outputValue(lines[request.lines[bit]].local, image) != 0) {
+                    request.next |= 1ull << bit;
+                }
+            }
+        }
+    });
+    for (auto& request : requests) {
+        if (request.direction != IOType::Output || (request.valid && request.next == request.value)) continue;
+        gpio_v2_line_values values{};
+        values.bits = request.next;
+        values.mask = request.mask;
+        if (ioctl(request.fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) < 0) {
+            return false;
+        }
+        request.value = request.next;
+        request.valid = true;
+    }
+    return true;
+}
+
+bool GpioClient::writePoint(const ResolvedAddress& local, uint64_t value) {
+    for (auto& request : requests) {
+        if (request.direction != IOType::Output) continue;
+        for (size_t bit = 0; bit < request.lines.size(); bit++) {
+            if (!(lines[request.lines[bit]].local == local)) continue;
+            gpio_v2_line_values values{};
+            values.bits = value != 0 ? 1ull << bit : 0;
+            values.mask = 1ull << bit;
+            if (ioctl(request.fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) < 0) {
+                return false;
+            }
+            request.value = (request.value & ~values.mask) | values.bits;
+            return true;
+        }
+    }
+    return true;
+}
+
+#else
+
+bool GpioClient::findLine(const std::string& name, uint32_t& offset) {
+    (void)name;
+    (void)offset;
+    return false;
+}
+
+bool GpioClient::openDevice() {
+    nodalisLog() << "GPIO is only supported on Linux, with the GPIO character device\n";
+    return false;
+}
+
+void GpioClient::closeDevice() {}
+
+bool GpioClient::readInputs() {
+    return false;
+}
+
+bool GpioClient::writeOutputs() {
+    return false;
+}
+
+bool GpioClient::writePoint(const ResolvedAddress& local, uint64_t value) {
+    (void)local;
+    (void)value;
+    return false;
+}
+
+#endif
+
+// ========== MMIO Client ==========
+
+MmioClient::MmioClient() : LocalIOClient("MMIO") {}
+
+MmioClient::~MmioClient() {
+    stop();
+    unregister();
+    closeDevice();
+    connected = false;
+}
+
+bool MmioClient::addPoint(IOMap& map) {
+    // The RemoteAddress is the byte offset of the register, and .bit the first bit of the field.
+    std::string address = map.remoteAddress;
+    uint64_t offset = 0, shift = 0;
+    size_t dot = address.find('.');
+    bool valid = parseNumber(address.substr(0, dot), offset) && (dot == std::string::npos || parseNumber(address.substr(dot + 1), shift));
+    if (!valid || offset % 4 != 0 || offset > UINT32_MAX || map.width > 32 || shift + static_cast<uint64_t>(map.width) > 32) {
+        nodalisLog() << "Invalid MMIO register " << map.remoteAddress << " for " << map.localAddress << "\n";
+        return false;
+    }
+    json config = protocolProperties(map);
+    int64_t setOffset = map.direction == IOType::Output ? numberProperty(config, "Set", -1) : -1;
+    int64_t clearOffset = map.direction == IOType::Output ? numberProperty(config, "Clear", -1) : -1;
+    if ((setOffset < 0) != (clearOffset < 0) || (setOffset >= 0 && (setOffset % 4 != 0 || clearOffset % 4 != 0))) {
+        nodalisLog() << "MMIO mapping " << map.localAddress << " must give both of Set and Clear, as register offsets\n";
+        return false;
+    }
+    Field field{ map.local, static_cast<uint32_t>(shift), map.width == 32 ? UINT32_MAX : (1u << map.width) - 1 };
+    auto found = std::find_if(registers.begin(), registers.end(), [&](const Register& r) {
+        return r.offset == offset && r.direction == map.direction && r.setOffset == setOffset && r.clearOffset == clearOffset;
+    });
+    if (found == registers.end()) {
+        registers.push_back({ static_cast<uint32_t>(offset), map.direction, setOffset, clearOffset, {} });
+        found = registers.end() - 1;
+    }
+    found->fields.push_back(field);
+    found->mask |= field.mask << field.shift;
+    return true;
+}
+
+#ifdef __linux__
+
+bool MmioClient::openDevice() {
+    uint64_t physical = 0;
+    if (!parseNumber(modulePort.empty() ? "0" : modulePort, physical)) {
+        nodalisLog() << "Invalid MMIO address " << modulePort << "\n";
+        return false;
+    }
+    memfd = ::open(moduleID.c_str(), O_RDWR | O_SYNC | O_CLOEXEC);
+    if (memfd < 0) {
+        nodalisLog() << "MMIO can't open " << moduleID << ": " << strerror(errno) << "\n";
+        return false;
+    }
+    // The mapping starts at the page of the first register and ends with the page of the last one.
+    uint64_t end = 0;
+    for (const auto& reg : registers) {
+        end = std::max<uint64_t>({ end, reg.offset + 4u, static_cast<uint64_t>(reg.setOffset + 4), static_cast<uint64_t>(reg.clearOffset + 4) });
+    }
+    uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    uint64_t start = physical & ~(page - 1);
+    mappingBytes = static_cast<size_t>((physical - start + end + page - 1) & ~(page - 1));
+    mapping = mmap(nullptr, mappingBytes, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, static_cast<off_t>(start));
+    if (mapping == MAP_FAILED) {
+        nodalisLog() << "MMIO can't map " << moduleID << " at " << modulePort << ": " << strerror(errno) << "\n";
+        mapping = nullptr;
+        closeDevice();
+        return false;
+    }
+    base = reinterpret_cast<volatile uint32_t*>(static_cast<uint8_t*>(mapping) + (physical - start));
+    for (auto& reg : registers) {
+        reg.valid = false;
+    }
+    nodalisLog() << "MMIO mapped " << registers.size() << " registers of " << moduleID << " at " << modulePort << "\n";
+    return true;
+}
+
+void MmioClient::closeDevice() {
+    if (mapping != nullptr) {
+        munmap(mapping, mappingBytes);
+        mapping = nullptr;
+        base = nullptr;
+    }
+    if (memfd >= 0) {
+        ::close(memfd);
+        memfd = -1;
+    }
+}
+
+bool MmioClient::readInputs() {
+    for (auto& reg : registers) {
+        if (reg.direction != IOType::Input) continue;
+        uint32_t value = base[reg.offset / 4] & reg.mask;
+        uint32_t changed = reg.valid ? value ^ reg.value : reg.mask;
+        if (changed == 0) continue;
+        for (const auto& field : reg.fields) {
+            if (((changed >> field.shift) & field.mask) != 0) {
+                stage(field.local, (value >> field.shift) & field.mask);
+            }
+        }
+        reg.value = value;
+        reg.valid = true;
+    }
+    return true;
+}
+
+bool MmioClient::writeOutputs() {
+    // The values are taken under the image lock, and stored to the registers after it is released.
+    readImage([&](const uint8_t* image) {
+        for (auto& reg : registers) {
+            if (reg.direction != IOType::Output) continue;
+            reg.next = 0;
+            for (const auto& field : reg.fields) {
+                reg.next |= (static_cast<uint32_t>(outputValue(field.local, image)) & field.mask) << field.shift;
+            }
+        }
+    });
+    for (auto& reg : registers) {
+        if (reg.direction != IOType::Output || (reg.valid && reg.next == reg.value)) continue;
+        if (reg.setOffset >= 0) {
+            base[reg.setOffset / 4] = reg.next;
+            base[reg.clearOffset / 4] = ~reg.next & reg.mask;
+        }
+        else {
+            volatile uint32_t& target = base[reg.offset / 4];
+            target = (target & ~reg.mask) | reg.next;
+        }
+        reg.value = reg.next;
+        reg.valid = true;
+    }
+    return true;
+}
+
+bool MmioClient::writePoint(const ResolvedAddress& local, uint64_t value) {
+    for (auto& reg : registers) {
+        if (reg.direction != IOType::Output) continue;
+        for (const auto& field : reg.fields) {
+            if (!(field.local == local)) continue;
+            uint32_t mask = field.mask << field.shift;
+            uint32_t bits = (static_cast<uint32_t>(value) & field.mask) << field.shift;
+            if (reg.setOffset >= 0) {
+                base[reg.setOffset / 4] = bits;
+                base[reg.clearOffset / 4] = ~bits & mask;
+            }
+            else {
+                volatile uint32_t& target = base[reg.offset / 4];
+                target = (target & ~mask) | bits;
+            }
+            reg.value = (reg.value & ~mask) | bits;
+            return true;
+        }
+    }
+    return true;
+}
+
+#else
+
+bool MmioClient::openDevice() {
+    nodalisLog() << "MMIO is only supported on Linux\n";
+    return false;
+}
+
+void MmioClient::closeDevice() {}
+
+bool MmioClient::readInputs() {
+    return false;
+}
+
+bool MmioClient::writeOutputs() {
+    return false;
+}
+
+bool MmioClient::writePoint(const ResolvedAddress& local, uint64_t value) {
+    (void)local;
+    (void)value;
+    return false;
+}
+
+#endif
@@ -0,0 +1,278 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Local IO
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * Local IO is the IO of the board the runtime runs on, such as the GPIO header of a linux-arm controller, which is
+ * read and written without a network in between. It is mapped like any other IO, with one of two protocols:
+ *
+ * GPIO uses the Linux GPIO character device. The ModuleID is the chip, as gpiochip0 or /dev/gpiochip0, and the
+ * RemoteAddress is the offset or the name of the line. Mappings are bits, and may set ActiveLow, a Bias of
+ * "pull-up", "pull-down" or "disabled", a Drive of "open-drain" or "open-source", and a Debounce in microseconds. The
+ * lines of a chip that share a direction and their settings are requested together, up to 64 at a time, so a scan
+ * reads each request with one GPIO_V2_LINE_GET_VALUES_IOCTL and writes it with one GPIO_V2_LINE_SET_VALUES_IOCTL.
+ *
+ * MMIO maps the registers of a peripheral from a device file, such as /dev/gpiomem or /dev/mem. The ModuleID is the
+ * device file, the ModulePort the physical address of the first register, and the RemoteAddress the byte offset of a
+ * 32 bit register, followed by .bit for a bit or the first bit of a narrower field. A scan loads each input register
+ * once; an output is written by read-modify-write, or, if the mapping gives the offsets of the Set and Clear
+ * registers of a peripheral with write-1-to-set and write-1-to-clear registers, with a store to each.
+ *
+ * Unlike the other clients, which are polled by their worker thread every PollTime, local IO is exchanged by the scan
+ * thread: the inputs are sampled right before each scan latches its inputs, staging the ones that changed in one
+ * batch, and the outputs are driven right after the scan commits its outputs, writing only the requests and the
+ * registers whose value changed. The worker thread only opens the device, and opens it again after it failed. The
+ * timed outputs are the exception: the timed output thread writes a single output with writeOutputNow() when its
+ * command is due, and the scan thread leaves it at that value until the image has it too.
+ */
+#pragma once
+#ifndef LOCALIO_H
+#define LOCALIO_H
+
+#include "nodalis.h"
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+/**
+ * The IO of one GPIO chip or one block of memory-mapped registers, exchanged by the scan thread.
+ */
+class LocalIOClient : public IOClient {
+public:
+    ~LocalIOClient();
+    /**
+     * Reads the inputs and stages the ones that changed, to be latched by the scan that is about to start. Called
+     * on the scan thread by sampleLocalInputs().
+     */
+    void sampleInputs();
+    /**
+     * Writes the outputs that changed in the scan that ended. Called on the scan thread by driveLocalOutputs().
+     */
+    void driveOutputs();
+    /**
+     * Writes an output to the device right away, for the timed outputs, and holds it at the value until the image has
+     * caught up with it, so that driveOutputs() doesn't write it back.
+     * @param mapping The index of the mapping.
+     * @param local The local address of the mapping.
+     * @param value The value.
+     */
+    void writeOutputNow(size_t mapping, const ResolvedAddress& local, uint64_t value) override;
+
+protected:
+    /**
+     * Registers the client with the scan thread.
+     * @param protocol The name of the protocol.
+     */
+    LocalIOClient(const std::string& protocol);
+    /**
+     * Closes the device and opens it again with the lines or registers of all the mappings.
+     */
+    void connect() override;
+    /**
+     * Adds a mapping, which takes effect when the device is opened again.
+     * @param map The mapping.
+     */
+    void onMappingAdded(IOMap& map) override;
+    /**
+     * Does nothing, since the mappings are exchanged by the scan thread.
+     * @param batch The requests of the mappings that are due.
+     */
+    void submitBatch(IOBatch& batch) override { (void)batch; }
+
+    /**
+     * Parses a mapping into the client's own points.
+     * @param map The mapping.
+     * @returns Returns false, having written why, if the mapping can't be served.
+     */
+    virtual bool addPoint(IOMap& map) = 0;
+    /**
+     * Opens the device with the points added so far.
+     * @returns Returns false, having written why, if it can't be opened.
+     */
+    virtual bool openDevice() = 0;
+    virtual void closeDevice() = 0;
+    /**
+     * Reads the inputs, calling stage() for each one that changed since the last sample.
+     * @returns Returns false if the device failed.
+     */
+    virtual bool readInputs() = 0;
+    /**
+     * Writes the outputs whose value in the image changed since they were last written.
+     * @returns Returns false if the device failed.
+     */
+    virtual bool writeOutputs() = 0;
+    /**
+     * Writes a single output, leaving the others of its request or register as they were last written.
+     * @param local The local address of the output.
+     * @param value The value.
+     * @returns Returns false if the device failed, or has no such output.
+     */
+    virtual bool writePoint(const ResolvedAddress& local, uint64_t value) = 0;
+    /**
+     * Gets the value to write for an output: the one writeOutputNow() holds, if any, otherwise the image's.
+     * @param local The local address of the output.
+     * @param image The published image.
+     * @returns Returns the value.
+     */
+    uint64_t outputValue(const ResolvedAddress& local, const uint8_t* image) const;
+    /**
+     * Stages the value of an input, to be written to the image with the others of the sample.
+     * @param local The local address of the input.
+     * @param value The value.
+     */
+    void stage(const ResolvedAddress& local, uint64_t value);
+    /**
+     * Unregisters the client from the scan thread, waiting for an exchange in progress. Called first by the
+     * destructors of derived classes, before they close the device.
+     */
+    void unregister();
+
+private:
+    /**
+     * Guards the device and the points, which are opened by the worker thread, exchanged by the scan thread and
+     * added from the main thread.
+     */
+    std::mutex deviceMutex;
+    std::vector<ResolvedAddress> stagedAddresses;
+    std::vector<uint64_t> stagedValues;
+    /**
+     * A value writeOutputNow() holds for an output, until the image generation reaches generation.
+     */
+    struct Hold {
+        ResolvedAddress local;
+        uint64_t value;
+        uint64_t generation;
+    };
+    std::vector<Hold> holds;
+
+    /**
+     * Counts the exchange and closes the device if it failed, so the worker thread opens it again.
+     * @param ok Whether the exchange succeeded.
+     * @param start When the exchange started.
+     */
+    void finish(bool ok, std::chrono::steady_clock::time_point start);
+};
+
+/**
+ * The bits of a GPIO chip, read and written through the Linux GPIO character device.
+ */
+class GpioClient : public LocalIOClient {
+public:
+    GpioClient();
+    ~GpioClient();
+
+protected:
+    bool addPoint(IOMap& map) override;
+    bool openDevice() override;
+    void closeDevice() override;
+    bool readInputs() override;
+    bool writeOutputs() override;
+    bool writePoint(const ResolvedAddress& local, uint64_t value) override;
+
+private:
+    /**
+     * A line of the chip.
+     */
+    struct Line {
+        ResolvedAddress local;
+        IOType direction;
+        std::string name;       // The offset or the name of the line.
+        uint64_t flags;         // The GPIO_V2_LINE_FLAG_ bits.
+        uint32_t debounce;      // Microseconds, or 0.
+    };
+    /**
+     * Lines requested together, which share their direction and settings.
+     */
+    struct Request {
+        int fd = -1;
+        IOType direction;
+        std::vector<size_t> lines;  // Indexes into lines, in the order of the request's bits.
+        uint64_t mask = 0;          // A bit for each line of the request.
+        uint64_t value = 0;         // The bits last read or written.
+        uint64_t next = 0;          // For outputs, the bits to write, as taken from the image.
+        bool valid = false;         // Whether value was read or written since the request was opened.
+    };
+    std::vector<Line> lines;
+    std::vector<Request> requests;
+    int chipfd = -1;
+
+    /**
+     * Finds the offset of a line on the open chip.
+     * @param name The offset or the name of the line.
+     * @param offset Receives the offset.
+     * @returns Returns false if the chip has no such line.
+     */
+    bool findLine(const std::string& name, uint32_t& offset);
+};
+
+/**
+ * The registers of a peripheral, mapped from a device file.
+ */
+class MmioClient : public LocalIOClient {
+public:
+    MmioClient();
+    ~MmioClient();
+
+protected:
+    bool addPoint(IOMap& map) override;
+    bool openDevice() override;
+    void closeDevice() override;
+    bool readInputs() override;
+    bool writeOutputs() override;
+    bool writePoint(const ResolvedAddress& local, uint64_t value) override;
+
+private:
+    /**
+     * A field of a register.
+     */
+    struct Field {
+        ResolvedAddress local;
+        uint32_t shift;
+        uint32_t mask;          // The mask of the field, before it is shifted.
+    };
+    /**
+     * A register and the fields that are mapped from or to it.
+     */
+    struct Register {
+        uint32_t offset;
+        IOType direction;
+        int64_t setOffset;      // The write-1-to-set register for outputs, or -1 for read-modify-write.
+        int64_t clearOffset;    // The write-1-to-clear register for outputs, or -1.
+        std::vector<Field> fields;
+        uint32_t mask = 0;      // The bits of all the fields.
+        uint32_t value = 0;     // The bits last read or written.
+        uint32_t next = 0;      // For outputs, the bits to write, as taken from the image.
+        bool valid = false;
+    };
+    std::vector<Register> registers;
+    int memfd = -1;
+    volatile uint32_t* base = nullptr;  // The register at ModulePort.
+    void* mapping = nullptr;
+    size_t mappingBytes = 0;
+};
+
+/**
+ * Samples the local inputs of every client. Called by the scheduler right before each scan latches its inputs.
+ */
+void sampleLocalInputs();
+/**
+ * Drives the local outputs of every client. Called by the scheduler right after each scan commits its outputs.
+ */
+void driveLocalOutputs();
+
+#endif // LOCALIO_H
@@ -0,0 +1,510 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Metrics
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+#include "metrics.h"
+#include "nodalis.h"
+#include "ioreactor.h"
+#include "alarms.h"
+#include <cstdio>
+#include <cstring>
+#include <set>
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #pragma comment(lib, "ws2_32.lib")
+#else
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <netinet/in.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+#endif
+
+/**
+ * The most scrapes that may be served at once. Further connections are refused.
+ */
+static constexpr size_t METRICS_MAX_CONNECTIONS = 16;
+/**
+ * The longest request that is read. A scraper's request is a few hundred bytes.
+ */
+static constexpr size_t METRICS_MAX_REQUEST = 8192;
+
+/**
+ * Closes a socket.
+ * @param fd The socket.
+ */
+static void closeSocket(int fd) {
+#ifdef _WIN32
+    closesocket(fd);
+#else
+    close(fd);
+#endif
+}
+
+/**
+ * Puts a socket in non-blocking mode.
+ * @param fd The socket.
+ * @returns Returns true on success.
+ */
+static bool setNonBlocking(int fd) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(fd, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+#pragma region "Exposition"
+/**
+ * Escapes the value of a label, as the text formats require.
+ * @param value The value.
+ * @returns Returns the escaped value.
+ */
+static std::string escapeLabel(const std::string& value) {
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if (c == '\n') {
+            escaped += "\\n";
+        }
+        else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+/**
+ * Formats a number of microseconds as seconds.
+ */
+static std::string seconds(double micros) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.9g", micros / 1e6);
+    return text;
+}
+
+/**
+ * Writes the HELP and TYPE lines of a metric family. A counter's samples are named with _total appended, which
+ * OpenMetrics leaves out of the family's name and the Prometheus format doesn't.
+ * @param out The text to append to.
+ * @param name The name of the family.
+ * @param type The type: counter, gauge or histogram.
+ * @param help The description of the family.
+ * @param openMetrics True for the OpenMetrics format.
+ */
+static void writeFamily(std::string& out, const std::string& name, const char* type, const char* help, bool openMetrics) {
+    std::string family = std::strcmp(type, "counter") == 0 && !openMetrics ? name + "_total" : name;
+    out += "# HELP " + family + " " + help + "\n";
+    out += "# TYPE " + family + " " + type + "\n";
+}
+
+/**
+ * Writes a sample.
+ * @param out The text to append to.
+ * @param name The name of the sample.
+ * @param labels The labels, without braces, or empty.
+ * @param value The value, as text.
+ */
+static void writeSample(std::string& out, const std::string& name, const std::string& labels, const std::string& value) {
+    out += name;
+    if (!labels.empty()) {
+        out += "{" + labels + "}";
+    }
+    out += " " + value + "\n";
+}
+
+/**
+ * Writes the samples of a histogram from a set of statistics. The upper bound of each bucket of the statistics
+ * becomes a bucket of the histogram, and the last bucket, which also counts everything longer, becomes +Inf.
+ * @param out The text to append to.
+ * @param name The name of the histogram.
+ * @param labels The labels of the histogram, without braces.
+ * @param stats The statistics.
+ */
+static void writeHistogram(std::string& out, const std::string& name, const std::string& labels, const ExecutionStats& stats) {
+    std::string prefix = labels.empty() ? "" : labels + ",";
+    // The count is taken from the buckets, so that it agrees with them while the statistics are being recorded.
+    uint64_t count = 0;
+    for (int x = 0; x < ExecutionStats::HISTOGRAM_BUCKETS - 1; x++) {
+        count += stats.getHistogram(x);
+        writeSample(out, name + "_bucket", prefix + "le=\"" + seconds(static_cast<double>(1ull << x)) + "\"", std::to_string(count));
+    }
+    count += stats.getHistogram(ExecutionStats::HISTOGRAM_BUCKETS - 1);
+    writeSample(out, name + "_bucket", prefix + "le=\"+Inf\"", std::to_string(count));
+    writeSample(out, name + "_count", labels, std::to_string(count));
+    writeSample(out, name + "_sum", labels, seconds(static_cast<double>(stats.getTotal())));
+}
+
+/**
+ * Gets the labels that identify an IO client.
+ */
+static std::string clientLabels(const IOClient& client) {
+    return "protocol=\"" + escapeLabel(client.getProtocol()) + "\",module=\"" + escapeLabel(client.getModuleID()) +
+           "\",port=\"" + escapeLabel(client.getModulePort()) + "\"";
+}
+
+/**
+ * Gets the labels that identify a mapping of an IO client.
+ */
+static std::string mappingLabels(const IOClient& client, size_t mapping) {
+    return clientLabels(client) + ",address=\"" + escapeLabel(client.getMappings()[mapping].localAddress) + "\"";
+}
+
+void MetricsServer::render(std::string& out, bool openMetrics) {
+    std::vector<ExecutionStats*> stats = getAllStats();
+    // The latency of the IO clients is written with the clients, labelled by client.
+    std::set<const ExecutionStats*> latencies;
+    for (auto& client : Clients) {
+        latencies.insert(client->getCounters().latency.load(std::memory_order_acquire));
+    }
+    std::vector<std::pair<ExecutionStats*, std::string>> executions;
+    for (auto* set : stats) {
+        if (latencies.count(set) == 0) {
+            executions.emplace_back(set, "name=\"" + escapeLabel(set->getName()) + "\"");
+        }
+    }
+
+    writeFamily(out, "nodalis_execution_seconds", "histogram", "The time taken by each scan, task, IO poll and retain save.", openMetrics);
+    for (auto& execution : executions) {
+        writeHistogram(out, "nodalis_execution_seconds", execution.second, *execution.first);
+    }
+    writeFamily(out, "nodalis_execution_overruns", "counter", "The number of missed deadlines.", openMetrics);
+    for (auto& execution : executions) {
+        writeSample(out, "nodalis_execution_overruns_total", execution.second, std::to_string(execution.first->getOverruns()));
+    }
+    writeFamily(out, "nodalis_execution_max_seconds", "gauge", "The longest execution.", openMetrics);
+    for (auto& execution : executions) {
+        writeSample(out, "nodalis_execution_max_seconds", execution.second, seconds(static_cast<double>(execution.first->getMaximum())));
+    }
+    writeFamily(out, "nodalis_execution_last_seconds", "gauge", "The most recent execution.", openMetrics);
+    for (auto& execution : executions) {
+        writeSample(out, "nodalis_execution_last_seconds", execution.second, seconds(static_cast<double>(execution.first->getLast())));
+    }
+
+    if (!Clients.empty()) {
+        writeFamily(out, "nodalis_io_connected", "gauge", "Whether the IO client is connected to its module.", openMetrics);
+        for (auto& client : Clients) {
+            writeSample(out, "nodalis_io_connected", clientLabels(*client), client->connected.load() ? "1" : "0");
+        }
+        struct Counter {
+            const char* name;
+            const char* help;
+            const std::atomic<uint64_t> IOCounters::* value;
+        };
+        static const Counter COUNTERS[] = {
+            { "nodalis_io_requests", "The number of requests that completed, failed or timed out.", &IOCounters::requests },
+            { "nodalis_io_errors", "The number of requests that failed, timed out or were refused.", &IOCounters::errors },
+            { "nodalis_io_connects", "The number of connections that were established.", &IOCounters::connects },
+            { "nodalis_io_connect_failures", "The number of connection attempts that failed.", &IOCounters::connectFailures },
+            { "nodalis_io_poll_backoffs", "The number of times adaptive polling lengthened the interval of an unchanged input.", &IOCounters::backoffs },
+            { "nodalis_io_poll_speedups", "The number of times adaptive polling shortened the interval of a changing input.", &IOCounters::speedups },
+            { "nodalis_io_saturations", "The number of times the round trip time grew far enough above its baseline to slow polling down.", &IOCounters::saturations },
+            { "nodalis_io_deferrals", "The number of times a due mapping was held back by the request budget or fair share of its device.", &IOCounters::deferrals },
+        };
+        for (const auto& counter : COUNTERS) {
+            writeFamily(out, counter.name, "counter", counter.help, openMetrics);
+            for (auto& client : Clients) {
+                const IOCounters& counters = client->getCounters();
+                writeSample(out, std::string(counter.name) + "_total", clientLabels(*client),
+                            std::to_string((counters.*counter.value).load(std::memory_order_relaxed)));
+            }
+        }
+        writeFamily(out, "nodalis_io_latency_seconds", "histogram", "The round trip time of the requests that succeeded.", openMetrics);
+        for (auto& client : Clients) {
+            const ExecutionStats* latency = client->getCounters().latency.load(std::memory_order_acquire);
+            if (latency != nullptr) {
+                writeHistogram(out, "nodalis_io_latency_seconds", clientLabels(*client), *latency);
+            }
+        }
+        // The freshness of each mapping, labelled by its local address. A histogram that has nothing recorded, like
+        // the input age of an output, is left out.
+        struct Freshness {
+            const char* name;
+            const char* help;
+            ExecutionStats MappingFreshness::* stats;
+        };
+        static const Freshness FRESHNESS[] = {
+            { "nodalis_io_value_round_trip_seconds", "The round trip time of the requests of a mapping that succeeded.", &MappingFreshness::roundTrip },
+            { "nodalis_io_input_age_seconds", "The time from an input value arriving to the scan that latched it.", &MappingFreshness::inputAge },
+            { "nodalis_io_output_delay_seconds", "The time from the scan that changed an output to the device acknowledging it.", &MappingFreshness::outputDelay },
+        };
+        for (const auto& family : FRESHNESS) {
+            writeFamily(out, family.name, "histogram", family.help, openMetrics);
+            for (auto& client : Clients) {
+                const auto& freshness = client->getFreshness();
+                for (size_t x = 0; x < freshness.size(); x++) {
+                    const ExecutionStats& stats = (*freshness[x]).*family.stats;
+                    if (stats.getCount() > 0) {
+                        writeHistogram(out, family.name, mappingLabels(*client, x), stats);
+                    }
+                }
+            }
+        }
+        writeFamily(out, "nodalis_io_inputs_superseded", "counter", "The number of input values replaced by a newer one before a scan latched them.", openMetrics);
+        for (auto& client : Clients) {
+            const auto& freshness = client->getFreshness();
+            for (size_t x = 0; x < freshness.size(); x++) {
+                if (!freshness[x]->output) {
+                    writeSample(out, "nodalis_io_inputs_superseded_total", mappingLabels(*client, x),
+                                std::to_string(freshness[x]->superseded.load(std::memory_order_relaxed)));
+                }
+            }
+        }
+    }
+
+    const RetainCounters& retain = getRetainCounters();
+    if (retain.flushes.load(std::memory_order_acquire) != nullptr) {
+        writeFamily(out, "nodalis_retain_saves", "counter", "The number of saves of retentive memory.", openMetrics);
+        writeSample(out, "nodalis_retain_saves_total", "", std::to_string(retain.saves.load(std::memory_order_relaxed)));
+        writeFamily(out, "nodalis_retain_unchanged", "counter", "The number of saves skipped because retentive memory hadn't changed.", openMetrics);
+        writeSample(out, "nodalis_retain_unchanged_total", "", std::to_string(retain.unchanged.load(std::memory_order_relaxed)));
+        writeFamily(out, "nodalis_retain_postponed", "counter", "The number of scans a save waited for the previous one to be written.", openMetrics);
+        writeSample(out, "nodalis_retain_postponed_total", "", std::to_string(retain.postponed.load(std::memory_order_relaxed)));
+    }
+
+    uint64_t residentKB, peakKB;
+    getMemoryUsage(residentKB, peakKB);
+    writeFamily(out, "nodalis_memory_resident_bytes", "gauge", "The resident memory of the process.", openMetrics);
+    writeSample(out, "nodalis_memory_resident_bytes", "", std::to_string(residentKB * 1024));
+    writeFamily(out, "nodalis_memory_peak_resident_bytes", "gauge", "The most resident memory the process has had.", openMetrics);
+    writeSample(out, "nodalis_memory_peak_resident_bytes", "", std::to_string(peakKB * 1024));
+    writeFamily(out, "nodalis_memory_process_image_bytes", "gauge", "The size of the process image.", openMetrics);
+    writeSample(out, "nodalis_memory_process_image_bytes", "", std::to_string(sizeof(ProcessImage)));
+    writeFamily(out, "nodalis_forced_addresses", "gauge", "The number of addresses that are forced.", openMetrics);
+    writeSample(out, "nodalis_forced_addresses", "", std::to_string(forceCount()));
+    writeFamily(out, "nodalis_alarms_active", "gauge", "The number of alarms whose condition holds.", openMetrics);
+    writeSample(out, "nodalis_alarms_active", "", std::to_string(activeAlarmCount()));
+    writeFamily(out, "nodalis_alarms_unacknowledged", "gauge", "The number of alarms that were raised and not acknowledged.", openMetrics);
+    writeSample(out, "nodalis_alarms_unacknowledged", "", std::to_string(unacknowledgedAlarmCount()));
+#if NODALIS_ALLOC_TRACK
+    const AllocationCounters& allocations = getAllocationCounters();
+    writeFamily(out, "nodalis_memory_heap_bytes", "gauge", "The bytes allocated with operator new and not yet freed.", openMetrics);
+    writeSample(out, "nodalis_memory_heap_bytes", "", std::to_string(allocations.liveBytes.load(std::memory_order_relaxed)));
+    writeFamily(out, "nodalis_memory_allocations", "counter", "The number of allocations made with operator new.", openMetrics);
+    writeSample(out, "nodalis_memory_allocations_total", "", std::to_string(allocations.allocations.load(std::memory_order_relaxed)));
+    writeFamily(out, "nodalis_memory_frees", "counter", "The number of allocations that were freed.", openMetrics);
+    writeSample(out, "nodalis_memory_frees_total", "", std::to_string(allocations.frees.load(std::memory_order_relaxed)));
+    writeFamily(out, "nodalis_memory_allocated_bytes", "counter", "The bytes allocated with operator new, including those since freed.", openMetrics);
+    writeSample(out, "nodalis_memory_allocated_bytes_total", "", std::to_string(allocations.bytes.load(std::memory_order_relaxed)));
+    writeFamily(out, "nodalis_memory_scan_allocations", "counter", "The number of allocations made during scans and task releases.", openMetrics);
+    writeSample(out, "nodalis_memory_scan_allocations_total", "", std::to_string(allocations.scanAllocations.load(std::memory_order_relaxed)));
+#endif
+#if NODALIS_ARENA_BYTES > 0
+    const ArenaCounters& arena = getArenaCounters();
+    writeFamily(out, "nodalis_memory_arena_bytes", "gauge", "The bytes of the startup arena in use.", openMetrics);
+    writeSample(out, "nodalis_memory_arena_bytes", "", std::to_string(arena.used.load(std::memory_order_relaxed)));
+    writeFamily(out, "nodalis_memory_arena_overflows", "counter", "The allocations made from the heap while starting, as the arena was full.", openMetrics);
+    writeSample(out, "nodalis_memory_arena_overflows_total", "", std::to_string(arena.overflows.load(std::memory_order_relaxed)));
+    writeFamily(out, "nodalis_memory_heap_allocations", "counter", "The allocations made from the heap after the arena was sealed.", openMetrics);
+    writeSample(out, "nodalis_memory_heap_allocations_total", "", std::to_string(arena.heapAllocations.load(std::memory_order_relaxed)));
+#endif
+
+    size_t pouCount = 0;
+    const POUProfile* profiles = getPOUProfiles(pouCount);
+    if (pouCount > 0) {
+        double nanos = nanosPerCycle();
+        auto pouLabels = [](const POUProfile& profile) {
+            return "pou=\"" + escapeLabel(profile.name) + "\",kind=\"" + profile.kind + "\"";
+        };
+        auto cycleSeconds = [nanos](const std::atomic<uint64_t>& cycles) {
+            return seconds(static_cast<double>(cycles.load(std::memory_order_relaxed)) * nanos / 1000.0);
+        };
+        writeFamily(out, "nodalis_pou_calls", "counter", "The number of calls of the POU.", openMetrics);
+        for (size_t x = 0; x < pouCount; x++) {
+            writeSample(out, "nodalis_pou_calls_total", pouLabels(profiles[x]), std::to_string(profiles[x].calls.load(std::memory_order_relaxed)));
+        }
+        writeFamily(out, "nodalis_pou_seconds", "counter", "The time spent in the POU, including the POUs it called.", openMetrics);
+        for (size_t x = 0; x < pouCount; x++) {
+            writeSample(out, "nodalis_pou_seconds_total", pouLabels(profiles[x]), cycleSeconds(profiles[x].cycles));
+        }
+        writeFamily(out, "nodalis_pou_self_seconds", "counter", "The time spent in the POU itself.", openMetrics);
+        for (size_t x = 0; x < pouCount; x++) {
+            writeSample(out, "nodalis_pou_self_seconds_total", pouLabels(profiles[x]), cycleSeconds(profiles[x].selfCycles));
+        }
+        writeFamily(out, "nodalis_pou_max_seconds", "gauge", "The longest call of the POU.", openMetrics);
+        for (size_t x = 0; x < pouCount; x++) {
+            writeSample(out, "nodalis_pou_max_seconds", pouLabels(profiles[x]), cycleSeconds(profiles[x].maxCycles));
+        }
+    }
+
+    if (openMetrics) {
+        out += "# EOF\n";
+    }
+}
+#pragma endregion
+
+#pragma region "Server"
+MetricsServer::MetricsServer() {
+#ifdef _WIN32
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2,2), &wsa);
+#endif
+}
+
+MetricsServer::~MetricsServer() {
+    stop();
+}
+
+bool MetricsServer::start(uint16_t port, const std::string& backend) {
+    if (listenFd >= 0) return true;
+    int fd = static_cast<int>(socket(AF_INET, SOCK_STREAM, 0));
+    if (fd < 0) {
+        nodalisError() << "Metrics server socket failed\n";
+        return false;
+    }
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        nodalisError() << "Metrics server can't listen on port " << port << "\n";
+        closeSocket(fd);
+        return false;
+    }
+    setNonBlocking(fd);
+    listenFd = fd;
+
+    reactor = std::make_unique<IOReactor>("METRICS", backend);
+    reactor->start();
+    reactor->post([this]() {
+        reactor->watch(listenFd, EVENT_READABLE, [this](uint32_t) { acceptConnections(); });
+    });
+    nodalisLog() << "Metrics server listening on port " << port << "\n";
+    return true;
+}
+
+void MetricsServer::stop() {
+    if (!reactor) return;
+    reactor->runSync([this]() {
+        while (!connections.empty()) {
+            closeConnection(connections.begin()->first);
+        }
+        reactor->unwatch(listenFd);
+        closeSocket(listenFd);
+        listenFd = -1;
+    });
+    reactor->stop();
+    reactor.reset();
+}
+
+void MetricsServer::acceptConnections() {
+    while (true) {
+        int fd = static_cast<int>(accept(listenFd, nullptr, nullptr));
+        if (fd < 0) return;
+        if (connections.size() >= METRICS_MAX_CONNECTIONS) {
+            closeSocket(fd);
+            continue;
+        }
+        setNonBlocking(fd);
+        auto connection = std::make_unique<Connection>();
+        connection->fd = fd;
+        Connection& added = *connection;
+        connections[fd] = std::move(connection);
+        startReceive(added);
+    }
+}
+
+void MetricsServer::startReceive(Connection& connection) {
+    int fd = connection.fd;
+    if (!reactor->submitReceive(fd, [this, fd](const uint8_t* data, int result) { onReceived(fd, data, result); })) {
+        closeConnection(fd);
+    }
+}
+
+void MetricsServer::onReceived(int fd, const uint8_t* data, int result) {
+    auto it = connections.find(fd);
+    if (it == connections.end()) return;
+    Connection& connection = *it->second;
+    if (result <= 0 || connection.request.size() + static_cast<size_t>(result) > METRICS_MAX_REQUEST) {
+        closeConnection(fd);
+        return;
+    }
+    connection.request.append(reinterpret_cast<const char*>(data), static_cast<size_t>(result));
+    if (connection.request.find("\r\n\r\n") == std::string::npos) {
+        startReceive(connection);
+        return;
+    }
+    respond(connection);
+}
+
+void MetricsServer::respond(Connection& connection) {
+    const std::string& request = connection.request;
+    std::string target = request.substr(0, request.find("\r\n"));
+    std::string status = "200 OK";
+    std::string type = "text/plain; charset=utf-8";
+    std::string body;
+    if (target.compare(0, 4, "GET ") != 0) {
+        status = "405 Method Not Allowed";
+        body = "Only GET is supported.\n";
+    }
+    else if (target.compare(4, 9, "/metrics ") != 0 && target.compare(4, 9, "/metrics?") != 0) {
+        status = "404 Not Found";
+        body = "The metrics are served at /metrics.\n";
+    }
+    else {
+        // Prometheus asks for OpenMetrics in its Accept header, and gets the older text format otherwise.
+        bool openMetrics = request.find("application/openmetrics-text") != std::string::npos;
+        type = openMetrics ? "application/openmetrics-text; version=1.0.0; charset=utf-8" : "text/plain; version=0.0.4; charset=utf-8";
+        render(body, openMetrics);
+    }
+    connection.response = "HTTP/1.1 " + status + "\r\nContent-Type: " + type + "\r\nContent-Length: " +
+                          std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    connection.sent = 0;
+    flushSend(connection);
+}
+
+void MetricsServer::flushSend(Connection& connection) {
+    int fd = connection.fd;
+    if (connection.sent >= connection.response.size()) {
+        closeConnection(fd);
+        return;
+    }
+    size_t taken = reactor->submitSend(fd, reinterpret_cast<const uint8_t*>(connection.response.data()) + connection.sent,
+        connection.response.size() - connection.sent, [this, fd](const uint8_t*, int result) {
+            auto it = connections.find(fd);
+            if (it == connections.end()) return;
+            if (result <= 0) {
+                closeConnection(fd);
+                return;
+            }
+            it->second->sent += static_cast<size_t>(result);
+            flushSend(*it->second);
+        });
+    if (taken == 0) {
+        closeConnection(fd);
+    }
+}
+
+void MetricsServer::closeConnection(int fd) {
+    if (connections.erase(fd) == 0) return;
+    reactor->cancelIO(fd);
+    reactor->unwatch(fd);
+    closeSocket(fd);
+}
+#pragma endregion
@@ -0,0 +1,98 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Metrics
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+#pragma once
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+class IOReactor;
+
+/**
+ * Serves the runtime's metrics over HTTP, in the Prometheus text format or, when the scraper asks for it, in
+ * OpenMetrics. The server runs on an IO reactor of its own, and a scrape only reads the atomic counters of the
+ * statistics, IO clients, retentive memory and POU profiles, so it never waits for, or holds up, the scan.
+ *
+ * The metrics are:
+ * - nodalis_execution_seconds, a histogram of each registered set of statistics (Scan, Task.<name>, IO.<client>,
+ *   Retain, ...), by name, with its overruns, longest and last execution.
+ * - nodalis_io_*, the connection state, request, error and connection counters, and the latency histogram of each
+ *   IO client, by protocol, module and port.
+ * - nodalis_retain_*, the saves of retentive memory.
+ * - nodalis_memory_*, the resident memory of the process and the size of the process image, and the heap and
+ *   allocation counters in a build with NODALIS_ALLOC_TRACK, and the use of the arena in a build with
+ *   NODALIS_ARENA_BYTES.
+ * - nodalis_pou_*, the calls and time of each POU, for programs compiled with pouProfile.
+ */
+class MetricsServer {
+public:
+    MetricsServer();
+    ~MetricsServer();
+
+    /**
+     * Starts listening for scrapes.
+     * @param port The TCP port to listen on.
+     * @param backend The reactor backend to use, as accepted by createReactorBackend().
+     * @returns Returns false if the port can't be listened on.
+     */
+    bool start(uint16_t port, const std::string& backend = "");
+    /**
+     * Closes every connection and stops listening.
+     */
+    void stop();
+
+    /**
+     * Writes the current metrics.
+     * @param out The text to append the metrics to.
+     * @param openMetrics True for the OpenMetrics format, false for the Prometheus text format.
+     */
+    static void render(std::string& out, bool openMetrics);
+
+private:
+    /**
+     * A scraper's connection. Each connection is answered once and then closed.
+     */
+    struct Connection {
+        int fd;
+        std::string request;
+        std::string response;
+        size_t sent = 0;
+    };
+    std::unique_ptr<IOReactor> reactor;
+    std::map<int, std::unique_ptr<Connection>> connections;
+    int listenFd = -1;
+
+    void acceptConnections();
+    void startReceive(Connection& connection);
+    void onReceived(int fd, const uint8_t* data, int result);
+    /**
+     * Answers a complete request.
+     * @param connection The connection the request came on.
+     */
+    void respond(Connection& connection);
+    void flushSend(Connection& connection);
+    void closeConnection(int fd);
+};
+
+#endif // METRICS_H
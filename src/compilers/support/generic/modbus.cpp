@@ -19,98 +19,39 @@
  * @copyright Apache 2.0
  */
 #include "modbus.h"
+#include "nodalisjson.h"
+#include "ioreactor.h"
 #include <cstring>
-#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cmath>
+#include <array>
+#include <thread>
 #ifdef _WIN32
     #include <winsock2.h>
     #include <ws2tcpip.h>
     #pragma comment(lib, "ws2_32.lib")
 #else
     #include <errno.h>
+    #include <fcntl.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <poll.h>
+    #include <sys/ioctl.h>
+    #include <sys/select.h>
+    #include <termios.h>
+#endif
+#ifdef __linux__
+    #include <linux/serial.h>
 #endif
 
-// ========== Server Implementation ==========
-
-ModbusServer::ModbusServer() {}
-
-void ModbusServer::setCoil(uint16_t address, bool value) {
-    coils[address] = value;
-}
-
-bool ModbusServer::getCoil(uint16_t address) {
-    return coils[address];
-}
-
-void ModbusServer::setDiscreteInput(uint16_t address, bool value) {
-    discreteInputs[address] = value;
-}
-
-bool ModbusServer::getDiscreteInput(uint16_t address) {
-    return discreteInputs[address];
-}
-
-void ModbusServer::setRegister(uint16_t address, uint16_t value) {
-    holdingRegisters[address] = value;
-}
-
-uint16_t ModbusServer::getRegister(uint16_t address) {
-    return holdingRegisters[address];
-}
-
-ModbusResponse ModbusServer::handleRequest(const ModbusRequest& request) {
-    ModbusResponse res;
-    res.address = request.address;
-    res.function = request.function;
-    res.exceptionCode = 0;
-
-    switch (request.function) {
-        case READ_COILS:
-        case READ_DISCRETE_INPUTS: {
-            for (uint16_t i = 0; i < request.quantity; ++i) {
-                bool bit = (request.function == READ_COILS)
-                    ? getCoil(request.startAddress + i)
-                    : getDiscreteInput(request.startAddress + i);
-                if (i % 8 == 0)
-                    res.data.push_back(0);
-                if (bit)
-                    res.data[i / 8] |= (1 << (i % 8));
-            }
-            break;
-        }
-
-        case READ_HOLDING_REGISTERS:
-        case READ_INPUT_REGISTERS: {
-            for (uint16_t i = 0; i < request.quantity; ++i) {
-                uint16_t val = getRegister(request.startAddress + i);
-                res.data.push_back(val >> 8);
-                res.data.push_back(val & 0xFF);
-            }
-            break;
-        }
-
-        case WRITE_SINGLE_COIL: {
-            if (request.data.size() < 2) { res.exceptionCode = 0x03; break; }
-            bool value = (request.data[0] == 0xFF);
-            setCoil(request.startAddress, value);
-            res.data = request.data;
-            break;
-        }
-
-        case WRITE_SINGLE_REGISTER: {
-            if (request.data.size() < 2) { res.exceptionCode = 0x03; break; }
-            uint16_t value = (request.data[0] << 8) | request.data[1];
-            setRegister(request.startAddress, value);
-            res.data = request.data;
-            break;
-        }
-
-        default:
-            res.exceptionCode = 0x01;
-            break;
-    }
-
-    return res;
-}
+#ifdef MSG_NOSIGNAL
+    // A peer that resets the connection must fail the send rather than raise SIGPIPE.
+    static constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+    static constexpr int SEND_FLAGS = 0;
+#endif
 
 // ========== Client Implementation ==========
 
@@ -120,17 +61,26 @@ ModbusClient::ModbusClient(const std::string& ip, uint16_t port, uint8_t unitId)
     WSADATA wsa;
     WSAStartup(MAKEWORD(2,2), &wsa);
 #endif
+    reconnectDelay = minReconnectDelay = 1000;
+    maxReconnectDelay = 30000;
         if(ip != "") connectTCP(ip, port);
 }
 
+ModbusClient::ModbusClient(const char* protocol, uint8_t unitId)
+    : IOClient(protocol), port(0), sockfd(-1), deviceAddress(unitId) {
+    reconnectDelay = minReconnectDelay = 1000;
+    maxReconnectDelay = 30000;
+}
+
 ModbusClient::~ModbusClient() {
+    stop();
+    if (reactor != nullptr) {
+        reactor->runSync([this]() { detach(); });
+    }
     disconnect();
 }
 
-void ModbusClient::connect(){
-    if(connected){
-        disconnect();
-    }
+bool ModbusClient::resolveEndpoint() {
     if(ip == "" || port == 0){
         if(mappings.size() > 0){
             IOMap& map = mappings[0];
@@ -140,47 +90,213 @@ void ModbusClient::connect(){
     }
     if(ip != "" && port > 0){
         moduleID = ip;
+        return true;
+    }
+    return false;
+}
+
+void ModbusClient::connect(){
+    if(connected){
+        disconnect();
+    }
+    if(resolveEndpoint()){
         connectTCP(ip, port);
     }
 }
 
-bool ModbusClient::connectTCP(const std::string& ip, uint16_t port) {
-    std::cout << "Modbus-TCP attempting to connect to " << ip.c_str() << ":" << port << "\n";
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd < 0) return false;
+/**
+ * Closes a socket.
+ * @param fd The socket.
+ */
+static void closeSocket(int fd) {
+#ifdef _WIN32
+    closesocket(fd);
+#else
+    close(fd);
+#endif
+}
+
+/**
+ * Switches a socket between blocking and non-blocking mode.
+ * @param fd The socket.
+ * @param nonBlocking True for non-blocking mode.
+ * @returns Returns true on success.
+ */
+static bool setNonBlocking(int fd, bool nonBlocking) {
+#ifdef _WIN32
+    u_long mode = nonBlocking ? 1 : 0;
+    return ioctlsocket(fd, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return false;
+    flags = nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    return fcntl(fd, F_SETFL, flags) == 0;
+#endif
+}
+
+/**
+ * Waits until a socket is readable or writable.
+ * @param fd The socket.
+ * @param forWrite True to wait for the socket to become writable, false to wait for data to read.
+ * @param timeoutMs The longest time to wait, in milliseconds.
+ * @returns Returns 1 if the socket is ready, 0 on timeout and -1 on error.
+ */
+static int waitSocket(int fd, bool forWrite, int64_t timeoutMs) {
+    fd_set set;
+    FD_ZERO(&set);
+    FD_SET(fd, &set);
+    timeval tv;
+    tv.tv_sec = static_cast<long>(timeoutMs / 1000);
+    tv.tv_usec = static_cast<long>((timeoutMs % 1000) * 1000);
+    int ret;
+    do {
+        ret = select(fd + 1, forWrite ? nullptr : &set, forWrite ? &set : nullptr, nullptr, &tv);
+#ifdef _WIN32
+    } while (false);
+#else
+    } while (ret < 0 && errno == EINTR);
+#endif
+    return ret;
+}
+
+/**
+ * Prints the last socket error.
+ * @param what The operation that failed.
+ */
+static void printSocketError(const char* what) {
+#ifdef _WIN32
+    nodalisError() << what << " failed: WSA error " << WSAGetLastError() << "\n";
+#else
+    nodalisError() << what << " failed: " << strerror(errno) << " (errno = " << errno << ")\n";
+#endif
+}
+
+int ModbusClient::openConnection(const std::string& ip, uint16_t port, bool& pending) {
+    DIAGNOSTIC_AT(LogSeverity::Info, "Modbus-TCP attempting to connect to " << ip.c_str() << ":" << port);
+    pending = false;
+    int fd = static_cast<int>(socket(AF_INET, SOCK_STREAM, 0));
+    if (fd < 0) return -1;
 
     sockaddr_in serverAddr;
     memset(&serverAddr, 0, sizeof(serverAddr));
     serverAddr.sin_family = AF_INET;
     serverAddr.sin_port = htons(port);
     inet_pton(AF_INET, ip.c_str(), &serverAddr.sin_addr);
-    
-    int err = ::connect(sockfd, (sockaddr*)&serverAddr, sizeof(serverAddr));
+
+    // Connect without blocking, so that an unreachable device costs at most connectTimeout.
+    if (!setNonBlocking(fd, true)) {
+        printSocketError("Connect");
+        closeSocket(fd);
+        return -1;
+    }
+    int err = ::connect(fd, (sockaddr*)&serverAddr, sizeof(serverAddr));
     if (err < 0) {
-        disconnect();
-        #ifdef _WIN32
-            int wsaErr = WSAGetLastError();
-            std::cerr << "Connect failed: WSA Error " << wsaErr << "\n";
-        #else
-            std::cerr << "Connect failed: " << strerror(errno)
-                    << " (errno = " << errno << ")\n";
-        #endif
+#ifdef _WIN32
+        pending = WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        pending = errno == EINPROGRESS;
+#endif
+        if (!pending) {
+            printSocketError("Connect");
+            closeSocket(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+/**
+ * Checks the result of a non-blocking connect once its socket has become writable.
+ * @param fd The socket.
+ * @returns Returns true if the connection was established.
+ */
+static bool connectSucceeded(int fd) {
+    int soError = 0;
+    socklen_t len = sizeof(soError);
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&soError), &len) < 0) {
+        printSocketError("Connect");
+        return false;
+    }
+    if (soError != 0) {
+        DIAGNOSTIC_AT(LogSeverity::Error, "Connect failed: " << strerror(soError));
         return false;
     }
-    std::cout << "Modbus-TCP connected to " << ip.c_str() << ":" << port << "\n";
-    connected = true;
     return true;
 }
 
-void ModbusClient::disconnect() {
-    if (connected) {
+bool ModbusClient::connectTCP(const std::string& ip, uint16_t port) {
+    bool pending = false;
+    int fd = openConnection(ip, port, pending);
+    if (fd < 0) return false;
+    if (pending) {
+        int ready = waitSocket(fd, true, connectTimeout);
+        if (ready == 0) {
+            DIAGNOSTIC_AT(LogSeverity::Error, "Connect to " << ip << ":" << port << " timed out after " << connectTimeout << "ms");
+        }
+        else if (ready < 0) {
+            printSocketError("Connect");
+        }
+        if (ready <= 0 || !connectSucceeded(fd)) {
+            closeSocket(fd);
+            return false;
+        }
+    }
+    setNonBlocking(fd, false);
+    connectionEstablished(fd);
+    return true;
+}
+
+void ModbusClient::connectionEstablished(int fd) {
+    configureSocket(fd);
+    sockfd = fd;
+    receiveBuffer.clear();
+    receiveStart = 0;
+    sendBuffer.clear();
+    DIAGNOSTIC_AT(LogSeverity::Info, "Modbus-TCP connected to " << ip.c_str() << ":" << port);
+    connecting = false;
+    connected = true;
+}
+
+void ModbusClient::configureSocket(int fd) {
+    int on = 1;
+    if (noDelay) {
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&on), sizeof(on));
+    }
+    if (keepAliveSeconds > 0) {
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, reinterpret_cast<const char*>(&on), sizeof(on));
+#if defined(TCP_KEEPIDLE) && defined(TCP_KEEPINTVL) && defined(TCP_KEEPCNT)
+        // Probe after keepAliveSeconds idle, then every second, and drop the connection after 3 missed probes.
+        int idle = keepAliveSeconds, interval = 1, count = 3;
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+#endif
+    }
+    // Bound sends as well, so that a full send buffer on a dead connection can't block the client.
 #ifdef _WIN32
-        closesocket(sockfd);
+    DWORD sendTimeout = static_cast<DWORD>(responseTimeout);
 #else
-        close(sockfd);
+    timeval sendTimeout;
+    sendTimeout.tv_sec = static_cast<long>(responseTimeout / 1000);
+    sendTimeout.tv_usec = static_cast<long>((responseTimeout % 1000) * 1000);
 #endif
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&sendTimeout), sizeof(sendTimeout));
+}
+
+void ModbusClient::disconnect() {
+    if (connected || connecting) {
+        if (reactor != nullptr) {
+            reactor->cancelIO(sockfd);
+            reactor->unwatch(sockfd);
+        }
+        closeSocket(sockfd);
         connected = false;
+        connecting = false;
     }
+    sending = false;
+    receiveBuffer.clear();
+    receiveStart = 0;
+    sendBuffer.clear();
 }
 
 ModbusRequest ModbusClient::createReadRequest(uint8_t function, uint16_t startAddress, uint16_t quantity) {
@@ -198,211 +314,1870 @@ ModbusRequest ModbusClient::createWriteSingleRegister(uint16_t address, uint16_t
 }
 
 bool ModbusClient::sendRequest(const ModbusRequest& req, ModbusResponse& resp) {
-    std::vector<uint8_t> pdu;
-
-    // Handle function-specific encoding
-    if (req.function == WRITE_SINGLE_COIL) {
-        // Function 0x05: Write Single Coil
-        pdu = {
-            req.function,
-            static_cast<uint8_t>(req.startAddress >> 8),
-            static_cast<uint8_t>(req.startAddress & 0xFF)
-        };
-        if (req.data.size() == 2) {
-            pdu.push_back(req.data[0]);  // Hi byte (0xFF or 0x00)
-            pdu.push_back(req.data[1]);  // Lo byte (always 0x00)
-        } else {
-            std::cerr << "Invalid data size for Write Single Coil (expected 2 bytes).\n";
-            return false;
-        }
-    } else {
-        // Default encoding for most function codes
-        pdu = {
-            req.function,
-            static_cast<uint8_t>(req.startAddress >> 8),
-            static_cast<uint8_t>(req.startAddress & 0xFF),
-            static_cast<uint8_t>(req.quantity >> 8),
-            static_cast<uint8_t>(req.quantity & 0xFF)
-        };
-        pdu.insert(pdu.end(), req.data.begin(), req.data.end());
-    }
-
-    std::vector<uint8_t> response;
-    if (!sendRaw(pdu, response)) return false;
+    std::vector<ModbusRequest> requests = { req };
+    std::vector<ModbusResponse> responses;
+    std::vector<bool> succeeded;
+    sendRequests(requests, responses, succeeded);
+    resp = responses[0];
+    return succeeded[0];
+}
 
-    if (response.size() < 2) return false;
+void ModbusClient::sendRequests(const std::vector<ModbusRequest>& requests, std::vector<ModbusResponse>& responses, std::vector<bool>& succeeded) {
+    responses.assign(requests.size(), ModbusResponse{});
+    succeeded.assign(requests.size(), false);
+    transact(requests.size(),
+        [&](size_t index, uint16_t transactionId, uint8_t* adu) {
+            return encodeRequest(requests[index], transactionId, adu);
+        },
+        [&](size_t index, ModbusBytes pdu, bool received) {
+            if (received) {
+                succeeded[index] = decodeResponse(requests[index], pdu, responses[index]);
+            }
+        });
+}
 
-    resp.address = req.address;
-    resp.function = response[0];
-    resp.data.assign(response.begin() + 1, response.end());
-    resp.exceptionCode = (resp.function & 0x80) ? resp.data[0] : 0;
+template <typename Encode, typename Complete>
+void ModbusClient::transact(size_t count, Encode encode, Complete complete) {
+    size_t window = maxInFlight < 1 ? 1 : maxInFlight;
+    size_t next = 0;
+    uint8_t adu[MODBUS_MAX_ADU];
+    inFlight.clear();
+    while (connected && (next < count || !inFlight.empty())) {
+        while (connected && next < count && inFlight.size() < window) {
+            size_t index = next++;
+            uint16_t transactionId = nextTransactionId++;
+            size_t length = encode(index, transactionId, adu);
+            if (length == 0) {
+                complete(index, ModbusBytes{}, false);
+                continue;
+            }
+            if (!sendFrame(adu, length)) {
+                requestCompleted(false, 0);
+                complete(index, ModbusBytes{}, false);
+                break;
+            }
+            inFlight.push_back({ transactionId, index, std::chrono::steady_clock::now() });
+        }
+        if (inFlight.empty()) continue;
 
-    if (resp.exceptionCode > 0) {
-        std::cerr << "MODBUS exception code: " << static_cast<int>(resp.exceptionCode) << "\n";
-        return false;
+        // Wait no longer than the response timeout of the oldest outstanding request.
+        auto deadline = std::chrono::steady_clock::time_point::max();
+        for (const auto& request : inFlight) {
+            auto due = request.sentAt + std::chrono::milliseconds(responseTimeout);
+            if (due < deadline) deadline = due;
+        }
+        uint16_t transactionId = 0;
+        ModbusBytes pdu;
+        if (!receiveFrame(transactionId, pdu, deadline)) break;
+        size_t index;
+        if (!takeInFlight(transactionId, pdu, index)) {
+            DIAGNOSTIC_AT(LogSeverity::Error, "Discarding MODBUS response with unknown transaction ID " << transactionId);
+            continue;
+        }
+        complete(index, pdu, true);
+    }
+    // Whatever wasn't answered when the connection failed is failed too.
+    for (const auto& request : inFlight) {
+        requestCompleted(false, 0);
+        complete(request.index, ModbusBytes{}, false);
+    }
+    inFlight.clear();
+    for (; next < count; next++) {
+        complete(next, ModbusBytes{}, false);
     }
+}
 
-    return true;
+bool ModbusClient::takeInFlight(uint16_t transactionId, ModbusBytes pdu, size_t& index) {
+    for (size_t i = 0; i < inFlight.size(); i++) {
+        if (inFlight[i].transactionId == transactionId) {
+            index = inFlight[i].index;
+            requestCompleted(pdu.size >= 2 && (pdu.data[0] & 0x80) == 0,
+                microsBetween(inFlight[i].sentAt, std::chrono::steady_clock::now()));
+            inFlight[i] = inFlight.back();
+            inFlight.pop_back();
+            return true;
+        }
+    }
+    return false;
 }
 
-bool ModbusClient::sendRaw(const std::vector<uint8_t>& pdu, std::vector<uint8_t>& response) {
-    if (!connected) return false;
+/**
+ * Writes a big endian 16 bit value.
+ * @param out The first byte to write.
+ * @param value The value.
+ */
+static inline void putWord(uint8_t* out, uint16_t value) {
+    out[0] = static_cast<uint8_t>(value >> 8);
+    out[1] = static_cast<uint8_t>(value & 0xFF);
+}
 
+/**
+ * Writes the MBAP header of a frame whose PDU has been written after it.
+ * @param adu The frame.
+ * @param transactionId The transaction ID.
+ * @param unitId The unit ID.
+ * @param pduLength The length of the PDU.
+ * @returns Returns the length of the frame.
+ */
+static size_t finishFrame(uint8_t* adu, uint16_t transactionId, uint8_t unitId, size_t pduLength) {
     // MBAP header (7 bytes): Transaction ID, Protocol ID, Length, Unit ID
-    uint8_t mbap[7] = {
-        0x00, 0x01, 0x00, 0x00,
-        static_cast<uint8_t>((pdu.size() + 1) >> 8),
-        static_cast<uint8_t>((pdu.size() + 1) & 0xFF),
-        deviceAddress
-    };
-
-    std::vector<uint8_t> packet(mbap, mbap + 7);
-    packet.insert(packet.end(), pdu.begin(), pdu.end());
-
-    // Send the packet
-    ssize_t bytesSent = send(sockfd, reinterpret_cast<const char*>(packet.data()), packet.size(), 0);
-    if (bytesSent < 0) {
-#ifdef _WIN32
-        int err = WSAGetLastError();
-        std::cerr << "Send failed: WSA error " << err << "\n";
-#else
-        std::cerr << "Send failed: " << strerror(errno) << " (errno = " << errno << ")\n";
-#endif
-        disconnect();
-        connected = false;
-        return false;
+    putWord(adu, transactionId);
+    putWord(adu + 2, 0);
+    putWord(adu + 4, static_cast<uint16_t>(pduLength + 1));
+    adu[6] = unitId;
+    return MODBUS_MBAP_SIZE + pduLength;
+}
+
+size_t ModbusClient::encodeRequest(const ModbusRequest& req, uint16_t transactionId, uint8_t* adu) {
+    uint8_t* pdu = adu + MODBUS_MBAP_SIZE;
+    pdu[0] = req.function;
+    putWord(pdu + 1, req.startAddress);
+    size_t length;
+    // Handle function-specific encoding
+    if (req.function == WRITE_SINGLE_COIL || req.function == WRITE_SINGLE_REGISTER) {
+        // Functions 0x05 and 0x06: the address is followed directly by the value
+        if (req.data.size() != 2) {
+            nodalisError() << "Invalid data size for Write Single Coil/Register (expected 2 bytes).\n";
+            return 0;
+        }
+        pdu[3] = req.data[0];  // Hi byte
+        pdu[4] = req.data[1];  // Lo byte
+        length = 5;
+    } else {
+        // Default encoding for most function codes
+        putWord(pdu + 3, req.quantity);
+        length = 5;
+        if (req.function == WRITE_MULTIPLE_COILS || req.function == WRITE_MULTIPLE_REGISTERS) {
+            pdu[length++] = static_cast<uint8_t>(req.data.size());
+        }
+        if (length + req.data.size() > MODBUS_MAX_PDU) {
+            nodalisError() << "MODBUS request of " << req.data.size() << " bytes is too large.\n";
+            return 0;
+        }
+        if (!req.data.empty()) {
+            memcpy(pdu + length, req.data.data(), req.data.size());
+        }
+        length += req.data.size();
     }
+    return finishFrame(adu, transactionId, req.address, length);
+}
 
-    // Receive response
-    uint8_t buf[260] = {0};
-    ssize_t len = recv(sockfd, reinterpret_cast<char*>(buf), sizeof(buf), 0);
-    if (len < 0) {
-#ifdef _WIN32
-        int err = WSAGetLastError();
-        std::cerr << "Receive failed: WSA error " << err << "\n";
-#else
-        std::cerr << "Receive failed: " << strerror(errno) << " (errno = " << errno << ")\n";
-#endif
-        disconnect();
-        connected = false;
+bool ModbusClient::checkResponse(uint8_t function, ModbusBytes pdu) {
+    if (pdu.size < 2) return false;
+    if (pdu.data[0] & 0x80) {
+        DIAGNOSTIC_AT(LogSeverity::Error, "MODBUS exception code: " << static_cast<int>(pdu.data[1]));
         return false;
     }
-
-    if (len < 9) {
-        std::cerr << "Incomplete MODBUS response (len = " << len << ")\n";
-        disconnect();
-        connected = false;
+    if (pdu.data[0] != function) {
+        DIAGNOSTIC_AT(LogSeverity::Error, "MODBUS response function " << static_cast<int>(pdu.data[0]) << " does not match request " << static_cast<int>(function));
         return false;
     }
-
-    response.assign(buf + 7, buf + len);
     return true;
 }
 
-bool ModbusClient::readBit(const std::string& remote, int& result) {
-    uint16_t addr = static_cast<uint16_t>(std::stoi(remote));
-    ModbusRequest req = createReadRequest(READ_DISCRETE_INPUTS, addr, 1);
-    ModbusResponse res;
-    if (!sendRequest(req, res)) return false;
+bool ModbusClient::decodeResponse(const ModbusRequest& req, ModbusBytes pdu, ModbusResponse& resp) {
+    if (pdu.size < 2) return false;
 
-    result = (res.data[1] & 0x01) ? 1 : 0;
-    return true;
+    resp.address = req.address;
+    resp.function = pdu.data[0];
+    resp.data.assign(pdu.data + 1, pdu.data + pdu.size);
+    resp.exceptionCode = (resp.function & 0x80) ? resp.data[0] : 0;
+    return checkResponse(req.function, pdu);
 }
 
-bool ModbusClient::writeBit(const std::string& remote, int value) {
-    uint16_t addr = static_cast<uint16_t>(std::stoi(remote));
-    ModbusRequest req = createWriteSingleCoil(addr, value != 0);
-    ModbusResponse res;
-    return sendRequest(req, res);
+int ModbusClient::takeFrame(uint16_t& transactionId, ModbusBytes& pdu) {
+    size_t available = receiveBuffer.size() - receiveStart;
+    if (available < MODBUS_MBAP_SIZE) return 0;
+    const uint8_t* frame = receiveBuffer.data() + receiveStart;
+    uint16_t length = static_cast<uint16_t>((frame[4] << 8) | frame[5]);
+    bool validProtocol = frame[2] == 0 && frame[3] == 0;
+    if (!validProtocol || length < 2 || length > 254) {
+        DIAGNOSTIC_AT(LogSeverity::Error, "Invalid MODBUS frame (length = " << length << ")");
+        return -1;
+    }
+    size_t frameSize = 6 + static_cast<size_t>(length);
+    if (available < frameSize) return 0;
+    transactionId = static_cast<uint16_t>((frame[0] << 8) | frame[1]);
+    pdu.data = frame + MODBUS_MBAP_SIZE;
+    pdu.size = frameSize - MODBUS_MBAP_SIZE;
+    // The frame stays in the buffer, so that the PDU can be decoded in place, until the buffer is next compacted.
+    receiveStart += frameSize;
+    return 1;
 }
 
-bool ModbusClient::readByte(const std::string& remote, uint8_t& result) {
-    uint16_t addr = static_cast<uint16_t>(std::stoi(remote));
-    ModbusRequest req = createReadRequest(READ_HOLDING_REGISTERS, addr, 1);
-    ModbusResponse res;
-    if (!sendRequest(req, res)) return false;
+void ModbusClient::compactReceiveBuffer() {
+    if (receiveStart > 0) {
+        receiveBuffer.erase(receiveBuffer.begin(), receiveBuffer.begin() + receiveStart);
+        receiveStart = 0;
+    }
+}
 
-    // Read only low byte
-    result = res.data.size() >= 2 ? res.data[1] : 0;
+bool ModbusClient::sendFrame(const uint8_t* adu, size_t length) {
+    if (!connected) return false;
+
+    size_t sent = 0;
+    while (sent < length) {
+        ssize_t bytesSent = send(sockfd, reinterpret_cast<const char*>(adu + sent), length - sent, SEND_FLAGS);
+        if (bytesSent <= 0) {
+            printSocketError("Send");
+            disconnect();
+            return false;
+        }
+        sent += bytesSent;
+    }
     return true;
 }
 
-bool ModbusClient::writeByte(const std::string& remote, uint8_t value) {
-    uint16_t addr = static_cast<uint16_t>(std::stoi(remote));
-    // Store value in lower byte; high byte = 0
-    std::vector<uint8_t> data = { 0x00, value };
-    ModbusRequest req = { deviceAddress, WRITE_SINGLE_REGISTER, addr, 1, data };
-    ModbusResponse res;
-    return sendRequest(req, res);
+bool ModbusClient::receiveFrame(uint16_t& transactionId, ModbusBytes& pdu, std::chrono::steady_clock::time_point deadline) {
+    // A read may return part of a response or several of them, so frames are cut from the buffer by their MBAP length.
+    while (connected) {
+        int framed = takeFrame(transactionId, pdu);
+        if (framed > 0) {
+            return true;
+        }
+        if (framed < 0) {
+            disconnect();
+            return false;
+        }
+
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        int ready = remaining > 0 ? waitSocket(sockfd, false, remaining) : 0;
+        if (ready <= 0) {
+            // A device that stops answering is dropped and reconnected with backoff, rather than waited on.
+            if (ready == 0) {
+                DIAGNOSTIC_AT(LogSeverity::Error, "MODBUS response from " << ip << " timed out after " << responseTimeout << "ms");
+            }
+            else {
+                printSocketError("Receive");
+            }
+            disconnect();
+            return false;
+        }
+
+        // Receive straight into the buffer, which keeps its capacity from poll to poll.
+        compactReceiveBuffer();
+        size_t used = receiveBuffer.size();
+        receiveBuffer.resize(used + MODBUS_MAX_ADU);
+        ssize_t len = recv(sockfd, reinterpret_cast<char*>(receiveBuffer.data() + used), MODBUS_MAX_ADU, 0);
+        receiveBuffer.resize(used + (len > 0 ? static_cast<size_t>(len) : 0));
+        if (len <= 0) {
+            if (len == 0) {
+                DIAGNOSTIC_AT(LogSeverity::Error, "MODBUS connection closed by " << ip);
+            }
+            else {
+                printSocketError("Receive");
+            }
+            disconnect();
+            return false;
+        }
+    }
+    return false;
 }
 
-bool ModbusClient::readWord(const std::string& remote, uint16_t& result) {
-    uint16_t addr = static_cast<uint16_t>(std::stoi(remote));
-    ModbusRequest req = createReadRequest(READ_HOLDING_REGISTERS, addr, 1);
-    ModbusResponse res;
-    if (!sendRequest(req, res)) return false;
+// ========== Request Coalescing ==========
 
-    result = (res.data[0] << 8) | res.data[1];
-    return true;
+// Largest blocks allowed by the protocol for one read or write.
+static constexpr uint16_t MAX_READ_REGISTERS = 125;
+static constexpr uint16_t MAX_READ_BITS = 2000;
+static constexpr uint16_t MAX_WRITE_REGISTERS = 123;
+static constexpr uint16_t MAX_WRITE_BITS = 1968;
+// Unmapped registers or bits that may be read between two mappings to merge them into one request.
+static constexpr uint16_t MAX_REGISTER_GAP = 8;
+static constexpr uint16_t MAX_BIT_GAP = 64;
+
+static int intProperty(const json& config, const char* name, int fallback) {
+    if (!config.is_object() || !config.contains(name)) return fallback;
+    const json& value = config[name];
+    if (value.is_string()) return std::atoi(value.get<std::string>().c_str());
+    if (value.is_number()) return value.get<int>();
+    return fallback;
 }
 
-bool ModbusClient::writeWord(const std::string& remote, uint16_t value) {
-    uint16_t addr = static_cast<uint16_t>(std::stoi(remote));
-    ModbusRequest req = createWriteSingleRegister(addr, value);
-    ModbusResponse res;
-    return sendRequest(req, res);
+/**
+ * Reads a string protocol property, ignoring case.
+ * @param config The protocol properties.
+ * @param name The name of the property.
+ * @returns Returns the value of the property in upper case, or an empty string if it is not present.
+ */
+static std::string stringProperty(const json& config, const char* name) {
+    if (!config.is_object() || !config.contains(name) || !config[name].is_string()) return "";
+    std::string value = config[name].get<std::string>();
+    std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+    return value;
 }
 
-bool ModbusClient::readDWord(const std::string& remote, uint32_t& result) {
-    uint16_t addr = static_cast<uint16_t>(std::stoi(remote));
-    ModbusRequest req = createReadRequest(READ_HOLDING_REGISTERS, addr, 2);
-    ModbusResponse res;
-    if (!sendRequest(req, res)) return false;
+/**
+ * Converts a block of big endian registers to host order. This is one pass over the block that the compiler can
+ * vectorize, so that the points of the block are assembled from registers rather than from single bytes.
+ * @param in The registers as received.
+ * @param out Receives the registers in host order.
+ * @param count The number of registers.
+ */
+static void loadRegisters(const uint8_t* in, uint16_t* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = static_cast<uint16_t>((in[i * 2] << 8) | in[i * 2 + 1]);
+    }
+}
 
-    result = (res.data[0] << 24) | (res.data[1] << 16) | (res.data[2] << 8) | res.data[3];
-    return true;
+static inline uint16_t swapBytes(uint16_t value) {
+    return static_cast<uint16_t>((value << 8) | (value >> 8));
 }
 
-bool ModbusClient::writeDWord(const std::string& remote, uint32_t value) {
-    uint16_t addr = static_cast<uint16_t>(std::stoi(remote));
-    std::vector<uint8_t> data = {
-        static_cast<uint8_t>(value >> 24),
-        static_cast<uint8_t>((value >> 16) & 0xFF),
-        static_cast<uint8_t>((value >> 8) & 0xFF),
-        static_cast<uint8_t>(value & 0xFF)
-    };
+/**
+ * Assembles a value from its registers.
+ * @param regs The registers of the value, in host order.
+ * @param count The number of registers.
+ * @param order The ModbusWordOrder of the registers.
+ * @returns Returns the value.
+ */
+static uint64_t joinRegisters(const uint16_t* regs, uint16_t count, uint8_t order) {
+    bool byteSwap = order == WORD_ORDER_BADC || order == WORD_ORDER_DCBA;
+    bool wordSwap = order == WORD_ORDER_CDAB || order == WORD_ORDER_DCBA;
+    uint64_t value = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t reg = regs[wordSwap ? count - 1 - i : i];
+        value = (value << 16) | (byteSwap ? swapBytes(reg) : reg);
+    }
+    return value;
+}
 
-    ModbusRequest req = { deviceAddress, WRITE_MULTIPLE_REGISTERS, addr, 2, data };
-    ModbusResponse res;
-    return sendRequest(req, res);
+/**
+ * Splits a value into big endian registers. This is the inverse of joinRegisters().
+ * @param value The value.
+ * @param count The number of registers.
+ * @param order The ModbusWordOrder of the registers.
+ * @param out Receives the registers, 2 bytes each.
+ */
+static void splitRegisters(uint64_t value, uint16_t count, uint8_t order, uint8_t* out) {
+    bool byteSwap = order == WORD_ORDER_BADC || order == WORD_ORDER_DCBA;
+    bool wordSwap = order == WORD_ORDER_CDAB || order == WORD_ORDER_DCBA;
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t reg = static_cast<uint16_t>(value >> ((count - 1 - i) * 16));
+        putWord(out + (wordSwap ? count - 1 - i : i) * 2, byteSwap ? swapBytes(reg) : reg);
+    }
 }
 
-bool ModbusClient::readLWord(const std::string &remote, uint64_t &result)
-{
-    uint16_t addr = static_cast<uint16_t>(std::stoi(remote));
-    ModbusRequest req = createReadRequest(READ_HOLDING_REGISTERS, addr, 4);
-    ModbusResponse res;
-    if (!sendRequest(req, res))
-        return false;
+/**
+ * Converts the value of a point's registers to the value of its mapping. A REAL or LREAL is stored as IEEE bits in
+ * 32 and 64 bit mappings, converted between float and double when the widths differ, and rounded to an integer in
+ * narrower mappings.
+ * @param remote The value of the registers.
+ * @param dataType The ModbusDataType of the registers.
+ * @param width The width of the mapping.
+ * @returns Returns the value to store in the process image.
+ */
+static uint64_t toLocal(uint64_t remote, uint8_t dataType, int width) {
+    if (dataType == MODBUS_INTEGER) return remote;
+    if ((dataType == MODBUS_REAL && width == 32) || (dataType == MODBUS_LREAL && width == 64)) return remote;
+    double real;
+    if (dataType == MODBUS_REAL) {
+        uint32_t bits = static_cast<uint32_t>(remote);
+        float single;
+        memcpy(&single, &bits, sizeof(single));
+        real = single;
+    }
+    else {
+        memcpy(&real, &remote, sizeof(real));
+    }
+    if (width == 64) {
+        uint64_t bits;
+        memcpy(&bits, &real, sizeof(bits));
+        return bits;
+    }
+    if (width == 32) {
+        float single = static_cast<float>(real);
+        uint32_t bits;
+        memcpy(&bits, &single, sizeof(bits));
+        return bits;
+    }
+    return static_cast<uint64_t>(static_cast<int64_t>(std::llround(real)));
+}
 
-    result = ((uint64_t)res.data[0] << 56) | ((uint64_t)res.data[1] << 48) | ((uint64_t)res.data[2] << 40) | ((uint64_t)res.data[3] << 32) | ((uint64_t)res.data[4] << 24) | ((uint64_t)res.data[5] << 16) | ((uint64_t)res.data[6] << 8) | (uint64_t)res.data[7];
-    return true;
+/**
+ * Converts the value of a mapping to the value of its point's registers. This is the inverse of toLocal().
+ * @param local The value in the process image.
+ * @param dataType The ModbusDataType of the registers.
+ * @param width The width of the mapping.
+ * @returns Returns the value to write to the registers.
+ */
+static uint64_t toRemote(uint64_t local, uint8_t dataType, int width) {
+    if (dataType == MODBUS_INTEGER) return local;
+    if ((dataType == MODBUS_REAL && width == 32) || (dataType == MODBUS_LREAL && width == 64)) return local;
+    double real;
+    if (width == 64) {
+        memcpy(&real, &local, sizeof(real));
+    }
+    else if (width == 32) {
+        uint32_t bits = static_cast<uint32_t>(local);
+        float single;
+        memcpy(&single, &bits, sizeof(single));
+        real = single;
+    }
+    else {
+        // Narrow mappings hold signed integers.
+        real = width == 8 ? static_cast<int8_t>(local) : static_cast<int16_t>(local);
+    }
+    if (dataType == MODBUS_REAL) {
+        float single = static_cast<float>(real);
+        uint32_t bits;
+        memcpy(&bits, &single, sizeof(bits));
+        return bits;
+    }
+    uint64_t bits;
+    memcpy(&bits, &real, sizeof(bits));
+    return bits;
 }
 
-bool ModbusClient::writeLWord(const std::string &remote, uint64_t value)
-{
-    uint16_t addr = static_cast<uint16_t>(std::stoi(remote));
-    std::vector<uint8_t> data = {
-        static_cast<uint8_t>((value >> 56) & 0xFF),
-        static_cast<uint8_t>((value >> 48) & 0xFF),
-        static_cast<uint8_t>((value >> 40) & 0xFF),
-        static_cast<uint8_t>((value >> 32) & 0xFF),
-        static_cast<uint8_t>((value >> 24) & 0xFF),
-        static_cast<uint8_t>((value >> 16) & 0xFF),
-        static_cast<uint8_t>((value >> 8) & 0xFF),
-        static_cast<uint8_t>(value & 0xFF)};
-
-    ModbusRequest req = {deviceAddress, WRITE_MULTIPLE_REGISTERS, addr, 4, data};
+void ModbusClient::addPoint(IOMap& map, uint8_t unit) {
+    ModbusPoint point;
+    NODALIS_TRY {
+        if (resolvePoint(map, unit, point)) {
+            point.mapping = static_cast<size_t>(&map - mappings.data());
+            map.remoteHandle = static_cast<int>(points.size());
+            points.push_back(point);
+        }
+    }
+    NODALIS_CATCH(e) {
+        nodalisLog() << "Invalid Modbus address " << map.remoteAddress << " for " << map.localAddress << "\n";
+    }
+}
+
+void ModbusClient::onMappingAdded(IOMap& map) {
+    json config = protocolProperties(map);
+    addPoint(map, deviceAddress);
+    int window = intProperty(config, "MaxInFlight", 0);
+    if (window > 0) {
+        maxInFlight = window;
+    }
+    connectTimeout = intProperty(config, "ConnectTimeout", static_cast<int>(connectTimeout));
+    responseTimeout = intProperty(config, "ResponseTimeout", static_cast<int>(responseTimeout));
+    minReconnectDelay = intProperty(config, "ReconnectDelay", static_cast<int>(minReconnectDelay));
+    maxReconnectDelay = intProperty(config, "MaxReconnectDelay", static_cast<int>(maxReconnectDelay));
+    if (maxReconnectDelay < minReconnectDelay) {
+        maxReconnectDelay = minReconnectDelay;
+    }
+    if (lastAttempt == 0) {
+        reconnectDelay = minReconnectDelay;
+    }
+    keepAliveSeconds = intProperty(config, "KeepAlive", keepAliveSeconds);
+    if (config.is_object() && config.contains("NoDelay") && config["NoDelay"].is_boolean()) {
+        noDelay = config["NoDelay"].get<bool>();
+    }
+    if (config.is_object() && config.contains("Coalesce") && config["Coalesce"].is_boolean()) {
+        coalesce = config["Coalesce"].get<bool>();
+    }
+}
+
+bool ModbusClient::resolvePoint(const IOMap& map, uint8_t unit, ModbusPoint& point) {
+    json config = protocolProperties(map);
+    point.local = map.local;
+    point.quality = map.quality;
+    point.width = map.width;
+    point.unit = static_cast<uint8_t>(intProperty(config, "UnitID", unit));
+    point.address = static_cast<uint16_t>(std::stoi(map.remoteAddress));
+    // A bit may be a bit of a register, as <register>.<bit>. Every input of the register shares its read, and the
+    // outputs of the register are written together with a mask write, which leaves its other bits alone.
+    size_t dot = map.remoteAddress.find('.');
+    if (dot != std::string::npos) {
+        int bit = std::stoi(map.remoteAddress.substr(dot + 1));
+        if (map.width != 1 || bit < 0 || bit > 15) {
+            nodalisLog() << "Modbus register bits are mapped as single bits, not " << map.remoteAddress
+                << " for " << map.localAddress << "\n";
+            return false;
+        }
+        point.bit = static_cast<int8_t>(bit);
+    }
+    bool isBit = map.width == 1 && point.bit < 0;
+    point.count = isBit ? 1 : static_cast<uint16_t>(map.width <= 16 ? 1 : map.width / 16);
+    // ProtocolProperties may give the byte order with {"WordOrder": "ABCD"|"CDAB"|"BADC"|"DCBA"}, and a float
+    // encoding with {"DataType": "REAL"|"LREAL"}, which sets the number of registers.
+    std::string order = stringProperty(config, "WordOrder");
+    point.wordOrder = order == "CDAB" ? WORD_ORDER_CDAB : order == "BADC" ? WORD_ORDER_BADC
+        : order == "DCBA" ? WORD_ORDER_DCBA : WORD_ORDER_ABCD;
+    std::string type = stringProperty(config, "DataType");
+    point.dataType = MODBUS_INTEGER;
+    if (!isBit && point.bit < 0 && type == "REAL") {
+        point.dataType = MODBUS_REAL;
+        point.count = 2;
+    }
+    else if (!isBit && point.bit < 0 && type == "LREAL") {
+        point.dataType = MODBUS_LREAL;
+        point.count = 4;
+    }
+    if (map.direction == IOType::Output) {
+        point.function = point.bit >= 0 ? MASK_WRITE_REGISTER : isBit ? WRITE_MULTIPLE_COILS : WRITE_MULTIPLE_REGISTERS;
+        return true;
+    }
+    point.function = isBit ? READ_DISCRETE_INPUTS : READ_HOLDING_REGISTERS;
+    // ProtocolProperties may select another table with {"Function": 1|2|3|4}.
+    int function = intProperty(config, "Function", 0);
+    bool bitFunction = function == READ_COILS || function == READ_DISCRETE_INPUTS;
+    bool registerFunction = function == READ_HOLDING_REGISTERS || function == READ_INPUT_REGISTERS;
+    if ((isBit && bitFunction) || (!isBit && registerFunction)) {
+        point.function = static_cast<uint8_t>(function);
+    }
+    return true;
+}
+
+void ModbusClient::submitBatch(IOBatch& requests) {
+    buildBlocks(requests);
+    if (batch.empty()) return;
+
+    // All blocks are sent together so that up to maxInFlight of them are outstanding at once. Each response is
+    // applied as it arrives, while its PDU is still in the receive buffer.
+    transact(batch.size(),
+        [this](size_t index, uint16_t transactionId, uint8_t* adu) {
+            return encodeBlock(batch[index], transactionId, adu);
+        },
+        [this](size_t index, ModbusBytes pdu, bool received) {
+            completeBlock(batch[index], pdu, received && checkResponse(batch[index].function, pdu));
+        });
+    batch.clear();
+}
+
+void ModbusClient::buildBlocks(IOBatch& requests) {
+    batch.clear();
+    blockPoints.clear();
+    for (auto& request : requests.requests) {
+        if (request.remoteHandle < 0) {
+            complete(request, IOStatus::Invalid);
+            continue;
+        }
+        blockPoints.push_back(points[request.remoteHandle]);
+        blockPoints.back().request = &request;
+    }
+    // Points are grouped by unit and function, since only those can share a request, and sorted by address.
+    std::sort(blockPoints.begin(), blockPoints.end(), [](const ModbusPoint& a, const ModbusPoint& b) {
+        if (a.unit != b.unit) return a.unit < b.unit;
+        if (a.function != b.function) return a.function < b.function;
+        return a.address < b.address;
+    });
+
+    size_t first = 0;
+    while (first < blockPoints.size()) {
+        if (!coalesce || blockPoints[first].function == MASK_WRITE_REGISTER) {
+            // Without coalescing, inputs of the same registers or coils, such as the bits of one register, still
+            // share a read, and the output bits of a register always share one mask write.
+            const ModbusPoint& point = blockPoints[first];
+            bool isWrite = point.function == WRITE_MULTIPLE_COILS || point.function == WRITE_MULTIPLE_REGISTERS;
+            size_t next = first + 1;
+            while (!isWrite && next < blockPoints.size() && blockPoints[next].unit == point.unit &&
+                   blockPoints[next].function == point.function && blockPoints[next].address == point.address &&
+                   blockPoints[next].count == point.count) {
+                next++;
+            }
+            addBlock(point.function, first, next - first);
+            first = next;
+            continue;
+        }
+        uint8_t unit = blockPoints[first].unit;
+        uint8_t function = blockPoints[first].function;
+        bool isWrite = function == WRITE_MULTIPLE_COILS || function == WRITE_MULTIPLE_REGISTERS;
+        bool isBit = function == READ_COILS || function == READ_DISCRETE_INPUTS || function == WRITE_MULTIPLE_COILS;
+        uint16_t maxBlock = isWrite ? (isBit ? MAX_WRITE_BITS : MAX_WRITE_REGISTERS) : (isBit ? MAX_READ_BITS : MAX_READ_REGISTERS);
+        // Writes must not touch registers that are not mapped, so only reads may bridge gaps.
+        uint16_t maxGap = isWrite ? 0 : (isBit ? MAX_BIT_GAP : MAX_REGISTER_GAP);
+
+        uint32_t blockStart = blockPoints[first].address;
+        uint32_t blockEnd = blockStart + blockPoints[first].count;
+        size_t next = first + 1;
+        for (; next < blockPoints.size(); next++) {
+            const ModbusPoint& point = blockPoints[next];
+            if (point.unit != unit || point.function != function) break;
+            uint32_t end = static_cast<uint32_t>(point.address) + point.count;
+            bool overlaps = point.address < blockEnd;
+            bool fits = end - blockStart <= maxBlock && point.address <= blockEnd + maxGap;
+            if (!fits || (isWrite && overlaps)) break;
+            if (end > blockEnd) blockEnd = end;
+        }
+        addBlock(function, first, next - first);
+        first = next;
+    }
+}
+
+void ModbusClient::addBlock(uint8_t function, size_t first, size_t count) {
+    ModbusBlock block;
+    block.unit = blockPoints[first].unit;
+    block.function = function;
+    block.startAddress = blockPoints[first].address;
+    uint16_t end = block.startAddress;
+    for (size_t i = first; i < first + count; i++) {
+        uint16_t pointEnd = static_cast<uint16_t>(blockPoints[i].address + blockPoints[i].count);
+        if (pointEnd > end) end = pointEnd;
+    }
+    block.quantity = static_cast<uint16_t>(end - block.startAddress);
+    block.firstPoint = first;
+    block.pointCount = count;
+    // A single value uses the single write functions, which every device supports.
+    if (count == 1 && blockPoints[first].count == 1) {
+        if (function == WRITE_MULTIPLE_COILS) block.function = WRITE_SINGLE_COIL;
+        if (function == WRITE_MULTIPLE_REGISTERS) block.function = WRITE_SINGLE_REGISTER;
+    }
+    batch.push_back(block);
+}
+
+size_t ModbusClient::encodeBlock(const ModbusBlock& block, uint16_t transactionId, uint8_t* adu) {
+    return finishFrame(adu, transactionId, block.unit, encodeBlockPdu(block, adu + MODBUS_MBAP_SIZE));
+}
+
+size_t ModbusClient::encodeBlockPdu(const ModbusBlock& block, uint8_t* pdu) {
+    pdu[0] = block.function;
+    putWord(pdu + 1, block.startAddress);
+    const ModbusPoint* first = &blockPoints[block.firstPoint];
+    size_t length = 5;
+    switch (block.function) {
+        case WRITE_SINGLE_COIL:
+            putWord(pdu + 3, first->request->value != 0 ? 0xFF00 : 0x0000);
+            break;
+        case WRITE_SINGLE_REGISTER: {
+            uint64_t value = first->request->value;
+            splitRegisters(first->width == 8 ? value & 0xFF : value, 1, first->wordOrder, pdu + 3);
+            break;
+        }
+        case WRITE_MULTIPLE_COILS: {
+            putWord(pdu + 3, block.quantity);
+            size_t bytes = (block.quantity + 7) / 8;
+            pdu[5] = static_cast<uint8_t>(bytes);
+            memset(pdu + 6, 0, bytes);
+            for (size_t i = 0; i < block.pointCount; i++) {
+                uint16_t offset = static_cast<uint16_t>(first[i].address - block.startAddress);
+                if (first[i].request->value != 0) {
+                    pdu[6 + offset / 8] |= static_cast<uint8_t>(1 << (offset % 8));
+                }
+            }
+            length = 6 + bytes;
+            break;
+        }
+        case MASK_WRITE_REGISTER: {
+            // The device computes (register AND andMask) OR (orMask AND NOT andMask), so the AND mask clears the
+            // mapped bits and the OR mask sets those that are on.
+            uint16_t mapped = 0;
+            uint16_t on = 0;
+            for (size_t i = 0; i < block.pointCount; i++) {
+                uint16_t bit = static_cast<uint16_t>(1u << first[i].bit);
+                mapped |= bit;
+                if (first[i].request->value != 0) {
+                    on |= bit;
+                }
+            }
+            putWord(pdu + 3, static_cast<uint16_t>(~mapped));
+            putWord(pdu + 5, on);
+            length = 7;
+            break;
+        }
+        case WRITE_MULTIPLE_REGISTERS: {
+            putWord(pdu + 3, block.quantity);
+            pdu[5] = static_cast<uint8_t>(block.quantity * 2);
+            uint8_t* out = pdu + 6;
+            for (size_t i = 0; i < block.pointCount; i++) {
+                uint64_t value = toRemote(first[i].request->value, first[i].dataType, first[i].width);
+                if (first[i].width == 8 && first[i].dataType == MODBUS_INTEGER) {
+                    value &= 0xFF;
+                }
+                splitRegisters(value, first[i].count, first[i].wordOrder, out);
+                out += first[i].count * 2;
+            }
+            length = 6 + static_cast<size_t>(block.quantity) * 2;
+            break;
+        }
+        default:
+            putWord(pdu + 3, block.quantity);
+            break;
+    }
+    return length;
+}
+
+void ModbusClient::completeBlock(const ModbusBlock& block, ModbusBytes pdu, bool succeeded) {
+    const ModbusPoint* first = &blockPoints[block.firstPoint];
+    bool isWrite = block.function == WRITE_SINGLE_COIL || block.function == WRITE_SINGLE_REGISTER
+        || block.function == WRITE_MULTIPLE_COILS || block.function == WRITE_MULTIPLE_REGISTERS
+        || block.function == MASK_WRITE_REGISTER;
+    // An exception response is the device refusing the request, rather than the request failing.
+    IOStatus failure = pdu.size > 0 && (pdu.data[0] & 0x80) != 0 ? IOStatus::Refused : IOStatus::Failed;
+    if (isWrite) {
+        if (!succeeded) {
+            DIAGNOSTIC_AT(LogSeverity::Error, "Failed to write " << block.quantity << " values at " << block.startAddress << " on " << moduleID);
+        }
+        for (size_t i = 0; i < block.pointCount; i++) {
+            complete(*first[i].request, succeeded ? IOStatus::Good : failure);
+        }
+        return;
+    }
+
+    bool isBit = block.function == READ_COILS || block.function == READ_DISCRETE_INPUTS;
+    size_t expected = isBit ? (block.quantity + 7) / 8 : block.quantity * 2;
+    if (!succeeded || pdu.size < expected + 2) {
+        DIAGNOSTIC_AT(LogSeverity::Error, "Failed to read " << block.quantity << " values at " << block.startAddress << " on " << moduleID);
+        for (size_t i = 0; i < block.pointCount; i++) {
+            complete(*first[i].request, failure);
+        }
+        return;
+    }
+    const uint8_t* values = pdu.data + 2; // skip the function and the byte count
+    if (!isBit) {
+        registers.resize(block.quantity);
+        loadRegisters(values, registers.data(), block.quantity);
+    }
+    for (size_t p = 0; p < block.pointCount; p++) {
+        const ModbusPoint& point = first[p];
+        uint16_t offset = static_cast<uint16_t>(point.address - block.startAddress);
+        if (isBit) {
+            complete(*point.request, IOStatus::Good, (values[offset / 8] >> (offset % 8)) & 0x01);
+            continue;
+        }
+        if (point.bit >= 0) {
+            complete(*point.request, IOStatus::Good, (registers[offset] >> point.bit) & 0x01);
+            continue;
+        }
+        uint64_t value = toLocal(joinRegisters(&registers[offset], point.count, point.wordOrder), point.dataType, point.width);
+        if (point.width == 8) {
+            value &= 0xFF;
+        }
+        complete(*point.request, IOStatus::Good, value);
+    }
+    // The values of the block are staged into the image together.
+    publishCompleted();
+}
+
+// ========== Reactor Mode ==========
+
+bool ModbusClient::attach(IOReactor& target) {
+    reactor = &target;
+    ioStats = &registerStats("IO." + protocol + "." + moduleID);
+    reactor->post([this]() { tick(); });
+    return true;
+}
+
+void ModbusClient::detach() {
+    reactor->cancel(tickTimer);
+    reactor->cancel(connectTimer);
+    reactor->cancel(timeoutTimer);
+    tickTimer = connectTimer = timeoutTimer = 0;
+    disconnect();
+    batch.clear();
+    inFlight.clear();
+}
+
+void ModbusClient::tick() {
+    NODALIS_TRACE_SCOPE(TraceCategory::IO, protocol.c_str(), moduleID.c_str());
+    tickTimer = 0;
+    if (!connected && !connecting) {
+        bool due;
+        {
+            std::lock_guard<std::mutex> lock(mappingMutex);
+            due = lastAttempt == 0 || elapsed() - lastAttempt >= reconnectDelay;
+        }
+        if (due) {
+            beginConnect();
+        }
+    }
+    else if (connected && batch.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(mappingMutex);
+            collectDue(dueMappings);
+            if (!dueMappings.empty()) {
+                buildBatch(dueMappings, tickBatch);
+                buildBlocks(tickBatch);
+            }
+        }
+        if (!batch.empty()) {
+            beginBatch();
+        }
+    }
+    scheduleTick();
+}
+
+void ModbusClient::wake() {
+    if (reactor == nullptr) {
+        IOClient::wake();
+        return;
+    }
+    reactor->post([this]() { scheduleTick(); });
+}
+
+void ModbusClient::scheduleTick() {
+    // While connecting or with a batch in flight, the connect or the batch schedules the next tick when it ends.
+    if (connecting || !batch.empty()) return;
+    reactor->cancel(tickTimer);
+    auto now = IOReactor::Clock::now();
+    auto when = PROGRAM_START + std::chrono::milliseconds(nextPollDue());
+    // Wake at least every 100ms so that newly added mappings are noticed.
+    if (when > now + std::chrono::milliseconds(100)) {
+        when = now + std::chrono::milliseconds(100);
+    }
+    tickTimer = reactor->schedule(when, [this]() { tick(); });
+}
+
+void ModbusClient::beginConnect() {
+    NODALIS_TRACE_SCOPE(TraceCategory::Connect, protocol.c_str(), moduleID.c_str());
+    bool resolved;
+    {
+        std::lock_guard<std::mutex> lock(mappingMutex);
+        lastAttempt = elapsed();
+        resolved = resolveEndpoint();
+    }
+    bool pending = false;
+    int fd = resolved ? openConnection(ip, port, pending) : -1;
+    if (fd < 0) {
+        connectAttempted(false);
+        return;
+    }
+    sockfd = fd;
+    connecting = true;
+    if (!pending) {
+        finishConnect();
+        return;
+    }
+    reactor->watch(fd, EVENT_WRITABLE, [this](uint32_t) { finishConnect(); });
+    connectTimer = reactor->schedule(IOReactor::Clock::now() + std::chrono::milliseconds(connectTimeout), [this]() {
+        connectTimer = 0;
+        DIAGNOSTIC_AT(LogSeverity::Error, "Connect to " << ip << ":" << port << " timed out after " << connectTimeout << "ms");
+        disconnect();
+        connectAttempted(false);
+        scheduleTick();
+    });
+}
+
+void ModbusClient::finishConnect() {
+    reactor->cancel(connectTimer);
+    connectTimer = 0;
+    if (!connectSucceeded(sockfd)) {
+        disconnect();
+        connectAttempted(false);
+        scheduleTick();
+        return;
+    }
+    connectionEstablished(sockfd);
+    // From here on the reactor performs the sends and receives, so the socket is no longer watched directly.
+    reactor->unwatch(sockfd);
+    if (!startReceive()) {
+        disconnect();
+        connectAttempted(false);
+        scheduleTick();
+        return;
+    }
+    connectAttempted(true);
+    scheduleTick();
+}
+
+void ModbusClient::beginBatch() {
+    batchDone.assign(batch.size(), false);
+    batchNext = 0;
+    batchRemaining = batch.size();
+    batchStart = IOReactor::Clock::now();
+    pump();
+}
+
+void ModbusClient::pump() {
+    size_t window = maxInFlight < 1 ? 1 : maxInFlight;
+    while (connected && batchNext < batch.size() && inFlight.size() < window) {
+        size_t index = batchNext++;
+        uint16_t transactionId = nextTransactionId++;
+        uint8_t adu[MODBUS_MAX_ADU];
+        size_t length = encodeBlock(batch[index], transactionId, adu);
+        if (length == 0) {
+            finishBlock(index, ModbusBytes{}, false);
+            continue;
+        }
+        sendBuffer.insert(sendBuffer.end(), adu, adu + length);
+        inFlight.push_back({ transactionId, index, IOReactor::Clock::now() });
+    }
+    if (connected && !sendBuffer.empty()) {
+        flushSend();
+    }
+    if (connected) {
+        armTimeout();
+    }
+    if (!batch.empty() && batchRemaining == 0) {
+        endBatch();
+    }
+}
+
+void ModbusClient::flushSend() {
+    if (sending || sendBuffer.empty()) return;
+    size_t taken = reactor->submitSend(sockfd, sendBuffer.data(), sendBuffer.size(),
+        [this](const uint8_t*, int result) { onSent(result); });
+    if (taken == 0) {
+        DIAGNOSTIC_AT(LogSeverity::Error, "IO reactor " << reactor->getName() << " has no free buffers for " << ip);
+        dropConnection();
+        return;
+    }
+    sending = true;
+}
+
+void ModbusClient::onSent(int result) {
+    sending = false;
+    if (result <= 0) {
+        DIAGNOSTIC_AT(LogSeverity::Error, "MODBUS send to " << ip << " failed: " << strerror(-result));
+        dropConnection();
+        return;
+    }
+    sendBuffer.erase(sendBuffer.begin(), sendBuffer.begin() + result);
+    flushSend();
+}
+
+bool ModbusClient::startReceive() {
+    return reactor->submitReceive(sockfd, [this](const uint8_t* data, int result) { onReceived(data, result); });
+}
+
+void ModbusClient::onReceived(const uint8_t* data, int result) {
+    if (result <= 0) {
+        if (result == 0) {
+            DIAGNOSTIC_AT(LogSeverity::Error, "MODBUS connection closed by " << ip);
+        }
+        else {
+            DIAGNOSTIC_AT(LogSeverity::Error, "MODBUS receive from " << ip << " failed: " << strerror(-result));
+        }
+        dropConnection();
+        return;
+    }
+    compactReceiveBuffer();
+    receiveBuffer.insert(receiveBuffer.end(), data, data + result);
+
+    uint16_t transactionId = 0;
+    ModbusBytes pdu;
+    int framed;
+    while ((framed = takeFrame(transactionId, pdu)) > 0) {
+        size_t index;
+        if (!takeInFlight(transactionId, pdu, index)) {
+            DIAGNOSTIC_AT(LogSeverity::Error, "Discarding MODBUS response with unknown transaction ID " << transactionId);
+            continue;
+        }
+        finishBlock(index, pdu, checkResponse(batch[index].function, pdu));
+    }
+    if (framed < 0 || !startReceive()) {
+        dropConnection();
+        return;
+    }
+    pump();
+}
+
+void ModbusClient::armTimeout() {
+    reactor->cancel(timeoutTimer);
+    timeoutTimer = 0;
+    if (inFlight.empty()) return;
+    // The timeout runs from the oldest outstanding request.
+    auto oldest = IOReactor::Clock::time_point::max();
+    for (const auto& request : inFlight) {
+        if (request.sentAt < oldest) oldest = request.sentAt;
+    }
+    timeoutTimer = reactor->schedule(oldest + std::chrono::milliseconds(responseTimeout), [this]() {
+        timeoutTimer = 0;
+        // A device that stops answering is dropped and reconnected with backoff, rather than waited on.
+        DIAGNOSTIC_AT(LogSeverity::Error, "MODBUS response from " << ip << " timed out after " << responseTimeout << "ms");
+        dropConnection();
+    });
+}
+
+void ModbusClient::finishBlock(size_t index, ModbusBytes pdu, bool succeeded) {
+    if (batchDone[index]) return;
+    batchDone[index] = true;
+    batchRemaining--;
+    completeBlock(batch[index], pdu, succeeded);
+}
+
+void ModbusClient::dropConnection() {
+    reactor->cancel(timeoutTimer);
+    timeoutTimer = 0;
+    disconnect();
+    for (size_t i = 0; i < inFlight.size(); i++) {
+        requestCompleted(false, 0);
+    }
+    inFlight.clear();
+    for (size_t i = 0; i < batch.size(); i++) {
+        finishBlock(i, ModbusBytes{}, false);
+    }
+    if (!batch.empty()) {
+        endBatch();
+    }
+    else {
+        scheduleTick();
+    }
+}
+
+void ModbusClient::endBatch() {
+    ioStats->record(microsBetween(batchStart, IOReactor::Clock::now()));
+    batch.clear();
+    batchDone.clear();
+    inFlight.clear();
+    reactor->cancel(timeoutTimer);
+    timeoutTimer = 0;
+    scheduleTick();
+}
+
+// ========== RTU Client ==========
+
+/**
+ * Builds the table of the Modbus CRC (the reflected polynomial 0xA001) of each byte value, so that the CRC of a frame
+ * takes a lookup and a shift per byte rather than eight.
+ * @returns Returns the table.
+ */
+static constexpr std::array<uint16_t, 256> makeCrcTable() {
+    std::array<uint16_t, 256> table{};
+    for (uint16_t value = 0; value < 256; value++) {
+        uint16_t crc = value;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? static_cast<uint16_t>((crc >> 1) ^ 0xA001) : static_cast<uint16_t>(crc >> 1);
+        }
+        table[value] = crc;
+    }
+    return table;
+}
+
+static constexpr std::array<uint16_t, 256> CRC_TABLE = makeCrcTable();
+
+uint16_t ModbusRtuClient::crc16(const uint8_t* data, size_t length) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc = static_cast<uint16_t>((crc >> 8) ^ CRC_TABLE[(crc ^ data[i]) & 0xFF]);
+    }
+    return crc;
+}
+
+/**
+ * Gets the length of an RTU response from its first bytes, which is what frames it: a read gives its byte count
+ * after the function, and exceptions and write echoes have a fixed length.
+ * @param frame The bytes received so far.
+ * @param size The number of bytes received.
+ * @returns Returns the length of the frame with its CRC, or 0 if not enough of it has arrived to tell.
+ */
+static size_t rtuResponseLength(const uint8_t* frame, size_t size) {
+    if (size < 2) return 0;
+    if (frame[1] & 0x80) return 5;
+    switch (frame[1]) {
+        case READ_COILS:
+        case READ_DISCRETE_INPUTS:
+        case READ_HOLDING_REGISTERS:
+        case READ_INPUT_REGISTERS:
+        case READ_WRITE_MULTIPLE_REGISTERS:
+            return size < 3 ? 0 : 5 + static_cast<size_t>(frame[2]);
+        case MASK_WRITE_REGISTER:
+            return 10;
+        default:
+            return 8;
+    }
+}
+
+static bool isWriteFunction(uint8_t function) {
+    return function == WRITE_SINGLE_COIL || function == WRITE_SINGLE_REGISTER
+        || function == WRITE_MULTIPLE_COILS || function == WRITE_MULTIPLE_REGISTERS || function == MASK_WRITE_REGISTER;
+}
+
+ModbusRtuClient::ModbusRtuClient() : ModbusClient("MODBUS-RTU", 1), slaves(256) {
+}
+
+ModbusRtuClient::~ModbusRtuClient() {
+    stop();
+    closePort();
+    connected = false;
+}
+
+void ModbusRtuClient::onMappingAdded(IOMap& map) {
+    json config = protocolProperties(map);
+    // The client serves the line, so it is named after the port, and each mapping addresses its slave by ModuleID.
+    moduleID = map.modulePort;
+    int unit = std::atoi(map.moduleID.c_str());
+    if (unit < 0 || unit > 247 || (unit == 0 && map.direction == IOType::Input)) {
+        nodalisLog() << "Invalid Modbus RTU slave " << map.moduleID << " for " << map.localAddress << "\n";
+    }
+    else {
+        addPoint(map, static_cast<uint8_t>(unit));
+    }
+    settings.baudRate = static_cast<uint32_t>(intProperty(config, "BaudRate", static_cast<int>(settings.baudRate)));
+    settings.dataBits = static_cast<uint8_t>(intProperty(config, "DataBits", settings.dataBits));
+    settings.stopBits = static_cast<uint8_t>(intProperty(config, "StopBits", settings.stopBits));
+    std::string parity = stringProperty(config, "Parity");
+    if (!parity.empty()) {
+        settings.parity = parity[0];
+    }
+    if (config.is_object() && config.contains("RS485") && config["RS485"].is_boolean()) {
+        settings.rs485 = config["RS485"].get<bool>();
+    }
+    if (config.is_object() && config.contains("Echo") && config["Echo"].is_boolean()) {
+        echo = config["Echo"].get<bool>();
+    }
+    if (config.is_object() && config.contains("Coalesce") && config["Coalesce"].is_boolean()) {
+        coalesce = config["Coalesce"].get<bool>();
+    }
+    responseTimeout = intProperty(config, "ResponseTimeout", static_cast<int>(responseTimeout));
+    turnaroundDelay = intProperty(config, "TurnaroundDelay", static_cast<int>(turnaroundDelay));
+    minReconnectDelay = intProperty(config, "ReconnectDelay", static_cast<int>(minReconnectDelay));
+    maxReconnectDelay = intProperty(config, "MaxReconnectDelay", static_cast<int>(maxReconnectDelay));
+    if (maxReconnectDelay < minReconnectDelay) {
+        maxReconnectDelay = minReconnectDelay;
+    }
+    if (lastAttempt == 0) {
+        reconnectDelay = minReconnectDelay;
+    }
+}
+
+void ModbusRtuClient::connect() {
+    closePort();
+    connected = openPort();
+}
+
+#ifndef _WIN32
+/**
+ * Gets the termios speed of a baud rate.
+ * @param baudRate The baud rate.
+ * @param speed Receives the speed.
+ * @returns Returns false if the rate isn't one termios has.
+ */
+static bool serialSpeed(uint32_t baudRate, speed_t& speed) {
+    switch (baudRate) {
+        case 1200: speed = B1200; return true;
+        case 2400: speed = B2400; return true;
+        case 4800: speed = B4800; return true;
+        case 9600: speed = B9600; return true;
+        case 19200: speed = B19200; return true;
+        case 38400: speed = B38400; return true;
+        case 57600: speed = B57600; return true;
+        case 115200: speed = B115200; return true;
+        case 230400: speed = B230400; return true;
+#ifdef B460800
+        case 460800: speed = B460800; return true;
+#endif
+#ifdef B921600
+        case 921600: speed = B921600; return true;
+#endif
+        default: return false;
+    }
+}
+#endif
+
+bool ModbusRtuClient::openPort() {
+    bool validFrame = (settings.dataBits == 7 || settings.dataBits == 8) && (settings.stopBits == 1 || settings.stopBits == 2)
+        && (settings.parity == 'N' || settings.parity == 'E' || settings.parity == 'O');
+    if (modulePort.empty() || settings.baudRate == 0 || !validFrame) {
+        nodalisError() << "Invalid Modbus RTU settings for " << modulePort << ": " << settings.baudRate << " "
+            << static_cast<int>(settings.dataBits) << settings.parity << static_cast<int>(settings.stopBits) << "\n";
+        return false;
+    }
+#ifdef _WIN32
+    std::string path = modulePort.rfind("\\\\.\\", 0) == 0 ? modulePort : "\\\\.\\" + modulePort;
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        nodalisError() << "Can't open " << modulePort << ": error " << GetLastError() << "\n";
+        return false;
+    }
+    DCB dcb{};
+    dcb.DCBlength = sizeof(dcb);
+    bool configured = GetCommState(handle, &dcb) != 0;
+    dcb.BaudRate = settings.baudRate;
+    dcb.ByteSize = settings.dataBits;
+    dcb.Parity = settings.parity == 'N' ? NOPARITY : settings.parity == 'O' ? ODDPARITY : EVENPARITY;
+    dcb.StopBits = settings.stopBits == 2 ? TWOSTOPBITS : ONESTOPBIT;
+    dcb.fBinary = TRUE;
+    dcb.fParity = settings.parity != 'N';
+    dcb.fOutxCtsFlow = FALSE;
+    dcb.fOutxDsrFlow = FALSE;
+    dcb.fOutX = FALSE;
+    dcb.fInX = FALSE;
+    dcb.fDtrControl = DTR_CONTROL_ENABLE;
+    // In RS-485 mode, the driver raises RTS while it sends, which switches the transceiver to transmit.
+    dcb.fRtsControl = settings.rs485 ? RTS_CONTROL_TOGGLE : RTS_CONTROL_ENABLE;
+    if (!configured || !SetCommState(handle, &dcb)) {
+        nodalisError() << "Can't configure " << modulePort << ": error " << GetLastError() << "\n";
+        CloseHandle(handle);
+        return false;
+    }
+    PurgeComm(handle, PURGE_RXCLEAR | PURGE_TXCLEAR);
+    port = handle;
+#else
+    speed_t speed;
+    if (!serialSpeed(settings.baudRate, speed)) {
+        nodalisError() << "Unsupported baud rate " << settings.baudRate << " for " << modulePort << "\n";
+        return false;
+    }
+    int fd = open(modulePort.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) {
+        nodalisError() << "Can't open " << modulePort << ": " << strerror(errno) << "\n";
+        return false;
+    }
+    termios tty{};
+    bool configured = tcgetattr(fd, &tty) == 0;
+    cfmakeraw(&tty);
+    cfsetispeed(&tty, speed);
+    cfsetospeed(&tty, speed);
+    tty.c_cflag &= ~(CSIZE | PARENB | PARODD | CSTOPB);
+#ifdef CRTSCTS
+    tty.c_cflag &= ~CRTSCTS;
+#endif
+    tty.c_cflag |= CLOCAL | CREAD | (settings.dataBits == 7 ? CS7 : CS8);
+    if (settings.parity != 'N') {
+        tty.c_cflag |= PARENB | (settings.parity == 'O' ? PARODD : 0);
+        tty.c_iflag |= INPCK;
+    }
+    if (settings.stopBits == 2) {
+        tty.c_cflag |= CSTOPB;
+    }
+    // Reads return what has arrived without waiting; poll() does the waiting.
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 0;
+    if (!configured || tcsetattr(fd, TCSANOW, &tty) != 0) {
+        nodalisError() << "Can't configure " << modulePort << ": " << strerror(errno) << "\n";
+        close(fd);
+        return false;
+    }
+#ifdef TIOCSRS485
+    if (settings.rs485) {
+        // The driver raises RTS while it sends, which switches the transceiver to transmit.
+        serial_rs485 rs485{};
+        rs485.flags = SER_RS485_ENABLED | SER_RS485_RTS_ON_SEND;
+        if (ioctl(fd, TIOCSRS485, &rs485) != 0) {
+            nodalisError() << "Can't enable RS-485 mode on " << modulePort << ": " << strerror(errno) << "\n";
+        }
+    }
+#endif
+    tcflush(fd, TCIOFLUSH);
+    port = fd;
+#endif
+    int bits = 1 + settings.dataBits + (settings.parity != 'N' ? 1 : 0) + settings.stopBits;
+    charTime = std::chrono::nanoseconds(1000000000LL * bits / settings.baudRate);
+    // Above 19200 baud the gap is fixed at 1750us, as the spec allows, since 3.5 characters get too short to time.
+    frameGap = settings.baudRate > 19200 ? std::chrono::nanoseconds(1750000) : charTime * 7 / 2;
+    lineBusy = std::chrono::steady_clock::now();
+    nodalisLog() << "Opened " << modulePort << " at " << settings.baudRate << " " << static_cast<int>(settings.dataBits)
+        << settings.parity << static_cast<int>(settings.stopBits) << "\n";
+    return true;
+}
+
+void ModbusRtuClient::closePort() {
+#ifdef _WIN32
+    if (port != INVALID_HANDLE_VALUE) {
+        CloseHandle(port);
+        port = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (port >= 0) {
+        close(port);
+        port = -1;
+    }
+#endif
+}
+
+bool ModbusRtuClient::writePort(const uint8_t* data, size_t length) {
+    size_t written = 0;
+    while (written < length) {
+#ifdef _WIN32
+        COMMTIMEOUTS timeouts{};
+        timeouts.WriteTotalTimeoutConstant = static_cast<DWORD>(responseTimeout);
+        DWORD count = 0;
+        if (!SetCommTimeouts(port, &timeouts) || !WriteFile(port, data + written, static_cast<DWORD>(length - written), &count, nullptr) || count == 0) {
+            DIAGNOSTIC_AT(LogSeverity::Error, "Write to " << modulePort << " failed: error " << GetLastError());
+            return false;
+        }
+#else
+        ssize_t count = write(port, data + written, length - written);
+        if (count < 0) {
+            int error = errno;
+            if (error == EINTR) continue;
+            if (error == EAGAIN || error == EWOULDBLOCK) {
+                pollfd pfd{ port, POLLOUT, 0 };
+                if (::poll(&pfd, 1, static_cast<int>(responseTimeout)) > 0) continue;
+            }
+            DIAGNOSTIC_AT(LogSeverity::Error, "Write to " << modulePort << " failed: " << strerror(error));
+            return false;
+        }
+#endif
+        written += static_cast<size_t>(count);
+    }
+    return true;
+}
+
+int ModbusRtuClient::readPort(uint8_t* data, size_t capacity, std::chrono::microseconds timeout) {
+    // The wait is rounded up to whole milliseconds, which the platforms wait in.
+    int64_t waitMs = timeout.count() <= 0 ? 0 : (timeout.count() + 999) / 1000;
+#ifdef _WIN32
+    // Return as soon as a byte has arrived, or after the timeout if none does.
+    COMMTIMEOUTS timeouts{};
+    timeouts.ReadIntervalTimeout = MAXDWORD;
+    timeouts.ReadTotalTimeoutMultiplier = waitMs > 0 ? MAXDWORD : 0;
+    timeouts.ReadTotalTimeoutConstant = static_cast<DWORD>(waitMs);
+    DWORD count = 0;
+    if (!SetCommTimeouts(port, &timeouts) || !ReadFile(port, data, static_cast<DWORD>(capacity), &count, nullptr)) {
+        DIAGNOSTIC_AT(LogSeverity::Error, "Read from " << modulePort << " failed: error " << GetLastError());
+        return -1;
+    }
+    return static_cast<int>(count);
+#else
+    pollfd pfd{ port, POLLIN, 0 };
+    int ready = ::poll(&pfd, 1, static_cast<int>(waitMs));
+    if (ready <= 0) {
+        return ready == 0 || errno == EINTR ? 0 : -1;
+    }
+    ssize_t count = read(port, data, capacity);
+    if (count > 0) {
+        return static_cast<int>(count);
+    }
+    if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return 0;
+    }
+    // A readable port that reads nothing has hung up, as a USB adapter that was unplugged does.
+    DIAGNOSTIC_AT(LogSeverity::Error, "Read from " << modulePort << " failed: " << (count < 0 ? strerror(errno) : "hung up"));
+    return -1;
+#endif
+}
+
+bool ModbusRtuClient::waitForSilence() {
+    uint8_t discard[MODBUS_RTU_MAX_ADU];
+    while (true) {
+        auto idle = lineBusy + frameGap;
+        if (std::chrono::steady_clock::now() < idle) {
+            std::this_thread::sleep_until(idle);
+        }
+        // Whatever arrived meanwhile, such as a late response or noise, is dropped, and the line must be silent again.
+        int count = readPort(discard, sizeof(discard), std::chrono::microseconds(0));
+        if (count <= 0) {
+            return count == 0;
+        }
+        lineBusy = std::chrono::steady_clock::now();
+    }
+}
+
+ModbusRtuClient::Exchange ModbusRtuClient::exchangeFrame(const uint8_t* adu, size_t length, ModbusBytes& pdu) {
+    pdu = ModbusBytes{};
+    if (!waitForSilence() || !writePort(adu, length)) {
+        return Exchange::PortFailed;
+    }
+    // The driver takes the frame at once, so the line is busy until its last character has been sent.
+    lineBusy = std::chrono::steady_clock::now() + charTime * static_cast<int64_t>(length);
+    uint8_t unit = adu[0];
+    if (unit == 0) {
+        // Broadcasts aren't answered, so the slaves are given the turnaround delay to act on them.
+        lineBusy += std::chrono::milliseconds(turnaroundDelay);
+        return Exchange::Answered;
+    }
+
+    size_t skip = echo ? length : 0;
+    size_t expected = 0;
+    auto deadline = lineBusy + std::chrono::milliseconds(responseTimeout);
+    receiveBuffer.clear();
+    while (expected == 0 || receiveBuffer.size() < skip + expected) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline || receiveBuffer.size() >= skip + 2 * MODBUS_RTU_MAX_ADU) break;
+        size_t used = receiveBuffer.size();
+        receiveBuffer.resize(used + MODBUS_RTU_MAX_ADU);
+        int count = readPort(receiveBuffer.data() + used, MODBUS_RTU_MAX_ADU,
+            std::chrono::duration_cast<std::chrono::microseconds>(deadline - now));
+        receiveBuffer.resize(used + (count > 0 ? static_cast<size_t>(count) : 0));
+        if (count < 0) {
+            return Exchange::PortFailed;
+        }
+        if (count > 0) {
+            lineBusy = std::chrono::steady_clock::now();
+            if (receiveBuffer.size() > skip) {
+                expected = rtuResponseLength(receiveBuffer.data() + skip, receiveBuffer.size() - skip);
+            }
+        }
+    }
+    if (expected == 0 || receiveBuffer.size() < skip + expected) {
+        return Exchange::TimedOut;
+    }
+    const uint8_t* frame = receiveBuffer.data() + skip;
+    uint16_t crc = static_cast<uint16_t>(frame[expected - 2] | (frame[expected - 1] << 8));
+    if (frame[0] != unit || crc != crc16(frame, expected - 2)) {
+        DIAGNOSTIC_AT(LogSeverity::Error, "Invalid MODBUS RTU response from slave " << static_cast<int>(unit) << " on " << modulePort);
+        return Exchange::Invalid;
+    }
+    pdu.data = frame + 1;
+    pdu.size = expected - 3;
+    return Exchange::Answered;
+}
+
+void ModbusRtuClient::interleaveBlocks() {
+    // buildBlocks() sorts the blocks by slave, so the blocks of each slave are a range of batch.
+    slaveBlocks.clear();
+    for (size_t i = 0; i < batch.size(); i++) {
+        if (i == 0 || batch[i].unit != batch[i - 1].unit) {
+            slaveBlocks.push_back({ i, i });
+        }
+        slaveBlocks.back().second = i + 1;
+    }
+    // Taking a block of each slave in turn gives each slave the others' requests to prepare its next response.
+    order.clear();
+    while (order.size() < batch.size()) {
+        for (auto& range : slaveBlocks) {
+            if (range.first < range.second) {
+                order.push_back(range.first++);
+            }
+        }
+    }
+}
+
+void ModbusRtuClient::slaveAnswered(uint8_t unit, bool answered) {
+    SlaveState& slave = slaves[unit];
+    if (answered) {
+        slave.delay = 0;
+        slave.retryAt = 0;
+        return;
+    }
+    slave.delay = slave.delay == 0 ? minReconnectDelay : std::min(slave.delay * 2, maxReconnectDelay);
+    slave.retryAt = elapsed() + slave.delay;
+    DIAGNOSTIC_AT(LogSeverity::Error, "MODBUS RTU slave " << static_cast<int>(unit) << " on " << modulePort << " didn't answer within "
+        << responseTimeout << "ms, retrying in " << slave.delay << "ms");
+}
+
+void ModbusRtuClient::submitBatch(IOBatch& requests) {
+    buildBlocks(requests);
+    if (batch.empty()) return;
+    interleaveBlocks();
+
+    uint8_t adu[MODBUS_RTU_MAX_ADU];
+    for (size_t index : order) {
+        const ModbusBlock& block = batch[index];
+        // A slave that is backing off is left alone, so that the line is spent on the slaves that answer. Its inputs
+        // keep their values, and its outputs are written again once it answers.
+        if (!connected || (block.unit != 0 && slaves[block.unit].retryAt > elapsed())) {
+            if (isWriteFunction(block.function)) {
+                for (size_t i = 0; i < block.pointCount; i++) {
+                    complete(*blockPoints[block.firstPoint + i].request, IOStatus::Failed);
+                }
+            }
+            continue;
+        }
+        adu[0] = block.unit;
+        size_t length = 1 + encodeBlockPdu(block, adu + 1);
+        uint16_t crc = crc16(adu, length);
+        adu[length++] = static_cast<uint8_t>(crc & 0xFF);
+        adu[length++] = static_cast<uint8_t>(crc >> 8);
+
+        auto start = std::chrono::steady_clock::now();
+        ModbusBytes pdu;
+        Exchange result = exchangeFrame(adu, length, pdu);
+        if (result == Exchange::PortFailed) {
+            // The rest of the poll is skipped, and the port is opened again after the reconnect delay.
+            closePort();
+            connected = false;
+            lastAttempt = elapsed();
+            requestCompleted(false, 0);
+            completeBlock(block, ModbusBytes{}, false);
+            continue;
+        }
+        bool succeeded = result == Exchange::Answered && (block.unit == 0 || checkResponse(block.function, pdu));
+        if (block.unit != 0) {
+            requestCompleted(succeeded, microsBetween(start, std::chrono::steady_clock::now()));
+            slaveAnswered(block.unit, result != Exchange::TimedOut);
+        }
+        completeBlock(block, pdu, succeeded);
+    }
+    batch.clear();
+}
+
+// ========== Server Implementation ==========
+
+// Largest quantities allowed by the protocol for each request.
+static constexpr uint16_t MAX_READ_WRITE_REGISTERS = 121;
+
+// Exception codes.
+static constexpr uint8_t ILLEGAL_FUNCTION = 0x01;
+static constexpr uint8_t ILLEGAL_DATA_ADDRESS = 0x02;
+static constexpr uint8_t ILLEGAL_DATA_VALUE = 0x03;
+
+/**
+ * Reads a big endian 16 bit value.
+ * @param in The first byte.
+ * @returns Returns the value.
+ */
+static inline uint16_t getWord(const uint8_t* in) {
+    return static_cast<uint16_t>((in[0] << 8) | in[1]);
+}
+
+/**
+ * Builds the byte offset table of a memory space.
+ * @param space The space.
+ * @param bytes Receives the offset of every byte of the space that is in the image.
+ */
+static void mapSpace(int space, std::vector<int32_t>& bytes) {
+    for (int index = 0; memoryOffset(space, index) >= 0; index++) {
+        bytes.push_back(memoryOffset(space, index));
+    }
+}
+
+/**
+ * Writes an exception response.
+ * @param function The function of the request.
+ * @param code The exception code.
+ * @param response The buffer for the response PDU.
+ * @returns Returns the length of the response PDU.
+ */
+static size_t exceptionResponse(uint8_t function, uint8_t code, uint8_t* response) {
+    response[0] = static_cast<uint8_t>(function | 0x80);
+    response[1] = code;
+    return 2;
+}
+
+ModbusServer::ModbusServer() {
+#ifdef _WIN32
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2,2), &wsa);
+#endif
+    mapSpace(MEMORY_SPACE::I, inputBytes);
+    mapSpace(MEMORY_SPACE::Q, outputBytes);
+    mapSpace(MEMORY_SPACE::M, memoryBytes);
+}
+
+ModbusServer::~ModbusServer() {
+    stop();
+}
+
+bool ModbusServer::bitAddress(const std::vector<int32_t>& bytes, int space, size_t bit, ResolvedAddress& address) {
+    if (bit / 8 >= bytes.size()) return false;
+    address.space = space;
+    address.width = 1;
+    address.index = static_cast<int>(bit / 8);
+    address.bit = static_cast<int>(bit % 8);
+    address.offset = static_cast<size_t>(bytes[bit / 8]);
+    address.bitOffset = address.offset;
+    address.bitMask = static_cast<uint8_t>(1 << (bit % 8));
+    return true;
+}
+
+bool ModbusServer::wordAddress(const std::vector<int32_t>& bytes, int space, size_t index, ResolvedAddress& address) {
+    if (index * 2 + 1 >= bytes.size()) return false;
+    address.space = space;
+    address.width = 16;
+    address.index = static_cast<int>(index);
+    address.bit = -1;
+    // Each space is contiguous, so the two bytes of a word are adjacent.
+    address.offset = static_cast<size_t>(bytes[index * 2]);
+    return true;
+}
+
+void ModbusServer::setCoil(uint16_t address, bool value) {
+    ResolvedAddress coil;
+    if (bitAddress(outputBytes, MEMORY_SPACE::Q, address, coil)) writeImage(coil, value);
+}
+
+bool ModbusServer::getCoil(uint16_t address) {
+    ResolvedAddress coil;
+    return bitAddress(outputBytes, MEMORY_SPACE::Q, address, coil) && readImage(coil) != 0;
+}
+
+void ModbusServer::setDiscreteInput(uint16_t address, bool value) {
+    ResolvedAddress input;
+    if (bitAddress(inputBytes, MEMORY_SPACE::I, address, input)) writeImage(input, value);
+}
+
+bool ModbusServer::getDiscreteInput(uint16_t address) {
+    ResolvedAddress input;
+    return bitAddress(inputBytes, MEMORY_SPACE::I, address, input) && readImage(input) != 0;
+}
+
+void ModbusServer::setRegister(uint16_t address, uint16_t value) {
+    ResolvedAddress reg;
+    if (wordAddress(memoryBytes, MEMORY_SPACE::M, address, reg)) writeImage(reg, value);
+}
+
+uint16_t ModbusServer::getRegister(uint16_t address) {
+    ResolvedAddress reg;
+    return wordAddress(memoryBytes, MEMORY_SPACE::M, address, reg) ? static_cast<uint16_t>(readImage(reg)) : 0;
+}
+
+ModbusResponse ModbusServer::handleRequest(const ModbusRequest& request) {
     ModbusResponse res;
-    return sendRequest(req, res);
+    res.address = request.address;
+    res.function = request.function;
+    res.exceptionCode = 0;
+
+    uint8_t adu[MODBUS_MAX_ADU];
+    size_t length = ModbusClient::encodeRequest(request, 0, adu);
+    if (length == 0) {
+        res.exceptionCode = ILLEGAL_DATA_VALUE;
+        return res;
+    }
+    uint8_t pdu[MODBUS_MAX_PDU];
+    size_t responseLength = handlePdu(adu + MODBUS_MBAP_SIZE, length - MODBUS_MBAP_SIZE, pdu);
+    if (pdu[0] & 0x80) {
+        res.exceptionCode = pdu[1];
+        return res;
+    }
+    res.data.assign(pdu + 1, pdu + responseLength);
+    return res;
+}
+
+void ModbusServer::readBits(const std::vector<int32_t>& bytes, uint16_t start, uint16_t quantity, uint8_t* out) {
+    memset(out, 0, (quantity + 7) / 8);
+    readImage([&](const uint8_t* image) {
+        for (uint16_t i = 0; i < quantity; i++) {
+            size_t bit = static_cast<size_t>(start) + i;
+            if (image[bytes[bit / 8]] & (1 << (bit % 8))) {
+                out[i / 8] |= static_cast<uint8_t>(1 << (i % 8));
+            }
+        }
+    });
+}
+
+void ModbusServer::readWords(const std::vector<int32_t>& bytes, uint16_t start, uint16_t quantity, uint8_t* out) {
+    readImage([&](const uint8_t* image) {
+        for (uint16_t i = 0; i < quantity; i++) {
+            // The image is little endian, and registers are sent big endian.
+            const uint8_t* word = image + bytes[(static_cast<size_t>(start) + i) * 2];
+            out[i * 2] = word[1];
+            out[i * 2 + 1] = word[0];
+        }
+    });
+}
+
+size_t ModbusServer::handlePdu(const uint8_t* request, size_t length, uint8_t* response) {
+    if (length < 1) return exceptionResponse(0, ILLEGAL_FUNCTION, response);
+    uint8_t function = request[0];
+    if (length < 5) return exceptionResponse(function, ILLEGAL_DATA_VALUE, response);
+    uint16_t start = getWord(request + 1);
+    uint16_t quantity = getWord(request + 3);
+    size_t bitCount = outputBytes.size() * 8;
+    size_t inputBitCount = inputBytes.size() * 8;
+    size_t registerCount = memoryBytes.size() / 2;
+    size_t inputRegisterCount = inputBytes.size() / 2;
+
+    switch (function) {
+        case READ_COILS:
+        case READ_DISCRETE_INPUTS: {
+            size_t count = function == READ_COILS ? bitCount : inputBitCount;
+            if (quantity < 1 || quantity > MAX_READ_BITS) return exceptionResponse(function, ILLEGAL_DATA_VALUE, response);
+            if (static_cast<size_t>(start) + quantity > count) return exceptionResponse(function, ILLEGAL_DATA_ADDRESS, response);
+            response[0] = function;
+            response[1] = static_cast<uint8_t>((quantity + 7) / 8);
+            readBits(function == READ_COILS ? outputBytes : inputBytes, start, quantity, response + 2);
+            return 2 + response[1];
+        }
+        case READ_HOLDING_REGISTERS:
+        case READ_INPUT_REGISTERS: {
+            size_t count = function == READ_HOLDING_REGISTERS ? registerCount : inputRegisterCount;
+            if (quantity < 1 || quantity > MAX_READ_REGISTERS) return exceptionResponse(function, ILLEGAL_DATA_VALUE, response);
+            if (static_cast<size_t>(start) + quantity > count) return exceptionResponse(function, ILLEGAL_DATA_ADDRESS, response);
+            response[0] = function;
+            response[1] = static_cast<uint8_t>(quantity * 2);
+            readWords(function == READ_HOLDING_REGISTERS ? memoryBytes : inputBytes, start, quantity, response + 2);
+            return 2 + response[1];
+        }
+        case WRITE_SINGLE_COIL: {
+            // The value of FC05 is in the quantity field, and must be FF00 or 0000.
+            if (quantity != 0xFF00 && quantity != 0x0000) return exceptionResponse(function, ILLEGAL_DATA_VALUE, response);
+            ResolvedAddress coil;
+            if (!bitAddress(outputBytes, MEMORY_SPACE::Q, start, coil)) return exceptionResponse(function, ILLEGAL_DATA_ADDRESS, response);
+            writeImage(coil, quantity == 0xFF00);
+            memcpy(response, request, 5);
+            return 5;
+        }
+        case WRITE_SINGLE_REGISTER: {
+            ResolvedAddress reg;
+            if (!wordAddress(memoryBytes, MEMORY_SPACE::M, start, reg)) return exceptionResponse(function, ILLEGAL_DATA_ADDRESS, response);
+            writeImage(reg, quantity);
+            memcpy(response, request, 5);
+            return 5;
+        }
+        case WRITE_MULTIPLE_COILS: {
+            if (length < 6 || quantity < 1 || quantity > MAX_WRITE_BITS || request[5] != (quantity + 7) / 8
+                || length < 6 + static_cast<size_t>(request[5])) {
+                return exceptionResponse(function, ILLEGAL_DATA_VALUE, response);
+            }
+            if (static_cast<size_t>(start) + quantity > bitCount) return exceptionResponse(function, ILLEGAL_DATA_ADDRESS, response);
+            writeAddresses.resize(quantity);
+            writeValues.resize(quantity);
+            for (uint16_t i = 0; i < quantity; i++) {
+                bitAddress(outputBytes, MEMORY_SPACE::Q, static_cast<size_t>(start) + i, writeAddresses[i]);
+                writeValues[i] = (request[6 + i / 8] >> (i % 8)) & 0x01;
+            }
+            writeImage(writeAddresses.data(), writeValues.data(), quantity);
+            memcpy(response, request, 5);
+            return 5;
+        }
+        case WRITE_MULTIPLE_REGISTERS: {
+            if (length < 6 || quantity < 1 || quantity > MAX_WRITE_REGISTERS || request[5] != quantity * 2
+                || length < 6 + static_cast<size_t>(request[5])) {
+                return exceptionResponse(function, ILLEGAL_DATA_VALUE, response);
+            }
+            if (static_cast<size_t>(start) + quantity > registerCount) return exceptionResponse(function, ILLEGAL_DATA_ADDRESS, response);
+            writeAddresses.resize(quantity);
+            writeValues.resize(quantity);
+            for (uint16_t i = 0; i < quantity; i++) {
+                wordAddress(memoryBytes, MEMORY_SPACE::M, static_cast<size_t>(start) + i, writeAddresses[i]);
+                writeValues[i] = getWord(request + 6 + i * 2);
+            }
+            writeImage(writeAddresses.data(), writeValues.data(), quantity);
+            memcpy(response, request, 5);
+            return 5;
+        }
+        case MASK_WRITE_REGISTER: {
+            // FC22: the AND mask is in the quantity field, followed by the OR mask. The register is changed from its
+            // value at the end of the last scan.
+            if (length < 7) return exceptionResponse(function, ILLEGAL_DATA_VALUE, response);
+            ResolvedAddress reg;
+            if (!wordAddress(memoryBytes, MEMORY_SPACE::M, start, reg)) return exceptionResponse(function, ILLEGAL_DATA_ADDRESS, response);
+            uint16_t orMask = getWord(request + 5);
+            uint8_t current[2];
+            readWords(memoryBytes, start, 1, current);
+            uint16_t value = static_cast<uint16_t>((getWord(current) & quantity) | (orMask & ~quantity));
+            writeImage(reg, value);
+            memcpy(response, request, 7);
+            return 7;
+        }
+        case READ_WRITE_MULTIPLE_REGISTERS: {
+            // FC23: read start, read quantity, write start, write quantity, byte count, values. The write is staged,
+            // so the read returns the registers as they were at the end of the last scan.
+            if (length < 10) return exceptionResponse(function, ILLEGAL_DATA_VALUE, response);
+            uint16_t writeStart = getWord(request + 5);
+            uint16_t writeQuantity = getWord(request + 7);
+            if (quantity < 1 || quantity > MAX_READ_REGISTERS || writeQuantity < 1 || writeQuantity > MAX_READ_WRITE_REGISTERS
+                || request[9] != writeQuantity * 2 || length < 10 + static_cast<size_t>(request[9])) {
+                return exceptionResponse(function, ILLEGAL_DATA_VALUE, response);
+            }
+            if (static_cast<size_t>(start) + quantity > registerCount || static_cast<size_t>(writeStart) + writeQuantity > registerCount) {
+                return exceptionResponse(function, ILLEGAL_DATA_ADDRESS, response);
+            }
+            writeAddresses.resize(writeQuantity);
+            writeValues.resize(writeQuantity);
+            for (uint16_t i = 0; i < writeQuantity; i++) {
+                wordAddress(memoryBytes, MEMORY_SPACE::M, static_cast<size_t>(writeStart) + i, writeAddresses[i]);
+                writeValues[i] = getWord(request + 10 + i * 2);
+            }
+            response[0] = function;
+            response[1] = static_cast<uint8_t>(quantity * 2);
+            readWords(memoryBytes, start, quantity, response + 2);
+            writeImage(writeAddresses.data(), writeValues.data(), writeQuantity);
+            return 2 + response[1];
+        }
+        default:
+            return exceptionResponse(function, ILLEGAL_FUNCTION, response);
+    }
+}
+
+bool ModbusServer::start(uint16_t port, int clients, const std::string& backend) {
+    if (listenFd >= 0) return true;
+    maxClients = clients > 0 ? static_cast<size_t>(clients) : 1;
+    int fd = static_cast<int>(socket(AF_INET, SOCK_STREAM, 0));
+    if (fd < 0) {
+        printSocketError("Modbus server socket");
+        return false;
+    }
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, 128) < 0) {
+        printSocketError("Modbus server listen");
+        closeSocket(fd);
+        return false;
+    }
+    setNonBlocking(fd, true);
+    listenFd = fd;
+
+    reactor = std::make_unique<IOReactor>("MODBUS-SERVER", backend);
+    reactor->start();
+    reactor->post([this]() {
+        reactor->watch(listenFd, EVENT_READABLE, [this](uint32_t) { acceptConnections(); });
+    });
+    nodalisLog() << "Modbus/TCP server listening on port " << port << "\n";
+    return true;
+}
+
+void ModbusServer::stop() {
+    if (!reactor) return;
+    reactor->runSync([this]() {
+        while (!connections.empty()) {
+            closeConnection(connections.begin()->first);
+        }
+        reactor->unwatch(listenFd);
+        closeSocket(listenFd);
+        listenFd = -1;
+    });
+    reactor->stop();
+    reactor.reset();
+}
+
+void ModbusServer::acceptConnections() {
+    while (true) {
+        sockaddr_in peer;
+        socklen_t peerLength = sizeof(peer);
+        int fd = static_cast<int>(accept(listenFd, reinterpret_cast<sockaddr*>(&peer), &peerLength));
+        if (fd < 0) return;
+        if (connections.size() >= maxClients) {
+            nodalisError() << "Modbus server refused a connection: " << maxClients << " clients are already connected\n";
+            closeSocket(fd);
+            continue;
+        }
+        setNonBlocking(fd, true);
+        int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+        auto connection = std::make_unique<Connection>();
+        connection->fd = fd;
+        Connection& added = *connection;
+        connections[fd] = std::move(connection);
+        startReceive(added);
+    }
+}
+
+void ModbusServer::startReceive(Connection& connection) {
+    int fd = connection.fd;
+    if (!reactor->submitReceive(fd, [this, fd](const uint8_t* data, int result) { onReceived(fd, data, result); })) {
+        closeConnection(fd);
+    }
+}
+
+void ModbusServer::onReceived(int fd, const uint8_t* data, int result) {
+    auto it = connections.find(fd);
+    if (it == connections.end()) return;
+    Connection& connection = *it->second;
+    if (result <= 0) {
+        closeConnection(fd);
+        return;
+    }
+    connection.receiveBuffer.insert(connection.receiveBuffer.end(), data, data + result);
+
+    // Answer every complete request in the buffer, in order.
+    size_t start = 0;
+    uint8_t adu[MODBUS_MAX_ADU];
+    while (connection.receiveBuffer.size() - start >= MODBUS_MBAP_SIZE) {
+        const uint8_t* frame = connection.receiveBuffer.data() + start;
+        uint16_t length = getWord(frame + 4);
+        if (frame[2] != 0 || frame[3] != 0 || length < 2 || length > MODBUS_MAX_PDU + 1) {
+            nodalisError() << "Modbus server closed a connection that sent an invalid frame (length = " << length << ")\n";
+            closeConnection(fd);
+            return;
+        }
+        size_t frameSize = 6 + static_cast<size_t>(length);
+        if (connection.receiveBuffer.size() - start < frameSize) break;
+        size_t pduLength = handlePdu(frame + MODBUS_MBAP_SIZE, frameSize - MODBUS_MBAP_SIZE, adu + MODBUS_MBAP_SIZE);
+        // The response echoes the transaction and unit IDs of the request.
+        size_t responseSize = finishFrame(adu, getWord(frame), frame[6], pduLength);
+        connection.sendBuffer.insert(connection.sendBuffer.end(), adu, adu + responseSize);
+        start += frameSize;
+    }
+    connection.receiveBuffer.erase(connection.receiveBuffer.begin(), connection.receiveBuffer.begin() + start);
+    flushSend(connection);
+    startReceive(connection);
+}
+
+void ModbusServer::flushSend(Connection& connection) {
+    if (connection.sending || connection.sendBuffer.empty()) return;
+    int fd = connection.fd;
+    size_t taken = reactor->submitSend(fd, connection.sendBuffer.data(), connection.sendBuffer.size(),
+        [this, fd](const uint8_t*, int result) {
+            auto it = connections.find(fd);
+            if (it == connections.end()) return;
+            Connection& sent = *it->second;
+            sent.sending = false;
+            if (result <= 0) {
+                closeConnection(fd);
+                return;
+            }
+            sent.sendBuffer.erase(sent.sendBuffer.begin(), sent.sendBuffer.begin() + result);
+            flushSend(sent);
+        });
+    if (taken == 0) {
+        closeConnection(fd);
+        return;
+    }
+    connection.sending = true;
+}
+
+void ModbusServer::closeConnection(int fd) {
+    if (connections.erase(fd) == 0) return;
+    reactor->cancelIO(fd);
+    reactor->unwatch(fd);
+    closeSocket(fd);
 }
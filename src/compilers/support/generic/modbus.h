@@ -26,8 +26,12 @@
 #include <vector>
 #include <map>
 #include <string>
+#include <chrono>
+#include <memory>
 #include "nodalis.h"
 
+class IOReactor;
+
 #ifdef _WIN32
     #include <winsock2.h>
     typedef int socklen_t;
@@ -46,7 +50,30 @@ enum ModbusFunctionCode {
     WRITE_SINGLE_COIL = 0x05,
     WRITE_SINGLE_REGISTER = 0x06,
     WRITE_MULTIPLE_COILS = 0x0F,
-    WRITE_MULTIPLE_REGISTERS = 0x10
+    WRITE_MULTIPLE_REGISTERS = 0x10,
+    MASK_WRITE_REGISTER = 0x16,
+    READ_WRITE_MULTIPLE_REGISTERS = 0x17
+};
+
+/**
+ * The order of the bytes of a multi-register value, with A the most significant byte. ABCD is the Modbus standard
+ * order, CDAB swaps the registers, BADC swaps the bytes in each register and DCBA does both. 64 bit values follow
+ * the same rule over four registers.
+ */
+enum ModbusWordOrder : uint8_t {
+    WORD_ORDER_ABCD,
+    WORD_ORDER_CDAB,
+    WORD_ORDER_BADC,
+    WORD_ORDER_DCBA
+};
+
+/**
+ * What the registers of a point hold on the device.
+ */
+enum ModbusDataType : uint8_t {
+    MODBUS_INTEGER, // An integer as wide as the mapping.
+    MODBUS_REAL,    // A 32 bit IEEE float in two registers.
+    MODBUS_LREAL    // A 64 bit IEEE float in four registers.
 };
 
 struct ModbusRequest {
@@ -64,10 +91,57 @@ struct ModbusResponse {
     uint8_t exceptionCode;
 };
 
-// Server implementation
+/**
+ * The size of the Modbus/TCP MBAP header, including the unit ID.
+ */
+static constexpr size_t MODBUS_MBAP_SIZE = 7;
+/**
+ * The largest Modbus PDU, and the largest Modbus/TCP ADU, which is the PDU with its MBAP header.
+ */
+static constexpr size_t MODBUS_MAX_PDU = 253;
+static constexpr size_t MODBUS_MAX_ADU = MODBUS_MBAP_SIZE + MODBUS_MAX_PDU;
+/**
+ * The largest Modbus RTU ADU, which is the PDU with the slave address before it and the CRC after it.
+ */
+static constexpr size_t MODBUS_RTU_MAX_ADU = 1 + MODBUS_MAX_PDU + 2;
+
+/**
+ * A read-only view of bytes owned by someone else, such as a PDU still in the receive buffer.
+ */
+struct ModbusBytes {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+/**
+ * A Modbus/TCP server that serves the process image to SCADA and HMI clients. Its tables are views of the image
+ * rather than copies of it:
+ *  - coils (FC01/05/15) are %QX, so coil 10 is %QX1.2,
+ *  - discrete inputs (FC02) are %IX,
+ *  - input registers (FC04) are %IW,
+ *  - holding registers (FC03/06/16/23) are %MW, so holding register 5 is %MW5.
+ * Reads come from the last published image, and writes are staged like any other external write, so they apply
+ * together at the start of the next scan. Requests from any unit ID are answered.
+ *
+ * The server runs on its own IO reactor, which serves many connections on one thread.
+ */
 class ModbusServer {
 public:
     ModbusServer();
+    ~ModbusServer();
+
+    /**
+     * Starts listening for connections.
+     * @param port The TCP port to listen on.
+     * @param maxClients The most clients that may be connected at once. Further connections are refused.
+     * @param backend The reactor backend to use, as accepted by createReactorBackend().
+     * @returns Returns false if the port can't be listened on.
+     */
+    bool start(uint16_t port, int maxClients = 32, const std::string& backend = "");
+    /**
+     * Closes every connection and stops listening.
+     */
+    void stop();
 
     void setCoil(uint16_t address, bool value);
     bool getCoil(uint16_t address);
@@ -79,11 +153,104 @@ public:
     uint16_t getRegister(uint16_t address);
 
     ModbusResponse handleRequest(const ModbusRequest& request);
+    /**
+     * Handles a request PDU. Invalid requests are answered with an exception response.
+     * @param request The request PDU.
+     * @param length The length of the request PDU.
+     * @param response The buffer for the response PDU, which must hold MODBUS_MAX_PDU bytes.
+     * @returns Returns the length of the response PDU.
+     */
+    size_t handlePdu(const uint8_t* request, size_t length, uint8_t* response);
 
 private:
-    std::map<uint16_t, bool> coils;
-    std::map<uint16_t, bool> discreteInputs;
-    std::map<uint16_t, uint16_t> holdingRegisters;
+    /**
+     * The offsets in the image of each byte of the %I, %Q and %M spaces, by byte index. The spaces aren't
+     * contiguous in the image, so this gives every table a flat, O(1) lookup.
+     */
+    std::vector<int32_t> inputBytes;
+    std::vector<int32_t> outputBytes;
+    std::vector<int32_t> memoryBytes;
+    /**
+     * The writes of the request being handled, kept between requests so that their storage is reused.
+     */
+    std::vector<ResolvedAddress> writeAddresses;
+    std::vector<uint64_t> writeValues;
+
+    /**
+     * A client connection.
+     */
+    struct Connection {
+        int fd;
+        std::vector<uint8_t> receiveBuffer;
+        std::vector<uint8_t> sendBuffer;
+        bool sending = false;
+    };
+    std::unique_ptr<IOReactor> reactor;
+    std::map<int, std::unique_ptr<Connection>> connections;
+    int listenFd = -1;
+    size_t maxClients = 32;
+
+    /**
+     * Gets the resolved address of a bit of a space.
+     * @param bytes The byte offsets of the space.
+     * @param space The space.
+     * @param bit The bit, counted from the first bit of the space.
+     * @param address Receives the address.
+     * @returns Returns false if the bit is outside of the space.
+     */
+    static bool bitAddress(const std::vector<int32_t>& bytes, int space, size_t bit, ResolvedAddress& address);
+    /**
+     * Gets the resolved address of a 16 bit register of a space.
+     * @param bytes The byte offsets of the space.
+     * @param space The space.
+     * @param index The register, counted in words from the start of the space.
+     * @param address Receives the address.
+     * @returns Returns false if the register is outside of the space.
+     */
+    static bool wordAddress(const std::vector<int32_t>& bytes, int space, size_t index, ResolvedAddress& address);
+    /**
+     * Reads bits of a space into a response.
+     * @param bytes The byte offsets of the space.
+     * @param start The first bit.
+     * @param quantity The number of bits.
+     * @param out The buffer for the packed bits.
+     */
+    void readBits(const std::vector<int32_t>& bytes, uint16_t start, uint16_t quantity, uint8_t* out);
+    /**
+     * Reads registers of a space into a response, as big endian words.
+     * @param bytes The byte offsets of the space.
+     * @param start The first register.
+     * @param quantity The number of registers.
+     * @param out The buffer for the registers.
+     */
+    void readWords(const std::vector<int32_t>& bytes, uint16_t start, uint16_t quantity, uint8_t* out);
+
+    /**
+     * Accepts the pending connections on the listening socket.
+     */
+    void acceptConnections();
+    /**
+     * Submits a receive on a connection.
+     * @param connection The connection.
+     */
+    void startReceive(Connection& connection);
+    /**
+     * Handles data received on a connection, answering each complete request in it.
+     * @param fd The socket of the connection.
+     * @param data The received data.
+     * @param result The number of bytes received, 0 if the client closed the connection, or a negative error code.
+     */
+    void onReceived(int fd, const uint8_t* data, int result);
+    /**
+     * Submits the front of a connection's send buffer, unless a send is already outstanding.
+     * @param connection The connection.
+     */
+    void flushSend(Connection& connection);
+    /**
+     * Closes a connection.
+     * @param fd The socket of the connection.
+     */
+    void closeConnection(int fd);
 };
 
 // Client implementation
@@ -100,27 +267,540 @@ public:
     ModbusRequest createWriteSingleRegister(uint16_t address, uint16_t value);
 
     bool sendRequest(const ModbusRequest& request, ModbusResponse& response);
+    /**
+     * Sends a batch of requests, keeping up to maxInFlight of them outstanding at once. Responses are matched to
+     * their requests by MBAP transaction ID, so they may arrive in any order.
+     * @param requests The requests to send.
+     * @param responses Receives a response for each request, in the same order as the requests.
+     * @param succeeded Receives true for each request that got a valid, non exception response.
+     */
+    void sendRequests(const std::vector<ModbusRequest>& requests, std::vector<ModbusResponse>& responses, std::vector<bool>& succeeded);
+    /**
+     * Encodes a request as a Modbus/TCP frame.
+     * @param request The request.
+     * @param transactionId The transaction ID.
+     * @param adu The buffer to encode into, which must hold MODBUS_MAX_ADU bytes.
+     * @returns Returns the length of the frame, or 0 if the request can't be encoded.
+     */
+    static size_t encodeRequest(const ModbusRequest& request, uint16_t transactionId, uint8_t* adu);
+    /**
+     * Checks that a response PDU answers a request with the given function and isn't an exception.
+     * @param function The function of the request.
+     * @param pdu The response PDU.
+     * @returns Returns true if the response is valid.
+     */
+    static bool checkResponse(uint8_t function, ModbusBytes pdu);
+    /**
+     * Runs the client on an IO reactor. The socket is then non-blocking, and polls, requests, responses and
+     * timeouts are all driven by reactor events, so one reactor thread can serve many devices.
+     * @param reactor The reactor.
+     * @returns Returns true.
+     */
+    bool attach(IOReactor& reactor) override;
 
 protected:
     std::string ip;
     uint16_t port;
-    bool readBit(const std::string& remote, int& result) override;
-    bool writeBit(const std::string& remote, int value) override;
-    bool readByte(const std::string& remote, uint8_t& result) override;
-    bool writeByte(const std::string& remote, uint8_t value) override;
-    bool readWord(const std::string& remote, uint16_t& result) override;
-    bool writeWord(const std::string& remote, uint16_t value) override;
-    bool readDWord(const std::string& remote, uint32_t& result) override;
-    bool writeDWord(const std::string& remote, uint32_t value) override;
-    bool readLWord(const std::string &remote, uint64_t &result) override;
-    bool writeLWord(const std::string &remote, uint64_t value) override;
     void connect() override;   
+    /**
+     * Coalesces the requests of a batch into blocks, and exchanges them with up to maxInFlight outstanding.
+     * @param requests The batch.
+     */
+    void submitBatch(IOBatch& requests) override;
+    void onMappingAdded(IOMap& map) override;
+
+    /**
+     * Constructs a client for another transport of Modbus, which shares the coalescing of the TCP client.
+     * @param protocol The name of the protocol.
+     * @param unitId The default unit ID.
+     */
+    ModbusClient(const char* protocol, uint8_t unitId);
 
-private:
     int sockfd;
     uint8_t deviceAddress;
+    /**
+     * Whether a non-blocking connect is in progress on sockfd, when running on a reactor.
+     */
+    bool connecting = false;
+    /**
+     * The number of requests that may be outstanding on the connection at once. It is set with the MaxInFlight
+     * protocol property, and defaults to 1 for devices that only handle one request at a time.
+     */
+    size_t maxInFlight = 1;
+    /**
+     * Whether mappings of neighbouring coils or registers are read and written together in block requests. Set
+     * with the Coalesce protocol property. Without it, every mapping is a request of its own.
+     */
+    bool coalesce = true;
+    /**
+     * The transaction ID for the next request.
+     */
+    uint16_t nextTransactionId = 1;
+    /**
+     * The longest time to wait for a connection, in milliseconds. Set with the ConnectTimeout protocol property.
+     */
+    int64_t connectTimeout = 3000;
+    /**
+     * The longest time to wait for a response, in milliseconds. Set with the ResponseTimeout protocol property.
+     */
+    int64_t responseTimeout = 1000;
+    /**
+     * The idle time before TCP keepalive probes start, in seconds, or 0 to disable them. Set with the KeepAlive
+     * protocol property.
+     */
+    int keepAliveSeconds = 10;
+    /**
+     * Whether Nagle's algorithm is disabled on the connection. Set with the NoDelay protocol property.
+     */
+    bool noDelay = true;
+    /**
+     * Bytes received from the connection that don't form a complete frame yet.
+     */
+    std::vector<uint8_t> receiveBuffer;
+    /**
+     * The start of the first frame in receiveBuffer that hasn't been taken yet.
+     */
+    size_t receiveStart = 0;
+    /**
+     * Bytes queued for the connection that the socket hasn't accepted yet, when running on a reactor.
+     */
+    std::vector<uint8_t> sendBuffer;
+    /**
+     * Whether a send of the front of sendBuffer is outstanding on the reactor.
+     */
+    bool sending = false;
+
+    /**
+     * A mapping resolved to the Modbus table and range it occupies.
+     */
+    struct ModbusPoint {
+        ResolvedAddress local;  // The process image address of the mapping.
+        int width;          // The width of the mapping.
+        uint8_t unit;       // The unit ID, which is the client's, or a serial slave's ModuleID, unless set with UnitID.
+        uint8_t function;   // The read function, or the multiple write function for outputs, or the mask write for register bits.
+        uint16_t address;   // The first coil or register.
+        uint16_t count;     // The number of coils or registers.
+        size_t mapping;     // The index of the mapping in mappings.
+        uint32_t quality;   // The quality slot of the mapping.
+        uint8_t wordOrder;  // The ModbusWordOrder of the registers, from the WordOrder protocol property.
+        uint8_t dataType;   // The ModbusDataType of the registers, from the DataType protocol property.
+        int8_t bit = -1;    // The bit of a register mapped as <register>.<bit>, or -1.
+        IORequest* request = nullptr;   // The request of the point in the batch being polled.
+    };
+
+    /**
+     * Resolves a mapping to the Modbus table and range it occupies.
+     * @param map The mapping.
+     * @param unit The unit ID of the point, unless the mapping sets another with the UnitID protocol property.
+     * @param point Receives the resolved point.
+     * @returns Returns true if the mapping could be resolved.
+     */
+    bool resolvePoint(const IOMap& map, uint8_t unit, ModbusPoint& point);
+    /**
+     * Resolves a mapping and adds it to points, setting its remoteHandle, or reports it if it can't be resolved.
+     * @param map The mapping, as stored in mappings.
+     * @param unit The unit ID of the point, unless the mapping sets another with the UnitID protocol property.
+     */
+    void addPoint(IOMap& map, uint8_t unit);
+    /**
+     * The resolved points of the mappings, indexed by their remoteHandle.
+     */
+    std::vector<ModbusPoint> points;
+    /**
+     * The points of the blocks being polled, sorted by unit, function and address. It keeps its storage between
+     * polls, like batch and inFlight, so that polling doesn't allocate once they have grown.
+     */
+    std::vector<ModbusPoint> blockPoints;
+    /**
+     * The mappings that are due in tick(), and their batch, which is kept until its blocks have all completed, and
+     * then reused.
+     */
+    std::vector<IOMap*> dueMappings;
+    IOBatch tickBatch;
+    /**
+     * The registers of the read response being scattered, in host order.
+     */
+    std::vector<uint16_t> registers;
+    /**
+     * A request covering a range of blockPoints.
+     */
+    struct ModbusBlock {
+        uint8_t unit;
+        uint8_t function;       // Single writes use FC05/FC06 rather than the multiple write functions.
+        uint16_t startAddress;
+        uint16_t quantity;
+        size_t firstPoint;      // The first point of the block in blockPoints.
+        size_t pointCount;
+    };
+
+    /**
+     * Groups the requests of a batch into as few block requests as the protocol limits allow, replacing batch and
+     * blockPoints. Requests without a resolved point are completed as invalid. The mapping mutex must be held.
+     * @param requests The batch, which must be kept until the blocks have completed.
+     */
+    void buildBlocks(IOBatch& requests);
+    /**
+     * Adds a block covering a range of blockPoints to batch.
+     * @param function The read function, or the multiple write function for outputs.
+     * @param first The first point of the block.
+     * @param count The number of points in the block.
+     */
+    void addBlock(uint8_t function, size_t first, size_t count);
+    /**
+     * Encodes the request of a block as a Modbus/TCP frame, with the output values of its requests.
+     * @param block The block.
+     * @param transactionId The transaction ID.
+     * @param adu The buffer to encode into, which must hold MODBUS_MAX_ADU bytes.
+     * @returns Returns the length of the frame.
+     */
+    size_t encodeBlock(const ModbusBlock& block, uint16_t transactionId, uint8_t* adu);
+    /**
+     * Encodes the request PDU of a block, which every transport frames the same way.
+     * @param block The block.
+     * @param pdu The buffer to encode into, which must hold MODBUS_MAX_PDU bytes.
+     * @returns Returns the length of the PDU.
+     */
+    size_t encodeBlockPdu(const ModbusBlock& block, uint8_t* pdu);
+    /**
+     * Completes the requests of the points of a block, scattering the values of a read response to them.
+     * @param block The block that was sent.
+     * @param pdu The response PDU.
+     * @param succeeded Whether the request succeeded.
+     */
+    void completeBlock(const ModbusBlock& block, ModbusBytes pdu, bool succeeded);
+
+    /**
+     * Sends a number of requests, keeping up to maxInFlight of them outstanding, and completes each one as its
+     * response arrives. Requests that aren't answered when the connection fails are completed as not received.
+     * @param count The number of requests.
+     * @param encode Called as encode(index, transactionId, adu) to encode a request, returning its length.
+     * @param complete Called as complete(index, pdu, received) with the response PDU, which is only valid during
+     * the call.
+     */
+    template <typename Encode, typename Complete>
+    void transact(size_t count, Encode encode, Complete complete);
+    /**
+     * Removes an outstanding request from inFlight, and counts its round trip.
+     * @param transactionId The transaction ID of the response.
+     * @param pdu The response PDU. An exception response counts as an error.
+     * @param index Receives the index of the request.
+     * @returns Returns false if no request has the transaction ID.
+     */
+    bool takeInFlight(uint16_t transactionId, ModbusBytes pdu, size_t& index);
+    /**
+     * Decodes a response PDU into a ModbusResponse.
+     * @param request The request the response belongs to.
+     * @param pdu The response PDU.
+     * @param response Receives the decoded response.
+     * @returns Returns true if the response is valid and not an exception.
+     */
+    bool decodeResponse(const ModbusRequest& request, ModbusBytes pdu, ModbusResponse& response);
+    /**
+     * Takes the next complete frame from the receive buffer. The frame stays in the buffer until it is compacted.
+     * @param transactionId Receives the transaction ID of the frame.
+     * @param pdu Receives a view of the PDU of the frame.
+     * @returns Returns 1 if a frame was taken, 0 if the buffer doesn't hold a complete frame yet, and -1 if the
+     * buffer holds an invalid frame.
+     */
+    int takeFrame(uint16_t& transactionId, ModbusBytes& pdu);
+    /**
+     * Drops the frames that have been taken from the receive buffer. This invalidates the PDUs they were taken as.
+     */
+    void compactReceiveBuffer();
+    /**
+     * Sends a frame.
+     * @param adu The frame.
+     * @param length The length of the frame.
+     * @returns Returns false if the send failed, in which case the connection is closed.
+     */
+    bool sendFrame(const uint8_t* adu, size_t length);
+    /**
+     * Receives the next complete frame from the connection.
+     * @param transactionId Receives the transaction ID of the frame.
+     * @param pdu Receives a view of the PDU of the frame, valid until the next receive.
+     * @param deadline The time by which the frame must arrive.
+     * @returns Returns false if the connection failed, timed out or sent an invalid frame, in which case it is closed.
+     */
+    bool receiveFrame(uint16_t& transactionId, ModbusBytes& pdu, std::chrono::steady_clock::time_point deadline);
+    /**
+     * Applies the TCP_NODELAY, keepalive and send timeout options to a connected socket.
+     * @param fd The socket.
+     */
+    void configureSocket(int fd);
+    /**
+     * Sets the endpoint from the first mapping if it wasn't given to the constructor.
+     * @returns Returns true if there is an endpoint to connect to.
+     */
+    bool resolveEndpoint();
+    /**
+     * Creates a non-blocking socket and starts connecting it.
+     * @param ip The IP address to connect to.
+     * @param port The TCP port to connect to.
+     * @param pending Receives true if the connect is still in progress.
+     * @returns Returns the socket, or -1 if the connect failed.
+     */
+    int openConnection(const std::string& ip, uint16_t port, bool& pending);
+    /**
+     * Configures a newly connected socket and marks the client as connected.
+     * @param fd The socket.
+     */
+    void connectionEstablished(int fd);
+
+    // ----- Reactor mode -----
+
+    /**
+     * The reactor the client runs on, or null if it is polled by a thread.
+     */
+    IOReactor* reactor = nullptr;
+    /**
+     * The IO statistics of the client, when running on a reactor.
+     */
+    ExecutionStats* ioStats = nullptr;
+    uint64_t tickTimer = 0;
+    uint64_t connectTimer = 0;
+    uint64_t timeoutTimer = 0;
+    /**
+     * The blocks of the poll in progress, and which of them are finished.
+     */
+    std::vector<ModbusBlock> batch;
+    std::vector<bool> batchDone;
+    size_t batchNext = 0;
+    size_t batchRemaining = 0;
+    std::chrono::steady_clock::time_point batchStart;
+    /**
+     * An outstanding request.
+     */
+    struct InFlightRequest {
+        uint16_t transactionId;
+        size_t index;       // The index of the request, or of its block in batch.
+        std::chrono::steady_clock::time_point sentAt;
+    };
+    /**
+     * The outstanding requests. There are at most maxInFlight of them, so they are searched linearly.
+     */
+    std::vector<InFlightRequest> inFlight;
+
+    /**
+     * Cancels the timers and closes the connection. This runs on the reactor thread when the client is destroyed.
+     */
+    void detach();
+    /**
+     * Starts a connection attempt or a poll, whichever is due, and schedules the next tick.
+     */
+    void tick();
+    /**
+     * Schedules the next tick for when the next poll or connection attempt is due.
+     */
+    void scheduleTick();
+    /**
+     * Reschedules the next tick on the reactor, so that outputs made due by requestFlush() are written at once.
+     */
+    void wake() override;
+    /**
+     * Starts a non-blocking connect, which completes in finishConnect() or times out after connectTimeout.
+     */
+    void beginConnect();
+    /**
+     * Completes a non-blocking connect once the socket is writable.
+     */
+    void finishConnect();
+    /**
+     * Starts sending the blocks of a poll, which buildBlocks() has put in batch.
+     */
+    void beginBatch();
+    /**
+     * Sends blocks of the current poll until maxInFlight requests are outstanding, and ends the poll once every
+     * block is finished.
+     */
+    void pump();
+    /**
+     * Submits the front of the send buffer to the reactor, unless a send is already outstanding.
+     */
+    void flushSend();
+    /**
+     * Handles the completion of a send, and submits the rest of the send buffer.
+     * @param result The number of bytes sent, or a negative error code.
+     */
+    void onSent(int result);
+    /**
+     * Submits a receive on the connected socket.
+     * @returns Returns false if the reactor has no free buffer.
+     */
+    bool startReceive();
+    /**
+     * Handles received data, completing the requests it answers.
+     * @param data The received data.
+     * @param result The number of bytes received, 0 if the device closed the connection, or a negative error code.
+     */
+    void onReceived(const uint8_t* data, int result);
+    /**
+     * Restarts the response timer for the oldest outstanding request.
+     */
+    void armTimeout();
+    /**
+     * Marks a block of the current poll as finished and applies its result.
+     * @param index The index of the block.
+     * @param pdu The response PDU.
+     * @param succeeded Whether the request succeeded.
+     */
+    void finishBlock(size_t index, ModbusBytes pdu, bool succeeded);
+    /**
+     * Closes the connection and fails every block of the current poll that isn't finished.
+     */
+    void dropConnection();
+    /**
+     * Ends the current poll, records its duration and schedules the next tick.
+     */
+    void endBatch();
+};
+
+/**
+ * The serial settings of a Modbus RTU line.
+ */
+struct SerialSettings {
+    uint32_t baudRate = 9600;
+    uint8_t dataBits = 8;
+    char parity = 'E';      // 'N', 'E' or 'O'. Modbus RTU calls for even parity unless the devices say otherwise.
+    uint8_t stopBits = 1;
+    bool rs485 = false;     // Whether the driver switches the transceiver with RTS (Linux RS-485 mode).
+};
+
+/**
+ * A Modbus RTU client for a multidrop RS-485 line (MODBUS-RTU). The ModulePort of a mapping is the serial port, such
+ * as /dev/ttyUSB0 or COM3, and its ModuleID the address of the slave, so every slave on a port shares one client and
+ * the line is never driven by two at once. The points of each slave are coalesced into block requests as the TCP
+ * client's are.
+ *
+ * The line is half duplex, so one request is outstanding at a time, and a request is only sent once the line has
+ * been silent for 3.5 characters. The client runs on a thread of its own, which sleeps until the line is due to be
+ * idle and waits in poll() for the response, rather than on a reactor shared with sockets. Responses are framed by
+ * the length their function implies, so a request follows as soon as the last byte and the silence after it are in,
+ * rather than after a read timeout. The requests of a poll are interleaved over the slaves, and a slave that doesn't
+ * answer is only tried again after a backoff, so one that is offline doesn't hold up the others with its timeouts.
+ */
+class ModbusRtuClient : public ModbusClient {
+public:
+    ModbusRtuClient();
+    ~ModbusRtuClient();
+
+    /**
+     * Serial lines are polled on a thread of their own.
+     * @param reactor The reactor.
+     * @returns Returns false.
+     */
+    bool attach(IOReactor& reactor) override { (void)reactor; return false; }
+    /**
+     * Computes the Modbus CRC of a frame, with a table of the remainder of each byte.
+     * @param data The frame.
+     * @param length The length of the frame.
+     * @returns Returns the CRC, which is sent low byte first.
+     */
+    static uint16_t crc16(const uint8_t* data, size_t length);
+
+protected:
+    void connect() override;
+    void submitBatch(IOBatch& requests) override;
+    void onMappingAdded(IOMap& map) override;
+
+private:
+#ifdef _WIN32
+    HANDLE port = INVALID_HANDLE_VALUE;
+#else
+    int port = -1;
+#endif
+    SerialSettings settings;
+    /**
+     * The time a character takes on the line, and the silence that ends a frame (3.5 characters, or 1750us above
+     * 19200 baud).
+     */
+    std::chrono::nanoseconds charTime{0};
+    std::chrono::nanoseconds frameGap{0};
+    /**
+     * The time after a broadcast (unit 0) before the next request, in milliseconds, since the slaves don't answer
+     * it. Set with the TurnaroundDelay protocol property.
+     */
+    int64_t turnaroundDelay = 100;
+    /**
+     * Whether the port receives what it sends, as some adapters do, so that each request is read back before its
+     * response. Set with the Echo protocol property.
+     */
+    bool echo = false;
+    /**
+     * The time the line was last seen busy, by a byte sent or received.
+     */
+    std::chrono::steady_clock::time_point lineBusy;
+    /**
+     * The state of each slave address. A slave that doesn't answer is skipped until retryAt, and its wait doubles
+     * with each request it misses, as the reconnect delay does.
+     */
+    struct SlaveState {
+        uint64_t retryAt = 0;
+        uint64_t delay = 0;
+    };
+    std::vector<SlaveState> slaves;
+    /**
+     * The order in which the blocks of a poll are sent, and the range of batch of each slave. They keep their storage
+     * between polls.
+     */
+    std::vector<size_t> order;
+    std::vector<std::pair<size_t, size_t>> slaveBlocks;
 
-    bool sendRaw(const std::vector<uint8_t>& requestPDU, std::vector<uint8_t>& responsePDU);
+    /**
+     * Opens and configures the serial port.
+     * @returns Returns false if it can't be opened with the settings.
+     */
+    bool openPort();
+    /**
+     * Closes the serial port.
+     */
+    void closePort();
+    /**
+     * Writes a frame to the port.
+     * @param data The frame.
+     * @param length The length of the frame.
+     * @returns Returns false if the port failed.
+     */
+    bool writePort(const uint8_t* data, size_t length);
+    /**
+     * Reads what the port has received, waiting for it up to a timeout.
+     * @param data The buffer.
+     * @param capacity The size of the buffer.
+     * @param timeout The longest time to wait for the first byte.
+     * @returns Returns the number of bytes read, 0 on timeout, or -1 if the port failed.
+     */
+    int readPort(uint8_t* data, size_t capacity, std::chrono::microseconds timeout);
+    /**
+     * Waits until the line has been silent for a frame gap, discarding whatever arrives meanwhile.
+     * @returns Returns false if the port failed.
+     */
+    bool waitForSilence();
+    /**
+     * The outcomes of a request on the line.
+     */
+    enum class Exchange {
+        Answered,       // A valid response arrived.
+        Invalid,        // A response arrived, but it was for another slave or its CRC was wrong.
+        TimedOut,       // No complete response arrived within the response timeout.
+        PortFailed      // The port failed, and must be opened again.
+    };
+    /**
+     * Sends a request frame and receives its response into receiveBuffer.
+     * @param adu The request, with its CRC.
+     * @param length The length of the request.
+     * @param pdu Receives a view of the response PDU, valid until the next exchange.
+     * @returns Returns the outcome of the request.
+     */
+    Exchange exchangeFrame(const uint8_t* adu, size_t length, ModbusBytes& pdu);
+    /**
+     * Orders the blocks of batch so that consecutive requests go to different slaves.
+     */
+    void interleaveBlocks();
+    /**
+     * Records whether a slave answered, backing off a slave that didn't.
+     * @param unit The slave address.
+     * @param answered Whether it answered.
+     */
+    void slaveAnswered(uint8_t unit, bool answered);
 };
 
 #endif // MODBUS_H
\ No newline at end of file
@@ -0,0 +1,345 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Network Variables
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+#include "netvar.h"
+#include "nodalisjson.h"
+#include <algorithm>
+#include <cstring>
+#include <random>
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #pragma comment(lib, "ws2_32.lib")
+#else
+    #include <arpa/inet.h>
+    #include <netinet/in.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+#endif
+
+/**
+ * The largest datagram sent, which fits in an Ethernet frame without fragments.
+ */
+static constexpr size_t NETVAR_DATAGRAM_BYTES = 1400;
+
+/**
+ * The milliseconds the receiver waits for a datagram before it checks whether the client is being destroyed.
+ */
+static constexpr int NETVAR_RECEIVE_WAIT = 200;
+
+/**
+ * The clients that publish, which publishNetworkVariables() sends from.
+ */
+static std::mutex NETVAR_CLIENTS_MUTEX;
+static std::vector<NetVarClient*> NETVAR_CLIENTS;
+
+/**
+ * Hashes the name of a network variable (FNV-1a), which is what a datagram carries in place of the name.
+ * @param name The name.
+ * @returns Returns the hash.
+ */
+static uint32_t nameHash(const std::string& name) {
+    uint32_t hash = 2166136261u;
+    for (unsigned char c : name) {
+        hash ^= c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Gets the number of bytes the value of an entry takes.
+ * @param width The width of the value, in bits.
+ */
+static size_t valueBytes(int width) {
+    return width == 1 ? 1 : static_cast<size_t>(width / 8);
+}
+
+static void closeSocket(int fd) {
+#ifdef _WIN32
+    closesocket(fd);
+#else
+    close(fd);
+#endif
+}
+
+NetVarClient::NetVarClient() : IOClient("NETVAR") {
+#ifdef _WIN32
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2,2), &wsa);
+#endif
+    reconnectDelay = minReconnectDelay = 1000;
+    maxReconnectDelay = 30000;
+    std::random_device random;
+    session = random();
+    datagram.reserve(NETVAR_DATAGRAM_BYTES);
+    std::lock_guard<std::mutex> lock(NETVAR_CLIENTS_MUTEX);
+    NETVAR_CLIENTS.push_back(this);
+}
+
+NetVarClient::~NetVarClient() {
+    {
+        std::lock_guard<std::mutex> lock(NETVAR_CLIENTS_MUTEX);
+        NETVAR_CLIENTS.erase(std::remove(NETVAR_CLIENTS.begin(), NETVAR_CLIENTS.end(), this), NETVAR_CLIENTS.end());
+    }
+    stop();
+    disconnect();
+}
+
+void NetVarClient::disconnect() {
+    connected = false;
+    receiving = false;
+    if (receiver.joinable()) {
+        receiver.join();
+    }
+    if (sockfd >= 0) {
+        closeSocket(sockfd);
+        sockfd = -1;
+    }
+}
+
+void NetVarClient::connect() {
+    if (connected) {
+        disconnect();
+    }
+    in_addr group{};
+    int port = std::atoi(modulePort.c_str());
+    if (inet_pton(AF_INET, moduleID.c_str(), &group) != 1 || !IN_MULTICAST(ntohl(group.s_addr)) || port <= 0 || port > 65535) {
+        nodalisLog() << "NETVAR group " << moduleID << ":" << modulePort << " isn't an IPv4 multicast group and port\n";
+        return;
+    }
+    int fd = static_cast<int>(socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+    if (fd < 0) {
+        return;
+    }
+    // Every controller on the host that uses the group binds the same port.
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&on), sizeof(on));
+#ifdef SO_REUSEPORT
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<const char*>(&on), sizeof(on));
+#endif
+    sockaddr_in local{};
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = htons(static_cast<uint16_t>(port));
+    // The interface to use can be given in the protocol properties as {"Interface": "192.168.1.10"}.
+    in_addr interfaceAddress{};
+    interfaceAddress.s_addr = htonl(INADDR_ANY);
+    if (!mappings.empty()) {
+        json properties = protocolProperties(mappings[0]);
+        if (properties.contains("Interface") && properties["Interface"].is_string()) {
+            inet_pton(AF_INET, properties["Interface"].get<std::string>().c_str(), &interfaceAddress);
+        }
+    }
+    ip_mreq membership{};
+    membership.imr_multiaddr = group;
+    membership.imr_interface = interfaceAddress;
+    if (bind(fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0 ||
+        setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, reinterpret_cast<const char*>(&membership), sizeof(membership)) != 0) {
+        nodalisLog() << "NETVAR can't join " << moduleID << ":" << modulePort << "\n";
+        closeSocket(fd);
+        return;
+    }
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, reinterpret_cast<const char*>(&interfaceAddress), sizeof(interfaceAddress));
+    // Controllers on the same host receive each other's datagrams, and the group stays on the local network.
+    unsigned char loop = 1, ttl = 1;
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, reinterpret_cast<const char*>(&loop), sizeof(loop));
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, reinterpret_cast<const char*>(&ttl), sizeof(ttl));
+#ifdef _WIN32
+    DWORD wait = NETVAR_RECEIVE_WAIT;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&wait), sizeof(wait));
+#else
+    timeval wait;
+    wait.tv_sec = 0;
+    wait.tv_usec = NETVAR_RECEIVE_WAIT * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &wait, sizeof(wait));
+#endif
+    sockfd = fd;
+    groupAddress = group.s_addr;
+    groupPort = htons(static_cast<uint16_t>(port));
+    receiving = true;
+    receiver = std::thread(&NetVarClient::receive, this);
+    nodalisLog() << "NETVAR joined " << moduleID << ":" << modulePort << "\n";
+    connected = true;
+}
+
+void NetVarClient::onMappingAdded(IOMap& map) {
+    uint32_t name = nameHash(map.remoteAddress);
+    uint64_t interval = static_cast<uint64_t>(map.interval > 0 ? map.interval : 1);
+    if (map.direction == IOType::Output) {
+        std::lock_guard<std::mutex> lock(publicationMutex);
+        map.remoteHandle = static_cast<int>(publications.size());
+        publications.push_back({ name, map.width, map.local });
+        keepalive = keepalive == 0 ? interval : std::min(keepalive, interval);
+        // The first publish sends the new publication's value.
+        nextKeepalive = 0;
+    }
+    else {
+        std::lock_guard<std::mutex> lock(subscriptionMutex);
+        map.remoteHandle = static_cast<int>(subscriptions.size());
+        subscriptions.push_back({ map.width, map.local, interval * 3 });
+        subscriptions.back().received = elapsed();
+        subscriptions.back().quality = map.quality;
+        subscriptionsByName.insert({ name, subscriptions.size() - 1 });
+    }
+}
+
+void NetVarClient::submitBatch(IOBatch& batch) {
+    uint64_t now = elapsed();
+    std::lock_guard<std::mutex> lock(subscriptionMutex);
+    for (const auto& request : batch.requests) {
+        if (request.direction != IOType::Input || request.remoteHandle < 0) {
+            continue;
+        }
+        Subscription& subscription = subscriptions[static_cast<size_t>(request.remoteHandle)];
+        if (!subscription.stale && now - subscription.received > subscription.timeout) {
+            subscription.stale = true;
+            markInputPending(subscription.local);
+            setInputQuality(subscription.quality, IOQuality::Stale);
+            nodalisLog() << "NETVAR " << mappings[request.mapping].remoteAddress << " is stale\n";
+        }
+    }
+}
+
+void NetVarClient::publish() {
+    if (!connected) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(publicationMutex);
+    if (publications.empty()) {
+        return;
+    }
+    bool changed = false;
+    readImage([&](const uint8_t* image) {
+        for (auto& publication : publications) {
+            uint64_t value = publication.local.load(image);
+            if (value != publication.value) {
+                publication.value = value;
+                changed = true;
+            }
+        }
+    });
+    uint64_t now = elapsed();
+    if (!changed && now < nextKeepalive) {
+        return;
+    }
+    nextKeepalive = now + keepalive;
+    size_t next = 0;
+    while (next < publications.size()) {
+        next = send(next);
+    }
+}
+
+size_t NetVarClient::send(size_t first) {
+    datagram.resize(sizeof(NetVarHeader));
+    size_t next = first;
+    for (; next < publications.size(); next++) {
+        const Publication& publication = publications[next];
+        size_t bytes = valueBytes(publication.width);
+        if (datagram.size() + 5 + bytes > NETVAR_DATAGRAM_BYTES) {
+            break;
+        }
+        size_t at = datagram.size();
+        datagram.resize(at + 5 + bytes);
+        std::memcpy(datagram.data() + at, &publication.name, 4);
+        datagram[at + 4] = static_cast<uint8_t>(publication.width);
+        std::memcpy(datagram.data() + at + 5, &publication.value, bytes);
+    }
+    NetVarHeader header{ NETVAR_MAGIC, NETVAR_VERSION, static_cast<uint16_t>(next - first), session, 0, ++sequence };
+    std::memcpy(datagram.data(), &header, sizeof(header));
+    sockaddr_in to{};
+    to.sin_family = AF_INET;
+    to.sin_addr.s_addr = groupAddress;
+    to.sin_port = groupPort;
+    auto start = std::chrono::steady_clock::now();
+    bool sent = sendto(sockfd, reinterpret_cast<const char*>(datagram.data()), static_cast<int>(datagram.size()), 0,
+        reinterpret_cast<sockaddr*>(&to), sizeof(to)) == static_cast<int>(datagram.size());
+    requestCompleted(sent, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count()));
+    // A publication too wide for any datagram is skipped rather than sent forever.
+    return next == first ? first + 1 : next;
+}
+
+void NetVarClient::receive() {
+    std::vector<uint8_t> buffer(65536);
+    while (receiving) {
+        int bytes = static_cast<int>(recv(sockfd, reinterpret_cast<char*>(buffer.data()), static_cast<int>(buffer.size()), 0));
+        if (bytes >= static_cast<int>(sizeof(NetVarHeader))) {
+            apply(buffer.data(), static_cast<size_t>(bytes));
+        }
+    }
+}
+
+void NetVarClient::apply(const uint8_t* data, size_t bytes) {
+    NetVarHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != NETVAR_MAGIC || header.version != NETVAR_VERSION || header.session == session) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(subscriptionMutex);
+    if (subscriptions.empty()) {
+        return;
+    }
+    uint64_t& last = lastSequence[header.session];
+    if (header.sequence <= last) {
+        // Late or repeated.
+        return;
+    }
+    // The datagrams that were lost count as failed requests, next to the datagrams sent.
+    for (uint64_t lost = last + 1; last != 0 && lost < header.sequence; lost++) {
+        requestCompleted(false, 0);
+    }
+    last = header.sequence;
+    uint64_t now = elapsed();
+    size_t at = sizeof(NetVarHeader);
+    for (uint16_t entry = 0; entry < header.count; entry++) {
+        if (at + 5 > bytes) {
+            break;
+        }
+        uint32_t name;
+        std::memcpy(&name, data + at, 4);
+        int width = data[at + 4];
+        size_t size = valueBytes(width);
+        if (size == 0 || size > 8 || at + 5 + size > bytes) {
+            break;
+        }
+        uint64_t value = 0;
+        std::memcpy(&value, data + at + 5, size);
+        at += 5 + size;
+        auto range = subscriptionsByName.equal_range(name);
+        for (auto it = range.first; it != range.second; ++it) {
+            Subscription& subscription = subscriptions[it->second];
+            if (subscription.width != width) {
+                continue;
+            }
+            writeImage(subscription.local, value);
+            setInputQuality(subscription.quality, IOQuality::Good);
+            subscription.received = now;
+            subscription.stale = false;
+        }
+    }
+}
+
+void publishNetworkVariables() {
+    std::lock_guard<std::mutex> lock(NETVAR_CLIENTS_MUTEX);
+    for (NetVarClient* client : NETVAR_CLIENTS) {
+        client->publish();
+    }
+}
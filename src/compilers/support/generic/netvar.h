@@ -0,0 +1,167 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Network Variables
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * Network variables are values that controllers exchange with each other over UDP multicast, without a server in
+ * between. They are mapped like any other IO, with the protocol NETVAR: the ModuleID is the multicast group, the
+ * ModulePort the UDP port, and the RemoteAddress the name of the variable. A %Q mapping publishes the value at its
+ * local address under that name, and a %I mapping subscribes to the value of that name and writes it to its local
+ * address.
+ *
+ * The publications of a group are sent together in one datagram right after the scan that changed one of them, and
+ * again every PollTime milliseconds when nothing changed. A value received is latched at the start of the next scan,
+ * so a value crosses from one controller to another in a scan plus the time on the wire. A subscription that hasn't
+ * been received for three times its PollTime is stale, and is reported as bad by isInputGood() until it is received
+ * again.
+ *
+ * A datagram is a NetVarHeader followed by its entries, each the hash of the name (uint32_t), the width (uint8_t) and
+ * the value, in a byte for a bit and in width / 8 bytes otherwise. Values are sent in the byte order of the
+ * controllers. Each sender counts its datagrams from a random session, so that a receiver drops the datagrams that
+ * arrive late or twice, and counts the ones that were lost as errors.
+ */
+#pragma once
+#ifndef NETVAR_H
+#define NETVAR_H
+
+#include "nodalis.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * The header of a network variable datagram.
+ */
+struct NetVarHeader {
+    uint32_t magic;         // NETVAR_MAGIC.
+    uint16_t version;       // NETVAR_VERSION.
+    uint16_t count;         // The number of entries.
+    uint32_t session;       // Chosen by the sender when it starts.
+    uint32_t reserved;
+    uint64_t sequence;      // Counts the sender's datagrams in the session, from 1.
+};
+
+constexpr uint32_t NETVAR_MAGIC = 0x564e444e;   // "NDNV"
+constexpr uint16_t NETVAR_VERSION = 1;
+
+/**
+ * Publishes and subscribes to the network variables of one multicast group and port.
+ */
+class NetVarClient : public IOClient {
+public:
+    NetVarClient();
+    ~NetVarClient();
+    /**
+     * Sends the publications if one of them changed in the last scan or the keepalive is due. Called on the scan
+     * thread by publishNetworkVariables().
+     */
+    void publish();
+
+protected:
+    /**
+     * Opens the socket, joins the group and starts the thread that receives the subscriptions.
+     */
+    void connect() override;
+    /**
+     * Adds an output mapping to the publications and an input mapping to the subscriptions.
+     * @param map The mapping.
+     */
+    void onMappingAdded(IOMap& map) override;
+    /**
+     * Marks the due subscriptions that haven't been received for three times their PollTime as stale. The
+     * publications are sent by publish() instead.
+     * @param batch The requests of the mappings that are due.
+     */
+    void submitBatch(IOBatch& batch) override;
+
+private:
+    /**
+     * A value this controller publishes.
+     */
+    struct Publication {
+        uint32_t name;          // The hash of the name.
+        int width;
+        ResolvedAddress local;
+        uint64_t value = 0;     // The value last sent.
+    };
+    /**
+     * A value this controller subscribes to.
+     */
+    struct Subscription {
+        int width;
+        ResolvedAddress local;
+        uint64_t timeout;       // The milliseconds after which the value is stale.
+        uint64_t received = 0;  // When the value was last received, in milliseconds since the program started.
+        bool stale = false;
+        uint32_t quality = NO_QUALITY_SLOT;
+    };
+    int sockfd = -1;
+    uint32_t groupAddress = 0;  // The IPv4 group, in network byte order.
+    uint16_t groupPort = 0;
+    uint32_t session;
+    uint64_t sequence = 0;
+    /**
+     * Guards the publications, which are added from the main thread and sent from the scan thread.
+     */
+    std::mutex publicationMutex;
+    std::vector<Publication> publications;
+    /**
+     * The milliseconds between datagrams when nothing changes: the shortest PollTime of the publications.
+     */
+    uint64_t keepalive = 0;
+    uint64_t nextKeepalive = 0;
+    std::vector<uint8_t> datagram;
+    /**
+     * Guards the subscriptions, which are added from the main thread, written by the receiver and checked by poll().
+     */
+    std::mutex subscriptionMutex;
+    std::vector<Subscription> subscriptions;
+    std::unordered_multimap<uint32_t, size_t> subscriptionsByName;
+    /**
+     * The last sequence received from each session.
+     */
+    std::unordered_map<uint32_t, uint64_t> lastSequence;
+    std::thread receiver;
+    std::atomic<bool> receiving{false};
+
+    /**
+     * Receives datagrams until the client is destroyed.
+     */
+    void receive();
+    /**
+     * Writes the entries of a datagram that this controller subscribes to.
+     * @param data The datagram.
+     * @param bytes The size of the datagram.
+     */
+    void apply(const uint8_t* data, size_t bytes);
+    /**
+     * Sends the entries of the publications from first, as many as fit in a datagram.
+     * @returns Returns the index of the first publication that wasn't sent.
+     */
+    size_t send(size_t first);
+    void disconnect();
+};
+
+/**
+ * Sends the network variables that changed in the scan that ended. Called by the scheduler after each scan.
+ */
+void publishNetworkVariables();
+
+#endif // NETVAR_H
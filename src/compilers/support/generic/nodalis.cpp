@@ -19,486 +19,5933 @@
  * @copyright Apache 2.0
  */
 #include "nodalis.h"
-#include <iostream>
+#include "nodalisjson.h"
 #include <map>
+#include <mutex>
+#include <cstring>
+#include <thread>
+#include <deque>
+#include <unordered_map>
+#include <ctime>
+#include <condition_variable>
+#include <cstdlib>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <csignal>
+#include <new>
+#include <cstddef>
+#if NODALIS_ALLOC_TRACK && (defined(__GLIBC__) || defined(__APPLE__))
+#include <execinfo.h>
+#endif
+#if !defined(NODALIS_SCALAR_KERNELS) && defined(__AVX2__)
+#define NODALIS_KERNEL_AVX2 1
+#include <immintrin.h>
+#elif !defined(NODALIS_SCALAR_KERNELS) && (defined(__SSE2__) || defined(_M_X64))
+#define NODALIS_KERNEL_SSE2 1
+#include <emmintrin.h>
+#elif !defined(NODALIS_SCALAR_KERNELS) && (defined(__ARM_NEON) || defined(_M_ARM64))
+#define NODALIS_KERNEL_NEON 1
+#include <arm_neon.h>
+#endif
+#if NODALIS_MODBUS
 #include "modbus.h"
+#endif
+#if NODALIS_OPCUA
 #include "opcua.h"
+#endif
+#if NODALIS_BACNET
 #include "bacnet.h"
+#else
+#define BACNET_MAX_INSTANCE 0x3FFFFF
+#endif
+#include "netvar.h"
+#include "localio.h"
+#include "enip.h"
+#include "ioreactor.h"
+#include "metrics.h"
+#include "ioscheduler.h"
+#include "redundancy.h"
+#include "recorder.h"
+#include "iocapture.h"
+#include "iodriver.h"
+#include "clocksync.h"
+#include "simulation.h"
+#include "historian.h"
+#include "alarms.h"
+#include "timedio.h"
+#include "sparkplug.h"
+#include "watch.h"
+#include "sharedimage.h"
+#include "symbolindex.h"
+#include "ioconfig.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <syslog.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <alloca.h>
+#include <malloc.h>
+#endif
+#endif
 
 uint64_t PROGRAM_COUNT = 0;
-uint64_t MEMORY[64][16] = { 0 };
+alignas(IMAGE_LINE_BYTES) uint64_t MEMORY[PROCESS_IMAGE_BYTES / sizeof(uint64_t)] = { 0 };
+uint64_t DIRTY_LINES[IMAGE_LINE_WORDS] = { 0 };
+IncrementalScan INCREMENTAL;
+uint64_t LINE_EPOCHS[IMAGE_LINES] = { 0 };
 
 std::chrono::steady_clock::time_point PROGRAM_START = std::chrono::steady_clock::now();
+std::atomic<uint64_t> SIMULATED_MICROS{SIMULATED_CLOCK_OFF};
 uint64_t elapsed() {
+    uint64_t simulated = SIMULATED_MICROS.load(std::memory_order_relaxed);
+    if(simulated != SIMULATED_CLOCK_OFF){
+        return simulated / 1000;
+    }
     return std::chrono::duration_cast<std::chrono::milliseconds>(
         std::chrono::steady_clock::now() - PROGRAM_START
     ).count();
 }
 
-uint64_t readLWord(std::string address)
-{
-    std::vector<int> parts = parseAddress(address);
-    int space = parts[0], width = parts[1], index = parts[2], bit = parts[3];
+uint64_t elapsedMicros() {
+    uint64_t simulated = SIMULATED_MICROS.load(std::memory_order_relaxed);
+    if(simulated != SIMULATED_CLOCK_OFF){
+        return simulated;
+    }
+    return microsBetween(PROGRAM_START, std::chrono::steady_clock::now());
+}
 
-    if (width != 64)
-    {
-        throw std::invalid_argument("Invalid address type: " + address);
+void latchScanTime(std::chrono::steady_clock::time_point now){
+    SCAN_MICROS = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - PROGRAM_START).count());
+    timerWheel().advance(SCAN_MICROS / 1000);
+}
+
+TimerWheel& timerWheel(){
+    static thread_local TimerWheel wheel;
+    return wheel;
+}
+
+TimerNode::~TimerNode(){
+    if(wheel != nullptr){
+        wheel->cancel(*this);
     }
-    if (space == -1)
-    {
-        throw std::invalid_argument("Invalid address space: " + address);
+}
+
+TimerNode& TimerNode::operator=(const TimerNode& other){
+    if(this != &other){
+        if(wheel != nullptr){
+            wheel->cancel(*this);
+        }
+        expired = other.expired;
+        expiry = other.expiry;
     }
-    if (index == -1)
-    {
-        throw std::invalid_argument("Invalid address index: " + address);
+    return *this;
+}
+
+TimerWheel::~TimerWheel(){
+    // Timers can outlive the wheel of the thread that scheduled them, so they are left idle rather than dangling.
+    for(auto& level : slots){
+        for(auto* head : level){
+            while(head != nullptr){
+                TimerNode* next = head->next;
+                head->next = head->prev = nullptr;
+                head->slot = nullptr;
+                head->wheel = nullptr;
+                head = next;
+            }
+        }
     }
-    if (bit > -1)
-    {
-        throw std::invalid_argument("Invalid address format. Reference specifies a bit: " + address);
+}
+
+void TimerWheel::unlink(TimerNode& node){
+    if(node.prev != nullptr){
+        node.prev->next = node.next;
+    }
+    else{
+        *node.slot = node.next;
+    }
+    if(node.next != nullptr){
+        node.next->prev = node.prev;
+    }
+    node.next = node.prev = nullptr;
+    node.slot = nullptr;
+}
+
+void TimerWheel::insert(TimerNode& node){
+    uint64_t delta = node.expiry - current;
+    int level = 0;
+    while(level < LEVELS - 1 && delta >= (SLOTS << (level * SLOT_BITS))){
+        level++;
+    }
+    // Timers beyond the reach of the wheel wait in the last slot of the top level and are placed again from there.
+    uint64_t at = level == LEVELS - 1 && delta >= (1ull << (LEVELS * SLOT_BITS)) ? current + (1ull << (LEVELS * SLOT_BITS)) - 1 : node.expiry;
+    TimerNode*& head = slots[level][(at >> (level * SLOT_BITS)) & (SLOTS - 1)];
+    node.prev = nullptr;
+    node.next = head;
+    if(head != nullptr){
+        head->prev = &node;
+    }
+    head = &node;
+    node.slot = &head;
+    node.wheel = this;
+}
+
+void TimerWheel::schedule(TimerNode& node, uint64_t expiry){
+    if(node.wheel != nullptr){
+        cancel(node);
+    }
+    if(count == 0 && current < SCAN_MICROS / 1000){
+        // An empty wheel has nothing to walk through, so it jumps straight to the scan time.
+        current = SCAN_MICROS / 1000;
+    }
+    node.expiry = expiry;
+    node.expired = expiry <= current;
+    if(node.expired){
+        return;
+    }
+    insert(node);
+    count++;
+}
+
+void TimerWheel::cancel(TimerNode& node){
+    if(node.wheel == this){
+        unlink(node);
+        node.wheel = nullptr;
+        count--;
+    }
+    node.expired = false;
+}
+
+void TimerWheel::cascade(int level){
+    int index = static_cast<int>((current >> (level * SLOT_BITS)) & (SLOTS - 1));
+    if(index == 0 && level < LEVELS - 1){
+        cascade(level + 1);
+    }
+    TimerNode* node = slots[level][index];
+    slots[level][index] = nullptr;
+    while(node != nullptr){
+        TimerNode* next = node->next;
+        insert(*node);
+        node = next;
+    }
+}
+
+void TimerWheel::advance(uint64_t now){
+    while(current < now){
+        if(count == 0){
+            current = now;
+            return;
+        }
+        current++;
+        if((current & (SLOTS - 1)) == 0){
+            cascade(1);
+        }
+        TimerNode* node = slots[0][current & (SLOTS - 1)];
+        slots[0][current & (SLOTS - 1)] = nullptr;
+        while(node != nullptr){
+            TimerNode* next = node->next;
+            node->next = node->prev = nullptr;
+            node->slot = nullptr;
+            node->wheel = nullptr;
+            node->expired = true;
+            count--;
+            node = next;
+        }
+    }
+}
+
+AddressStatus tryResolveAddress(const std::string& address, int width, bool isBit, ResolvedAddress& resolved) noexcept{
+    ResolvedAddress ret;
+    if(!tryParseAddress(address, ret.space, ret.width, ret.index, ret.bit)){
+        return AddressStatus::INVALID_FORMAT;
+    }
+    if(!isBit && width != -1 && ret.width != width){
+        return AddressStatus::INVALID_TYPE;
+    }
+    if(isBit != (ret.bit > -1)){
+        return AddressStatus::INVALID_BIT;
+    }
+
+    int offset = ret.bit > -1 ? memoryOffset(ret.space, static_cast<long long>(ret.index) << widthShift(ret.width))
+                              : addressOffset(ret.space, ret.width, ret.index);
+    if(offset < 0){
+        return AddressStatus::INVALID_INDEX;
+    }
+    ret.offset = static_cast<size_t>(offset);
+    if(ret.bit > -1){
+        int bit = bitOffset(ret.space, ret.width, ret.index, ret.bit);
+        if(bit < 0){
+            return AddressStatus::INVALID_BIT;
+        }
+        ret.bitOffset = static_cast<size_t>(bit);
+        ret.bitMask = static_cast<uint8_t>(1 << (ret.bit % 8));
+    }
+    resolved = ret;
+    return AddressStatus::OK;
+}
+
+ResolvedAddress resolveAddress(const std::string& address, int width, bool isBit){
+    ResolvedAddress ret;
+    AddressStatus status = tryResolveAddress(address, width, isBit, ret);
+    if(status == AddressStatus::INVALID_BIT && !isBit){
+        NODALIS_THROW(std::invalid_argument("Invalid address format. Reference specifies a bit: " + address));
+    }
+    if(status != AddressStatus::OK){
+        NODALIS_THROW(std::invalid_argument(std::string(addressStatusText(status)) + ": " + address));
+    }
+    return ret;
+}
+
+AddressStatus tryRead(const std::string& address, uint64_t& value) noexcept{
+    ResolvedAddress resolved;
+    AddressStatus status = tryResolveAddress(address, -1, address.find('.') != std::string::npos, resolved);
+    if(status == AddressStatus::OK){
+        value = resolved.load(reinterpret_cast<const uint8_t*>(TASK_IMAGE));
+    }
+    return status;
+}
+
+AddressStatus tryWrite(const std::string& address, uint64_t value) noexcept{
+    ResolvedAddress resolved;
+    AddressStatus status = tryResolveAddress(address, -1, address.find('.') != std::string::npos, resolved);
+    if(status != AddressStatus::OK){
+        return status;
     }
-    return *getMemoryLWord(space, index);
+    resolved.store(value);
+    return AddressStatus::OK;
+}
+
+uint64_t readLWord(std::string address)
+{
+    return *reinterpret_cast<uint64_t*>(resolveAddress(address, 64, false).data());
 }
 
 uint32_t readDWord(std::string address){
-   std::vector<int> parts = parseAddress(address);
-   int space = parts[0], width = parts[1], index = parts[2], bit = parts[3];
-   
-   if(width != 32){
-    throw std::invalid_argument("Invalid address type: " + address);
-   }
-   if(space == -1){
-    throw std::invalid_argument("Invalid address space: " + address);
-   }
-   if(index == -1){
-    throw std::invalid_argument("Invalid address index: " + address);
-   }
-   if(bit > -1){
-    throw std::invalid_argument("Invalid address format. Reference specifies a bit: " + address);
-   }
-   return *getMemoryDWord(space, index);
+    return *reinterpret_cast<uint32_t*>(resolveAddress(address, 32, false).data());
 }
 uint16_t readWord(std::string address){
-    std::vector<int> parts = parseAddress(address);
-   int space = parts[0], width = parts[1], index = parts[2], bit = parts[3];
-   
-   if(width != 16){
-    throw std::invalid_argument("Invalid address type: " + address);
-   }
-   if(space == -1){
-    throw std::invalid_argument("Invalid address space: " + address);
-   }
-   if(index == -1){
-    throw std::invalid_argument("Invalid address index: " + address);
-   }
-   if(bit > -1){
-    throw std::invalid_argument("Invalid address format. Reference specifies a bit: " + address);
-   }
-   return *getMemoryWord(space, index);
+    return *reinterpret_cast<uint16_t*>(resolveAddress(address, 16, false).data());
 }
 uint8_t readByte(std::string address){
-    std::vector<int> parts = parseAddress(address);
-   int space = parts[0], width = parts[1], index = parts[2], bit = parts[3];
-   
-   if(width != 8){
-    throw std::invalid_argument("Invalid address type: " + address);
-   }
-   if(space == -1){
-    throw std::invalid_argument("Invalid address space: " + address);
-   }
-   if(index == -1){
-    throw std::invalid_argument("Invalid address index: " + address);
-   }
-   if(bit > -1){
-    throw std::invalid_argument("Invalid address format. Reference specifies a bit: " + address);
-   }
-   return *getMemoryByte(space, index);
+    return *resolveAddress(address, 8, false).data();
 }
 bool readBit(std::string address){
-    std::vector<int> parts = parseAddress(address);
-   int space = parts[0], width = parts[1], index = parts[2], bit = parts[3];
-   
-   uint32_t val = 0;
-   if(space == -1){
-    throw std::invalid_argument("Invalid address space: " + address);
-   }
-   if(index == -1){
-    throw std::invalid_argument("Invalid address index: " + address);
-   }
-   if(bit == -1)
-   {
-    throw std::invalid_argument("Invalid address bit: " + address);
-   }
-   if(width == -1){
-    throw std::invalid_argument("Invalid address size: " + address);
-   }
-   bool ret = false;
-   switch(width){
-    case 8:
-        ret = getBit(getMemoryByte(space, index), bit);
-        break;
-    case 16:
-        ret = getBit(getMemoryWord(space, index), bit);
-        break;
-    case 32:
-        ret = getBit(getMemoryDWord(space, index), bit);
-        break;
-    case 64:
-        ret = getBit(getMemoryLWord(space, index), bit);
-        break;
-    }
-   return ret;
+    return resolveAddress(address, -1, true).getBit();
 }
 
 void writeLWord(std::string address, uint64_t value)
 {
-    std::vector<int> parts = parseAddress(address);
-    int space = parts[0], width = parts[1], index = parts[2], bit = parts[3];
-
-    if (width != 64)
-    {
-        throw std::invalid_argument("Invalid address type: " + address);
-    }
-    if (space == -1)
-    {
-        throw std::invalid_argument("Invalid address space: " + address);
-    }
-    if (index == -1)
-    {
-        throw std::invalid_argument("Invalid address index: " + address);
-    }
-    if (bit > -1)
-    {
-        throw std::invalid_argument("Invalid address format. Reference specifies a bit: " + address);
-    }
-    uint64_t *temp = getMemoryLWord(space, index);
-    *temp = value;
+    resolveAddress(address, 64, false).store(value);
 }
 
 void writeDWord(std::string address, uint32_t value){
-    std::vector<int> parts = parseAddress(address);
-   int space = parts[0], width = parts[1], index = parts[2], bit = parts[3];
-   
-   if(width != 32){
-    throw std::invalid_argument("Invalid address type: " + address);
-   }
-   if(space == -1){
-    throw std::invalid_argument("Invalid address space: " + address);
-   }
-   if(index == -1){
-    throw std::invalid_argument("Invalid address index: " + address);
-   }
-   if(bit > -1){
-    throw std::invalid_argument("Invalid address format. Reference specifies a bit: " + address);
-   }
-   uint32_t* temp = getMemoryDWord(space, index);
-   *temp = value;
+    resolveAddress(address, 32, false).store(value);
 }
 void writeWord(std::string address, uint16_t value){
-    std::vector<int> parts = parseAddress(address);
-   int space = parts[0], width = parts[1], index = parts[2], bit = parts[3];
-   
-   if(width != 16){
-    throw std::invalid_argument("Invalid address type: " + address);
-   }
-   if(space == -1){
-    throw std::invalid_argument("Invalid address space: " + address);
-   }
-   if(index == -1){
-    throw std::invalid_argument("Invalid address index: " + address);
-   }
-   if(bit > -1){
-    throw std::invalid_argument("Invalid address format. Reference specifies a bit: " + address);
-   }
-   uint16_t* temp = getMemoryWord(space, index);
-   *temp = value;
+    resolveAddress(address, 16, false).store(value);
 }
 void writeByte(std::string address, uint8_t value){
-    std::vector<int> parts = parseAddress(address);
-   int space = parts[0], width = parts[1], index = parts[2], bit = parts[3];
-   
-   if(width != 8){
-    throw std::invalid_argument("Invalid address type: " + address);
-   }
-   if(space == -1){
-    throw std::invalid_argument("Invalid address space: " + address);
-   }
-   if(index == -1){
-    throw std::invalid_argument("Invalid address index: " + address);
-   }
-   if(bit > -1){
-    throw std::invalid_argument("Invalid address format. Reference specifies a bit: " + address);
-   }
-   uint8_t* temp = getMemoryByte(space, index);
-   *temp = value;
+    resolveAddress(address, 8, false).store(value);
 }
 void writeBit(std::string address, bool value){
-    std::vector<int> parts = parseAddress(address);
-   int space = parts[0], width = parts[1], index = parts[2], bit = parts[3];
-   
-   if(space == -1){
-    throw std::invalid_argument("Invalid address space: " + address);
-   }
-   if(index == -1){
-    throw std::invalid_argument("Invalid address index: " + address);
-   }
-   
-   if(bit == -1)
-   {
-    throw std::invalid_argument("Invalid address bit: " + address);
-   }
-   if(width == -1){
-    throw std::invalid_argument("Invalid address size: " + address);
-   }
-   switch(width){
-    case 8:
-        setBit(getMemoryByte(space, index), bit, value);
-        break;
-    case 16:
-        setBit(getMemoryWord(space, index), bit, value);
-        break;
-    case 32:
-        setBit(getMemoryDWord(space, index), bit, value);
-        break;
-    case 64:
-        setBit(getMemoryLWord(space, index), bit, value);
-        break;
-    }
-}
-bool getBit(void* var, int bit) {
-    // Advance to the byte containing the bit
-    uint8_t* bytePtr = static_cast<uint8_t*>(var) + (bit / 8);
-
-    // Mask out the bit within the byte
-    uint8_t mask = 1 << (bit % 8);
-
-    // Return true if the bit is set
-    return (*bytePtr & mask) != 0;
-}
-
-void setBit(void* var, int bit, bool value) {
-    uint8_t* bytePtr = static_cast<uint8_t*>(var) + (bit / 8);
-    uint8_t mask = 1 << (bit % 8);
-
-    if (value) {
-        *bytePtr |= mask;  // Set the bit
-    } else {
-        *bytePtr &= ~mask; // Clear the bit
+    resolveAddress(address, -1, true).setBit(value);
+}
+
+#pragma region "Image Kernels"
+/**
+ * The kernels that compare, copy and merge whole images work a cache line (8 words) at a time. The instruction set
+ * is picked from what the target's compiler enables: SSE2 on x64, NEON on arm64 (and 32 bit ARM built with NEON),
+ * AVX2 when the compiler is told it may use it, and plain 64 bit words otherwise or with NODALIS_SCALAR_KERNELS.
+ * The images are line aligned, but unaligned loads are used so the kernels work on any buffer.
+ */
+static constexpr size_t LINE_WORDS = IMAGE_LINE_BYTES / sizeof(uint64_t);
+static_assert(LINE_WORDS == 8, "The image kernels work on 64 byte lines");
+
+/**
+ * Determines whether two lines differ.
+ */
+static inline bool lineDiffers(const uint64_t* a, const uint64_t* b){
+#if defined(NODALIS_KERNEL_AVX2)
+    __m256i x0 = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b)));
+    __m256i x1 = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + 4)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + 4)));
+    __m256i x = _mm256_or_si256(x0, x1);
+    return !_mm256_testz_si256(x, x);
+#elif defined(NODALIS_KERNEL_SSE2)
+    __m128i x = _mm_setzero_si128();
+    for(size_t i = 0; i < LINE_WORDS; i += 2){
+        x = _mm_or_si128(x, _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+                                          _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i))));
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_setzero_si128())) != 0xFFFF;
+#elif defined(NODALIS_KERNEL_NEON)
+    uint64x2_t x = vdupq_n_u64(0);
+    for(size_t i = 0; i < LINE_WORDS; i += 2){
+        x = vorrq_u64(x, veorq_u64(vld1q_u64(a + i), vld1q_u64(b + i)));
+    }
+    return (vgetq_lane_u64(x, 0) | vgetq_lane_u64(x, 1)) != 0;
+#else
+    uint64_t x = 0;
+    for(size_t i = 0; i < LINE_WORDS; i++){
+        x |= a[i] ^ b[i];
     }
+    return x != 0;
+#endif
 }
 
-std::vector<std::unique_ptr<IOClient>> Clients;
+/**
+ * Replaces the bits of a line selected by a mask: dst = (dst & ~mask) | (values & mask).
+ * @returns Returns true if the line changed.
+ */
+static inline bool blendLine(uint64_t* dst, const uint64_t* values, const uint64_t* mask){
+#if defined(NODALIS_KERNEL_AVX2)
+    bool changed = false;
+    for(size_t i = 0; i < LINE_WORDS; i += 4){
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        __m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(mask + i));
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+        __m256i r = _mm256_or_si256(_mm256_andnot_si256(m, d), _mm256_and_si256(v, m));
+        __m256i x = _mm256_xor_si256(r, d);
+        changed |= !_mm256_testz_si256(x, x);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), r);
+    }
+    return changed;
+#elif defined(NODALIS_KERNEL_SSE2)
+    __m128i x = _mm_setzero_si128();
+    for(size_t i = 0; i < LINE_WORDS; i += 2){
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask + i));
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+        __m128i r = _mm_or_si128(_mm_andnot_si128(m, d), _mm_and_si128(v, m));
+        x = _mm_or_si128(x, _mm_xor_si128(r, d));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), r);
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_setzero_si128())) != 0xFFFF;
+#elif defined(NODALIS_KERNEL_NEON)
+    uint64x2_t x = vdupq_n_u64(0);
+    for(size_t i = 0; i < LINE_WORDS; i += 2){
+        uint64x2_t d = vld1q_u64(dst + i);
+        uint64x2_t r = vbslq_u64(vld1q_u64(mask + i), vld1q_u64(values + i), d);
+        x = vorrq_u64(x, veorq_u64(r, d));
+        vst1q_u64(dst + i, r);
+    }
+    return (vgetq_lane_u64(x, 0) | vgetq_lane_u64(x, 1)) != 0;
+#else
+    uint64_t x = 0;
+    for(size_t i = 0; i < LINE_WORDS; i++){
+        uint64_t r = (dst[i] & ~mask[i]) | (values[i] & mask[i]);
+        x |= r ^ dst[i];
+        dst[i] = r;
+    }
+    return x != 0;
+#endif
+}
 
-IOMap::IOMap(std::string mapJson){
-    json j = json::parse(mapJson);
-    moduleID = j["ModuleID"];
-    modulePort = j["ModulePort"];
-    localAddress = j["InternalAddress"];
-    remoteAddress = j["RemoteAddress"];
-    width = std::atoi(j["RemoteSize"].get<std::string>().c_str());
-    interval = std::atoi(j["PollTime"].get<std::string>().c_str());
-    protocol = j["Protocol"];
-    additionalProperties = j["ProtocolProperties"];
-    if(localAddress.find("%Q") != std::string::npos){
-        direction = IOType::Output;
+/**
+ * Merges the bits that changed between two versions of a line into a third: the bits where changed and original
+ * differ are taken from changed.
+ * @returns Returns true if any bits differed.
+ */
+static inline bool mergeLine(uint64_t* shared, const uint64_t* changed, const uint64_t* original){
+    if(!lineDiffers(changed, original)){
+        return false;
     }
-    else{
-        direction = IOType::Input;
+    uint64_t diff[LINE_WORDS];
+    for(size_t i = 0; i < LINE_WORDS; i++){
+        diff[i] = changed[i] ^ original[i];
     }
-    lastPoll = elapsed();
+    blendLine(shared, changed, diff);
+    return true;
 }
 
-IOMap::IOMap(){
+void diffImages(const ProcessImage a, const ProcessImage b, uint64_t* lines){
+    std::memset(lines, 0, IMAGE_LINE_WORDS * sizeof(uint64_t));
+    for(size_t line = 0; line < IMAGE_LINES; line++){
+        if(lineDiffers(a + line * LINE_WORDS, b + line * LINE_WORDS)){
+            lines[line >> 6] |= 1ull << (line & 63);
+        }
+    }
+}
 
+void copyChangedLines(ProcessImage dst, const ProcessImage src, uint64_t* lines){
+    if(lines != nullptr){
+        std::memset(lines, 0, IMAGE_LINE_WORDS * sizeof(uint64_t));
+    }
+    for(size_t line = 0; line < IMAGE_LINES; line++){
+        uint64_t* to = dst + line * LINE_WORDS;
+        const uint64_t* from = src + line * LINE_WORDS;
+        if(lineDiffers(to, from)){
+            std::memcpy(to, from, IMAGE_LINE_BYTES);
+            if(lines != nullptr){
+                lines[line >> 6] |= 1ull << (line & 63);
+            }
+        }
+    }
 }
+#pragma endregion
 
-IOClient::IOClient(const std::string& protocol) : protocol(protocol) {
-    connected = false;
+#pragma region "Controllers"
+/**
+ * The vector operations advancePIDLoops() is written in, on the instruction set of the image kernels. NEON has no
+ * vector division on 32 bit ARM, which advances its loops one by one.
+ */
+#if defined(NODALIS_KERNEL_AVX2)
+#define NODALIS_PID_VECTORS 1
+typedef __m256 PIDVector;
+typedef __m256 PIDMask;
+static constexpr size_t PID_LANES = 8;
+static inline PIDVector pidLoad(const float* p){ return _mm256_loadu_ps(p); }
+static inline void pidStore(float* p, PIDVector v){ _mm256_storeu_ps(p, v); }
+static inline PIDVector pidSplat(float v){ return _mm256_set1_ps(v); }
+static inline PIDVector pidAdd(PIDVector a, PIDVector b){ return _mm256_add_ps(a, b); }
+static inline PIDVector pidSub(PIDVector a, PIDVector b){ return _mm256_sub_ps(a, b); }
+static inline PIDVector pidMul(PIDVector a, PIDVector b){ return _mm256_mul_ps(a, b); }
+static inline PIDVector pidDiv(PIDVector a, PIDVector b){ return _mm256_div_ps(a, b); }
+static inline PIDMask pidGreater(PIDVector a, PIDVector b){ return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+static inline PIDMask pidNotEqual(PIDVector a, PIDVector b){ return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); }
+static inline PIDMask pidAnd(PIDMask a, PIDMask b){ return _mm256_and_ps(a, b); }
+static inline PIDVector pidSelect(PIDMask m, PIDVector a, PIDVector b){ return _mm256_blendv_ps(b, a, m); }
+static inline uint64_t pidBits(PIDMask m){ return static_cast<uint64_t>(_mm256_movemask_ps(m)); }
+#elif defined(NODALIS_KERNEL_SSE2)
+#define NODALIS_PID_VECTORS 1
+typedef __m128 PIDVector;
+typedef __m128 PIDMask;
+static constexpr size_t PID_LANES = 4;
+static inline PIDVector pidLoad(const float* p){ return _mm_loadu_ps(p); }
+static inline void pidStore(float* p, PIDVector v){ _mm_storeu_ps(p, v); }
+static inline PIDVector pidSplat(float v){ return _mm_set1_ps(v); }
+static inline PIDVector pidAdd(PIDVector a, PIDVector b){ return _mm_add_ps(a, b); }
+static inline PIDVector pidSub(PIDVector a, PIDVector b){ return _mm_sub_ps(a, b); }
+static inline PIDVector pidMul(PIDVector a, PIDVector b){ return _mm_mul_ps(a, b); }
+static inline PIDVector pidDiv(PIDVector a, PIDVector b){ return _mm_div_ps(a, b); }
+static inline PIDMask pidGreater(PIDVector a, PIDVector b){ return _mm_cmpgt_ps(a, b); }
+static inline PIDMask pidNotEqual(PIDVector a, PIDVector b){ return _mm_cmpneq_ps(a, b); }
+static inline PIDMask pidAnd(PIDMask a, PIDMask b){ return _mm_and_ps(a, b); }
+static inline PIDVector pidSelect(PIDMask m, PIDVector a, PIDVector b){ return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+static inline uint64_t pidBits(PIDMask m){ return static_cast<uint64_t>(_mm_movemask_ps(m)); }
+#elif defined(NODALIS_KERNEL_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+#define NODALIS_PID_VECTORS 1
+typedef float32x4_t PIDVector;
+typedef uint32x4_t PIDMask;
+static constexpr size_t PID_LANES = 4;
+static inline PIDVector pidLoad(const float* p){ return vld1q_f32(p); }
+static inline void pidStore(float* p, PIDVector v){ vst1q_f32(p, v); }
+static inline PIDVector pidSplat(float v){ return vdupq_n_f32(v); }
+static inline PIDVector pidAdd(PIDVector a, PIDVector b){ return vaddq_f32(a, b); }
+static inline PIDVector pidSub(PIDVector a, PIDVector b){ return vsubq_f32(a, b); }
+static inline PIDVector pidMul(PIDVector a, PIDVector b){ return vmulq_f32(a, b); }
+static inline PIDVector pidDiv(PIDVector a, PIDVector b){ return vdivq_f32(a, b); }
+static inline PIDMask pidGreater(PIDVector a, PIDVector b){ return vcgtq_f32(a, b); }
+static inline PIDMask pidNotEqual(PIDVector a, PIDVector b){ return vmvnq_u32(vceqq_f32(a, b)); }
+static inline PIDMask pidAnd(PIDMask a, PIDMask b){ return vandq_u32(a, b); }
+static inline PIDVector pidSelect(PIDMask m, PIDVector a, PIDVector b){ return vbslq_f32(m, a, b); }
+static inline uint64_t pidBits(PIDMask m){
+    uint32x4_t bits = vshrq_n_u32(m, 31);
+    return vgetq_lane_u32(bits, 0) | (vgetq_lane_u32(bits, 1) << 1) | (vgetq_lane_u32(bits, 2) << 2) | (vgetq_lane_u32(bits, 3) << 3);
 }
+#endif
 
-void IOClient::addMapping(const IOMap& map) {
-    if(!hasMapping(map.localAddress)){
-        if(mappings.size() == 0){
-            moduleID = map.moduleID;
+uint64_t advancePIDLoops(const PIDLoops& loops, size_t first, size_t count, float dt){
+    uint64_t limited = 0;
+    size_t lane = 0;
+#if defined(NODALIS_PID_VECTORS)
+    // The same arithmetic as pidStep(), with both sides of each of its conditions computed and selected from.
+    const PIDVector zero = pidSplat(0.0f);
+    const PIDVector one = pidSplat(1.0f);
+    const PIDVector step = pidSplat(dt);
+    const PIDVector rate = pidSplat(dt > 0 ? dt : 1.0f);
+    for(; lane + PID_LANES <= count; lane += PID_LANES){
+        size_t i = first + lane;
+        PIDVector actual = pidLoad(loops.actual + i);
+        PIDVector kp = pidLoad(loops.kp + i);
+        PIDVector tn = pidLoad(loops.tn + i);
+        PIDVector yOffset = pidLoad(loops.yOffset + i);
+        PIDVector yMin = pidLoad(loops.yMin + i);
+        PIDVector yMax = pidLoad(loops.yMax + i);
+        PIDVector derivative = pidLoad(loops.derivative + i);
+        PIDVector proportional = pidMul(kp, pidSub(pidLoad(loops.setPoint + i), actual));
+        PIDMask integrating = pidGreater(tn, zero);
+        PIDVector integrated = pidSelect(integrating,
+            pidAdd(pidLoad(loops.integral + i), pidDiv(pidMul(proportional, step), pidSelect(integrating, tn, one))), zero);
+        PIDVector raw = dt > 0 ? pidDiv(pidSub(zero, pidMul(pidMul(kp, pidLoad(loops.tv + i)), pidSub(actual, pidLoad(loops.lastActual + i)))), rate)
+            : zero;
+        PIDVector tf = pidLoad(loops.tf + i);
+        PIDVector lag = pidAdd(pidSelect(pidGreater(tf, zero), tf, zero), step);
+        PIDMask lagging = pidGreater(lag, zero);
+        PIDVector filtered = pidAdd(derivative, pidMul(pidSub(raw, derivative), pidSelect(lagging, pidDiv(step, pidSelect(lagging, lag, one)), one)));
+        PIDVector y = pidAdd(pidAdd(pidAdd(yOffset, proportional), integrated), filtered);
+        PIDMask bounded = pidGreater(yMax, yMin);
+        PIDVector upper = pidSelect(pidGreater(y, yMax), yMax, y);
+        PIDVector clamped = pidSelect(pidGreater(yMin, upper), yMin, upper);
+        PIDMask limits = pidAnd(bounded, pidNotEqual(clamped, y));
+        y = pidSelect(bounded, clamped, y);
+        PIDVector held = pidSub(pidSub(pidSub(y, yOffset), proportional), filtered);
+        pidStore(loops.y + i, y);
+        pidStore(loops.integral + i, pidSelect(pidAnd(integrating, limits), held, integrated));
+        pidStore(loops.derivative + i, filtered);
+        pidStore(loops.lastActual + i, actual);
+        limited |= pidBits(limits) << lane;
+    }
+#endif
+    for(; lane < count; lane++){
+        size_t i = first + lane;
+        bool bounded;
+        loops.y[i] = pidStep(loops.integral[i], loops.derivative[i], loops.lastActual[i], loops.actual[i], loops.setPoint[i],
+            loops.kp[i], loops.tn[i], loops.tv[i], loops.tf[i], loops.yOffset[i], loops.yMin[i], loops.yMax[i], dt, bounded);
+        if(bounded){
+            limited |= 1ull << lane;
         }
-        std::cout << "Adding map for " << map.moduleID.c_str() << ":" << map.modulePort.c_str() << "->" << map.localAddress.c_str() << "\n";
-        mappings.push_back(map);
-        onMappingAdded(mappings.back());
     }
+    return limited;
 }
+#pragma endregion
 
-bool IOClient::hasMapping(std::string localAddress){
-    for (const auto& map : mappings) {
-        if(map.localAddress == localAddress){
-            return true;
+/**
+ * A write that has been staged by the IO layer or a server thread, waiting to be applied to MEMORY.
+ */
+struct StagedWrite {
+    size_t offset;
+    int width;
+    uint8_t mask;
+    uint64_t value;
+    MappingFreshness* freshness;    // The mapping of a read from a device, or null.
+    uint64_t arrived;               // When the read arrived, in microseconds since the program started.
+};
+
+alignas(IMAGE_LINE_BYTES) static ProcessImage IMAGE_BUFFERS[2] = {};
+static std::atomic<uint64_t*> PUBLISHED_IMAGE{IMAGE_BUFFERS[0]};
+static std::vector<StagedWrite> STAGED_WRITES;
+static std::mutex IMAGE_MUTEX;
+/**
+ * The bits of %I that are waiting for their first read, one bit for each bit of the space. Latching a write to a
+ * bit clears it. INPUTS_PENDING is set once any input is marked, so that latching costs nothing without IO.
+ */
+static std::atomic<uint8_t> INPUT_PENDING[INPUT_IMAGE_BYTES];
+static std::atomic<bool> INPUTS_PENDING{false};
+static std::mutex MEMORY_MUTEX;
+static std::atomic<uint64_t> IMAGE_GENERATION{0};
+/**
+ * Advanced by commitOutputs() before it refills the back buffer and again once it has published it, so that it is
+ * odd while a buffer is being refilled. A buffer that was published can't be refilled until the sequence has advanced
+ * by two, which lets single value reads go without IMAGE_MUTEX.
+ */
+static std::atomic<uint64_t> IMAGE_SEQUENCE{0};
+/**
+ * Set by enterSafeState(). commitOutputs() then publishes %Q as 0.
+ */
+static std::atomic<bool> SAFE_STATE{false};
+/**
+ * The lines written in the scan being published, handed to every ImageChanges by commitOutputs(). Without dirty
+ * tracking every line is reported.
+ */
+static uint64_t CHANGED_LINES[IMAGE_LINE_WORDS] = { 0 };
+/**
+ * The scans between those that evaluate every rung of incremental programs, or 0 for none (--incremental-full).
+ */
+static uint64_t INCREMENTAL_FULL = 0;
+/**
+ * The output mappings whose changes commitOutputs() time stamps for their output delay, guarded by MEMORY_MUTEX.
+ */
+static std::vector<MappingFreshness*> OUTPUT_WATCHES;
+
+/**
+ * The bits of the image that are forced, and the values they are forced to. Guarded by IMAGE_MUTEX.
+ */
+alignas(IMAGE_LINE_BYTES) static ProcessImage FORCE_MASK = {};
+alignas(IMAGE_LINE_BYTES) static ProcessImage FORCE_VALUES = {};
+static std::atomic<bool> FORCES_ACTIVE{false};
+/**
+ * An address in the force list, with the value it is forced to.
+ */
+struct ForceEntry {
+    ResolvedAddress address;
+    uint64_t value;
+};
+/**
+ * The forced addresses, in the order they were forced, which FORCE_MASK and FORCE_VALUES are built from. Guarded by
+ * IMAGE_MUTEX.
+ */
+static std::vector<ForceEntry> FORCE_LIST;
+static std::atomic<size_t> FORCE_COUNT{0};
+
+/**
+ * Overwrites the forced bits of MEMORY with their forced values. MEMORY_MUTEX and IMAGE_MUTEX must be held.
+ */
+static void applyForces(){
+    if(!FORCES_ACTIVE.load(std::memory_order_relaxed)){
+        return;
+    }
+    for(size_t line = 0; line < IMAGE_LINES; line++){
+        size_t word = line * LINE_WORDS;
+        if(blendLine(MEMORY + word, FORCE_VALUES + word, FORCE_MASK + word)){
+#if NODALIS_DIRTY_TRACKING
+            DIRTY_LINES[line >> 6] |= 1ull << (line & 63);
+#endif
         }
     }
-    return false;
 }
 
-const std::string& IOClient::getProtocol() const {
-    return protocol;
+/**
+ * Marks every line of the image in a bitmap of lines.
+ * @param lines The bitmap.
+ */
+static void markAllLines(uint64_t* lines){
+    std::memset(lines, 0xff, IMAGE_LINE_WORDS * sizeof(uint64_t));
+    if(IMAGE_LINES % 64 != 0){
+        lines[IMAGE_LINE_WORDS - 1] = (1ull << (IMAGE_LINES % 64)) - 1;
+    }
 }
 
-const std::string& IOClient::getModuleID() const {
-    return moduleID;
+/**
+ * Gets the consumers of the image changes. This is a function so that an ImageChanges can be registered from
+ * another translation unit's static initialization. Guarded by IMAGE_MUTEX.
+ */
+static std::vector<ImageChanges*>& changeSets(){
+    static std::vector<ImageChanges*> sets;
+    return sets;
 }
 
-void IOClient::poll() {
-    if(connected){
-        for (auto& map : mappings) {
-            try {
-                if(elapsed() - map.lastPoll > map.interval){
-                    map.lastPoll = elapsed();
-                    bool result = false;
-                    if (map.direction == IOType::Output)
-                    {
-                        switch (map.width) {
-                            case 1: {
-                                int bit = ::readBit(map.localAddress);
-                                result = writeBit(map.remoteAddress, bit);
-                                break;
-                            }
-                            case 8: {
-                                uint8_t val = ::readByte(map.localAddress);
-                                result = writeByte(map.remoteAddress, val);
-                                break;
-                            }
-                            case 16: {
-                                uint16_t val = ::readWord(map.localAddress);
-                                result = writeWord(map.remoteAddress, val);
-                                break;
-                            }
-                            case 32: {
-                                uint32_t val = ::readDWord(map.localAddress);
-                                result = writeDWord(map.remoteAddress, val);
-                                break;
-                            }
-                            case 64:
-                            {
-                                uint64_t val = ::readLWord(map.localAddress);
-                                result = writeLWord(map.remoteAddress, val);
-                                break;
-                            }
-                            }
-                            if (!result)
-                            {
-                                std::cout << "Failed to write on map for " << map.moduleID << "/" << map.remoteAddress << "\n";
-                            }
-                    }
-                    else if (map.direction == IOType::Input) {
-
-                        switch (map.width) {
-                            case 1: {
-                                int bit = 0;
-                                if (readBit(map.remoteAddress, bit)) {
-                                    ::writeBit(map.localAddress, bit > 0);
-                                }
-                                break;
-                            }
-                            case 8: {
-                                uint8_t val = 0;
-                                if (readByte(map.remoteAddress, val)) {
-                                    ::writeByte(map.localAddress, val);
-                                }
-                                break;
-                            }
-                            case 16: {
-                                uint16_t val = 0;
-                                if (readWord(map.remoteAddress, val)) {
-                                    ::writeWord(map.localAddress, val);
-                                }
-                                break;
-                            }
-                            case 32: {
-                                uint32_t val = 0;
-                                if (readDWord(map.remoteAddress, val)) {
-                                    ::writeDWord(map.localAddress, val);
-                                }
-                                break;
-                            }
-                            case 64:
-                            {
-                                uint64_t val = 0;
-                                if (readLWord(map.remoteAddress, val))
-                                {
-                                    ::writeLWord(map.localAddress, val);
-                                }
-                                break;
-                            }
-                        }
-                    } 
-                }
-            }
-            catch (const std::exception& e) {
-            // handle error or log it
-            }
-        } 
-        
+#pragma region "Retentive Memory"
+/**
+ * The header at the start of the retain file. A file written for another layout of retentive memory is started over.
+ */
+struct RetainFileHeader {
+    char magic[8];
+    uint64_t offset;        // The offset of the retained bytes from %MB0.
+    uint64_t bytes;         // The number of retained bytes.
+    uint64_t reserved[5];
+};
+
+/**
+ * The header of each of the two copies in the retain file, followed by the retained bytes.
+ */
+struct RetainSlotHeader {
+    uint64_t generation;    // Counts the saves, so the newer copy can be told apart. 0 for a copy never written.
+    uint64_t checksum;      // Covers the generation and the bytes, so a copy that wasn't written completely is ignored.
+    uint64_t reserved[6];
+};
+
+static_assert(sizeof(RetainFileHeader) == 64 && sizeof(RetainSlotHeader) == 64, "The retain file headers are one line each");
+static const char RETAIN_MAGIC[8] = { 'N', 'D', 'L', 'S', 'R', 'T', 'N', '1' };
+static constexpr size_t RETAIN_SLOT_BYTES = sizeof(RetainSlotHeader) + imageSpaceBytes(RETAIN_IMAGE_BYTES);
+static constexpr size_t RETAIN_FILE_BYTES = sizeof(RetainFileHeader) + 2 * RETAIN_SLOT_BYTES;
+
+/**
+ * Computes the checksum of a copy of retentive memory, a 64 bit FNV-1a hash.
+ * @param generation The generation of the copy.
+ * @param data The retained bytes.
+ * @returns Returns the checksum.
+ */
+static uint64_t retainChecksum(uint64_t generation, const uint8_t* data){
+    uint64_t hash = 14695981039346656037ull;
+    for(size_t i = 0; i < sizeof(generation); i++){
+        hash = (hash ^ ((generation >> (i * 8)) & 0xff)) * 1099511628211ull;
     }
-    else if(elapsed() - lastAttempt >= 15000){
-        lastAttempt = elapsed();
-        connect();
+    for(size_t i = 0; i < RETAIN_IMAGE_BYTES; i++){
+        hash = (hash ^ data[i]) * 1099511628211ull;
     }
+    return hash;
 }
 
+/**
+ * Keeps retentive memory in a memory mapped file. The scan thread copies the retained bytes to a staging buffer
+ * when a save is due and the writer is idle, and the writer thread copies them into the older copy in the file and
+ * flushes it. The scan never waits for the writer.
+ */
+class RetainStore {
+public:
+    ~RetainStore(){ close(); }
 
+    bool open(const std::string& path, uint64_t flushScans);
+    void capture();
+    void close();
 
-IOClient* findClient(IOMap map){
-    for(int x = 0; x < Clients.size(); x++){
-        if(Clients[x]->hasMapping(map.localAddress)){
-            return Clients[x].get();
-        }
-        else if(Clients[x]->getModuleID() == map.moduleID){
-            Clients[x]->addMapping(map);
-            return Clients[x].get();
+    RetainCounters counters;
+
+private:
+    void run();
+    uint8_t* slot(int index){ return map + sizeof(RetainFileHeader) + static_cast<size_t>(index) * RETAIN_SLOT_BYTES; }
+    void flush();
+
+    uint8_t* map = nullptr;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+    std::vector<uint8_t> staging;   // The bytes to save next, written by the scan thread while the writer is idle.
+    std::vector<uint8_t> saved;     // The bytes last handed to the writer, used to skip saves of unchanged bytes.
+    uint64_t generation = 0;        // The generation of the newest complete copy. Only used by the writer.
+    uint64_t flushScans = 10;
+    uint64_t scans = 0;
+    std::atomic<bool> busy{false};  // Set while the writer owns the staging buffer.
+    std::atomic<bool> running{false};
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread writer;
+};
+
+bool RetainStore::open(const std::string& path, uint64_t flushScans){
+    this->flushScans = flushScans > 0 ? flushScans : 1;
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE){
+        nodalisLog() << "Failed to open retain file " << path << "\n";
+        return false;
+    }
+    LARGE_INTEGER size;
+    bool fresh = !GetFileSizeEx(file, &size) || static_cast<uint64_t>(size.QuadPart) != RETAIN_FILE_BYTES;
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, 0, static_cast<DWORD>(RETAIN_FILE_BYTES), nullptr);
+    map = mapping ? static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, RETAIN_FILE_BYTES)) : nullptr;
+#else
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(fd < 0){
+        nodalisLog() << "Failed to open retain file " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    struct stat info;
+    bool fresh = fstat(fd, &info) != 0 || static_cast<uint64_t>(info.st_size) != RETAIN_FILE_BYTES;
+    if(fresh && ftruncate(fd, static_cast<off_t>(RETAIN_FILE_BYTES)) != 0){
+        nodalisLog() << "Failed to size retain file " << path << ": " << std::strerror(errno) << "\n";
+        close();
+        return false;
+    }
+    void* view = mmap(nullptr, RETAIN_FILE_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    map = view == MAP_FAILED ? nullptr : static_cast<uint8_t*>(view);
+#endif
+    if(map == nullptr){
+        nodalisLog() << "Failed to map retain file " << path << "\n";
+        close();
+        return false;
+    }
+
+    auto* header = reinterpret_cast<RetainFileHeader*>(map);
+    fresh = fresh || std::memcmp(header->magic, RETAIN_MAGIC, sizeof(RETAIN_MAGIC)) != 0 ||
+            header->offset != NODALIS_RETAIN_OFFSET || header->bytes != RETAIN_IMAGE_BYTES;
+    int newest = -1;
+    for(int x = 0; x < 2 && !fresh; x++){
+        auto* copy = reinterpret_cast<const RetainSlotHeader*>(slot(x));
+        const uint8_t* data = slot(x) + sizeof(RetainSlotHeader);
+        if(copy->generation > generation && copy->checksum == retainChecksum(copy->generation, data)){
+            generation = copy->generation;
+            newest = x;
         }
-        
     }
-    return nullptr;
+    if(newest >= 0){
+        std::lock_guard<std::mutex> memoryLock(MEMORY_MUTEX);
+        std::memcpy(reinterpret_cast<uint8_t*>(MEMORY) + RETAIN_IMAGE_OFFSET, slot(newest) + sizeof(RetainSlotHeader), RETAIN_IMAGE_BYTES);
+        nodalisLog() << "Restored " << RETAIN_IMAGE_BYTES << " bytes of retentive memory from " << path << "\n";
+    }
+    else{
+        std::memset(map, 0, RETAIN_FILE_BYTES);
+        std::memcpy(header->magic, RETAIN_MAGIC, sizeof(RETAIN_MAGIC));
+        header->offset = NODALIS_RETAIN_OFFSET;
+        header->bytes = RETAIN_IMAGE_BYTES;
+        nodalisLog() << "Started retentive memory in " << path << "\n";
+    }
+    staging.assign(RETAIN_IMAGE_BYTES, 0);
+    saved.assign(reinterpret_cast<uint8_t*>(MEMORY) + RETAIN_IMAGE_OFFSET,
+                 reinterpret_cast<uint8_t*>(MEMORY) + RETAIN_IMAGE_OFFSET + RETAIN_IMAGE_BYTES);
+    counters.flushes.store(&registerStats("Retain"), std::memory_order_release);
+    running = true;
+    writer = std::thread(&RetainStore::run, this);
+    return true;
 }
-std::unique_ptr<IOClient> createClient(IOMap& map){
-   
-    if(map.protocol == "MODBUS-TCP"){
-        auto ret = std::make_unique<ModbusClient>();
-        ret->addMapping(map);
-        return ret;
+
+void RetainStore::capture(){
+    if(!running.load(std::memory_order_relaxed) || ++scans < flushScans){
+        return;
     }
-    else if(map.protocol == "OPCUA"){
-        auto ret = std::make_unique<OPCUAClient>();
-        ret->addMapping(map);
-        return ret;
+    if(busy.load(std::memory_order_acquire)){
+        counters.postponed.fetch_add(1, std::memory_order_relaxed);
+        return;
     }
-    else if(map.protocol == "BACNET" || map.protocol == "BACNET-IP"){
-        auto ret = std::make_unique<BACNETClient>();
-        ret->addMapping(map);
-        return ret;
+    const uint8_t* retained = reinterpret_cast<const uint8_t*>(MEMORY) + RETAIN_IMAGE_OFFSET;
+    if(std::memcmp(retained, saved.data(), RETAIN_IMAGE_BYTES) == 0){
+        scans = 0;
+        counters.unchanged.fetch_add(1, std::memory_order_relaxed);
+        return;
     }
-    return nullptr;
+    // The writer only sleeps while holding the lock, so if it can't be had the save waits for the next scan.
+    std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+    if(!lock.owns_lock()){
+        counters.postponed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    scans = 0;
+    counters.saves.fetch_add(1, std::memory_order_relaxed);
+    std::memcpy(staging.data(), retained, RETAIN_IMAGE_BYTES);
+    std::memcpy(saved.data(), retained, RETAIN_IMAGE_BYTES);
+    busy.store(true, std::memory_order_release);
+    lock.unlock();
+    wake.notify_one();
 }
 
-void mapIO(std::string map){
-    try{
-        IOMap newMap(map);
-        IOClient* existing = findClient(newMap);
-        if(existing == nullptr){
-            auto client = createClient(newMap);
-            if(client) Clients.push_back(std::move(client));
+void RetainStore::run(){
+    moveToBackground();
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true){
+        wake.wait(lock, [this]{ return busy.load(std::memory_order_acquire) || !running.load(); });
+        if(!busy.load(std::memory_order_acquire)){
+            return;
         }
+        lock.unlock();
+        auto started = std::chrono::steady_clock::now();
+        flush();
+        counters.flushes.load(std::memory_order_relaxed)->record(microsBetween(started, std::chrono::steady_clock::now()));
+        busy.store(false, std::memory_order_release);
+        lock.lock();
     }
-    catch(const std::exception& e){
-        std::cout << "Caught exception: " << e.what() << "\n";
-    }
-    
+}
 
+void RetainStore::flush(){
+    // The older copy is overwritten, so the newest complete one survives if this is cut short.
+    uint64_t next = generation + 1;
+    uint8_t* target = slot(static_cast<int>(next % 2));
+    auto* copy = reinterpret_cast<RetainSlotHeader*>(target);
+    std::memcpy(target + sizeof(RetainSlotHeader), staging.data(), RETAIN_IMAGE_BYTES);
+    copy->generation = next;
+    copy->checksum = retainChecksum(next, staging.data());
+#ifdef _WIN32
+    FlushViewOfFile(map, RETAIN_FILE_BYTES);
+    FlushFileBuffers(file);
+#else
+    msync(map, RETAIN_FILE_BYTES, MS_SYNC);
+#endif
+    generation = next;
 }
 
-void superviseIO(){
-    try{
-        for(int x = 0; x < Clients.size(); x++){
-            Clients[x]->poll();
+void RetainStore::close(){
+    if(writer.joinable()){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
         }
+        wake.notify_one();
+        writer.join();
     }
-    catch(const std::exception& e){
-        std::cout << "Caught exception: " << e.what() << "\n";
+    running = false;
+#ifdef _WIN32
+    if(map != nullptr) UnmapViewOfFile(map);
+    if(mapping != nullptr) CloseHandle(mapping);
+    if(file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    mapping = nullptr;
+    file = INVALID_HANDLE_VALUE;
+#else
+    if(map != nullptr) munmap(map, RETAIN_FILE_BYTES);
+    if(fd >= 0) ::close(fd);
+    fd = -1;
+#endif
+    map = nullptr;
+}
+
+static RetainStore RETAIN_STORE;
+
+/**
+ * Hands the retentive bytes to the retain writer when a save is due. Called by commitOutputs() with MEMORY_MUTEX held.
+ */
+static void captureRetain(){
+    if(RETAIN_IMAGE_BYTES > 0){
+        RETAIN_STORE.capture();
+    }
+}
+
+bool openRetentiveMemory(const RuntimeOptions& options){
+    if(RETAIN_IMAGE_BYTES == 0){
+        return false;
+    }
+    return RETAIN_STORE.open(options.retainFile, options.retainFlush);
+}
+
+const RetainCounters& getRetainCounters(){
+    return RETAIN_STORE.counters;
+}
+#pragma endregion
+
+#pragma region "Warm Restart"
+/**
+ * The header at the start of a snapshot file. The process image follows it, then a SnapshotEntry for each state
+ * variable, the names and layouts of the variables, and their values, each at an offset aligned for any type. The
+ * file is written whole and renamed over the last one, and is restored by mapping it and copying the values from it.
+ */
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;       // SNAPSHOT_VERSION.
+    uint32_t count;         // The number of entries.
+    uint64_t layout;        // A hash of the names, layouts and sizes of the entries, and of the image layout.
+    uint64_t imageBytes;    // PROCESS_IMAGE_BYTES of the runtime that wrote the snapshot.
+    uint64_t scanMillis;    // The scan time the snapshot was taken at.
+    uint64_t entries;       // The offset of the entries.
+    uint64_t bytes;         // The size of the file.
+    uint64_t checksum;      // Covers everything after the header, so a file that wasn't written completely is ignored.
+};
+
+/**
+ * Locates a state variable in a snapshot file.
+ */
+struct SnapshotEntry {
+    uint32_t name;          // The offset of the variable's name, NUL terminated.
+    uint32_t layout;        // The offset of the variable's layout, NUL terminated.
+    uint64_t data;          // The offset of the variable's value.
+    uint64_t size;          // The size of the value.
+    uint64_t mask;          // The bit of a packed BOOL in the word at data, or 0.
+};
+
+static_assert(sizeof(SnapshotHeader) == 64 && sizeof(SnapshotEntry) == 32, "The snapshot file layout is fixed");
+static const char SNAPSHOT_MAGIC[8] = { 'N', 'D', 'L', 'S', 'N', 'A', 'P', '1' };
+static constexpr uint32_t SNAPSHOT_VERSION = 1;
+static constexpr size_t SNAPSHOT_ALIGN = 16;
+
+static size_t alignSnapshot(size_t offset){
+    return (offset + SNAPSHOT_ALIGN - 1) & ~(SNAPSHOT_ALIGN - 1);
+}
+
+/**
+ * Hashes bytes into a 64 bit FNV-1a hash.
+ * @param hash The hash so far.
+ * @param data The bytes.
+ * @param bytes The number of bytes.
+ * @returns Returns the hash.
+ */
+static uint64_t snapshotHash(uint64_t hash, const void* data, size_t bytes){
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    for(size_t i = 0; i < bytes; i++){
+        hash = (hash ^ p[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * Sets the stopping flag when the runtime is asked to stop, so that the scheduler takes a last snapshot and exits
+ * between scans.
+ */
+static volatile std::sig_atomic_t SNAPSHOT_STOP = 0;
+
+static void snapshotSignal(int){
+    SNAPSHOT_STOP = 1;
+}
+
+/**
+ * Takes warm restart snapshots. The layout of the file is fixed by the state table, so the scan thread copies the
+ * image and the values into a buffer laid out like the file, and the writer thread checksums and writes it.
+ */
+class SnapshotStore {
+public:
+    ~SnapshotStore(){ close(); }
+
+    /**
+     * Lays out the snapshot of the registered state table, restores the last one unless it is a cold start, and
+     * starts the writer.
+     * @returns Returns true if a snapshot was restored.
+     */
+    bool open(const RuntimeOptions& options);
+    /**
+     * Hands a snapshot to the writer if one is due and the writer is idle, or writes the last one if the runtime was
+     * asked to stop. Called on the scan thread between scans.
+     * @returns Returns true if the runtime was asked to stop.
+     */
+    bool capture();
+    /**
+     * Writes the last snapshot and stops taking them.
+     */
+    void saveLast();
+    void close();
+
+private:
+    void layOut();
+    bool restore();
+    void fill();
+    void run();
+    bool write();
+
+    std::string path;
+    StateTable table = nullptr;     // The table the file is laid out for.
+    std::vector<const StateVariable*> rows;
+    uint64_t layout = 0;
+    std::vector<uint8_t> staging;   // The next file, filled by the scan thread while the writer is idle.
+    std::chrono::steady_clock::duration interval{};
+    std::chrono::steady_clock::time_point nextSave;
+    std::atomic<bool> busy{false};  // Set while the writer owns the staging buffer.
+    std::atomic<bool> running{false};
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread writer;
+};
+
+void SnapshotStore::layOut(){
+    table = registeredStateTable();
+    size_t count = 0;
+    const StateVariable* variables = table(&count);
+    rows.clear();
+    layout = stateLayout();
+    std::string strings;
+    std::vector<SnapshotEntry> entries(count);
+    for(size_t x = 0; x < count; x++){
+        rows.push_back(&variables[x]);
+        entries[x].name = static_cast<uint32_t>(strings.size());
+        strings.append(variables[x].name).push_back('\0');
+        entries[x].layout = static_cast<uint32_t>(strings.size());
+        strings.append(variables[x].layout).push_back('\0');
+        entries[x].size = variables[x].mask != 0 ? sizeof(uint64_t) : variables[x].size;
+        entries[x].mask = variables[x].mask;
+    }
+    size_t entryOffset = alignSnapshot(sizeof(SnapshotHeader) + PROCESS_IMAGE_BYTES);
+    size_t stringOffset = entryOffset + count * sizeof(SnapshotEntry);
+    size_t offset = alignSnapshot(stringOffset + strings.size());
+    for(auto& entry : entries){
+        entry.name += static_cast<uint32_t>(stringOffset);
+        entry.layout += static_cast<uint32_t>(stringOffset);
+        entry.data = offset;
+        offset = alignSnapshot(offset + entry.size);
+    }
+    staging.assign(offset, 0);
+    auto* header = reinterpret_cast<SnapshotHeader*>(staging.data());
+    std::memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header->version = SNAPSHOT_VERSION;
+    header->count = static_cast<uint32_t>(count);
+    header->layout = layout;
+    header->imageBytes = PROCESS_IMAGE_BYTES;
+    header->entries = entryOffset;
+    header->bytes = offset;
+    std::memcpy(staging.data() + entryOffset, entries.data(), count * sizeof(SnapshotEntry));
+    std::memcpy(staging.data() + stringOffset, strings.data(), strings.size());
+}
+
+/**
+ * Restores a state variable from its value in a snapshot.
+ * @param variable The variable.
+ * @param entry The entry of the value.
+ * @param data The value.
+ */
+static void restoreState(const StateVariable& variable, const SnapshotEntry& entry, const uint8_t* data){
+    if(variable.mask == 0){
+        variable.copy(variable.address, data);
+        return;
+    }
+    uint64_t word = 0;
+    std::memcpy(&word, data, sizeof(word));
+    uint64_t& target = *static_cast<uint64_t*>(variable.address);
+    target = (word & entry.mask) != 0 ? target | variable.mask : target & ~variable.mask;
+}
+
+bool SnapshotStore::restore(){
+    auto started = std::chrono::steady_clock::now();
+    size_t bytes = 0;
+    const uint8_t* map = nullptr;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE){
+        return false;
+    }
+    LARGE_INTEGER size;
+    HANDLE mapping = nullptr;
+    if(GetFileSizeEx(file, &size) && size.QuadPart >= static_cast<LONGLONG>(sizeof(SnapshotHeader))){
+        bytes = static_cast<size_t>(size.QuadPart);
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        map = mapping ? static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+    }
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0){
+        return false;
+    }
+    struct stat info;
+    if(fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(SnapshotHeader)){
+        bytes = static_cast<size_t>(info.st_size);
+        void* view = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        map = view == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(view);
+    }
+#endif
+    bool restored = false;
+    const auto* header = reinterpret_cast<const SnapshotHeader*>(map);
+    if(map == nullptr || std::memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+       header->version != SNAPSHOT_VERSION || header->bytes != bytes ||
+       header->entries + static_cast<uint64_t>(header->count) * sizeof(SnapshotEntry) > bytes ||
+       header->checksum != snapshotHash(14695981039346656037ull, map + sizeof(SnapshotHeader), bytes - sizeof(SnapshotHeader))){
+        nodalisLog() << "The snapshot in " << path << " is incomplete or of another version, so the program starts cold\n";
+    }
+    else{
+        const auto* entries = reinterpret_cast<const SnapshotEntry*>(map + header->entries);
+        size_t kept = 0;
+        {
+            std::lock_guard<std::mutex> memoryLock(MEMORY_MUTEX);
+            if(header->imageBytes == PROCESS_IMAGE_BYTES){
+                std::memcpy(MEMORY, map + sizeof(SnapshotHeader), PROCESS_IMAGE_BYTES);
+#if NODALIS_DIRTY_TRACKING
+                markAllLines(DIRTY_LINES);
+#endif
+            }
+            if(header->layout == layout && header->count == rows.size()){
+                // The same program: each entry is the value of the variable of the same row.
+                for(size_t x = 0; x < rows.size(); x++){
+                    restoreState(*rows[x], entries[x], map + entries[x].data);
+                }
+                kept = rows.size();
+            }
+            else{
+                // Another build of the program: the variables are matched by name and layout.
+                std::unordered_map<std::string, const SnapshotEntry*> byName;
+                for(uint32_t x = 0; x < header->count; x++){
+                    if(entries[x].name < bytes && entries[x].layout < bytes && entries[x].data + entries[x].size <= bytes){
+                        byName.emplace(reinterpret_cast<const char*>(map + entries[x].name), &entries[x]);
+                    }
+                }
+                for(const StateVariable* variable : rows){
+                    auto match = byName.find(variable->name);
+                    if(match == byName.end() || std::strcmp(reinterpret_cast<const char*>(map + match->second->layout), variable->layout) != 0 ||
+                       match->second->size != (variable->mask != 0 ? sizeof(uint64_t) : variable->size) || (match->second->mask != 0) != (variable->mask != 0)){
+                        continue;
+                    }
+                    restoreState(*variable, *match->second, map + match->second->data);
+                    kept++;
+                }
+            }
+        }
+        // The clock resumes from the snapshot, so the start times the timers hold stay meaningful.
+        PROGRAM_START = std::chrono::steady_clock::now() - std::chrono::milliseconds(header->scanMillis);
+        nodalisLog() << "Restored " << kept << " of " << rows.size() << " variable(s)"
+                  << (header->imageBytes == PROCESS_IMAGE_BYTES ? " and the process image" : "") << " from " << path
+                  << " in " << microsBetween(started, std::chrono::steady_clock::now()) << " us\n";
+        restored = true;
+    }
+#ifdef _WIN32
+    if(map != nullptr) UnmapViewOfFile(map);
+    if(mapping != nullptr) CloseHandle(mapping);
+    CloseHandle(file);
+#else
+    if(map != nullptr) munmap(const_cast<uint8_t*>(map), bytes);
+    ::close(fd);
+#endif
+    return restored;
+}
+
+bool SnapshotStore::open(const RuntimeOptions& options){
+    if(registeredStateTable() == nullptr){
+        return false;
+    }
+    if(options.threadedTasks){
+        nodalisLog() << "Warm restart snapshots are taken between scans, which threaded tasks don't have, so they are off\n";
+        return false;
+    }
+    path = options.snapshotFile;
+    layOut();
+    bool restored = !options.coldStart && restore();
+    interval = std::chrono::milliseconds(options.snapshotInterval);
+    nextSave = std::chrono::steady_clock::now() + interval;
+    std::signal(SIGTERM, snapshotSignal);
+    std::signal(SIGINT, snapshotSignal);
+    running = true;
+    writer = std::thread(&SnapshotStore::run, this);
+    return restored;
+}
+
+void SnapshotStore::fill(){
+    // An online change registers the table of each version it loads, which may have other variables.
+    if(table != registeredStateTable()){
+        layOut();
+    }
+    auto* header = reinterpret_cast<SnapshotHeader*>(staging.data());
+    header->scanMillis = scanTime();
+    std::memcpy(staging.data() + sizeof(SnapshotHeader), MEMORY, PROCESS_IMAGE_BYTES);
+    const auto* entries = reinterpret_cast<const SnapshotEntry*>(staging.data() + header->entries);
+    for(size_t x = 0; x < rows.size(); x++){
+        std::memcpy(staging.data() + entries[x].data, rows[x]->address, entries[x].size);
+    }
+}
+
+bool SnapshotStore::capture(){
+    if(!running.load(std::memory_order_relaxed)){
+        return false;
+    }
+    if(SNAPSHOT_STOP){
+        saveLast();
+        return true;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if(interval.count() == 0 || now < nextSave || busy.load(std::memory_order_acquire)){
+        return false;
+    }
+    std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+    if(!lock.owns_lock()){
+        return false;
+    }
+    nextSave = now + interval;
+    fill();
+    busy.store(true, std::memory_order_release);
+    lock.unlock();
+    wake.notify_one();
+    return false;
+}
+
+void SnapshotStore::saveLast(){
+    if(!running.load(std::memory_order_relaxed)){
+        return;
+    }
+    // The last snapshot is written on the scan thread, once the writer is done with the one before.
+    std::unique_lock<std::mutex> lock(mutex);
+    wake.wait(lock, [this]{ return !busy.load(std::memory_order_acquire); });
+    running = false;
+    fill();
+    nodalisLog() << (write() ? "Snapshot written to " : "Could not write the snapshot to ") << path << "\n";
+}
+
+bool SnapshotStore::write(){
+    auto* header = reinterpret_cast<SnapshotHeader*>(staging.data());
+    header->checksum = snapshotHash(14695981039346656037ull, staging.data() + sizeof(SnapshotHeader), staging.size() - sizeof(SnapshotHeader));
+    // The snapshot replaces the last one only once it is complete, so a crash while writing keeps the last one.
+    std::string partial = path + ".partial";
+#ifdef _WIN32
+    HANDLE file = CreateFileA(partial.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE){
+        return false;
+    }
+    DWORD written = 0;
+    bool ok = WriteFile(file, staging.data(), static_cast<DWORD>(staging.size()), &written, nullptr) && written == staging.size() &&
+              FlushFileBuffers(file);
+    CloseHandle(file);
+    return ok && MoveFileExA(partial.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+    int fd = ::open(partial.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0){
+        return false;
+    }
+    size_t done = 0;
+    while(done < staging.size()){
+        ssize_t n = ::write(fd, staging.data() + done, staging.size() - done);
+        if(n <= 0){
+            break;
+        }
+        done += static_cast<size_t>(n);
+    }
+    bool ok = done == staging.size() && fsync(fd) == 0;
+    ::close(fd);
+    return ok && std::rename(partial.c_str(), path.c_str()) == 0;
+#endif
+}
+
+void SnapshotStore::run(){
+    moveToBackground();
+    ExecutionStats& stats = registerStats("Snapshot");
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true){
+        wake.wait(lock, [this]{ return busy.load(std::memory_order_acquire) || !running.load(); });
+        if(!busy.load(std::memory_order_acquire)){
+            return;
+        }
+        lock.unlock();
+        auto started = std::chrono::steady_clock::now();
+        if(!write()){
+            DIAGNOSTIC("Could not write the snapshot to " << path);
+        }
+        stats.record(microsBetween(started, std::chrono::steady_clock::now()));
+        lock.lock();
+        busy.store(false, std::memory_order_release);
+        wake.notify_all();
+    }
+}
+
+void SnapshotStore::close(){
+    if(writer.joinable()){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        wake.notify_all();
+        writer.join();
+    }
+    running = false;
+}
+
+static SnapshotStore SNAPSHOT_STORE;
+static StateTable STATE_TABLE = nullptr;
+
+uint64_t stateLayout(){
+    uint64_t hash = snapshotHash(14695981039346656037ull, &PROCESS_IMAGE_BYTES, sizeof(PROCESS_IMAGE_BYTES));
+    size_t count = 0;
+    const StateVariable* variables = STATE_TABLE != nullptr ? STATE_TABLE(&count) : nullptr;
+    for(size_t x = 0; x < count; x++){
+        uint64_t size = variables[x].mask != 0 ? sizeof(uint64_t) : variables[x].size;
+        hash = snapshotHash(hash, variables[x].name, std::strlen(variables[x].name) + 1);
+        hash = snapshotHash(hash, variables[x].layout, std::strlen(variables[x].layout) + 1);
+        hash = snapshotHash(hash, &size, sizeof(size));
+        hash = snapshotHash(hash, &variables[x].mask, sizeof(variables[x].mask));
+    }
+    return hash;
+}
+
+void registerStateTable(StateTable table){
+    STATE_TABLE = table;
+}
+
+StateTable registeredStateTable(){
+    return STATE_TABLE;
+}
+
+bool openSnapshot(const RuntimeOptions& options){
+    return SNAPSHOT_STORE.open(options);
+}
+
+#pragma endregion
+
+#pragma region "Shared Image"
+static const ImageSymbol* REGISTERED_SYMBOLS = nullptr;
+static size_t REGISTERED_SYMBOL_COUNT = 0;
+
+void registerImageSymbols(const ImageSymbol* symbols, size_t count){
+    REGISTERED_SYMBOLS = symbols;
+    REGISTERED_SYMBOL_COUNT = count;
+}
+
+const ImageSymbol* registeredImageSymbols(size_t& count){
+    count = REGISTERED_SYMBOL_COUNT;
+    return REGISTERED_SYMBOLS;
+}
+
+static SymbolIndexReader SYMBOL_INDEX;
+
+void registerSymbolIndex(const uint8_t* index, size_t bytes){
+    if(!SYMBOL_INDEX.attach(index, bytes)){
+        nodalisLog() << "Ignoring an unreadable symbol index\n";
+        return;
+    }
+    const SymbolIndexHeader* header = SYMBOL_INDEX.header();
+    if(header->inputBytes != INPUT_IMAGE_BYTES || header->outputBytes != OUTPUT_IMAGE_BYTES ||
+       header->memoryBytes != MEMORY_IMAGE_BYTES){
+        nodalisLog() << "Ignoring a symbol index built for another image layout\n";
+        SYMBOL_INDEX.close();
+    }
+}
+
+const char* findSymbolAddress(const std::string& name){
+    if(SYMBOL_INDEX.isOpen()){
+        const SymbolIndexEntry* entry = SYMBOL_INDEX.find(name.c_str());
+        return entry != nullptr ? SYMBOL_INDEX.text(entry->address) : nullptr;
+    }
+    for(size_t x = 0; x < REGISTERED_SYMBOL_COUNT; x++){
+        if(name == REGISTERED_SYMBOLS[x].name){
+            return REGISTERED_SYMBOLS[x].address;
+        }
+    }
+    return nullptr;
+}
+
+const char* findSymbolType(const std::string& name){
+    const SymbolIndexEntry* entry = SYMBOL_INDEX.isOpen() ? SYMBOL_INDEX.find(name.c_str()) : nullptr;
+    return entry != nullptr ? SYMBOL_INDEX.text(entry->type) : nullptr;
+}
+
+/**
+ * Publishes the image to a named shared memory segment. The segment is laid out as a SharedImageHeader, the symbol
+ * table and then the image, which starts on a line so it can be copied with the line kernels.
+ */
+class SharedImage {
+public:
+    ~SharedImage(){ close(); }
+
+    bool open(const std::string& name);
+    void publish();
+    void close();
+
+private:
+    SharedImageHeader* header = nullptr;
+    uint64_t* image = nullptr;
+    size_t bytes = 0;
+#ifdef _WIN32
+    HANDLE mapping = nullptr;
+#else
+    std::string name;
+#endif
+};
+
+bool SharedImage::open(const std::string& name){
+    size_t symbolsOffset = sizeof(SharedImageHeader);
+    size_t headerBytes = imageSpaceBytes(symbolsOffset + REGISTERED_SYMBOL_COUNT * sizeof(SharedImageSymbol));
+    bytes = headerBytes + PROCESS_IMAGE_BYTES;
+    std::string os = sharedImageName(name);
+    void* view = nullptr;
+#ifdef _WIN32
+    mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, static_cast<DWORD>(bytes), os.c_str());
+    view = mapping ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, bytes) : nullptr;
+#else
+    // A segment left by an earlier run, perhaps of another program, is replaced rather than reused.
+    shm_unlink(os.c_str());
+    int fd = shm_open(os.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if(fd < 0){
+        nodalisLog() << "Failed to create shared image " << os << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    this->name = os;
+    if(ftruncate(fd, static_cast<off_t>(bytes)) == 0){
+        view = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        view = view == MAP_FAILED ? nullptr : view;
+    }
+    ::close(fd);
+#endif
+    if(view == nullptr){
+        nodalisLog() << "Failed to map shared image " << os << "\n";
+        close();
+        return false;
+    }
+
+    header = static_cast<SharedImageHeader*>(view);
+    image = reinterpret_cast<uint64_t*>(static_cast<uint8_t*>(view) + headerBytes);
+    // The sequence stays odd until the first image is in, so readers that open the segment early wait for it.
+    header->sequence.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header->magic, SHARED_IMAGE_MAGIC, sizeof(SHARED_IMAGE_MAGIC));
+    header->version = SHARED_IMAGE_VERSION;
+    header->headerBytes = static_cast<uint32_t>(headerBytes);
+    header->imageBytes = static_cast<uint32_t>(PROCESS_IMAGE_BYTES);
+    header->lineBytes = static_cast<uint32_t>(IMAGE_LINE_BYTES);
+    header->inputOffset = 0;
+    header->inputBytes = static_cast<uint32_t>(INPUT_IMAGE_BYTES);
+    header->outputOffset = static_cast<uint32_t>(INPUT_IMAGE_BYTES);
+    header->outputBytes = static_cast<uint32_t>(OUTPUT_IMAGE_BYTES);
+    header->memoryOffset = static_cast<uint32_t>(INPUT_IMAGE_BYTES + OUTPUT_IMAGE_BYTES);
+    header->memoryBytes = static_cast<uint32_t>(MEMORY_IMAGE_BYTES);
+    header->symbolsOffset = static_cast<uint32_t>(symbolsOffset);
+    header->symbolCount = 0;
+#ifdef _WIN32
+    header->process = static_cast<uint32_t>(GetCurrentProcessId());
+#else
+    header->process = static_cast<uint32_t>(getpid());
+#endif
+    header->generation = 0;
+
+    auto* symbols = reinterpret_cast<SharedImageSymbol*>(reinterpret_cast<uint8_t*>(header) + symbolsOffset);
+    for(size_t x = 0; x < REGISTERED_SYMBOL_COUNT; x++){
+        ResolvedAddress address;
+        std::string text = REGISTERED_SYMBOLS[x].address;
+        if(tryResolveAddress(text, -1, text.find('.') != std::string::npos, address) != AddressStatus::OK){
+            continue;
+        }
+        SharedImageSymbol& symbol = symbols[header->symbolCount++];
+        std::memset(&symbol, 0, sizeof(symbol));
+        symbol.offset = static_cast<uint32_t>(address.bit > -1 ? address.bitOffset : address.offset);
+        symbol.width = static_cast<uint8_t>(address.bit > -1 ? 1 : address.width);
+        symbol.bit = static_cast<int8_t>(address.bit > -1 ? countTrailingZeros(address.bitMask) : -1);
+        symbol.space = address.space == MEMORY_SPACE::I ? 'I' : address.space == MEMORY_SPACE::Q ? 'Q' : 'M';
+        std::strncpy(symbol.name, REGISTERED_SYMBOLS[x].name, sizeof(symbol.name) - 1);
+    }
+    {
+        std::lock_guard<std::mutex> memoryLock(MEMORY_MUTEX);
+        copyChangedLines(image, MEMORY, nullptr);
+    }
+    header->sequence.store(2, std::memory_order_release);
+    nodalisLog() << "Sharing the process image in " << os << "\n";
+    return true;
+}
+
+void SharedImage::publish(){
+    if(header == nullptr){
+        return;
+    }
+    uint64_t sequence = header->sequence.load(std::memory_order_relaxed);
+    header->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    // Only the bytes of lines that differ are stored, so readers of lines that didn't change aren't disturbed.
+    copyChangedLines(image, MEMORY, nullptr);
+    header->generation++;
+    header->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void SharedImage::close(){
+#ifdef _WIN32
+    if(header != nullptr) UnmapViewOfFile(header);
+    if(mapping != nullptr) CloseHandle(mapping);
+    mapping = nullptr;
+#else
+    if(header != nullptr) munmap(header, bytes);
+    if(!name.empty()) shm_unlink(name.c_str());
+    name.clear();
+#endif
+    header = nullptr;
+    image = nullptr;
+}
+
+static SharedImage SHARED_IMAGE;
+
+bool openSharedImage(const RuntimeOptions& options){
+    if(options.shmImage.empty()){
+        return false;
+    }
+    return SHARED_IMAGE.open(options.shmImage);
+}
+#pragma endregion
+
+void latchInputs(){
+    std::lock_guard<std::mutex> memoryLock(MEMORY_MUTEX);
+    std::lock_guard<std::mutex> lock(IMAGE_MUTEX);
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(MEMORY);
+    bool pending = INPUTS_PENDING.load(std::memory_order_relaxed);
+    uint64_t now = 0;
+    for(const auto& w : STAGED_WRITES){
+        if(w.freshness != nullptr){
+            // The clock is read once, and only when a read from a device is latched.
+            now = now != 0 ? now : elapsedMicros();
+            w.freshness->inputAge.record(now > w.arrived ? now - w.arrived : 0);
+        }
+        if(w.mask != 0){
+            if(w.value) bytes[w.offset] |= w.mask;
+            else bytes[w.offset] &= static_cast<uint8_t>(~w.mask);
+            markImageDirty(w.offset, 1);
+            if(pending && w.offset < INPUT_IMAGE_BYTES){
+                INPUT_PENDING[w.offset].fetch_and(static_cast<uint8_t>(~w.mask), std::memory_order_relaxed);
+            }
+        }
+        else{
+            std::memcpy(bytes + w.offset, &w.value, w.width / 8);
+            markImageDirty(w.offset, w.width / 8);
+            for(size_t b = w.offset; pending && b < w.offset + w.width / 8 && b < INPUT_IMAGE_BYTES; b++){
+                INPUT_PENDING[b].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+    STAGED_WRITES.clear();
+    applyForces();
+    SCAN_NUMBER.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * Time stamps the watched outputs whose value in MEMORY differs from the published image, so that their clients can
+ * measure the delay to the write being acknowledged. MEMORY_MUTEX must be held.
+ * @param published The published image.
+ */
+static void stampOutputChanges(const uint8_t* published){
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(MEMORY);
+    uint64_t now = 0;
+    for(auto* watch : OUTPUT_WATCHES){
+#if NODALIS_DIRTY_TRACKING
+        size_t line = (watch->local.bit > -1 ? watch->local.bitOffset : watch->local.offset) / IMAGE_LINE_BYTES;
+        if((DIRTY_LINES[line >> 6] & (1ull << (line & 63))) == 0){
+            continue;
+        }
+#endif
+        if(watch->local.load(bytes) != watch->local.load(published)){
+            now = now != 0 ? now : elapsedMicros();
+            watch->changedAt.store(now, std::memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * Stamps the lines changed in the image being committed with the current epoch, and starts the next one.
+ */
+static void stampChangedLines(){
+    for(size_t word = 0; word < IMAGE_LINE_WORDS; word++){
+        for(uint64_t bits = CHANGED_LINES[word]; bits != 0; bits &= bits - 1){
+            LINE_EPOCHS[(word << 6) + countTrailingZeros(bits)] = INCREMENTAL.epoch;
+        }
+    }
+    INCREMENTAL.epoch++;
+    INCREMENTAL.full = INCREMENTAL_FULL > 0 && INCREMENTAL.epoch % INCREMENTAL_FULL == 0;
+}
+
+void configureIncremental(const RuntimeOptions& options){
+    INCREMENTAL_FULL = options.incrementalFull;
+    INCREMENTAL.enabled = false;
+    if(!options.incremental){
+        return;
+    }
+    if(options.threadedTasks){
+        // A task worker runs against a private image whose writes aren't marked until it is merged.
+        nodalisLog() << "Incremental evaluation needs the tasks to run on the scan thread, so every rung is evaluated\n";
+        return;
+    }
+#if !NODALIS_DIRTY_TRACKING
+    nodalisLog() << "Incremental evaluation needs dirty tracking, which this build doesn't have, so every rung is evaluated\n";
+#else
+    INCREMENTAL.enabled = true;
+#endif
+}
+
+void commitOutputs(){
+    // MEMORY_MUTEX is held until the image is published, so that enterSafeState() can publish one from another thread.
+    std::lock_guard<std::mutex> memoryLock(MEMORY_MUTEX);
+    // The back buffer is never visible to readers holding the lock, so it can be filled without it. Readers without
+    // the lock may still be finishing with it, and see from the sequence that they must read again.
+    uint64_t* back = PUBLISHED_IMAGE.load(std::memory_order_relaxed) == IMAGE_BUFFERS[0] ? IMAGE_BUFFERS[1] : IMAGE_BUFFERS[0];
+    IMAGE_SEQUENCE.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    {
+        if(FORCES_ACTIVE.load(std::memory_order_relaxed)){
+            std::lock_guard<std::mutex> lock(IMAGE_MUTEX);
+            applyForces();
+        }
+        stampOutputChanges(reinterpret_cast<const uint8_t*>(PUBLISHED_IMAGE.load(std::memory_order_relaxed)));
+        // The back buffer holds the image of two scans ago, so usually only a few of its lines need to be copied.
+        copyChangedLines(back, MEMORY, nullptr);
+        if(SAFE_STATE.load(std::memory_order_relaxed)){
+            std::memset(reinterpret_cast<uint8_t*>(back) + INPUT_IMAGE_BYTES, 0, OUTPUT_IMAGE_BYTES);
+        }
+        captureRetain();
+        SHARED_IMAGE.publish();
+#if NODALIS_DIRTY_TRACKING
+        std::memcpy(CHANGED_LINES, DIRTY_LINES, sizeof(DIRTY_LINES));
+        std::memset(DIRTY_LINES, 0, sizeof(DIRTY_LINES));
+#else
+        markAllLines(CHANGED_LINES);
+#endif
+    }
+    if(INCREMENTAL.enabled){
+        stampChangedLines();
+    }
+    std::lock_guard<std::mutex> lock(IMAGE_MUTEX);
+    PUBLISHED_IMAGE.store(back, std::memory_order_release);
+    IMAGE_SEQUENCE.fetch_add(1, std::memory_order_release);
+    IMAGE_GENERATION.fetch_add(1, std::memory_order_release);
+    // The changes are handed over with the image, so a consumer never sees lines marked that aren't published yet.
+    for(auto* changes : changeSets()){
+        changes->add(CHANGED_LINES);
+    }
+}
+
+void enterSafeState(){
+    if(SAFE_STATE.exchange(true, std::memory_order_acq_rel)){
+        return;
+    }
+    nodalisLog() << "Entering the safe state: the tasks are stopped and the outputs are held at 0\n";
+    {
+        // The scan thread may be stuck in a release, so the last published image is published again with %Q cleared,
+        // rather than MEMORY, which the release may be halfway through writing.
+        std::lock_guard<std::mutex> memoryLock(MEMORY_MUTEX);
+        uint64_t* published = PUBLISHED_IMAGE.load(std::memory_order_relaxed);
+        uint64_t* back = published == IMAGE_BUFFERS[0] ? IMAGE_BUFFERS[1] : IMAGE_BUFFERS[0];
+        IMAGE_SEQUENCE.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(back, published, sizeof(ProcessImage));
+        std::memset(reinterpret_cast<uint8_t*>(back) + INPUT_IMAGE_BYTES, 0, OUTPUT_IMAGE_BYTES);
+        uint64_t outputs[IMAGE_LINE_WORDS] = {};
+        for(size_t line = INPUT_IMAGE_BYTES / IMAGE_LINE_BYTES; line < (INPUT_IMAGE_BYTES + OUTPUT_IMAGE_BYTES) / IMAGE_LINE_BYTES; line++){
+            outputs[line >> 6] |= 1ull << (line & 63);
+        }
+        std::lock_guard<std::mutex> lock(IMAGE_MUTEX);
+        PUBLISHED_IMAGE.store(back, std::memory_order_release);
+        IMAGE_SEQUENCE.fetch_add(1, std::memory_order_release);
+        IMAGE_GENERATION.fetch_add(1, std::memory_order_release);
+        for(auto* changes : changeSets()){
+            changes->add(outputs);
+        }
+    }
+    driveLocalOutputs();
+    wakeScheduler();
+}
+
+bool inSafeState(){
+    return SAFE_STATE.load(std::memory_order_relaxed);
+}
+
+ImageChanges::ImageChanges(){
+    markAllLines(pending);
+    std::memset(taken, 0, sizeof(taken));
+    std::lock_guard<std::mutex> lock(IMAGE_MUTEX);
+    changeSets().push_back(this);
+}
+
+ImageChanges::~ImageChanges(){
+    std::lock_guard<std::mutex> lock(IMAGE_MUTEX);
+    auto& sets = changeSets();
+    for(size_t x = 0; x < sets.size(); x++){
+        if(sets[x] == this){
+            sets.erase(sets.begin() + x);
+            break;
+        }
+    }
+}
+
+void ImageChanges::add(const uint64_t* lines){
+    for(size_t w = 0; w < IMAGE_LINE_WORDS; w++){
+        pending[w] |= lines[w];
+    }
+}
+
+bool ImageChanges::read(const std::function<void(const uint8_t* image, const ImageChanges& changes)>& reader){
+    std::lock_guard<std::mutex> lock(IMAGE_MUTEX);
+    uint64_t any = 0;
+    for(size_t w = 0; w < IMAGE_LINE_WORDS; w++){
+        taken[w] = pending[w];
+        pending[w] = 0;
+        any |= taken[w];
+    }
+    if(any == 0){
+        return false;
+    }
+    reader(reinterpret_cast<const uint8_t*>(PUBLISHED_IMAGE.load(std::memory_order_relaxed)), *this);
+    return true;
+}
+
+void loadImageBytes(size_t offset, const uint8_t* bytes, size_t count){
+    if(count == 0 || offset + count > PROCESS_IMAGE_BYTES){
+        return;
+    }
+    std::lock_guard<std::mutex> memoryLock(MEMORY_MUTEX);
+    std::memcpy(reinterpret_cast<uint8_t*>(MEMORY) + offset, bytes, count);
+#if NODALIS_DIRTY_TRACKING
+    for(size_t line = offset / IMAGE_LINE_BYTES; line <= (offset + count - 1) / IMAGE_LINE_BYTES; line++){
+        DIRTY_LINES[line >> 6] |= 1ull << (line & 63);
+    }
+#endif
+}
+
+uint64_t imageGeneration(){
+    return IMAGE_GENERATION.load(std::memory_order_acquire);
+}
+
+void loadTaskImage(ProcessImage image, ProcessImage snapshot){
+    {
+        std::lock_guard<std::mutex> memoryLock(MEMORY_MUTEX);
+        copyChangedLines(image, MEMORY, nullptr);
+    }
+    copyChangedLines(snapshot, image, nullptr);
+}
+
+void storeTaskImage(const ProcessImage image, const ProcessImage snapshot){
+    std::lock_guard<std::mutex> memoryLock(MEMORY_MUTEX);
+    for(size_t line = 0; line < IMAGE_LINES; line++){
+        // Merge only the bits this task changed, so tasks writing neighbouring bits don't undo each other.
+        size_t word = line * LINE_WORDS;
+        if(mergeLine(MEMORY + word, image + word, snapshot + word)){
+#if NODALIS_DIRTY_TRACKING
+            DIRTY_LINES[line >> 6] |= 1ull << (line & 63);
+#endif
+        }
+    }
+}
+
+GlobalExchange::GlobalExchange(void* buffers, size_t bytes, const GlobalChannel* channels, size_t count)
+    : buffers{static_cast<uint8_t*>(buffers), static_cast<uint8_t*>(buffers) + bytes}, channels(channels),
+      slots(std::make_unique<Slot[]>(count)){
+}
+
+void GlobalExchange::loadChannels(uint8_t* copy, const uint16_t* indices, size_t count){
+    for(size_t x = 0; x < count; x++){
+        const GlobalChannel& channel = channels[indices[x]];
+        Slot& slot = slots[indices[x]];
+        while(true){
+            uint32_t buffer = slot.latest.load(std::memory_order_acquire);
+            uint32_t sequence = slot.sequence[buffer].load(std::memory_order_acquire);
+            if(sequence & 1){
+                // A writer flipped the global twice since, and is on this buffer again; read the one it flipped to.
+                continue;
+            }
+            std::memcpy(copy + channel.offset, buffers[buffer] + channel.offset, channel.bytes);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(slot.sequence[buffer].load(std::memory_order_relaxed) == sequence){
+                break;
+            }
+        }
+    }
+}
+
+void GlobalExchange::storeChannels(const uint8_t* copy, const uint16_t* indices, size_t count){
+    for(size_t x = 0; x < count; x++){
+        const GlobalChannel& channel = channels[indices[x]];
+        Slot& slot = slots[indices[x]];
+        while(slot.writing.exchange(true, std::memory_order_acquire)){
+            std::this_thread::yield();
+        }
+        uint32_t buffer = slot.latest.load(std::memory_order_relaxed) ^ 1;
+        uint32_t sequence = slot.sequence[buffer].load(std::memory_order_relaxed);
+        slot.sequence[buffer].store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(buffers[buffer] + channel.offset, copy + channel.offset, channel.bytes);
+        slot.sequence[buffer].store(sequence + 2, std::memory_order_release);
+        slot.latest.store(buffer, std::memory_order_release);
+        slot.writing.store(false, std::memory_order_release);
+    }
+}
+
+/**
+ * Sets the mask and value bits of a force. IMAGE_MUTEX must be held.
+ * @param force The force.
+ */
+static void setForceBits(const ForceEntry& force){
+    const ResolvedAddress& address = force.address;
+    uint8_t* mask = reinterpret_cast<uint8_t*>(FORCE_MASK);
+    uint8_t* values = reinterpret_cast<uint8_t*>(FORCE_VALUES);
+    if(address.bit > -1){
+        mask[address.bitOffset] |= address.bitMask;
+        if(force.value) values[address.bitOffset] |= address.bitMask;
+        else values[address.bitOffset] &= static_cast<uint8_t>(~address.bitMask);
+    }
+    else{
+        std::memset(mask + address.offset, 0xff, address.width / 8);
+        std::memcpy(values + address.offset, &force.value, address.width / 8);
+    }
+}
+
+/**
+ * Determines whether two addresses share a bit of the image.
+ */
+static bool forcesOverlap(const ResolvedAddress& a, const ResolvedAddress& b){
+    if(a.bit > -1 && b.bit > -1){
+        return a.bitOffset == b.bitOffset && a.bitMask == b.bitMask;
+    }
+    size_t aStart = a.bit > -1 ? a.bitOffset : a.offset;
+    size_t aEnd = a.bit > -1 ? a.bitOffset + 1 : a.offset + a.width / 8;
+    size_t bStart = b.bit > -1 ? b.bitOffset : b.offset;
+    size_t bEnd = b.bit > -1 ? b.bitOffset + 1 : b.offset + b.width / 8;
+    return aStart < bEnd && bStart < aEnd;
+}
+
+/**
+ * Rebuilds the force images from the force list, after forces were taken out of it. IMAGE_MUTEX must be held.
+ */
+static void rebuildForces(){
+    std::memset(FORCE_MASK, 0, sizeof(ProcessImage));
+    for(const auto& force : FORCE_LIST){
+        setForceBits(force);
+    }
+    FORCE_COUNT.store(FORCE_LIST.size(), std::memory_order_relaxed);
+    FORCES_ACTIVE.store(!FORCE_LIST.empty(), std::memory_order_relaxed);
+}
+
+/**
+ * Formats a resolved address as text, such as %QW0 or %IX0.1.
+ */
+static std::string formatAddress(const ResolvedAddress& address){
+    static const char SPACES[] = { 'I', 'Q', 'M' };
+    char width = 'B';
+    switch(address.width){
+        case 8: width = address.bit > -1 ? 'X' : 'B'; break;
+        case 16: width = 'W'; break;
+        case 32: width = 'D'; break;
+        case 64: width = 'L'; break;
+    }
+    std::string text = std::string("%") + SPACES[address.space] + width + std::to_string(address.index);
+    if(address.bit > -1){
+        text += "." + std::to_string(address.bit);
+    }
+    return text;
+}
+
+/**
+ * Resolves a located global by name, or an address.
+ */
+static AddressStatus resolveForceAddress(const std::string& address, ResolvedAddress& resolved){
+    const char* located = findSymbolAddress(address);
+    std::string text = located != nullptr ? located : address;
+    return tryResolveAddress(text, -1, text.find('.') != std::string::npos, resolved);
+}
+
+void forceImage(const ResolvedAddress& address, uint64_t value){
+    std::lock_guard<std::mutex> lock(IMAGE_MUTEX);
+    // Forcing an address again replaces its force, so the list holds one entry per address.
+    for(size_t x = 0; x < FORCE_LIST.size(); x++){
+        const ResolvedAddress& forced = FORCE_LIST[x].address;
+        if(forced.bit == address.bit && forced.width == address.width && forced.offset == address.offset &&
+           forced.bitOffset == address.bitOffset){
+            FORCE_LIST.erase(FORCE_LIST.begin() + x);
+            break;
+        }
+    }
+    FORCE_LIST.push_back(ForceEntry{address, value});
+    setForceBits(FORCE_LIST.back());
+    FORCE_COUNT.store(FORCE_LIST.size(), std::memory_order_relaxed);
+    FORCES_ACTIVE.store(true, std::memory_order_relaxed);
+}
+
+void releaseForce(const ResolvedAddress& address){
+    std::lock_guard<std::mutex> lock(IMAGE_MUTEX);
+    FORCE_LIST.erase(std::remove_if(FORCE_LIST.begin(), FORCE_LIST.end(),
+        [&](const ForceEntry& force){ return forcesOverlap(force.address, address); }), FORCE_LIST.end());
+    rebuildForces();
+}
+
+void releaseAllForces(){
+    std::lock_guard<std::mutex> lock(IMAGE_MUTEX);
+    FORCE_LIST.clear();
+    rebuildForces();
+}
+
+AddressStatus forceAddress(const std::string& address, uint64_t value){
+    ResolvedAddress resolved;
+    AddressStatus status = resolveForceAddress(address, resolved);
+    if(status == AddressStatus::OK){
+        forceImage(resolved, value);
+    }
+    return status;
+}
+
+AddressStatus releaseAddress(const std::string& address){
+    ResolvedAddress resolved;
+    AddressStatus status = resolveForceAddress(address, resolved);
+    if(status == AddressStatus::OK){
+        releaseForce(resolved);
+    }
+    return status;
+}
+
+std::vector<ForcedAddress> listForces(){
+    std::lock_guard<std::mutex> lock(IMAGE_MUTEX);
+    std::vector<ForcedAddress> forces;
+    forces.reserve(FORCE_LIST.size());
+    for(const auto& force : FORCE_LIST){
+        forces.push_back(ForcedAddress{formatAddress(force.address), force.value});
+    }
+    return forces;
+}
+
+size_t forceCount(){
+    return FORCE_COUNT.load(std::memory_order_relaxed);
+}
+
+uint64_t readImage(const ResolvedAddress& address){
+    while(true){
+        uint64_t sequence = IMAGE_SEQUENCE.load(std::memory_order_acquire);
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(PUBLISHED_IMAGE.load(std::memory_order_acquire));
+        uint64_t value = address.load(bytes);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        // If the buffer could have been refilled while it was read, the value may be torn, so it is read again.
+        if(IMAGE_SEQUENCE.load(std::memory_order_relaxed) - sequence <= 1){
+            return value;
+        }
+    }
+}
+
+void readImage(const std::function<void(const uint8_t* image)>& reader){
+    std::lock_guard<std::mutex> lock(IMAGE_MUTEX);
+    reader(reinterpret_cast<const uint8_t*>(PUBLISHED_IMAGE.load(std::memory_order_relaxed)));
+}
+
+/**
+ * Stages a write. IMAGE_MUTEX must be held.
+ * @param address The resolved address to write.
+ * @param value The value to write.
+ */
+static void stageWrite(const ResolvedAddress& address, uint64_t value, MappingFreshness* freshness = nullptr, uint64_t arrived = 0){
+    StagedWrite w;
+    if(address.bit > -1){
+        w = { address.bitOffset, 1, address.bitMask, value != 0 ? 1u : 0u, freshness, arrived };
+    }
+    else{
+        w = { address.offset, address.width, 0, value, freshness, arrived };
+    }
+    // Only the latest value of each location matters, so replace an earlier write instead of queueing another.
+    for(auto& staged : STAGED_WRITES){
+        if(staged.offset == w.offset && staged.width == w.width && staged.mask == w.mask){
+            if(staged.freshness != nullptr){
+                staged.freshness->superseded.fetch_add(1, std::memory_order_relaxed);
+            }
+            staged.value = w.value;
+            staged.freshness = w.freshness;
+            staged.arrived = w.arrived;
+            return;
+        }
+    }
+    STAGED_WRITES.push_back(w);
+}
+
+void writeImage(const ResolvedAddress& address, uint64_t value){
+    if(IO_CAPTURING.load(std::memory_order_relaxed)){
+        captureInput(address, value);
+    }
+    {
+        std::lock_guard<std::mutex> lock(IMAGE_MUTEX);
+        stageWrite(address, value);
+    }
+    wakeScheduler();
+}
+
+void writeImage(const ResolvedAddress* addresses, const uint64_t* values, size_t count){
+    if(IO_CAPTURING.load(std::memory_order_relaxed)){
+        for(size_t i = 0; i < count; i++){
+            captureInput(addresses[i], values[i]);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(IMAGE_MUTEX);
+        for(size_t i = 0; i < count; i++){
+            stageWrite(addresses[i], values[i]);
+        }
+    }
+    wakeScheduler();
+}
+
+void writeImage(const ResolvedAddress* addresses, const uint64_t* values, MappingFreshness* const* freshness,
+    uint64_t arrived, size_t count){
+    if(IO_CAPTURING.load(std::memory_order_relaxed)){
+        for(size_t i = 0; i < count; i++){
+            captureInput(addresses[i], values[i]);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(IMAGE_MUTEX);
+        for(size_t i = 0; i < count; i++){
+            stageWrite(addresses[i], values[i], freshness[i], arrived);
+        }
+    }
+    wakeScheduler();
+}
+
+void markInputPending(const ResolvedAddress& address){
+    if(address.space != MEMORY_SPACE::I){
+        return;
+    }
+    if(address.bit > -1){
+        INPUT_PENDING[address.bitOffset].fetch_or(address.bitMask, std::memory_order_relaxed);
+    }
+    else{
+        for(size_t b = address.offset; b < address.offset + address.width / 8 && b < INPUT_IMAGE_BYTES; b++){
+            INPUT_PENDING[b].store(0xFF, std::memory_order_relaxed);
+        }
+    }
+    INPUTS_PENDING.store(true, std::memory_order_relaxed);
+}
+
+bool isInputGood(const ResolvedAddress& address){
+    if(address.space != MEMORY_SPACE::I || !INPUTS_PENDING.load(std::memory_order_relaxed)){
+        return true;
+    }
+    if(address.bit > -1){
+        return (INPUT_PENDING[address.bitOffset].load(std::memory_order_relaxed) & address.bitMask) == 0;
+    }
+    for(size_t b = address.offset; b < address.offset + address.width / 8 && b < INPUT_IMAGE_BYTES; b++){
+        if(INPUT_PENDING[b].load(std::memory_order_relaxed) != 0){
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * The slots of the quality plane by the address of their input: the offset, the width and the bit.
+ */
+static std::unordered_map<uint64_t, uint32_t> QUALITY_SLOTS;
+static std::mutex QUALITY_MUTEX;
+
+/**
+ * Gets the key of an input in QUALITY_SLOTS.
+ * @param address The resolved address of the input.
+ * @returns Returns the key.
+ */
+static uint64_t qualityKey(const ResolvedAddress& address){
+    if(address.bit > -1){
+        return (static_cast<uint64_t>(address.bitOffset) << 16) | static_cast<uint64_t>(address.bit + 1);
+    }
+    return (static_cast<uint64_t>(address.offset) << 16) | (static_cast<uint64_t>(address.width) << 8);
+}
+
+uint32_t allocateQualitySlot(const ResolvedAddress& address){
+    std::lock_guard<std::mutex> lock(QUALITY_MUTEX);
+    auto found = QUALITY_SLOTS.find(qualityKey(address));
+    if(found != QUALITY_SLOTS.end()){
+        return found->second;
+    }
+    uint32_t slot = static_cast<uint32_t>(QUALITY_SLOTS.size());
+    if(slot / QUALITY_BLOCK_SLOTS >= QUALITY_BLOCKS){
+        return NO_QUALITY_SLOT;
+    }
+    if(slot % QUALITY_BLOCK_SLOTS == 0){
+        QualityBlock* block = new QualityBlock();
+        for(size_t x = 0; x < QUALITY_BLOCK_SLOTS; x++){
+            block->status[x].store(static_cast<uint8_t>(IOQuality::CommFail), std::memory_order_relaxed);
+            block->scan[x].store(0, std::memory_order_relaxed);
+            block->time[x].store(0, std::memory_order_relaxed);
+        }
+        QUALITY_PLANE[slot / QUALITY_BLOCK_SLOTS].store(block, std::memory_order_release);
+    }
+    QUALITY_SLOTS.emplace(qualityKey(address), slot);
+    return slot;
+}
+
+uint32_t findQualitySlot(const ResolvedAddress& address){
+    std::lock_guard<std::mutex> lock(QUALITY_MUTEX);
+    auto found = QUALITY_SLOTS.find(qualityKey(address));
+    return found == QUALITY_SLOTS.end() ? NO_QUALITY_SLOT : found->second;
+}
+
+void setInputQuality(uint32_t slot, IOQuality quality, int64_t now){
+    QualityBlock* block = qualityBlock(slot);
+    if(block == nullptr){
+        return;
+    }
+    if(quality != IOQuality::Good && IO_CAPTURING.load(std::memory_order_relaxed)){
+        captureQuality(slot, quality);
+    }
+    size_t index = slot % QUALITY_BLOCK_SLOTS;
+    if(quality == IOQuality::Good){
+        if(now == 0){
+            now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+        block->scan[index].store(SCAN_NUMBER.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        block->time[index].store(now, std::memory_order_relaxed);
+    }
+    // An input that was never read has no earlier value to be stale, so it stays CommFail until it is.
+    else if(quality == IOQuality::Stale && block->scan[index].load(std::memory_order_relaxed) == 0){
+        return;
+    }
+    if(block->status[index].load(std::memory_order_relaxed) != static_cast<uint8_t>(quality)){
+        block->status[index].store(static_cast<uint8_t>(quality), std::memory_order_relaxed);
+        QUALITY_CHANGES.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+uint64_t readImage(const std::string& address){
+    bool isBit = address.find('.') != std::string::npos;
+    return readImage(resolveAddress(address, -1, isBit));
+}
+
+void writeImage(const std::string& address, uint64_t value){
+    bool isBit = address.find('.') != std::string::npos;
+    writeImage(resolveAddress(address, -1, isBit), value);
+}
+
+// The reactors are defined before the clients, so that they outlive the clients that are attached to them.
+static std::vector<std::unique_ptr<IOReactor>> REACTORS;
+static size_t NEXT_REACTOR = 0;
+std::vector<std::unique_ptr<IOClient>> Clients;
+
+// Adaptive polling, as set by --adaptive-poll and --poll-budget.
+static bool ADAPTIVE_POLL = false;
+static uint64_t POLL_BUDGET = 0;
+// How many times its PollTime an input polled with --adaptive-poll may back off to.
+static constexpr int ADAPTIVE_MAX_FACTOR = 8;
+// The unchanged polls after which an adaptive interval doubles.
+static constexpr uint32_t ADAPTIVE_QUIET_POLLS = 4;
+// A device is saturated when its recent round trip time is this many times its baseline, and this much longer.
+static constexpr uint64_t ADAPTIVE_SATURATION_FACTOR = 3;
+static constexpr uint64_t ADAPTIVE_SATURATION_MICROS = 2000;
+// Polling in step with the tasks, as set by --io-phase and --io-phase-margin. The margin is in microseconds.
+static bool IO_PHASE = false;
+static uint64_t IO_PHASE_MARGIN = 1000;
+// The default request scheduling of the devices, as set by --io-request-rate, --io-byte-rate and --io-batch-limit.
+static double IO_REQUEST_RATE = 0;
+static double IO_BYTE_RATE = 0;
+static size_t IO_BATCH_LIMIT = 0;
+
+void configureAdaptivePolling(const RuntimeOptions& options){
+    ADAPTIVE_POLL = options.adaptivePoll;
+    POLL_BUDGET = options.pollBudget > 0 ? static_cast<uint64_t>(options.pollBudget) : 0;
+    IO_PHASE = options.ioPhase;
+    IO_PHASE_MARGIN = options.ioPhaseMargin > 0 ? static_cast<uint64_t>(options.ioPhaseMargin) * 1000 : 0;
+    IO_REQUEST_RATE = options.ioRequestRate > 0 ? options.ioRequestRate : 0;
+    IO_BYTE_RATE = options.ioByteRate > 0 ? options.ioByteRate : 0;
+    IO_BATCH_LIMIT = options.ioBatchLimit > 0 ? static_cast<size_t>(options.ioBatchLimit) : 0;
+}
+
+TaskPhase* taskPhase(const std::string& name){
+    static std::mutex phaseMutex;
+    static std::map<std::string, std::unique_ptr<TaskPhase>> phases;
+    std::lock_guard<std::mutex> lock(phaseMutex);
+    std::unique_ptr<TaskPhase>& phase = phases[name];
+    if(!phase){
+        phase.reset(new TaskPhase());
+    }
+    return phase.get();
+}
+
+void TaskPhase::flush(){
+    completions.fetch_add(1, std::memory_order_release);
+    std::lock_guard<std::mutex> lock(clientMutex);
+    for(IOClient* client : clients){
+        client->requestFlush();
+    }
+}
+
+IOMap::IOMap(std::string mapJson){
+    json j = json::parse(mapJson);
+    moduleID = j["ModuleID"];
+    modulePort = j["ModulePort"];
+    localAddress = j["InternalAddress"];
+    remoteAddress = j["RemoteAddress"];
+    width = std::atoi(j["RemoteSize"].get<std::string>().c_str());
+    interval = std::atoi(j["PollTime"].get<std::string>().c_str());
+    protocol = j["Protocol"];
+    // The properties are kept as JSON text, whether they were given as an object or as a string of JSON.
+    const json& properties = j["ProtocolProperties"];
+    additionalProperties = properties.is_string() ? properties.get<std::string>() : properties.is_null() ? "" : properties.dump();
+    if(localAddress.find("%Q") != std::string::npos){
+        direction = IOType::Output;
+    }
+    else{
+        direction = IOType::Input;
+    }
+    local = resolveAddress(localAddress, width == 1 ? -1 : width, width == 1);
+    // Optional report-by-exception settings for outputs, given as numbers or strings like the other fields.
+    if(j.contains("Deadband")){
+        deadband = j["Deadband"].is_string() ? std::strtoull(j["Deadband"].get<std::string>().c_str(), nullptr, 10) : j["Deadband"].get<uint64_t>();
+    }
+    if(j.contains("RefreshTime")){
+        refreshTime = j["RefreshTime"].is_string() ? std::atoi(j["RefreshTime"].get<std::string>().c_str()) : j["RefreshTime"].get<int>();
+    }
+    if(j.contains("MinPollTime")){
+        minInterval = j["MinPollTime"].is_string() ? std::atoi(j["MinPollTime"].get<std::string>().c_str()) : j["MinPollTime"].get<int>();
+    }
+    if(j.contains("MaxPollTime")){
+        maxInterval = j["MaxPollTime"].is_string() ? std::atoi(j["MaxPollTime"].get<std::string>().c_str()) : j["MaxPollTime"].get<int>();
+    }
+    if(j.contains("Task") && j["Task"].is_string()){
+        task = j["Task"].get<std::string>();
+    }
+    lastPoll = elapsed();
+}
+
+IOMap::IOMap(const IOMapDefinition& row) :
+    moduleID(row.moduleID), modulePort(row.modulePort), protocol(row.protocol), additionalProperties(row.properties),
+    remoteAddress(row.remoteAddress), localAddress(row.localAddress), width(row.width), interval(row.interval),
+    definition(row.definition), deadband(row.deadband), refreshTime(row.refreshTime), minInterval(row.minInterval),
+    maxInterval(row.maxInterval), task(row.task ? row.task : ""){
+    direction = localAddress.find("%Q") != std::string::npos ? IOType::Output : IOType::Input;
+    // The compiler resolves and checks the address of each row of its table.
+    local = row.local.space >= 0 ? row.local : resolveAddress(localAddress, width == 1 ? -1 : width, width == 1);
+    lastPoll = elapsed();
+}
+
+IOMap::IOMap(){
+
+}
+
+IOClient::IOClient(const std::string& protocol) : protocol(protocol) {
+    connected = false;
+}
+
+IOClient::~IOClient() {
+    stop();
+    std::lock_guard<std::mutex> lock(MEMORY_MUTEX);
+    for(auto& mapping : freshness){
+        OUTPUT_WATCHES.erase(std::remove(OUTPUT_WATCHES.begin(), OUTPUT_WATCHES.end(), mapping.get()), OUTPUT_WATCHES.end());
+    }
+}
+
+void IOClient::start() {
+    if(!running){
+        running = true;
+        worker = std::thread(&IOClient::runWorker, this);
+    }
+}
+
+void IOClient::stop() {
+    if(running){
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            running = false;
+        }
+        wakeSignal.notify_all();
+        if(worker.joinable()){
+            worker.join();
+        }
+    }
+    if(connector.joinable()){
+        connector.join();
+    }
+    // The tasks stop waking the client once it is stopped.
+    std::lock_guard<std::mutex> lock(mappingMutex);
+    for(size_t index : flushClasses){
+        TaskPhase* phase = pollClasses[index].phase;
+        std::lock_guard<std::mutex> phaseLock(phase->clientMutex);
+        phase->clients.erase(std::remove(phase->clients.begin(), phase->clients.end(), this), phase->clients.end());
+    }
+    flushClasses.clear();
+}
+
+void IOClient::requestFlush() {
+    flushPending.store(true, std::memory_order_release);
+    wake();
+}
+
+void IOClient::wake() {
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+    }
+    wakeSignal.notify_all();
+}
+
+bool IOClient::connectInBackground() {
+    if(connecting.load(std::memory_order_acquire)){
+        return false;
+    }
+    if(connected){
+        return true;
+    }
+    if(lastAttempt != 0 && elapsed() - lastAttempt < reconnectDelay){
+        return false;
+    }
+    if(connector.joinable()){
+        connector.join();
+    }
+    lastAttempt = elapsed();
+    connecting.store(true, std::memory_order_release);
+    connector = std::thread([this](){
+        moveToBackground();
+        {
+            std::lock_guard<std::mutex> lock(mappingMutex);
+            NODALIS_TRACE_SCOPE(TraceCategory::Connect, protocol.c_str(), moduleID.c_str());
+            NODALIS_TRY{
+                connect();
+            }
+            NODALIS_CATCH(e){
+                nodalisLog() << "Caught exception: " << e.what() << "\n";
+            }
+            connectAttempted(connected);
+        }
+        connecting.store(false, std::memory_order_release);
+    });
+    return false;
+}
+
+uint64_t IOClient::nextPollDue() {
+    std::lock_guard<std::mutex> lock(mappingMutex);
+    if(!connected){
+        return lastAttempt == 0 ? 0 : lastAttempt + reconnectDelay;
+    }
+    if(flushPending.load(std::memory_order_acquire)){
+        return 0;
+    }
+    uint64_t due = pollQueue.empty() ? UINT64_MAX : pollQueue.top().first;
+    // Mappings the scheduler holds back are sent as soon as their device's budget allows.
+    if(scheduler){
+        uint64_t ready = scheduler->nextReady(elapsed());
+        due = ready < due ? ready : due;
+    }
+    return due;
+}
+
+void IOClient::runWorker() {
+    moveToBackground();
+    NODALIS_TRACE_THREAD("IO." + protocol + "." + moduleID);
+    ExecutionStats& stats = registerStats("IO." + protocol + "." + moduleID);
+    while(running){
+        auto start = std::chrono::steady_clock::now();
+        NODALIS_TRY{
+            poll();
+        }
+        NODALIS_CATCH(e){
+            nodalisLog() << "Caught exception: " << e.what() << "\n";
+        }
+        stats.record(microsBetween(start, std::chrono::steady_clock::now()));
+        // Sleep in short steps so that newly added mappings are noticed quickly. stop() and requestFlush() wake it.
+        uint64_t now = elapsed();
+        uint64_t due = nextPollDue();
+        uint64_t wait = due > now ? due - now : 0;
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        wakeSignal.wait_for(lock, std::chrono::milliseconds(wait < 100 ? wait : 100), [this](){
+            return !running || flushPending.load(std::memory_order_acquire);
+        });
+    }
+}
+
+void IOClient::addMapping(const IOMap& map) {
+    std::lock_guard<std::mutex> lock(mappingMutex);
+    if(!hasMappingLocked(map.localAddress)){
+        DIAGNOSTIC_AT(LogSeverity::Info, "Adding map for " << map.moduleID << ":" << map.modulePort << "->" << map.localAddress);
+        appendMappingLocked(map);
+    }
+}
+
+void IOClient::addMappings(const IOMap* maps, size_t count) {
+    std::lock_guard<std::mutex> lock(mappingMutex);
+    mappings.reserve(mappings.size() + count);
+    mappingIndex.reserve(mappings.size() + count);
+    {
+        std::lock_guard<std::mutex> outputLock(outputMutex);
+        outputs.reserve(outputs.size() + count);
+    }
+    for(size_t x = 0; x < count; x++){
+        appendMappingLocked(maps[x]);
+    }
+}
+
+void IOClient::appendMappingLocked(const IOMap& map) {
+    if(mappings.size() == 0){
+        moduleID = map.moduleID;
+        modulePort = map.modulePort;
+        endpoint = endpointKey(map);
+    }
+    mappingIndex.emplace(map.localAddress, mappings.size());
+    mappings.push_back(map);
+    if(map.direction == IOType::Input){
+        markInputPending(map.local);
+        mappings.back().quality = allocateQualitySlot(map.local);
+    }
+    int interval = map.interval > 0 ? map.interval : 1;
+    AdaptiveState state;
+    if(map.direction == IOType::Input && (map.minInterval > 0 || map.maxInterval > 0)){
+        state.minInterval = map.minInterval > 0 && map.minInterval < interval ? map.minInterval : interval;
+        state.maxInterval = map.maxInterval > interval ? map.maxInterval : interval;
+    }
+    else if(map.direction == IOType::Input && ADAPTIVE_POLL){
+        state.minInterval = interval;
+        state.maxInterval = interval * ADAPTIVE_MAX_FACTOR;
+    }
+    // A mapping polled in step with its task keeps to the task's schedule rather than adapting.
+    TaskPhase* phase = IO_PHASE && !map.task.empty() ? taskPhase(map.task) : nullptr;
+    if(phase){
+        state = AdaptiveState();
+    }
+    if(state.maxInterval > state.minInterval){
+        state.interval = interval;
+        adaptiveCount++;
+    }
+    adaptive.push_back(state);
+    // A new class is due right away; a mapping joining an existing class is first polled with it.
+    size_t pollClass = phase ? pollClassFor(phase, map.direction == IOType::Output, interval) : pollClassFor(interval, 0);
+    pollClasses[pollClass].members.push_back(mappings.size() - 1);
+    {
+        std::lock_guard<std::mutex> outputLock(outputMutex);
+        outputs.emplace_back();
+        if(map.direction == IOType::Input){
+            inputSlots.push_back(mappings.back().quality);
+        }
+    }
+    onMappingAdded(mappings.back());
+    scheduleMappingLocked(mappings.size() - 1);
+    // The client may name itself after another part of its endpoint once it has seen its first mapping.
+    if(mappings.size() == 1){
+        counters.latency.store(&registerStats("IO." + protocol + "." + moduleID + ".Latency"), std::memory_order_release);
+    }
+    freshness.push_back(std::make_unique<MappingFreshness>("IO." + protocol + "." + moduleID + "." + map.localAddress,
+        map.local, map.direction == IOType::Output));
+    if(map.direction == IOType::Output){
+        std::lock_guard<std::mutex> lock(MEMORY_MUTEX);
+        OUTPUT_WATCHES.push_back(freshness.back().get());
+    }
+}
+
+/**
+ * Reads a number from the protocol properties, given as a number or a string.
+ * @param config The protocol properties.
+ * @param name The name of the property.
+ * @returns Returns the number, or -1 if the property isn't present.
+ */
+static double scheduleProperty(const json& config, const char* name){
+    if(!config.is_object() || !config.contains(name)){
+        return -1;
+    }
+    const json& value = config[name];
+    return value.is_string() ? std::atof(value.get<std::string>().c_str()) : value.is_number() ? value.get<double>() : -1;
+}
+
+void IOClient::scheduleMappingLocked(size_t index) {
+    const IOMap& map = mappings[index];
+    // The properties are parsed only if they may hold scheduling settings, since most mappings have none.
+    const std::string& text = map.additionalProperties;
+    bool scheduled = text.find("Priority") != std::string::npos || text.find("Rate") != std::string::npos
+        || text.find("Weight") != std::string::npos;
+    if(!scheduler && !scheduled && IO_REQUEST_RATE == 0 && IO_BYTE_RATE == 0 && IO_BATCH_LIMIT == 0){
+        return;
+    }
+    json config = scheduled || text.find("UnitID") != std::string::npos ? protocolProperties(map) : json();
+    IOPriority priority = IOPriority::Normal;
+    if(config.is_object() && config.contains("Priority") && config["Priority"].is_string()
+        && !parseIOPriority(config["Priority"].get<std::string>(), priority)){
+        nodalisLog() << protocol << " " << map.localAddress << ": Priority must be Critical, High, Normal or Low\n";
+    }
+    if(!scheduler){
+        scheduler.reset(new IORequestScheduler(IO_REQUEST_RATE, IO_BYTE_RATE, IO_BATCH_LIMIT));
+        // The mappings added before the first that asked for scheduling join it with the defaults.
+        for(size_t earlier = 0; earlier < index; earlier++){
+            json earlierConfig = protocolProperties(mappings[earlier]);
+            std::string device = mappings[earlier].moduleID;
+            if(earlierConfig.is_object() && earlierConfig.contains("UnitID")){
+                device += "/" + (earlierConfig["UnitID"].is_string() ? earlierConfig["UnitID"].get<std::string>() : earlierConfig["UnitID"].dump());
+            }
+            scheduler->add(earlier, mappings[earlier], IOPriority::Normal, device, -1, -1, -1);
+        }
+    }
+    // The units behind a gateway, and the slaves of a serial line, are each a device of their own.
+    std::string device = map.moduleID;
+    if(config.is_object() && config.contains("UnitID")){
+        device += "/" + (config["UnitID"].is_string() ? config["UnitID"].get<std::string>() : config["UnitID"].dump());
+    }
+    scheduler->add(index, map, priority, device, scheduleProperty(config, "RequestRate"), scheduleProperty(config, "ByteRate"),
+        scheduleProperty(config, "Weight"));
+}
+
+size_t IOClient::pollClassFor(int interval, uint64_t due) {
+    auto it = classByInterval.find(interval);
+    if(it == classByInterval.end()){
+        it = classByInterval.insert({ interval, pollClasses.size() }).first;
+        pollClasses.push_back({ interval, due, {} });
+        pollQueue.push({ due, it->second });
+    }
+    return it->second;
+}
+
+size_t IOClient::pollClassFor(TaskPhase* phase, bool output, int interval) {
+    auto it = classByTask.find({ phase, output });
+    if(it == classByTask.end()){
+        it = classByTask.insert({ { phase, output }, pollClasses.size() }).first;
+        PollClass pollClass{ interval, 0, {} };
+        pollClass.phase = phase;
+        pollClass.flushed = phase->completions.load(std::memory_order_acquire);
+        pollClasses.push_back(pollClass);
+        pollQueue.push({ 0, it->second });
+        if(output){
+            flushClasses.push_back(it->second);
+            std::lock_guard<std::mutex> lock(phase->clientMutex);
+            phase->clients.push_back(this);
+        }
+    }
+    else if(interval < pollClasses[it->second].interval){
+        pollClasses[it->second].interval = interval;
+    }
+    return it->second;
+}
+
+uint64_t IOClient::phaseDue(const PollClass& pollClass, uint64_t now) {
+    uint64_t period = pollClass.phase->interval.load(std::memory_order_acquire);
+    // Outputs are written when the task completes and refreshed in between, and the inputs of a task that has no
+    // schedule keep their interval.
+    if(period == 0 || mappings[pollClass.members.front()].direction == IOType::Output){
+        return pollClass.nextDue + pollClass.interval > now ? pollClass.nextDue + pollClass.interval : now + pollClass.interval;
+    }
+    uint64_t release = pollClass.phase->nextRelease.load(std::memory_order_acquire);
+    uint64_t lead = rttRecent.load(std::memory_order_relaxed) + IO_PHASE_MARGIN;
+    uint64_t start = release > lead ? release - lead : 0;
+    // The read for the release that is next was just made if its start has passed, so the one after is due. The queue
+    // counts whole milliseconds, so the start must be past the current one.
+    uint64_t current = now * 1000 + 999;
+    if(start <= current){
+        start += ((current - start) / period + 1) * period;
+    }
+    return start / 1000;
+}
+
+bool IOClient::hasMapping(std::string localAddress){
+    std::lock_guard<std::mutex> lock(mappingMutex);
+    return hasMappingLocked(localAddress);
+}
+
+bool IOClient::hasMappingLocked(const std::string& localAddress){
+    return mappingIndex.count(localAddress) > 0;
+}
+
+bool IOClient::findOutput(const ResolvedAddress& local, size_t& mapping){
+    std::lock_guard<std::mutex> lock(mappingMutex);
+    for(size_t index = 0; index < mappings.size(); index++){
+        if(mappings[index].direction == IOType::Output && mappings[index].local == local){
+            mapping = index;
+            return true;
+        }
+    }
+    return false;
+}
+
+void IOClient::writeOutputNow(size_t mapping, const ResolvedAddress& local, uint64_t value){
+    (void)local;
+    {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        // Two publishes: the scan running now may commit without the staged value, and the next one latches it.
+        uint64_t generation = imageGeneration() + 2;
+        auto held = std::find_if(holds.begin(), holds.end(), [&](const OutputHold& hold){ return hold.mapping == mapping; });
+        if(held == holds.end()){
+            holds.push_back(OutputHold{ mapping, value, generation, false });
+        }
+        else{
+            *held = OutputHold{ mapping, value, generation, false };
+        }
+    }
+    holdPending.store(true, std::memory_order_release);
+    wake();
+}
+
+uint64_t IOClient::heldValue(size_t index, uint64_t value){
+    if(holds.empty()){
+        return value;
+    }
+    uint64_t generation = imageGeneration();
+    holds.erase(std::remove_if(holds.begin(), holds.end(), [&](const OutputHold& hold){
+        return hold.sent && generation >= hold.generation;
+    }), holds.end());
+    for(const auto& hold : holds){
+        if(hold.mapping == index){
+            return hold.value;
+        }
+    }
+    return value;
+}
+
+const std::string& IOClient::getProtocol() const {
+    return protocol;
+}
+
+const std::string& IOClient::getModuleID() const {
+    return moduleID;
+}
+
+const std::string& IOClient::getModulePort() const {
+    return modulePort;
+}
+
+const std::string& IOClient::getEndpoint() const {
+    return endpoint;
+}
+
+const IOCounters& IOClient::getCounters() const {
+    return counters;
+}
+
+void IOClient::requestCompleted(bool succeeded, uint64_t micros) {
+    counters.requests.fetch_add(1, std::memory_order_relaxed);
+    if(IO_CAPTURING.load(std::memory_order_relaxed)){
+        captureRequest(this, succeeded, micros);
+    }
+    if(!succeeded){
+        counters.errors.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    ExecutionStats* latency = counters.latency.load(std::memory_order_acquire);
+    if(latency != nullptr){
+        latency->record(micros);
+    }
+    // The requests of a client complete one at a time, so the averages are updated without a compare and swap.
+    uint64_t recent = rttRecent.load(std::memory_order_relaxed);
+    rttRecent.store(recent == 0 ? micros : recent - recent / 8 + micros / 8, std::memory_order_relaxed);
+    uint64_t baseline = rttBaseline.load(std::memory_order_relaxed);
+    rttBaseline.store(baseline == 0 || micros < baseline ? micros : baseline + (micros - baseline) / 256, std::memory_order_relaxed);
+}
+
+void IOClient::poll() {
+    NODALIS_TRACE_SCOPE(TraceCategory::IO, protocol.c_str(), moduleID.c_str());
+    std::lock_guard<std::mutex> lock(mappingMutex);
+    if(connected){
+        collectDue(dueMappings);
+        if(!dueMappings.empty()){
+            pollMappings(dueMappings);
+        }
+    }
+    else if(lastAttempt == 0 || elapsed() - lastAttempt >= reconnectDelay){
+        lastAttempt = elapsed();
+        NODALIS_TRACE_SCOPE(TraceCategory::Connect, protocol.c_str(), moduleID.c_str());
+        connect();
+        connectAttempted(connected);
+    }
+}
+
+void IOClient::collectDue(std::vector<IOMap*>& due) {
+    due.clear();
+    uint64_t now = elapsed();
+    bool constrained = adaptiveCount > 0 && pollConstrained(now);
+    // The outputs of the tasks that completed a release are due now. The entry a class had in the queue is left, and
+    // skipped when it comes up, since it no longer matches when the class is due.
+    if(flushPending.exchange(false, std::memory_order_acq_rel)){
+        for(size_t index : flushClasses){
+            PollClass& pollClass = pollClasses[index];
+            uint64_t completions = pollClass.phase->completions.load(std::memory_order_acquire);
+            if(completions != pollClass.flushed && pollClass.nextDue > now){
+                pollClass.nextDue = now;
+                pollQueue.push({ now, index });
+            }
+            pollClass.flushed = completions;
+        }
+    }
+    int classes = 0;
+    while(!pollQueue.empty() && pollQueue.top().first <= now){
+        size_t index = pollQueue.top().second;
+        uint64_t queued = pollQueue.top().first;
+        pollQueue.pop();
+        PollClass& pollClass = pollClasses[index];
+        if(queued != pollClass.nextDue){
+            continue;
+        }
+        for(size_t member : pollClass.members){
+            mappings[member].lastPoll = now;
+            if(mappings[member].direction == IOType::Output && !outputDue(member, now)){
+                continue;
+            }
+            if(adaptive[member].interval > 0){
+                adaptInterval(member, constrained);
+            }
+            due.push_back(&mappings[member]);
+        }
+        // Keep to the class's schedule, unless polls were missed, in which case restart it from now.
+        if(pollClass.phase){
+            pollClass.nextDue = phaseDue(pollClass, now);
+        }
+        else{
+            pollClass.nextDue += pollClass.interval;
+            if(pollClass.nextDue <= now){
+                pollClass.nextDue = now + pollClass.interval;
+            }
+        }
+        pollQueue.push({ pollClass.nextDue, index });
+        classes++;
+    }
+    // A mapping whose interval changed moves to the class of its new interval, and is next due with it.
+    for(const auto& move : adaptiveMoves){
+        std::vector<size_t>& from = pollClasses[classByInterval[move.second]].members;
+        from.erase(std::find(from.begin(), from.end(), move.first));
+        int interval = adaptive[move.first].interval;
+        std::vector<size_t>& to = pollClasses[pollClassFor(interval, now + interval)].members;
+        to.insert(std::lower_bound(to.begin(), to.end(), move.first), move.first);
+    }
+    adaptiveMoves.clear();
+    // The scheduler sends the Critical mappings and what the budgets of the devices allow, and queues the rest.
+    if(scheduler){
+        size_t deferred = scheduler->admit(due, mappings.data(), now);
+        counters.deferrals.fetch_add(deferred, std::memory_order_relaxed);
+        classes = due.empty() ? 0 : 1;
+    }
+    // The outputs writeOutputNow() holds are due now, whether or not their class is.
+    if(holdPending.exchange(false, std::memory_order_acq_rel)){
+        heldDue.clear();
+        {
+            std::lock_guard<std::mutex> lock(outputMutex);
+            for(auto& hold : holds){
+                if(!hold.sent){
+                    hold.sent = true;
+                    heldDue.push_back(hold.mapping);
+                }
+            }
+        }
+        for(size_t index : heldDue){
+            IOMap* map = &mappings[index];
+            if(std::find(due.begin(), due.end(), map) == due.end() && outputDue(index, now)){
+                due.push_back(map);
+                classes++;
+            }
+        }
+    }
+    if(classes > 1){
+        std::sort(due.begin(), due.end());
+    }
+}
+
+void IOClient::adaptInterval(size_t index, bool constrained) {
+    AdaptiveState& state = adaptive[index];
+    // The image holds what the previous poll read, once a scan has latched it.
+    uint64_t value = readImage(mappings[index].local);
+    bool changed = state.seen && value != state.value;
+    state.value = value;
+    state.seen = true;
+    int interval = state.interval;
+    if(changed){
+        state.quiet = 0;
+        if(!constrained){
+            interval = interval / 2 < state.minInterval ? state.minInterval : interval / 2;
+        }
+    }
+    // A constrained device backs off after every unchanged poll rather than after a few.
+    else if(++state.quiet >= (constrained ? 1u : ADAPTIVE_QUIET_POLLS)){
+        state.quiet = 0;
+        interval = interval > state.maxInterval / 2 ? state.maxInterval : interval * 2;
+    }
+    if(interval != state.interval){
+        (interval > state.interval ? counters.backoffs : counters.speedups).fetch_add(1, std::memory_order_relaxed);
+        adaptiveMoves.push_back({ index, state.interval });
+        state.interval = interval;
+    }
+}
+
+bool IOClient::pollConstrained(uint64_t now) {
+    uint64_t recent = rttRecent.load(std::memory_order_relaxed);
+    uint64_t baseline = rttBaseline.load(std::memory_order_relaxed);
+    bool nowSaturated = baseline > 0 && recent > baseline * ADAPTIVE_SATURATION_FACTOR && recent - baseline > ADAPTIVE_SATURATION_MICROS;
+    if(nowSaturated != saturated){
+        saturated = nowSaturated;
+        if(saturated){
+            counters.saturations.fetch_add(1, std::memory_order_relaxed);
+            DIAGNOSTIC_AT(LogSeverity::Warning, protocol << " " << moduleID << " is saturated: round trips take " << recent
+                << " us against " << baseline << " us, so polling slows down");
+        }
+    }
+    if(POLL_BUDGET > 0 && now - budgetStart >= 1000){
+        uint64_t requests = counters.requests.load(std::memory_order_relaxed);
+        requestRate = budgetStart == 0 ? 0 : (requests - budgetRequests) * 1000 / (now - budgetStart);
+        budgetStart = now;
+        budgetRequests = requests;
+    }
+    return saturated || (POLL_BUDGET > 0 && requestRate > POLL_BUDGET);
+}
+
+bool IOClient::outputDue(size_t index, uint64_t now) {
+    const IOMap& map = mappings[index];
+    uint64_t value = readImage(map.local);
+    std::lock_guard<std::mutex> lock(outputMutex);
+    value = heldValue(index, value);
+    OutputState& state = outputs[index];
+    if(state.valid && map.refreshTime > 0 && now - state.writtenAt < static_cast<uint64_t>(map.refreshTime)){
+        if(value == state.value){
+            return false;
+        }
+        if(map.deadband > 0 && map.width > 1){
+            // Compare as signed values of the mapping width, so that a deadband works across zero.
+            int shift = 64 - (map.width < 64 ? map.width : 64);
+            int64_t current = static_cast<int64_t>(value << shift) >> shift;
+            int64_t last = static_cast<int64_t>(state.value << shift) >> shift;
+            uint64_t change = current > last ? static_cast<uint64_t>(current - last) : static_cast<uint64_t>(last - current);
+            if(change <= map.deadband){
+                return false;
+            }
+        }
+    }
+    // A change starts the output delay, unless a failed write of an earlier one is still pending.
+    MappingFreshness& fresh = *freshness[index];
+    if(value != state.value && fresh.pendingChange == 0){
+        uint64_t changed = fresh.changedAt.load(std::memory_order_relaxed);
+        fresh.pendingChange = changed != 0 ? changed : elapsedMicros();
+    }
+    // The write is assumed to succeed; outputFailed() makes the next poll write again if it doesn't.
+    state.value = value;
+    state.writtenAt = now;
+    state.valid = true;
+    return true;
+}
+
+void IOClient::outputFailed(size_t mapping) {
+    std::lock_guard<std::mutex> lock(outputMutex);
+    if(mapping < outputs.size()){
+        outputs[mapping].valid = false;
+    }
+}
+
+void IOClient::connectAttempted(bool succeeded) {
+    (succeeded ? counters.connects : counters.connectFailures).fetch_add(1, std::memory_order_relaxed);
+    // Each failed attempt doubles the wait before the next one, up to maxReconnectDelay.
+    if(succeeded){
+        reconnectDelay = minReconnectDelay;
+        // The device may have lost its outputs while disconnected, so every output is written again.
+        std::lock_guard<std::mutex> lock(outputMutex);
+        for(auto& output : outputs){
+            output.valid = false;
+        }
+    }
+    else{
+        reconnectDelay = reconnectDelay * 2 < maxReconnectDelay ? reconnectDelay * 2 : maxReconnectDelay;
+        markInputs(IOQuality::CommFail);
+    }
+}
+
+void IOClient::markInputs(IOQuality quality) {
+    int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    std::lock_guard<std::mutex> lock(outputMutex);
+    for(uint32_t slot : inputSlots){
+        setInputQuality(slot, quality, now);
+    }
+}
+
+void IOClient::pollMappings(std::vector<IOMap*>& due) {
+    buildBatch(due, pollBatch);
+    submitBatch(pollBatch);
+    publishCompleted();
+}
+
+void IOClient::buildBatch(const std::vector<IOMap*>& due, IOBatch& batch) {
+    batch.requests.clear();
+    bool outputs = false;
+    uint64_t issued = due.empty() ? 0 : elapsedMicros();
+    for(auto* map : due){
+        IORequest request;
+        request.mapping = static_cast<size_t>(map - mappings.data());
+        request.direction = map->direction;
+        request.width = map->width;
+        request.remoteHandle = map->remoteHandle;
+        request.local = map->local;
+        request.quality = map->quality;
+        request.value = 0;
+        request.status = IOStatus::Pending;
+        request.freshness = freshness[request.mapping].get();
+        request.issued = issued;
+        batch.requests.push_back(request);
+        outputs = outputs || map->direction == IOType::Output;
+    }
+    if(outputs){
+        readImage([&](const uint8_t* image){
+            for(auto& request : batch.requests){
+                if(request.direction == IOType::Output){
+                    request.value = request.local.load(image);
+                }
+            }
+        });
+        std::lock_guard<std::mutex> lock(outputMutex);
+        if(!holds.empty()){
+            for(auto& request : batch.requests){
+                if(request.direction == IOType::Output){
+                    request.value = heldValue(request.mapping, request.value);
+                }
+            }
+        }
+    }
+}
+
+void IOClient::complete(IORequest& request, IOStatus status, uint64_t value) {
+    request.status = status;
+    uint64_t now = 0;
+    if(status == IOStatus::Good && request.freshness != nullptr){
+        now = elapsedMicros();
+        request.freshness->roundTrip.record(now > request.issued ? now - request.issued : 0);
+    }
+    if(request.direction == IOType::Output){
+        if(status == IOStatus::Good && request.freshness != nullptr){
+            std::lock_guard<std::mutex> lock(outputMutex);
+            MappingFreshness& fresh = *request.freshness;
+            if(fresh.pendingChange != 0){
+                fresh.outputDelay.record(now > fresh.pendingChange ? now - fresh.pendingChange : 0);
+                fresh.pendingChange = 0;
+            }
+        }
+        else if(status != IOStatus::Good && status != IOStatus::Invalid){
+            outputFailed(request.mapping);
+        }
+        return;
+    }
+    if(status == IOStatus::Good){
+        request.value = value;
+        completedAddresses.push_back(request.local);
+        completedValues.push_back(value);
+        completedSlots.push_back(request.quality);
+        completedFreshness.push_back(request.freshness);
+    }
+    else if(status != IOStatus::Invalid && status != IOStatus::Pending){
+        setInputQuality(request.quality, IOQuality::Stale);
+    }
+}
+
+void IOClient::publishCompleted() {
+    if(completedAddresses.empty()){
+        return;
+    }
+    int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    for(uint32_t slot : completedSlots){
+        setInputQuality(slot, IOQuality::Good, now);
+    }
+    writeImage(completedAddresses.data(), completedValues.data(), completedFreshness.data(), elapsedMicros(),
+        completedAddresses.size());
+    completedAddresses.clear();
+    completedValues.clear();
+    completedSlots.clear();
+    completedFreshness.clear();
+}
+
+void ScalarIOClient::submitBatch(IOBatch& batch) {
+    for (auto& request : batch.requests) {
+        NODALIS_TRY {
+            exchange(request);
+        }
+        NODALIS_CATCH(e) {
+            complete(request, IOStatus::Failed);
+        }
+    }
+}
+
+void ScalarIOClient::exchange(IORequest& request) {
+    bool result = false;
+    const IOMap& map = mappings[request.mapping];
+    if (request.direction == IOType::Output)
+    {
+        uint64_t val = request.value;
+        switch (request.width) {
+            case 1:
+                result = writeBit(map.remoteAddress, static_cast<int>(val));
+                break;
+            case 8:
+                result = writeByte(map.remoteAddress, static_cast<uint8_t>(val));
+                break;
+            case 16:
+                result = writeWord(map.remoteAddress, static_cast<uint16_t>(val));
+                break;
+            case 32:
+                result = writeDWord(map.remoteAddress, static_cast<uint32_t>(val));
+                break;
+            case 64:
+                result = writeLWord(map.remoteAddress, val);
+                break;
+        }
+        if (!result)
+        {
+            DIAGNOSTIC("Failed to write on map for " << map.moduleID << "/" << map.remoteAddress);
+        }
+        complete(request, result ? IOStatus::Good : IOStatus::Failed);
+    }
+    else if (request.direction == IOType::Input) {
+        uint64_t value = 0;
+        switch (request.width) {
+            case 1: {
+                int bit = 0;
+                if ((result = readBit(map.remoteAddress, bit))) {
+                    value = bit > 0;
+                }
+                break;
+            }
+            case 8: {
+                uint8_t val = 0;
+                if ((result = readByte(map.remoteAddress, val))) {
+                    value = val;
+                }
+                break;
+            }
+            case 16: {
+                uint16_t val = 0;
+                if ((result = readWord(map.remoteAddress, val))) {
+                    value = val;
+                }
+                break;
+            }
+            case 32: {
+                uint32_t val = 0;
+                if ((result = readDWord(map.remoteAddress, val))) {
+                    value = val;
+                }
+                break;
+            }
+            case 64:
+            {
+                result = readLWord(map.remoteAddress, value);
+                break;
+            }
+        }
+        complete(request, result ? IOStatus::Good : IOStatus::Failed, value);
+    }
+}
+
+
+
+/**
+ * Resolves a host name to its IPv4 address, so that a device mapped by name and by address gives one key. Each name
+ * is only looked up once.
+ * @param host The host name or address.
+ * @returns Returns the address, or the host name in lower case if it can't be resolved.
+ */
+static std::string resolveHost(const std::string& host){
+    static std::unordered_map<std::string, std::string> resolved;
+    std::string name = toLowerCase(host);
+    auto found = resolved.find(name);
+    if(found != resolved.end()){
+        return found->second;
+    }
+    std::string address = name;
+#ifndef _WIN32
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    addrinfo* result = nullptr;
+    if(!name.empty() && getaddrinfo(name.c_str(), nullptr, &hints, &result) == 0 && result != nullptr){
+        char text[INET_ADDRSTRLEN];
+        if(inet_ntop(AF_INET, &reinterpret_cast<sockaddr_in*>(result->ai_addr)->sin_addr, text, sizeof(text)) != nullptr){
+            address = text;
+        }
+        freeaddrinfo(result);
+    }
+#endif
+    resolved[name] = address;
+    return address;
+}
+
+/**
+ * Resolves the links in the path of a device file, such as a /dev/serial/by-id name for a serial port.
+ */
+static std::string devicePath(const std::string& path){
+#ifndef _WIN32
+    char* real = realpath(path.c_str(), nullptr);
+    if(real != nullptr){
+        std::string result = real;
+        std::free(real);
+        return result;
+    }
+#endif
+    return path;
+}
+
+/**
+ * Writes a port number without leading zeros, or the default port of the protocol if there is none.
+ */
+static std::string portText(const std::string& port, const char* fallback){
+    if(port.empty()){
+        return fallback;
+    }
+    if(port.find_first_not_of("0123456789") != std::string::npos){
+        return toLowerCase(port);
+    }
+    return std::to_string(std::strtoul(port.c_str(), nullptr, 10));
+}
+
+std::string endpointKey(const IOMap& map){
+    const std::string& protocol = map.protocol;
+    if(protocol == "MODBUS-RTU"){
+        // The slaves on one serial line share the port, whichever name it is opened by.
+        return devicePath(map.modulePort) + "/" + protocol;
+    }
+    if(protocol == "GPIO"){
+        return devicePath(map.moduleID.find('/') == std::string::npos ? "/dev/" + map.moduleID : map.moduleID) + "/" + protocol;
+    }
+    if(protocol == "MMIO"){
+        return devicePath(map.moduleID) + ":" + portText(map.modulePort, "0") + "/" + protocol;
+    }
+    if(protocol == "OPCUA"){
+        // The ModuleID is the URL of the server, as opc.tcp://host:port/path.
+        const std::string& url = map.moduleID;
+        size_t start = url.find("://");
+        start = start == std::string::npos ? 0 : start + 3;
+        size_t pathStart = url.find('/', start);
+        std::string authority = url.substr(start, pathStart == std::string::npos ? std::string::npos : pathStart - start);
+        std::string path = pathStart == std::string::npos ? "" : url.substr(pathStart);
+        while(path.size() > 1 && path.back() == '/'){
+            path.pop_back();
+        }
+        size_t colon = authority.rfind(':');
+        bool hasPort = colon != std::string::npos && authority.find(']', colon) == std::string::npos;
+        std::string host = hasPort ? authority.substr(0, colon) : authority;
+        return resolveHost(host) + ":" + portText(hasPort ? authority.substr(colon + 1) : "", "4840") + (path == "/" ? "" : path) + "/" + protocol;
+    }
+    if(protocol == "BACNET" || protocol == "BACNET-IP"){
+        // The devices behind a router share its address, and are told apart by their instance.
+        std::string key = resolveHost(map.moduleID) + ":" + portText(map.modulePort, "47808") + "/BACNET";
+        json config = protocolProperties(map);
+        if(config.is_object() && config.contains("DeviceInstance")){
+            const json& instance = config["DeviceInstance"];
+            key += "#" + (instance.is_string() ? instance.get<std::string>() : instance.dump());
+        }
+        return key;
+    }
+    const char* fallback = protocol == "MODBUS-TCP" ? "502" : protocol == "ETHERNET-IP" ? "44818" : "";
+    return resolveHost(map.moduleID) + ":" + portText(map.modulePort, fallback) + "/" + protocol;
+}
+
+std::unique_ptr<IOClient> newClient(const std::string& protocol){
+    // A replay stands in for the client of every endpoint, so that no device is reached.
+    if(ioReplayActive()){
+        return std::make_unique<IOReplayClient>(protocol);
+    }
+#if NODALIS_MODBUS
+    if(protocol == "MODBUS-TCP"){
+        return std::make_unique<ModbusClient>();
+    }
+    else if(protocol == "MODBUS-RTU"){
+        return std::make_unique<ModbusRtuClient>();
+    }
+#endif
+#if NODALIS_OPCUA
+    if(protocol == "OPCUA"){
+        return std::make_unique<OPCUAClient>();
+    }
+#endif
+#if NODALIS_BACNET
+    if(protocol == "BACNET" || protocol == "BACNET-IP"){
+        return std::make_unique<BACNETClient>();
+    }
+#endif
+    if(protocol == "NETVAR"){
+        return std::make_unique<NetVarClient>();
+    }
+    else if(protocol == "ETHERNET-IP"){
+        return std::make_unique<EnipClient>();
+    }
+    else if(protocol == "GPIO"){
+        return std::make_unique<GpioClient>();
+    }
+    else if(protocol == "MMIO"){
+        return std::make_unique<MmioClient>();
+    }
+    // Any other protocol is served by its driver library, if there is one.
+    return newDriverClient(protocol);
+}
+
+std::unique_ptr<IOClient> createClient(IOMap& map){
+    auto ret = newClient(map.protocol);
+    if(ret){
+        ret->addMapping(map);
+    }
+    return ret;
+}
+
+static std::atomic<bool> IO_STARTED{false};
+
+/**
+ * Starts a client on the next reactor, or on its own thread if there are no reactors or it can't run on one.
+ * @param client The client to start.
+ */
+static void startClient(IOClient& client){
+    if(!REACTORS.empty() && client.attach(*REACTORS[NEXT_REACTOR++ % REACTORS.size()])){
+        return;
+    }
+    client.start();
+}
+
+/**
+ * A transport endpoint and the one client that serves it, whichever ModuleID and ModulePort its mappings name it by.
+ */
+struct PooledEndpoint {
+    IOClient* client;
+    /**
+     * The ModuleID and ModulePort of each name the endpoint is mapped by. Each name holds a reference to the client.
+     */
+    std::vector<std::string> references;
+};
+static std::unordered_map<std::string, PooledEndpoint> ENDPOINTS;
+
+/**
+ * Gets the name a mapping gives its endpoint by. The slaves on a serial line are named by their ModuleID, so the line
+ * is named by its port alone.
+ */
+static std::string endpointName(const IOMap& map){
+    if(map.protocol == "MODBUS-RTU" || map.moduleID.empty()){
+        return map.modulePort;
+    }
+    return map.modulePort.empty() ? map.moduleID : map.moduleID + ":" + map.modulePort;
+}
+
+/**
+ * Finds the client of an endpoint, and adds a reference to it for the name of a mapping.
+ * @param map The mapping.
+ * @param key The endpoint key of the mapping.
+ * @returns Returns the client, or nullptr if the endpoint has none yet.
+ */
+static IOClient* shareEndpoint(const IOMap& map, const std::string& key){
+    auto found = ENDPOINTS.find(key);
+    if(found == ENDPOINTS.end()){
+        return nullptr;
+    }
+    PooledEndpoint& pooled = found->second;
+    std::string name = endpointName(map);
+    if(std::find(pooled.references.begin(), pooled.references.end(), name) == pooled.references.end()){
+        pooled.references.push_back(name);
+        nodalisLog() << name << " shares the connection of " << pooled.references[0] << " to " << key << " ("
+            << pooled.references.size() << " references)\n";
+    }
+    return pooled.client;
+}
+
+/**
+ * Adds a new client to the clients, and to the pool as the client of its endpoint.
+ * @param client The client.
+ * @param map The first mapping of the client.
+ */
+static void poolClient(std::unique_ptr<IOClient> client, const IOMap& map){
+    IOClient* added = client.get();
+    ENDPOINTS[added->getEndpoint()] = PooledEndpoint{ added, { endpointName(map) } };
+    if(IO_STARTED) startClient(*added);
+    Clients.push_back(std::move(client));
+}
+
+/**
+ * A local address that is mapped, and where from.
+ */
+struct MappedAddress {
+    IOClient* client;
+    std::string endpoint;
+    std::string remoteAddress;
+    ResolvedAddress local;
+    IOType direction;
+};
+static std::unordered_map<std::string, MappedAddress> MAPPED_ADDRESSES;
+/**
+ * A bit for each bit of the image that a mapped input writes, and for each bit that a mapped output reads.
+ */
+static std::vector<uint64_t> MAPPED_INPUT_BITS;
+static std::vector<uint64_t> MAPPED_OUTPUT_BITS;
+
+/**
+ * Checks the bits of an address in a bitmap of the image, and marks them.
+ * @param bits The bitmap.
+ * @param local The address.
+ * @param mark Whether to mark the bits, or only check them.
+ * @returns Returns true if any of them was already marked.
+ */
+static bool markBits(std::vector<uint64_t>& bits, const ResolvedAddress& local, bool mark){
+    if(bits.empty()){
+        bits.resize(PROCESS_IMAGE_BYTES / 8);
+    }
+    size_t first = local.bit >= 0 ? local.bitOffset * 8 + local.bit : local.offset * 8;
+    size_t end = first + (local.bit >= 0 ? 1 : static_cast<size_t>(local.width > 0 ? local.width : 1));
+    bool marked = false;
+    for(size_t x = first; x < end && x / 64 < bits.size(); x++){
+        uint64_t mask = uint64_t(1) << (x % 64);
+        marked = marked || (bits[x / 64] & mask) != 0;
+        if(mark){
+            bits[x / 64] |= mask;
+        }
+    }
+    return marked;
+}
+
+/**
+ * Registers the local address of a mapping with the client that serves it, and reports a mapping that conflicts with
+ * one already registered: the same address from another endpoint or remote address, or an address that overlaps the
+ * bits another mapping's input writes.
+ * @param map The mapping.
+ * @param client The client that serves it.
+ * @param endpoint The endpoint key of the mapping.
+ * @returns Returns false if the address is already mapped, by this client or another, in which case the mapping is
+ * left out.
+ */
+static bool claimAddress(const IOMap& map, IOClient* client, const std::string& endpoint){
+    auto found = MAPPED_ADDRESSES.find(map.localAddress);
+    if(found != MAPPED_ADDRESSES.end()){
+        const MappedAddress& first = found->second;
+        if(first.endpoint != endpoint || first.remoteAddress != map.remoteAddress){
+            nodalisLog() << map.localAddress << " is mapped from " << first.endpoint << " " << first.remoteAddress << " and from "
+                << endpoint << " " << map.remoteAddress << "; the first mapping is kept\n";
+        }
+        return false;
+    }
+    MAPPED_ADDRESSES.emplace(map.localAddress, MappedAddress{ client, endpoint, map.remoteAddress, map.local, map.direction });
+    if(map.local.space < 0){
+        return true;
+    }
+    // Two inputs that write the same bits race each other, and an output that an input writes is overwritten. Outputs
+    // only read the image, so they may overlap each other.
+    bool input = map.direction == IOType::Input;
+    bool overlaps = markBits(MAPPED_INPUT_BITS, map.local, input) || (input && markBits(MAPPED_OUTPUT_BITS, map.local, false));
+    if(!input){
+        markBits(MAPPED_OUTPUT_BITS, map.local, true);
+    }
+    if(overlaps){
+        // Only a conflict is worth the search for what it conflicts with.
+        const ResolvedAddress& a = map.local;
+        size_t aFirst = a.bit >= 0 ? a.bitOffset * 8 + a.bit : a.offset * 8;
+        size_t aEnd = aFirst + (a.bit >= 0 ? 1 : a.width);
+        for(const auto& other : MAPPED_ADDRESSES){
+            const ResolvedAddress& b = other.second.local;
+            if(other.first == map.localAddress || b.space < 0 || (!input && other.second.direction == IOType::Output)){
+                continue;
+            }
+            size_t bFirst = b.bit >= 0 ? b.bitOffset * 8 + b.bit : b.offset * 8;
+            size_t bEnd = bFirst + (b.bit >= 0 ? 1 : b.width);
+            if(aFirst < bEnd && bFirst < aEnd){
+                nodalisLog() << map.localAddress << " from " << endpoint << " overlaps " << other.first << " from "
+                    << other.second.endpoint << "\n";
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+IOClient* findClient(IOMap map){
+    std::string endpoint = endpointKey(map);
+    auto mapped = MAPPED_ADDRESSES.find(map.localAddress);
+    if(mapped != MAPPED_ADDRESSES.end()){
+        IOClient* client = mapped->second.client;
+        claimAddress(map, client, endpoint);
+        return client;
+    }
+    // Mappings share a client per endpoint, so the units behind one gateway, the slaves on one serial line and the
+    // names of one device share its connection.
+    IOClient* client = shareEndpoint(map, endpoint);
+    if(client != nullptr){
+        claimAddress(map, client, endpoint);
+        client->addMapping(map);
+    }
+    return client;
+}
+
+#if NODALIS_MODBUS
+static std::unique_ptr<ModbusServer> MODBUS_SERVER;
+#endif
+static std::unique_ptr<MetricsServer> METRICS_SERVER;
+static std::unique_ptr<WatchServer> WATCH_SERVER;
+
+bool startModbusServer(int port, int maxClients, const std::string& ioBackend){
+#if NODALIS_MODBUS
+    if(MODBUS_SERVER){
+        return true;
+    }
+    auto server = std::make_unique<ModbusServer>();
+    if(!server->start(static_cast<uint16_t>(port), maxClients, ioBackend)){
+        return false;
+    }
+    MODBUS_SERVER = std::move(server);
+    return true;
+#else
+    (void)port;
+    (void)maxClients;
+    (void)ioBackend;
+    nodalisLog() << "Modbus server: Modbus isn't built into this program\n";
+    return false;
+#endif
+}
+
+bool startMetricsServer(int port, const std::string& ioBackend){
+    if(METRICS_SERVER){
+        return true;
+    }
+    auto server = std::make_unique<MetricsServer>();
+    if(!server->start(static_cast<uint16_t>(port), ioBackend)){
+        return false;
+    }
+    METRICS_SERVER = std::move(server);
+    return true;
+}
+
+bool startWatchServer(int port, uint64_t interval, const std::string& ioBackend){
+    if(WATCH_SERVER){
+        return true;
+    }
+    auto server = std::make_unique<WatchServer>();
+    if(!server->start(static_cast<uint16_t>(port), interval, ioBackend)){
+        return false;
+    }
+    WATCH_SERVER = std::move(server);
+    return true;
+}
+
+// The objects published before the BACnet server is started, by name and address.
+static std::vector<std::pair<std::string, std::string>> BACNET_OBJECTS;
+#if NODALIS_BACNET
+static std::unique_ptr<BACnetServer> BACNET_SERVER;
+#endif
+
+void publishBACnetObject(const std::string& name, const std::string& address){
+    BACNET_OBJECTS.emplace_back(name, address);
+}
+
+bool startBACnetServer(uint32_t deviceInstance, const std::string& deviceName){
+#if NODALIS_BACNET
+    if(BACNET_SERVER){
+        return true;
+    }
+    auto server = std::make_unique<BACnetServer>(deviceInstance, deviceName);
+    for(const auto& object : BACNET_OBJECTS){
+        if(!server->publish(object.first, object.second)){
+            nodalisLog() << "BACnet server: " << object.second << " of " << object.first << " is not a %M address\n";
+        }
+    }
+    if(!server->start()){
+        return false;
+    }
+    BACNET_SERVER = std::move(server);
+    return true;
+#else
+    (void)deviceInstance;
+    (void)deviceName;
+    nodalisLog() << "BACnet server: BACnet isn't built into this program\n";
+    return false;
+#endif
+}
+
+void mapIO(std::string map, int definition){
+    NODALIS_TRY{
+        IOMap newMap(map);
+        newMap.definition = definition;
+        IOClient* existing = findClient(newMap);
+        if(existing == nullptr){
+            auto client = createClient(newMap);
+            if(client){
+                claimAddress(newMap, client.get(), client->getEndpoint());
+                poolClient(std::move(client), newMap);
+            }
+        }
+    }
+    NODALIS_CATCH(e){
+        nodalisLog() << "Caught exception: " << e.what() << "\n";
+    }
+    
+
+}
+
+void mapIOTable(const IOMapDefinition* maps, const IOClientDefinition* clients, size_t clientCount){
+    Clients.reserve(Clients.size() + clientCount);
+    for(size_t c = 0; c < clientCount; c++){
+        NODALIS_TRY{
+            const IOMapDefinition* rows = maps + clients[c].first;
+            std::vector<IOMap> mapped(rows, rows + clients[c].count);
+            // Rows of another name for an endpoint that already has a client join it.
+            std::string endpoint = endpointKey(mapped[0]);
+            IOClient* shared = shareEndpoint(mapped[0], endpoint);
+            std::unique_ptr<IOClient> client;
+            if(shared == nullptr){
+                client = newClient(rows[0].protocol);
+                if(!client){
+                    continue;
+                }
+            }
+            IOClient* target = shared != nullptr ? shared : client.get();
+            // Rows whose address a mapping of another client already has are left out.
+            mapped.erase(std::remove_if(mapped.begin(), mapped.end(), [&](const IOMap& map){
+                return !claimAddress(map, target, endpoint);
+            }), mapped.end());
+            if(mapped.empty()){
+                continue;
+            }
+            target->addMappings(mapped.data(), mapped.size());
+            if(client){
+                poolClient(std::move(client), mapped[0]);
+            }
+            nodalisLog() << "Mapped " << mapped.size() << " points of " << rows[0].moduleID << ":" << rows[0].modulePort << "\n";
+        }
+        NODALIS_CATCH(e){
+            nodalisLog() << "Caught exception: " << e.what() << "\n";
+        }
+    }
+}
+
+bool mapIOConfig(const std::string& path){
+    auto started = std::chrono::steady_clock::now();
+    IOConfigReader config;
+    if(!config.open(path)){
+        nodalisLog() << "Can't map the IO configuration in " << path << ": it is missing, damaged or of another version\n";
+        return false;
+    }
+    const IOConfigHeader* header = config.header();
+    // The rows point into the mapped strings, which each IOMap copies, so the file can be unmapped afterwards.
+    std::vector<IOMapDefinition> rows(header->mapCount);
+    for(uint32_t m = 0; m < header->mapCount; m++){
+        const IOConfigMap& map = config.maps()[m];
+        rows[m] = { config.string(map.protocol), config.string(map.moduleID), config.string(map.modulePort),
+            config.string(map.remoteAddress), config.string(map.localAddress), config.string(map.properties),
+            map.width, map.interval, map.deadband, map.refreshTime, -1, map.minInterval, map.maxInterval,
+            map.task != 0 ? config.string(map.task) : nullptr };
+    }
+    std::vector<IOClientDefinition> clients(header->clientCount);
+    for(uint32_t c = 0; c < header->clientCount; c++){
+        clients[c] = { config.clients()[c].first, config.clients()[c].count };
+    }
+    mapIOTable(rows.data(), clients.data(), clients.size());
+    nodalisLog() << "Mapped " << rows.size() << " points of " << clients.size() << " clients from " << path << " in "
+        << microsBetween(started, std::chrono::steady_clock::now()) << " us\n";
+    return true;
+}
+
+void startIO(int ioThreads, const std::string& ioBackend){
+    for(int x = 0; x < ioThreads; x++){
+        REACTORS.push_back(std::make_unique<IOReactor>("IO" + std::to_string(x), ioBackend));
+        REACTORS.back()->start();
+    }
+    IO_STARTED = true;
+    for(auto& client : Clients){
+        startClient(*client);
+    }
+}
+
+void superviseIO(){
+    if(IO_STARTED){
+        return;
+    }
+    NODALIS_TRY{
+        // Clients connect on threads of their own, so the scan never waits for a device that is offline.
+        for(int x = 0; x < Clients.size(); x++){
+            if(Clients[x]->connectInBackground()){
+                Clients[x]->poll();
+            }
+        }
+    }
+    NODALIS_CATCH(e){
+        nodalisLog() << "Caught exception: " << e.what() << "\n";
+    }
+}
+
+ExecutionStats::ExecutionStats(const std::string& name) : name(name) {
+}
+
+MappingFreshness::MappingFreshness(const std::string& name, const ResolvedAddress& local, bool output)
+    : name(name), local(local), output(output), roundTrip(name + ".RoundTrip"), inputAge(name + ".InputAge"),
+      outputDelay(name + ".OutputDelay") {
+}
+
+void ExecutionStats::record(uint64_t micros){
+    count.fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(micros, std::memory_order_relaxed);
+    last.store(micros, std::memory_order_relaxed);
+    uint64_t current = minimum.load(std::memory_order_relaxed);
+    while(micros < current && !minimum.compare_exchange_weak(current, micros, std::memory_order_relaxed)){
+    }
+    current = maximum.load(std::memory_order_relaxed);
+    while(micros > current && !maximum.compare_exchange_weak(current, micros, std::memory_order_relaxed)){
+    }
+    int bucket = 0;
+    while(micros > 0 && bucket < HISTOGRAM_BUCKETS - 1){
+        micros >>= 1;
+        bucket++;
+    }
+    histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void ExecutionStats::recordOverrun(uint64_t count){
+    overruns.fetch_add(count, std::memory_order_relaxed);
+}
+
+const std::string& ExecutionStats::getName() const {
+    return name;
+}
+
+uint64_t ExecutionStats::getCount() const {
+    return count.load(std::memory_order_relaxed);
+}
+
+uint64_t ExecutionStats::getMinimum() const {
+    uint64_t value = minimum.load(std::memory_order_relaxed);
+    return value == UINT64_MAX ? 0 : value;
+}
+
+uint64_t ExecutionStats::getMaximum() const {
+    return maximum.load(std::memory_order_relaxed);
+}
+
+uint64_t ExecutionStats::getAverage() const {
+    uint64_t n = getCount();
+    return n == 0 ? 0 : total.load(std::memory_order_relaxed) / n;
+}
+
+uint64_t ExecutionStats::getTotal() const {
+    return total.load(std::memory_order_relaxed);
+}
+
+uint64_t ExecutionStats::getLast() const {
+    return last.load(std::memory_order_relaxed);
+}
+
+uint64_t ExecutionStats::getOverruns() const {
+    return overruns.load(std::memory_order_relaxed);
+}
+
+uint64_t ExecutionStats::getHistogram(int bucket) const {
+    if(bucket < 0 || bucket >= HISTOGRAM_BUCKETS){
+        return 0;
+    }
+    return histogram[bucket].load(std::memory_order_relaxed);
+}
+
+uint64_t ExecutionStats::getPercentile(double percent) const {
+    uint64_t n = 0;
+    for(int x = 0; x < HISTOGRAM_BUCKETS; x++){
+        n += getHistogram(x);
+    }
+    if(n == 0){
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(std::ceil(n * percent / 100.0));
+    uint64_t seen = 0;
+    uint64_t bound = 0;
+    for(int x = 0; x < HISTOGRAM_BUCKETS; x++){
+        seen += getHistogram(x);
+        bound = x == 0 ? 1 : (1ull << x);
+        if(seen >= rank){
+            break;
+        }
+    }
+    uint64_t longest = getMaximum();
+    return bound < longest ? bound : longest;
+}
+
+void ExecutionStats::dump(LogText& out) const {
+    out << name << ": count=" << getCount() << " min=" << getMinimum() << "us avg=" << getAverage()
+        << "us max=" << getMaximum() << "us last=" << getLast() << "us overruns=" << getOverruns() << " histogram=";
+    // Only print the populated range of the histogram to keep the line short.
+    int first = 0, end = HISTOGRAM_BUCKETS;
+    while(first < end && getHistogram(first) == 0) first++;
+    while(end > first && getHistogram(end - 1) == 0) end--;
+    for(int x = first; x < end; x++){
+        out << (x == first ? "" : ",") << "<" << (1ull << x) << "us:" << getHistogram(x);
+    }
+    out << "\n";
+}
+
+static std::mutex STATS_MUTEX;
+static std::vector<std::unique_ptr<ExecutionStats>> ALL_STATS;
+
+ExecutionStats& registerStats(const std::string& name){
+    std::lock_guard<std::mutex> lock(STATS_MUTEX);
+    ALL_STATS.push_back(std::make_unique<ExecutionStats>(name));
+    return *ALL_STATS.back();
+}
+
+std::vector<ExecutionStats*> getAllStats(){
+    std::lock_guard<std::mutex> lock(STATS_MUTEX);
+    std::vector<ExecutionStats*> ret;
+    for(auto& stats : ALL_STATS){
+        ret.push_back(stats.get());
+    }
+    return ret;
+}
+
+void dumpStats(LogText& out){
+    for(auto* stats : getAllStats()){
+        stats->dump(out);
+    }
+    size_t count = 0;
+    const POUProfile* profiles = getPOUProfiles(count);
+    double nanos = count > 0 ? nanosPerCycle() : 0.0;
+    for(size_t x = 0; x < count; x++){
+        const POUProfile& profile = profiles[x];
+        uint64_t calls = profile.calls.load(std::memory_order_relaxed);
+        auto average = [&](const std::atomic<uint64_t>& cycles){
+            return calls == 0 ? 0 : static_cast<uint64_t>(static_cast<double>(cycles.load(std::memory_order_relaxed)) * nanos / calls);
+        };
+        out << "POU." << profile.name << ": kind=" << profile.kind << " calls=" << calls << " avg=" << average(profile.cycles)
+            << "ns self=" << average(profile.selfCycles) << "ns max="
+            << static_cast<uint64_t>(static_cast<double>(profile.maxCycles.load(std::memory_order_relaxed)) * nanos) << "ns\n";
+    }
+#if NODALIS_ALLOC_TRACK
+    const AllocationCounters& allocations = getAllocationCounters();
+    out << "Allocations: count=" << allocations.allocations.load(std::memory_order_relaxed)
+        << " frees=" << allocations.frees.load(std::memory_order_relaxed)
+        << " bytes=" << allocations.bytes.load(std::memory_order_relaxed)
+        << " live=" << allocations.liveBytes.load(std::memory_order_relaxed)
+        << " scan=" << allocations.scanAllocations.load(std::memory_order_relaxed) << "\n";
+#endif
+#if NODALIS_ARENA_BYTES > 0
+    const ArenaCounters& arena = getArenaCounters();
+    out << "Arena: size=" << static_cast<size_t>(NODALIS_ARENA_BYTES) << " used=" << arena.used.load(std::memory_order_relaxed)
+        << " overflows=" << arena.overflows.load(std::memory_order_relaxed)
+        << " heap=" << arena.heapAllocations.load(std::memory_order_relaxed) << "\n";
+#endif
+}
+
+// The least severe diagnostics that are logged, as set by --log-level.
+static std::atomic<uint8_t> LOG_LEVEL{static_cast<uint8_t>(LogSeverity::Info)};
+
+bool admitDiagnostic(DiagnosticSite& site, uint32_t& suppressed){
+    if(static_cast<uint8_t>(site.severity) < LOG_LEVEL.load(std::memory_order_relaxed)){
+        return false;
+    }
+    uint64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    uint64_t start = site.windowStart.load(std::memory_order_relaxed);
+    if(start == 0 || now - start >= DIAGNOSTIC_WINDOW_MS){
+        if(site.windowStart.compare_exchange_strong(start, now, std::memory_order_relaxed)){
+            site.logged.store(0, std::memory_order_relaxed);
+        }
+    }
+    if(site.logged.fetch_add(1, std::memory_order_relaxed) < DIAGNOSTIC_BURST){
+        suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+    site.suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+/**
+ * Writes queued diagnostics to stdout on its own thread, so the threads that log them never wait on the console.
+ */
+/**
+ * A message waiting in the ring of the diagnostics thread.
+ */
+struct DiagnosticRecord {
+    std::atomic<size_t> sequence{0};
+    const DiagnosticSite* site = nullptr;
+    int64_t time = 0;               // Microseconds since the Unix epoch.
+    size_t length = 0;
+    char text[DIAGNOSTIC_MESSAGE_BYTES];
+};
+
+static const char* severityText(LogSeverity severity){
+    switch(severity){
+        case LogSeverity::Debug: return "DEBUG";
+        case LogSeverity::Info: return "INFO";
+        case LogSeverity::Warning: return "WARNING";
+        default: return "ERROR";
+    }
+}
+
+/**
+ * Formats a time as an ISO 8601 date and time in UTC, to the millisecond.
+ */
+static std::string formatLogTime(int64_t micros){
+    std::time_t seconds = static_cast<std::time_t>(micros / 1000000);
+    std::tm utc{};
+#ifdef _WIN32
+    gmtime_s(&utc, &seconds);
+#else
+    gmtime_r(&seconds, &utc);
+#endif
+    char text[40];
+    std::snprintf(text, sizeof(text), "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ", utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday,
+        utc.tm_hour, utc.tm_min, utc.tm_sec, static_cast<int>(micros % 1000000 / 1000));
+    return text;
+}
+
+/**
+ * Writes the diagnostics on a thread of its own. Threads that log claim a slot of a bounded ring with one atomic add
+ * and publish it with the slot's sequence number, so logging never takes a lock or waits for the console, the file
+ * or syslog.
+ */
+class DiagnosticWriter {
+public:
+    DiagnosticWriter(){
+        // Each slot is free for the position it is first claimed at, and published when it holds one more.
+        for(size_t x = 0; x < DIAGNOSTIC_QUEUE_SIZE; x++){
+            ring[x].sequence.store(x, std::memory_order_relaxed);
+        }
+        worker = std::thread([this]{ run(); });
+    }
+    ~DiagnosticWriter(){
+        stopping.store(true, std::memory_order_release);
+        ready.notify_one();
+        worker.join();
+        if(file != nullptr){
+            std::fclose(file);
+        }
+    }
+    void push(const DiagnosticSite& site, const std::string& message){
+        size_t position = tail.load(std::memory_order_relaxed);
+        DiagnosticRecord* record;
+        while(true){
+            record = &ring[position & (DIAGNOSTIC_QUEUE_SIZE - 1)];
+            size_t sequence = record->sequence.load(std::memory_order_acquire);
+            if(sequence == position){
+                if(tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)){
+                    break;
+                }
+            }
+            else if(sequence < position){
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            else{
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+        record->site = &site;
+        record->time = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        record->length = message.size() < DIAGNOSTIC_MESSAGE_BYTES ? message.size() : DIAGNOSTIC_MESSAGE_BYTES;
+        std::memcpy(record->text, message.data(), record->length);
+        record->sequence.store(position + 1, std::memory_order_release);
+        if(!pending.exchange(true, std::memory_order_acq_rel)){
+            ready.notify_one();
+        }
+    }
+    /**
+     * Sets where the diagnostics are written besides stdout. Called before the IO starts, while little is logged.
+     */
+    void configure(const std::string& path, bool useSyslog){
+        std::lock_guard<std::mutex> lock(sinkMutex);
+        if(!path.empty()){
+            file = std::fopen(path.c_str(), "a");
+            if(file == nullptr){
+                nodalisLog() << "Can't write the log to " << path << "\n";
+            }
+        }
+#ifndef _WIN32
+        if(useSyslog && !syslogOpen){
+            openlog("nodalis", LOG_PID, LOG_DAEMON);
+            syslogOpen = true;
+        }
+#else
+        if(useSyslog){
+            nodalisLog() << "--log-syslog isn't supported on Windows\n";
+        }
+#endif
+    }
+
+private:
+    void run(){
+        // The ring is checked again after a while even without a wakeup, since a push may notify just before this
+        // thread starts to wait.
+        static constexpr auto IDLE_WAIT = std::chrono::milliseconds(100);
+        std::unique_lock<std::mutex> lock(waitMutex);
+        while(true){
+            ready.wait_for(lock, IDLE_WAIT, [this]{
+                return pending.load(std::memory_order_acquire) || stopping.load(std::memory_order_acquire);
+            });
+            pending.store(false, std::memory_order_release);
+            bool wrote = drain();
+            if(!wrote && repeats > 0 && ++idle >= 10){
+                // Nothing was logged for a second, so the repeats of the last message are written.
+                writeRepeats();
+            }
+            if(stopping.load(std::memory_order_acquire) && !wrote){
+                writeRepeats();
+                return;
+            }
+        }
+    }
+
+    bool drain(){
+        bool wrote = false;
+        std::lock_guard<std::mutex> lock(sinkMutex);
+        while(true){
+            DiagnosticRecord& record = ring[head & (DIAGNOSTIC_QUEUE_SIZE - 1)];
+            if(record.sequence.load(std::memory_order_acquire) != head + 1){
+                break;
+            }
+            uint64_t lost = dropped.exchange(0, std::memory_order_relaxed);
+            if(lost > 0){
+                nodalisLog() << lost << " diagnostic messages dropped\n";
+            }
+            if(record.site == lastSite && lastText.size() == record.length && lastText.compare(0, record.length, record.text, record.length) == 0){
+                repeats++;
+            }
+            else{
+                writeRepeats();
+                lastSite = record.site;
+                lastText.assign(record.text, record.length);
+                write(*record.site, record.time, lastText);
+            }
+            record.sequence.store(head + DIAGNOSTIC_QUEUE_SIZE, std::memory_order_release);
+            head++;
+            wrote = true;
+            idle = 0;
+        }
+        if(wrote){
+            std::fflush(stdout);
+            if(file != nullptr){
+                std::fflush(file);
+            }
+        }
+        return wrote;
+    }
+
+    void writeRepeats(){
+        if(repeats == 0){
+            return;
+        }
+        LogText text;
+        text << "message repeated " << repeats << " times: " << lastText;
+        repeats = 0;
+        write(*lastSite, std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count(), text.str());
+    }
+
+    void write(const DiagnosticSite& site, int64_t time, const std::string& text){
+        nodalisLog() << text << "\n";
+        if(file != nullptr){
+            const char* source = std::strrchr(site.file, '/');
+            LogLine(file) << formatLogTime(time) << " " << severityText(site.severity) << " "
+                << (source != nullptr ? source + 1 : site.file) << ":" << site.line << " " << text << "\n";
+        }
+#ifndef _WIN32
+        if(syslogOpen){
+            static const int PRIORITIES[] = { LOG_DEBUG, LOG_INFO, LOG_WARNING, LOG_ERR };
+            syslog(PRIORITIES[static_cast<int>(site.severity)], "%s", text.c_str());
+        }
+#endif
+    }
+
+    DiagnosticRecord ring[DIAGNOSTIC_QUEUE_SIZE];
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) size_t head = 0;
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> pending{false};
+    std::atomic<bool> stopping{false};
+    std::mutex waitMutex;
+    std::condition_variable ready;
+    // Guards the sinks, which configure() opens while the thread may be writing.
+    std::mutex sinkMutex;
+    FILE* file = nullptr;
+    bool syslogOpen = false;
+    // The last message written, and how many times it was logged again since.
+    const DiagnosticSite* lastSite = nullptr;
+    std::string lastText;
+    uint64_t repeats = 0;
+    int idle = 0;
+    std::thread worker;
+
+};
+
+static DiagnosticWriter& diagnosticWriter(){
+    static DiagnosticWriter writer;
+    return writer;
+}
+
+void logDiagnostic(const DiagnosticSite& site, const std::string& message){
+    diagnosticWriter().push(site, message);
+}
+
+void configureLogging(const RuntimeOptions& options){
+    const std::string& level = options.logLevel;
+    LogSeverity severity = level == "debug" ? LogSeverity::Debug : level == "warning" ? LogSeverity::Warning
+        : level == "error" ? LogSeverity::Error : LogSeverity::Info;
+    if(level != "debug" && level != "info" && level != "warning" && level != "error"){
+        nodalisLog() << "Unknown log level " << level << "; logging from info\n";
+    }
+    LOG_LEVEL.store(static_cast<uint8_t>(severity), std::memory_order_relaxed);
+    if(!options.logFile.empty() || options.logSyslog){
+        diagnosticWriter().configure(options.logFile, options.logSyslog);
+    }
+}
+
+#pragma region "Tracing"
+static std::mutex TRACE_MUTEX;
+// The rings of every thread that has recorded an event. A ring is never freed, since a dump may read it after its
+// thread has ended.
+static std::vector<TraceRing*> TRACE_RINGS;
+static std::atomic<bool> TRACE_DUMP_REQUESTED{false};
+// The file the trace is written to, set when tracing starts.
+static std::string TRACE_PATH;
+
+/**
+ * A reading of the cycle counter and the steady clock at the same moment. Two of them give the rate of the counter.
+ */
+struct TraceClockPoint {
+    uint64_t cycles;
+    std::chrono::steady_clock::time_point time;
+};
+
+static TraceClockPoint readTraceClock(){
+    return TraceClockPoint{readCycleCounter(), std::chrono::steady_clock::now()};
+}
+
+// Taken when the runtime starts, so that the counts can be converted to times since then.
+static const TraceClockPoint TRACE_EPOCH = readTraceClock();
+
+double nanosPerCycle(){
+    TraceClockPoint now = readTraceClock();
+    return now.cycles > TRACE_EPOCH.cycles
+        ? std::chrono::duration<double, std::nano>(now.time - TRACE_EPOCH.time).count() / static_cast<double>(now.cycles - TRACE_EPOCH.cycles)
+        : 1.0;
+}
+
+TraceRing& createTraceRing(){
+    auto* ring = new TraceRing();
+    std::lock_guard<std::mutex> lock(TRACE_MUTEX);
+    ring->thread = static_cast<uint32_t>(TRACE_RINGS.size() + 1);
+    TRACE_RINGS.push_back(ring);
+    TRACE_RING = ring;
+    return *ring;
+}
+
+void nameTraceThread(const std::string& name){
+    TraceRing& ring = TRACE_RING != nullptr ? *TRACE_RING : createTraceRing();
+    std::lock_guard<std::mutex> lock(TRACE_MUTEX);
+    ring.threadName = name;
+}
+
+void requestTraceDump(){
+    TRACE_DUMP_REQUESTED.store(true, std::memory_order_relaxed);
+}
+
+static const char* traceCategoryName(TraceCategory category){
+    switch(category){
+        case TraceCategory::Scan: return "scan";
+        case TraceCategory::Task: return "task";
+        case TraceCategory::Program: return "program";
+        case TraceCategory::IO: return "io";
+        case TraceCategory::Connect: return "connect";
+        case TraceCategory::OPCUA: return "opcua";
+    }
+    return "other";
+}
+
+/**
+ * Writes a string as a JSON string literal.
+ */
+static void writeTraceString(std::ostream& out, const char* text){
+    out << '"';
+    for(const char* c = text; *c != '\0'; c++){
+        if(*c == '"' || *c == '\\'){
+            out << '\\' << *c;
+        }
+        else if(static_cast<unsigned char>(*c) >= 0x20){
+            out << *c;
+        }
+    }
+    out << '"';
+}
+
+bool writeTrace(const std::string& path){
+    std::vector<TraceRing*> rings;
+    {
+        std::lock_guard<std::mutex> lock(TRACE_MUTEX);
+        rings = TRACE_RINGS;
+    }
+    double nanos = nanosPerCycle();
+    auto micros = [&](uint64_t cycles){
+        return cycles > TRACE_EPOCH.cycles ? static_cast<double>(cycles - TRACE_EPOCH.cycles) * nanos / 1000.0 : 0.0;
+    };
+
+    std::ofstream out(path, std::ios::trunc);
+    if(!out){
+        return false;
+    }
+    out << std::fixed;
+    out.precision(3);
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    std::vector<TraceRecord> records;
+    for(TraceRing* ring : rings){
+        std::string threadName;
+        {
+            std::lock_guard<std::mutex> lock(TRACE_MUTEX);
+            threadName = ring->threadName.empty() ? "Thread " + std::to_string(ring->thread) : ring->threadName;
+        }
+        out << (first ? "" : ",") << "\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << ring->thread
+            << ",\"args\":{\"name\":";
+        writeTraceString(out, threadName.c_str());
+        out << "}}";
+        first = false;
+
+        // The ring keeps being written while it is copied, so the events the writer may have reached are dropped.
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t begin = head > TRACE_RING_RECORDS ? head - TRACE_RING_RECORDS : 0;
+        records.clear();
+        for(uint64_t n = begin; n < head; n++){
+            records.push_back(ring->records[n & (TRACE_RING_RECORDS - 1)]);
+        }
+        uint64_t after = ring->head.load(std::memory_order_acquire);
+        uint64_t overwritten = after >= TRACE_RING_RECORDS ? after - TRACE_RING_RECORDS + 1 : 0;
+        for(uint64_t n = begin; n < head; n++){
+            if(n < overwritten){
+                continue;
+            }
+            const TraceRecord& record = records[n - begin];
+            out << ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->thread << ",\"cat\":\"" << traceCategoryName(record.category)
+                << "\",\"name\":";
+            writeTraceString(out, record.name != nullptr ? record.name : "");
+            out << ",\"ts\":" << micros(record.start) << ",\"dur\":" << (record.end > record.start ? micros(record.end) - micros(record.start) : 0.0);
+            if(record.detail != nullptr){
+                out << ",\"args\":{\"detail\":";
+                writeTraceString(out, record.detail);
+                out << "}";
+            }
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
+
+#ifndef _WIN32
+static void traceSignal(int){
+    requestTraceDump();
+}
+#endif
+
+void startTracing(const RuntimeOptions& options){
+#if NODALIS_TRACE
+    if(options.benchScans > 0){
+        return;
+    }
+#ifndef _WIN32
+    signal(SIGUSR1, traceSignal);
+#endif
+    // The file is written off the scan thread, which only ever sets the flag.
+    TRACE_PATH = options.traceOut;
+    std::thread([path = options.traceOut](){
+        moveToBackground();
+        while(true){
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            if(TRACE_DUMP_REQUESTED.exchange(false, std::memory_order_relaxed)){
+                nodalisLog() << (writeTrace(path) ? "Trace written to " : "Could not write the trace to ") << path << "\n";
+            }
+        }
+    }).detach();
+    NODALIS_TRACE_THREAD("Scan");
+#else
+    (void)options;
+#endif
+}
+#pragma endregion
+
+#pragma region "POU Profiling"
+static POUProfile* POU_PROFILE_TABLE = nullptr;
+static size_t POU_PROFILE_COUNT = 0;
+
+void registerPOUProfiles(POUProfile* profiles, size_t count){
+    POU_PROFILE_TABLE = profiles;
+    POU_PROFILE_COUNT = count;
+}
+
+const POUProfile* getPOUProfiles(size_t& count){
+    count = POU_PROFILE_COUNT;
+    return POU_PROFILE_TABLE;
+}
+#pragma endregion
+
+#pragma region "Allocation Accounting"
+static AllocationCounters ALLOCATION_COUNTERS;
+static ArenaCounters ARENA_COUNTERS;
+
+const AllocationCounters& getAllocationCounters(){
+    return ALLOCATION_COUNTERS;
+}
+
+const ArenaCounters& getArenaCounters(){
+    return ARENA_COUNTERS;
+}
+
+#if NODALIS_ARENA_BYTES > 0
+// Each block of the arena is preceded by a header that holds its size, header included, so that the last block can
+// be given back. The header keeps the alignment operator new guarantees.
+static constexpr size_t ARENA_HEADER = alignof(std::max_align_t);
+alignas(64) static uint8_t ARENA[NODALIS_ARENA_BYTES];
+static std::atomic<size_t> ARENA_TOP{0};
+// What an allocation from the heap after the arena is sealed does: 0 only counts it, 1 also logs its size and 2 then
+// aborts.
+static std::atomic<int> ARENA_STRICT{0};
+static std::atomic<uint32_t> ARENA_REPORTS{0};
+static constexpr uint32_t ARENA_REPORT_LIMIT = 16;
+
+/**
+ * Takes a block from the top of the arena.
+ * @param size The size of the allocation.
+ * @returns Returns the block, or nullptr if the arena is full.
+ */
+static void* arenaAllocate(size_t size) noexcept{
+    size_t bytes = ARENA_HEADER + ((size + ARENA_HEADER - 1) & ~(ARENA_HEADER - 1));
+    size_t top = ARENA_TOP.load(std::memory_order_relaxed);
+    do{
+        if(bytes < size || bytes > NODALIS_ARENA_BYTES - top){
+            return nullptr;
+        }
+    } while(!ARENA_TOP.compare_exchange_weak(top, top + bytes, std::memory_order_relaxed));
+    *reinterpret_cast<size_t*>(ARENA + top) = bytes;
+    ARENA_COUNTERS.used.store(top + bytes, std::memory_order_relaxed);
+    return ARENA + top + ARENA_HEADER;
+}
+
+/**
+ * Gives a block back to the arena if it is the last one taken. Others stay in place.
+ * @param p The allocation.
+ * @returns Returns false if the memory isn't from the arena.
+ */
+static bool arenaFree(void* p) noexcept{
+    auto* block = static_cast<uint8_t*>(p);
+    if(block < ARENA || block >= ARENA + NODALIS_ARENA_BYTES){
+        return false;
+    }
+    size_t start = static_cast<size_t>(block - ARENA) - ARENA_HEADER;
+    size_t end = start + *reinterpret_cast<size_t*>(ARENA + start);
+    if(ARENA_TOP.compare_exchange_strong(end, start, std::memory_order_relaxed)){
+        ARENA_COUNTERS.used.store(start, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+/**
+ * Counts an allocation from the heap after the arena was sealed, and logs it or aborts as --arena-strict asks. Only
+ * stdio is used, which doesn't go through operator new.
+ * @param size The size of the allocation.
+ */
+static void reportHeapAllocation(size_t size){
+    ARENA_COUNTERS.heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    int strict = ARENA_STRICT.load(std::memory_order_relaxed);
+    if(strict == 0){
+        return;
+    }
+    uint32_t report = ARENA_REPORTS.fetch_add(1, std::memory_order_relaxed);
+    if(strict == 1 && report >= ARENA_REPORT_LIMIT){
+        return;
+    }
+    std::fprintf(stderr, "Allocation of %zu bytes from the heap after startup\n", size);
+    if(strict == 2){
+        std::abort();
+    }
+    if(report + 1 == ARENA_REPORT_LIMIT){
+        std::fprintf(stderr, "Further allocations from the heap are only counted\n");
+    }
+}
+#endif
+
+/**
+ * Allocates the memory operator new returns: from the arena while the runtime starts, in a build with
+ * NODALIS_ARENA_BYTES, and from the heap otherwise.
+ * @param size The size of the allocation.
+ * @returns Returns the memory, or nullptr if there is none.
+ */
+[[maybe_unused]] static void* heapAllocate(size_t size) noexcept{
+#if NODALIS_ARENA_BYTES > 0
+    if(!ARENA_COUNTERS.sealed.load(std::memory_order_relaxed)){
+        if(void* p = arenaAllocate(size)){
+            return p;
+        }
+        if(ARENA_COUNTERS.overflows.fetch_add(1, std::memory_order_relaxed) == 0){
+            std::fprintf(stderr, "The arena of %zu bytes is full, so the rest of startup allocates from the heap\n",
+                static_cast<size_t>(NODALIS_ARENA_BYTES));
+        }
+    }
+    else{
+        reportHeapAllocation(size);
+    }
+#endif
+    return std::malloc(size);
+}
+
+[[maybe_unused]] static void heapFree(void* p) noexcept{
+#if NODALIS_ARENA_BYTES > 0
+    if(arenaFree(p)){
+        return;
+    }
+#endif
+    std::free(p);
+}
+
+void sealArena(){
+#if NODALIS_ARENA_BYTES > 0
+    if(ARENA_COUNTERS.sealed.load(std::memory_order_relaxed)){
+        return;
+    }
+    // The message is written first, since formatting it allocates.
+    nodalisLog() << "Started in " << ARENA_COUNTERS.used.load(std::memory_order_relaxed) << " of "
+        << static_cast<size_t>(NODALIS_ARENA_BYTES) << " bytes of the arena\n";
+    ARENA_COUNTERS.sealed.store(true, std::memory_order_relaxed);
+#endif
+}
+
+#if NODALIS_ALLOC_TRACK
+// What a scan allocation after startup does: 0 only counts it, 1 also logs a stack trace of it and 2 then aborts.
+static std::atomic<int> ALLOC_STRICT{0};
+// The scan allocations logged so far. After ALLOC_REPORT_LIMIT they are only counted, so a scan that allocates
+// every time doesn't flood the console.
+static std::atomic<uint32_t> ALLOC_REPORTS{0};
+static constexpr uint32_t ALLOC_REPORT_LIMIT = 16;
+// Set while the calling thread reports an allocation, since writing the report may allocate in turn.
+static thread_local bool IN_ALLOC_REPORT = false;
+
+/**
+ * Writes a stack trace of an allocation made during a scan, and aborts in abort mode. Only stdio and the raw stack
+ * trace functions are used, which don't go through operator new.
+ * @param size The size of the allocation.
+ */
+static void reportScanAllocation(size_t size){
+    int strict = ALLOC_STRICT.load(std::memory_order_relaxed);
+    if(strict == 0 || IN_ALLOC_REPORT){
+        return;
+    }
+    uint32_t report = ALLOC_REPORTS.fetch_add(1, std::memory_order_relaxed);
+    if(strict == 1 && report >= ALLOC_REPORT_LIMIT){
+        return;
+    }
+    IN_ALLOC_REPORT = true;
+    std::fprintf(stderr, "Allocation of %zu bytes during a scan:\n", size);
+#if defined(__GLIBC__) || defined(__APPLE__)
+    void* frames[32];
+    int count = backtrace(frames, 32);
+    backtrace_symbols_fd(frames, count, 2);
+#elif defined(_WIN32)
+    void* frames[32];
+    USHORT count = CaptureStackBackTrace(0, 32, frames, nullptr);
+    for(USHORT x = 0; x < count; x++){
+        std::fprintf(stderr, "  %p\n", frames[x]);
+    }
+#endif
+    if(strict == 2){
+        std::abort();
+    }
+    if(report + 1 == ALLOC_REPORT_LIMIT){
+        std::fprintf(stderr, "Further allocations during scans are only counted\n");
+    }
+    IN_ALLOC_REPORT = false;
+}
+
+// Each allocation is preceded by a header that holds its size, so that frees are counted in bytes too. The header
+// is as large as the alignment operator new guarantees, so the memory after it keeps that alignment.
+static constexpr size_t ALLOC_HEADER = alignof(std::max_align_t);
+
+static void* trackedAllocate(size_t size) noexcept{
+    auto* block = static_cast<uint8_t*>(heapAllocate(size + ALLOC_HEADER));
+    if(block == nullptr){
+        return nullptr;
+    }
+    *reinterpret_cast<size_t*>(block) = size;
+    ALLOCATION_COUNTERS.allocations.fetch_add(1, std::memory_order_relaxed);
+    ALLOCATION_COUNTERS.bytes.fetch_add(size, std::memory_order_relaxed);
+    ALLOCATION_COUNTERS.liveBytes.fetch_add(size, std::memory_order_relaxed);
+    if(SCAN_ALLOCATION_STATE.inScan){
+        ALLOCATION_COUNTERS.scanAllocations.fetch_add(1, std::memory_order_relaxed);
+        if(SCAN_ALLOCATION_STATE.armed){
+            reportScanAllocation(size);
+        }
+    }
+    return block + ALLOC_HEADER;
+}
+
+static void trackedFree(void* p) noexcept{
+    if(p == nullptr){
+        return;
+    }
+    auto* block = static_cast<uint8_t*>(p) - ALLOC_HEADER;
+    ALLOCATION_COUNTERS.frees.fetch_add(1, std::memory_order_relaxed);
+    ALLOCATION_COUNTERS.liveBytes.fetch_sub(*reinterpret_cast<size_t*>(block), std::memory_order_relaxed);
+    heapFree(block);
+}
+#elif NODALIS_ARENA_BYTES > 0
+static void* trackedAllocate(size_t size) noexcept{
+    return heapAllocate(size);
+}
+
+static void trackedFree(void* p) noexcept{
+    if(p != nullptr){
+        heapFree(p);
+    }
+}
+#endif
+
+#if NODALIS_ALLOC_TRACK || NODALIS_ARENA_BYTES > 0
+void* operator new(std::size_t size){
+    if(void* p = trackedAllocate(size)){
+        return p;
+    }
+    NODALIS_THROW(std::bad_alloc());
+}
+void* operator new[](std::size_t size){
+    return operator new(size);
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept{
+    return trackedAllocate(size);
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept{
+    return trackedAllocate(size);
+}
+void operator delete(void* p) noexcept{ trackedFree(p); }
+void operator delete[](void* p) noexcept{ trackedFree(p); }
+void operator delete(void* p, std::size_t) noexcept{ trackedFree(p); }
+void operator delete[](void* p, std::size_t) noexcept{ trackedFree(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept{ trackedFree(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept{ trackedFree(p); }
+#endif
+
+void configureAllocationTracking(const RuntimeOptions& options){
+#if NODALIS_ARENA_BYTES > 0
+    ARENA_STRICT.store(options.arenaStrict == "abort" ? 2 : options.arenaStrict == "log" ? 1 : 0, std::memory_order_relaxed);
+#else
+    if(!options.arenaStrict.empty()){
+        nodalisLog() << "--arena-strict needs a build with arenaBytes\n";
+    }
+#endif
+#if NODALIS_ALLOC_TRACK
+    int strict = options.allocStrict == "abort" ? 2 : options.allocStrict == "log" ? 1 : 0;
+    if(strict > 0){
+#if defined(__GLIBC__) || defined(__APPLE__)
+        // The first stack trace loads the unwinder, which allocates, so it is taken now rather than in a scan.
+        void* frames[1];
+        backtrace(frames, 1);
+#endif
+        nodalisLog() << "Allocations during scans after the first are " << (strict == 2 ? "aborted" : "logged") << "\n";
+    }
+    ALLOC_STRICT.store(strict, std::memory_order_relaxed);
+#else
+    if(!options.allocStrict.empty()){
+        nodalisLog() << "--alloc-strict needs a build with allocTrack\n";
+    }
+#endif
+}
+#pragma endregion
+
+RuntimeOptions parseRuntimeOptions(int argc, char* argv[]){
+    RuntimeOptions options;
+    for(int x = 1; x < argc; x++){
+        std::string arg = argv[x];
+        if(arg == "--threaded-tasks"){
+            options.threadedTasks = true;
+        }
+        else if(arg == "--incremental"){
+            options.incremental = true;
+        }
+        else if(arg == "--incremental-full" && x + 1 < argc){
+            options.incrementalFull = std::strtoull(argv[++x], nullptr, 10);
+        }
+        else if(arg == "--parallel-programs" && x + 1 < argc){
+            options.parallelPrograms = std::atoi(argv[++x]);
+        }
+        else if(arg == "--watchdog" && x + 1 < argc){
+            options.watchdog = std::strtoull(argv[++x], nullptr, 10);
+        }
+        else if(arg == "--overrun-policy" && x + 1 < argc){
+            options.overrunPolicy = argv[++x];
+        }
+        else if(arg == "--clock-sync" && x + 1 < argc){
+            options.clockSync = argv[++x];
+        }
+        else if(arg == "--clock-phase" && x + 1 < argc){
+            options.clockPhase = std::strtoull(argv[++x], nullptr, 10);
+        }
+        else if(arg == "--io-interval" && x + 1 < argc){
+            uint64_t interval = std::strtoull(argv[++x], nullptr, 10);
+            options.ioInterval = interval > 0 ? interval : 1;
+        }
+        else if(arg == "--realtime"){
+            options.realtime = true;
+        }
+        else if(arg == "--scan-cpu" && x + 1 < argc){
+            options.scanCpu = std::atoi(argv[++x]);
+        }
+        else if(arg == "--rt-priority" && x + 1 < argc){
+            options.rtPriority = std::atoi(argv[++x]);
+        }
+        else if(arg == "--prefault-heap" && x + 1 < argc){
+            options.prefaultHeap = std::strtoull(argv[++x], nullptr, 10);
+        }
+        else if(arg == "--prefault-stack" && x + 1 < argc){
+            options.prefaultStack = std::strtoull(argv[++x], nullptr, 10);
+        }
+        else if(arg == "--stats-interval" && x + 1 < argc){
+            options.statsInterval = std::strtoull(argv[++x], nullptr, 10);
+        }
+        else if(arg == "--sync-io"){
+            options.syncIO = true;
+        }
+        else if(arg == "--io-threads" && x + 1 < argc){
+            int threads = std::atoi(argv[++x]);
+            options.ioThreads = threads > 0 ? threads : 0;
+        }
+        else if(arg == "--io-backend" && x + 1 < argc){
+            options.ioBackend = argv[++x];
+        }
+        else if(arg == "--io-config" && x + 1 < argc){
+            options.ioConfig = argv[++x];
+        }
+        else if(arg == "--io-capture" && x + 1 < argc){
+            options.ioCapture = argv[++x];
+        }
+        else if(arg == "--io-replay" && x + 1 < argc){
+            options.ioReplay = argv[++x];
+        }
+        else if(arg == "--io-drivers" && x + 1 < argc){
+            options.ioDrivers = argv[++x];
+        }
+        else if(arg == "--modbus-server" && x + 1 < argc){
+            options.modbusServerPort = std::atoi(argv[++x]);
+        }
+        else if(arg == "--modbus-clients" && x + 1 < argc){
+            int clients = std::atoi(argv[++x]);
+            options.modbusServerClients = clients > 0 ? clients : 1;
+        }
+        else if(arg == "--metrics-port" && x + 1 < argc){
+            options.metricsPort = std::atoi(argv[++x]);
+        }
+        else if(arg == "--watch-port" && x + 1 < argc){
+            options.watchPort = std::atoi(argv[++x]);
+        }
+        else if(arg == "--watch-interval" && x + 1 < argc){
+            options.watchInterval = std::strtoull(argv[++x], nullptr, 10);
+        }
+        else if(arg == "--bacnet-bindings" && x + 1 < argc){
+            options.bacnetBindings = argv[++x];
+        }
+        else if(arg == "--bacnet-server" && x + 1 < argc){
+            int64_t instance = std::strtoll(argv[++x], nullptr, 10);
+            // 4194303 is the wildcard instance, which a device can't have.
+            options.bacnetServerInstance = instance >= 0 && instance < BACNET_MAX_INSTANCE ? instance : -1;
+        }
+        else if(arg == "--bacnet-name" && x + 1 < argc){
+            options.bacnetServerName = argv[++x];
+        }
+        else if(arg == "--bacnet-port" && x + 1 < argc){
+            int port = std::atoi(argv[++x]);
+            options.bacnetServerPort = port > 0 && port < 65536 ? port : 47808;
+        }
+        else if(arg == "--opcua-cooperative"){
+            options.opcuaCooperative = true;
+        }
+        else if(arg == "--opcua-slack" && x + 1 < argc){
+            options.opcuaSlack = std::strtoull(argv[++x], nullptr, 10);
+        }
+        else if(arg == "--opcua-update" && x + 1 < argc){
+            options.opcuaUpdate = std::strtoull(argv[++x], nullptr, 10);
+        }
+        else if(arg == "--opcua-pubsub" && x + 1 < argc){
+            options.opcuaPubSub = argv[++x];
+        }
+        else if(arg == "--retain-file" && x + 1 < argc){
+            options.retainFile = argv[++x];
+        }
+        else if(arg == "--retain-flush" && x + 1 < argc){
+            uint64_t scans = std::strtoull(argv[++x], nullptr, 10);
+            options.retainFlush = scans > 0 ? scans : 1;
+        }
+        else if(arg == "--snapshot" && x + 1 < argc){
+            options.snapshotFile = argv[++x];
+        }
+        else if(arg == "--snapshot-interval" && x + 1 < argc){
+            options.snapshotInterval = std::strtoull(argv[++x], nullptr, 10);
+        }
+        else if(arg == "--cold-start"){
+            options.coldStart = true;
+        }
+        else if(arg == "--redundancy" && x + 1 < argc){
+            options.redundancy = argv[++x];
+        }
+        else if(arg == "--redundancy-link" && x + 1 < argc){
+            options.redundancyLink = argv[++x];
+        }
+        else if(arg == "--redundancy-timeout" && x + 1 < argc){
+            uint64_t timeout = std::strtoull(argv[++x], nullptr, 10);
+            options.redundancyTimeout = timeout > 0 ? timeout : 1;
+        }
+        else if(arg == "--record" && x + 1 < argc){
+            options.record = argv[++x];
+        }
+        else if(arg == "--record-trigger" && x + 1 < argc){
+            options.recordTrigger = argv[++x];
+        }
+        else if(arg == "--record-pretrigger" && x + 1 < argc){
+            options.recordPretrigger = std::strtoull(argv[++x], nullptr, 10);
+        }
+        else if(arg == "--record-samples" && x + 1 < argc){
+            options.recordSamples = std::strtoull(argv[++x], nullptr, 10);
+        }
+        else if(arg == "--record-out" && x + 1 < argc){
+            options.recordOut = argv[++x];
+        }
+        else if(arg == "--record-port" && x + 1 < argc){
+            options.recordPort = std::atoi(argv[++x]);
+        }
+        else if(arg == "--record-buffer" && x + 1 < argc){
+            uint64_t samples = std::strtoull(argv[++x], nullptr, 10);
+            options.recordBuffer = samples > 0 ? samples : 1;
+        }
+        else if(arg == "--history" && x + 1 < argc){
+            options.history = argv[++x];
+        }
+        else if(arg == "--history-dir" && x + 1 < argc){
+            options.historyDir = argv[++x];
+        }
+        else if(arg == "--history-mode" && x + 1 < argc){
+            options.historyMode = argv[++x];
+        }
+        else if(arg == "--history-segment-bytes" && x + 1 < argc){
+            options.historySegmentBytes = std::strtoull(argv[++x], nullptr, 10);
+        }
+        else if(arg == "--history-segments" && x + 1 < argc){
+            options.historySegments = std::strtoull(argv[++x], nullptr, 10);
+        }
+        else if(arg == "--history-buffer" && x + 1 < argc){
+            uint64_t values = std::strtoull(argv[++x], nullptr, 10);
+            options.historyBuffer = values > 0 ? values : 1;
+        }
+        else if(arg == "--alarms" && x + 1 < argc){
+            options.alarms = argv[++x];
+        }
+        else if(arg == "--alarm-log" && x + 1 < argc){
+            options.alarmLog = argv[++x];
+        }
+        else if(arg == "--alarm-buffer" && x + 1 < argc){
+            uint64_t events = std::strtoull(argv[++x], nullptr, 10);
+            options.alarmBuffer = events > 0 ? events : 1;
+        }
+        else if(arg == "--mqtt" && x + 1 < argc){
+            options.mqtt = argv[++x];
+        }
+        else if(arg == "--mqtt-tags" && x + 1 < argc){
+            options.mqttTags = argv[++x];
+        }
+        else if(arg == "--mqtt-interval" && x + 1 < argc){
+            options.mqttInterval = std::strtoull(argv[++x], nullptr, 10);
+        }
+        else if(arg == "--mqtt-user" && x + 1 < argc){
+            options.mqttUser = argv[++x];
+        }
+        else if(arg == "--mqtt-password" && x + 1 < argc){
+            options.mqttPassword = argv[++x];
+        }
+        else if(arg == "--mqtt-keepalive" && x + 1 < argc){
+            options.mqttKeepAlive = std::atoi(argv[++x]);
+        }
+        else if(arg == "--mqtt-buffer" && x + 1 < argc){
+            uint64_t batches = std::strtoull(argv[++x], nullptr, 10);
+            options.mqttBuffer = batches > 0 ? batches : 1;
+        }
+        else if(arg == "--sparkplug-group" && x + 1 < argc){
+            options.sparkplugGroup = argv[++x];
+        }
+        else if(arg == "--sparkplug-node" && x + 1 < argc){
+            options.sparkplugNode = argv[++x];
+        }
+        else if(arg == "--sparkplug-device" && x + 1 < argc){
+            options.sparkplugDevice = argv[++x];
+        }
+        else if(arg == "--shm-image" && x + 1 < argc){
+            options.shmImage = argv[++x];
+        }
+        else if(arg == "--run-for" && x + 1 < argc){
+            options.runFor = std::strtoull(argv[++x], nullptr, 10);
+        }
+        else if(arg == "--bench" && x + 1 < argc){
+            options.benchScans = std::strtoull(argv[++x], nullptr, 10);
+        }
+        else if(arg == "--bench-out" && x + 1 < argc){
+            options.benchOut = argv[++x];
+        }
+        else if(arg == "--simulate"){
+            options.simulate = true;
+        }
+        else if(arg == "--sim-input" && x + 1 < argc){
+            options.simulateInput = argv[++x];
+            options.simulate = true;
+        }
+        else if(arg == "--trace-out" && x + 1 < argc){
+            options.traceOut = argv[++x];
+        }
+        else if(arg == "--trace-overrun"){
+            options.traceOverrun = true;
+        }
+        else if(arg == "--alloc-strict" && x + 1 < argc){
+            options.allocStrict = argv[++x];
+        }
+        else if(arg == "--arena-strict" && x + 1 < argc){
+            options.arenaStrict = argv[++x];
+        }
+        else if(arg == "--log-level" && x + 1 < argc){
+            options.logLevel = argv[++x];
+        }
+        else if(arg == "--log-file" && x + 1 < argc){
+            options.logFile = argv[++x];
+        }
+        else if(arg == "--log-syslog"){
+            options.logSyslog = true;
+        }
+        else if(arg == "--adaptive-poll"){
+            options.adaptivePoll = true;
+        }
+        else if(arg == "--poll-budget" && x + 1 < argc){
+            options.pollBudget = std::atoi(argv[++x]);
+        }
+        else if(arg == "--io-request-rate" && x + 1 < argc){
+            options.ioRequestRate = std::atof(argv[++x]);
+        }
+        else if(arg == "--io-byte-rate" && x + 1 < argc){
+            options.ioByteRate = std::atof(argv[++x]);
+        }
+        else if(arg == "--io-batch-limit" && x + 1 < argc){
+            options.ioBatchLimit = std::atoi(argv[++x]);
+        }
+        else if(arg == "--io-phase"){
+            options.ioPhase = true;
+        }
+        else if(arg == "--io-phase-margin" && x + 1 < argc){
+            options.ioPhaseMargin = std::atoi(argv[++x]);
+        }
+        else if(arg == "--program" && x + 1 < argc){
+            options.programFiles.push_back(argv[++x]);
+        }
+    }
+    if(options.retainFile.empty()){
+        options.retainFile = std::string(argc > 0 ? argv[0] : "nodalis") + ".retain";
+    }
+    if(options.snapshotFile.empty()){
+        options.snapshotFile = std::string(argc > 0 ? argv[0] : "nodalis") + ".snapshot";
+    }
+    if(options.benchOut.empty()){
+        options.benchOut = std::string(argc > 0 ? argv[0] : "nodalis") + ".bench.json";
+    }
+    if(options.recordOut.empty()){
+        options.recordOut = std::string(argc > 0 ? argv[0] : "nodalis") + ".rec";
+    }
+    if(options.historyDir.empty()){
+        options.historyDir = std::string(argc > 0 ? argv[0] : "nodalis") + ".history";
+    }
+    if(options.sparkplugNode.empty()){
+        std::string executable = argc > 0 ? argv[0] : "nodalis";
+        options.sparkplugNode = executable.substr(executable.find_last_of("/\\") + 1);
+    }
+    if(options.ioDrivers.empty()){
+        std::string executable = argc > 0 ? argv[0] : "nodalis";
+        size_t slash = executable.find_last_of("/\\");
+        options.ioDrivers = (slash == std::string::npos ? std::string() : executable.substr(0, slash + 1)) + "drivers";
+    }
+    if(options.traceOut.empty()){
+        options.traceOut = std::string(argc > 0 ? argv[0] : "nodalis") + ".trace.json";
+    }
+    if(options.programFiles.empty()){
+#ifdef __APPLE__
+        options.programFiles.push_back(std::string(argc > 0 ? argv[0] : "nodalis") + ".program.dylib");
+#else
+        options.programFiles.push_back(std::string(argc > 0 ? argv[0] : "nodalis") + ".program.so");
+#endif
+    }
+    return options;
+}
+
+static RuntimeOptions ACTIVE_OPTIONS;
+
+#ifdef __linux__
+/**
+ * Touches every page of a block of stack, so that later scans do not page fault on it.
+ * @param size The number of bytes of stack to touch.
+ */
+static void __attribute__((noinline)) prefaultStack(size_t size){
+    volatile uint8_t* stack = static_cast<volatile uint8_t*>(alloca(size));
+    for(size_t x = 0; x < size; x += 4096){
+        stack[x] = 0;
+    }
+}
+#endif
+
+void applyRuntimeProfile(const RuntimeOptions& options){
+    ACTIVE_OPTIONS = options;
+    configureLogging(options);
+    configureAdaptivePolling(options);
+    setIODriverDirectory(options.ioDrivers);
+    if(!options.ioReplay.empty()){
+        openIOReplay(options.ioReplay);
+    }
+    if(!options.realtime){
+        return;
+    }
+#ifdef __linux__
+    if(mlockall(MCL_CURRENT | MCL_FUTURE) != 0){
+        nodalisLog() << "Real-time profile: could not lock memory\n";
+    }
+#ifdef __GLIBC__
+    // Keep freed memory in the heap instead of returning it to the OS, so the prefaulted pages stay mapped.
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+#endif
+    if(options.prefaultHeap > 0){
+        size_t size = options.prefaultHeap * 1024;
+        uint8_t* heap = static_cast<uint8_t*>(malloc(size));
+        if(heap != nullptr){
+            for(size_t x = 0; x < size; x += 4096){
+                heap[x] = 0;
+            }
+            free(heap);
+        }
+    }
+    if(options.prefaultStack > 0){
+        prefaultStack(options.prefaultStack * 1024);
+    }
+    if(options.scanCpu >= 0){
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(options.scanCpu, &set);
+        if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0){
+            nodalisLog() << "Real-time profile: could not pin the scan thread to core " << options.scanCpu << "\n";
+        }
+    }
+    sched_param param{};
+    param.sched_priority = options.rtPriority;
+    if(pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0){
+        nodalisLog() << "Real-time profile: could not set the real-time scheduling policy\n";
+    }
+#else
+    nodalisLog() << "Real-time profile: only supported on Linux, running with normal scheduling\n";
+#endif
+}
+
+void getMemoryUsage(uint64_t& residentKB, uint64_t& peakKB){
+    residentKB = 0;
+    peakKB = 0;
+#ifdef __linux__
+    // statm reports pages, and ru_maxrss is already in KB on Linux.
+    FILE* statm = std::fopen("/proc/self/statm", "r");
+    if(statm != nullptr){
+        unsigned long size = 0, resident = 0;
+        if(std::fscanf(statm, "%lu %lu", &size, &resident) == 2){
+            residentKB = static_cast<uint64_t>(resident) * static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) / 1024;
+        }
+        std::fclose(statm);
+    }
+    rusage usage{};
+    if(getrusage(RUSAGE_SELF, &usage) == 0){
+        peakKB = static_cast<uint64_t>(usage.ru_maxrss);
+    }
+#endif
+}
+
+void moveToBackground(){
+    if(!ACTIVE_OPTIONS.realtime){
+        return;
+    }
+#ifdef __linux__
+    if(ACTIVE_OPTIONS.scanCpu >= 0){
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        for(long x = 0; x < cpus; x++){
+            if(x != ACTIVE_OPTIONS.scanCpu){
+                CPU_SET(x, &set);
+            }
+        }
+        if(CPU_COUNT(&set) > 0){
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        }
+    }
+    // Threads inherit the real-time policy of the thread that created them.
+    sched_param param{};
+    param.sched_priority = 0;
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+#endif
+}
+
+/**
+ * Sets the OS priority of the calling thread from an IEC task priority, where 0 is the highest.
+ * A real-time policy is used where the process is allowed one, otherwise the priority is approximated.
+ * @param priority The IEC priority of the task.
+ * @param name The name of the task, for logging.
+ */
+static void applyTaskPriority(int priority, const std::string& name){
+#ifdef _WIN32
+    int level = priority <= 0 ? THREAD_PRIORITY_HIGHEST
+        : priority == 1 ? THREAD_PRIORITY_ABOVE_NORMAL
+        : priority == 2 ? THREAD_PRIORITY_NORMAL
+        : THREAD_PRIORITY_BELOW_NORMAL;
+    if(!SetThreadPriority(GetCurrentThread(), level)){
+        nodalisLog() << "Could not set the priority of task " << name << "\n";
+    }
+#else
+    int lowest = sched_get_priority_min(SCHED_FIFO);
+    int highest = sched_get_priority_max(SCHED_FIFO);
+    sched_param param{};
+    // Keep the top of the range free for the IO thread.
+    param.sched_priority = highest - 1 - priority;
+    if(param.sched_priority < lowest){
+        param.sched_priority = lowest;
+    }
+    if(pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0){
+        return;
+    }
+#ifdef __linux__
+    // Without real-time privileges, lower priority tasks get a higher nice value so they yield to higher ones.
+    int niceness = priority < 0 ? 0 : priority > 19 ? 19 : priority;
+    if(setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), niceness) == 0){
+        return;
+    }
+#endif
+    nodalisLog() << "Could not set the priority of task " << name << ", it will run at normal priority\n";
+#endif
+}
+
+TaskScheduler::TaskScheduler(const RuntimeOptions& options)
+    : options(options), ioInterval(options.ioInterval), scanStats(registerStats("Scan")), ioStats(registerStats("IO")) {
+    nextIO = std::chrono::steady_clock::now();
+    nextStatsDump = nextIO + std::chrono::seconds(options.statsInterval);
+    // A benchmark or a simulation starts from a cleared image and doesn't publish it, so its runs can be compared.
+    if(options.benchScans == 0 && !options.simulate){
+        openRetentiveMemory(options);
+        openSnapshot(options);
+        openSharedImage(options);
+        openHistorian(options);
+        openAlarms(options);
+    }
+}
+
+void TaskScheduler::superviseAndReport(){
+    auto start = std::chrono::steady_clock::now();
+    trackClockSync();
+    superviseIO();
+    auto finished = std::chrono::steady_clock::now();
+    ioStats.record(microsBetween(start, finished));
+    if(options.statsInterval > 0 && finished >= nextStatsDump){
+        nextStatsDump = finished + std::chrono::seconds(options.statsInterval);
+        LogLine report(stdout);
+        dumpStats(report);
+    }
+}
+
+/**
+ * Creates a task with its statistics.
+ * @param name The name of the task.
+ * @param interval The period of the task, in milliseconds.
+ * @param priority The IEC priority of the task.
+ * @param body The function that runs the programs of the task.
+ * @returns Returns the task.
+ */
+static CyclicTask makeTask(const std::string& name, uint64_t interval, int priority, std::function<void()> body){
+    CyclicTask task;
+    task.name = name;
+    task.interval = std::chrono::milliseconds(interval > 0 ? interval : 1);
+    task.priority = priority;
+    task.body = std::move(body);
+    task.nextRelease = std::chrono::steady_clock::now();
+    task.execution = &registerStats("Task." + name);
+    task.lateness = &registerStats("Task." + name + ".Lateness");
+    return task;
+}
+
+/**
+ * Publishes the next release of a cyclic task for the IO clients polled in step with it.
+ * @param task The task.
+ */
+static void publishPhase(const CyclicTask& task){
+    if(task.phase){
+        task.phase->nextRelease.store(microsBetween(PROGRAM_START, task.nextRelease), std::memory_order_release);
+    }
+}
+
+void TaskScheduler::insertTask(CyclicTask task, uint64_t budget){
+    if(budget == 0){
+        budget = options.watchdog;
+    }
+    if(budget > 0){
+        task.watchdog = std::make_shared<TaskWatchdog>();
+        task.watchdog->budget = std::chrono::milliseconds(budget);
+    }
+    auto pos = tasks.begin();
+    while(pos != tasks.end() && pos->priority <= task.priority){
+        pos++;
+    }
+    tasks.insert(pos, std::move(task));
+}
+
+void TaskScheduler::addTask(const std::string& name, uint64_t interval, int priority, std::function<void()> body, uint64_t budget){
+    CyclicTask task = makeTask(name, interval, priority, std::move(body));
+    if(options.ioPhase){
+        task.phase = taskPhase(name);
+        task.phase->interval.store(std::chrono::duration_cast<std::chrono::microseconds>(task.interval).count(),
+            std::memory_order_release);
+        publishPhase(task);
+    }
+    insertTask(std::move(task), budget);
+}
+
+void TaskScheduler::addEventTask(const std::string& name, int priority, std::function<bool()> condition, std::function<void()> body,
+                                 uint64_t budget){
+    CyclicTask task = makeTask(name, 0, priority, std::move(body));
+    task.event = std::make_shared<TaskEvent>();
+    task.event->condition = std::move(condition);
+    task.nextRelease = (std::chrono::steady_clock::time_point::max)();
+    insertTask(std::move(task), budget);
+    hasEvents = true;
+}
+
+void TaskScheduler::startWatchdog(){
+    std::vector<std::pair<std::string, std::shared_ptr<TaskWatchdog>>> watched;
+    auto period = std::chrono::microseconds(100000);
+    for(const auto& task : tasks){
+        if(task.watchdog){
+            watched.emplace_back(task.name, task.watchdog);
+            if(task.watchdog->budget / 4 < period){
+                period = task.watchdog->budget / 4;
+            }
+        }
+    }
+    if(watched.empty()){
+        return;
+    }
+    if(period < std::chrono::milliseconds(1)){
+        period = std::chrono::milliseconds(1);
+    }
+    if(options.overrunPolicy != "continue" && options.overrunPolicy != "skip" && options.overrunPolicy != "safe"){
+        nodalisLog() << "Unknown overrun policy " << options.overrunPolicy << ", overruns are logged\n";
+        options.overrunPolicy = "continue";
+    }
+    bool safe = options.overrunPolicy == "safe";
+    std::thread([watched, period, safe](){
+        NODALIS_TRACE_THREAD("Watchdog");
+        while(true){
+            std::this_thread::sleep_for(period);
+            int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+            for(const auto& [name, watchdog] : watched){
+                int64_t started = watchdog->started.load(std::memory_order_acquire);
+                if(started <= 0 || std::chrono::steady_clock::duration(now - started) <= watchdog->budget){
+                    continue;
+                }
+                // The release may have ended since, in which case the exchange fails and it isn't counted.
+                if(!watchdog->started.compare_exchange_strong(started, -started, std::memory_order_acq_rel)){
+                    continue;
+                }
+                nodalisLog() << "Task " << name << " ran past its watchdog budget of "
+                             << std::chrono::duration_cast<std::chrono::milliseconds>(watchdog->budget).count() << " ms\n";
+                if(safe){
+                    enterSafeState();
+                }
+            }
+        }
+    }).detach();
+}
+
+bool TaskScheduler::raiseEvents(std::chrono::steady_clock::time_point now){
+    bool raised = false;
+    for(auto& task : tasks){
+        if(!task.event){
+            continue;
+        }
+        TaskEvent& event = *task.event;
+        bool state = event.condition();
+        if(state && !event.state){
+            {
+                std::lock_guard<std::mutex> lock(event.mutex);
+                if(!event.released){
+                    event.released = true;
+                    event.raisedAt = now;
+                }
+            }
+            event.signal.notify_one();
+            raised = true;
+        }
+        event.state = state;
+    }
+    return raised;
+}
+
+static std::mutex WAKE_MUTEX;
+static std::condition_variable WAKE_SIGNAL;
+static std::atomic<bool> WAKE_PENDING{false};
+
+void wakeScheduler(){
+    // Only the first wake since the scheduler last looked signals it, so a burst of writes costs one notification.
+    if(!WAKE_PENDING.exchange(true, std::memory_order_acq_rel)){
+        std::lock_guard<std::mutex> lock(WAKE_MUTEX);
+        WAKE_SIGNAL.notify_one();
+    }
+}
+
+/**
+ * Blocks the scheduler until a deadline, or until wakeScheduler() is called.
+ * @param deadline The time to wake at if nothing wakes the scheduler first.
+ */
+static void waitForWakeup(std::chrono::steady_clock::time_point deadline){
+    std::unique_lock<std::mutex> lock(WAKE_MUTEX);
+    WAKE_SIGNAL.wait_until(lock, deadline, []{ return WAKE_PENDING.load(std::memory_order_acquire); });
+}
+
+/**
+ * The work run in the slack between cycles, its budget, and when it is next due. SLACK_MUTEX is held while it runs.
+ */
+static std::mutex SLACK_MUTEX;
+static std::function<uint64_t()> SLACK_WORK;
+static std::chrono::microseconds SLACK_BUDGET{0};
+static std::chrono::steady_clock::time_point SLACK_DUE;
+
+void setSlackWork(std::function<uint64_t()> work, uint64_t budget){
+    std::lock_guard<std::mutex> lock(SLACK_MUTEX);
+    SLACK_WORK = std::move(work);
+    SLACK_BUDGET = std::chrono::microseconds(budget);
+    SLACK_DUE = std::chrono::steady_clock::now();
+}
+
+/**
+ * Waits like waitForWakeup(), running the slack work in the meantime whenever it is due and there is enough slack
+ * left before the deadline.
+ * @param deadline The time to wake at if nothing wakes the scheduler first.
+ */
+static void waitInSlack(std::chrono::steady_clock::time_point deadline){
+    std::unique_lock<std::mutex> lock(SLACK_MUTEX);
+    if(!SLACK_WORK){
+        lock.unlock();
+        waitForWakeup(deadline);
+        return;
+    }
+    while(!WAKE_PENDING.load(std::memory_order_acquire)){
+        auto now = std::chrono::steady_clock::now();
+        if(now >= deadline){
+            return;
+        }
+        if(now >= SLACK_DUE && deadline - now >= SLACK_BUDGET){
+            uint64_t wait = SLACK_WORK();
+            SLACK_DUE = std::chrono::steady_clock::now() + std::chrono::milliseconds(wait);
+        }
+        // The scheduler sleeps to the deadline if the work isn't due again with enough slack left before it.
+        auto due = SLACK_DUE > now ? SLACK_DUE : now;
+        auto until = due < deadline && deadline - due >= SLACK_BUDGET ? due : deadline;
+        lock.unlock();
+        waitForWakeup(until);
+        lock.lock();
+        if(!SLACK_WORK){
+            lock.unlock();
+            waitForWakeup(deadline);
+            return;
+        }
+    }
+}
+
+#if defined(NODALIS_PGO_TRAINING)
+#if defined(__clang__)
+extern "C" int __llvm_profile_write_file(void);
+#else
+extern "C" void __gcov_dump(void);
+#endif
+#endif
+
+/**
+ * The time a run limited with --run-for stops at.
+ */
+static std::chrono::steady_clock::time_point RUN_DEADLINE = (std::chrono::steady_clock::time_point::max)();
+
+/**
+ * Ends a run limited with --run-for, or a run with warm restart snapshots that was asked to stop, after writing the
+ * last snapshot. A build that trains profile guided optimization (NODALIS_PGO_TRAINING) writes its profile first. The
+ * process exits without running destructors, since the IO and server threads are still running.
+ */
+[[noreturn]] static void endRun(){
+    SNAPSHOT_STORE.saveLast();
+    stopRecorder();
+    stopIOCapture();
+    closeHistorian();
+    closeAlarms();
+    closeTimedOutputs();
+    stopSparkplug();
+#if defined(NODALIS_PGO_TRAINING)
+#if defined(__clang__)
+    __llvm_profile_write_file();
+#else
+    __gcov_dump();
+#endif
+#endif
+#if NODALIS_TRACE
+    if(!TRACE_PATH.empty()){
+        nodalisLog() << (writeTrace(TRACE_PATH) ? "Trace written to " : "Could not write the trace to ") << TRACE_PATH << "\n";
+    }
+#endif
+    std::fflush(stdout);
+    std::_Exit(0);
+}
+
+/**
+ * Ends the run if its time is up, and otherwise limits the time the scheduler waits until to the end of the run.
+ * @param next The time the scheduler would wait until.
+ * @returns Returns the time to wait until.
+ */
+static std::chrono::steady_clock::time_point untilRunEnds(std::chrono::steady_clock::time_point next){
+    if(RUN_DEADLINE == (std::chrono::steady_clock::time_point::max)()){
+        return next;
+    }
+    if(std::chrono::steady_clock::now() >= RUN_DEADLINE){
+        endRun();
+    }
+    return next < RUN_DEADLINE ? next : RUN_DEADLINE;
+}
+
+/**
+ * Whether IO is supervised on the scan thread, in which case the scheduler has to wake at every IO interval.
+ * @returns Returns true if the IO clients haven't been handed to IO threads.
+ */
+static bool ioOnScanThread(){
+    return !IO_STARTED.load(std::memory_order_relaxed) && !Clients.empty();
+}
+
+std::chrono::steady_clock::time_point TaskScheduler::runCycle(){
+    auto now = std::chrono::steady_clock::now();
+#if NODALIS_TRACE
+    uint64_t cycleStart = readCycleCounter();
+#endif
+    latchScanTime(now);
+    // The flag is cleared before the staged writes are looked at, so a write that arrives during the cycle wakes the next.
+    bool woken = WAKE_PENDING.exchange(false, std::memory_order_acq_rel);
+    superviseAndReport();
+    while(nextIO <= now){
+        nextIO += ioInterval;
+    }
+    NODALIS_SCAN_ALLOCATIONS();
+
+    // Event tasks are triggered by what is latched, so a wake latches the inputs when there are any.
+    bool due = woken && hasEvents;
+    for(const auto& task : tasks){
+        if(task.nextRelease <= now){
+            due = true;
+        }
+    }
+    bool latched = false;
+    bool ran = false;
+    if(due){
+        sampleLocalInputs();
+        latchInputs();
+        latched = true;
+        if(hasEvents){
+            raiseEvents(now);
+        }
+        for(auto& task : tasks){
+            if(task.event ? !task.event->released : task.nextRelease > now){
+                continue;
+            }
+            runRelease(task);
+            if(task.phase){
+                task.phase->completed.store(true, std::memory_order_release);
+            }
+            ran = true;
+        }
+    }
+    if(ran){
+        commitOutputs();
+        flushTaskOutputs();
+        driveLocalOutputs();
+        recordSignals(SCAN_MICROS);
+        recordHistory(SCAN_MICROS);
+        evaluateAlarms(SCAN_MICROS);
+        recordSparkplug(SCAN_MICROS);
+        PROGRAM_COUNT++;
+        scanStats.record(microsBetween(now, std::chrono::steady_clock::now()));
+#if NODALIS_TRACE
+        traceEvent(TraceCategory::Scan, "Scan", nullptr, cycleStart, readCycleCounter());
+#endif
+    }
+    else if(woken){
+        // Writes from the IO layer or a server are applied and published now rather than at the next release.
+        if(!latched){
+            latchInputs();
+        }
+        commitOutputs();
+        driveLocalOutputs();
+    }
+
+    // Only the deadlines that need the scheduler count, so it sleeps through the ticks where there is nothing to do.
+    auto next = now + IDLE_WAKE;
+    for(const auto& task : tasks){
+        if(task.nextRelease < next){
+            next = task.nextRelease;
+        }
+    }
+    if(ioOnScanThread() && nextIO < next){
+        next = nextIO;
+    }
+    if(options.statsInterval > 0 && nextStatsDump < next){
+        next = nextStatsDump;
+    }
+    return next;
+}
+
+void TaskScheduler::runRelease(CyclicTask& task){
+    NODALIS_TRACE_SCOPE(TraceCategory::Task, task.name.c_str());
+    auto start = std::chrono::steady_clock::now();
+    if(task.event){
+        std::lock_guard<std::mutex> lock(task.event->mutex);
+        task.event->released = false;
+        task.lateness->record(microsBetween(task.event->raisedAt, start));
+    }
+    else{
+        task.lateness->record(microsBetween(task.nextRelease, start));
+    }
+    if(task.watchdog){
+        task.watchdog->started.store(start.time_since_epoch().count(), std::memory_order_release);
+        RELEASE_WATCH = &task.watchdog->started;
+    }
+    // In the safe state, the releases come and go without running the programs.
+    if(!inSafeState()){
+#if NODALIS_SCAN_EXCEPTIONS
+        try{
+            task.body();
+        }
+        catch(const std::exception& e){
+            nodalisLog() << "Caught exception: " << e.what() << "\n";
+        }
+#else
+        task.body();
+#endif
+    }
+    bool overran = false;
+    if(task.watchdog){
+        overran = task.watchdog->started.exchange(0, std::memory_order_acq_rel) < 0;
+        RELEASE_WATCH = &UNWATCHED_RELEASE;
+    }
+    auto finished = std::chrono::steady_clock::now();
+    task.execution->record(microsBetween(start, finished));
+    if(task.event){
+        // An event task has no deadline; edges seen while it ran release it again.
+        return;
+    }
+    task.nextRelease += task.interval;
+    if(overran && options.overrunPolicy == "skip"){
+        task.nextRelease += task.interval;
+    }
+    if(clockSyncActive()){
+        task.nextRelease = alignSyncedRelease(task.nextRelease, task.interval);
+    }
+    if(finished > task.nextRelease){
+        // Skip the releases that were overrun rather than running the task back to back to catch up.
+        uint64_t missed = (finished - task.nextRelease) / task.interval + 1;
+        task.execution->recordOverrun(missed);
+        task.nextRelease += task.interval * missed;
+        nodalisLog() << "Task " << task.name << " missed " << missed << " deadline(s)\n";
+#if NODALIS_TRACE
+        if(options.traceOverrun){
+            requestTraceDump();
+        }
+#endif
+    }
+    publishPhase(task);
+}
+
+void TaskScheduler::flushTaskOutputs(){
+    for(auto& task : tasks){
+        if(task.phase && task.phase->completed.exchange(false, std::memory_order_acq_rel)){
+            task.phase->flush();
+        }
+    }
+}
+
+void TaskScheduler::run(){
+    configureAllocationTracking(options);
+    configureIncremental(options);
+    startProgramPool(options);
+    if(options.benchScans > 0){
+        runBenchmark();
+    }
+    if(options.simulate){
+        runSimulation();
+    }
+    if(!options.clockSync.empty() && openClockSync(options.clockSync, options.clockPhase)){
+        auto now = std::chrono::steady_clock::now();
+        for(auto& task : tasks){
+            if(!task.event){
+                task.nextRelease = firstSyncedRelease(now, task.interval);
+                publishPhase(task);
+            }
+        }
+    }
+    startWatchdog();
+#if NODALIS_BACNET
+    BACnetDatalink::instance().setBindingsFile(options.bacnetBindings);
+    if(options.bacnetServerInstance >= 0){
+        // The server is found at its port, so the datalink binds it rather than one the OS picks.
+        BACnetDatalink::instance().setLocalPort(static_cast<uint16_t>(options.bacnetServerPort));
+    }
+#endif
+    // A standby mirrors the primary and leaves the IO alone until it takes over.
+    if(options.redundancy == "standby"){
+        followPrimary(options);
+    }
+    startIOCapture(options);
+    if(!options.syncIO){
+        startIO(options.ioThreads, options.ioBackend);
+    }
+    if(options.modbusServerPort > 0){
+        startModbusServer(options.modbusServerPort, options.modbusServerClients, options.ioBackend);
+    }
+    if(options.metricsPort > 0){
+        startMetricsServer(options.metricsPort, options.ioBackend);
+    }
+    if(options.watchPort > 0){
+        startWatchServer(options.watchPort, options.watchInterval, options.ioBackend);
+    }
+    if(options.bacnetServerInstance >= 0){
+        startBACnetServer(static_cast<uint32_t>(options.bacnetServerInstance), options.bacnetServerName);
+    }
+    if(options.runFor > 0){
+        RUN_DEADLINE = std::chrono::steady_clock::now() + std::chrono::milliseconds(options.runFor);
+    }
+    startTracing(options);
+    startRecorder(options);
+    startSparkplug(options);
+    if(options.redundancy == "primary"){
+        startReplication(options);
+    }
+    if(options.threadedTasks){
+        runThreaded();
+    }
+    while(true){
+        auto next = runCycle();
+        sealArena();
+        if(cycleHook){
+            cycleHook();
+        }
+        if(SNAPSHOT_STORE.capture()){
+            endRun();
+        }
+        publishNetworkVariables();
+        replicateScan();
+        waitInSlack(untilRunEnds(next));
+    }
+}
+
+/**
+ * The private image of a task worker, and the copy used to find what the task changed.
+ */
+struct TaskImage {
+    alignas(IMAGE_LINE_BYTES) ProcessImage image;
+    alignas(IMAGE_LINE_BYTES) ProcessImage snapshot;
+};
+
+void TaskScheduler::runWorker(CyclicTask& task){
+    applyTaskPriority(task.priority, task.name);
+    NODALIS_TRACE_THREAD("Task." + task.name);
+    auto buffers = std::make_unique<TaskImage>();
+    TASK_IMAGE = buffers->image;
+    while(true){
+        if(task.event){
+            std::unique_lock<std::mutex> lock(task.event->mutex);
+            task.event->signal.wait(lock, [&task]{ return task.event->released; });
+        }
+        else{
+            std::this_thread::sleep_until(task.nextRelease);
+        }
+        NODALIS_SCAN_ALLOCATIONS();
+        latchScanTime(std::chrono::steady_clock::now());
+        loadTaskImage(buffers->image, buffers->snapshot);
+        runRelease(task);
+        storeTaskImage(buffers->image, buffers->snapshot);
+        // The scheduler has the IO write the task's outputs once it publishes them.
+        if(task.phase){
+            task.phase->completed.store(true, std::memory_order_release);
+        }
+        wakeScheduler();
+    }
+}
+
+void TaskScheduler::runThreaded(){
+    std::vector<std::thread> workers;
+    auto now = std::chrono::steady_clock::now();
+    for(auto& task : tasks){
+        if(!task.event){
+            task.nextRelease = clockSyncActive() ? firstSyncedRelease(now, task.interval) : now;
+            publishPhase(task);
+        }
+        workers.emplace_back(&TaskScheduler::runWorker, this, std::ref(task));
+    }
+    nextIO = now;
+    while(true){
+        auto start = std::chrono::steady_clock::now();
+#if NODALIS_TRACE
+        uint64_t cycleStart = readCycleCounter();
+#endif
+        WAKE_PENDING.store(false, std::memory_order_release);
+        superviseAndReport();
+        NODALIS_SCAN_ALLOCATIONS();
+        sampleLocalInputs();
+        latchInputs();
+        if(hasEvents){
+            // The workers merge their images into MEMORY under this lock, so the triggers are read under it too.
+            std::lock_guard<std::mutex> memoryLock(MEMORY_MUTEX);
+            raiseEvents(start);
+        }
+        commitOutputs();
+        flushTaskOutputs();
+        driveLocalOutputs();
+        recordSignals(microsBetween(PROGRAM_START, start));
+        recordHistory(microsBetween(PROGRAM_START, start));
+        evaluateAlarms(microsBetween(PROGRAM_START, start));
+        recordSparkplug(microsBetween(PROGRAM_START, start));
+        PROGRAM_COUNT++;
+        scanStats.record(microsBetween(start, std::chrono::steady_clock::now()));
+#if NODALIS_TRACE
+        traceEvent(TraceCategory::Scan, "Scan", nullptr, cycleStart, readCycleCounter());
+#endif
+        sealArena();
+        if(cycleHook){
+            cycleHook();
+        }
+        publishNetworkVariables();
+        nextIO += ioInterval;
+        now = std::chrono::steady_clock::now();
+        if(nextIO < now){
+            nextIO = now;
+        }
+        // The workers wake this thread when they finish a release, so it only ticks while it supervises IO itself.
+        auto next = ioOnScanThread() ? nextIO : now + IDLE_WAKE;
+        if(options.statsInterval > 0 && nextStatsDump < next){
+            next = nextStatsDump;
+        }
+        waitInSlack(untilRunEnds(next));
+    }
+}
+
+const std::vector<CyclicTask>& TaskScheduler::getTasks() const {
+    return tasks;
+}
+
+void TaskScheduler::setCycleHook(std::function<void()> hook){
+    cycleHook = std::move(hook);
+}
+
+/**
+ * The threads runParallel() runs the lanes of a stage on. The scan thread publishes a stage by moving the generation
+ * on, and every thread counts remaining down when it is done with the stage, whether it had lanes in it or not, so
+ * that none of them is still looking at a stage when the next one is published.
+ */
+struct ProgramPool {
+    size_t size = 0;
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<uint64_t[]>> dirty;     // The lines each thread marked, merged after the stage.
+    std::atomic<uint64_t> generation{0};
+    std::atomic<size_t> remaining{0};
+    std::mutex mutex;
+    std::condition_variable signal;
+    void (* const* lanes)() = nullptr;
+    size_t laneCount = 0;
+    uint64_t scanMicros = 0;
+};
+static ProgramPool PROGRAM_POOL;
+
+/**
+ * How many times a pool thread, and the scan thread at the end of a stage, check for the other side before they
+ * yield. Stages follow each other within a scan, so most waits are shorter than a trip through the OS.
+ */
+static constexpr int POOL_SPINS = 4000;
+
+/**
+ * Runs a lane, reporting an exception the way a task release does, so that a lane always finishes its stage.
+ * @param lane The lane.
+ */
+static void runLane(void (*lane)()){
+#if NODALIS_SCAN_EXCEPTIONS
+    try{
+        lane();
+    }
+    catch(const std::exception& e){
+        nodalisLog() << "Caught exception: " << e.what() << "\n";
+    }
+#else
+    lane();
+#endif
+}
+
+/**
+ * The loop of a thread of the program pool.
+ * @param index The index of the thread. It runs the lanes index + 1, index + 1 + threads + 1, and so on.
+ */
+static void runPoolThread(size_t index){
+    NODALIS_TRACE_THREAD("Programs." + std::to_string(index + 1));
+    DIRTY_TARGET = PROGRAM_POOL.dirty[index].get();
+    uint64_t seen = 0;
+    while(true){
+        uint64_t generation = PROGRAM_POOL.generation.load(std::memory_order_acquire);
+        for(int spin = 0; generation == seen && spin < POOL_SPINS; spin++){
+            generation = PROGRAM_POOL.generation.load(std::memory_order_acquire);
+        }
+        if(generation == seen){
+            std::unique_lock<std::mutex> lock(PROGRAM_POOL.mutex);
+            PROGRAM_POOL.signal.wait(lock, [&]{
+                generation = PROGRAM_POOL.generation.load(std::memory_order_acquire);
+                return generation != seen;
+            });
+        }
+        seen = generation;
+        size_t stride = PROGRAM_POOL.size + 1;
+        if(index + 1 < PROGRAM_POOL.laneCount){
+            NODALIS_SCAN_ALLOCATIONS();
+            // A lane's timers are on this thread's wheel, so it is advanced to the scan time of the stage first.
+            latchScanTime(PROGRAM_START + std::chrono::microseconds(PROGRAM_POOL.scanMicros));
+            for(size_t lane = index + 1; lane < PROGRAM_POOL.laneCount; lane += stride){
+                runLane(PROGRAM_POOL.lanes[lane]);
+            }
+        }
+        PROGRAM_POOL.remaining.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
+
+void startProgramPool(const RuntimeOptions& options){
+    if(options.parallelPrograms <= 0 || !PROGRAM_POOL.threads.empty()){
+        return;
+    }
+    size_t count = static_cast<size_t>(options.parallelPrograms);
+    for(size_t x = 0; x < count; x++){
+        PROGRAM_POOL.dirty.emplace_back(new uint64_t[IMAGE_LINE_WORDS]());
+    }
+    PROGRAM_POOL.size = count;
+    // The threads are created here, on the scan thread, so they inherit its real-time policy.
+    for(size_t x = 0; x < count; x++){
+        PROGRAM_POOL.threads.emplace_back(runPoolThread, x);
+#ifdef __linux__
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if(cpus > 1){
+            long first = options.scanCpu >= 0 ? options.scanCpu + 1 : 1;
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(static_cast<int>((first + static_cast<long>(x)) % cpus), &set);
+            pthread_setaffinity_np(PROGRAM_POOL.threads.back().native_handle(), sizeof(set), &set);
+        }
+#endif
+    }
+    nodalisLog() << "Running independent programs on " << count << " pool thread(s)\n";
+}
+
+void runParallel(std::initializer_list<void (*)()> lanes){
+    size_t threads = PROGRAM_POOL.size;
+    if(threads == 0 || lanes.size() < 2 || TASK_IMAGE != MEMORY){
+        for(auto lane : lanes){
+            lane();
+        }
+        return;
+    }
+    size_t active = lanes.size() - 1 < threads ? lanes.size() - 1 : threads;
+    PROGRAM_POOL.lanes = lanes.begin();
+    PROGRAM_POOL.laneCount = lanes.size();
+    PROGRAM_POOL.scanMicros = SCAN_MICROS;
+    PROGRAM_POOL.remaining.store(threads, std::memory_order_relaxed);
+    PROGRAM_POOL.generation.fetch_add(1, std::memory_order_release);
+    {
+        // Taken so that a thread between checking the generation and waiting doesn't miss the signal.
+        std::lock_guard<std::mutex> lock(PROGRAM_POOL.mutex);
+    }
+    PROGRAM_POOL.signal.notify_all();
+    for(size_t lane = 0; lane < lanes.size(); lane += threads + 1){
+        runLane(lanes.begin()[lane]);
+    }
+    for(int spin = 0; PROGRAM_POOL.remaining.load(std::memory_order_acquire) != 0; spin++){
+        if(spin >= POOL_SPINS){
+            std::this_thread::yield();
+        }
+    }
+#if NODALIS_DIRTY_TRACKING
+    for(size_t x = 0; x < active; x++){
+        uint64_t* lines = PROGRAM_POOL.dirty[x].get();
+        for(size_t word = 0; word < IMAGE_LINE_WORDS; word++){
+            DIRTY_LINES[word] |= lines[word];
+            lines[word] = 0;
+        }
+    }
+#endif
+}
+
+static ProgramProfile* PROGRAM_PROFILES = nullptr;
+static size_t PROGRAM_PROFILE_COUNT = 0;
+
+void registerProgramProfiles(ProgramProfile* profiles, size_t count){
+    PROGRAM_PROFILES = profiles;
+    PROGRAM_PROFILE_COUNT = count;
+}
+
+/**
+ * Gets the number of nanoseconds between two times.
+ * @param from The start time.
+ * @param to The end time.
+ * @returns Returns the nanoseconds from the start to the end.
+ */
+static uint64_t nanosBetween(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to){
+    return to > from ? static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count()) : 0;
+}
+
+// When the runtime was loaded, during static initialization, which the benchmark measures the startup from.
+static const std::chrono::steady_clock::time_point RUNTIME_LOADED = std::chrono::steady_clock::now();
+
+void TaskScheduler::runBenchmark(){
+    const uint64_t scans = options.benchScans;
+    const uint64_t startupNanos = nanosBetween(RUNTIME_LOADED, std::chrono::steady_clock::now());
+    // Everything the benchmark records is allocated before it starts, so the scans only run the program.
+    std::vector<uint64_t> scanNanos(scans);
+    std::vector<uint64_t> taskNanos(tasks.size());
+    PROFILE_PROGRAMS = true;
+    nodalisLog() << "Benchmarking " << scans << " scans\n";
+    std::fflush(stdout);
+    auto begin = std::chrono::steady_clock::now();
+#if NODALIS_ALLOC_TRACK
+    uint64_t allocations = getAllocationCounters().scanAllocations.load(std::memory_order_relaxed);
+#endif
+    for(uint64_t n = 0; n < scans; n++){
+        NODALIS_SCAN_ALLOCATIONS();
+        auto start = std::chrono::steady_clock::now();
+        latchScanTime(start);
+        latchInputs();
+        auto taskStart = start;
+        for(size_t t = 0; t < tasks.size(); t++){
+#if NODALIS_SCAN_EXCEPTIONS
+            try{
+                tasks[t].body();
+            }
+            catch(const std::exception& e){
+                nodalisLog() << "Caught exception: " << e.what() << "\n";
+            }
+#else
+            tasks[t].body();
+#endif
+            auto taskEnd = std::chrono::steady_clock::now();
+            taskNanos[t] += nanosBetween(taskStart, taskEnd);
+            taskStart = taskEnd;
+        }
+        commitOutputs();
+        PROGRAM_COUNT++;
+        scanNanos[n] = nanosBetween(start, std::chrono::steady_clock::now());
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    PROFILE_PROGRAMS = false;
+
+    std::vector<uint64_t> sorted(scanNanos);
+    std::sort(sorted.begin(), sorted.end());
+    double total = 0;
+    for(uint64_t ns : scanNanos){
+        total += static_cast<double>(ns);
+    }
+    double mean = scans > 0 ? total / static_cast<double>(scans) : 0;
+    double variance = 0;
+    for(uint64_t ns : scanNanos){
+        variance += (static_cast<double>(ns) - mean) * (static_cast<double>(ns) - mean);
+    }
+    auto percentile = [&](double percent){
+        if(sorted.empty()){
+            return static_cast<uint64_t>(0);
+        }
+        size_t rank = static_cast<size_t>(std::ceil(percent / 100.0 * static_cast<double>(sorted.size())));
+        return sorted[rank > 0 ? rank - 1 : 0];
+    };
+
+    json result;
+    result["scans"] = scans;
+    result["seconds"] = seconds;
+    result["scansPerSecond"] = seconds > 0 ? static_cast<double>(scans) / seconds : 0;
+    result["startupNanos"] = startupNanos;
+    result["scanNanos"] = {
+        {"min", sorted.empty() ? 0 : sorted.front()}, {"mean", mean}, {"p50", percentile(50)}, {"p90", percentile(90)},
+        {"p99", percentile(99)}, {"p999", percentile(99.9)}, {"max", sorted.empty() ? 0 : sorted.back()},
+        {"stddev", scans > 0 ? std::sqrt(variance / static_cast<double>(scans)) : 0}
+    };
+    // Scan times are counted in buckets of powers of two nanoseconds, from 2^n up to 2^(n+1).
+    json histogram = json::array();
+    size_t next = 0;
+    for(int bucket = 0; bucket < 64 && next < sorted.size(); bucket++){
+        uint64_t upper = bucket == 63 ? UINT64_MAX : (1ull << (bucket + 1));
+        size_t first = next;
+        while(next < sorted.size() && sorted[next] < upper){
+            next++;
+        }
+        if(next > first){
+            histogram.push_back({{"fromNanos", bucket == 0 ? 0 : 1ull << bucket}, {"toNanos", upper}, {"count", next - first}});
+        }
+    }
+    result["histogram"] = histogram;
+    json taskResults = json::array();
+    for(size_t t = 0; t < tasks.size(); t++){
+        taskResults.push_back({{"name", tasks[t].name}, {"nanosPerScan", scans > 0 ? static_cast<double>(taskNanos[t]) / static_cast<double>(scans) : 0}});
+    }
+    result["tasks"] = taskResults;
+    json programResults = json::array();
+    for(size_t p = 0; p < PROGRAM_PROFILE_COUNT; p++){
+        const ProgramProfile& profile = PROGRAM_PROFILES[p];
+        programResults.push_back({
+            {"name", profile.name}, {"calls", profile.calls},
+            {"meanNanos", profile.calls > 0 ? static_cast<double>(profile.nanos) / static_cast<double>(profile.calls) : 0},
+            {"maxNanos", profile.maxNanos},
+            {"share", total > 0 ? static_cast<double>(profile.nanos) / total : 0}
+        });
+    }
+    result["programs"] = programResults;
+#if NODALIS_ALLOC_TRACK
+    result["scanAllocations"] = getAllocationCounters().scanAllocations.load(std::memory_order_relaxed) - allocations;
+#endif
+
+    std::ofstream out(options.benchOut);
+    out << result.dump(2) << "\n";
+    out.close();
+    nodalisLog() << "Ran " << scans << " scans in " << seconds << " s (" << result["scansPerSecond"].get<double>() << " scans/s), p50 "
+              << percentile(50) << " ns, p99 " << percentile(99) << " ns, max " << (sorted.empty() ? 0 : sorted.back()) << " ns\n";
+    nodalisLog() << (out ? "Results written to " : "Could not write the results to ") << options.benchOut << "\n";
+    endRun();
+}
+
+void TaskScheduler::runSimulation(){
+    if(!openSimulation(options)){
+        std::fflush(stdout);
+        std::_Exit(1);
+    }
+    if(options.runFor == 0 && options.simulateInput.empty()){
+        nodalisLog() << "A simulation needs --run-for or --sim-input to know when to stop\n";
+        std::fflush(stdout);
+        std::_Exit(1);
+    }
+    startRecorder(options);
+    // The virtual clock stands still while a scan runs, so a scan takes no time and no release is ever missed.
+    const uint64_t end = options.runFor > 0 ? options.runFor * 1000 : UINT64_MAX;
+    std::vector<uint64_t> releases(tasks.size(), 0);
+    SIMULATED_MICROS.store(0, std::memory_order_relaxed);
+    nodalisLog() << "Simulating " << (options.runFor > 0 ? std::to_string(options.runFor) + " ms" : "the inputs") << "\n";
+    std::fflush(stdout);
+    auto begin = std::chrono::steady_clock::now();
+    while(true){
+        uint64_t now = nextSimulatedInput();
+        for(size_t t = 0; t < tasks.size(); t++){
+            if(!tasks[t].event && releases[t] < now){
+                now = releases[t];
+            }
+        }
+        if(now == UINT64_MAX || now > end){
+            break;
+        }
+        SIMULATED_MICROS.store(now, std::memory_order_relaxed);
+        auto at = PROGRAM_START + std::chrono::microseconds(now);
+        waitForRecorder();
+        applySimulatedInputs(now);
+        latchScanTime(at);
+        latchInputs();
+        if(hasEvents){
+            raiseEvents(at);
+        }
+        for(size_t t = 0; t < tasks.size(); t++){
+            CyclicTask& task = tasks[t];
+            if(task.event){
+                std::lock_guard<std::mutex> lock(task.event->mutex);
+                if(!task.event->released){
+                    continue;
+                }
+                task.event->released = false;
+            }
+            else if(releases[t] > now){
+                continue;
+            }
+            else{
+                releases[t] += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(task.interval).count());
+            }
+#if NODALIS_SCAN_EXCEPTIONS
+            try{
+                task.body();
+            }
+            catch(const std::exception& e){
+                nodalisLog() << "Caught exception: " << e.what() << "\n";
+            }
+#else
+            task.body();
+#endif
+        }
+        commitOutputs();
+        recordSignals(now);
+        PROGRAM_COUNT++;
+        // Without a run limit, the simulation ends with the scan that latched the last input.
+        if(options.runFor == 0 && nextSimulatedInput() == UINT64_MAX){
+            break;
+        }
     }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    nodalisLog() << "Simulated " << SIMULATED_MICROS.load(std::memory_order_relaxed) / 1000 << " ms in " << PROGRAM_COUNT
+              << " scans, in " << seconds << " s\n";
+    endRun();
 }
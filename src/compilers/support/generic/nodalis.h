@@ -19,825 +19,6511 @@
  * @copyright Apache 2.0
  */
 #pragma once
-#include <iostream>
 #include <cstdint>
 #include <string>
+#include <cstring>
 #include <cctype>
 #include <chrono>
 #include <type_traits> // for std::is_same
 #include <math.h>
 #include <vector>
-#include <regex>
 #include <stdexcept>
-#define JSON_USE_IMPLICIT_CONVERSIONS 1
-#define JSON_USE_WIDE_STRING 1
-#include "json.hpp"
-using json = nlohmann::json;
+#include <functional>
+#include <initializer_list>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <queue>
+#include <map>
+#include <unordered_map>
+#include <limits>
+#include <tuple>
+#include <cstdlib>
+#include "nodalislog.h"
 
-#pragma region "Program Timing"
-extern uint64_t PROGRAM_COUNT;
-extern std::chrono::steady_clock::time_point PROGRAM_START;
+#pragma region "Error Handling"
 /**
- * Provides the number of milliseconds since the program started.
- * @returns Returns a ulong of the elapsed time, in milliseconds.
+ * Whether the runtime is built with C++ exceptions. The embedded build profile compiles with -fno-exceptions and
+ * -fno-rtti; the runtime then reports what it would have thrown and aborts, and its try blocks run without a handler.
  */
-uint64_t elapsed();
-#pragma endregion
-#pragma region "Memory Handling"
+#ifndef NODALIS_EXCEPTIONS
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#define NODALIS_EXCEPTIONS 1
+#else
+#define NODALIS_EXCEPTIONS 0
+#endif
+#endif
 
 /**
- * Defines the total memory block for this PLC. This memory is a grid of 64x16 "sheets" or pages of memory.
- * The first column is the row of 64, the second column is 16 registers for that sheet.
- * Addresses are reserved based on MTI's standard registers, AI (physical inputs), AO (physical outputs),
- * SW (switch inputs from HMIs), LD (LED outputs to HMIs), BI, BO, CI, CO (all free memory locations for logical operations)
- * PROTECT, BREACH, TROUBLE, STAT1, STAT2, MISC1, MISC2, MISC3.
- * Standard IEC address references break down in the following ways:
- * %I - corresponds to the AI register MEMORY[x][0]. If requesting %IX0, the sheet row would be calculated by r = floor((0*8)/64) - which would yield 0.
- *  To reference each individual byte, we would get uint8_t* bytes = &MEMORY[r][0]; We then can reference the byte within this row by getting b = 0 % 8;
- *  We can then get the value of that byte by referencing bytes[b];
- * %Q - Same as %I, except uint8_t* bytes = &MEMORY[r][1];
- * %M - Virtual memory used for program interface. This takes up the other 14 columns in a row. A reference to %MX[a], where a is a numerical byte address would be used to calculate
- *  r = floor((a*8)/(64*14)). If a is 0, this would yield row 0. If a is 112, it would yield 1. The column would be c = floor(a/(8*14)) + 2, so 0 would yield 2 and 112 would also yield 2.
- *  The byte would be obtained by b = a % 8, so 0 would yield 0, and 112 would yield 0.
+ * Reports an error the runtime can't continue from, and aborts.
+ * @param what The error.
  */
-extern uint64_t MEMORY[64][16];
-
-inline std::string toLowerCase(const std::string& input) {
-    std::string result = input;
-    for (size_t i = 0; i < result.size(); ++i) {
-        result[i] = std::tolower(result[i]);
-    }
-    return result;
+[[noreturn]] inline void nodalisFatal(const char* what) {
+    std::fprintf(stderr, "Fatal: %s\n", what);
+    std::abort();
 }
 
+#if NODALIS_EXCEPTIONS
+#define NODALIS_THROW(exception) throw exception
+#define NODALIS_TRY try
+#define NODALIS_CATCH(name) catch (const std::exception& name)
+#else
+#define NODALIS_THROW(exception) nodalisFatal((exception).what())
 /**
- * Defines the memory space designations for use in getting memory addresses.
- */
-enum MEMORY_SPACE : int {
-    I, //input memory space
-    Q, //output memory space
-    M, //Virtual memory space
-};
-
-/**
- * Parses a ST address reference into a vector with the memory space, type, byte index, and bit broken out.
- * @param address A string representing the ST address.
- * @returns Returns a vector with four elements: the memory space (Input, Output, or Virtual), the width in bits, the address index, and the bit.
+ * The exception a handler names when exceptions are disabled, whose body is compiled but never runs.
  */
-inline std::vector<int> parseAddress(const std::string& address) {
-    std::regex pattern(R"(%([IQM])([XBWDL])(\d+)(?:\.(\d+))?)", std::regex::icase);
-    std::smatch match;
-
-    if (std::regex_match(address, match, pattern)) {
-        std::string space = match[1].str();   // I, Q, M
-        std::string type = match[2].str();    // X, W, D, etc.
-        std::string index = match[3].str();   // 0, 1, ...
-        std::string bit = match[4].matched ? match[4].str() : ""; // bit if present
-
-        
-        int ispace = -1;
-        int addr = -1;
-        int ibit = -1;
-        int width = -1;
-        if(toLowerCase(space) == "m"){
-            ispace = MEMORY_SPACE::M;
-        }
-        else if(toLowerCase(space) == "q"){
-            ispace = MEMORY_SPACE::Q;
-        }
-        else if(toLowerCase(space) == "i"){
-            ispace = MEMORY_SPACE::I;
-        }
-
-        if(toLowerCase(type) == "x"){
-            width = 8;
-        }
-        else if(toLowerCase(type) == "w"){
-            width = 16;
-        }
-        else if(toLowerCase(type) == "d"){
-            width = 32;
-        }
-        else if (toLowerCase(type) == "l")
-        {
-            width = 32;
-        }
-
-        if(bit != ""){
-            ibit = std::stoi(bit);
-        }
-        
-
-        addr = std::stoi(index);
-        return {ispace, width, addr, ibit};
-    }
-
-    throw std::invalid_argument("Invalid address format: " + address);
+inline const std::exception& nodalisNoException() {
+    static const std::exception none;
+    return none;
 }
+#define NODALIS_TRY if (true)
+#define NODALIS_CATCH(name) else if (const std::exception& name = nodalisNoException(); ((void)name, false))
+#endif
+#pragma endregion
 
+#pragma region "Program Timing"
+extern uint64_t PROGRAM_COUNT;
+extern std::chrono::steady_clock::time_point PROGRAM_START;
 /**
- * Gets a byte pointer to a memory address in a certain memory space.
- * @param space The memory space from which to get the address
- * @param addr The byte index to pull from.
- * @returns Returns a byte pointer to the memory address, or 0 if there is no memory at the given address.
- */
-inline uint8_t* getMemoryByte(int space, int addr){
-    uint8_t* ret = 0;
-    int r = -1, c = 0, b = 0;
-    switch(space){
-        case MEMORY_SPACE::Q:
-            r = floor((addr*8)/64);
-            c = 1;
-            b = addr % 8;
-        break;
-        case MEMORY_SPACE::I:
-            r = floor((addr*8)/64);
-            c = 0;
-            b = addr % 8;
-        break;
-        case MEMORY_SPACE::M:
-            r = floor((addr*8)/(64*14));
-            c = floor(addr/112) + 2;
-            b = addr % 8;
-        break;
-    }
-    if(r >= 0){
-        ret = (uint8_t*)(&MEMORY[r][c]) + b;
-    }
-    return ret;
-}
-/**
- * Gets a word pointer to a memory address in a certain memory space.
- * @param space The memory space from which to get the address.
- * @param addr The word index to pull from.
- * @returns Returns a word pointer to a memory address, or 0 if there is no memory at the given address.
- */
-inline uint16_t* getMemoryWord(int space, int addr){
-    return (uint16_t*)getMemoryByte(space, addr * 2);
-}
-/**
- * Gets a double word pointer to a memory address in a certain memory space.
- * @param space The memory space from which to get the address
- * @param addr The double word index to pull from.
- * @return Returns a double word pointer to a memory address, or 0 if there is no memory at the given address.
+ * Provides the number of milliseconds since the program started.
+ * @returns Returns a ulong of the elapsed time, in milliseconds.
  */
-inline uint32_t* getMemoryDWord(int space, int addr){
-    return (uint32_t*) getMemoryByte(space, addr*4);
-}
-
+uint64_t elapsed();
 /**
- * Gets a long word pointer to a memory address in a certain memory space.
- * @param space The memory space from which to get the address
- * @param addr The double word index to pull from.
- * @return Returns a long word pointer to a memory address, or 0 if there is no memory at the given address.
+ * Provides the number of microseconds since the program started, from the simulated clock under --simulate.
+ * @returns Returns the elapsed time, in microseconds.
  */
-inline uint64_t *getMemoryLWord(int space, int addr)
-{
-    return (uint64_t *)getMemoryByte(space, addr * 8);
-}
-
+uint64_t elapsedMicros();
 /**
- * Reads the 64 bit value at a given address.
- * @param address The address of the memory to get the 64 bit value from.
- * @returns Returns a 64 bit value
+ * The value of SIMULATED_MICROS when the runtime runs in real time.
  */
-uint64_t readLWord(std::string address);
-
+constexpr uint64_t SIMULATED_CLOCK_OFF = UINT64_MAX;
 /**
- * Reads the 32 bit value at a given address.
- * @param address The address of the memory to get the 32 bit value from.
- * @returns Returns a 32 bit value
+ * The virtual time of a simulated run (--simulate), in microseconds since the program started, which elapsed() reads
+ * instead of the steady clock. It is SIMULATED_CLOCK_OFF when the runtime runs in real time.
  */
- uint32_t readDWord(std::string address);
+extern std::atomic<uint64_t> SIMULATED_MICROS;
 /**
- * Reads the 16 bit value at a given address.
- * @param address The address of the memory to get the 16 bit value from.
- * @returns Returns a 16 bit value
+ * The time the calling thread's current scan started, in microseconds since the program started. The scan thread
+ * latches it once per cycle and each task worker once per release, so every timer in a scan sees the same time and
+ * the clock is read once per scan rather than once per timer. Threads that don't run tasks should use elapsed().
  */
- uint16_t readWord(std::string address);
+inline thread_local uint64_t SCAN_MICROS = 0;
 /**
- * Reads the 8 bit value at a given address.
- * @param address The address of the memory to get the 8 bit value from.
- * @returns Returns a 8 bit value
+ * Latches the scan time of the calling thread, and advances its timer wheel to it.
+ * @param now The time the scan started.
  */
-uint8_t readByte(std::string address);
+void latchScanTime(std::chrono::steady_clock::time_point now);
 /**
- * Reads the bit value at a given address.
- * @param address The address of the memory to get the bit value from.
- * @returns Returns a boolean value indicating the status of the bit.
+ * Provides the time the current scan started, for timers.
+ * @returns Returns the milliseconds since the program started, as of the start of the scan.
  */
-bool readBit(std::string address);
-
+inline uint64_t scanTime(){
+    return SCAN_MICROS / 1000;
+}
 /**
- * Writes a 64 bit value to an address in memory.
- * @param address The address of memory to write to.
- * @param value The 64 bit value to write to memory.
+ * Provides the time the current scan started with microsecond resolution.
+ * @returns Returns the microseconds since the program started, as of the start of the scan.
  */
-void writeDWord(std::string address, uint32_t value);
+inline uint64_t scanTimeMicros(){
+    return SCAN_MICROS;
+}
 
 /**
- * Writes a 32 bit value to an address in memory.
- * @param address The address of memory to write to.
- * @param value The 32 bit value to write to memory.
- */
-void writeDWord(std::string address, uint32_t value);
-/**
- * Writes a 16 bit value to an address in memory.
- * @param address The address of memory to write to.
- * @param value The 16 bit value to write to memory.
+ * The nanoseconds in a millisecond. TIME counts milliseconds, and LTIME, like the other long time and date types,
+ * counts nanoseconds, so the transpiler folds T#1h2m3s to 3723000 and LT#1h2m3s to 3723000000000.
  */
-void writeWord(std::string address, uint16_t value);
+constexpr int64_t NANOS_PER_MS = 1000000;
 /**
- * Writes a 8 bit value to an address in memory.
- * @param address The address of memory to write to.
- * @param value The 8 bit value to write to memory.
+ * An LTIME, a duration in nanoseconds.
  */
-void writeByte(std::string address, uint8_t value);
+typedef int64_t IEC_LTIME;
+
 /**
- * Writes a bit value to an address in memory.
- * @param address The address of memory to write to.
- * @param value The bit value to write to memory.
+ * A timer scheduled on a TimerWheel. Timer function blocks own one each. Copying a timer copies whether it has expired
+ * and when, but not its place on a wheel, so a copied function block never shares a slot of the wheel. A copy of a
+ * timer that was scheduled is idle(), and the function block schedules it again when it is next called.
  */
-void writeBit(std::string address, bool value);
+struct TimerNode {
+    TimerNode() = default;
+    TimerNode(const TimerNode& other) : expired(other.expired), expiry(other.expiry) {}
+    TimerNode& operator=(const TimerNode& other);
+    ~TimerNode();
+
+    /**
+     * Determines whether the timer is neither scheduled nor expired, as a copy of a scheduled timer is.
+     */
+    bool idle() const { return slot == nullptr && !expired; }
+
+    /**
+     * Whether the timer has expired since it was last scheduled.
+     */
+    bool expired = false;
+    /**
+     * The scan time, in milliseconds, at which the timer expires.
+     */
+    uint64_t expiry = 0;
+
+private:
+    friend class TimerWheel;
+    TimerNode* next = nullptr;
+    TimerNode* prev = nullptr;
+    TimerNode** slot = nullptr;     // The head of the slot the timer is in, or nullptr if it isn't scheduled.
+    class TimerWheel* wheel = nullptr;
+};
+
 /**
- * Gets the bit value from a variable
- * @param var A pointer to the variable from which to get the bit.
- * @param bit The number of the bit to get
- * @returns Returns the state of the bit.
+ * A hierarchical timing wheel with millisecond ticks. Four levels of 256 slots cover 2^32 ms. A timer is inserted into
+ * the slot of its expiry at the coarsest level needed, and is moved to a finer level when the wheel reaches that slot,
+ * so scheduling, cancelling and expiring a timer are all O(1). Each thread that runs tasks has its own wheel, which is
+ * advanced when the thread latches its scan time, so timers expire at the start of the scan without reading the clock.
  */
-bool getBit(void* var, int bit);
+class TimerWheel {
+public:
+    ~TimerWheel();
+
+    /**
+     * Schedules a timer, replacing any earlier schedule it had. A timer that is already due expires at once.
+     * @param node The timer to schedule.
+     * @param expiry The scan time at which it expires, in milliseconds.
+     */
+    void schedule(TimerNode& node, uint64_t expiry);
+    /**
+     * Cancels a timer. Its expired flag is cleared.
+     * @param node The timer to cancel.
+     */
+    void cancel(TimerNode& node);
+    /**
+     * Expires the timers that are due by a time.
+     * @param now The scan time to advance to, in milliseconds.
+     */
+    void advance(uint64_t now);
+    /**
+     * @returns Returns the number of timers that are scheduled and have not expired.
+     */
+    size_t pending() const { return count; }
+
+private:
+    static constexpr int LEVELS = 4;
+    static constexpr int SLOT_BITS = 8;
+    static constexpr uint64_t SLOTS = 1u << SLOT_BITS;
+
+    void insert(TimerNode& node);
+    void cascade(int level);
+    static void unlink(TimerNode& node);
+
+    TimerNode* slots[LEVELS][SLOTS] = {};
+    uint64_t current = 0;
+    size_t count = 0;
+};
+
 /**
- * Sets the bit in a variable.
- * @param var A pointer to the variable to which to set the bit.
- * @param bit The bit to set.
- * @param value The state to set the bit to.
+ * Gets the timer wheel of the calling thread.
+ * @returns Returns the wheel.
  */
-void setBit(void* var, int bit, bool value);
+TimerWheel& timerWheel();
 #pragma endregion
-#pragma region "Reference Handling"
+#pragma region "Protocols"
 
 /**
- * The RefVar class provides a means of declaring a variable with a reference to memory, similar to a pointer.
+ * Whether the clients and servers of Modbus, OPC UA and BACnet are built into the runtime. The compiler writes
+ * runtimeconfig.h with a 0 for each protocol the program doesn't use, and leaves the protocol's source, and its prebuilt
+ * open62541 or BACnet library, out of the build. A client of a protocol that is left out can't be created, and its
+ * server doesn't start.
  */
-template<typename T>
-class RefVar {
-private:
+#if __has_include("runtimeconfig.h")
+#include "runtimeconfig.h"
+#endif
+#ifndef NODALIS_MODBUS
+#define NODALIS_MODBUS 1
+#endif
+#ifndef NODALIS_OPCUA
+#define NODALIS_OPCUA 1
+#endif
+#ifndef NODALIS_BACNET
+#define NODALIS_BACNET 1
+#endif
+#pragma endregion
+#pragma region "Fixed Point"
 /**
- * The address of the memory.
+ * The number of fractional bits of a REAL in a program built with fixedReal, which gives REAL a range of about
+ * +/-2^(31 - NODALIS_FIXED_REAL_BITS) with a resolution of 2^-NODALIS_FIXED_REAL_BITS.
  */
-    std::string address;
-    /**
-     * The cached value of the address
-     */
-    T cache;
+#ifndef NODALIS_FIXED_REAL_BITS
+#define NODALIS_FIXED_REAL_BITS 16
+#endif
 
+/**
+ * A REAL held as a signed 32 bit Q-format number with Fraction fractional bits, for programs built with fixedReal
+ * for CPUs without a floating point unit, where each float operation is a library call. The arithmetic is integer
+ * arithmetic that saturates at the limits of the format instead of wrapping, and a division by zero gives the limit
+ * of the dividend's sign. Floats are only converted at the edges: literals, which the C++ compiler folds, the process
+ * image, which keeps the IEEE bits of a REAL so that clients see no difference, and the standard blocks that compute
+ * in float. Mixing a REAL with an integer or an LREAL converts the other operand to the REAL's format.
+ * @tparam Fraction The number of fractional bits, from 1 to 30.
+ */
+template<int Fraction>
+class QFixed {
+    static_assert(Fraction > 0 && Fraction < 31, "A QFixed needs from 1 to 30 fractional bits");
 public:
     /**
-     * Constructs a new RefVar object based on a given address
-     * @param addr The address to reference.
+     * The raw value of 1.
      */
-    RefVar(const std::string& addr) : address(addr) {
-        cache = read();
-    }
+    static constexpr int64_t ONE = int64_t(1) << Fraction;
+
+    constexpr QFixed() = default;
+    template<typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+    constexpr QFixed(T value) : raw(fromInteger(value)) {}
+    template<typename T, typename std::enable_if<std::is_floating_point<T>::value, int>::type = 0>
+    constexpr QFixed(T value) : raw(fromFloating(value)) {}
 
-    virtual ~RefVar() = default;
     /**
-     * Provides an assignment operator for RefVar so that it acts just like a primitive variable.
-     * @param value The value to assign.
+     * Makes a value from its raw bits.
+     * @param raw The value times 2^Fraction.
+     * @returns Returns the value.
      */
-    RefVar<T>& operator=(T value) {
-        cache = value;
-        write(value);
-        return *this;
+    static constexpr QFixed fromRaw(int32_t raw) {
+        QFixed value;
+        value.raw = raw;
+        return value;
     }
-
     /**
-     * Provides a reference operator to provide a reference to this RefVar.
+     * Gets the raw bits of the value, the value times 2^Fraction.
      */
-    RefVar<T>& operator&(){
-        return *this;
-    }
-
+    constexpr int32_t getRaw() const { return raw; }
     /**
-     * Provides an expression operator so that a RefVar object can be used in a statement like any other variable and return its memory value.
+     * Converts the value to a float, for the standard functions and blocks that compute in float.
      */
-    operator T() const {
-        return read();
+    constexpr operator float() const { return static_cast<float>(raw) / static_cast<float>(ONE); }
+
+    constexpr QFixed operator+() const { return *this; }
+    constexpr QFixed operator-() const { return fromRaw(saturate(-static_cast<int64_t>(raw))); }
+    friend constexpr QFixed operator+(QFixed a, QFixed b) { return fromRaw(saturate(static_cast<int64_t>(a.raw) + b.raw)); }
+    friend constexpr QFixed operator-(QFixed a, QFixed b) { return fromRaw(saturate(static_cast<int64_t>(a.raw) - b.raw)); }
+    friend constexpr QFixed operator*(QFixed a, QFixed b) {
+        // The product is rounded to the nearest, rather than truncated towards minus infinity by the shift.
+        return fromRaw(saturate((static_cast<int64_t>(a.raw) * b.raw + (ONE >> 1)) >> Fraction));
+    }
+    friend constexpr QFixed operator/(QFixed a, QFixed b) {
+        if (b.raw == 0) {
+            return fromRaw(a.raw < 0 ? INT32_MIN : INT32_MAX);
+        }
+        return fromRaw(saturate(static_cast<int64_t>(a.raw) * ONE / b.raw));
     }
+    friend constexpr bool operator==(QFixed a, QFixed b) { return a.raw == b.raw; }
+    friend constexpr bool operator!=(QFixed a, QFixed b) { return a.raw != b.raw; }
+    friend constexpr bool operator<(QFixed a, QFixed b) { return a.raw < b.raw; }
+    friend constexpr bool operator>(QFixed a, QFixed b) { return a.raw > b.raw; }
+    friend constexpr bool operator<=(QFixed a, QFixed b) { return a.raw <= b.raw; }
+    friend constexpr bool operator>=(QFixed a, QFixed b) { return a.raw >= b.raw; }
+    constexpr QFixed& operator+=(QFixed b) { return *this = *this + b; }
+    constexpr QFixed& operator-=(QFixed b) { return *this = *this - b; }
+    constexpr QFixed& operator*=(QFixed b) { return *this = *this * b; }
+    constexpr QFixed& operator/=(QFixed b) { return *this = *this / b; }
 
 private:
-    /**
-     * Reads the value of the reference from memory.
-     */
-    T read() const {
-        if constexpr (std::is_same_v<T, bool>) {
-            return readBit(address);
-        } else if constexpr (std::is_same_v<T, uint8_t>) {
-            return readByte(address);
-        } else if constexpr (std::is_same_v<T, uint16_t>) {
-            return readWord(address);
-        } else if constexpr (std::is_same_v<T, uint32_t>) {
-            return readDWord(address);
-        }
-        else if constexpr (std::is_same_v<T, uint64_t>)
-        {
-            return readLWord(address);
-        }
-        else
-        {
-            static_assert(!std::is_same_v<T, T>, "Unsupported type for RefVar");
-        }
+    int32_t raw = 0;
+
+    static constexpr int32_t saturate(int64_t value) {
+        return value > INT32_MAX ? INT32_MAX : value < INT32_MIN ? INT32_MIN : static_cast<int32_t>(value);
     }
-    /**
-     * Writes the value to the memory referenced.
-     * @param value The value to assign to the memory.
-     */
-    void write(T value) const {
-        if constexpr (std::is_same_v<T, bool>) {
-            writeBit(address, value);
-        } else if constexpr (std::is_same_v<T, uint8_t>) {
-            writeByte(address, value);
-        } else if constexpr (std::is_same_v<T, uint16_t>) {
-            writeWord(address, value);
-        } else if constexpr (std::is_same_v<T, uint32_t>) {
-            writeDWord(address, value);
-        }
-        else if constexpr (std::is_same_v<T, uint64_t>)
-        {
-            writeLWord(address, value);
-        }
-        else
-        {
-            static_assert(!std::is_same_v<T, T>, "Unsupported type for RefVar");
+    template<typename T>
+    static constexpr int32_t fromInteger(T value) {
+        constexpr int64_t limit = INT32_MAX >> Fraction;
+        if constexpr (std::is_signed<T>::value) {
+            if (static_cast<int64_t>(value) > limit) return INT32_MAX;
+            if (static_cast<int64_t>(value) < -limit - 1) return INT32_MIN;
+        } else {
+            if (static_cast<uint64_t>(value) > static_cast<uint64_t>(limit)) return INT32_MAX;
         }
+        return static_cast<int32_t>(static_cast<int64_t>(value) * ONE);
+    }
+    template<typename T>
+    static constexpr int32_t fromFloating(T value) {
+        T scaled = value * static_cast<T>(ONE);
+        if (scaled != scaled) return 0;
+        if (scaled >= static_cast<T>(INT32_MAX)) return INT32_MAX;
+        if (scaled <= static_cast<T>(INT32_MIN)) return INT32_MIN;
+        return static_cast<int32_t>(scaled < 0 ? scaled - static_cast<T>(0.5) : scaled + static_cast<T>(0.5));
     }
 };
 
+// An operand of another arithmetic type, such as a literal, is converted to the format of the REAL, so that the C++
+// compiler folds a literal into a constant and the operation stays integer arithmetic.
+#define QFIXED_MIXED(OP, RESULT) \
+template<int F, typename T, typename std::enable_if<std::is_arithmetic<T>::value, int>::type = 0> \
+constexpr RESULT operator OP(QFixed<F> a, T b) { return a OP QFixed<F>(b); } \
+template<int F, typename T, typename std::enable_if<std::is_arithmetic<T>::value, int>::type = 0> \
+constexpr RESULT operator OP(T a, QFixed<F> b) { return QFixed<F>(a) OP b; }
+QFIXED_MIXED(+, QFixed<F>)
+QFIXED_MIXED(-, QFixed<F>)
+QFIXED_MIXED(*, QFixed<F>)
+QFIXED_MIXED(/, QFixed<F>)
+QFIXED_MIXED(==, bool)
+QFIXED_MIXED(!=, bool)
+QFIXED_MIXED(<, bool)
+QFIXED_MIXED(>, bool)
+QFIXED_MIXED(<=, bool)
+QFIXED_MIXED(>=, bool)
+#undef QFIXED_MIXED
+
 /**
- * Gets a bit from a RefVar object.
- * @param var a reference to the RefVar object
- * @param bit The bit to read.
- * @returns Returns the state of the bit.
+ * The type of REAL in a program built with fixedReal.
  */
-template<typename T>
-bool getBit(RefVar<T>& var, int bit){
-    T ref = var;
-    return getBit(&ref, bit);
-}
+using FixedReal = QFixed<NODALIS_FIXED_REAL_BITS>;
+
 /**
- * Sets a bit in a RefVar object
- * @param var A reference to the RefVar object.
- * @param bit The bit to set.
- * @param value The state to set the bit to.
+ * Whether a type is a QFixed.
  */
 template<typename T>
-void setBit(RefVar<T>& var, int bit, bool value){
-    T ref = var;
-    setBit(&ref, bit, value);
-    var = ref;
-}
+struct isQFixedType : std::false_type {};
+template<int Fraction>
+struct isQFixedType<QFixed<Fraction>> : std::true_type {};
+template<typename T>
+constexpr bool isQFixed = isQFixedType<T>::value;
 #pragma endregion
-#pragma region "IO Handling"
+#pragma region "Memory Handling"
+
 /**
- * Handles the aquisition of IO inputs and the application of IO outputs.
+ * The sizes of the %I, %Q and %M spaces, in bytes. The compiler writes them to processimage.h, sized to cover every
+ * address the program uses. Each space is rounded up to a whole number of cache lines.
  */
-void superviseIO();
+#if __has_include("processimage.h")
+#include "processimage.h"
+#endif
+#ifndef NODALIS_INPUT_BYTES
+#define NODALIS_INPUT_BYTES 512
+#endif
+#ifndef NODALIS_OUTPUT_BYTES
+#define NODALIS_OUTPUT_BYTES 512
+#endif
+#ifndef NODALIS_MEMORY_BYTES
+#define NODALIS_MEMORY_BYTES 7168
+#endif
 
-// Identifies direction of I/O mapping
-enum class IOType {
-    Input,
-    Output
-};
+/**
+ * The size of a cache line, which each memory space starts on.
+ */
+constexpr size_t IMAGE_LINE_BYTES = 64;
 
 /**
- * Defines a single mapping between a remote IO module address and an internal address in the PLC.
+ * Rounds the size of a memory space up to a whole number of cache lines.
+ * @param bytes The size of the space.
+ * @returns Returns the rounded size.
  */
-class IOMap {
-public:
-    /**
-     * The direction of the IO interface.
-     */
-    IOType direction;
-    /**
-     * The unique identifier of the module. This can be the IP address or a unit ID.
+constexpr size_t imageSpaceBytes(size_t bytes){
+    return (bytes + IMAGE_LINE_BYTES - 1) & ~(IMAGE_LINE_BYTES - 1);
+}
+
+constexpr size_t INPUT_IMAGE_BYTES = imageSpaceBytes(NODALIS_INPUT_BYTES);
+constexpr size_t OUTPUT_IMAGE_BYTES = imageSpaceBytes(NODALIS_OUTPUT_BYTES);
+constexpr size_t MEMORY_IMAGE_BYTES = imageSpaceBytes(NODALIS_MEMORY_BYTES);
+constexpr size_t PROCESS_IMAGE_BYTES = INPUT_IMAGE_BYTES + OUTPUT_IMAGE_BYTES + MEMORY_IMAGE_BYTES;
+static_assert(PROCESS_IMAGE_BYTES <= 0x7fffffff, "The process image is too large");
+
+/**
+ * The part of %M that is retentive, kept in the retain file and restored when the runtime starts. The compiler
+ * writes it to processimage.h, spanning the program's RETAIN globals. NODALIS_RETAIN_OFFSET is relative to %MB0.
+ */
+#ifndef NODALIS_RETAIN_OFFSET
+#define NODALIS_RETAIN_OFFSET 0
+#endif
+#ifndef NODALIS_RETAIN_BYTES
+#define NODALIS_RETAIN_BYTES 0
+#endif
+constexpr size_t RETAIN_IMAGE_OFFSET = INPUT_IMAGE_BYTES + OUTPUT_IMAGE_BYTES + NODALIS_RETAIN_OFFSET;
+constexpr size_t RETAIN_IMAGE_BYTES = NODALIS_RETAIN_BYTES;
+static_assert(NODALIS_RETAIN_OFFSET + NODALIS_RETAIN_BYTES <= MEMORY_IMAGE_BYTES, "The retentive memory is outside of %M");
+
+/**
+ * Defines the total memory block for this PLC. The %I, %Q and %M spaces follow each other in this order, each one
+ * contiguous and starting on a cache line, so that %MW1 is the two bytes after %MW0 and a range of addresses can be
+ * copied in one block. The byte at %IB<a> is at offset a, %QB<a> at INPUT_IMAGE_BYTES + a, and %MB<a> at
+ * INPUT_IMAGE_BYTES + OUTPUT_IMAGE_BYTES + a. Wider values are found by shifting their index by the log2 of
+ * their size in bytes, so %MD3 starts at %MB12.
+ */
+alignas(IMAGE_LINE_BYTES) extern uint64_t MEMORY[PROCESS_IMAGE_BYTES / sizeof(uint64_t)];
+
+/**
+ * Defines a buffer with the same layout as MEMORY. Buffers of this type should be declared alignas(IMAGE_LINE_BYTES).
+ */
+typedef uint64_t ProcessImage[PROCESS_IMAGE_BYTES / sizeof(uint64_t)];
+
+/**
+ * The image the calling thread runs its logic against. This is MEMORY, unless the thread is a task worker
+ * with its own copy of the image (see TaskScheduler). All located reads and writes go through this pointer.
+ */
+inline thread_local uint64_t* TASK_IMAGE = MEMORY;
+
+/**
+ * Whether the writes to MEMORY mark the cache lines they change, so that commitOutputs() can tell the consumers of
+ * the image which lines changed in a scan. Without it, every line is reported as changed in every scan.
+ */
+#ifndef NODALIS_DIRTY_TRACKING
+#define NODALIS_DIRTY_TRACKING 1
+#endif
+
+/**
+ * The number of cache lines in the process image, and of 64 bit words in a bitmap of them.
+ */
+constexpr size_t IMAGE_LINES = PROCESS_IMAGE_BYTES / IMAGE_LINE_BYTES;
+constexpr size_t IMAGE_LINE_WORDS = (IMAGE_LINES + 63) / 64;
+
+/**
+ * The bitmap of the cache lines of MEMORY changed since the last commitOutputs(). It is guarded like MEMORY: the
+ * scan thread marks it, and task workers mark it while they merge their image under the image's lock.
+ */
+extern uint64_t DIRTY_LINES[IMAGE_LINE_WORDS];
+
+/**
+ * The bitmap the calling thread marks the lines it writes in. The threads of the program pool mark their own, which
+ * runParallel() merges into DIRTY_LINES when their stage is over.
+ */
+inline thread_local uint64_t* DIRTY_TARGET = DIRTY_LINES;
+
+/**
+ * Marks the lines of MEMORY holding a range of bytes as written. Writes to a task worker's private image are
+ * skipped; they are marked when the image is merged back.
+ * @param offset The offset of the first byte from the start of the image.
+ * @param bytes The number of bytes written.
+ */
+inline void markImageDirty(size_t offset, size_t bytes){
+#if NODALIS_DIRTY_TRACKING
+    if(TASK_IMAGE != MEMORY){
+        return;
+    }
+    size_t first = offset / IMAGE_LINE_BYTES;
+    size_t last = (offset + bytes - 1) / IMAGE_LINE_BYTES;
+    DIRTY_TARGET[first >> 6] |= 1ull << (first & 63);
+    DIRTY_TARGET[last >> 6] |= 1ull << (last & 63);
+#endif
+}
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+/**
+ * Counts the trailing zero bits of a bitmap word.
+ * @param word The word, which must not be 0.
+ * @returns Returns the index of the lowest set bit.
+ */
+inline int countTrailingZeros(uint64_t word){
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+inline std::string toLowerCase(const std::string& input) {
+    std::string result = input;
+    for (size_t i = 0; i < result.size(); ++i) {
+        result[i] = std::tolower(result[i]);
+    }
+    return result;
+}
+
+/**
+ * Defines the memory space designations for use in getting memory addresses.
+ */
+enum MEMORY_SPACE : int {
+    I, //input memory space
+    Q, //output memory space
+    M, //Virtual memory space
+};
+
+/**
+ * The result of parsing or resolving an address without throwing.
+ */
+enum class AddressStatus : int {
+    OK, //the address is valid
+    INVALID_FORMAT, //the address is not of the form %<space><width><index>[.<bit>]
+    INVALID_TYPE, //the width of the address does not match the width it is used with
+    INVALID_INDEX, //the addressed value is outside of its memory space
+    INVALID_BIT, //a bit was expected and is missing or outside of the memory space, or a bit was given where none is expected
+};
+
+/**
+ * Gets a description of an address status, for error messages.
+ * @param status The status.
+ * @returns Returns the description.
+ */
+inline const char* addressStatusText(AddressStatus status) {
+    switch (status) {
+        case AddressStatus::OK: return "Valid address";
+        case AddressStatus::INVALID_FORMAT: return "Invalid address format";
+        case AddressStatus::INVALID_TYPE: return "Invalid address type";
+        case AddressStatus::INVALID_INDEX: return "Invalid address index";
+        case AddressStatus::INVALID_BIT: return "Invalid address bit";
+    }
+    return "Invalid address";
+}
+
+/**
+ * Parses a ST address reference without throwing or allocating.
+ * @param address A string representing the ST address.
+ * @param space Receives the memory space (Input, Output, or Virtual).
+ * @param width Receives the width in bits.
+ * @param index Receives the address index.
+ * @param bit Receives the bit, or -1 if the address does not select a bit.
+ * @returns Returns true if the address is well formed.
+ */
+inline bool tryParseAddress(const std::string& address, int& space, int& width, int& index, int& bit) noexcept {
+    size_t pos = 0;
+    size_t len = address.size();
+    space = width = index = bit = -1;
+
+    if (len < 4 || address[pos++] != '%') {
+        return false;
+    }
+    switch (std::tolower(static_cast<unsigned char>(address[pos++]))) {
+        case 'i': space = MEMORY_SPACE::I; break;
+        case 'q': space = MEMORY_SPACE::Q; break;
+        case 'm': space = MEMORY_SPACE::M; break;
+        default: return false;
+    }
+    switch (std::tolower(static_cast<unsigned char>(address[pos++]))) {
+        case 'x': width = 8; break;
+        case 'b': width = 8; break;
+        case 'w': width = 16; break;
+        case 'd': width = 32; break;
+        case 'l': width = 64; break;
+        default: return false;
+    }
+
+    auto parseNumber = [&](int& value) {
+        size_t begin = pos;
+        long long number = 0;
+        while (pos < len && std::isdigit(static_cast<unsigned char>(address[pos]))) {
+            number = number * 10 + (address[pos] - '0');
+            if (number > 0x7fffffff) return false;
+            pos++;
+        }
+        value = static_cast<int>(number);
+        return pos != begin;
+    };
+
+    if (!parseNumber(index)) {
+        return false;
+    }
+    if (pos < len && address[pos] == '.') {
+        pos++;
+        if (!parseNumber(bit)) {
+            return false;
+        }
+    }
+    return pos == len;
+}
+
+/**
+ * Parses a ST address reference into a vector with the memory space, type, byte index, and bit broken out.
+ * @param address A string representing the ST address.
+ * @returns Returns a vector with four elements: the memory space (Input, Output, or Virtual), the width in bits, the address index, and the bit.
+ * @throws std::invalid_argument if the address is malformed.
+ */
+inline std::vector<int> parseAddress(const std::string& address) {
+    int space, width, index, bit;
+    if (!tryParseAddress(address, space, width, index, bit)) {
+        NODALIS_THROW(std::invalid_argument("Invalid address format: " + address));
+    }
+    return {space, width, index, bit};
+}
+
+/**
+ * Maps an address width in bits to the unsigned type that holds it.
+ */
+template<int Width>
+using MemoryType = std::conditional_t<Width == 8, uint8_t,
+                   std::conditional_t<Width == 16, uint16_t,
+                   std::conditional_t<Width == 32, uint32_t, uint64_t>>>;
+
+/**
+ * Whether the values of the image are read and written with relaxed atomic accesses, so that a thread never sees half
+ * of a value another thread wrote. Every located value is naturally aligned, since each space starts on a cache line
+ * and an address is its index times its width, so an aligned access of its width is all it takes. That is a single
+ * copy on a 64 bit target, where this is off by default and the plain accesses are kept for the compiler to combine,
+ * but a 32 bit target such as linux-arm may copy an LWORD or LREAL as two words, so it is on by default there.
+ */
+#ifndef NODALIS_ATOMIC_IMAGE
+#if UINTPTR_MAX <= 0xffffffffu
+#define NODALIS_ATOMIC_IMAGE 1
+#else
+#define NODALIS_ATOMIC_IMAGE 0
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+/**
+ * The types a value of the image is accessed as. GCC and Clang are told that they alias the uint64_t words of MEMORY,
+ * so that a WORD written through one is seen by the copies that move the image a word or a line at a time.
+ */
+template<int Width> struct ImageWordType;
+template<> struct ImageWordType<8> { typedef uint8_t __attribute__((may_alias)) type; };
+template<> struct ImageWordType<16> { typedef uint16_t __attribute__((may_alias)) type; };
+template<> struct ImageWordType<32> { typedef uint32_t __attribute__((may_alias)) type; };
+template<> struct ImageWordType<64> { typedef uint64_t __attribute__((may_alias)) type; };
+template<int Width>
+using ImageWord = typename ImageWordType<Width>::type;
+#else
+template<int Width>
+using ImageWord = MemoryType<Width>;
+#endif
+
+/**
+ * Reads a value of an address width from an image. The value must be aligned to its width.
+ * @tparam Width The width of the value in bits.
+ * @param data The first byte of the value.
+ * @returns Returns the value.
+ */
+template<int Width>
+inline MemoryType<Width> loadImageWord(const uint8_t* data){
+    const ImageWord<Width>* word = reinterpret_cast<const ImageWord<Width>*>(data);
+#if NODALIS_ATOMIC_IMAGE && (defined(__GNUC__) || defined(__clang__))
+    return __atomic_load_n(word, __ATOMIC_RELAXED);
+#else
+    return *word;
+#endif
+}
+
+/**
+ * Writes a value of an address width to an image. The value must be aligned to its width.
+ * @tparam Width The width of the value in bits.
+ * @param data The first byte of the value.
+ * @param value The value to write.
+ */
+template<int Width>
+inline void storeImageWord(uint8_t* data, MemoryType<Width> value){
+    ImageWord<Width>* word = reinterpret_cast<ImageWord<Width>*>(data);
+#if NODALIS_ATOMIC_IMAGE && (defined(__GNUC__) || defined(__clang__))
+    __atomic_store_n(word, value, __ATOMIC_RELAXED);
+#else
+    *word = value;
+#endif
+}
+
+/**
+ * Writes a value of an address width to an image unless it already holds it. Writes that leave the image as it was
+ * don't mark its lines, so that a rung rewriting the same coil every scan doesn't make its line look changed.
+ * @tparam Width The width of the value in bits.
+ * @param data The first byte of the value, which must be aligned to its width.
+ * @param value The value to write.
+ * @returns Returns true if the value was different.
+ */
+template<int Width>
+inline bool replaceImageWord(uint8_t* data, MemoryType<Width> value){
+    if(loadImageWord<Width>(data) == value){
+        return false;
+    }
+    storeImageWord<Width>(data, value);
+    return true;
+}
+
+/**
+ * An address reference that has been parsed and validated once, along with its offset into the process image,
+ * so that it can be read and written without parsing the address again.
+ */
+struct ResolvedAddress {
+    /**
+     * The memory space of the address.
      */
-    std::string moduleID;
+    int space = -1;
     /**
-     * The port for the module communications port. In TCP/IP coms, this is the TCP port. In serial, this is the serial port.
+     * The width of the address in bits.
      */
-    std::string modulePort;
+    int width = -1;
     /**
-     * The name of the protocol for this map.
+     * The index of the address, in units of its width.
      */
-    std::string protocol;
+    int index = -1;
     /**
-     * Additional properties, as defined by the protocol.
+     * The bit selected by the address, or -1 if the address does not select a bit.
      */
-    json additionalProperties;
+    int bit = -1;
     /**
-     * The remote address, as it is understood by the protocol.
+     * The offset of the first byte of the addressed value from the start of the image.
      */
-    std::string remoteAddress;  // e.g. "40001"
+    size_t offset = 0;
     /**
-     * The local address, which is a memory address reference.
+     * The offset of the byte containing the selected bit from the start of the image.
      */
-    std::string localAddress;   // e.g. "%MW1"
+    size_t bitOffset = 0;
     /**
-     * The bit of the address.
+     * The mask of the selected bit within its byte.
      */
-    int bit = -1;               // Optional bit index
+    uint8_t bitMask = 0;
+
     /**
-     * The width of the input to read from the remote and store in the address.
+     * Reads the addressed value from an image.
+     * @param image The start of the image, such as the one passed to a readImage() reader.
+     * @returns Returns the value at the address. Bit addresses return 0 or 1.
      */
-    int width = 16;             // 8, 16, or 32
+    uint64_t load(const uint8_t* image) const {
+        uint64_t value = 0;
+        if (bit > -1) {
+            value = (image[bitOffset] & bitMask) != 0 ? 1 : 0;
+        }
+        else {
+            switch (width) {
+                case 8: value = loadImageWord<8>(image + offset); break;
+                case 16: value = loadImageWord<16>(image + offset); break;
+                case 32: value = loadImageWord<32>(image + offset); break;
+                default: value = loadImageWord<64>(image + offset); break;
+            }
+        }
+        return value;
+    }
     /**
-     * The interval at which the module should be polled for this address.
+     * Gets a pointer to the first byte of the addressed value in the calling thread's image.
      */
-    int interval = 500;
+    uint8_t* data() const { return reinterpret_cast<uint8_t*>(TASK_IMAGE) + offset; }
     /**
-     * The last time the module was polled, in Milliseconds.
+     * Reads the selected bit.
      */
-    uint64_t lastPoll = 0;
+    bool getBit() const { return (reinterpret_cast<const uint8_t*>(TASK_IMAGE)[bitOffset] & bitMask) != 0; }
     /**
-     * Constructs a new IOMap object based on a string of JSON.
-     * @param A string of JSON properties.
+     * Writes the selected bit.
+     * @param value The state to set the bit to.
      */
-    IOMap(std::string mapJson);
-    IOMap();
+    void setBit(bool value) const {
+        uint8_t& byte = reinterpret_cast<uint8_t*>(TASK_IMAGE)[bitOffset];
+        if (((byte & bitMask) != 0) == value) return;
+        if (value) byte |= bitMask;
+        else byte &= static_cast<uint8_t>(~bitMask);
+        markImageDirty(bitOffset, 1);
+    }
+    /**
+     * Writes the addressed value, truncated to the width of the address. Bit addresses are set if the value is not 0.
+     * @param value The value to write.
+     */
+    void store(uint64_t value) const {
+        if (bit > -1) {
+            setBit(value != 0);
+        }
+        else {
+            bool changed;
+            switch (width) {
+                case 8: changed = replaceImageWord<8>(data(), static_cast<uint8_t>(value)); break;
+                case 16: changed = replaceImageWord<16>(data(), static_cast<uint16_t>(value)); break;
+                case 32: changed = replaceImageWord<32>(data(), static_cast<uint32_t>(value)); break;
+                default: changed = replaceImageWord<64>(data(), value); break;
+            }
+            if (changed) markImageDirty(offset, width / 8);
+        }
+    }
+    /**
+     * Tells whether two resolved addresses select the same value or bit.
+     */
+    bool operator==(const ResolvedAddress& other) const {
+        return offset == other.offset && bit == other.bit && width == other.width;
+    }
 };
 
 /**
- * The IOClient is an abstract class implemented by all protocol clients that will be used in Nodalis.
+ * Parses and validates an address once, resolving it to a location in memory, without throwing or allocating.
+ * @param address A string representing the ST address.
+ * @param width The width, in bits, the address must have, or -1 to accept any width. Ignored for bit references.
+ * @param isBit Indicates whether the address must select a bit (true) or must not select a bit (false).
+ * @param resolved Receives the resolved address. It is left unchanged if the address is invalid.
+ * @returns Returns AddressStatus::OK, or the reason the address is invalid.
  */
-class IOClient {
-public:
-    /**
-    * Indicates whether the IOClient is connected to its remote module.
-    */
-    bool connected;
-    IOClient(const std::string& protocol);
-    virtual ~IOClient() = default;
+AddressStatus tryResolveAddress(const std::string& address, int width, bool isBit, ResolvedAddress& resolved) noexcept;
 
-    void addMapping(const IOMap& map);
-    bool hasMapping(std::string localAddress);
+/**
+ * Parses and validates an address once, resolving it to a location in memory.
+ * @param address A string representing the ST address.
+ * @param width The width, in bits, the address must have, or -1 to accept any width. Ignored for bit references.
+ * @param isBit Indicates whether the address must select a bit (true) or must not select a bit (false).
+ * @returns Returns the resolved address.
+ * @throws std::invalid_argument if the address is malformed or does not match the requested width or bit selection.
+ */
+ResolvedAddress resolveAddress(const std::string& address, int width, bool isBit);
 
-    void poll(); // Reads and writes mapped I/O
+/**
+ * Gets the offset and size of a memory space within MEMORY.
+ * @param space The memory space.
+ * @param size Receives the size of the space in bytes, or 0 if there is no such space.
+ * @returns Returns the offset of the first byte of the space.
+ */
+constexpr size_t memorySpace(int space, size_t& size){
+    switch(space){
+        case MEMORY_SPACE::I: size = INPUT_IMAGE_BYTES; return 0;
+        case MEMORY_SPACE::Q: size = OUTPUT_IMAGE_BYTES; return INPUT_IMAGE_BYTES;
+        case MEMORY_SPACE::M: size = MEMORY_IMAGE_BYTES; return INPUT_IMAGE_BYTES + OUTPUT_IMAGE_BYTES;
+    }
+    size = 0;
+    return 0;
+}
 
-    const std::string& getProtocol() const;
-    const std::string& getModuleID() const;
-protected:
-    std::string protocol;
-    std::string moduleID;
-    std::vector<IOMap> mappings;
-    uint64_t lastAttempt = 0;
+/**
+ * Gets the log2 of the size in bytes of an address width, which converts an index to a byte index.
+ * @param width The width of the address in bits.
+ * @returns Returns the shift, or -1 if the width is invalid.
+ */
+constexpr int widthShift(int width){
+    switch(width){
+        case 8: return 0;
+        case 16: return 1;
+        case 32: return 2;
+        case 64: return 3;
+    }
+    return -1;
+}
 
-    // Must be implemented by derived classes
-    virtual bool readBit(const std::string& remote, int& result) = 0;
-    virtual bool writeBit(const std::string& remote, int value) = 0;
-    virtual bool readByte(const std::string& remote, uint8_t& result) = 0;
-    virtual bool writeByte(const std::string& remote, uint8_t value) = 0;
-    virtual bool readWord(const std::string& remote, uint16_t& result) = 0;
-    virtual bool writeWord(const std::string& remote, uint16_t value) = 0;
-    virtual bool readDWord(const std::string& remote, uint32_t& result) = 0;
-    virtual bool writeDWord(const std::string& remote, uint32_t value) = 0;
-    virtual bool readLWord(const std::string &remote, uint64_t &result) = 0;
-    virtual bool writeLWord(const std::string &remote, uint64_t value) = 0;
-    virtual void connect() = 0;
-    virtual void onMappingAdded(const IOMap& map) { (void)map; }
-};
+/**
+ * Computes the byte offset of a range of bytes within MEMORY. This can be evaluated at compile time.
+ * @param space The memory space of the address.
+ * @param addr The byte index within the memory space.
+ * @param count The number of bytes that must be in the space, starting at addr.
+ * @returns Returns the offset of the byte from the start of MEMORY, or -1 if the bytes are not all in the space.
+ */
+constexpr int memoryOffset(int space, long long addr, long long count = 1){
+    size_t size = 0;
+    size_t base = memorySpace(space, size);
+    if(addr < 0 || count < 1 || static_cast<unsigned long long>(addr + count) > size){
+        return -1;
+    }
+    return static_cast<int>(base + static_cast<size_t>(addr));
+}
 
-extern std::vector<std::unique_ptr<IOClient>> Clients;
+/**
+ * Computes the byte offset of an address within MEMORY. This can be evaluated at compile time.
+ * @param space The memory space of the address.
+ * @param width The width of the address in bits.
+ * @param index The index of the address, in units of its width.
+ * @returns Returns the offset of the first byte of the value, or -1 if the value is not entirely in the space.
+ */
+constexpr int addressOffset(int space, int width, long long index){
+    int shift = widthShift(width);
+    if(shift < 0 || index < 0 || index > 0x7fffffff){
+        return -1;
+    }
+    return memoryOffset(space, index << shift, 1ll << shift);
+}
 
-IOClient* findClient(IOMap map);
-std::unique_ptr<IOClient> createClient(IOMap& map);
+/**
+ * Computes the byte offset of the byte holding a bit of an address within MEMORY. This can be evaluated at compile time.
+ * @param space The memory space of the address.
+ * @param width The width of the address in bits.
+ * @param index The index of the address, in units of its width.
+ * @param bit The bit, counted from the first byte of the value.
+ * @returns Returns the offset of the byte holding the bit, or -1 if that byte is not in the space.
+ */
+constexpr int bitOffset(int space, int width, long long index, int bit){
+    int shift = widthShift(width);
+    if(shift < 0 || bit < 0 || index < 0 || index > 0x7fffffff){
+        return -1;
+    }
+    return memoryOffset(space, (index << shift) + (bit >> 3));
+}
 
+/**
+ * Gets a byte pointer to a memory address in a certain memory space of the calling thread's image.
+ * @param space The memory space from which to get the address
+ * @param addr The byte index to pull from.
+ * @returns Returns a byte pointer to the memory address, or 0 if there is no memory at the given address.
+ */
+inline uint8_t* getMemoryByte(int space, int addr){
+    int offset = memoryOffset(space, addr);
+    if(offset < 0){
+        return 0;
+    }
+    return reinterpret_cast<uint8_t*>(TASK_IMAGE) + offset;
+}
+/**
+ * Gets a word pointer to a memory address in a certain memory space.
+ * @param space The memory space from which to get the address.
+ * @param addr The word index to pull from.
+ * @returns Returns a word pointer to a memory address, or 0 if there is no memory at the given address.
+ */
+inline ImageWord<16>* getMemoryWord(int space, int addr){
+    int offset = addressOffset(space, 16, addr);
+    return offset < 0 ? 0 : reinterpret_cast<ImageWord<16>*>(reinterpret_cast<uint8_t*>(TASK_IMAGE) + offset);
+}
+/**
+ * Gets a double word pointer to a memory address in a certain memory space.
+ * @param space The memory space from which to get the address
+ * @param addr The double word index to pull from.
+ * @return Returns a double word pointer to a memory address, or 0 if there is no memory at the given address.
+ */
+inline ImageWord<32>* getMemoryDWord(int space, int addr){
+    int offset = addressOffset(space, 32, addr);
+    return offset < 0 ? 0 : reinterpret_cast<ImageWord<32>*>(reinterpret_cast<uint8_t*>(TASK_IMAGE) + offset);
+}
 
-void mapIO(std::string map);
+/**
+ * Gets a long word pointer to a memory address in a certain memory space.
+ * @param space The memory space from which to get the address
+ * @param addr The double word index to pull from.
+ * @return Returns a long word pointer to a memory address, or 0 if there is no memory at the given address.
+ */
+inline ImageWord<64> *getMemoryLWord(int space, int addr)
+{
+    int offset = addressOffset(space, 64, addr);
+    return offset < 0 ? 0 : reinterpret_cast<ImageWord<64>*>(reinterpret_cast<uint8_t*>(TASK_IMAGE) + offset);
+}
 
-#pragma endregion
+/**
+ * Whether a type can be viewed in the process image: BOOL as a bit, the signed and unsigned integers, and the IEEE
+ * floats REAL and LREAL, which are stored as their bits in a DWORD or LWORD. A fixed point REAL is stored as the bits
+ * of the float it converts to.
+ */
+template<typename T>
+constexpr bool isImageType = std::is_same_v<T, bool> ||
+    ((std::is_integral_v<T> || std::is_same_v<T, float> || std::is_same_v<T, double> || isQFixed<T>) &&
+     (sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8));
 
-#pragma region "Standard Function Blocks"
+/**
+ * Reinterprets the bits of a value as another type of the same size, which compiles to nothing or a register move.
+ * @param value The value to reinterpret.
+ * @returns Returns the value with the same bits.
+ */
+template<typename To, typename From>
+inline To imageCast(From value){
+    static_assert(sizeof(To) == sizeof(From), "imageCast requires types of the same size");
+    if constexpr (std::is_same_v<To, From>) {
+        return value;
+    } else if constexpr (isQFixed<From>) {
+        return imageCast<To>(static_cast<float>(value));
+    } else if constexpr (isQFixed<To>) {
+        return To(imageCast<float>(value));
+    } else {
+        To ret;
+        std::memcpy(&ret, &value, sizeof(To));
+        return ret;
+    }
+}
 
-class TP{
-    public:
-        bool Q;
-        bool IN;
-        uint64_t PT;
-        uint64_t ET;
-    
+/**
+ * Reads a value of a type from the image. Signed values are read from their two's complement bits and floats from
+ * their IEEE bits.
+ * @param data The first byte of the value.
+ * @returns Returns the value.
+ */
+template<typename T>
+inline T loadImageValue(const uint8_t* data){
+    static_assert(isImageType<T> && !std::is_same_v<T, bool>, "Unsupported type for the process image");
+    return imageCast<T>(loadImageWord<sizeof(T) * 8>(data));
+}
 
-    void operator()(){
-        Q = false;
-        if(!lastIN && IN){
-            lastIN = IN;
+/**
+ * Writes a value of a type to the image.
+ * @param data The first byte of the value.
+ * @param value The value to write.
+ */
+template<typename T>
+inline void storeImageValue(uint8_t* data, T value){
+    static_assert(isImageType<T> && !std::is_same_v<T, bool>, "Unsupported type for the process image");
+    storeImageWord<sizeof(T) * 8>(data, imageCast<MemoryType<sizeof(T) * 8>>(value));
+}
+
+/**
+ * Provides a reference to a located address that was resolved when the program was compiled, so that no address
+ * parsing happens during the scan. An address outside of its memory space fails to compile. The reference is read and
+ * written with plain accesses; readMemory() and writeMemory() use the atomic ones when NODALIS_ATOMIC_IMAGE is set.
+ * @tparam Space The memory space of the address.
+ * @tparam Width The width of the address in bits.
+ * @tparam Index The index of the address, in units of its width.
+ * @returns Returns a reference to the value in memory.
+ */
+template<int Space, int Width, int Index>
+inline ImageWord<Width>& memoryRef(){
+    static_assert(Width == 8 || Width == 16 || Width == 32 || Width == 64, "Invalid address width");
+    constexpr int offset = addressOffset(Space, Width, Index);
+    static_assert(offset >= 0, "Address is outside of memory");
+    static_assert(offset % (Width / 8) == 0, "Address is not aligned to its width");
+    return *reinterpret_cast<ImageWord<Width>*>(reinterpret_cast<uint8_t*>(TASK_IMAGE) + offset);
+}
+
+/**
+ * Reads a located address that was resolved when the program was compiled, as a single aligned load.
+ * Generated code uses this for reads of %I, %Q and %M literals.
+ * @tparam Space The memory space of the address.
+ * @tparam Width The width of the address in bits.
+ * @tparam Index The index of the address, in units of its width.
+ * @returns Returns the value in memory.
+ */
+template<int Space, int Width, int Index>
+inline MemoryType<Width> readMemory(){
+    return loadImageWord<Width>(reinterpret_cast<const uint8_t*>(&memoryRef<Space, Width, Index>()));
+}
+
+/**
+ * Reads a bit from a located address that was resolved when the program was compiled.
+ * @tparam Space The memory space of the address.
+ * @tparam Width The width of the address in bits.
+ * @tparam Index The index of the address, in units of its width.
+ * @tparam Bit The bit to read.
+ * @returns Returns the state of the bit.
+ */
+template<int Space, int Width, int Index, int Bit>
+inline bool readMemoryBit(){
+    static_assert(Bit >= 0, "Invalid address bit");
+    constexpr int offset = bitOffset(Space, Width, Index, Bit);
+    static_assert(offset >= 0, "Address is outside of memory");
+    return (reinterpret_cast<const uint8_t*>(TASK_IMAGE)[offset] & (1u << (Bit % 8))) != 0;
+}
+
+/**
+ * Writes a bit to a located address that was resolved when the program was compiled.
+ * @tparam Space The memory space of the address.
+ * @tparam Width The width of the address in bits.
+ * @tparam Index The index of the address, in units of its width.
+ * @tparam Bit The bit to write.
+ * @param value The state to set the bit to.
+ */
+template<int Space, int Width, int Index, int Bit>
+inline void writeMemoryBit(bool value){
+    static_assert(Bit >= 0, "Invalid address bit");
+    constexpr int offset = bitOffset(Space, Width, Index, Bit);
+    static_assert(offset >= 0, "Address is outside of memory");
+    uint8_t& byte = reinterpret_cast<uint8_t*>(TASK_IMAGE)[offset];
+    if(((byte & (1u << (Bit % 8))) != 0) == value) return;
+    if(value) byte |= static_cast<uint8_t>(1u << (Bit % 8));
+    else byte &= static_cast<uint8_t>(~(1u << (Bit % 8)));
+    markImageDirty(offset, 1);
+}
+
+/**
+ * Writes a located address that was resolved when the program was compiled, and marks it as changed if it was.
+ * Generated code uses this for assignments to %I, %Q and %M literals.
+ * @tparam Space The memory space of the address.
+ * @tparam Width The width of the address in bits.
+ * @tparam Index The index of the address, in units of its width.
+ * @param value The value to write.
+ */
+template<int Space, int Width, int Index>
+inline void writeMemory(MemoryType<Width> value){
+    if(replaceImageWord<Width>(reinterpret_cast<uint8_t*>(&memoryRef<Space, Width, Index>()), value)){
+        markImageDirty(addressOffset(Space, Width, Index), Width / 8);
+    }
+}
+
+/**
+ * Reads a located address that was resolved when the program was compiled as a value of a type, such as a REAL
+ * from %MD4 or an INT from %IW2. The width of the address is the size of the type, so this is a single load.
+ * @tparam T The type of the value.
+ * @tparam Space The memory space of the address.
+ * @tparam Index The index of the address, in units of the size of the type.
+ * @returns Returns the value.
+ */
+template<typename T, int Space, int Index>
+inline T readMemoryAs(){
+    return loadImageValue<T>(reinterpret_cast<const uint8_t*>(&memoryRef<Space, sizeof(T) * 8, Index>()));
+}
+
+/**
+ * Writes a value of a type to a located address that was resolved when the program was compiled, and marks it as
+ * changed. This is a single store.
+ * @tparam T The type of the value.
+ * @tparam Space The memory space of the address.
+ * @tparam Index The index of the address, in units of the size of the type.
+ * @param value The value to write.
+ */
+template<typename T, int Space, int Index>
+inline void writeMemoryAs(T value){
+    writeMemory<Space, sizeof(T) * 8, Index>(imageCast<MemoryType<sizeof(T) * 8>>(value));
+}
+
+#pragma region "Incremental Evaluation"
+/**
+ * The state of incremental evaluation (--incremental), which the rung guards of programs compiled with the
+ * incremental option read (see IncrementalRung). It is set once before the tasks start, and advanced by
+ * commitOutputs().
+ */
+struct IncrementalScan {
+    /**
+     * Set when rungs may be skipped: with --incremental, when the tasks run on the scan thread.
+     */
+    bool enabled = false;
+    /**
+     * Set for the scans that evaluate every rung, every --incremental-full scans.
+     */
+    bool full = false;
+    /**
+     * The number of images committed, plus 1. A line stamped with an epoch changed before that image was committed.
+     */
+    uint64_t epoch = 1;
+};
+extern IncrementalScan INCREMENTAL;
+
+/**
+ * The epoch of the last image each line of MEMORY changed in, kept while incremental evaluation is enabled.
+ */
+extern uint64_t LINE_EPOCHS[IMAGE_LINES];
+
+/**
+ * Gets the line of MEMORY a located address lies in, which is checked when the program is compiled.
+ * @tparam Space The memory space of the address.
+ * @tparam Width The width of the address in bits.
+ * @tparam Index The index of the address, in units of its width.
+ * @tparam Bit The bit selected by the address, or -1 if the address does not select a bit.
+ * @returns Returns the index of the line.
+ */
+template<int Space, int Width, int Index, int Bit = -1>
+constexpr uint32_t imageLine(){
+    constexpr int offset = Bit < 0 ? addressOffset(Space, Width, Index) : bitOffset(Space, Width, Index, Bit);
+    static_assert(offset >= 0, "Address is outside of memory");
+    return static_cast<uint32_t>(offset / IMAGE_LINE_BYTES);
+}
+
+/**
+ * Tells whether a line of MEMORY changed since an epoch: in an image committed since, or in the scan under way,
+ * by the calling thread or by an earlier stage of the program pool.
+ * @param line The index of the line.
+ * @param since The epoch.
+ */
+inline bool lineChangedSince(uint32_t line, uint64_t since){
+    uint64_t bit = 1ull << (line & 63);
+    return ((DIRTY_LINES[line >> 6] | DIRTY_TARGET[line >> 6]) & bit) != 0 || LINE_EPOCHS[line] >= since;
+}
+
+/**
+ * Guards a group of top level statements of a program, a rung, so that it is only evaluated when it could do
+ * something it didn't the last time. The rung names the lines of the located addresses it reads or writes, and
+ * passes the values of its other operands before it is evaluated, to due(), and after, to done(). It is skipped
+ * when none of its lines changed since it was last checked, its operands hold the values they had after it was last
+ * evaluated, and that evaluation left them as it found them: the rung only reads its operands and calls pure
+ * functions, so evaluating it again would write the same values again.
+ * @tparam T The types of the operands that aren't located, which are compared with ==.
+ */
+template<typename... T>
+class IncrementalRung {
+public:
+    /**
+     * Decides whether the rung is evaluated in this scan.
+     * @param lines The lines of the located addresses of the rung.
+     * @param values The values of its other operands.
+     * @returns Returns false to skip the rung.
+     */
+    bool due(std::initializer_list<uint32_t> lines, const T&... values){
+        evaluating = INCREMENTAL.enabled;
+        if(!evaluating){
+            return true;
+        }
+        bool skip = settled && !INCREMENTAL.full && std::tuple<const T&...>(values...) == last;
+        for(auto it = lines.begin(); skip && it != lines.end(); ++it){
+            skip = !lineChangedSince(*it, checked);
+        }
+        checked = INCREMENTAL.epoch;
+        if(skip){
+            return false;
+        }
+        last = std::tuple<T...>(values...);
+        return true;
+    }
+    /**
+     * Records the values of the operands after the rung was evaluated.
+     * @param values The values of the operands that aren't located.
+     */
+    void done(const T&... values){
+        if(evaluating){
+            settled = std::tuple<const T&...>(values...) == last;
+        }
+    }
+private:
+    std::tuple<T...> last{};
+    uint64_t checked = 0;
+    bool settled = false;
+    bool evaluating = false;
+};
+#pragma endregion
+
+/**
+ * Resolves a located address that was parsed when the program was compiled. An address outside of its memory
+ * space fails to compile, so the handle needs no checks when it is used.
+ * @tparam Space The memory space of the address.
+ * @tparam Width The width of the address in bits.
+ * @tparam Index The index of the address, in units of its width.
+ * @tparam Bit The bit selected by the address, or -1 if the address does not select a bit.
+ * @returns Returns the resolved address.
+ */
+template<int Space, int Width, int Index, int Bit = -1>
+constexpr ResolvedAddress locatedAddress(){
+    static_assert(widthShift(Width) >= 0, "Invalid address width");
+    constexpr int offset = Bit < 0 ? addressOffset(Space, Width, Index) : memoryOffset(Space, static_cast<long long>(Index) << widthShift(Width));
+    constexpr int bitByte = Bit < 0 ? offset : bitOffset(Space, Width, Index, Bit);
+    static_assert(offset >= 0 && bitByte >= 0, "Address is outside of memory");
+    ResolvedAddress ret;
+    ret.space = Space;
+    ret.width = Width;
+    ret.index = Index;
+    ret.bit = Bit;
+    ret.offset = static_cast<size_t>(offset);
+    if(Bit >= 0){
+        ret.bitOffset = static_cast<size_t>(bitByte);
+        ret.bitMask = static_cast<uint8_t>(1u << (Bit % 8));
+    }
+    return ret;
+}
+
+/**
+ * Reads the value at an address without throwing. Bit addresses read 0 or 1.
+ * @param address The address to read.
+ * @param value Receives the value. It is left unchanged if the address is invalid.
+ * @returns Returns AddressStatus::OK, or the reason the address is invalid.
+ */
+AddressStatus tryRead(const std::string& address, uint64_t& value) noexcept;
+
+/**
+ * Writes a value to an address without throwing. The value is truncated to the width of the address, and bit
+ * addresses are set if the value is not 0.
+ * @param address The address to write.
+ * @param value The value to write.
+ * @returns Returns AddressStatus::OK, or the reason the address is invalid.
+ */
+AddressStatus tryWrite(const std::string& address, uint64_t value) noexcept;
+
+/**
+ * Reads the 64 bit value at a given address.
+ * @param address The address of the memory to get the 64 bit value from.
+ * @returns Returns a 64 bit value
+ */
+uint64_t readLWord(std::string address);
+
+/**
+ * Reads the 32 bit value at a given address.
+ * @param address The address of the memory to get the 32 bit value from.
+ * @returns Returns a 32 bit value
+ */
+ uint32_t readDWord(std::string address);
+/**
+ * Reads the 16 bit value at a given address.
+ * @param address The address of the memory to get the 16 bit value from.
+ * @returns Returns a 16 bit value
+ */
+ uint16_t readWord(std::string address);
+/**
+ * Reads the 8 bit value at a given address.
+ * @param address The address of the memory to get the 8 bit value from.
+ * @returns Returns a 8 bit value
+ */
+uint8_t readByte(std::string address);
+/**
+ * Reads the bit value at a given address.
+ * @param address The address of the memory to get the bit value from.
+ * @returns Returns a boolean value indicating the status of the bit.
+ */
+bool readBit(std::string address);
+
+/**
+ * Writes a 64 bit value to an address in memory.
+ * @param address The address of memory to write to.
+ * @param value The 64 bit value to write to memory.
+ */
+void writeLWord(std::string address, uint64_t value);
+
+/**
+ * Writes a 32 bit value to an address in memory.
+ * @param address The address of memory to write to.
+ * @param value The 32 bit value to write to memory.
+ */
+void writeDWord(std::string address, uint32_t value);
+/**
+ * Writes a 16 bit value to an address in memory.
+ * @param address The address of memory to write to.
+ * @param value The 16 bit value to write to memory.
+ */
+void writeWord(std::string address, uint16_t value);
+/**
+ * Writes a 8 bit value to an address in memory.
+ * @param address The address of memory to write to.
+ * @param value The 8 bit value to write to memory.
+ */
+void writeByte(std::string address, uint8_t value);
+/**
+ * Writes a bit value to an address in memory.
+ * @param address The address of memory to write to.
+ * @param value The bit value to write to memory.
+ */
+void writeBit(std::string address, bool value);
+#pragma endregion
+#pragma region "Bit Access"
+/**
+ * The bit accessors are inline and work on the value of a variable as a word of its own width rather than on its
+ * bytes, so with a constant bit number, as the transpiler emits for x.3, a read is a single test and a write a single
+ * or, and-not or bit set instruction. Variables that aren't integers are read and written as their bytes in memory.
+ */
+template<typename T>
+struct BitWord { using type = std::make_unsigned_t<T>; };
+template<>
+struct BitWord<bool> { using type = uint8_t; };
+
+/**
+ * Extracts a field of bits from a word.
+ * @tparam Low The number of the lowest bit of the field.
+ * @tparam Width The number of bits in the field.
+ * @param word The word.
+ * @returns Returns the field, in the low bits.
+ */
+template<int Low, int Width, typename T>
+constexpr T extractBits(T word) {
+    using U = typename BitWord<T>::type;
+    static_assert(Low >= 0 && Width > 0 && Low + Width <= static_cast<int>(sizeof(T) * 8), "Bit field is out of range");
+    constexpr U mask = Width == static_cast<int>(sizeof(U) * 8) ? static_cast<U>(~U(0)) : static_cast<U>((U(1) << Width) - 1);
+    return static_cast<T>(static_cast<U>(static_cast<U>(word) >> Low) & mask);
+}
+/**
+ * Inserts a field of bits into a word.
+ * @tparam Low The number of the lowest bit of the field.
+ * @tparam Width The number of bits in the field.
+ * @param word The word.
+ * @param field The field, in the low bits. Bits above the width are ignored.
+ * @returns Returns the word with the field replaced.
+ */
+template<int Low, int Width, typename T>
+constexpr T insertBits(T word, T field) {
+    using U = typename BitWord<T>::type;
+    static_assert(Low >= 0 && Width > 0 && Low + Width <= static_cast<int>(sizeof(T) * 8), "Bit field is out of range");
+    constexpr U mask = static_cast<U>((Width == static_cast<int>(sizeof(U) * 8) ? static_cast<U>(~U(0))
+        : static_cast<U>((U(1) << Width) - 1)) << Low);
+    return static_cast<T>(static_cast<U>((static_cast<U>(word) & ~mask) | (static_cast<U>(static_cast<U>(field) << Low) & mask)));
+}
+
+/**
+ * Gets a bit of a variable.
+ * @tparam Bit The number of the bit to get.
+ * @param var A pointer to the variable from which to get the bit.
+ * @returns Returns the state of the bit.
+ */
+template<int Bit, typename T>
+constexpr bool getBit(const T* var) {
+    static_assert(Bit >= 0 && Bit < static_cast<int>(sizeof(T) * 8), "Bit number is out of range of the variable");
+    if constexpr (std::is_integral_v<T>) {
+        return (static_cast<typename BitWord<T>::type>(*var) >> Bit) & 1;
+    } else {
+        return (reinterpret_cast<const uint8_t*>(var)[Bit / 8] >> (Bit % 8)) & 1;
+    }
+}
+/**
+ * Sets a bit of a variable.
+ * @tparam Bit The number of the bit to set.
+ * @param var A pointer to the variable to which to set the bit.
+ * @param value The state to set the bit to.
+ */
+template<int Bit, typename T>
+constexpr void setBit(T* var, bool value) {
+    static_assert(Bit >= 0 && Bit < static_cast<int>(sizeof(T) * 8), "Bit number is out of range of the variable");
+    if constexpr (std::is_integral_v<T>) {
+        using U = typename BitWord<T>::type;
+        constexpr U mask = static_cast<U>(U(1) << Bit);
+        U word = static_cast<U>(*var);
+        *var = static_cast<T>(value ? static_cast<U>(word | mask) : static_cast<U>(word & ~mask));
+    } else {
+        uint8_t& byte = reinterpret_cast<uint8_t*>(var)[Bit / 8];
+        byte = value ? static_cast<uint8_t>(byte | (1 << (Bit % 8))) : static_cast<uint8_t>(byte & ~(1 << (Bit % 8)));
+    }
+}
+/**
+ * Gets a bit of a variable, for a bit number that is only known at run time.
+ * @param var A pointer to the variable from which to get the bit.
+ * @param bit The number of the bit to get.
+ * @returns Returns the state of the bit, or false if the variable has no such bit.
+ */
+template<typename T>
+constexpr bool getBit(const T* var, int bit) {
+    if (bit < 0 || bit >= static_cast<int>(sizeof(T) * 8)) {
+        return false;
+    }
+    if constexpr (std::is_integral_v<T>) {
+        return (static_cast<typename BitWord<T>::type>(*var) >> bit) & 1;
+    } else {
+        return (reinterpret_cast<const uint8_t*>(var)[bit / 8] >> (bit % 8)) & 1;
+    }
+}
+/**
+ * Sets a bit of a variable, for a bit number that is only known at run time.
+ * @param var A pointer to the variable to which to set the bit.
+ * @param bit The number of the bit to set. Nothing is written if the variable has no such bit.
+ * @param value The state to set the bit to.
+ */
+template<typename T>
+constexpr void setBit(T* var, int bit, bool value) {
+    if (bit < 0 || bit >= static_cast<int>(sizeof(T) * 8)) {
+        return;
+    }
+    if constexpr (std::is_integral_v<T>) {
+        using U = typename BitWord<T>::type;
+        U mask = static_cast<U>(U(1) << bit);
+        U word = static_cast<U>(*var);
+        *var = static_cast<T>(value ? static_cast<U>(word | mask) : static_cast<U>(word & ~mask));
+    } else {
+        uint8_t& byte = reinterpret_cast<uint8_t*>(var)[bit / 8];
+        byte = value ? static_cast<uint8_t>(byte | (1 << (bit % 8))) : static_cast<uint8_t>(byte & ~(1 << (bit % 8)));
+    }
+}
+#pragma endregion
+#pragma region "Reference Handling"
+
+/**
+ * The RefVar class provides a means of declaring a variable with a reference to memory, similar to a pointer.
+ * BOOL references a bit. The integer types and REAL and LREAL reference a value the width of the type, which is read
+ * and written with a single load or store.
+ */
+template<typename T>
+class RefVar {
+    static_assert(isImageType<T>, "Unsupported type for RefVar");
+private:
+/**
+ * The address of the memory.
+ */
+    std::string address;
+    /**
+     * The address resolved to its location in memory.
+     */
+    ResolvedAddress handle;
+    /**
+     * The cached value of the address
+     */
+    T cache;
+
+public:
+    /**
+     * Constructs a new RefVar object based on a given address. The address is parsed and validated once.
+     * @param addr The address to reference.
+     * @throws std::invalid_argument if the address is not valid for the type of this RefVar.
+     */
+    RefVar(const std::string& addr)
+        : address(addr),
+          handle(resolveAddress(addr, std::is_same_v<T, bool> ? -1 : static_cast<int>(sizeof(T) * 8), std::is_same_v<T, bool>)) {
+        cache = read();
+    }
+
+    /**
+     * Constructs a new RefVar object from an address that was resolved when the program was compiled, such as one
+     * from locatedAddress(). Nothing is parsed or validated, so this can't throw.
+     * @param resolved The resolved address to reference.
+     */
+    RefVar(const ResolvedAddress& resolved) noexcept
+        : handle(resolved) {
+        cache = read();
+    }
+
+    virtual ~RefVar() = default;
+    /**
+     * Provides an assignment operator for RefVar so that it acts just like a primitive variable.
+     * @param value The value to assign.
+     */
+    RefVar<T>& operator=(T value) {
+        cache = value;
+        write(value);
+        return *this;
+    }
+
+    /**
+     * Provides a reference operator to provide a reference to this RefVar.
+     */
+    RefVar<T>& operator&(){
+        return *this;
+    }
+
+    /**
+     * Provides an expression operator so that a RefVar object can be used in a statement like any other variable and return its memory value.
+     */
+    operator T() const {
+        return read();
+    }
+
+private:
+    /**
+     * Reads the value of the reference from memory.
+     */
+    T read() const {
+        if constexpr (std::is_same_v<T, bool>) {
+            return handle.getBit();
+        } else {
+            return loadImageValue<T>(handle.data());
+        }
+    }
+    /**
+     * Writes the value to the memory referenced.
+     * @param value The value to assign to the memory.
+     */
+    void write(T value) const {
+        if constexpr (std::is_same_v<T, bool>) {
+            handle.setBit(value);
+        } else {
+            if (replaceImageWord<sizeof(T) * 8>(handle.data(), imageCast<MemoryType<sizeof(T) * 8>>(value))) {
+                markImageDirty(handle.offset, sizeof(T));
+            }
+        }
+    }
+};
+
+/**
+ * Gets a bit from a RefVar object.
+ * @param var a reference to the RefVar object
+ * @param bit The bit to read.
+ * @returns Returns the state of the bit.
+ */
+template<typename T>
+bool getBit(RefVar<T>& var, int bit){
+    T ref = var;
+    return getBit(&ref, bit);
+}
+/**
+ * Gets a bit from a RefVar object.
+ * @tparam Bit The bit to read.
+ * @param var a reference to the RefVar object
+ * @returns Returns the state of the bit.
+ */
+template<int Bit, typename T>
+bool getBit(RefVar<T>& var){
+    T ref = var;
+    return getBit<Bit>(&ref);
+}
+/**
+ * Sets a bit in a RefVar object
+ * @param var A reference to the RefVar object.
+ * @param bit The bit to set.
+ * @param value The state to set the bit to.
+ */
+template<typename T>
+void setBit(RefVar<T>& var, int bit, bool value){
+    T ref = var;
+    setBit(&ref, bit, value);
+    var = ref;
+}
+/**
+ * Sets a bit in a RefVar object
+ * @tparam Bit The bit to set.
+ * @param var A reference to the RefVar object.
+ * @param value The state to set the bit to.
+ */
+template<int Bit, typename T>
+void setBit(RefVar<T>& var, bool value){
+    T ref = var;
+    setBit<Bit>(&ref, value);
+    var = ref;
+}
+#pragma endregion
+#pragma region "Process Image"
+/**
+ * The process image is double buffered so that a scan always runs against a stable snapshot.
+ * MEMORY is the logic image and is only touched by the scan thread. The IO layer and server threads exchange data
+ * with it through two phases:
+ *  - latchInputs() applies the inputs and external writes that were staged with writeImage() to MEMORY at the start of a scan.
+ *  - commitOutputs() copies MEMORY into a back buffer at the end of a scan and publishes it with a single pointer swap.
+ *    readImage() always reads from the last published image. Single values are read without a lock, and read
+ *    again in the rare case that the buffer was refilled meanwhile, so readers never hold up the scan.
+ */
+/**
+ * Applies all staged writes to the logic image. Called by the scan thread at the start of a scan.
+ */
+void latchInputs();
+/**
+ * Publishes the logic image to the IO layer and server threads. Called by the scan thread at the end of a scan.
+ */
+void commitOutputs();
+/**
+ * Puts the runtime in its safe state, for a task that overran its watchdog budget with the "safe" overrun policy: the
+ * tasks are no longer run, and the outputs are published as 0 from then on. The image is published from the calling
+ * thread, so the outputs are cleared even while a release never returns. This is safe to call from any thread.
+ */
+void enterSafeState();
+/**
+ * Gets whether the runtime is in its safe state.
+ * @returns Returns true once enterSafeState() was called.
+ */
+bool inSafeState();
+/**
+ * Copies bytes into MEMORY and marks them written, as a standby controller does with the changes the primary sends
+ * it. The scan thread must not be running tasks.
+ * @param offset The offset of the first byte from the start of the image.
+ * @param bytes The bytes.
+ * @param count The number of bytes.
+ */
+void loadImageBytes(size_t offset, const uint8_t* bytes, size_t count);
+/**
+ * Gets the number of images commitOutputs() has published, so that a server thread can tell when a new scan's
+ * outputs are available.
+ * @returns Returns the number of published images.
+ */
+uint64_t imageGeneration();
+/**
+ * Copies MEMORY into a task's private image at the start of a task release.
+ * @param image The task's image, which the task will run against.
+ * @param snapshot Receives a copy of the image, used by storeTaskImage() to find what the task changed.
+ */
+void loadTaskImage(ProcessImage image, ProcessImage snapshot);
+/**
+ * Merges the bits a task changed in its private image back into MEMORY at the end of a task release.
+ * @param image The task's image after it ran.
+ * @param snapshot The copy of the image taken by loadTaskImage().
+ */
+void storeTaskImage(const ProcessImage image, const ProcessImage snapshot);
+/**
+ * The place of a global the tasks exchange in EXCHANGED_GLOBALS, the struct the compiler declares them in. Its size
+ * is fixed when the program is compiled, so each global is a channel of its own.
+ */
+struct GlobalChannel {
+    uint32_t offset;
+    uint32_t bytes;
+};
+
+/**
+ * Gets the channel of a member of the exchanged globals.
+ * @param globals The exchanged globals.
+ * @param member The member of the globals.
+ * @returns Returns the channel.
+ */
+template<typename Globals, typename T>
+GlobalChannel globalChannel(const Globals& globals, const T& member){
+    static_assert(std::is_trivially_copyable_v<T>, "An exchanged global must be trivially copyable");
+    return { static_cast<uint32_t>(reinterpret_cast<const uint8_t*>(&member) - reinterpret_cast<const uint8_t*>(&globals)),
+             static_cast<uint32_t>(sizeof(T)) };
+}
+
+/**
+ * Exchanges the globals that more than one task uses between task workers, without a lock in the scan. Each global
+ * is double buffered: a task publishes what it wrote to the buffer readers aren't on, with a sequence number that is
+ * odd while it writes, and then flips the global to it. A task loads the latest buffer of each global it uses and
+ * checks the sequence number afterwards, so it never keeps a value that is half written, and never waits for a
+ * writer that was preempted, since the buffer the writer is on isn't the one it reads. Tasks that write the same
+ * global publish it one at a time.
+ * Tasks on the scan thread, and the programs on the pool of runParallel(), run against the first buffer directly,
+ * so load() and store() only copy on a task worker, whose TASK_IMAGE isn't MEMORY.
+ */
+class GlobalExchange {
+public:
+    /**
+     * Constructs the exchange of the globals.
+     * @param buffers The two buffers of the globals, GLOBAL_BUFFERS.
+     * @param bytes The size of each buffer.
+     * @param channels The channels, one for each global.
+     * @param count The number of channels.
+     */
+    GlobalExchange(void* buffers, size_t bytes, const GlobalChannel* channels, size_t count);
+    /**
+     * Points the calling task worker at its copy of the globals and loads the latest value of the globals it uses.
+     * @param current TASK_GLOBALS.
+     * @param indices The channels of the globals the task reads or writes.
+     */
+    template<typename Globals>
+    void load(Globals*& current, std::initializer_list<uint16_t> indices){
+        if(TASK_IMAGE == MEMORY){
+            return;
+        }
+        thread_local Globals copy;
+        current = &copy;
+        loadChannels(reinterpret_cast<uint8_t*>(&copy), indices.begin(), indices.size());
+    }
+    /**
+     * Publishes the globals the calling task worker wrote.
+     * @param current TASK_GLOBALS.
+     * @param indices The channels of the globals the task writes.
+     */
+    template<typename Globals>
+    void store(Globals* current, std::initializer_list<uint16_t> indices){
+        if(TASK_IMAGE == MEMORY){
+            return;
+        }
+        storeChannels(reinterpret_cast<const uint8_t*>(current), indices.begin(), indices.size());
+    }
+private:
+    struct Slot {
+        std::atomic<uint32_t> latest{0};
+        std::atomic<uint32_t> sequence[2] = {};
+        std::atomic<bool> writing{false};
+    };
+    uint8_t* buffers[2];
+    const GlobalChannel* channels;
+    std::unique_ptr<Slot[]> slots;
+
+    void loadChannels(uint8_t* copy, const uint16_t* indices, size_t count);
+    void storeChannels(const uint8_t* copy, const uint16_t* indices, size_t count);
+};
+/**
+ * Forces an address to a value. The value replaces whatever the program or the IO layer writes to the address: it is
+ * applied when the inputs are latched and again before the outputs are published. This is safe to call from any thread.
+ * @param address The resolved address to force.
+ * @param value The value to force it to. Bit addresses are forced on when the value is non-zero.
+ */
+void forceImage(const ResolvedAddress& address, uint64_t value);
+/**
+ * Releases a forced address, so that it takes the values written to it again.
+ * @param address The resolved address to release.
+ */
+void releaseForce(const ResolvedAddress& address);
+/**
+ * Releases every forced address.
+ */
+void releaseAllForces();
+/**
+ * A forced address, as listed by listForces().
+ */
+struct ForcedAddress {
+    std::string address;    // The address, such as %QW0 or %IX0.1.
+    uint64_t value;         // The value the address is forced to.
+};
+/**
+ * Forces a located global or an address to a value, as forceImage() does. This is safe to call from any thread.
+ * @param address The name of a located global, or an address.
+ * @param value The value to force it to. Bit addresses are forced on when the value is non-zero.
+ * @returns Returns AddressStatus::OK, or the reason the address is invalid.
+ */
+AddressStatus forceAddress(const std::string& address, uint64_t value);
+/**
+ * Releases a located global or an address, as releaseForce() does, along with every force it overlaps.
+ * @param address The name of a located global, or an address.
+ * @returns Returns AddressStatus::OK, or the reason the address is invalid.
+ */
+AddressStatus releaseAddress(const std::string& address);
+/**
+ * Lists the forced addresses, in the order they were forced. A later force wins where two overlap.
+ * @returns Returns the forces.
+ */
+std::vector<ForcedAddress> listForces();
+/**
+ * Gets the number of forced addresses, without locking.
+ * @returns Returns the number of forces.
+ */
+size_t forceCount();
+/**
+ * Compares two images a cache line at a time.
+ * @param a The first image.
+ * @param b The second image.
+ * @param lines Receives a bitmap of IMAGE_LINE_WORDS words, with a bit set for each line that differs.
+ */
+void diffImages(const ProcessImage a, const ProcessImage b, uint64_t* lines);
+/**
+ * Copies an image, writing only the cache lines that differ.
+ * @param dst The image to update.
+ * @param src The image to copy.
+ * @param lines Receives a bitmap of IMAGE_LINE_WORDS words of the lines that were copied, or nullptr.
+ */
+void copyChangedLines(ProcessImage dst, const ProcessImage src, uint64_t* lines);
+/**
+ * Marks an input as waiting for its first read. IO clients mark the inputs they are mapped to when the mapping is
+ * added, so that until a value for it is latched, isInputGood() reports it as bad and the servers don't publish the
+ * zero it starts with as a reading. This is safe to call from any thread.
+ * @param address The resolved address of the input.
+ */
+void markInputPending(const ResolvedAddress& address);
+/**
+ * Determines whether an input has had a value latched since it was mapped. Addresses that aren't mapped inputs are
+ * always good. This is safe to call from any thread, and doesn't lock.
+ * @param address The resolved address.
+ * @returns Returns false while any bit of the address is waiting for its first read.
+ */
+bool isInputGood(const ResolvedAddress& address);
+/**
+ * The quality of a mapped input, as the client that reads it last saw it.
+ */
+enum class IOQuality : uint8_t {
+    /**
+     * The last read of the input succeeded.
+     */
+    Good = 0,
+    /**
+     * The last read of the input failed, so the image holds the value of an earlier read.
+     */
+    Stale = 1,
+    /**
+     * The client has no connection to the device, or the input hasn't been read since it was mapped.
+     */
+    CommFail = 2
+};
+/**
+ * The slot of a mapping that has none in the quality plane, which reads as IOQuality::CommFail.
+ */
+constexpr uint32_t NO_QUALITY_SLOT = UINT32_MAX;
+/**
+ * The slots of the quality plane are allocated in blocks, which are never moved or freed, so that it can grow while
+ * the clients that were mapped first are already writing to it.
+ */
+constexpr size_t QUALITY_BLOCK_SLOTS = 4096;
+constexpr size_t QUALITY_BLOCKS = 256;
+/**
+ * A block of the quality plane, in which each mapped input has the same index in every array.
+ */
+struct QualityBlock {
+    std::atomic<uint8_t> status[QUALITY_BLOCK_SLOTS];
+    /**
+     * The number of the scan that latched the last good read, or 0 if there was none.
+     */
+    std::atomic<uint64_t> scan[QUALITY_BLOCK_SLOTS];
+    /**
+     * The time of the last good read, in microseconds since the Unix epoch.
+     */
+    std::atomic<int64_t> time[QUALITY_BLOCK_SLOTS];
+};
+/**
+ * The quality plane, which holds the quality of the mapped inputs beside their values in the process image. A slot is
+ * allocated for each input when it is mapped, and IOMap::quality holds its index.
+ */
+inline std::atomic<QualityBlock*> QUALITY_PLANE[QUALITY_BLOCKS] = {};
+/**
+ * The number of the current scan, advanced by latchInputs(). A value staged during scan n is latched by scan n + 1.
+ */
+inline std::atomic<uint64_t> SCAN_NUMBER{0};
+/**
+ * Advanced whenever the quality of an input changes, so that servers can tell when to look at the plane again.
+ */
+inline std::atomic<uint64_t> QUALITY_CHANGES{0};
+/**
+ * Allocates the slot of an input in the quality plane, or finds the one of another mapping of the same address. A
+ * new slot reads as IOQuality::CommFail until the input is read.
+ * @param address The resolved address of the input.
+ * @returns Returns the slot.
+ */
+uint32_t allocateQualitySlot(const ResolvedAddress& address);
+/**
+ * Finds the slot of an input in the quality plane. This locks, so programs look each address up once.
+ * @param address The resolved address of the input.
+ * @returns Returns the slot, or NO_QUALITY_SLOT if the address isn't a mapped input.
+ */
+uint32_t findQualitySlot(const ResolvedAddress& address);
+/**
+ * Finds the block of a slot of the quality plane.
+ * @param slot The slot.
+ * @returns Returns the block, or nullptr for NO_QUALITY_SLOT.
+ */
+inline QualityBlock* qualityBlock(uint32_t slot) {
+    return slot == NO_QUALITY_SLOT ? nullptr : QUALITY_PLANE[slot / QUALITY_BLOCK_SLOTS].load(std::memory_order_acquire);
+}
+/**
+ * Records the quality of an input. A good read is stamped with the scan that will latch it and the current time. This
+ * is safe to call from any thread.
+ * @param slot The slot of the input, or NO_QUALITY_SLOT, which is ignored.
+ * @param quality The quality.
+ * @param now The time of the read, in microseconds since the Unix epoch, or 0 to take the current time.
+ */
+void setInputQuality(uint32_t slot, IOQuality quality, int64_t now = 0);
+/**
+ * Gets the quality of an input. This is safe to call from any thread, and doesn't lock.
+ * @param slot The slot of the input.
+ * @returns Returns the quality, or IOQuality::CommFail for NO_QUALITY_SLOT.
+ */
+inline IOQuality inputQuality(uint32_t slot) {
+    QualityBlock* block = qualityBlock(slot);
+    return block == nullptr ? IOQuality::CommFail
+        : static_cast<IOQuality>(block->status[slot % QUALITY_BLOCK_SLOTS].load(std::memory_order_relaxed));
+}
+/**
+ * Gets the number of the scan that latched the last good read of an input.
+ * @param slot The slot of the input.
+ * @returns Returns the scan number, or 0 if the input hasn't been read.
+ */
+inline uint64_t inputUpdatedScan(uint32_t slot) {
+    QualityBlock* block = qualityBlock(slot);
+    return block == nullptr ? 0 : block->scan[slot % QUALITY_BLOCK_SLOTS].load(std::memory_order_relaxed);
+}
+/**
+ * Gets the time of the last good read of an input.
+ * @param slot The slot of the input.
+ * @returns Returns the time in microseconds since the Unix epoch, or 0 if the input hasn't been read.
+ */
+inline int64_t inputUpdatedTime(uint32_t slot) {
+    QualityBlock* block = qualityBlock(slot);
+    return block == nullptr ? 0 : block->time[slot % QUALITY_BLOCK_SLOTS].load(std::memory_order_relaxed);
+}
+/**
+ * Finds the slot of a located address the first time a program asks for its quality. The transpiler turns
+ * IO_QUALITY(%IW0) and IO_UPDATED(%IW0) in ST into calls of the functions below with the address as template
+ * arguments, so each call site looks its address up once and then reads the plane with an indexed load.
+ */
+template<int Space, int Width, int Index, int Bit = -1>
+inline uint32_t qualitySlotOf() {
+    static const uint32_t slot = [] {
+        static const char spaces[] = { 'I', 'Q', 'M' };
+        std::string text = std::string("%") + spaces[Space] + (Bit > -1 ? 'X' : Width == 8 ? 'B' : Width == 16 ? 'W' : Width == 32 ? 'D' : 'L')
+            + std::to_string(Index) + (Bit > -1 ? "." + std::to_string(Bit) : "");
+        ResolvedAddress address;
+        return tryResolveAddress(text, Bit > -1 ? -1 : Width, Bit > -1, address) == AddressStatus::OK
+            ? findQualitySlot(address) : NO_QUALITY_SLOT;
+    }();
+    return slot;
+}
+/**
+ * Gets the quality of a mapped input from ST, as IO_QUALITY(%IW0).
+ * @returns Returns 0 if the last read was good, 1 if it failed and the value is stale, and 2 if the device can't be
+ * reached or the input hasn't been read.
+ */
+template<int Space, int Width, int Index, int Bit = -1>
+inline uint8_t IO_QUALITY() {
+    return static_cast<uint8_t>(inputQuality(qualitySlotOf<Space, Width, Index, Bit>()));
+}
+/**
+ * Gets the number of the scan that latched the last good read of a mapped input from ST, as IO_UPDATED(%IW0).
+ * @returns Returns the scan number, or 0 if the input hasn't been read.
+ */
+template<int Space, int Width, int Index, int Bit = -1>
+inline uint64_t IO_UPDATED() {
+    return inputUpdatedScan(qualitySlotOf<Space, Width, Index, Bit>());
+}
+/**
+ * Reads a value from the last published process image. This is safe to call from any thread, and doesn't lock.
+ * @param address The resolved address to read.
+ * @returns Returns the value at the address. Bit addresses return 0 or 1.
+ */
+uint64_t readImage(const ResolvedAddress& address);
+/**
+ * Stages a write to the logic image, to be applied at the start of the next scan. This is safe to call from any thread.
+ * @param address The resolved address to write.
+ * @param value The value to write. Bit addresses are set when the value is non-zero.
+ */
+void writeImage(const ResolvedAddress& address, uint64_t value);
+/**
+ * Calls a reader with the bytes of the last published process image, so that a block of values can be read from
+ * one consistent image without copying it. The image is locked during the call, so the reader must be quick.
+ * @param reader The reader, called with the start of the image. Values are at the offsets of their ResolvedAddress.
+ */
+void readImage(const std::function<void(const uint8_t* image)>& reader);
+/**
+ * Collects the cache lines of the process image that changed in the scans published since it last read the image,
+ * so that a consumer like a server can look at only what changed instead of the whole image. Each commitOutputs()
+ * adds the lines written in its scan to every ImageChanges. A new ImageChanges reports every line as changed.
+ */
+class ImageChanges {
+public:
+    ImageChanges();
+    ~ImageChanges();
+    ImageChanges(const ImageChanges&) = delete;
+    ImageChanges& operator=(const ImageChanges&) = delete;
+
+    /**
+     * Takes the lines that changed since the last call and, if there are any, calls a reader with the last published
+     * image. The image is locked during the call, as with readImage(), so the reader must be quick.
+     * @param reader The reader, called with the start of the image and this object, which tells it what changed.
+     * @returns Returns true if anything changed and the reader was called.
+     */
+    bool read(const std::function<void(const uint8_t* image, const ImageChanges& changes)>& reader);
+    /**
+     * Determines whether the line holding a byte changed, as of the last read().
+     * @param offset The offset of the byte from the start of the image.
+     * @returns Returns true if the line changed.
+     */
+    bool isChanged(size_t offset) const {
+        size_t line = offset / IMAGE_LINE_BYTES;
+        return (taken[line >> 6] & (1ull << (line & 63))) != 0;
+    }
+    /**
+     * Calls a visitor for each run of consecutive lines that changed, as of the last read().
+     * @param visitor The visitor, called with the offset and length in bytes of the run.
+     */
+    template<typename Visitor>
+    void forEachChange(Visitor&& visitor) const {
+        size_t start = 0, length = 0;
+        for(size_t w = 0; w < IMAGE_LINE_WORDS; w++){
+            uint64_t word = taken[w];
+            while(word != 0){
+                size_t line = w * 64 + static_cast<size_t>(countTrailingZeros(word));
+                word &= word - 1;
+                if(length > 0 && start + length == line){
+                    length++;
+                    continue;
+                }
+                if(length > 0) visitor(start * IMAGE_LINE_BYTES, length * IMAGE_LINE_BYTES);
+                start = line;
+                length = 1;
+            }
+        }
+        if(length > 0) visitor(start * IMAGE_LINE_BYTES, length * IMAGE_LINE_BYTES);
+    }
+    /**
+     * Adds lines to the pending changes. Called by commitOutputs() with the image lock held.
+     * @param lines The bitmap of the lines that changed.
+     */
+    void add(const uint64_t* lines);
+
+private:
+    uint64_t pending[IMAGE_LINE_WORDS];  // Lines changed since the last read(), guarded by the image lock.
+    uint64_t taken[IMAGE_LINE_WORDS];    // Lines that had changed as of the last read().
+};
+
+struct MappingFreshness;
+
+/**
+ * Stages several writes together, so that they are all applied at the start of the same scan.
+ * @param addresses The resolved addresses to write.
+ * @param values The values to write.
+ * @param count The number of writes.
+ */
+void writeImage(const ResolvedAddress* addresses, const uint64_t* values, size_t count);
+/**
+ * Stages reads that arrived from a device together, so that latchInputs() records how long each waited for a scan in
+ * the input age of its mapping.
+ * @param addresses The resolved addresses to write.
+ * @param values The values to write.
+ * @param freshness The freshness statistics of the mapping of each write.
+ * @param arrived When the reads arrived, in microseconds since the program started.
+ * @param count The number of writes.
+ */
+void writeImage(const ResolvedAddress* addresses, const uint64_t* values, MappingFreshness* const* freshness,
+    uint64_t arrived, size_t count);
+/**
+ * Resolves an address string and reads it from the last published process image.
+ * @param address The address to read, like %QX0.1 or %MW10.
+ * @returns Returns the value at the address.
+ */
+uint64_t readImage(const std::string& address);
+/**
+ * Resolves an address string and stages a write to it.
+ * @param address The address to write, like %IX0.1 or %MW10.
+ * @param value The value to write.
+ */
+void writeImage(const std::string& address, uint64_t value);
+#pragma endregion
+#pragma region "IO Handling"
+/**
+ * Handles the aquisition of IO inputs and the application of IO outputs. Once IO has been started with startIO(),
+ * the clients poll on their own threads and this does nothing.
+ */
+void superviseIO();
+/**
+ * Starts IO on background threads, so that the scan thread never blocks on network IO. Clients that can run on an
+ * IO reactor are spread over ioThreads reactor threads, and the others each poll on their own thread.
+ * Clients created after this are started as soon as they are created.
+ * @param ioThreads The number of reactor threads, or 0 to give every client its own thread.
+ * @param ioBackend The reactor backend to use, as accepted by createReactorBackend(), or empty for the default.
+ */
+void startIO(int ioThreads = 1, const std::string& ioBackend = "");
+/**
+ * Starts the Modbus/TCP server, which serves the process image to SCADA and HMI clients on its own IO reactor.
+ * @param port The TCP port to listen on.
+ * @param maxClients The most clients that may be connected at once.
+ * @param ioBackend The reactor backend to use, as accepted by createReactorBackend(), or empty for the default.
+ * @returns Returns false if the server can't listen on the port, or Modbus isn't built into the runtime.
+ */
+bool startModbusServer(int port, int maxClients = 32, const std::string& ioBackend = "");
+/**
+ * Starts the metrics server, which serves the runtime's statistics and counters to Prometheus scrapes at /metrics.
+ * @param port The TCP port to listen on.
+ * @param ioBackend The reactor backend to use, as accepted by createReactorBackend().
+ * @returns Returns false if the port can't be listened on.
+ */
+bool startMetricsServer(int port, const std::string& ioBackend = "");
+/**
+ * Starts the watch server, which streams the values of the watch lists of its clients as they change.
+ * @param port The TCP port to listen on.
+ * @param interval The shortest interval between the frames of a client, in milliseconds.
+ * @param ioBackend The reactor backend to use, as accepted by createReactorBackend().
+ * @returns Returns false if the port can't be listened on.
+ */
+bool startWatchServer(int port, uint64_t interval, const std::string& ioBackend = "");
+/**
+ * Publishes an address in %M memory as an object of the BACnet server, if it is started. A bit address is published
+ * as a Binary Value and any other address as an Analog Value, numbered from 0 per type in the order published.
+ * @param name The object name.
+ * @param address The address, like %MX0.1 or %MD10.
+ */
+void publishBACnetObject(const std::string& name, const std::string& address);
+/**
+ * A BACnet point as the compiler emits it, parsed from the protocol properties of its mapping at compile time.
+ */
+struct BACnetPointDefinition
+{
+    uint16_t objectType;
+    uint32_t objectInstance;
+    uint32_t propertyId;
+    uint32_t arrayIndex;    // UINT32_MAX for the whole property.
+    uint8_t valueType;
+    uint8_t priority;
+    bool cov;
+    bool covConfirmed;
+    uint32_t covLifetime;
+};
+
+/**
+ * Registers the BACnet point table the compiler generated, which mappings refer to by their definition index. It must
+ * be registered before the mappings are.
+ * @param points The points.
+ * @param count The number of points.
+ */
+void registerBACnetPoints(const BACnetPointDefinition* points, size_t count);
+/**
+ * Starts the BACnet/IP server, which publishes the objects from publishBACnetObject() as a BACnet device on the
+ * shared BACnet datalink.
+ * @param deviceInstance The instance of the device object.
+ * @param deviceName The name of the device object, or empty for a name made from the instance.
+ * @returns Returns false if the datalink could not be initialized, or BACnet isn't built into the runtime.
+ */
+bool startBACnetServer(uint32_t deviceInstance, const std::string& deviceName = "");
+
+class IOReactor;
+
+// Identifies direction of I/O mapping
+enum class IOType {
+    Input,
+    Output
+};
+
+/**
+ * A mapping as the compiler parsed it from the program's IO map, as a row of the table it generates.
+ */
+struct IOMapDefinition
+{
+    const char* protocol;
+    const char* moduleID;
+    const char* modulePort;
+    const char* remoteAddress;
+    const char* localAddress;
+    const char* properties;  // The protocol properties, as the text of a JSON object.
+    int width;
+    int interval;
+    uint64_t deadband;
+    int refreshTime;
+    int definition;          // The index of the mapping in the protocol's generated table, or -1.
+    int minInterval = 0;     // The bounds of an adaptive poll interval, or 0 (MinPollTime and MaxPollTime).
+    int maxInterval = 0;
+    const char* task = nullptr;  // The task that reads the input or writes the output, or nullptr (Task).
+    ResolvedAddress local = {};  // The local address resolved at compile time, or with a space of -1 to resolve it.
+};
+
+/**
+ * The mappings of one client in the generated table, which are the rows that share its ModuleID and ModulePort.
+ */
+struct IOClientDefinition
+{
+    size_t first;
+    size_t count;
+};
+
+/**
+ * Defines a single mapping between a remote IO module address and an internal address in the PLC.
+ */
+class IOMap {
+public:
+    /**
+     * The direction of the IO interface.
+     */
+    IOType direction;
+    /**
+     * The unique identifier of the module. This can be the IP address or a unit ID.
+     */
+    std::string moduleID;
+    /**
+     * The port for the module communications port. In TCP/IP coms, this is the TCP port. In serial, this is the serial port.
+     */
+    std::string modulePort;
+    /**
+     * The name of the protocol for this map.
+     */
+    std::string protocol;
+    /**
+     * Additional properties, as defined by the protocol, as the text of a JSON object. Clients parse them with
+     * protocolProperties() from nodalisjson.h, so that programs don't include the JSON library.
+     */
+    std::string additionalProperties;
+    /**
+     * The remote address, as it is understood by the protocol.
+     */
+    std::string remoteAddress;  // e.g. "40001"
+    /**
+     * The local address, which is a memory address reference.
+     */
+    std::string localAddress;   // e.g. "%MW1"
+    /**
+     * The bit of the address.
+     */
+    int bit = -1;               // Optional bit index
+    /**
+     * The width of the input to read from the remote and store in the address.
+     */
+    int width = 16;             // 8, 16, or 32
+    /**
+     * The interval at which the module should be polled for this address.
+     */
+    int interval = 500;
+    /**
+     * The last time the module was polled, in Milliseconds.
+     */
+    uint64_t lastPoll = 0;
+    /**
+     * The local address, resolved once when the map is created.
+     */
+    ResolvedAddress local;
+    /**
+     * The protocol-specific descriptor of the remote address, parsed once by the client when the map is added.
+     * This is an index into the client's own table of descriptors, or -1 if the client doesn't use one or the
+     * remote address is invalid.
+     */
+    int remoteHandle = -1;
+    /**
+     * The index of the remote address in the table the compiler generated for the protocol, or -1 if the client
+     * parses it from the protocol properties.
+     */
+    int definition = -1;
+    /**
+     * For outputs, the change that must be exceeded before an unchanged value is written again, compared as signed
+     * integers of the mapping width (Deadband). 0 writes on any change.
+     */
+    uint64_t deadband = 0;
+    /**
+     * For outputs, the longest time an unchanged value goes without being written, in milliseconds (RefreshTime).
+     * 0 writes the value on every poll.
+     */
+    int refreshTime = 10000;
+    /**
+     * For inputs, the shortest and the longest poll interval adaptive polling may move the mapping to, in
+     * milliseconds (MinPollTime and MaxPollTime). A mapping that sets either adapts between them and its interval;
+     * 0 leaves that side at the interval.
+     */
+    int minInterval = 0;
+    int maxInterval = 0;
+    /**
+     * The cyclic task that reads the input or writes the output, which the compiler finds from the programs of the
+     * tasks, or which the map names (Task). With --io-phase, the mapping is polled in step with the task rather than
+     * at its PollTime. Empty if no task is known.
+     */
+    std::string task;
+    /**
+     * For inputs, the slot of the mapping in the quality plane, allocated when it is added to its client.
+     */
+    uint32_t quality = NO_QUALITY_SLOT;
+    /**
+     * Constructs a new IOMap object based on a string of JSON.
+     * @param A string of JSON properties.
+     */
+    IOMap(std::string mapJson);
+    /**
+     * Constructs a new IOMap object from a row of the generated table.
+     * @param row The row.
+     */
+    IOMap(const IOMapDefinition& row);
+    IOMap();
+};
+
+class ExecutionStats;
+class IOClient;
+class IORequestScheduler;
+
+/**
+ * The release schedule of a cyclic task, published by the scheduler for the IO clients that poll in step with it
+ * (--io-phase). An input tied to the task is read so that it arrives just before the task's next release, and an
+ * output is written as soon as the image of a release that completed is published.
+ */
+struct TaskPhase {
+    /**
+     * The next release of the task and its period, in microseconds since the program started. The period is 0 until
+     * the task is added, and stays 0 for an event task, which has no schedule to align with.
+     */
+    std::atomic<uint64_t> nextRelease{0};
+    std::atomic<uint64_t> interval{0};
+    /**
+     * The releases whose outputs were published, counted so that a client can tell which it has written.
+     */
+    std::atomic<uint64_t> completions{0};
+    /**
+     * Set when a release completes, and cleared once its outputs are published.
+     */
+    std::atomic<bool> completed{false};
+    /**
+     * The clients with outputs tied to the task, which are woken to write them.
+     */
+    std::mutex clientMutex;
+    std::vector<IOClient*> clients;
+    /**
+     * Counts a completed release whose outputs were published, and wakes the clients that write them.
+     */
+    void flush();
+};
+
+/**
+ * Gets the phase of a task, creating it if the task hasn't been added yet. Phases live as long as the program.
+ * @param name The name of the task.
+ * @returns Returns the phase.
+ */
+TaskPhase* taskPhase(const std::string& name);
+
+/**
+ * The result of a request in an IOBatch.
+ */
+enum class IOStatus : uint8_t {
+    /**
+     * The request hasn't completed, or the client serves it another way, like a subscription.
+     */
+    Pending = 0,
+    /**
+     * The device read or wrote the value.
+     */
+    Good = 1,
+    /**
+     * The request failed or timed out, or the connection was lost before it was answered.
+     */
+    Failed = 2,
+    /**
+     * The device answered with an error, like a Modbus exception or a bad status of an OPC UA node.
+     */
+    Refused = 3,
+    /**
+     * The request can't be made, because its remote address couldn't be resolved or has no type of its width. The
+     * quality of an input is left as it is.
+     */
+    Invalid = 4
+};
+
+/**
+ * A read or a write of one mapping in an IOBatch, parsed before it is handed to the client, so that a client reads
+ * everything it needs from the request and doesn't touch the mappings or the process image.
+ */
+struct IORequest {
+    size_t mapping;             // The index of the mapping in the client's mappings.
+    IOType direction;
+    int width;
+    int remoteHandle;           // The remoteHandle the client gave the mapping in onMappingAdded().
+    ResolvedAddress local;
+    uint32_t quality;           // The quality slot of an input.
+    /**
+     * The value to write, sampled from the process image when the batch was built, so that every output of a batch
+     * comes from the same scan. For a read, the value it completed with.
+     */
+    uint64_t value;
+    IOStatus status;
+    /**
+     * The freshness statistics of the mapping, and when the batch was built, in microseconds since the program
+     * started, from which complete() measures the round trip.
+     */
+    MappingFreshness* freshness = nullptr;
+    uint64_t issued = 0;
+};
+
+/**
+ * The reads and writes of the mappings that are due in a poll, in the order the mappings were added.
+ */
+struct IOBatch {
+    std::vector<IORequest> requests;
+};
+
+/**
+ * The IOClient is an abstract class implemented by all protocol clients that will be used in Nodalis.
+ */
+
+/**
+ * Counters of the requests an IO client makes and of its connections. They are atomic, so they are sampled from any
+ * thread, such as the OPC UA server's, without locking the client.
+ */
+struct IOCounters {
+    /**
+     * The number of requests that completed, failed or timed out.
+     */
+    std::atomic<uint64_t> requests{0};
+    /**
+     * The number of requests that failed, timed out or were refused by the device.
+     */
+    std::atomic<uint64_t> errors{0};
+    /**
+     * The number of connections that were established.
+     */
+    std::atomic<uint64_t> connects{0};
+    /**
+     * The number of connection attempts that failed.
+     */
+    std::atomic<uint64_t> connectFailures{0};
+    /**
+     * The number of times adaptive polling lengthened the interval of a mapping whose value didn't change.
+     */
+    std::atomic<uint64_t> backoffs{0};
+    /**
+     * The number of times adaptive polling shortened the interval of a mapping whose value changed.
+     */
+    std::atomic<uint64_t> speedups{0};
+    /**
+     * The number of times the round trip time grew so far above its baseline that the device was taken as
+     * saturated, and adaptive polling stopped speeding up.
+     */
+    std::atomic<uint64_t> saturations{0};
+    /**
+     * The number of times a due mapping was held back for a later poll by the request scheduling of its device.
+     */
+    std::atomic<uint64_t> deferrals{0};
+    /**
+     * The round trip times of the requests that succeeded, or nullptr until the client has its first mapping.
+     */
+    std::atomic<ExecutionStats*> latency{nullptr};
+};
+
+class IOClient {
+public:
+    /**
+    * Indicates whether the IOClient is connected to its remote module.
+    */
+    std::atomic<bool> connected;
+    IOClient(const std::string& protocol);
+    virtual ~IOClient();
+
+    void addMapping(const IOMap& map);
+    /**
+     * Adds mappings that are known to have distinct local addresses, as the compiler's table has, without checking
+     * them against the mappings the client already has.
+     * @param maps The mappings.
+     * @param count The number of mappings.
+     */
+    void addMappings(const IOMap* maps, size_t count);
+    bool hasMapping(std::string localAddress);
+    /**
+     * Finds the output mapping of a local address. The mapping mutex is taken, so this may wait for a poll.
+     * @param local The local address.
+     * @param mapping Receives the index of the mapping in mappings.
+     * @returns Returns false if the client has no output mapping of the address.
+     */
+    bool findOutput(const ResolvedAddress& local, size_t& mapping);
+    /**
+     * Writes an output as soon as the client can, ahead of its poll, for the timed outputs. The value is held over the
+     * image's until the image has been published twice more, by which time a scan has latched the value the timed
+     * output thread staged, so the output doesn't go back to the value it had for a scan. By default the mapping is
+     * made due and the client woken, so the value goes out with its next request. This may be called from any thread.
+     * @param mapping The index of the mapping in mappings, as found by findOutput().
+     * @param local The local address of the mapping.
+     * @param value The value.
+     */
+    virtual void writeOutputNow(size_t mapping, const ResolvedAddress& local, uint64_t value);
+
+    void poll(); // Reads and writes mapped I/O
+    /**
+     * Makes the outputs tied to a task that completed a release due, and wakes the client to write them. This may be
+     * called from any thread.
+     */
+    void requestFlush();
+
+    /**
+     * Starts polling this client on its own worker thread.
+     */
+    void start();
+    /**
+     * Stops the worker thread, waiting for the current poll to finish, and waits for a connection attempt made by
+     * connectInBackground(). Derived classes must call this in their destructor, before releasing anything the worker
+     * uses.
+     */
+    void stop();
+    /**
+     * Starts a connection attempt on a thread of its own if the client isn't connected, no attempt is in progress
+     * and the reconnect delay has passed. Used when the client is polled on the scan thread (--sync-io), so that
+     * connecting to a device that is offline doesn't hold up the scan, and the clients connect concurrently.
+     * @returns Returns true if the client is connected and can be polled.
+     */
+    bool connectInBackground();
+    /**
+     * Hands the client to an IO reactor, which then drives its polls and sockets instead of a worker thread.
+     * @param reactor The reactor.
+     * @returns Returns false if the client can't run on a reactor, in which case it is started on its own thread.
+     */
+    virtual bool attach(IOReactor& reactor) { (void)reactor; return false; }
+
+    const std::string& getProtocol() const;
+    const std::string& getModuleID() const;
+    const std::string& getModulePort() const;
+    /**
+     * Gets the key of the endpoint the client serves, as made by endpointKey() from its first mapping.
+     */
+    const std::string& getEndpoint() const;
+    /**
+     * Gets the request and connection counters of the client.
+     */
+    const IOCounters& getCounters() const;
+    /**
+     * Gets the mappings of the client, in the order they were added. They must not be added to while the caller
+     * uses them.
+     */
+    const std::vector<IOMap>& getMappings() const { return mappings; }
+    /**
+     * Gets the freshness statistics of the mappings, by index in mappings, with the same caveat as getMappings().
+     */
+    const std::vector<std::unique_ptr<MappingFreshness>>& getFreshness() const { return freshness; }
+protected:
+    std::string protocol;
+    std::string moduleID;
+    std::string modulePort;
+    std::string endpoint;
+    std::vector<IOMap> mappings;
+    uint64_t lastAttempt = 0;
+    /**
+     * The time to wait after a failed connection attempt before the next one, in milliseconds. It starts at
+     * minReconnectDelay and doubles with each failed attempt, up to maxReconnectDelay.
+     */
+    uint64_t reconnectDelay = 15000;
+    uint64_t minReconnectDelay = 15000;
+    uint64_t maxReconnectDelay = 15000;
+    /**
+     * The value last written for an output mapping, kept to skip writes of values that haven't changed.
+     */
+    struct OutputState {
+        uint64_t value = 0;
+        uint64_t writtenAt = 0;
+        bool valid = false;
+    };
+    /**
+     * Guards the mappings, which are polled on the worker thread and added from the main thread.
+     */
+    std::mutex mappingMutex;
+
+    // Must be implemented by derived classes
+    /**
+     * Starts the requests of a batch. Each request is completed with complete(), either before this returns or
+     * later, on the thread that drives the client, as the device answers. A client that completes requests later
+     * must keep its own batch, built with buildBatch(), until they have all completed. The mapping mutex is held.
+     * @param batch The batch, which the client may reorder or split, but not resize.
+     */
+    virtual void submitBatch(IOBatch& batch) = 0;
+    virtual void connect() = 0;
+    /**
+     * Called when a mapping is added, so that the client can parse its remote address and protocol properties
+     * once, and set its remoteHandle. The mapping mutex is held.
+     * @param map The mapping, as stored in mappings.
+     */
+    virtual void onMappingAdded(IOMap& map) { (void)map; }
+    /**
+     * Wakes the client to poll what is due now, when requestFlush() made outputs due. By default this wakes the worker
+     * thread. Clients that run on a reactor override it to reschedule their poll there. This may be called from any
+     * thread.
+     */
+    virtual void wake();
+    /**
+     * Exchanges the values of the mappings that are due, as a batch handed to submitBatch(). The mapping mutex must
+     * be held.
+     * @param due The mappings that are due, in the order they were added.
+     */
+    void pollMappings(std::vector<IOMap*>& due);
+    /**
+     * Builds the batch of the mappings that are due, sampling the values of all its outputs from one published
+     * image. The mapping mutex must be held.
+     * @param due The mappings that are due, in the order they were added.
+     * @param batch Receives the requests. It is cleared first, so that callers can reuse its storage.
+     */
+    void buildBatch(const std::vector<IOMap*>& due, IOBatch& batch);
+    /**
+     * Completes a request of a batch. A good read is staged into the image by the next publishCompleted(), with the
+     * other reads completed since, and a failed write is written again on its next poll. This is called on the
+     * thread that drives the client.
+     * @param request The request.
+     * @param status The result.
+     * @param value The value read, for a good read.
+     */
+    void complete(IORequest& request, IOStatus status, uint64_t value = 0);
+    /**
+     * Stages the reads completed since the last call into the image together, and marks them Good. Called by
+     * pollMappings() after submitBatch(), and by clients that complete requests later as each response is handled.
+     */
+    void publishCompleted();
+    /**
+     * Collects the mappings that are due and marks them as polled. Only the poll classes that are due are touched,
+     * so the cost doesn't grow with the number of mappings that aren't. The mapping mutex must be held.
+     * @param due Receives the mappings that are due, in the order they were added. It is cleared first, so that
+     * callers can reuse its storage from poll to poll.
+     */
+    void collectDue(std::vector<IOMap*>& due);
+    /**
+     * Reports that writing an output mapping failed, so that it is written again on its next poll even if its
+     * value hasn't changed. This may be called without the mapping mutex.
+     * @param mapping The index of the mapping in mappings.
+     */
+    void outputFailed(size_t mapping);
+    /**
+     * Updates the reconnect delay after a connection attempt.
+     * @param succeeded Whether the attempt succeeded.
+     */
+    void connectAttempted(bool succeeded);
+    /**
+     * Counts a request in the client's counters. This may be called from any thread.
+     * @param succeeded Whether the device answered the request without an error.
+     * @param micros The round trip time of the request, in microseconds. It is recorded only if the request succeeded.
+     */
+    void requestCompleted(bool succeeded, uint64_t micros);
+    /**
+     * Sets the quality of all the client's inputs, for protocols that read them all in one exchange. This may be
+     * called without the mapping mutex.
+     * @param quality The quality.
+     */
+    void markInputs(IOQuality quality);
+    /**
+     * Gets the time at which the next poll or connection attempt is due.
+     * @returns Returns the time, in milliseconds since the program started.
+     */
+    uint64_t nextPollDue();
+private:
+    std::thread worker;
+    std::atomic<bool> running{false};
+    /**
+     * Wakes the worker thread from its sleep between polls.
+     */
+    std::mutex wakeMutex;
+    std::condition_variable wakeSignal;
+    /**
+     * Set by requestFlush() until collectDue() has made the outputs of the completed releases due.
+     */
+    std::atomic<bool> flushPending{false};
+    /**
+     * The thread of the connection attempt started by connectInBackground(), and whether it is still connecting.
+     */
+    std::thread connector;
+    std::atomic<bool> connecting{false};
+    IOCounters counters;
+    /**
+     * The mappings that share a poll interval. They are always due together, so that they can be batched.
+     */
+    struct PollClass {
+        int interval;
+        /**
+         * The time the class is next due, in milliseconds since the program started.
+         */
+        uint64_t nextDue;
+        /**
+         * The indexes of the mappings in the class, in the order they were added.
+         */
+        std::vector<size_t> members;
+        /**
+         * With --io-phase, the task the class is polled in step with, or null, and for outputs the completions of the
+         * task the class has written.
+         */
+        TaskPhase* phase = nullptr;
+        uint64_t flushed = 0;
+    };
+    std::vector<PollClass> pollClasses;
+    /**
+     * The index of the class of the inputs, or of the outputs, tied to each task.
+     */
+    std::map<std::pair<TaskPhase*, bool>, size_t> classByTask;
+    /**
+     * The classes of outputs tied to a task, which requestFlush() makes due.
+     */
+    std::vector<size_t> flushClasses;
+    /**
+     * The adaptive poll interval of a mapping, which lengthens while its value doesn't change and shortens when it
+     * does.
+     */
+    struct AdaptiveState {
+        int interval = 0;       // The current interval, or 0 if the mapping is polled at its fixed interval.
+        int minInterval = 0;
+        int maxInterval = 0;
+        uint32_t quiet = 0;     // The polls since the value last changed.
+        uint64_t value = 0;     // The value seen at the last poll.
+        bool seen = false;
+    };
+    /**
+     * The adaptive state of each mapping, by index in mappings.
+     */
+    std::vector<AdaptiveState> adaptive;
+    size_t adaptiveCount = 0;
+    /**
+     * The mappings whose interval changed in collectDue(), with their old interval, moved once it is done.
+     */
+    std::vector<std::pair<size_t, int>> adaptiveMoves;
+    /**
+     * The recent round trip time, averaged over about 8 requests, and its baseline, which follows the fastest round
+     * trips and rises only slowly, in microseconds.
+     */
+    std::atomic<uint64_t> rttRecent{0};
+    std::atomic<uint64_t> rttBaseline{0};
+    bool saturated = false;
+    /**
+     * The requests made in the last whole second, measured against the poll budget.
+     */
+    uint64_t budgetStart = 0;
+    uint64_t budgetRequests = 0;
+    uint64_t requestRate = 0;
+    /**
+     * The mappings that are due in poll(), kept between polls so that its storage is reused.
+     */
+    std::vector<IOMap*> dueMappings;
+    /**
+     * The batch of pollMappings(), kept between polls like dueMappings.
+     */
+    IOBatch pollBatch;
+    /**
+     * The good reads that complete() queued for publishCompleted().
+     */
+    std::vector<ResolvedAddress> completedAddresses;
+    std::vector<uint64_t> completedValues;
+    std::vector<uint32_t> completedSlots;
+    std::vector<MappingFreshness*> completedFreshness;
+    /**
+     * The freshness statistics of each mapping, by index in mappings.
+     */
+    std::vector<std::unique_ptr<MappingFreshness>> freshness;
+    /**
+     * The last written value of each mapping, by index in mappings. It has its own mutex because write results
+     * can arrive on a reactor without the mapping mutex.
+     */
+    std::vector<OutputState> outputs;
+    std::mutex outputMutex;
+    /**
+     * The quality slots of the client's inputs, guarded by outputMutex like outputs, since connection results also
+     * arrive on a reactor.
+     */
+    std::vector<uint32_t> inputSlots;
+    /**
+     * A value writeOutputNow() holds for a mapping, guarded by outputMutex.
+     */
+    struct OutputHold {
+        size_t mapping;
+        uint64_t value;
+        uint64_t generation;    // The image generation from which the image is trusted again.
+        bool sent;              // Whether collectDue() has made the mapping due for it.
+    };
+    std::vector<OutputHold> holds;
+    /**
+     * Set by writeOutputNow() until collectDue() has made the held mappings due.
+     */
+    std::atomic<bool> holdPending{false};
+    /**
+     * The held mappings collectDue() makes due, kept between polls like dueMappings.
+     */
+    std::vector<size_t> heldDue;
+    /**
+     * Shares the client's requests between its devices and keeps them to their rate budgets, or null if no mapping
+     * sets a Priority, RequestRate, ByteRate or Weight and no --io-request-rate, --io-byte-rate or --io-batch-limit
+     * is given, in which case every due mapping is sent.
+     */
+    std::unique_ptr<IORequestScheduler> scheduler;
+    /**
+     * Gets the value to write for an output mapping: the held one if it has one, otherwise the image's. Holds whose
+     * generation has been reached are dropped first. outputMutex must be held.
+     * @param index The index of the mapping.
+     * @param value The value of the mapping in the image.
+     * @returns Returns the value to write.
+     */
+    uint64_t heldValue(size_t index, uint64_t value);
+    /**
+     * Checks whether an output mapping needs to be written, and if so records its current value as written.
+     * @param index The index of the mapping.
+     * @param now The current time, in milliseconds since the program started.
+     * @returns Returns false if the value is unchanged, or within the deadband, and was written recently.
+     */
+    bool outputDue(size_t index, uint64_t now);
+    /**
+     * Compares the value of an adaptive mapping with the one seen at its last poll, and chooses its next interval.
+     * @param index The index of the mapping.
+     * @param constrained Whether the device is saturated or over its poll budget, so intervals may only lengthen.
+     */
+    void adaptInterval(size_t index, bool constrained);
+    /**
+     * Checks whether the device is saturated, from the growth of its round trip time, or over the poll budget.
+     * @param now The current time, in milliseconds since the program started.
+     * @returns Returns true if adaptive polling shouldn't poll any faster.
+     */
+    bool pollConstrained(uint64_t now);
+    /**
+     * Finds the poll class of an interval, creating it if there is none.
+     * @param interval The interval.
+     * @param due When a new class is first due.
+     * @returns Returns the index of the class.
+     */
+    size_t pollClassFor(int interval, uint64_t due);
+    /**
+     * Finds the class of the inputs or the outputs tied to a task, creating it if there is none. The class is polled
+     * at the shortest interval of its members while the task has no schedule.
+     * @param phase The phase of the task.
+     * @param output Whether the class holds outputs.
+     * @param interval The interval of the mapping joining the class.
+     * @returns Returns the index of the class.
+     */
+    size_t pollClassFor(TaskPhase* phase, bool output, int interval);
+    /**
+     * Gets when a class polled in step with a task is next due. Inputs are read early enough to arrive before the
+     * task's next release that is still ahead, by the recent round trip time and the margin set with
+     * --io-phase-margin. Outputs are written when the task completes, and otherwise refreshed at their interval.
+     * @param pollClass The class.
+     * @param now The current time, in milliseconds since the program started.
+     * @returns Returns the time, in milliseconds since the program started.
+     */
+    uint64_t phaseDue(const PollClass& pollClass, uint64_t now);
+    /**
+     * The index of the poll class for each interval.
+     */
+    std::map<int, size_t> classByInterval;
+    /**
+     * A min-heap of the poll classes by the time they are next due. Each class has exactly one entry.
+     */
+    std::priority_queue<std::pair<uint64_t, size_t>, std::vector<std::pair<uint64_t, size_t>>,
+        std::greater<std::pair<uint64_t, size_t>>> pollQueue;
+    /**
+     * The index of each mapping in mappings, by local address.
+     */
+    std::unordered_map<std::string, size_t> mappingIndex;
+    /**
+     * Checks for a mapping while the mapping mutex is already held.
+     * @param localAddress The local address of the mapping.
+     * @returns Returns true if the client has a mapping for the address.
+     */
+    bool hasMappingLocked(const std::string& localAddress);
+    /**
+     * Adds a mapping while the mapping mutex is held, without checking for one of the same local address.
+     * @param map The mapping.
+     */
+    void appendMappingLocked(const IOMap& map);
+    /**
+     * Adds a mapping to the request scheduler, creating it when the mapping or the runtime options are the first to
+     * ask for scheduling. The mapping mutex must be held.
+     * @param index The index of the mapping in mappings.
+     */
+    void scheduleMappingLocked(size_t index);
+    /**
+     * The loop of the worker thread.
+     */
+    void runWorker();
+};
+
+/**
+ * An IOClient for simple drivers that read and write one address at a time. It completes each request of a batch
+ * with the read or write function of its width, in order.
+ */
+class ScalarIOClient : public IOClient {
+public:
+    ScalarIOClient(const std::string& protocol) : IOClient(protocol) {}
+
+protected:
+    // Must be implemented by derived classes
+    virtual bool readBit(const std::string& remote, int& result) = 0;
+    virtual bool writeBit(const std::string& remote, int value) = 0;
+    virtual bool readByte(const std::string& remote, uint8_t& result) = 0;
+    virtual bool writeByte(const std::string& remote, uint8_t value) = 0;
+    virtual bool readWord(const std::string& remote, uint16_t& result) = 0;
+    virtual bool writeWord(const std::string& remote, uint16_t value) = 0;
+    virtual bool readDWord(const std::string& remote, uint32_t& result) = 0;
+    virtual bool writeDWord(const std::string& remote, uint32_t value) = 0;
+    virtual bool readLWord(const std::string &remote, uint64_t &result) = 0;
+    virtual bool writeLWord(const std::string &remote, uint64_t value) = 0;
+    /**
+     * Exchanges each request of the batch on its own with exchange().
+     * @param batch The batch.
+     */
+    void submitBatch(IOBatch& batch) override;
+    /**
+     * Exchanges the value of a single request between the process image and the remote module, and completes it.
+     * @param request The request.
+     */
+    void exchange(IORequest& request);
+};
+
+extern std::vector<std::unique_ptr<IOClient>> Clients;
+
+/**
+ * Makes the key of the transport endpoint a mapping is reached at, as host:port/protocol. Mappings with the same key
+ * share one client, and so one socket, session or serial port, even if their ModuleID or ModulePort differ: host
+ * names are resolved to their IPv4 address, ports default to the protocol's port, and device files are followed to
+ * the device. OPC UA keys also hold the path of the endpoint URL, and BACnet keys the DeviceInstance, since the
+ * devices behind a router share its address.
+ * @param map The mapping.
+ * @returns Returns the key.
+ */
+std::string endpointKey(const IOMap& map);
+/**
+ * Finds the client of a mapping: the client that already maps its local address, or else the client of its endpoint,
+ * which it is added to. Both are found through hash indexes, so mapping n points takes time linear in n. A local
+ * address that another client maps from a different endpoint or remote address is reported as a conflict, and
+ * stays with the first.
+ * @param map The mapping.
+ * @returns Returns the client, or nullptr if the mapping needs a new one.
+ */
+IOClient* findClient(IOMap map);
+std::unique_ptr<IOClient> createClient(IOMap& map);
+/**
+ * Creates a client for a protocol, without any mappings.
+ * @param protocol The protocol.
+ * @returns Returns the client, or nullptr if the protocol isn't supported or isn't built into the runtime.
+ */
+std::unique_ptr<IOClient> newClient(const std::string& protocol);
+
+/**
+ * Adds a mapping to the client of its module, creating the client if there is none yet.
+ * @param map The mapping, as JSON.
+ * @param definition The index of the mapping's remote address in the table the compiler generated for its
+ * protocol, or -1 to parse it from the protocol properties.
+ */
+void mapIO(std::string map, int definition = -1);
+
+/**
+ * Creates the clients of the IO map table the compiler generated, in one pass. The mappings of each client are
+ * contiguous rows of the table, and no two rows share a local address, so no mapping is compared with the others.
+ * Only the endpoint of each client is looked up, and the rows of an endpoint that already has a client join it.
+ * @param maps The rows of the table.
+ * @param clients The rows of each client.
+ * @param clientCount The number of clients.
+ */
+void mapIOTable(const IOMapDefinition* maps, const IOClientDefinition* clients, size_t clientCount);
+
+/**
+ * Creates the clients of a binary IO configuration (see ioconfig.h), which is mapped into memory and read in place
+ * as the table the compiler generates would be.
+ * @param path The path of the configuration.
+ * @returns Returns false, having written why, if the file can't be read or isn't a valid configuration.
+ */
+bool mapIOConfig(const std::string& path);
+
+#pragma endregion
+
+#pragma region "Scan Statistics"
+/**
+ * Execution time statistics for a scan, a task or the IO layer. Each set of statistics has a single writer, and all
+ * counters are atomic, so they can be read from any thread without locking.
+ */
+class ExecutionStats {
+public:
+    /**
+     * The number of histogram buckets. Bucket 0 counts durations under 1us, and bucket n counts durations
+     * from 2^(n-1)us up to 2^n us. The last bucket also counts everything longer.
+     */
+    static constexpr int HISTOGRAM_BUCKETS = 24;
+
+    /**
+     * Constructs a new set of statistics.
+     * @param name The name of the statistics, like Scan or Task.MainTask.
+     */
+    ExecutionStats(const std::string& name);
+    /**
+     * Records one execution.
+     * @param micros The duration of the execution, in microseconds.
+     */
+    void record(uint64_t micros);
+    /**
+     * Records executions that overran their deadline.
+     * @param count The number of deadlines that were missed.
+     */
+    void recordOverrun(uint64_t count = 1);
+
+    /**
+     * Gets the name of the statistics.
+     */
+    const std::string& getName() const;
+    /**
+     * Gets the number of executions recorded.
+     */
+    uint64_t getCount() const;
+    /**
+     * Gets the shortest execution, in microseconds, or 0 if none were recorded.
+     */
+    uint64_t getMinimum() const;
+    /**
+     * Gets the longest execution, in microseconds.
+     */
+    uint64_t getMaximum() const;
+    /**
+     * Gets the average execution, in microseconds.
+     */
+    uint64_t getAverage() const;
+    /**
+     * Gets the sum of the executions recorded, in microseconds.
+     */
+    uint64_t getTotal() const;
+    /**
+     * Gets the most recent execution, in microseconds.
+     */
+    uint64_t getLast() const;
+    /**
+     * Gets the number of missed deadlines.
+     */
+    uint64_t getOverruns() const;
+    /**
+     * Gets the number of executions recorded in a histogram bucket.
+     * @param bucket The bucket, from 0 to HISTOGRAM_BUCKETS - 1.
+     * @returns Returns the number of executions in the bucket.
+     */
+    uint64_t getHistogram(int bucket) const;
+    /**
+     * Estimates a percentile of the executions from the histogram.
+     * @param percent The percentile, from 0 to 100.
+     * @returns Returns the upper bound of the histogram bucket the percentile falls in, in microseconds, but no
+     * more than the longest execution. Returns 0 if none were recorded.
+     */
+    uint64_t getPercentile(double percent) const;
+    /**
+     * Writes the statistics as a single line of text.
+     * @param out The text to write to.
+     */
+    void dump(LogText& out) const;
+private:
+    std::string name;
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> minimum{UINT64_MAX};
+    std::atomic<uint64_t> maximum{0};
+    std::atomic<uint64_t> last{0};
+    std::atomic<uint64_t> overruns{0};
+    std::atomic<uint64_t> histogram[HISTOGRAM_BUCKETS] = {};
+};
+
+/**
+ * How fresh the values of one IO mapping are, measured end to end. Unlike the latency of a client, which times
+ * requests, these follow each value: the round trip of the request that carried it, how long a value read from the
+ * device waited for a scan to latch it, and how long a changed output waited for the device to acknowledge it. The
+ * statistics aren't registered, so they are left out of --stats-interval and are exported per mapping instead.
+ */
+struct MappingFreshness {
+    /**
+     * Constructs the statistics of a mapping.
+     * @param name The name of the mapping, like IO.MODBUS-TCP.192.168.1.10.%IW0.
+     * @param local The local address of the mapping.
+     * @param output Whether the mapping is an output.
+     */
+    MappingFreshness(const std::string& name, const ResolvedAddress& local, bool output);
+    std::string name;
+    ResolvedAddress local;
+    bool output;
+    /**
+     * The round trips of the requests of the mapping that succeeded.
+     */
+    ExecutionStats roundTrip;
+    /**
+     * For an input, the time from a value arriving to the scan that latched it.
+     */
+    ExecutionStats inputAge;
+    /**
+     * For an output, the time from the scan that changed it to the device acknowledging the write.
+     */
+    ExecutionStats outputDelay;
+    /**
+     * The input values that a newer value replaced before any scan latched them.
+     */
+    std::atomic<uint64_t> superseded{0};
+    /**
+     * When commitOutputs() last published a change to the output, in microseconds since the program started.
+     */
+    std::atomic<uint64_t> changedAt{0};
+    /**
+     * When the change the client is writing was published, or 0 if none is pending. Guarded by the client's
+     * outputMutex, and kept across failed writes so that a retry is measured from the original change.
+     */
+    uint64_t pendingChange = 0;
+};
+
+/**
+ * Creates a set of statistics that lives for the rest of the program.
+ * @param name The name of the statistics.
+ * @returns Returns the new statistics.
+ */
+ExecutionStats& registerStats(const std::string& name);
+/**
+ * Gets all registered statistics, in the order they were registered.
+ * @returns Returns the statistics.
+ */
+std::vector<ExecutionStats*> getAllStats();
+/**
+ * Writes all registered statistics, one per line.
+ * @param out The text to write to.
+ */
+void dumpStats(LogText& out);
+/**
+ * Gets the memory used by the process. This is only supported on Linux, and returns zeros elsewhere.
+ * @param residentKB Receives the resident set size, in KB.
+ * @param peakKB Receives the largest resident set size the process has had, in KB.
+ */
+void getMemoryUsage(uint64_t& residentKB, uint64_t& peakKB);
+/**
+ * Gets the number of microseconds between two times.
+ * @param from The start time.
+ * @param to The end time.
+ * @returns Returns the microseconds from the start to the end, or 0 if the end is before the start.
+ */
+inline uint64_t microsBetween(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to){
+    return to > from ? std::chrono::duration_cast<std::chrono::microseconds>(to - from).count() : 0;
+}
+#pragma endregion
+
+#pragma region "Diagnostics"
+/**
+ * The severity of a diagnostic. Diagnostics below the level set with --log-level, Info by default, are neither
+ * formatted nor logged.
+ */
+enum class LogSeverity : uint8_t {
+    Debug,
+    Info,
+    Warning,
+    Error
+};
+
+/**
+ * A place in the code that logs diagnostics. Each site may log DIAGNOSTIC_BURST messages per DIAGNOSTIC_WINDOW_MS.
+ * The rest are counted, and the count is reported with the next message the site logs, so that a failing device
+ * can't flood the console.
+ */
+struct DiagnosticSite {
+    constexpr DiagnosticSite(LogSeverity severity, const char* file, int line)
+        : severity(severity), file(file), line(line) {}
+    const LogSeverity severity;
+    const char* const file;
+    const int line;
+    std::atomic<uint64_t> windowStart{0};
+    std::atomic<uint32_t> logged{0};
+    std::atomic<uint32_t> suppressed{0};
+};
+
+/**
+ * The number of messages a site may log per window.
+ */
+constexpr uint32_t DIAGNOSTIC_BURST = 5;
+/**
+ * The length of a rate limiting window, in milliseconds.
+ */
+constexpr uint64_t DIAGNOSTIC_WINDOW_MS = 10000;
+/**
+ * The number of messages that can wait for the diagnostics thread, a power of two. Messages logged while it is full
+ * are dropped.
+ */
+constexpr size_t DIAGNOSTIC_QUEUE_SIZE = 256;
+/**
+ * The longest message that is queued, in bytes. Longer messages are cut short.
+ */
+constexpr size_t DIAGNOSTIC_MESSAGE_BYTES = 240;
+
+/**
+ * Checks whether a site may log another message now.
+ * @param site The site that wants to log.
+ * @param suppressed Set to the number of messages suppressed at the site since it last logged.
+ * @returns Returns true if the message should be formatted and logged.
+ */
+bool admitDiagnostic(DiagnosticSite& site, uint32_t& suppressed);
+/**
+ * Queues a message to be written by the diagnostics thread, to stdout and the log file or syslog. This never waits
+ * on the console, or takes a lock: the message is copied into a slot of a ring shared by every thread. If the ring is
+ * full, the message is dropped and counted, and the count is written with the next message that fits. A message the
+ * same as the last one written, from the same site, is counted rather than written again, as "message repeated N
+ * times".
+ * @param site The site that logged the message.
+ * @param message The message, without a trailing newline.
+ */
+void logDiagnostic(const DiagnosticSite& site, const std::string& message);
+
+/**
+ * Logs a diagnostic of a severity, from the IO path or anywhere else a message could repeat. The message is a stream
+ * expression, as in DIAGNOSTIC_AT(LogSeverity::Error, "read of " << name << " failed"), and is only formatted if the
+ * severity is logged and the call site isn't rate limited.
+ */
+#define DIAGNOSTIC_AT(severity, message) \
+    do { \
+        static DiagnosticSite diagnosticSite_{severity, __FILE__, __LINE__}; \
+        uint32_t diagnosticSuppressed_ = 0; \
+        if (admitDiagnostic(diagnosticSite_, diagnosticSuppressed_)) { \
+            LogText diagnosticText_; \
+            diagnosticText_ << message; \
+            if (diagnosticSuppressed_ > 0) diagnosticText_ << " (" << diagnosticSuppressed_ << " similar messages suppressed)"; \
+            logDiagnostic(diagnosticSite_, diagnosticText_.str()); \
+        } \
+    } while (0)
+
+/**
+ * Logs a warning from the IO path, as DIAGNOSTIC("read of " << name << " failed").
+ */
+#define DIAGNOSTIC(message) DIAGNOSTIC_AT(LogSeverity::Warning, message)
+#pragma endregion
+
+#pragma region "Tracing"
+/**
+ * Whether the runtime records trace events around its tasks, programs, IO client polls and connects, and OPC UA
+ * callbacks. Built with NODALIS_TRACE 0, the default, the trace points expand to nothing.
+ */
+#ifndef NODALIS_TRACE
+#define NODALIS_TRACE 0
+#endif
+
+/**
+ * Reads the CPU's cycle counter: the TSC on x86 and the virtual counter on ARM64. Elsewhere it reads the steady clock
+ * in nanoseconds. The counter is converted to time when it is written out, from two readings taken against the steady
+ * clock, so its rate never has to be known. On x86 the TSC has to be invariant, as it is on any recent CPU.
+ * @returns Returns the count.
+ */
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+inline uint64_t readCycleCounter(){ return __rdtsc(); }
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+inline uint64_t readCycleCounter(){ return __rdtsc(); }
+#elif defined(__aarch64__)
+inline uint64_t readCycleCounter(){
+    uint64_t count;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(count));
+    return count;
+}
+#else
+inline uint64_t readCycleCounter(){
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+#endif
+
+/**
+ * Gets the time of a count of readCycleCounter(), measured against the steady clock since the runtime started.
+ * @returns Returns the nanoseconds per count.
+ */
+double nanosPerCycle();
+
+/**
+ * The kinds of trace events, which become the categories of the exported trace.
+ */
+enum class TraceCategory : uint32_t {
+    Scan,       // A cycle of the scheduler that latched the inputs, ran the due tasks and committed the outputs.
+    Task,       // A release of a task.
+    Program,    // A call of a program instance.
+    IO,         // A poll of an IO client.
+    Connect,    // A connection attempt of an IO client.
+    OPCUA       // A read, write or update of the OPC UA server.
+};
+
+/**
+ * A trace event. The names must outlive the trace, as literals and the names of tasks, programs and clients do.
+ */
+struct TraceRecord {
+    uint64_t start;         // The cycle count the event started at.
+    uint64_t end;           // The cycle count the event ended at.
+    const char* name;       // The name of the event.
+    const char* detail;     // What the event was for, such as the module of an IO client, or nullptr.
+    TraceCategory category;
+};
+
+/**
+ * The number of events each thread keeps. When it is full, the oldest events are overwritten.
+ */
+constexpr size_t TRACE_RING_RECORDS = 16384;
+
+/**
+ * The trace events of a thread. Only the thread writes to it, and it publishes each event by advancing the head, so
+ * recording never takes a lock. A dump copies the events and discards any that were overwritten while it copied.
+ */
+struct TraceRing {
+    TraceRecord records[TRACE_RING_RECORDS];
+    std::atomic<uint64_t> head{0};      // The number of events recorded.
+    uint32_t thread = 0;                // The number of the thread in the trace.
+    std::string threadName;             // The name of the thread in the trace, which the thread sets.
+};
+
+/**
+ * Gets the ring of the calling thread, creating and registering it on the thread's first event.
+ * @returns Returns the ring.
+ */
+TraceRing& createTraceRing();
+inline thread_local TraceRing* TRACE_RING = nullptr;
+
+/**
+ * Records a trace event on the calling thread.
+ */
+inline void traceEvent(TraceCategory category, const char* name, const char* detail, uint64_t start, uint64_t end){
+    TraceRing& ring = TRACE_RING != nullptr ? *TRACE_RING : createTraceRing();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    ring.records[head & (TRACE_RING_RECORDS - 1)] = TraceRecord{start, end, name, detail, category};
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+/**
+ * Records the time from its construction to its destruction as a trace event.
+ */
+class TraceScope {
+public:
+    TraceScope(TraceCategory category, const char* name, const char* detail = nullptr)
+        : category(category), name(name), detail(detail), start(readCycleCounter()){
+    }
+    ~TraceScope(){
+        traceEvent(category, name, detail, start, readCycleCounter());
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+private:
+    TraceCategory category;
+    const char* name;
+    const char* detail;
+    uint64_t start;
+};
+
+/**
+ * Names the calling thread in the trace. Threads that aren't named are numbered.
+ * @param name The name.
+ */
+void nameTraceThread(const std::string& name);
+/**
+ * Asks for the trace to be written to the trace file. This only sets a flag, so it is safe to call from the scan
+ * thread and from a signal handler; the trace thread writes the file.
+ */
+void requestTraceDump();
+/**
+ * Writes the events of every thread as a Chrome trace, which chrome://tracing and the Perfetto UI open.
+ * @param path The file to write.
+ * @returns Returns false if the file can't be written.
+ */
+bool writeTrace(const std::string& path);
+
+/**
+ * Traces the rest of the enclosing scope, as in NODALIS_TRACE_SCOPE(TraceCategory::IO, "poll", moduleID.c_str()).
+ */
+#define NODALIS_TRACE_JOIN_(a, b) a##b
+#define NODALIS_TRACE_JOIN(a, b) NODALIS_TRACE_JOIN_(a, b)
+#if NODALIS_TRACE
+#define NODALIS_TRACE_SCOPE(category, ...) TraceScope NODALIS_TRACE_JOIN(traceScope_, __LINE__)(category, __VA_ARGS__)
+#define NODALIS_TRACE_THREAD(name) nameTraceThread(name)
+#else
+#define NODALIS_TRACE_SCOPE(category, ...) ((void)0)
+#define NODALIS_TRACE_THREAD(name) ((void)0)
+#endif
+#pragma endregion
+
+#pragma region "POU Profiling"
+/**
+ * The time spent in a PROGRAM, FUNCTION or FUNCTION_BLOCK, counted in readCycleCounter() counts. Programs compiled
+ * with pouProfile have a table of these, POU_PROFILES, indexed by the ID the compiler gives each POU, and each body
+ * samples the counter when it is entered and left. The counters are atomic, since a function or function block may
+ * be called from several task threads.
+ */
+struct POUProfile {
+    const char* name;                       // The name of the POU.
+    const char* kind;                       // PROGRAM, FUNCTION or FUNCTION_BLOCK.
+    std::atomic<uint64_t> calls{0};         // The number of calls.
+    std::atomic<uint64_t> cycles{0};        // The counts spent in the calls, including the POUs they called.
+    std::atomic<uint64_t> selfCycles{0};    // The counts spent in the calls, without the POUs they called.
+    std::atomic<uint64_t> maxCycles{0};     // The longest call, including the POUs it called.
+};
+
+/**
+ * The counts spent in the POUs called by the POU the calling thread is in, so that a POU's own time can be told
+ * from that of the POUs it calls.
+ */
+inline thread_local uint64_t POU_NESTED_CYCLES = 0;
+
+/**
+ * Adds the time from its construction to its destruction to a POU's profile. Generated code declares one at the top
+ * of the body of each POU.
+ */
+class POUSample {
+public:
+    explicit POUSample(POUProfile& profile) : profile(profile), outer(POU_NESTED_CYCLES), start(readCycleCounter()){
+        POU_NESTED_CYCLES = 0;
+    }
+    ~POUSample(){
+        uint64_t total = readCycleCounter() - start;
+        uint64_t nested = POU_NESTED_CYCLES;
+        POU_NESTED_CYCLES = outer + total;
+        profile.calls.fetch_add(1, std::memory_order_relaxed);
+        profile.cycles.fetch_add(total, std::memory_order_relaxed);
+        profile.selfCycles.fetch_add(total > nested ? total - nested : 0, std::memory_order_relaxed);
+        if(total > profile.maxCycles.load(std::memory_order_relaxed)){
+            profile.maxCycles.store(total, std::memory_order_relaxed);
+        }
+    }
+    POUSample(const POUSample&) = delete;
+    POUSample& operator=(const POUSample&) = delete;
+private:
+    POUProfile& profile;
+    uint64_t outer;
+    uint64_t start;
+};
+
+/**
+ * Registers the POU profiles of the program, so that they are served under Diagnostics.POUs and written with the
+ * statistics. The table must outlive the runtime. Generated code calls this before the scheduler is constructed.
+ * @param profiles The profiles, indexed by POU ID.
+ * @param count The number of POUs.
+ */
+void registerPOUProfiles(POUProfile* profiles, size_t count);
+/**
+ * Gets the registered POU profiles.
+ * @param count Set to the number of POUs.
+ * @returns Returns the profiles, or nullptr if the program isn't profiled.
+ */
+const POUProfile* getPOUProfiles(size_t& count);
+#pragma endregion
+
+#pragma region "Allocation Accounting"
+/**
+ * Whether the runtime replaces the global operator new and delete to count the allocations of the whole process.
+ * Built with NODALIS_ALLOC_TRACK 0, the default, the allocator is left alone and the counters stay at zero.
+ */
+#ifndef NODALIS_ALLOC_TRACK
+#define NODALIS_ALLOC_TRACK 0
+#endif
+
+/**
+ * Counters of the allocations made with operator new. They are atomic, so they are sampled from any thread.
+ */
+struct AllocationCounters {
+    std::atomic<uint64_t> allocations{0};       // The number of allocations.
+    std::atomic<uint64_t> frees{0};             // The number of allocations that were freed.
+    std::atomic<uint64_t> bytes{0};             // The bytes allocated, including those since freed.
+    std::atomic<uint64_t> liveBytes{0};         // The bytes allocated and not yet freed.
+    std::atomic<uint64_t> scanAllocations{0};   // The allocations made during a scan or a task release.
+};
+
+/**
+ * Gets the allocation counters. They stay at zero in a build without NODALIS_ALLOC_TRACK.
+ */
+const AllocationCounters& getAllocationCounters();
+
+/**
+ * The size, in bytes, of the arena the runtime allocates from while it starts. With NODALIS_ARENA_BYTES, operator new
+ * takes memory from one static, cache line aligned block instead of the heap until the first scan has finished, so
+ * the clients, their mappings, the servers and their buffers are laid out next to each other in the order they were
+ * made, and none of it fragments the heap. Memory freed while starting is given back if it was the last allocated,
+ * which covers the temporaries of parsing, and is otherwise left in place. After the first scan the arena is sealed:
+ * later allocations come from the heap, and are counted, and with --arena-strict reported or refused. Built with
+ * NODALIS_ARENA_BYTES 0, the default, there is no arena. C libraries such as open62541 allocate with malloc, and
+ * aren't affected.
+ */
+#ifndef NODALIS_ARENA_BYTES
+#define NODALIS_ARENA_BYTES 0
+#endif
+
+/**
+ * The use of the arena. It stays at zero in a build without NODALIS_ARENA_BYTES.
+ */
+struct ArenaCounters {
+    std::atomic<uint64_t> used{0};              // The bytes of the arena in use, with those freed out of order.
+    std::atomic<uint64_t> overflows{0};         // The allocations made from the heap while starting, as the arena was full.
+    std::atomic<uint64_t> heapAllocations{0};   // The allocations made from the heap since the arena was sealed.
+    std::atomic<bool> sealed{false};
+};
+
+/**
+ * Gets the use of the arena.
+ */
+const ArenaCounters& getArenaCounters();
+
+/**
+ * Seals the arena, in a build with NODALIS_ARENA_BYTES, so that later allocations come from the heap. The scheduler
+ * calls it when its first scan has finished. Does nothing in other builds, or after the first call.
+ */
+void sealArena();
+
+/**
+ * Whether the calling thread is in a scan, and whether it has finished its first one. Allocations are counted as
+ * scan allocations while in a scan, and, with --alloc-strict, reported once the first scan has finished, which is
+ * when startup is considered complete.
+ */
+struct ScanAllocationState {
+    bool inScan = false;
+    bool armed = false;
+};
+inline thread_local ScanAllocationState SCAN_ALLOCATION_STATE;
+
+/**
+ * Marks the rest of the enclosing block as part of a scan, for the allocation counters.
+ */
+class ScanAllocationScope {
+public:
+    ScanAllocationScope(){ SCAN_ALLOCATION_STATE.inScan = true; }
+    ~ScanAllocationScope(){
+        SCAN_ALLOCATION_STATE.inScan = false;
+        SCAN_ALLOCATION_STATE.armed = true;
+    }
+    ScanAllocationScope(const ScanAllocationScope&) = delete;
+    ScanAllocationScope& operator=(const ScanAllocationScope&) = delete;
+};
+
+#if NODALIS_ALLOC_TRACK
+#define NODALIS_SCAN_ALLOCATIONS() ScanAllocationScope scanAllocationScope
+#else
+#define NODALIS_SCAN_ALLOCATIONS() ((void)0)
+#endif
+#pragma endregion
+
+#pragma region "Task Scheduling"
+/**
+ * Options for the runtime, set from the command line of the PLC executable.
+ */
+struct RuntimeOptions {
+    /**
+     * Runs each task on its own worker thread at an OS priority derived from its IEC priority (--threaded-tasks).
+     */
+    bool threadedTasks = false;
+    /**
+     * The number of threads, besides the scan thread, that the independent program instances of a task run on, or 0
+     * to run them one after another (--parallel-programs <n>).
+     */
+    int parallelPrograms = 0;
+    /**
+     * Skips the rungs of programs compiled with the incremental option when nothing they read or write changed since
+     * they were last evaluated (--incremental). It has no effect with threaded tasks.
+     */
+    bool incremental = false;
+    /**
+     * The scans between those that evaluate every rung of incremental programs, or 0 for none
+     * (--incremental-full <scans>).
+     */
+    uint64_t incrementalFull = 100;
+    /**
+     * The longest a release of a task may run, in milliseconds, for the tasks that don't have a budget of their own,
+     * or 0 for no watchdog (--watchdog <ms>).
+     */
+    uint64_t watchdog = 0;
+    /**
+     * What the scheduler does about a release that ran past its watchdog budget (--overrun-policy <policy>): "continue"
+     * logs it, "skip" also skips the next release of the task, and "safe" enters the safe state (see enterSafeState()).
+     */
+    std::string overrunPolicy = "continue";
+    /**
+     * The clock the releases of the cyclic tasks are aligned to, so that the cycles of controllers that share it
+     * start together (--clock-sync <clock>): "realtime" for the system clock when NTP or phc2sys disciplines it, or a
+     * PTP hardware clock such as /dev/ptp0 on Linux. Empty to release the tasks from when the runtime started. See
+     * clocksync.h.
+     */
+    std::string clockSync;
+    /**
+     * The offset of the aligned releases from the multiples of their task's interval, in microseconds
+     * (--clock-phase <us>).
+     */
+    uint64_t clockPhase = 0;
+    /**
+     * The period at which IO is supervised, in milliseconds (--io-interval <ms>).
+     */
+    uint64_t ioInterval = 1;
+    /**
+     * Enables the real-time profile (--realtime). This is only supported on Linux.
+     */
+    bool realtime = false;
+    /**
+     * The core the scan thread is pinned to in the real-time profile, or -1 to not pin it (--scan-cpu <n>).
+     */
+    int scanCpu = -1;
+    /**
+     * The SCHED_FIFO priority of the scan thread in the real-time profile (--rt-priority <n>).
+     */
+    int rtPriority = 80;
+    /**
+     * The amount of heap to prefault and keep in the process in the real-time profile, in KB (--prefault-heap <kb>).
+     */
+    size_t prefaultHeap = 8192;
+    /**
+     * The amount of stack to prefault in the real-time profile, in KB (--prefault-stack <kb>).
+     */
+    size_t prefaultStack = 256;
+    /**
+     * The period at which statistics are written to stdout, in seconds, or 0 to not write them (--stats-interval <s>).
+     */
+    uint64_t statsInterval = 0;
+    /**
+     * Polls the IO clients on the scan thread instead of on their own threads (--sync-io).
+     */
+    bool syncIO = false;
+    /**
+     * The number of IO reactor threads that the IO clients are spread over, or 0 to give every client its own
+     * thread (--io-threads <n>).
+     */
+    int ioThreads = 1;
+    /**
+     * The IO reactor backend, such as "uring" for io_uring on Linux, or empty for the platform default
+     * (--io-backend <name>).
+     */
+    std::string ioBackend;
+    /**
+     * A binary IO configuration whose maps are used in place of those the program was compiled with, or empty to use
+     * those (--io-config <file>). It is written beside the program as <executable>.iomap, or by `nodalis iomap`.
+     */
+    std::string ioConfig;
+    /**
+     * The file the requests of the IO clients and their responses are captured to, or empty to not capture them
+     * (--io-capture <file>). See iocapture.h.
+     */
+    std::string ioCapture;
+    /**
+     * A capture whose responses are served, with their recorded timing, by clients that stand in for those of the
+     * mappings, or empty to exchange the IO with the devices (--io-replay <file>). See iocapture.h.
+     */
+    std::string ioReplay;
+    /**
+     * The directory that the drivers of protocols the runtime doesn't have are loaded from (--io-drivers <dir>). It is
+     * the drivers directory beside the executable unless it is given. See nodalisdriver.h.
+     */
+    std::string ioDrivers;
+    /**
+     * The TCP port the Modbus server listens on, or 0 to not run it (--modbus-server <port>).
+     */
+    int modbusServerPort = 0;
+    /**
+     * The most Modbus server clients that may be connected at once (--modbus-clients <n>).
+     */
+    int modbusServerClients = 32;
+    /**
+     * The TCP port the metrics server serves Prometheus scrapes on, or 0 to not run it (--metrics-port <port>).
+     */
+    int metricsPort = 0;
+    /**
+     * The TCP port the watch server streams watch lists to engineering tools and HMIs on, over TCP or WebSocket, or 0
+     * to not run it (--watch-port <port>).
+     */
+    int watchPort = 0;
+    /**
+     * The shortest interval between the frames the watch server sends a client, in milliseconds
+     * (--watch-interval <ms>).
+     */
+    uint64_t watchInterval = 50;
+    /**
+     * The file that BACnet device bindings are kept in between runs, or empty to not keep them
+     * (--bacnet-bindings <file>).
+     */
+    std::string bacnetBindings;
+    /**
+     * The device instance the BACnet server publishes the process image as, or -1 to not run it
+     * (--bacnet-server <instance>).
+     */
+    int64_t bacnetServerInstance = -1;
+    /**
+     * The object name of the BACnet server's device, or empty for a name made from its instance
+     * (--bacnet-name <name>).
+     */
+    std::string bacnetServerName;
+    /**
+     * The UDP port the BACnet datalink listens on when the BACnet server runs (--bacnet-port <port>).
+     */
+    int bacnetServerPort = 47808;
+    /**
+     * The period at which the OPC UA server's variables are updated with the values that changed in the published
+     * image, in milliseconds, or 0 to read the image whenever a variable is sampled (--opcua-update <ms>).
+     */
+    uint64_t opcuaUpdate = 0;
+    /**
+     * The file that configures the datasets the OPC UA PubSub publisher sends, or empty to not publish
+     * (--opcua-pubsub <file>).
+     */
+    std::string opcuaPubSub;
+    /**
+     * Runs the OPC UA server in the slack the scheduler has between cycles, on the scan thread, rather than on a
+     * thread of its own (--opcua-cooperative). On a single core, the server then never preempts the tasks.
+     */
+    bool opcuaCooperative = false;
+    /**
+     * The least time before the next task release, in microseconds, in which the cooperative OPC UA server runs an
+     * iteration (--opcua-slack <us>). It should be longer than an iteration takes, as the OPCUA.Iterate statistics show.
+     */
+    uint64_t opcuaSlack = 1000;
+    /**
+     * The file that retentive memory is kept in, which defaults to the executable's path with .retain appended
+     * (--retain-file <file>). It is only used if the program has RETAIN variables.
+     */
+    std::string retainFile;
+    /**
+     * The number of scans between saves of retentive memory (--retain-flush <scans>). A save is skipped when the
+     * retained bytes haven't changed, and postponed while the previous one is still being written.
+     */
+    uint64_t retainFlush = 10;
+    /**
+     * The name of the shared memory segment the published image is copied to after every scan, or empty to not
+     * share it (--shm-image <name>). Readers on the same host map it with the SharedImageReader in sharedimage.h.
+     */
+    std::string shmImage;
+    /**
+     * Stops the runtime once it has run for this many milliseconds, or 0 to run until it is stopped (--run-for <ms>).
+     * A build made to train profile guided optimization writes its profile when it stops.
+     */
+    uint64_t runFor = 0;
+    /**
+     * Runs the tasks for this many scans back to back, with IO, the servers and retentive memory left stopped, and
+     * writes how long the scans, tasks and programs took, or 0 to run normally (--bench <scans>).
+     */
+    uint64_t benchScans = 0;
+    /**
+     * The file the benchmark results are written to as JSON, which defaults to the executable's path with
+     * .bench.json appended (--bench-out <file>).
+     */
+    std::string benchOut;
+    /**
+     * Runs the tasks against a virtual clock rather than the steady clock (--simulate). elapsed(), the timers and the
+     * task releases all read the virtual clock, which jumps from one release to the next, so the scans run back to
+     * back without sleeping and a run takes the same course every time. IO isn't polled, and the servers, retentive
+     * memory and snapshots are left stopped. The run stops after runFor milliseconds of virtual time, or with the
+     * last input of simulateInput.
+     */
+    bool simulate = false;
+    /**
+     * The inputs of a simulated run, which implies simulate (--sim-input <file>). It is either a signal recording made
+     * with --record, whose %I channels are replayed at the times they were recorded, or a script with a line for each
+     * write of the time in milliseconds, the address and the value, like "250 %IX0.1 1" or "1000 %MD4 21.5".
+     */
+    std::string simulateInput;
+    /**
+     * The file the trace is written to, which defaults to the executable's path with .trace.json appended
+     * (--trace-out <file>). The trace is written on SIGUSR1 and when a run limited with --run-for ends. It is only
+     * recorded in builds with NODALIS_TRACE.
+     */
+    std::string traceOut;
+    /**
+     * Also writes the trace when a task overruns its deadline (--trace-overrun).
+     */
+    bool traceOverrun = false;
+    /**
+     * What to do about an allocation made during a scan after the first scan, in a build with NODALIS_ALLOC_TRACK
+     * (--alloc-strict <log|abort>): "log" writes a stack trace of it, "abort" also aborts the process, and empty,
+     * the default, only counts it.
+     */
+    std::string allocStrict;
+    /**
+     * What to do about an allocation from the heap once the arena is sealed, in a build with NODALIS_ARENA_BYTES
+     * (--arena-strict <log|abort>): "log" writes its size, "abort" also aborts the process, and empty, the default,
+     * only counts it.
+     */
+    std::string arenaStrict;
+    /**
+     * The least severe diagnostics that are logged (--log-level <debug|info|warning|error>).
+     */
+    std::string logLevel = "info";
+    /**
+     * A file the diagnostics are appended to, with their time, severity and source, as well as written to stdout
+     * (--log-file <file>).
+     */
+    std::string logFile;
+    /**
+     * Also sends the diagnostics to syslog, on POSIX systems (--log-syslog).
+     */
+    bool logSyslog = false;
+    /**
+     * Polls every input adaptively (--adaptive-poll): an input whose value doesn't change is polled less often, up
+     * to 8 times its PollTime, and one that changes is polled more often again, down to its PollTime. Inputs that
+     * set MinPollTime or MaxPollTime adapt without it.
+     */
+    bool adaptivePoll = false;
+    /**
+     * The requests per second each IO client should stay under (--poll-budget <n>). Above it, adaptive polling
+     * only lengthens intervals. 0, the default, sets no budget.
+     */
+    int pollBudget = 0;
+    /**
+     * The requests per second each device of an IO client may take (--io-request-rate <n>), for the devices whose
+     * mappings don't set RequestRate. 0, the default, sets no limit.
+     */
+    double ioRequestRate = 0;
+    /**
+     * The bytes per second each device of an IO client may take (--io-byte-rate <n>), for the devices whose mappings
+     * don't set ByteRate. 0, the default, sets no limit.
+     */
+    double ioByteRate = 0;
+    /**
+     * The most mappings an IO client sends in one poll, besides its Critical ones (--io-batch-limit <n>). The rest
+     * are sent in the polls that follow, fairly between the devices. 0, the default, sets no limit.
+     */
+    int ioBatchLimit = 0;
+    /**
+     * Polls the mappings tied to a cyclic task in step with it (--io-phase): an input is read so that it arrives just
+     * before the task's release, and an output is written as soon as the task completes. Mappings that aren't tied to
+     * a task keep their PollTime.
+     */
+    bool ioPhase = false;
+    /**
+     * The milliseconds an input tied to a task is read before the release, on top of the recent round trip time of
+     * its device (--io-phase-margin <ms>).
+     */
+    int ioPhaseMargin = 1;
+    /**
+     * The program libraries the host of a program compiled with onlineChange loads, which default to the executable's
+     * path with .program.so, or .program.dylib on macOS, appended (--program <file>, once for each library). A new
+     * build of a file is swapped in while the host runs. Each library is a resource, and several resources built
+     * together with compileHost() share the host's scheduler, IO and OPC UA server, each in its own window of the
+     * process image.
+     */
+    std::vector<std::string> programFiles;
+    /**
+     * The file the warm restart snapshot of a program compiled with warmRestart is kept in, which defaults to the
+     * executable's path with .snapshot appended (--snapshot <file>).
+     */
+    std::string snapshotFile;
+    /**
+     * The milliseconds between snapshots while the program runs (--snapshot-interval <ms>). With 0, the default, a
+     * snapshot is only taken when the runtime is stopped with SIGTERM or SIGINT, or a --run-for run ends.
+     */
+    uint64_t snapshotInterval = 0;
+    /**
+     * Starts without restoring the snapshot (--cold-start). Snapshots are still taken.
+     */
+    bool coldStart = false;
+    /**
+     * The role of the controller in a redundant pair (--redundancy <primary|standby>), or empty to run alone. See
+     * redundancy.h.
+     */
+    std::string redundancy;
+    /**
+     * The address of the redundancy link (--redundancy-link <ip:port>): the standby's address, which the primary
+     * connects to, or, for the standby, the address it listens on, where an empty IP is any address.
+     */
+    std::string redundancyLink;
+    /**
+     * The milliseconds without a frame from the primary after which the standby takes over, which is also how long
+     * the primary waits for a frame to be acknowledged (--redundancy-timeout <ms>). The primary sends a heartbeat
+     * when it has sent nothing for a fifth of it.
+     */
+    uint64_t redundancyTimeout = 500;
+    /**
+     * The addresses the signal recorder samples after every scan, separated by commas, as in %IW0,%QX0.1, or empty
+     * to not record (--record <addresses>). See recorder.h.
+     */
+    std::string record;
+    /**
+     * The condition the recording starts at, as an address, a comparison (>, >=, <, <=, = or <>) and an integer,
+     * as in %MW2>100, or empty to start right away (--record-trigger <condition>). It fires on the first scan where
+     * the condition becomes true.
+     */
+    std::string recordTrigger;
+    /**
+     * The number of samples before the trigger that the recording starts with (--record-pretrigger <samples>).
+     */
+    uint64_t recordPretrigger = 0;
+    /**
+     * The number of samples the recording ends after, or 0 to record until the runtime stops
+     * (--record-samples <samples>).
+     */
+    uint64_t recordSamples = 0;
+    /**
+     * The file the recording is written to, which defaults to the executable's path with .rec appended
+     * (--record-out <file>).
+     */
+    std::string recordOut;
+    /**
+     * The TCP port a client can connect to to receive the recording as it is made, or 0 for none
+     * (--record-port <port>).
+     */
+    int recordPort = 0;
+    /**
+     * The number of samples the ring between the scan and the recorder thread holds, rounded up to a power of two
+     * (--record-buffer <samples>). Samples taken while it is full are dropped and counted.
+     */
+    uint64_t recordBuffer = 65536;
+    /**
+     * The tags the historian keeps the history of, as located globals by name or addresses separated by commas, or
+     * empty for none (--history <tags>).
+     */
+    std::string history;
+    /**
+     * The directory the historian keeps its segments in, which defaults to the executable's path with .history
+     * appended (--history-dir <directory>).
+     */
+    std::string historyDir;
+    /**
+     * When the historian appends a tag: "change" when its value changed, or "scan" after every scan
+     * (--history-mode <mode>).
+     */
+    std::string historyMode = "change";
+    /**
+     * The size of a segment file, in bytes (--history-segment-bytes <bytes>).
+     */
+    uint64_t historySegmentBytes = 1048576;
+    /**
+     * The number of segments kept for each tag, after which the oldest is deleted (--history-segments <count>).
+     */
+    uint64_t historySegments = 64;
+    /**
+     * The number of values the ring between the scan and the historian thread holds, rounded up to a power of two
+     * (--history-buffer <values>).
+     */
+    uint64_t historyBuffer = 65536;
+    /**
+     * The alarms the runtime detects and latches, as located BOOLs by name or bit addresses separated by commas, or
+     * empty for none (--alarms <alarms>). See alarms.h.
+     */
+    std::string alarms;
+    /**
+     * The file alarm events are appended to, or empty to write them to the standard output (--alarm-log <file>).
+     */
+    std::string alarmLog;
+    /**
+     * The number of events the ring between the scan and the alarm thread holds, rounded up to a power of two
+     * (--alarm-buffer <events>). Events that happen while it is full are dropped and counted.
+     */
+    uint64_t alarmBuffer = 4096;
+    /**
+     * The MQTT broker the Sparkplug B publisher connects to, as host[:port], or empty to not publish (--mqtt <broker>).
+     * See sparkplug.h.
+     */
+    std::string mqtt;
+    /**
+     * The tags that are published, as located globals by name or addresses separated by commas (--mqtt-tags <tags>).
+     */
+    std::string mqttTags;
+    /**
+     * The shortest interval between the DDATA messages of the changed tags, in milliseconds (--mqtt-interval <ms>).
+     */
+    uint64_t mqttInterval = 1000;
+    /**
+     * The user name and password the publisher connects with, or empty for none (--mqtt-user <name>,
+     * --mqtt-password <password>).
+     */
+    std::string mqttUser;
+    std::string mqttPassword;
+    /**
+     * The keep alive interval of the connection to the broker, in seconds (--mqtt-keepalive <s>).
+     */
+    int mqttKeepAlive = 30;
+    /**
+     * The number of batches that are kept while the broker can't be reached, after which the oldest is dropped
+     * (--mqtt-buffer <batches>).
+     */
+    uint64_t mqttBuffer = 3600;
+    /**
+     * The Sparkplug group of the edge node (--sparkplug-group <group>).
+     */
+    std::string sparkplugGroup = "Nodalis";
+    /**
+     * The Sparkplug edge node, which defaults to the name of the executable (--sparkplug-node <node>).
+     */
+    std::string sparkplugNode;
+    /**
+     * The Sparkplug device whose metrics the tags are (--sparkplug-device <device>).
+     */
+    std::string sparkplugDevice = "PLC";
+};
+
+/**
+ * Parses the runtime options from the command line. Unknown arguments are ignored.
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ * @returns Returns the parsed options.
+ */
+RuntimeOptions parseRuntimeOptions(int argc, char* argv[]);
+
+/**
+ * Applies the real-time profile to the process and the calling thread, which becomes the scan thread.
+ * The profile locks all memory, prefaults the stack and heap, pins the scan thread to its core and sets a real-time
+ * scheduling policy for it. Does nothing if the profile is not enabled.
+ * This should be called at the start of main, before any other threads are started.
+ * @param options The runtime options.
+ */
+void applyRuntimeProfile(const RuntimeOptions& options);
+
+/**
+ * Starts recording trace events in a build with NODALIS_TRACE, and the thread that writes them to options.traceOut
+ * when they are asked for. Does nothing in other builds, or in benchmark mode.
+ * @param options The runtime options.
+ */
+void startTracing(const RuntimeOptions& options);
+
+/**
+ * Sets the level of the diagnostics that are logged and where they are written, from options.logLevel,
+ * options.logFile and options.logSyslog. Called by applyRuntimeProfile().
+ * @param options The runtime options.
+ */
+void configureLogging(const RuntimeOptions& options);
+/**
+ * Sets whether inputs are polled adaptively and the poll budget of the IO clients, from options.adaptivePoll and
+ * options.pollBudget, whether mappings are polled in step with their tasks, from options.ioPhase and
+ * options.ioPhaseMargin, and the default request scheduling of the devices, from options.ioRequestRate,
+ * options.ioByteRate and options.ioBatchLimit. Called by applyRuntimeProfile(), before the IO is mapped.
+ * @param options The runtime options.
+ */
+void configureAdaptivePolling(const RuntimeOptions& options);
+/**
+ * Sets whether the rungs of programs compiled with the incremental option are skipped when nothing they use changed,
+ * from options.incremental, and how often every rung is evaluated anyway, from options.incrementalFull. Rungs are
+ * always evaluated with threaded tasks. Called by TaskScheduler::run() before the tasks start.
+ * @param options The runtime options.
+ */
+void configureIncremental(const RuntimeOptions& options);
+
+/**
+ * Sets how allocations made during a scan are reported after startup, from options.allocStrict, in a build with
+ * NODALIS_ALLOC_TRACK, and how allocations from the heap are after the arena is sealed, from options.arenaStrict, in
+ * a build with NODALIS_ARENA_BYTES. Does nothing in other builds.
+ * @param options The runtime options.
+ */
+void configureAllocationTracking(const RuntimeOptions& options);
+
+/**
+ * Moves the calling thread off the scan core and back to normal scheduling when the real-time profile is active.
+ * Background threads, like the OPC UA server and IO threads, call this when they start.
+ */
+void moveToBackground();
+
+/**
+ * The time spent in one program instance of a task, as measured in benchmark mode. The benchmark runs every task on
+ * the scan thread, so the counters are not atomic.
+ */
+struct ProgramProfile {
+    /**
+     * The name of the program instance.
+     */
+    const char* name;
+    /**
+     * The number of times the program was called.
+     */
+    uint64_t calls = 0;
+    /**
+     * The total time spent in the program, in nanoseconds.
+     */
+    uint64_t nanos = 0;
+    /**
+     * The longest call of the program, in nanoseconds.
+     */
+    uint64_t maxNanos = 0;
+};
+
+/**
+ * Whether runProgram() times the programs it calls. Benchmark mode turns it on.
+ */
+inline bool PROFILE_PROGRAMS = false;
+
+/**
+ * Registers the profiles of the program instances, which the compiler generates a table of, so that benchmark mode
+ * reports the time spent in each.
+ * @param profiles The profiles, one per program instance.
+ * @param count The number of profiles.
+ */
+void registerProgramProfiles(ProgramProfile* profiles, size_t count);
+
+/**
+ * Calls a program of a task. When programs are profiled, the time of the call is added to the program's profile.
+ * @param profile The profile of the program instance.
+ * @param program The program.
+ */
+template<typename Program>
+inline void runProgram(ProgramProfile& profile, Program&& program){
+    NODALIS_TRACE_SCOPE(TraceCategory::Program, profile.name);
+    if(!PROFILE_PROGRAMS){
+        program();
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    program();
+    uint64_t nanos = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    profile.calls++;
+    profile.nanos += nanos;
+    if(nanos > profile.maxNanos){
+        profile.maxNanos = nanos;
+    }
+}
+
+/**
+ * Runs the lanes of a stage of a task, each a program instance, and returns when all of them have finished. The
+ * compiler only puts instances in one stage when none of them writes what another reads or writes, so the stage ends
+ * as if they ran one after another. Lane 0 runs on the calling thread, and each other lane always on the same thread of
+ * the program pool, so the timers of an instance stay on one timer wheel. Without a pool, and with --threaded-tasks,
+ * where the tasks already have threads of their own, the lanes run in order on the calling thread.
+ * @param lanes The lanes.
+ */
+void runParallel(std::initializer_list<void (*)()> lanes);
+/**
+ * Starts the threads runParallel() runs lanes on (--parallel-programs <n>). On Linux, they are pinned to the cores
+ * after the scan thread's. Does nothing if options.parallelPrograms is 0.
+ * @param options The runtime options.
+ */
+void startProgramPool(const RuntimeOptions& options);
+
+/**
+ * The watchdog of a task. A release stores when it started in it, and the watchdog thread of the scheduler negates
+ * it once the release has run past the budget, so the release can tell from one load that it overran.
+ */
+struct TaskWatchdog {
+    /**
+     * The longest a release may run.
+     */
+    std::chrono::microseconds budget;
+    /**
+     * When the running release started, in steady clock ticks, negated once it overran, or 0 between releases.
+     */
+    std::atomic<int64_t> started{0};
+};
+
+/**
+ * The start of a release that is never overrun, watched by the threads that aren't running a task with a watchdog.
+ */
+inline const std::atomic<int64_t> UNWATCHED_RELEASE{0};
+/**
+ * The start of the release the calling thread is running, from its task's TaskWatchdog.
+ */
+inline thread_local const std::atomic<int64_t>* RELEASE_WATCH = &UNWATCHED_RELEASE;
+
+/**
+ * Gets whether the release the calling thread is running has overrun its watchdog budget. Programs built with
+ * loopGuard check it in each iteration of their loops, and leave the loop once it is.
+ * @returns Returns true if the release overran.
+ */
+inline bool releaseExpired(){
+    return RELEASE_WATCH->load(std::memory_order_relaxed) < 0;
+}
+
+/**
+ * The trigger of an IEC event task. The scheduler reads the condition each time it latches the inputs, and releases
+ * the task on a rising edge. With --threaded-tasks, the worker of the task waits on the signal until it is released.
+ */
+struct TaskEvent {
+    /**
+     * Reads the BOOL that triggers the task.
+     */
+    std::function<bool()> condition;
+    /**
+     * The value of the condition when it was last read.
+     */
+    bool state = false;
+    /**
+     * Guards released and raisedAt, for the worker of a threaded task.
+     */
+    std::mutex mutex;
+    /**
+     * Signals the worker of a threaded task that it was released.
+     */
+    std::condition_variable signal;
+    /**
+     * Whether the task was released and has not run since. Edges while it is pending are merged into one release.
+     */
+    bool released = false;
+    /**
+     * When the rising edge was seen, which the lateness of the release is measured from.
+     */
+    std::chrono::steady_clock::time_point raisedAt;
+};
+
+/**
+ * A cyclic IEC task. A task is released at absolute times spaced by its interval, so its period does not
+ * stretch with the time spent in the scan or on IO. An event task has a trigger instead, and is only released by it.
+ */
+struct CyclicTask {
+    /**
+     * The name of the task.
+     */
+    std::string name;
+    /**
+     * The period of the task.
+     */
+    std::chrono::milliseconds interval;
+    /**
+     * The IEC priority of the task. 0 is the highest priority.
+     */
+    int priority = 0;
+    /**
+     * Runs the programs associated with the task.
+     */
+    std::function<void()> body;
+    /**
+     * The next time at which the task is due.
+     */
+    std::chrono::steady_clock::time_point nextRelease;
+    /**
+     * The execution time of each release. Overruns count the releases that did not complete before the
+     * following release was due.
+     */
+    ExecutionStats* execution = nullptr;
+    /**
+     * How late each release started after it was due.
+     */
+    ExecutionStats* lateness = nullptr;
+    /**
+     * The trigger of an event task, or null for a cyclic task.
+     */
+    std::shared_ptr<TaskEvent> event;
+    /**
+     * The watchdog of the task, or null if its releases may run for as long as they take.
+     */
+    std::shared_ptr<TaskWatchdog> watchdog;
+    /**
+     * The schedule the task publishes for the IO clients with --io-phase, or null.
+     */
+    TaskPhase* phase = nullptr;
+};
+
+/**
+ * Whether a task release is run inside a try/catch that reports and survives an exception. Located addresses in
+ * generated code are validated when the program is compiled, so a program that doesn't throw itself can be built
+ * with NODALIS_SCAN_EXCEPTIONS 0 to keep exception handling out of the scan entirely. An exception from a task then
+ * terminates the runtime. It defaults to 0 when the runtime is built without exceptions.
+ */
+#ifndef NODALIS_SCAN_EXCEPTIONS
+#define NODALIS_SCAN_EXCEPTIONS NODALIS_EXCEPTIONS
+#endif
+
+/**
+ * Opens the retain file and restores retentive memory from its last complete save. From then on,
+ * commitOutputs() saves the retentive bytes every options.retainFlush scans, on a background thread.
+ * The file holds two copies with a generation and a checksum each, written in turn, so a save that is cut short by
+ * a crash leaves the other intact. Restoring copies the bytes straight into MEMORY. Does nothing if the program has
+ * no retentive memory.
+ * @param options The runtime options.
+ * @returns Returns true if retentive memory is kept.
+ */
+bool openRetentiveMemory(const RuntimeOptions& options);
+
+/**
+ * Counters of the saves of retentive memory. They are atomic, so they are sampled from any thread.
+ */
+struct RetainCounters {
+    /**
+     * The number of saves handed to the retain writer.
+     */
+    std::atomic<uint64_t> saves{0};
+    /**
+     * The number of due saves that were skipped because the retained bytes hadn't changed.
+     */
+    std::atomic<uint64_t> unchanged{0};
+    /**
+     * The number of scans a due save was put off by, because the writer was still writing the previous one.
+     */
+    std::atomic<uint64_t> postponed{0};
+    /**
+     * The time the writer took to write and flush each save, or nullptr until the retain file is opened.
+     */
+    std::atomic<ExecutionStats*> flushes{nullptr};
+};
+
+/**
+ * Gets the counters of the saves of retentive memory.
+ */
+const RetainCounters& getRetainCounters();
+
+/**
+ * A variable of a program instance or a global, which a warm restart or an online change carries over. The compiler
+ * generates a table of them with the stateTable option (see stateTable in gcctranspiler.js).
+ */
+struct StateVariable {
+    const char* name;       // The name the variable is matched by: PROGRAM.VARIABLE, or the name of a global.
+    const char* layout;     // The C++ type of the variable, with the layout of each user type in it.
+    void* address;          // The variable, or with a mask, the word its bit is packed into.
+    size_t size;            // The size of the variable.
+    uint64_t mask;          // The bit of a BOOL packed with packBools, or 0.
+    void (*copy)(void* to, const void* from);   // Assigns a variable of the same layout, or nullptr for a packed BOOL.
+};
+
+/**
+ * Assigns one variable to another of the same layout. The source may be the bytes of a variable that a snapshot
+ * saved, so it is only read through the type's assignment, which leaves out what can't be carried over, such as the
+ * links of a TimerNode.
+ * @param to The variable to assign.
+ * @param from The variable to assign from.
+ */
+template<typename T>
+void copyState(void* to, const void* from){
+    *static_cast<T*>(to) = *static_cast<const T*>(from);
+}
+
+/**
+ * The function that returns a table of state variables and its number of rows.
+ */
+typedef const StateVariable* (*StateTable)(size_t* count);
+
+/**
+ * Appends a table of state variables to another.
+ * @param state The table to append to.
+ * @param table The function that returns the table to append.
+ */
+inline void appendState(std::vector<StateVariable>& state, StateTable table){
+    size_t count = 0;
+    const StateVariable* rows = table(&count);
+    state.insert(state.end(), rows, rows + count);
+}
+
+/**
+ * Hashes the layout of the process image and of the registered state table: the name, layout and size of each
+ * variable. Two builds with the same hash have the same state table, row for row.
+ * @returns Returns the hash.
+ */
+uint64_t stateLayout();
+/**
+ * Registers the table of the variables a warm restart snapshot holds along with the process image. Generated code
+ * calls this before the scheduler is constructed, and the host of an online change again for each version it loads.
+ * @param table The function that returns the table.
+ */
+void registerStateTable(StateTable table);
+/**
+ * Gets the table registered with registerStateTable().
+ * @returns Returns the table, or nullptr if the program has none.
+ */
+StateTable registeredStateTable();
+/**
+ * Opens the warm restart snapshot of a program with a state table. Unless options.coldStart is set, a snapshot that
+ * is complete is restored: the process image, then each state variable, and the runtime's clock resumes from the
+ * time of the snapshot. Timers that had expired stay expired, and those that were running start their preset time
+ * again. From then on, a snapshot is taken between scans
+ * every options.snapshotInterval milliseconds and written by a background thread, and when the runtime is stopped.
+ * Called by the TaskScheduler constructor. Threaded tasks have no point between scans at which the state is
+ * consistent, so they don't take snapshots.
+ * @param options The runtime options.
+ * @returns Returns true if a snapshot was restored.
+ */
+bool openSnapshot(const RuntimeOptions& options);
+
+/**
+ * A located variable of the program, from the symbol table the compiler generates.
+ */
+struct ImageSymbol {
+    const char* name;       // The name of the variable.
+    const char* address;    // The located address of the variable, validated when the program was compiled.
+};
+
+/**
+ * Registers the program's located variables, which are published as the layout descriptor of the shared image.
+ * The table must outlive the runtime. Generated code calls this before the scheduler is constructed.
+ * @param symbols The symbol table.
+ * @param count The number of rows in the table.
+ */
+void registerImageSymbols(const ImageSymbol* symbols, size_t count);
+/**
+ * Gets the symbol table registered with registerImageSymbols().
+ * @param count Receives the number of rows in the table.
+ * @returns Returns the table, or nullptr if none was registered.
+ */
+const ImageSymbol* registeredImageSymbols(size_t& count);
+/**
+ * Registers the program's symbol index, the perfect hash table of its located variables the compiler embeds in the
+ * program and writes beside it as <executable>.symbols, laid out as in symbolindex.h. An index computed for another
+ * size of the image is ignored. The bytes must outlive the runtime. Generated code calls this before the scheduler is
+ * constructed.
+ * @param index The index.
+ * @param bytes The size of the index.
+ */
+void registerSymbolIndex(const uint8_t* index, size_t bytes);
+/**
+ * Finds the address of a located variable by name, through the symbol index, or the symbol table if the program
+ * has no index.
+ * @param name The name of the variable.
+ * @returns Returns the address, such as %QW0, or nullptr if the program has no such located variable.
+ */
+const char* findSymbolAddress(const std::string& name);
+/**
+ * Finds the declared type of a located variable by name, through the symbol index.
+ * @param name The name of the variable.
+ * @returns Returns the type, such as INT, or nullptr if the program has no index or no such located variable.
+ */
+const char* findSymbolType(const std::string& name);
+
+/**
+ * Applies the runtime options to the OPC UA server of the runtime. This must be called before any variable is mapped.
+ * @param options The runtime options.
+ */
+void configureOPCUAServer(const RuntimeOptions& options);
+/**
+ * Serves the program's located variables from the OPC UA server, building its address space in a single pass. The
+ * table must outlive the server. This must be called before the server is started.
+ * @param symbols The symbol table.
+ * @param count The number of rows in the table.
+ */
+void mapOPCUAVariables(const ImageSymbol* symbols, size_t count);
+/**
+ * Serves the variables mapped from then on in a namespace of their own, urn:nodalis:resource:<name>, under a folder
+ * named after the resource, so the resources of a host can have variables of the same name. This must be called
+ * before the server is started.
+ * @param resource The name of the resource.
+ */
+void useOPCUAResource(const char* resource);
+/**
+ * Exposes the statistics and the diagnostics of the runtime from the OPC UA server and starts it. This must be called
+ * once the IO has been mapped and the tasks added.
+ */
+void startOPCUAServer();
+
+/**
+ * Creates the shared memory segment named by options.shmImage, a named POSIX shared memory object or a named file
+ * mapping on Windows, and writes its layout descriptor: the offsets and sizes of %I, %Q and %M and a table of the
+ * registered symbols. From then on, commitOutputs() copies the lines of the image that changed into the segment
+ * under a seqlock, so readers in other processes read consistent snapshots in place. Does nothing if no name is set.
+ * @param options The runtime options.
+ * @returns Returns true if the image is shared.
+ */
+bool openSharedImage(const RuntimeOptions& options);
+
+/**
+ * Wakes the scheduler, so that writes staged with writeImage() are latched and published without waiting for the next
+ * task release. writeImage() calls this itself. This is safe to call from any thread.
+ */
+void wakeScheduler();
+/**
+ * Sets work the scheduler runs on its own thread in the slack between cycles, such as the cooperative OPC UA server,
+ * instead of on a thread that competes with the tasks. The work runs only while the next task release is at least the
+ * budget away, so it never delays a release, and the scheduler returns to the tasks as soon as it is woken. Setting
+ * another work, or none, waits for a step that is running to finish.
+ * @param work Runs one step of the work, which should take less than the budget, and returns the milliseconds until
+ * it should run again, or nullptr for none.
+ * @param budget The least slack, in microseconds, that a step is started in.
+ */
+void setSlackWork(std::function<uint64_t()> work, uint64_t budget);
+
+/**
+ * The longest the scheduler sleeps when nothing else is due.
+ */
+constexpr std::chrono::seconds IDLE_WAKE(1);
+
+/**
+ * Runs cyclic tasks on their deadlines. Each cycle supervises IO, and when any task is due, latches the inputs,
+ * runs every due task in order of priority, and commits the outputs. Between cycles, the scheduler blocks until the
+ * next task release, the next IO supervision if IO is polled on the scan thread, or the next statistics dump,
+ * whichever comes first. It doesn't tick in between. A staged write, from an IO completion or a server, wakes it at
+ * once to latch and publish the write.
+ *
+ * With threaded tasks, each task instead runs on its own worker thread, so a high priority task can preempt a long
+ * running one. Each worker runs against a private copy of the image: MEMORY is copied in when the task is released,
+ * and the bits the task changed are merged back when it completes. A task therefore never sees a torn value from
+ * another task, and sees the other tasks' results as of its own release. The calling thread keeps supervising IO.
+ * Variables that are not located in memory are not covered by this and should not be shared between tasks.
+ */
+class TaskScheduler {
+public:
+    /**
+     * Constructs a new scheduler.
+     * @param options The runtime options.
+     */
+    TaskScheduler(const RuntimeOptions& options = RuntimeOptions());
+    /**
+     * Adds a task to the scheduler. Tasks of equal priority run in the order they were added.
+     * @param name The name of the task.
+     * @param interval The period of the task, in milliseconds.
+     * @param priority The IEC priority of the task, 0 being the highest.
+     * @param body The function that runs the programs of the task.
+     * @param budget The longest a release may run, in milliseconds, or 0 for options.watchdog.
+     */
+    void addTask(const std::string& name, uint64_t interval, int priority, std::function<void()> body, uint64_t budget = 0);
+    /**
+     * Adds an IEC event task, which is released on each rising edge of a BOOL rather than periodically. The condition is
+     * read whenever the inputs are latched, and writes from the IO layer wake the scheduler to latch them at once, so
+     * the task runs right after the IO writes its trigger. Tasks of equal priority run in the order they were added.
+     * @param name The name of the task.
+     * @param priority The IEC priority of the task, 0 being the highest.
+     * @param condition Reads the BOOL that triggers the task.
+     * @param body The function that runs the programs of the task.
+     * @param budget The longest a release may run, in milliseconds, or 0 for options.watchdog.
+     */
+    void addEventTask(const std::string& name, int priority, std::function<bool()> condition, std::function<void()> body,
+                      uint64_t budget = 0);
+    /**
+     * Runs a single cycle of the scheduler without sleeping.
+     * @returns Returns the time at which the next cycle is due.
+     */
+    std::chrono::steady_clock::time_point runCycle();
+    /**
+     * Runs the scheduler forever.
+     */
+    void run();
+    /**
+     * Runs each task on its own worker thread and supervises IO on the calling thread, forever.
+     */
+    void runThreaded();
+    /**
+     * Runs every task in each of options.benchScans scans, back to back and on the calling thread, without
+     * supervising IO. Then writes the scan rate, the distribution of scan times and the time spent in each task and
+     * program to options.benchOut, and ends the process.
+     */
+    [[noreturn]] void runBenchmark();
+    /**
+     * Runs the tasks against the virtual clock of options.simulate on the calling thread, advancing it to the next
+     * task release or simulated input and scanning right away, without supervising IO. Then ends the process.
+     */
+    [[noreturn]] void runSimulation();
+    /**
+     * Gets the tasks managed by this scheduler.
+     * @returns Returns the tasks, in order of priority.
+     */
+    const std::vector<CyclicTask>& getTasks() const;
+    /**
+     * Sets a function the scheduler calls on its own thread after each cycle, between task releases. The host of an
+     * online change swaps in new versions of the program from it.
+     * @param hook The function to call.
+     */
+    void setCycleHook(std::function<void()> hook);
+private:
+    std::vector<CyclicTask> tasks;
+    bool hasEvents = false;
+    std::function<void()> cycleHook;
+    RuntimeOptions options;
+    std::chrono::milliseconds ioInterval;
+    std::chrono::steady_clock::time_point nextIO;
+    std::chrono::steady_clock::time_point nextStatsDump;
+    ExecutionStats& scanStats;
+    ExecutionStats& ioStats;
+
+    /**
+     * Supervises IO, recording its statistics, and writes the statistics to stdout when they are due.
+     */
+    void superviseAndReport();
+
+    /**
+     * Inserts a task after the tasks of higher or equal priority.
+     * @param task The task.
+     * @param budget The watchdog budget of the task, in milliseconds, or 0 for options.watchdog.
+     */
+    void insertTask(CyclicTask task, uint64_t budget);
+    /**
+     * Starts the thread that watches the releases of the tasks with a watchdog, and applies options.overrunPolicy
+     * to those that run past their budget. Does nothing if no task has one.
+     */
+    void startWatchdog();
+    /**
+     * Runs a released task and moves its release time forward, counting any deadlines it missed.
+     * @param task The task to run.
+     */
+    void runRelease(CyclicTask& task);
+    /**
+     * Reads the triggers of the event tasks, and releases those that had a rising edge. MEMORY must have just been
+     * latched.
+     * @param now The time of the cycle.
+     * @returns Returns true if a task was released.
+     */
+    bool raiseEvents(std::chrono::steady_clock::time_point now);
+    /**
+     * Wakes the IO clients to write the outputs of the tasks that completed a release, once commitOutputs() has
+     * published them. Does nothing without --io-phase.
+     */
+    void flushTaskOutputs();
+    /**
+     * The loop of a task worker thread.
+     * @param task The task the worker runs.
+     */
+    void runWorker(CyclicTask& task);
+};
+#pragma endregion
+
+#pragma region "Standard Function Blocks"
+
+/**
+ * Forces a call to be inlined. The standard timers, triggers, gates and selectors are evaluated in every scan of every
+ * POU that uses them, and inlining them lets the C++ compiler keep their pins in registers between the assignments of
+ * a call and the call itself. User function blocks with small bodies are compiled with it too.
+ */
+#if defined(_MSC_VER)
+#define NODALIS_ALWAYS_INLINE __forceinline
+#elif defined(__GNUC__) || defined(__clang__)
+#define NODALIS_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define NODALIS_ALWAYS_INLINE inline
+#endif
+
+// The timers are templates on the type of PT and ET and on their unit, in nanoseconds: TP, TON and TOF take TIME in
+// milliseconds, and TP_LTIME, TON_LTIME and TOF_LTIME take LTIME in nanoseconds, so a duration literal folded by the
+// transpiler is compared as it is. Both run on the timer wheel, which ticks every millisecond, so an LTIME timer
+// expires at the first tick at or after its time, and its ET counts from the microsecond its scan started.
+
+/**
+ * Gets the time the current scan started in the unit of a timer.
+ * @tparam Unit The nanoseconds in a unit of the timer.
+ */
+template<int64_t Unit>
+NODALIS_ALWAYS_INLINE uint64_t timerNow(){
+    return Unit == NANOS_PER_MS ? scanTime() : SCAN_MICROS * 1000 / Unit;
+}
+
+/**
+ * Gets the tick of the timer wheel by which a time in the unit of a timer has passed.
+ * @tparam Unit The nanoseconds in a unit of the timer.
+ * @param time The time.
+ * @returns Returns the tick, rounded up.
+ */
+template<int64_t Unit>
+constexpr uint64_t timerTick(uint64_t time){
+    return Unit == NANOS_PER_MS ? time : (time * Unit + NANOS_PER_MS - 1) / NANOS_PER_MS;
+}
+
+/**
+ * Gets the duration of a PT, taking a negative LTIME as 0.
+ */
+template<typename T>
+constexpr uint64_t timerDuration(T pt){
+    return pt > 0 ? static_cast<uint64_t>(pt) : 0;
+}
+
+template<typename T, int64_t Unit>
+class TPBlock{
+    public:
+        bool Q;
+        bool IN;
+        T PT;
+        T ET;
+    
+
+    NODALIS_ALWAYS_INLINE void operator()(){
+        Q = false;
+        if(!lastIN && IN){
+            lastIN = IN;
+            ET = 0;
+            timing = false;
+            timerWheel().cancel(timer);
+        }
+        if(IN){
+            Q = true;
+        }
+        else if(lastIN && !IN){
+            uint64_t now = timerNow<Unit>();
+            if(!timing || PT != armed || timer.idle()){
+                // The pulse lasts while ET has not passed PT, so it ends the unit after PT.
+                startTime = timing ? startTime : now;
+                timing = true;
+                armed = PT;
+                timerWheel().schedule(timer, timerTick<Unit>(startTime + timerDuration(PT) + 1));
+            }
+            ET = static_cast<T>(now - startTime);
+            if(!timer.expired){
+                Q = true;
+            }
+            else{
+                lastIN = false;
+            }
+        }
+    }
+    private:
+        bool lastIN = false;
+        bool timing = false;
+        uint64_t startTime = 0;
+        T armed = 0;
+        TimerNode timer;
+};
+
+// TON: On-delay timer
+template<typename T, int64_t Unit>
+class TONBlock {
+public:
+    bool IN;
+    T PT;
+    bool Q = false;
+    T ET = 0;
+
+    NODALIS_ALWAYS_INLINE void operator()() {
+        if (IN) {
+            uint64_t now = timerNow<Unit>();
+            if (!timing || PT != armed || timer.idle()) {
+                startTime = timing ? startTime : now;
+                timing = true;
+                armed = PT;
+                timerWheel().schedule(timer, timerTick<Unit>(startTime + timerDuration(PT)));
+            }
+            ET = static_cast<T>(now - startTime);
+            Q = timer.expired;
+        } else {
+            if (timing) {
+                timerWheel().cancel(timer);
+            }
+            timing = false;
+            ET = 0;
+            Q = false;
+        }
+    }
+
+private:
+    bool timing = false;
+    uint64_t startTime = 0;
+    T armed = 0;
+    TimerNode timer;
+};
+
+// TOF: Off-delay timer
+template<typename T, int64_t Unit>
+class TOFBlock {
+public:
+    bool IN;
+    T PT;
+    bool Q = false;
+    T ET = 0;
+
+    NODALIS_ALWAYS_INLINE void operator()() {
+        if (IN) {
+            Q = true;
+            if (timing) {
+                timerWheel().cancel(timer);
+            }
+            timing = false;
             ET = 0;
-            startTime = 0;
+        } else if (Q) {
+            uint64_t now = timerNow<Unit>();
+            if (!timing || PT != armed || timer.idle()) {
+                startTime = timing ? startTime : now;
+                timing = true;
+                armed = PT;
+                timerWheel().schedule(timer, timerTick<Unit>(startTime + timerDuration(PT)));
+            }
+            ET = static_cast<T>(now - startTime);
+            if (timer.expired) {
+                Q = false;
+            }
+        }
+    }
+
+private:
+    bool timing = false;
+    uint64_t startTime = 0;
+    T armed = 0;
+    TimerNode timer;
+};
+
+using TP = TPBlock<uint64_t, NANOS_PER_MS>;
+using TON = TONBlock<uint64_t, NANOS_PER_MS>;
+using TOF = TOFBlock<uint64_t, NANOS_PER_MS>;
+using TP_LTIME = TPBlock<IEC_LTIME, 1>;
+using TON_LTIME = TONBlock<IEC_LTIME, 1>;
+using TOF_LTIME = TOFBlock<IEC_LTIME, 1>;
+
+// Boolean Logic Gates
+#define BOOL_GATE(NAME, EXPR) \
+class NAME { \
+public: \
+    bool IN1 = false; \
+    bool IN2 = false; \
+    bool OUT = false; \
+    NODALIS_ALWAYS_INLINE void operator()() { OUT = (EXPR); } \
+};
+
+BOOL_GATE(AND, IN1 && IN2)
+BOOL_GATE(OR, IN1 || IN2)
+BOOL_GATE(XOR, IN1 != IN2)
+BOOL_GATE(NOR, !(IN1 || IN2))
+BOOL_GATE(NAND, !(IN1 && IN2))
+#undef BOOL_GATE
+
+class NOT {
+public:
+    bool IN = false;
+    bool OUT = false;
+    NODALIS_ALWAYS_INLINE void operator()() { OUT = !IN; }
+};
+
+class ASSIGNMENT {
+public:
+    bool IN = false;
+    bool OUT = false;
+    NODALIS_ALWAYS_INLINE void operator()() { OUT = IN; }
+};
+
+// Set/Reset flip-flops
+class SR {
+public:
+    bool S1 = false;
+    bool R = false;
+    bool Q1 = false;
+
+    NODALIS_ALWAYS_INLINE void operator()() {
+        if (R) Q1 = false;
+        if (S1) Q1 = true;
+    }
+};
+
+class RS {
+public:
+    bool S = false;
+    bool R1 = false;
+    bool Q1 = false;
+
+    NODALIS_ALWAYS_INLINE void operator()() {
+        if (S) Q1 = true;
+        if (R1) Q1 = false;
+    }
+};
+
+// Rising-edge Trigger
+class R_TRIG {
+public:
+    bool CLK = false;
+    bool OUT = false;
+
+    NODALIS_ALWAYS_INLINE void operator()() {
+        OUT = CLK && !lastCLK;
+        lastCLK = CLK;
+    }
+
+private:
+    bool lastCLK = false;
+};
+
+// Falling-edge Trigger
+class F_TRIG {
+public:
+    bool CLK = false;
+    bool OUT = false;
+
+    NODALIS_ALWAYS_INLINE void operator()() {
+        OUT = !CLK && lastCLK;
+        lastCLK = CLK;
+    }
+
+private:
+    bool lastCLK = false;
+};
+
+// Function block banks. An ARRAY OF TON, R_TRIG or F_TRIG is declared as a bank, which keeps each pin of its
+// instances in an array: BOOL pins as bit words, one bit per instance, and times as arrays of values. Calling the bank
+// evaluates every instance, a word of 64 instances at a time, so instances that are idle cost nothing. Indexing the
+// bank gives an element whose pins read and assign like those of a single block, with the bounds of the ST array.
+
+/**
+ * A BOOL pin of one instance in a bank.
+ */
+class BankBit {
+public:
+    BankBit(uint64_t& word, uint64_t mask) : word(word), mask(mask) {}
+    operator bool() const { return (word & mask) != 0; }
+    BankBit& operator=(bool value) {
+        word = value ? (word | mask) : (word & ~mask);
+        return *this;
+    }
+    BankBit& operator=(const BankBit& other) { return *this = static_cast<bool>(other); }
+
+private:
+    uint64_t& word;
+    uint64_t mask;
+};
+
+/**
+ * Calls a visitor with the index of every set bit of a word.
+ * @param word The word.
+ * @param base The index of the word's first bit.
+ * @param visitor Called with the index of each set bit.
+ */
+template<typename Visitor>
+inline void forEachBankBit(uint64_t word, size_t base, Visitor&& visitor) {
+    while (word != 0) {
+        visitor(base + static_cast<size_t>(countTrailingZeros(word)));
+        word &= word - 1;
+    }
+}
+
+// A bank of rising edge triggers.
+template<size_t N, int Low = 0>
+class R_TRIG_BANK {
+public:
+    static constexpr size_t WORDS = (N + 63) / 64;
+    struct Element { BankBit CLK; BankBit OUT; };
+
+    Element operator[](int index) {
+        size_t i = static_cast<size_t>(index - Low);
+        uint64_t mask = 1ull << (i % 64);
+        return Element{ BankBit(clk[i / 64], mask), BankBit(out[i / 64], mask) };
+    }
+
+    void operator()() {
+        for (size_t w = 0; w < WORDS; w++) {
+            out[w] = clk[w] & ~lastCLK[w];
+            lastCLK[w] = clk[w];
+        }
+    }
+
+private:
+    uint64_t clk[WORDS] = {};
+    uint64_t out[WORDS] = {};
+    uint64_t lastCLK[WORDS] = {};
+};
+
+// A bank of falling edge triggers.
+template<size_t N, int Low = 0>
+class F_TRIG_BANK {
+public:
+    static constexpr size_t WORDS = (N + 63) / 64;
+    struct Element { BankBit CLK; BankBit OUT; };
+
+    Element operator[](int index) {
+        size_t i = static_cast<size_t>(index - Low);
+        uint64_t mask = 1ull << (i % 64);
+        return Element{ BankBit(clk[i / 64], mask), BankBit(out[i / 64], mask) };
+    }
+
+    void operator()() {
+        for (size_t w = 0; w < WORDS; w++) {
+            out[w] = ~clk[w] & lastCLK[w];
+            lastCLK[w] = clk[w];
+        }
+    }
+
+private:
+    uint64_t clk[WORDS] = {};
+    uint64_t out[WORDS] = {};
+    uint64_t lastCLK[WORDS] = {};
+};
+
+// A bank of on-delay timers. Only the instances whose IN is set are visited, to update their ET and Q.
+template<size_t N, int Low = 0>
+class TON_BANK {
+public:
+    static constexpr size_t WORDS = (N + 63) / 64;
+    struct Element { BankBit IN; BankBit Q; uint64_t& PT; uint64_t& ET; };
+
+    Element operator[](int index) {
+        size_t i = static_cast<size_t>(index - Low);
+        uint64_t mask = 1ull << (i % 64);
+        return Element{ BankBit(in[i / 64], mask), BankBit(q[i / 64], mask), pt[i], et[i] };
+    }
+
+    void operator()() {
+        uint64_t now = scanTime();
+        for (size_t w = 0; w < WORDS; w++) {
+            uint64_t running = in[w];
+            forEachBankBit(running & ~timing[w], w * 64, [&](size_t i) { start[i] = now; });
+            forEachBankBit(timing[w] & ~running, w * 64, [&](size_t i) { et[i] = 0; });
+            timing[w] = running;
+            uint64_t expired = 0;
+            forEachBankBit(running, w * 64, [&](size_t i) {
+                et[i] = now - start[i];
+                if (et[i] >= pt[i]) expired |= 1ull << (i % 64);
+            });
+            q[w] = expired;
+        }
+    }
+
+private:
+    uint64_t in[WORDS] = {};
+    uint64_t q[WORDS] = {};
+    uint64_t timing[WORDS] = {};
+    uint64_t pt[N] = {};
+    uint64_t et[N] = {};
+    uint64_t start[N] = {};
+};
+
+// Counters are templates on the type of their count, which defaults to the 16 bit count of CTU, CTD and CTUD. The
+// typed IEC counters like CTU_DINT are aliases of them. A count stops at the limits of its type instead of wrapping.
+
+// Up Counter
+template<typename T = uint16_t>
+class CTU {
+public:
+    bool CU = false;
+    bool R = false;
+    T PV = 0;
+    T CV = 0;
+    bool Q = false;
+
+    NODALIS_ALWAYS_INLINE void operator()() {
+        if (R) {
+            CV = 0;
+        } else if (CU && !lastCU && CV < (std::numeric_limits<T>::max)()) {
+            CV++;
+        }
+        Q = CV >= PV;
+        lastCU = CU;
+    }
+
+private:
+    bool lastCU = false;
+};
+
+// Down Counter
+template<typename T = uint16_t>
+class CTD {
+public:
+    bool CD = false;
+    bool LD = false;
+    T PV = 0;
+    T CV = 0;
+    bool Q = false;
+
+    NODALIS_ALWAYS_INLINE void operator()() {
+        if (LD) {
+            CV = PV;
+        } else if (CD && !lastCD && CV > 0) {
+            CV--;
+        }
+        Q = CV == 0;
+        lastCD = CD;
+    }
+
+private:
+    bool lastCD = false;
+};
+
+// Up/Down Counter
+template<typename T = uint16_t>
+class CTUD {
+public:
+    bool CU = false;
+    bool CD = false;
+    bool R = false;
+    bool LD = false;
+    T PV = 0;
+    T CV = 0;
+    bool QU = false;
+    bool QD = false;
+
+    NODALIS_ALWAYS_INLINE void operator()() {
+        if (R) {
+            CV = 0;
+        } else if (LD) {
+            CV = PV;
+        } else {
+            if (CU && !lastCU && CV < (std::numeric_limits<T>::max)()) CV++;
+            if (CD && !lastCD && CV > 0) CV--;
+        }
+
+        QU = CV >= PV;
+        QD = CV == 0;
+
+        lastCU = CU;
+        lastCD = CD;
+    }
+
+private:
+    bool lastCU = false;
+    bool lastCD = false;
+};
+
+#define TYPED_COUNTERS(SUFFIX, TYPE) \
+using CTU_##SUFFIX = CTU<TYPE>; \
+using CTD_##SUFFIX = CTD<TYPE>; \
+using CTUD_##SUFFIX = CTUD<TYPE>;
+
+TYPED_COUNTERS(INT, int16_t)
+TYPED_COUNTERS(DINT, int32_t)
+TYPED_COUNTERS(LINT, int64_t)
+TYPED_COUNTERS(UDINT, uint32_t)
+TYPED_COUNTERS(ULINT, uint64_t)
+#undef TYPED_COUNTERS
+
+// The comparison and selection blocks are templates on the type of their operands. The transpiler instantiates them
+// from the types of the variables wired to them, so they compare and move values without converting them.
+
+// Comparison blocks
+#define COMP_BLOCK(NAME, EXPR) \
+template<typename T = uint32_t> \
+class NAME { \
+public: \
+    T IN1 = 0, IN2 = 0; \
+    bool OUT = false; \
+    NODALIS_ALWAYS_INLINE void operator()() { OUT = (EXPR); } \
+};
+
+COMP_BLOCK(EQ, IN1 == IN2)
+COMP_BLOCK(NE, IN1 != IN2)
+COMP_BLOCK(LT, IN1 < IN2)
+COMP_BLOCK(GT, IN1 > IN2)
+COMP_BLOCK(GE, IN1 >= IN2)
+COMP_BLOCK(LE, IN1 <= IN2)
+#undef COMP_BLOCK
+
+template<typename T = uint32_t>
+class MOVE {
+public:
+    T IN = 0;
+    T OUT = 0;
+    NODALIS_ALWAYS_INLINE void operator()() { OUT = IN; }
+};
+
+template<typename T = uint32_t>
+class SEL {
+public:
+    bool G = false;
+    T IN0 = 0, IN1 = 0;
+    T OUT = 0;
+    NODALIS_ALWAYS_INLINE void operator()() { OUT = G ? IN1 : IN0; }
+};
+
+template<typename T = uint32_t>
+class MUX {
+public:
+    bool K = false;
+    T IN0 = 0, IN1 = 0;
+    T OUT = 0;
+    NODALIS_ALWAYS_INLINE void operator()() { OUT = K ? IN1 : IN0; }
+};
+
+template<typename T = uint32_t>
+class MIN {
+public:
+    T IN1 = 0, IN2 = 0;
+    T OUT = 0;
+    NODALIS_ALWAYS_INLINE void operator()() { OUT = IN2 < IN1 ? IN2 : IN1; }
+};
+
+template<typename T = uint32_t>
+class MAX {
+public:
+    T IN1 = 0, IN2 = 0;
+    T OUT = 0;
+    NODALIS_ALWAYS_INLINE void operator()() { OUT = IN1 < IN2 ? IN2 : IN1; }
+};
+
+template<typename T = uint32_t>
+class LIMIT {
+public:
+    T MN = 0, IN = 0, MX = 0;
+    T OUT = 0;
+    NODALIS_ALWAYS_INLINE void operator()() {
+        if (IN < MN) OUT = MN;
+        else if (IN > MX) OUT = MX;
+        else OUT = IN;
+    }
+};
+
+
+#pragma endregion
+
+#pragma region "Strings"
+// STRING and WSTRING variables are IECString values, which hold their characters inline up to the declared length
+// (STRING[20]), so assigning, comparing and the standard string functions never allocate. Characters past the
+// capacity of a string are dropped, as IEC 61131-3 requires. Positions are 1 based, as in ST.
+
+#ifdef DELETE
+// The Windows headers define DELETE as an access right, which would hide the DELETE string function.
+#undef DELETE
+#endif
+
+/**
+ * The length of a STRING declared without one.
+ */
+constexpr size_t IEC_STRING_DEFAULT_LENGTH = 80;
+
+/**
+ * The capacity of the strings the string functions return. Assigning one to a shorter string truncates it.
+ */
+constexpr size_t IEC_STRING_RESULT_LENGTH = 254;
+
+/**
+ * The characters of a string, or a literal, that a string function reads.
+ */
+template<typename CharT>
+struct IECStringView {
+    using value_type = CharT;
+    const CharT* data;
+    size_t size;
+};
+
+/**
+ * Counts the characters of a null terminated literal.
+ * @param text The literal.
+ * @returns Returns the number of characters before the terminator.
+ */
+template<typename CharT>
+inline size_t stringLength(const CharT* text) {
+    size_t length = 0;
+    while (text != nullptr && text[length] != 0) length++;
+    return length;
+}
+
+/**
+ * A fixed capacity STRING (char) or WSTRING (char16_t) that holds its characters inline.
+ * @tparam N The most characters the string holds.
+ * @tparam CharT The character type.
+ */
+template<size_t N, typename CharT = char>
+class IECString {
+public:
+    static constexpr size_t CAPACITY = N;
+
+    IECString() = default;
+    IECString(const CharT* text) { assign(text, stringLength(text)); }
+    IECString(IECStringView<CharT> text) { assign(text.data, text.size); }
+    template<size_t M>
+    IECString(const IECString<M, CharT>& other) { assign(other.data(), other.size()); }
+
+    IECString& operator=(const CharT* text) {
+        assign(text, stringLength(text));
+        return *this;
+    }
+    IECString& operator=(IECStringView<CharT> text) {
+        assign(text.data, text.size);
+        return *this;
+    }
+    template<size_t M>
+    IECString& operator=(const IECString<M, CharT>& other) {
+        assign(other.data(), other.size());
+        return *this;
+    }
+
+    /**
+     * Sets the characters of the string, dropping those past its capacity. The source may overlap the string.
+     * @param text The characters.
+     * @param count The number of characters.
+     */
+    void assign(const CharT* text, size_t count) {
+        used = count < N ? count : N;
+        if (used > 0) std::memmove(chars, text, used * sizeof(CharT));
+        chars[used] = 0;
+    }
+
+    /**
+     * Appends characters to the string, dropping those past its capacity.
+     * @param text The characters.
+     * @param count The number of characters.
+     */
+    void append(const CharT* text, size_t count) {
+        size_t room = N - used;
+        count = count < room ? count : room;
+        if (count > 0) std::memmove(chars + used, text, count * sizeof(CharT));
+        used += count;
+        chars[used] = 0;
+    }
+
+    const CharT* data() const { return chars; }
+    const CharT* c_str() const { return chars; }
+    size_t size() const { return used; }
+    operator IECStringView<CharT>() const { return { chars, used }; }
+
+private:
+    CharT chars[N + 1] = {};
+    size_t used = 0;
+};
+
+template<size_t N, typename CharT>
+inline IECStringView<CharT> stringView(const IECString<N, CharT>& text) { return text; }
+inline IECStringView<char> stringView(const char* text) { return { text, stringLength(text) }; }
+inline IECStringView<char16_t> stringView(const char16_t* text) { return { text, stringLength(text) }; }
+template<typename CharT>
+inline IECStringView<CharT> stringView(IECStringView<CharT> text) { return text; }
+
+/**
+ * The character type of a string or literal.
+ */
+template<typename S>
+using StringChar = typename decltype(stringView(std::declval<const S&>()))::value_type;
+
+/**
+ * The type the string functions return for a string or literal.
+ */
+template<typename S>
+using StringResult = IECString<IEC_STRING_RESULT_LENGTH, StringChar<S>>;
+
+/**
+ * Clamps a length or position given to a string function to the characters available.
+ * @param value The length or position.
+ * @param limit The most it can be.
+ * @returns Returns the value, 0 if it was negative.
+ */
+template<typename T>
+inline size_t stringClamp(T value, size_t limit) {
+    if (value <= 0) return 0;
+    return static_cast<uint64_t>(value) < limit ? static_cast<size_t>(value) : limit;
+}
+
+/**
+ * Compares two strings ordinally.
+ * @returns Returns less than 0, 0 or more than 0 as a sorts before, with or after b.
+ */
+template<typename CharT>
+inline int compareStrings(IECStringView<CharT> a, IECStringView<CharT> b) {
+    size_t count = a.size < b.size ? a.size : b.size;
+    for (size_t x = 0; x < count; x++) {
+        if (a.data[x] != b.data[x]) return a.data[x] < b.data[x] ? -1 : 1;
+    }
+    return a.size == b.size ? 0 : (a.size < b.size ? -1 : 1);
+}
+
+#define IEC_STRING_COMPARISON(OP) \
+template<size_t N, size_t M, typename CharT> \
+inline bool operator OP(const IECString<N, CharT>& a, const IECString<M, CharT>& b) { return compareStrings(stringView(a), stringView(b)) OP 0; } \
+template<size_t N, typename CharT> \
+inline bool operator OP(const IECString<N, CharT>& a, const CharT* b) { return compareStrings(stringView(a), stringView(b)) OP 0; } \
+template<size_t N, typename CharT> \
+inline bool operator OP(const CharT* a, const IECString<N, CharT>& b) { return compareStrings(stringView(a), stringView(b)) OP 0; }
+IEC_STRING_COMPARISON(==)
+IEC_STRING_COMPARISON(!=)
+IEC_STRING_COMPARISON(<)
+IEC_STRING_COMPARISON(>)
+IEC_STRING_COMPARISON(<=)
+IEC_STRING_COMPARISON(>=)
+#undef IEC_STRING_COMPARISON
+
+/**
+ * @returns Returns the number of characters in a string.
+ */
+template<typename S>
+inline int16_t LEN(const S& in) { return static_cast<int16_t>(stringView(in).size); }
+
+/**
+ * @returns Returns the first l characters of a string.
+ */
+template<typename S, typename L>
+inline StringResult<S> LEFT(const S& in, L l) {
+    auto text = stringView(in);
+    return IECStringView<StringChar<S>>{ text.data, stringClamp(l, text.size) };
+}
+
+/**
+ * @returns Returns the last l characters of a string.
+ */
+template<typename S, typename L>
+inline StringResult<S> RIGHT(const S& in, L l) {
+    auto text = stringView(in);
+    size_t count = stringClamp(l, text.size);
+    return IECStringView<StringChar<S>>{ text.data + text.size - count, count };
+}
+
+/**
+ * @returns Returns l characters of a string, from position p.
+ */
+template<typename S, typename L, typename P>
+inline StringResult<S> MID(const S& in, L l, P p) {
+    auto text = stringView(in);
+    size_t start = stringClamp(p, text.size + 1);
+    if (start == 0) return {};
+    size_t count = stringClamp(l, text.size - (start - 1));
+    return IECStringView<StringChar<S>>{ text.data + start - 1, count };
+}
+
+/**
+ * @returns Returns the strings joined in order.
+ */
+template<typename S, typename... Rest>
+inline StringResult<S> CONCAT(const S& first, const Rest&... rest) {
+    StringResult<S> result = stringView(first);
+    (result.append(stringView(rest).data, stringView(rest).size), ...);
+    return result;
+}
+
+/**
+ * @returns Returns in1 with in2 inserted after its first p characters.
+ */
+template<typename S1, typename S2, typename P>
+inline StringResult<S1> INSERT(const S1& in1, const S2& in2, P p) {
+    auto text = stringView(in1);
+    size_t at = stringClamp(p, text.size);
+    StringResult<S1> result = IECStringView<StringChar<S1>>{ text.data, at };
+    result.append(stringView(in2).data, stringView(in2).size);
+    result.append(text.data + at, text.size - at);
+    return result;
+}
+
+/**
+ * @returns Returns a string without the l characters from position p.
+ */
+template<typename S, typename L, typename P>
+inline StringResult<S> DELETE(const S& in, L l, P p) {
+    auto text = stringView(in);
+    size_t start = stringClamp(p, text.size + 1);
+    if (start == 0) return text;
+    size_t count = stringClamp(l, text.size - (start - 1));
+    StringResult<S> result = IECStringView<StringChar<S>>{ text.data, start - 1 };
+    result.append(text.data + start - 1 + count, text.size - (start - 1) - count);
+    return result;
+}
+
+/**
+ * @returns Returns in1 with the l characters from position p replaced with in2.
+ */
+template<typename S1, typename S2, typename L, typename P>
+inline StringResult<S1> REPLACE(const S1& in1, const S2& in2, L l, P p) {
+    auto text = stringView(in1);
+    size_t start = stringClamp(p, text.size + 1);
+    start = start == 0 ? 1 : start;
+    size_t count = stringClamp(l, text.size - (start - 1));
+    StringResult<S1> result = IECStringView<StringChar<S1>>{ text.data, start - 1 };
+    result.append(stringView(in2).data, stringView(in2).size);
+    result.append(text.data + start - 1 + count, text.size - (start - 1) - count);
+    return result;
+}
+
+/**
+ * @returns Returns the position of the first occurrence of in2 in in1, or 0 if it doesn't occur.
+ */
+template<typename S1, typename S2>
+inline int16_t FIND(const S1& in1, const S2& in2) {
+    auto text = stringView(in1);
+    auto pattern = stringView(in2);
+    if (pattern.size == 0 || pattern.size > text.size) return 0;
+    for (size_t x = 0; x + pattern.size <= text.size; x++) {
+        if (std::memcmp(text.data + x, pattern.data, pattern.size * sizeof(StringChar<S1>)) == 0) {
+            return static_cast<int16_t>(x + 1);
         }
-        if(IN){
-            Q = true;
+    }
+    return 0;
+}
+
+/**
+ * Writes a STRING to a message, for diagnostics.
+ */
+template<size_t N>
+inline LogText& operator<<(LogText& out, const IECString<N, char>& text) {
+    return out.append(text.data(), text.size());
+}
+
+// DATE and DATE_AND_TIME are seconds since 1970-01-01 and TIME_OF_DAY is milliseconds since midnight, the same
+// fixed size values most IEC runtimes use, rather than text. LDATE, LDATE_AND_TIME and LTIME_OF_DAY count the same in
+// 64 bit nanoseconds.
+typedef uint32_t IEC_DATE;
+typedef uint32_t IEC_TIME_OF_DAY;
+typedef uint32_t IEC_DATE_AND_TIME;
+typedef int64_t IEC_LDATE;
+typedef int64_t IEC_LTIME_OF_DAY;
+typedef int64_t IEC_LDATE_AND_TIME;
+#pragma endregion
+
+#pragma region "Arrays"
+/**
+ * With NODALIS_ARRAY_BOUNDS_CHECK 1, indexing an ST array outside of its bounds throws std::out_of_range, which the
+ * scheduler reports as a fault of the task. By default the index is not checked, so indexing is a single address
+ * computation the C++ compiler can vectorize loops over.
+ */
+#ifndef NODALIS_ARRAY_BOUNDS_CHECK
+#define NODALIS_ARRAY_BOUNDS_CHECK 0
+#endif
+
+/**
+ * Marks the loop that follows as one whose iterations don't depend on each other, so the C++ compiler vectorizes it
+ * without having to prove that the arrays it reads and writes don't overlap. The ST compiler emits it only for FOR
+ * loops that assign array elements at the counter and read the arrays they assign only there.
+ */
+#if defined(__clang__)
+#define NODALIS_IVDEP _Pragma("clang loop vectorize(assume_safety)")
+#elif defined(__GNUC__)
+#define NODALIS_IVDEP _Pragma("GCC ivdep")
+#elif defined(_MSC_VER)
+#define NODALIS_IVDEP __pragma(loop(ivdep))
+#else
+#define NODALIS_IVDEP
+#endif
+
+/**
+ * The type a FOR loop steps its counter in: the declared type of the counter, promoted the way C++ arithmetic promotes
+ * it. The counter never leaves the bounds of the loop, so the body reads the values it would read in the declared
+ * type, and an index of an array by the counter stays affine in the iteration for the vectorizer.
+ * @tparam T The declared type of the counter.
+ */
+template<typename T>
+using ForCounter = decltype(+T());
+
+/**
+ * An ST ARRAY [Low..High] OF T. The elements are stored inline and contiguously, aligned for vector loads, and are
+ * indexed with the bounds of the ST declaration. A multi-dimensional array is an array of arrays.
+ * @tparam T The type of the elements.
+ * @tparam Low The lower bound.
+ * @tparam High The upper bound.
+ */
+template<typename T, int64_t Low, int64_t High>
+class IECArray {
+    static_assert(High >= Low, "The upper bound of an array can't be below its lower bound");
+public:
+    static constexpr size_t N = static_cast<size_t>(High - Low + 1);
+
+    /**
+     * Gets an element by its ST index.
+     * @param index The index, between Low and High.
+     * @returns Returns the element.
+     */
+    template<typename I>
+    T& operator[](I index) { return items[offset(index)]; }
+    template<typename I>
+    const T& operator[](I index) const { return items[offset(index)]; }
+
+    /**
+     * Calls every element, for an array of function blocks.
+     */
+    void operator()() {
+        for (auto& item : items) item();
+    }
+
+    T* begin() { return items; }
+    T* end() { return items + N; }
+    const T* begin() const { return items; }
+    const T* end() const { return items + N; }
+    static constexpr size_t size() { return N; }
+
+private:
+    template<typename I>
+    static size_t offset(I index) {
+#if NODALIS_ARRAY_BOUNDS_CHECK
+        if (static_cast<int64_t>(index) < Low || static_cast<int64_t>(index) > High) {
+            NODALIS_THROW(std::out_of_range("Array index " + std::to_string(static_cast<int64_t>(index)) + " is outside of [" +
+                std::to_string(Low) + ".." + std::to_string(High) + "]"));
         }
-        else if(lastIN && !IN){
-            if(startTime == 0){
-                startTime = elapsed();
-            }
-            ET = elapsed() - startTime;
-            if(PT >= ET){
-                Q = true;
-            }
-            else{
-                lastIN = false;
-            }
+#endif
+        return static_cast<size_t>(static_cast<int64_t>(index) - Low);
+    }
+
+    alignas(alignof(T) > 16 ? alignof(T) : 16) T items[N] = {};
+};
+#pragma endregion
+
+// The standard numeric, bit shift and conversion functions, SQRT, TO_INT, ROL and their array forms.
+#include "iecfunctions.h"
+
+#pragma region "Controllers"
+// The PID controllers compute Y = Y_OFFSET + KP * (e + 1/TN * integral of e + TV * de/dt), with e = SET_POINT - ACTUAL,
+// TN and TV in seconds and the sample time taken from the scan times of the calls. The integral is kept in units of Y,
+// so a change of KP doesn't make it jump, and the derivative is taken of ACTUAL rather than of e, so a step of the set
+// point doesn't kick the output, and is filtered with the time constant TF. When Y_MAX is above Y_MIN, Y is limited
+// to them and the integral is held where it keeps Y at the limit (anti-windup). In MANUAL, Y follows Y_MANUAL, and the
+// integral is set so that the loop takes over from it without a bump when MANUAL is cleared. RESET clears the
+// integral and the derivative. A TN of 0 leaves the integral out.
+
+/**
+ * Advances a PID loop in automatic mode.
+ * @param integral The integral of the loop, in units of Y.
+ * @param derivative The filtered derivative term of the loop.
+ * @param lastActual ACTUAL as of the previous call.
+ * @param dt The seconds since the previous call, or 0 on the first.
+ * @param limited Receives whether Y was limited.
+ * @returns Returns Y.
+ */
+template<typename T>
+inline T pidStep(T& integral, T& derivative, T& lastActual, T actual, T setPoint, T kp, T tn, T tv, T tf, T yOffset,
+                 T yMin, T yMax, T dt, bool& limited) {
+    T proportional = kp * (setPoint - actual);
+    T integrated = tn > 0 ? integral + proportional * dt / tn : T(0);
+    T raw = dt > 0 ? -(kp * tv * (actual - lastActual)) / dt : T(0);
+    T lag = (tf > 0 ? tf : T(0)) + dt;
+    T filtered = derivative + (raw - derivative) * (lag > 0 ? dt / lag : T(1));
+    T y = yOffset + proportional + integrated + filtered;
+    limited = false;
+    if (yMax > yMin) {
+        T clamped = y > yMax ? yMax : (y < yMin ? yMin : y);
+        limited = clamped != y;
+        y = clamped;
+    }
+    integral = tn > 0 && limited ? y - yOffset - proportional - filtered : integrated;
+    derivative = filtered;
+    lastActual = actual;
+    return y;
+}
+
+/**
+ * Holds a PID loop in MANUAL or RESET, setting its state so that automatic mode resumes from the output.
+ * @param integral The integral of the loop, in units of Y.
+ * @param derivative The filtered derivative term of the loop.
+ * @param lastActual ACTUAL as of the previous call.
+ * @param limited Receives whether Y was limited.
+ * @returns Returns Y.
+ */
+template<typename T>
+inline T pidHold(T& integral, T& derivative, T& lastActual, T actual, T setPoint, T kp, T tn, T yManual, T yOffset,
+                 T yMin, T yMax, bool manual, bool reset, bool& limited) {
+    derivative = 0;
+    lastActual = actual;
+    T y = manual ? yManual : yOffset;
+    limited = yMax > yMin && (y > yMax || y < yMin);
+    if (limited) y = y > yMax ? yMax : yMin;
+    // In manual, the integral takes up what the other terms don't give, so the output doesn't jump when it resumes.
+    integral = manual && !reset && tn > 0 ? y - yOffset - kp * (setPoint - actual) : T(0);
+    return y;
+}
+
+// PID controller, templated on the type of its values. PID is of REALs and PID_LREAL of LREALs.
+template<typename T>
+class PIDBlock {
+public:
+    T ACTUAL = 0;
+    T SET_POINT = 0;
+    T KP = 1;
+    T TN = 0;
+    T TV = 0;
+    T TF = 0;
+    T Y_MANUAL = 0;
+    T Y_OFFSET = 0;
+    T Y_MIN = 0;
+    T Y_MAX = 0;
+    bool MANUAL = false;
+    bool RESET = false;
+    T Y = 0;
+    bool LIMITS_ACTIVE = false;
+
+    void operator()() {
+        uint64_t now = scanTimeMicros();
+        T dt = called ? static_cast<T>(now - lastCall) / T(1000000) : T(0);
+        lastCall = now;
+        called = true;
+        if (MANUAL || RESET) {
+            Y = pidHold(integral, derivative, lastActual, ACTUAL, SET_POINT, KP, TN, Y_MANUAL, Y_OFFSET, Y_MIN, Y_MAX,
+                        MANUAL, RESET, LIMITS_ACTIVE);
+        } else {
+            Y = pidStep(integral, derivative, lastActual, ACTUAL, SET_POINT, KP, TN, TV, TF, Y_OFFSET, Y_MIN, Y_MAX, dt,
+                        LIMITS_ACTIVE);
         }
     }
-    private:
-        bool lastIN = false;
-        uint64_t startTime = 0;
+
+private:
+    T integral = 0;
+    T derivative = 0;
+    T lastActual = 0;
+    uint64_t lastCall = 0;
+    bool called = false;
 };
 
-// TON: On-delay timer
-class TON {
+using PID = PIDBlock<float>;
+using PID_LREAL = PIDBlock<double>;
+
+/**
+ * The arrays of the loops of a PID bank, as advancePIDLoops() reads and updates them.
+ */
+struct PIDLoops {
+    const float* actual;
+    const float* setPoint;
+    const float* kp;
+    const float* tn;
+    const float* tv;
+    const float* tf;
+    const float* yOffset;
+    const float* yMin;
+    const float* yMax;
+    float* y;
+    float* integral;
+    float* derivative;
+    float* lastActual;
+};
+
+/**
+ * Advances up to 64 loops of a PID bank in automatic mode, as pidStep() would each, several loops at a time with the
+ * vector instructions of the image kernels.
+ * @param loops The arrays of the bank.
+ * @param first The index of the first loop.
+ * @param count The number of loops, at most 64.
+ * @param dt The seconds since the bank was last called, or 0 on the first call.
+ * @returns Returns a bit for each loop whose Y was limited, the first loop in the lowest bit.
+ */
+uint64_t advancePIDLoops(const PIDLoops& loops, size_t first, size_t count, float dt);
+
+// A bank of PID controllers. An ARRAY OF PID is declared as a bank, which keeps each REAL pin of its loops in an array
+// of floats and each BOOL pin as bit words, like the other banks. Calling the bank advances every loop with the time
+// since its last call as the sample time, 64 loops at a time with vector instructions, and then holds the loops in
+// MANUAL or RESET one by one, so the loops in automatic cost no branches.
+template<size_t N, int Low = 0>
+class PID_BANK {
 public:
-    bool IN;
-    uint64_t PT;
-    bool Q = false;
-    uint64_t ET = 0;
+    static constexpr size_t WORDS = (N + 63) / 64;
+    struct Element {
+        float& ACTUAL; float& SET_POINT; float& KP; float& TN; float& TV; float& TF;
+        float& Y_MANUAL; float& Y_OFFSET; float& Y_MIN; float& Y_MAX;
+        BankBit MANUAL; BankBit RESET;
+        float& Y; BankBit LIMITS_ACTIVE;
+    };
+
+    PID_BANK() {
+        for (size_t i = 0; i < N; i++) kp[i] = 1;
+    }
+
+    Element operator[](int index) {
+        size_t i = static_cast<size_t>(index - Low);
+        uint64_t mask = 1ull << (i % 64);
+        return Element{ actual[i], setPoint[i], kp[i], tn[i], tv[i], tf[i], yManual[i], yOffset[i], yMin[i], yMax[i],
+                        BankBit(manual[i / 64], mask), BankBit(reset[i / 64], mask), y[i], BankBit(limits[i / 64], mask) };
+    }
 
     void operator()() {
-        if (IN) {
-            if (startTime == 0) {
-                startTime = elapsed();
-            }
-            ET = elapsed() - startTime;
-            Q = ET >= PT;
+        uint64_t now = scanTimeMicros();
+        float dt = called ? static_cast<float>(now - lastCall) / 1000000.0f : 0.0f;
+        lastCall = now;
+        called = true;
+        const PIDLoops loops{ actual, setPoint, kp, tn, tv, tf, yOffset, yMin, yMax, y, integral, derivative, lastActual };
+        for (size_t w = 0; w < WORDS; w++) {
+            size_t first = w * 64;
+            uint64_t word = advancePIDLoops(loops, first, first + 64 < N ? 64 : N - first, dt);
+            forEachBankBit(manual[w] | reset[w], first, [&](size_t i) {
+                bool limited;
+                uint64_t mask = 1ull << (i % 64);
+                y[i] = pidHold(integral[i], derivative[i], lastActual[i], actual[i], setPoint[i], kp[i], tn[i], yManual[i],
+                               yOffset[i], yMin[i], yMax[i], (manual[w] & mask) != 0, (reset[w] & mask) != 0, limited);
+                word = limited ? (word | mask) : (word & ~mask);
+            });
+            limits[w] = word;
+        }
+    }
+
+private:
+    alignas(64) float actual[N] = {};
+    alignas(64) float setPoint[N] = {};
+    alignas(64) float kp[N] = {};
+    alignas(64) float tn[N] = {};
+    alignas(64) float tv[N] = {};
+    alignas(64) float tf[N] = {};
+    alignas(64) float yManual[N] = {};
+    alignas(64) float yOffset[N] = {};
+    alignas(64) float yMin[N] = {};
+    alignas(64) float yMax[N] = {};
+    alignas(64) float y[N] = {};
+    alignas(64) float integral[N] = {};
+    alignas(64) float derivative[N] = {};
+    alignas(64) float lastActual[N] = {};
+    uint64_t manual[WORDS] = {};
+    uint64_t reset[WORDS] = {};
+    uint64_t limits[WORDS] = {};
+    uint64_t lastCall = 0;
+    bool called = false;
+};
+#pragma endregion
+
+#pragma region "Signal Processing"
+// The signal blocks condition analog values: MOVING_AVG averages the last N samples, LOWPASS is a first order lag
+// with the time constant TC, RAMP limits the rate at which OUT follows IN and LIN_TABLE linearizes IN through a table
+// of points. Like the comparison blocks, they are templates on the type of IN and OUT, and compute in float, or in
+// double for LREAL and 64 bit values, rounding to integer outputs. Times are in seconds and taken from the scan times
+// of the calls. None of them allocates: the samples and points are stored in the instance.
+
+/**
+ * The type the signal blocks compute in for values of type T.
+ */
+template<typename T>
+using SignalReal = typename std::conditional<(std::is_same<T, double>::value || sizeof(T) > 4), double, float>::type;
+
+/**
+ * Converts a computed value to the type of a block's output, rounding it to the nearest integer for integer outputs.
+ * @param value The computed value.
+ * @returns Returns the output.
+ */
+template<typename T, typename R>
+inline T signalOut(R value) {
+    if constexpr (std::is_integral<T>::value) {
+        return static_cast<T>(value < 0 ? value - R(0.5) : value + R(0.5));
+    } else {
+        return static_cast<T>(value);
+    }
+}
+
+/**
+ * Measures the time between the calls of a block, from the scan times.
+ */
+class ScanInterval {
+public:
+    /**
+     * Takes the time of the current call.
+     * @returns Returns the seconds since the previous call, or 0 on the first.
+     */
+    template<typename R>
+    R next() {
+        uint64_t now = scanTimeMicros();
+        R dt = called ? static_cast<R>(now - last) / R(1000000) : R(0);
+        last = now;
+        called = true;
+        return dt;
+    }
+
+    /**
+     * Gets whether the block was called before.
+     * @returns Returns true after the first call.
+     */
+    bool started() const { return called; }
+
+private:
+    uint64_t last = 0;
+    bool called = false;
+};
+
+/**
+ * A sum that samples are added to and removed from, with Kahan compensation so that the rounding errors of a long
+ * running sum don't accumulate.
+ */
+struct RunningSum {
+    double total = 0;
+    double compensation = 0;
+
+    void add(double value) {
+        double y = value - compensation;
+        double t = total + y;
+        compensation = (t - total) - y;
+        total = t;
+    }
+
+    void clear() {
+        total = 0;
+        compensation = 0;
+    }
+};
+
+/**
+ * Interpolates linearly between the points of a table. IN below the first point gives the first Y and IN above the
+ * last point the last Y. The segment is found with a branchless binary search.
+ * @param x The X of the points, in ascending order.
+ * @param y The Y of the points.
+ * @param n The number of points, at least 1.
+ * @param in The value to look up.
+ * @returns Returns the interpolated Y.
+ */
+template<typename R, typename T>
+inline R interpolateTable(const T* x, const T* y, size_t n, R in) {
+    if (n < 2 || in <= static_cast<R>(x[0])) return static_cast<R>(y[0]);
+    if (in >= static_cast<R>(x[n - 1])) return static_cast<R>(y[n - 1]);
+    // The search keeps base[0] <= in and narrows the range to the last point that is.
+    const T* base = x;
+    for (size_t len = n; len > 1; len -= len / 2) {
+        base = static_cast<R>(base[len / 2]) <= in ? base + len / 2 : base;
+    }
+    size_t i = static_cast<size_t>(base - x);
+    R x0 = static_cast<R>(x[i]);
+    R y0 = static_cast<R>(y[i]);
+    return y0 + (in - x0) * (static_cast<R>(y[i + 1]) - y0) / (static_cast<R>(x[i + 1]) - x0);
+}
+
+// Moving average of the last N samples, at most Capacity. The samples are kept in a ring and their sum is updated
+// with the sample that enters and the one that leaves, so a call costs the same for any N. Until N samples are taken,
+// OUT is the average of those taken. Changing N or setting RESET starts over.
+template<typename T = float, size_t Capacity = 128>
+class MOVING_AVG {
+public:
+    T IN = 0;
+    int16_t N = static_cast<int16_t>(Capacity);
+    bool RESET = false;
+    T OUT = 0;
+
+    void operator()() {
+        size_t window = N < 1 ? 1 : (static_cast<size_t>(N) > Capacity ? Capacity : static_cast<size_t>(N));
+        if (RESET || window != size) {
+            size = window;
+            count = 0;
+            head = 0;
+            sum.clear();
+        }
+        if (count == size) {
+            sum.add(-static_cast<double>(samples[head]));
+        } else {
+            count++;
+        }
+        samples[head] = IN;
+        sum.add(static_cast<double>(IN));
+        head = head + 1 == size ? 0 : head + 1;
+        OUT = signalOut<T>(static_cast<SignalReal<T>>(sum.total / static_cast<double>(count)));
+    }
+
+private:
+    T samples[Capacity] = {};
+    RunningSum sum;
+    size_t size = 0;
+    size_t count = 0;
+    size_t head = 0;
+};
+
+// First order low pass filter: OUT approaches IN with the time constant TC, in seconds. A TC of 0 passes IN through,
+// and so do the first call and RESET.
+template<typename T = float>
+class LOWPASS {
+public:
+    T IN = 0;
+    SignalReal<T> TC = 0;
+    bool RESET = false;
+    T OUT = 0;
+
+    void operator()() {
+        using R = SignalReal<T>;
+        bool started = interval.started();
+        R dt = interval.next<R>();
+        if (!started || RESET || !(TC > 0)) {
+            state = static_cast<R>(IN);
         } else {
-            startTime = 0;
-            ET = 0;
-            Q = false;
+            state += (static_cast<R>(IN) - state) * dt / (TC + dt);
         }
+        OUT = signalOut<T>(state);
     }
 
 private:
-    uint64_t startTime = 0;
+    SignalReal<T> state = 0;
+    ScanInterval interval;
 };
 
-// TOF: Off-delay timer
-class TOF {
+// Ramp generator: OUT follows IN, rising by at most RISE and falling by at most FALL per second. A rate of 0 doesn't
+// limit that direction. BUSY is set while OUT hasn't reached IN. The first call and RESET set OUT to IN.
+template<typename T = float>
+class RAMP {
 public:
-    bool IN;
-    uint64_t PT;
-    bool Q = false;
-    uint64_t ET = 0;
+    T IN = 0;
+    SignalReal<T> RISE = 0;
+    SignalReal<T> FALL = 0;
+    bool RESET = false;
+    T OUT = 0;
+    bool BUSY = false;
 
     void operator()() {
-        if (IN) {
-            Q = true;
-            startTime = 0;
-            ET = 0;
-        } else if (Q) {
-            if (startTime == 0) {
-                startTime = elapsed();
-            }
-            ET = elapsed() - startTime;
-            if (ET >= PT) {
-                Q = false;
-            }
+        using R = SignalReal<T>;
+        bool started = interval.started();
+        R dt = interval.next<R>();
+        R target = static_cast<R>(IN);
+        R step = target - state;
+        if (started && !RESET && RISE > 0 && step > RISE * dt) {
+            state += RISE * dt;
+        } else if (started && !RESET && FALL > 0 && step < -FALL * dt) {
+            state -= FALL * dt;
+        } else {
+            state = target;
         }
+        BUSY = state != target;
+        OUT = signalOut<T>(state);
     }
 
 private:
-    uint64_t startTime = 0;
+    SignalReal<T> state = 0;
+    ScanInterval interval;
 };
 
-// Boolean Logic Gates
-#define BOOL_GATE(NAME, EXPR) \
-class NAME { \
-public: \
-    bool IN1 = false; \
-    bool IN2 = false; \
-    bool OUT = false; \
-    void operator()() { OUT = (EXPR); } \
+// Linearization table of up to Points points: OUT is interpolated between the points (X[i], Y[i]) around IN, of the
+// first POINTS of them. X must be in ascending order. IN outside of the table gives the Y of its first or last point.
+template<typename T = float, size_t Points = 16>
+class LIN_TABLE {
+public:
+    T IN = 0;
+    IECArray<T, 1, Points> X;
+    IECArray<T, 1, Points> Y;
+    int16_t POINTS = static_cast<int16_t>(Points);
+    T OUT = 0;
+
+    void operator()() {
+        size_t n = POINTS < 1 ? 1 : (static_cast<size_t>(POINTS) > Points ? Points : static_cast<size_t>(POINTS));
+        OUT = signalOut<T>(interpolateTable(X.begin(), Y.begin(), n, static_cast<SignalReal<T>>(IN)));
+    }
 };
 
-BOOL_GATE(AND, IN1 && IN2)
-BOOL_GATE(OR, IN1 || IN2)
-BOOL_GATE(XOR, IN1 != IN2)
-BOOL_GATE(NOR, !(IN1 || IN2))
-BOOL_GATE(NAND, !(IN1 && IN2))
-#undef BOOL_GATE
+// Banks of the signal blocks, for the arrays of them. They are of REALs and keep each pin of their channels in an
+// array, so that the low pass filters and ramps of every channel are computed in one loop that the compiler vectorizes.
 
-class NOT {
+// A bank of moving averages. The samples are stored by position, each position holding a sample of every channel.
+template<size_t Channels, int Low = 0, size_t Capacity = 128>
+class MOVING_AVG_BANK {
 public:
-    bool IN = false;
-    bool OUT = false;
-    void operator()() { OUT = !IN; }
-};
+    static constexpr size_t WORDS = (Channels + 63) / 64;
+    struct Element { float& IN; int16_t& N; BankBit RESET; float& OUT; };
 
-class ASSIGNMENT {
-public:
-    bool IN = false;
-    bool OUT = false;
-    void operator()() { OUT = IN; }
-};
+    MOVING_AVG_BANK() {
+        for (size_t i = 0; i < Channels; i++) n[i] = static_cast<int16_t>(Capacity);
+    }
 
-// Set/Reset flip-flops
-class SR {
-public:
-    bool S1 = false;
-    bool R = false;
-    bool Q1 = false;
+    Element operator[](int index) {
+        size_t i = static_cast<size_t>(index - Low);
+        return Element{ in[i], n[i], BankBit(reset[i / 64], 1ull << (i % 64)), out[i] };
+    }
 
     void operator()() {
-        if (R) Q1 = false;
-        if (S1) Q1 = true;
+        for (size_t i = 0; i < Channels; i++) {
+            size_t window = n[i] < 1 ? 1 : (static_cast<size_t>(n[i]) > Capacity ? Capacity : static_cast<size_t>(n[i]));
+            if ((reset[i / 64] >> (i % 64)) & 1 || window != size[i]) {
+                size[i] = window;
+                count[i] = 0;
+                head[i] = 0;
+                sums[i].clear();
+            }
+            float* sample = &samples[head[i] * Channels + i];
+            if (count[i] == size[i]) {
+                sums[i].add(-static_cast<double>(*sample));
+            } else {
+                count[i]++;
+            }
+            *sample = in[i];
+            sums[i].add(static_cast<double>(in[i]));
+            head[i] = head[i] + 1 == size[i] ? 0 : head[i] + 1;
+            out[i] = static_cast<float>(sums[i].total / static_cast<double>(count[i]));
+        }
     }
+
+private:
+    alignas(64) float in[Channels] = {};
+    alignas(64) float out[Channels] = {};
+    int16_t n[Channels] = {};
+    uint64_t reset[WORDS] = {};
+    RunningSum sums[Channels] = {};
+    uint32_t size[Channels] = {};
+    uint32_t count[Channels] = {};
+    uint32_t head[Channels] = {};
+    float samples[Capacity * Channels] = {};
 };
 
-class RS {
+// A bank of low pass filters.
+template<size_t N, int Low = 0>
+class LOWPASS_BANK {
 public:
-    bool S = false;
-    bool R1 = false;
-    bool Q1 = false;
+    static constexpr size_t WORDS = (N + 63) / 64;
+    struct Element { float& IN; float& TC; BankBit RESET; float& OUT; };
+
+    Element operator[](int index) {
+        size_t i = static_cast<size_t>(index - Low);
+        return Element{ in[i], tc[i], BankBit(reset[i / 64], 1ull << (i % 64)), out[i] };
+    }
 
     void operator()() {
-        if (S) Q1 = true;
-        if (R1) Q1 = false;
+        bool started = interval.started();
+        float dt = interval.next<float>();
+        if (!started) {
+            for (size_t i = 0; i < N; i++) out[i] = in[i];
+            return;
+        }
+        if (dt > 0) {
+            for (size_t i = 0; i < N; i++) {
+                float lag = (tc[i] > 0 ? tc[i] : 0.0f) + dt;
+                out[i] += (in[i] - out[i]) * (dt / lag);
+            }
+        }
+        for (size_t w = 0; w < WORDS; w++) {
+            forEachBankBit(reset[w], w * 64, [&](size_t i) { out[i] = in[i]; });
+        }
     }
+
+private:
+    alignas(64) float in[N] = {};
+    alignas(64) float tc[N] = {};
+    alignas(64) float out[N] = {};
+    uint64_t reset[WORDS] = {};
+    ScanInterval interval;
 };
 
-// Rising-edge Trigger
-class R_TRIG {
+// A bank of ramp generators.
+template<size_t N, int Low = 0>
+class RAMP_BANK {
 public:
-    bool CLK = false;
-    bool OUT = false;
+    static constexpr size_t WORDS = (N + 63) / 64;
+    struct Element { float& IN; float& RISE; float& FALL; BankBit RESET; float& OUT; BankBit BUSY; };
+
+    Element operator[](int index) {
+        size_t i = static_cast<size_t>(index - Low);
+        uint64_t mask = 1ull << (i % 64);
+        return Element{ in[i], rise[i], fall[i], BankBit(reset[i / 64], mask), out[i], BankBit(busy[i / 64], mask) };
+    }
 
     void operator()() {
-        OUT = CLK && !lastCLK;
-        lastCLK = CLK;
+        bool started = interval.started();
+        float dt = interval.next<float>();
+        if (!started) {
+            for (size_t i = 0; i < N; i++) out[i] = in[i];
+        } else if (dt > 0) {
+            // OUT is IN limited to the band the rates allow since the last call.
+            for (size_t i = 0; i < N; i++) {
+                float up = rise[i] > 0 ? rise[i] : std::numeric_limits<float>::infinity();
+                float down = fall[i] > 0 ? fall[i] : std::numeric_limits<float>::infinity();
+                float high = out[i] + up * dt;
+                float low = out[i] - down * dt;
+                float next = in[i] < high ? in[i] : high;
+                out[i] = next > low ? next : low;
+            }
+        }
+        for (size_t w = 0; w < WORDS; w++) {
+            size_t first = w * 64;
+            forEachBankBit(reset[w], first, [&](size_t i) { out[i] = in[i]; });
+            uint64_t moving = 0;
+            for (size_t i = first; i < N && i < first + 64; i++) {
+                moving |= static_cast<uint64_t>(out[i] != in[i]) << (i - first);
+            }
+            busy[w] = moving;
+        }
     }
 
 private:
-    bool lastCLK = false;
+    alignas(64) float in[N] = {};
+    alignas(64) float rise[N] = {};
+    alignas(64) float fall[N] = {};
+    alignas(64) float out[N] = {};
+    uint64_t reset[WORDS] = {};
+    uint64_t busy[WORDS] = {};
+    ScanInterval interval;
 };
+#pragma endregion
 
-// Falling-edge Trigger
-class F_TRIG {
+#pragma region "Timed Outputs"
+// The timed output blocks drive an output at a time finer than the scan. On a rising edge of EXECUTE the block queues
+// a command, and the timed output thread, which runs at the highest real-time priority, writes it when it is due.
+// Times are in microseconds after the start of the scan that queued the command, so a pulse keeps its place in the
+// cycle however long the scan takes to reach the block. OUTPUT is the address of a %Q output, as '%QX0.3' or
+// '%QW4', resolved again only when it changes. A GPIO or MMIO output is written to the device when the command is
+// due; an output of any other client is made due, so it goes out with the client's next request. Either way the value
+// is also staged into the image, which logic sees from the next scan.
+
+/**
+ * Resolves the output of a timed output block, and starts the timed output thread if it isn't running.
+ * @param address The address, which must be in the %Q space.
+ * @param local Receives the resolved address.
+ * @returns Returns false if the address isn't a valid output.
+ */
+bool openTimedOutput(const char* address, ResolvedAddress& local);
+/**
+ * Queues a command for the timed output thread. This doesn't lock, allocate or wait, and may be called from any task.
+ * @param local The output, as resolved by openTimedOutput().
+ * @param value The value to write. A bit output is set if it isn't 0.
+ * @param due When to write it, in microseconds since the program started.
+ * @param width If not 0, the output is written with 0 this many microseconds after due, which makes a pulse.
+ * @returns Returns false if the queue is full, in which case the command is dropped.
+ */
+bool queueTimedOutput(const ResolvedAddress& local, uint64_t value, uint64_t due, uint64_t width = 0);
+
+/**
+ * The output of a timed output block, which keeps the address it was resolved from.
+ */
+class TimedOutputTarget {
 public:
-    bool CLK = false;
-    bool OUT = false;
+    ResolvedAddress local;
 
-    void operator()() {
-        OUT = !CLK && lastCLK;
-        lastCLK = CLK;
+    /**
+     * Resolves the output, unless it is the one that was resolved last.
+     * @param output The address of the output.
+     * @returns Returns false if the address isn't a valid output.
+     */
+    bool resolve(const IECString<IEC_STRING_DEFAULT_LENGTH>& output) {
+        if (!resolved || std::strcmp(output.c_str(), address.c_str()) != 0) {
+            address = output;
+            resolved = openTimedOutput(address.c_str(), local);
+        }
+        return resolved;
     }
 
 private:
-    bool lastCLK = false;
+    IECString<IEC_STRING_DEFAULT_LENGTH> address;
+    bool resolved = false;
 };
 
-// Up Counter
-class CTU {
+// PULSE_OUT: sets OUTPUT for WIDTH microseconds, starting DELAY microseconds after the scan
+class PULSE_OUT {
 public:
-    bool CU = false;
-    bool R = false;
-    uint16_t PV = 0;
-    uint16_t CV = 0;
-    bool Q = false;
+    bool EXECUTE = false;
+    IECString<IEC_STRING_DEFAULT_LENGTH> OUTPUT;
+    uint32_t DELAY = 0;
+    uint32_t WIDTH = 0;
+    bool BUSY = false;      // Set until the pulse has ended.
+    bool ERROR = false;     // Set if OUTPUT isn't an output, or the queue was full.
 
     void operator()() {
-        if (R) {
-            CV = 0;
-        } else if (CU && !lastCU) {
-            CV++;
+        if (EXECUTE && !lastExecute) {
+            uint64_t due = SCAN_MICROS + DELAY;
+            ERROR = !target.resolve(OUTPUT) || (WIDTH > 0 && !queueTimedOutput(target.local, 1, due, WIDTH));
+            ends = ERROR ? 0 : due + WIDTH;
         }
-        Q = CV >= PV;
-        lastCU = CU;
+        lastExecute = EXECUTE;
+        BUSY = SCAN_MICROS < ends;
     }
 
 private:
-    bool lastCU = false;
+    TimedOutputTarget target;
+    uint64_t ends = 0;
+    bool lastExecute = false;
 };
 
-// Down Counter
-class CTD {
+// SET_OUT_AT: writes VALUE to OUTPUT DELAY microseconds after the scan
+class SET_OUT_AT {
 public:
-    bool CD = false;
-    bool LD = false;
-    uint16_t PV = 0;
-    uint16_t CV = 0;
-    bool Q = false;
+    bool EXECUTE = false;
+    IECString<IEC_STRING_DEFAULT_LENGTH> OUTPUT;
+    uint64_t VALUE = 0;
+    uint32_t DELAY = 0;
+    bool BUSY = false;      // Set until the value has been written.
+    bool ERROR = false;     // Set if OUTPUT isn't an output, or the queue was full.
 
     void operator()() {
-        if (LD) {
-            CV = PV;
-        } else if (CD && !lastCD && CV > 0) {
-            CV--;
+        if (EXECUTE && !lastExecute) {
+            uint64_t due = SCAN_MICROS + DELAY;
+            ERROR = !target.resolve(OUTPUT) || !queueTimedOutput(target.local, VALUE, due);
+            ends = ERROR ? 0 : due;
         }
-        Q = CV == 0;
-        lastCD = CD;
+        lastExecute = EXECUTE;
+        BUSY = SCAN_MICROS < ends;
     }
 
 private:
-    bool lastCD = false;
+    TimedOutputTarget target;
+    uint64_t ends = 0;
+    bool lastExecute = false;
 };
+#pragma endregion
 
-// Up/Down Counter
-class CTUD {
+#pragma region "Sequential Function Charts"
+// A sequential function chart is compiled to static tables of its steps, transitions and action associations, and
+// a SfcChart that keeps the active steps as a bitset. Each call runs the actions of the active steps and then tests
+// only the transitions that leave them, so a scan costs in proportion to the active steps rather than to the size of
+// the chart. The transitions leaving a step are tested in the order they were written and the first that is clear
+// fires; one whose source steps aren't all active isn't tested. All transitions are tested against the steps active
+// when the scan started, and the steps they lead to are active from the next scan.
+
+/**
+ * The qualifiers of an action association.
+ */
+enum SfcQualifier : uint8_t {
+    SFC_N,  // While the step is active.
+    SFC_S,  // Set: from when the step activates until an R of the action.
+    SFC_R,  // Reset: ends an S of the action, and overrides its other associations while the step is active.
+    SFC_P,  // Pulse: for the scan after the step activates, with no last run.
+    SFC_P0, // Pulse: for the scan after the step deactivates, with no last run.
+    SFC_L,  // Time limited: while the step is active, for up to its duration.
+    SFC_D   // Time delayed: while the step is active, from when it has been for its duration.
+};
+
+/**
+ * A step of a chart: the ranges of its transitions in SfcTable::stepTransitions and of its action associations.
+ */
+struct SfcStep {
+    uint16_t firstTransition;
+    uint16_t transitions;
+    uint16_t firstAssociation;
+    uint16_t associations;
+};
+
+/**
+ * A transition of a chart: its source steps and then its target steps, from firstLink in SfcTable::links.
+ */
+struct SfcTransition {
+    uint16_t firstLink;
+    uint16_t sources;
+    uint16_t targets;
+};
+
+/**
+ * An action associated with a step, with its qualifier and, for L and D, its duration in milliseconds.
+ */
+struct SfcAssociation {
+    uint16_t action;
+    SfcQualifier qualifier;
+    uint32_t duration;
+};
+
+/**
+ * The static tables of a chart, as the compiler emits them.
+ */
+struct SfcTable {
+    const SfcStep* steps;
+    const uint16_t* stepTransitions;
+    const SfcTransition* transitions;
+    const uint16_t* links;
+    const SfcAssociation* associations;
+    const uint16_t* initial;
+    uint16_t initialSteps;
+};
+
+/**
+ * The flags of a step that ST reads as Step.X and Step.T: whether it is active, and the milliseconds since it was
+ * last activated, which are kept after it deactivates.
+ */
+struct SfcStepFlags {
+    bool X = false;
+    uint32_t T = 0;
+};
+
+/**
+ * The state of a sequential function chart of Steps steps and Actions actions.
+ */
+template<size_t Steps, size_t Actions>
+class SfcChart {
 public:
-    bool CU = false;
-    bool CD = false;
-    bool R = false;
-    bool LD = false;
-    uint16_t PV = 0;
-    uint16_t CV = 0;
-    bool QU = false;
-    bool QD = false;
+    static constexpr size_t STEP_WORDS = (Steps + 63) / 64;
+    static constexpr size_t ACTION_WORDS = Actions / 64 + 1;
 
-    void operator()() {
-        if (R) {
-            CV = 0;
-        } else if (LD) {
-            CV = PV;
-        } else {
-            if (CU && !lastCU) CV++;
-            if (CD && !lastCD && CV > 0) CV--;
+    SfcStepFlags steps[Steps];
+
+    /**
+     * Runs a scan of the chart: the actions of the active steps, and then the transitions that leave them.
+     * @param table The tables of the chart.
+     * @param condition Called with the index of a transition, returns whether its condition is true.
+     * @param action Called with the index of each action that is active, with true, and of each action that was
+     * active in the previous scan but no longer is, with false, so it can run a last time. An action that only a P or
+     * P0 qualified has no last run.
+     */
+    template<typename Condition, typename Action>
+    void operator()(const SfcTable& table, Condition&& condition, Action&& action) {
+        uint32_t now = static_cast<uint32_t>(scanTime());
+        if (!started) {
+            started = true;
+            for (uint16_t i = 0; i < table.initialSteps; i++) {
+                size_t s = table.initial[i];
+                active[s / 64] |= 1ull << (s % 64);
+                entered[s / 64] |= 1ull << (s % 64);
+                activate(s, now);
+            }
         }
 
-        QU = CV >= PV;
-        QD = CV == 0;
+        uint64_t qualified[ACTION_WORDS] = {};
+        uint64_t resets[ACTION_WORDS] = {};
+        uint64_t pulsed[ACTION_WORDS] = {};
+        // Collects the actions a step qualifies, or, for a step that deactivated in the last scan, its P0 actions.
+        auto associate = [&](size_t s, bool deactivated) {
+            const SfcStep& step = table.steps[s];
+            for (uint16_t a = step.firstAssociation; a < step.firstAssociation + step.associations; a++) {
+                const SfcAssociation& association = table.associations[a];
+                uint64_t* target = qualified;
+                bool on = !deactivated;
+                switch (association.qualifier) {
+                    case SFC_N: break;
+                    case SFC_S: target = stored; break;
+                    case SFC_R: target = resets; break;
+                    case SFC_P: target = pulsed; on = on && ((entered[s / 64] >> (s % 64)) & 1) != 0; break;
+                    case SFC_P0: target = pulsed; on = deactivated; break;
+                    case SFC_L: on = on && steps[s].T < association.duration; break;
+                    case SFC_D: on = on && steps[s].T >= association.duration; break;
+                }
+                if (on) target[association.action / 64] |= 1ull << (association.action % 64);
+            }
+        };
+        for (size_t w = 0; w < STEP_WORDS; w++) {
+            forEachBankBit(active[w], w * 64, [&](size_t s) {
+                steps[s].T = now - activation[s];
+                associate(s, false);
+            });
+            forEachBankBit(left[w], w * 64, [&](size_t s) { associate(s, true); });
+        }
+        for (size_t w = 0; w < ACTION_WORDS; w++) {
+            stored[w] &= ~resets[w];
+            uint64_t held = (qualified[w] | stored[w]) & ~resets[w];
+            uint64_t running = held | (pulsed[w] & ~resets[w]);
+            forEachBankBit(running | ran[w], w * 64, [&](size_t a) { action(a, ((running >> (a % 64)) & 1) != 0); });
+            ran[w] = held;
+        }
 
-        lastCU = CU;
-        lastCD = CD;
+        uint64_t cleared[STEP_WORDS] = {};
+        uint64_t reached[STEP_WORDS] = {};
+        for (size_t w = 0; w < STEP_WORDS; w++) {
+            forEachBankBit(active[w], w * 64, [&](size_t s) {
+                // A step that a transition of this scan has already left, as one of its sources, leaves no other.
+                if ((cleared[s / 64] >> (s % 64)) & 1) return;
+                const SfcStep& step = table.steps[s];
+                for (uint16_t i = step.firstTransition; i < step.firstTransition + step.transitions; i++) {
+                    size_t t = table.stepTransitions[i];
+                    const SfcTransition& transition = table.transitions[t];
+                    const uint16_t* links = table.links + transition.firstLink;
+                    bool enabled = true;
+                    for (uint16_t k = 0; k < transition.sources && enabled; k++) {
+                        enabled = ((active[links[k] / 64] & ~cleared[links[k] / 64]) >> (links[k] % 64)) & 1;
+                    }
+                    if (!enabled || !condition(t)) continue;
+                    for (uint16_t k = 0; k < transition.sources; k++) {
+                        cleared[links[k] / 64] |= 1ull << (links[k] % 64);
+                    }
+                    for (uint16_t k = transition.sources; k < transition.sources + transition.targets; k++) {
+                        reached[links[k] / 64] |= 1ull << (links[k] % 64);
+                    }
+                    return;
+                }
+            });
+        }
+        for (size_t w = 0; w < STEP_WORDS; w++) {
+            forEachBankBit(cleared[w] & ~reached[w], w * 64, [&](size_t s) { steps[s].X = false; });
+            forEachBankBit(reached[w], w * 64, [&](size_t s) { activate(s, now); });
+            active[w] = (active[w] & ~cleared[w]) | reached[w];
+            left[w] = cleared[w] & ~reached[w];
+            entered[w] = reached[w];
+        }
     }
 
 private:
-    bool lastCU = false;
-    bool lastCD = false;
+    void activate(size_t s, uint32_t now) {
+        steps[s].X = true;
+        steps[s].T = 0;
+        activation[s] = now;
+    }
+
+    uint64_t active[STEP_WORDS] = {};
+    uint64_t entered[STEP_WORDS] = {};
+    uint64_t left[STEP_WORDS] = {};
+    uint32_t activation[Steps] = {};
+    uint64_t stored[ACTION_WORDS] = {};
+    uint64_t ran[ACTION_WORDS] = {};
+    bool started = false;
 };
+#pragma endregion
 
-// Comparison blocks
-#define COMP_BLOCK(NAME, EXPR) \
-class NAME { \
-public: \
-    uint32_t IN1 = 0, IN2 = 0; \
-    bool OUT = false; \
-    void operator()() { OUT = (EXPR); } \
+#pragma region "Variable Browsing"
+/**
+ * The kinds of value a variable browsed from the OPC UA server can have.
+ */
+enum class BrowseKind : uint8_t {
+    Opaque,     // A value that isn't browsed, such as a bank of function blocks.
+    Bool,
+    Int8,
+    UInt8,
+    Int16,
+    UInt16,
+    Int32,
+    UInt32,
+    Int64,
+    UInt64,
+    Float,
+    Double,
+    Fixed,      // A fixed point REAL of a program built with fixedReal, served as a Float.
+    String,     // A STRING.
+    Object,     // A program, function block instance or STRUCT, with members.
+    Array       // An ARRAY, with elements.
 };
 
-COMP_BLOCK(EQ, IN1 == IN2)
-COMP_BLOCK(NE, IN1 != IN2)
-COMP_BLOCK(LT, IN1 < IN2)
-COMP_BLOCK(GT, IN1 > IN2)
-COMP_BLOCK(GE, IN1 >= IN2)
-COMP_BLOCK(LE, IN1 <= IN2)
-#undef COMP_BLOCK
+struct BrowseType;
 
-class MOVE {
-public:
-    uint32_t IN = 0;
-    uint32_t OUT = 0;
-    void operator()() { OUT = IN; }
+/**
+ * A member of a program, function block or STRUCT, as browsed from the OPC UA server.
+ */
+struct BrowseMember {
+    const char* name;                   // The name of the member.
+    void* (*address)(void* owner);      // Gets the address of the member in an instance of its owner.
+    const BrowseType* (*type)();        // Gets the type of the member.
+    uint64_t mask;                      // For a packed BOOL, the bit of the word at the address, otherwise 0.
 };
 
-class SEL {
-public:
-    bool G = false;
-    uint32_t IN0 = 0, IN1 = 0;
-    uint32_t OUT = 0;
-    void operator()() { OUT = G ? IN1 : IN0; }
+/**
+ * Describes the layout of a type for the OPC UA server to browse and read variables of it in place, without a node
+ * for each of them. An Object has members sorted by name, an Array has elements and a String has text.
+ */
+struct BrowseType {
+    BrowseKind kind;
+    const BrowseMember* members = nullptr;              // The members of an Object, sorted by name.
+    size_t count = 0;                                   // The number of members.
+    int64_t low = 0;                                    // The lower bound of an Array.
+    size_t length = 0;                                  // The number of elements of an Array.
+    void* (*element)(void* array, size_t i) = nullptr;  // Gets the address of an element of an Array.
+    const BrowseType* (*elementType)() = nullptr;       // Gets the type of the elements of an Array.
+    IECStringView<char> (*text)(const void* value) = nullptr;   // Gets the characters of a String.
 };
 
-class MUX {
-public:
-    bool K = false;
-    uint32_t IN0 = 0, IN1 = 0;
-    uint32_t OUT = 0;
-    void operator()() { OUT = K ? IN1 : IN0; }
-};
+/**
+ * Gets the kind of an elementary type.
+ * @tparam T The type.
+ * @returns Returns the kind, or BrowseKind::Opaque if the type isn't elementary.
+ */
+template<typename T>
+constexpr BrowseKind browseKind() {
+    if (std::is_same<T, bool>::value) return BrowseKind::Bool;
+    if (std::is_same<T, int8_t>::value) return BrowseKind::Int8;
+    if (std::is_same<T, uint8_t>::value) return BrowseKind::UInt8;
+    if (std::is_same<T, int16_t>::value) return BrowseKind::Int16;
+    if (std::is_same<T, uint16_t>::value) return BrowseKind::UInt16;
+    if (std::is_same<T, int32_t>::value) return BrowseKind::Int32;
+    if (std::is_same<T, uint32_t>::value) return BrowseKind::UInt32;
+    if (std::is_same<T, int64_t>::value) return BrowseKind::Int64;
+    if (std::is_same<T, uint64_t>::value) return BrowseKind::UInt64;
+    if (std::is_same<T, float>::value) return BrowseKind::Float;
+    if (std::is_same<T, double>::value) return BrowseKind::Double;
+    if (isQFixed<T>) return BrowseKind::Fixed;
+    return BrowseKind::Opaque;
+}
 
-class MIN {
-public:
-    uint32_t IN1 = 0, IN2 = 0;
-    uint32_t OUT = 0;
-    void operator()() { OUT = std::min(IN1, IN2); }
+/**
+ * Gets the browse type of a type. The compiler specializes it for the function blocks and STRUCT types of the
+ * program, and the runtime for its standard function blocks.
+ * @tparam T The type.
+ */
+template<typename T>
+struct BrowseTraits {
+    static const BrowseType* type() {
+        static const BrowseType browse{ browseKind<T>() };
+        return &browse;
+    }
 };
 
-class MAX {
-public:
-    uint32_t IN1 = 0, IN2 = 0;
-    uint32_t OUT = 0;
-    void operator()() { OUT = std::max(IN1, IN2); }
+template<typename T, int64_t Low, int64_t High>
+struct BrowseTraits<IECArray<T, Low, High>> {
+    static const BrowseType* type() {
+        static const BrowseType browse{ BrowseKind::Array, nullptr, 0, Low, IECArray<T, Low, High>::N,
+            [](void* array, size_t i) -> void* { return static_cast<IECArray<T, Low, High>*>(array)->begin() + i; },
+            &BrowseTraits<T>::type };
+        return &browse;
+    }
 };
 
-class LIMIT {
-public:
-    uint32_t MN = 0, IN = 0, MX = 0;
-    uint32_t OUT = 0;
-    void operator()() {
-        if (IN < MN) OUT = MN;
-        else if (IN > MX) OUT = MX;
-        else OUT = IN;
+template<size_t N>
+struct BrowseTraits<IECString<N, char>> {
+    static const BrowseType* type() {
+        static const BrowseType browse{ BrowseKind::String, nullptr, 0, 0, 0, nullptr, nullptr,
+            [](const void* value) -> IECStringView<char> { return *static_cast<const IECString<N, char>*>(value); } };
+        return &browse;
     }
 };
 
+/**
+ * A row of a BrowseMember table for a member of Owner, which must be listed in strcmp() order of their names.
+ */
+#define NODALIS_BROWSE_MEMBER(Owner, Name) \
+    { #Name, [](void* owner) -> void* { return &static_cast<Owner*>(owner)->Name; }, \
+      &BrowseTraits<typename std::remove_cv<decltype(std::declval<Owner&>().Name)>::type>::type, 0 }
+/**
+ * A row of a BrowseMember table for a BOOL of Owner that is packed into a bit of a word.
+ */
+#define NODALIS_BROWSE_BIT(Owner, Name, Word, Bit) \
+    { #Name, [](void* owner) -> void* { return &static_cast<Owner*>(owner)->Word; }, &BrowseTraits<bool>::type, 1ull << (Bit) }
+/**
+ * A row of a BrowseMember table for a global variable, which doesn't have an owner.
+ */
+#define NODALIS_BROWSE_GLOBAL(Name) \
+    { #Name, [](void*) -> void* { return &Name; }, \
+      &BrowseTraits<typename std::remove_cv<typename std::remove_reference<decltype(Name)>::type>::type>::type, 0 }
+
+/**
+ * Defines the browse type of a function block of the runtime from its members.
+ */
+#define NODALIS_BROWSE_OBJECT(Block, ...) \
+    static const BrowseType* type() { \
+        using Owner = Block; \
+        static const BrowseMember members[] = { __VA_ARGS__ }; \
+        static const BrowseType browse{ BrowseKind::Object, members, sizeof(members) / sizeof(members[0]) }; \
+        return &browse; \
+    }
+
+template<> struct BrowseTraits<TP> {
+    NODALIS_BROWSE_OBJECT(TP, NODALIS_BROWSE_MEMBER(Owner, ET), NODALIS_BROWSE_MEMBER(Owner, IN),
+        NODALIS_BROWSE_MEMBER(Owner, PT), NODALIS_BROWSE_MEMBER(Owner, Q))
+};
+template<> struct BrowseTraits<TON> {
+    NODALIS_BROWSE_OBJECT(TON, NODALIS_BROWSE_MEMBER(Owner, ET), NODALIS_BROWSE_MEMBER(Owner, IN),
+        NODALIS_BROWSE_MEMBER(Owner, PT), NODALIS_BROWSE_MEMBER(Owner, Q))
+};
+template<> struct BrowseTraits<TOF> {
+    NODALIS_BROWSE_OBJECT(TOF, NODALIS_BROWSE_MEMBER(Owner, ET), NODALIS_BROWSE_MEMBER(Owner, IN),
+        NODALIS_BROWSE_MEMBER(Owner, PT), NODALIS_BROWSE_MEMBER(Owner, Q))
+};
+template<> struct BrowseTraits<SR> {
+    NODALIS_BROWSE_OBJECT(SR, NODALIS_BROWSE_MEMBER(Owner, Q1), NODALIS_BROWSE_MEMBER(Owner, R),
+        NODALIS_BROWSE_MEMBER(Owner, S1))
+};
+template<> struct BrowseTraits<RS> {
+    NODALIS_BROWSE_OBJECT(RS, NODALIS_BROWSE_MEMBER(Owner, Q1), NODALIS_BROWSE_MEMBER(Owner, R1),
+        NODALIS_BROWSE_MEMBER(Owner, S))
+};
+template<> struct BrowseTraits<R_TRIG> {
+    NODALIS_BROWSE_OBJECT(R_TRIG, NODALIS_BROWSE_MEMBER(Owner, CLK), NODALIS_BROWSE_MEMBER(Owner, OUT))
+};
+template<> struct BrowseTraits<F_TRIG> {
+    NODALIS_BROWSE_OBJECT(F_TRIG, NODALIS_BROWSE_MEMBER(Owner, CLK), NODALIS_BROWSE_MEMBER(Owner, OUT))
+};
+template<typename T> struct BrowseTraits<CTU<T>> {
+    NODALIS_BROWSE_OBJECT(CTU<T>, NODALIS_BROWSE_MEMBER(Owner, CU), NODALIS_BROWSE_MEMBER(Owner, CV),
+        NODALIS_BROWSE_MEMBER(Owner, PV), NODALIS_BROWSE_MEMBER(Owner, Q), NODALIS_BROWSE_MEMBER(Owner, R))
+};
+template<typename T> struct BrowseTraits<CTD<T>> {
+    NODALIS_BROWSE_OBJECT(CTD<T>, NODALIS_BROWSE_MEMBER(Owner, CD), NODALIS_BROWSE_MEMBER(Owner, CV),
+        NODALIS_BROWSE_MEMBER(Owner, LD), NODALIS_BROWSE_MEMBER(Owner, PV), NODALIS_BROWSE_MEMBER(Owner, Q))
+};
+template<typename T> struct BrowseTraits<CTUD<T>> {
+    NODALIS_BROWSE_OBJECT(CTUD<T>, NODALIS_BROWSE_MEMBER(Owner, CD), NODALIS_BROWSE_MEMBER(Owner, CU),
+        NODALIS_BROWSE_MEMBER(Owner, CV), NODALIS_BROWSE_MEMBER(Owner, LD), NODALIS_BROWSE_MEMBER(Owner, PV),
+        NODALIS_BROWSE_MEMBER(Owner, QD), NODALIS_BROWSE_MEMBER(Owner, QU), NODALIS_BROWSE_MEMBER(Owner, R))
+};
 
+/**
+ * Publishes the variables of a program, or the globals, from the OPC UA server, under the Programs folder of its
+ * namespace urn:nodalis:programs. No node is created for them: the server's nodestore makes up the node of a
+ * variable, from its browse type, when a client browses or reads it, and drops it again once the request has been
+ * answered, so the memory the server uses doesn't grow with the size of the program. The node IDs are the dotted
+ * paths of the variables, such as Main.T1.ET or Main.A[3]. The variables are read-only, and are read while the tasks
+ * run. This must be called before the server is started.
+ * @param name The name of the program, or GLOBALS.
+ * @param instance The instance of the program, or nullptr for the globals, whose members have no owner.
+ * @param type The browse type of the program.
+ */
+void browseOPCUAProgram(const char* name, void* instance, const BrowseType* type);
 #pragma endregion
@@ -0,0 +1,187 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC IO Driver Plugins
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * A C interface for protocol drivers built as shared libraries, so that a protocol the runtime doesn't have can be
+ * added without building the runtime again. A mapping whose Protocol isn't built into the runtime is looked up in the
+ * driver directory (--io-drivers <dir>, by default the drivers directory beside the executable) as
+ * libnodalis-<protocol>.so, libnodalis-<protocol>.dylib or nodalis-<protocol>.dll, with the protocol in lower case.
+ * The library is loaded once, when the first mapping of the protocol is, and exports nodalis_driver().
+ *
+ * The runtime creates an instance of the driver for each endpoint, as it does a client of a built in protocol, and
+ * gives it the runtime's batching and scheduling: the mappings that are due in a poll are handed to submit() as one
+ * batch of parsed requests, with the values of the writes taken from one published image, and the instance runs on
+ * the shared IO reactor. It completes each request through the host, either in submit() or later in service(),
+ * which the reactor calls when the instance's descriptor is readable or the instance asked for it with wake().
+ *
+ * Every function of an instance, and the host's complete(), are called on the thread that drives the instance, so
+ * an instance needs no locking of its own. Only the host's wake() may be called from another thread. Every request
+ * must be completed, as NODALIS_IO_FAILED if it timed out, since the next batch is only submitted once the last one
+ * has completed.
+ */
+#pragma once
+#ifndef NODALISDRIVER_H
+#define NODALISDRIVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#define NODALIS_DRIVER_API __declspec(dllexport)
+#else
+#define NODALIS_DRIVER_API __attribute__((visibility("default")))
+#endif
+
+/**
+ * The version of this interface, which changes when a structure's layout or a function's meaning does.
+ */
+#define NODALIS_DRIVER_ABI_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The results a request is completed with, which are those of the runtime's IOStatus.
+ */
+enum {
+    NODALIS_IO_GOOD = 1,        // The device read or wrote the value.
+    NODALIS_IO_FAILED = 2,      // The request failed or timed out.
+    NODALIS_IO_REFUSED = 3,     // The device answered with an error.
+    NODALIS_IO_INVALID = 4      // The request can't be made. The quality of an input is left as it is.
+};
+
+/**
+ * A mapping added to an instance.
+ */
+typedef struct NodalisIOMapping {
+    const char* moduleID;
+    const char* modulePort;
+    const char* remoteAddress;
+    const char* properties;     // The protocol properties, as the text of a JSON object.
+    uint8_t output;             // 1 for an output, 0 for an input.
+    uint8_t width;              // 1, 8, 16, 32 or 64.
+    int32_t interval;           // The poll interval, in milliseconds.
+} NodalisIOMapping;
+
+/**
+ * A read or a write of a batch.
+ */
+typedef struct NodalisIORequest {
+    uint64_t value;             // The value to write. Unused for a read, whose value is passed to complete().
+    int32_t handle;             // The handle map() returned for the mapping.
+    uint8_t output;             // 1 for a write, 0 for a read.
+    uint8_t width;
+    uint16_t reserved;
+    uint32_t batch;             // Identify the request to the host. An instance may keep a copy of the request
+    uint32_t index;             // instead of the request itself, and complete the copy.
+} NodalisIORequest;
+
+/**
+ * What the runtime gives an instance when it creates it.
+ */
+typedef struct NodalisDriverHost {
+    void* client;               // Passed back to each function of the host.
+    /**
+     * Completes a request. A request that was already completed, or of a batch that was abandoned when the
+     * connection was lost, is ignored.
+     * @param client The host's client.
+     * @param request The request, or a copy of it.
+     * @param status NODALIS_IO_GOOD, NODALIS_IO_FAILED, NODALIS_IO_REFUSED or NODALIS_IO_INVALID.
+     * @param value The value read, for a good read.
+     */
+    void (*complete)(void* client, const NodalisIORequest* request, int status, uint64_t value);
+    /**
+     * Counts a request or a frame sent to the device, for the client's diagnostics and adaptive polling.
+     * @param client The host's client.
+     * @param succeeded Whether the device answered without an error.
+     * @param micros The round trip time, in microseconds.
+     */
+    void (*counted)(void* client, int succeeded, uint64_t micros);
+    /**
+     * Writes a line to the runtime's log.
+     * @param client The host's client.
+     * @param message The line, without a newline.
+     */
+    void (*log)(void* client, const char* message);
+    /**
+     * Asks the runtime to call service() soon, on the thread that drives the instance. This may be called from any
+     * thread, such as one of the instance's own.
+     * @param client The host's client.
+     */
+    void (*wake)(void* client);
+} NodalisDriverHost;
+
+/**
+ * A driver, as nodalis_driver() returns it. The optional functions may be null.
+ */
+typedef struct NodalisDriver {
+    int abiVersion;             // NODALIS_DRIVER_ABI_VERSION.
+    const char* protocol;       // The Protocol of the mappings it serves, in upper case, like "ACME-FAST".
+    /**
+     * Creates an instance for an endpoint.
+     * @param host The host, which lives as long as the instance.
+     * @returns Returns the instance, or null if it can't be created.
+     */
+    void* (*create)(const NodalisDriverHost* host);
+    /**
+     * Closes the connection of an instance, if it is open, and destroys it.
+     */
+    void (*destroy)(void* instance);
+    /**
+     * Parses a mapping added to an instance.
+     * @returns Returns the handle of the mapping, which its requests carry, or -1 if it can't be served.
+     */
+    int32_t (*map)(void* instance, const NodalisIOMapping* mapping);
+    /**
+     * Opens the connection of an instance. It should not block for longer than a poll.
+     * @returns Returns 1 if the instance is connected, or 0 to try again after the reconnect delay.
+     */
+    int (*connect)(void* instance);
+    /**
+     * Starts the requests of a batch, and completes those it can at once.
+     * @param requests The requests, in the order the mappings were added. They are only valid during the call.
+     * @param count The number of requests.
+     * @returns Returns 1, or 0 if the connection was lost, in which case the requests left are failed and the
+     * instance is connected again after the reconnect delay.
+     */
+    int (*submit)(void* instance, const NodalisIORequest* requests, size_t count);
+    /**
+     * Optional. Gets the socket or file descriptor the reactor watches for the instance, or -1 for none. It is read
+     * after each successful connect().
+     */
+    int (*descriptor)(void* instance);
+    /**
+     * Optional. Handles what arrived on the descriptor, or what the instance woke the host for, completing requests.
+     * @returns Returns 1, or 0 if the connection was lost.
+     */
+    int (*service)(void* instance);
+} NodalisDriver;
+
+/**
+ * The entry point of a driver library.
+ * @returns Returns the driver.
+ */
+typedef const NodalisDriver* (*NodalisDriverEntry)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NODALISDRIVER_H
@@ -0,0 +1,63 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Program Host
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * The main of the host executable of a program compiled with onlineChange. It starts the runtime as the main of a
+ * compiled program would, with the program's tasks, IO maps and symbols taken from its library, or from the library
+ * of each resource it is given.
+ */
+#include "programhost.h"
+#include <set>
+
+int main(int argc, char* argv[]) {
+  RuntimeOptions options = parseRuntimeOptions(argc, argv);
+  applyRuntimeProfile(options);
+  configureOPCUAServer(options);
+  bool shared = options.programFiles.size() > 1;
+  std::vector<std::unique_ptr<ProgramHost>> hosts;
+  std::set<std::string> names;
+  for(const auto& file : options.programFiles){
+    hosts.push_back(std::make_unique<ProgramHost>(options, file, shared));
+    if(!hosts.back()->load()){
+      return 1;
+    }
+    if(!names.insert(hosts.back()->name()).second){
+      nodalisLog() << "Could not load " << file << ": another resource is named " << hosts.back()->name() << "\n";
+      return 1;
+    }
+  }
+  TaskScheduler scheduler(options);
+  for(auto& host : hosts){
+    host->start(scheduler);
+  }
+  if(!options.ioConfig.empty() && !mapIOConfig(options.ioConfig)){
+    return 1;
+  }
+  scheduler.setCycleHook([&hosts](){
+    for(auto& host : hosts){
+      host->poll();
+    }
+  });
+  startOPCUAServer();
+  for(auto& host : hosts){
+    nodalisLog() << host->name() << " is running!\n";
+  }
+  scheduler.run();
+  return 0;
+}
@@ -0,0 +1,74 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC IO Library
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+#include "nodalisio.h"
+#include "nodalis.h"
+#include "netvar.h"
+
+int nodalis_io_version(void){
+    return NODALIS_IO_ABI_VERSION;
+}
+
+size_t nodalis_io_image_bytes(void){
+    return PROCESS_IMAGE_BYTES;
+}
+
+size_t nodalis_io_space_bytes(char space){
+    switch(space){
+        case 'I': return INPUT_IMAGE_BYTES;
+        case 'Q': return OUTPUT_IMAGE_BYTES;
+        case 'M': return MEMORY_IMAGE_BYTES;
+        default: return 0;
+    }
+}
+
+void nodalis_io_map(const char* map){
+    if(map != nullptr){
+        mapIO(map);
+    }
+}
+
+void nodalis_io_start(int ioThreads, const char* backend){
+    startIO(ioThreads, backend != nullptr ? backend : "");
+}
+
+void nodalis_io_poll(void){
+    superviseIO();
+}
+
+int nodalis_io_exchange(uint64_t* image, size_t bytes){
+    if(image == nullptr || bytes != PROCESS_IMAGE_BYTES){
+        return -1;
+    }
+    // MEMORY stands in for the host's image: it takes the lines the host's scan changed, marked as written so that
+    // they are published, then the staged inputs, and goes back to the host whole.
+    uint64_t lines[IMAGE_LINE_WORDS];
+    copyChangedLines(MEMORY, image, lines);
+#if NODALIS_DIRTY_TRACKING
+    for(size_t word = 0; word < IMAGE_LINE_WORDS; word++){
+        DIRTY_LINES[word] |= lines[word];
+    }
+#endif
+    latchInputs();
+    copyChangedLines(image, MEMORY, nullptr);
+    commitOutputs();
+    publishNetworkVariables();
+    return 0;
+}
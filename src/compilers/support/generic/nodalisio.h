@@ -0,0 +1,102 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC IO Library
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * A C interface to the runtime's IO clients, so that a host written in another language (the jint PLC) can run its
+ * IO on the same Modbus, OPC UA and BACnet clients as the C++ runtime, with their coalescing, pipelining, reactor
+ * threads and COV subscriptions. The runtime is built into a shared library with this interface, and the host keeps
+ * its own process image, laid out like the runtime's, which it exchanges with the library once per scan.
+ *
+ * The functions are not thread safe with respect to each other: the host calls them from its scan thread. The IO
+ * clients themselves run on the library's threads once nodalis_io_start() has been called.
+ */
+#pragma once
+#ifndef NODALISIO_H
+#define NODALISIO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#define NODALIS_IO_API __declspec(dllexport)
+#else
+#define NODALIS_IO_API __attribute__((visibility("default")))
+#endif
+
+/**
+ * The version of this interface, which changes when a function's signature or meaning does.
+ */
+#define NODALIS_IO_ABI_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Gets the version of the interface the library was built with.
+ * @returns Returns NODALIS_IO_ABI_VERSION.
+ */
+NODALIS_IO_API int nodalis_io_version(void);
+
+/**
+ * Gets the size of the library's process image, which the host's image must match.
+ * @returns Returns the size in bytes of %I, %Q and %M together.
+ */
+NODALIS_IO_API size_t nodalis_io_image_bytes(void);
+
+/**
+ * Gets the size of one of the library's memory spaces. The spaces follow each other in the order %I, %Q, %M.
+ * @param space 'I', 'Q' or 'M'.
+ * @returns Returns the size of the space in bytes, or 0 for another space.
+ */
+NODALIS_IO_API size_t nodalis_io_space_bytes(char space);
+
+/**
+ * Maps a point, creating the client of its module or adding it to the existing one.
+ * @param map The JSON of the mapping, as the compiler writes it for mapIO().
+ */
+NODALIS_IO_API void nodalis_io_map(const char* map);
+
+/**
+ * Starts the IO clients on background threads. Until it is called, the host polls them with nodalis_io_poll().
+ * @param ioThreads The number of reactor threads, or 0 to give every client its own thread.
+ * @param backend The reactor backend, as for --io-backend, or NULL for the default.
+ */
+NODALIS_IO_API void nodalis_io_start(int ioThreads, const char* backend);
+
+/**
+ * Polls the IO clients on the calling thread. Does nothing once IO has been started.
+ */
+NODALIS_IO_API void nodalis_io_poll(void);
+
+/**
+ * Exchanges the host's process image with the IO clients. The host's image is taken as the logic's image of the
+ * scan that just ended, the inputs the clients have received since the last exchange are applied to it, and the
+ * result is published to the clients as the outputs they write. Only the lines that differ are copied each way.
+ * @param image The host's process image, nodalis_io_image_bytes() long and aligned to 8 bytes.
+ * @param bytes The size of the host's image.
+ * @returns Returns 0, or -1 if the size of the image doesn't match the library's.
+ */
+NODALIS_IO_API int nodalis_io_exchange(uint64_t* image, size_t bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NODALISIO_H
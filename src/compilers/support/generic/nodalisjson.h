@@ -0,0 +1,44 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC runtime JSON support
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * JSON is only parsed by the runtime, when IO maps and configuration files are loaded, so nlohmann::json is included
+ * by the runtime sources through this header and never by nodalis.h, which every generated program includes.
+ */
+#pragma once
+
+#define JSON_USE_IMPLICIT_CONVERSIONS 1
+#define JSON_USE_WIDE_STRING 1
+#include "json.hpp"
+#include "nodalis.h"
+
+using json = nlohmann::json;
+
+/**
+ * Parses the protocol properties of a map, which IOMap keeps as JSON text.
+ * @param map The map.
+ * @returns Returns the properties as an object, or null if there are none or they can't be parsed.
+ */
+inline json protocolProperties(const IOMap& map) {
+    if (map.additionalProperties.empty()) {
+        return json();
+    }
+    json config = json::parse(map.additionalProperties, nullptr, false);
+    return config.is_object() ? config : json();
+}
@@ -0,0 +1,129 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC runtime logging
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * The runtime writes its messages with nodalisLog() rather than std::cout, as in
+ * nodalisLog() << "Mapped " << count << " points\n", so that neither it nor the programs need iostream. The message is
+ * formatted into a buffer with snprintf and written with one fwrite when the statement ends, so the messages of
+ * different threads never interleave. Numbers are formatted as an ostream formats them by default: integers in
+ * decimal, or in hex with logHex(), and floating point values with six significant digits.
+ */
+#pragma once
+#ifndef NODALISLOG_H
+#define NODALISLOG_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <type_traits>
+
+/**
+ * An integer to be written in hex, as made by logHex().
+ */
+struct LogHex {
+    unsigned long long value;
+};
+
+/**
+ * Marks an integer to be written in hex, without a prefix.
+ * @param value The integer.
+ * @returns Returns the integer to write.
+ */
+template<typename T>
+inline LogHex logHex(T value) {
+    return LogHex{ static_cast<unsigned long long>(static_cast<typename std::make_unsigned<T>::type>(value)) };
+}
+
+/**
+ * Text formatted with <<, as a message to log or a diagnostic.
+ */
+class LogText {
+public:
+    LogText& operator<<(const char* value) { text += value == nullptr ? "(null)" : value; return *this; }
+    LogText& operator<<(const std::string& value) { text += value; return *this; }
+    LogText& operator<<(char value) { text += value; return *this; }
+    LogText& operator<<(signed char value) { text += static_cast<char>(value); return *this; }
+    LogText& operator<<(unsigned char value) { text += static_cast<char>(value); return *this; }
+    LogText& operator<<(bool value) { text += value ? '1' : '0'; return *this; }
+    LogText& operator<<(const void* value) { return format("%p", value); }
+    LogText& operator<<(double value) { return format("%g", value); }
+    LogText& operator<<(LogHex value) { return format("%llx", value.value); }
+
+    template<typename T, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, int>::type = 0>
+    LogText& operator<<(T value) { return format("%lld", static_cast<long long>(value)); }
+    template<typename T, typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value, int>::type = 0>
+    LogText& operator<<(T value) { return format("%llu", static_cast<unsigned long long>(value)); }
+    template<typename T, typename std::enable_if<std::is_enum<T>::value, int>::type = 0>
+    LogText& operator<<(T value) { return *this << static_cast<typename std::underlying_type<T>::type>(value); }
+
+    /**
+     * Appends characters that need not end with a null.
+     * @param data The characters.
+     * @param size The number of characters.
+     */
+    LogText& append(const char* data, size_t size) { text.append(data, size); return *this; }
+    /**
+     * @returns Returns the text formatted so far.
+     */
+    const std::string& str() const { return text; }
+
+protected:
+    std::string text;
+
+    template<typename T>
+    LogText& format(const char* spec, T value) {
+        char buffer[32];
+        int length = std::snprintf(buffer, sizeof(buffer), spec, value);
+        if (length > 0) {
+            text.append(buffer, static_cast<size_t>(length) < sizeof(buffer) ? static_cast<size_t>(length) : sizeof(buffer) - 1);
+        }
+        return *this;
+    }
+};
+
+/**
+ * A message, written to its stream when the statement that formats it ends.
+ */
+class LogLine : public LogText {
+public:
+    explicit LogLine(FILE* stream) : stream(stream) {}
+    LogLine(const LogLine&) = delete;
+    LogLine& operator=(const LogLine&) = delete;
+    ~LogLine() {
+        if (!text.empty()) {
+            std::fwrite(text.data(), 1, text.size(), stream);
+        }
+    }
+
+private:
+    FILE* stream;
+};
+
+/**
+ * Starts a message to standard output.
+ * @returns Returns the message, which is written when the statement ends.
+ */
+inline LogLine nodalisLog() { return LogLine(stdout); }
+/**
+ * Starts a message to standard error.
+ * @returns Returns the message, which is written when the statement ends.
+ */
+inline LogLine nodalisError() { return LogLine(stderr); }
+
+#endif // NODALISLOG_H
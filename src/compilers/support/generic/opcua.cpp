@@ -1,175 +1,1267 @@
 #include "opcua.h"
-#include <iostream>
+#include "nodalisjson.h"
+#include "historian.h"
+#include "alarms.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <cstring>
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+#else
+    #include <arpa/inet.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+#endif
+
+namespace {
+    // How often the client's event loop is iterated on the reactor while a connect or a request is outstanding,
+    // in milliseconds.
+    constexpr unsigned BUSY_TICK_MS = 2;
+
+    /**
+     * Reads a boolean protocol property, given as a boolean, a number or a string.
+     * @param config The protocol properties.
+     * @param key The name of the property.
+     * @returns Returns true if the property is set and true.
+     */
+    bool propertyEnabled(const json& config, const char* key) {
+        if (!config.is_object() || !config.contains(key)) {
+            return false;
+        }
+        const json& token = config.at(key);
+        if (token.is_boolean()) {
+            return token.get<bool>();
+        }
+        if (token.is_number()) {
+            return token.get<int64_t>() != 0;
+        }
+        if (token.is_string()) {
+            std::string text = token.get<std::string>();
+            return text == "true" || text == "True" || text == "TRUE" || text == "1";
+        }
+        return false;
+    }
+
+    /**
+     * Reads a numeric protocol property, given as a number or a string.
+     * @param config The protocol properties.
+     * @param key The name of the property.
+     * @param value Receives the value, if the property is set to a non-negative number.
+     * @returns Returns true if the value was set.
+     */
+    template<typename T>
+    bool propertyNumber(const json& config, const char* key, T& value) {
+        if (!config.is_object() || !config.contains(key)) {
+            return false;
+        }
+        const json& token = config.at(key);
+        if (token.is_string()) {
+            value = static_cast<T>(std::strtoull(token.get<std::string>().c_str(), nullptr, 10));
+            return true;
+        }
+        if (token.is_number_unsigned()) {
+            value = static_cast<T>(token.get<uint64_t>());
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * Gets the data type that the client reads for a mapping of the given width.
+     * @param width The width of the mapping.
+     * @returns Returns the type, or nullptr for a width the client doesn't support.
+     */
+    const UA_DataType* typeForWidth(int width) {
+        switch (width) {
+            case 1: return &UA_TYPES[UA_TYPES_BOOLEAN];
+            case 8: return &UA_TYPES[UA_TYPES_BYTE];
+            case 16: return &UA_TYPES[UA_TYPES_UINT16];
+            case 32: return &UA_TYPES[UA_TYPES_UINT32];
+            case 64: return &UA_TYPES[UA_TYPES_UINT64];
+        }
+        return nullptr;
+    }
+
+    /**
+     * Gets the value of a scalar variant of the type that the client reads for a mapping width.
+     * @param variant The variant.
+     * @param width The width of the mapping.
+     * @param value Receives the value.
+     * @returns Returns false if the variant isn't a scalar of the expected type.
+     */
+    bool scalarValue(const UA_Variant& variant, int width, uint64_t& value) {
+        const UA_DataType* type = typeForWidth(width);
+        if (type == nullptr || !UA_Variant_hasScalarType(&variant, type)) {
+            return false;
+        }
+        switch (width) {
+            case 1: value = *static_cast<const UA_Boolean*>(variant.data) ? 1 : 0; break;
+            case 8: value = *static_cast<const UA_Byte*>(variant.data); break;
+            case 16: value = *static_cast<const UA_UInt16*>(variant.data); break;
+            case 32: value = *static_cast<const UA_UInt32*>(variant.data); break;
+            default: value = *static_cast<const UA_UInt64*>(variant.data); break;
+        }
+        return true;
+    }
+
+    /**
+     * Points a variant at a scalar of the type that the client writes for a mapping width, stored in a slot.
+     * @param variant The variant, which doesn't own the slot.
+     * @param slot The storage of the scalar, which must outlive the variant's use.
+     * @param width The width of the mapping.
+     * @param value The value to store.
+     */
+    void setScalar(UA_Variant& variant, uint64_t& slot, int width, uint64_t value) {
+        void* data = &slot;
+        switch (width) {
+            case 1: *static_cast<UA_Boolean*>(data) = value != 0; break;
+            case 8: *static_cast<UA_Byte*>(data) = static_cast<UA_Byte>(value); break;
+            case 16: *static_cast<UA_UInt16*>(data) = static_cast<UA_UInt16>(value); break;
+            case 32: *static_cast<UA_UInt32*>(data) = static_cast<UA_UInt32>(value); break;
+            default: slot = value; break;
+        }
+        UA_Variant_setScalar(&variant, data, typeForWidth(width));
+    }
+}
 
 OPCUAClient::OPCUAClient()
     : IOClient("opcua"), endpointUrl("opc.tcp://localhost:4840") {
     client = UA_Client_new();
-    UA_ClientConfig_setDefault(UA_Client_getConfig(client));
+    UA_ClientConfig* config = UA_Client_getConfig(client);
+    UA_ClientConfig_setDefault(config);
+    config->clientContext = this;
+    config->timeout = static_cast<UA_UInt32>(responseTimeout);
+    reconnectDelay = minReconnectDelay = 1000;
+    maxReconnectDelay = 30000;
 }
 
 OPCUAClient::~OPCUAClient() {
+    stop();
+    if (reactor != nullptr) {
+        reactor->runSync([this]() { detach(); });
+    }
     UA_Client_disconnect(client);
     UA_Client_delete(client);
+    for (auto& node : nodes) {
+        UA_NodeId_clear(&node);
+    }
 }
 
 void OPCUAClient::connect() {
     if (!connected) {
         if (UA_Client_connect(client, moduleID.c_str()) == UA_STATUSCODE_GOOD) {
             connected = true;
+            resuming = false;
         } else {
             connected = false;
         }
     }
 }
 
-template<typename T>
-bool OPCUAClient::readValue(const std::string& nodeIdStr, T& value, const UA_DataType* type) {
-    UA_Variant val;
-    UA_Variant_init(&val);
+bool OPCUAClient::parseNodeId(const std::string& remote, UA_NodeId& nodeId) {
+    UA_NodeId_init(&nodeId);
+    // Addresses were always string identifiers in namespace 1, and a bare name still is.
+    size_t equals = remote.find('=');
+    std::string prefix = equals == std::string::npos ? "" : remote.substr(0, equals);
+    if (prefix != "ns" && prefix != "i" && prefix != "s" && prefix != "g" && prefix != "b") {
+        if (remote.empty()) {
+            return false;
+        }
+        nodeId = UA_NODEID_STRING_ALLOC(1, remote.c_str());
+        return true;
+    }
+    UA_String text;
+    text.length = remote.size();
+    text.data = reinterpret_cast<UA_Byte*>(const_cast<char*>(remote.data()));
+    return UA_NodeId_parse(&nodeId, text) == UA_STATUSCODE_GOOD;
+}
 
-    UA_NodeId nodeId = UA_NODEID_STRING_ALLOC(1, nodeIdStr.c_str());
-    UA_StatusCode status = UA_Client_readValueAttribute(client, nodeId, &val);
-    UA_NodeId_clear(&nodeId);
+void OPCUAClient::onMappingAdded(IOMap& map) {
+    mappingPoints.resize(mappings.size(), -1);
+    auto known = nodeIndex.find(map.remoteAddress);
+    if (known != nodeIndex.end()) {
+        map.remoteHandle = static_cast<int>(known->second);
+    }
+    else {
+        UA_NodeId node;
+        if (!parseNodeId(map.remoteAddress, node)) {
+            nodalisLog() << "OPC UA mapping " << map.localAddress << " has an invalid node ID: " << map.remoteAddress << "\n";
+            return;
+        }
+        map.remoteHandle = static_cast<int>(nodes.size());
+        nodeIndex[map.remoteAddress] = nodes.size();
+        nodes.push_back(node);
+    }
+    json config = protocolProperties(map);
+    size_t nodesPerRequest = 0;
+    if (propertyNumber(config, "MaxNodesPerRequest", nodesPerRequest) && nodesPerRequest > 0) {
+        maxNodesPerRequest = nodesPerRequest;
+    }
+    propertyNumber(config, "ConnectTimeout", connectTimeout);
+    if (propertyNumber(config, "ResponseTimeout", responseTimeout)) {
+        // The client times out its own requests, including the calls made without a reactor.
+        UA_Client_getConfig(client)->timeout = static_cast<UA_UInt32>(responseTimeout);
+    }
+    propertyNumber(config, "ReconnectDelay", minReconnectDelay);
+    propertyNumber(config, "MaxReconnectDelay", maxReconnectDelay);
+    if (maxReconnectDelay < minReconnectDelay) {
+        maxReconnectDelay = minReconnectDelay;
+    }
+    if (lastAttempt == 0) {
+        reconnectDelay = minReconnectDelay;
+    }
+    if (map.direction != IOType::Input || !propertyEnabled(config, "Subscribe") || typeForWidth(map.width) == nullptr) {
+        return;
+    }
+    // Inputs of the same node share its monitored item, which samples as often as the fastest of them asks.
+    size_t index = static_cast<size_t>(&map - mappings.data());
+    double samplingInterval = map.interval > 0 ? map.interval : 0;
+    for (size_t x = 0; x < monitored.size(); x++) {
+        OPCUAMonitoredPoint& existing = monitored[x];
+        if (existing.node != static_cast<size_t>(map.remoteHandle)) {
+            continue;
+        }
+        existing.shared.push_back(index);
+        if (samplingInterval < existing.samplingInterval && existing.itemId == 0) {
+            existing.samplingInterval = samplingInterval;
+        }
+        mappingPoints[index] = static_cast<int>(x);
+        return;
+    }
+    OPCUAMonitoredPoint point;
+    point.mapping = index;
+    point.node = static_cast<size_t>(map.remoteHandle);
+    point.local = map.local;
+    point.width = map.width;
+    point.quality = map.quality;
+    point.samplingInterval = samplingInterval;
+    mappingPoints[point.mapping] = static_cast<int>(monitored.size());
+    monitored.push_back(point);
+    itemsPending = true;
+}
 
-    if (status == UA_STATUSCODE_GOOD && UA_Variant_hasScalarType(&val, type)) {
-        value = *(T*)val.data;
-        return true;
+void OPCUAClient::subscribe() {
+    if (subscribing) {
+        return;
     }
-    return false;
+    if (subscriptionId == 0) {
+        // Notifications are published as often as the fastest point is sampled.
+        double interval = 0;
+        for (const auto& point : monitored) {
+            if (!point.refused && (interval == 0 || point.samplingInterval < interval)) {
+                interval = point.samplingInterval;
+            }
+        }
+        UA_CreateSubscriptionRequest request = UA_CreateSubscriptionRequest_default();
+        if (interval > 0) {
+            request.requestedPublishingInterval = interval;
+        }
+        UA_StatusCode status = UA_Client_Subscriptions_create_async(client, request, this, nullptr,
+            &OPCUAClient::subscriptionDeleted, &OPCUAClient::subscriptionCreated, nullptr, nullptr);
+        if (status != UA_STATUSCODE_GOOD) {
+            DIAGNOSTIC("OPC UA subscription to " << moduleID << " failed: " << UA_StatusCode_name(status));
+            return;
+        }
+        subscribing = true;
+        return;
+    }
+
+    pendingItems.clear();
+    std::vector<UA_MonitoredItemCreateRequest> items;
+    std::vector<void*> contexts;
+    std::vector<UA_Client_DataChangeNotificationCallback> callbacks;
+    for (size_t x = 0; x < monitored.size(); x++) {
+        OPCUAMonitoredPoint& point = monitored[x];
+        if (point.itemId != 0 || point.refused) {
+            continue;
+        }
+        UA_MonitoredItemCreateRequest item = UA_MonitoredItemCreateRequest_default(nodes[point.node]);
+        item.requestedParameters.samplingInterval = point.samplingInterval;
+        pendingItems.push_back(x);
+        items.push_back(item);
+        contexts.push_back(reinterpret_cast<void*>(static_cast<uintptr_t>(x)));
+        callbacks.push_back(&OPCUAClient::dataChanged);
+    }
+    itemsPending = false;
+    if (items.empty()) {
+        return;
+    }
+
+    UA_CreateMonitoredItemsRequest request;
+    UA_CreateMonitoredItemsRequest_init(&request);
+    request.subscriptionId = subscriptionId;
+    request.timestampsToReturn = UA_TIMESTAMPSTORETURN_NEITHER;
+    request.itemsToCreate = items.data();
+    request.itemsToCreateSize = items.size();
+    UA_StatusCode status = UA_Client_MonitoredItems_createDataChanges_async(client, request, contexts.data(),
+        callbacks.data(), nullptr, &OPCUAClient::itemsCreated, nullptr, nullptr);
+    if (status != UA_STATUSCODE_GOOD) {
+        itemsPending = true;
+        DIAGNOSTIC("OPC UA monitored items on " << moduleID << " failed: " << UA_StatusCode_name(status));
+        return;
+    }
+    subscribing = true;
 }
 
-template<typename T>
-bool OPCUAClient::writeValue(const std::string& nodeIdStr, T value, const UA_DataType* type) {
-    UA_Variant val;
-    UA_Variant_setScalar(&val, &value, type);
+void OPCUAClient::subscriptionCreated(UA_Client* client, void* userdata, UA_UInt32 requestId,
+                                      UA_CreateSubscriptionResponse* response) {
+    (void)userdata;
+    (void)requestId;
+    auto* self = static_cast<OPCUAClient*>(UA_Client_getContext(client));
+    self->subscribing = false;
+    UA_StatusCode status = response->responseHeader.serviceResult;
+    if (status != UA_STATUSCODE_GOOD) {
+        // Without a subscription every point is polled, and the subscription is tried again on reconnect.
+        DIAGNOSTIC("OPC UA subscription to " << self->moduleID << " failed: " << UA_StatusCode_name(status));
+        self->itemsPending = false;
+        return;
+    }
+    self->subscriptionId = response->subscriptionId;
+    self->subscribe();
+}
 
-    UA_NodeId nodeId = UA_NODEID_STRING_ALLOC(1, nodeIdStr.c_str());
-    UA_StatusCode status = UA_Client_writeValueAttribute(client, nodeId, &val);
-    UA_NodeId_clear(&nodeId);
+void OPCUAClient::itemsCreated(UA_Client* client, void* userdata, UA_UInt32 requestId,
+                               UA_CreateMonitoredItemsResponse* response) {
+    (void)userdata;
+    (void)requestId;
+    auto* self = static_cast<OPCUAClient*>(UA_Client_getContext(client));
+    self->subscribing = false;
+    UA_StatusCode status = response->responseHeader.serviceResult;
+    for (size_t x = 0; x < self->pendingItems.size(); x++) {
+        OPCUAMonitoredPoint& point = self->monitored[self->pendingItems[x]];
+        if (status == UA_STATUSCODE_GOOD && x < response->resultsSize &&
+            response->results[x].statusCode == UA_STATUSCODE_GOOD) {
+            point.itemId = response->results[x].monitoredItemId;
+        }
+        else if (status == UA_STATUSCODE_GOOD) {
+            // The server won't monitor this node, so it is polled from now on.
+            point.refused = true;
+            DIAGNOSTIC("OPC UA server " << self->moduleID << " refused to monitor "
+                << self->mappings[point.mapping].remoteAddress);
+        }
+    }
+    self->pendingItems.clear();
+    if (status != UA_STATUSCODE_GOOD) {
+        // The items are created again after a reconnect, and the points polled until then.
+        DIAGNOSTIC("OPC UA monitored items on " << self->moduleID << " failed: " << UA_StatusCode_name(status));
+    }
+}
+
+void OPCUAClient::dropSubscription() {
+    subscriptionId = 0;
+    subscribing = false;
+    pendingItems.clear();
+    for (auto& point : monitored) {
+        point.itemId = 0;
+        itemsPending = itemsPending || !point.refused;
+    }
+}
+
+void OPCUAClient::subscriptionDeleted(UA_Client* client, UA_UInt32 subId, void* subContext) {
+    (void)client;
+    auto* self = static_cast<OPCUAClient*>(subContext);
+    if (self != nullptr && subId == self->subscriptionId) {
+        self->dropSubscription();
+    }
+}
+
+void OPCUAClient::dataChanged(UA_Client* client, UA_UInt32 subId, void* subContext, UA_UInt32 monId,
+                              void* monContext, UA_DataValue* value) {
+    (void)client;
+    (void)subId;
+    (void)monId;
+    auto* self = static_cast<OPCUAClient*>(subContext);
+    if (self != nullptr) {
+        self->notified(static_cast<size_t>(reinterpret_cast<uintptr_t>(monContext)), value);
+    }
+}
+
+void OPCUAClient::notified(size_t point, const UA_DataValue* value) {
+    if (point >= monitored.size() || value == nullptr) {
+        return;
+    }
+    const OPCUAMonitoredPoint& target = monitored[point];
+    bool valid = value->hasValue && (!value->hasStatus || value->status == UA_STATUSCODE_GOOD);
+    uint64_t result = 0;
+    bool good = valid;
+    if (valid && !scalarValue(value->value, target.width, result)) {
+        DIAGNOSTIC("OPC UA notification for " << mappings[target.mapping].remoteAddress << " has the wrong type");
+        good = false;
+    }
+    if (good) {
+        writeImage(target.local, result);
+    }
+    setInputQuality(target.quality, good ? IOQuality::Good : IOQuality::Stale);
+    // The value is written to the other inputs of the node as wide as each of them.
+    for (size_t member : target.shared) {
+        const IOMap& map = mappings[member];
+        bool stored = valid && scalarValue(value->value, map.width, result);
+        if (stored) {
+            writeImage(map.local, result);
+        }
+        setInputQuality(map.quality, stored ? IOQuality::Good : IOQuality::Stale);
+    }
+}
+
+bool OPCUAClient::sessionActive() {
+    // Responses and notifications are delivered to their callbacks on this thread, from within the iteration.
+    UA_Client_run_iterate(client, 0);
+    UA_SessionState session = UA_SESSIONSTATE_CLOSED;
+    UA_Client_getState(client, nullptr, &session, nullptr);
+    return session == UA_SESSIONSTATE_ACTIVATED;
+}
+
+void OPCUAClient::sessionLost() {
+    connected = false;
+    UA_SessionState session = UA_SESSIONSTATE_CLOSED;
+    UA_Client_getState(client, nullptr, &session, nullptr);
+    if (session == UA_SESSIONSTATE_CLOSED) {
+        resuming = false;
+        dropSubscription();
+        return;
+    }
+    // Only the channel is gone, so the next connect activates the same session, and is tried at once.
+    resuming = true;
+    lastAttempt = 0;
+}
+
+void OPCUAClient::splitBatch(IOBatch& batch) {
+    readBatch.clear();
+    writeBatch.clear();
+    for (auto& request : batch.requests) {
+        if (request.remoteHandle < 0 || typeForWidth(request.width) == nullptr) {
+            complete(request, IOStatus::Invalid);
+            continue;
+        }
+        if (request.direction == IOType::Output) {
+            writeBatch.push_back(&request);
+        }
+        else {
+            int point = mappingPoints[request.mapping];
+            if (point < 0 || monitored[point].itemId == 0) {
+                readBatch.push_back(&request);
+            }
+        }
+    }
+    // The polled inputs of a node follow each other, so that each request reads the node once for all of them.
+    std::stable_sort(readBatch.begin(), readBatch.end(), [](const IORequest* a, const IORequest* b) {
+        return a->remoteHandle < b->remoteHandle;
+    });
+}
+
+void OPCUAClient::submitBatch(IOBatch& batch) {
+    if (!sessionActive()) {
+        // The client reconnects on a later poll, resuming the session if it can and subscribing again if not.
+        sessionLost();
+        return;
+    }
+    if (itemsPending) {
+        subscribe();
+    }
+    splitBatch(batch);
+    transferBatch(writeBatch, true);
+    transferBatch(readBatch, false);
+}
+
+void OPCUAClient::transferBatch(std::vector<IORequest*>& batch, bool write) {
+    size_t first = 0;
+    while (first < batch.size() && connected) {
+        size_t count = batch.size() - first < maxNodesPerRequest ? batch.size() - first : maxNodesPerRequest;
+        UA_StatusCode status;
+        if (write) {
+            UA_WriteRequest request;
+            buildWrite(&batch[first], count, request);
+            auto sent = std::chrono::steady_clock::now();
+            UA_WriteResponse response = UA_Client_Service_write(client, request);
+            status = response.responseHeader.serviceResult;
+            requestCompleted(status == UA_STATUSCODE_GOOD, microsBetween(sent, std::chrono::steady_clock::now()));
+            writeCompleted(&batch[first], count, response);
+            UA_WriteResponse_clear(&response);
+        }
+        else {
+            UA_ReadRequest request;
+            buildRead(&batch[first], count, request);
+            auto sent = std::chrono::steady_clock::now();
+            UA_ReadResponse response = UA_Client_Service_read(client, request);
+            status = response.responseHeader.serviceResult;
+            requestCompleted(status == UA_STATUSCODE_GOOD, microsBetween(sent, std::chrono::steady_clock::now()));
+            readCompleted(&batch[first], count, response);
+            UA_ReadResponse_clear(&response);
+        }
+        if (status == UA_STATUSCODE_BADTOOMANYOPERATIONS && count > 1) {
+            // The run is sent again in requests of the server's size.
+            continue;
+        }
+        first += count;
+    }
+}
+
+void OPCUAClient::buildRead(IORequest* const* members, size_t count, UA_ReadRequest& request) {
+    readIds.resize(count);
+    size_t read = 0;
+    for (size_t x = 0; x < count; x++) {
+        int node = members[x]->remoteHandle;
+        if (x > 0 && node == members[x - 1]->remoteHandle) {
+            continue;
+        }
+        // The request only borrows the cached node ID, so nothing is allocated for it.
+        UA_ReadValueId_init(&readIds[read]);
+        readIds[read].nodeId = nodes[node];
+        readIds[read].attributeId = UA_ATTRIBUTEID_VALUE;
+        read++;
+    }
+    UA_ReadRequest_init(&request);
+    request.nodesToRead = readIds.data();
+    request.nodesToReadSize = read;
+    request.timestampsToReturn = UA_TIMESTAMPSTORETURN_NEITHER;
+}
+
+void OPCUAClient::buildWrite(IORequest* const* members, size_t count, UA_WriteRequest& request) {
+    // The scalars are sized first, since the variants point into them.
+    writeValues.resize(count);
+    writeScalars.resize(count);
+    for (size_t x = 0; x < count; x++) {
+        const IORequest& write = *members[x];
+        UA_WriteValue& value = writeValues[x];
+        UA_WriteValue_init(&value);
+        value.nodeId = nodes[write.remoteHandle];
+        value.attributeId = UA_ATTRIBUTEID_VALUE;
+        value.value.hasValue = true;
+        setScalar(value.value.value, writeScalars[x], write.width, write.value);
+    }
+    UA_WriteRequest_init(&request);
+    request.nodesToWrite = writeValues.data();
+    request.nodesToWriteSize = count;
+}
+
+void OPCUAClient::readCompleted(IORequest* const* members, size_t count, const UA_ReadResponse& response) {
+    UA_StatusCode status = response.responseHeader.serviceResult;
+    if (status != UA_STATUSCODE_GOOD) {
+        requestFailed(status, count, false);
+        for (size_t x = 0; x < count; x++) {
+            complete(*members[x], IOStatus::Failed);
+        }
+        return;
+    }
+    // Results come back in the order of the request, and are written to the image together.
+    size_t result = 0;
+    for (size_t x = 0; x < count; x++) {
+        IORequest& read = *members[x];
+        if (x > 0 && read.remoteHandle != members[x - 1]->remoteHandle) {
+            result++;
+        }
+        uint64_t value = 0;
+        if (result >= response.resultsSize) {
+            complete(read, IOStatus::Failed);
+        }
+        else if (!response.results[result].hasValue ||
+                 (response.results[result].hasStatus && response.results[result].status != UA_STATUSCODE_GOOD)) {
+            complete(read, IOStatus::Refused);
+        }
+        else {
+            complete(read, scalarValue(response.results[result].value, read.width, value) ? IOStatus::Good : IOStatus::Refused, value);
+        }
+    }
+    publishCompleted();
+}
+
+void OPCUAClient::writeCompleted(IORequest* const* members, size_t count, const UA_WriteResponse& response) {
+    UA_StatusCode status = response.responseHeader.serviceResult;
+    if (status != UA_STATUSCODE_GOOD) {
+        requestFailed(status, count, true);
+        for (size_t x = 0; x < count; x++) {
+            complete(*members[x], IOStatus::Failed);
+        }
+        return;
+    }
+    for (size_t x = 0; x < count; x++) {
+        bool good = x < response.resultsSize && response.results[x] == UA_STATUSCODE_GOOD;
+        if (!good) {
+            const IOMap& map = mappings[members[x]->mapping];
+            DIAGNOSTIC("Failed to write on map for " << map.moduleID << "/" << map.remoteAddress);
+        }
+        complete(*members[x], good ? IOStatus::Good : IOStatus::Refused);
+    }
+}
 
-    return status == UA_STATUSCODE_GOOD;
+void OPCUAClient::requestFailed(UA_StatusCode status, size_t count, bool write) {
+    if (status == UA_STATUSCODE_BADTOOMANYOPERATIONS && count > 1) {
+        // The server has a lower limit than the request, so later requests are smaller.
+        maxNodesPerRequest = count / 2;
+        DIAGNOSTIC("OPC UA server " << moduleID << " limits requests to fewer than " << count << " nodes");
+        return;
+    }
+    DIAGNOSTIC("OPC UA " << (write ? "write to " : "read from ") << moduleID << " failed: " << UA_StatusCode_name(status));
 }
 
-// Implement required IOClient methods
+// ========== Reactor Mode ==========
 
-bool OPCUAClient::readBit(const std::string& remote, int& result) {
-    bool val;
-    bool success = readValue(remote, val, &UA_TYPES[UA_TYPES_BOOLEAN]);
-    result = val;
-    return success;
+bool OPCUAClient::attach(IOReactor& target) {
+    reactor = &target;
+    ioStats = &registerStats("IO." + protocol + "." + moduleID);
+    reactor->post([this]() { tick(); });
+    return true;
 }
 
-bool OPCUAClient::writeBit(const std::string& remote, int value) {
-    bool val = value != 0;
-    return writeValue(remote, val, &UA_TYPES[UA_TYPES_BOOLEAN]);
+void OPCUAClient::detach() {
+    reactor->cancel(tickTimer);
+    tickTimer = 0;
 }
 
-bool OPCUAClient::readByte(const std::string& remote, uint8_t& result) {
-    return readValue(remote, result, &UA_TYPES[UA_TYPES_BYTE]);
+void OPCUAClient::tick() {
+    tickTimer = 0;
+    {
+        std::lock_guard<std::mutex> lock(mappingMutex);
+        bool active = sessionActive();
+        uint64_t now = elapsed();
+        if (connecting) {
+            UA_StatusCode status = UA_STATUSCODE_GOOD;
+            UA_Client_getState(client, nullptr, nullptr, &status);
+            if (active) {
+                connecting = false;
+                connected = true;
+                connectAttempted(true);
+                nodalisLog() << "OPC UA " << (resuming && subscriptionId != 0 ? "resumed the session with " : "connected to ")
+                    << moduleID << "\n";
+                resuming = false;
+            }
+            else if (status != UA_STATUSCODE_GOOD || now - lastAttempt >= connectTimeout) {
+                DIAGNOSTIC("OPC UA connect to " << moduleID << " failed: "
+                    << (status != UA_STATUSCODE_GOOD ? UA_StatusCode_name(status) : "timed out"));
+                connecting = false;
+                // Only the channel is closed, so that a session waiting to be resumed is kept for the next attempt.
+                UA_Client_disconnectSecureChannelAsync(client);
+                connectAttempted(false);
+            }
+        }
+        else if (connected && !active) {
+            // Outstanding requests were completed with an error by the iteration.
+            DIAGNOSTIC("OPC UA session with " << moduleID << " was lost");
+            sessionLost();
+        }
+        if (!connected && !connecting && outstanding == 0 && (lastAttempt == 0 || now - lastAttempt >= reconnectDelay)) {
+            lastAttempt = now;
+            UA_StatusCode status = UA_Client_connectAsync(client, moduleID.c_str());
+            if (status == UA_STATUSCODE_GOOD) {
+                connecting = true;
+            }
+            else {
+                DIAGNOSTIC("OPC UA connect to " << moduleID << " failed: " << UA_StatusCode_name(status));
+                connectAttempted(false);
+            }
+        }
+        if (connected) {
+            if (itemsPending) {
+                subscribe();
+            }
+            // Like the other reactor clients, a poll starts once the previous one is finished.
+            if (outstanding == 0) {
+                collectDue(reactorDue);
+                if (!reactorDue.empty()) {
+                    buildBatch(reactorDue, reactorBatch);
+                    splitBatch(reactorBatch);
+                    batchStart = IOReactor::Clock::now();
+                    sendBatch(writeBatch, true);
+                    sendBatch(readBatch, false);
+                }
+            }
+        }
+    }
+    scheduleTick();
 }
 
-bool OPCUAClient::writeByte(const std::string& remote, uint8_t value) {
-    return writeValue(remote, value, &UA_TYPES[UA_TYPES_BYTE]);
+void OPCUAClient::wake() {
+    if (reactor == nullptr) {
+        IOClient::wake();
+        return;
+    }
+    reactor->post([this]() { scheduleTick(); });
+}
+
+void OPCUAClient::scheduleTick() {
+    reactor->cancel(tickTimer);
+    auto now = IOReactor::Clock::now();
+    IOReactor::Clock::time_point when;
+    if (connecting || outstanding > 0) {
+        // The client's own event loop is iterated often while it waits for the server.
+        when = now + std::chrono::milliseconds(BUSY_TICK_MS);
+    }
+    else {
+        when = PROGRAM_START + std::chrono::milliseconds(nextPollDue());
+        // Wake at least every 100ms so that newly added mappings and notifications are noticed.
+        if (when > now + std::chrono::milliseconds(100)) {
+            when = now + std::chrono::milliseconds(100);
+        }
+    }
+    tickTimer = reactor->schedule(when, [this]() { tick(); });
 }
 
-bool OPCUAClient::readWord(const std::string& remote, uint16_t& result) {
-    return readValue(remote, result, &UA_TYPES[UA_TYPES_UINT16]);
+void OPCUAClient::sendBatch(std::vector<IORequest*>& batch, bool write) {
+    for (size_t first = 0; first < batch.size(); first += maxNodesPerRequest) {
+        size_t count = batch.size() - first < maxNodesPerRequest ? batch.size() - first : maxNodesPerRequest;
+        size_t slot = 0;
+        while (slot < requests.size() && requests[slot].busy) {
+            slot++;
+        }
+        if (slot == requests.size()) {
+            requests.emplace_back();
+        }
+        OPCUARequest& entry = requests[slot];
+        entry.members.assign(batch.begin() + first, batch.begin() + first + count);
+        entry.write = write;
+        entry.sentAt = std::chrono::steady_clock::now();
+        void* userdata = reinterpret_cast<void*>(static_cast<uintptr_t>(slot));
+        UA_StatusCode status;
+        // The requests are encoded when they are sent, so the arrays they borrow can be reused right away.
+        if (write) {
+            UA_WriteRequest request;
+            buildWrite(entry.members.data(), count, request);
+            status = UA_Client_sendAsyncWriteRequest(client, &request, &OPCUAClient::writeDone, userdata, nullptr);
+        }
+        else {
+            UA_ReadRequest request;
+            buildRead(entry.members.data(), count, request);
+            status = UA_Client_sendAsyncReadRequest(client, &request, &OPCUAClient::readDone, userdata, nullptr);
+        }
+        if (status != UA_STATUSCODE_GOOD) {
+            requestCompleted(false, 0);
+            requestFailed(status, count, write);
+            for (IORequest* member : entry.members) {
+                complete(*member, IOStatus::Failed);
+            }
+            continue;
+        }
+        entry.busy = true;
+        outstanding++;
+    }
 }
 
-bool OPCUAClient::writeWord(const std::string& remote, uint16_t value) {
-    return writeValue(remote, value, &UA_TYPES[UA_TYPES_UINT16]);
+void OPCUAClient::requestDone(size_t slot) {
+    requests[slot].busy = false;
+    if (outstanding > 0 && --outstanding == 0 && ioStats != nullptr) {
+        ioStats->record(microsBetween(batchStart, IOReactor::Clock::now()));
+    }
 }
 
-bool OPCUAClient::readDWord(const std::string& remote, uint32_t& result) {
-    return readValue(remote, result, &UA_TYPES[UA_TYPES_UINT32]);
+void OPCUAClient::readDone(UA_Client* client, void* userdata, UA_UInt32 requestId, UA_ReadResponse* response) {
+    (void)requestId;
+    auto* self = static_cast<OPCUAClient*>(UA_Client_getContext(client));
+    size_t slot = static_cast<size_t>(reinterpret_cast<uintptr_t>(userdata));
+    OPCUARequest& entry = self->requests[slot];
+    self->requestCompleted(response->responseHeader.serviceResult == UA_STATUSCODE_GOOD,
+        microsBetween(entry.sentAt, std::chrono::steady_clock::now()));
+    self->readCompleted(entry.members.data(), entry.members.size(), *response);
+    self->requestDone(slot);
 }
 
-bool OPCUAClient::writeDWord(const std::string& remote, uint32_t value) {
-    return writeValue(remote, value, &UA_TYPES[UA_TYPES_UINT32]);
+void OPCUAClient::writeDone(UA_Client* client, void* userdata, UA_UInt32 requestId, UA_WriteResponse* response) {
+    (void)requestId;
+    auto* self = static_cast<OPCUAClient*>(UA_Client_getContext(client));
+    size_t slot = static_cast<size_t>(reinterpret_cast<uintptr_t>(userdata));
+    OPCUARequest& entry = self->requests[slot];
+    self->requestCompleted(response->responseHeader.serviceResult == UA_STATUSCODE_GOOD,
+        microsBetween(entry.sentAt, std::chrono::steady_clock::now()));
+    self->writeCompleted(entry.members.data(), entry.members.size(), *response);
+    self->requestDone(slot);
 }
 
-bool OPCUAClient::readLWord(const std::string &remote, uint64_t &result)
-{
-    return readValue(remote, result, &UA_TYPES[UA_TYPES_UINT64]);
+/**
+ * Gets the status a variable is served with. An input waiting for its first read is bad, and a mapped input has the
+ * status of its quality: uncertain while its reads fail, and bad while its device can't be reached.
+ * @param variable The variable.
+ * @returns Returns the status.
+ */
+static UA_StatusCode variableStatus(const OPCUAVariable& variable) {
+    if (!isInputGood(variable.address)) {
+        return UA_STATUSCODE_BADWAITINGFORINITIALDATA;
+    }
+    if (variable.quality == NO_QUALITY_SLOT) {
+        return UA_STATUSCODE_GOOD;
+    }
+    switch (inputQuality(variable.quality)) {
+        case IOQuality::Good:
+            return UA_STATUSCODE_GOOD;
+        case IOQuality::Stale:
+            return UA_STATUSCODE_UNCERTAINLASTUSABLEVALUE;
+        default:
+            return UA_STATUSCODE_BADNOCOMMUNICATION;
+    }
 }
 
-bool OPCUAClient::writeLWord(const std::string &remote, uint64_t value)
-{
-    return writeValue(remote, value, &UA_TYPES[UA_TYPES_UINT64]);
+/**
+ * Sets the status of a value read from a variable, and the time its input was last read as its source timestamp.
+ * @param variable The variable.
+ * @param status The status, from variableStatus().
+ * @param data The value.
+ */
+static void setValueQuality(const OPCUAVariable& variable, UA_StatusCode status, UA_DataValue& data) {
+    if (status != UA_STATUSCODE_GOOD) {
+        data.hasStatus = true;
+        data.status = status;
+    }
+    int64_t updated = inputUpdatedTime(variable.quality);
+    if (updated > 0) {
+        data.sourceTimestamp = updated * UA_DATETIME_USEC + UA_DATETIME_UNIX_EPOCH;
+        data.hasSourceTimestamp = true;
+    }
 }
 
 static UA_StatusCode staticRead(UA_Server*, const UA_NodeId*, void*, const UA_NodeId*, void* nodeContext,
                                 UA_Boolean, const UA_NumericRange*, UA_DataValue* dataValue) {
-    auto* addr = static_cast<std::string*>(nodeContext);
-    UA_StatusCode res = UA_STATUSCODE_BAD;
-    if(addr->find('.') != std::string::npos){
-        bool bval = readBit(*addr);
-        UA_Variant_setScalarCopy(&dataValue->value, &bval, &UA_TYPES[UA_TYPES_BOOLEAN]);
-        dataValue->hasValue = true;
-        res = UA_STATUSCODE_GOOD;
+    NODALIS_TRACE_SCOPE(TraceCategory::OPCUA, "read");
+    auto* variable = static_cast<OPCUAVariable*>(nodeContext);
+    uint64_t value = readImage(variable->address);
+    uint64_t slot = 0;
+    UA_Variant scalar;
+    setScalar(scalar, slot, variable->address.bit > -1 ? 1 : variable->address.width, value);
+    UA_Variant_copy(&scalar, &dataValue->value);
+    dataValue->hasValue = true;
+    setValueQuality(*variable, variableStatus(*variable), *dataValue);
+    return UA_STATUSCODE_GOOD;
+}
+
+/**
+ * Stages a value written by a client to a variable.
+ * @param variable The variable that was written.
+ * @param value The written value.
+ * @returns Returns UA_STATUSCODE_GOOD, or UA_STATUSCODE_BADTYPEMISMATCH if the value has a type a variable can't hold.
+ */
+static UA_StatusCode stageVariable(const OPCUAVariable& variable, const UA_Variant& value) {
+    if (UA_Variant_hasScalarType(&value, &UA_TYPES[UA_TYPES_UINT64])) {
+        writeImage(variable.address, *(uint64_t*)value.data);
     }
-    else{
-        char size = addr->c_str()[2];
-        uint8_t byval;
-        uint16_t wval;
-        uint32_t dval;
-        switch(size){
-            case 'X':
-                byval = readByte(*addr);
-                UA_Variant_setScalarCopy(&dataValue->value, &byval, &UA_TYPES[UA_TYPES_BYTE]);
-                dataValue->hasValue = true;
-                res = UA_STATUSCODE_GOOD;
-                break;
-            case 'W':
-                wval = readWord(*addr);
-                UA_Variant_setScalarCopy(&dataValue->value, &wval, &UA_TYPES[UA_TYPES_UINT16]);
-                dataValue->hasValue = true;
-                res = UA_STATUSCODE_GOOD;
-                break;
-            case 'D':
-                dval = readDWord(*addr);
-                UA_Variant_setScalarCopy(&dataValue->value, &dval, &UA_TYPES[UA_TYPES_UINT32]);
-                dataValue->hasValue = true;
-                res = UA_STATUSCODE_GOOD;
-                break;
-        }
-    }
-    
-    return res;
+    else if (UA_Variant_hasScalarType(&value, &UA_TYPES[UA_TYPES_UINT32])) {
+        writeImage(variable.address, *(uint32_t*)value.data);
+    }
+    else if (UA_Variant_hasScalarType(&value, &UA_TYPES[UA_TYPES_UINT16])) {
+        writeImage(variable.address, *(uint16_t*)value.data);
+    }
+    else if (UA_Variant_hasScalarType(&value, &UA_TYPES[UA_TYPES_BYTE])) {
+        writeImage(variable.address, *(uint8_t*)value.data);
+    }
+    else if (UA_Variant_hasScalarType(&value, &UA_TYPES[UA_TYPES_BOOLEAN])) {
+        writeImage(variable.address, *(bool*)value.data);
+    }
+    else {
+        return UA_STATUSCODE_BADTYPEMISMATCH;
+    }
+    return UA_STATUSCODE_GOOD;
 }
 
 static UA_StatusCode staticWrite(UA_Server*, const UA_NodeId*, void*, const UA_NodeId*, void* nodeContext,
                                  const UA_NumericRange*, const UA_DataValue* dataValue) {
-    auto* addr = static_cast<std::string*>(nodeContext);
-    if (UA_Variant_hasScalarType(&dataValue->value, &UA_TYPES[UA_TYPES_UINT16])) {
-        uint16_t value = *(uint16_t*)dataValue->value.data;
-        writeWord(*addr, value);
-        return UA_STATUSCODE_GOOD;
+    NODALIS_TRACE_SCOPE(TraceCategory::OPCUA, "write");
+    return stageVariable(*static_cast<OPCUAVariable*>(nodeContext), dataValue->value);
+}
+
+/**
+ * A variable of a published program, as resolved from its node ID.
+ */
+struct BrowseTarget {
+    void* address = nullptr;            // The address of the variable, or nullptr for the Programs folder.
+    const BrowseType* type = nullptr;   // The browse type of the variable.
+    uint64_t mask = 0;                  // For a packed BOOL, its bit of the word at the address.
+};
+
+/**
+ * A node made up for a variable of a published program. The node comes first, so that the node released is the
+ * allocation.
+ */
+struct BrowseNode {
+    UA_Node node;
+    BrowseTarget target;    // The context of a variable node.
+};
+
+static const char* const BROWSE_FOLDER = "Programs";
+
+/**
+ * Gets the type a variable of an elementary kind is served as.
+ * @param kind The kind of the variable.
+ * @returns Returns the type, or nullptr if the variable isn't served as a value.
+ */
+static const UA_DataType* browseDataType(BrowseKind kind) {
+    switch (kind) {
+        case BrowseKind::Bool: return &UA_TYPES[UA_TYPES_BOOLEAN];
+        case BrowseKind::Int8: return &UA_TYPES[UA_TYPES_SBYTE];
+        case BrowseKind::UInt8: return &UA_TYPES[UA_TYPES_BYTE];
+        case BrowseKind::Int16: return &UA_TYPES[UA_TYPES_INT16];
+        case BrowseKind::UInt16: return &UA_TYPES[UA_TYPES_UINT16];
+        case BrowseKind::Int32: return &UA_TYPES[UA_TYPES_INT32];
+        case BrowseKind::UInt32: return &UA_TYPES[UA_TYPES_UINT32];
+        case BrowseKind::Int64: return &UA_TYPES[UA_TYPES_INT64];
+        case BrowseKind::UInt64: return &UA_TYPES[UA_TYPES_UINT64];
+        case BrowseKind::Float: return &UA_TYPES[UA_TYPES_FLOAT];
+        case BrowseKind::Double: return &UA_TYPES[UA_TYPES_DOUBLE];
+        case BrowseKind::Fixed: return &UA_TYPES[UA_TYPES_FLOAT];
+        case BrowseKind::String: return &UA_TYPES[UA_TYPES_STRING];
+        default: return nullptr;
     }
-    else if (UA_Variant_hasScalarType(&dataValue->value, &UA_TYPES[UA_TYPES_UINT32])) {
-        uint32_t value = *(uint32_t*)dataValue->value.data;
-        writeDWord(*addr, value);
-        return UA_STATUSCODE_GOOD;
+}
+
+/**
+ * Resolves the node ID of a variable of a published program: the program's name, followed by .Member for each
+ * member and [Index] for each element of an array, such as Main.T1.ET or Main.A[3].
+ * @param store The nodestore.
+ * @param path The string node ID.
+ * @param target Receives the variable.
+ * @returns Returns false if there is no such variable, or it isn't browsed.
+ */
+static bool resolveBrowsePath(const OPCUABrowseStore& store, const std::string& path, BrowseTarget& target) {
+    if (path == BROWSE_FOLDER) {
+        target = BrowseTarget{};
+        return true;
     }
-    else if (UA_Variant_hasScalarType(&dataValue->value, &UA_TYPES[UA_TYPES_BYTE])) {
-        uint8_t value = *(uint8_t*)dataValue->value.data;
-        writeByte(*addr, value);
-        return UA_STATUSCODE_GOOD;
+    size_t end = path.find_first_of(".[");
+    std::string program = path.substr(0, end);
+    auto root = std::find_if(store.roots.begin(), store.roots.end(), [&](const OPCUABrowseRoot& r) { return r.name == program; });
+    if (root == store.roots.end()) {
+        return false;
     }
-    else if (UA_Variant_hasScalarType(&dataValue->value, &UA_TYPES[UA_TYPES_BOOLEAN])) {
-        bool value = *(bool*)dataValue->value.data;
-        writeBit(*addr, value);
-        return UA_STATUSCODE_GOOD;
+    target = BrowseTarget{root->instance, root->type, 0};
+    size_t at = program.size();
+    while (at < path.size()) {
+        if (target.mask != 0) {
+            return false;
+        }
+        if (path[at] == '.') {
+            size_t next = path.find_first_of(".[", at + 1);
+            std::string name = path.substr(at + 1, next == std::string::npos ? std::string::npos : next - at - 1);
+            at = next == std::string::npos ? path.size() : next;
+            if (target.type->kind != BrowseKind::Object) {
+                return false;
+            }
+            const BrowseMember* first = target.type->members;
+            const BrowseMember* last = first + target.type->count;
+            const BrowseMember* member = std::lower_bound(first, last, name.c_str(),
+                [](const BrowseMember& m, const char* n) { return std::strcmp(m.name, n) < 0; });
+            if (member == last || name != member->name) {
+                return false;
+            }
+            target = BrowseTarget{member->address(target.address), member->type(), member->mask};
+        }
+        else {
+            size_t close = path.find(']', at);
+            if (close == std::string::npos || target.type->kind != BrowseKind::Array) {
+                return false;
+            }
+            char* stop = nullptr;
+            std::string index = path.substr(at + 1, close - at - 1);
+            long long value = std::strtoll(index.c_str(), &stop, 10);
+            if (index.empty() || *stop != 0 || value < target.type->low ||
+                static_cast<uint64_t>(value - target.type->low) >= target.type->length) {
+                return false;
+            }
+            target = BrowseTarget{target.type->element(target.address, static_cast<size_t>(value - target.type->low)),
+                target.type->elementType(), 0};
+            at = close + 1;
+        }
     }
-    return UA_STATUSCODE_BADTYPEMISMATCH;
+    return target.type->kind != BrowseKind::Opaque;
+}
+
+/**
+ * Adds a reference to a node that is made up.
+ * @param node The node.
+ * @param refTypeIndex The index of the type of the reference.
+ * @param isForward Whether the reference is forward, from the node to its target.
+ * @param target The target of the reference.
+ * @param name The browse name of the target.
+ */
+static void addBrowseReference(UA_Node* node, UA_Byte refTypeIndex, bool isForward, const UA_NodeId& target,
+                               const UA_QualifiedName& name) {
+    UA_ExpandedNodeId expanded;
+    UA_ExpandedNodeId_init(&expanded);
+    expanded.nodeId = target;
+    UA_Node_addReference(node, refTypeIndex, isForward, &expanded, UA_QualifiedName_hash(&name));
+}
+
+static UA_StatusCode browseRead(UA_Server*, const UA_NodeId*, void*, const UA_NodeId*, void* nodeContext,
+                                UA_Boolean, const UA_NumericRange*, UA_DataValue* dataValue) {
+    NODALIS_TRACE_SCOPE(TraceCategory::OPCUA, "browse");
+    auto* target = static_cast<const BrowseTarget*>(nodeContext);
+    // The variable is read while the tasks run, so a value wider than a word may be torn.
+    if (target->type->kind == BrowseKind::Bool) {
+        UA_Boolean value = target->mask != 0 ? (*static_cast<const uint64_t*>(target->address) & target->mask) != 0
+                                             : *static_cast<const bool*>(target->address);
+        UA_Variant_setScalarCopy(&dataValue->value, &value, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    }
+    else if (target->type->kind == BrowseKind::Fixed) {
+        UA_Float value = *static_cast<const FixedReal*>(target->address);
+        UA_Variant_setScalarCopy(&dataValue->value, &value, &UA_TYPES[UA_TYPES_FLOAT]);
+    }
+    else if (target->type->kind == BrowseKind::String) {
+        IECStringView<char> text = target->type->text(target->address);
+        UA_String value{text.size, reinterpret_cast<UA_Byte*>(const_cast<char*>(text.data))};
+        UA_Variant_setScalarCopy(&dataValue->value, &value, &UA_TYPES[UA_TYPES_STRING]);
+    }
+    else {
+        UA_Variant_setScalarCopy(&dataValue->value, target->address, browseDataType(target->type->kind));
+    }
+    dataValue->hasValue = true;
+    return UA_STATUSCODE_GOOD;
+}
+
+/**
+ * Makes up the node of a variable of a published program. A program, function block instance, STRUCT or array is an
+ * object with a component for each member or element that is browsed, and a variable of an elementary type is a
+ * read-only variable. Only the references the server asked for are added.
+ * @param store The nodestore.
+ * @param nodeId The node ID, in the namespace of the published programs.
+ * @param references The types of references the server asked for.
+ * @returns Returns the node, which releaseBrowseNode() frees, or nullptr if there is no such variable.
+ */
+static const UA_Node* makeBrowseNode(const OPCUABrowseStore& store, const UA_NodeId& nodeId, UA_ReferenceTypeSet references) {
+    if (nodeId.identifierType != UA_NODEIDTYPE_STRING) {
+        return nullptr;
+    }
+    std::string path(reinterpret_cast<const char*>(nodeId.identifier.string.data), nodeId.identifier.string.length);
+    BrowseTarget target;
+    if (!resolveBrowsePath(store, path, target)) {
+        return nullptr;
+    }
+    auto* made = static_cast<BrowseNode*>(UA_calloc(1, sizeof(BrowseNode)));
+    if (made == nullptr) {
+        return nullptr;
+    }
+    made->target = target;
+    UA_Node* node = &made->node;
+    bool folder = target.type == nullptr;
+    bool variable = !folder && browseDataType(target.type->kind) != nullptr;
+    node->head.nodeClass = variable ? UA_NODECLASS_VARIABLE : UA_NODECLASS_OBJECT;
+    UA_NodeId_copy(&nodeId, &node->head.nodeId);
+    size_t dot = path.rfind('.');
+    std::string name = dot == std::string::npos ? path : path.substr(dot + 1);
+    node->head.browseName = UA_QUALIFIEDNAME_ALLOC(store.namespaceIndex, name.c_str());
+    if (variable) {
+        UA_VariableAttributes attr = UA_VariableAttributes_default;
+        attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+        attr.dataType = browseDataType(target.type->kind)->typeId;
+        UA_Node_setAttributes(node, &attr, &UA_TYPES[UA_TYPES_VARIABLEATTRIBUTES]);
+        node->variableNode.valueSourceType = UA_VALUESOURCETYPE_CALLBACK;
+        node->variableNode.valueSource.callback.read = browseRead;
+        node->variableNode.valueSource.callback.write = nullptr;
+        node->head.context = &made->target;
+    }
+    else {
+        UA_ObjectAttributes attr = UA_ObjectAttributes_default;
+        UA_Node_setAttributes(node, &attr, &UA_TYPES[UA_TYPES_OBJECTATTRIBUTES]);
+    }
+
+    if (UA_ReferenceTypeSet_contains(&references, UA_REFERENCETYPEINDEX_HASTYPEDEFINITION)) {
+        UA_UInt32 definition = folder ? UA_NS0ID_FOLDERTYPE : variable ? UA_NS0ID_BASEDATAVARIABLETYPE : UA_NS0ID_BASEOBJECTTYPE;
+        UA_QualifiedName definitionName = UA_QUALIFIEDNAME(0, (char*)(folder ? "FolderType" : variable ? "BaseDataVariableType" : "BaseObjectType"));
+        addBrowseReference(node, UA_REFERENCETYPEINDEX_HASTYPEDEFINITION, true, UA_NODEID_NUMERIC(0, definition), definitionName);
+    }
+    if (folder) {
+        if (UA_ReferenceTypeSet_contains(&references, UA_REFERENCETYPEINDEX_ORGANIZES)) {
+            addBrowseReference(node, UA_REFERENCETYPEINDEX_ORGANIZES, false, UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                               UA_QUALIFIEDNAME(0, (char*)"Objects"));
+            for (const OPCUABrowseRoot& root : store.roots) {
+                addBrowseReference(node, UA_REFERENCETYPEINDEX_ORGANIZES, true,
+                                   UA_NODEID_STRING(store.namespaceIndex, (char*)root.name.c_str()),
+                                   UA_QUALIFIEDNAME(store.namespaceIndex, (char*)root.name.c_str()));
+            }
+        }
+        return node;
+    }
+    bool program = path.find_first_of(".[") == std::string::npos;
+    if (program && UA_ReferenceTypeSet_contains(&references, UA_REFERENCETYPEINDEX_ORGANIZES)) {
+        addBrowseReference(node, UA_REFERENCETYPEINDEX_ORGANIZES, false, UA_NODEID_STRING(store.namespaceIndex, (char*)BROWSE_FOLDER),
+                           UA_QUALIFIEDNAME(store.namespaceIndex, (char*)BROWSE_FOLDER));
+    }
+    if (!UA_ReferenceTypeSet_contains(&references, UA_REFERENCETYPEINDEX_HASCOMPONENT)) {
+        return node;
+    }
+    if (!program) {
+        std::string parent = path.substr(0, dot == std::string::npos ? path.find('[') : dot);
+        size_t parentDot = parent.rfind('.');
+        std::string parentName = parentDot == std::string::npos ? parent : parent.substr(parentDot + 1);
+        addBrowseReference(node, UA_REFERENCETYPEINDEX_HASCOMPONENT, false,
+                           UA_NODEID_STRING(store.namespaceIndex, (char*)parent.c_str()),
+                           UA_QUALIFIEDNAME(store.namespaceIndex, (char*)parentName.c_str()));
+    }
+    if (target.type->kind == BrowseKind::Object) {
+        for (size_t i = 0; i < target.type->count; i++) {
+            const BrowseMember& member = target.type->members[i];
+            if (member.type()->kind == BrowseKind::Opaque) {
+                continue;
+            }
+            std::string child = path + "." + member.name;
+            addBrowseReference(node, UA_REFERENCETYPEINDEX_HASCOMPONENT, true,
+                               UA_NODEID_STRING(store.namespaceIndex, (char*)child.c_str()),
+                               UA_QUALIFIEDNAME(store.namespaceIndex, (char*)member.name));
+        }
+    }
+    else if (target.type->kind == BrowseKind::Array && target.type->elementType()->kind != BrowseKind::Opaque) {
+        for (size_t i = 0; i < target.type->length; i++) {
+            std::string element = name + "[" + std::to_string(target.type->low + static_cast<int64_t>(i)) + "]";
+            std::string child = path.substr(0, path.size() - name.size()) + element;
+            addBrowseReference(node, UA_REFERENCETYPEINDEX_HASCOMPONENT, true,
+                               UA_NODEID_STRING(store.namespaceIndex, (char*)child.c_str()),
+                               UA_QUALIFIEDNAME(store.namespaceIndex, (char*)element.c_str()));
+        }
+    }
+    return node;
+}
+
+/**
+ * Whether a node ID is in the namespace of the published programs, whose nodes are made up.
+ * @param store The nodestore.
+ * @param nodeId The node ID.
+ * @returns Returns true if the node is made up.
+ */
+static bool isBrowseNode(const OPCUABrowseStore& store, const UA_NodeId& nodeId) {
+    return store.namespaceIndex != 0 && nodeId.namespaceIndex == store.namespaceIndex;
+}
+
+static void browseStoreClear(void* context) {
+    auto* store = static_cast<OPCUABrowseStore*>(context);
+    store->inner.clear(store->inner.context);
+}
+
+static UA_Node* browseStoreNewNode(void* context, UA_NodeClass nodeClass) {
+    auto* store = static_cast<OPCUABrowseStore*>(context);
+    return store->inner.newNode(store->inner.context, nodeClass);
+}
+
+static void browseStoreDeleteNode(void* context, UA_Node* node) {
+    auto* store = static_cast<OPCUABrowseStore*>(context);
+    store->inner.deleteNode(store->inner.context, node);
+}
+
+static const UA_Node* browseStoreGetNode(void* context, const UA_NodeId* nodeId, UA_UInt32 attributeMask,
+                                         UA_ReferenceTypeSet references, UA_BrowseDirection directions) {
+    auto* store = static_cast<OPCUABrowseStore*>(context);
+    if (isBrowseNode(*store, *nodeId)) {
+        return makeBrowseNode(*store, *nodeId, references);
+    }
+    return store->inner.getNode(store->inner.context, nodeId, attributeMask, references, directions);
+}
+
+static const UA_Node* browseStoreGetNodeFromPtr(void* context, UA_NodePointer ptr, UA_UInt32 attributeMask,
+                                                UA_ReferenceTypeSet references, UA_BrowseDirection directions) {
+    auto* store = static_cast<OPCUABrowseStore*>(context);
+    if (!UA_NodePointer_isLocal(ptr)) {
+        return nullptr;
+    }
+    UA_NodeId nodeId = UA_NodePointer_toNodeId(ptr);
+    if (isBrowseNode(*store, nodeId)) {
+        return makeBrowseNode(*store, nodeId, references);
+    }
+    return store->inner.getNodeFromPtr(store->inner.context, ptr, attributeMask, references, directions);
+}
+
+static UA_Node* browseStoreGetEditNode(void* context, const UA_NodeId* nodeId, UA_UInt32 attributeMask,
+                                       UA_ReferenceTypeSet references, UA_BrowseDirection directions) {
+    auto* store = static_cast<OPCUABrowseStore*>(context);
+    if (isBrowseNode(*store, *nodeId)) {
+        return nullptr;
+    }
+    return store->inner.getEditNode(store->inner.context, nodeId, attributeMask, references, directions);
+}
+
+static UA_Node* browseStoreGetEditNodeFromPtr(void* context, UA_NodePointer ptr, UA_UInt32 attributeMask,
+                                              UA_ReferenceTypeSet references, UA_BrowseDirection directions) {
+    auto* store = static_cast<OPCUABrowseStore*>(context);
+    if (UA_NodePointer_isLocal(ptr) && isBrowseNode(*store, UA_NodePointer_toNodeId(ptr))) {
+        return nullptr;
+    }
+    return store->inner.getEditNodeFromPtr(store->inner.context, ptr, attributeMask, references, directions);
+}
+
+static void browseStoreReleaseNode(void* context, const UA_Node* node) {
+    auto* store = static_cast<OPCUABrowseStore*>(context);
+    if (node != nullptr && isBrowseNode(*store, node->head.nodeId)) {
+        UA_Node* made = const_cast<UA_Node*>(node);
+        UA_Node_clear(made);
+        UA_free(made);
+        return;
+    }
+    store->inner.releaseNode(store->inner.context, node);
+}
+
+static UA_StatusCode browseStoreGetNodeCopy(void* context, const UA_NodeId* nodeId, UA_Node** outNode) {
+    auto* store = static_cast<OPCUABrowseStore*>(context);
+    if (isBrowseNode(*store, *nodeId)) {
+        return UA_STATUSCODE_BADNOTWRITABLE;
+    }
+    return store->inner.getNodeCopy(store->inner.context, nodeId, outNode);
+}
+
+static UA_StatusCode browseStoreInsertNode(void* context, UA_Node* node, UA_NodeId* addedNodeId) {
+    auto* store = static_cast<OPCUABrowseStore*>(context);
+    if (isBrowseNode(*store, node->head.nodeId)) {
+        store->inner.deleteNode(store->inner.context, node);
+        return UA_STATUSCODE_BADNODEIDREJECTED;
+    }
+    return store->inner.insertNode(store->inner.context, node, addedNodeId);
+}
+
+static UA_StatusCode browseStoreReplaceNode(void* context, UA_Node* node) {
+    auto* store = static_cast<OPCUABrowseStore*>(context);
+    return store->inner.replaceNode(store->inner.context, node);
+}
+
+static UA_StatusCode browseStoreRemoveNode(void* context, const UA_NodeId* nodeId) {
+    auto* store = static_cast<OPCUABrowseStore*>(context);
+    if (isBrowseNode(*store, *nodeId)) {
+        return UA_STATUSCODE_BADNOTWRITABLE;
+    }
+    return store->inner.removeNode(store->inner.context, nodeId);
+}
+
+static const UA_NodeId* browseStoreGetReferenceTypeId(void* context, UA_Byte refTypeIndex) {
+    auto* store = static_cast<OPCUABrowseStore*>(context);
+    return store->inner.getReferenceTypeId(store->inner.context, refTypeIndex);
+}
+
+static void browseStoreIterate(void* context, UA_NodestoreVisitor visitor, void* visitorContext) {
+    auto* store = static_cast<OPCUABrowseStore*>(context);
+    store->inner.iterate(store->inner.context, visitor, visitorContext);
+}
+
+/**
+ * Wraps the stack's nodestore, so that the nodes of the published programs are made up rather than stored.
+ * @param store The context of the wrapper, which holds the stack's nodestore.
+ * @param nodestore Receives the wrapper.
+ * @returns Returns the status of creating the stack's nodestore.
+ */
+static UA_StatusCode wrapNodestore(OPCUABrowseStore& store, UA_Nodestore& nodestore) {
+    UA_StatusCode status = UA_Nodestore_HashMap(&store.inner);
+    if (status != UA_STATUSCODE_GOOD) {
+        return status;
+    }
+    nodestore.context = &store;
+    nodestore.clear = browseStoreClear;
+    nodestore.newNode = browseStoreNewNode;
+    nodestore.deleteNode = browseStoreDeleteNode;
+    nodestore.getNode = browseStoreGetNode;
+    nodestore.getNodeFromPtr = browseStoreGetNodeFromPtr;
+    nodestore.getEditNode = browseStoreGetEditNode;
+    nodestore.getEditNodeFromPtr = browseStoreGetEditNodeFromPtr;
+    nodestore.releaseNode = browseStoreReleaseNode;
+    nodestore.getNodeCopy = browseStoreGetNodeCopy;
+    nodestore.insertNode = browseStoreInsertNode;
+    nodestore.replaceNode = browseStoreReplaceNode;
+    nodestore.removeNode = browseStoreRemoveNode;
+    nodestore.getReferenceTypeId = browseStoreGetReferenceTypeId;
+    nodestore.iterate = browseStoreIterate;
+    return UA_STATUSCODE_GOOD;
 }
 
 OPCUAServer::OPCUAServer() {
-    server = UA_Server_new();
+    // The default configuration keeps the nodestore it is given, which is the stack's own, wrapped.
+    UA_ServerConfig initial;
+    std::memset(&initial, 0, sizeof(initial));
+    wrapNodestore(browseStore, initial.nodestore);
+    UA_ServerConfig_setDefault(&initial);
+    server = UA_Server_newWithConfig(&initial);
     UA_ServerConfig* config = UA_Server_getConfig(server);
-
-    // Initialize config (minimal or default)
-    UA_ServerConfig_setDefault(config);  // or UA_ServerConfig_setMinimal(config, 4840, NULL);
+    config->context = this;
 
     // Now change endpoint URL(s)
     for (size_t i = 0; i < config->endpointsSize; ++i) {
@@ -182,20 +1274,128 @@ OPCUAServer::OPCUAServer() {
 }
 
 OPCUAServer::~OPCUAServer() {
+    setAlarmListener(nullptr);
     stop();
     UA_Server_delete(server);
+    for (auto& variable : variables) {
+        UA_NodeId_clear(&variable.node);
+    }
+}
+
+void OPCUAServer::configure(const RuntimeOptions& options) {
+    updateInterval = options.opcuaUpdate;
+    pubSubConfig = options.opcuaPubSub;
+    headless = options.benchScans > 0;
+    cooperative = options.opcuaCooperative;
+    slackBudget = options.opcuaSlack;
+    if (updateInterval > 0) {
+        UA_Server_addRepeatedCallback(server, updateCallback, this, static_cast<UA_Double>(updateInterval), nullptr);
+    }
+    // The tags are matched to the variables as they are mapped, since the symbols aren't registered yet.
+    size_t from = 0;
+    while (from < options.history.size()) {
+        size_t comma = options.history.find(',', from);
+        std::string tag = options.history.substr(from, comma == std::string::npos ? std::string::npos : comma - from);
+        from = comma == std::string::npos ? options.history.size() : comma + 1;
+        tag.erase(0, tag.find_first_not_of(' '));
+        tag.erase(tag.find_last_not_of(' ') + 1);
+        if (!tag.empty()) {
+            historized.insert(tag);
+        }
+    }
+    if (!historized.empty() && options.benchScans == 0) {
+        UA_HistoryDatabase& database = UA_Server_getConfig(server)->historyDatabase;
+        database = UA_HistoryDatabase{};
+        database.context = this;
+        database.readRaw = readHistoryRaw;
+    }
+}
+
+void OPCUAServer::readHistoryRaw(UA_Server*, void*, const UA_NodeId*, void*, const UA_RequestHeader*,
+                                 const UA_ReadRawModifiedDetails* details, UA_TimestampsToReturn, UA_Boolean,
+                                 size_t nodesToReadSize, const UA_HistoryReadValueId* nodesToRead,
+                                 UA_HistoryReadResponse* response, UA_HistoryData* const* const historyData) {
+    NODALIS_TRACE_SCOPE(TraceCategory::OPCUA, "history");
+    // OPC UA times are in 100 ns ticks since 1601, and the historian's in microseconds since 1970.
+    auto toMicros = [](UA_DateTime time) { return (time - UA_DATETIME_UNIX_EPOCH) / UA_DATETIME_USEC; };
+    bool reverse = details->startTime > details->endTime && details->endTime != 0;
+    int64_t from = details->startTime == 0 ? INT64_MIN : toMicros(reverse ? details->endTime : details->startTime);
+    int64_t to = details->endTime == 0 ? INT64_MAX : toMicros(reverse ? details->startTime : details->endTime);
+    std::vector<HistorySample> samples;
+    for (size_t n = 0; n < nodesToReadSize; n++) {
+        UA_HistoryReadResult& result = response->results[n];
+        const UA_NodeId& node = nodesToRead[n].nodeId;
+        if (node.namespaceIndex != 1 || node.identifierType != UA_NODEIDTYPE_STRING) {
+            result.statusCode = UA_STATUSCODE_BADHISTORYOPERATIONUNSUPPORTED;
+            continue;
+        }
+        std::string name(reinterpret_cast<const char*>(node.identifier.string.data), node.identifier.string.length);
+        samples.clear();
+        int width = 0;
+        // Reading backwards takes the newest values, so the limit can only be applied after the whole range is read.
+        if (!readHistory(name, from, to, reverse ? 0 : details->numValuesPerNode, samples, width)) {
+            result.statusCode = UA_STATUSCODE_BADHISTORYOPERATIONUNSUPPORTED;
+            continue;
+        }
+        if (reverse) {
+            std::reverse(samples.begin(), samples.end());
+            if (details->numValuesPerNode > 0 && samples.size() > details->numValuesPerNode) {
+                samples.resize(details->numValuesPerNode);
+            }
+        }
+        if (samples.empty()) {
+            result.statusCode = UA_STATUSCODE_GOODNODATA;
+            continue;
+        }
+        UA_DataValue* values = static_cast<UA_DataValue*>(UA_Array_new(samples.size(), &UA_TYPES[UA_TYPES_DATAVALUE]));
+        if (values == nullptr) {
+            result.statusCode = UA_STATUSCODE_BADOUTOFMEMORY;
+            continue;
+        }
+        for (size_t s = 0; s < samples.size(); s++) {
+            uint64_t slot = 0;
+            UA_Variant value;
+            setScalar(value, slot, width, samples[s].value);
+            UA_Variant_copy(&value, &values[s].value);
+            values[s].hasValue = true;
+            values[s].sourceTimestamp = samples[s].time * UA_DATETIME_USEC + UA_DATETIME_UNIX_EPOCH;
+            values[s].hasSourceTimestamp = true;
+        }
+        historyData[n]->dataValues = values;
+        historyData[n]->dataValuesSize = samples.size();
+    }
 }
 
 void OPCUAServer::start() {
-    if (!running) {
+    if (!running && !headless) {
+        // The variables are added before the IO is mapped, so the inputs among them find their quality here.
+        for (auto& variable : variables) {
+            variable.quality = findQualitySlot(variable.address);
+        }
+        // The messages are laid out from the variables, so this waits until they have all been mapped.
+        if (!pubSubConfig.empty() && publisher.load(server, pubSubConfig, variablesByName)) {
+            publisher.start();
+        }
         running = true;
-        serverThread = std::thread(&OPCUAServer::run, this);
+        if (cooperative) {
+            // The scheduler iterates the server between cycles, so no thread of its own competes with the tasks.
+            iterations = &registerStats("OPCUA.Iterate");
+            UA_Server_run_startup(server);
+            setSlackWork([this]() { return iterate(); }, slackBudget);
+        }
+        else {
+            serverThread = std::thread(&OPCUAServer::run, this);
+        }
     }
 }
 
 void OPCUAServer::stop() {
+    publisher.stop();
     if (running) {
         running = false;
+        if (cooperative) {
+            setSlackWork(nullptr, 0);
+        }
         UA_Server_run_shutdown(server);
         if (serverThread.joinable())
             serverThread.join();
@@ -203,88 +1403,1087 @@ void OPCUAServer::stop() {
 }
 
 void OPCUAServer::run() {
+    moveToBackground();
+    NODALIS_TRACE_THREAD("OPC UA");
     UA_Server_run(server, (const volatile UA_Boolean*)&running);
 }
 
+/**
+ * The longest the cooperative server goes between iterations, in milliseconds, so that requests are answered
+ * promptly, since an iteration doesn't wait for the network.
+ */
+static constexpr uint64_t OPCUA_COOPERATIVE_PERIOD = 5;
+
+uint64_t OPCUAServer::iterate() {
+    NODALIS_TRACE_SCOPE(TraceCategory::OPCUA, "iterate");
+    auto start = std::chrono::steady_clock::now();
+    uint64_t wait = UA_Server_run_iterate(server, false);
+    iterations->record(microsBetween(start, std::chrono::steady_clock::now()));
+    return wait < 1 ? 1 : wait > OPCUA_COOPERATIVE_PERIOD ? OPCUA_COOPERATIVE_PERIOD : wait;
+}
+
 void OPCUAServer::mapVariable(std::string varname, std::string addr){
-    auto* addrStr = new std::string(addr.c_str());
+    // The node copies its ID and names, so the name only needs to live for the call.
+    addVariable(varname.c_str(), addr);
+}
+
+void OPCUAServer::mapVariables(const OPCUASymbol* symbols, size_t count){
+    for(size_t x = 0; x < count; x++){
+        addVariable(symbols[x].name, symbols[x].address);
+    }
+}
+
+void OPCUAServer::useResource(const std::string& resource){
+    variableNamespace = UA_Server_addNamespace(server, ("urn:nodalis:resource:" + resource).c_str());
+    variableFolder = resource;
+    UA_ObjectAttributes folderAttr = UA_ObjectAttributes_default;
+    folderAttr.displayName = UA_LOCALIZEDTEXT((char*)"en-US", (char*)variableFolder.c_str());
+    UA_Server_addObjectNode(server, UA_NODEID_STRING(variableNamespace, (char*)variableFolder.c_str()),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+        UA_QUALIFIEDNAME(variableNamespace, (char*)variableFolder.c_str()),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+        folderAttr, nullptr, nullptr);
+}
+
+void OPCUAServer::addVariable(const char* name, const std::string& addr){
+    // The address is resolved here, once, rather than on every read.
+    ResolvedAddress address;
+    NODALIS_TRY{
+        address = resolveAddress(addr, -1, addr.find('.') != std::string::npos);
+    }
+    NODALIS_CATCH(e){
+        nodalisLog() << "OPC UA variable " << name << " has an invalid address: " << e.what() << "\n";
+        return;
+    }
+    const UA_DataType* type = address.bit > -1 ? &UA_TYPES[UA_TYPES_BOOLEAN]
+        : address.width == 8 ? &UA_TYPES[UA_TYPES_BYTE]
+        : address.width == 16 ? &UA_TYPES[UA_TYPES_UINT16]
+        : address.width == 32 ? &UA_TYPES[UA_TYPES_UINT32]
+        : &UA_TYPES[UA_TYPES_UINT64];
+    UA_NodeId node = UA_NODEID_STRING(variableNamespace, (char*)name);
+    UA_NodeId parent = variableFolder.empty() ? UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER)
+        : UA_NODEID_STRING(variableNamespace, (char*)variableFolder.c_str());
+    variables.push_back(OPCUAVariable{address, type, UA_NODEID_NULL, 0, UA_STATUSCODE_GOOD, NO_QUALITY_SLOT});
+    OPCUAVariable& variable = variables.back();
+    UA_NodeId_copy(&node, &variable.node);
+    variablesByName[name] = &variable;
 
-    UA_DataSource ds;
-    ds.read = staticRead;
-    ds.write = staticWrite;
-    char* lang = (char*)malloc(6);
-    strcpy(lang, "en-US");
     UA_VariableAttributes attr = UA_VariableAttributes_default;
-    attr.displayName = UA_LOCALIZEDTEXT(lang,(char*) varname.c_str());
+    attr.displayName = UA_LOCALIZEDTEXT((char*)"en-US", (char*)name);
     attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
-    if(addr.find('.') != std::string::npos){
-        UA_Server_addDataSourceVariableNode(
-            server,
-            UA_NODEID_STRING(1, (char*)varname.c_str()),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, (char*)varname.c_str()),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
-            attr,
-            ds,
-            addrStr,  // pass the address as a string*
-            nullptr
-        );
-    }
-    else if(addr.c_str()[2] == 'X'){
-        UA_Server_addDataSourceVariableNode(
-            server,
-            UA_NODEID_STRING(1, (char*)varname.c_str()),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, (char*)varname.c_str()),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
-            attr,
-            ds,
-            addrStr,  // pass the address as a string*
-            nullptr
-        );
-    }
-    else if(addr.c_str()[2] == 'W'){
-        UA_Server_addDataSourceVariableNode(
-            server,
-            UA_NODEID_STRING(1, (char*)varname.c_str()),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, (char*)varname.c_str()),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
-            attr,
-            ds,
-            addrStr,  // pass the address as a string*
-            nullptr
-        );
-    }
-    else if(addr.c_str()[2] == 'D'){
-        UA_Server_addDataSourceVariableNode(
-            server,
-            UA_NODEID_STRING(1, (char*)varname.c_str()),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, (char*)varname.c_str()),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
-            attr,
-            ds,
-            addrStr,  // pass the address as a string*
-            nullptr
-        );
+    if (historized.count(name) > 0 || historized.count(addr) > 0) {
+        attr.accessLevel |= UA_ACCESSLEVELMASK_HISTORYREAD;
+        attr.historizing = true;
     }
-    else if (addr.c_str()[2] == 'L')
-    {
-        UA_Server_addDataSourceVariableNode(
-            server,
-            UA_NODEID_STRING(1, (char *)varname.c_str()),
-            UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+    attr.dataType = type->typeId;
+    attr.valueRank = UA_VALUERANK_SCALAR;
+    if (updateInterval > 0) {
+        // A value node holds its last value, so sampling it doesn't touch the image, and its subscriptions only
+        // notify when an update actually changes it.
+        uint64_t slot = 0;
+        setScalar(attr.value, slot, address.bit > -1 ? 1 : address.width, 0);
+        UA_Server_addVariableNode(server, variable.node,
+            parent,
             UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-            UA_QUALIFIEDNAME(1, (char *)varname.c_str()),
+            UA_QUALIFIEDNAME(variableNamespace, (char*)name),
             UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
-            attr,
-            ds,
-            addrStr, // pass the address as a string*
-            nullptr);
+            attr, &variable, nullptr);
+        UA_ValueCallback callback;
+        callback.onRead = nullptr;
+        callback.onWrite = valueWritten;
+        UA_Server_setVariableNode_valueCallback(server, variable.node, callback);
+        return;
+    }
+
+    UA_DataSource ds;
+    ds.read = staticRead;
+    ds.write = staticWrite;
+    UA_Server_addDataSourceVariableNode(
+        server,
+        node,
+        parent,
+        UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+        UA_QUALIFIEDNAME(variableNamespace, (char*)name),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+        attr,
+        ds,
+        &variable,
+        nullptr
+    );
+}
+
+void OPCUAServer::updateCallback(UA_Server*, void* data) {
+    static_cast<OPCUAServer*>(data)->updateVariables();
+}
+
+void OPCUAServer::valueWritten(UA_Server* server, const UA_NodeId*, void*, const UA_NodeId*, void* nodeContext,
+                               const UA_NumericRange*, const UA_DataValue* data) {
+    auto* self = static_cast<OPCUAServer*>(UA_Server_getConfig(server)->context);
+    // The updates are written from the server thread, which is also the only thread that calls this.
+    if (self->updating || !data->hasValue) {
+        return;
+    }
+    NODALIS_TRACE_SCOPE(TraceCategory::OPCUA, "write");
+    stageVariable(*static_cast<OPCUAVariable*>(nodeContext), data->value);
+}
+
+void OPCUAServer::updateVariables() {
+    if (variables.empty()) {
+        return;
+    }
+    NODALIS_TRACE_SCOPE(TraceCategory::OPCUA, "update");
+    // The values are all taken from one image, and the nodes are updated after it is released. Only the variables
+    // in lines that changed are read again.
+    updateValues.resize(variables.size());
+    bool changed = imageChanges.read([this](const uint8_t* image, const ImageChanges& changes) {
+        for (size_t x = 0; x < variables.size(); x++) {
+            const ResolvedAddress& address = variables[x].address;
+            bool dirty = changes.isChanged(address.bit > -1 ? address.bitOffset : address.offset);
+            updateValues[x] = dirty ? address.load(image) : variables[x].last;
+        }
+    });
+    // A change of quality alone is looked for too, since an input whose device stopped answering keeps its value.
+    uint64_t qualities = QUALITY_CHANGES.load(std::memory_order_relaxed);
+    if (!changed && qualities == qualityChanges) {
+        return;
+    }
+    qualityChanges = qualities;
+    updating = true;
+    for (size_t x = 0; x < variables.size(); x++) {
+        OPCUAVariable& variable = variables[x];
+        UA_StatusCode status = variableStatus(variable);
+        if (updateValues[x] == variable.last && status == variable.status) {
+            continue;
+        }
+        uint64_t slot = 0;
+        UA_Variant value;
+        setScalar(value, slot, variable.address.bit > -1 ? 1 : variable.address.width, updateValues[x]);
+        if (status == variable.status && variable.quality == NO_QUALITY_SLOT) {
+            UA_Server_writeValue(server, variable.node, value);
+        }
+        else {
+            // The status is written with the value even when it is good, so that it replaces a bad one.
+            UA_DataValue data;
+            UA_DataValue_init(&data);
+            data.value = value;
+            data.hasValue = true;
+            setValueQuality(variable, status, data);
+            data.hasStatus = true;
+            UA_Server_writeDataValue(server, variable.node, data);
+        }
+        variable.last = updateValues[x];
+        variable.status = status;
+    }
+    updating = false;
+}
+
+enum StatisticsField : int {
+    STAT_COUNT,
+    STAT_MINIMUM,
+    STAT_MAXIMUM,
+    STAT_AVERAGE,
+    STAT_LAST,
+    STAT_OVERRUNS,
+    STAT_HISTOGRAM
+};
+
+static UA_StatusCode statisticsRead(UA_Server*, const UA_NodeId*, void*, const UA_NodeId*, void* nodeContext,
+                                    UA_Boolean, const UA_NumericRange*, UA_DataValue* dataValue) {
+    auto* node = static_cast<StatisticsNode*>(nodeContext);
+    if(node->field == STAT_HISTOGRAM){
+        UA_UInt64 buckets[ExecutionStats::HISTOGRAM_BUCKETS];
+        for(int x = 0; x < ExecutionStats::HISTOGRAM_BUCKETS; x++){
+            buckets[x] = node->stats->getHistogram(x);
+        }
+        UA_Variant_setArrayCopy(&dataValue->value, buckets, ExecutionStats::HISTOGRAM_BUCKETS, &UA_TYPES[UA_TYPES_UINT64]);
+    }
+    else{
+        UA_UInt64 value = 0;
+        switch(node->field){
+            case STAT_COUNT: value = node->stats->getCount(); break;
+            case STAT_MINIMUM: value = node->stats->getMinimum(); break;
+            case STAT_MAXIMUM: value = node->stats->getMaximum(); break;
+            case STAT_AVERAGE: value = node->stats->getAverage(); break;
+            case STAT_LAST: value = node->stats->getLast(); break;
+            case STAT_OVERRUNS: value = node->stats->getOverruns(); break;
+        }
+        UA_Variant_setScalarCopy(&dataValue->value, &value, &UA_TYPES[UA_TYPES_UINT64]);
+    }
+    dataValue->hasValue = true;
+    return UA_STATUSCODE_GOOD;
+}
+
+void OPCUAServer::mapStatistics(){
+    static const char* fieldNames[] = { "Count", "Minimum", "Maximum", "Average", "Last", "Overruns", "Histogram" };
+    UA_NodeId folderId = UA_NODEID_STRING(1, (char*)"Statistics");
+    UA_ObjectAttributes folderAttr = UA_ObjectAttributes_default;
+    folderAttr.displayName = UA_LOCALIZEDTEXT((char*)"en-US", (char*)"Statistics");
+    UA_Server_addObjectNode(server, folderId,
+        UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+        UA_QUALIFIEDNAME(1, (char*)"Statistics"),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+        folderAttr, nullptr, nullptr);
+
+    for(auto* stats : getAllStats()){
+        std::string objectName = "Statistics." + stats->getName();
+        UA_ObjectAttributes objectAttr = UA_ObjectAttributes_default;
+        objectAttr.displayName = UA_LOCALIZEDTEXT((char*)"en-US", (char*)stats->getName().c_str());
+        UA_Server_addObjectNode(server, UA_NODEID_STRING(1, (char*)objectName.c_str()),
+            folderId,
+            UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+            UA_QUALIFIEDNAME(1, (char*)stats->getName().c_str()),
+            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE),
+            objectAttr, nullptr, nullptr);
+
+        for(int field = STAT_COUNT; field <= STAT_HISTOGRAM; field++){
+            std::string varName = objectName + "." + fieldNames[field];
+            UA_DataSource ds;
+            ds.read = statisticsRead;
+            ds.write = nullptr;
+            UA_VariableAttributes attr = UA_VariableAttributes_default;
+            attr.displayName = UA_LOCALIZEDTEXT((char*)"en-US", (char*)fieldNames[field]);
+            attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+            attr.dataType = UA_TYPES[UA_TYPES_UINT64].typeId;
+            UA_UInt32 buckets = ExecutionStats::HISTOGRAM_BUCKETS;
+            if(field == STAT_HISTOGRAM){
+                attr.valueRank = UA_VALUERANK_ONE_DIMENSION;
+                attr.arrayDimensionsSize = 1;
+                attr.arrayDimensions = &buckets;
+            }
+            else{
+                attr.valueRank = UA_VALUERANK_SCALAR;
+            }
+            statistics.push_back(StatisticsNode{stats, field});
+            UA_Server_addDataSourceVariableNode(server, UA_NODEID_STRING(1, (char*)varName.c_str()),
+                UA_NODEID_STRING(1, (char*)objectName.c_str()),
+                UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                UA_QUALIFIEDNAME(1, (char*)fieldNames[field]),
+                UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                attr, ds, &statistics.back(), nullptr);
+        }
+    }
+}
+
+static UA_StatusCode diagnosticsRead(UA_Server*, const UA_NodeId*, void*, const UA_NodeId*, void* nodeContext,
+                                     UA_Boolean, const UA_NumericRange*, UA_DataValue* dataValue) {
+    auto* node = static_cast<DiagnosticsNode*>(nodeContext);
+    uint64_t value = node->sample();
+    if (node->type == &UA_TYPES[UA_TYPES_BOOLEAN]) {
+        UA_Boolean state = value != 0;
+        UA_Variant_setScalarCopy(&dataValue->value, &state, node->type);
+    }
+    else {
+        UA_UInt64 count = value;
+        UA_Variant_setScalarCopy(&dataValue->value, &count, node->type);
+    }
+    dataValue->hasValue = true;
+    return UA_STATUSCODE_GOOD;
+}
+
+void OPCUAServer::addDiagnosticsObject(const std::string& id, const UA_NodeId& parent, const std::string& name) {
+    UA_ObjectAttributes attr = UA_ObjectAttributes_default;
+    attr.displayName = UA_LOCALIZEDTEXT((char*)"en-US", (char*)name.c_str());
+    UA_Server_addObjectNode(server, UA_NODEID_STRING(1, (char*)id.c_str()), parent,
+        UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+        UA_QUALIFIEDNAME(1, (char*)name.c_str()),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE),
+        attr, nullptr, nullptr);
+}
+
+void OPCUAServer::addDiagnosticsValue(const std::string& object, const char* name, bool boolean,
+                                      std::function<uint64_t()> sample) {
+    diagnostics.push_back(DiagnosticsNode{std::move(sample), boolean ? &UA_TYPES[UA_TYPES_BOOLEAN] : &UA_TYPES[UA_TYPES_UINT64]});
+    std::string id = object + "." + name;
+    UA_DataSource ds;
+    ds.read = diagnosticsRead;
+    ds.write = nullptr;
+    UA_VariableAttributes attr = UA_VariableAttributes_default;
+    attr.displayName = UA_LOCALIZEDTEXT((char*)"en-US", (char*)name);
+    attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+    attr.dataType = diagnostics.back().type->typeId;
+    attr.valueRank = UA_VALUERANK_SCALAR;
+    UA_Server_addDataSourceVariableNode(server, UA_NODEID_STRING(1, (char*)id.c_str()),
+        UA_NODEID_STRING(1, (char*)object.c_str()),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+        UA_QUALIFIEDNAME(1, (char*)name),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+        attr, ds, &diagnostics.back(), nullptr);
+}
+
+/**
+ * Gets the string of a method argument.
+ */
+static std::string methodString(const UA_Variant& input) {
+    if (!UA_Variant_hasScalarType(&input, &UA_TYPES[UA_TYPES_STRING])) {
+        return "";
+    }
+    const UA_String* text = static_cast<const UA_String*>(input.data);
+    return std::string(reinterpret_cast<const char*>(text->data), text->length);
+}
+
+/**
+ * Serves the Force method: forces a located global or an address to a value.
+ */
+static UA_StatusCode forceCalled(UA_Server*, const UA_NodeId*, void*, const UA_NodeId*, void*, const UA_NodeId*, void*,
+                                 size_t inputSize, const UA_Variant* input, size_t, UA_Variant*) {
+    if (inputSize < 2 || !UA_Variant_hasScalarType(&input[1], &UA_TYPES[UA_TYPES_UINT64])) {
+        return UA_STATUSCODE_BADARGUMENTSMISSING;
+    }
+    uint64_t value = *static_cast<const UA_UInt64*>(input[1].data);
+    return forceAddress(methodString(input[0]), value) == AddressStatus::OK ? UA_STATUSCODE_GOOD : UA_STATUSCODE_BADINVALIDARGUMENT;
+}
+
+/**
+ * Serves the Release method: releases a located global or an address.
+ */
+static UA_StatusCode releaseCalled(UA_Server*, const UA_NodeId*, void*, const UA_NodeId*, void*, const UA_NodeId*, void*,
+                                   size_t inputSize, const UA_Variant* input, size_t, UA_Variant*) {
+    if (inputSize < 1) {
+        return UA_STATUSCODE_BADARGUMENTSMISSING;
+    }
+    return releaseAddress(methodString(input[0])) == AddressStatus::OK ? UA_STATUSCODE_GOOD : UA_STATUSCODE_BADINVALIDARGUMENT;
+}
+
+/**
+ * Serves the ReleaseAll method.
+ */
+static UA_StatusCode releaseAllCalled(UA_Server*, const UA_NodeId*, void*, const UA_NodeId*, void*, const UA_NodeId*, void*,
+                                      size_t, const UA_Variant*, size_t, UA_Variant*) {
+    releaseAllForces();
+    return UA_STATUSCODE_GOOD;
+}
+
+/**
+ * Serves the List method: the forces, each as its address and value, such as %QW0=42.
+ */
+static UA_StatusCode listForcesCalled(UA_Server*, const UA_NodeId*, void*, const UA_NodeId*, void*, const UA_NodeId*, void*,
+                                      size_t, const UA_Variant*, size_t outputSize, UA_Variant* output) {
+    if (outputSize < 1) {
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+    std::vector<ForcedAddress> forces = listForces();
+    std::vector<std::string> texts;
+    std::vector<UA_String> strings;
+    texts.reserve(forces.size());
+    for (const auto& force : forces) {
+        texts.push_back(force.address + "=" + std::to_string(force.value));
+    }
+    for (const auto& text : texts) {
+        strings.push_back(UA_String{text.size(), reinterpret_cast<UA_Byte*>(const_cast<char*>(text.data()))});
+    }
+    return UA_Variant_setArrayCopy(output, strings.data(), strings.size(), &UA_TYPES[UA_TYPES_STRING]);
+}
+
+/**
+ * Serves the Acknowledge method of the alarms: acknowledges an alarm by name or address.
+ */
+static UA_StatusCode acknowledgeCalled(UA_Server*, const UA_NodeId*, void*, const UA_NodeId*, void*, const UA_NodeId*, void*,
+                                       size_t inputSize, const UA_Variant* input, size_t, UA_Variant*) {
+    if (inputSize < 1) {
+        return UA_STATUSCODE_BADARGUMENTSMISSING;
+    }
+    return acknowledgeAlarm(methodString(input[0])) ? UA_STATUSCODE_GOOD : UA_STATUSCODE_BADINVALIDARGUMENT;
+}
+
+/**
+ * Serves the AcknowledgeAll method of the alarms.
+ */
+static UA_StatusCode acknowledgeAllCalled(UA_Server*, const UA_NodeId*, void*, const UA_NodeId*, void*, const UA_NodeId*, void*,
+                                          size_t, const UA_Variant*, size_t, UA_Variant*) {
+    acknowledgeAllAlarms();
+    return UA_STATUSCODE_GOOD;
+}
+
+/**
+ * Serves the List method of the alarms: the alarms that are active or unacknowledged, each as its name and its
+ * states, such as Overheat=ACTIVE,UNACKNOWLEDGED.
+ */
+static UA_StatusCode listAlarmsCalled(UA_Server*, const UA_NodeId*, void*, const UA_NodeId*, void*, const UA_NodeId*, void*,
+                                      size_t, const UA_Variant*, size_t outputSize, UA_Variant* output) {
+    if (outputSize < 1) {
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+    std::vector<AlarmState> alarms = listAlarms();
+    std::vector<std::string> texts;
+    std::vector<UA_String> strings;
+    texts.reserve(alarms.size());
+    for (const auto& alarm : alarms) {
+        texts.push_back(alarm.name + "=" + (alarm.active ? "ACTIVE" : "INACTIVE") + "," + (alarm.acknowledged ? "ACKNOWLEDGED" : "UNACKNOWLEDGED"));
+    }
+    for (const auto& text : texts) {
+        strings.push_back(UA_String{text.size(), reinterpret_cast<UA_Byte*>(const_cast<char*>(text.data()))});
+    }
+    return UA_Variant_setArrayCopy(output, strings.data(), strings.size(), &UA_TYPES[UA_TYPES_STRING]);
+}
+
+/**
+ * Finds a space of the process image for the block methods of the Image object.
+ * @param name The name of the space: I, Q or M.
+ * @param space Receives the MEMORY_SPACE.
+ * @param start Receives the offset of the space from the start of the image.
+ * @param bytes Receives the size of the space.
+ * @returns Returns false for any other name.
+ */
+static bool imageSpace(const std::string& name, int& space, size_t& start, size_t& bytes) {
+    if (name == "I") {
+        space = MEMORY_SPACE::I;
+        start = 0;
+        bytes = INPUT_IMAGE_BYTES;
+    }
+    else if (name == "Q") {
+        space = MEMORY_SPACE::Q;
+        start = INPUT_IMAGE_BYTES;
+        bytes = OUTPUT_IMAGE_BYTES;
+    }
+    else if (name == "M") {
+        space = MEMORY_SPACE::M;
+        start = INPUT_IMAGE_BYTES + OUTPUT_IMAGE_BYTES;
+        bytes = MEMORY_IMAGE_BYTES;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Serves the ReadBlock method of the Image object: a range of bytes of a space, as %IB<offset> onwards, copied from
+ * the last published image in one piece.
+ */
+static UA_StatusCode readBlockCalled(UA_Server*, const UA_NodeId*, void*, const UA_NodeId*, void*, const UA_NodeId*, void*,
+                                     size_t inputSize, const UA_Variant* input, size_t outputSize, UA_Variant* output) {
+    if (inputSize < 3 || outputSize < 1 || !UA_Variant_hasScalarType(&input[1], &UA_TYPES[UA_TYPES_UINT32]) ||
+        !UA_Variant_hasScalarType(&input[2], &UA_TYPES[UA_TYPES_UINT32])) {
+        return UA_STATUSCODE_BADARGUMENTSMISSING;
+    }
+    int space;
+    size_t start, bytes;
+    size_t offset = *static_cast<const UA_UInt32*>(input[1].data);
+    size_t length = *static_cast<const UA_UInt32*>(input[2].data);
+    if (!imageSpace(methodString(input[0]), space, start, bytes)) {
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    }
+    if (offset > bytes || length > bytes - offset) {
+        return UA_STATUSCODE_BADOUTOFRANGE;
+    }
+    UA_ByteString* data = UA_ByteString_new();
+    if (length > 0 && UA_ByteString_allocBuffer(data, length) != UA_STATUSCODE_GOOD) {
+        UA_ByteString_delete(data);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    if (length > 0) {
+        readImage([&](const uint8_t* image) { std::memcpy(data->data, image + start + offset, length); });
+    }
+    UA_Variant_setScalar(output, data, &UA_TYPES[UA_TYPES_BYTESTRING]);
+    return UA_STATUSCODE_GOOD;
+}
+
+/**
+ * Serves the WriteBlock method of the Image object: stages bytes to %Q or %M from an offset, which the next scan
+ * applies together.
+ */
+static UA_StatusCode writeBlockCalled(UA_Server*, const UA_NodeId*, void*, const UA_NodeId*, void*, const UA_NodeId*, void*,
+                                      size_t inputSize, const UA_Variant* input, size_t, UA_Variant*) {
+    if (inputSize < 3 || !UA_Variant_hasScalarType(&input[1], &UA_TYPES[UA_TYPES_UINT32]) ||
+        !UA_Variant_hasScalarType(&input[2], &UA_TYPES[UA_TYPES_BYTESTRING])) {
+        return UA_STATUSCODE_BADARGUMENTSMISSING;
+    }
+    int space;
+    size_t start, bytes;
+    std::string name = methodString(input[0]);
+    size_t offset = *static_cast<const UA_UInt32*>(input[1].data);
+    const UA_ByteString* data = static_cast<const UA_ByteString*>(input[2].data);
+    // Inputs belong to the IO, and are forced rather than written.
+    if (name == "I" || !imageSpace(name, space, start, bytes)) {
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    }
+    if (offset > bytes || data->length > bytes - offset) {
+        return UA_STATUSCODE_BADOUTOFRANGE;
+    }
+    // The block is staged as aligned 64 bit words where it can be, and as bytes around them.
+    std::vector<ResolvedAddress> addresses;
+    std::vector<uint64_t> values;
+    size_t x = 0;
+    while (x < data->length) {
+        ResolvedAddress address;
+        address.space = space;
+        address.offset = start + offset + x;
+        size_t width = address.offset % 8 == 0 && data->length - x >= 8 ? 8 : 1;
+        address.width = static_cast<int>(width * 8);
+        address.index = static_cast<int>((offset + x) / width);
+        uint64_t value = 0;
+        std::memcpy(&value, data->data + x, width);
+        addresses.push_back(address);
+        values.push_back(value);
+        x += width;
+    }
+    writeImage(addresses.data(), values.data(), addresses.size());
+    return UA_STATUSCODE_GOOD;
+}
+
+/**
+ * Serves the ReadVariables method of the Image object: the values of the named variables from one published image,
+ * one after the other in the order of the names, each as many little endian bytes as its width and a bit as a byte.
+ */
+static UA_StatusCode readVariablesCalled(UA_Server* server, const UA_NodeId*, void*, const UA_NodeId*, void*,
+                                         const UA_NodeId*, void*, size_t inputSize, const UA_Variant* input,
+                                         size_t outputSize, UA_Variant* output) {
+    if (inputSize < 1 || outputSize < 1 || !UA_Variant_hasArrayType(&input[0], &UA_TYPES[UA_TYPES_STRING])) {
+        return UA_STATUSCODE_BADARGUMENTSMISSING;
+    }
+    auto* self = static_cast<OPCUAServer*>(UA_Server_getConfig(server)->context);
+    const UA_String* names = static_cast<const UA_String*>(input[0].data);
+    std::vector<const OPCUAVariable*> variables;
+    size_t length = 0;
+    for (size_t x = 0; x < input[0].arrayLength; x++) {
+        const OPCUAVariable* variable = self->findVariable(std::string(reinterpret_cast<const char*>(names[x].data), names[x].length));
+        if (variable == nullptr) {
+            return UA_STATUSCODE_BADNODEIDUNKNOWN;
+        }
+        variables.push_back(variable);
+        length += variable->address.bit > -1 ? 1 : static_cast<size_t>(variable->address.width / 8);
+    }
+    UA_ByteString* data = UA_ByteString_new();
+    if (length > 0 && UA_ByteString_allocBuffer(data, length) != UA_STATUSCODE_GOOD) {
+        UA_ByteString_delete(data);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    if (length > 0) {
+        readImage([&](const uint8_t* image) {
+            uint8_t* out = data->data;
+            for (const OPCUAVariable* variable : variables) {
+                uint64_t value = variable->address.load(image);
+                size_t width = variable->address.bit > -1 ? 1 : static_cast<size_t>(variable->address.width / 8);
+                for (size_t b = 0; b < width; b++) {
+                    *out++ = static_cast<uint8_t>(value >> (b * 8));
+                }
+            }
+        });
+    }
+    UA_Variant_setScalar(output, data, &UA_TYPES[UA_TYPES_BYTESTRING]);
+    return UA_STATUSCODE_GOOD;
+}
+
+/**
+ * Makes a scalar argument of a method.
+ */
+static UA_Argument methodArgument(const char* name, const UA_DataType& type, int32_t valueRank = UA_VALUERANK_SCALAR) {
+    UA_Argument argument;
+    UA_Argument_init(&argument);
+    argument.name = UA_STRING(const_cast<char*>(name));
+    argument.description = UA_LOCALIZEDTEXT(const_cast<char*>("en-US"), const_cast<char*>(name));
+    argument.dataType = type.typeId;
+    argument.valueRank = valueRank;
+    return argument;
+}
+
+void OPCUAServer::addDiagnosticsMethod(const std::string& object, const char* name, UA_MethodCallback method,
+                                       const std::vector<UA_Argument>& inputs, const std::vector<UA_Argument>& outputs) {
+    std::string id = object + "." + name;
+    UA_MethodAttributes attr = UA_MethodAttributes_default;
+    attr.displayName = UA_LOCALIZEDTEXT((char*)"en-US", (char*)name);
+    attr.executable = true;
+    attr.userExecutable = true;
+    UA_Server_addMethodNode(server, UA_NODEID_STRING(1, (char*)id.c_str()),
+        UA_NODEID_STRING(1, (char*)object.c_str()),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+        UA_QUALIFIEDNAME(1, (char*)name),
+        attr, method, inputs.size(), inputs.data(), outputs.size(), outputs.data(), nullptr, nullptr);
+}
+
+void OPCUAServer::raiseAlarmEvent(const AlarmEvent& event) {
+    UA_NodeId node;
+    if (UA_Server_createEvent(server, UA_NODEID_NUMERIC(0, UA_NS0ID_BASEEVENTTYPE), &node) != UA_STATUSCODE_GOOD) {
+        return;
+    }
+    // Raised alarms are the most severe, and acknowledgements the least.
+    UA_UInt16 severity = event.kind == AlarmEventKind::Raised ? 700 : event.kind == AlarmEventKind::Cleared ? 300 : 100;
+    std::string message = event.name + (event.kind == AlarmEventKind::Raised ? " raised" :
+        event.kind == AlarmEventKind::Cleared ? " cleared" : " acknowledged");
+    UA_DateTime time = UA_DATETIME_UNIX_EPOCH + event.time * UA_DATETIME_USEC;
+    UA_LocalizedText text = UA_LOCALIZEDTEXT((char*)"en-US", (char*)message.c_str());
+    UA_String source = UA_String{event.name.size(), reinterpret_cast<UA_Byte*>(const_cast<char*>(event.name.data()))};
+    UA_NodeId sourceNode = UA_NODEID_STRING(1, (char*)"Diagnostics.Alarms");
+    UA_Server_writeObjectProperty_scalar(server, node, UA_QUALIFIEDNAME(0, (char*)"Time"), &time, &UA_TYPES[UA_TYPES_DATETIME]);
+    UA_Server_writeObjectProperty_scalar(server, node, UA_QUALIFIEDNAME(0, (char*)"Severity"), &severity, &UA_TYPES[UA_TYPES_UINT16]);
+    UA_Server_writeObjectProperty_scalar(server, node, UA_QUALIFIEDNAME(0, (char*)"Message"), &text, &UA_TYPES[UA_TYPES_LOCALIZEDTEXT]);
+    UA_Server_writeObjectProperty_scalar(server, node, UA_QUALIFIEDNAME(0, (char*)"SourceName"), &source, &UA_TYPES[UA_TYPES_STRING]);
+    UA_Server_writeObjectProperty_scalar(server, node, UA_QUALIFIEDNAME(0, (char*)"SourceNode"), &sourceNode, &UA_TYPES[UA_TYPES_NODEID]);
+    UA_Server_triggerEvent(server, node, UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER), nullptr, true);
+}
+
+void OPCUAServer::mapDiagnostics() {
+    UA_ObjectAttributes folderAttr = UA_ObjectAttributes_default;
+    folderAttr.displayName = UA_LOCALIZEDTEXT((char*)"en-US", (char*)"Diagnostics");
+    UA_Server_addObjectNode(server, UA_NODEID_STRING(1, (char*)"Diagnostics"),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+        UA_QUALIFIEDNAME(1, (char*)"Diagnostics"),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+        folderAttr, nullptr, nullptr);
+    UA_NodeId root = UA_NODEID_STRING(1, (char*)"Diagnostics");
+
+    for (auto* stats : getAllStats()) {
+        if (stats->getName() != "Scan") {
+            continue;
+        }
+        addDiagnosticsObject("Diagnostics.Scan", root, "Scan");
+        addDiagnosticsValue("Diagnostics.Scan", "Count", false, [stats]() { return stats->getCount(); });
+        addDiagnosticsValue("Diagnostics.Scan", "Average", false, [stats]() { return stats->getAverage(); });
+        addDiagnosticsValue("Diagnostics.Scan", "Maximum", false, [stats]() { return stats->getMaximum(); });
+        addDiagnosticsValue("Diagnostics.Scan", "P50", false, [stats]() { return stats->getPercentile(50); });
+        addDiagnosticsValue("Diagnostics.Scan", "P99", false, [stats]() { return stats->getPercentile(99); });
+        addDiagnosticsValue("Diagnostics.Scan", "Overruns", false, [stats]() { return stats->getOverruns(); });
+    }
+
+    addDiagnosticsObject("Diagnostics.Memory", root, "Memory");
+    addDiagnosticsValue("Diagnostics.Memory", "ResidentKB", false, []() {
+        uint64_t resident, peak;
+        getMemoryUsage(resident, peak);
+        return resident;
+    });
+    addDiagnosticsValue("Diagnostics.Memory", "PeakKB", false, []() {
+        uint64_t resident, peak;
+        getMemoryUsage(resident, peak);
+        return peak;
+    });
+    addDiagnosticsValue("Diagnostics.Memory", "ProcessImageBytes", false, []() { return static_cast<uint64_t>(sizeof(ProcessImage)); });
+#if NODALIS_ALLOC_TRACK
+    const AllocationCounters* allocations = &getAllocationCounters();
+    addDiagnosticsValue("Diagnostics.Memory", "Allocations", false, [allocations]() { return allocations->allocations.load(std::memory_order_relaxed); });
+    addDiagnosticsValue("Diagnostics.Memory", "Frees", false, [allocations]() { return allocations->frees.load(std::memory_order_relaxed); });
+    addDiagnosticsValue("Diagnostics.Memory", "AllocatedBytes", false, [allocations]() { return allocations->bytes.load(std::memory_order_relaxed); });
+    addDiagnosticsValue("Diagnostics.Memory", "HeapBytes", false, [allocations]() { return allocations->liveBytes.load(std::memory_order_relaxed); });
+    addDiagnosticsValue("Diagnostics.Memory", "ScanAllocations", false, [allocations]() { return allocations->scanAllocations.load(std::memory_order_relaxed); });
+#endif
+#if NODALIS_ARENA_BYTES > 0
+    const ArenaCounters* arena = &getArenaCounters();
+    addDiagnosticsValue("Diagnostics.Memory", "ArenaBytes", false, [arena]() { return arena->used.load(std::memory_order_relaxed); });
+    addDiagnosticsValue("Diagnostics.Memory", "ArenaOverflows", false, [arena]() { return arena->overflows.load(std::memory_order_relaxed); });
+    addDiagnosticsValue("Diagnostics.Memory", "HeapAllocations", false, [arena]() { return arena->heapAllocations.load(std::memory_order_relaxed); });
+#endif
+
+    // Forces are listed and managed through methods, so commissioning tools can force %I and %Q over OPC UA.
+    addDiagnosticsObject("Diagnostics.Forces", root, "Forces");
+    addDiagnosticsValue("Diagnostics.Forces", "Count", false, []() { return static_cast<uint64_t>(forceCount()); });
+    addDiagnosticsMethod("Diagnostics.Forces", "Force", forceCalled,
+        { methodArgument("Address", UA_TYPES[UA_TYPES_STRING]), methodArgument("Value", UA_TYPES[UA_TYPES_UINT64]) }, {});
+    addDiagnosticsMethod("Diagnostics.Forces", "Release", releaseCalled, { methodArgument("Address", UA_TYPES[UA_TYPES_STRING]) }, {});
+    addDiagnosticsMethod("Diagnostics.Forces", "ReleaseAll", releaseAllCalled, {}, {});
+    addDiagnosticsMethod("Diagnostics.Forces", "List", listForcesCalled, {},
+        { methodArgument("Forces", UA_TYPES[UA_TYPES_STRING], UA_VALUERANK_ONE_DIMENSION) });
+
+    // Alarms are acknowledged through methods, and each of their events is raised as an event of the Server object.
+    addDiagnosticsObject("Diagnostics.Alarms", root, "Alarms");
+    addDiagnosticsValue("Diagnostics.Alarms", "Active", false, []() { return static_cast<uint64_t>(activeAlarmCount()); });
+    addDiagnosticsValue("Diagnostics.Alarms", "Unacknowledged", false, []() { return static_cast<uint64_t>(unacknowledgedAlarmCount()); });
+    addDiagnosticsMethod("Diagnostics.Alarms", "Acknowledge", acknowledgeCalled, { methodArgument("Name", UA_TYPES[UA_TYPES_STRING]) }, {});
+    addDiagnosticsMethod("Diagnostics.Alarms", "AcknowledgeAll", acknowledgeAllCalled, {}, {});
+    addDiagnosticsMethod("Diagnostics.Alarms", "List", listAlarmsCalled, {},
+        { methodArgument("Alarms", UA_TYPES[UA_TYPES_STRING], UA_VALUERANK_ONE_DIMENSION) });
+    if (!headless) {
+        setAlarmListener([this](const AlarmEvent& event) { raiseAlarmEvent(event); });
+    }
+
+    addDiagnosticsObject("Diagnostics.IO", root, "IO");
+    UA_NodeId io = UA_NODEID_STRING(1, (char*)"Diagnostics.IO");
+    for (auto& client : Clients) {
+        const IOClient* source = client.get();
+        const IOCounters* counters = &source->getCounters();
+        std::string name = source->getProtocol() + "." + source->getModuleID();
+        std::string object = "Diagnostics.IO." + name;
+        addDiagnosticsObject(object, io, name);
+        addDiagnosticsValue(object, "Connected", true, [source]() { return static_cast<uint64_t>(source->connected.load()); });
+        addDiagnosticsValue(object, "Requests", false, [counters]() { return counters->requests.load(std::memory_order_relaxed); });
+        addDiagnosticsValue(object, "Errors", false, [counters]() { return counters->errors.load(std::memory_order_relaxed); });
+        addDiagnosticsValue(object, "Connects", false, [counters]() { return counters->connects.load(std::memory_order_relaxed); });
+        addDiagnosticsValue(object, "ConnectFailures", false, [counters]() { return counters->connectFailures.load(std::memory_order_relaxed); });
+        addDiagnosticsValue(object, "PollBackoffs", false, [counters]() { return counters->backoffs.load(std::memory_order_relaxed); });
+        addDiagnosticsValue(object, "PollSpeedups", false, [counters]() { return counters->speedups.load(std::memory_order_relaxed); });
+        addDiagnosticsValue(object, "Saturations", false, [counters]() { return counters->saturations.load(std::memory_order_relaxed); });
+        addDiagnosticsValue(object, "Deferrals", false, [counters]() { return counters->deferrals.load(std::memory_order_relaxed); });
+        // A successful connection after the first is a reconnect.
+        addDiagnosticsValue(object, "Reconnects", false, [counters]() {
+            uint64_t connects = counters->connects.load(std::memory_order_relaxed);
+            return connects > 0 ? connects - 1 : 0;
+        });
+        ExecutionStats* latency = counters->latency.load(std::memory_order_acquire);
+        if (latency == nullptr) {
+            continue;
+        }
+        addDiagnosticsValue(object, "LatencyAverage", false, [latency]() { return latency->getAverage(); });
+        addDiagnosticsValue(object, "LatencyMaximum", false, [latency]() { return latency->getMaximum(); });
+        addDiagnosticsValue(object, "LatencyP50", false, [latency]() { return latency->getPercentile(50); });
+        addDiagnosticsValue(object, "LatencyP90", false, [latency]() { return latency->getPercentile(90); });
+        addDiagnosticsValue(object, "LatencyP99", false, [latency]() { return latency->getPercentile(99); });
+        // The freshness of each mapping, under an object named after its local address.
+        const auto& mappings = source->getMappings();
+        const auto& freshness = source->getFreshness();
+        for (size_t x = 0; x < freshness.size() && x < mappings.size(); x++) {
+            const MappingFreshness* fresh = freshness[x].get();
+            std::string mapping = object + "." + mappings[x].localAddress;
+            addDiagnosticsObject(mapping, UA_NODEID_STRING(1, (char*)object.c_str()), mappings[x].localAddress);
+            addDiagnosticsValue(mapping, "RoundTripP50", false, [fresh]() { return fresh->roundTrip.getPercentile(50); });
+            addDiagnosticsValue(mapping, "RoundTripP99", false, [fresh]() { return fresh->roundTrip.getPercentile(99); });
+            if (fresh->output) {
+                addDiagnosticsValue(mapping, "OutputDelayP50", false, [fresh]() { return fresh->outputDelay.getPercentile(50); });
+                addDiagnosticsValue(mapping, "OutputDelayP99", false, [fresh]() { return fresh->outputDelay.getPercentile(99); });
+                addDiagnosticsValue(mapping, "OutputDelayMaximum", false, [fresh]() { return fresh->outputDelay.getMaximum(); });
+            }
+            else {
+                addDiagnosticsValue(mapping, "InputAgeP50", false, [fresh]() { return fresh->inputAge.getPercentile(50); });
+                addDiagnosticsValue(mapping, "InputAgeP99", false, [fresh]() { return fresh->inputAge.getPercentile(99); });
+                addDiagnosticsValue(mapping, "InputAgeMaximum", false, [fresh]() { return fresh->inputAge.getMaximum(); });
+                addDiagnosticsValue(mapping, "Superseded", false, [fresh]() { return fresh->superseded.load(std::memory_order_relaxed); });
+            }
+        }
+    }
+
+    size_t pouCount = 0;
+    const POUProfile* profiles = getPOUProfiles(pouCount);
+    if (pouCount == 0) {
+        return;
+    }
+    addDiagnosticsObject("Diagnostics.POUs", root, "POUs");
+    UA_NodeId pous = UA_NODEID_STRING(1, (char*)"Diagnostics.POUs");
+    // The counts are converted to nanoseconds when they are read, at the rate measured up to then.
+    auto nanos = [](const std::atomic<uint64_t>& cycles) {
+        return static_cast<uint64_t>(static_cast<double>(cycles.load(std::memory_order_relaxed)) * nanosPerCycle());
+    };
+    for (size_t x = 0; x < pouCount; x++) {
+        const POUProfile* profile = &profiles[x];
+        std::string object = std::string("Diagnostics.POUs.") + profile->name;
+        addDiagnosticsObject(object, pous, profile->name);
+        addDiagnosticsValue(object, "Calls", false, [profile]() { return profile->calls.load(std::memory_order_relaxed); });
+        addDiagnosticsValue(object, "TotalNanos", false, [profile, nanos]() { return nanos(profile->cycles); });
+        addDiagnosticsValue(object, "SelfNanos", false, [profile, nanos]() { return nanos(profile->selfCycles); });
+        addDiagnosticsValue(object, "MaximumNanos", false, [profile, nanos]() { return nanos(profile->maxCycles); });
+    }
+}
+
+void OPCUAServer::mapImage() {
+    // The image is read and written in blocks through the methods of one object, so that a client can fetch thousands
+    // of tags with one call and decode them with the layout of the symbol index.
+    UA_ObjectAttributes attr = UA_ObjectAttributes_default;
+    attr.displayName = UA_LOCALIZEDTEXT((char*)"en-US", (char*)"Image");
+    UA_Server_addObjectNode(server, UA_NODEID_STRING(1, (char*)"Image"),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+        UA_QUALIFIEDNAME(1, (char*)"Image"),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE),
+        attr, nullptr, nullptr);
+    addDiagnosticsMethod("Image", "ReadBlock", readBlockCalled,
+        { methodArgument("Space", UA_TYPES[UA_TYPES_STRING]), methodArgument("Offset", UA_TYPES[UA_TYPES_UINT32]),
+          methodArgument("Length", UA_TYPES[UA_TYPES_UINT32]) },
+        { methodArgument("Data", UA_TYPES[UA_TYPES_BYTESTRING]) });
+    addDiagnosticsMethod("Image", "WriteBlock", writeBlockCalled,
+        { methodArgument("Space", UA_TYPES[UA_TYPES_STRING]), methodArgument("Offset", UA_TYPES[UA_TYPES_UINT32]),
+          methodArgument("Data", UA_TYPES[UA_TYPES_BYTESTRING]) }, {});
+    addDiagnosticsMethod("Image", "ReadVariables", readVariablesCalled,
+        { methodArgument("Names", UA_TYPES[UA_TYPES_STRING], UA_VALUERANK_ONE_DIMENSION) },
+        { methodArgument("Data", UA_TYPES[UA_TYPES_BYTESTRING]) });
+}
+
+const OPCUAVariable* OPCUAServer::findVariable(const std::string& name) const {
+    auto found = variablesByName.find(name);
+    return found == variablesByName.end() ? nullptr : found->second;
+}
+
+void OPCUAServer::browseProgram(const char* name, void* instance, const BrowseType* type) {
+    if (browseStore.namespaceIndex == 0) {
+        browseStore.namespaceIndex = UA_Server_addNamespace(server, "urn:nodalis:programs");
+        // The Programs folder is organized by the Objects folder, which is given the reference directly, since the
+        // server only adds references between nodes that are stored.
+        UA_NodeId objects = UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER);
+        UA_Node* node = browseStore.inner.getEditNode(browseStore.inner.context, &objects, UA_NODEATTRIBUTESMASK_ALL,
+                                                      UA_REFERENCETYPESET_ALL, UA_BROWSEDIRECTION_BOTH);
+        if (node != nullptr) {
+            UA_QualifiedName folder = UA_QUALIFIEDNAME(browseStore.namespaceIndex, (char*)BROWSE_FOLDER);
+            addBrowseReference(node, UA_REFERENCETYPEINDEX_ORGANIZES, true,
+                               UA_NODEID_STRING(browseStore.namespaceIndex, (char*)BROWSE_FOLDER), folder);
+            browseStore.inner.releaseNode(browseStore.inner.context, node);
+        }
+    }
+    browseStore.roots.push_back(OPCUABrowseRoot{name, instance, type});
+}
+
+/**
+ * The OPC UA server of the runtime, constructed the first time a program configures it.
+ */
+static OPCUAServer& runtimeOPCUAServer() {
+    static OPCUAServer server;
+    return server;
+}
+
+void configureOPCUAServer(const RuntimeOptions& options) {
+    runtimeOPCUAServer().configure(options);
+}
+
+void mapOPCUAVariables(const ImageSymbol* symbols, size_t count) {
+    runtimeOPCUAServer().mapVariables(symbols, count);
+}
+
+void useOPCUAResource(const char* resource) {
+    runtimeOPCUAServer().useResource(resource);
+}
+
+void browseOPCUAProgram(const char* name, void* instance, const BrowseType* type) {
+    runtimeOPCUAServer().browseProgram(name, instance, type);
+}
+
+void startOPCUAServer() {
+    OPCUAServer& server = runtimeOPCUAServer();
+    server.mapStatistics();
+    server.start();
+    server.mapDiagnostics();
+    server.mapImage();
+}
+
+OPCUAPublisher::OPCUAPublisher() : sockfd(-1), running(false) {
+    std::memset(&target, 0, sizeof(target));
+}
+
+OPCUAPublisher::~OPCUAPublisher() {
+    stop();
+}
+
+bool OPCUAPublisher::load(UA_Server* server, const std::string& path,
+                          const std::unordered_map<std::string, const OPCUAVariable*>& variables) {
+    std::ifstream in(path);
+    json config = in ? json::parse(in, nullptr, false) : json();
+    if (!config.is_object() || !config.contains("DataSets") || !config["DataSets"].is_array()) {
+        nodalisLog() << "OPC UA PubSub ignoring unreadable configuration " << path << "\n";
+        return false;
+    }
+    std::string url = config.value("Url", std::string("opc.udp://224.0.0.22:4840"));
+    std::string host = url.substr(url.find("://") == std::string::npos ? 0 : url.find("://") + 3);
+    uint16_t port = 4840;
+    if (host.find(':') != std::string::npos) {
+        port = static_cast<uint16_t>(std::atoi(host.substr(host.find(':') + 1).c_str()));
+        host = host.substr(0, host.find(':'));
+    }
+    target.sin_family = AF_INET;
+    target.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &target.sin_addr) != 1) {
+        nodalisLog() << "OPC UA PubSub has an invalid address: " << url << "\n";
+        return false;
+    }
+
+    UA_PubSubConnectionConfig connectionConfig;
+    std::memset(&connectionConfig, 0, sizeof(connectionConfig));
+    connectionConfig.name = UA_STRING((char*)"Nodalis");
+    connectionConfig.transportProfileUri = UA_STRING((char*)"http://opcfoundation.org/UA-Profile/Transport/pubsub-udp-uadp");
+    UA_NetworkAddressUrlDataType address = {UA_STRING_NULL, UA_STRING((char*)url.c_str())};
+    UA_Variant_setScalar(&connectionConfig.address, &address, &UA_TYPES[UA_TYPES_NETWORKADDRESSURLDATATYPE]);
+    connectionConfig.publisherId.idType = UA_PUBLISHERIDTYPE_UINT16;
+    connectionConfig.publisherId.id.uint16 = 1;
+    propertyNumber(config, "PublisherId", connectionConfig.publisherId.id.uint16);
+    UA_NodeId connection;
+    // The connection is never enabled, so the stack opens no socket for it. It only lays out the messages.
+    UA_StatusCode status = UA_Server_addPubSubConnection(server, &connectionConfig, &connection);
+    if (status != UA_STATUSCODE_GOOD) {
+        nodalisLog() << "OPC UA PubSub connection failed: " << UA_StatusCode_name(status) << "\n";
+        return false;
+    }
+
+    const json& sets = config["DataSets"];
+    for (size_t x = 0; x < sets.size(); x++) {
+        const json& set = sets[x];
+        OPCUAPublishedDataSet dataSet;
+        dataSet.name = set.is_object() ? set.value("Name", "DataSet" + std::to_string(x + 1)) : "";
+        dataSet.interval = 10;
+        propertyNumber(set, "Interval", dataSet.interval);
+        if (dataSet.interval == 0) {
+            dataSet.interval = 1;
+        }
+        UA_UInt16 writerGroupId = static_cast<UA_UInt16>(x + 1);
+        UA_UInt16 dataSetWriterId = static_cast<UA_UInt16>(x + 1);
+        propertyNumber(set, "WriterGroupId", writerGroupId);
+        propertyNumber(set, "DataSetWriterId", dataSetWriterId);
+
+        UA_PublishedDataSetConfig dataSetConfig;
+        std::memset(&dataSetConfig, 0, sizeof(dataSetConfig));
+        dataSetConfig.publishedDataSetType = UA_PUBSUB_DATASET_PUBLISHEDITEMS;
+        dataSetConfig.name = UA_STRING((char*)dataSet.name.c_str());
+        UA_NodeId publishedDataSet;
+        if (!set.is_object() || UA_Server_addPublishedDataSet(server, &dataSetConfig, &publishedDataSet).addResult != UA_STATUSCODE_GOOD) {
+            nodalisLog() << "OPC UA PubSub dataset " << x << " is invalid\n";
+            continue;
+        }
+
+        // The fields are added in order, so that they can be matched to their offsets in the message.
+        std::vector<std::pair<UA_NodeId, const OPCUAVariable*>> fields;
+        if (set.contains("Variables") && set["Variables"].is_array()) {
+            for (const auto& name : set["Variables"]) {
+                auto found = name.is_string() ? variables.find(name.get<std::string>()) : variables.end();
+                if (found == variables.end()) {
+                    nodalisLog() << "OPC UA PubSub dataset " << dataSet.name << " has no variable " << name.dump() << "\n";
+                    continue;
+                }
+                UA_DataSetFieldConfig fieldConfig;
+                std::memset(&fieldConfig, 0, sizeof(fieldConfig));
+                fieldConfig.dataSetFieldType = UA_PUBSUB_DATASETFIELD_VARIABLE;
+                fieldConfig.field.variable.fieldNameAlias = UA_STRING((char*)found->first.c_str());
+                fieldConfig.field.variable.publishParameters.publishedVariable = found->second->node;
+                fieldConfig.field.variable.publishParameters.attributeId = UA_ATTRIBUTEID_VALUE;
+                UA_NodeId field;
+                if (UA_Server_addDataSetField(server, publishedDataSet, &fieldConfig, &field).result == UA_STATUSCODE_GOOD) {
+                    fields.emplace_back(field, found->second);
+                }
+            }
+        }
+
+        UA_WriterGroupConfig groupConfig;
+        std::memset(&groupConfig, 0, sizeof(groupConfig));
+        groupConfig.name = UA_STRING((char*)dataSet.name.c_str());
+        groupConfig.publishingInterval = static_cast<UA_Duration>(dataSet.interval);
+        groupConfig.writerGroupId = writerGroupId;
+        groupConfig.encodingMimeType = UA_PUBSUB_ENCODING_UADP;
+        UA_UadpWriterGroupMessageDataType groupMessage;
+        UA_UadpWriterGroupMessageDataType_init(&groupMessage);
+        groupMessage.networkMessageContentMask = (UA_UadpNetworkMessageContentMask)(
+            UA_UADPNETWORKMESSAGECONTENTMASK_PUBLISHERID | UA_UADPNETWORKMESSAGECONTENTMASK_GROUPHEADER |
+            UA_UADPNETWORKMESSAGECONTENTMASK_WRITERGROUPID | UA_UADPNETWORKMESSAGECONTENTMASK_SEQUENCENUMBER |
+            UA_UADPNETWORKMESSAGECONTENTMASK_PAYLOADHEADER | UA_UADPNETWORKMESSAGECONTENTMASK_TIMESTAMP);
+        UA_ExtensionObject_setValue(&groupConfig.messageSettings, &groupMessage, &UA_TYPES[UA_TYPES_UADPWRITERGROUPMESSAGEDATATYPE]);
+        UA_NodeId writerGroup;
+        status = UA_Server_addWriterGroup(server, connection, &groupConfig, &writerGroup);
+
+        UA_DataSetWriterConfig writerConfig;
+        std::memset(&writerConfig, 0, sizeof(writerConfig));
+        writerConfig.name = UA_STRING((char*)dataSet.name.c_str());
+        writerConfig.dataSetWriterId = dataSetWriterId;
+        writerConfig.keyFrameCount = 1;
+        // Raw fields have the size of their type, which is what fixes the layout of the message.
+        writerConfig.dataSetFieldContentMask = UA_DATASETFIELDCONTENTMASK_RAWDATA;
+        UA_UadpDataSetWriterMessageDataType writerMessage;
+        UA_UadpDataSetWriterMessageDataType_init(&writerMessage);
+        writerMessage.dataSetMessageContentMask = (UA_UadpDataSetMessageContentMask)(
+            UA_UADPDATASETMESSAGECONTENTMASK_SEQUENCENUMBER);
+        UA_ExtensionObject_setValue(&writerConfig.messageSettings, &writerMessage, &UA_TYPES[UA_TYPES_UADPDATASETWRITERMESSAGEDATATYPE]);
+        UA_NodeId writer;
+        if (status == UA_STATUSCODE_GOOD) {
+            status = UA_Server_addDataSetWriter(server, writerGroup, publishedDataSet, &writerConfig, &writer);
+        }
+
+        UA_PubSubOffsetTable table;
+        if (status == UA_STATUSCODE_GOOD) {
+            status = UA_Server_computeWriterGroupOffsetTable(server, writerGroup, &table);
+        }
+        if (status != UA_STATUSCODE_GOOD) {
+            nodalisLog() << "OPC UA PubSub dataset " << dataSet.name << " can't be published: " << UA_StatusCode_name(status) << "\n";
+            continue;
+        }
+        dataSet.message.assign(table.networkMessage.data, table.networkMessage.data + table.networkMessage.length);
+        for (size_t o = 0; o < table.offsetsSize; o++) {
+            const UA_PubSubOffset& offset = table.offsets[o];
+            switch (offset.offsetType) {
+                case UA_PUBSUBOFFSETTYPE_NETWORKMESSAGE_SEQUENCENUMBER:
+                case UA_PUBSUBOFFSETTYPE_DATASETMESSAGE_SEQUENCENUMBER:
+                    dataSet.sequenceOffsets.push_back(offset.offset);
+                    break;
+                case UA_PUBSUBOFFSETTYPE_NETWORKMESSAGE_TIMESTAMP:
+                case UA_PUBSUBOFFSETTYPE_DATASETMESSAGE_TIMESTAMP:
+                    dataSet.timestampOffsets.push_back(offset.offset);
+                    break;
+                case UA_PUBSUBOFFSETTYPE_DATASETFIELD_RAW:
+                    for (const auto& field : fields) {
+                        if (UA_NodeId_equal(&field.first, &offset.component)) {
+                            const ResolvedAddress& resolved = field.second->address;
+                            dataSet.fields.push_back({offset.offset, resolved,
+                                resolved.bit > -1 ? 1 : static_cast<size_t>(resolved.width / 8)});
+                        }
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        UA_PubSubOffsetTable_clear(&table);
+        nodalisLog() << "OPC UA PubSub dataset " << dataSet.name << " publishes " << dataSet.fields.size()
+                  << " fields every " << dataSet.interval << " ms to " << url << "\n";
+        dataSets.push_back(std::move(dataSet));
+    }
+    return !dataSets.empty();
+}
+
+void OPCUAPublisher::start() {
+    if (running || dataSets.empty()) {
+        return;
+    }
+    sockfd = static_cast<int>(socket(AF_INET, SOCK_DGRAM, 0));
+    if (sockfd < 0) {
+        nodalisLog() << "OPC UA PubSub can't open a socket\n";
+        return;
+    }
+    running = true;
+    publisherThread = std::thread(&OPCUAPublisher::run, this);
+}
+
+void OPCUAPublisher::stop() {
+    running = false;
+    if (publisherThread.joinable()) {
+        publisherThread.join();
+    }
+    if (sockfd >= 0) {
+#ifdef _WIN32
+        closesocket(sockfd);
+#else
+        close(sockfd);
+#endif
+        sockfd = -1;
+    }
+}
+
+void OPCUAPublisher::run() {
+    moveToBackground();
+    auto now = std::chrono::steady_clock::now();
+    for (auto& dataSet : dataSets) {
+        dataSet.due = now;
+    }
+    while (running) {
+        now = std::chrono::steady_clock::now();
+        // Waking at least every 100 ms lets stop() end the thread promptly.
+        auto next = now + std::chrono::milliseconds(100);
+        for (auto& dataSet : dataSets) {
+            if (now >= dataSet.due) {
+                publish(dataSet);
+                dataSet.due += std::chrono::milliseconds(dataSet.interval);
+                if (dataSet.due <= now) {
+                    // A dataset that fell behind skips the cycles it missed rather than sending them in a burst.
+                    dataSet.due = now + std::chrono::milliseconds(dataSet.interval);
+                }
+            }
+            if (dataSet.due < next) {
+                next = dataSet.due;
+            }
+        }
+        std::this_thread::sleep_until(next);
+    }
+}
+
+void OPCUAPublisher::publish(OPCUAPublishedDataSet& dataSet) {
+    uint8_t* message = dataSet.message.data();
+    // The values are copied from one image into their places in the message. The encoding is little endian, as is
+    // the image.
+    readImage([&](const uint8_t* image) {
+        for (const auto& field : dataSet.fields) {
+            uint64_t value = field.address.load(image);
+            std::memcpy(message + field.offset, &value, field.size);
+        }
+    });
+    dataSet.sequence++;
+    for (size_t offset : dataSet.sequenceOffsets) {
+        std::memcpy(message + offset, &dataSet.sequence, sizeof(dataSet.sequence));
+    }
+    UA_DateTime timestamp = UA_DateTime_now();
+    for (size_t offset : dataSet.timestampOffsets) {
+        std::memcpy(message + offset, &timestamp, sizeof(timestamp));
+    }
+    if (sendto(sockfd, reinterpret_cast<const char*>(message), static_cast<int>(dataSet.message.size()), 0,
+               reinterpret_cast<const sockaddr*>(&target), sizeof(target)) < 0) {
+        DIAGNOSTIC("OPC UA PubSub dataset " << dataSet.name << " could not be sent");
     }
 }
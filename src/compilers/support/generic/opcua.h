@@ -1,5 +1,6 @@
 #pragma once
 #include "nodalis.h"
+#include "ioreactor.h"
 #if defined(_WIN32)
 #include "open62541/src/win32/open62541.h"
 #else
@@ -14,37 +15,407 @@
 #endif
 #include <thread>
 #include <atomic>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <deque>
+#include <chrono>
+#ifndef _WIN32
+    #include <netinet/in.h>
+#endif
+
+
+/**
+ * An input mapping that is read through a monitored item of the client's subscription, rather than polled.
+ */
+struct OPCUAMonitoredPoint {
+    size_t mapping;             // The index of the mapping in the client's mappings.
+    size_t node;                // The index of the mapping's node in the client's nodes.
+    ResolvedAddress local;      // The local address that notified values are written to.
+    int width;                  // The width of the mapping, which selects the expected data type.
+    uint32_t quality;           // The quality slot of the mapping.
+    double samplingInterval;    // The sampling interval asked of the server, in milliseconds, from PollTime.
+    UA_UInt32 itemId = 0;       // The server's ID of the monitored item, or 0 while the point isn't monitored.
+    bool refused = false;       // Whether the server refused the item, in which case the point is polled.
+    std::vector<size_t> shared; // The other subscribed inputs of the node, which the item's notifications also update.
+};
+
+/**
+ * A Read or Write request that is outstanding on a reactor, and the mappings it transfers, in its order.
+ */
+struct OPCUARequest {
+    std::vector<IORequest*> members;    // The requests of the batch it transfers.
+    bool write = false;
+    bool busy = false;              // Whether the request is outstanding, so that the entry can't be reused.
+    std::chrono::steady_clock::time_point sentAt;   // When the request was sent, to count its round trip.
+};
 
 class OPCUAClient : public IOClient {
 public:
     OPCUAClient();
     ~OPCUAClient();
+    /**
+     * Runs the client on an IO reactor. Connects, reads, writes and subscriptions are then asynchronous, and the
+     * client's event loop is iterated from reactor timers, so a slow or unreachable server never blocks a thread.
+     * @param reactor The reactor.
+     * @returns Returns true.
+     */
+    bool attach(IOReactor& reactor) override;
 
 protected:
     void connect() override;
-
-    bool readBit(const std::string& remote, int& result) override;
-    bool writeBit(const std::string& remote, int value) override;
-    bool readByte(const std::string& remote, uint8_t& result) override;
-    bool writeByte(const std::string& remote, uint8_t value) override;
-    bool readWord(const std::string& remote, uint16_t& result) override;
-    bool writeWord(const std::string& remote, uint16_t value) override;
-    bool readDWord(const std::string& remote, uint32_t& result) override;
-    bool writeDWord(const std::string& remote, uint32_t value) override;
-    bool readLWord(const std::string &remote, uint64_t &result) override;
-    bool writeLWord(const std::string &remote, uint64_t value) override;
+    /**
+     * Resolves the node of a mapping and parses its protocol properties. An input with {"Subscribe": true} becomes
+     * a monitored point. A mapping whose remote address isn't a valid node ID is never exchanged.
+     * @param map The mapping.
+     */
+    void onMappingAdded(IOMap& map) override;
+    /**
+     * Processes the notifications of the subscription, creates the monitored items of points that don't have one
+     * yet, and reads and writes the due mappings that aren't monitored. The due outputs are written with one Write
+     * request, and the due inputs read with one Read request, each of up to maxNodesPerRequest nodes. This is only
+     * used without a reactor, and waits for each request.
+     * @param batch The requests of the mappings that are due.
+     */
+    void submitBatch(IOBatch& batch) override;
 
 private:
     UA_Client* client;
     std::string endpointUrl;
+    /**
+     * The nodes of the mappings, resolved once from their remote addresses and indexed by their remoteHandle.
+     * Mappings of the same address share a node. The client clears them when it is destroyed.
+     */
+    std::vector<UA_NodeId> nodes;
+    /**
+     * The index in nodes of each remote address, so that mappings of the same address share a node.
+     */
+    std::unordered_map<std::string, size_t> nodeIndex;
+    /**
+     * The points read through monitored items.
+     */
+    std::vector<OPCUAMonitoredPoint> monitored;
+    /**
+     * The index in monitored of each mapping's point, by index in mappings, or -1 for a mapping that is polled.
+     */
+    std::vector<int> mappingPoints;
+    /**
+     * The ID of the client's subscription, or 0 if there is none.
+     */
+    UA_UInt32 subscriptionId = 0;
+    /**
+     * Whether some monitored points have no monitored item yet, and haven't been refused by the server.
+     */
+    bool itemsPending = false;
+    /**
+     * Whether a request to create the subscription or its monitored items is outstanding.
+     */
+    bool subscribing = false;
+    /**
+     * The points whose monitored items are being created, in the order of the outstanding request.
+     */
+    std::vector<size_t> pendingItems;
+    /**
+     * The most nodes read or written with one request, from the MaxNodesPerRequest protocol property. It is halved
+     * when the server answers that a request has too many operations.
+     */
+    size_t maxNodesPerRequest = 500;
+    /**
+     * The longest a connection attempt may take on a reactor, in milliseconds, from ConnectTimeout.
+     */
+    uint64_t connectTimeout = 5000;
+    /**
+     * The longest the client waits for a response, in milliseconds, from ResponseTimeout.
+     */
+    uint64_t responseTimeout = 5000;
+    /**
+     * The requests of the current poll that are read and written, and the storage of the OPC UA requests, kept
+     * between polls so that it is reused.
+     */
+    std::vector<IORequest*> readBatch;
+    std::vector<IORequest*> writeBatch;
+    std::vector<UA_ReadValueId> readIds;
+    std::vector<UA_WriteValue> writeValues;
+    std::vector<uint64_t> writeScalars;
+
+    // ----- Reactor mode -----
+
+    /**
+     * The reactor the client runs on, or null if it is polled by a thread.
+     */
+    IOReactor* reactor = nullptr;
+    /**
+     * The IO statistics of the client, when running on a reactor.
+     */
+    ExecutionStats* ioStats = nullptr;
+    uint64_t tickTimer = 0;
+    /**
+     * Whether an asynchronous connect is in progress.
+     */
+    bool connecting = false;
+    /**
+     * Whether the session lost its secure channel and is being activated again on a new one.
+     */
+    bool resuming = false;
+    /**
+     * The requests of the poll in progress, and entries that can be reused, indexed by the userdata of their
+     * callbacks.
+     */
+    std::vector<OPCUARequest> requests;
+    size_t outstanding = 0;
+    /**
+     * The mappings that are due in a tick, and the batch of the poll in progress, which is kept until its requests
+     * have all completed, and then reused.
+     */
+    std::vector<IOMap*> reactorDue;
+    IOBatch reactorBatch;
+    std::chrono::steady_clock::time_point batchStart;
+
+    /**
+     * Handles the loss of the session. The client library keeps a session whose secure channel was lost, with its
+     * subscription and monitored items, and activates it again on the next channel, so the client then reconnects at
+     * once rather than after the reconnect delay, and notifications resume without creating the items again. A
+     * session the library discarded has already dropped its subscription through subscriptionDeleted().
+     */
+    void sessionLost();
+    /**
+     * Cancels the timers. This runs on the reactor thread when the client is destroyed.
+     */
+    void detach();
+    /**
+     * Iterates the client's event loop, which completes connects and requests and delivers notifications, then
+     * starts a connection attempt or a poll, whichever is due, and schedules the next tick.
+     */
+    void tick();
+    /**
+     * Schedules the next tick: soon while a connect or a request is outstanding, and otherwise for when the next
+     * poll is due.
+     */
+    void scheduleTick();
+    /**
+     * Reschedules the next tick on the reactor, so that outputs made due by requestFlush() are written at once.
+     */
+    void wake() override;
+    /**
+     * Sends a batch of mappings as asynchronous requests of up to maxNodesPerRequest nodes.
+     * @param batch The requests, which are all reads or all writes.
+     * @param write Whether the mappings are written rather than read.
+     */
+    void sendBatch(std::vector<IORequest*>& batch, bool write);
+    /**
+     * Marks a request as finished, and records the poll's statistics once it was the last one.
+     * @param slot The index of the request in requests.
+     */
+    void requestDone(size_t slot);
+    static void readDone(UA_Client* client, void* userdata, UA_UInt32 requestId, UA_ReadResponse* response);
+    static void writeDone(UA_Client* client, void* userdata, UA_UInt32 requestId, UA_WriteResponse* response);
+
+    /**
+     * Iterates the client's event loop without waiting, and checks the session.
+     * @returns Returns true if the session is active.
+     */
+    bool sessionActive();
+    /**
+     * Sorts the requests of a batch into readBatch and writeBatch. Monitored inputs are left pending, and mappings
+     * without a valid node or a type of their width are completed as invalid.
+     * @param batch The batch.
+     */
+    void splitBatch(IOBatch& batch);
+    /**
+     * Creates the subscription if there is none, or else a monitored item for each point that doesn't have one, in
+     * one request. Both requests are asynchronous, and the items are requested once the subscription is created.
+     * A point whose item the server refuses is polled instead.
+     */
+    void subscribe();
+    static void subscriptionCreated(UA_Client* client, void* userdata, UA_UInt32 requestId,
+                                    UA_CreateSubscriptionResponse* response);
+    static void itemsCreated(UA_Client* client, void* userdata, UA_UInt32 requestId,
+                             UA_CreateMonitoredItemsResponse* response);
+    /**
+     * Resolves a remote address to a node ID. It may be given in the standard notation, such as "ns=2;i=1001",
+     * "ns=3;s=Line1.Speed", "g=..." or "b=...", or as a bare name, which is a string identifier in namespace 1.
+     * @param remote The remote address.
+     * @param nodeId Receives the node, which the caller clears.
+     * @returns Returns false if the address isn't a valid node ID.
+     */
+    static bool parseNodeId(const std::string& remote, UA_NodeId& nodeId);
+    /**
+     * Forgets the subscription and its monitored items, so that they are created again on the next connection.
+     */
+    void dropSubscription();
+    /**
+     * Writes a notified value to the process image.
+     * @param point The index of the point in monitored.
+     * @param value The notified value.
+     */
+    void notified(size_t point, const UA_DataValue* value);
+    /**
+     * Reads or writes a batch of mappings, in as many requests as maxNodesPerRequest needs, waiting for each one.
+     * @param batch The requests, which are all reads or all writes.
+     * @param write Whether the mappings are written rather than read.
+     */
+    void transferBatch(std::vector<IORequest*>& batch, bool write);
+    /**
+     * Builds a Read request for some mappings, with one entry for each run of mappings of the same node. It borrows
+     * the cached node IDs and readIds.
+     * @param members The requests.
+     * @param count The number of requests.
+     * @param request Receives the request.
+     */
+    void buildRead(IORequest* const* members, size_t count, UA_ReadRequest& request);
+    /**
+     * Builds a Write request of the values of some write requests. It borrows the cached node IDs, writeValues and
+     * writeScalars.
+     * @param members The requests.
+     * @param count The number of requests.
+     * @param request Receives the request.
+     */
+    void buildWrite(IORequest* const* members, size_t count, UA_WriteRequest& request);
+    /**
+     * Completes the requests of a Read response, whose values are written to the process image together. Results
+     * are matched to the requests by position, with a run of requests of the same node sharing one result.
+     * @param members The requests, in the order of the request.
+     * @param count The number of requests.
+     * @param response The response.
+     */
+    void readCompleted(IORequest* const* members, size_t count, const UA_ReadResponse& response);
+    /**
+     * Completes the requests of a Write response. Outputs that failed are written again on their next poll.
+     * @param members The requests, in the order of the request.
+     * @param count The number of requests.
+     * @param response The response.
+     */
+    void writeCompleted(IORequest* const* members, size_t count, const UA_WriteResponse& response);
+    /**
+     * Reports a request that failed as a whole. If the server answered that it had too many operations,
+     * maxNodesPerRequest is halved.
+     * @param status The result of the service.
+     * @param count The number of mappings in the request.
+     * @param write Whether the request was a write.
+     */
+    void requestFailed(UA_StatusCode status, size_t count, bool write);
+    static void dataChanged(UA_Client* client, UA_UInt32 subId, void* subContext, UA_UInt32 monId,
+                            void* monContext, UA_DataValue* value);
+    static void subscriptionDeleted(UA_Client* client, UA_UInt32 subId, void* subContext);
+};
+
+/**
+ * The node context of a variable served from the process image. It is resolved once when the variable is mapped,
+ * so that a read is a single load from the image.
+ */
+struct OPCUAVariable {
+    ResolvedAddress address;    // The location of the variable in the process image.
+    const UA_DataType* type;    // The type the variable is served as.
+    UA_NodeId node;             // The node of the variable, used to update it when it is served as a value node.
+    uint64_t last;              // The value the node was last updated with, when it is served as a value node.
+    UA_StatusCode status;       // The status the node was last updated with, when it is served as a value node.
+    uint32_t quality;           // The slot of a mapped input in the quality plane, found when the server starts.
+};
+
+/**
+ * A row of the symbol table the compiler generates from the program's located globals. The name of the variable is
+ * also its string node ID in namespace 1.
+ */
+typedef ImageSymbol OPCUASymbol;
+
+/**
+ * Identifies one value of a set of execution statistics exposed by the server.
+ */
+struct StatisticsNode {
+    ExecutionStats* stats;
+    int field;
+};
+
+/**
+ * A value of the diagnostics tree, sampled on the server thread whenever it is read.
+ */
+struct DiagnosticsNode {
+    std::function<uint64_t()> sample;   // Reads the value. It only loads atomics, so it never holds up the scan.
+    const UA_DataType* type;            // The type the value is served as, Boolean or UInt64.
+};
+
+/**
+ * A field of a published dataset, copied from the image into its precomputed place in the network message.
+ */
+struct OPCUAPublishedField {
+    size_t offset;              // The offset of the field's raw value in the network message.
+    ResolvedAddress address;    // The location of the field's value in the process image.
+    size_t size;                // The encoded size of the value, in bytes.
+};
+
+/**
+ * A dataset the PubSub publisher sends: a writer group with one DataSetWriter, whose network message has a fixed
+ * layout that is encoded once and then only patched.
+ */
+struct OPCUAPublishedDataSet {
+    std::string name;                               // The name of the dataset.
+    uint64_t interval;                              // The publishing interval, in milliseconds.
+    std::chrono::steady_clock::time_point due;      // When the dataset is next sent.
+    std::vector<uint8_t> message;                   // The encoded network message.
+    std::vector<OPCUAPublishedField> fields;        // The fields, in message order.
+    std::vector<size_t> sequenceOffsets;            // The offsets of the UInt16 sequence numbers in the message.
+    std::vector<size_t> timestampOffsets;           // The offsets of the DateTime timestamps in the message.
+    uint16_t sequence = 0;                          // The sequence number of the last message sent.
+};
+
+/**
+ * Publishes datasets of the server's variables as UADP network messages over UDP, at a fixed interval per dataset.
+ * The messages are laid out once by the OPC UA stack, which also provides the offsets of their changing parts, so
+ * publishing a dataset copies its values from the image into the message and sends it.
+ */
+class OPCUAPublisher {
+public:
+    OPCUAPublisher();
+    ~OPCUAPublisher();
+
+    /**
+     * Loads the datasets from a configuration file and lays out their messages.
+     * @param server The server whose variables are published.
+     * @param path The path of the JSON configuration.
+     * @param variables The server's variables by name.
+     * @returns Returns true if at least one dataset can be published.
+     */
+    bool load(UA_Server* server, const std::string& path, const std::unordered_map<std::string, const OPCUAVariable*>& variables);
+    void start();
+    void stop();
 
-    template<typename T>
-    bool readValue(const std::string& nodeIdStr, T& value, const UA_DataType* type);
+private:
+    void run();
+    /**
+     * Sends a dataset with the current values of its fields.
+     * @param dataSet The dataset to send.
+     */
+    void publish(OPCUAPublishedDataSet& dataSet);
 
-    template<typename T>
-    bool writeValue(const std::string& nodeIdStr, T value, const UA_DataType* type);
+    std::vector<OPCUAPublishedDataSet> dataSets;
+    int sockfd;
+    sockaddr_in target;
+    std::thread publisherThread;
+    std::atomic<bool> running;
 };
 
+/**
+ * A program published by browseOPCUAProgram(), whose variables are browsed in place.
+ */
+struct OPCUABrowseRoot {
+    std::string name;           // The name of the program, which is also its node ID.
+    void* instance;             // The instance of the program, or nullptr for the globals.
+    const BrowseType* type;     // The browse type of the program.
+};
+
+/**
+ * The nodestore of the server: the stack's own nodestore, which keeps every node that is added to the server, wrapped
+ * so that the nodes of the published programs' variables are made up from their browse types when they are asked
+ * for, and freed when they are released.
+ */
+struct OPCUABrowseStore {
+    UA_Nodestore inner;                     // The stack's nodestore.
+    UA_UInt16 namespaceIndex = 0;           // The index of urn:nodalis:programs, or 0 until a program is published.
+    std::vector<OPCUABrowseRoot> roots;     // The published programs, in the order they were published.
+};
+
+struct AlarmEvent;
+
 class OPCUAServer {
 public:
     OPCUAServer();
@@ -52,12 +423,145 @@ public:
 
     void start();
     void stop();
+    /**
+     * Applies the runtime options to the server. This must be called before any variable is mapped.
+     * @param options The runtime options.
+     */
+    void configure(const RuntimeOptions& options);
     void mapVariable(std::string varname, std::string addr);
+    /**
+     * Builds the variables of the address space from a symbol table in a single pass. The table, and the strings it
+     * points to, must outlive the server, which is the case for the static table the compiler generates.
+     * This must be called before the server is started.
+     * @param symbols The symbols to serve.
+     * @param count The number of symbols in the table.
+     */
+    void mapVariables(const OPCUASymbol* symbols, size_t count);
+    /**
+     * Exposes all registered execution statistics as read-only variables in a Statistics folder.
+     * This must be called before the server is started.
+     */
+    void mapStatistics();
+    /**
+     * Exposes the health of the runtime as read-only variables in a Diagnostics object: the scan statistics, the
+     * memory used by the process, and the request, error, latency and connection counters of each IO client.
+     * This must be called once the IO has been mapped, so that every client exists.
+     */
+    void mapDiagnostics();
+    /**
+     * Adds the Image object, whose methods read a block of a space of the process image, or the values of a list of
+     * variables, from one published image as a ByteString, and stage a block of %Q or %M to be written.
+     */
+    void mapImage();
+    /**
+     * Finds a served variable.
+     * @param name The name of the variable.
+     * @returns Returns the variable, or nullptr if no variable has the name.
+     */
+    const OPCUAVariable* findVariable(const std::string& name) const;
+    /**
+     * Publishes the variables of a program, which the server's nodestore browses in place (see browseOPCUAProgram()).
+     * This must be called before the server is started.
+     * @param name The name of the program.
+     * @param instance The instance of the program, or nullptr for the globals.
+     * @param type The browse type of the program.
+     */
+    void browseProgram(const char* name, void* instance, const BrowseType* type);
+    /**
+     * Puts the variables mapped from then on in a namespace and folder of a resource (see useOPCUAResource()).
+     * This must be called before the server is started.
+     * @param resource The name of the resource.
+     */
+    void useResource(const std::string& resource);
 
 private:
     void run();
+    /**
+     * Runs an iteration of the server without waiting for the network, from the scheduler's slack in cooperative mode.
+     * @returns Returns the milliseconds until the server should be iterated again.
+     */
+    uint64_t iterate();
+    /**
+     * Adds a variable node served from the process image.
+     * @param name The name and string node ID of the variable.
+     * @param addr The located address of the variable.
+     */
+    void addVariable(const char* name, const std::string& addr);
+    /**
+     * Updates the value nodes whose values changed since the image they were last updated from.
+     * This runs on the server thread.
+     */
+    void updateVariables();
+    /**
+     * Called by the server at the update interval.
+     * @param server The server.
+     * @param data The OPCUAServer.
+     */
+    static void updateCallback(UA_Server* server, void* data);
+    /**
+     * Adds an object to the diagnostics tree.
+     * @param id The string node ID of the object.
+     * @param parent The parent of the object.
+     * @param name The browse and display name of the object.
+     */
+    void addDiagnosticsObject(const std::string& id, const UA_NodeId& parent, const std::string& name);
+    /**
+     * Adds a read-only value to a diagnostics object. Its node ID is the object's followed by its name.
+     * @param object The string node ID of the object.
+     * @param name The browse and display name of the value.
+     * @param boolean Whether the value is served as a Boolean rather than a UInt64.
+     * @param sample Reads the value.
+     */
+    void addDiagnosticsValue(const std::string& object, const char* name, bool boolean, std::function<uint64_t()> sample);
+    /**
+     * Adds a method to a diagnostics object. Its node ID is the object's followed by its name.
+     * @param object The string node ID of the object.
+     * @param name The browse and display name of the method.
+     * @param method The callback that serves the method.
+     * @param inputs The input arguments.
+     * @param outputs The output arguments.
+     */
+    void addDiagnosticsMethod(const std::string& object, const char* name, UA_MethodCallback method,
+                              const std::vector<UA_Argument>& inputs, const std::vector<UA_Argument>& outputs);
+    /**
+     * Raises an alarm event as a BaseEventType event of the Server object. This runs on the alarm thread.
+     */
+    void raiseAlarmEvent(const AlarmEvent& event);
+    /**
+     * Stages a write made by a client to a value node to the process image.
+     */
+    static void valueWritten(UA_Server* server, const UA_NodeId* sessionId, void* sessionContext,
+                             const UA_NodeId* nodeId, void* nodeContext, const UA_NumericRange* range,
+                             const UA_DataValue* data);
+    /**
+     * Serves a raw HistoryRead of the historized variables from the historian.
+     */
+    static void readHistoryRaw(UA_Server* server, void* hdbContext, const UA_NodeId* sessionId, void* sessionContext,
+                               const UA_RequestHeader* requestHeader, const UA_ReadRawModifiedDetails* details,
+                               UA_TimestampsToReturn timestampsToReturn, UA_Boolean releaseContinuationPoints,
+                               size_t nodesToReadSize, const UA_HistoryReadValueId* nodesToRead,
+                               UA_HistoryReadResponse* response, UA_HistoryData* const* const historyData);
 
+    OPCUABrowseStore browseStore;   // The nodestore's context, which outlives the server.
     UA_Server* server;
     std::thread serverThread;
     std::atomic<bool> running;
+    uint64_t updateInterval = 0;    // The period of value node updates in milliseconds, or 0 to serve data sources.
+    ImageChanges imageChanges;      // The lines of the image that changed since the value nodes were last updated.
+    bool updating = false;          // Set while the value nodes are updated, so the updates aren't staged as writes.
+    std::vector<uint64_t> updateValues;     // The values read from the image in an update, by variable.
+    uint64_t qualityChanges = 0;            // QUALITY_CHANGES when the value nodes were last updated.
+    std::deque<OPCUAVariable> variables;        // The contexts of the served variables, owned by the server.
+    std::deque<StatisticsNode> statistics;      // The contexts of the statistics variables, owned by the server.
+    std::deque<DiagnosticsNode> diagnostics;    // The contexts of the diagnostics variables, owned by the server.
+    std::unordered_map<std::string, const OPCUAVariable*> variablesByName;
+    UA_UInt16 variableNamespace = 1;            // The namespace of the variables mapped next.
+    std::string variableFolder;                 // The folder of the resource they are mapped to, or empty for Objects.
+    std::string pubSubConfig;                   // The PubSub configuration file, or empty to not publish.
+    OPCUAPublisher publisher;
+    bool headless = false;                      // Set in benchmark mode, where the server is never started.
+    bool cooperative = false;                   // Whether the server runs in the scheduler's slack (--opcua-cooperative).
+    uint64_t slackBudget = 1000;                // The least slack an iteration is started in, in microseconds.
+    ExecutionStats* iterations = nullptr;       // The times of the cooperative iterations.
+    std::unordered_set<std::string> historized; // The names and addresses of the tags the historian keeps.
 };
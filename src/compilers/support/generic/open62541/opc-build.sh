@@ -23,32 +23,39 @@ DEST=$SCRIPT_DIR/lib/linux-arm
 echo "Making Linux Arm To $DEST"
 rm -rf $DEST
 mkdir -p $DEST
-arm-linux-gnueabi-gcc -std=c11 -D_GNU_SOURCE -D_DEFAULT_SOURCE -D_XOPEN_SOURCE=600 -c "$SCRIPT_DIR/src/posix/open62541.c" -o "$DEST/open62541.o"
+arm-linux-gnueabi-gcc -std=c11 -fPIC -D_GNU_SOURCE -D_DEFAULT_SOURCE -D_XOPEN_SOURCE=600 -c "$SCRIPT_DIR/src/posix/open62541.c" -o "$DEST/open62541.o"
+
+#Make for Linux Arm hard-float
+DEST=$SCRIPT_DIR/lib/linux-armhf
+echo "Making Linux Arm hard-float To $DEST"
+rm -rf $DEST
+mkdir -p $DEST
+arm-linux-gnueabihf-gcc -std=c11 -fPIC -mfpu=neon -D_GNU_SOURCE -D_DEFAULT_SOURCE -D_XOPEN_SOURCE=600 -c "$SCRIPT_DIR/src/posix/open62541.c" -o "$DEST/open62541.o"
 
 #Make for Linux Arm64
 DEST=$SCRIPT_DIR/lib/linux-arm64
 echo "Making Linux Arm64 To $DEST"
 rm -rf $DEST
 mkdir -p $DEST
-aarch64-linux-gnu-gcc -std=c11 -D_GNU_SOURCE -D_DEFAULT_SOURCE -D_XOPEN_SOURCE=600 -c "$SCRIPT_DIR/src/posix/open62541.c" -o "$DEST/open62541.o"
+aarch64-linux-gnu-gcc -std=c11 -fPIC -D_GNU_SOURCE -D_DEFAULT_SOURCE -D_XOPEN_SOURCE=600 -c "$SCRIPT_DIR/src/posix/open62541.c" -o "$DEST/open62541.o"
 
 #Make for Linux x64
 DEST=$SCRIPT_DIR/lib/linux-x64
 echo "Making Linux x64 To $DEST"
 rm -rf $DEST
 mkdir -p $DEST
-x86_64-linux-gnu-gcc -std=c11 -D_GNU_SOURCE -D_DEFAULT_SOURCE -D_XOPEN_SOURCE=600 -c "$SCRIPT_DIR/src/posix/open62541.c" -o "$DEST/open62541.o"
+x86_64-linux-gnu-gcc -std=c11 -fPIC -D_GNU_SOURCE -D_DEFAULT_SOURCE -D_XOPEN_SOURCE=600 -c "$SCRIPT_DIR/src/posix/open62541.c" -o "$DEST/open62541.o"
 
 #Make for MacOS x64
 DEST=$SCRIPT_DIR/lib/macos-x64
 echo "Making Macos x64 To $DEST"
 rm -rf $DEST
 mkdir -p $DEST
-clang -arch x86_64 -std=c11 -D_DEFAULT_SOURCE -c "$SCRIPT_DIR/src/posix/open62541.c" -o "$DEST/open62541.o"
+clang -arch x86_64 -std=c11 -fPIC -D_DEFAULT_SOURCE -c "$SCRIPT_DIR/src/posix/open62541.c" -o "$DEST/open62541.o"
 
 #Make for MacOS arm64
 DEST=$SCRIPT_DIR/lib/macos-arm64
 echo "Making Macos arm64 To $DEST"
 rm -rf $DEST
 mkdir -p $DEST
-clang -arch arm64 -std=c11 -D_DEFAULT_SOURCE -c "$SCRIPT_DIR/src/posix/open62541.c" -o "$DEST/open62541.o"
\ No newline at end of file
+clang -arch arm64 -std=c11 -fPIC -D_DEFAULT_SOURCE -c "$SCRIPT_DIR/src/posix/open62541.c" -o "$DEST/open62541.o"
\ No newline at end of file
@@ -0,0 +1,252 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Program Host
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+#include "programhost.h"
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <dlfcn.h>
+#include <unistd.h>
+#endif
+
+/**
+ * How often the host looks at the library file for a new build.
+ */
+static constexpr std::chrono::milliseconds CHANGE_CHECK(500);
+
+ProgramHost::ProgramHost(const RuntimeOptions& options, const std::string& programFile, bool shared)
+    : programFile(programFile), threaded(options.threadedTasks), shared(shared), mapsIO(options.ioConfig.empty()),
+      runtime(NODALIS_RUNTIME_ID) {
+    nextCheck = std::chrono::steady_clock::now();
+}
+
+bool ProgramHost::stamp(int64_t& modified, uint64_t& size) const {
+    struct stat info;
+    if(stat(programFile.c_str(), &info) != 0){
+        return false;
+    }
+#ifdef __APPLE__
+    modified = static_cast<int64_t>(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    modified = static_cast<int64_t>(info.st_mtime) * 1000000000;
+#else
+    modified = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+    size = static_cast<uint64_t>(info.st_size);
+    return true;
+}
+
+const ProgramModule* ProgramHost::open(std::string& error){
+#ifdef _WIN32
+    error = "online change is not supported on Windows";
+    return nullptr;
+#else
+    // The loader keeps a library that is opened again under the same name, so each version is loaded from a copy of
+    // its own. The copy is removed once it is mapped.
+    std::string copy = programFile + "." + std::to_string(getpid()) + "." + std::to_string(++version);
+    {
+        std::ifstream in(programFile, std::ios::binary);
+        std::ofstream out(copy, std::ios::binary | std::ios::trunc);
+        if(!in || !out || !(out << in.rdbuf())){
+            error = "could not copy " + programFile;
+            std::remove(copy.c_str());
+            return nullptr;
+        }
+    }
+    void* library = dlopen(copy.c_str(), RTLD_NOW | RTLD_LOCAL);
+    std::remove(copy.c_str());
+    if(library == nullptr){
+        const char* reason = dlerror();
+        error = reason != nullptr ? reason : "could not load " + programFile;
+        return nullptr;
+    }
+    auto entry = reinterpret_cast<ProgramEntry>(dlsym(library, "nodalis_program"));
+    const ProgramModule* loaded = entry != nullptr ? entry() : nullptr;
+    if(loaded == nullptr || loaded->abiVersion != NODALIS_PROGRAM_ABI_VERSION){
+        error = programFile + " is not a program library of this version of the runtime";
+    }
+    else if(runtime != loaded->runtime){
+        error = programFile + " was compiled against another build of the runtime, and needs a restart of a new host";
+    }
+    else if(module != nullptr && std::strcmp(module->configuration, loaded->configuration) != 0){
+        error = "the tasks, IO maps or located variables of " + programFile + " have changed, and need a restart";
+    }
+    else{
+        return loaded;
+    }
+    dlclose(library);
+    return nullptr;
+#endif
+}
+
+bool ProgramHost::load(){
+    std::string error;
+    stamp(modified, fileSize);
+    module = open(error);
+    if(module == nullptr){
+        nodalisLog() << "Could not load the program: " << error << "\n";
+        return false;
+    }
+    for(size_t t = 0; t < module->taskCount; t++){
+        runs.push_back(module->tasks[t].run);
+        triggers.push_back(module->tasks[t].trigger);
+    }
+#if NODALIS_OPCUA
+    if(shared){
+        useOPCUAResource(module->name);
+    }
+#endif
+    module->configure();
+    module->attach();
+    return true;
+}
+
+void ProgramHost::start(TaskScheduler& scheduler){
+    for(size_t t = 0; t < module->taskCount; t++){
+        const ProgramTask& task = module->tasks[t];
+        // A task runs whichever version is current when it is released. Threaded tasks hold the swap off while
+        // they run.
+        std::function<void()> body;
+        if(threaded){
+            body = [this, t](){
+                std::shared_lock<std::shared_mutex> lock(swapMutex);
+                runs[t]();
+            };
+        }
+        else{
+            body = [this, t](){
+                runs[t]();
+            };
+        }
+        // Triggers are read on the scheduler's own thread, which is also where versions are swapped.
+        std::string name = shared ? std::string(module->name) + "." + task.name : task.name;
+        if(task.trigger != nullptr){
+            scheduler.addEventTask(name, task.priority, [this, t](){ return triggers[t](); }, std::move(body), task.watchdog);
+        }
+        else{
+            scheduler.addTask(name, task.interval, task.priority, std::move(body), task.watchdog);
+        }
+    }
+    if(mapsIO){
+        module->map();
+    }
+}
+
+/**
+ * Reads a state variable that is a BOOL, packed or not.
+ * @param variable The variable.
+ * @returns Returns the value.
+ */
+static bool readStateBit(const StateVariable& variable){
+    return variable.mask != 0 ? (*static_cast<const uint64_t*>(variable.address) & variable.mask) != 0
+                              : *static_cast<const bool*>(variable.address);
+}
+
+/**
+ * Writes a state variable that is a BOOL, packed or not.
+ * @param variable The variable.
+ * @param value The value.
+ */
+static void writeStateBit(const StateVariable& variable, bool value){
+    if(variable.mask == 0){
+        *static_cast<bool*>(variable.address) = value;
+    }
+    else if(value){
+        *static_cast<uint64_t*>(variable.address) |= variable.mask;
+    }
+    else{
+        *static_cast<uint64_t*>(variable.address) &= ~variable.mask;
+    }
+}
+
+void ProgramHost::migrate(const ProgramModule& next){
+    size_t count = 0;
+    const StateVariable* previous = module->state(&count);
+    std::unordered_map<std::string, const StateVariable*> byName;
+    for(size_t x = 0; x < count; x++){
+        byName.emplace(previous[x].name, &previous[x]);
+    }
+    const StateVariable* variables = next.state(&count);
+    size_t kept = 0;
+    size_t initialized = 0;
+    for(size_t x = 0; x < count; x++){
+        const StateVariable& variable = variables[x];
+        auto match = byName.find(variable.name);
+        if(match == byName.end() || std::strcmp(match->second->layout, variable.layout) != 0){
+            initialized++;
+            continue;
+        }
+        const StateVariable& from = *match->second;
+        if(variable.mask != 0 || from.mask != 0){
+            writeStateBit(variable, readStateBit(from));
+        }
+        else if(variable.size == from.size){
+            variable.copy(variable.address, from.address);
+        }
+        else{
+            initialized++;
+            continue;
+        }
+        byName.erase(match);
+        kept++;
+    }
+    nodalisLog() << "Online change: " << kept << " variable(s) kept, " << initialized << " initialized, "
+              << byName.size() << " removed\n";
+}
+
+void ProgramHost::poll(){
+    auto now = std::chrono::steady_clock::now();
+    if(now < nextCheck){
+        return;
+    }
+    nextCheck = now + CHANGE_CHECK;
+    int64_t changed = 0;
+    uint64_t size = 0;
+    if(!stamp(changed, size) || (changed == modified && size == fileSize)){
+        return;
+    }
+    modified = changed;
+    fileSize = size;
+
+    std::string error;
+    const ProgramModule* next = open(error);
+    if(next == nullptr){
+        nodalisLog() << "Online change rejected: " << error << "\n";
+        return;
+    }
+    std::unique_lock<std::shared_mutex> lock(swapMutex, std::defer_lock);
+    if(threaded){
+        lock.lock();
+    }
+    migrate(*next);
+    // A program built with warmRestart snapshots the variables of the version that is running.
+    if(registeredStateTable() == module->state){
+        registerStateTable(next->state);
+    }
+    for(size_t t = 0; t < next->taskCount; t++){
+        runs[t] = next->tasks[t].run;
+        triggers[t] = next->tasks[t].trigger;
+    }
+    next->attach();
+    module = next;
+    nodalisLog() << "Online change: " << next->name << " version " << version << " is running\n";
+}
@@ -0,0 +1,166 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Program Host
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * Online change. A program compiled with onlineChange is built into a shared library, and the runtime into a host
+ * executable that loads it. The host owns the process image, the IO clients and the servers, and the library only
+ * holds the POUs. When a new build of the library replaces the file, the host loads it at a scan boundary, carries
+ * the variables of the programs and the globals over to it by name and layout, and runs its tasks from the next
+ * release on, without stopping IO or dropping a connection.
+ *
+ * A host can load several libraries, each a resource built by compileHost() into a window of its own of the process
+ * image. Their tasks share the host's scheduler, their IO clients its reactor, and their variables its OPC UA server,
+ * in a namespace for each resource, and each library is swapped on its own.
+ */
+#pragma once
+#ifndef PROGRAMHOST_H
+#define PROGRAMHOST_H
+
+#include "nodalis.h"
+#include <shared_mutex>
+
+/**
+ * The version of ProgramModule and StateVariable, which changes when their layout or meaning does.
+ */
+#define NODALIS_PROGRAM_ABI_VERSION 3
+
+/**
+ * The build of the runtime, which the compiler defines for the host and its program libraries alike: a library is
+ * only loaded by a host built from the same runtime sources, options and process image layout.
+ */
+#ifndef NODALIS_RUNTIME_ID
+#define NODALIS_RUNTIME_ID ""
+#endif
+
+#if defined(_WIN32)
+#define NODALIS_PROGRAM_EXPORT extern "C" __declspec(dllexport)
+#else
+#define NODALIS_PROGRAM_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+/**
+ * A task of a program library, which the host schedules.
+ */
+struct ProgramTask {
+    const char* name;
+    uint64_t interval;      // The period of the task, in milliseconds.
+    int priority;
+    void (*run)();          // Runs the programs of the task.
+    bool (*trigger)();      // Reads the BOOL of an event task, or null for a cyclic task.
+    uint64_t watchdog;      // The watchdog budget of the task, in milliseconds, or 0 for the host's --watchdog.
+};
+
+/**
+ * What a program library exports, from nodalis_program().
+ */
+struct ProgramModule {
+    int abiVersion;             // NODALIS_PROGRAM_ABI_VERSION.
+    const char* runtime;        // The build of the runtime the library was compiled against.
+    const char* configuration;  // A hash of the tasks, the IO maps and the symbols, which can't change online.
+    const char* name;           // The name of the PLC.
+    const ProgramTask* tasks;
+    size_t taskCount;
+    void (*configure)();        // Registers the symbols and the BACnet objects. Called for the first version only.
+    void (*map)();              // Maps the IO. Called for the first version only.
+    void (*attach)();           // Registers the profiles. Called for each version when it is started.
+    StateTable state;           // Gets the table of the variables carried over.
+};
+
+/**
+ * The function a program library exports its module with.
+ */
+typedef const ProgramModule* (*ProgramEntry)();
+
+/**
+ * Loads a program library and swaps in each new build of it.
+ */
+class ProgramHost {
+public:
+    /**
+     * Constructs a host for a program library.
+     * @param options The runtime options.
+     * @param programFile The program library.
+     * @param shared Whether the library is one of several resources of the process, whose tasks are then named after
+     * the resource and whose variables are served in its own OPC UA namespace.
+     */
+    ProgramHost(const RuntimeOptions& options, const std::string& programFile, bool shared = false);
+
+    /**
+     * Loads the first version of the program and registers its symbols, BACnet objects and profiles, before the
+     * scheduler is constructed.
+     * @returns Returns false, having written why, if the library can't be loaded or wasn't built for this host.
+     */
+    bool load();
+    /**
+     * Adds the program's tasks to the scheduler and maps its IO, unless the IO is mapped from a configuration
+     * (--io-config). The scheduler's cycle hook should then call poll().
+     * @param scheduler The scheduler to run the tasks on.
+     */
+    void start(TaskScheduler& scheduler);
+    /**
+     * Gets the name of the PLC.
+     */
+    const char* name() const { return module->name; }
+    /**
+     * Swaps in a new build of the library if the file has changed. The scheduler calls this between cycles, so no
+     * task of its thread is running, and with threaded tasks, the swap waits for the releases in progress to end.
+     */
+    void poll();
+
+private:
+    std::string programFile;
+    bool threaded;
+    bool shared;
+    bool mapsIO;
+    std::string runtime;
+    const ProgramModule* module = nullptr;
+    /**
+     * The run function of each task, in the order of the first version's tasks.
+     */
+    std::vector<void (*)()> runs;
+    std::vector<bool (*)()> triggers;
+    /**
+     * Taken shared by a release of a threaded task, and exclusively by a swap.
+     */
+    std::shared_mutex swapMutex;
+    int64_t modified = 0;
+    uint64_t fileSize = 0;
+    std::chrono::steady_clock::time_point nextCheck;
+    int version = 0;
+
+    /**
+     * Loads a copy of the library file, so that the file can be replaced while the copy stays loaded. Libraries are
+     * never unloaded, since the runtime keeps pointers to the tables they registered.
+     * @param error The reason the library can't be used.
+     * @returns Returns the module, or nullptr.
+     */
+    const ProgramModule* open(std::string& error);
+    /**
+     * Carries the state variables of the running version over to the next.
+     * @param next The next version.
+     */
+    void migrate(const ProgramModule& next);
+    /**
+     * Reads the time stamp and size of the library file.
+     * @returns Returns false if the file can't be read.
+     */
+    bool stamp(int64_t& modified, uint64_t& size) const;
+};
+
+#endif // PROGRAMHOST_H
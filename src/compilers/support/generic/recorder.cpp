@@ -0,0 +1,471 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Signal Recorder
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+#include "recorder.h"
+#include "nodalis.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #pragma comment(lib, "ws2_32.lib")
+#else
+    #include <arpa/inet.h>
+    #include <fcntl.h>
+    #include <netinet/in.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+#endif
+
+#ifdef MSG_NOSIGNAL
+    // A client that goes away must fail the send rather than raise SIGPIPE.
+    static constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+    static constexpr int SEND_FLAGS = 0;
+#endif
+
+/**
+ * How long the recorder thread sleeps between drains of the ring, in milliseconds. The ring holds
+ * options.recordBuffer samples, which must cover the scans of a drain with room to spare.
+ */
+static constexpr int RECORDER_DRAIN_WAIT = 10;
+
+/**
+ * A comparison of a channel with a value, which the recording starts at when it becomes true.
+ */
+struct SignalTrigger {
+    enum Op { Greater, GreaterEqual, Less, LessEqual, Equal, NotEqual };
+    size_t channel = 0;
+    Op op = Equal;
+    int64_t value = 0;
+};
+
+static void closeSocket(int fd) {
+#ifdef _WIN32
+    closesocket(fd);
+#else
+    close(fd);
+#endif
+}
+
+static bool setNonBlocking(int fd) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(fd, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+/**
+ * Gets the number of bytes a value of a channel takes in a sample.
+ * @param width The width of the channel, in bits.
+ */
+static size_t valueBytes(int width) {
+    return width == 1 ? 1 : static_cast<size_t>(width / 8);
+}
+
+class SignalRecorder {
+public:
+    bool start(const RuntimeOptions& options);
+    /**
+     * Copies the values of the channels from MEMORY into the ring. Called by the scan thread.
+     */
+    void sample(uint64_t micros) {
+        uint64_t slot = head.load(std::memory_order_relaxed);
+        if (slot - tail.load(std::memory_order_acquire) >= capacity) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        uint64_t* row = ring.data() + (slot & (capacity - 1)) * stride;
+        const uint8_t* image = reinterpret_cast<const uint8_t*>(MEMORY);
+        row[0] = micros;
+        for (size_t c = 0; c < channels.size(); c++) {
+            row[c + 1] = channels[c].load(image);
+        }
+        head.store(slot + 1, std::memory_order_release);
+    }
+    /**
+     * Waits until the ring has room for a sample, or the recording ends. Called by the scan thread.
+     */
+    void waitForRoom() {
+        while (recording.load(std::memory_order_relaxed)
+            && head.load(std::memory_order_relaxed) - tail.load(std::memory_order_acquire) >= capacity) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    void stop();
+
+    std::atomic<bool> recording{false};
+
+private:
+    std::vector<ResolvedAddress> channels;
+    std::vector<std::string> names;
+    bool triggered = true;
+    SignalTrigger trigger;
+    uint64_t pretrigger = 0;
+    uint64_t samples = 0;
+    /**
+     * The ring of samples, each stride words: the time and a value per channel. Only the scan thread advances the
+     * head and only the recorder thread the tail, each on a cache line of its own.
+     */
+    std::vector<uint64_t> ring;
+    size_t stride = 0;
+    uint64_t capacity = 0;
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    alignas(64) std::atomic<uint64_t> dropped{0};
+
+    /**
+     * Guards the drain, which the recorder thread and stop() both do.
+     */
+    std::mutex drainMutex;
+    std::string path;
+    FILE* file = nullptr;
+    int listener = -1;
+    int client = -1;
+    /**
+     * The samples kept before the trigger, as a ring of pretrigger rows, and how many it has seen.
+     */
+    std::vector<uint64_t> history;
+    uint64_t seen = 0;
+    bool lastCondition = true;
+    uint64_t written = 0;
+    std::vector<uint8_t> packed;
+
+    bool parseTrigger(const std::string& text);
+    bool condition(const uint64_t* row) const;
+    void drain();
+    void handle(const uint64_t* row);
+    void pack(const uint64_t* row);
+    std::vector<uint8_t> header(uint32_t before) const;
+    void flush();
+    void finish();
+};
+
+static SignalRecorder RECORDER;
+
+bool SignalRecorder::parseTrigger(const std::string& text) {
+    size_t at = text.find_first_of("<>=!");
+    if (at == std::string::npos || at == 0) {
+        return false;
+    }
+    std::string address = text.substr(0, at);
+    bool twoCharacters = text.compare(at + 1, 1, "=") == 0 || text.compare(at, 2, "<>") == 0;
+    std::string op = text.substr(at, twoCharacters ? 2 : 1);
+    std::string value = text.substr(at + op.size());
+    if (op == ">") trigger.op = SignalTrigger::Greater;
+    else if (op == ">=") trigger.op = SignalTrigger::GreaterEqual;
+    else if (op == "<") trigger.op = SignalTrigger::Less;
+    else if (op == "<=") trigger.op = SignalTrigger::LessEqual;
+    else if (op == "=" || op == "==") trigger.op = SignalTrigger::Equal;
+    else if (op == "<>" || op == "!=") trigger.op = SignalTrigger::NotEqual;
+    else return false;
+    char* end = nullptr;
+    trigger.value = std::strtoll(value.c_str(), &end, 0);
+    if (value.empty() || *end != '\0') {
+        return false;
+    }
+    auto found = std::find(names.begin(), names.end(), address);
+    if (found == names.end()) {
+        // The trigger's address is recorded as well, so that the recorder thread can evaluate it from the samples.
+        ResolvedAddress resolved;
+        bool bit = address.find('.') != std::string::npos;
+        if (tryResolveAddress(address, -1, bit, resolved) != AddressStatus::OK) {
+            return false;
+        }
+        channels.push_back(resolved);
+        names.push_back(address);
+        found = names.end() - 1;
+    }
+    trigger.channel = static_cast<size_t>(found - names.begin());
+    return true;
+}
+
+bool SignalRecorder::condition(const uint64_t* row) const {
+    const ResolvedAddress& channel = channels[trigger.channel];
+    uint64_t raw = row[trigger.channel + 1];
+    // Values are compared as signed integers of the channel's width.
+    int shift = channel.bit > -1 ? 0 : 64 - channel.width;
+    int64_t value = shift > 0 ? static_cast<int64_t>(raw << shift) >> shift : static_cast<int64_t>(raw);
+    switch (trigger.op) {
+        case SignalTrigger::Greater: return value > trigger.value;
+        case SignalTrigger::GreaterEqual: return value >= trigger.value;
+        case SignalTrigger::Less: return value < trigger.value;
+        case SignalTrigger::LessEqual: return value <= trigger.value;
+        case SignalTrigger::Equal: return value == trigger.value;
+        case SignalTrigger::NotEqual: return value != trigger.value;
+    }
+    return false;
+}
+
+bool SignalRecorder::start(const RuntimeOptions& options) {
+    std::string list = options.record;
+    size_t from = 0;
+    while (from <= list.size()) {
+        size_t comma = list.find(',', from);
+        std::string address = list.substr(from, comma == std::string::npos ? std::string::npos : comma - from);
+        from = comma == std::string::npos ? list.size() + 1 : comma + 1;
+        address.erase(0, address.find_first_not_of(' '));
+        address.erase(address.find_last_not_of(' ') + 1);
+        if (address.empty()) {
+            continue;
+        }
+        ResolvedAddress resolved;
+        bool bit = address.find('.') != std::string::npos;
+        AddressStatus status = tryResolveAddress(address, -1, bit, resolved);
+        if (status != AddressStatus::OK) {
+            nodalisLog() << "Can't record " << address << ": " << addressStatusText(status) << "\n";
+            return false;
+        }
+        channels.push_back(resolved);
+        names.push_back(address);
+    }
+    if (channels.empty()) {
+        return false;
+    }
+    if (!options.recordTrigger.empty()) {
+        if (!parseTrigger(options.recordTrigger)) {
+            nodalisLog() << "Can't record with the trigger " << options.recordTrigger << "\n";
+            return false;
+        }
+        triggered = false;
+        pretrigger = options.recordPretrigger;
+    }
+    if (channels.size() > 0xffff) {
+        return false;
+    }
+    samples = options.recordSamples;
+    path = options.recordOut;
+    stride = channels.size() + 1;
+    capacity = 1;
+    while (capacity < options.recordBuffer) {
+        capacity <<= 1;
+    }
+    ring.assign(capacity * stride, 0);
+    history.assign(pretrigger * stride, 0);
+    packed.reserve(stride * 8 * 256);
+    file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        nodalisLog() << "Can't write the recording to " << path << "\n";
+    }
+    if (options.recordPort > 0) {
+#ifdef _WIN32
+        WSADATA wsa;
+        WSAStartup(MAKEWORD(2,2), &wsa);
+#endif
+        listener = static_cast<int>(socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+        int on = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&on), sizeof(on));
+        sockaddr_in local{};
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_ANY);
+        local.sin_port = htons(static_cast<uint16_t>(options.recordPort));
+        if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0 ||
+            listen(listener, 1) != 0 || !setNonBlocking(listener)) {
+            nodalisLog() << "Can't serve the recording on port " << options.recordPort << "\n";
+            if (listener >= 0) closeSocket(listener);
+            listener = -1;
+        }
+    }
+    if (file == nullptr && listener < 0) {
+        return false;
+    }
+    if (triggered && file != nullptr) {
+        auto bytes = header(0);
+        std::fwrite(bytes.data(), 1, bytes.size(), file);
+    }
+    nodalisLog() << "Recording " << channels.size() << " signals" << (triggered ? "" : " on " + options.recordTrigger)
+        << (file != nullptr ? " to " + path : "") << "\n";
+    recording = true;
+    std::thread([this]() {
+        moveToBackground();
+        NODALIS_TRACE_THREAD("Recorder");
+        while (recording) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(RECORDER_DRAIN_WAIT));
+            drain();
+        }
+    }).detach();
+    return true;
+}
+
+std::vector<uint8_t> SignalRecorder::header(uint32_t before) const {
+    uint32_t sampleBytes = 8;
+    for (const auto& channel : channels) {
+        sampleBytes += static_cast<uint32_t>(valueBytes(channel.bit > -1 ? 1 : channel.width));
+    }
+    SignalRecordingHeader head{ SIGNAL_RECORDING_MAGIC, SIGNAL_RECORDING_VERSION, static_cast<uint16_t>(channels.size()),
+        sampleBytes, before };
+    std::vector<uint8_t> bytes(sizeof(head));
+    std::memcpy(bytes.data(), &head, sizeof(head));
+    for (size_t c = 0; c < channels.size(); c++) {
+        bytes.push_back(static_cast<uint8_t>(channels[c].bit > -1 ? 1 : channels[c].width));
+        size_t length = std::min<size_t>(names[c].size(), 255);
+        bytes.push_back(static_cast<uint8_t>(length));
+        bytes.insert(bytes.end(), names[c].begin(), names[c].begin() + static_cast<std::ptrdiff_t>(length));
+    }
+    return bytes;
+}
+
+void SignalRecorder::pack(const uint64_t* row) {
+    size_t at = packed.size();
+    packed.resize(at + 8);
+    std::memcpy(packed.data() + at, &row[0], 8);
+    for (size_t c = 0; c < channels.size(); c++) {
+        size_t bytes = valueBytes(channels[c].bit > -1 ? 1 : channels[c].width);
+        at = packed.size();
+        packed.resize(at + bytes);
+        std::memcpy(packed.data() + at, &row[c + 1], bytes);
+    }
+    written++;
+}
+
+void SignalRecorder::handle(const uint64_t* row) {
+    if (!triggered) {
+        bool met = condition(row);
+        bool fired = met && !lastCondition;
+        lastCondition = met;
+        if (!fired) {
+            if (pretrigger > 0) {
+                std::copy(row, row + stride, history.begin() + static_cast<std::ptrdiff_t>((seen % pretrigger) * stride));
+            }
+            seen++;
+            return;
+        }
+        triggered = true;
+        uint64_t before = std::min(seen, pretrigger);
+        nodalisLog() << "Recording triggered by " << names[trigger.channel] << "\n";
+        if (file != nullptr) {
+            auto bytes = header(static_cast<uint32_t>(before));
+            std::fwrite(bytes.data(), 1, bytes.size(), file);
+        }
+        for (uint64_t n = seen - before; n < seen; n++) {
+            pack(history.data() + (n % pretrigger) * stride);
+        }
+    }
+    pack(row);
+}
+
+void SignalRecorder::drain() {
+    std::lock_guard<std::mutex> lock(drainMutex);
+    if (listener >= 0 && client < 0) {
+        int accepted = static_cast<int>(accept(listener, nullptr, nullptr));
+        if (accepted >= 0) {
+            // The client gets the samples from when it connected on, which have no trigger point.
+            client = accepted;
+            setNonBlocking(client);
+            auto bytes = header(0);
+            if (send(client, reinterpret_cast<const char*>(bytes.data()), static_cast<int>(bytes.size()), SEND_FLAGS) != static_cast<int>(bytes.size())) {
+                closeSocket(client);
+                client = -1;
+            }
+        }
+    }
+    uint64_t from = tail.load(std::memory_order_relaxed);
+    uint64_t to = head.load(std::memory_order_acquire);
+    packed.clear();
+    for (uint64_t slot = from; slot < to; slot++) {
+        if (samples == 0 || written < samples) {
+            handle(ring.data() + (slot & (capacity - 1)) * stride);
+        }
+    }
+    tail.store(to, std::memory_order_release);
+    flush();
+    if (samples > 0 && written >= samples) {
+        finish();
+    }
+}
+
+void SignalRecorder::flush() {
+    if (packed.empty()) {
+        return;
+    }
+    if (file != nullptr) {
+        std::fwrite(packed.data(), 1, packed.size(), file);
+        std::fflush(file);
+    }
+    if (client >= 0) {
+        // A client that can't keep up is dropped rather than holding up the recording.
+        if (send(client, reinterpret_cast<const char*>(packed.data()), static_cast<int>(packed.size()), SEND_FLAGS) != static_cast<int>(packed.size())) {
+            closeSocket(client);
+            client = -1;
+        }
+    }
+    packed.clear();
+}
+
+void SignalRecorder::finish() {
+    if (!recording.exchange(false)) {
+        return;
+    }
+    if (file != nullptr) {
+        std::fclose(file);
+        file = nullptr;
+        nodalisLog() << "Recorded " << written << " samples to " << path;
+    }
+    else {
+        nodalisLog() << "Recorded " << written << " samples";
+    }
+    uint64_t lost = dropped.load(std::memory_order_relaxed);
+    nodalisLog() << (lost > 0 ? ", dropping " + std::to_string(lost) : std::string()) << "\n";
+    if (client >= 0) {
+        closeSocket(client);
+        client = -1;
+    }
+    if (listener >= 0) {
+        closeSocket(listener);
+        listener = -1;
+    }
+}
+
+void SignalRecorder::stop() {
+    if (!recording) {
+        return;
+    }
+    drain();
+    std::lock_guard<std::mutex> lock(drainMutex);
+    finish();
+}
+
+bool startRecorder(const RuntimeOptions& options) {
+    if (options.record.empty() || options.benchScans > 0) {
+        return false;
+    }
+    return RECORDER.start(options);
+}
+
+void recordSignals(uint64_t micros) {
+    if (RECORDER.recording.load(std::memory_order_relaxed)) {
+        RECORDER.sample(micros);
+    }
+}
+
+void waitForRecorder() {
+    if (RECORDER.recording.load(std::memory_order_relaxed)) {
+        RECORDER.waitForRoom();
+    }
+}
+
+void stopRecorder() {
+    RECORDER.stop();
+}
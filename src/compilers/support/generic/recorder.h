@@ -0,0 +1,82 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Signal Recorder
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * Records the values of a set of addresses at every scan, like an oscilloscope, for commissioning. The addresses are
+ * resolved once (--record %IW0,%QX0.1,%MD4), and after each scan the scan thread copies their values from the image
+ * into a ring buffer that was allocated when the recorder started, which it shares with a single reader, the recorder
+ * thread. Recording a sample takes no lock, makes no system call and never waits: when the ring is full, the sample is
+ * dropped and counted instead, so the recorder doesn't change the timing it is recording.
+ *
+ * The recorder thread drains the ring and writes the samples to a file (--record-out), and to a client connected to
+ * --record-port, if there is one. A recording starts right away, or, with a trigger (--record-trigger %MW2>100), at
+ * the first sample where the condition becomes true, with the --record-pretrigger samples before it. It ends after
+ * --record-samples samples, or when the runtime stops.
+ *
+ * The recording is a SignalRecordingHeader, then the address of each channel, as its width (uint8_t), the length of
+ * its text (uint8_t) and the text, then the samples. A sample is the time of its scan, in microseconds since the
+ * runtime started (uint64_t), followed by the value of each channel, in a byte for a bit and in width / 8 bytes
+ * otherwise. Values are written in the byte order of the controller.
+ */
+#pragma once
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <cstdint>
+
+struct RuntimeOptions;
+
+/**
+ * The header of a signal recording.
+ */
+struct SignalRecordingHeader {
+    uint32_t magic;         // SIGNAL_RECORDING_MAGIC.
+    uint16_t version;       // SIGNAL_RECORDING_VERSION.
+    uint16_t channels;      // The number of channels.
+    uint32_t sampleBytes;   // The size of a sample.
+    uint32_t pretrigger;    // The number of samples before the one that met the trigger, or 0 without one.
+};
+
+constexpr uint32_t SIGNAL_RECORDING_MAGIC = 0x4753444e;    // "NDSG"
+constexpr uint16_t SIGNAL_RECORDING_VERSION = 1;
+
+/**
+ * Resolves the addresses to record, allocates the ring and starts the recorder thread, if options.record names any
+ * addresses. Called by TaskScheduler::run() before the first scan.
+ * @param options The runtime options.
+ * @returns Returns false, having written why, if nothing is recorded or an address or the trigger is invalid.
+ */
+bool startRecorder(const RuntimeOptions& options);
+/**
+ * Samples the recorded addresses from the image of the scan that was just committed. Called by the scan thread after
+ * each scan, and does nothing if the recorder isn't recording.
+ * @param micros The time of the scan, in microseconds since the runtime started.
+ */
+void recordSignals(uint64_t micros);
+/**
+ * Waits until the ring has room for another sample. A simulated run scans faster than the recorder thread drains, so
+ * it waits before each scan rather than have the samples of its scans dropped.
+ */
+void waitForRecorder();
+/**
+ * Writes the samples that are still in the ring and closes the recording. Called when the runtime stops.
+ */
+void stopRecorder();
+
+#endif // RECORDER_H
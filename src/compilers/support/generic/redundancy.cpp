@@ -0,0 +1,710 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Redundancy
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+#include "redundancy.h"
+#include "nodalis.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <thread>
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #pragma comment(lib, "ws2_32.lib")
+#else
+    #include <arpa/inet.h>
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <sys/select.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+#endif
+
+#ifdef MSG_NOSIGNAL
+    // A peer that resets the connection must fail the send rather than raise SIGPIPE.
+    static constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+    static constexpr int SEND_FLAGS = 0;
+#endif
+
+/**
+ * Bytes that are unchanged between two changed ones are sent with them when there are fewer of them than this, since
+ * a run of their own would cost its 8 byte header.
+ */
+static constexpr size_t RUN_GAP = 8;
+
+#pragma region "Link"
+/**
+ * Closes a socket.
+ * @param fd The socket.
+ */
+static void closeSocket(int fd) {
+#ifdef _WIN32
+    closesocket(fd);
+#else
+    close(fd);
+#endif
+}
+
+/**
+ * Sets the blocking mode of a socket.
+ * @param fd The socket.
+ * @param nonBlocking True to make it non-blocking.
+ * @returns Returns true on success.
+ */
+static bool setNonBlocking(int fd, bool nonBlocking) {
+#ifdef _WIN32
+    u_long mode = nonBlocking ? 1 : 0;
+    return ioctlsocket(fd, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK)) == 0;
+#endif
+}
+
+/**
+ * Sends frames as soon as they are written, and fails a send that the peer hasn't made room for in time.
+ * @param fd The socket.
+ * @param timeout The milliseconds a send may wait.
+ */
+static void configureLink(int fd, uint64_t timeout) {
+    int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+#ifdef _WIN32
+    DWORD wait = static_cast<DWORD>(timeout);
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&wait), sizeof(wait));
+#else
+    timeval wait;
+    wait.tv_sec = static_cast<time_t>(timeout / 1000);
+    wait.tv_usec = static_cast<suseconds_t>((timeout % 1000) * 1000);
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &wait, sizeof(wait));
+#endif
+}
+
+/**
+ * Waits until a socket is readable.
+ * @param fd The socket.
+ * @param deadline The time to wait until.
+ * @returns Returns false if the deadline passed first.
+ */
+static bool waitReadable(int fd, std::chrono::steady_clock::time_point deadline) {
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) return false;
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(deadline - now).count();
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(fd, &readable);
+    timeval wait;
+    wait.tv_sec = static_cast<long>(micros / 1000000);
+    wait.tv_usec = static_cast<long>(micros % 1000000);
+    return select(fd + 1, &readable, nullptr, nullptr, &wait) > 0;
+}
+
+/**
+ * Sends all of a buffer.
+ * @returns Returns false if the connection failed or the send timed out.
+ */
+static bool sendAll(int fd, const uint8_t* data, size_t bytes) {
+    while (bytes > 0) {
+        int sent = static_cast<int>(send(fd, reinterpret_cast<const char*>(data), static_cast<int>(bytes), SEND_FLAGS));
+        if (sent <= 0) return false;
+        data += sent;
+        bytes -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+/**
+ * Receives all of a buffer.
+ * @param deadline The time the buffer must be received by.
+ * @returns Returns false if the connection closed or failed, or the deadline passed.
+ */
+static bool receiveAll(int fd, uint8_t* data, size_t bytes, std::chrono::steady_clock::time_point deadline) {
+    while (bytes > 0) {
+        if (!waitReadable(fd, deadline)) return false;
+        int received = static_cast<int>(recv(fd, reinterpret_cast<char*>(data), static_cast<int>(bytes), 0));
+        if (received <= 0) return false;
+        data += received;
+        bytes -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+/**
+ * Sends a frame.
+ * @param fd The socket.
+ * @param type The type of the frame.
+ * @param sequence The sequence of the frame.
+ * @param payload The payload.
+ * @param bytes The size of the payload.
+ * @returns Returns false if the frame couldn't be sent.
+ */
+static bool sendFrame(int fd, uint16_t type, uint64_t sequence, const uint8_t* payload, size_t bytes) {
+    RedundancyFrame frame = { REDUNDANCY_MAGIC, REDUNDANCY_VERSION, type, sequence, static_cast<uint32_t>(bytes), 0 };
+    return sendAll(fd, reinterpret_cast<const uint8_t*>(&frame), sizeof(frame)) && (bytes == 0 || sendAll(fd, payload, bytes));
+}
+
+/**
+ * Receives a frame.
+ * @param fd The socket.
+ * @param frame Receives the header.
+ * @param payload Receives the payload.
+ * @param deadline The time the frame must be received by, once it has started.
+ * @returns Returns false if the connection failed, timed out or didn't send a frame of this version.
+ */
+static bool receiveFrame(int fd, RedundancyFrame& frame, std::vector<uint8_t>& payload, std::chrono::steady_clock::time_point deadline) {
+    if (!receiveAll(fd, reinterpret_cast<uint8_t*>(&frame), sizeof(frame), deadline) ||
+        frame.magic != REDUNDANCY_MAGIC || frame.version != REDUNDANCY_VERSION) {
+        return false;
+    }
+    payload.resize(frame.bytes);
+    return frame.bytes == 0 || receiveAll(fd, payload.data(), frame.bytes, deadline);
+}
+
+/**
+ * Parses the address of the link.
+ * @param link The address, as ip:port. Without an IP, it is any address.
+ * @param address Receives the IPv4 address and port.
+ * @returns Returns false if the address isn't valid.
+ */
+static bool parseLink(const std::string& link, sockaddr_in& address) {
+    size_t colon = link.rfind(':');
+    int port = colon == std::string::npos ? 0 : std::atoi(link.c_str() + colon + 1);
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    std::string ip = colon == std::string::npos ? "" : link.substr(0, colon);
+    if (ip.empty()) {
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+    }
+    else if (inet_pton(AF_INET, ip.c_str(), &address.sin_addr) != 1) {
+        return false;
+    }
+    return port > 0 && port < 65536;
+}
+
+/**
+ * Gets the variables of the registered state table.
+ * @returns Returns the variables, in the order of the table.
+ */
+static std::vector<const StateVariable*> stateRows() {
+    std::vector<const StateVariable*> rows;
+    StateTable table = registeredStateTable();
+    size_t count = 0;
+    const StateVariable* variables = table != nullptr ? table(&count) : nullptr;
+    for (size_t x = 0; x < count; x++) {
+        rows.push_back(&variables[x]);
+    }
+    return rows;
+}
+
+/**
+ * Gets the size of a state variable's value in a frame. A packed BOOL is sent as the word it is packed in.
+ */
+static size_t stateBytes(const StateVariable& variable) {
+    return variable.mask != 0 ? sizeof(uint64_t) : variable.size;
+}
+
+template<typename T>
+static void append(std::vector<uint8_t>& out, const T& value) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+#pragma endregion
+
+#pragma region "Primary"
+/**
+ * The primary's end of the link. The scan thread builds each frame between scans, while the link thread isn't
+ * sending one, and the link thread sends it and waits for it to be acknowledged, so the scan never waits for the
+ * standby. Changes made while a frame is in flight are sent with the next one.
+ */
+class RedundancyPrimary {
+public:
+    ~RedundancyPrimary() { stop(); }
+
+    bool start(const RuntimeOptions& options);
+    void replicate();
+    void stop();
+
+private:
+    sockaddr_in address;
+    std::chrono::milliseconds timeout{};
+    std::chrono::milliseconds heartbeat{};
+    int fd = -1;
+    uint64_t sequence = 0;
+
+    // Owned by the scan thread.
+    std::unique_ptr<ImageChanges> changes;
+    std::vector<uint8_t> sentImage;     // The image as the standby has it, once the first frame is sent.
+    std::vector<const StateVariable*> rows;
+    std::vector<size_t> rowOffsets;
+    std::vector<uint8_t> sentState;     // The variables as the standby has them.
+    StateTable table = nullptr;
+    bool full = true;                   // The next frame holds the whole image and every variable.
+
+    // Handed from the scan thread to the link thread.
+    std::vector<uint8_t> frame;
+    std::atomic<bool> linked{false};
+    std::atomic<bool> busy{false};
+    std::atomic<bool> resync{false};    // Set by the link thread when it connects, so the next frame is full.
+    std::atomic<bool> relink{false};    // Set by the scan thread when the state table changed, so the link says HELLO again.
+    std::atomic<bool> running{false};
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread link;
+    ExecutionStats* latency = nullptr;
+
+    void run();
+    bool connectLink();
+    bool exchange(uint16_t type, const std::vector<uint8_t>& payload);
+    void disconnect();
+    void layOut();
+    void appendImage(const uint8_t* image, const ImageChanges& changed, uint32_t& runs);
+    void appendState(uint32_t& count);
+};
+
+bool RedundancyPrimary::start(const RuntimeOptions& options) {
+    if (!parseLink(options.redundancyLink, address) || address.sin_addr.s_addr == htonl(INADDR_ANY)) {
+        nodalisLog() << "Redundancy: the primary needs the standby's address, as --redundancy-link <ip:port>\n";
+        return false;
+    }
+    if (options.threadedTasks) {
+        nodalisLog() << "Redundancy: changes are sent between scans, which threaded tasks don't have, so the primary runs alone\n";
+        return false;
+    }
+#ifdef _WIN32
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2,2), &wsa);
+#endif
+    timeout = std::chrono::milliseconds(options.redundancyTimeout);
+    heartbeat = std::max(std::chrono::milliseconds(1), timeout / 5);
+    latency = &registerStats("Redundancy");
+    layOut();
+    running = true;
+    link = std::thread(&RedundancyPrimary::run, this);
+    return true;
+}
+
+void RedundancyPrimary::layOut() {
+    table = registeredStateTable();
+    rows = stateRows();
+    rowOffsets.clear();
+    size_t bytes = 0;
+    for (const StateVariable* row : rows) {
+        rowOffsets.push_back(bytes);
+        bytes += stateBytes(*row);
+    }
+    sentState.assign(bytes, 0);
+    sentImage.assign(PROCESS_IMAGE_BYTES, 0);
+}
+
+void RedundancyPrimary::appendImage(const uint8_t* image, const ImageChanges& changed, uint32_t& runs) {
+    auto appendRun = [&](size_t offset, size_t length) {
+        append(frame, static_cast<uint32_t>(offset));
+        append(frame, static_cast<uint32_t>(length));
+        frame.insert(frame.end(), image + offset, image + offset + length);
+        std::memcpy(sentImage.data() + offset, image + offset, length);
+        runs++;
+    };
+    changed.forEachChange([&](size_t offset, size_t length) {
+        if (full) {
+            appendRun(offset, length);
+            return;
+        }
+        // Only the bytes that differ from what the standby has are sent, so the frame follows the rate of change
+        // rather than the size of the lines written.
+        size_t end = offset + length;
+        size_t x = offset;
+        while (x < end) {
+            while (x < end && image[x] == sentImage[x]) x++;
+            if (x == end) break;
+            size_t start = x;
+            size_t last = x;
+            while (x < end && x - last < RUN_GAP) {
+                if (image[x] != sentImage[x]) last = x;
+                x++;
+            }
+            appendRun(start, last + 1 - start);
+        }
+    });
+}
+
+void RedundancyPrimary::appendState(uint32_t& count) {
+    for (size_t x = 0; x < rows.size(); x++) {
+        const StateVariable& row = *rows[x];
+        uint8_t* sent = sentState.data() + rowOffsets[x];
+        size_t bytes = stateBytes(row);
+        bool changed;
+        if (row.mask != 0) {
+            uint64_t word = *static_cast<const uint64_t*>(row.address);
+            uint64_t previous;
+            std::memcpy(&previous, sent, sizeof(previous));
+            changed = full || ((word ^ previous) & row.mask) != 0;
+        }
+        else {
+            changed = full || std::memcmp(row.address, sent, bytes) != 0;
+        }
+        if (changed) {
+            append(frame, static_cast<uint32_t>(x));
+            std::memcpy(sent, row.address, bytes);
+            frame.insert(frame.end(), sent, sent + bytes);
+            count++;
+        }
+    }
+}
+
+void RedundancyPrimary::replicate() {
+    if (!linked.load(std::memory_order_acquire) || busy.load(std::memory_order_acquire)) {
+        return;
+    }
+    if (table != registeredStateTable()) {
+        // An online change loaded a version with other variables. The standby must be running the same build.
+        layOut();
+        relink = true;
+        return;
+    }
+    if (resync.exchange(false)) {
+        changes = std::make_unique<ImageChanges>();
+        full = true;
+    }
+    frame.clear();
+    append(frame, scanTime());
+    append(frame, uint32_t(0));
+    append(frame, uint32_t(0));
+    uint32_t runs = 0;
+    uint32_t count = 0;
+    changes->read([&](const uint8_t* image, const ImageChanges& changed) {
+        appendImage(image, changed, runs);
+    });
+    appendState(count);
+    if (runs == 0 && count == 0 && !full) {
+        return;
+    }
+    std::memcpy(frame.data() + sizeof(uint64_t), &runs, sizeof(runs));
+    std::memcpy(frame.data() + sizeof(uint64_t) + sizeof(uint32_t), &count, sizeof(count));
+    full = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        busy.store(true, std::memory_order_release);
+    }
+    wake.notify_one();
+}
+
+bool RedundancyPrimary::connectLink() {
+    int socketFd = static_cast<int>(socket(AF_INET, SOCK_STREAM, 0));
+    if (socketFd < 0) return false;
+    // Connect without blocking, so that an unreachable standby costs at most the timeout.
+    setNonBlocking(socketFd, true);
+    bool connected = ::connect(socketFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    if (!connected) {
+        fd_set writable;
+        FD_ZERO(&writable);
+        FD_SET(socketFd, &writable);
+        timeval wait;
+        wait.tv_sec = static_cast<long>(timeout.count() / 1000);
+        wait.tv_usec = static_cast<long>((timeout.count() % 1000) * 1000);
+        int error = 0;
+        socklen_t length = sizeof(error);
+        connected = select(socketFd + 1, nullptr, &writable, nullptr, &wait) > 0 &&
+                    getsockopt(socketFd, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error), &length) == 0 && error == 0;
+    }
+    if (!connected || !setNonBlocking(socketFd, false)) {
+        closeSocket(socketFd);
+        return false;
+    }
+    configureLink(socketFd, static_cast<uint64_t>(timeout.count()));
+    uint64_t layout = stateLayout();
+    RedundancyFrame reply;
+    std::vector<uint8_t> payload;
+    if (!sendFrame(socketFd, REDUNDANCY_HELLO, ++sequence, reinterpret_cast<const uint8_t*>(&layout), sizeof(layout)) ||
+        !receiveFrame(socketFd, reply, payload, std::chrono::steady_clock::now() + timeout)) {
+        closeSocket(socketFd);
+        return false;
+    }
+    if (reply.type == REDUNDANCY_REJECT) {
+        nodalisLog() << "Redundancy: the standby runs another build of the program, and can't follow this one\n";
+        closeSocket(socketFd);
+        return false;
+    }
+    fd = socketFd;
+    return reply.type == REDUNDANCY_ACK && reply.sequence == sequence;
+}
+
+void RedundancyPrimary::disconnect() {
+    if (fd >= 0) {
+        closeSocket(fd);
+        fd = -1;
+    }
+    linked.store(false, std::memory_order_release);
+    busy.store(false, std::memory_order_release);
+}
+
+bool RedundancyPrimary::exchange(uint16_t type, const std::vector<uint8_t>& payload) {
+    auto started = std::chrono::steady_clock::now();
+    uint64_t sent = ++sequence;
+    RedundancyFrame reply;
+    std::vector<uint8_t> received;
+    if (!sendFrame(fd, type, sent, payload.data(), payload.size()) ||
+        !receiveFrame(fd, reply, received, started + timeout) || reply.type != REDUNDANCY_ACK || reply.sequence != sent) {
+        return false;
+    }
+    if (type == REDUNDANCY_DELTA) {
+        latency->record(microsBetween(started, std::chrono::steady_clock::now()));
+    }
+    return true;
+}
+
+void RedundancyPrimary::run() {
+    moveToBackground();
+    bool reported = false;
+    const std::vector<uint8_t> none;
+    while (running.load()) {
+        if (fd < 0) {
+            if (!connectLink()) {
+                disconnect();
+                if (!reported) {
+                    nodalisLog() << "Redundancy: no standby at the link, the primary runs alone until one is there\n";
+                    reported = true;
+                }
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait_for(lock, std::max(timeout, std::chrono::milliseconds(1000)), [this] { return !running.load(); });
+                continue;
+            }
+            nodalisLog() << "Redundancy: the standby is following\n";
+            reported = false;
+            resync = true;
+            linked.store(true, std::memory_order_release);
+        }
+        bool due;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            due = wake.wait_for(lock, heartbeat, [this] { return busy.load(std::memory_order_acquire) || relink.load() || !running.load(); });
+        }
+        if (!running.load()) {
+            break;
+        }
+        if (relink.exchange(false)) {
+            disconnect();
+            continue;
+        }
+        // A scan that changed nothing sends nothing, so the link says it is alive when it has been quiet.
+        bool delta = due && busy.load(std::memory_order_acquire);
+        if (!exchange(delta ? REDUNDANCY_DELTA : REDUNDANCY_HEARTBEAT, delta ? frame : none)) {
+            nodalisLog() << "Redundancy: the standby stopped acknowledging, reconnecting\n";
+            disconnect();
+            continue;
+        }
+        if (delta) {
+            busy.store(false, std::memory_order_release);
+        }
+    }
+}
+
+void RedundancyPrimary::stop() {
+    if (link.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        wake.notify_all();
+        link.join();
+    }
+    disconnect();
+}
+#pragma endregion
+
+#pragma region "Standby"
+/**
+ * The standby's end of the link, which runs on the scan thread until it takes over.
+ */
+class RedundancyStandby {
+public:
+    void follow(const RuntimeOptions& options);
+
+private:
+    std::vector<const StateVariable*> rows;
+    std::vector<uint64_t> scratch;      // An aligned copy of a variable's value, for its copy().
+    bool accepted = false;              // The primary's HELLO was accepted.
+
+    bool handle(int fd, const RedundancyFrame& frame, const std::vector<uint8_t>& payload);
+    bool apply(const std::vector<uint8_t>& payload);
+};
+
+bool RedundancyStandby::apply(const std::vector<uint8_t>& payload) {
+    const uint8_t* data = payload.data();
+    size_t bytes = payload.size();
+    if (bytes < sizeof(uint64_t) + 2 * sizeof(uint32_t)) return false;
+    uint64_t scanMillis;
+    uint32_t runs, count;
+    std::memcpy(&scanMillis, data, sizeof(scanMillis));
+    std::memcpy(&runs, data + 8, sizeof(runs));
+    std::memcpy(&count, data + 12, sizeof(count));
+    size_t at = 16;
+    for (uint32_t x = 0; x < runs; x++) {
+        uint32_t offset, length;
+        if (at + 8 > bytes) return false;
+        std::memcpy(&offset, data + at, sizeof(offset));
+        std::memcpy(&length, data + at + 4, sizeof(length));
+        at += 8;
+        if (at + length > bytes || static_cast<size_t>(offset) + length > PROCESS_IMAGE_BYTES) return false;
+        loadImageBytes(offset, data + at, length);
+        at += length;
+    }
+    for (uint32_t x = 0; x < count; x++) {
+        uint32_t index;
+        if (at + 4 > bytes) return false;
+        std::memcpy(&index, data + at, sizeof(index));
+        at += 4;
+        if (index >= rows.size() || at + stateBytes(*rows[index]) > bytes) return false;
+        const StateVariable& row = *rows[index];
+        size_t size = stateBytes(row);
+        if (row.mask != 0) {
+            uint64_t word;
+            std::memcpy(&word, data + at, sizeof(word));
+            uint64_t& target = *static_cast<uint64_t*>(row.address);
+            target = (word & row.mask) != 0 ? target | row.mask : target & ~row.mask;
+        }
+        else {
+            scratch.resize((size + sizeof(uint64_t) - 1) / sizeof(uint64_t) + 1);
+            std::memcpy(scratch.data(), data + at, size);
+            row.copy(row.address, scratch.data());
+        }
+        at += size;
+    }
+    // The clock follows the primary's, so timers and TIME values carry on from it after a takeover.
+    PROGRAM_START = std::chrono::steady_clock::now() - std::chrono::milliseconds(scanMillis);
+    commitOutputs();
+    return true;
+}
+
+bool RedundancyStandby::handle(int fd, const RedundancyFrame& frame, const std::vector<uint8_t>& payload) {
+    if (frame.type == REDUNDANCY_HELLO) {
+        uint64_t layout = 0;
+        if (payload.size() == sizeof(layout)) std::memcpy(&layout, payload.data(), sizeof(layout));
+        accepted = layout == stateLayout();
+        if (!accepted) {
+            nodalisLog() << "Redundancy: the primary runs another build of the program, so the standby can't follow it\n";
+            sendFrame(fd, REDUNDANCY_REJECT, frame.sequence, nullptr, 0);
+            return false;
+        }
+        rows = stateRows();
+        return sendFrame(fd, REDUNDANCY_ACK, frame.sequence, nullptr, 0);
+    }
+    if (!accepted || (frame.type != REDUNDANCY_HEARTBEAT && (frame.type != REDUNDANCY_DELTA || !apply(payload)))) {
+        return false;
+    }
+    return sendFrame(fd, REDUNDANCY_ACK, frame.sequence, nullptr, 0);
+}
+
+void RedundancyStandby::follow(const RuntimeOptions& options) {
+    sockaddr_in address;
+    if (!parseLink(options.redundancyLink, address)) {
+        nodalisLog() << "Redundancy: the standby needs the address to listen on, as --redundancy-link <ip:port>, so it runs alone\n";
+        return;
+    }
+#ifdef _WIN32
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2,2), &wsa);
+#endif
+    int listenFd = static_cast<int>(socket(AF_INET, SOCK_STREAM, 0));
+    int reuse = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+    if (listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listenFd, 1) < 0) {
+        nodalisLog() << "Redundancy: the standby can't listen on " << options.redundancyLink << ", so it runs alone\n";
+        if (listenFd >= 0) closeSocket(listenFd);
+        return;
+    }
+    nodalisLog() << "Redundancy: standing by for the primary on " << options.redundancyLink << "\n";
+    ExecutionStats& stats = registerStats("Redundancy");
+    auto timeout = std::chrono::milliseconds(options.redundancyTimeout);
+    bool following = false;
+    auto lastFrame = std::chrono::steady_clock::now();
+    int fd = -1;
+    RedundancyFrame frame;
+    std::vector<uint8_t> payload;
+    while (true) {
+        auto now = std::chrono::steady_clock::now();
+        if (following && now >= lastFrame + timeout) {
+            break;
+        }
+        // Until the primary is first heard from, the standby waits for it however long it takes.
+        auto deadline = following ? lastFrame + timeout : now + std::chrono::seconds(1);
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(deadline - now).count();
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(listenFd, &readable);
+        if (fd >= 0) FD_SET(fd, &readable);
+        timeval wait;
+        wait.tv_sec = static_cast<long>(micros / 1000000);
+        wait.tv_usec = static_cast<long>(micros % 1000000);
+        if (select(std::max(listenFd, fd) + 1, &readable, nullptr, nullptr, &wait) <= 0) {
+            continue;
+        }
+        if (FD_ISSET(listenFd, &readable)) {
+            int incoming = static_cast<int>(accept(listenFd, nullptr, nullptr));
+            if (incoming >= 0) {
+                // A primary that reconnects replaces the connection it had.
+                if (fd >= 0) closeSocket(fd);
+                fd = incoming;
+                configureLink(fd, static_cast<uint64_t>(options.redundancyTimeout));
+                accepted = false;
+            }
+            continue;
+        }
+        if (fd < 0 || !FD_ISSET(fd, &readable)) {
+            continue;
+        }
+        auto started = std::chrono::steady_clock::now();
+        if (!receiveFrame(fd, frame, payload, started + timeout) || !handle(fd, frame, payload)) {
+            closeSocket(fd);
+            fd = -1;
+            continue;
+        }
+        if (frame.type == REDUNDANCY_DELTA) {
+            if (!following) {
+                nodalisLog() << "Redundancy: following the primary\n";
+            }
+            following = true;
+            stats.record(microsBetween(started, std::chrono::steady_clock::now()));
+        }
+        lastFrame = std::chrono::steady_clock::now();
+    }
+    if (fd >= 0) closeSocket(fd);
+    closeSocket(listenFd);
+    nodalisLog() << "Redundancy: the primary has been silent for " << options.redundancyTimeout << " ms, the standby takes over\n";
+}
+#pragma endregion
+
+static RedundancyPrimary PRIMARY;
+
+void followPrimary(const RuntimeOptions& options) {
+    RedundancyStandby standby;
+    standby.follow(options);
+}
+
+bool startReplication(const RuntimeOptions& options) {
+    return PRIMARY.start(options);
+}
+
+void replicateScan() {
+    PRIMARY.replicate();
+}
@@ -0,0 +1,89 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Redundancy
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * Hot standby. Two controllers run the same build of a program, one as the primary (--redundancy primary) and one
+ * as the standby (--redundancy standby), joined by a TCP link of their own (--redundancy-link). The primary runs the
+ * program and the IO, and after each scan sends the standby what changed: the runs of bytes of the process image
+ * that differ from what it last sent, found from the lines dirty tracking marked, and the variables of the state
+ * table (see registerStateTable()) that differ. The standby applies each frame to its image and variables and
+ * acknowledges it, and leaves the IO alone. When it has received nothing for --redundancy-timeout milliseconds, it
+ * takes over: it starts its IO and runs the program from the state it last received.
+ *
+ * A frame is a RedundancyFrame followed by its payload. The primary sends a HELLO with the hash of its layout
+ * (stateLayout()) when it connects, which the standby acknowledges if its own layout is the same, a DELTA for each
+ * scan that changed anything, and a HEARTBEAT when it has sent nothing for a fifth of the timeout. The standby
+ * acknowledges each frame. The payload of a DELTA is the scan time (uint64_t), the number of runs and of variables
+ * (uint32_t each), each run as its offset and length (uint32_t each) and bytes, and each variable as its index in
+ * the state table (uint32_t) and value. The first DELTA after the HELLO holds the whole image and every variable.
+ * Frames are sent in the byte order of the controllers, which are the same build.
+ */
+#pragma once
+#ifndef REDUNDANCY_H
+#define REDUNDANCY_H
+
+#include <cstdint>
+
+struct RuntimeOptions;
+
+/**
+ * The header of a frame on the redundancy link.
+ */
+struct RedundancyFrame {
+    uint32_t magic;         // REDUNDANCY_MAGIC.
+    uint16_t version;       // REDUNDANCY_VERSION.
+    uint16_t type;          // A RedundancyFrameType.
+    uint64_t sequence;      // The sequence of the frame, which its ACK repeats.
+    uint32_t bytes;         // The size of the payload.
+    uint32_t reserved;
+};
+
+enum RedundancyFrameType : uint16_t {
+    REDUNDANCY_HELLO = 1,       // Primary to standby: the layout hash (uint64_t).
+    REDUNDANCY_DELTA = 2,       // Primary to standby: the changes of a scan.
+    REDUNDANCY_ACK = 3,         // Standby to primary: the frame was applied.
+    REDUNDANCY_REJECT = 4,      // Standby to primary: the HELLO's layout isn't the standby's.
+    REDUNDANCY_HEARTBEAT = 5,   // Primary to standby: nothing changed.
+};
+
+constexpr uint32_t REDUNDANCY_MAGIC = 0x4c52444e;   // "NDRL"
+constexpr uint16_t REDUNDANCY_VERSION = 1;
+
+/**
+ * Runs the runtime as the standby of a primary: mirrors the primary's image and variables, and returns when the
+ * primary has been silent for options.redundancyTimeout milliseconds after it was first heard from. Called by
+ * TaskScheduler::run() before it starts the IO. A standby that has never heard from a primary waits for one, so
+ * that two controllers started together don't both run the IO.
+ * @param options The runtime options.
+ */
+void followPrimary(const RuntimeOptions& options);
+/**
+ * Starts replicating the runtime to a standby, connecting to it, and reconnecting, on a thread of its own.
+ * @param options The runtime options.
+ * @returns Returns false if the options don't name a link, or the tasks are threaded, which have no point between
+ * scans at which the state is consistent.
+ */
+bool startReplication(const RuntimeOptions& options);
+/**
+ * Hands the changes of the scan that ended to the link thread, unless it is still waiting for the last frame to be
+ * acknowledged, in which case they go with a later scan. Called by the scan thread between scans.
+ */
+void replicateScan();
+
+#endif // REDUNDANCY_H
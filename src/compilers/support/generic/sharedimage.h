@@ -0,0 +1,249 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Shared Process Image
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * The layout of the shared memory segment the runtime publishes its image to with --shm-image, and a reader for it.
+ * This header only depends on the standard library and the OS, so local HMIs and co-processes can include it on its
+ * own to read the image without going through OPC UA.
+ */
+#pragma once
+#ifndef SHAREDIMAGE_H
+#define SHAREDIMAGE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Identifies a shared image segment.
+ */
+static constexpr char SHARED_IMAGE_MAGIC[8] = { 'N', 'D', 'L', 'S', 'S', 'H', 'M', '1' };
+
+/**
+ * The version of the segment layout. Readers should refuse a segment with a version they don't know.
+ */
+static constexpr uint32_t SHARED_IMAGE_VERSION = 1;
+
+/**
+ * The header at the start of a shared image segment. The first line describes the layout and never changes while
+ * the runtime runs. The second holds the seqlock sequence, which the runtime makes odd before it copies a scan's
+ * image in and even again after, so a reader that sees the same even sequence before and after reading has read a
+ * consistent snapshot.
+ */
+struct alignas(64) SharedImageHeader {
+    char magic[8];              // SHARED_IMAGE_MAGIC.
+    uint32_t version;           // SHARED_IMAGE_VERSION.
+    uint32_t headerBytes;       // The offset of the image from the start of the segment.
+    uint32_t imageBytes;        // The size of the image.
+    uint32_t lineBytes;         // The size of an image line, the unit the runtime copies the image in.
+    uint32_t inputOffset;       // The offset of %I from the start of the image.
+    uint32_t inputBytes;        // The size of %I.
+    uint32_t outputOffset;      // The offset of %Q from the start of the image.
+    uint32_t outputBytes;       // The size of %Q.
+    uint32_t memoryOffset;      // The offset of %M from the start of the image.
+    uint32_t memoryBytes;       // The size of %M.
+    uint32_t symbolsOffset;     // The offset of the symbol table from the start of the segment.
+    uint32_t symbolCount;       // The number of rows in the symbol table.
+    uint32_t process;           // The process ID of the runtime that publishes the segment.
+    uint32_t reserved;
+    alignas(64) std::atomic<uint64_t> sequence; // Odd while the runtime is copying an image in.
+    uint64_t generation;        // The number of scans published, read under the sequence like the image.
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "The shared image sequence must be lock free to be shared between processes.");
+
+/**
+ * A row of the symbol table of a shared image, describing one located variable of the program.
+ */
+struct SharedImageSymbol {
+    uint32_t offset;    // The offset of the value from the start of the image, or of the byte holding the bit.
+    uint8_t width;      // The width of the value in bits, or 1 for a bit.
+    int8_t bit;         // The bit within the byte at offset, or -1 if the symbol is not a bit.
+    char space;         // 'I', 'Q' or 'M'.
+    uint8_t reserved;
+    char name[56];      // The name of the variable, null terminated and truncated if it didn't fit.
+};
+
+static_assert(sizeof(SharedImageSymbol) == 64, "Shared image symbols are one line each.");
+
+/**
+ * Makes the OS name of a shared image segment from the name given to --shm-image.
+ * @param name The name of the segment.
+ * @returns Returns the name to open the segment with.
+ */
+inline std::string sharedImageName(const std::string& name){
+#ifdef _WIN32
+    return name.rfind("Local\\", 0) == 0 || name.rfind("Global\\", 0) == 0 ? name : "Local\\" + name;
+#else
+    return !name.empty() && name[0] == '/' ? name : "/" + name;
+#endif
+}
+
+/**
+ * Maps a shared image segment published by a runtime and reads consistent snapshots of it in place.
+ */
+class SharedImageReader {
+public:
+    ~SharedImageReader(){ close(); }
+
+    /**
+     * Opens a shared image segment read only.
+     * @param name The name the runtime was given with --shm-image.
+     * @returns Returns true if the segment was mapped and its layout is one this reader knows.
+     */
+    bool open(const std::string& name){
+        close();
+        std::string os = sharedImageName(name);
+#ifdef _WIN32
+        mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, os.c_str());
+        if(mapping == nullptr){
+            return false;
+        }
+        map = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        MEMORY_BASIC_INFORMATION info;
+        size = map != nullptr && VirtualQuery(map, &info, sizeof(info)) != 0 ? info.RegionSize : 0;
+#else
+        int fd = shm_open(os.c_str(), O_RDONLY, 0);
+        if(fd < 0){
+            return false;
+        }
+        struct stat info;
+        size = fstat(fd, &info) == 0 ? static_cast<size_t>(info.st_size) : 0;
+        void* view = size >= sizeof(SharedImageHeader) ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        map = view == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(view);
+#endif
+        const SharedImageHeader* h = header();
+        if(map == nullptr || size < sizeof(SharedImageHeader) || std::memcmp(h->magic, SHARED_IMAGE_MAGIC, sizeof(SHARED_IMAGE_MAGIC)) != 0 ||
+           h->version != SHARED_IMAGE_VERSION || static_cast<size_t>(h->headerBytes) + h->imageBytes > size ||
+           static_cast<size_t>(h->symbolsOffset) + static_cast<size_t>(h->symbolCount) * sizeof(SharedImageSymbol) > size){
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Unmaps the segment.
+     */
+    void close(){
+#ifdef _WIN32
+        if(map != nullptr) UnmapViewOfFile(map);
+        if(mapping != nullptr) CloseHandle(mapping);
+        mapping = nullptr;
+#else
+        if(map != nullptr) munmap(const_cast<uint8_t*>(map), size);
+#endif
+        map = nullptr;
+        size = 0;
+    }
+
+    /**
+     * @returns Returns the header of the segment, or nullptr if it isn't open.
+     */
+    const SharedImageHeader* header() const { return reinterpret_cast<const SharedImageHeader*>(map); }
+
+    /**
+     * @returns Returns the image in the segment. It changes under the reader, so it should only be read in read().
+     */
+    const uint8_t* image() const { return map + header()->headerBytes; }
+
+    /**
+     * Looks up a located variable by name.
+     * @param name The name of the variable.
+     * @returns Returns the symbol of the variable, or nullptr if the program has no such located variable.
+     */
+    const SharedImageSymbol* find(const char* name) const {
+        auto* symbols = reinterpret_cast<const SharedImageSymbol*>(map + header()->symbolsOffset);
+        for(uint32_t x = 0; x < header()->symbolCount; x++){
+            if(std::strncmp(symbols[x].name, name, sizeof(symbols[x].name)) == 0){
+                return &symbols[x];
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * Reads a consistent snapshot of the image in place. The reader is called with the image and is called again if
+     * the runtime published a new image while it ran, so it should only copy out what it needs and have no other
+     * effects. It should not keep the pointer.
+     * @param reader Called with the image when it is consistent.
+     * @param generation Set to the generation of the snapshot read, if not nullptr.
+     * @param tries The most attempts before giving up, for a runtime that stopped in the middle of a copy.
+     * @returns Returns true if a consistent snapshot was read.
+     */
+    template<typename Reader>
+    bool read(Reader&& reader, uint64_t* generation = nullptr, int tries = 1000) const {
+        const SharedImageHeader* h = header();
+        for(int x = 0; x < tries; x++){
+            uint64_t before = h->sequence.load(std::memory_order_acquire);
+            if(before & 1){
+                std::this_thread::yield();
+                continue;
+            }
+            reader(image());
+            uint64_t scans = h->generation;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(h->sequence.load(std::memory_order_relaxed) == before){
+                if(generation != nullptr){
+                    *generation = scans;
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Reads the value of one located variable.
+     * @param symbol The symbol of the variable, from find().
+     * @param value Set to the value. Bits read as 0 or 1.
+     * @returns Returns true if a consistent value was read.
+     */
+    bool value(const SharedImageSymbol& symbol, uint64_t& value) const {
+        return read([&](const uint8_t* image){
+            if(symbol.bit > -1){
+                value = (image[symbol.offset] >> symbol.bit) & 1;
+            }
+            else{
+                value = 0;
+                std::memcpy(&value, image + symbol.offset, symbol.width / 8);
+            }
+        });
+    }
+
+private:
+    const uint8_t* map = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE mapping = nullptr;
+#endif
+};
+
+#endif // SHAREDIMAGE_H
@@ -0,0 +1,201 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Simulated Inputs
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+#include "simulation.h"
+#include "recorder.h"
+#include "nodalis.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+/**
+ * A write of a simulated input, at a time in microseconds since the start of the run.
+ */
+struct SimulatedInput {
+    uint64_t micros = 0;
+    ResolvedAddress address;
+    uint64_t value = 0;
+};
+
+/**
+ * The inputs of the run in order of time, and how many of them have been staged.
+ */
+static std::vector<SimulatedInput> INPUTS;
+static size_t STAGED = 0;
+
+/**
+ * Resolves an address for a simulated input.
+ * @param text The address.
+ * @param address Receives the resolved address.
+ * @returns Returns true if the address is valid.
+ */
+static bool resolveInput(const std::string& text, ResolvedAddress& address) {
+    AddressStatus status = tryResolveAddress(text, -1, text.find('.') != std::string::npos, address);
+    if (status != AddressStatus::OK) {
+        nodalisLog() << "Can't simulate " << text << ": " << addressStatusText(status) << "\n";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Reads the %I channels of a signal recording as simulated inputs, writing each channel when it changes.
+ * @param bytes The contents of the recording.
+ * @returns Returns false if the recording is truncated or has an invalid channel.
+ */
+static bool readRecording(const std::vector<uint8_t>& bytes) {
+    SignalRecordingHeader head;
+    if (bytes.size() < sizeof(head)) {
+        return false;
+    }
+    std::memcpy(&head, bytes.data(), sizeof(head));
+    if (head.version != SIGNAL_RECORDING_VERSION) {
+        nodalisLog() << "Can't simulate a recording of version " << head.version << "\n";
+        return false;
+    }
+    struct Channel {
+        ResolvedAddress address;
+        size_t bytes = 0;
+        bool input = false;
+    };
+    std::vector<Channel> channels(head.channels);
+    size_t at = sizeof(head);
+    uint32_t sampleBytes = 8;
+    for (auto& channel : channels) {
+        if (at + 2 > bytes.size() || at + 2 + bytes[at + 1] > bytes.size()) {
+            return false;
+        }
+        int width = bytes[at];
+        std::string name(reinterpret_cast<const char*>(bytes.data() + at + 2), bytes[at + 1]);
+        at += 2 + bytes[at + 1];
+        if (!resolveInput(name, channel.address)) {
+            return false;
+        }
+        channel.bytes = width == 1 ? 1 : static_cast<size_t>(width / 8);
+        channel.input = channel.address.space == MEMORY_SPACE::I;
+        sampleBytes += static_cast<uint32_t>(channel.bytes);
+    }
+    if (sampleBytes != head.sampleBytes) {
+        return false;
+    }
+    // Outputs and memory are what the program makes of the inputs, so only the inputs are replayed.
+    std::vector<uint64_t> last(channels.size());
+    bool first = true;
+    for (; at + sampleBytes <= bytes.size(); at += sampleBytes) {
+        uint64_t micros = 0;
+        std::memcpy(&micros, bytes.data() + at, 8);
+        size_t offset = at + 8;
+        for (size_t c = 0; c < channels.size(); c++) {
+            uint64_t value = 0;
+            std::memcpy(&value, bytes.data() + offset, channels[c].bytes);
+            offset += channels[c].bytes;
+            if (channels[c].input && (first || value != last[c])) {
+                INPUTS.push_back({ micros, channels[c].address, value });
+            }
+            last[c] = value;
+        }
+        first = false;
+    }
+    return true;
+}
+
+/**
+ * Reads a script of simulated inputs.
+ * @param text The contents of the script.
+ * @returns Returns false, having written which, if a line is invalid.
+ */
+static bool readScript(const std::string& text) {
+    std::istringstream lines(text);
+    std::string line;
+    for (int number = 1; std::getline(lines, line); number++) {
+        std::istringstream fields(line);
+        std::string time, address, value;
+        if (!(fields >> time) || time[0] == '#') {
+            continue;
+        }
+        char* end = nullptr;
+        double millis = std::strtod(time.c_str(), &end);
+        SimulatedInput input;
+        if (*end != '\0' || millis < 0 || !(fields >> address >> value) || !resolveInput(address, input.address)) {
+            nodalisLog() << "Can't simulate line " << number << ": " << line << "\n";
+            return false;
+        }
+        input.micros = static_cast<uint64_t>(millis * 1000.0 + 0.5);
+        if (value.find_first_of(".eE") != std::string::npos && input.address.width >= 32 && input.address.bit < 0) {
+            double real = std::strtod(value.c_str(), &end);
+            if (input.address.width == 32) {
+                float single = static_cast<float>(real);
+                uint32_t raw = 0;
+                std::memcpy(&raw, &single, sizeof(raw));
+                input.value = raw;
+            }
+            else {
+                std::memcpy(&input.value, &real, sizeof(real));
+            }
+        }
+        else {
+            input.value = value[0] == '-' ? static_cast<uint64_t>(std::strtoll(value.c_str(), &end, 0))
+                : std::strtoull(value.c_str(), &end, 0);
+        }
+        if (*end != '\0') {
+            nodalisLog() << "Can't simulate line " << number << ": " << line << "\n";
+            return false;
+        }
+        INPUTS.push_back(input);
+    }
+    return true;
+}
+
+bool openSimulation(const RuntimeOptions& options) {
+    if (options.simulateInput.empty()) {
+        return true;
+    }
+    std::ifstream file(options.simulateInput, std::ios::binary);
+    if (!file) {
+        nodalisLog() << "Can't read the simulated inputs from " << options.simulateInput << "\n";
+        return false;
+    }
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    uint32_t magic = 0;
+    if (bytes.size() >= sizeof(magic)) {
+        std::memcpy(&magic, bytes.data(), sizeof(magic));
+    }
+    bool read = magic == SIGNAL_RECORDING_MAGIC ? readRecording(bytes)
+        : readScript(std::string(bytes.begin(), bytes.end()));
+    if (!read) {
+        nodalisLog() << "Can't simulate the inputs of " << options.simulateInput << "\n";
+        return false;
+    }
+    std::stable_sort(INPUTS.begin(), INPUTS.end(),
+        [](const SimulatedInput& a, const SimulatedInput& b) { return a.micros < b.micros; });
+    nodalisLog() << "Simulating " << INPUTS.size() << " input writes from " << options.simulateInput << "\n";
+    return true;
+}
+
+uint64_t nextSimulatedInput() {
+    return STAGED < INPUTS.size() ? INPUTS[STAGED].micros : UINT64_MAX;
+}
+
+void applySimulatedInputs(uint64_t micros) {
+    for (; STAGED < INPUTS.size() && INPUTS[STAGED].micros <= micros; STAGED++) {
+        writeImage(INPUTS[STAGED].address, INPUTS[STAGED].value);
+    }
+}
@@ -0,0 +1,58 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Simulated Inputs
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * Serves the inputs of a simulated run (--simulate), in which the tasks run against a virtual clock instead of the
+ * field. The inputs are read up front from --sim-input, which is either a signal recording made with --record or a
+ * script, and are staged into the image as the virtual clock reaches them, so a run sees the same inputs at the same
+ * scans every time.
+ *
+ * A recording is replayed from its %I channels: each sample writes the channels that changed since the one before, at
+ * the time it was recorded. A script has a line for each write, of the time in milliseconds since the start of the
+ * run, the address and the value, like "250 %IX0.1 1". A value with a decimal point or an exponent is written as a
+ * REAL to a double word address and as an LREAL to a long word one. Empty lines and lines that start with # are
+ * skipped. Writes to the same time are staged in the order they appear.
+ */
+#pragma once
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <cstdint>
+
+struct RuntimeOptions;
+
+/**
+ * Reads the inputs of a simulated run from options.simulateInput, if it names a file. Called by
+ * TaskScheduler::runSimulation() before the first scan.
+ * @param options The runtime options.
+ * @returns Returns false, having written why, if the file can't be read or has an invalid line or address.
+ */
+bool openSimulation(const RuntimeOptions& options);
+/**
+ * Gets the time of the next simulated input that hasn't been staged yet.
+ * @returns Returns the time in microseconds since the start of the run, or UINT64_MAX when there are no more inputs.
+ */
+uint64_t nextSimulatedInput();
+/**
+ * Stages the simulated inputs that are due by a time, so that the next latchInputs() applies them.
+ * @param micros The virtual time, in microseconds since the start of the run.
+ */
+void applySimulatedInputs(uint64_t micros);
+
+#endif // SIMULATION_H
@@ -0,0 +1,940 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Sparkplug B Publisher
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+#include "sparkplug.h"
+#include "nodalis.h"
+#include "ioreactor.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <thread>
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #pragma comment(lib, "ws2_32.lib")
+#else
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <netdb.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+#endif
+
+/**
+ * The number of changes the ring between the scan and the publisher holds. A change made while it is full is
+ * appended with the next scan, since the tag still differs from the value it was last appended with.
+ */
+static constexpr uint64_t SPARKPLUG_CHANGE_RING = 65536;
+/**
+ * The most bytes that may wait to be sent before batches are kept for later instead, so a slow link doesn't grow
+ * the send buffer without bound.
+ */
+static constexpr size_t MQTT_MAX_BACKLOG = 262144;
+/**
+ * How long to wait before connecting again after a connection failed or was lost, in milliseconds.
+ */
+static constexpr int MQTT_RETRY_WAIT = 5000;
+/**
+ * How long a connection may take to be accepted by the broker, in milliseconds.
+ */
+static constexpr int MQTT_CONNECT_TIMEOUT = 10000;
+/**
+ * The longest packet that is read from the broker. The publisher only subscribes to its own commands.
+ */
+static constexpr size_t MQTT_MAX_PACKET = 65536;
+
+/**
+ * The MQTT control packet types.
+ */
+enum MqttPacket : uint8_t {
+    MQTT_CONNECT = 1,
+    MQTT_CONNACK = 2,
+    MQTT_PUBLISH = 3,
+    MQTT_PUBACK = 4,
+    MQTT_SUBSCRIBE = 8,
+    MQTT_SUBACK = 9,
+    MQTT_PINGREQ = 12,
+    MQTT_PINGRESP = 13,
+    MQTT_DISCONNECT = 14,
+};
+
+static void closeSocket(int fd) {
+#ifdef _WIN32
+    closesocket(fd);
+#else
+    close(fd);
+#endif
+}
+
+static bool setNonBlocking(int fd) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(fd, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+#pragma region "Encoding"
+/**
+ * Appends a protobuf varint.
+ */
+static void putVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+/**
+ * Appends the key of a protobuf field.
+ * @param field The number of the field.
+ * @param wire The wire type: 0 for a varint, 1 for 64 bits, 2 for a length and bytes, and 5 for 32 bits.
+ */
+static void putKey(std::string& out, uint32_t field, uint32_t wire) {
+    putVarint(out, (static_cast<uint64_t>(field) << 3) | wire);
+}
+
+static void putVarintField(std::string& out, uint32_t field, uint64_t value) {
+    putKey(out, field, 0);
+    putVarint(out, value);
+}
+
+static void putBytesField(std::string& out, uint32_t field, const char* data, size_t length) {
+    putKey(out, field, 2);
+    putVarint(out, length);
+    out.append(data, length);
+}
+
+static void putFixedField(std::string& out, uint32_t field, uint64_t value, size_t bytes) {
+    putKey(out, field, bytes == 4 ? 5 : 1);
+    for (size_t b = 0; b < bytes; b++) {
+        out.push_back(static_cast<char>((value >> (b * 8)) & 0xFF));
+    }
+}
+
+/**
+ * Appends the value of a metric, in the field of its datatype. Values are the bits of the image, zero extended.
+ */
+static void putMetricValue(std::string& out, SparkplugType type, uint64_t value) {
+    switch (type) {
+        case SparkplugType::Int8: putVarintField(out, 10, static_cast<uint32_t>(static_cast<int32_t>(static_cast<int8_t>(value)))); break;
+        case SparkplugType::Int16: putVarintField(out, 10, static_cast<uint32_t>(static_cast<int32_t>(static_cast<int16_t>(value)))); break;
+        case SparkplugType::Int32:
+        case SparkplugType::UInt8:
+        case SparkplugType::UInt16:
+        case SparkplugType::UInt32: putVarintField(out, 10, static_cast<uint32_t>(value)); break;
+        case SparkplugType::Int64:
+        case SparkplugType::UInt64: putVarintField(out, 11, value); break;
+        case SparkplugType::Float: putFixedField(out, 12, value, 4); break;
+        case SparkplugType::Double: putFixedField(out, 13, value, 8); break;
+        case SparkplugType::Boolean: putVarintField(out, 14, value != 0 ? 1 : 0); break;
+    }
+}
+
+/**
+ * Appends an MQTT remaining length.
+ */
+static void putMqttLength(std::string& out, size_t length) {
+    do {
+        uint8_t digit = static_cast<uint8_t>(length & 0x7F);
+        length >>= 7;
+        out.push_back(static_cast<char>(length > 0 ? digit | 0x80 : digit));
+    } while (length > 0);
+}
+
+/**
+ * Appends an MQTT string, after its length.
+ */
+static void putMqttString(std::string& out, const std::string& text) {
+    out.push_back(static_cast<char>((text.size() >> 8) & 0xFF));
+    out.push_back(static_cast<char>(text.size() & 0xFF));
+    out += text;
+}
+
+/**
+ * Reads a protobuf varint.
+ * @returns Returns false if the data ends first.
+ */
+static bool takeVarint(const uint8_t*& data, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; data < end && shift < 64; shift += 7) {
+        uint8_t byte = *data++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Calls a visitor with each field of a protobuf message: its number, wire type, value for varints and fixed
+ * fields, and bytes for length delimited fields.
+ * @returns Returns false if the message is malformed.
+ */
+template<typename Visitor>
+static bool forEachField(const uint8_t* data, size_t length, Visitor&& visitor) {
+    const uint8_t* end = data + length;
+    while (data < end) {
+        uint64_t key, value = 0;
+        if (!takeVarint(data, end, key)) return false;
+        uint32_t wire = static_cast<uint32_t>(key & 7);
+        const uint8_t* bytes = nullptr;
+        if (wire == 0) {
+            if (!takeVarint(data, end, value)) return false;
+        }
+        else if (wire == 1 || wire == 5) {
+            size_t size = wire == 1 ? 8 : 4;
+            if (static_cast<size_t>(end - data) < size) return false;
+            for (size_t b = 0; b < size; b++) value |= static_cast<uint64_t>(data[b]) << (b * 8);
+            data += size;
+        }
+        else if (wire == 2) {
+            if (!takeVarint(data, end, value) || value > static_cast<uint64_t>(end - data)) return false;
+            bytes = data;
+            data += value;
+        }
+        else {
+            return false;
+        }
+        visitor(static_cast<uint32_t>(key >> 3), wire, value, bytes);
+    }
+    return true;
+}
+
+/**
+ * Checks whether a command payload asks the node for a rebirth, with a Node Control/Rebirth metric set to true.
+ */
+static bool asksForRebirth(const uint8_t* payload, size_t length) {
+    static const std::string REBIRTH = "Node Control/Rebirth";
+    bool rebirth = false;
+    forEachField(payload, length, [&](uint32_t field, uint32_t wire, uint64_t size, const uint8_t* metric) {
+        if (field != 2 || wire != 2) return;
+        bool named = false, set = false;
+        forEachField(metric, static_cast<size_t>(size), [&](uint32_t f, uint32_t w, uint64_t value, const uint8_t* bytes) {
+            if (f == 1 && w == 2) named = REBIRTH.compare(0, std::string::npos, reinterpret_cast<const char*>(bytes), static_cast<size_t>(value)) == 0;
+            else if (f == 14 && w == 0) set = value != 0;
+        });
+        rebirth = rebirth || (named && set);
+    });
+    return rebirth;
+}
+#pragma endregion
+
+/**
+ * A tag that is published as a metric.
+ */
+struct SparkplugTag {
+    std::string name;               // The name of the located global, or the address.
+    std::string address;
+    ResolvedAddress resolved;
+    SparkplugType type;
+    uint64_t last = 0;              // The value last appended by the scan thread.
+    bool recorded = false;          // Whether the scan thread has appended a value yet.
+};
+
+/**
+ * A change of a tag, as appended by the scan thread and kept in a batch.
+ */
+struct SparkplugChange {
+    uint64_t micros;
+    uint64_t value;
+    uint32_t tag;
+};
+
+/**
+ * Gets the datatype of a tag, from its declared type or else from the width of its address.
+ */
+static SparkplugType tagType(const std::string& name, const ResolvedAddress& resolved) {
+    static const std::pair<const char*, SparkplugType> TYPES[] = {
+        { "BOOL", SparkplugType::Boolean }, { "SINT", SparkplugType::Int8 }, { "INT", SparkplugType::Int16 },
+        { "DINT", SparkplugType::Int32 }, { "LINT", SparkplugType::Int64 }, { "USINT", SparkplugType::UInt8 },
+        { "BYTE", SparkplugType::UInt8 }, { "UINT", SparkplugType::UInt16 }, { "WORD", SparkplugType::UInt16 },
+        { "UDINT", SparkplugType::UInt32 }, { "DWORD", SparkplugType::UInt32 }, { "ULINT", SparkplugType::UInt64 },
+        { "LWORD", SparkplugType::UInt64 }, { "REAL", SparkplugType::Float }, { "LREAL", SparkplugType::Double },
+    };
+    static const int WIDTHS[] = { 1, 8, 16, 32, 64, 8, 8, 16, 16, 32, 32, 64, 64, 32, 64 };
+    int width = resolved.bit > -1 ? 1 : resolved.width;
+    if (const char* declared = findSymbolType(name)) {
+        std::string type = declared;
+        std::transform(type.begin(), type.end(), type.begin(), [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+        for (size_t t = 0; t < sizeof(TYPES) / sizeof(TYPES[0]); t++) {
+            if (type == TYPES[t].first && WIDTHS[t] == width) {
+                return TYPES[t].second;
+            }
+        }
+    }
+    switch (width) {
+        case 1: return SparkplugType::Boolean;
+        case 8: return SparkplugType::UInt8;
+        case 16: return SparkplugType::UInt16;
+        case 32: return SparkplugType::UInt32;
+        default: return SparkplugType::UInt64;
+    }
+}
+
+class SparkplugPublisher {
+public:
+    bool start(const RuntimeOptions& options);
+    void record(uint64_t micros) {
+        const uint8_t* image = reinterpret_cast<const uint8_t*>(MEMORY);
+        for (size_t t = 0; t < tags.size(); t++) {
+            SparkplugTag& tag = tags[t];
+            uint64_t value = tag.resolved.load(image);
+            if (tag.recorded && value == tag.last) {
+                continue;
+            }
+            uint64_t slot = head.load(std::memory_order_relaxed);
+            if (slot - tail.load(std::memory_order_acquire) >= SPARKPLUG_CHANGE_RING) {
+                continue;
+            }
+            ring[slot & (SPARKPLUG_CHANGE_RING - 1)] = SparkplugChange{ micros, value, static_cast<uint32_t>(t) };
+            head.store(slot + 1, std::memory_order_release);
+            tag.last = value;
+            tag.recorded = true;
+        }
+    }
+    void stop();
+
+    std::atomic<bool> running{false};
+
+private:
+    enum class State { Disconnected, Connecting, Connected, Online };
+
+    std::vector<SparkplugTag> tags;
+    std::vector<SparkplugChange> ring;
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+
+    // The rest belongs to the reactor thread.
+    std::unique_ptr<IOReactor> reactor;
+    std::string host;
+    std::string port;
+    std::string clientId;
+    std::string user;
+    std::string password;
+    int keepAlive = 30;
+    uint64_t interval = 1000;
+    std::string nodeTopic;          // spBv1.0/<group>/<type>/<node>, with %s for the type.
+    std::string deviceTopic;        // spBv1.0/<group>/<type>/<node>/<device>, with %s for the type.
+    std::string commandTopic;
+    /**
+     * The wall clock time the runtime started at, in microseconds since the Unix epoch, which scan times are added to.
+     */
+    int64_t epoch = 0;
+    State state = State::Disconnected;
+    int fd = -1;
+    bool watching = false;
+    std::string sending;            // The bytes waiting to be sent, from the start of the send that is outstanding.
+    bool sendPending = false;
+    std::string received;
+    uint64_t bdSeq = 0;             // The birth and death sequence of the next connection.
+    uint64_t sessionBdSeq = 0;      // The birth and death sequence of this connection.
+    uint64_t seq = 0;               // The sequence number of the next message of the session.
+    uint64_t connectTimer = 0;
+    uint64_t pingTimer = 0;
+    IOReactor::Clock::time_point lastReceived;
+    std::vector<uint64_t> pendingValues;        // The last value of each tag taken from the ring.
+    std::vector<uint64_t> pendingTimes;         // The time of the last change of each tag taken from the ring.
+    std::vector<bool> pendingChanged;           // Whether each tag changed since the last batch.
+    std::vector<SparkplugChange> batch;
+    std::vector<std::vector<SparkplugChange>> stored;   // The batches kept while they can't be sent, as a ring.
+    size_t storedFirst = 0;
+    size_t storedCount = 0;
+    uint64_t droppedBatches = 0;
+    std::string payload;            // The payload being built, kept for its capacity.
+    std::string metric;             // The metric being built, kept for its capacity.
+
+    void connect();
+    void finishConnect();
+    void scheduleReconnect();
+    void closeConnection(const char* reason);
+    void startReceive();
+    void onReceived(const uint8_t* data, int result);
+    void takePackets();
+    void schedulePing();
+    /**
+     * Publishes the NBIRTH of the node and the DBIRTH of the device, then the batches that were kept.
+     */
+    void birth();
+    /**
+     * Takes the changes from the ring and publishes or keeps a batch of the tags that changed.
+     */
+    void publishChanges();
+    /**
+     * Sends the batches that were kept, oldest first, as historical data, until the link is busy.
+     */
+    void forwardStored();
+    void store(std::vector<SparkplugChange>& changes);
+    void takeChanges();
+    void publishBatch(const std::vector<SparkplugChange>& changes, bool historical);
+    /**
+     * Appends a metric to the payload being built.
+     * @param name The name of the metric, or nullptr to identify it by its alias alone.
+     * @param alias The alias of the metric, which is the index of its tag, or -1 for a metric of the node.
+     * @param datatype Whether to include the datatype, which only births do.
+     */
+    void putMetric(const char* name, int64_t alias, uint64_t millis, SparkplugType type, uint64_t value, bool historical, bool datatype);
+    void startPayload(uint64_t millis, bool withSeq);
+    void publish(const std::string& topic, const std::string& data);
+    std::string topic(const std::string& pattern, const char* type) const;
+    uint64_t nowMillis() const;
+    void flushSend();
+};
+
+static SparkplugPublisher SPARKPLUG;
+
+bool SparkplugPublisher::start(const RuntimeOptions& options) {
+    size_t symbolCount = 0;
+    const ImageSymbol* symbols = registeredImageSymbols(symbolCount);
+    std::string list = options.mqttTags;
+    size_t from = 0;
+    while (from <= list.size()) {
+        size_t comma = list.find(',', from);
+        std::string name = list.substr(from, comma == std::string::npos ? std::string::npos : comma - from);
+        from = comma == std::string::npos ? list.size() + 1 : comma + 1;
+        name.erase(0, name.find_first_not_of(' '));
+        name.erase(name.find_last_not_of(' ') + 1);
+        if (name.empty()) {
+            continue;
+        }
+        // A tag is a located global by name, or an address, which takes the name of the global located at it.
+        std::string address = name;
+        if (const char* located = findSymbolAddress(name)) {
+            address = located;
+        }
+        else {
+            for (size_t s = 0; s < symbolCount; s++) {
+                if (name == symbols[s].address) {
+                    name = symbols[s].name;
+                }
+            }
+        }
+        SparkplugTag tag;
+        AddressStatus status = tryResolveAddress(address, -1, address.find('.') != std::string::npos, tag.resolved);
+        if (status != AddressStatus::OK) {
+            nodalisLog() << "Can't publish " << name << ": " << addressStatusText(status) << "\n";
+            continue;
+        }
+        tag.name = name;
+        tag.address = address;
+        tag.type = tagType(name, tag.resolved);
+        tags.push_back(std::move(tag));
+    }
+    if (tags.empty()) {
+        nodalisLog() << "Not publishing to " << options.mqtt << ", since --mqtt-tags names no tags\n";
+        return false;
+    }
+
+    std::string broker = options.mqtt;
+    size_t scheme = broker.find("://");
+    if (scheme != std::string::npos) {
+        broker.erase(0, scheme + 3);
+    }
+    size_t colon = broker.rfind(':');
+    host = colon == std::string::npos ? broker : broker.substr(0, colon);
+    port = colon == std::string::npos ? "1883" : broker.substr(colon + 1);
+    user = options.mqttUser;
+    password = options.mqttPassword;
+    keepAlive = std::max(options.mqttKeepAlive, 5);
+    interval = std::max<uint64_t>(options.mqttInterval, 1);
+    clientId = "nodalis-" + options.sparkplugGroup + "-" + options.sparkplugNode;
+    nodeTopic = "spBv1.0/" + options.sparkplugGroup + "/%s/" + options.sparkplugNode;
+    deviceTopic = nodeTopic + "/" + options.sparkplugDevice;
+    commandTopic = topic(nodeTopic, "NCMD");
+    epoch = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count()
+        - std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - PROGRAM_START).count();
+
+    ring.resize(SPARKPLUG_CHANGE_RING);
+    pendingValues.assign(tags.size(), 0);
+    pendingTimes.assign(tags.size(), 0);
+    pendingChanged.assign(tags.size(), false);
+    batch.reserve(tags.size());
+    stored.resize(std::max<uint64_t>(options.mqttBuffer, 1));
+
+#ifdef _WIN32
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2,2), &wsa);
+#endif
+    reactor = std::make_unique<IOReactor>("SPARKPLUG", options.ioBackend);
+    reactor->start();
+    running = true;
+    reactor->post([this]() {
+        connect();
+        reactor->schedule(IOReactor::Clock::now() + std::chrono::milliseconds(interval), [this]() { publishChanges(); });
+    });
+    nodalisLog() << "Publishing " << tags.size() << " tags to " << host << ":" << port << " as " << topic(deviceTopic, "DDATA") << "\n";
+    return true;
+}
+
+std::string SparkplugPublisher::topic(const std::string& pattern, const char* type) const {
+    std::string text = pattern;
+    size_t at = text.find("%s");
+    return text.replace(at, 2, type);
+}
+
+uint64_t SparkplugPublisher::nowMillis() const {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+void SparkplugPublisher::connect() {
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* found = nullptr;
+    // The name is resolved on the publisher's own reactor, so a slow lookup only holds up the publisher.
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0 || found == nullptr) {
+        nodalisError() << "MQTT can't resolve " << host << "\n";
+        scheduleReconnect();
+        return;
+    }
+    fd = static_cast<int>(socket(found->ai_family, found->ai_socktype, found->ai_protocol));
+    if (fd < 0 || !setNonBlocking(fd)) {
+        freeaddrinfo(found);
+        closeConnection("socket failed");
+        return;
+    }
+    int result = ::connect(fd, found->ai_addr, static_cast<socklen_t>(found->ai_addrlen));
+    freeaddrinfo(found);
+#ifdef _WIN32
+    bool pending = result < 0 && WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    bool pending = result < 0 && errno == EINPROGRESS;
+#endif
+    if (result < 0 && !pending) {
+        closeConnection("connect failed");
+        return;
+    }
+    state = State::Connecting;
+    connectTimer = reactor->schedule(IOReactor::Clock::now() + std::chrono::milliseconds(MQTT_CONNECT_TIMEOUT), [this]() {
+        connectTimer = 0;
+        closeConnection("the connection timed out");
+    });
+    if (!pending) {
+        finishConnect();
+        return;
+    }
+    watching = reactor->watch(fd, EVENT_WRITABLE, [this](uint32_t) { finishConnect(); });
+}
+
+void SparkplugPublisher::finishConnect() {
+    if (watching) {
+        reactor->unwatch(fd);
+        watching = false;
+    }
+    int soError = 0;
+    socklen_t length = sizeof(soError);
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&soError), &length) < 0 || soError != 0) {
+        closeConnection("connect failed");
+        return;
+    }
+    int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+    state = State::Connected;
+    lastReceived = IOReactor::Clock::now();
+
+    // The will of the connection is the death certificate of the node, with the bdSeq its birth will carry.
+    sessionBdSeq = bdSeq;
+    bdSeq = (bdSeq + 1) % 256;
+    startPayload(nowMillis(), false);
+    putMetric("bdSeq", -1, nowMillis(), SparkplugType::UInt64, sessionBdSeq, false, true);
+    std::string body;
+    putMqttString(body, "MQTT");
+    body.push_back(4);
+    uint8_t flags = 0x02 | 0x04 | 0x08;     // A clean session, and a will with a QoS of 1.
+    if (!user.empty()) flags |= 0x80;
+    if (!password.empty()) flags |= 0x40;
+    body.push_back(static_cast<char>(flags));
+    body.push_back(static_cast<char>((keepAlive >> 8) & 0xFF));
+    body.push_back(static_cast<char>(keepAlive & 0xFF));
+    putMqttString(body, clientId);
+    putMqttString(body, topic(nodeTopic, "NDEATH"));
+    putMqttString(body, payload);
+    if (!user.empty()) putMqttString(body, user);
+    if (!password.empty()) putMqttString(body, password);
+    sending.push_back(static_cast<char>(MQTT_CONNECT << 4));
+    putMqttLength(sending, body.size());
+    sending += body;
+    flushSend();
+    startReceive();
+}
+
+void SparkplugPublisher::scheduleReconnect() {
+    reactor->schedule(IOReactor::Clock::now() + std::chrono::milliseconds(MQTT_RETRY_WAIT), [this]() {
+        if (running && state == State::Disconnected) {
+            connect();
+        }
+    });
+}
+
+void SparkplugPublisher::closeConnection(const char* reason) {
+    if (fd >= 0) {
+        if (!running) {
+            // The runtime is stopping, which isn't worth a message.
+        }
+        else if (state == State::Online) {
+            nodalisError() << "MQTT connection to " << host << ":" << port << " lost: " << reason << "\n";
+        }
+        else {
+            nodalisError() << "MQTT can't connect to " << host << ":" << port << ": " << reason << "\n";
+        }
+        if (watching) {
+            reactor->unwatch(fd);
+            watching = false;
+        }
+        reactor->cancelIO(fd);
+        closeSocket(fd);
+        fd = -1;
+    }
+    if (connectTimer != 0) {
+        reactor->cancel(connectTimer);
+        connectTimer = 0;
+    }
+    if (pingTimer != 0) {
+        reactor->cancel(pingTimer);
+        pingTimer = 0;
+    }
+    state = State::Disconnected;
+    sending.clear();
+    sendPending = false;
+    received.clear();
+    if (running) {
+        scheduleReconnect();
+    }
+}
+
+void SparkplugPublisher::startReceive() {
+    if (!reactor->submitReceive(fd, [this](const uint8_t* data, int result) { onReceived(data, result); })) {
+        reactor->post([this]() { closeConnection("no receive buffer is free"); });
+    }
+}
+
+void SparkplugPublisher::onReceived(const uint8_t* data, int result) {
+    if (result <= 0) {
+        closeConnection(result == 0 ? "the broker closed the connection" : "receive failed");
+        return;
+    }
+    lastReceived = IOReactor::Clock::now();
+    received.append(reinterpret_cast<const char*>(data), static_cast<size_t>(result));
+    takePackets();
+    if (fd >= 0) {
+        startReceive();
+    }
+}
+
+void SparkplugPublisher::takePackets() {
+    while (fd >= 0 && received.size() >= 2) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(received.data());
+        size_t length = 0;
+        size_t header = 1;
+        bool complete = false;
+        for (int shift = 0; header < received.size() && shift <= 21; shift += 7) {
+            uint8_t digit = bytes[header++];
+            length |= static_cast<size_t>(digit & 0x7F) << shift;
+            if ((digit & 0x80) == 0) {
+                complete = true;
+                break;
+            }
+        }
+        if (!complete || length > MQTT_MAX_PACKET) {
+            if (header > 4 || length > MQTT_MAX_PACKET) closeConnection("the broker sent a malformed packet");
+            return;
+        }
+        if (received.size() < header + length) {
+            return;
+        }
+        uint8_t type = bytes[0] >> 4;
+        const uint8_t* body = bytes + header;
+        if (type == MQTT_CONNACK) {
+            if (length < 2 || body[1] != 0) {
+                received.clear();
+                closeConnection(length < 2 ? "the broker sent a malformed CONNACK" : "the broker refused the connection");
+                return;
+            }
+            if (connectTimer != 0) {
+                reactor->cancel(connectTimer);
+                connectTimer = 0;
+            }
+            birth();
+        }
+        else if (type == MQTT_PUBLISH && length >= 2) {
+            size_t topicLength = (static_cast<size_t>(body[0]) << 8) | body[1];
+            size_t offset = 2 + topicLength + (((bytes[0] >> 1) & 3) != 0 ? 2 : 0);
+            if (offset <= length) {
+                std::string name(reinterpret_cast<const char*>(body) + 2, std::min(topicLength, length - 2));
+                if (((bytes[0] >> 1) & 3) == 1) {
+                    // A command sent with a QoS of 1 is acknowledged.
+                    sending.push_back(static_cast<char>(MQTT_PUBACK << 4));
+                    sending.push_back(2);
+                    sending.append(reinterpret_cast<const char*>(body) + 2 + topicLength, 2);
+                    flushSend();
+                }
+                if (name == commandTopic && state == State::Online && asksForRebirth(body + offset, length - offset)) {
+                    nodalisLog() << "MQTT rebirth requested\n";
+                    birth();
+                }
+            }
+        }
+        if (fd < 0) {
+            return;
+        }
+        received.erase(0, header + length);
+    }
+}
+
+void SparkplugPublisher::schedulePing() {
+    pingTimer = reactor->schedule(IOReactor::Clock::now() + std::chrono::milliseconds(keepAlive * 500), [this]() {
+        pingTimer = 0;
+        if (IOReactor::Clock::now() - lastReceived > std::chrono::milliseconds(keepAlive * 1500)) {
+            closeConnection("the broker stopped answering");
+            return;
+        }
+        sending.push_back(static_cast<char>(MQTT_PINGREQ << 4));
+        sending.push_back(0);
+        flushSend();
+        schedulePing();
+    });
+}
+
+void SparkplugPublisher::birth() {
+    bool reborn = state == State::Online;
+    state = State::Online;
+    if (!reborn) {
+        nodalisLog() << "MQTT connected to " << host << ":" << port << "\n";
+        std::string body;
+        body.push_back(0);
+        body.push_back(1);
+        putMqttString(body, commandTopic);
+        body.push_back(1);
+        sending.push_back(static_cast<char>((MQTT_SUBSCRIBE << 4) | 0x02));
+        putMqttLength(sending, body.size());
+        sending += body;
+        schedulePing();
+    }
+    // The births hold the values as of now, so the changes before them are taken and not sent again.
+    takeChanges();
+    std::fill(pendingChanged.begin(), pendingChanged.end(), false);
+    seq = 0;
+    uint64_t millis = nowMillis();
+    startPayload(millis, true);
+    putMetric("bdSeq", -1, millis, SparkplugType::UInt64, sessionBdSeq, false, true);
+    putMetric("Node Control/Rebirth", -1, millis, SparkplugType::Boolean, 0, false, true);
+    publish(topic(nodeTopic, "NBIRTH"), payload);
+
+    startPayload(millis, true);
+    readImage([&](const uint8_t* image) {
+        for (size_t t = 0; t < tags.size(); t++) {
+            putMetric(tags[t].name.c_str(), static_cast<int64_t>(t), millis, tags[t].type, tags[t].resolved.load(image), false, true);
+        }
+    });
+    publish(topic(deviceTopic, "DBIRTH"), payload);
+    forwardStored();
+}
+
+void SparkplugPublisher::takeChanges() {
+    uint64_t from = tail.load(std::memory_order_relaxed);
+    uint64_t to = head.load(std::memory_order_acquire);
+    for (uint64_t slot = from; slot < to; slot++) {
+        const SparkplugChange& change = ring[slot & (SPARKPLUG_CHANGE_RING - 1)];
+        pendingValues[change.tag] = change.value;
+        pendingTimes[change.tag] = change.micros;
+        pendingChanged[change.tag] = true;
+    }
+    tail.store(to, std::memory_order_release);
+}
+
+void SparkplugPublisher::publishChanges() {
+    takeChanges();
+    batch.clear();
+    for (size_t t = 0; t < tags.size(); t++) {
+        if (pendingChanged[t]) {
+            batch.push_back(SparkplugChange{ pendingTimes[t], pendingValues[t], static_cast<uint32_t>(t) });
+            pendingChanged[t] = false;
+        }
+    }
+    if (state == State::Online) {
+        forwardStored();
+    }
+    if (!batch.empty()) {
+        // Batches are sent in order, so a batch waits behind those that were kept.
+        if (state == State::Online && storedCount == 0 && sending.size() < MQTT_MAX_BACKLOG) {
+            publishBatch(batch, false);
+        }
+        else {
+            store(batch);
+        }
+    }
+    if (running) {
+        reactor->schedule(IOReactor::Clock::now() + std::chrono::milliseconds(interval), [this]() { publishChanges(); });
+    }
+}
+
+void SparkplugPublisher::store(std::vector<SparkplugChange>& changes) {
+    if (storedCount == stored.size()) {
+        storedFirst = (storedFirst + 1) % stored.size();
+        storedCount--;
+        if (droppedBatches++ % 100 == 0) {
+            nodalisError() << "MQTT dropped the oldest kept batch, since " << stored.size() << " are kept\n";
+        }
+    }
+    std::vector<SparkplugChange>& slot = stored[(storedFirst + storedCount) % stored.size()];
+    slot.swap(changes);
+    changes.clear();
+    storedCount++;
+}
+
+void SparkplugPublisher::forwardStored() {
+    while (storedCount > 0 && sending.size() < MQTT_MAX_BACKLOG) {
+        publishBatch(stored[storedFirst], true);
+        stored[storedFirst].clear();
+        storedFirst = (storedFirst + 1) % stored.size();
+        storedCount--;
+    }
+}
+
+void SparkplugPublisher::publishBatch(const std::vector<SparkplugChange>& changes, bool historical) {
+    startPayload(nowMillis(), true);
+    for (const auto& change : changes) {
+        uint64_t millis = static_cast<uint64_t>(epoch + static_cast<int64_t>(change.micros)) / 1000;
+        putMetric(nullptr, static_cast<int64_t>(change.tag), millis, tags[change.tag].type, change.value, historical, false);
+    }
+    publish(topic(deviceTopic, "DDATA"), payload);
+}
+
+void SparkplugPublisher::startPayload(uint64_t millis, bool withSeq) {
+    payload.clear();
+    putVarintField(payload, 1, millis);
+    if (withSeq) {
+        putVarintField(payload, 3, seq);
+        seq = (seq + 1) % 256;
+    }
+}
+
+void SparkplugPublisher::putMetric(const char* name, int64_t alias, uint64_t millis, SparkplugType type, uint64_t value,
+                                   bool historical, bool datatype) {
+    metric.clear();
+    if (name != nullptr) {
+        putBytesField(metric, 1, name, std::strlen(name));
+    }
+    if (alias >= 0) {
+        putVarintField(metric, 2, static_cast<uint64_t>(alias));
+    }
+    putVarintField(metric, 3, millis);
+    if (datatype) {
+        putVarintField(metric, 4, static_cast<uint64_t>(type));
+    }
+    if (historical) {
+        putVarintField(metric, 5, 1);
+    }
+    putMetricValue(metric, type, value);
+    putBytesField(payload, 2, metric.data(), metric.size());
+}
+
+void SparkplugPublisher::publish(const std::string& name, const std::string& data) {
+    sending.push_back(static_cast<char>(MQTT_PUBLISH << 4));
+    putMqttLength(sending, 2 + name.size() + data.size());
+    putMqttString(sending, name);
+    sending += data;
+    flushSend();
+}
+
+void SparkplugPublisher::flushSend() {
+    if (sendPending || sending.empty() || fd < 0 || state == State::Connecting) {
+        return;
+    }
+    size_t taken = reactor->submitSend(fd, reinterpret_cast<const uint8_t*>(sending.data()), sending.size(),
+        [this](const uint8_t*, int result) {
+            sendPending = false;
+            if (result <= 0) {
+                closeConnection("send failed");
+                return;
+            }
+            sending.erase(0, static_cast<size_t>(result));
+            flushSend();
+        });
+    if (taken == 0) {
+        // The connection is closed once the caller, which may still be using it, has returned.
+        reactor->post([this]() { closeConnection("no send buffer is free"); });
+        return;
+    }
+    sendPending = true;
+}
+
+void SparkplugPublisher::stop() {
+    if (!reactor) return;
+    reactor->runSync([this]() {
+        running = false;
+        if (state != State::Online) {
+            return;
+        }
+        // The last changes are published, then the node's death, since the broker only sends the will of a
+        // connection that is lost.
+        takeChanges();
+        batch.clear();
+        for (size_t t = 0; t < tags.size(); t++) {
+            if (pendingChanged[t]) {
+                batch.push_back(SparkplugChange{ pendingTimes[t], pendingValues[t], static_cast<uint32_t>(t) });
+            }
+        }
+        if (!batch.empty()) {
+            publishBatch(batch, false);
+        }
+        startPayload(nowMillis(), false);
+        putMetric("bdSeq", -1, nowMillis(), SparkplugType::UInt64, sessionBdSeq, false, true);
+        publish(topic(nodeTopic, "NDEATH"), payload);
+        sending.push_back(static_cast<char>(MQTT_DISCONNECT << 4));
+        sending.push_back(0);
+        flushSend();
+    });
+    // The reactor sends what is left, for a moment.
+    for (int wait = 0; wait < 50; wait++) {
+        bool sent = true;
+        reactor->runSync([&]() { sent = fd < 0 || (sending.empty() && !sendPending); });
+        if (sent) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    reactor->runSync([this]() { closeConnection("the runtime stopped"); });
+    reactor->stop();
+    reactor.reset();
+}
+
+bool startSparkplug(const RuntimeOptions& options) {
+    if (options.mqtt.empty() || options.benchScans > 0) {
+        return false;
+    }
+    return SPARKPLUG.start(options);
+}
+
+void recordSparkplug(uint64_t micros) {
+    if (SPARKPLUG.running.load(std::memory_order_relaxed)) {
+        SPARKPLUG.record(micros);
+    }
+}
+
+void stopSparkplug() {
+    SPARKPLUG.stop();
+}
@@ -0,0 +1,83 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Sparkplug B Publisher
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * Publishes a set of tags to an MQTT broker as a Sparkplug B edge node (--mqtt <broker>), so cloud integrations
+ * receive changes instead of polling the OPC UA server. A tag is a located global, by name, or an address; the edge
+ * node is --sparkplug-node in the group --sparkplug-group, and the tags are the metrics of its device
+ * --sparkplug-device.
+ *
+ * After each scan, the scan thread compares each tag with the value it last saw and appends the ones that changed to
+ * a ring that was allocated when the publisher started, without a lock, a system call or an allocation. Every
+ * --mqtt-interval, the publisher takes the changes from the ring and publishes the last value of each tag that
+ * changed, with the time of its change, in one DDATA payload, by the metric's alias. A payload is sent over a
+ * non-blocking connection on an IO reactor of its own; while the broker can't be reached, or isn't taking what was
+ * sent, the batches are kept in a ring of --mqtt-buffer batches, the oldest being dropped, and are sent as historical
+ * DDATA once the node has been born again.
+ *
+ * The connection's will is the NDEATH of the node, with its bdSeq. Once connected, the node publishes its NBIRTH and
+ * the DBIRTH of the device, with the name, alias, datatype and value of every tag, and it publishes them again when it
+ * is sent the Node Control/Rebirth command. Payloads are encoded as the Payload message of sparkplug_b.proto, without
+ * a protobuf library.
+ */
+#pragma once
+#ifndef SPARKPLUG_H
+#define SPARKPLUG_H
+
+#include <cstdint>
+
+struct RuntimeOptions;
+
+/**
+ * The Sparkplug B datatypes of metrics.
+ */
+enum class SparkplugType : uint32_t {
+    Int8 = 1,
+    Int16 = 2,
+    Int32 = 3,
+    Int64 = 4,
+    UInt8 = 5,
+    UInt16 = 6,
+    UInt32 = 7,
+    UInt64 = 8,
+    Float = 9,
+    Double = 10,
+    Boolean = 11,
+};
+
+/**
+ * Resolves the tags of options.mqttTags, allocates the rings and starts connecting to options.mqtt. Called by
+ * TaskScheduler::run() before the first scan.
+ * @param options The runtime options.
+ * @returns Returns false, having written why, if there is nothing to publish or it can't be published.
+ */
+bool startSparkplug(const RuntimeOptions& options);
+/**
+ * Appends the tags that changed in the scan that was just committed to the publisher's ring. Called by the scan
+ * thread after each scan, and does nothing if the publisher isn't running.
+ * @param micros The time of the scan, in microseconds since the runtime started.
+ */
+void recordSparkplug(uint64_t micros);
+/**
+ * Publishes the changes that are still in the ring and the NDEATH of the node, and disconnects. Called when the
+ * runtime stops.
+ */
+void stopSparkplug();
+
+#endif // SPARKPLUG_H
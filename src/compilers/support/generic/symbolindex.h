@@ -0,0 +1,280 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Symbol Index
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * The layout of the symbol index the compiler writes beside the executable as <executable>.symbols and embeds in it,
+ * and a reader for it. The index maps the name of each located variable to its type, its location in the process
+ * image and the POU that declares it, through a minimal perfect hash, so a name is found with two hashes and one
+ * comparison. This header only depends on the standard library and the OS, so engineering tools can include it on
+ * its own to map the file.
+ */
+#pragma once
+#ifndef SYMBOLINDEX_H
+#define SYMBOLINDEX_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Identifies a symbol index.
+ */
+static constexpr char SYMBOL_INDEX_MAGIC[8] = { 'N', 'D', 'L', 'S', 'S', 'Y', 'M', '1' };
+
+/**
+ * The version of the index layout. Readers should refuse an index with a version they don't know.
+ */
+static constexpr uint32_t SYMBOL_INDEX_VERSION = 1;
+
+/**
+ * The header at the start of a symbol index. It is followed by the displacement of each bucket (uint32_t), the
+ * entries and the strings. All numbers are little endian.
+ */
+struct SymbolIndexHeader {
+    char magic[8];              // SYMBOL_INDEX_MAGIC.
+    uint32_t version;           // SYMBOL_INDEX_VERSION.
+    uint32_t count;             // The number of entries, which is also the number of slots of the table.
+    uint32_t buckets;           // The number of buckets, each with a displacement.
+    uint32_t entriesOffset;     // The offset of the entries from the start of the index.
+    uint32_t stringsOffset;     // The offset of the strings from the start of the index.
+    uint32_t stringsBytes;      // The size of the strings.
+    uint32_t inputBytes;        // The size of %I the offsets were computed with.
+    uint32_t outputBytes;       // The size of %Q the offsets were computed with.
+    uint32_t memoryBytes;       // The size of %M the offsets were computed with.
+    uint32_t reserved;
+};
+
+static_assert(sizeof(SymbolIndexHeader) == 48, "The symbol index header is 48 bytes.");
+
+/**
+ * An entry of a symbol index, describing one located variable. Names, types, POUs and addresses are offsets into the
+ * strings, which are null terminated. The offset 0 is the empty string.
+ */
+struct SymbolIndexEntry {
+    uint32_t hash;      // The hash of the name with the seed 0, which rejects most other names without a comparison.
+    uint32_t name;      // The name of the variable.
+    uint32_t type;      // The declared type of the variable.
+    uint32_t pou;       // The POU that declares the variable, or the empty string for a global.
+    uint32_t address;   // The located address of the variable, such as %QW0.
+    uint32_t offset;    // The offset of the value from the start of the image, or of the byte holding the bit.
+    uint16_t width;     // The width of the address in bits, or 1 for a bit.
+    int8_t bit;         // The bit within the byte at offset, or -1 if the variable is not a bit.
+    char space;         // 'I', 'Q' or 'M'.
+    uint32_t size;      // The number of bytes the variable covers from offset, all of its elements for an array.
+};
+
+static_assert(sizeof(SymbolIndexEntry) == 32, "Symbol index entries are 32 bytes.");
+
+/**
+ * Hashes a name for the symbol index, with FNV-1a over its bytes in upper case, since names in ST aren't case
+ * sensitive, and a final mix. The compiler builds the index with the same function.
+ * @param seed The seed, 0 for the bucket of a name and the displacement of its bucket for its slot.
+ * @param name The name.
+ * @returns Returns the hash.
+ */
+inline uint32_t symbolHash(uint32_t seed, const char* name){
+    uint32_t h = 2166136261u ^ (seed * 0x9E3779B1u);
+    for(const char* c = name; *c != '\0'; c++){
+        uint8_t byte = static_cast<uint8_t>(*c);
+        if(byte >= 'a' && byte <= 'z'){
+            byte = static_cast<uint8_t>(byte - 'a' + 'A');
+        }
+        h = (h ^ byte) * 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+/**
+ * Reads a symbol index in place, from the file the compiler wrote or from the copy embedded in the program.
+ */
+class SymbolIndexReader {
+public:
+    SymbolIndexReader() = default;
+    SymbolIndexReader(const SymbolIndexReader&) = delete;
+    SymbolIndexReader& operator=(const SymbolIndexReader&) = delete;
+    ~SymbolIndexReader(){ close(); }
+
+    /**
+     * Maps a symbol index file read only.
+     * @param path The path of the file, <executable>.symbols.
+     * @returns Returns true if the file was mapped and its layout is one this reader knows.
+     */
+    bool open(const std::string& path){
+        close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(file == INVALID_HANDLE_VALUE){
+            return false;
+        }
+        LARGE_INTEGER length;
+        size_t bytes = GetFileSizeEx(file, &length) ? static_cast<size_t>(length.QuadPart) : 0;
+        mapping = bytes > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+        CloseHandle(file);
+        const uint8_t* view = mapping != nullptr ? static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0){
+            return false;
+        }
+        struct stat info;
+        size_t bytes = fstat(fd, &info) == 0 ? static_cast<size_t>(info.st_size) : 0;
+        void* region = bytes > 0 ? mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        const uint8_t* view = region == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(region);
+#endif
+        map = view;
+        size = bytes;
+        mapped = view != nullptr;
+        return validate();
+    }
+
+    /**
+     * Reads an index that is already in memory, such as the one embedded in the program. The bytes must outlive the
+     * reader and be aligned to 4 bytes.
+     * @param bytes The index.
+     * @param length The size of the index.
+     * @returns Returns true if the layout is one this reader knows.
+     */
+    bool attach(const uint8_t* bytes, size_t length){
+        close();
+        map = bytes;
+        size = length;
+        return validate();
+    }
+
+    /**
+     * Unmaps the file, or lets go of the bytes that were attached.
+     */
+    void close(){
+        if(mapped && map != nullptr){
+#ifdef _WIN32
+            UnmapViewOfFile(map);
+#else
+            munmap(const_cast<uint8_t*>(map), size);
+#endif
+        }
+#ifdef _WIN32
+        if(mapping != nullptr) CloseHandle(mapping);
+        mapping = nullptr;
+#endif
+        mapped = false;
+        map = nullptr;
+        size = 0;
+    }
+
+    /**
+     * @returns Returns true if an index is open.
+     */
+    bool isOpen() const { return map != nullptr; }
+
+    /**
+     * @returns Returns the header of the index, or nullptr if it isn't open.
+     */
+    const SymbolIndexHeader* header() const { return reinterpret_cast<const SymbolIndexHeader*>(map); }
+
+    /**
+     * @returns Returns the number of entries of the index.
+     */
+    uint32_t count() const { return map != nullptr ? header()->count : 0; }
+
+    /**
+     * @returns Returns the entries of the index, in the order of their slots.
+     */
+    const SymbolIndexEntry* entries() const {
+        return reinterpret_cast<const SymbolIndexEntry*>(map + header()->entriesOffset);
+    }
+
+    /**
+     * Gets a string of an entry.
+     * @param offset The offset of the string, such as SymbolIndexEntry::name.
+     * @returns Returns the string, or the empty string if the offset is out of range.
+     */
+    const char* text(uint32_t offset) const {
+        return offset < header()->stringsBytes ? reinterpret_cast<const char*>(map + header()->stringsOffset + offset) : "";
+    }
+
+    /**
+     * Looks up a located variable by name, without regard to case.
+     * @param name The name of the variable.
+     * @returns Returns the entry of the variable, or nullptr if the program has no such located variable.
+     */
+    const SymbolIndexEntry* find(const char* name) const {
+        if(map == nullptr || header()->count == 0){
+            return nullptr;
+        }
+        const SymbolIndexHeader* h = header();
+        uint32_t hash = symbolHash(0, name);
+        uint32_t displacement = reinterpret_cast<const uint32_t*>(map + sizeof(SymbolIndexHeader))[hash % h->buckets];
+        const SymbolIndexEntry& entry = entries()[symbolHash(displacement, name) % h->count];
+        if(entry.hash != hash){
+            return nullptr;
+        }
+        const char* candidate = text(entry.name);
+        size_t x = 0;
+        for(; name[x] != '\0' && candidate[x] != '\0'; x++){
+            char a = name[x] >= 'a' && name[x] <= 'z' ? static_cast<char>(name[x] - 'a' + 'A') : name[x];
+            char b = candidate[x] >= 'a' && candidate[x] <= 'z' ? static_cast<char>(candidate[x] - 'a' + 'A') : candidate[x];
+            if(a != b){
+                return nullptr;
+            }
+        }
+        return name[x] == candidate[x] ? &entry : nullptr;
+    }
+
+private:
+    /**
+     * Checks that the index is one this reader knows and that its parts are within it, closing it if not.
+     * @returns Returns true if the index can be read.
+     */
+    bool validate(){
+        const SymbolIndexHeader* h = header();
+        if(map == nullptr || size < sizeof(SymbolIndexHeader) || std::memcmp(h->magic, SYMBOL_INDEX_MAGIC, sizeof(SYMBOL_INDEX_MAGIC)) != 0 ||
+           h->version != SYMBOL_INDEX_VERSION || h->buckets == 0 ||
+           sizeof(SymbolIndexHeader) + static_cast<size_t>(h->buckets) * sizeof(uint32_t) > h->entriesOffset ||
+           static_cast<size_t>(h->entriesOffset) + static_cast<size_t>(h->count) * sizeof(SymbolIndexEntry) > h->stringsOffset ||
+           static_cast<size_t>(h->stringsOffset) + h->stringsBytes > size || h->stringsBytes == 0 ||
+           map[h->stringsOffset + h->stringsBytes - 1] != '\0'){
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    const uint8_t* map = nullptr;
+    size_t size = 0;
+    bool mapped = false;        // Set when map is a view of a file this reader unmaps.
+#ifdef _WIN32
+    HANDLE mapping = nullptr;
+#endif
+};
+
+#endif // SYMBOLINDEX_H
@@ -0,0 +1,296 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Timed Outputs
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+#include "timedio.h"
+#include <array>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <pthread.h>
+    #include <sched.h>
+#endif
+
+/**
+ * The number of commands the ring holds, a power of two.
+ */
+static constexpr uint64_t TIMED_OUTPUT_QUEUE = 256;
+
+/**
+ * How long before a command is due the timed output thread stops sleeping and spins, in microseconds, which covers
+ * the time the OS takes to wake a thread.
+ */
+static constexpr uint64_t TIMED_OUTPUT_SPIN = 200;
+
+/**
+ * The longest the timed output thread sleeps at a time, in microseconds, so that it notices a simulated clock that
+ * was moved on.
+ */
+static constexpr uint64_t TIMED_OUTPUT_MAX_WAIT = 10000;
+
+/**
+ * A command, as a block queues it.
+ */
+struct TimedCommand {
+    ResolvedAddress local;
+    uint64_t value;
+    uint64_t due;
+    uint64_t width;     // If not 0, the microseconds after due at which 0 is written.
+};
+
+/**
+ * A slot of the ring. Its sequence tells whether it is free for the producer of a position or holds the command of
+ * one for the consumer.
+ */
+struct TimedSlot {
+    std::atomic<uint64_t> sequence{0};
+    TimedCommand command;
+};
+
+/**
+ * A write the timed output thread has to make.
+ */
+struct TimedWrite {
+    uint64_t due;
+    uint64_t order;     // Keeps the writes that are due together in the order they were queued.
+    ResolvedAddress local;
+    uint64_t value;
+
+    bool operator>(const TimedWrite& other) const {
+        return due != other.due ? due > other.due : order > other.order;
+    }
+};
+
+/**
+ * The client that maps an output, as the timed output thread found it.
+ */
+struct TimedTarget {
+    IOClient* client = nullptr;
+    size_t mapping = 0;
+    size_t clients = SIZE_MAX;  // The number of clients when it was looked for, to look again when one is added.
+};
+
+class TimedOutputs {
+public:
+    TimedOutputs() {
+        for (uint64_t k = 0; k < TIMED_OUTPUT_QUEUE; k++) {
+            slots[k].sequence.store(k, std::memory_order_relaxed);
+        }
+    }
+    ~TimedOutputs() { close(); }
+
+    void open();
+    void close();
+    bool push(const TimedCommand& command) {
+        uint64_t position = head.load(std::memory_order_relaxed);
+        TimedSlot* slot;
+        for (;;) {
+            slot = &slots[position & (TIMED_OUTPUT_QUEUE - 1)];
+            int64_t lag = static_cast<int64_t>(slot->sequence.load(std::memory_order_acquire) - position);
+            if (lag == 0) {
+                if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (lag < 0) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else {
+                position = head.load(std::memory_order_relaxed);
+            }
+        }
+        slot->command = command;
+        slot->sequence.store(position + 1, std::memory_order_release);
+        // The thread is only woken while it sleeps, so a command queued while it spins costs nothing more.
+        if (sleeping.load(std::memory_order_seq_cst)) {
+            {
+                std::lock_guard<std::mutex> lock(wakeMutex);
+            }
+            wakeSignal.notify_one();
+        }
+        return true;
+    }
+
+private:
+    std::array<TimedSlot, TIMED_OUTPUT_QUEUE> slots;
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) uint64_t tail = 0;              // Only the timed output thread takes commands.
+    std::atomic<uint64_t> dropped{0};
+    uint64_t reported = 0;
+    std::priority_queue<TimedWrite, std::vector<TimedWrite>, std::greater<TimedWrite>> writes;
+    uint64_t order = 0;
+    std::unordered_map<uint64_t, TimedTarget> targets;
+    ExecutionStats* lateness = nullptr;
+    std::once_flag started;
+    std::atomic<bool> running{false};
+    std::thread thread;
+    std::atomic<bool> sleeping{false};
+    std::mutex wakeMutex;
+    std::condition_variable wakeSignal;
+
+    bool queued() const {
+        return slots[tail & (TIMED_OUTPUT_QUEUE - 1)].sequence.load(std::memory_order_acquire) == tail + 1;
+    }
+    void run();
+    void drain();
+    void write(const TimedWrite& timed);
+    TimedTarget& target(const ResolvedAddress& local);
+};
+
+static TimedOutputs TIMED_OUTPUTS;
+
+/**
+ * Raises the calling thread to the highest real-time priority, above the tasks.
+ */
+static void raisePriority() {
+#ifdef _WIN32
+    if (!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL)) {
+        nodalisLog() << "Timed outputs: could not raise the priority of their thread, so they may be late under load\n";
+    }
+#else
+    sched_param param{};
+    param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+        nodalisLog() << "Timed outputs: could not set the real-time scheduling policy, so they may be late under load\n";
+    }
+#endif
+}
+
+void TimedOutputs::open() {
+    std::call_once(started, [this]() {
+        lateness = &registerStats("TimedOutput.Lateness");
+        running = true;
+        thread = std::thread([this]() { run(); });
+    });
+}
+
+void TimedOutputs::close() {
+    if (!running.exchange(false)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+    }
+    wakeSignal.notify_one();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void TimedOutputs::run() {
+    raisePriority();
+    while (running.load(std::memory_order_relaxed)) {
+        drain();
+        uint64_t now = elapsedMicros();
+        while (!writes.empty() && writes.top().due <= now) {
+            TimedWrite timed = writes.top();
+            writes.pop();
+            write(timed);
+        }
+        // A simulated clock only moves with the scans, so the thread sleeps up to the command instead of spinning.
+        bool simulated = SIMULATED_MICROS.load(std::memory_order_relaxed) != SIMULATED_CLOCK_OFF;
+        uint64_t spin = simulated ? 0 : TIMED_OUTPUT_SPIN;
+        uint64_t wait = writes.empty() ? TIMED_OUTPUT_MAX_WAIT : writes.top().due - now;
+        if (wait <= spin) {
+            continue;
+        }
+        wait = wait - spin < TIMED_OUTPUT_MAX_WAIT ? wait - spin : TIMED_OUTPUT_MAX_WAIT;
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        sleeping.store(true, std::memory_order_seq_cst);
+        if (!queued() && running.load(std::memory_order_relaxed)) {
+            wakeSignal.wait_for(lock, std::chrono::microseconds(wait));
+        }
+        sleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+void TimedOutputs::drain() {
+    while (queued()) {
+        TimedSlot& slot = slots[tail & (TIMED_OUTPUT_QUEUE - 1)];
+        TimedCommand command = slot.command;
+        slot.sequence.store(tail + TIMED_OUTPUT_QUEUE, std::memory_order_release);
+        tail++;
+        // The client is found now, so that the write doesn't wait for it when it is due.
+        target(command.local);
+        uint64_t value = command.local.bit > -1 ? (command.value != 0 ? 1 : 0) : command.value;
+        writes.push(TimedWrite{ command.due, order++, command.local, value });
+        if (command.width > 0) {
+            writes.push(TimedWrite{ command.due + command.width, order++, command.local, 0 });
+        }
+    }
+    uint64_t lost = dropped.load(std::memory_order_relaxed);
+    if (lost != reported) {
+        nodalisLog() << "Timed outputs: " << lost - reported << " commands were dropped, since the queue of "
+            << TIMED_OUTPUT_QUEUE << " was full\n";
+        reported = lost;
+    }
+}
+
+void TimedOutputs::write(const TimedWrite& timed) {
+    TimedTarget& found = target(timed.local);
+    if (found.client != nullptr) {
+        found.client->writeOutputNow(found.mapping, timed.local, timed.value);
+    }
+    uint64_t now = elapsedMicros();
+    lateness->record(now > timed.due ? now - timed.due : 0);
+    writeImage(timed.local, timed.value);
+}
+
+TimedTarget& TimedOutputs::target(const ResolvedAddress& local) {
+    uint64_t key = (static_cast<uint64_t>(local.bit > -1 ? local.bitOffset : local.offset) << 16)
+        | (static_cast<uint64_t>(local.bit + 1) << 8) | static_cast<uint64_t>(local.width);
+    TimedTarget& found = targets[key];
+    // An output that isn't mapped yet is looked for again once a client has been added.
+    if (found.client == nullptr && found.clients != Clients.size()) {
+        found.clients = Clients.size();
+        for (auto& client : Clients) {
+            if (client->findOutput(local, found.mapping)) {
+                found.client = client.get();
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+bool openTimedOutput(const char* address, ResolvedAddress& local) {
+    std::string text = address;
+    if (tryResolveAddress(text, -1, true, local) != AddressStatus::OK && tryResolveAddress(text, -1, false, local) != AddressStatus::OK) {
+        nodalisLog() << "Timed outputs: " << text << " isn't a valid address\n";
+        return false;
+    }
+    if (local.space != MEMORY_SPACE::Q) {
+        nodalisLog() << "Timed outputs: " << text << " isn't an output\n";
+        return false;
+    }
+    TIMED_OUTPUTS.open();
+    return true;
+}
+
+bool queueTimedOutput(const ResolvedAddress& local, uint64_t value, uint64_t due, uint64_t width) {
+    return TIMED_OUTPUTS.push(TimedCommand{ local, value, due, width });
+}
+
+void closeTimedOutputs() {
+    TIMED_OUTPUTS.close();
+}
@@ -0,0 +1,47 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Timed Outputs
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ *
+ * Writes outputs at times finer than the scan, for the PULSE_OUT and SET_OUT_AT blocks, so that a dosing valve or a
+ * cutter isn't held to the scan period plus the IO poll interval. A block queues a command, an output, a value and
+ * the time it is due, into a bounded ring that any task appends to with a compare and swap, without a lock, a system
+ * call or an allocation. The timed output thread runs at the highest real-time priority, above the tasks, whose
+ * priorities leave it the top of the range. It takes the commands from the ring into a heap ordered by when they are
+ * due, sleeps until shortly before the first one and then spins, so it writes it within microseconds of its time.
+ *
+ * A command is written through the client that maps the output, which is found when the command is queued, not when
+ * it is due: a GPIO or MMIO output is written to the device on the timed output thread, and the output of any other
+ * client is made due and the client woken, so it goes out with its next request. The value is also staged into the
+ * image, and the client holds it over the image's value until the image has been published twice, so the output
+ * doesn't go back to the old value for the scan that was running when it was written.
+ *
+ * How late each command was written, from when it was due, is kept as the TimedOutput.Lateness statistics.
+ */
+#pragma once
+#ifndef TIMEDIO_H
+#define TIMEDIO_H
+
+#include "nodalis.h"
+
+/**
+ * Stops the timed output thread, dropping the commands that aren't due yet. Called when the runtime stops.
+ */
+void closeTimedOutputs();
+
+#endif // TIMEDIO_H
@@ -0,0 +1,532 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Watch Server
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+#include "watch.h"
+#include "ioreactor.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #pragma comment(lib, "ws2_32.lib")
+#else
+    #include <fcntl.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+#endif
+
+/**
+ * The most clients that may watch at once. Further connections are refused.
+ */
+static constexpr size_t WATCH_MAX_CONNECTIONS = 16;
+/**
+ * The longest message or handshake that is read. A watch list of a few thousand names fits.
+ */
+static constexpr size_t WATCH_MAX_REQUEST = 65536;
+/**
+ * The most entries of a watch list, which are indexed by a uint16_t.
+ */
+static constexpr size_t WATCH_MAX_ENTRIES = 65535;
+
+/**
+ * Closes a socket.
+ * @param fd The socket.
+ */
+static void closeSocket(int fd) {
+#ifdef _WIN32
+    closesocket(fd);
+#else
+    close(fd);
+#endif
+}
+
+/**
+ * Puts a socket in non-blocking mode.
+ * @param fd The socket.
+ * @returns Returns true on success.
+ */
+static bool setNonBlocking(int fd) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(fd, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+/**
+ * Appends a number to a frame, little endian.
+ * @param out The frame.
+ * @param value The number.
+ * @param bytes The number of bytes to write.
+ */
+static void appendNumber(std::string& out, uint64_t value, size_t bytes) {
+    for (size_t b = 0; b < bytes; b++) {
+        out.push_back(static_cast<char>((value >> (b * 8)) & 0xFF));
+    }
+}
+
+#pragma region "WebSocket"
+/**
+ * Computes the SHA-1 digest of a text, which the WebSocket handshake needs.
+ * @param text The text.
+ * @param digest Receives the 20 bytes of the digest.
+ */
+static void sha1(const std::string& text, uint8_t digest[20]) {
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    std::string data = text;
+    uint64_t bits = static_cast<uint64_t>(text.size()) * 8;
+    data.push_back(static_cast<char>(0x80));
+    while (data.size() % 64 != 56) {
+        data.push_back(0);
+    }
+    for (int b = 7; b >= 0; b--) {
+        data.push_back(static_cast<char>((bits >> (b * 8)) & 0xFF));
+    }
+    auto rotate = [](uint32_t value, int count) { return (value << count) | (value >> (32 - count)); };
+    for (size_t chunk = 0; chunk < data.size(); chunk += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++) {
+            const uint8_t* p = reinterpret_cast<const uint8_t*>(data.data()) + chunk + i * 4;
+            w[i] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+        }
+        for (int i = 16; i < 80; i++) {
+            w[i] = rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) { f = (b & c) | (~b & d); k = 0x5A827999; }
+            else if (i < 40) { f = b ^ c ^ d; k = 0x6ED9EBA1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+            else { f = b ^ c ^ d; k = 0xCA62C1D6; }
+            uint32_t t = rotate(a, 5) + f + e + k + w[i];
+            e = d; d = c; c = rotate(b, 30); b = a; a = t;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+    for (int i = 0; i < 5; i++) {
+        for (int b = 0; b < 4; b++) {
+            digest[i * 4 + b] = static_cast<uint8_t>(h[i] >> (24 - b * 8));
+        }
+    }
+}
+
+/**
+ * Encodes bytes in base64.
+ */
+static std::string base64(const uint8_t* data, size_t length) {
+    static const char* ALPHABET = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t i = 0; i < length; i += 3) {
+        uint32_t group = uint32_t(data[i]) << 16;
+        if (i + 1 < length) group |= uint32_t(data[i + 1]) << 8;
+        if (i + 2 < length) group |= data[i + 2];
+        out.push_back(ALPHABET[(group >> 18) & 63]);
+        out.push_back(ALPHABET[(group >> 12) & 63]);
+        out.push_back(i + 1 < length ? ALPHABET[(group >> 6) & 63] : '=');
+        out.push_back(i + 2 < length ? ALPHABET[group & 63] : '=');
+    }
+    return out;
+}
+#pragma endregion
+
+WatchServer::WatchServer() {
+#ifdef _WIN32
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2,2), &wsa);
+#endif
+}
+
+WatchServer::~WatchServer() {
+    stop();
+}
+
+bool WatchServer::start(uint16_t port, uint64_t interval, const std::string& backend) {
+    if (listenFd >= 0) return true;
+    minInterval = std::max<uint64_t>(interval, 1);
+    int fd = static_cast<int>(socket(AF_INET, SOCK_STREAM, 0));
+    if (fd < 0) {
+        nodalisError() << "Watch server socket failed\n";
+        return false;
+    }
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        nodalisError() << "Watch server can't listen on port " << port << "\n";
+        closeSocket(fd);
+        return false;
+    }
+    setNonBlocking(fd);
+    listenFd = fd;
+
+    reactor = std::make_unique<IOReactor>("WATCH", backend);
+    reactor->start();
+    reactor->post([this]() {
+        reactor->watch(listenFd, EVENT_READABLE, [this](uint32_t) { acceptConnections(); });
+    });
+    nodalisLog() << "Watch server listening on port " << port << "\n";
+    return true;
+}
+
+void WatchServer::stop() {
+    if (!reactor) return;
+    reactor->runSync([this]() {
+        while (!connections.empty()) {
+            closeConnection(connections.begin()->first);
+        }
+        reactor->unwatch(listenFd);
+        closeSocket(listenFd);
+        listenFd = -1;
+    });
+    reactor->stop();
+    reactor.reset();
+}
+
+void WatchServer::acceptConnections() {
+    while (true) {
+        int fd = static_cast<int>(accept(listenFd, nullptr, nullptr));
+        if (fd < 0) return;
+        if (connections.size() >= WATCH_MAX_CONNECTIONS) {
+            closeSocket(fd);
+            continue;
+        }
+        setNonBlocking(fd);
+        int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+        auto connection = std::make_unique<Connection>();
+        connection->fd = fd;
+        Connection& added = *connection;
+        connections[fd] = std::move(connection);
+        startReceive(added);
+    }
+}
+
+void WatchServer::startReceive(Connection& connection) {
+    int fd = connection.fd;
+    if (!reactor->submitReceive(fd, [this, fd](const uint8_t* data, int result) { onReceived(fd, data, result); })) {
+        closeConnection(fd);
+    }
+}
+
+void WatchServer::onReceived(int fd, const uint8_t* data, int result) {
+    auto it = connections.find(fd);
+    if (it == connections.end()) return;
+    Connection& connection = *it->second;
+    if (result <= 0 || connection.received.size() + static_cast<size_t>(result) > WATCH_MAX_REQUEST) {
+        closeConnection(fd);
+        return;
+    }
+    connection.received.append(reinterpret_cast<const char*>(data), static_cast<size_t>(result));
+    if (!connection.upgraded) {
+        // A WebSocket client starts with its HTTP upgrade, and a TCP client with the interval of its watch list.
+        if (connection.received.size() < 4 && connection.received.find('\n') == std::string::npos) {
+            startReceive(connection);
+            return;
+        }
+        connection.webSocket = connection.received.compare(0, 4, "GET ") == 0;
+        if (connection.webSocket) {
+            if (connection.received.find("\r\n\r\n") == std::string::npos) {
+                startReceive(connection);
+                return;
+            }
+            if (!upgrade(connection)) {
+                closeConnection(fd);
+                return;
+            }
+        }
+        connection.upgraded = true;
+    }
+    if (!takeMessages(connection)) {
+        closeConnection(fd);
+        return;
+    }
+    startReceive(connection);
+}
+
+bool WatchServer::upgrade(Connection& connection) {
+    size_t end = connection.received.find("\r\n\r\n") + 4;
+    std::string request = connection.received.substr(0, end);
+    connection.received.erase(0, end);
+    std::string lower = request;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    size_t header = lower.find("\r\nsec-websocket-key:");
+    if (header == std::string::npos || lower.find("websocket") == std::string::npos) {
+        return false;
+    }
+    size_t from = request.find_first_not_of(' ', header + 20);
+    size_t to = request.find("\r\n", from);
+    std::string key = request.substr(from, to - from);
+    key.erase(key.find_last_not_of(' ') + 1);
+    uint8_t digest[20];
+    sha1(key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11", digest);
+    connection.sending += "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                          "Sec-WebSocket-Accept: " + base64(digest, sizeof(digest)) + "\r\n\r\n";
+    flushSend(connection);
+    return true;
+}
+
+bool WatchServer::takeMessages(Connection& connection) {
+    std::string& in = connection.received;
+    if (!connection.webSocket) {
+        size_t end;
+        while ((end = in.find('\n')) != std::string::npos) {
+            std::string line = in.substr(0, end);
+            in.erase(0, end + 1);
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            registerList(connection, line);
+        }
+        return true;
+    }
+    while (in.size() >= 2) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(in.data());
+        bool fin = (bytes[0] & 0x80) != 0;
+        uint8_t opcode = bytes[0] & 0x0F;
+        // Every frame a client sends is masked.
+        if ((bytes[1] & 0x80) == 0) {
+            return false;
+        }
+        uint64_t length = bytes[1] & 0x7F;
+        size_t header = 2;
+        if (length == 126) {
+            if (in.size() < 4) break;
+            length = (uint64_t(bytes[2]) << 8) | bytes[3];
+            header = 4;
+        }
+        else if (length == 127) {
+            if (in.size() < 10) break;
+            length = 0;
+            for (int b = 0; b < 8; b++) {
+                length = (length << 8) | bytes[2 + b];
+            }
+            header = 10;
+        }
+        if (length > WATCH_MAX_REQUEST) {
+            return false;
+        }
+        if (in.size() < header + 4 + length) break;
+        const uint8_t* mask = bytes + header;
+        std::string payload(static_cast<size_t>(length), '\0');
+        for (size_t i = 0; i < length; i++) {
+            payload[i] = static_cast<char>(bytes[header + 4 + i] ^ mask[i & 3]);
+        }
+        in.erase(0, header + 4 + static_cast<size_t>(length));
+        switch (opcode) {
+            case 0x0:
+            case 0x1:
+            case 0x2:
+                if (connection.message.size() + payload.size() > WATCH_MAX_REQUEST) {
+                    return false;
+                }
+                connection.message += payload;
+                if (fin) {
+                    std::string message;
+                    message.swap(connection.message);
+                    registerList(connection, message);
+                }
+                break;
+            case 0x8:
+                return false;
+            case 0x9:
+                queueFrame(connection, payload, 0xA);
+                break;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+void WatchServer::registerList(Connection& connection, const std::string& message) {
+    std::string list = message;
+    uint64_t interval = 0;
+    size_t start = list.find_first_not_of(" \t");
+    if (start != std::string::npos && std::isdigit(static_cast<unsigned char>(list[start]))) {
+        size_t end = list.find_first_of(" \t", start);
+        interval = std::strtoull(list.substr(start, end - start).c_str(), nullptr, 10);
+        list = end == std::string::npos ? "" : list.substr(end);
+    }
+    connection.entries.clear();
+    size_t from = 0;
+    while (from < list.size() && connection.entries.size() < WATCH_MAX_ENTRIES) {
+        size_t comma = list.find(',', from);
+        std::string name = list.substr(from, comma == std::string::npos ? std::string::npos : comma - from);
+        from = comma == std::string::npos ? list.size() : comma + 1;
+        name.erase(0, name.find_first_not_of(" \t"));
+        name.erase(name.find_last_not_of(" \t") + 1);
+        if (name.empty()) {
+            continue;
+        }
+        Entry entry;
+        entry.name = name;
+        const char* located = findSymbolAddress(name);
+        std::string address = located != nullptr ? located : name;
+        // An unknown name is kept in the list, with a width of 0, so the indexes stay those the client sent.
+        if (tryResolveAddress(address, -1, address.find('.') != std::string::npos, entry.address) == AddressStatus::OK) {
+            entry.width = entry.address.bit > -1 ? 1 : entry.address.width;
+        }
+        connection.entries.push_back(std::move(entry));
+    }
+
+    std::string& frame = connection.frame;
+    frame.clear();
+    frame.push_back(static_cast<char>(WatchFrame::List));
+    appendNumber(frame, connection.entries.size(), 2);
+    for (const auto& entry : connection.entries) {
+        size_t length = std::min<size_t>(entry.name.size(), 255);
+        frame.push_back(static_cast<char>(entry.width));
+        frame.push_back(static_cast<char>(length));
+        frame.append(entry.name, 0, length);
+    }
+    queueFrame(connection, frame);
+
+    // A new set of changes reports every line as changed, so the first frame reads every value.
+    connection.changes = std::make_unique<ImageChanges>();
+    connection.full = true;
+    connection.interval = std::max(interval, minInterval);
+    if (connection.timer != 0) {
+        reactor->cancel(connection.timer);
+    }
+    int fd = connection.fd;
+    connection.timer = reactor->schedule(IOReactor::Clock::now(), [this, fd]() { sendChanges(fd); });
+}
+
+void WatchServer::sendChanges(int fd) {
+    auto it = connections.find(fd);
+    if (it == connections.end()) return;
+    Connection& connection = *it->second;
+    connection.timer = 0;
+    // A client that hasn't taken its last frame yet gets the changes since then in its next one.
+    if (connection.sending.empty() && !connection.entries.empty()) {
+        std::string& frame = connection.frame;
+        frame.clear();
+        frame.push_back(static_cast<char>(WatchFrame::Values));
+        appendNumber(frame, 0, 8);
+        appendNumber(frame, 0, 2);
+        uint64_t count = 0;
+        bool full = connection.full;
+        connection.changes->read([&](const uint8_t* image, const ImageChanges& changes) {
+            for (size_t x = 0; x < connection.entries.size(); x++) {
+                Entry& entry = connection.entries[x];
+                if (entry.width == 0) {
+                    continue;
+                }
+                if (!full && !changes.isChanged(entry.address.bit > -1 ? entry.address.bitOffset : entry.address.offset)) {
+                    continue;
+                }
+                uint64_t value = entry.address.load(image);
+                if (!full && value == entry.last) {
+                    continue;
+                }
+                entry.last = value;
+                appendNumber(frame, x, 2);
+                appendNumber(frame, value, entry.width == 1 ? 1 : static_cast<size_t>(entry.width / 8));
+                count++;
+            }
+        });
+        if (count > 0 || full) {
+            uint64_t generation = imageGeneration();
+            for (size_t b = 0; b < 8; b++) {
+                frame[1 + b] = static_cast<char>((generation >> (b * 8)) & 0xFF);
+            }
+            frame[9] = static_cast<char>(count & 0xFF);
+            frame[10] = static_cast<char>((count >> 8) & 0xFF);
+            connection.full = false;
+            queueFrame(connection, frame);
+        }
+    }
+    connection.timer = reactor->schedule(IOReactor::Clock::now() + std::chrono::milliseconds(connection.interval),
+        [this, fd]() { sendChanges(fd); });
+}
+
+void WatchServer::queueFrame(Connection& connection, const std::string& frame, uint8_t opcode) {
+    std::string& out = connection.sending;
+    if (connection.webSocket) {
+        out.push_back(static_cast<char>(0x80 | opcode));
+        if (frame.size() < 126) {
+            out.push_back(static_cast<char>(frame.size()));
+        }
+        else if (frame.size() < 65536) {
+            out.push_back(static_cast<char>(126));
+            out.push_back(static_cast<char>((frame.size() >> 8) & 0xFF));
+            out.push_back(static_cast<char>(frame.size() & 0xFF));
+        }
+        else {
+            out.push_back(static_cast<char>(127));
+            for (int b = 7; b >= 0; b--) {
+                out.push_back(static_cast<char>((static_cast<uint64_t>(frame.size()) >> (b * 8)) & 0xFF));
+            }
+        }
+    }
+    else {
+        appendNumber(out, frame.size(), 4);
+    }
+    out += frame;
+    flushSend(connection);
+}
+
+void WatchServer::flushSend(Connection& connection) {
+    if (connection.sendPending || connection.sending.empty()) {
+        return;
+    }
+    int fd = connection.fd;
+    size_t taken = reactor->submitSend(fd, reinterpret_cast<const uint8_t*>(connection.sending.data()),
+        connection.sending.size(), [this, fd](const uint8_t*, int result) {
+            auto it = connections.find(fd);
+            if (it == connections.end()) return;
+            if (result <= 0) {
+                closeConnection(fd);
+                return;
+            }
+            Connection& sent = *it->second;
+            sent.sending.erase(0, static_cast<size_t>(result));
+            sent.sendPending = false;
+            flushSend(sent);
+        });
+    if (taken == 0) {
+        // The connection is closed once the caller, which may still be using it, has returned.
+        reactor->post([this, fd]() { closeConnection(fd); });
+        return;
+    }
+    connection.sendPending = true;
+}
+
+void WatchServer::closeConnection(int fd) {
+    auto it = connections.find(fd);
+    if (it == connections.end()) return;
+    if (it->second->timer != 0) {
+        reactor->cancel(it->second->timer);
+    }
+    connections.erase(it);
+    reactor->cancelIO(fd);
+    reactor->unwatch(fd);
+    closeSocket(fd);
+}
@@ -0,0 +1,148 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Nodalis PLC Watch Server
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+#pragma once
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "nodalis.h"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class IOReactor;
+
+/**
+ * The types of the frames the watch server sends.
+ */
+enum class WatchFrame : uint8_t {
+    /**
+     * Describes the watch list a client registered: the number of entries (uint16_t), then for each entry its width
+     * in bits, with 1 for a bit (uint8_t, 0 if the symbol is unknown), the length of its name (uint8_t) and the name.
+     */
+    List = 1,
+    /**
+     * The values that changed since the last frame: the image generation they were read from (uint64_t), the number
+     * of values (uint16_t), then for each value the index of its entry (uint16_t) and the value, in a byte for a bit
+     * and in width / 8 bytes otherwise. The first frame after a list holds every value.
+     */
+    Values = 2,
+};
+
+/**
+ * Streams the values of a watch list to engineering tools and HMIs, so online monitoring doesn't read each variable
+ * through OPC UA. A client connects over TCP, or over WebSocket with an HTTP upgrade on the same port, and sends its
+ * watch list as a line of text (a text or binary message over WebSocket): the shortest interval between frames in
+ * milliseconds, then the located globals, by name or address, separated by commas, as in "100 Speed,%QW0". A new list
+ * replaces the last one.
+ *
+ * The server answers with a List frame and then sends a Values frame with the values that changed since the last
+ * one, at most once per interval and never faster than --watch-interval. The changes are taken from the lines of the
+ * image that commitOutputs() marked since the client's last frame, so no scan is missed and the scan does no work for
+ * the clients. A value that changes and changes back between two frames isn't sent. While a client's last frame is
+ * still being sent, its changes accumulate into the next one.
+ *
+ * Frames are sent as they are over TCP, each after its length (uint32_t), and as binary WebSocket messages. All
+ * numbers are little endian. The server runs on an IO reactor of its own.
+ */
+class WatchServer {
+public:
+    WatchServer();
+    ~WatchServer();
+
+    /**
+     * Starts listening for clients.
+     * @param port The TCP port to listen on.
+     * @param interval The shortest interval between the frames of a client, in milliseconds.
+     * @param backend The reactor backend to use, as accepted by createReactorBackend().
+     * @returns Returns false if the port can't be listened on.
+     */
+    bool start(uint16_t port, uint64_t interval, const std::string& backend = "");
+    /**
+     * Closes every connection and stops listening.
+     */
+    void stop();
+
+private:
+    /**
+     * An entry of a client's watch list.
+     */
+    struct Entry {
+        std::string name;
+        ResolvedAddress address;
+        int width = 0;          // The width of the value, with 1 for a bit, or 0 if the name is unknown.
+        uint64_t last = 0;      // The value last sent.
+    };
+    /**
+     * A client's connection.
+     */
+    struct Connection {
+        int fd;
+        bool webSocket = false;
+        bool upgraded = false;      // Set once a WebSocket handshake was answered, or right away for TCP.
+        std::string received;
+        std::string message;        // The fragments of a WebSocket message, until its last one.
+        std::string sending;        // The bytes waiting to be sent, from the start of the send that is outstanding.
+        bool sendPending = false;
+        std::vector<Entry> entries;
+        bool full = true;           // Set when the next Values frame holds every value.
+        uint64_t interval = 0;
+        uint64_t timer = 0;
+        std::unique_ptr<ImageChanges> changes;
+        std::string frame;          // The frame being built, kept for its capacity.
+    };
+    std::unique_ptr<IOReactor> reactor;
+    std::map<int, std::unique_ptr<Connection>> connections;
+    int listenFd = -1;
+    uint64_t minInterval = 0;
+
+    void acceptConnections();
+    void startReceive(Connection& connection);
+    void onReceived(int fd, const uint8_t* data, int result);
+    /**
+     * Answers the WebSocket handshake of a connection whose request is complete.
+     * @returns Returns false if the request isn't a WebSocket upgrade.
+     */
+    bool upgrade(Connection& connection);
+    /**
+     * Takes the complete messages that were received, as lines over TCP or WebSocket frames.
+     * @returns Returns false if the connection must be closed.
+     */
+    bool takeMessages(Connection& connection);
+    /**
+     * Registers the watch list of a message and sends its List frame.
+     */
+    void registerList(Connection& connection, const std::string& message);
+    /**
+     * Sends the values that changed, and schedules the next frame.
+     */
+    void sendChanges(int fd);
+    /**
+     * Queues a frame to be sent, framed for the connection.
+     * @param opcode The WebSocket opcode of the frame.
+     */
+    void queueFrame(Connection& connection, const std::string& frame, uint8_t opcode = 2);
+    void flushSend(Connection& connection);
+    void closeConnection(int fd);
+};
+
+#endif // WATCH_H
@@ -22,6 +22,8 @@ using System.Collections.Generic;
 using System.Net.Sockets;
 using System.Net;
 using System.Text;
+using System.Threading;
+using System.Threading.Tasks;
 
 namespace Nodalis
 {
@@ -36,6 +38,39 @@ namespace Nodalis
         private int port = 502;
         private byte unitId = 1;
         private ushort transactionId = 0;
+
+        // Largest blocks allowed by the protocol for one read or write.
+        private const int MAX_READ_REGISTERS = 125;
+        private const int MAX_READ_BITS = 2000;
+        private const int MAX_WRITE_REGISTERS = 123;
+        private const int MAX_WRITE_BITS = 1968;
+        // Unmapped registers or bits that may be read between two mappings to merge them into one request.
+        private const int MAX_REGISTER_GAP = 8;
+        private const int MAX_BIT_GAP = 64;
+
+        /// <summary>
+        /// The milliseconds to wait for a connection.
+        /// </summary>
+        public int ConnectTimeout = 3000;
+        /// <summary>
+        /// The milliseconds to wait for a response.
+        /// </summary>
+        public int ResponseTimeout = 1000;
+
+        /// <summary>
+        /// A mapping, with its remote address parsed, as part of a block request.
+        /// </summary>
+        private struct ModbusPoint
+        {
+            public IOMap Map;
+            public byte Function;
+            public ushort Address;
+            public ushort Count;
+        }
+
+        private Socket? socket;
+        private readonly byte[] adu = new byte[260];
+        private readonly List<ModbusPoint> points = new();
         /// <summary>
         /// Instantiates a new Modbus client.
         /// </summary>
@@ -223,5 +258,241 @@ namespace Nodalis
             };
             return SendRequest(0x10, addr, 2, payload, out _);
         }
+
+        /// <summary>
+        /// Connects to the device from the polling task, without blocking a thread, for at most ConnectTimeout.
+        /// </summary>
+        /// <param name="token">Cancelled when the client is stopped.</param>
+        protected override async Task ConnectAsync(CancellationToken token)
+        {
+            if (mappings.Count > 0)
+            {
+                ip = mappings[0].moduleID;
+                port = int.Parse(mappings[0].modulePort);
+                moduleID = ip;
+            }
+            CloseSocket();
+            var next = new Socket(SocketType.Stream, ProtocolType.Tcp) { NoDelay = true };
+            using var timeout = CancellationTokenSource.CreateLinkedTokenSource(token);
+            timeout.CancelAfter(ConnectTimeout);
+            try
+            {
+                await next.ConnectAsync(ip, port, timeout.Token);
+                socket = next;
+                connected = true;
+            }
+            catch (OperationCanceledException) when (!token.IsCancellationRequested)
+            {
+                next.Dispose();
+                connected = false;
+            }
+            catch (SocketException)
+            {
+                next.Dispose();
+                connected = false;
+            }
+        }
+
+        /// <summary>
+        /// Closes the connection of the polling task.
+        /// </summary>
+        protected override void OnStopped() => CloseSocket();
+
+        private void CloseSocket()
+        {
+            socket?.Dispose();
+            socket = null;
+            connected = false;
+        }
+
+        /// <summary>
+        /// Polls the mappings that are due with as few requests as possible. Inputs at neighbouring addresses are read
+        /// with one FC02 or FC03 request, bridging small gaps, and contiguous outputs are written with one FC15 or
+        /// FC16 request, or FC05/FC06 for a single value, like the C++ runtime's client. The Coalesce protocol property
+        /// can be set to "false" to send each mapping alone.
+        /// </summary>
+        /// <param name="due">The mappings that are due.</param>
+        /// <param name="token">Cancelled when the client is stopped.</param>
+        protected override async Task PollAsync(List<IOMap> due, CancellationToken token)
+        {
+            points.Clear();
+            bool coalesce = true;
+            foreach (var map in due)
+            {
+                if (!ushort.TryParse(map.remoteAddress, out var address)) continue;
+                if (map.protocolProperties != null && map.protocolProperties.TryGetValue("Coalesce", out var value) &&
+                    value.Equals("false", StringComparison.OrdinalIgnoreCase))
+                    coalesce = false;
+                bool isBit = map.width == 1;
+                byte function = map.direction == IOType.Output ? (byte)(isBit ? 0x0F : 0x10) : (byte)(isBit ? 0x02 : 0x03);
+                points.Add(new ModbusPoint { Map = map, Function = function, Address = address, Count = (ushort)(isBit ? 1 : Math.Max(1, map.width / 16)) });
+            }
+            // Points are grouped by function, since only those can share a request, and sorted by address.
+            points.Sort((a, b) => a.Function != b.Function ? a.Function.CompareTo(b.Function) : a.Address.CompareTo(b.Address));
+
+            int first = 0;
+            while (first < points.Count)
+            {
+                byte function = points[first].Function;
+                bool isWrite = function == 0x0F || function == 0x10;
+                bool isBit = function == 0x02 || function == 0x0F;
+                int maxBlock = isWrite ? (isBit ? MAX_WRITE_BITS : MAX_WRITE_REGISTERS) : (isBit ? MAX_READ_BITS : MAX_READ_REGISTERS);
+                // Writes must not touch registers that are not mapped, so only reads may bridge gaps.
+                int maxGap = isWrite ? 0 : (isBit ? MAX_BIT_GAP : MAX_REGISTER_GAP);
+                int start = points[first].Address;
+                int end = start + points[first].Count;
+                int next = first + 1;
+                for (; coalesce && next < points.Count; next++)
+                {
+                    var point = points[next];
+                    if (point.Function != function) break;
+                    int pointEnd = point.Address + point.Count;
+                    bool fits = pointEnd - start <= maxBlock && point.Address <= end + maxGap;
+                    if (!fits || (isWrite && point.Address < end)) break;
+                    if (pointEnd > end) end = pointEnd;
+                }
+                if (!connected) return;
+                if (isWrite)
+                    await WriteBlockAsync(function, first, next - first, start, end - start, token);
+                else
+                    await ReadBlockAsync(function, first, next - first, start, end - start, token);
+                first = next;
+            }
+        }
+
+        private async Task ReadBlockAsync(byte function, int first, int count, int start, int quantity, CancellationToken token)
+        {
+            adu[7] = function;
+            PutWord(8, (ushort)start);
+            PutWord(10, (ushort)quantity);
+            int length = await TransactAsync(5, token);
+            if (length < 2) return;
+            // The values start after the function code and byte count, at adu[9].
+            for (int i = first; i < first + count; i++)
+            {
+                var point = points[i];
+                int offset = point.Address - start;
+                if (function == 0x02)
+                {
+                    if (2 + offset / 8 >= length) continue;
+                    PostInput(point.Map, (ulong)((adu[9 + offset / 8] >> (offset % 8)) & 1));
+                }
+                else
+                {
+                    if (2 + (offset + point.Count) * 2 > length) continue;
+                    ulong value = 0;
+                    for (int r = 0; r < point.Count; r++)
+                        value = (value << 16) | GetWord(9 + (offset + r) * 2);
+                    PostInput(point.Map, point.Map.width == 8 ? value & 0xFF : value);
+                }
+            }
+        }
+
+        private async Task WriteBlockAsync(byte function, int first, int count, int start, int quantity, CancellationToken token)
+        {
+            int pduLength;
+            // A single value uses the single write functions, which every device supports.
+            if (count == 1 && points[first].Count == 1)
+            {
+                ulong value = OutputValue(points[first].Map);
+                adu[7] = function == 0x0F ? (byte)0x05 : (byte)0x06;
+                PutWord(8, (ushort)start);
+                PutWord(10, function == 0x0F ? (ushort)(value != 0 ? 0xFF00 : 0x0000) : (ushort)value);
+                pduLength = 5;
+            }
+            else
+            {
+                adu[7] = function;
+                PutWord(8, (ushort)start);
+                PutWord(10, (ushort)quantity);
+                int bytes = function == 0x0F ? (quantity + 7) / 8 : quantity * 2;
+                adu[12] = (byte)bytes;
+                Array.Clear(adu, 13, bytes);
+                for (int i = first; i < first + count; i++)
+                {
+                    var point = points[i];
+                    int offset = point.Address - start;
+                    ulong value = OutputValue(point.Map);
+                    if (function == 0x0F)
+                    {
+                        if (value != 0) adu[13 + offset / 8] |= (byte)(1 << (offset % 8));
+                    }
+                    else
+                    {
+                        for (int r = point.Count - 1; r >= 0; r--)
+                        {
+                            PutWord(13 + (offset + r) * 2, (ushort)value);
+                            value >>= 16;
+                        }
+                    }
+                }
+                pduLength = 6 + bytes;
+            }
+            await TransactAsync(pduLength, token);
+        }
+
+        /// <summary>
+        /// Sends the request in adu and receives its response into adu, for at most ResponseTimeout.
+        /// </summary>
+        /// <param name="pduLength">The length of the request's PDU, which starts at adu[7].</param>
+        /// <param name="token">Cancelled when the client is stopped.</param>
+        /// <returns>Returns the length of the response's PDU, or 0 if there was no valid response.</returns>
+        private async Task<int> TransactAsync(int pduLength, CancellationToken token)
+        {
+            if (socket == null) return 0;
+            byte function = adu[7];
+            transactionId++;
+            PutWord(0, transactionId);
+            PutWord(2, 0);
+            PutWord(4, (ushort)(pduLength + 1));
+            adu[6] = unitId;
+            using var timeout = CancellationTokenSource.CreateLinkedTokenSource(token);
+            timeout.CancelAfter(ResponseTimeout);
+            try
+            {
+                await socket.SendAsync(new ReadOnlyMemory<byte>(adu, 0, 7 + pduLength), SocketFlags.None, timeout.Token);
+                // Responses are framed by the MBAP length, and any that don't answer this request are skipped.
+                while (true)
+                {
+                    await ReceiveAsync(0, 7, timeout.Token);
+                    int length = GetWord(4) - 1;
+                    if (length < 1 || length > adu.Length - 7)
+                        throw new InvalidOperationException("Invalid Modbus frame length.");
+                    await ReceiveAsync(7, length, timeout.Token);
+                    if (GetWord(0) != transactionId) continue;
+                    // An exception response has the high bit of the function code set.
+                    return adu[7] == function ? length : 0;
+                }
+            }
+            catch (OperationCanceledException) when (!token.IsCancellationRequested)
+            {
+                CloseSocket();
+            }
+            catch (Exception ex) when (ex is SocketException || ex is InvalidOperationException || ex is ObjectDisposedException)
+            {
+                CloseSocket();
+            }
+            return 0;
+        }
+
+        private async Task ReceiveAsync(int offset, int count, CancellationToken token)
+        {
+            while (count > 0)
+            {
+                int read = await socket!.ReceiveAsync(new Memory<byte>(adu, offset, count), SocketFlags.None, token);
+                if (read == 0)
+                    throw new InvalidOperationException("The connection was closed.");
+                offset += read;
+                count -= read;
+            }
+        }
+
+        private void PutWord(int offset, ushort value)
+        {
+            adu[offset] = (byte)(value >> 8);
+            adu[offset + 1] = (byte)(value & 0xFF);
+        }
+
+        private ushort GetWord(int offset) => (ushort)((adu[offset] << 8) | adu[offset + 1]);
     }
 }
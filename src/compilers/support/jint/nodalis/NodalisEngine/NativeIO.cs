@@ -0,0 +1,94 @@
+#nullable enable
+
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+using System;
+using System.Runtime.InteropServices;
+
+namespace Nodalis
+{
+    /// <summary>
+    /// The C interface of the nodalisio library, which runs the IO on the C++ runtime's Modbus, OPC UA and BACnet
+    /// clients. The library is built with the compiler's nativeIO option and is loaded from beside the executable.
+    /// See nodalisio.h for the meaning of each function.
+    /// </summary>
+    internal static partial class NativeIOLibrary
+    {
+        private const string Library = "nodalisio";
+
+        /// <summary>
+        /// The version of nodalisio.h that the declarations below follow.
+        /// </summary>
+        public const int AbiVersion = 1;
+
+        [LibraryImport(Library, EntryPoint = "nodalis_io_version")]
+        internal static partial int Version();
+
+        [LibraryImport(Library, EntryPoint = "nodalis_io_image_bytes")]
+        internal static partial nuint ImageBytes();
+
+        [LibraryImport(Library, EntryPoint = "nodalis_io_space_bytes")]
+        internal static partial nuint SpaceBytes(byte space);
+
+        [LibraryImport(Library, EntryPoint = "nodalis_io_map", StringMarshalling = StringMarshalling.Utf8)]
+        internal static partial void Map(string map);
+
+        [LibraryImport(Library, EntryPoint = "nodalis_io_start", StringMarshalling = StringMarshalling.Utf8)]
+        internal static partial void Start(int ioThreads, string? backend);
+
+        [LibraryImport(Library, EntryPoint = "nodalis_io_poll")]
+        internal static partial void Poll();
+
+        [LibraryImport(Library, EntryPoint = "nodalis_io_exchange")]
+        internal static unsafe partial int Exchange(ulong* image, nuint bytes);
+
+        /// <summary>
+        /// Exchanges a process image with the library's IO clients.
+        /// </summary>
+        /// <param name="image">The process image, laid out like the library's.</param>
+        /// <returns>Returns false if the library rejected the image.</returns>
+        internal static unsafe bool Exchange(ulong[] image)
+        {
+            fixed (ulong* cells = image)
+            {
+                return Exchange(cells, (nuint)(image.Length * sizeof(ulong))) == 0;
+            }
+        }
+
+        /// <summary>
+        /// Loads the library and checks that it can run the IO of a process image.
+        /// </summary>
+        /// <param name="image">The process image the library's IO will be exchanged with.</param>
+        /// <param name="error">The reason the library can't be used, or null.</param>
+        /// <returns>Returns true if the library is loaded, has this interface and the same image layout.</returns>
+        internal static bool TryOpen(ulong[] image, out string? error)
+        {
+            error = null;
+            try
+            {
+                int version = Version();
+                if (version != AbiVersion)
+                    error = $"The {Library} library has interface version {version}, not {AbiVersion}.";
+                else if (ImageBytes() != (nuint)(image.Length * sizeof(ulong)))
+                    error = $"The {Library} library's process image is {ImageBytes()} bytes, not {image.Length * sizeof(ulong)}.";
+            }
+            catch (Exception ex) when (ex is DllNotFoundException || ex is EntryPointNotFoundException || ex is BadImageFormatException)
+            {
+                error = $"The {Library} library can't be loaded: {ex.Message}";
+            }
+            return error == null;
+        }
+    }
+}
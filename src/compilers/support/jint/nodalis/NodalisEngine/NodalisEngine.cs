@@ -19,8 +19,14 @@
 /// </summary>
 
 using System;
+using System.Collections.Concurrent;
 using System.Collections.Generic;
+using System.Runtime.CompilerServices;
 using System.Text.Json;
+using System.Text.Json.Serialization;
+using System.Threading;
+using System.Threading.Channels;
+using System.Threading.Tasks;
 using Jint;
 using Jint.Native;
 using Jint.Native.Object;
@@ -107,12 +113,16 @@ namespace Nodalis
         /// </summary>
         public Dictionary<string, string>? protocolProperties;
         /// <summary>
+        /// The index of an output's latched value in its client, or -1 for an input.
+        /// </summary>
+        internal int outputIndex = -1;
+        /// <summary>
         /// Constructs a new map based on the json configuration of it.
         /// </summary>
         /// <param name="json">A json string representing the map.</param>
         public IOMap(string json)
         {
-            var dict = System.Text.Json.JsonSerializer.Deserialize<Dictionary<string, string>>(json);
+            var dict = System.Text.Json.JsonSerializer.Deserialize(json, IOMapJsonContext.Default.DictionaryStringString)!;
             localAddress = dict["InternalAddress"];
             remoteAddress = dict["RemoteAddress"];
             moduleID = dict["ModuleID"];
@@ -125,7 +135,7 @@ namespace Nodalis
             {
                 try
                 {
-                    protocolProperties = System.Text.Json.JsonSerializer.Deserialize<Dictionary<string, string>>(nestedJson);
+                    protocolProperties = System.Text.Json.JsonSerializer.Deserialize(nestedJson, IOMapJsonContext.Default.DictionaryStringString);
                 }
                 catch
                 {
@@ -134,6 +144,39 @@ namespace Nodalis
             }
         }
     }
+    /// <summary>
+    /// The serializer of IO map configurations, generated at compile time so that it needs no reflection and survives
+    /// trimming and Native AOT.
+    /// </summary>
+    [JsonSerializable(typeof(Dictionary<string, string>))]
+    internal partial class IOMapJsonContext : JsonSerializerContext
+    {
+    }
+    /// <summary>
+    /// A value read from a module, queued for the engine's memory.
+    /// </summary>
+    public readonly struct IOUpdate
+    {
+        /// <summary>
+        /// The mapping the value was read for.
+        /// </summary>
+        public readonly IOMap Map;
+        /// <summary>
+        /// The value, in its low bits.
+        /// </summary>
+        public readonly ulong Value;
+        /// <summary>
+        /// Constructs an update.
+        /// </summary>
+        /// <param name="map">The mapping the value was read for.</param>
+        /// <param name="value">The value.</param>
+        public IOUpdate(IOMap map, ulong value)
+        {
+            Map = map;
+            Value = value;
+        }
+    }
+
     /// <summary>
     /// IOClient defines the behavior for an IO interface between the engine and a module.
     /// </summary>
@@ -156,10 +199,33 @@ namespace Nodalis
         /// </summary>
         protected List<IOMap> mappings = new();
         /// <summary>
+        /// The local addresses of the mappings, so that a mapping is found without searching them.
+        /// </summary>
+        private readonly HashSet<string> mappedAddresses = new();
+        /// <summary>
         /// The last attempt to poll the module.
         /// </summary>
         protected long lastAttempt = 0;
         /// <summary>
+        /// The milliseconds to wait after a failed connection before connecting again.
+        /// </summary>
+        protected int reconnectDelay = 1000;
+
+        /// <summary>
+        /// The mappings as the polling task sees them. The set is replaced, never changed, when a mapping is added, so
+        /// the task can use it without a lock.
+        /// </summary>
+        private sealed class MappingSet
+        {
+            public IOMap[] All = Array.Empty<IOMap>();
+            public ulong[] OutputValues = Array.Empty<ulong>();
+        }
+        private MappingSet mappingSet = new();
+        private Channel<IOUpdate>? updates;
+        private CancellationTokenSource? stopping;
+        private Task? pollTask;
+        private Task? connectTask;
+        /// <summary>
         /// Constructs a new client with the given protocol.
         /// </summary>
         /// <param name="protocol">The name of the protocol</param>
@@ -174,7 +240,7 @@ namespace Nodalis
         /// <param name="map">The map object defining the mapping.</param>
         public void AddMapping(IOMap map)
         {
-            if (!mappings.Exists(m => m.localAddress == map.localAddress))
+            if (mappedAddresses.Add(map.localAddress))
             {
                 if (mappings.Count == 0)
                 {
@@ -182,6 +248,13 @@ namespace Nodalis
                     
                 }
                 mappings.Add(map);
+                var set = new MappingSet { All = mappings.ToArray(), OutputValues = mappingSet.OutputValues };
+                if (map.direction == IOType.Output)
+                {
+                    map.outputIndex = set.OutputValues.Length;
+                    Array.Resize(ref set.OutputValues, set.OutputValues.Length + 1);
+                }
+                Volatile.Write(ref mappingSet, set);
                 Console.WriteLine(@$"Added map for {map.localAddress} to {map.protocol}:{map.moduleID}/{map.remoteAddress}");
             }
         }
@@ -190,14 +263,17 @@ namespace Nodalis
         /// </summary>
         /// <param name="localAddress">The local address to search for.</param>
         /// <returns>Returns true if the mapping is facilitated by this client.</returns>
-        public bool HasMapping(string localAddress) => mappings.Exists(m => m.localAddress == localAddress);
+        public bool HasMapping(string localAddress) => mappedAddresses.Contains(localAddress);
 
         /// <summary>
-        /// Polls each map within this client for updates, based on the interval set for each map.
+        /// Polls each map within this client for updates, based on the interval set for each map. The module is
+        /// accessed on the calling thread, so this is only used when the engine's IO is synchronous.
         /// </summary>
         /// <param name="engine">The NodalisEngine from which to get and set addresses.</param>
         public void Poll(NodalisEngine engine)
         {
+            if (!BeginConnect(engine))
+                return;
             foreach (var map in mappings)
             {
                 if (engine.ElapsedMilliseconds - map.lastPoll >= map.interval)
@@ -206,30 +282,239 @@ namespace Nodalis
                     try
                     {
                         if (map.direction == IOType.Output)
+                            WriteRemote(map, ReadLocal(engine, map));
+                        else if (ReadRemote(map, out var value))
+                            WriteLocal(engine, map, value);
+                    }
+                    catch { }
+                }
+            }
+        }
+
+        /// <summary>
+        /// Connects to the module on a task of its own if it isn't connected, no attempt is in progress and the
+        /// reconnect delay has passed. Used when the client is polled on the engine's thread, so that a module that is
+        /// offline never holds up the logic, and the clients connect concurrently.
+        /// </summary>
+        /// <param name="engine">The engine, which gives the time.</param>
+        /// <returns>Returns true if the client is connected and can be polled.</returns>
+        public bool BeginConnect(NodalisEngine engine)
+        {
+            if (connectTask != null && !connectTask.IsCompleted)
+                return false;
+            if (Volatile.Read(ref connected))
+                return true;
+            long now = engine.ElapsedMilliseconds;
+            if (connectTask != null && now - lastAttempt < reconnectDelay)
+                return false;
+            lastAttempt = now;
+            connectTask = Task.Run(() =>
+            {
+                try { Connect(); }
+                catch (Exception ex) { Console.WriteLine($"{protocol}:{moduleID} connect error: {ex.Message}"); }
+            });
+            return false;
+        }
+
+        /// <summary>
+        /// Starts polling the module on a task of its own, which connects, polls the mappings that are due and
+        /// reconnects after a failure. Values are handed to and from the engine by Exchange, so the logic never waits
+        /// for the module.
+        /// </summary>
+        /// <param name="engine">The engine, which gives the time.</param>
+        public void Start(NodalisEngine engine)
+        {
+            if (pollTask != null) return;
+            updates = Channel.CreateUnbounded<IOUpdate>(new UnboundedChannelOptions { SingleReader = true, SingleWriter = true });
+            stopping = new CancellationTokenSource();
+            var token = stopping.Token;
+            pollTask = Task.Run(() => RunAsync(engine, token));
+        }
+
+        /// <summary>
+        /// Stops the polling task and waits for it to end, and for a connection attempt made by BeginConnect.
+        /// </summary>
+        public void Stop()
+        {
+            try { connectTask?.Wait(); }
+            catch (AggregateException) { }
+            if (pollTask == null) return;
+            stopping?.Cancel();
+            try { pollTask.Wait(); }
+            catch (AggregateException) { }
+            pollTask = null;
+            OnStopped();
+        }
+
+        /// <summary>
+        /// Called when the polling task has ended, to close what it opened.
+        /// </summary>
+        protected virtual void OnStopped()
+        {
+        }
+
+        /// <summary>
+        /// Writes the inputs the polling task has read to the engine's memory, and latches the outputs for it to write.
+        /// Called on the thread that runs the logic, between scans.
+        /// </summary>
+        /// <param name="engine">The engine.</param>
+        public void Exchange(NodalisEngine engine)
+        {
+            if (updates != null)
+            {
+                while (updates.Reader.TryRead(out var update))
+                    WriteLocal(engine, update.Map, update.Value);
+            }
+            var set = mappingSet;
+            foreach (var map in set.All)
+            {
+                if (map.outputIndex >= 0)
+                    Volatile.Write(ref set.OutputValues[map.outputIndex], ReadLocal(engine, map));
+            }
+        }
+
+        private async Task RunAsync(NodalisEngine engine, CancellationToken token)
+        {
+            var due = new List<IOMap>();
+            while (!token.IsCancellationRequested)
+            {
+                try
+                {
+                    if (!connected)
+                    {
+                        await ConnectAsync(token);
+                        if (!connected)
                         {
-                            switch (map.width)
-                            {
-                                case 1: WriteBit(map.remoteAddress, engine.ReadBit(map.localAddress) ? 1 : 0); break;
-                                case 8: WriteByte(map.remoteAddress, engine.ReadByte(map.localAddress)); break;
-                                case 16: WriteWord(map.remoteAddress, engine.ReadWord(map.localAddress)); break;
-                                case 32: WriteDWord(map.remoteAddress, engine.ReadDWord(map.localAddress)); break;
-                                case 64: WriteLWord(map.remoteAddress, engine.ReadLWord(map.localAddress)); break;
-                            }
+                            await Task.Delay(reconnectDelay, token);
+                            continue;
                         }
-                        else
+                    }
+                    var set = Volatile.Read(ref mappingSet);
+                    long now = engine.ElapsedMilliseconds;
+                    long next = now + 100;
+                    due.Clear();
+                    foreach (var map in set.All)
+                    {
+                        if (now - map.lastPoll >= map.interval)
                         {
-                            switch (map.width)
-                            {
-                                case 1: if (ReadBit(map.remoteAddress, out var bit)) engine.WriteBit(map.localAddress, bit != 0); break;
-                                case 8: if (ReadByte(map.remoteAddress, out var b)) engine.WriteByte(map.localAddress, b); break;
-                                case 16: if (ReadWord(map.remoteAddress, out var w)) engine.WriteWord(map.localAddress, w); break;
-                                case 32: if (ReadDWord(map.remoteAddress, out var d)) engine.WriteDWord(map.localAddress, d); break;
-                                case 64: if (ReadLWord(map.remoteAddress, out var l)) engine.WriteLWord(map.localAddress, l); break;
-                            }
+                            map.lastPoll = now;
+                            due.Add(map);
                         }
+                        next = Math.Min(next, map.lastPoll + map.interval);
                     }
-                    catch { }
+                    if (due.Count > 0)
+                        await PollAsync(due, token);
+                    long wait = next - engine.ElapsedMilliseconds;
+                    await Task.Delay((int)Math.Max(1, wait), token);
+                }
+                catch (OperationCanceledException)
+                {
+                    break;
+                }
+                catch (Exception ex)
+                {
+                    Console.WriteLine($"{protocol}:{moduleID} IO error: {ex.Message}");
+                }
+            }
+        }
+
+        /// <summary>
+        /// Connects to the module from the polling task. The default connects synchronously, on the task's thread.
+        /// </summary>
+        /// <param name="token">Cancelled when the client is stopped.</param>
+        protected virtual Task ConnectAsync(CancellationToken token)
+        {
+            Connect();
+            return Task.CompletedTask;
+        }
+
+        /// <summary>
+        /// Polls the mappings that are due, from the polling task. Inputs are handed to the engine with PostInput, and
+        /// outputs are taken from OutputValue. The default accesses each mapping with the synchronous methods.
+        /// </summary>
+        /// <param name="due">The mappings that are due.</param>
+        /// <param name="token">Cancelled when the client is stopped.</param>
+        protected virtual Task PollAsync(List<IOMap> due, CancellationToken token)
+        {
+            foreach (var map in due)
+            {
+                try
+                {
+                    if (map.direction == IOType.Output)
+                        WriteRemote(map, OutputValue(map));
+                    else if (ReadRemote(map, out var value))
+                        PostInput(map, value);
                 }
+                catch { }
+            }
+            return Task.CompletedTask;
+        }
+
+        /// <summary>
+        /// Queues a value read from the module, to be written to the engine's memory by the next Exchange.
+        /// </summary>
+        /// <param name="map">The input mapping.</param>
+        /// <param name="value">The value, in its low bits.</param>
+        protected void PostInput(IOMap map, ulong value) => updates?.Writer.TryWrite(new IOUpdate(map, value));
+
+        /// <summary>
+        /// Gets the value of an output as the last Exchange latched it.
+        /// </summary>
+        /// <param name="map">The output mapping.</param>
+        /// <returns>Returns the value, in its low bits.</returns>
+        protected ulong OutputValue(IOMap map)
+        {
+            var set = Volatile.Read(ref mappingSet);
+            return map.outputIndex >= 0 && map.outputIndex < set.OutputValues.Length ? Volatile.Read(ref set.OutputValues[map.outputIndex]) : 0;
+        }
+
+        private static ulong ReadLocal(NodalisEngine engine, IOMap map) => map.width switch
+        {
+            1 => engine.ReadBit(map.localAddress) ? 1UL : 0UL,
+            8 => engine.ReadByte(map.localAddress),
+            16 => engine.ReadWord(map.localAddress),
+            32 => engine.ReadDWord(map.localAddress),
+            64 => engine.ReadLWord(map.localAddress),
+            _ => 0
+        };
+
+        private static void WriteLocal(NodalisEngine engine, IOMap map, ulong value)
+        {
+            engine.InputRead(map.localAddress);
+            switch (map.width)
+            {
+                case 1: engine.WriteBit(map.localAddress, value != 0); break;
+                case 8: engine.WriteByte(map.localAddress, (byte)value); break;
+                case 16: engine.WriteWord(map.localAddress, (ushort)value); break;
+                case 32: engine.WriteDWord(map.localAddress, (uint)value); break;
+                case 64: engine.WriteLWord(map.localAddress, value); break;
+            }
+        }
+
+        private bool ReadRemote(IOMap map, out ulong value)
+        {
+            value = 0;
+            bool read = false;
+            switch (map.width)
+            {
+                case 1: read = ReadBit(map.remoteAddress, out var bit); value = (ulong)bit; break;
+                case 8: read = ReadByte(map.remoteAddress, out var b); value = b; break;
+                case 16: read = ReadWord(map.remoteAddress, out var w); value = w; break;
+                case 32: read = ReadDWord(map.remoteAddress, out var d); value = d; break;
+                case 64: read = ReadLWord(map.remoteAddress, out var l); value = l; break;
+            }
+            return read;
+        }
+
+        private void WriteRemote(IOMap map, ulong value)
+        {
+            switch (map.width)
+            {
+                case 1: WriteBit(map.remoteAddress, value != 0 ? 1 : 0); break;
+                case 8: WriteByte(map.remoteAddress, (byte)value); break;
+                case 16: WriteWord(map.remoteAddress, (ushort)value); break;
+                case 32: WriteDWord(map.remoteAddress, (uint)value); break;
+                case 64: WriteLWord(map.remoteAddress, value); break;
             }
         }
         /// <summary>
@@ -361,9 +646,36 @@ namespace Nodalis
         /// <summary>
         /// The Jint engine to use in executing code.
         /// </summary>
-        protected readonly Engine JsEngine = new Engine(cfg => { cfg.AllowClr(); });
+        protected readonly Engine JsEngine;
+
+        private static readonly object[] NoArguments = Array.Empty<object>();
+        private Prepared<Acornima.Ast.Script>? _script;
+        private JsValue? _setup;
+        private JsValue? _run;
+        // A reference is created each time the program that declares it runs, so each address gets one reference,
+        // and one JS wrapper of it, which are reused.
+        private readonly Dictionary<string, object> _references = new();
+        private readonly Dictionary<string, JsValue> _referenceValues = new();
 
         private readonly List<IOClient> Clients = new();
+        // The client of each module, and the first mapping of each local address, so that MapIO doesn't search.
+        private readonly Dictionary<string, IOClient> _clientsByModule = new();
+        private readonly Dictionary<string, IOMap> _mappedAddresses = new();
+        // The mapped inputs that haven't been read yet, by address.
+        private readonly ConcurrentDictionary<string, byte> _pendingInputs = new();
+        /// <summary>
+        /// Polls the IO clients on the thread that calls SuperviseIO, as before the clients had polling tasks of their
+        /// own. Must be set before the program maps its IO.
+        /// </summary>
+        public bool SynchronousIO { get; set; }
+        /// <summary>
+        /// Runs the IO on the C++ runtime's clients, from the nodalisio library that the compiler's nativeIO option
+        /// builds, instead of the managed clients. The engine's memory must be one ProcessImage laid out like the
+        /// runtime's. Must be set before the program maps its IO; if the library can't be used, the managed clients
+        /// are.
+        /// </summary>
+        public bool NativeIO { get; set; }
+        private bool? _nativeIOOpen;
         private readonly DateTime StartTime = DateTime.UtcNow;
 
         /// <summary>
@@ -374,24 +686,72 @@ namespace Nodalis
         /// <summary>
         /// Instantiates a new engine.
         /// </summary>
-        public NodalisEngine()
+        public NodalisEngine() : this(null)
+        {
+        }
+
+        /// <summary>
+        /// Instantiates a new engine with options for Jint, such as the constraints a scan runs under
+        /// (TimeoutInterval, MaxStatements, LimitRecursion, LimitMemory). Constraints are reset before each scan.
+        /// </summary>
+        /// <param name="configure">Sets the options of the Jint engine, or null for the defaults.</param>
+        public NodalisEngine(Action<Options>? configure)
         {
+            JsEngine = new Engine(cfg =>
+            {
+                cfg.AllowClr();
+                configure?.Invoke(cfg);
+            });
             InjectBindings();
         }
 
+        /// <summary>
+        /// Parses javascript code once, so that it can be loaded into any number of engines.
+        /// </summary>
+        /// <param name="code">The javascript code to parse.</param>
+        /// <returns>Returns the prepared script.</returns>
+        public static Prepared<Acornima.Ast.Script> Prepare(string code) => Engine.PrepareScript(code);
         /// <summary>
         /// Loads the javascript code for the engine.
         /// </summary>
         /// <param name="code">The javascript code to load.</param>
-        public void Load(string code) => JsEngine.Execute(code);
+        public void Load(string code) => Load(Prepare(code));
+        /// <summary>
+        /// Loads a prepared script for the engine.
+        /// </summary>
+        /// <param name="script">The script, from Prepare.</param>
+        public void Load(Prepared<Acornima.Ast.Script> script)
+        {
+            _script = script;
+            _setup = null;
+            _run = null;
+            JsEngine.Execute(script);
+        }
+        /// <summary>
+        /// Loads the script that was last loaded again, without parsing it, which restarts the program.
+        /// </summary>
+        public void Reload()
+        {
+            if (_script.HasValue)
+                Load(_script.Value);
+        }
         /// <summary>
         /// Calls the "setup()" function within JS that was previously loaded by "Load"
         /// </summary>
-        public void Setup() => JsEngine.Invoke("setup");
+        public void Setup()
+        {
+            JsEngine.Constraints.Reset();
+            JsEngine.Invoke(_setup ??= JsEngine.GetValue("setup"), NoArguments);
+        }
         /// <summary>
-        /// Calls the "run()" function within JS that was previously loaded by "Load"
+        /// Calls the "run()" function within JS that was previously loaded by "Load". The function is looked up once,
+        /// after the script is loaded.
         /// </summary>
-        public void Execute() => JsEngine.Invoke("run");
+        public void Execute()
+        {
+            JsEngine.Constraints.Reset();
+            JsEngine.Invoke(_run ??= JsEngine.GetValue("run"), NoArguments);
+        }
         /// <summary>
         /// Instantiates a new FunctionBlock from the Javascript.
         /// </summary>
@@ -407,32 +767,117 @@ namespace Nodalis
         /// <param name="json">The JSON string representing a mapping of IO.</param>
         public void MapIO(string json)
         {
+            if (UsesNativeIO())
+            {
+                NativeIOLibrary.Map(json);
+                return;
+            }
             try
             {
                 var map = new IOMap(json);
-                var client = Clients.Find(c => c.HasMapping(map.localAddress) || c.moduleID == map.moduleID);
-                if (client == null)
-                { 
+                // An address is mapped once. Mapping it again from another module or remote address is a conflict,
+                // and the first mapping is kept.
+                if (_mappedAddresses.TryGetValue(map.localAddress, out var first))
+                {
+                    if (first.moduleID != map.moduleID || first.remoteAddress != map.remoteAddress)
+                        Console.WriteLine($"mapIO conflict: {map.localAddress} is mapped from {first.moduleID}/{first.remoteAddress} and from {map.moduleID}/{map.remoteAddress}; the first mapping is kept");
+                    return;
+                }
+                if (map.direction == IOType.Input)
+                    _pendingInputs.TryAdd(map.localAddress, 0);
+                if (_clientsByModule.TryGetValue(map.moduleID, out var client))
+                    client.AddMapping(map);
+                else
+                {
                     client = CreateClient(map);
                     if (client != null)
                     {
-                        client.Connect();
+                        if (SynchronousIO)
+                            client.BeginConnect(this);
+                        else
+                            client.Start(this);
                         Clients.Add(client);
+                        _clientsByModule[map.moduleID] = client;
                     }
                 }
-                else client.AddMapping(map);
+                _mappedAddresses[map.localAddress] = map;
             }
             catch (Exception ex) { Console.WriteLine($"mapIO error: {ex.Message}"); }
         }
         /// <summary>
-        /// Supervises the IOClients that have been added based on mappings.
+        /// Determines whether an input has been read since it was mapped, so that a server can report the inputs that
+        /// are still waiting for their first read as bad. Addresses that aren't mapped inputs are always good.
+        /// </summary>
+        /// <param name="address">The address, as it was mapped.</param>
+        /// <returns>Returns false while the input is waiting for its first read.</returns>
+        public bool IsInputGood(string address) => _pendingInputs.IsEmpty || !_pendingInputs.ContainsKey(address);
+        /// <summary>
+        /// Records that an input has been read.
+        /// </summary>
+        /// <param name="address">The address, as it was mapped.</param>
+        internal void InputRead(string address)
+        {
+            if (!_pendingInputs.IsEmpty)
+                _pendingInputs.TryRemove(address, out _);
+        }
+        /// <summary>
+        /// Supervises the IOClients that have been added based on mappings. Each client polls its module on a task of
+        /// its own, so this only writes the inputs they have read to memory and latches the outputs for them, and
+        /// never waits for a module. With SynchronousIO, the clients are polled here instead.
         /// </summary>
         public void SuperviseIO()
         {
+            if (UsesNativeIO())
+            {
+                if (SynchronousIO)
+                    NativeIOLibrary.Poll();
+                NativeIOLibrary.Exchange(ProcessImage!);
+                return;
+            }
             foreach (var client in Clients)
             {
-                client.Poll(this);
+                if (SynchronousIO)
+                    client.Poll(this);
+                else
+                    client.Exchange(this);
+            }
+        }
+        /// <summary>
+        /// Stops the polling tasks of the IO clients.
+        /// </summary>
+        public void StopIO()
+        {
+            foreach (var client in Clients)
+            {
+                client.Stop();
+            }
+        }
+        /// <summary>
+        /// Opens the nodalisio library the first time the IO is used with NativeIO, and starts its clients on a
+        /// thread of their own unless the IO is synchronous.
+        /// </summary>
+        /// <returns>Returns true if the IO runs on the library.</returns>
+        private bool UsesNativeIO()
+        {
+            if (_nativeIOOpen == null)
+            {
+                _nativeIOOpen = false;
+                if (NativeIO)
+                {
+                    var image = ProcessImage;
+                    if (image == null)
+                        Console.WriteLine("Native IO needs an engine with a process image, so the managed IO clients are used.");
+                    else if (!NativeIOLibrary.TryOpen(image, out var error))
+                        Console.WriteLine($"{error} The managed IO clients are used.");
+                    else
+                    {
+                        if (!SynchronousIO)
+                            NativeIOLibrary.Start(1, null);
+                        _nativeIOOpen = true;
+                    }
+                }
             }
+            return _nativeIOOpen.Value;
         }
         /// <summary>
         /// Creates an IO Client based on the map.
@@ -485,8 +930,7 @@ namespace Nodalis
         /// <returns>Returns the state of the bit.</returns>
         public static bool GetBit<T>(RefVar<T> var, int bit) where T : struct
         {
-            ulong val = Convert.ToUInt64(var.Value);
-            return (val & (1u << bit)) != 0;
+            return (var.Bits & (1UL << bit)) != 0;
         }
         /// <summary>
         /// Sets the bit within a refvar object.
@@ -497,9 +941,8 @@ namespace Nodalis
         /// <param name="state">The state of the bit to set.</param>
         public static void SetBit<T>(ref RefVar<T> var, int bit, bool state) where T : struct
         {
-            ulong val = Convert.ToUInt64(var.Value);
-            val = state ? (val | (1u << bit)) : (val & ~(1u << bit));
-            var.Value = (T)Convert.ChangeType(val, typeof(T));
+            ulong val = var.Bits;
+            var.Bits = state ? (val | (1UL << bit)) : (val & ~(1UL << bit));
         }
         /// <summary>
         /// Reads a bit from memory.
@@ -562,23 +1005,38 @@ namespace Nodalis
         /// <param name="value">The value to write.</param>
         public abstract void WriteLWord(string address, ulong value);
         /// <summary>
-        /// Creates a RefVar object based on the type of the address given.
+        /// Resolves an address to its memory cell, so that a reference can access it without parsing the address again.
+        /// Engines that keep their memory in cells of 64 bits should override this; the default returns null, and
+        /// references then use the Read and Write methods with the address.
+        /// </summary>
+        /// <param name="address">The address to resolve.</param>
+        /// <returns>Returns the handle of the address, or null if the engine doesn't resolve addresses.</returns>
+        public virtual AddressHandle? ResolveAddress(string address) => null;
+        /// <summary>
+        /// The engine's memory as one process image: %I, %Q and %M, in that order, in cells of 64 bits, with the sizes
+        /// of the C++ runtime's spaces. Engines that keep their memory this way should override this so that their IO
+        /// can run with NativeIO; the default returns null.
+        /// </summary>
+        public virtual ulong[]? ProcessImage => null;
+        /// <summary>
+        /// Creates a RefVar object based on the type of the address given. An address gets one reference, which is
+        /// returned again for later calls.
         /// </summary>
         /// <param name="address">The address to create a reference for.</param>
         /// <returns></returns>
         public object CreateReference(string address)
         {
-            address = address.ToUpperInvariant();
-
-            Type type = typeof(bool);
-            if (address.Contains(".")) type = typeof(bool);
-            else if (address.Contains("W")) type = typeof(ushort);
-            else if (address.Contains("D")) type = typeof(uint);
-            else if (address.Contains("X")) type = typeof(byte);
+            if (_references.TryGetValue(address, out var reference))
+                return reference;
 
-            var refVarType = typeof(RefVar<>).MakeGenericType(type);
-            var instance = Activator.CreateInstance(refVarType, this, address);
-            return instance;
+            string upper = address.ToUpperInvariant();
+            if (upper.Contains('.')) reference = new RefVar<bool>(this, upper);
+            else if (upper.Contains('W')) reference = new RefVar<ushort>(this, upper);
+            else if (upper.Contains('D')) reference = new RefVar<uint>(this, upper);
+            else if (upper.Contains('X')) reference = new RefVar<byte>(this, upper);
+            else reference = new RefVar<bool>(this, upper);
+            _references[address] = reference;
+            return reference;
         }
 
         /// <summary>
@@ -610,83 +1068,96 @@ namespace Nodalis
             JsEngine.SetValue(name, variable);
         }
 
+        /// <summary>
+        /// Creates a function that can be called from JS. Unlike a delegate, which Jint calls through reflection, it is
+        /// called directly with the JS arguments.
+        /// </summary>
+        /// <param name="name">The name of the function.</param>
+        /// <param name="length">The number of arguments.</param>
+        /// <param name="func">The function.</param>
+        /// <returns>Returns the function.</returns>
+        private ClrFunction HostFunction(string name, int length, Func<JsValue[], JsValue> func) =>
+            new ClrFunction(JsEngine, name, (thisObj, args) => func(args), length, PropertyFlag.Configurable | PropertyFlag.Writable);
+
+        private static JsValue ToJs(IRefVar reference) =>
+            reference.IsBit ? (reference.Bits != 0 ? JsBoolean.True : JsBoolean.False) : JsNumber.Create((double)reference.Bits);
+
         private void InjectBindings()
         {
-            JsEngine.SetValue("readBit", new Func<string, bool>(ReadBit));
-            JsEngine.SetValue("writeBit", new Action<string, bool>(WriteBit));
-            JsEngine.SetValue("readByte", new Func<string, byte>(ReadByte));
-            JsEngine.SetValue("writeByte", new Action<string, byte>(WriteByte));
-            JsEngine.SetValue("readWord", new Func<string, ushort>(ReadWord));
-            JsEngine.SetValue("writeWord", new Action<string, ushort>(WriteWord));
-            JsEngine.SetValue("readDWord", new Func<string, uint>(ReadDWord));
-            JsEngine.SetValue("writeDWord", new Action<string, uint>(WriteDWord));
-            JsEngine.SetValue("readLWord", new Func<string, ulong>(ReadLWord));
-            JsEngine.SetValue("writeLWord", new Action<string, ulong>(WriteLWord));
-            JsEngine.SetValue("elapsed", new Func<long>(() => ElapsedMilliseconds));
+            // Located variables are read and written by address on every scan, so these are the engine's hot paths.
+            JsEngine.SetValue("readBit", HostFunction("readBit", 1, args => ReadBit(args[0].AsString()) ? JsBoolean.True : JsBoolean.False));
+            JsEngine.SetValue("writeBit", HostFunction("writeBit", 2, args =>
+            {
+                WriteBit(args[0].AsString(), TypeConverter.ToBoolean(args[1]));
+                return JsValue.Undefined;
+            }));
+            JsEngine.SetValue("readByte", HostFunction("readByte", 1, args => JsNumber.Create((int)ReadByte(args[0].AsString()))));
+            JsEngine.SetValue("writeByte", HostFunction("writeByte", 2, args =>
+            {
+                WriteByte(args[0].AsString(), (byte)TypeConverter.ToUint32(args[1]));
+                return JsValue.Undefined;
+            }));
+            JsEngine.SetValue("readWord", HostFunction("readWord", 1, args => JsNumber.Create((int)ReadWord(args[0].AsString()))));
+            JsEngine.SetValue("writeWord", HostFunction("writeWord", 2, args =>
+            {
+                WriteWord(args[0].AsString(), (ushort)TypeConverter.ToUint32(args[1]));
+                return JsValue.Undefined;
+            }));
+            JsEngine.SetValue("readDWord", HostFunction("readDWord", 1, args => JsNumber.Create((double)ReadDWord(args[0].AsString()))));
+            JsEngine.SetValue("writeDWord", HostFunction("writeDWord", 2, args =>
+            {
+                WriteDWord(args[0].AsString(), TypeConverter.ToUint32(args[1]));
+                return JsValue.Undefined;
+            }));
+            JsEngine.SetValue("readLWord", HostFunction("readLWord", 1, args => JsNumber.Create((double)ReadLWord(args[0].AsString()))));
+            JsEngine.SetValue("writeLWord", HostFunction("writeLWord", 2, args =>
+            {
+                WriteLWord(args[0].AsString(), (ulong)(long)TypeConverter.ToNumber(args[1]));
+                return JsValue.Undefined;
+            }));
+            JsEngine.SetValue("elapsed", HostFunction("elapsed", 0, args => JsNumber.Create((double)ElapsedMilliseconds)));
             JsEngine.SetValue("mapIO", new Action<string>(MapIO));
             JsEngine.SetValue("superviseIO", new Action(SuperviseIO));
-            JsEngine.SetValue("writeDWord", new Action<string, uint>(WriteDWord));
             JsEngine.SetValue("log", new Action<string>(Console.WriteLine));
             JsEngine.SetValue("error", new Action<string>(Console.Error.WriteLine));
 
-            var funcFlags = PropertyFlag.Configurable | PropertyFlag.Writable;
-
-            JsEngine.SetValue("getBit", new ClrFunction(JsEngine, "getBit", (thisObj, args) =>
+            JsEngine.SetValue("getBit", HostFunction("getBit", 2, args =>
             {
+                var bit = (int)args[1].AsNumber();
                 if (args[0].IsObject())
                 {
-                    var jsObj = args[0].AsObject();
-                    var refObj = jsObj.ToObject();
-                    if (refObj != null && refObj.GetType().IsGenericType && refObj.GetType().GetGenericTypeDefinition() == typeof(RefVar<>))
-                    {
-
-                        var bit = (int)args[1].AsNumber();
-                        var method = typeof(NodalisEngine).GetMethod("GetBit").MakeGenericMethod(refObj.GetType().GetGenericArguments()[0]);
-                        return (bool)method.Invoke(null, new[] { refObj, bit });
-                    }
-                    else
-                    {
-                        return false;
-                    }
+                    return args[0].ToObject() is IRefVar reference && (reference.Bits & (1UL << bit)) != 0 ? JsBoolean.True : JsBoolean.False;
                 }
-                else
-                {
-                    var value = (uint)args[0].AsNumber();
-                    var bit = (int)args[1].AsNumber();
-                    return GetBit(value, bit);
-                }
-            }, 2, funcFlags));
+                return GetBit((uint)args[0].AsNumber(), bit) ? JsBoolean.True : JsBoolean.False;
+            }));
 
-            JsEngine.SetValue("setBit", new ClrFunction(JsEngine, "setBit", (thisObj, args) =>
+            JsEngine.SetValue("setBit", HostFunction("setBit", 3, args =>
             {
-                if (args[0].ToObject() is RefVar<bool> refVar)
+                var bit = (int)args[1].AsNumber();
+                var state = args[2].AsBoolean();
+                if (args[0].ToObject() is IRefVar reference)
                 {
-                    var jsObj = args[0].AsObject();
-                    var refObj = jsObj.ToObject();
-                    var bit = (int)args[1].AsNumber();
-                    var state = args[2].AsBoolean();
-                    var method = typeof(NodalisEngine).GetMethod("SetBit", new[] { refObj.GetType(), typeof(int), typeof(bool) });
-                    if (method != null)
-                    {
-                        var parameters = new object[] { refObj, bit, state };
-                        method.Invoke(null, parameters);
-                    }
+                    ulong bits = reference.Bits;
+                    reference.Bits = state ? (bits | (1UL << bit)) : (bits & ~(1UL << bit));
                     return JsValue.Undefined;
                 }
-                else
+                var value = (ulong)args[0].AsNumber();
+                SetBit(ref value, bit, state);
+                return JsValue.FromObject(JsEngine, value);
+            }));
+
+            JsEngine.SetValue("createReference", HostFunction("createReference", 1, args =>
+            {
+                var address = args[0].AsString();
+                if (!_referenceValues.TryGetValue(address, out var value))
                 {
-                    var value = (ulong)args[0].AsNumber();
-                    var bit = (int)args[1].AsNumber();
-                    var state = args[2].AsBoolean();
-                    SetBit(ref value, bit, state);
-                    return JsValue.FromObject(JsEngine, value);
+                    value = JsValue.FromObject(JsEngine, CreateReference(address));
+                    _referenceValues[address] = value;
                 }
-            }, 3, funcFlags));
-
-            JsEngine.SetValue("createReference", new Func<string, object>(CreateReference));
+                return value;
+            }));
 
-
-            JsEngine.SetValue("newStatic", new ClrFunction(JsEngine, "newStatic", (thisObj, args) =>
+            JsEngine.SetValue("newStatic", HostFunction("newStatic", 2, args =>
             {
                 var key = args[0].AsString();
                 var jsCtor = args[1];
@@ -698,19 +1169,10 @@ namespace Nodalis
 
                 _staticStore[key] = instance;
                 return instance;
-            }, 2, funcFlags));
+            }));
 
-            JsEngine.SetValue("resolve", new ClrFunction(JsEngine, "resolve", (thisObj, args) =>
-            {
-                var val = args[0].ToObject();
-                if (val != null && val.GetType().IsGenericType &&
-                    val.GetType().GetGenericTypeDefinition() == typeof(RefVar<>))
-                {
-                    var valueProp = val.GetType().GetProperty("Value");
-                    return JsValue.FromObject(JsEngine, valueProp.GetValue(val));
-                }
-                return args[0];
-            }, 1, funcFlags));
+            JsEngine.SetValue("resolve", HostFunction("resolve", 1, args =>
+                args[0].IsObject() && args[0].ToObject() is IRefVar reference ? ToJs(reference) : args[0]));
 
             var types = new[] {
                 typeof(TON), typeof(TOF), typeof(TP), typeof(AND), typeof(OR), typeof(NOT), typeof(XOR),
@@ -724,11 +1186,85 @@ namespace Nodalis
         }
     }
 
+    /// <summary>
+    /// An address resolved to the memory cell that holds it, and the position of its value within the cell.
+    /// </summary>
+    public readonly struct AddressHandle
+    {
+        /// <summary>
+        /// The memory the cell is in.
+        /// </summary>
+        public readonly ulong[] Memory;
+        /// <summary>
+        /// The index of the cell in the memory.
+        /// </summary>
+        public readonly int Cell;
+        /// <summary>
+        /// The position of the value's lowest bit in the cell.
+        /// </summary>
+        public readonly int Shift;
+        /// <summary>
+        /// The mask of the value, before it is shifted.
+        /// </summary>
+        public readonly ulong Mask;
+        /// <summary>
+        /// Constructs a handle to a value within a memory cell.
+        /// </summary>
+        /// <param name="memory">The memory the cell is in.</param>
+        /// <param name="cell">The index of the cell.</param>
+        /// <param name="shift">The position of the value's lowest bit in the cell.</param>
+        /// <param name="width">The width of the value in bits: 1, 8, 16, 32 or 64.</param>
+        public AddressHandle(ulong[] memory, int cell, int shift, int width)
+        {
+            Memory = memory;
+            Cell = cell;
+            Shift = shift;
+            Mask = width >= 64 ? ulong.MaxValue : (1UL << width) - 1;
+        }
+        /// <summary>
+        /// Gets a reference to the cell.
+        /// </summary>
+        public ref ulong Location => ref Memory[Cell];
+        /// <summary>
+        /// Reads the value.
+        /// </summary>
+        /// <returns>Returns the value, in its low bits.</returns>
+        public ulong Read() => (Memory[Cell] >> Shift) & Mask;
+        /// <summary>
+        /// Writes the value, truncated to its width.
+        /// </summary>
+        /// <param name="value">The value to write.</param>
+        public void Write(ulong value)
+        {
+            ref ulong cell = ref Memory[Cell];
+            cell = (cell & ~(Mask << Shift)) | ((value & Mask) << Shift);
+        }
+    }
+
+    /// <summary>
+    /// The untyped view of a RefVar, which the JS bindings use without knowing its type.
+    /// </summary>
+    public interface IRefVar
+    {
+        /// <summary>
+        /// Gets the address of the reference.
+        /// </summary>
+        string Address { get; }
+        /// <summary>
+        /// Indicates whether the reference is to a bit.
+        /// </summary>
+        bool IsBit { get; }
+        /// <summary>
+        /// Gets or sets the value of the reference as an unsigned integer.
+        /// </summary>
+        ulong Bits { get; set; }
+    }
+
     /// <summary>
     /// Defines a reference variable, used like a pointer.
     /// </summary>
     /// <typeparam name="T">The type of the reference.</typeparam>
-    public class RefVar<T> where T : struct
+    public class RefVar<T> : IRefVar where T : struct
     {
         /// <summary>
         /// When assigned, the RefVar returns the value it contains.
@@ -741,53 +1277,103 @@ namespace Nodalis
 
         private readonly NodalisEngine _engine;
         private readonly string _address;
+        private readonly AddressHandle? _handle;
         /// <summary>
-        /// Constructs a new RefVar based on the NodalisEngine and the PLC address.
+        /// Constructs a new RefVar based on the NodalisEngine and the PLC address. The address is resolved once, here,
+        /// if the engine resolves addresses.
         /// </summary>
         /// <param name="engine">The engine to use in referencing memory.</param>
         /// <param name="address">The PLC address from which to create the reference.</param>
         public RefVar(NodalisEngine engine, string address)
         {
+            if (typeof(T) != typeof(bool) && typeof(T) != typeof(byte) && typeof(T) != typeof(ushort) && typeof(T) != typeof(uint))
+                throw new NotSupportedException($"Unsupported RefVar type: {typeof(T)}");
             _engine = engine;
             _address = address;
+            _handle = engine.ResolveAddress(address);
         }
         /// <summary>
         /// Gets or sets the value of the reference.
         /// </summary>
         public T Value
         {
-            get => Read();
-            set => Write(value);
+            get => FromBits(Bits);
+            set => Bits = ToBits(value);
         }
         /// <summary>
         /// Gets the address of the reference.
         /// </summary>
         public string Address => _address;
 
-        private T Read()
+        /// <summary>
+        /// Indicates whether the reference is to a bit.
+        /// </summary>
+        public bool IsBit => typeof(T) == typeof(bool);
+
+        /// <summary>
+        /// Gets or sets the value of the reference as an unsigned integer.
+        /// </summary>
+        public ulong Bits
+        {
+            get
+            {
+                if (_handle.HasValue)
+                    return _handle.Value.Read();
+                if (typeof(T) == typeof(bool))
+                    return _engine.ReadBit(_address) ? 1UL : 0UL;
+                if (typeof(T) == typeof(byte))
+                    return _engine.ReadByte(_address);
+                if (typeof(T) == typeof(ushort))
+                    return _engine.ReadWord(_address);
+                return _engine.ReadDWord(_address);
+            }
+            set
+            {
+                if (_handle.HasValue)
+                    _handle.Value.Write(value);
+                else if (typeof(T) == typeof(bool))
+                    _engine.WriteBit(_address, value != 0);
+                else if (typeof(T) == typeof(byte))
+                    _engine.WriteByte(_address, (byte)value);
+                else if (typeof(T) == typeof(ushort))
+                    _engine.WriteWord(_address, (ushort)value);
+                else
+                    _engine.WriteDWord(_address, (uint)value);
+            }
+        }
+
+        // The typeof(T) tests are constants in each instantiation, so the JIT keeps only the branch for T, and
+        // Unsafe.As reinterprets the value in place of boxing it.
+        private static T FromBits(ulong bits)
         {
             if (typeof(T) == typeof(bool))
-                return (T)(object)_engine.ReadBit(_address);
+            {
+                bool value = bits != 0;
+                return Unsafe.As<bool, T>(ref value);
+            }
             if (typeof(T) == typeof(byte))
-                return (T)(object)_engine.ReadByte(_address);
+            {
+                byte value = (byte)bits;
+                return Unsafe.As<byte, T>(ref value);
+            }
             if (typeof(T) == typeof(ushort))
-                return (T)(object)_engine.ReadWord(_address);
-            if (typeof(T) == typeof(uint))
-                return (T)(object)_engine.ReadDWord(_address);
-            throw new NotSupportedException($"Unsupported RefVar type: {typeof(T)}");
+            {
+                ushort value = (ushort)bits;
+                return Unsafe.As<ushort, T>(ref value);
+            }
+            uint word = (uint)bits;
+            return Unsafe.As<uint, T>(ref word);
         }
 
-        private void Write(T value)
+        private static ulong ToBits(T value)
         {
             if (typeof(T) == typeof(bool))
-                _engine.WriteBit(_address, (bool)(object)value);
-            else if (typeof(T) == typeof(byte))
-                _engine.WriteByte(_address, (byte)(object)value);
-            else if (typeof(T) == typeof(ushort))
-                _engine.WriteWord(_address, (ushort)(object)value);
-            else if (typeof(T) == typeof(uint))
-                _engine.WriteDWord(_address, (uint)(object)value);
-            else throw new NotSupportedException($"Unsupported RefVar type: {typeof(T)}");
+                return Unsafe.As<T, bool>(ref value) ? 1UL : 0UL;
+            if (typeof(T) == typeof(byte))
+                return Unsafe.As<T, byte>(ref value);
+            if (typeof(T) == typeof(ushort))
+                return Unsafe.As<T, ushort>(ref value);
+            return Unsafe.As<T, uint>(ref value);
         }
     }
 
@@ -189,7 +189,8 @@ namespace Nodalis
                     try
                     {
                         value = ReadFromEngine(addr);
-                        statusCode = StatusCodes.Good;
+                        // An input waiting for its first read from its module has only its initial value.
+                        statusCode = _engine.IsInputGood(addr) ? StatusCodes.Good : StatusCodes.BadWaitingForInitialData;
                         timestamp = DateTime.UtcNow;
                         return ServiceResult.Good;
                     }
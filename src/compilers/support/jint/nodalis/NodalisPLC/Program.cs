@@ -17,6 +17,7 @@
 /// </summary>
 
 using System;
+using System.Collections.Concurrent;
 using System.IO;
 using System.Threading;
 using Jint;
@@ -27,66 +28,44 @@ using System.Text.RegularExpressions;
 
 class ProgramEngine : NodalisEngine
 {
-    private static readonly ulong[,] MEMORY = new ulong[64, 16];
-
-    public override bool ReadBit(string address)
+    // The memory spaces follow each other in one process image of 64 bit cells, laid out like the C++ runtime's so
+    // that it can be exchanged with the nodalisio library: 512 bytes of inputs, 512 bytes of outputs and 7168 bytes of
+    // memory. Each space is given by its first cell and its number of cells.
+    private static readonly ulong[] IMAGE = new ulong[64 + 64 + 64 * 14];
+    private static readonly (int First, int Cells)[] SPACES = { (0, 64), (64, 64), (128, 64 * 14) };
+    private static readonly Regex ADDRESS = new Regex(@"%([IQM])([XBWDL])(\d+)(?:\.(\d+))?", RegexOptions.IgnoreCase | RegexOptions.Compiled);
+
+    // The programs and the IO clients access the same few addresses on every scan, so each address is parsed once
+    // and its handle is kept. The OPC UA server reads from its own threads, so the cache is concurrent.
+    private readonly ConcurrentDictionary<string, AddressHandle> _handles = new();
+
+    public ProgramEngine(Action<Options>? configure) : base(configure)
     {
-        var mem = ParseAddress(address);
-        return (GetMemoryCell(mem[0], mem[2]) & (1UL << (mem[3] % 64))) != 0;
     }
 
-    public override byte ReadByte(string address)
-    {
-        var mem = ParseAddress(address);
-        return (byte)((GetMemoryCell(mem[0], mem[2]) >> (mem[3] % 64)) & 0xFF);
-    }
+    public override bool ReadBit(string address) => Resolve(address, true).Read() != 0;
 
-    public override ushort ReadWord(string address)
-    {
-        var mem = ParseAddress(address);
-        return (ushort)((GetMemoryCell(mem[0], mem[2]) >> (mem[3] % 64)) & 0xFFFF);
-    }
+    public override byte ReadByte(string address) => (byte)Resolve(address, false).Read();
 
-    public override uint ReadDWord(string address)
-    {
-        var mem = ParseAddress(address);
-        return (uint)((GetMemoryCell(mem[0], mem[2]) >> (mem[3] % 64)) & 0xFFFFFFFF);
-    }
+    public override ushort ReadWord(string address) => (ushort)Resolve(address, false).Read();
 
-    public override ulong ReadLWord(string address)
-    {
-        var mem = ParseAddress(address);
-        return (ulong)((GetMemoryCell(mem[0], mem[2]) >> (mem[3] % 64)) & ulong.MaxValue);
-    }
+    public override uint ReadDWord(string address) => (uint)Resolve(address, false).Read();
 
-    public override void WriteBit(string address, bool value)
-    {
-        var mem = ParseAddress(address);
-        if (value)
-            GetMemoryCell(mem[0], mem[2]) |= (1UL << (mem[3] % 64));
-        else
-            GetMemoryCell(mem[0], mem[2]) &= ~(1UL << (mem[3] % 64));
-    }
+    public override ulong ReadLWord(string address) => Resolve(address, false).Read();
 
-    public override void WriteByte(string address, byte value)
-    {
-        WriteGeneric(address, value, 8);
-    }
+    public override void WriteBit(string address, bool value) => Resolve(address, true).Write(value ? 1UL : 0UL);
 
-    public override void WriteWord(string address, ushort value)
-    {
-        WriteGeneric(address, value, 16);
-    }
+    public override void WriteByte(string address, byte value) => Resolve(address, false).Write(value);
 
-    public override void WriteDWord(string address, uint value)
-    {
-        WriteGeneric(address, value, 32);
-    }
+    public override void WriteWord(string address, ushort value) => Resolve(address, false).Write(value);
 
-    public override void WriteLWord(string address, ulong value)
-    {
-        WriteGeneric(address, value, 64);
-    }
+    public override void WriteDWord(string address, uint value) => Resolve(address, false).Write(value);
+
+    public override void WriteLWord(string address, ulong value) => Resolve(address, false).Write(value);
+
+    public override AddressHandle? ResolveAddress(string address) => Resolve(address, address.Contains('.'));
+
+    public override ulong[]? ProcessImage => IMAGE;
 
     public enum MemorySpace
     {
@@ -95,79 +74,65 @@ class ProgramEngine : NodalisEngine
         M = 2
     }
 
-    public static ref ulong GetMemoryCell(int space, int addr)
+    /// <summary>
+    /// Gets the handle of an address, parsing it the first time it is used.
+    /// </summary>
+    /// <param name="address">The address.</param>
+    /// <param name="isBit">Whether the address must select a bit.</param>
+    /// <returns>Returns the handle.</returns>
+    private AddressHandle Resolve(string address, bool isBit)
     {
-        int r = -1, c = 0, b = 0;
-        switch (space)
-        {
-            case 1: // Q
-                r = (addr * 8) / 64;
-                c = 1;
-                b = addr % 8;
-                break;
-            case 0: // I
-                r = (addr * 8) / 64;
-                c = 0;
-                b = addr % 8;
-                break;
-            case 2: // M
-                r = (addr * 8) / (64 * 14);
-                c = (addr / 112) + 2;
-                b = addr % 8;
-                break;
-        }
-
-        if (r >= 0 && r < 64 && c >= 0 && c < 16)
+        if (!_handles.TryGetValue(address, out var handle))
         {
-            return ref MEMORY[r, c];
+            handle = ParseAddress(address);
+            _handles[address] = handle;
         }
-        throw new ArgumentOutOfRangeException();
+        if (isBit != (handle.Mask == 1))
+            throw new ArgumentException($"Invalid {(isBit ? "bit" : "value")} address: {address}");
+        return handle;
     }
 
-    public static List<int> ParseAddress(string address)
+    /// <summary>
+    /// Parses an address into a handle. The index of an address counts values of its width, so %IW1 is the second
+    /// word of the inputs, and a bit address selects a bit of the value at the index.
+    /// </summary>
+    /// <param name="address">The address, such as %IX0.1, %QW3 or %MD10.</param>
+    /// <returns>Returns the handle of the address.</returns>
+    public static AddressHandle ParseAddress(string address)
     {
-        var pattern = new Regex(@"%([IQM])([XBWDL])(\d+)(?:\.(\d+))?", RegexOptions.IgnoreCase);
-        var match = pattern.Match(address);
+        var match = ADDRESS.Match(address);
 
         if (!match.Success)
             throw new ArgumentException($"Invalid address format: {address}");
 
-        string space = match.Groups[1].Value.ToUpperInvariant();  // I, Q, M
-        string type = match.Groups[2].Value.ToUpperInvariant();   // X, W, D, etc.
-        string index = match.Groups[3].Value;                     // 0, 1, ...
-        string bit = match.Groups[4].Success ? match.Groups[4].Value : null;
-
-        int ispace = space switch
+        var space = SPACES[(int)(char.ToUpperInvariant(match.Groups[1].Value[0]) switch
         {
-            "M" => (int)MemorySpace.M,
-            "Q" => (int)MemorySpace.Q,
-            "I" => (int)MemorySpace.I,
-            _ => throw new ArgumentException($"Unknown memory space: {space}")
-        };
+            'M' => MemorySpace.M,
+            'Q' => MemorySpace.Q,
+            _ => MemorySpace.I
+        })];
 
-        int width = type switch
+        int width = char.ToUpperInvariant(match.Groups[2].Value[0]) switch
         {
-            "X" => 8,
-            "W" => 16,
-            "D" => 32,
-            "L" => 64,
-            _ => throw new ArgumentException($"Unknown type: {type}")
+            'W' => 16,
+            'D' => 32,
+            'L' => 64,
+            _ => 8
         };
 
-        int addr = int.Parse(index);
-        int ibit = bit != null ? int.Parse(bit) : -1;
-
-        return new List<int> { ispace, width, addr, ibit };
-    }
+        long position = long.Parse(match.Groups[3].Value) * width;
+        if (match.Groups[4].Success)
+        {
+            int bit = int.Parse(match.Groups[4].Value);
+            if (bit >= width)
+                throw new ArgumentOutOfRangeException(nameof(address), $"Bit out of range: {address}");
+            position += bit;
+            width = 1;
+        }
+        if (position + width > (long)space.Cells * 64)
+            throw new ArgumentOutOfRangeException(nameof(address), $"Address out of range: {address}");
 
-    private void WriteGeneric(string address, ulong value, int width)
-    {
-        var mem = ParseAddress(address);
-        ulong mask = (1UL << width) - 1;
-        ulong shiftedMask = mask << (mem[3] % 64);
-        ulong location = GetMemoryCell(mem[0], mem[2]);
-        location &= ~shiftedMask;
-        location |= (value & mask) << (mem[3] % 64);
+        return new AddressHandle(IMAGE, space.First + (int)(position / 64), (int)(position % 64), width);
     }
 }
 
@@ -177,16 +142,43 @@ class Program
     {
         if (args.Length < 1)
         {
-            Console.WriteLine("Usage: NodalisPLC <jsfile>");
+            Console.WriteLine("Usage: NodalisPLC <jsfile> [--scan-timeout <ms>] [--max-statements <n>] [--recursion-limit <n>] [--sync-io] [--native-io]");
             return;
         }
 
-        var engine = new ProgramEngine();
+        // The constraints are checked by Jint as the program runs, and are reset before each scan, so they bound a
+        // single scan. None are set by default, which leaves the interpreter without the checks.
+        int scanTimeout = 0, maxStatements = 0, recursionLimit = 0;
+        bool syncIO = false, nativeIO = false;
+        for (int i = 1; i < args.Length; i++)
+        {
+            int Next() => i + 1 < args.Length ? int.Parse(args[++i]) : 0;
+            switch (args[i])
+            {
+                case "--scan-timeout": scanTimeout = Next(); break;
+                case "--max-statements": maxStatements = Next(); break;
+                case "--recursion-limit": recursionLimit = Next(); break;
+                case "--sync-io": syncIO = true; break;
+                case "--native-io": nativeIO = true; break;
+                default: Console.WriteLine($"Unknown option: {args[i]}"); break;
+            }
+        }
+
+        var engine = new ProgramEngine(options =>
+        {
+            if (scanTimeout > 0) options.TimeoutInterval(TimeSpan.FromMilliseconds(scanTimeout));
+            if (maxStatements > 0) options.MaxStatements(maxStatements);
+            if (recursionLimit > 0) options.LimitRecursion(recursionLimit);
+        });
+        // IO clients poll their modules on tasks of their own unless --sync-io is given, and SuperviseIO only hands
+        // values to and from them, so a slow module doesn't hold up the scan.
+        engine.SynchronousIO = syncIO;
+        // With --native-io, the IO runs on the C++ runtime's clients, from the nodalisio library beside the executable.
+        engine.NativeIO = nativeIO;
         long lastExec = engine.ElapsedMilliseconds;
-        string jsCode = File.ReadAllText(args[0]);
         try
         {
-            engine.Load(jsCode);
+            engine.Load(NodalisEngine.Prepare(File.ReadAllText(args[0])));
             engine.Setup();
             while (true)
             {
@@ -206,4 +198,3 @@ class Program
         
     }
 }
-
@@ -2,4 +2,4 @@
 set SCRIPT={script}  REM to be replaced by JSCompiler
 
 set DIR=%~dp0
-"%DIR%NodalisPLC.exe" %SCRIPT%
+"%DIR%NodalisPLC.exe" %SCRIPT% %*
@@ -2,4 +2,4 @@
 SCRIPT="{script}" # to be replaced by JSCompiler
 
 DIR="$(cd "$(dirname "$0")" && pwd)"
-"$DIR/NodalisPLC" "$SCRIPT"
+"$DIR/NodalisPLC" "$SCRIPT" "$@"
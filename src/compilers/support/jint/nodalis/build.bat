@@ -1,30 +1,38 @@
 @echo off
-echo Building NodalisEngine...
-dotnet build NodalisEngine/NodalisEngine.csproj
-
-echo Publishing NodalisPLC for Windows...
-dotnet publish NodalisPLC/NodalisPLC.csproj -c Release -r win-x64 --self-contained true /p:PublishSingleFile=true /p:Trim=true -o publish/win-x64
-copy "NodalisPLC/bootstrap.bat" publish/win-x64/bootstrap.bat
-
-dotnet publish NodalisPLC/NodalisPLC.csproj -c Release -r win-arm64 --self-contained true /p:PublishSingleFile=true /p:Trim=true -o publish/win-arm64
-copy "NodalisPLC/bootstrap.bat" publish/win-arm64/bootstrap.bat
-
-echo Publishing NodalisPLC for Linux...
-dotnet publish NodalisPLC/NodalisPLC.csproj -c Release -r linux-x64 --self-contained true /p:PublishSingleFile=true /p:Trim=true -o publish/linux-x64
-copy "NodalisPLC/bootstrap.sh" publish/linux-x64/bootstrap.sh
-
-dotnet publish NodalisPLC/NodalisPLC.csproj -c Release -r linux-arm64 --self-contained true /p:PublishSingleFile=true /p:Trim=true -o publish/linux-arm64
-copy "NodalisPLC/bootstrap.sh" publish/linux-arm64/bootstrap.sh
-
-dotnet publish NodalisPLC/NodalisPLC.csproj -c Release -r linux-arm --self-contained true /p:PublishSingleFile=true /p:Trim=true -o publish/linux-arm
-copy "NodalisPLC/bootstrap.sh" publish/linux-arm/bootstrap.sh
-
-echo Publishing NodalisPLC for macOS...
-dotnet publish NodalisPLC/NodalisPLC.csproj -c Release -r osx-x64 --self-contained true /p:PublishSingleFile=true /p:Trim=true -o publish/osx-x64
-copy "NodalisPLC/bootstrap.sh" publish/osx-x64/bootstrap.sh
-
-dotnet publish NodalisPLC/NodalisPLC.csproj -c Release -r osx-arm64 --self-contained true /p:PublishSingleFile=true /p:Trim=true -o publish/osx-arm64
-copy "NodalisPLC/bootstrap.sh" publish/osx-arm64/bootstrap.sh
+setlocal
 
+rem The publish profile: r2r (ReadyToRun and trimmed, the default), aot (Native AOT) or jit. See NodalisPLC.csproj.
+set PROFILE=%1
+if "%PROFILE%"=="" set PROFILE=%NODALIS_PUBLISH%
+if "%PROFILE%"=="" set PROFILE=r2r
 
+echo Building NodalisEngine...
+dotnet build NodalisEngine/NodalisEngine.csproj -c Release || exit /b 1
+
+if /i "%PROFILE%"=="aot" (
+    rem Native AOT can't compile for another operating system, so only the host's target is published.
+    if /i "%PROCESSOR_ARCHITECTURE%"=="ARM64" (
+        call :publish win-arm64 bootstrap.bat || exit /b 1
+    ) else (
+        call :publish win-x64 bootstrap.bat || exit /b 1
+    )
+    goto done
+)
+
+call :publish win-x64 bootstrap.bat || exit /b 1
+call :publish win-arm64 bootstrap.bat || exit /b 1
+call :publish linux-x64 bootstrap.sh || exit /b 1
+call :publish linux-arm64 bootstrap.sh || exit /b 1
+call :publish linux-arm bootstrap.sh || exit /b 1
+call :publish osx-x64 bootstrap.sh || exit /b 1
+call :publish osx-arm64 bootstrap.sh || exit /b 1
+
+:done
 echo Build complete.
+exit /b 0
+
+:publish
+echo Publishing NodalisPLC for %1 (%PROFILE%)...
+dotnet publish NodalisPLC/NodalisPLC.csproj -c Release -r %1 -p:NodalisPublish=%PROFILE% -o publish/%1 || exit /b 1
+copy "NodalisPLC\%2" "publish\%1\%2" >nul
+exit /b 0
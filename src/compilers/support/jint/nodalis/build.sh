@@ -1,31 +1,34 @@
 #!/bin/bash
 set -e
 
-echo "Building NodalisEngine..."
-dotnet build NodalisEngine/NodalisEngine.csproj
-
-echo "Publishing NodalisPLC for Windows..."
-dotnet publish NodalisPLC/NodalisPLC.csproj -c Release -r win-x64 --self-contained true /p:PublishSingleFile=true /p:Trim=true -o publish/win-x64
-cp "NodalisPLC/bootstrap.bat" publish/win-x64/bootstrap.bat
-
-echo "Publishing NodalisPLC for Linux..."
-dotnet publish NodalisPLC/NodalisPLC.csproj -c Release -r linux-x64 --self-contained true /p:PublishSingleFile=true /p:Trim=true -o publish/linux-x64
-cp "NodalisPLC/bootstrap.sh" publish/linux-x64/bootstrap.sh
-
-echo "Publishing NodalisPLC for macOS..."
-dotnet publish NodalisPLC/NodalisPLC.csproj -c Release -r osx-x64 --self-contained true /p:PublishSingleFile=true /p:Trim=true -o publish/osx-x64
-cp "NodalisPLC/bootstrap.sh" publish/osx-x64/bootstrap.sh
+# The publish profile: r2r (ReadyToRun and trimmed, the default), aot (Native AOT) or jit. See NodalisPLC.csproj.
+PROFILE="${1:-${NODALIS_PUBLISH:-r2r}}"
 
-echo "Publishing NodalisPLC for macOS ARM64..."
-dotnet publish NodalisPLC/NodalisPLC.csproj -c Release -r osx-arm64 --self-contained true /p:PublishSingleFile=true /p:Trim=true -o publish/osx-arm64
-cp "NodalisPLC/bootstrap.sh" publish/osx-arm64/bootstrap.sh
-
-echo Publishing NodalisPLC for Linux ARM 32-bit...
-dotnet publish NodalisPLC/NodalisPLC.csproj -c Release -r linux-arm --self-contained true /p:PublishSingleFile=true /p:Trim=true -o publish/linux-arm
-cp "NodalisPLC/bootstrap.sh" publish/linux-arm/bootstrap.sh
-
-echo Publishing NodalisPLC for Linux ARM 64-bit...
-dotnet publish NodalisPLC/NodalisPLC.csproj -c Release -r linux-arm64 --self-contained true /p:PublishSingleFile=true /p:Trim=true -o publish/linux-arm64
-cp "NodalisPLC/bootstrap.sh" publish/linux-arm64/bootstrap.sh
+echo "Building NodalisEngine..."
+dotnet build NodalisEngine/NodalisEngine.csproj -c Release
+
+publish() {
+    echo "Publishing NodalisPLC for $1 ($PROFILE)..."
+    dotnet publish NodalisPLC/NodalisPLC.csproj -c Release -r "$1" -p:NodalisPublish="$PROFILE" -o "publish/$1"
+    cp "NodalisPLC/$2" "publish/$1/$2"
+}
+
+if [ "$PROFILE" = "aot" ]; then
+    # Native AOT can't compile for another operating system, so only the host's target is published.
+    case "$(uname -s)-$(uname -m)" in
+        Linux-x86_64) publish linux-x64 bootstrap.sh ;;
+        Linux-aarch64) publish linux-arm64 bootstrap.sh ;;
+        Darwin-x86_64) publish osx-x64 bootstrap.sh ;;
+        Darwin-arm64) publish osx-arm64 bootstrap.sh ;;
+        *) echo "Native AOT isn't supported on $(uname -s) $(uname -m)."; exit 1 ;;
+    esac
+else
+    publish win-x64 bootstrap.bat
+    publish linux-x64 bootstrap.sh
+    publish osx-x64 bootstrap.sh
+    publish osx-arm64 bootstrap.sh
+    publish linux-arm bootstrap.sh
+    publish linux-arm64 bootstrap.sh
+fi
 
 echo "Build complete."
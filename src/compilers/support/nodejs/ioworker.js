@@ -0,0 +1,36 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/**
+ * @description Nodalis PLC IO Worker for NodeJs
+ * @author Nathan Skipper, MTI
+ * @version 1.0.2
+ * @copyright Apache 2.0
+ */
+import { parentPort, workerData } from "worker_threads";
+import { attachProcessImage, mapIO, superviseIO } from "./nodalis.js";
+
+// The IO clients read and write the logic's process image, which the main thread shares with this one.
+attachProcessImage(workerData.image);
+
+parentPort.on("message", (message) => {
+  if (message.map) mapIO(message.map);
+});
+
+function poll() {
+  superviseIO();
+  setTimeout(poll, 1);
+}
+poll();
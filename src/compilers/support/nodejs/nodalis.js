@@ -22,10 +22,68 @@
 import {IOClient, IOMap, setTiming, setMemoryAccess} from "./IOClient.js"
 import {ModbusClient} from "./modbus.js";
 import { OPCClient } from "./opcua.js";
+import { Worker } from "worker_threads";
 
-const MEMORY = Array.from({ length: 64 }, () =>
-  Array.from({ length: 16 }, () => new Uint8Array(8))
-);
+/**
+ * The sizes of the %I, %Q and %M spaces, in bytes, as in the C++ runtime.
+ */
+export const INPUT_BYTES = 512;
+export const OUTPUT_BYTES = 512;
+export const MEMORY_BYTES = 7168;
+const SPACES = {
+  I: { offset: 0, bytes: INPUT_BYTES },
+  Q: { offset: INPUT_BYTES, bytes: OUTPUT_BYTES },
+  M: { offset: INPUT_BYTES + OUTPUT_BYTES, bytes: MEMORY_BYTES }
+};
+
+/**
+ * The process image. The %I, %Q and %M spaces follow each other in one SharedArrayBuffer, laid out as in the C++
+ * runtime: %IB<a> is at offset a, %QB<a> at INPUT_BYTES + a and %MB<a> at INPUT_BYTES + OUTPUT_BYTES + a, and wider
+ * values are placed by their width, so %MD3 starts at %MB12. The IO worker attaches to the same buffer, so inputs
+ * and outputs pass between it and the logic without being copied or serialized. Values are read and written through
+ * typed arrays, whose aligned elements are never torn, and bits are set with Atomics, so that a bit written by one
+ * thread can't undo a bit another thread wrote to the same byte.
+ */
+let IMAGE = new SharedArrayBuffer(INPUT_BYTES + OUTPUT_BYTES + MEMORY_BYTES);
+export let IMAGE_BYTES = new Uint8Array(IMAGE);
+export let IMAGE_WORDS = new Uint16Array(IMAGE);
+export let IMAGE_DWORDS = new Uint32Array(IMAGE);
+
+/**
+ * Gets the process image, to share with another thread.
+ * @returns {SharedArrayBuffer} Returns the buffer.
+ */
+export function processImage() {
+  return IMAGE;
+}
+
+/**
+ * Uses the process image of another thread, in place of this thread's own.
+ * @param {SharedArrayBuffer} image The process image.
+ */
+export function attachProcessImage(image) {
+  IMAGE = image;
+  IMAGE_BYTES = new Uint8Array(IMAGE);
+  IMAGE_WORDS = new Uint16Array(IMAGE);
+  IMAGE_DWORDS = new Uint32Array(IMAGE);
+}
+
+/**
+ * Instantiates the programs compiled to WebAssembly. The module's memory is shared and begins with the process image,
+ * so it takes the place of the image: the values already in the image are copied into it, and the runtime, and the IO
+ * worker started after this, use it from then on.
+ * @param {Uint8Array} bytes The module.
+ * @param {number} pages The pages of memory the module imports.
+ * @returns {Object<string, Function>} Returns the programs, by name, with their variables set to their initial values.
+ */
+export function loadWasmProgram(bytes, pages) {
+  const memory = new WebAssembly.Memory({ initial: pages, maximum: pages, shared: true });
+  new Uint8Array(memory.buffer).set(IMAGE_BYTES);
+  attachProcessImage(memory.buffer);
+  const instance = new WebAssembly.Instance(new WebAssembly.Module(bytes), { env: { memory } });
+  instance.exports.__init();
+  return instance.exports;
+}
 
 export let PROGRAM_START = Date.now();
 export function elapsed() {
@@ -145,34 +203,53 @@ export class RefVar {
 }
 
 export function parseAddress(address) {
-  const regex = /^%([IQM])([XWD])([0-9]+)(?:\.(\d+))?$/i;
+  const regex = /^%([IQM])([XBWDL])([0-9]+)(?:\.(\d+))?$/i;
   const match = address.match(regex);
   if (!match) throw new Error("Invalid address: " + address);
   const [, space, type, indexStr, bitStr] = match;
-  const width = type.toUpperCase() === "X" ? 8 : type.toUpperCase() === "W" ? 16 : 32;
+  const width = { W: 16, D: 32, L: 64 }[type.toUpperCase()] ?? 8;
   const index = parseInt(indexStr, 10);
   const bit = bitStr !== undefined ? parseInt(bitStr, 10) : -1;
   return [space.toUpperCase(), width, index, bit];
 }
 
-export function getMemoryByte(space, addr) {
-  let r = -1, c = 0, b = 0;
-  switch (space) {
-    case 'Q': r = Math.floor((addr * 8) / 64); c = 1; b = addr % 8; break;
-    case 'I': r = Math.floor((addr * 8) / 64); c = 0; b = addr % 8; break;
-    case 'M': r = Math.floor((addr * 8) / (64 * 14)); c = Math.floor(addr / 112) + 2; b = addr % 8; break;
-    default: throw new Error("Invalid space");
+const ADDRESSES = new Map();
+
+/**
+ * Finds an address in the process image. Each address is parsed once, and its place is cached for the next access.
+ * @param {string} address The address.
+ * @returns {{width: number, bit: number, byte: number, mask: number}} Returns the width of the value, its bit (or -1
+ * for a whole value), the offset of its first byte in the image and, for a bit, its mask within that byte.
+ */
+export function resolveAddress(address) {
+  let resolved = ADDRESSES.get(address);
+  if (resolved === undefined) {
+    const [space, width, index, bit] = parseAddress(address);
+    const position = index * width + Math.max(bit, 0);
+    if (bit >= width || position + (bit > -1 ? 1 : width) > SPACES[space].bytes * 8) {
+      throw new Error("Address out of range: " + address);
+    }
+    resolved = {
+      width,
+      bit,
+      byte: SPACES[space].offset + (position >> 3),
+      mask: bit > -1 ? 1 << (position & 7) : 0
+    };
+    ADDRESSES.set(address, resolved);
   }
-  return MEMORY[r]?.[c];
+  return resolved;
+}
+
+export function getMemoryByte(space, addr) {
+  if (!SPACES[space]) throw new Error("Invalid space");
+  return IMAGE_BYTES.subarray(SPACES[space].offset + addr, SPACES[space].offset + addr + 1);
 }
 
 export function getMemoryTyped(space, addr, type) {
-  const byteOffset = type === 2 ? addr * 2 : type === 4 ? addr * 4 : addr;
-  const r = Math.floor(byteOffset / 64);
-  const c = space === 'Q' ? 1 : space === 'I' ? 0 : Math.floor(addr / 112) + 2;
-  const base = MEMORY[r]?.[c];
-  if (!base) throw new Error("Invalid memory");
-  return new DataView(base.buffer, base.byteOffset, base.byteLength);
+  if (!SPACES[space]) throw new Error("Invalid space");
+  const offset = SPACES[space].offset + addr * type;
+  if (addr * type + type > SPACES[space].bytes) throw new Error("Invalid memory");
+  return new DataView(IMAGE, offset, type);
 }
 
 export function getBit(buffer, bit) {
@@ -204,53 +281,62 @@ export function setBit(buffer, bit, value) {
 }
 
 export function readByte(address) {
-  const [space, width, index, bit] = parseAddress(address);
-  if (width !== 8 || bit > -1) throw new Error("Invalid byte address: " + address);
-  return getMemoryByte(space, index)[0];
+  const a = resolveAddress(address);
+  if (a.width !== 8 || a.bit > -1) throw new Error("Invalid byte address: " + address);
+  return IMAGE_BYTES[a.byte];
 }
 
 export function writeByte(address, value) {
-  const [space, width, index, bit] = parseAddress(address);
-  if (width !== 8 || bit > -1) throw new Error("Invalid byte address: " + address);
-  getMemoryByte(space, index)[0] = value;
+  const a = resolveAddress(address);
+  if (a.width !== 8 || a.bit > -1) throw new Error("Invalid byte address: " + address);
+  IMAGE_BYTES[a.byte] = value;
 }
 
 export function readWord(address) {
-  const [space, width, index, bit] = parseAddress(address);
-  if (width !== 16 || bit > -1) throw new Error("Invalid word address: " + address);
-  return getMemoryTyped(space, index, 2).getUint16(0, true);
+  const a = resolveAddress(address);
+  if (a.width !== 16 || a.bit > -1) throw new Error("Invalid word address: " + address);
+  return IMAGE_WORDS[a.byte >> 1];
 }
 
 export function writeWord(address, value) {
-  const [space, width, index, bit] = parseAddress(address);
-  if (width !== 16 || bit > -1) throw new Error("Invalid word address: " + address);
-  getMemoryTyped(space, index, 2).setUint16(0, value, true);
+  const a = resolveAddress(address);
+  if (a.width !== 16 || a.bit > -1) throw new Error("Invalid word address: " + address);
+  IMAGE_WORDS[a.byte >> 1] = value;
 }
 
 export function readDWord(address) {
-  const [space, width, index, bit] = parseAddress(address);
-  if (width !== 32 || bit > -1) throw new Error("Invalid dword address: " + address);
-  return getMemoryTyped(space, index, 4).getUint32(0, true);
+  const a = resolveAddress(address);
+  if (a.width !== 32 || a.bit > -1) throw new Error("Invalid dword address: " + address);
+  return IMAGE_DWORDS[a.byte >> 2];
 }
 
 export function writeDWord(address, value) {
-  const [space, width, index, bit] = parseAddress(address);
-  if (width !== 32 || bit > -1) throw new Error("Invalid dword address: " + address);
-  getMemoryTyped(space, index, 4).setUint32(0, value, true);
+  const a = resolveAddress(address);
+  if (a.width !== 32 || a.bit > -1) throw new Error("Invalid dword address: " + address);
+  IMAGE_DWORDS[a.byte >> 2] = value;
 }
 
 export function readBit(address) {
-  const [space, width, index, bit] = parseAddress(address);
-  if (bit === -1) throw new Error("Missing bit index in address: " + address);
-  const buffer = getMemoryByte(space, index);
-  return getBit(buffer, bit);
+  const a = resolveAddress(address);
+  if (a.bit === -1) throw new Error("Missing bit index in address: " + address);
+  return (IMAGE_BYTES[a.byte] & a.mask) !== 0;
 }
 
 export function writeBit(address, value) {
-  const [space, width, index, bit] = parseAddress(address);
-  if (bit === -1) throw new Error("Missing bit index in address: " + address);
-  const buffer = getMemoryByte(space, index);
-  setBit(buffer, bit, value);
+  const a = resolveAddress(address);
+  if (a.bit === -1) throw new Error("Missing bit index in address: " + address);
+  setImageBit(a.byte, a.mask, value);
+}
+
+/**
+ * Sets or clears a bit of the process image. The compiler writes located bits with it, by their offset and mask.
+ * @param {number} byte The offset of the bit's byte.
+ * @param {number} mask The mask of the bit in its byte.
+ * @param {boolean} value The value of the bit.
+ */
+export function setImageBit(byte, mask, value) {
+  if (value) Atomics.or(IMAGE_BYTES, byte, mask);
+  else Atomics.and(IMAGE_BYTES, byte, ~mask & 0xff);
 }
 
 export function readAddress(address){
@@ -260,6 +346,7 @@ export function readAddress(address){
   else{
     switch(address[2]){
       case "X":
+      case "B":
         return readByte(address);
       
       case "W":
@@ -279,6 +366,7 @@ export function writeAddress(address, value){
   else{
     switch(address[2]){
       case "X":
+      case "B":
         writeByte(address, value);
       break;
       case "W":
@@ -349,10 +437,13 @@ export class TON extends FunctionBlock {
     this.ET = 0;
     this._startTime = 0;
   }
+  now() {
+    return elapsed();
+  }
   call() {
     if (this.IN) {
-      if (this._startTime === 0) this._startTime = elapsed();
-      this.ET = elapsed() - this._startTime;
+      if (this._startTime === 0) this._startTime = this.now();
+      this.ET = this.now() - this._startTime;
       this.Q = this.ET >= this.PT;
     } else {
       this._startTime = 0;
@@ -371,14 +462,17 @@ export class TOF extends FunctionBlock {
     this.ET = 0;
     this._startTime = 0;
   }
+  now() {
+    return elapsed();
+  }
   call() {
     if (this.IN) {
       this.Q = true;
       this._startTime = 0;
       this.ET = 0;
     } else if (this.Q) {
-      if (this._startTime === 0) this._startTime = elapsed();
-      this.ET = elapsed() - this._startTime;
+      if (this._startTime === 0) this._startTime = this.now();
+      this.ET = this.now() - this._startTime;
       if (this.ET >= this.PT) this.Q = false;
     }
   }
@@ -394,6 +488,9 @@ export class TP extends FunctionBlock {
     this._startTime = 0;
     this._lastIN = false;
   }
+  now() {
+    return elapsed();
+  }
   call() {
     this.Q = false;
     if (!this._lastIN && this.IN) {
@@ -404,14 +501,35 @@ export class TP extends FunctionBlock {
     if (this.IN) {
       this.Q = true;
     } else if (this._lastIN && !this.IN) {
-      if (this._startTime === 0) this._startTime = elapsed();
-      this.ET = elapsed() - this._startTime;
+      if (this._startTime === 0) this._startTime = this.now();
+      this.ET = this.now() - this._startTime;
       this.Q = this.PT >= this.ET;
       if (!this.Q) this._lastIN = false;
     }
   }
 }
 
+/**
+ * The timers of LTIME, whose PT and ET are in nanoseconds, measured in the milliseconds of the program's clock.
+ */
+export class TON_LTIME extends TON {
+  now() {
+    return elapsed() * 1000000;
+  }
+}
+
+export class TOF_LTIME extends TOF {
+  now() {
+    return elapsed() * 1000000;
+  }
+}
+
+export class TP_LTIME extends TP {
+  now() {
+    return elapsed() * 1000000;
+  }
+}
+
 export class R_TRIG extends FunctionBlock {
   constructor() {
     super();
@@ -607,6 +725,78 @@ export class LIMIT extends FunctionBlock {
   }
 }
 
+// The standard numeric, conversion and bit shift functions, under the names the transpiler maps the ST calls onto:
+// INT_TO_REAL(x) and TO_REAL(x) are both TO_REAL(x). A conversion to an integer rounds a REAL to the nearest, halves
+// away from zero, and saturates to the range of the type. The 64-bit types are numbers, exact to 2^53.
+export const SQRT = Math.sqrt;
+export const LN = Math.log;
+export const LOG = Math.log10;
+export const EXP = Math.exp;
+export const SIN = Math.sin;
+export const COS = Math.cos;
+export const TAN = Math.tan;
+export const ASIN = Math.asin;
+export const ACOS = Math.acos;
+export const ATAN = Math.atan;
+export const EXPT = Math.pow;
+export const ABS = Math.abs;
+
+function toInteger(value, low, high, round = true) {
+  if (typeof value === 'boolean') return value ? 1 : 0;
+  if (Number.isNaN(value)) return 0;
+  const whole = round ? Math.sign(value) * Math.round(Math.abs(value)) : Math.trunc(value);
+  return whole < low ? low : whole > high ? high : whole;
+}
+
+const INTEGER_RANGES = {
+  BYTE: [0, 0xff], WORD: [0, 0xffff], DWORD: [0, 0xffffffff], LWORD: [0, Number.MAX_SAFE_INTEGER],
+  SINT: [-0x80, 0x7f], INT: [-0x8000, 0x7fff], DINT: [-0x80000000, 0x7fffffff],
+  LINT: [Number.MIN_SAFE_INTEGER, Number.MAX_SAFE_INTEGER], USINT: [0, 0xff], UINT: [0, 0xffff],
+  UDINT: [0, 0xffffffff], ULINT: [0, Number.MAX_SAFE_INTEGER], TIME: [0, 0xffffffff],
+  LTIME: [Number.MIN_SAFE_INTEGER, Number.MAX_SAFE_INTEGER], LDATE: [Number.MIN_SAFE_INTEGER, Number.MAX_SAFE_INTEGER],
+  LTOD: [Number.MIN_SAFE_INTEGER, Number.MAX_SAFE_INTEGER], LDT: [Number.MIN_SAFE_INTEGER, Number.MAX_SAFE_INTEGER]
+};
+const integer = (type, round = true) => (value) => toInteger(value, ...INTEGER_RANGES[type], round);
+export const TO_BOOL = (value) => Boolean(value);
+export const TO_BYTE = integer('BYTE');
+export const TO_WORD = integer('WORD');
+export const TO_DWORD = integer('DWORD');
+export const TO_LWORD = integer('LWORD');
+export const TO_SINT = integer('SINT');
+export const TO_INT = integer('INT');
+export const TO_DINT = integer('DINT');
+export const TO_LINT = integer('LINT');
+export const TO_USINT = integer('USINT');
+export const TO_UINT = integer('UINT');
+export const TO_UDINT = integer('UDINT');
+export const TO_ULINT = integer('ULINT');
+export const TO_REAL = (value) => Math.fround(Number(value));
+export const TO_LREAL = (value) => Number(value);
+export const TO_TIME = integer('TIME');
+export const TO_LTIME = integer('LTIME');
+export const TO_LDATE = integer('LDATE');
+export const TO_LTOD = integer('LTOD');
+export const TO_LDT = integer('LDT');
+export const TRUNC = integer('DINT', false);
+export const TRUNC_DINT = TRUNC;
+export const TRUNC_SINT = integer('SINT', false);
+export const TRUNC_INT = integer('INT', false);
+export const TRUNC_LINT = integer('LINT', false);
+export const TRUNC_USINT = integer('USINT', false);
+export const TRUNC_UINT = integer('UINT', false);
+export const TRUNC_UDINT = integer('UDINT', false);
+export const TRUNC_ULINT = integer('ULINT', false);
+export const TIME_TO_LTIME = (value) => value * 1000000;
+export const LTIME_TO_TIME = (value) => TO_TIME(Math.trunc(value / 1000000));
+export const LDT_TO_LDATE = (value) => value - (((value % 86400e9) + 86400e9) % 86400e9);
+export const LDT_TO_LTOD = (value) => ((value % 86400e9) + 86400e9) % 86400e9;
+
+// The shifts and rotations work on 32 bits, since a number doesn't carry the width of its ST type.
+export const SHL = (value, n) => (n >= 32 ? 0 : (value << n) >>> 0);
+export const SHR = (value, n) => (n >= 32 ? 0 : value >>> n);
+export const ROL = (value, n) => ((value << (n & 31)) | (value >>> ((32 - (n & 31)) & 31))) >>> 0;
+export const ROR = (value, n) => ((value >>> (n & 31)) | (value << ((32 - (n & 31)) & 31))) >>> 0;
+
 const Clients = [];
 
 function findClient(map) {
@@ -637,7 +827,26 @@ function createClient(map) {
   return null;
 }
 
+let IOWorker = null;
+
+/**
+ * Moves the IO clients to a worker thread, which polls them on its own event loop and shares the process image with
+ * the logic, so that neither waits for the other. It must be started before the first call to mapIO.
+ * @returns {Worker} Returns the worker.
+ */
+export function startIOWorker() {
+  if (!IOWorker) {
+    IOWorker = new Worker(new URL("./ioworker.js", import.meta.url), { workerData: { image: IMAGE } });
+    IOWorker.on("error", (e) => console.error("IO Worker Exception:", e.message));
+  }
+  return IOWorker;
+}
+
 export function mapIO(mapStr) {
+  if (IOWorker) {
+    IOWorker.postMessage({ map: mapStr });
+    return;
+  }
   try {
     const newMap = new IOMap(mapStr);
     const existing = findClient(newMap);
@@ -660,3 +869,90 @@ export function superviseIO() {
   }
 }
 
+/**
+ * The time before a release that the scheduler stops sleeping on a timer, which can fire a millisecond or more late,
+ * and yields to the event loop with setImmediate until the release is due.
+ */
+const SPIN_NANOS = 2000000n;
+
+/**
+ * Runs the tasks from a single loop. Each task is released at absolute deadlines on the monotonic clock, the time
+ * the scheduler started plus a whole number of intervals, so a late release doesn't delay the ones after it as
+ * setInterval does. A task that falls behind by an interval or more skips the releases it missed, counting them as
+ * overruns, rather than running them back to back. The tasks that are due run in order of priority, and, unless
+ * the IO clients run on their worker, superviseIO() is called at each wake, at least once a millisecond.
+ * @param {{name: string, interval: number, priority?: number, run: Function}[]} tasks The tasks, with their intervals
+ * in milliseconds.
+ * @returns {{stop: Function, statistics: Function}} Returns the scheduler, which can be stopped and report how often
+ * each task ran, overran and how long it took.
+ */
+export function startScheduler(tasks) {
+  const start = process.hrtime.bigint();
+  const released = tasks
+    .map((t) => ({
+      name: t.name,
+      priority: t.priority ?? 0,
+      run: t.run,
+      period: BigInt(Math.max(1, Math.round(t.interval * 1000000))),
+      next: start,
+      runs: 0,
+      overruns: 0,
+      lastNanos: 0,
+      maxNanos: 0
+    }))
+    .sort((a, b) => a.priority - b.priority);
+  let timer = null;
+  let stopped = false;
+
+  const cycle = () => {
+    timer = null;
+    if (stopped) return;
+    if (!IOWorker) superviseIO();
+    let now = process.hrtime.bigint();
+    let next = null;
+    for (const task of released) {
+      if (now >= task.next) {
+        try {
+          task.run();
+        } catch (e) {
+          console.error(`Task ${task.name} Exception:`, e.message);
+        }
+        const ended = process.hrtime.bigint();
+        const nanos = Number(ended - now);
+        task.runs++;
+        task.lastNanos = nanos;
+        task.maxNanos = Math.max(task.maxNanos, nanos);
+        task.next += task.period;
+        if (task.next <= ended) {
+          const missed = (ended - task.next) / task.period + 1n;
+          task.overruns += Number(missed);
+          task.next += missed * task.period;
+        }
+        now = ended;
+      }
+      if (next === null || task.next < next) next = task.next;
+    }
+    const wait = next === null ? 1000000000n : next - process.hrtime.bigint();
+    if (wait <= SPIN_NANOS) {
+      timer = setImmediate(cycle);
+    } else {
+      let ms = Number((wait - SPIN_NANOS) / 1000000n);
+      if (!IOWorker) ms = Math.min(ms, 1);
+      timer = setTimeout(cycle, Math.max(1, ms));
+    }
+  };
+  cycle();
+
+  return {
+    stop() {
+      stopped = true;
+      if (timer) {
+        clearTimeout(timer);
+        clearImmediate(timer);
+      }
+    },
+    statistics() {
+      return released.map(({ name, runs, overruns, lastNanos, maxNanos }) => ({ name, runs, overruns, lastNanos, maxNanos }));
+    }
+  };
+}
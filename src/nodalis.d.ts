@@ -17,7 +17,7 @@
 export type IECLanguageCode = 'LD' | 'ST' | 'FBD' | 'IL' | 'SFC';
 
 /** Supported output types */
-export type OutputTypeCode = 'executable' | 'node' | 'code';
+export type OutputTypeCode = 'executable' | 'node' | 'code' | 'wasm';
 
 /** Supported communication protocols */
 export type CommunicationProtocolCode =
@@ -30,7 +30,7 @@ export type CommunicationProtocolCode =
 
 /** Information about a compiler returned by Nodalis.listCompilers() */
 export interface CompilerInfo {
-    /** Class name, e.g. "CPPCompiler", "JSCompiler", "SkipCompiler" */
+    /** Class name, e.g. "CPPCompiler", "JSCompiler", "SkipCompiler", "BareMetalCompiler" */
     name: string;
     supportedTargets: string[];        // e.g. ['linux', 'macos', 'windows']
     supportedOutputTypes: string[];    // e.g. ['executable', 'code']
@@ -67,6 +67,103 @@ export interface CompileOptions {
 
     /** Language code (e.g. 'st', 'ld', 'skip'). Case-insensitive. */
     language: string;
+
+    /**
+     * C++ executables only. When false, task releases run without a try/catch, so there is no exception
+     * handling in the scan. An exception thrown by the program then terminates the runtime. Defaults to true.
+     */
+    scanExceptions?: boolean;
+
+    /**
+     * C++ executables only. When true, indexing an array outside of its declared bounds throws, which faults the
+     * task. Defaults to false, where indices aren't checked.
+     */
+    boundsChecks?: boolean;
+
+    /**
+     * C++ only. When true, each program, function and function block is written to a translation unit of its own,
+     * <filename>.<POU>.cpp, with a <filename>.h header of their declarations. Files that don't change keep their
+     * time stamps, so a rebuild only compiles the POUs that changed. Defaults to false, a single <filename>.cpp.
+     */
+    splitUnits?: boolean;
+
+    /**
+     * C++ executables only. The build profile: 'release' (-O2 with link time optimization), 'size' (-Os with link
+     * time optimization) or 'debug' (-O0 -g). Defaults to 'release'.
+     */
+    profile?: 'debug' | 'release' | 'size';
+
+    /**
+     * C++ executables only. The CPU to build for, passed as -mcpu (-march on x64, /arch with cl.exe), such as
+     * 'cortex-a72'. The executable may then not run on other CPUs. Defaults to tuning only, for a Cortex-A53 on
+     * linux-arm64.
+     */
+    cpu?: string;
+
+    /** C++ executables only. When false, release and size builds are not link time optimized. Defaults to true. */
+    lto?: boolean;
+
+    /**
+     * C++ executables only, built on a host of the target. When set, the executable is built twice: first
+     * instrumented and run for this many milliseconds to record a profile, then optimized with that profile.
+     */
+    pgoTraining?: number;
+}
+
+/** Options for Nodalis.compileBatch(...) */
+export interface BatchCompileOptions extends Omit<CompileOptions, 'target' | 'resourceName'> {
+    /** The targets to build, e.g. ['linux-x64', 'linux-arm64'] */
+    targets: string[];
+
+    /** The resources of an IEC project to build. Each is built for every target. */
+    resourceNames?: string[];
+
+    /** The number of toolchain processes to run at once. Defaults to the number of cores. */
+    jobs?: number;
+}
+
+/** The result of one build of Nodalis.compileBatch(...) */
+export interface BatchCompileResult {
+    target: string;
+    resourceName?: string;
+
+    /** The folder the build was written to: outputPath/<target>, or outputPath/<resourceName>/<target> */
+    outputPath: string;
+    success: boolean;
+
+    /** The reason the build failed */
+    error?: string;
+}
+
+/** Options for Nodalis.watch(...) */
+export interface WatchOptions extends CompileOptions {
+    /** A programmer target (e.g. 'MTI') to program each successful build into a device with */
+    deployTarget?: string;
+
+    /** The file or folder to program. Defaults to outputPath. */
+    deploySource?: string;
+
+    /** The device to program, as for program() */
+    destination?: string;
+    username?: string;
+    password?: string;
+
+    /** Milliseconds to wait after a change for more changes before building. Defaults to 200. */
+    debounce?: number;
+}
+
+/** The result of one build of Nodalis.watch(...) */
+export interface WatchBuildResult {
+    success: boolean;
+
+    /** Milliseconds the build, and its deployment, took */
+    duration: number;
+
+    /** True when the build was programmed into the device */
+    deployed: boolean;
+
+    /** The reason the build or its deployment failed */
+    error?: string;
 }
 
 /** Options for Nodalis.program(...) */
@@ -128,6 +225,19 @@ export class Nodalis {
      */
     compile(options: CompileOptions): Promise<void>;
 
+    /**
+     * Builds a source for several targets and resources in parallel. The project is parsed once, and a build
+     * that fails is reported in its result without stopping the others.
+     */
+    compileBatch(options: BatchCompileOptions): Promise<BatchCompileResult[]>;
+
+    /**
+     * Builds a source, then builds it again each time it is saved, keeping the compiler and the parsed POUs in
+     * memory between builds. C++ builds default to splitUnits, so a save only recompiles the POUs it changed.
+     * Call close() on the returned watcher to stop.
+     */
+    watch(options: WatchOptions, onBuild?: (result: WatchBuildResult) => void): { close(): void };
+
     /**
      * High-level programming/deployment operation.
      * Selects the appropriate programmer and executes it.
@@ -17,13 +17,17 @@
 
 import path from 'path';
 import fs from 'fs';
+import crypto from 'crypto';
 import { fileURLToPath } from 'url';
 
 // Updated compiler imports
-import { CPPCompiler } from './compilers/CPPCompiler.js';
+import { CPPCompiler, setToolchainJobs, layoutHostImage, groupMappings, buildIOConfig } from './compilers/CPPCompiler.js';
 import { JSCompiler } from './compilers/JSCompiler.js';
 import { SkipCompiler } from "./compilers/SkipCompiler.js";
+import { BareMetalCompiler } from "./compilers/BareMetalCompiler.js";
 import { MTIProgrammer } from "./programmers/MTIProgrammer.js";
+import { SSHProgrammer } from "./programmers/SSHProgrammer.js";
+import * as iec from "./compilers/iec-parser/parser.js";
 import { CompileList } from "mticp-npm"
 
 const __filename = fileURLToPath(import.meta.url);
@@ -32,11 +36,13 @@ const __dirname = path.dirname(__filename);
 const availableCompilers = [
   new CPPCompiler(),
   new JSCompiler(),
-  new SkipCompiler()
+  new SkipCompiler(),
+  new BareMetalCompiler()
 ];
 
 const availableProgrammers = [
-  new MTIProgrammer()
+  new MTIProgrammer(),
+  new SSHProgrammer()
 ];
 
 function validateFileExtension(language, sourcePath) {
@@ -101,7 +107,7 @@ export class Nodalis {
     );
   }
 
-  async compile({ target, outputType, outputPath, resourceName, sourcePath, language }) {
+  async compile({ target, outputType, outputPath, resourceName, sourcePath, language, scanExceptions, packBools, boundsChecks, trace, pouProfile, allocTrack, atomicImage, arenaBytes, splitUnits, profile, cpu, lto, pgoTraining, nativeIO, onlineChange, warmRestart, loopGuard, fixedReal, protocols, browseVariables, incremental }) {
     validateFileExtension(language, sourcePath);
 
     const compiler = this.getCompiler(target, outputType, language);
@@ -116,11 +122,274 @@ export class Nodalis {
       target,
       outputType,
       language,
+      scanExceptions,
+      packBools,
+      boundsChecks,
+      trace,
+      pouProfile,
+      allocTrack,
+      atomicImage,
+      arenaBytes,
+      splitUnits,
+      profile,
+      cpu,
+      lto,
+      pgoTraining,
+      nativeIO,
+      onlineChange,
+      warmRestart,
+      loopGuard,
+      fixedReal,
+      protocols,
+      browseVariables,
+      incremental,
     };
 
     await compiler.compile();
   }
 
+  /**
+   * Builds a source for several targets, and several resources of an IEC project, at once. The project is parsed once
+   * and shared by every build, each build runs on its own compiler instance, and their toolchain processes run in
+   * parallel, at most `jobs` at a time. A build that fails is reported in the results without stopping the others.
+   * @param {object} options The options of compile(), with targets and resourceNames lists in place of target and
+   * resourceName, and the number of jobs, which defaults to the number of cores.
+   * @returns {Promise<{target: string, resourceName: string, outputPath: string, success: boolean, error: string}[]>}
+   * Returns the result of each build. Each is written to outputPath/<target>, or outputPath/<resourceName>/<target>
+   * when resources are named.
+   */
+  async compileBatch({ targets, resourceNames, outputType, outputPath, sourcePath, language, jobs, scanExceptions, packBools, boundsChecks, trace, pouProfile, allocTrack, atomicImage, arenaBytes, splitUnits, profile, cpu, lto, pgoTraining, nativeIO, onlineChange, warmRestart, loopGuard, fixedReal, protocols, browseVariables, incremental }) {
+    validateFileExtension(language, sourcePath);
+    if (!Array.isArray(targets) || targets.length === 0) {
+      throw new Error("A batch build needs at least one target.");
+    }
+    if (jobs !== undefined) {
+      setToolchainJobs(jobs);
+    }
+    const ext = path.extname(sourcePath).toLowerCase();
+    const resources = resourceNames?.length ? resourceNames : [undefined];
+    // The project is read once, for just the resources of the batch.
+    const project = ext === ".iec" || ext === ".xml" ? iec.Project.fromXML(fs.readFileSync(sourcePath, "utf-8"), resourceNames?.length ? resourceNames : undefined) : undefined;
+    const builds = resources.flatMap((resourceName) => targets.map((target) => ({
+      target,
+      resourceName,
+      outputPath: resourceName === undefined ? path.join(outputPath, target) : path.join(outputPath, resourceName, target)
+    })));
+
+    return Promise.all(builds.map(async (build) => {
+      try {
+        const compiler = this.getCompiler(build.target, outputType, language);
+        if (!compiler) {
+          throw new Error(`No compiler found for target "${build.target}", outputType "${outputType}", and language "${language}"`);
+        }
+        // The compilers in the list are shared, so each build gets an instance of its own.
+        const instance = new compiler.constructor({
+          sourcePath,
+          outputPath: build.outputPath,
+          resourceName: build.resourceName,
+          target: build.target,
+          outputType,
+          language,
+          scanExceptions,
+          packBools,
+          boundsChecks,
+          trace,
+          pouProfile,
+          allocTrack,
+          atomicImage,
+          arenaBytes,
+          splitUnits,
+          profile,
+          cpu,
+          lto,
+          pgoTraining,
+          nativeIO,
+          onlineChange,
+          warmRestart,
+          loopGuard,
+          fixedReal,
+          protocols,
+          browseVariables,
+          incremental,
+          project
+        });
+        await instance.compile();
+        return { ...build, success: true };
+      } catch (err) {
+        return { ...build, success: false, error: err.message };
+      }
+    }));
+  }
+
+  /**
+   * Builds several resources of an IEC project to run in one host process, sharing its scheduler, IO reactor,
+   * connections and OPC UA server. Each resource is built with onlineChange into a program library, with its located
+   * addresses moved into a window of the host's process image of its own, so the resources can't touch each other's
+   * image. The host executable is the same for every resource, and runs them all when given each library with
+   * --program. The variables of each resource are served from the OPC UA namespace urn:nodalis:resource:<name>.
+   * @param {object} options The options of compile(), with a resourceNames list in place of resourceName.
+   * @returns {Promise<{host: string, programs: string[]}>} Returns the path to the host executable and to the
+   * library of each resource, each written to outputPath/<resourceName>.
+   */
+  async compileHost({ target, resourceNames, outputType, outputPath, sourcePath, language, scanExceptions, packBools, boundsChecks, trace, pouProfile, allocTrack, atomicImage, arenaBytes, splitUnits, profile, cpu, lto, loopGuard, fixedReal, incremental }) {
+    validateFileExtension(language, sourcePath);
+    const ext = path.extname(sourcePath).toLowerCase();
+    if (ext !== ".iec" && ext !== ".xml") {
+      throw new Error("A host is built from the resources of an IEC project.");
+    }
+    if (!Array.isArray(resourceNames) || resourceNames.length === 0) {
+      throw new Error("A host needs at least one resource.");
+    }
+    const compiler = this.getCompiler(target, outputType, language);
+    if (!(compiler instanceof CPPCompiler)) {
+      throw new Error(`Resources can only be hosted together by a C++ executable, not for target "${target}".`);
+    }
+    const project = iec.Project.fromXML(fs.readFileSync(sourcePath, "utf-8"), resourceNames);
+    const sources = resourceNames.map((resourceName) => {
+      const resource = project.Instances.Configurations.flatMap((c) => c.Resources).find((r) => r.Name === resourceName);
+      if (!resource) {
+        throw new Error("No resource was found by the name " + resourceName + ".");
+      }
+      return resource.toST();
+    });
+    const windows = layoutHostImage(sources);
+    const builds = resourceNames.map((resourceName, x) => ({ resourceName, imageWindow: windows[x], outputPath: path.join(outputPath, resourceName) }));
+    await Promise.all(builds.map((build) => new compiler.constructor({
+      sourcePath,
+      outputPath: build.outputPath,
+      resourceName: build.resourceName,
+      target,
+      outputType,
+      language,
+      scanExceptions,
+      packBools,
+      boundsChecks,
+      trace,
+      pouProfile,
+      allocTrack,
+      atomicImage,
+      arenaBytes,
+      splitUnits,
+      profile,
+      cpu,
+      lto,
+      onlineChange: true,
+      loopGuard,
+      fixedReal,
+      incremental,
+      imageWindow: build.imageWindow,
+      project
+    }).compile()));
+    const executable = path.basename(sourcePath, path.extname(sourcePath));
+    const library = `.program.${target?.startsWith("macos") ? "dylib" : "so"}`;
+    return {
+      host: path.join(builds[0].outputPath, executable),
+      programs: builds.map((build) => path.join(build.outputPath, executable + library))
+    };
+  }
+
+  /**
+   * Watches a source and builds it again each time it is saved, until the returned watcher is closed. The compiler,
+   * its toolchain settings and the POUs read from an IEC project stay in memory between builds, and C++ programs are
+   * split into a translation unit per POU, so a save only recompiles the POUs it changed. A save that leaves the
+   * source as it was is not built. When a deploy target is given, each successful build is then programmed into the
+   * device, as program() does.
+   * @param {object} options The options of compile(), with the target, source, destination, username and password
+   * for deploying as deployTarget, deploySource (defaults to outputPath), destination, username and password, and
+   * how long to wait after a change for more of them, in milliseconds, as debounce (200 by default).
+   * @param {function({success: boolean, duration: number, deployed: boolean, error?: string}): void} onBuild Called
+   * with the result of each build.
+   * @returns {{close: function(): void}} Returns the watcher.
+   */
+  watch({ target, outputType, outputPath, resourceName, sourcePath, language, scanExceptions, packBools, boundsChecks, trace, pouProfile, allocTrack, atomicImage, arenaBytes, splitUnits, profile, cpu, lto, pgoTraining, nativeIO, onlineChange, warmRestart, loopGuard, fixedReal, protocols, browseVariables, incremental,
+    deployTarget, deploySource, destination, username, password, debounce = 200 }, onBuild = () => {}) {
+    validateFileExtension(language, sourcePath);
+    const compiler = this.getCompiler(target, outputType, language);
+    if (!compiler) {
+      throw new Error(`No compiler found for target "${target}", outputType "${outputType}", and language "${language}"`);
+    }
+    const instance = new compiler.constructor({
+      sourcePath,
+      outputPath,
+      resourceName,
+      target,
+      outputType,
+      language,
+      scanExceptions,
+      packBools,
+      boundsChecks,
+      trace,
+      pouProfile,
+      allocTrack,
+      atomicImage,
+      arenaBytes,
+      splitUnits: splitUnits ?? true,
+      profile,
+      cpu,
+      lto,
+      pgoTraining,
+      nativeIO,
+      onlineChange,
+      warmRestart,
+      loopGuard,
+      fixedReal,
+      protocols,
+      browseVariables,
+      incremental,
+      unitCache: new Map()
+    });
+
+    // Builds run one at a time. Changes made during a build are built once it finishes.
+    let building = false;
+    let pending = false;
+    let builtHash = null;
+    let timer = null;
+    const build = async () => {
+      if (building) {
+        pending = true;
+        return;
+      }
+      building = true;
+      try {
+        do {
+          pending = false;
+          const hash = crypto.createHash('sha256').update(fs.readFileSync(sourcePath)).digest('hex');
+          if (hash === builtHash) continue;
+          const started = Date.now();
+          let deployed = false;
+          try {
+            await instance.compile();
+            builtHash = hash;
+            if (deployTarget) {
+              await this.program({ target: deployTarget, source: deploySource ?? outputPath, destination, username, password });
+              deployed = true;
+            }
+            onBuild({ success: true, duration: Date.now() - started, deployed });
+          } catch (err) {
+            onBuild({ success: false, duration: Date.now() - started, deployed, error: err.message });
+          }
+        } while (pending);
+      } finally {
+        building = false;
+      }
+    };
+
+    // The folder is watched rather than the file, so saves that replace the file are seen as well.
+    const sourceName = path.basename(sourcePath);
+    const watcher = fs.watch(path.dirname(path.resolve(sourcePath)), (event, file) => {
+      if (file !== sourceName) return;
+      clearTimeout(timer);
+      timer = setTimeout(build, debounce);
+    });
+    build();
+    return {
+      close() {
+        clearTimeout(timer);
+        watcher.close();
+      }
+    };
+  }
+
   async program({ target, source, destination, username, password }) {
     const programmer = this.getProgrammer(target);
     if (!programmer) {
@@ -137,6 +406,31 @@ export class Nodalis {
     }
   }
 
+  /**
+   * Writes the IO maps of a source as a binary IO configuration, which a C++ runtime started with --io-config maps in
+   * place of the maps it was compiled with.
+   * @param {Object} options
+   * @param {string} options.sourcePath A JSON array of maps, with the fields of a //Map= line, or a source whose
+   * //Map= lines are read.
+   * @param {string} options.outputPath The configuration file to write.
+   * @returns {number} Returns the number of mappings written.
+   */
+  writeIOConfig({ sourcePath, outputPath }) {
+    const text = fs.readFileSync(sourcePath, 'utf8');
+    const entries = /\.json$/i.test(sourcePath)
+      ? JSON.parse(text).map((map) => JSON.stringify(JSON.stringify(map)).slice(1, -1))
+      : text.split('\n').filter((line) => line.trim().startsWith('//Map=')).map((line) => line.substring(line.indexOf('=') + 1).trim());
+    const compiler = new CPPCompiler();
+    const maps = entries.map((entry) => compiler.compileMap(entry));
+    const invalid = maps.filter((m) => !m.row);
+    if (invalid.length > 0) {
+      throw new Error(`${invalid.length} map(s) couldn't be read, the first being ${JSON.parse(`"${invalid[0].text}"`)}`);
+    }
+    const clients = groupMappings(maps);
+    fs.writeFileSync(outputPath, buildIOConfig(clients));
+    return [...clients.values()].reduce((sum, group) => sum + group.length, 0);
+  }
+
 }
 
 // === CLI Entry Point ===
@@ -153,20 +447,71 @@ Actions:
 
   --action compile
       Required options:
-        --target        Target platform (e.g. nodejs, generic-cpp)
-        --outputType    Output type (e.g. code, executable)
+        --target        Target platform (e.g. nodejs, generic-cpp, cortex-m)
+        --outputType    Output type (e.g. code, executable, wasm)
         --outputPath    Directory to write the result
         --resourceName  Resource name (used for .iec projects)
         --sourcePath    Path to source file (.st or .iec)
         --language      st (Structured Text) or ld (Ladder Diagram)
+      Optional:
+        --scanExceptions false  Builds C++ executables without exception handling around the scan
+        --packBools true        Packs the internal BOOLs of C++ programs into words and evaluates runs of rungs a word at a time
+        --boundsChecks true     Builds C++ executables that fault a task that indexes an array outside of its bounds
+        --trace true            Builds C++ executables that record trace events of their tasks, programs, IO and OPC UA server
+        --pouProfile true       Builds C++ executables that time each PROGRAM, FUNCTION and FUNCTION_BLOCK, for the diagnostics
+        --allocTrack true       Builds C++ executables that count their heap allocations, and can report those made during scans
+        --atomicImage true      Builds C++ executables that read and write each located value with one atomic access (the default on 32 bit targets)
+        --arenaBytes <n>        Builds C++ executables that allocate from a static arena of that many bytes while they start
+        --splitUnits true       Writes each C++ POU to a translation unit of its own, so a rebuild only compiles the POUs that changed
+        --profile <name>        C++ build profile: release (-O2 with link time optimization, the default), size (-Os), embedded (-Os without exceptions or RTTI) or debug (-O0 -g)
+        --cpu <name>            Builds C++ executables for a CPU, with -mcpu (or -march on x64), e.g. cortex-a72
+        --lto false             Builds C++ release and size profiles without link time optimization
+        --pgo <ms>              Builds a C++ executable with profile guided optimization, trained on a run of that many milliseconds
+        --nativeIO true         Builds the C++ IO clients into a library beside a jint executable, for its --native-io option
+        --onlineChange true     Builds a C++ executable as a host and a program library it swaps in when rebuilt, keeping its state and IO
+        --warmRestart true      Builds C++ executables that snapshot their state when stopped and restore it when started again
+        --loopGuard true        Builds C++ loops that end once their task has run past its watchdog budget
+        --fixedReal <true|n>    Builds C++ programs whose REAL is a saturating fixed point number with n (16) fractional bits, for CPUs without an FPU
+        --protocols <list>      Builds C++ executables with Modbus, OPC UA or BACnet (modbus,opcua,bacnet or all) whether or not the IO maps use them
+        --browseVariables true  Builds C++ executables whose OPC UA server browses every program, function block and global variable in place
+        --incremental true      Builds C++ programs whose rungs are skipped when nothing they use changed, when run with --incremental
+
+  --action build
+      Builds a source for several targets and resources in parallel. Takes the options of compile, with:
+        --targets       Comma separated targets (e.g. linux-x64,linux-arm64,windows-x64)
+        --resourceNames Comma separated resources of an IEC project (optional for .st sources)
+        --jobs          Toolchain processes to run at once (defaults to the number of cores)
+      Each build is written to <outputPath>/<target>, or <outputPath>/<resourceName>/<target>. A failed build is
+      reported without stopping the others, and the exit code is 1 if any build failed.
+
+  --action host
+      Builds several resources of an IEC project to run in one host process, each in its own window of the process
+      image and OPC UA namespace, sharing the scheduler, IO and OPC UA server. Takes the options of compile, with:
+        --resourceNames Comma separated resources of the project
+      Each resource is written to <outputPath>/<resourceName>. The host is started with --program <library> for
+      each resource.
+
+  --action watch
+      Builds a source with the options of compile, then builds it again each time it is saved, until stopped with
+      Ctrl+C. C++ builds are split into a unit per POU, so a save only recompiles the POUs that changed. Optional:
+        --deployTarget  Programs each successful build into a device with this programmer (e.g. MTI or SSH)
+        --deploySource  The file or folder to program (defaults to outputPath)
+        --destination, --username, --password   As for deploy
+        --debounce      Milliseconds to wait after a change before building (defaults to 200)
 
   --action deploy  Programs a device based on a protocol.
-    --target        The device/protocol targeted for programming.
+    --target        The device/protocol targeted for programming (MTI, or SSH to send only what changed since
+                    the last deployment to [user@]host:folder).
     --source    The path to the file or folder to use for programming.
     --destination   The destination of the target device.
     --username      The username for programming the device, if needed.
     --password      The password for programming the device, if needed.
 
+  --action iomap  Writes IO maps as a binary IO configuration, which a C++ runtime started with --io-config <file>
+                  uses in place of the maps it was compiled with.
+    --sourcePath    A JSON array of maps, with the fields of a //Map= line, or a source with //Map= lines.
+    --outputPath    The configuration file to write (e.g. plc.iomap).
+
 Examples:
   node nodalis.js --action list-compilers
 
@@ -207,6 +552,27 @@ Examples:
         resourceName: argMap.resourceName,
         sourcePath: argMap.sourcePath,
         language: argMap.language,
+        scanExceptions: argMap.scanExceptions === undefined ? undefined : argMap.scanExceptions !== 'false',
+        packBools: argMap.packBools === 'true',
+        boundsChecks: argMap.boundsChecks === 'true',
+        trace: argMap.trace === 'true',
+        pouProfile: argMap.pouProfile === 'true',
+        allocTrack: argMap.allocTrack === 'true',
+        atomicImage: argMap.atomicImage === 'true',
+        arenaBytes: argMap.arenaBytes ? Number(argMap.arenaBytes) : undefined,
+        splitUnits: argMap.splitUnits === 'true',
+        profile: argMap.profile,
+        cpu: argMap.cpu,
+        lto: argMap.lto === undefined ? undefined : argMap.lto !== 'false',
+        pgoTraining: argMap.pgo === undefined ? undefined : parseInt(argMap.pgo, 10),
+        nativeIO: argMap.nativeIO === 'true',
+        onlineChange: argMap.onlineChange === 'true',
+        warmRestart: argMap.warmRestart === 'true',
+        loopGuard: argMap.loopGuard === 'true',
+        fixedReal: argMap.fixedReal === 'true' ? true : argMap.fixedReal ? Number(argMap.fixedReal) : undefined,
+        protocols: argMap.protocols,
+        browseVariables: argMap.browseVariables === 'true',
+        incremental: argMap.incremental === 'true',
       }).then(() => {
         console.log('Compilation completed.');
       }).catch(err => {
@@ -215,6 +581,136 @@ Examples:
       break;
     }
 
+    case 'build': {
+      const list = (value) => value === undefined ? undefined : value.split(',').map(v => v.trim()).filter(v => v.length > 0);
+      app.compileBatch({
+        targets: list(argMap.targets ?? argMap.target),
+        resourceNames: list(argMap.resourceNames ?? argMap.resourceName),
+        outputType: argMap.outputType,
+        outputPath: argMap.outputPath,
+        sourcePath: argMap.sourcePath,
+        language: argMap.language,
+        jobs: argMap.jobs === undefined ? undefined : parseInt(argMap.jobs, 10),
+        scanExceptions: argMap.scanExceptions === undefined ? undefined : argMap.scanExceptions !== 'false',
+        packBools: argMap.packBools === 'true',
+        boundsChecks: argMap.boundsChecks === 'true',
+        trace: argMap.trace === 'true',
+        pouProfile: argMap.pouProfile === 'true',
+        allocTrack: argMap.allocTrack === 'true',
+        atomicImage: argMap.atomicImage === 'true',
+        arenaBytes: argMap.arenaBytes ? Number(argMap.arenaBytes) : undefined,
+        splitUnits: argMap.splitUnits === 'true',
+        profile: argMap.profile,
+        cpu: argMap.cpu,
+        lto: argMap.lto === undefined ? undefined : argMap.lto !== 'false',
+        pgoTraining: argMap.pgo === undefined ? undefined : parseInt(argMap.pgo, 10),
+        nativeIO: argMap.nativeIO === 'true',
+        onlineChange: argMap.onlineChange === 'true',
+        warmRestart: argMap.warmRestart === 'true',
+        loopGuard: argMap.loopGuard === 'true',
+        fixedReal: argMap.fixedReal === 'true' ? true : argMap.fixedReal ? Number(argMap.fixedReal) : undefined,
+        protocols: argMap.protocols,
+        browseVariables: argMap.browseVariables === 'true',
+        incremental: argMap.incremental === 'true',
+      }).then((results) => {
+        results.forEach((r) => {
+          const name = r.resourceName === undefined ? r.target : `${r.resourceName} ${r.target}`;
+          console.log(r.success ? `${name}: built in ${r.outputPath}` : `${name}: failed: ${r.error}`);
+        });
+        const failed = results.filter((r) => !r.success).length;
+        console.log(`${results.length - failed} of ${results.length} builds completed.`);
+        if (failed > 0) process.exitCode = 1;
+      }).catch(err => {
+        console.error(`Build failed: ${err.message}`);
+        process.exitCode = 1;
+      });
+      break;
+    }
+
+    case 'host': {
+      app.compileHost({
+        target: argMap.target,
+        resourceNames: (argMap.resourceNames ?? "").split(',').map(v => v.trim()).filter(v => v.length > 0),
+        outputType: argMap.outputType,
+        outputPath: argMap.outputPath,
+        sourcePath: argMap.sourcePath,
+        language: argMap.language,
+        scanExceptions: argMap.scanExceptions === undefined ? undefined : argMap.scanExceptions !== 'false',
+        packBools: argMap.packBools === 'true',
+        boundsChecks: argMap.boundsChecks === 'true',
+        trace: argMap.trace === 'true',
+        pouProfile: argMap.pouProfile === 'true',
+        allocTrack: argMap.allocTrack === 'true',
+        atomicImage: argMap.atomicImage === 'true',
+        arenaBytes: argMap.arenaBytes ? Number(argMap.arenaBytes) : undefined,
+        splitUnits: argMap.splitUnits === 'true',
+        profile: argMap.profile,
+        cpu: argMap.cpu,
+        lto: argMap.lto === undefined ? undefined : argMap.lto !== 'false',
+        loopGuard: argMap.loopGuard === 'true',
+        fixedReal: argMap.fixedReal === 'true' ? true : argMap.fixedReal ? Number(argMap.fixedReal) : undefined,
+        incremental: argMap.incremental === 'true',
+      }).then((result) => {
+        console.log(`Host built. Run: ${[result.host, ...result.programs.flatMap((p) => ["--program", p])].join(" ")}`);
+      }).catch(err => {
+        console.error(`Host build failed: ${err.message}`);
+        process.exitCode = 1;
+      });
+      break;
+    }
+
+    case 'watch': {
+      try {
+        const watcher = app.watch({
+          target: argMap.target,
+          outputType: argMap.outputType,
+          outputPath: argMap.outputPath,
+          resourceName: argMap.resourceName,
+          sourcePath: argMap.sourcePath,
+          language: argMap.language,
+          scanExceptions: argMap.scanExceptions === undefined ? undefined : argMap.scanExceptions !== 'false',
+          packBools: argMap.packBools === 'true',
+          boundsChecks: argMap.boundsChecks === 'true',
+          trace: argMap.trace === 'true',
+          pouProfile: argMap.pouProfile === 'true',
+          allocTrack: argMap.allocTrack === 'true',
+          atomicImage: argMap.atomicImage === 'true',
+          arenaBytes: argMap.arenaBytes ? Number(argMap.arenaBytes) : undefined,
+          splitUnits: argMap.splitUnits === undefined ? undefined : argMap.splitUnits !== 'false',
+          profile: argMap.profile,
+          cpu: argMap.cpu,
+          lto: argMap.lto === undefined ? undefined : argMap.lto !== 'false',
+          pgoTraining: argMap.pgo === undefined ? undefined : parseInt(argMap.pgo, 10),
+          nativeIO: argMap.nativeIO === 'true',
+          onlineChange: argMap.onlineChange === 'true',
+          warmRestart: argMap.warmRestart === 'true',
+          loopGuard: argMap.loopGuard === 'true',
+          fixedReal: argMap.fixedReal === 'true' ? true : argMap.fixedReal ? Number(argMap.fixedReal) : undefined,
+          protocols: argMap.protocols,
+          browseVariables: argMap.browseVariables === 'true',
+          incremental: argMap.incremental === 'true',
+          deployTarget: argMap.deployTarget,
+          deploySource: argMap.deploySource,
+          destination: argMap.destination,
+          username: argMap.username,
+          password: argMap.password,
+          debounce: argMap.debounce === undefined ? undefined : parseInt(argMap.debounce, 10),
+        }, (r) => {
+          const time = new Date().toLocaleTimeString();
+          console.log(r.success ? `[${time}] Built in ${r.duration} ms${r.deployed ? " and deployed" : ""}.` : `[${time}] Build failed: ${r.error}`);
+        });
+        console.log(`Watching ${argMap.sourcePath}. Press Ctrl+C to stop.`);
+        process.on('SIGINT', () => {
+          watcher.close();
+          process.exit(0);
+        });
+      } catch (err) {
+        console.error(`Watch failed: ${err.message}`);
+        process.exitCode = 1;
+      }
+      break;
+    }
+
     case 'deploy': {
       app.program({
         target: argMap.target,
@@ -230,9 +726,20 @@ Examples:
       break;
     }
 
+    case 'iomap': {
+      try {
+        const count = app.writeIOConfig({ sourcePath: argMap.sourcePath, outputPath: argMap.outputPath });
+        console.log(`Wrote ${count} mappings to ${argMap.outputPath}.`);
+      } catch (err) {
+        console.error(`IO configuration failed: ${err.message}`);
+        process.exitCode = 1;
+      }
+      break;
+    }
+
     default: {
       console.error(`Unknown or missing action: ${argMap.action}`);
-      console.error(`Valid actions: list-compilers, compile, deploy`);
+      console.error(`Valid actions: list-compilers, compile, build, watch, deploy, iomap`);
       break;
     }
   }
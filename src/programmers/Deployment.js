@@ -0,0 +1,228 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * Delta deployment for programmers that reach a device through a shell.
+ *
+ * The files to deploy are cut into chunks at content-defined boundaries, so an edit only changes the chunks around it
+ * and a rebuilt executable shares most of its chunks with the one installed before it. The device keeps the chunks
+ * of its installed files in a store beside them, named by their SHA-256, and a deployment only sends the chunks the
+ * store doesn't have. Each changed file is then put together from the store into a temporary file and renamed over
+ * the installed one, so a running program never sees a half-written file, and a host started with --onlineChange
+ * swaps in a replaced program library as it would after any other online change.
+ */
+import crypto from 'crypto';
+import fs from 'fs';
+import path from 'path';
+
+const MIN_CHUNK = 2 * 1024;
+const MAX_CHUNK = 64 * 1024;
+/** A boundary every 8 KiB on average: the low 13 bits of the rolling hash are zero. */
+const CHUNK_MASK = 0x1fff;
+
+/** The folder of the chunk store and manifest, in the destination folder. */
+export const DEPLOYMENT_FOLDER = '.nodalis-deploy';
+
+/**
+ * The gear table of the rolling hash, a random 32 bit value for each byte value. It is derived from SHA-256 rather
+ * than Math.random() so that every build of the compiler cuts the same file into the same chunks.
+ */
+const GEAR = Array.from({ length: 256 }, (_, i) =>
+  crypto.createHash('sha256').update(`nodalis-gear-${i}`).digest().readUInt32LE(0));
+
+/**
+ * Cuts a buffer into chunks at content-defined boundaries.
+ * @param {Buffer} data The contents of a file.
+ * @returns {Buffer[]} Returns the chunks, in order.
+ */
+export function chunkBuffer(data) {
+  const chunks = [];
+  let start = 0;
+  while (start < data.length) {
+    const end = Math.min(start + MAX_CHUNK, data.length);
+    let cut = end;
+    let hash = 0;
+    for (let i = start + MIN_CHUNK; i < end; i++) {
+      hash = ((hash << 1) + GEAR[data[i]]) >>> 0;
+      if ((hash & CHUNK_MASK) === 0) {
+        cut = i + 1;
+        break;
+      }
+    }
+    chunks.push(data.subarray(start, cut));
+    start = cut;
+  }
+  return chunks;
+}
+
+/**
+ * Names a chunk in the store.
+ * @param {Buffer} chunk The chunk.
+ * @returns {string} Returns the hex SHA-256 of the chunk.
+ */
+export function chunkName(chunk) {
+  return crypto.createHash('sha256').update(chunk).digest('hex');
+}
+
+/**
+ * Lists the files to deploy from a source. A file is deployed on its own. Of a folder, such as the output folder of a
+ * build, the executables, program libraries and symbol indexes at its top level are deployed, and the generated
+ * sources and build files beside them are not.
+ * @param {string} source The file or folder to deploy.
+ * @returns {string[]} Returns the paths of the files.
+ */
+export function listDeployedFiles(source) {
+  if (!fs.statSync(source).isDirectory()) {
+    return [source];
+  }
+  return fs.readdirSync(source, { withFileTypes: true })
+    .filter(entry => entry.isFile())
+    .map(entry => path.join(source, entry.name))
+    .filter(file => /\.(so|dylib|dll|exe|symbols|iomap)$/.test(file) || (fs.statSync(file).mode & 0o111) !== 0);
+}
+
+/**
+ * Makes the manifest of the files to deploy, and the chunks they are made of.
+ * @param {string[]} files The paths of the files.
+ * @returns {{manifest: Object, chunks: Map<string, Buffer>}} Returns the manifest, which maps the name of each file to
+ * its size, mode and the names of its chunks in order, and the chunks by name.
+ */
+export function buildManifest(files) {
+  const manifest = { version: 1, files: {} };
+  const chunks = new Map();
+  for (const file of files) {
+    const data = fs.readFileSync(file);
+    const names = chunkBuffer(data).map(chunk => {
+      const name = chunkName(chunk);
+      chunks.set(name, chunk);
+      return name;
+    });
+    manifest.files[path.basename(file)] = {
+      size: data.length,
+      mode: fs.statSync(file).mode & 0o777,
+      chunks: names
+    };
+  }
+  return { manifest, chunks };
+}
+
+/**
+ * Writes files into a ustar archive, which the tar of any device can unpack from a pipe.
+ * @param {Array<{name: string, data: Buffer}>} entries The files, with names of up to 100 bytes.
+ * @returns {Buffer} Returns the archive.
+ */
+export function tarArchive(entries) {
+  const blocks = [];
+  for (const { name, data } of entries) {
+    const header = Buffer.alloc(512);
+    header.write(name, 0, 100);
+    header.write('0000644\0', 100);
+    header.write('0000000\0', 108);
+    header.write('0000000\0', 116);
+    header.write(data.length.toString(8).padStart(11, '0') + '\0', 124);
+    header.write(Math.floor(Date.now() / 1000).toString(8).padStart(11, '0') + '\0', 136);
+    header.write('        ', 148);
+    header.write('0', 156);
+    header.write('ustar\0', 257);
+    header.write('00', 263);
+    let sum = 0;
+    for (const byte of header) {
+      sum += byte;
+    }
+    header.write(sum.toString(8).padStart(6, '0') + '\0 ', 148);
+    blocks.push(header, data, Buffer.alloc((512 - data.length % 512) % 512));
+  }
+  blocks.push(Buffer.alloc(1024));
+  return Buffer.concat(blocks);
+}
+
+/**
+ * Quotes a word for a POSIX shell.
+ * @param {string} word The word.
+ * @returns {string} Returns the quoted word.
+ */
+export function shellQuote(word) {
+  return `'${String(word).replace(/'/g, `'\\''`)}'`;
+}
+
+/**
+ * Deploys files into a folder of a device through a shell on it, sending only the chunks the device doesn't have.
+ * @param {Object} options
+ * @param {string} options.source The file or folder to deploy, as for listDeployedFiles().
+ * @param {string} options.folder The destination folder on the device.
+ * @param {function(string, Buffer=): Promise<string>} options.run Runs a POSIX shell script on the device, with the
+ * buffer as its standard input if given, and resolves to its standard output. It rejects if the script fails.
+ * @returns {Promise<{files: number, changed: string[], sentChunks: number, sentBytes: number, totalBytes: number}>}
+ * Returns how many files were deployed, the names of those that changed, and how much of them was sent.
+ */
+export async function deployDelta({ source, folder, run }) {
+  const files = listDeployedFiles(source);
+  if (files.length === 0) {
+    throw new Error(`Nothing to deploy in ${source}.`);
+  }
+  const { manifest, chunks } = buildManifest(files);
+  const store = `${folder}/${DEPLOYMENT_FOLDER}`;
+  const q = shellQuote;
+
+  // The chunks the device has, and the manifest of what it has installed.
+  const listing = await run(`mkdir -p ${q(store + '/chunks')} && ls ${q(store + '/chunks')} && echo --- && ` +
+    `(cat ${q(store + '/manifest.json')} 2>/dev/null || true)`);
+  const [stored, installedText] = listing.split(/^---$/m);
+  const present = new Set(stored.split(/\s+/).filter(name => /^[0-9a-f]{64}$/.test(name)));
+  let installed = { files: {} };
+  try {
+    installed = JSON.parse(installedText) ?? installed;
+  }
+  catch {
+    // A device without a manifest, or with a damaged one, gets every file put together again.
+  }
+
+  const missing = [...chunks.keys()].filter(name => !present.has(name));
+  const sentBytes = missing.reduce((sum, name) => sum + chunks.get(name).length, 0);
+  if (missing.length > 0) {
+    await run(`tar -xf - -C ${q(store + '/chunks')}`,
+      tarArchive(missing.map(name => ({ name, data: chunks.get(name) }))));
+  }
+
+  // Each changed file is put together beside the installed one and renamed over it, which is atomic.
+  const changed = Object.keys(manifest.files).filter(name =>
+    JSON.stringify(installed.files?.[name]) !== JSON.stringify(manifest.files[name]));
+  const script = ['set -e', `cd ${q(store + '/chunks')}`];
+  for (const name of changed) {
+    const file = manifest.files[name];
+    const temporary = `${folder}/.${name}.deploying`;
+    script.push(`cat /dev/null ${file.chunks.join(' ')} > ${q(temporary)}`,
+      `chmod ${file.mode.toString(8)} ${q(temporary)}`,
+      `mv -f ${q(temporary)} ${q(`${folder}/${name}`)}`);
+  }
+  // The manifest records the files this deployment installed alongside those of earlier ones.
+  const merged = { version: 1, files: { ...installed.files, ...manifest.files } };
+  script.push(`cat > ${q(store + '/manifest.json.new')} <<'NODALIS_MANIFEST'`, JSON.stringify(merged),
+    'NODALIS_MANIFEST', `mv -f ${q(store + '/manifest.json.new')} ${q(store + '/manifest.json')}`);
+  // Chunks that no installed file is made of any more are removed.
+  const kept = new Set(Object.values(merged.files).flatMap(file => file.chunks));
+  const stale = [...present].filter(name => !kept.has(name));
+  for (let i = 0; i < stale.length; i += 200) {
+    script.push(`rm -f ${stale.slice(i, i + 200).join(' ')}`);
+  }
+  await run('sh -s', Buffer.from(script.join('\n') + '\n'));
+
+  return {
+    files: files.length,
+    changed,
+    sentChunks: missing.length,
+    sentBytes,
+    totalBytes: Object.values(manifest.files).reduce((sum, file) => sum + file.size, 0)
+  };
+}
@@ -0,0 +1,86 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+import { spawn } from 'child_process';
+import { Programmer, ProgrammingTargets } from "./Programmer.js";
+import { deployDelta } from "./Deployment.js";
+/**
+ * @typedef {Object} ProgrammerOptions
+ * @property {string} source - Source file or folder path
+ * @property {string} destination - Output destination folder path, ip address, or URI.
+ * @property {string} username - Username for programming.
+ * @property {string} password - Password for programming.
+ */
+
+/**
+ * Programs a device over SSH, as [user@]host:folder, with a delta deployment: only the chunks of the build the device
+ * doesn't have yet are sent, compressed by ssh, and the changed files are swapped in atomically. The ssh client of the
+ * system is used, with its keys and configuration; a password is passed through sshpass, which must be installed.
+ */
+export class SSHProgrammer extends Programmer {
+    constructor(options) {
+        super(options);
+        this.name = "SSHProgrammer";
+        this.target = ProgrammingTargets.SSH;
+    }
+
+    /**
+     * Runs a shell script on the device.
+     * @param {string} host The host, with the user if given.
+     * @param {string} script The script.
+     * @param {Buffer} input The standard input of the script, if any.
+     * @returns {Promise<string>} Returns the standard output of the script.
+     */
+    run(host, script, input) {
+        const password = this.options.password;
+        const ssh = ["-C", "-o", `BatchMode=${password ? "no" : "yes"}`, host, script];
+        const child = password
+            ? spawn("sshpass", ["-e", "ssh", ...ssh], { env: { ...process.env, SSHPASS: password } })
+            : spawn("ssh", ssh);
+        return new Promise((resolve, reject) => {
+            let output = "";
+            let errors = "";
+            child.stdout.on("data", data => { output += data; });
+            child.stderr.on("data", data => { errors += data; });
+            child.on("error", reject);
+            child.on("close", code => code === 0 ? resolve(output)
+                : reject(new Error(`ssh ${host} failed (${code}): ${errors.trim()}`)));
+            child.stdin.end(input);
+        });
+    }
+
+    async program() {
+        const match = /^(?:([^@]+)@)?([^:]+):(.+)$/.exec(this.options.destination ?? "");
+        if (!match) {
+            console.error(`SSH destinations are [user@]host:folder, not ${this.options.destination}`);
+            return false;
+        }
+        const user = match[1] ?? this.options.username;
+        const host = user ? `${user}@${match[2]}` : match[2];
+        try {
+            const result = await deployDelta({
+                source: this.options.source,
+                folder: match[3].replace(/\/+$/, "") || "/",
+                run: (script, input) => this.run(host, script, input)
+            });
+            console.log(`Sent ${result.sentChunks} chunks (${result.sentBytes} of ${result.totalBytes} bytes) to ` +
+                `${host}; ${result.changed.length} of ${result.files} files changed` +
+                (result.changed.length > 0 ? `: ${result.changed.join(", ")}` : "") + ".");
+        }
+        catch (e) {
+            console.error(e.message || e);
+            return false;
+        }
+        return true;
+    }
+}
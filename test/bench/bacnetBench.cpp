@@ -0,0 +1,701 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Load benchmark of the BACnet/IP client against simulated devices
+ * @author Nathan Skipper, MTI
+ * @version 1.0.0
+ * @copyright Apache 2.0
+ */
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+// The standard headers come first, since the BACnet stack defines min and max as macros.
+#include "nodalis.h"
+#include "nodalisjson.h"
+#include "bacnet.h"
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #pragma comment(lib, "ws2_32.lib")
+    using socket_t = SOCKET;
+    using socklen = int;
+    static constexpr socket_t NO_SOCKET = INVALID_SOCKET;
+    static void closeSocket(socket_t fd){ closesocket(fd); }
+#else
+    #include <netinet/in.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+    using socket_t = int;
+    using socklen = socklen_t;
+    static constexpr socket_t NO_SOCKET = -1;
+    static void closeSocket(socket_t fd){ close(fd); }
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+#pragma region "Simulated Devices"
+/**
+ * BACnet/IP devices simulated on loopback ports, each with a number of Analog Input objects. A device answers
+ * Who-Is, ReadProperty, ReadPropertyMultiple and SubscribeCOV on its own UDP socket, with a reader thread per device.
+ * Replies are queued by the time they are due and sent by a single writer, after a configurable latency and jitter,
+ * and requests can be dropped at random to exercise the client's retries and timeouts. The subscribed objects change
+ * at a fixed interval, and each change is notified to its subscriber.
+ */
+class SimulatedDevices {
+public:
+    struct Options {
+        size_t devices = 1;
+        size_t objects = 100;
+        uint32_t firstInstance = 100000;
+        int64_t latency = 0;        // The time from a request to its reply, in microseconds.
+        int64_t jitter = 0;         // The most the latency varies by either way, uniformly, in microseconds.
+        double loss = 0;            // The fraction of confirmed requests that are dropped.
+        bool rpm = true;            // Whether ReadPropertyMultiple is supported. Without it, it is rejected.
+        int covInterval = 100;      // The interval the subscribed objects change at, in milliseconds.
+    };
+
+    explicit SimulatedDevices(const Options& options) : options(options){
+#ifdef _WIN32
+        WSADATA wsa;
+        WSAStartup(MAKEWORD(2,2), &wsa);
+#endif
+    }
+
+    /**
+     * Opens a socket for every device, and starts the threads. The threads run until the process exits.
+     * @returns Returns false if a socket can't be opened.
+     */
+    bool start(){
+        for(size_t d = 0; d < options.devices; d++){
+            auto device = std::make_unique<Device>();
+            device->instance = options.firstInstance + static_cast<uint32_t>(d);
+            device->values.reset(new std::atomic<uint32_t>[options.objects]);
+            for(size_t k = 0; k < options.objects; k++){
+                device->values[k] = static_cast<uint32_t>(k);
+            }
+            device->fd = socket(AF_INET, SOCK_DGRAM, 0);
+            if(device->fd == NO_SOCKET){
+                return false;
+            }
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen length = sizeof(address);
+            if(bind(device->fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+                || getsockname(device->fd, reinterpret_cast<sockaddr*>(&address), &length) != 0){
+                closeSocket(device->fd);
+                return false;
+            }
+            device->port = ntohs(address.sin_port);
+            devices.push_back(std::move(device));
+        }
+        for(auto& device : devices){
+            std::thread(&SimulatedDevices::runDevice, this, device.get()).detach();
+        }
+        std::thread(&SimulatedDevices::runWriter, this).detach();
+        std::thread(&SimulatedDevices::runChanges, this).detach();
+        return true;
+    }
+
+    /**
+     * Gets the UDP port of a device.
+     */
+    uint16_t port(size_t device) const { return devices[device]->port; }
+
+    /**
+     * Counters of the devices, summed.
+     */
+    struct Counters {
+        uint64_t requests = 0;      // The confirmed requests received, including those that were dropped.
+        uint64_t lost = 0;          // The confirmed requests that were dropped.
+        uint64_t values = 0;        // The property values read.
+        uint64_t notifications = 0; // The COV notifications sent.
+        uint64_t rejected = 0;      // The requests rejected, like ReadPropertyMultiple when it isn't supported.
+    };
+    Counters getCounters() const {
+        Counters counters;
+        counters.requests = requests.load();
+        counters.lost = lost.load();
+        counters.values = values.load();
+        counters.notifications = notifications.load();
+        counters.rejected = rejected.load();
+        return counters;
+    }
+
+private:
+    struct Device {
+        socket_t fd = NO_SOCKET;
+        uint16_t port = 0;
+        uint32_t instance = 0;
+        std::unique_ptr<std::atomic<uint32_t>[]> values;
+    };
+    /**
+     * A COV subscription to an object of a device.
+     */
+    struct Subscription {
+        Device* device;
+        sockaddr_in subscriber;
+        uint32_t processId;
+        uint32_t object;
+    };
+    /**
+     * A frame waiting for its due time.
+     */
+    struct Frame {
+        Clock::time_point due;
+        uint64_t sequence;
+        socket_t fd;
+        sockaddr_in dest;
+        std::vector<uint8_t> bytes;
+        bool operator>(const Frame& other) const {
+            return due != other.due ? due > other.due : sequence > other.sequence;
+        }
+    };
+
+    Options options;
+    std::vector<std::unique_ptr<Device>> devices;
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> lost{0};
+    std::atomic<uint64_t> values{0};
+    std::atomic<uint64_t> notifications{0};
+    std::atomic<uint64_t> rejected{0};
+
+    std::mutex subscriptionMutex;
+    std::vector<Subscription> subscriptions;
+
+    std::mutex queueMutex;
+    std::condition_variable queueReady;
+    std::priority_queue<Frame, std::vector<Frame>, std::greater<Frame>> queue;
+    uint64_t nextSequence = 0;
+
+    /**
+     * Queues an APDU to be sent from a device, wrapped in a BVLC Original-Unicast-NPDU and an NPDU.
+     */
+    void send(Device& device, const sockaddr_in& dest, const uint8_t* apdu, int apduLen, Clock::time_point due){
+        if(apduLen <= 0){
+            return;
+        }
+        Frame frame;
+        frame.due = due;
+        frame.fd = device.fd;
+        frame.dest = dest;
+        size_t length = 6 + static_cast<size_t>(apduLen);
+        frame.bytes = { 0x81, 0x0A, static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length), 0x01, 0x00 };
+        frame.bytes.insert(frame.bytes.end(), apdu, apdu + apduLen);
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            frame.sequence = nextSequence++;
+            queue.push(std::move(frame));
+        }
+        queueReady.notify_one();
+    }
+
+    /**
+     * Encodes the value of an object's property.
+     * @returns Returns the length of the value, or BACNET_STATUS_ERROR if the device has no such property.
+     */
+    int encodeValue(Device& device, BACNET_OBJECT_TYPE type, uint32_t instance, BACNET_PROPERTY_ID property, uint8_t* out,
+                    BACNET_ERROR_CLASS& errorClass, BACNET_ERROR_CODE& errorCode){
+        if(type == OBJECT_DEVICE && (instance == device.instance || instance == BACNET_MAX_INSTANCE)){
+            if(property == PROP_OBJECT_IDENTIFIER){
+                return encode_application_object_id(out, OBJECT_DEVICE, device.instance);
+            }
+        }
+        else if(type != OBJECT_ANALOG_INPUT || instance >= options.objects){
+            errorClass = ERROR_CLASS_OBJECT;
+            errorCode = ERROR_CODE_UNKNOWN_OBJECT;
+            return BACNET_STATUS_ERROR;
+        }
+        else if(property == PROP_PRESENT_VALUE){
+            values.fetch_add(1, std::memory_order_relaxed);
+            return encode_application_unsigned(out, device.values[instance].load(std::memory_order_relaxed));
+        }
+        errorClass = ERROR_CLASS_PROPERTY;
+        errorCode = ERROR_CODE_UNKNOWN_PROPERTY;
+        return BACNET_STATUS_ERROR;
+    }
+
+    void readProperty(Device& device, const sockaddr_in& from, const uint8_t* apdu, int apduLen, Clock::time_point due){
+        uint8_t invoke = apdu[2];
+        uint8_t reply[MAX_APDU + 64];
+        BACNET_READ_PROPERTY_DATA request{};
+        if(rp_decode_service_request(apdu + 4, static_cast<unsigned>(apduLen - 4), &request) <= 0){
+            send(device, from, reply, reject_encode_apdu(reply, invoke, REJECT_REASON_MISSING_REQUIRED_PARAMETER), due);
+            return;
+        }
+        uint8_t value[32];
+        BACNET_ERROR_CLASS errorClass;
+        BACNET_ERROR_CODE errorCode;
+        int len = encodeValue(device, request.object_type, request.object_instance, request.object_property, value, errorClass, errorCode);
+        if(len < 0){
+            send(device, from, reply, bacerror_encode_apdu(reply, invoke, SERVICE_CONFIRMED_READ_PROPERTY, errorClass, errorCode), due);
+            return;
+        }
+        request.application_data = value;
+        request.application_data_len = len;
+        send(device, from, reply, rp_ack_encode_apdu(reply, invoke, &request), due);
+    }
+
+    void readPropertyMultiple(Device& device, const sockaddr_in& from, const uint8_t* apdu, int apduLen, Clock::time_point due){
+        uint8_t invoke = apdu[2];
+        uint8_t reply[MAX_APDU + 64];
+        if(!options.rpm){
+            rejected.fetch_add(1, std::memory_order_relaxed);
+            send(device, from, reply, reject_encode_apdu(reply, invoke, REJECT_REASON_UNRECOGNIZED_SERVICE), due);
+            return;
+        }
+        size_t maxReply = static_cast<size_t>(decode_max_apdu(apdu[1]));
+        if(maxReply < 50 || maxReply > MAX_APDU){
+            maxReply = MAX_APDU;
+        }
+        uint8_t value[32];
+        int len = rpm_ack_encode_apdu_init(reply, invoke);
+        bool overflow = false;
+        int offset = 4;
+        while(offset < apduLen && !overflow){
+            BACNET_RPM_DATA request{};
+            int decoded = rpm_decode_object_id(apdu + offset, static_cast<unsigned>(apduLen - offset), &request);
+            if(decoded <= 0){
+                break;
+            }
+            offset += decoded;
+            len += rpm_ack_encode_apdu_object_begin(reply + len, &request);
+            while(offset < apduLen && rpm_decode_object_end(apdu + offset, static_cast<unsigned>(apduLen - offset)) != 1){
+                decoded = rpm_decode_object_property(apdu + offset, static_cast<unsigned>(apduLen - offset), &request);
+                if(decoded <= 0){
+                    offset = apduLen + 1;
+                    break;
+                }
+                offset += decoded;
+                BACNET_ERROR_CLASS errorClass;
+                BACNET_ERROR_CODE errorCode;
+                int valueLen = encodeValue(device, request.object_type, request.object_instance, request.object_property, value, errorClass, errorCode);
+                // The property, its tags and its value or error.
+                if(static_cast<size_t>(len) + 12 + 10 + 1 > maxReply){
+                    overflow = true;
+                    break;
+                }
+                len += rpm_ack_encode_apdu_object_property(reply + len, request.object_property, request.array_index);
+                len += valueLen >= 0 ? rpm_ack_encode_apdu_object_property_value(reply + len, value, static_cast<unsigned>(valueLen))
+                                     : rpm_ack_encode_apdu_object_property_error(reply + len, errorClass, errorCode);
+            }
+            offset++;
+            len += rpm_ack_encode_apdu_object_end(reply + len);
+        }
+        if(overflow){
+            len = abort_encode_apdu(reply, invoke, ABORT_REASON_SEGMENTATION_NOT_SUPPORTED, true);
+        }
+        else if(offset != apduLen){
+            len = reject_encode_apdu(reply, invoke, REJECT_REASON_INVALID_TAG);
+        }
+        send(device, from, reply, len, due);
+    }
+
+    void subscribeCov(Device& device, const sockaddr_in& from, const uint8_t* apdu, int apduLen, Clock::time_point due){
+        uint8_t invoke = apdu[2];
+        uint8_t reply[16];
+        BACNET_SUBSCRIBE_COV_DATA request{};
+        if(cov_subscribe_decode_service_request(apdu + 4, static_cast<unsigned>(apduLen - 4), &request) <= 0){
+            send(device, from, reply, reject_encode_apdu(reply, invoke, REJECT_REASON_MISSING_REQUIRED_PARAMETER), due);
+            return;
+        }
+        uint32_t object = request.monitoredObjectIdentifier.instance;
+        if(request.monitoredObjectIdentifier.type != OBJECT_ANALOG_INPUT || object >= options.objects){
+            send(device, from, reply, bacerror_encode_apdu(reply, invoke, SERVICE_CONFIRMED_SUBSCRIBE_COV, ERROR_CLASS_OBJECT,
+                ERROR_CODE_UNKNOWN_OBJECT), due);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(subscriptionMutex);
+            bool renewed = false;
+            for(auto& subscription : subscriptions){
+                if(subscription.device == &device && subscription.object == object && subscription.processId == request.subscriberProcessIdentifier){
+                    renewed = true;
+                }
+            }
+            if(!renewed && !request.cancellationRequest){
+                subscriptions.push_back({ &device, from, request.subscriberProcessIdentifier, object });
+            }
+        }
+        send(device, from, reply, encode_simple_ack(reply, invoke, SERVICE_CONFIRMED_SUBSCRIBE_COV), due);
+    }
+
+    void runDevice(Device* device){
+        std::mt19937_64 random(device->instance);
+        std::uniform_int_distribution<int64_t> spread(-options.jitter, options.jitter);
+        std::uniform_real_distribution<double> chance(0, 1);
+        uint8_t buffer[MAX_PDU + 64];
+        for(;;){
+            sockaddr_in from{};
+            socklen length = sizeof(from);
+            int received = recvfrom(device->fd, reinterpret_cast<char*>(buffer), sizeof(buffer), 0, reinterpret_cast<sockaddr*>(&from), &length);
+            if(received < 4 || buffer[0] != 0x81 || (buffer[1] != 0x0A && buffer[1] != 0x0B)){
+                continue;
+            }
+            auto arrived = Clock::now();
+            BACNET_ADDRESS dest{};
+            BACNET_ADDRESS source{};
+            BACNET_NPDU_DATA npdu{};
+            int offset = bacnet_npdu_decode(buffer + 4, static_cast<uint16_t>(received - 4), &dest, &source, &npdu);
+            if(offset <= 0 || npdu.network_layer_message || received - 4 - offset < 2){
+                continue;
+            }
+            const uint8_t* apdu = buffer + 4 + offset;
+            int apduLen = received - 4 - offset;
+            int64_t delay = options.latency + (options.jitter > 0 ? spread(random) : 0);
+            auto due = arrived + std::chrono::microseconds(delay > 0 ? delay : 0);
+            uint8_t type = apdu[0] & 0xF0;
+            if(type == PDU_TYPE_UNCONFIRMED_SERVICE_REQUEST && apdu[1] == SERVICE_UNCONFIRMED_WHO_IS){
+                int32_t low = -1;
+                int32_t high = -1;
+                if(apduLen > 2 && whois_decode_service_request(apdu + 2, static_cast<unsigned>(apduLen - 2), &low, &high) <= 0){
+                    continue;
+                }
+                if(low < 0 || (static_cast<int64_t>(device->instance) >= low && static_cast<int64_t>(device->instance) <= high)){
+                    uint8_t iam[32];
+                    send(*device, from, iam, iam_encode_apdu(iam, device->instance, MAX_APDU, SEGMENTATION_NONE, BACNET_VENDOR_ID), due);
+                }
+                continue;
+            }
+            if(type != PDU_TYPE_CONFIRMED_SERVICE_REQUEST || apduLen < 4){
+                continue;
+            }
+            requests.fetch_add(1, std::memory_order_relaxed);
+            if(options.loss > 0 && chance(random) < options.loss){
+                lost.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            switch(apdu[3]){
+                case SERVICE_CONFIRMED_READ_PROPERTY:
+                    readProperty(*device, from, apdu, apduLen, due);
+                    break;
+                case SERVICE_CONFIRMED_READ_PROP_MULTIPLE:
+                    readPropertyMultiple(*device, from, apdu, apduLen, due);
+                    break;
+                case SERVICE_CONFIRMED_SUBSCRIBE_COV:
+                    subscribeCov(*device, from, apdu, apduLen, due);
+                    break;
+                default: {
+                    uint8_t reply[8];
+                    rejected.fetch_add(1, std::memory_order_relaxed);
+                    send(*device, from, reply, reject_encode_apdu(reply, apdu[2], REJECT_REASON_UNRECOGNIZED_SERVICE), due);
+                    break;
+                }
+            }
+        }
+    }
+
+    /**
+     * Changes every subscribed object at the COV interval, and notifies its subscriber.
+     */
+    void runChanges(){
+        auto next = Clock::now();
+        uint8_t apdu[MAX_APDU];
+        for(;;){
+            next += std::chrono::milliseconds(options.covInterval > 0 ? options.covInterval : 1);
+            std::this_thread::sleep_until(next);
+            std::lock_guard<std::mutex> lock(subscriptionMutex);
+            auto due = Clock::now() + std::chrono::microseconds(options.latency);
+            for(auto& subscription : subscriptions){
+                uint32_t value = subscription.device->values[subscription.object].fetch_add(1, std::memory_order_relaxed) + 1;
+                BACNET_PROPERTY_VALUE list[1];
+                BACNET_COV_DATA data{};
+                cov_data_value_list_link(&data, list, 1);
+                data.subscriberProcessIdentifier = subscription.processId;
+                data.initiatingDeviceIdentifier = subscription.device->instance;
+                data.monitoredObjectIdentifier.type = OBJECT_ANALOG_INPUT;
+                data.monitoredObjectIdentifier.instance = subscription.object;
+                cov_value_list_encode_unsigned(list, value, false, false, false, false);
+                send(*subscription.device, subscription.subscriber, apdu, ucov_notify_encode_apdu(apdu, sizeof(apdu), &data), due);
+                notifications.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void runWriter(){
+        std::unique_lock<std::mutex> lock(queueMutex);
+        for(;;){
+            if(queue.empty()){
+                queueReady.wait(lock);
+                continue;
+            }
+            Clock::time_point due = queue.top().due;
+            if(due > Clock::now()){
+                queueReady.wait_until(lock, due);
+                continue;
+            }
+            Frame frame = queue.top();
+            queue.pop();
+            lock.unlock();
+            sendto(frame.fd, reinterpret_cast<const char*>(frame.bytes.data()), static_cast<int>(frame.bytes.size()), 0,
+                reinterpret_cast<const sockaddr*>(&frame.dest), sizeof(frame.dest));
+            lock.lock();
+        }
+    }
+};
+#pragma endregion
+
+#pragma region "Harness"
+/**
+ * The options of a run, from the command line.
+ */
+struct BenchOptions {
+    /**
+     * rp reads every point with its own ReadProperty, since the devices reject ReadPropertyMultiple. rpm reads the
+     * points of a device in ReadPropertyMultiple requests. cov subscribes to every point and receives its changes.
+     */
+    std::string mode = "rpm";
+    size_t points = 1000;
+    int inFlight = 1;
+    int poll = 100;
+    int responseTimeout = 200;
+    int retries = 1;
+    uint16_t localPort = 0;
+    int warmup = 1000;
+    int duration = 3000;
+    std::string out;
+};
+
+/**
+ * The IO counters of every client, summed.
+ */
+struct ClientTotals {
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+    uint64_t latency[ExecutionStats::HISTOGRAM_BUCKETS] = {};
+};
+
+static ClientTotals totalClients(){
+    ClientTotals totals;
+    for(auto& client : Clients){
+        const IOCounters& counters = client->getCounters();
+        totals.requests += counters.requests.load();
+        totals.errors += counters.errors.load();
+        if(ExecutionStats* stats = counters.latency.load()){
+            for(int b = 0; b < ExecutionStats::HISTOGRAM_BUCKETS; b++){
+                totals.latency[b] += stats->getHistogram(b);
+            }
+        }
+    }
+    return totals;
+}
+
+/**
+ * Estimates a percentile from the difference of two latency histograms.
+ * @returns Returns the upper bound of the bucket the percentile falls in, in microseconds, or 0 if it is empty.
+ */
+static uint64_t histogramPercentile(const ClientTotals& before, const ClientTotals& after, double percent){
+    uint64_t count = 0;
+    for(int b = 0; b < ExecutionStats::HISTOGRAM_BUCKETS; b++){
+        count += after.latency[b] - before.latency[b];
+    }
+    if(count == 0){
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(static_cast<double>(count) * percent / 100.0);
+    uint64_t seen = 0;
+    for(int b = 0; b < ExecutionStats::HISTOGRAM_BUCKETS; b++){
+        seen += after.latency[b] - before.latency[b];
+        if(seen > rank){
+            return 1ull << b;
+        }
+    }
+    return 1ull << (ExecutionStats::HISTOGRAM_BUCKETS - 1);
+}
+
+/**
+ * The counters of the shared datalink at one moment.
+ */
+struct DatalinkTotals {
+    uint64_t receives, emptyReceives, waits, unrouted, resends, timeouts;
+};
+
+static DatalinkTotals totalDatalink(){
+    const BACnetDatalinkCounters& counters = BACnetDatalink::instance().getCounters();
+    return { counters.receives.load(), counters.emptyReceives.load(), counters.waits.load(), counters.unrouted.load(),
+             counters.resends.load(), counters.timeouts.load() };
+}
+
+/**
+ * Runs scans every millisecond until a time, so that the values the clients stage are latched.
+ */
+static void runScans(Clock::time_point until){
+    auto next = Clock::now();
+    while(next < until){
+        latchScanTime(Clock::now());
+        latchInputs();
+        commitOutputs();
+        next += std::chrono::milliseconds(1);
+        std::this_thread::sleep_until(next);
+    }
+}
+#pragma endregion
+
+int main(int argc, char* argv[]){
+    BenchOptions options;
+    SimulatedDevices::Options devices;
+    for(int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        bool value = i + 1 < argc;
+        if(arg == "--mode" && value) options.mode = argv[++i];
+        else if(arg == "--devices" && value) devices.devices = std::strtoull(argv[++i], nullptr, 10);
+        else if(arg == "--points" && value) options.points = std::strtoull(argv[++i], nullptr, 10);
+        else if(arg == "--in-flight" && value) options.inFlight = std::atoi(argv[++i]);
+        else if(arg == "--poll" && value) options.poll = std::atoi(argv[++i]);
+        else if(arg == "--timeout" && value) options.responseTimeout = std::atoi(argv[++i]);
+        else if(arg == "--retries" && value) options.retries = std::atoi(argv[++i]);
+        else if(arg == "--latency" && value) devices.latency = std::atoll(argv[++i]);
+        else if(arg == "--jitter" && value) devices.jitter = std::atoll(argv[++i]);
+        else if(arg == "--loss" && value) devices.loss = std::atof(argv[++i]);
+        else if(arg == "--cov-interval" && value) devices.covInterval = std::atoi(argv[++i]);
+        else if(arg == "--local-port" && value) options.localPort = static_cast<uint16_t>(std::atoi(argv[++i]));
+        else if(arg == "--warmup" && value) options.warmup = std::atoi(argv[++i]);
+        else if(arg == "--duration" && value) options.duration = std::atoi(argv[++i]);
+        else if(arg == "--out" && value) options.out = argv[++i];
+        else{
+            std::cout << "Usage: " << argv[0] << " [--mode rp|rpm|cov] [--devices <n>] [--points <n>] [--in-flight <n>] [--poll <ms>]\n"
+                << "    [--timeout <ms>] [--retries <n>] [--latency <us>] [--jitter <us>] [--loss <fraction>] [--cov-interval <ms>]\n"
+                << "    [--local-port <port>] [--warmup <ms>] [--duration <ms>] [--out <file>]\n";
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+    if(options.mode != "rp" && options.mode != "rpm" && options.mode != "cov"){
+        std::cerr << "Unknown mode " << options.mode << "\n";
+        return 1;
+    }
+    devices.devices = devices.devices < 1 ? 1 : devices.devices > options.points ? options.points : devices.devices;
+    devices.objects = (options.points + devices.devices - 1) / devices.devices;
+    devices.rpm = options.mode != "rp";
+    if(options.points == 0 || options.points > NODALIS_INPUT_BYTES / 4){
+        std::cerr << "The process image can't hold " << options.points << " points\n";
+        return 1;
+    }
+    latchScanTime(Clock::now());
+
+    SimulatedDevices simulated(devices);
+    if(!simulated.start()){
+        std::cerr << "Can't open the sockets of the simulated devices\n";
+        return 1;
+    }
+    BACnetDatalink::instance().setLocalPort(options.localPort);
+
+    // Point i is Analog Input i / devices of device i % devices, read into %ID(i). The rows of each device are
+    // contiguous, as in the table the compiler generates.
+    std::vector<std::string> ports;
+    std::vector<std::string> properties(options.points);
+    std::vector<std::string> locals(options.points);
+    std::vector<IOMapDefinition> rows;
+    std::vector<IOClientDefinition> clients;
+    rows.reserve(options.points);
+    for(size_t d = 0; d < devices.devices; d++){
+        ports.push_back(std::to_string(simulated.port(d)));
+    }
+    for(size_t d = 0; d < devices.devices; d++){
+        clients.push_back({ rows.size(), 0 });
+        for(size_t i = d; i < options.points; i += devices.devices){
+            json config = {
+                {"ObjectType", OBJECT_ANALOG_INPUT},
+                {"ObjectInstance", i / devices.devices},
+                {"PropertyId", PROP_PRESENT_VALUE},
+                {"ValueType", "u"},
+                {"MaxInFlight", options.inFlight > 0 ? options.inFlight : 1},
+                {"ResponseTimeout", options.responseTimeout},
+                {"Retries", options.retries}
+            };
+            if(options.mode == "cov"){
+                config["COV"] = true;
+            }
+            properties[i] = config.dump();
+            locals[i] = "%ID" + std::to_string(i);
+            rows.push_back({ "BACNET-IP", "127.0.0.1", ports[d].c_str(), locals[i].c_str(), locals[i].c_str(),
+                properties[i].c_str(), 32, options.poll, 0, 0, -1 });
+            clients.back().count++;
+        }
+    }
+    mapIOTable(rows.data(), clients.data(), clients.size());
+    startIO(0);
+
+    runScans(Clock::now() + std::chrono::milliseconds(options.warmup));
+    size_t connected = 0;
+    for(auto& client : Clients){
+        connected += client->connected ? 1 : 0;
+    }
+    ClientTotals before = totalClients();
+    DatalinkTotals linkBefore = totalDatalink();
+    SimulatedDevices::Counters devicesBefore = simulated.getCounters();
+    auto start = Clock::now();
+    runScans(start + std::chrono::milliseconds(options.duration));
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    ClientTotals after = totalClients();
+    DatalinkTotals link = totalDatalink();
+    SimulatedDevices::Counters devicesAfter = simulated.getCounters();
+
+    uint64_t requests = after.requests - before.requests;
+    uint64_t receives = link.receives - linkBefore.receives;
+    auto perSecond = [&](uint64_t count){ return static_cast<double>(count) / seconds; };
+    json results = {
+        {"mode", options.mode},
+        {"devices", devices.devices},
+        {"points", options.points},
+        {"connected", connected},
+        {"inFlight", options.inFlight},
+        {"pollMillis", options.poll},
+        {"latencyMicros", devices.latency},
+        {"jitterMicros", devices.jitter},
+        {"loss", devices.loss},
+        {"seconds", seconds},
+        {"requests", requests},
+        {"requestsPerSecond", perSecond(requests)},
+        {"errors", after.errors - before.errors},
+        {"timeouts", link.timeouts - linkBefore.timeouts},
+        {"resends", link.resends - linkBefore.resends},
+        {"lost", devicesAfter.lost - devicesBefore.lost},
+        {"rejected", devicesAfter.rejected - devicesBefore.rejected},
+        {"valuesPerSecond", perSecond(devicesAfter.values - devicesBefore.values)},
+        {"notificationsPerSecond", perSecond(devicesAfter.notifications - devicesBefore.notifications)},
+        {"roundTripMicros", {
+            {"p50", histogramPercentile(before, after, 50)},
+            {"p99", histogramPercentile(before, after, 99)}
+        }},
+        {"receiveLoop", {
+            {"receives", receives},
+            {"emptyReceives", link.emptyReceives - linkBefore.emptyReceives},
+            {"waits", link.waits - linkBefore.waits},
+            {"unrouted", link.unrouted - linkBefore.unrouted},
+            {"receivesPerRequest", requests > 0 ? static_cast<double>(receives) / static_cast<double>(requests) : 0.0}
+        }}
+    };
+    if(options.out.empty()){
+        std::cout << results.dump(2) << std::endl;
+    }
+    else{
+        std::ofstream(options.out) << results.dump(2) << "\n";
+    }
+    std::cout.flush();
+    // The clients and the simulated devices are left running; exiting here skips tearing them down mid-request.
+    std::_Exit(0);
+}
@@ -0,0 +1,77 @@
+// benchBACnet.js
+//
+// Builds the BACnet benchmark, which runs the BACnet/IP client against simulated devices on loopback ports, and runs
+// it for each number of points in each mode: rp (a ReadProperty per point, since the devices reject
+// ReadPropertyMultiple), rpm (ReadPropertyMultiple requests) and cov (a subscription per point, with the changes
+// notified). Each run reports requests/s, values/s, notifications/s, round trip percentiles, timeouts, resends and
+// lost requests, and how many receives the client's wait loop makes per request. The results are written as JSON.
+//
+//   node test/bench/benchBACnet.js [--points 1,100,1000,10000] [--modes rp,rpm,cov] [--devices 10] [--in-flight 4]
+//                                  [--latency 200] [--jitter 50] [--loss 0] [--poll 100] [--duration 3000]
+//                                  [--profile release] [--out results.json]
+
+import fs from 'fs';
+import os from 'os';
+import path from 'path';
+import { execFileSync } from 'child_process';
+import { fileURLToPath } from 'url';
+import { buildBenchmark, hostTarget, parseArgs } from './buildBench.js';
+
+const __filename = fileURLToPath(import.meta.url);
+const __dirname = path.dirname(__filename);
+const fixture = path.join(__dirname, 'fixtures', 'bacnet.st');
+const benchSource = path.join(__dirname, 'bacnetBench.cpp');
+
+/**
+ * The options passed through to each run, with their defaults.
+ */
+const RUN_OPTIONS = {
+  devices: '10', 'in-flight': '4', latency: '200', jitter: '50', loss: '0', poll: '100', timeout: '200', retries: '1',
+  'cov-interval': '100', warmup: '1000', duration: '3000'
+};
+
+async function runBenchmarks() {
+  const args = parseArgs(process.argv.slice(2));
+  const profile = typeof args.profile === 'string' ? args.profile : 'release';
+  const sizes = (typeof args.points === 'string' ? args.points : '1,100,1000,10000').split(',').map((s) => parseInt(s, 10));
+  const modes = (typeof args.modes === 'string' ? args.modes : 'rp,rpm,cov').split(',');
+  const target = hostTarget();
+  const exeFile = await buildBenchmark({ name: 'bacnet', source: benchSource, fixture, target, profile, protocols: ['bacnet'] });
+  const resultsFile = path.join(path.dirname(exeFile), 'run.json');
+
+  const passed = [];
+  Object.keys(RUN_OPTIONS).forEach((name) => passed.push(`--${name}`, typeof args[name] === 'string' ? args[name] : RUN_OPTIONS[name]));
+  if (typeof args['local-port'] === 'string') passed.push('--local-port', args['local-port']);
+  const report = { date: new Date().toISOString(), host: `${os.platform()}-${os.arch()}`, cpu: os.cpus()[0]?.model, profile, runs: [] };
+  console.log(`${'points'.padStart(6)} ${'mode'.padEnd(4)} ${'req/s'.padStart(9)} ${'values/s'.padStart(10)} ${'notify/s'.padStart(9)} ` +
+    `${'p50 us'.padStart(7)} ${'p99 us'.padStart(7)} ${'timeouts'.padStart(8)} ${'resends'.padStart(7)} ${'lost'.padStart(6)} ` +
+    `${'recv/req'.padStart(8)} errors`);
+  for (const points of sizes) {
+    for (const mode of modes) {
+      fs.rmSync(resultsFile, { force: true });
+      try {
+        execFileSync(exeFile, ['--mode', mode, '--points', String(points), ...passed, '--out', resultsFile], { stdio: 'ignore' });
+        const run = JSON.parse(fs.readFileSync(resultsFile, 'utf-8'));
+        report.runs.push(run);
+        console.log(`${String(points).padStart(6)} ${mode.padEnd(4)} ${run.requestsPerSecond.toFixed(0).padStart(9)} ` +
+          `${run.valuesPerSecond.toFixed(0).padStart(10)} ${run.notificationsPerSecond.toFixed(0).padStart(9)} ` +
+          `${String(run.roundTripMicros.p50).padStart(7)} ${String(run.roundTripMicros.p99).padStart(7)} ` +
+          `${String(run.timeouts).padStart(8)} ${String(run.resends).padStart(7)} ${String(run.lost).padStart(6)} ` +
+          `${run.receiveLoop.receivesPerRequest.toFixed(2).padStart(8)} ${run.errors}`);
+      } catch (err) {
+        report.runs.push({ mode, points, error: err.message });
+        console.error(`❌ ${points} points, ${mode}: ${err.message}`);
+        process.exitCode = 1;
+      }
+    }
+  }
+
+  const out = typeof args.out === 'string' ? args.out : path.join(__dirname, 'output', 'bacnet', 'results.json');
+  fs.writeFileSync(out, JSON.stringify(report, null, 2));
+  console.log(`Results written to ${out}`);
+}
+
+runBenchmarks().catch((err) => {
+  console.error(err);
+  process.exitCode = 1;
+});
@@ -0,0 +1,124 @@
+// benchCompile.js
+//
+// Times each stage of CPPCompiler.compile() (XML parse, toST, ST parse, analysis, transpile, writing the code,
+// copying the runtime and the toolchain) on generated projects of growing size (see genProject.js), and reports the
+// memory of the compiler's process through each build. Each build runs cold, in a process of its own with an empty cache, so that one build's
+// heap and cached code don't carry over to the next. The growth of each stage is fitted as time ≈ a·n^k over the
+// number of POUs n, and a stage whose k is well above 1 is reported as superlinear. The results are written as JSON.
+//
+//   node test/bench/benchCompile.js [--sweep 10,100,1000] [--rungs 20] [--globals 200] [--maps 100] [--tasks 4]
+//                                   [--formats iec,st] [--outputType code|executable] [--out results.json]
+
+import fs from 'fs';
+import os from 'os';
+import path from 'path';
+import { execFileSync } from 'child_process';
+import { fileURLToPath } from 'url';
+import { CPPCompiler } from '../../src/compilers/CPPCompiler.js';
+import { parseArgs, hostTarget } from './buildBench.js';
+import { generateProject, DEFAULT_SIZE, RESOURCE_NAME } from './genProject.js';
+
+const __filename = fileURLToPath(import.meta.url);
+const __dirname = path.dirname(__filename);
+const outputRoot = path.join(__dirname, 'output', 'compile');
+
+/**
+ * The exponent of growth above which a stage is reported as superlinear, which leaves room for noise in a linear one.
+ */
+const SUPERLINEAR = 1.2;
+
+/**
+ * Runs one build in this process and writes its stages and peak memory as JSON. They are written to a file, since the
+ * toolchain writes to the output of the process.
+ * @param {{source: string, output: string, outputType: string, results: string}} build The build.
+ */
+async function buildOnce(build) {
+  const compiler = new CPPCompiler({ sourcePath: build.source, outputPath: build.output, target: hostTarget(),
+    outputType: build.outputType, resourceName: RESOURCE_NAME });
+  await compiler.compile();
+  // maxRSS is in kilobytes.
+  fs.writeFileSync(build.results, JSON.stringify({ stages: compiler.buildStages, maxRssBytes: process.resourceUsage().maxRSS * 1024 }));
+}
+
+/**
+ * Fits time ≈ a·n^k to the times of a stage, by least squares on their logarithms.
+ * @param {{n: number, millis: number}[]} points The times of the stage by the number of POUs.
+ * @returns {number|null} Returns the exponent k, or null if there are fewer than three times, which are too few to
+ * tell growth from noise.
+ */
+function growthExponent(points) {
+  const logs = points.filter((p) => p.millis > 0.05).map((p) => ({ x: Math.log(p.n), y: Math.log(p.millis) }));
+  if (logs.length < 3) return null;
+  const mx = logs.reduce((a, p) => a + p.x, 0) / logs.length;
+  const my = logs.reduce((a, p) => a + p.y, 0) / logs.length;
+  const sxx = logs.reduce((a, p) => a + (p.x - mx) ** 2, 0);
+  return sxx > 0 ? logs.reduce((a, p) => a + (p.x - mx) * (p.y - my), 0) / sxx : null;
+}
+
+async function runBenchmarks() {
+  const args = parseArgs(process.argv.slice(2));
+  if (typeof args.build === 'string') {
+    await buildOnce(JSON.parse(args.build));
+    return;
+  }
+  const sizes = (typeof args.sweep === 'string' ? args.sweep : '10,100,1000').split(',').map((s) => parseInt(s, 10));
+  const formats = (typeof args.formats === 'string' ? args.formats : 'iec,st').split(',');
+  const outputType = typeof args.outputType === 'string' ? args.outputType : 'code';
+  const size = Object.fromEntries(Object.keys(DEFAULT_SIZE).filter((key) => key !== 'pous' && args[key] !== undefined)
+    .map((key) => [key, parseInt(args[key], 10)]));
+  fs.rmSync(outputRoot, { recursive: true, force: true });
+
+  const report = {
+    date: new Date().toISOString(),
+    host: `${os.platform()}-${os.arch()}`,
+    cpu: os.cpus()[0]?.model,
+    outputType,
+    size: { ...DEFAULT_SIZE, ...size, pous: sizes },
+    builds: [],
+    scaling: {}
+  };
+  for (const format of formats) {
+    for (const pous of sizes) {
+      const name = `${format}${pous}`;
+      // Each source sits in its own directory, which keeps the toolchain.json the compiler writes beside it.
+      const sourceDir = path.join(outputRoot, 'sources', name);
+      fs.mkdirSync(sourceDir, { recursive: true });
+      const source = path.join(sourceDir, `${name}.${format === 'st' ? 'st' : 'iec'}`);
+      fs.writeFileSync(source, generateProject({ ...size, pous }, format));
+      const build = { source, output: path.join(outputRoot, name), outputType, results: path.join(sourceDir, 'stages.json') };
+      let result;
+      try {
+        execFileSync(process.execPath, [__filename, '--build', JSON.stringify(build)], {
+          env: { ...process.env, NODALIS_CACHE: path.join(outputRoot, 'cache', name) }, stdio: ['ignore', 'ignore', 'inherit']
+        });
+        result = JSON.parse(fs.readFileSync(build.results, 'utf-8'));
+      } catch (err) {
+        report.builds.push({ format, pous, error: err.message });
+        console.error(`❌ ${name}: ${err.message}`);
+        process.exitCode = 1;
+        continue;
+      }
+      const totalMillis = result.stages.reduce((a, s) => a + s.millis, 0);
+      report.builds.push({ format, pous, sourceBytes: fs.statSync(source).size, totalMillis, ...result });
+      console.log(`${format.padEnd(3)} ${String(pous).padStart(6)} POUs: ${totalMillis.toFixed(0)} ms, ` +
+        `${(result.maxRssBytes / 1048576).toFixed(0)} MiB peak | ` +
+        result.stages.map((s) => `${s.name} ${s.millis.toFixed(0)} ms`).join(', '));
+    }
+    const builds = report.builds.filter((b) => b.format === format && !b.error);
+    const stages = [...new Set(builds.flatMap((b) => b.stages.map((s) => s.name)))];
+    report.scaling[format] = Object.fromEntries(stages.map((stage) => [stage,
+      growthExponent(builds.map((b) => ({ n: b.pous, millis: b.stages.find((s) => s.name === stage)?.millis ?? 0 })))]));
+    Object.entries(report.scaling[format]).filter(([, k]) => k !== null && k > SUPERLINEAR).forEach(([stage, k]) => {
+      console.warn(`⚠️  ${format} ${stage} grows as n^${k.toFixed(2)} with the number of POUs`);
+    });
+  }
+
+  const out = typeof args.out === 'string' ? args.out : path.join(outputRoot, 'results.json');
+  fs.writeFileSync(out, JSON.stringify(report, null, 2));
+  console.log(`Results written to ${out}`);
+}
+
+runBenchmarks().catch((err) => {
+  console.error(err);
+  process.exitCode = 1;
+});
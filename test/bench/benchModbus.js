@@ -0,0 +1,72 @@
+// benchModbus.js
+//
+// Builds the Modbus benchmark, which runs the Modbus/TCP client against a simulated slave on loopback ports, and
+// runs it for each number of mappings in each mode: sequential (a request per mapping, one at a time), coalesced
+// (block requests, one at a time) and pipelined (block requests, several outstanding). Each run reports
+// transactions/s, round trip percentiles and how long the scan thread was stalled by IO. The results are written
+// as JSON.
+//
+//   node test/bench/benchModbus.js [--mappings 1,10,100,1000,10000] [--modes sequential,coalesced,pipelined]
+//                                  [--clients 4] [--in-flight 8] [--latency 500] [--jitter 100] [--poll 1]
+//                                  [--duration 2000] [--sync-io] [--profile release] [--out results.json]
+
+import fs from 'fs';
+import os from 'os';
+import path from 'path';
+import { execFileSync } from 'child_process';
+import { fileURLToPath } from 'url';
+import { buildBenchmark, hostTarget, parseArgs } from './buildBench.js';
+
+const __filename = fileURLToPath(import.meta.url);
+const __dirname = path.dirname(__filename);
+const fixture = path.join(__dirname, 'fixtures', 'modbus.st');
+const benchSource = path.join(__dirname, 'modbusBench.cpp');
+
+/**
+ * The options passed through to each run, with their defaults.
+ */
+const RUN_OPTIONS = { clients: '4', 'in-flight': '8', latency: '500', jitter: '100', poll: '1', warmup: '500', duration: '2000' };
+
+async function runBenchmarks() {
+  const args = parseArgs(process.argv.slice(2));
+  const profile = typeof args.profile === 'string' ? args.profile : 'release';
+  const sizes = (typeof args.mappings === 'string' ? args.mappings : '1,10,100,1000,10000').split(',').map((s) => parseInt(s, 10));
+  const modes = (typeof args.modes === 'string' ? args.modes : 'sequential,coalesced,pipelined').split(',');
+  const target = hostTarget();
+  const exeFile = await buildBenchmark({ name: 'modbus', source: benchSource, fixture, target, profile, protocols: ['modbus'] });
+  const resultsFile = path.join(path.dirname(exeFile), 'run.json');
+
+  const passed = [];
+  Object.keys(RUN_OPTIONS).forEach((name) => passed.push(`--${name}`, typeof args[name] === 'string' ? args[name] : RUN_OPTIONS[name]));
+  if (args['sync-io']) passed.push('--sync-io');
+  const report = { date: new Date().toISOString(), host: `${os.platform()}-${os.arch()}`, cpu: os.cpus()[0]?.model, profile, runs: [] };
+  console.log(`${'mappings'.padStart(8)} ${'mode'.padEnd(10)} ${'trans/s'.padStart(10)} ${'regs/s'.padStart(12)} ` +
+    `${'p50 us'.padStart(8)} ${'p99 us'.padStart(8)} ${'stall p99 ns'.padStart(13)} ${'stall %'.padStart(8)} errors`);
+  for (const mappings of sizes) {
+    for (const mode of modes) {
+      fs.rmSync(resultsFile, { force: true });
+      try {
+        execFileSync(exeFile, ['--mode', mode, '--mappings', String(mappings), ...passed, '--out', resultsFile], { stdio: 'ignore' });
+        const run = JSON.parse(fs.readFileSync(resultsFile, 'utf-8'));
+        report.runs.push(run);
+        console.log(`${String(mappings).padStart(8)} ${mode.padEnd(10)} ${run.transactionsPerSecond.toFixed(0).padStart(10)} ` +
+          `${run.registersPerSecond.toFixed(0).padStart(12)} ${String(run.roundTripMicros.p50).padStart(8)} ` +
+          `${String(run.roundTripMicros.p99).padStart(8)} ${String(run.scanStallNanos.p99).padStart(13)} ` +
+          `${(run.scanStallNanos.fraction * 100).toFixed(3).padStart(8)} ${run.errors}`);
+      } catch (err) {
+        report.runs.push({ mode, mappings, error: err.message });
+        console.error(`❌ ${mappings} mappings, ${mode}: ${err.message}`);
+        process.exitCode = 1;
+      }
+    }
+  }
+
+  const out = typeof args.out === 'string' ? args.out : path.join(__dirname, 'output', 'modbus', 'results.json');
+  fs.writeFileSync(out, JSON.stringify(report, null, 2));
+  console.log(`Results written to ${out}`);
+}
+
+runBenchmarks().catch((err) => {
+  console.error(err);
+  process.exitCode = 1;
+});
@@ -0,0 +1,83 @@
+// benchRuntime.js
+//
+// Builds the runtime micro benchmarks for one or more targets, runs them on the host's target, and compares the
+// results with a baseline. The benchmarks are built against the same runtime library and flags as a PLC executable,
+// so a build for another target can be copied there and run to compare targets.
+//
+//   node test/bench/benchRuntime.js [--target linux-x64,linux-arm64] [--profile release] [--time 200]
+//                                   [--filter TON] [--baseline results.json] [--tolerance 0.2]
+//   node test/bench/benchRuntime.js --results linux-arm64.json --baseline linux-x64.json
+
+import fs from 'fs';
+import path from 'path';
+import { execFileSync } from 'child_process';
+import { fileURLToPath } from 'url';
+import { buildBenchmark, hostTarget, parseArgs } from './buildBench.js';
+
+const __filename = fileURLToPath(import.meta.url);
+const __dirname = path.dirname(__filename);
+const fixture = path.join(__dirname, 'fixtures', 'bench.st');
+const benchSource = path.join(__dirname, 'runtimeBench.cpp');
+
+/**
+ * Compares results with a baseline.
+ * @param {object[]} results The results of a run.
+ * @param {object[]} baseline The results to compare with.
+ * @param {number} tolerance How much slower, as a fraction, a benchmark can be before it is a regression.
+ * @returns {number} Returns the number of benchmarks that regressed.
+ */
+function compare(results, baseline, tolerance) {
+  const before = new Map(baseline.map((r) => [r.name, r]));
+  let regressions = 0;
+  results.forEach((r) => {
+    const b = before.get(r.name);
+    if (!b) {
+      return;
+    }
+    const change = b.nsPerOp > 0 ? r.nsPerOp / b.nsPerOp - 1 : 0;
+    const slower = change > tolerance || r.allocsPerOp > b.allocsPerOp;
+    if (slower) {
+      regressions++;
+    }
+    console.log(`${slower ? '❌' : '  '} ${r.name.padEnd(32)} ${b.nsPerOp.toFixed(2).padStart(10)} -> ${r.nsPerOp.toFixed(2).padStart(10)} ns/op ` +
+      `(${change >= 0 ? '+' : ''}${(change * 100).toFixed(1)}%) ${b.allocsPerOp.toFixed(3)} -> ${r.allocsPerOp.toFixed(3)} allocs/op`);
+  });
+  return regressions;
+}
+
+async function runBenchmarks() {
+  const args = parseArgs(process.argv.slice(2));
+  const tolerance = args.tolerance === undefined ? 0.2 : parseFloat(args.tolerance);
+  const baseline = typeof args.baseline === 'string' ? JSON.parse(fs.readFileSync(args.baseline, 'utf-8')) : null;
+  if (typeof args.results === 'string') {
+    process.exitCode = baseline && compare(JSON.parse(fs.readFileSync(args.results, 'utf-8')), baseline, tolerance) > 0 ? 1 : 0;
+    return;
+  }
+
+  const host = hostTarget();
+  const targets = typeof args.target === 'string' ? args.target.split(',') : [host];
+  const profile = typeof args.profile === 'string' ? args.profile : 'release';
+  for (const target of targets) {
+    const exeFile = await buildBenchmark({ name: 'runtimeBench', source: benchSource, fixture, target, profile });
+    if (target !== host) {
+      console.log(`Built ${exeFile}. Run it on a ${target} host with --json to record its results.`);
+      continue;
+    }
+    const benchArgs = ['--json'];
+    if (args.time !== undefined) benchArgs.push('--time', String(args.time));
+    if (typeof args.filter === 'string') benchArgs.push('--filter', args.filter);
+    const results = JSON.parse(execFileSync(exeFile, benchArgs, { encoding: 'utf-8', maxBuffer: 16 * 1024 * 1024 }));
+    const resultsFile = path.join(path.dirname(exeFile), 'results.json');
+    fs.writeFileSync(resultsFile, JSON.stringify(results, null, 2));
+    results.forEach((r) => console.log(`${r.name.padEnd(32)} ${r.nsPerOp.toFixed(2).padStart(12)} ns/op ${r.allocsPerOp.toFixed(3).padStart(10)} allocs/op`));
+    console.log(`Results for ${target} written to ${resultsFile}`);
+    if (baseline && compare(results, baseline, tolerance) > 0) {
+      process.exitCode = 1;
+    }
+  }
+}
+
+runBenchmarks().catch((err) => {
+  console.error(err);
+  process.exitCode = 1;
+});
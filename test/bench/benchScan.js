@@ -0,0 +1,138 @@
+// benchScan.js
+//
+// Compiles ST fixtures with the CPPCompiler and runs each executable in benchmark mode (--bench), which runs every
+// task back to back for a number of scans with IO and the servers left stopped. A sweep of generated programs, from
+// 10 to 10,000 rungs, shows how the scan time grows with the size of a program. The results are written as JSON.
+//
+//   node test/bench/benchScan.js [--fixtures test/st/fixtures/PLC-1.st,...] [--scans 100000]
+//                                [--sweep 10,100,1000,10000] [--profile release] [--out results.json]
+
+import fs from 'fs';
+import os from 'os';
+import path from 'path';
+import { execFileSync } from 'child_process';
+import { fileURLToPath } from 'url';
+import { CPPCompiler } from '../../src/compilers/CPPCompiler.js';
+
+const __filename = fileURLToPath(import.meta.url);
+const __dirname = path.dirname(__filename);
+const outputRoot = path.join(__dirname, 'output', 'scan');
+const defaultFixtures = ['PLC-1.st', 'simpleProgram.st'].map((f) => path.resolve(__dirname, '..', 'st', 'fixtures', f));
+
+function parseArgs(argv) {
+  const args = {};
+  for (let i = 0; i < argv.length; i++) {
+    if (argv[i].startsWith('--')) {
+      args[argv[i].substring(2)] = argv[i + 1] !== undefined && !argv[i + 1].startsWith('--') ? argv[++i] : true;
+    }
+  }
+  return args;
+}
+
+/**
+ * Writes a program of latching rungs, like the coils of a Ladder Diagram network. Each rung sets an output from an
+ * input, holds it, and resets it from the input of the next rung.
+ * @param {number} rungs The number of rungs.
+ * @returns {string} Returns the ST of the program.
+ */
+function sweepProgram(rungs) {
+  const bit = (i) => `${Math.floor(i / 8)}.${i % 8}`;
+  let st = `PROGRAM Sweep${rungs}\n`;
+  for (let i = 0; i < rungs; i++) {
+    st += `  %QX${bit(i)} := (%IX${bit(i)} OR %QX${bit(i)}) AND NOT %IX${bit((i + 1) % rungs)};\n`;
+  }
+  return st + 'END_PROGRAM\n';
+}
+
+/**
+ * Compiles a source into an executable and runs it in benchmark mode.
+ * @param {string} sourcePath The ST source.
+ * @param {number} scans The number of scans to run.
+ * @param {string} profile The build profile.
+ * @returns {Promise<object>} Returns the results the runtime wrote.
+ */
+async function benchmark(sourcePath, scans, profile) {
+  const name = path.basename(sourcePath, path.extname(sourcePath));
+  const outputPath = path.join(outputRoot, name);
+  const host = new CPPCompiler({});
+  const target = `${host.getHostOS()}-${host.getHostArch()}`;
+  await new CPPCompiler({ sourcePath, outputPath, target, outputType: 'executable', profile }).compile();
+  const exeFile = path.join(outputPath, target.startsWith('windows') ? `${name}.exe` : name);
+  const resultsFile = path.join(outputPath, `${name}.bench.json`);
+  fs.rmSync(resultsFile, { force: true });
+  execFileSync(exeFile, ['--bench', String(scans), '--bench-out', resultsFile], { stdio: 'ignore', maxBuffer: 64 * 1024 * 1024 });
+  return { name, ...JSON.parse(fs.readFileSync(resultsFile, 'utf-8')) };
+}
+
+/**
+ * Fits a line to the mean scan time against the number of rungs, by least squares.
+ * @param {{rungs: number, meanNanos: number}[]} points The sweep.
+ * @returns {{overheadNanos: number, nanosPerRung: number, r2: number}} Returns the fixed cost of a scan, the cost of
+ * each rung, and how well the line fits, from 0 to 1.
+ */
+function fitLine(points) {
+  const n = points.length;
+  const mx = points.reduce((a, p) => a + p.rungs, 0) / n;
+  const my = points.reduce((a, p) => a + p.meanNanos, 0) / n;
+  const sxy = points.reduce((a, p) => a + (p.rungs - mx) * (p.meanNanos - my), 0);
+  const sxx = points.reduce((a, p) => a + (p.rungs - mx) ** 2, 0);
+  const syy = points.reduce((a, p) => a + (p.meanNanos - my) ** 2, 0);
+  const slope = sxx > 0 ? sxy / sxx : 0;
+  return { overheadNanos: my - slope * mx, nanosPerRung: slope, r2: sxx > 0 && syy > 0 ? (sxy * sxy) / (sxx * syy) : 1 };
+}
+
+async function runBenchmarks() {
+  const args = parseArgs(process.argv.slice(2));
+  const scans = args.scans !== undefined ? parseInt(args.scans, 10) : 100000;
+  const profile = typeof args.profile === 'string' ? args.profile : 'release';
+  const fixtures = typeof args.fixtures === 'string' ? args.fixtures.split(',').map((f) => path.resolve(f)) : defaultFixtures;
+  const sizes = args.sweep === 'none' ? [] : (typeof args.sweep === 'string' ? args.sweep : '10,100,1000,10000').split(',').map((s) => parseInt(s, 10));
+  fs.mkdirSync(outputRoot, { recursive: true });
+
+  const report = {
+    date: new Date().toISOString(),
+    host: `${os.platform()}-${os.arch()}`,
+    cpu: os.cpus()[0]?.model,
+    profile,
+    scans,
+    fixtures: [],
+    sweep: []
+  };
+  for (const fixture of fixtures) {
+    try {
+      const result = await benchmark(fixture, scans, profile);
+      report.fixtures.push(result);
+      console.log(`✅ ${result.name}: ${Math.round(result.scansPerSecond)} scans/s, p50 ${result.scanNanos.p50} ns, p99 ${result.scanNanos.p99} ns`);
+    } catch (err) {
+      report.fixtures.push({ name: path.basename(fixture), error: err.message });
+      console.error(`❌ ${path.basename(fixture)}: ${err.message}`);
+      process.exitCode = 1;
+    }
+  }
+
+  // The sweep sources sit in their own directory, which keeps the toolchain.json the compiler writes beside them.
+  const sweepDir = path.join(outputRoot, 'sources');
+  fs.mkdirSync(sweepDir, { recursive: true });
+  for (const rungs of sizes) {
+    const source = path.join(sweepDir, `sweep${rungs}.st`);
+    fs.writeFileSync(source, sweepProgram(rungs));
+    const result = await benchmark(source, scans, profile);
+    const point = { rungs, scansPerSecond: result.scansPerSecond, meanNanos: result.scanNanos.mean, p50: result.scanNanos.p50,
+      p99: result.scanNanos.p99, nanosPerRung: result.scanNanos.mean / rungs };
+    report.sweep.push(point);
+    console.log(`${String(rungs).padStart(6)} rungs: ${Math.round(point.scansPerSecond)} scans/s, ${point.meanNanos.toFixed(0)} ns/scan, ${point.nanosPerRung.toFixed(2)} ns/rung`);
+  }
+  if (report.sweep.length > 1) {
+    report.scaling = fitLine(report.sweep);
+    console.log(`Scan time ≈ ${report.scaling.overheadNanos.toFixed(0)} ns + ${report.scaling.nanosPerRung.toFixed(3)} ns/rung (r² ${report.scaling.r2.toFixed(4)})`);
+  }
+
+  const out = typeof args.out === 'string' ? args.out : path.join(outputRoot, 'results.json');
+  fs.writeFileSync(out, JSON.stringify(report, null, 2));
+  console.log(`Results written to ${out}`);
+}
+
+runBenchmarks().catch((err) => {
+  console.error(err);
+  process.exitCode = 1;
+});
@@ -0,0 +1,89 @@
+// buildBench.js
+//
+// Builds a C++ benchmark against the Nodalis runtime, with the same runtime library and flags as a PLC executable.
+
+import fs from 'fs';
+import path from 'path';
+import { execFileSync } from 'child_process';
+import { fileURLToPath } from 'url';
+import { CPPCompiler } from '../../src/compilers/CPPCompiler.js';
+
+const __filename = fileURLToPath(import.meta.url);
+const __dirname = path.dirname(__filename);
+
+/**
+ * Parses --name value and --flag arguments.
+ * @param {string[]} argv The arguments.
+ * @returns {Object<string, string|boolean>} Returns the arguments by name.
+ */
+export function parseArgs(argv) {
+  const args = {};
+  for (let i = 0; i < argv.length; i++) {
+    if (argv[i].startsWith('--')) {
+      args[argv[i].substring(2)] = argv[i + 1] !== undefined && !argv[i + 1].startsWith('--') ? argv[++i] : true;
+    }
+  }
+  return args;
+}
+
+/**
+ * Gets the target of the host, such as linux-x64.
+ * @returns {string} Returns the target.
+ */
+export function hostTarget() {
+  const probe = new CPPCompiler({});
+  return `${probe.getHostOS()}-${probe.getHostArch()}`;
+}
+
+/**
+ * Builds a benchmark for a target. A fixture is compiled first, to put the runtime sources and its process image in
+ * the output directory, and the benchmark is then linked against the runtime library in place of the program.
+ * @param {object} options
+ * @param {string} options.name The name of the benchmark, which names its output directory and executable.
+ * @param {string} options.source The C++ source of the benchmark.
+ * @param {string} options.fixture The ST fixture that sizes the process image.
+ * @param {string} options.target The target, such as linux-x64.
+ * @param {string} options.profile The build profile.
+ * @param {string[]} options.protocols The protocols to build the runtime with, such as modbus, opcua or bacnet.
+ * @returns {Promise<string>} Returns the path to the executable.
+ */
+export async function buildBenchmark({ name, source, fixture, target, profile, protocols = [] }) {
+  const outputPath = path.join(__dirname, 'output', name, target);
+  // The fixtures have no mappings, so the runtime is built with the protocols the benchmark drives, which are named.
+  const compiler = new CPPCompiler({ sourcePath: fixture, outputPath, target, outputType: 'code', profile, protocols });
+  await compiler.compile();
+
+  const info = compiler.resolveTarget(target);
+  const cpp = compiler.detectCompiler(compiler.getHostOS(), compiler.getHostArch(), info.os, info.arch);
+  const msvc = cpp === 'cl.exe';
+  const windows = info.os === 'windows';
+  const archFlags = compiler.getArchFlags(info.os, info.arch, cpp);
+  const buildFlags = compiler.getProfileFlags(profile, cpp, target, undefined, true);
+  const bacnet = path.join(outputPath, 'bacnet-stack', target);
+  const includes = msvc
+    ? `/I${bacnet}/include /I${bacnet}/include/ports/${windows ? 'win32' : 'linux'} `
+    : `-I${bacnet}/include -I${bacnet}/include/ports/${windows ? 'win32' : 'linux'} `;
+  const join = (flags = []) => (flags.length ? `${flags.join(' ')} ` : '');
+  const flags = msvc
+    ? `${includes}${join(archFlags.cpp)}${join(buildFlags.compile)}/EHsc /std:c++17`
+    : `${join(archFlags.cpp)}${join(buildFlags.compile)}-std=c++17 ${includes}`;
+
+  const benchFile = path.join(outputPath, path.basename(source));
+  fs.copyFileSync(source, benchFile);
+  const [runtimeLib, benchObject] = await Promise.all([
+    compiler.runtimeLibrary(outputPath, target, cpp, flags, [], buildFlags.lto),
+    compiler.programObject(outputPath, benchFile, target, cpp, flags)
+  ]);
+  let exeFile = path.join(outputPath, name);
+  if (windows) {
+    exeFile += '.exe';
+  }
+  const open62541 = path.join(outputPath, 'open62541', 'lib', target, windows ? 'open62541.lib' : 'open62541.o');
+  const prebuilt = [...(protocols.includes('opcua') ? [open62541] : []), ...(protocols.includes('bacnet') ? [path.join(bacnet, 'libbacnet.a')] : [])];
+  const inputs = msvc ? [benchObject, runtimeLib] : [benchObject, runtimeLib, ...prebuilt];
+  const quoted = inputs.map((input) => `"${input}"`).join(' ');
+  execFileSync(msvc ? 'cmd' : 'sh', msvc
+    ? ['/c', `cl.exe ${join(archFlags.cpp)}/Fe:"${exeFile}" ${quoted} ${join(buildFlags.link)}`]
+    : ['-c', `${cpp} ${join(archFlags.cpp)}${join(buildFlags.link)}-o "${exeFile}" ${quoted} ${archFlags.linker}`], { stdio: 'inherit' });
+  return exeFile;
+}
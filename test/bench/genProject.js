@@ -0,0 +1,220 @@
+// genProject.js
+//
+// Generates a synthetic project of a given size, as an IEC 61131-10 XML project or as ST, for benchmarking the
+// compiler on projects the size of the field's without sharing them. Each program is a Ladder Diagram of latching
+// rungs, in ST as the assignments the rungs become, which read the globals, the mapped inputs and the rung before, and
+// the programs are spread round robin over the tasks.
+//
+//   node test/bench/genProject.js --out project.iec [--format iec|st] [--pous 100] [--rungs 20] [--globals 200]
+//                                 [--maps 100] [--tasks 4]
+
+import fs from 'fs';
+import path from 'path';
+import { fileURLToPath } from 'url';
+import { parseArgs } from './buildBench.js';
+
+const __filename = fileURLToPath(import.meta.url);
+
+/**
+ * The resource of a generated project, which a build of an IEC project names.
+ */
+export const RESOURCE_NAME = 'Bench';
+
+/**
+ * The mappings of each simulated Modbus device.
+ */
+const MAPS_PER_DEVICE = 8;
+
+/**
+ * The size of a project when it isn't given.
+ */
+export const DEFAULT_SIZE = { pous: 100, rungs: 20, globals: 200, maps: 100, tasks: 4 };
+
+const bit = (i) => `${Math.floor(i / 8)}.${i % 8}`;
+
+/**
+ * Lays out a project: its tasks, globals, mappings and the rungs of each program. Even mappings read an input and odd
+ * ones write an output, and the last rung of each program drives an output when there are any.
+ * @param {{pous: number, rungs: number, globals: number, maps: number, tasks: number}} size The size of the project.
+ * @returns {object} Returns the layout.
+ */
+function layoutProject(size) {
+  const { pous, rungs, globals, maps } = size;
+  const tasks = Math.max(1, size.tasks);
+  const inputs = Math.ceil(maps / 2);
+  const outputs = Math.floor(maps / 2);
+  const project = {
+    tasks: Array.from({ length: tasks }, (_, t) => ({ name: `T${t}`, interval: 10 * (t + 1), priority: t + 1 })),
+    globals: Array.from({ length: globals }, (_, g) => ({ name: `G${g}`, address: `%MX${bit(g)}` })),
+    maps: Array.from({ length: maps }, (_, m) => {
+      const device = Math.floor(m / MAPS_PER_DEVICE);
+      return {
+        ModuleID: `10.0.${device >> 8}.${device & 255}`, ModulePort: '502', Protocol: 'MODBUS-TCP',
+        RemoteAddress: String(Math.floor(m / 2)), RemoteSize: '1',
+        InternalAddress: m % 2 === 0 ? `%IX${bit(m / 2)}` : `%QX${bit(Math.floor(m / 2))}`,
+        Resource: RESOURCE_NAME, PollTime: '100', ProtocolProperties: '{}'
+      };
+    }),
+    programs: []
+  };
+  for (let p = 0; p < pous; p++) {
+    const program = { name: `P${p}`, task: `T${p % tasks}`, rungs: [] };
+    for (let r = 0; r < rungs; r++) {
+      const n = p * rungs + r;
+      program.rungs.push({
+        // Each rung latches its coil on a global, and is reset by an input, or by the next global without inputs.
+        set: globals > 0 ? `G${n % globals}` : `%IX${bit(n % Math.max(1, inputs))}`,
+        reset: inputs > 0 ? `%IX${bit((n + 1) % inputs)}` : globals > 0 ? `G${(n + 1) % globals}` : 'FALSE',
+        before: r > 0 ? `R${r - 1}` : null,
+        coil: r === rungs - 1 && outputs > 0 ? `%QX${bit(p % outputs)}` : `R${r}`
+      });
+    }
+    project.programs.push(program);
+  }
+  return project;
+}
+
+function stProject(project) {
+  let st = '';
+  project.maps.forEach((map) => {
+    // A mapping is written as the body of a JSON string holding its JSON, as toST() writes it.
+    st += `//Map=${JSON.stringify(JSON.stringify(map)).slice(1, -1)}\n`;
+  });
+  project.tasks.forEach((task) => {
+    st += `//Task={"Name":"${task.name}", "Interval":"${task.interval}", "Priority":"${task.priority}"}\n`;
+  });
+  project.programs.forEach((program) => {
+    st += `//Instance={"TypeName":"${program.name}", "Name":"${program.name}Instance", "AssociatedTaskName":"${program.task}"}\n`;
+  });
+  if (project.globals.length > 0) {
+    st += 'VAR_GLOBAL\n';
+    project.globals.forEach((global) => {
+      st += `    ${global.name} AT ${global.address} : BOOL;\n//Global={"Name":"${global.name}", "Address":"${global.address}"}\n`;
+    });
+    st += 'END_VAR\n';
+  }
+  project.programs.forEach((program) => {
+    st += `PROGRAM ${program.name}\n    VAR\n`;
+    program.rungs.forEach((rung, r) => {
+      st += `        R${r} : BOOL;\n`;
+    });
+    st += '    END_VAR\n';
+    program.rungs.forEach((rung) => {
+      const coil = rung.coil;
+      st += `    ${coil} := ((${rung.set} OR ${coil})${rung.before ? ` AND ${rung.before}` : ''}) AND NOT ${rung.reset};\n`;
+    });
+    st += 'END_PROGRAM\n';
+  });
+  return st;
+}
+
+function ldObject(type, operand, id, input, extra = '') {
+  return `<LdObject xsi:type="${type}" operand="${operand}" edge="none" negated="${extra === 'negated'}" latch="none">
+<RelPosition x="${id * 100}" y="2"/>
+${input ? `<ConnectionPointIn>\n${input.map((from) => `<Connection refConnectionPointOutId="${from}"/>`).join('\n')}\n</ConnectionPointIn>\n` : ''}\
+<ConnectionPointOut connectionPointOutId="${id}"></ConnectionPointOut>
+</LdObject>`;
+}
+
+/**
+ * Writes a rung: the set contact, in parallel with the coil's own contact, in series with the rung before and the
+ * negated reset contact, driving the coil.
+ */
+function ldRung(rung, order) {
+  const objects = [
+    `<LdObject xsi:type="LeftPowerRail" operand="1" edge="none" negated="false" latch="none">
+<RelPosition x="2" y="2"/>
+<ConnectionPointOut connectionPointOutId="1"></ConnectionPointOut>
+</LdObject>`,
+    ldObject('Contact', rung.set, 2, [1]),
+    ldObject('Contact', rung.coil, 3, [1])
+  ];
+  let last = [2, 3];
+  if (rung.before) {
+    objects.push(ldObject('Contact', rung.before, 4, last));
+    last = [4];
+  }
+  objects.push(ldObject('Contact', rung.reset, 5, last, 'negated'));
+  objects.push(ldObject('Coil', rung.coil, 6, [5]));
+  objects.push(`<LdObject xsi:type="RightPowerRail" operand="1" edge="none" negated="false" latch="none">
+<RelPosition x="800" y="2"/>
+<ConnectionPointIn><Connection refConnectionPointOutId="6"/></ConnectionPointIn>
+</LdObject>`);
+  return `<Rung evaluationOrder="${order}">\n${objects.join('\n')}\n</Rung>`;
+}
+
+function variable(name, type, address) {
+  const located = address ? `<Address location="${address[1]}" size="${address[2]}" address="${address.substring(3)}"></Address>\n` : '';
+  return `<Variable name="${name}" orderWithinParamSet="">
+<Type><TypeName>${type}</TypeName></Type>
+${located}</Variable>`;
+}
+
+const escape = (text) => text.replace(/&/g, '&amp;').replace(/"/g, '&quot;').replace(/</g, '&lt;');
+
+function iecProject(project) {
+  const programs = project.programs.map((program) => `<Program name="${program.name}">
+<ExternalVars></ExternalVars>
+<Vars accessSpecifier="private">
+${program.rungs.map((rung, r) => variable(`R${r}`, 'BOOL')).join('\n')}
+</Vars>
+<MainBody>
+<BodyContent xsi:type="LD">
+${program.rungs.map((rung, r) => ldRung(rung, r + 1)).join('\n')}
+</BodyContent>
+</MainBody>
+</Program>`);
+  return `<?xml version="1.0" encoding="utf-8"?>
+<Project xmlns="www.iec.ch/public/TC65SC65BWG7TF10" xmlns:xsi="http://www.w3.org/2001/XMLSchema-instance"
+ xsi:schemaLocation="www.iec.ch/public/TC65SC65BWG7TF10 IEC61131_10_Ed1_0.xsd" schemaVersion="1.0">
+<FileHeader companyName="Nodalis" companyURL="" productName="genProject" productVersion="1" productRelease="1"/>
+<ContentHeader name="Bench Project" version="1.0" creationDateTime="2026-01-01T00:00:00Z" modificationDateTime="0"
+ organization="" author="" language="En"></ContentHeader>
+<Types>
+<GlobalNamespace>
+<NamespaceDecl name="Bench">
+${programs.join('\n')}
+</NamespaceDecl>
+</GlobalNamespace>
+</Types>
+<Instances>
+<Configuration name="Main">
+<Resource name="${RESOURCE_NAME}" resourceTypeName="Main">
+<GlobalVars>
+${project.globals.map((global) => variable(global.name, 'BOOL', global.address)).join('\n')}
+</GlobalVars>
+${project.tasks.map((task) => `<Task xsi:type="StandardTask" name="${task.name}" interval="${task.interval}" priority="${task.priority}"/>`).join('\n')}
+${project.programs.map((program) => `<ProgramInstance typeName="${program.name}" name="${program.name}Instance" associatedTaskName="${program.task}"/>`).join('\n')}
+</Resource>
+</Configuration>
+</Instances>
+<MappingTable>
+${project.maps.map((map) => `<Map ${Object.entries(map).map(([key, value]) => `${key}="${escape(value)}"`).join(' ')}></Map>`).join('\n')}
+</MappingTable>
+</Project>
+`;
+}
+
+/**
+ * Generates a project.
+ * @param {{pous: number, rungs: number, globals: number, maps: number, tasks: number}} size The number of programs,
+ * of rungs in each program, of BOOL globals in %M, of IO mappings and of tasks. Missing counts are taken from
+ * DEFAULT_SIZE.
+ * @param {'iec'|'st'} format Whether to write an IEC 61131-10 XML project, whose programs are Ladder Diagrams, or
+ * the same project in ST.
+ * @returns {string} Returns the text of the project.
+ */
+export function generateProject(size = {}, format = 'iec') {
+  const project = layoutProject({ ...DEFAULT_SIZE, ...size });
+  return format === 'st' ? stProject(project) : iecProject(project);
+}
+
+if (process.argv[1] && path.resolve(process.argv[1]) === __filename) {
+  const args = parseArgs(process.argv.slice(2));
+  const size = Object.fromEntries(Object.keys(DEFAULT_SIZE).filter((key) => args[key] !== undefined)
+    .map((key) => [key, parseInt(args[key], 10)]));
+  const out = typeof args.out === 'string' ? args.out : 'project.iec';
+  const format = typeof args.format === 'string' ? args.format : out.toLowerCase().endsWith('.st') ? 'st' : 'iec';
+  fs.writeFileSync(out, generateProject(size, format));
+  console.log(`Wrote ${out}`);
+}
@@ -0,0 +1,590 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Throughput and latency benchmark of the Modbus/TCP client against a simulated slave
+ * @author Nathan Skipper, MTI
+ * @version 1.0.0
+ * @copyright Apache 2.0
+ */
+#include "nodalis.h"
+#include "modbus.h"
+#include "nodalisjson.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #pragma comment(lib, "ws2_32.lib")
+    using socket_t = SOCKET;
+    static constexpr socket_t NO_SOCKET = INVALID_SOCKET;
+    static void closeSocket(socket_t fd){ closesocket(fd); }
+    static void shutdownSocket(socket_t fd){ shutdown(fd, SD_BOTH); }
+#else
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+    using socket_t = int;
+    static constexpr socket_t NO_SOCKET = -1;
+    static void closeSocket(socket_t fd){ close(fd); }
+    static void shutdownSocket(socket_t fd){ shutdown(fd, SHUT_RDWR); }
+#endif
+
+#ifdef MSG_NOSIGNAL
+    static constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+    static constexpr int SEND_FLAGS = 0;
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+#pragma region "Simulated Slave"
+/**
+ * A Modbus/TCP slave that answers requests from the process image with ModbusServer::handlePdu(), after a
+ * configurable latency. It listens on a loopback port per client, so that each gets a module of its own, and every
+ * connection has a reader thread. The responses are queued by the time they are due and sent by a single writer, so
+ * pipelined requests are answered concurrently and, with jitter, out of order, as a real network and device would.
+ */
+class SimulatedSlave {
+public:
+    /**
+     * Constructs a slave.
+     * @param latency The time from a request to its response, in microseconds.
+     * @param jitter The most the latency varies by either way, uniformly, in microseconds.
+     */
+    SimulatedSlave(int64_t latency, int64_t jitter) : latency(latency), jitter(jitter){
+#ifdef _WIN32
+        WSADATA wsa;
+        WSAStartup(MAKEWORD(2,2), &wsa);
+#endif
+        writer = std::thread(&SimulatedSlave::runWriter, this);
+    }
+
+    ~SimulatedSlave(){
+        stop();
+    }
+
+    /**
+     * Listens on a new loopback port.
+     * @returns Returns the port, or 0 if it can't be listened on.
+     */
+    uint16_t listen(){
+        socket_t fd = socket(AF_INET, SOCK_STREAM, 0);
+        if(fd == NO_SOCKET){
+            return 0;
+        }
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = 0;
+        socklen_t length = sizeof(address);
+        if(bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, 16) != 0
+            || getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) != 0){
+            closeSocket(fd);
+            return 0;
+        }
+        std::lock_guard<std::mutex> lock(connectionMutex);
+        listeners.push_back(fd);
+        threads.emplace_back(&SimulatedSlave::runAcceptor, this, fd);
+        return ntohs(address.sin_port);
+    }
+
+    /**
+     * Closes every connection and port, and waits for the threads to finish.
+     */
+    void stop(){
+        if(stopping.exchange(true)){
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(connectionMutex);
+            for(socket_t fd : listeners){
+                shutdownSocket(fd);
+                closeSocket(fd);
+            }
+            for(auto& connection : connections){
+                shutdownSocket(connection->fd);
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+        }
+        queueReady.notify_all();
+        writer.join();
+        // Acceptors add readers to threads until they see stopping, so the list is only walked once they have.
+        for(size_t i = 0; ; i++){
+            std::thread thread;
+            {
+                std::lock_guard<std::mutex> lock(connectionMutex);
+                if(i >= threads.size()){
+                    break;
+                }
+                thread = std::move(threads[i]);
+            }
+            if(thread.joinable()){
+                thread.join();
+            }
+        }
+        for(auto& connection : connections){
+            closeSocket(connection->fd);
+        }
+    }
+
+    /**
+     * Sets the value of a holding register.
+     * @param address The register.
+     * @param value The value.
+     */
+    void setRegister(uint16_t address, uint16_t value){
+        std::lock_guard<std::mutex> lock(serverMutex);
+        server.setRegister(address, value);
+    }
+
+    /**
+     * Gets the number of requests answered.
+     */
+    uint64_t getTransactions() const { return transactions.load(std::memory_order_relaxed); }
+    /**
+     * Gets the number of coils and registers read and written.
+     */
+    uint64_t getPoints() const { return points.load(std::memory_order_relaxed); }
+
+private:
+    struct Connection {
+        socket_t fd;
+        std::mutex sendMutex;
+    };
+    /**
+     * A response waiting for its due time.
+     */
+    struct Response {
+        Clock::time_point due;
+        uint64_t sequence;
+        std::shared_ptr<Connection> connection;
+        std::vector<uint8_t> frame;
+        bool operator>(const Response& other) const {
+            return due != other.due ? due > other.due : sequence > other.sequence;
+        }
+    };
+
+    int64_t latency;
+    int64_t jitter;
+    ModbusServer server;
+    std::mutex serverMutex;
+    std::atomic<bool> stopping{false};
+    std::atomic<uint64_t> transactions{0};
+    std::atomic<uint64_t> points{0};
+
+    std::mutex connectionMutex;
+    std::vector<socket_t> listeners;
+    std::vector<std::shared_ptr<Connection>> connections;
+    std::vector<std::thread> threads;
+
+    std::mutex queueMutex;
+    std::condition_variable queueReady;
+    std::priority_queue<Response, std::vector<Response>, std::greater<Response>> queue;
+    uint64_t nextSequence = 0;
+    std::thread writer;
+
+    void runAcceptor(socket_t listener){
+        while(!stopping){
+            socket_t fd = accept(listener, nullptr, nullptr);
+            if(fd == NO_SOCKET){
+                return;
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof(one));
+            auto connection = std::make_shared<Connection>();
+            connection->fd = fd;
+            std::lock_guard<std::mutex> lock(connectionMutex);
+            if(stopping){
+                closeSocket(fd);
+                return;
+            }
+            connections.push_back(connection);
+            threads.emplace_back(&SimulatedSlave::runReader, this, connection);
+        }
+    }
+
+    void runReader(std::shared_ptr<Connection> connection){
+        std::mt19937_64 random(static_cast<uint64_t>(connection->fd) * 0x9E3779B97F4A7C15ull);
+        std::uniform_int_distribution<int64_t> spread(-jitter, jitter);
+        std::vector<uint8_t> buffer;
+        uint8_t pdu[MODBUS_MAX_PDU];
+        uint8_t chunk[4096];
+        for(;;){
+            int received = recv(connection->fd, reinterpret_cast<char*>(chunk), sizeof(chunk), 0);
+            if(received <= 0){
+                return;
+            }
+            auto arrived = Clock::now();
+            buffer.insert(buffer.end(), chunk, chunk + received);
+            size_t start = 0;
+            while(buffer.size() - start >= MODBUS_MBAP_SIZE){
+                const uint8_t* frame = buffer.data() + start;
+                size_t length = (static_cast<size_t>(frame[4]) << 8) | frame[5];
+                if(length < 2 || length > MODBUS_MAX_PDU + 1){
+                    return;
+                }
+                if(buffer.size() - start < 6 + length){
+                    break;
+                }
+                size_t answered;
+                {
+                    std::lock_guard<std::mutex> lock(serverMutex);
+                    answered = server.handlePdu(frame + MODBUS_MBAP_SIZE, length - 1, pdu);
+                }
+                countPoints(frame + MODBUS_MBAP_SIZE, length - 1, pdu);
+                Response response;
+                int64_t delay = latency + (jitter > 0 ? spread(random) : 0);
+                response.due = arrived + std::chrono::microseconds(delay > 0 ? delay : 0);
+                response.connection = connection;
+                response.frame.assign(frame, frame + MODBUS_MBAP_SIZE);
+                response.frame[4] = static_cast<uint8_t>((answered + 1) >> 8);
+                response.frame[5] = static_cast<uint8_t>(answered + 1);
+                response.frame.insert(response.frame.end(), pdu, pdu + answered);
+                {
+                    std::lock_guard<std::mutex> lock(queueMutex);
+                    response.sequence = nextSequence++;
+                    queue.push(std::move(response));
+                }
+                queueReady.notify_one();
+                transactions.fetch_add(1, std::memory_order_relaxed);
+                start += 6 + length;
+            }
+            buffer.erase(buffer.begin(), buffer.begin() + static_cast<std::ptrdiff_t>(start));
+        }
+    }
+
+    /**
+     * Counts the coils or registers of a request that was answered without an exception.
+     */
+    void countPoints(const uint8_t* request, size_t length, const uint8_t* response){
+        if(length >= 5 && (response[0] & 0x80) == 0){
+            uint8_t function = request[0];
+            uint64_t quantity = (static_cast<uint64_t>(request[3]) << 8) | request[4];
+            bool single = function == WRITE_SINGLE_COIL || function == WRITE_SINGLE_REGISTER;
+            points.fetch_add(single ? 1 : quantity, std::memory_order_relaxed);
+        }
+    }
+
+    void runWriter(){
+        std::unique_lock<std::mutex> lock(queueMutex);
+        while(!stopping){
+            if(queue.empty()){
+                queueReady.wait(lock);
+                continue;
+            }
+            Clock::time_point due = queue.top().due;
+            if(due > Clock::now()){
+                queueReady.wait_until(lock, due);
+                continue;
+            }
+            Response response = queue.top();
+            queue.pop();
+            lock.unlock();
+            {
+                std::lock_guard<std::mutex> sendLock(response.connection->sendMutex);
+                size_t sent = 0;
+                while(sent < response.frame.size()){
+                    int result = send(response.connection->fd, reinterpret_cast<const char*>(response.frame.data() + sent),
+                        static_cast<int>(response.frame.size() - sent), SEND_FLAGS);
+                    if(result <= 0){
+                        break;
+                    }
+                    sent += static_cast<size_t>(result);
+                }
+            }
+            lock.lock();
+        }
+    }
+};
+#pragma endregion
+
+#pragma region "Harness"
+/**
+ * The options of a run, from the command line.
+ */
+struct BenchOptions {
+    /**
+     * sequential sends every mapping as a request of its own, one at a time. coalesced groups neighbouring
+     * registers into block requests, one at a time. pipelined groups them and keeps inFlight requests outstanding.
+     */
+    std::string mode = "coalesced";
+    size_t mappings = 100;
+    size_t clients = 4;
+    int inFlight = 8;
+    /**
+     * The latency of the slave and how much it varies, in microseconds.
+     */
+    int64_t latency = 0;
+    int64_t jitter = 0;
+    /**
+     * The poll interval of the mappings, in milliseconds.
+     */
+    int poll = 1;
+    /**
+     * How long to connect and settle for, and how long to measure for, in milliseconds.
+     */
+    int warmup = 500;
+    int duration = 2000;
+    /**
+     * The interval of the simulated scan, in microseconds.
+     */
+    int scanInterval = 1000;
+    int ioThreads = 1;
+    std::string ioBackend;
+    /**
+     * True to poll the clients on the scan thread, with superviseIO(), rather than starting IO.
+     */
+    bool syncIO = false;
+    /**
+     * The file to write the results to as JSON, or empty to write them to stdout.
+     */
+    std::string out;
+};
+
+/**
+ * The IO counters of every client, summed.
+ */
+struct ClientTotals {
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+    uint64_t latency[ExecutionStats::HISTOGRAM_BUCKETS] = {};
+};
+
+static ClientTotals totalClients(){
+    ClientTotals totals;
+    for(auto& client : Clients){
+        const IOCounters& counters = client->getCounters();
+        totals.requests += counters.requests.load();
+        totals.errors += counters.errors.load();
+        if(ExecutionStats* stats = counters.latency.load()){
+            for(int b = 0; b < ExecutionStats::HISTOGRAM_BUCKETS; b++){
+                totals.latency[b] += stats->getHistogram(b);
+            }
+        }
+    }
+    return totals;
+}
+
+/**
+ * Estimates a percentile from the difference of two latency histograms.
+ * @returns Returns the upper bound of the bucket the percentile falls in, in microseconds, or 0 if it is empty.
+ */
+static uint64_t histogramPercentile(const ClientTotals& before, const ClientTotals& after, double percent){
+    uint64_t count = 0;
+    for(int b = 0; b < ExecutionStats::HISTOGRAM_BUCKETS; b++){
+        count += after.latency[b] - before.latency[b];
+    }
+    if(count == 0){
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(static_cast<double>(count) * percent / 100.0);
+    uint64_t seen = 0;
+    for(int b = 0; b < ExecutionStats::HISTOGRAM_BUCKETS; b++){
+        seen += after.latency[b] - before.latency[b];
+        if(seen > rank){
+            return 1ull << b;
+        }
+    }
+    return 1ull << (ExecutionStats::HISTOGRAM_BUCKETS - 1);
+}
+
+/**
+ * Runs scans at the scan interval until a time, recording how long each one kept the scan thread busy.
+ * @param until When to stop.
+ * @param stalls Receives the time of each scan, in nanoseconds, if not null.
+ */
+static void runScans(const BenchOptions& options, Clock::time_point until, std::vector<uint64_t>* stalls){
+    auto next = Clock::now();
+    while(next < until){
+        auto start = Clock::now();
+        latchScanTime(start);
+        if(options.syncIO){
+            superviseIO();
+        }
+        latchInputs();
+        commitOutputs();
+        if(stalls){
+            stalls->push_back(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()));
+        }
+        next += std::chrono::microseconds(options.scanInterval);
+        auto now = Clock::now();
+        if(next < now){
+            next = now;
+        }
+        std::this_thread::sleep_until(next);
+    }
+}
+#pragma endregion
+
+int main(int argc, char* argv[]){
+    BenchOptions options;
+    for(int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        bool value = i + 1 < argc;
+        if(arg == "--mode" && value) options.mode = argv[++i];
+        else if(arg == "--mappings" && value) options.mappings = std::strtoull(argv[++i], nullptr, 10);
+        else if(arg == "--clients" && value) options.clients = std::strtoull(argv[++i], nullptr, 10);
+        else if(arg == "--in-flight" && value) options.inFlight = std::atoi(argv[++i]);
+        else if(arg == "--latency" && value) options.latency = std::atoll(argv[++i]);
+        else if(arg == "--jitter" && value) options.jitter = std::atoll(argv[++i]);
+        else if(arg == "--poll" && value) options.poll = std::atoi(argv[++i]);
+        else if(arg == "--warmup" && value) options.warmup = std::atoi(argv[++i]);
+        else if(arg == "--duration" && value) options.duration = std::atoi(argv[++i]);
+        else if(arg == "--scan-interval" && value) options.scanInterval = std::atoi(argv[++i]);
+        else if(arg == "--io-threads" && value) options.ioThreads = std::atoi(argv[++i]);
+        else if(arg == "--io-backend" && value) options.ioBackend = argv[++i];
+        else if(arg == "--out" && value) options.out = argv[++i];
+        else if(arg == "--sync-io") options.syncIO = true;
+        else{
+            std::cout << "Usage: " << argv[0] << " [--mode sequential|coalesced|pipelined] [--mappings <n>] [--clients <n>]\n"
+                << "    [--in-flight <n>] [--latency <us>] [--jitter <us>] [--poll <ms>] [--warmup <ms>] [--duration <ms>]\n"
+                << "    [--scan-interval <us>] [--io-threads <n>] [--io-backend <name>] [--sync-io] [--out <file>]\n";
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+    if(options.mode != "sequential" && options.mode != "coalesced" && options.mode != "pipelined"){
+        std::cerr << "Unknown mode " << options.mode << "\n";
+        return 1;
+    }
+    options.clients = options.clients < 1 ? 1 : options.clients > options.mappings ? options.mappings : options.clients;
+    size_t registers = (options.mappings + options.clients - 1) / options.clients;
+    if(options.mappings == 0 || registers > NODALIS_MEMORY_BYTES / 2 || options.mappings > NODALIS_INPUT_BYTES / 2){
+        std::cerr << "The process image can't hold " << options.mappings << " mappings\n";
+        return 1;
+    }
+    latchScanTime(Clock::now());
+
+    SimulatedSlave slave(options.latency, options.jitter);
+    for(size_t r = 0; r < registers; r++){
+        slave.setRegister(static_cast<uint16_t>(r), static_cast<uint16_t>(r));
+    }
+    std::vector<std::string> ports;
+    for(size_t c = 0; c < options.clients; c++){
+        uint16_t port = slave.listen();
+        if(port == 0){
+            std::cerr << "Can't listen on a loopback port\n";
+            return 1;
+        }
+        ports.push_back(std::to_string(port));
+    }
+
+    // Mapping i is register i / clients of client i % clients, read into %IW(i). The rows of each client are
+    // contiguous, as in the table the compiler generates.
+    std::string properties = options.mode == "sequential" ? "{\"Coalesce\":false,\"MaxInFlight\":1}"
+        : options.mode == "coalesced" ? "{\"MaxInFlight\":1}"
+        : "{\"MaxInFlight\":" + std::to_string(options.inFlight > 0 ? options.inFlight : 1) + "}";
+    std::vector<std::string> remotes(options.mappings);
+    std::vector<std::string> locals(options.mappings);
+    std::vector<IOMapDefinition> rows;
+    std::vector<IOClientDefinition> clients;
+    rows.reserve(options.mappings);
+    for(size_t c = 0; c < options.clients; c++){
+        clients.push_back({ rows.size(), 0 });
+        for(size_t i = c; i < options.mappings; i += options.clients){
+            remotes[i] = std::to_string(i / options.clients);
+            locals[i] = "%IW" + std::to_string(i);
+            rows.push_back({ "MODBUS-TCP", "127.0.0.1", ports[c].c_str(), remotes[i].c_str(), locals[i].c_str(),
+                properties.c_str(), 16, options.poll, 0, 0, -1 });
+            clients.back().count++;
+        }
+    }
+    mapIOTable(rows.data(), clients.data(), clients.size());
+    if(!options.syncIO){
+        startIO(options.ioThreads, options.ioBackend);
+    }
+
+    runScans(options, Clock::now() + std::chrono::milliseconds(options.warmup), nullptr);
+    size_t connected = 0;
+    for(auto& client : Clients){
+        connected += client->connected ? 1 : 0;
+    }
+    ClientTotals before = totalClients();
+    uint64_t slaveTransactions = slave.getTransactions();
+    uint64_t slavePoints = slave.getPoints();
+    std::vector<uint64_t> stalls;
+    stalls.reserve(static_cast<size_t>(options.duration) * 1000 / static_cast<size_t>(options.scanInterval > 0 ? options.scanInterval : 1) + 16);
+    auto start = Clock::now();
+    runScans(options, start + std::chrono::milliseconds(options.duration), &stalls);
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    ClientTotals after = totalClients();
+    slaveTransactions = slave.getTransactions() - slaveTransactions;
+    slavePoints = slave.getPoints() - slavePoints;
+
+    uint64_t stallTotal = 0;
+    for(uint64_t stall : stalls){
+        stallTotal += stall;
+    }
+    std::sort(stalls.begin(), stalls.end());
+    auto stallPercentile = [&](double percent){
+        return stalls.empty() ? 0 : stalls[(std::min)(stalls.size() - 1, static_cast<size_t>(static_cast<double>(stalls.size()) * percent / 100.0))];
+    };
+    uint64_t requests = after.requests - before.requests;
+    json results = {
+        {"mode", options.mode},
+        {"mappings", options.mappings},
+        {"clients", options.clients},
+        {"connected", connected},
+        {"inFlight", options.mode == "pipelined" ? options.inFlight : 1},
+        {"latencyMicros", options.latency},
+        {"jitterMicros", options.jitter},
+        {"pollMillis", options.poll},
+        {"syncIO", options.syncIO},
+        {"seconds", seconds},
+        {"transactions", requests},
+        {"transactionsPerSecond", static_cast<double>(requests) / seconds},
+        {"errors", after.errors - before.errors},
+        {"slaveTransactionsPerSecond", static_cast<double>(slaveTransactions) / seconds},
+        {"registersPerSecond", static_cast<double>(slavePoints) / seconds},
+        {"roundTripMicros", {
+            {"p50", histogramPercentile(before, after, 50)},
+            {"p99", histogramPercentile(before, after, 99)}
+        }},
+        {"scanStallNanos", {
+            {"scans", stalls.size()},
+            {"mean", stalls.empty() ? 0.0 : static_cast<double>(stallTotal) / static_cast<double>(stalls.size())},
+            {"p50", stallPercentile(50)},
+            {"p99", stallPercentile(99)},
+            {"max", stalls.empty() ? 0 : stalls.back()},
+            {"fraction", static_cast<double>(stallTotal) / (seconds * 1e9)}
+        }}
+    };
+    if(options.out.empty()){
+        std::cout << results.dump(2) << std::endl;
+    }
+    else{
+        std::ofstream(options.out) << results.dump(2) << "\n";
+    }
+    std::cout.flush();
+    // The reactors and clients are left running; exiting here skips tearing them down mid-poll.
+    std::_Exit(0);
+}
@@ -0,0 +1,362 @@
+// Copyright [2025] Nathan Skipper
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @description Micro benchmarks of the Nodalis runtime's memory access and standard function blocks
+ * @author Nathan Skipper, MTI
+ * @version 1.0.0
+ * @copyright Apache 2.0
+ */
+#include "nodalis.h"
+#include <chrono>
+#include <cstdint>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+#pragma region "Allocation Counting"
+// The global allocation functions are replaced, so every allocation made by the runtime during a benchmark is counted.
+static std::atomic<uint64_t> ALLOCATIONS{0};
+
+void* operator new(std::size_t size){
+    ALLOCATIONS.fetch_add(1, std::memory_order_relaxed);
+    if(void* p = std::malloc(size == 0 ? 1 : size)){
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size){
+    return operator new(size);
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept{
+    ALLOCATIONS.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size == 0 ? 1 : size);
+}
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept{
+    return operator new(size, tag);
+}
+void operator delete(void* p) noexcept{ std::free(p); }
+void operator delete[](void* p) noexcept{ std::free(p); }
+void operator delete(void* p, std::size_t) noexcept{ std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept{ std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept{ std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept{ std::free(p); }
+#pragma endregion
+
+#pragma region "Harness"
+/**
+ * Keeps the compiler from optimizing a value away, without storing it anywhere.
+ * @param value The value the benchmark computed.
+ */
+template<typename T>
+inline void keep(const T& value){
+#if defined(_MSC_VER) && !defined(__clang__)
+    const volatile void* sink = &value;
+    (void)sink;
+    _ReadWriteBarrier();
+#else
+    asm volatile("" : : "r,m"(value) : "memory");
+#endif
+}
+
+/**
+ * The options of a run, from the command line.
+ */
+struct BenchOptions {
+    /**
+     * Only benchmarks whose name contains this are run.
+     */
+    std::string filter;
+    /**
+     * True to write the results as JSON instead of a table.
+     */
+    bool json = false;
+    /**
+     * How long each benchmark is timed for, in milliseconds.
+     */
+    int milliseconds = 200;
+};
+
+static BenchOptions OPTIONS;
+static bool FIRST_RESULT = true;
+
+/**
+ * Times a benchmark and writes its result. The body is run in batches that grow until a batch takes a tenth of the
+ * time to measure, and then batches are run until that time has passed.
+ * @param name The name of the benchmark.
+ * @param body Runs one operation.
+ */
+template<typename Body>
+void bench(const char* name, Body&& body){
+    if(!OPTIONS.filter.empty() && std::string(name).find(OPTIONS.filter) == std::string::npos){
+        return;
+    }
+    using clock = std::chrono::steady_clock;
+    const auto budget = std::chrono::milliseconds(OPTIONS.milliseconds);
+    uint64_t batch = 1;
+    for(;;){
+        auto start = clock::now();
+        for(uint64_t i = 0; i < batch; i++){
+            body();
+        }
+        if(clock::now() - start >= budget / 10 || batch >= (1ull << 40)){
+            break;
+        }
+        batch *= 2;
+    }
+    uint64_t operations = 0;
+    uint64_t allocations = ALLOCATIONS.load(std::memory_order_relaxed);
+    auto start = clock::now();
+    auto end = start;
+    do{
+        for(uint64_t i = 0; i < batch; i++){
+            body();
+        }
+        operations += batch;
+        end = clock::now();
+    } while(end - start < budget);
+    allocations = ALLOCATIONS.load(std::memory_order_relaxed) - allocations;
+    double ns = std::chrono::duration<double, std::nano>(end - start).count() / static_cast<double>(operations);
+    double allocs = static_cast<double>(allocations) / static_cast<double>(operations);
+    if(OPTIONS.json){
+        std::printf("%s\n  { \"name\": \"%s\", \"nsPerOp\": %.3f, \"allocsPerOp\": %.3f, \"operations\": %llu }",
+            FIRST_RESULT ? "" : ",", name, ns, allocs, static_cast<unsigned long long>(operations));
+    }
+    else{
+        std::printf("%-32s %12.2f ns/op %10.3f allocs/op\n", name, ns, allocs);
+    }
+    FIRST_RESULT = false;
+}
+
+/**
+ * Advances the scan time of the calling thread, as the scheduler does at the start of a scan, so that the timers see
+ * time pass without reading the clock.
+ * @param ms The milliseconds to advance by.
+ */
+inline void advanceScan(uint64_t ms){
+    SCAN_MICROS += ms * 1000;
+    timerWheel().advance(SCAN_MICROS / 1000);
+}
+#pragma endregion
+
+#pragma region "Benchmarks"
+static void benchAddresses(){
+    const std::string bitAddress = "%IX12.3";
+    const std::string wordAddress = "%MW40";
+    const std::string lwordAddress = "%ML8";
+    uint64_t value = 0;
+    int count = 0;
+
+    bench("parseAddress", [&](){ keep(parseAddress(wordAddress)); });
+    bench("tryParseAddress", [&](){
+        int space, width, index, bit;
+        keep(tryParseAddress(wordAddress, space, width, index, bit));
+    });
+    bench("resolveAddress", [&](){ keep(resolveAddress(wordAddress, 16, false)); });
+    bench("readBit", [&](){ keep(readBit(bitAddress)); });
+    bench("readByte", [&](){ keep(readByte("%MB3")); });
+    bench("readWord", [&](){ keep(readWord(wordAddress)); });
+    bench("readDWord", [&](){ keep(readDWord("%MD20")); });
+    bench("readLWord", [&](){ keep(readLWord(lwordAddress)); });
+    bench("writeBit", [&](){ writeBit("%QX1.4", (++count & 1) != 0); });
+    bench("writeByte", [&](){ writeByte("%MB3", static_cast<uint8_t>(++count)); });
+    bench("writeWord", [&](){ writeWord(wordAddress, static_cast<uint16_t>(++count)); });
+    bench("writeDWord", [&](){ writeDWord("%MD20", static_cast<uint32_t>(++count)); });
+    bench("writeLWord", [&](){ writeLWord(lwordAddress, ++value); });
+}
+
+static void benchReferences(){
+    RefVar<bool> bit("%MX100.1");
+    RefVar<uint8_t> byte("%MB101");
+    RefVar<uint16_t> word("%MW51");
+    RefVar<uint32_t> dword("%MD26");
+    RefVar<uint64_t> lword("%ML20");
+    RefVar<float> real("%MD27");
+    int count = 0;
+
+    bench("RefVar<BOOL> load", [&](){ keep(static_cast<bool>(bit)); });
+    bench("RefVar<BOOL> store", [&](){ bit = (++count & 1) != 0; });
+    bench("RefVar<BYTE> load", [&](){ keep(static_cast<uint8_t>(byte)); });
+    bench("RefVar<BYTE> store", [&](){ byte = static_cast<uint8_t>(++count); });
+    bench("RefVar<WORD> load", [&](){ keep(static_cast<uint16_t>(word)); });
+    bench("RefVar<WORD> store", [&](){ word = static_cast<uint16_t>(++count); });
+    bench("RefVar<DWORD> load", [&](){ keep(static_cast<uint32_t>(dword)); });
+    bench("RefVar<DWORD> store", [&](){ dword = static_cast<uint32_t>(++count); });
+    bench("RefVar<LWORD> load", [&](){ keep(static_cast<uint64_t>(lword)); });
+    bench("RefVar<LWORD> store", [&](){ lword = static_cast<uint64_t>(++count); });
+    bench("RefVar<REAL> load", [&](){ keep(static_cast<float>(real)); });
+    bench("RefVar<REAL> store", [&](){ real = static_cast<float>(++count); });
+    bench("RefVar construct", [&](){ RefVar<uint16_t> ref("%MW52"); keep(ref); });
+
+    uint32_t local = 0;
+    bench("getBit", [&](){ keep(getBit(&local, count++ & 31)); });
+    bench("setBit", [&](){ setBit(&local, count & 31, (++count & 2) != 0); keep(local); });
+    bench("getBit constant", [&](){ count++; keep(getBit<5>(&local)); });
+    bench("setBit constant", [&](){ setBit<5>(&local, (++count & 2) != 0); keep(local); });
+    bench("getBit RefVar", [&](){ keep(getBit(word, count++ & 15)); });
+    bench("setBit RefVar", [&](){ setBit(word, count & 15, (++count & 2) != 0); });
+}
+
+static void benchTimers(){
+    uint64_t scan = 0;
+    TON ton;
+    ton.PT = 50;
+    bench("TON", [&](){
+        // The input stays on past the preset, so the timer runs, expires and restarts every 100 scans.
+        ton.IN = (++scan % 100) != 0;
+        advanceScan(1);
+        ton();
+        keep(ton.Q);
+    });
+    TOF tof;
+    tof.PT = 50;
+    bench("TOF", [&](){
+        tof.IN = (++scan % 100) == 0;
+        advanceScan(1);
+        tof();
+        keep(tof.Q);
+    });
+    TP tp;
+    tp.PT = 50;
+    bench("TP", [&](){
+        tp.IN = (++scan % 100) == 0;
+        advanceScan(1);
+        tp();
+        keep(tp.Q);
+    });
+    TON_BANK<256> bank;
+    for(int i = 0; i < 256; i++){
+        bank[i].PT = 20 + i;
+    }
+    bench("TON_BANK<256>", [&](){
+        bank[static_cast<int>(++scan % 256)].IN = (scan / 256) % 2 == 0;
+        advanceScan(1);
+        bank();
+        keep(bank[0].Q);
+    });
+}
+
+static void benchLogic(){
+    uint32_t count = 0;
+#define BENCH_GATE(NAME) { \
+    NAME block; \
+    bench(#NAME, [&](){ block.IN1 = (++count & 1) != 0; block.IN2 = (count & 2) != 0; block(); keep(block.OUT); }); \
+}
+    BENCH_GATE(AND)
+    BENCH_GATE(OR)
+    BENCH_GATE(XOR)
+    BENCH_GATE(NOR)
+    BENCH_GATE(NAND)
+#undef BENCH_GATE
+    NOT inverter;
+    bench("NOT", [&](){ inverter.IN = (++count & 1) != 0; inverter(); keep(inverter.OUT); });
+    ASSIGNMENT assign;
+    bench("ASSIGNMENT", [&](){ assign.IN = (++count & 1) != 0; assign(); keep(assign.OUT); });
+    SR sr;
+    bench("SR", [&](){ sr.S1 = (++count & 3) == 0; sr.R = (count & 3) == 2; sr(); keep(sr.Q1); });
+    RS rs;
+    bench("RS", [&](){ rs.S = (++count & 3) == 0; rs.R1 = (count & 3) == 2; rs(); keep(rs.Q1); });
+    R_TRIG rising;
+    bench("R_TRIG", [&](){ rising.CLK = (++count & 1) != 0; rising(); keep(rising.OUT); });
+    F_TRIG falling;
+    bench("F_TRIG", [&](){ falling.CLK = (++count & 1) != 0; falling(); keep(falling.OUT); });
+    R_TRIG_BANK<256> risingBank;
+    bench("R_TRIG_BANK<256>", [&](){ risingBank[static_cast<int>(++count % 256)].CLK = (count & 256) != 0; risingBank(); keep(risingBank[0].OUT); });
+    F_TRIG_BANK<256> fallingBank;
+    bench("F_TRIG_BANK<256>", [&](){ fallingBank[static_cast<int>(++count % 256)].CLK = (count & 256) != 0; fallingBank(); keep(fallingBank[0].OUT); });
+}
+
+static void benchCounters(){
+    uint32_t count = 0;
+    CTU<> ctu;
+    ctu.PV = 1000;
+    bench("CTU", [&](){ ctu.CU = (++count & 1) != 0; ctu.R = (count & 4095) == 0; ctu(); keep(ctu.Q); });
+    CTD<> ctd;
+    ctd.PV = 1000;
+    bench("CTD", [&](){ ctd.CD = (++count & 1) != 0; ctd.LD = (count & 4095) == 0; ctd(); keep(ctd.Q); });
+    CTUD<> ctud;
+    ctud.PV = 1000;
+    bench("CTUD", [&](){ ctud.CU = (++count & 1) != 0; ctud.CD = (count & 6) == 6; ctud(); keep(ctud.QU); });
+    CTU_DINT ctuDint;
+    ctuDint.PV = 1000;
+    bench("CTU_DINT", [&](){ ctuDint.CU = (++count & 1) != 0; ctuDint.R = (count & 4095) == 0; ctuDint(); keep(ctuDint.Q); });
+}
+
+static void benchSelection(){
+    int32_t count = 0;
+#define BENCH_COMPARE(NAME) { \
+    NAME<int32_t> block; \
+    bench(#NAME, [&](){ block.IN1 = ++count; block.IN2 = count ^ 5; block(); keep(block.OUT); }); \
+}
+    BENCH_COMPARE(EQ)
+    BENCH_COMPARE(NE)
+    BENCH_COMPARE(LT)
+    BENCH_COMPARE(GT)
+    BENCH_COMPARE(GE)
+    BENCH_COMPARE(LE)
+    BENCH_COMPARE(MIN)
+    BENCH_COMPARE(MAX)
+#undef BENCH_COMPARE
+    MOVE<int32_t> move;
+    bench("MOVE", [&](){ move.IN = ++count; move(); keep(move.OUT); });
+    SEL<int32_t> sel;
+    bench("SEL", [&](){ sel.G = (++count & 1) != 0; sel.IN0 = count; sel.IN1 = -count; sel(); keep(sel.OUT); });
+    MUX<int32_t> mux;
+    bench("MUX", [&](){ mux.K = (++count & 1) != 0; mux.IN0 = count; mux.IN1 = -count; mux(); keep(mux.OUT); });
+    LIMIT<int32_t> limit;
+    limit.MN = -100;
+    limit.MX = 100;
+    bench("LIMIT", [&](){ limit.IN = (++count % 301) - 150; limit(); keep(limit.OUT); });
+}
+#pragma endregion
+
+int main(int argc, char* argv[]){
+    for(int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if(arg == "--json"){
+            OPTIONS.json = true;
+        }
+        else if(arg == "--filter" && i + 1 < argc){
+            OPTIONS.filter = argv[++i];
+        }
+        else if(arg == "--time" && i + 1 < argc){
+            OPTIONS.milliseconds = std::atoi(argv[++i]);
+        }
+        else{
+            std::cout << "Usage: " << argv[0] << " [--json] [--filter <name>] [--time <ms per benchmark>]\n";
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+    latchScanTime(std::chrono::steady_clock::now());
+    if(OPTIONS.json){
+        std::printf("[");
+    }
+    benchAddresses();
+    benchReferences();
+    benchTimers();
+    benchLogic();
+    benchCounters();
+    benchSelection();
+    if(OPTIONS.json){
+        std::printf("\n]\n");
+    }
+    return 0;
+}
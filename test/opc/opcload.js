@@ -0,0 +1,474 @@
+// opcload.js
+//
+// Load test of the OPC UA server of a generated PLC. For each number of monitored items it builds a PLC whose only
+// program echoes an input word to an output word for every item, starts it, and measures its scan time while it is
+// idle. It then opens a number of client sessions, which subscribe to every output between them, while some of them
+// hammer reads and others write the inputs. Since the program echoes each write, the time from a write to the
+// notification of its echo is the notification latency a SCADA client sees. Each run reports the server's CPU use,
+// notifications/s, the notification latency, the rate and latency of reads and writes, and the scan time with and
+// without the load. The results are written as JSON.
+//
+//   node test/opc/opcload.js [--items 100,1000,10000] [--sessions 10] [--readers 2] [--writers 2] [--read-batch 100]
+//                            [--publishing 100] [--sampling 50] [--interval 10] [--opcua-update 0]
+//                            [--baseline 3000] [--warmup 2000] [--duration 10000] [--profile release]
+//                            [--endpoint opc.tcp://host:4840 [--pid <pid>]] [--out results.json]
+//
+// With --endpoint, the harness loads a PLC that is already running instead of building one; it must have been built
+// from the program this writes for the same number of items. Its CPU is only measured if --pid is given, and only on
+// Linux.
+
+const fs = require("fs");
+const os = require("os");
+const path = require("path");
+const { spawn, execFileSync } = require("child_process");
+const {
+    OPCUAClient,
+    AttributeIds,
+    ClientMonitoredItemGroup,
+    DataType,
+    StatusCodes,
+    TimestampsToReturn
+} = require("node-opcua");
+
+const outputRoot = path.join(__dirname, "output", "load");
+// The items are subscribed to in groups of this many, to keep each CreateMonitoredItems request within the server's limits.
+const MONITOR_CHUNK = 500;
+
+function parseArgs(argv) {
+    const args = {};
+    for (let i = 0; i < argv.length; i++) {
+        if (argv[i].startsWith("--")) {
+            args[argv[i].substring(2)] = argv[i + 1] !== undefined && !argv[i + 1].startsWith("--") ? argv[++i] : true;
+        }
+    }
+    return args;
+}
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+/**
+ * Gets a percentile of a list of numbers.
+ * @param {number[]} values The values, which are sorted in place.
+ * @param {number} percent The percentile.
+ * @returns {number} Returns the value, or 0 if there are none.
+ */
+function percentile(values, percent) {
+    if (values.length === 0) {
+        return 0;
+    }
+    values.sort((a, b) => a - b);
+    return values[Math.min(values.length - 1, Math.ceil((values.length * percent) / 100) - 1)];
+}
+
+/**
+ * Writes the program the load is run against: every item is a located input word, In<i>, that the program copies to
+ * a located output word, Out<i>. Both are published by the OPC UA server under their names.
+ * @param {number} items The number of items.
+ * @param {number} interval The interval of the task, in milliseconds.
+ * @returns {string} Returns the ST of the program.
+ */
+function loadProgram(items, interval) {
+    let st = `//Task={"Name":"LoadTask", "Interval":"${interval}", "Priority":"1"}\n`;
+    st += `//Instance={"TypeName":"OPCLoad", "Name":"OPCLoad-Instance", "AssociatedTaskName":"LoadTask"}\n`;
+    for (let i = 0; i < items; i++) {
+        st += `//Global={"Name":"In${i}", "Address":"%IW${i}"}\n//Global={"Name":"Out${i}", "Address":"%QW${i}"}\n`;
+    }
+    st += "PROGRAM OPCLoad\n";
+    for (let i = 0; i < items; i++) {
+        st += `  %QW${i} := %IW${i};\n`;
+    }
+    return st + "END_PROGRAM\n";
+}
+
+/**
+ * Compiles the load program for a number of items into an executable.
+ * @returns {Promise<string>} Returns the path to the executable.
+ */
+async function buildPlc(items, interval, profile) {
+    const { CPPCompiler } = await import("../../src/compilers/CPPCompiler.js");
+    const name = `opcload${items}`;
+    // The sources sit in their own directory, which keeps the toolchain.json the compiler writes beside them.
+    const sourceDir = path.join(outputRoot, "sources");
+    fs.mkdirSync(sourceDir, { recursive: true });
+    const sourcePath = path.join(sourceDir, `${name}.st`);
+    fs.writeFileSync(sourcePath, loadProgram(items, interval));
+    const outputPath = path.join(outputRoot, name);
+    const host = new CPPCompiler({});
+    const target = `${host.getHostOS()}-${host.getHostArch()}`;
+    await new CPPCompiler({ sourcePath, outputPath, target, outputType: "executable", profile }).compile();
+    return path.join(outputPath, target.startsWith("windows") ? `${name}.exe` : name);
+}
+
+/**
+ * Starts a PLC and waits until it reports that it is running.
+ * @returns {Promise<import("child_process").ChildProcess>} Returns the process.
+ */
+function startPlc(exeFile, plcArgs) {
+    return new Promise((resolve, reject) => {
+        const plc = spawn(exeFile, plcArgs, { stdio: ["ignore", "pipe", "inherit"] });
+        let output = "";
+        const onData = (data) => {
+            output += data.toString();
+            if (output.includes("is running!")) {
+                plc.stdout.off("data", onData);
+                // The output is still drained, so the PLC never blocks on a full pipe.
+                plc.stdout.resume();
+                resolve(plc);
+            }
+        };
+        plc.stdout.on("data", onData);
+        plc.on("error", reject);
+        plc.on("exit", (code) => reject(new Error(`${path.basename(exeFile)} exited with ${code}`)));
+    });
+}
+
+// The clock ticks per second that /proc reports CPU time in.
+const CLOCK_TICKS = (() => {
+    try {
+        return parseInt(execFileSync("getconf", ["CLK_TCK"]).toString(), 10) || 100;
+    } catch {
+        return 100;
+    }
+})();
+
+/**
+ * Gets the CPU time a process has used, from /proc on Linux.
+ * @param {number} pid The process.
+ * @returns {number|null} Returns the time in seconds, or null if it can't be read.
+ */
+function processCpuSeconds(pid) {
+    try {
+        const stat = fs.readFileSync(`/proc/${pid}/stat`, "utf-8");
+        // The fields after the command name, which may contain spaces, start with the state; utime and stime follow.
+        const fields = stat.substring(stat.lastIndexOf(")") + 2).split(" ");
+        return (parseInt(fields[11], 10) + parseInt(fields[12], 10)) / CLOCK_TICKS;
+    } catch {
+        return null;
+    }
+}
+
+/**
+ * Connects a client and opens a session, retrying while the server starts.
+ * @returns {Promise<{client: OPCUAClient, session: ClientSession}>}
+ */
+async function openSession(endpoint) {
+    const client = OPCUAClient.create({
+        endpointMustExist: false,
+        connectionStrategy: { maxRetry: 20, initialDelay: 250, maxDelay: 1000 }
+    });
+    await client.connect(endpoint);
+    const session = await client.createSession();
+    return { client, session };
+}
+
+async function closeSession({ client, session }) {
+    try {
+        await session.close();
+    } catch {
+        // The session is gone with the connection either way.
+    }
+    await client.disconnect();
+}
+
+/**
+ * Takes a snapshot of the PLC's scan statistics, which the OPC UA server publishes under Statistics.Scan, and of the
+ * CPU time of its process.
+ */
+async function sampleServer(session, pid) {
+    const fields = ["Count", "Average", "Maximum", "Histogram"];
+    const values = await session.read(fields.map((field) => ({
+        nodeId: `ns=1;s=Statistics.Scan.${field}`,
+        attributeId: AttributeIds.Value
+    })));
+    const number = (value) => Number(Array.isArray(value) ? (value[0] * 2 ** 32 + value[1]) : value);
+    const histogram = Array.from(values[3].value.value || [], number);
+    return {
+        time: process.hrtime.bigint(),
+        cpu: pid ? processCpuSeconds(pid) : null,
+        count: number(values[0].value.value),
+        average: number(values[1].value.value),
+        maximum: number(values[2].value.value),
+        histogram
+    };
+}
+
+/**
+ * Summarises the scans run between two snapshots. The mean is rebuilt from the averages, so it is within a
+ * microsecond, and the percentiles are the power of two bounds of the runtime's histogram.
+ */
+function summariseServer(before, after) {
+    const seconds = Number(after.time - before.time) / 1e9;
+    const scans = after.count - before.count;
+    const buckets = after.histogram.map((count, x) => count - (before.histogram[x] || 0));
+    const bound = (percent) => {
+        const rank = Math.ceil((scans * percent) / 100);
+        let seen = 0;
+        for (let x = 0; x < buckets.length; x++) {
+            seen += buckets[x];
+            if (seen >= rank) {
+                return x === 0 ? 1 : 2 ** x;
+            }
+        }
+        return 0;
+    };
+    return {
+        seconds,
+        scansPerSecond: scans / seconds,
+        scanMicros: {
+            mean: scans > 0 ? (after.average * after.count - before.average * before.count) / scans : 0,
+            p50: scans > 0 ? bound(50) : 0,
+            p99: scans > 0 ? bound(99) : 0,
+            maximum: after.maximum
+        },
+        cpuPercent: before.cpu !== null && after.cpu !== null ? ((after.cpu - before.cpu) / seconds) * 100 : null
+    };
+}
+
+/**
+ * Subscribes a session to a set of outputs.
+ * @param {Function} onChange Called with the index of the item and its value for every notification.
+ */
+async function subscribe(session, indexes, options, onChange) {
+    const subscription = await session.createSubscription2({
+        requestedPublishingInterval: options.publishing,
+        requestedLifetimeCount: 600,
+        requestedMaxKeepAliveCount: 20,
+        maxNotificationsPerPublish: 0,
+        publishingEnabled: true,
+        priority: 1
+    });
+    for (let start = 0; start < indexes.length; start += MONITOR_CHUNK) {
+        const chunk = indexes.slice(start, start + MONITOR_CHUNK);
+        const group = ClientMonitoredItemGroup.create(subscription,
+            chunk.map((i) => ({ nodeId: `ns=1;s=Out${i}`, attributeId: AttributeIds.Value })),
+            { samplingInterval: options.sampling, discardOldest: true, queueSize: 10 },
+            TimestampsToReturn.Neither);
+        group.on("changed", (item, dataValue, index) => onChange(chunk[index], dataValue.value.value));
+        await new Promise((resolve, reject) => {
+            group.once("initialized", resolve);
+            group.once("err", (message) => reject(new Error(message)));
+        });
+    }
+    return subscription;
+}
+
+/**
+ * Runs the load for one number of items against a running server.
+ */
+async function runLoad(endpoint, pid, items, options) {
+    const probe = await openSession(endpoint);
+    await sleep(options.warmup);
+    const idleBefore = await sampleServer(probe.session, pid);
+    await sleep(options.baseline);
+    const idle = summariseServer(idleBefore, await sampleServer(probe.session, pid));
+
+    const sessionCount = Math.max(1, options.sessions);
+    const sessions = [];
+    const connectStart = Date.now();
+    for (let s = 0; s < sessionCount; s++) {
+        sessions.push(await openSession(endpoint));
+    }
+    const connectMillis = Date.now() - connectStart;
+
+    // A write is pending until the notification of its echo arrives, or another write to the item replaces it.
+    const pending = new Map();
+    const counters = { notifications: 0, echoes: 0, reads: 0, readValues: 0, writes: 0, errors: 0 };
+    const latencies = { notification: [], read: [], write: [] };
+    let measuring = false;
+    const onChange = (index, value) => {
+        counters.notifications += measuring ? 1 : 0;
+        const write = pending.get(index);
+        if (write !== undefined && write.value === value) {
+            pending.delete(index);
+            if (measuring) {
+                counters.echoes++;
+                latencies.notification.push(Number(process.hrtime.bigint() - write.time) / 1e6);
+            }
+        }
+    };
+    const subscribeStart = Date.now();
+    const subscriptions = await Promise.all(sessions.map(({ session }, s) => {
+        const indexes = [];
+        for (let i = s; i < items; i += sessionCount) {
+            indexes.push(i);
+        }
+        return indexes.length > 0 ? subscribe(session, indexes, options, onChange) : null;
+    }));
+    const subscribeMillis = Date.now() - subscribeStart;
+
+    let running = true;
+    const reader = async (session, r) => {
+        let next = r * options.readBatch;
+        while (running) {
+            const nodes = [];
+            for (let n = 0; n < Math.min(options.readBatch, items); n++, next++) {
+                nodes.push({ nodeId: `ns=1;s=Out${next % items}`, attributeId: AttributeIds.Value });
+            }
+            const start = process.hrtime.bigint();
+            try {
+                const values = await session.read(nodes);
+                if (measuring) {
+                    counters.reads++;
+                    counters.readValues += values.filter((v) => v.statusCode === StatusCodes.Good).length;
+                    latencies.read.push(Number(process.hrtime.bigint() - start) / 1e6);
+                }
+            } catch {
+                counters.errors += measuring ? 1 : 0;
+            }
+        }
+    };
+    const writer = async (session, w) => {
+        // The writers take turns over the items, and each write changes the item's value.
+        let seq = 0;
+        for (let i = w; running; i += options.writers) {
+            const index = i % items;
+            const value = (++seq * 7 + index) & 0xffff;
+            const start = process.hrtime.bigint();
+            pending.set(index, { value, time: start });
+            try {
+                const status = await session.write({
+                    nodeId: `ns=1;s=In${index}`,
+                    attributeId: AttributeIds.Value,
+                    value: { value: { dataType: DataType.UInt16, value } }
+                });
+                if (measuring) {
+                    counters.writes++;
+                    counters.errors += status === StatusCodes.Good ? 0 : 1;
+                    latencies.write.push(Number(process.hrtime.bigint() - start) / 1e6);
+                }
+            } catch {
+                counters.errors += measuring ? 1 : 0;
+            }
+        }
+    };
+    const workers = [];
+    for (let r = 0; r < options.readers; r++) {
+        workers.push(reader(sessions[r % sessionCount].session, r));
+    }
+    for (let w = 0; w < options.writers; w++) {
+        workers.push(writer(sessions[(options.readers + w) % sessionCount].session, w));
+    }
+
+    await sleep(options.warmup);
+    const harnessBefore = process.cpuUsage();
+    const loadBefore = await sampleServer(probe.session, pid);
+    measuring = true;
+    await sleep(options.duration);
+    measuring = false;
+    const loaded = summariseServer(loadBefore, await sampleServer(probe.session, pid));
+    const harness = process.cpuUsage(harnessBefore);
+    running = false;
+    await Promise.all(workers);
+    await Promise.all(subscriptions.filter((s) => s !== null).map((s) => s.terminate().catch(() => {})));
+    await Promise.all(sessions.map(closeSession));
+    await closeSession(probe);
+
+    const seconds = loaded.seconds;
+    const millis = (values) => ({ p50: percentile(values, 50), p99: percentile(values, 99) });
+    return {
+        items,
+        sessions: sessionCount,
+        readers: options.readers,
+        writers: options.writers,
+        readBatch: options.readBatch,
+        publishingMillis: options.publishing,
+        samplingMillis: options.sampling,
+        connectMillis,
+        subscribeMillis,
+        seconds,
+        serverCpuPercent: loaded.cpuPercent,
+        idleServerCpuPercent: idle.cpuPercent,
+        // When this approaches 100, the harness rather than the server limits the load.
+        harnessCpuPercent: ((harness.user + harness.system) / 1e6 / seconds) * 100,
+        notificationsPerSecond: counters.notifications / seconds,
+        echoes: counters.echoes,
+        notificationLatencyMillis: millis(latencies.notification),
+        readsPerSecond: counters.reads / seconds,
+        readValuesPerSecond: counters.readValues / seconds,
+        readLatencyMillis: millis(latencies.read),
+        writesPerSecond: counters.writes / seconds,
+        writeLatencyMillis: millis(latencies.write),
+        errors: counters.errors,
+        scan: {
+            idle: idle.scanMicros,
+            loaded: loaded.scanMicros,
+            idleScansPerSecond: idle.scansPerSecond,
+            loadedScansPerSecond: loaded.scansPerSecond
+        }
+    };
+}
+
+async function runLoadTests() {
+    const args = parseArgs(process.argv.slice(2));
+    const number = (name, fallback) => (typeof args[name] === "string" ? parseInt(args[name], 10) : fallback);
+    const options = {
+        sessions: number("sessions", 10),
+        readers: number("readers", 2),
+        writers: number("writers", 2),
+        readBatch: number("read-batch", 100),
+        publishing: number("publishing", 100),
+        sampling: number("sampling", 50),
+        baseline: number("baseline", 3000),
+        warmup: number("warmup", 2000),
+        duration: number("duration", 10000)
+    };
+    const interval = number("interval", 10);
+    const opcuaUpdate = number("opcua-update", 0);
+    const profile = typeof args.profile === "string" ? args.profile : "release";
+    const sizes = (typeof args.items === "string" ? args.items : "100,1000,10000").split(",").map((s) => parseInt(s, 10));
+    fs.mkdirSync(outputRoot, { recursive: true });
+
+    const report = {
+        date: new Date().toISOString(),
+        host: `${os.platform()}-${os.arch()}`,
+        cpu: os.cpus()[0]?.model,
+        profile,
+        taskMillis: interval,
+        opcuaUpdateMillis: opcuaUpdate,
+        runs: []
+    };
+    console.log(`${"items".padStart(6)} ${"cpu %".padStart(6)} ${"notify/s".padStart(9)} ${"p50 ms".padStart(7)} ${"p99 ms".padStart(7)} ` +
+        `${"reads/s".padStart(8)} ${"writes/s".padStart(8)} ${"scan us".padStart(8)} ${"idle us".padStart(8)} errors`);
+    for (const items of sizes) {
+        let plc = null;
+        try {
+            let endpoint = typeof args.endpoint === "string" ? args.endpoint : null;
+            let pid = typeof args.pid === "string" ? parseInt(args.pid, 10) : null;
+            if (endpoint === null) {
+                const exeFile = await buildPlc(items, interval, profile);
+                const plcArgs = opcuaUpdate > 0 ? ["--opcua-update", String(opcuaUpdate)] : [];
+                plc = await startPlc(exeFile, plcArgs);
+                plc.removeAllListeners("exit");
+                endpoint = "opc.tcp://localhost:4840";
+                pid = plc.pid;
+            }
+            const run = await runLoad(endpoint, pid, items, options);
+            report.runs.push(run);
+            const cpu = run.serverCpuPercent === null ? "-" : run.serverCpuPercent.toFixed(0);
+            console.log(`${String(items).padStart(6)} ${cpu.padStart(6)} ${run.notificationsPerSecond.toFixed(0).padStart(9)} ` +
+                `${run.notificationLatencyMillis.p50.toFixed(1).padStart(7)} ${run.notificationLatencyMillis.p99.toFixed(1).padStart(7)} ` +
+                `${run.readsPerSecond.toFixed(0).padStart(8)} ${run.writesPerSecond.toFixed(0).padStart(8)} ` +
+                `${run.scan.loaded.mean.toFixed(0).padStart(8)} ${run.scan.idle.mean.toFixed(0).padStart(8)} ${run.errors}`);
+        } catch (err) {
+            report.runs.push({ items, error: err.message });
+            console.error(`❌ ${items} items: ${err.message}`);
+            process.exitCode = 1;
+        } finally {
+            if (plc !== null) {
+                // The next PLC listens on the same port, so this one has to be gone first.
+                const exited = new Promise((resolve) => plc.once("exit", resolve));
+                plc.kill();
+                await exited;
+            }
+        }
+    }
+
+    const out = typeof args.out === "string" ? args.out : path.join(outputRoot, "results.json");
+    fs.writeFileSync(out, JSON.stringify(report, null, 2));
+    console.log(`Results written to ${out}`);
+}
+
+runLoadTests().catch((err) => {
+    console.error(err);
+    process.exitCode = 1;
+});
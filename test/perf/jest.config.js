@@ -0,0 +1,15 @@
+// jest.config.js
+//
+// The configuration of the performance tier, which only runs the tests in test/perf and gives them time to build and
+// run the benchmarks.
+
+import config from '../../jest.config.js';
+
+/** @type {import('jest').Config} */
+export default {
+  ...config,
+  rootDir: '../..',
+  testMatch: ['<rootDir>/test/perf/**/*.test.js'],
+  testPathIgnorePatterns: ['/node_modules/'],
+  testTimeout: 30 * 60 * 1000
+};
@@ -0,0 +1,171 @@
+// perf.test.js
+//
+// The performance tier of the test suite. It runs the scan and Modbus benchmarks and times the compiler, and fails
+// if a measurement is worse than the baseline recorded for the host's target by more than the measurement's
+// tolerance. The baselines are kept in test/perf/baselines/<target>.json, and a target without one is skipped.
+//
+//   npm run test_perf
+//   NODALIS_PERF_UPDATE=1 npm run test_perf     records the measurements as the target's baseline
+
+import fs from 'fs';
+import os from 'os';
+import path from 'path';
+import { execFileSync } from 'child_process';
+import { fileURLToPath } from 'url';
+import { CPPCompiler } from '../../src/compilers/CPPCompiler.js';
+
+const __filename = fileURLToPath(import.meta.url);
+const __dirname = path.dirname(__filename);
+const benchDir = path.resolve(__dirname, '..', 'bench');
+const outputRoot = path.join(__dirname, 'output');
+const fixture = path.resolve(__dirname, '..', 'st', 'fixtures', 'PLC-1.st');
+const update = ['1', 'true'].includes(process.env.NODALIS_PERF_UPDATE);
+
+/**
+ * The gated measurements, whether a lower or a higher value is better, and the fraction a measurement can be worse
+ * than its baseline by before it is a regression. A baseline can set its own tolerance for a measurement.
+ */
+const METRICS = {
+  'scan.p50Nanos': { better: 'lower', tolerance: 0.25 },
+  'scan.meanNanos': { better: 'lower', tolerance: 0.25 },
+  'startup.nanos': { better: 'lower', tolerance: 0.5 },
+  'modbus.transactionsPerSecond': { better: 'higher', tolerance: 0.25 },
+  'compile.transpileMillis': { better: 'lower', tolerance: 0.5 },
+  'compile.buildMillis': { better: 'lower', tolerance: 0.5 }
+};
+
+/**
+ * The number of times the scan benchmark and the compiler are run. The median of the runs is compared, which keeps
+ * a single slow run from failing the tier.
+ */
+const RUNS = 3;
+
+const host = new CPPCompiler({});
+const target = `${host.getHostOS()}-${host.getHostArch()}`;
+const baselineFile = path.join(__dirname, 'baselines', `${target}.json`);
+const baseline = fs.existsSync(baselineFile) ? JSON.parse(fs.readFileSync(baselineFile, 'utf-8')) : null;
+
+function median(values) {
+  const sorted = [...values].sort((a, b) => a - b);
+  return sorted[Math.floor(sorted.length / 2)];
+}
+
+/**
+ * Runs a benchmark script and reads the results it wrote.
+ * @param {string} script The script in test/bench.
+ * @param {string[]} args The arguments to pass to it.
+ * @returns {object} Returns the results.
+ */
+function runBench(script, args) {
+  const out = path.join(outputRoot, `${path.basename(script, '.js')}.json`);
+  fs.rmSync(out, { force: true });
+  execFileSync(process.execPath, [path.join(benchDir, script), ...args, '--out', out], { stdio: 'ignore' });
+  return JSON.parse(fs.readFileSync(out, 'utf-8'));
+}
+
+/**
+ * Times a compile of the fixture.
+ * @param {string} outputType The output type, code or executable.
+ * @returns {Promise<number>} Returns the milliseconds the compile took.
+ */
+async function timeCompile(outputType) {
+  const outputPath = path.join(outputRoot, 'compile', outputType);
+  const start = process.hrtime.bigint();
+  await new CPPCompiler({ sourcePath: fixture, outputPath, target, outputType, profile: 'release' }).compile();
+  return Number(process.hrtime.bigint() - start) / 1e6;
+}
+
+/**
+ * Takes every measurement.
+ * @returns {Promise<Object<string, number>>} Returns the measurements by name.
+ */
+async function measure() {
+  const scans = [];
+  for (let i = 0; i < RUNS; i++) {
+    const [result] = runBench('benchScan.js', ['--fixtures', fixture, '--sweep', 'none', '--scans', '100000']).fixtures;
+    if (result.error) {
+      throw new Error(`The scan benchmark failed: ${result.error}`);
+    }
+    scans.push(result);
+  }
+  const [modbus] = runBench('benchModbus.js', ['--mappings', '100', '--modes', 'pipelined', '--duration', '1000']).runs;
+  if (modbus.error || modbus.errors > 0) {
+    throw new Error(`The Modbus benchmark failed: ${modbus.error ?? `${modbus.errors} errors`}`);
+  }
+  // A run that never connected has no errors, but a baseline of no transactions would never gate anything.
+  if (!(modbus.transactionsPerSecond > 0)) {
+    throw new Error(`The Modbus benchmark made no transactions, with ${modbus.connected} of ${modbus.clients} clients connected`);
+  }
+
+  // The first builds fill the runtime library and object caches, so the timed ones are the compiles a change to a
+  // program makes.
+  await timeCompile('code');
+  await timeCompile('executable');
+  const transpile = [];
+  const build = [];
+  for (let i = 0; i < RUNS; i++) {
+    transpile.push(await timeCompile('code'));
+    build.push(await timeCompile('executable'));
+  }
+  return {
+    'scan.p50Nanos': median(scans.map((s) => s.scanNanos.p50)),
+    'scan.meanNanos': median(scans.map((s) => s.scanNanos.mean)),
+    'startup.nanos': median(scans.map((s) => s.startupNanos)),
+    'modbus.transactionsPerSecond': modbus.transactionsPerSecond,
+    'compile.transpileMillis': median(transpile),
+    'compile.buildMillis': median(build)
+  };
+}
+
+/**
+ * Writes the measurements as the target's baseline, keeping the tolerances of the baseline they replace.
+ * @param {Object<string, number>} measured The measurements.
+ */
+function writeBaseline(measured) {
+  const metrics = {};
+  Object.entries(METRICS).forEach(([name, metric]) => {
+    metrics[name] = { value: measured[name], better: metric.better, tolerance: baseline?.metrics?.[name]?.tolerance ?? metric.tolerance };
+  });
+  fs.mkdirSync(path.dirname(baselineFile), { recursive: true });
+  fs.writeFileSync(baselineFile, JSON.stringify({ target, cpu: os.cpus()[0]?.model, date: new Date().toISOString(), metrics }, null, 2) + '\n');
+}
+
+// The baselines are absolute timings, which only gate the machine they were recorded on (see baselines/README.md).
+if (!baseline && !update) {
+  console.warn(`Skipping the performance tier: there is no baseline for ${target} ` +
+    `(${path.relative(process.cwd(), baselineFile)}). Record one on the machine that gates the tier with NODALIS_PERF_UPDATE=1 npm run test_perf.`);
+}
+const gate = baseline || update ? describe : describe.skip;
+
+gate(`performance on ${target}`, () => {
+  let measured;
+
+  beforeAll(async () => {
+    fs.mkdirSync(outputRoot, { recursive: true });
+    measured = await measure();
+    if (update) {
+      writeBaseline(measured);
+    }
+  });
+
+  test.each(Object.keys(METRICS))('%s', (name) => {
+    if (update) {
+      return;
+    }
+    const recorded = baseline.metrics?.[name];
+    if (!recorded) {
+      console.warn(`Skipping ${name}: the baseline for ${target} doesn't have it. Record it again with NODALIS_PERF_UPDATE=1 npm run test_perf.`);
+      return;
+    }
+    const tolerance = recorded.tolerance ?? METRICS[name].tolerance;
+    const value = measured[name];
+    const change = recorded.value > 0 ? value / recorded.value - 1 : 0;
+    const worse = METRICS[name].better === 'lower' ? change > tolerance : -change > tolerance;
+    console.log(`${name}: ${recorded.value.toFixed(2)} -> ${value.toFixed(2)} (${change >= 0 ? '+' : ''}${(change * 100).toFixed(1)}%)`);
+    if (worse) {
+      throw new Error(`${name} regressed from ${recorded.value.toFixed(2)} to ${value.toFixed(2)}, ` +
+        `${(Math.abs(change) * 100).toFixed(1)}% ${METRICS[name].better === 'lower' ? 'higher' : 'lower'}, ` +
+        `beyond the tolerance of ${(tolerance * 100).toFixed(0)}%`);
+    }
+  });
+});